@@ -0,0 +1,137 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/allocation_event_tracer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <new>
+
+#include "absl/base/internal/spinlock.h"
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/selsan/selsan.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+uint32_t Saturate(uint64_t n) {
+  return static_cast<uint32_t>(
+      std::min<uint64_t>(n, std::numeric_limits<uint32_t>::max()));
+}
+
+}  // namespace
+
+bool AllocationEventTracer::Start() {
+  absl::base_internal::SpinLockHolder l(&drain_lock_);
+  if (active()) {
+    return false;
+  }
+  if (shards_ == nullptr) {
+    const int num_shards = NumCPUs();
+    PageHeapSpinLockHolder h;
+    Shard* shards = static_cast<Shard*>(tc_globals.arena().Alloc(
+        num_shards * sizeof(Shard), std::align_val_t(alignof(Shard))));
+    for (int i = 0; i < num_shards; ++i) {
+      new (&shards[i]) Shard();
+    }
+    // One more than a shard holds, for the kDropped event.
+    drain_buffer_ = static_cast<Event*>(
+        tc_globals.arena().Alloc((kShardEvents + 1) * sizeof(Event),
+                                 std::align_val_t(alignof(Event))));
+    num_shards_ = num_shards;
+    shards_ = shards;
+  }
+  active_.store(true, std::memory_order_release);
+  return true;
+}
+
+void AllocationEventTracer::Stop() {
+  absl::base_internal::SpinLockHolder l(&drain_lock_);
+  active_.store(false, std::memory_order_relaxed);
+}
+
+void AllocationEventTracer::Record(EventKind kind, const void* ptr,
+                                   size_t size) {
+  // Pairs with the release in Start, so that shards_ is set.
+  if (!active_.load(std::memory_order_acquire)) {
+    return;
+  }
+  // The thread may be migrated right after this; its event then lands in the
+  // buffer of the CPU it came from, which is still correct, if less local.
+  const int cpu = subtle::percpu::GetRealCpu();
+  Shard& shard = shards_[static_cast<unsigned>(cpu) % num_shards_];
+  if (!shard.lock.TryLock()) {
+    shard.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (shard.size == kShardEvents) {
+    shard.lock.Unlock();
+    shard.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  shard.events[shard.size++] = {
+      .address = reinterpret_cast<uintptr_t>(selsan::RemoveTag(ptr)),
+      .size = Saturate(size),
+      .cpu = static_cast<uint16_t>(cpu),
+      .kind = kind,
+  };
+  shard.lock.Unlock();
+}
+
+size_t AllocationEventTracer::Drain(
+    absl::FunctionRef<void(absl::Span<const Event>)> callback) {
+  // Not an AllocationGuardSpinLockHolder: the callback may allocate.
+  absl::base_internal::SpinLockHolder l(&drain_lock_);
+  size_t drained = 0;
+  for (int i = 0; i < num_shards_; ++i) {
+    Shard& shard = shards_[i];
+    size_t n;
+    {
+      AllocationGuardSpinLockHolder h(&shard.lock);
+      n = shard.size;
+      std::copy_n(shard.events, n, drain_buffer_);
+      shard.size = 0;
+    }
+    if (const uint64_t dropped =
+            shard.dropped.exchange(0, std::memory_order_relaxed);
+        dropped != 0) {
+      drain_buffer_[n++] = {
+          .size = Saturate(dropped),
+          .cpu = static_cast<uint16_t>(i),
+          .kind = EventKind::kDropped,
+      };
+    }
+    if (n == 0) {
+      continue;
+    }
+    callback(absl::MakeConstSpan(drain_buffer_, n));
+    drained += n;
+  }
+  return drained;
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,108 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_ALLOCATION_EVENT_TRACER_H_
+#define TCMALLOC_ALLOCATION_EVENT_TRACER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/malloc_tracing_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// AllocationEventTracer records allocations and frees as compact events in a
+// buffer per CPU, for a consumer thread to drain in batches.  It stands in for
+// allocation hooks, which send every call down the slow paths: while tracing
+// is off, the fast paths pay a single relaxed load, and while it is on they
+// append to the buffer of the CPU they run on.
+//
+// Appending takes the buffer's lock with TryLock, so that a consumer draining
+// the buffer, or a signal handler allocating on the same thread, never makes
+// an allocation wait.  Events that find the lock taken or the buffer full are
+// counted and reported as a kDropped event at the next drain.
+class AllocationEventTracer {
+ public:
+  using Event = malloc_tracing_extension::AllocationEvent;
+  using EventKind = malloc_tracing_extension::AllocationEventKind;
+
+  // Events buffered per CPU between drains.
+  static constexpr size_t kShardEvents = 512;
+
+  constexpr AllocationEventTracer() = default;
+
+  bool active() const { return active_.load(std::memory_order_relaxed); }
+
+  // Starts recording, allocating the buffers from the arena on the first call.
+  // Returns false if tracing is already on.
+  bool Start();
+
+  // Stops recording.  Events buffered so far may still be drained.
+  void Stop();
+
+  void RecordNew(const void* ptr, size_t size) {
+    Record(EventKind::kNew, ptr, size);
+  }
+
+  // `size` is the capacity of the object freed.
+  void RecordDelete(const void* ptr, size_t size) {
+    Record(EventKind::kDelete, ptr, size);
+  }
+
+  // Moves the events buffered so far out of each CPU's buffer and passes them
+  // to `callback`, a CPU at a time, without any buffer's lock held.  Returns
+  // the number of events passed, including kDropped ones.
+  size_t Drain(absl::FunctionRef<void(absl::Span<const Event>)> callback)
+      ABSL_LOCKS_EXCLUDED(drain_lock_);
+
+ private:
+  struct ABSL_CACHELINE_ALIGNED Shard {
+    absl::base_internal::SpinLock lock{
+        absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+    size_t size ABSL_GUARDED_BY(lock) = 0;
+    // Events lost since the last drain.  Updated without the lock, when it
+    // could not be taken.
+    std::atomic<uint64_t> dropped{0};
+    Event events[kShardEvents] ABSL_GUARDED_BY(lock);
+  };
+
+  ABSL_ATTRIBUTE_NOINLINE void Record(EventKind kind, const void* ptr,
+                                      size_t size);
+
+  std::atomic<bool> active_{false};
+  // Set once, by the first Start, before active_ is.
+  Shard* shards_ = nullptr;
+  int num_shards_ = 0;
+
+  // Serializes Start, Stop and Drain.  Drains share drain_buffer_.
+  absl::base_internal::SpinLock drain_lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  Event* drain_buffer_ ABSL_GUARDED_BY(drain_lock_) = nullptr;
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_ALLOCATION_EVENT_TRACER_H_
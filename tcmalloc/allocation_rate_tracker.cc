@@ -0,0 +1,49 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/allocation_rate_tracker.h"
+
+#include <cmath>
+#include <memory>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/stack_trace_table.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+std::unique_ptr<ProfileBase> AllocationRateTracker::DumpSample(
+    absl::Time now) {
+  auto profile =
+      std::make_unique<StackTraceTable>(ProfileType::kAllocationRate);
+  profile->SetDuration(kDecay);
+
+  Iterate(now, [&](const StackTrace& t, double rate) {
+    // Reweight the sample so that it stands for one second's worth of
+    // allocations at the current rate.
+    StackTrace rated = t;
+    rated.weight = std::lround(rate);
+    if (rated.weight == 0) {
+      return;
+    }
+    profile->AddTrace(1.0, rated);
+  });
+  return profile;
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,139 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_ALLOCATION_RATE_TRACKER_H_
+#define TCMALLOC_ALLOCATION_RATE_TRACKER_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/hash/hash.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// AllocationRateTracker estimates how fast each allocation stack allocates,
+// from the sampled allocations alone.  Every sample stands for its weight in
+// bytes, so the rate of a stack is an exponentially decaying sum of the
+// weights of its samples.
+//
+// Like CallsiteLifetimes, it is a small table indexed by the hash of the
+// stack.  A stack that finds no room among the slots it probes replaces the
+// one with the lowest current rate, so the table keeps the heaviest
+// allocators.
+class AllocationRateTracker {
+ public:
+  static constexpr size_t kSize = 128;
+  static constexpr size_t kProbes = 8;
+  // The time constant of the decay.  A sample's contribution to the rate of
+  // its stack falls by a factor of e every kDecay.
+  static constexpr absl::Duration kDecay = absl::Seconds(30);
+
+  constexpr AllocationRateTracker() = default;
+
+  // Accounts for the sampled allocation `t`, which stands for `t.weight`
+  // bytes allocated at `t.allocation_time`.
+  void RecordAllocation(const StackTrace& t) ABSL_LOCKS_EXCLUDED(lock_) {
+    const size_t hash =
+        std::max<size_t>(absl::HashOf(absl::MakeConstSpan(t.stack, t.depth)),
+                         1);
+    const absl::Time now = t.allocation_time;
+
+    AllocationGuardSpinLockHolder h(&lock_);
+    Slot* slot = nullptr;
+    double lowest = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < kProbes; ++i) {
+      Slot& candidate = slots_[(hash + i) % kSize];
+      if (candidate.hash == hash) {
+        slot = &candidate;
+        break;
+      }
+      const double rate = candidate.hash == 0 ? -1 : Rate(candidate, now);
+      if (rate < lowest) {
+        slot = &candidate;
+        lowest = rate;
+      }
+    }
+    TC_ASSERT_NE(slot, nullptr);
+
+    if (slot->hash != hash) {
+      slot->hash = hash;
+      slot->rate = 0;
+      slot->updated = now;
+    }
+    slot->rate = Rate(*slot, now) + t.weight / absl::ToDoubleSeconds(kDecay);
+    slot->updated = std::max(slot->updated, now);
+    slot->trace = t;
+  }
+
+  // Calls `f` on the most recent sample of every tracked stack, along with
+  // the stack's allocation rate as of `now`, in bytes per second.  `f` runs
+  // under the tracker's lock and must not allocate from it.
+  void Iterate(absl::Time now,
+               absl::FunctionRef<void(const StackTrace&, double)> f)
+      ABSL_LOCKS_EXCLUDED(lock_) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    for (const Slot& slot : slots_) {
+      if (slot.hash != 0) {
+        f(slot.trace, Rate(slot, now));
+      }
+    }
+  }
+
+  // Returns the allocation rate of every tracked stack as of `now`.  Sample
+  // sums are in bytes per second and counts in objects per second.
+  std::unique_ptr<ProfileBase> DumpSample(absl::Time now)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  struct Slot {
+    size_t hash = 0;
+    // Bytes per second allocated from this stack, as of `updated`.
+    double rate = 0;
+    absl::Time updated;
+    // The most recent sample from this stack.
+    StackTrace trace = {};
+  };
+
+  // Returns the rate of `slot` decayed to `now`.  Samples may be recorded
+  // slightly out of order, so a `now` before the last update does not decay.
+  static double Rate(const Slot& slot, absl::Time now) {
+    const double elapsed =
+        std::max(absl::ToDoubleSeconds(now - slot.updated), 0.0);
+    return slot.rate * std::exp(-elapsed / absl::ToDoubleSeconds(kDecay));
+  }
+
+  absl::base_internal::SpinLock lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  Slot slots_[kSize] ABSL_GUARDED_BY(lock_);
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_ALLOCATION_RATE_TRACKER_H_
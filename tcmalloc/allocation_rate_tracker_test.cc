@@ -0,0 +1,103 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/allocation_rate_tracker.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmath>
+#include <memory>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/logging.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+StackTrace Sample(uintptr_t pc, size_t weight, absl::Time time) {
+  StackTrace t = {};
+  t.depth = 1;
+  t.stack[0] = reinterpret_cast<void*>(pc);
+  t.requested_size = 16;
+  t.allocated_size = 16;
+  t.weight = weight;
+  t.allocation_time = time;
+  return t;
+}
+
+absl::flat_hash_map<uintptr_t, double> Rates(AllocationRateTracker& tracker,
+                                             absl::Time now) {
+  absl::flat_hash_map<uintptr_t, double> rates;
+  tracker.Iterate(now, [&](const StackTrace& t, double rate) {
+    rates[reinterpret_cast<uintptr_t>(t.stack[0])] = rate;
+  });
+  return rates;
+}
+
+TEST(AllocationRateTrackerTest, SteadyRate) {
+  auto tracker = std::make_unique<AllocationRateTracker>();
+  const absl::Time start = absl::UnixEpoch();
+  const double decay = absl::ToDoubleSeconds(AllocationRateTracker::kDecay);
+
+  // One stack allocates 1 MiB every second, another 1 KiB.  After many time
+  // constants the estimates settle close to the true rates.
+  const int kSeconds = 20 * decay;
+  for (int i = 1; i <= kSeconds; ++i) {
+    const absl::Time now = start + absl::Seconds(i);
+    tracker->RecordAllocation(Sample(1, 1 << 20, now));
+    tracker->RecordAllocation(Sample(2, 1 << 10, now));
+  }
+
+  const auto rates = Rates(*tracker, start + absl::Seconds(kSeconds));
+  ASSERT_EQ(rates.size(), 2);
+  EXPECT_NEAR(rates.at(1), 1 << 20, 0.02 * (1 << 20));
+  EXPECT_NEAR(rates.at(2), 1 << 10, 0.02 * (1 << 10));
+}
+
+TEST(AllocationRateTrackerTest, Decays) {
+  auto tracker = std::make_unique<AllocationRateTracker>();
+  const absl::Time start = absl::UnixEpoch();
+  tracker->RecordAllocation(Sample(1, 1000, start));
+
+  const double initial = Rates(*tracker, start).at(1);
+  EXPECT_GT(initial, 0);
+  // Samples recorded out of order do not inflate the rate.
+  EXPECT_DOUBLE_EQ(Rates(*tracker, start - absl::Seconds(1)).at(1), initial);
+  EXPECT_NEAR(Rates(*tracker, start + AllocationRateTracker::kDecay).at(1),
+              initial / M_E, 1e-6 * initial);
+}
+
+TEST(AllocationRateTrackerTest, EvictsSlowestStack) {
+  auto tracker = std::make_unique<AllocationRateTracker>();
+  const absl::Time now = absl::UnixEpoch();
+
+  // Far more stacks than slots: the table fills up and, once full, keeps the
+  // stacks allocating the most.
+  const size_t kStacks = 16 * AllocationRateTracker::kSize;
+  for (uintptr_t pc = 1; pc <= kStacks; ++pc) {
+    tracker->RecordAllocation(Sample(pc, pc, now));
+  }
+
+  const auto rates = Rates(*tracker, now);
+  EXPECT_EQ(rates.size(), AllocationRateTracker::kSize);
+  EXPECT_TRUE(rates.contains(kStacks));
+  EXPECT_FALSE(rates.contains(1));
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
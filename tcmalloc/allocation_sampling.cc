@@ -14,15 +14,16 @@
 
 #include "tcmalloc/allocation_sampling.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <optional>
-#include <utility>
 
 #include "absl/base/attributes.h"
+#include "absl/base/call_once.h"
 #include "absl/base/optimization.h"
 #include "absl/debugging/stacktrace.h"
 #include "absl/time/clock.h"
@@ -30,9 +31,13 @@
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/freed_sample_log.h"
 #include "tcmalloc/guarded_allocations.h"
+#include "tcmalloc/huge_page_filler.h"
+#include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/exponential_biased.h"
+#include "tcmalloc/internal/frame_pointer_unwinder.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/malloc_extension.h"
@@ -40,6 +45,7 @@
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/span_recycler.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/tcmalloc_policy.h"
 #include "tcmalloc/thread_cache.h"
@@ -47,13 +53,47 @@
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc::tcmalloc_internal {
 
-std::unique_ptr<const ProfileBase> DumpFragmentationProfile(Static& state) {
-  auto profile = std::make_unique<StackTraceTable>(ProfileType::kFragmentation);
+ABSL_CONST_INIT thread_local int ThreadAllocationLabel::label_
+    ABSL_ATTRIBUTE_INITIAL_EXEC = 0;
+
+namespace {
+
+// The estimated live bytes a sample adds to its label.  Computed the same way
+// on allocation and free, so that the two cancel out.
+int64_t SampledLabelBytes(const SampleDetails& details) {
+  return static_cast<int64_t>(AllocatedBytes(details) + 0.5);
+}
+
+// Returns the bytes of free, still backed pages on the hugepage holding the end
+// of `span` that are charged to `span`.  The waste on a hugepage is split among
+// its used pages, so each span pays in proportion to the pages it allocated
+// there.  Spans that the HugePageFiller does not track are charged nothing.
+double HugePageWaste(Static& state, const Span& span)
+    ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+  const HugePage hp = HugePageContaining(span.last_page());
+  const Length here = std::min(span.num_pages(),
+                               span.last_page() - hp.first_page() + Length(1));
+
+  PageHeapSpinLockHolder l;
+  const PageTracker* pt = reinterpret_cast<const PageTracker*>(
+      state.pagemap().GetHugepage(hp.first_page()));
+  if (pt == nullptr || pt->used_pages() == Length(0)) {
+    return 0;
+  }
+  const Length waste = pt->free_pages() - pt->released_pages();
+  return static_cast<double>(waste.in_bytes()) * here.raw_num() /
+         pt->used_pages().raw_num();
+}
+
+std::unique_ptr<const ProfileBase> DumpFragmentationProfile(Static& state,
+                                                            ProfileType type) {
+  const bool precise = type == ProfileType::kPreciseFragmentation;
+  auto profile = std::make_unique<StackTraceTable>(type);
   state.sampled_allocation_recorder().Iterate(
-      [&state, &profile](const SampledAllocation& sampled_allocation) {
+      [&](const SampledAllocation& sampled_allocation) {
         // Compute fragmentation to charge to this sample:
-        const StackTrace& t = sampled_allocation.sampled_stack;
-        if (t.proxy == nullptr) {
+        const SampleDetails& t = sampled_allocation.details;
+        if (t.proxy == nullptr && !precise) {
           // There is just one object per-span, and neighboring spans
           // can be released back to the system, so we charge no
           // fragmentation to this sampled object.
@@ -61,8 +101,9 @@ std::unique_ptr<const ProfileBase> DumpFragmentationProfile(Static& state) {
         }
 
         // Fetch the span on which the proxy lives so we can examine its
-        // co-residents.
-        const PageId p = PageIdContaining(t.proxy);
+        // co-residents.  Large objects have a span to themselves.
+        const PageId p = PageIdContaining(
+            t.proxy != nullptr ? t.proxy : t.span_start_address);
         Span* span = state.pagemap().GetDescriptor(p);
         if (span == nullptr) {
           // Avoid crashes in production mode code, but report in tests.
@@ -70,23 +111,97 @@ std::unique_ptr<const ProfileBase> DumpFragmentationProfile(Static& state) {
           return;
         }
 
-        const double frag = span->Fragmentation(t.allocated_size);
+        double frag = 0;
+        size_t live = 1;
+        if (t.proxy != nullptr) {
+          frag = span->Fragmentation(t.allocated_size);
+          live = std::max<size_t>(span->Allocated(), 1);
+        }
+        if (precise) {
+          // The span's share of its hugepage's waste is split evenly among
+          // its live objects, and is expressed in objects of this size like
+          // the span-level fragmentation above.
+          frag += HugePageWaste(state, *span) / live / t.allocated_size;
+        }
         if (frag > 0) {
           // Associate the memory warmth with the actual object, not the proxy.
           // The residency information (t.span_start_address) is likely not very
           // useful, but we might as well pass it along.
-          profile->AddTrace(frag, t);
+          profile->AddTrace(frag, sampled_allocation.stack_trace());
         }
       });
   return profile;
 }
 
+}  // namespace
+
+std::unique_ptr<const ProfileBase> DumpFragmentationProfile(Static& state) {
+  return DumpFragmentationProfile(state, ProfileType::kFragmentation);
+}
+
+std::unique_ptr<const ProfileBase> DumpPreciseFragmentationProfile(
+    Static& state) {
+  return DumpFragmentationProfile(state, ProfileType::kPreciseFragmentation);
+}
+
 std::unique_ptr<const ProfileBase> DumpHeapProfile(Static& state) {
   auto profile = std::make_unique<StackTraceTable>(ProfileType::kHeap);
   state.sampled_allocation_recorder().Iterate(
       [&](const SampledAllocation& sampled_allocation) {
-        profile->AddTrace(1.0, sampled_allocation.sampled_stack);
+        profile->AddTrace(1.0, sampled_allocation.stack_trace());
+      });
+  return profile;
+}
+
+std::unique_ptr<const ProfileBase> DumpHeapProfileDelta(Static& state,
+                                                        AllocHandle& allocated,
+                                                        uint64_t& freed,
+                                                        bool& is_delta) {
+  FreedSampleLog& log = state.freed_samples;
+  ABSL_CONST_INIT static absl::once_flag flag;
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    StackTrace* entries;
+    {
+      PageHeapSpinLockHolder l;
+      entries = static_cast<StackTrace*>(
+          state.arena().Alloc(sizeof(StackTrace) * FreedSampleLog::kCapacity,
+                              kAlignment, ArenaUse::kSampled));
+    }
+    log.Enable(absl::MakeSpan(entries, FreedSampleLog::kCapacity));
+  });
+
+  // Samples freed before this point are gone before the iteration below, so
+  // they are reported now; those freed later are left for the next delta.
+  const uint64_t freed_end = log.recorded();
+  const AllocHandle allocated_end =
+      state.sampled_alloc_handle_generator.load(std::memory_order_relaxed);
+  log.Cover(allocated_end);
+
+  auto profile = std::make_unique<StackTraceTable>(ProfileType::kHeap);
+  // Samples allocated and freed between two deltas were never reported, so
+  // only the frees of earlier ones are.
+  is_delta =
+      allocated != 0 && log.Read(freed, freed_end, [&](const StackTrace& t) {
+        if (t.sampled_alloc_handle <= allocated) {
+          profile->SubtractTrace(1.0, t);
+        }
+      });
+  if (!is_delta) {
+    // Too many samples were freed since the last delta to report them all, so
+    // start over from the whole live heap.
+    profile = std::make_unique<StackTraceTable>(ProfileType::kHeap);
+    allocated = 0;
+  }
+  state.sampled_allocation_recorder().Iterate(
+      [&](const SampledAllocation& sampled_allocation) {
+        const AllocHandle handle =
+            sampled_allocation.details.sampled_alloc_handle;
+        if (allocated < handle && handle <= allocated_end) {
+          profile->AddTrace(1.0, sampled_allocation.stack_trace());
+        }
       });
+  allocated = allocated_end;
+  freed = freed_end;
   return profile;
 }
 
@@ -132,15 +247,26 @@ ABSL_ATTRIBUTE_NOINLINE static inline void FreeProxyObject(State& state,
 sized_ptr_t SampleifyAllocation(Static& state, size_t requested_size,
                                 size_t align, size_t weight, size_t size_class,
                                 hot_cold_t access_hint, bool size_returning,
-                                void* obj, Span* span) {
+                                void* obj, Span* span,
+                                absl::Span<void* const> stack) {
   TC_CHECK((size_class != 0 && obj != nullptr && span == nullptr) ||
            (size_class == 0 && obj == nullptr && span != nullptr));
 
   StackTrace stack_trace;
   stack_trace.proxy = nullptr;
   stack_trace.requested_size = requested_size;
-  // Grab the stack trace outside the heap lock.
-  stack_trace.depth = absl::GetStackTrace(stack_trace.stack, kMaxStackDepth, 0);
+  if (!stack.empty()) {
+    TC_ASSERT_LE(stack.size(), kMaxStackDepth);
+    std::copy(stack.begin(), stack.end(), stack_trace.stack);
+    stack_trace.depth = stack.size();
+  } else {
+    // Grab the stack trace outside the heap lock.
+    stack_trace.depth =
+        Parameters::frame_pointer_unwinding()
+            ? GetStackTraceFromFramePointers(stack_trace.stack, kMaxStackDepth,
+                                             0)
+            : absl::GetStackTrace(stack_trace.stack, kMaxStackDepth, 0);
+  }
 
   // requested_alignment = 1 means 'small size table alignment was used'
   // Historically this is reported as requested_alignment = 0
@@ -171,8 +297,7 @@ sized_ptr_t SampleifyAllocation(Static& state, size_t requested_size,
     if (alloc_with_status.status == Profile::Sample::GuardedStatus::Guarded) {
       TC_ASSERT(!IsNormalMemory(alloc_with_status.alloc));
       const PageId p = PageIdContaining(alloc_with_status.alloc);
-      PageHeapSpinLockHolder l;
-      span = Span::New(p, num_pages);
+      span = SpanRecycler::New(p, num_pages);
       state.pagemap().Set(p, span);
       // If we report capacity back from a size returning allocation, we can not
       // report the stack_trace.allocated_size, as we guard the size to
@@ -224,6 +349,7 @@ sized_ptr_t SampleifyAllocation(Static& state, size_t requested_size,
   stack_trace.span_start_address = span->start_address();
   stack_trace.allocation_time = absl::Now();
   stack_trace.guarded_status = static_cast<int>(alloc_with_status.status);
+  stack_trace.label = ThreadAllocationLabel::Get();
 
   // How many allocations does this sample represent, given the sampling
   // frequency (weight) and its size.
@@ -236,21 +362,28 @@ sized_ptr_t SampleifyAllocation(Static& state, size_t requested_size,
     state.sampled_internal_fragmentation_.Add(
         allocation_estimate * (stack_trace.allocated_size - requested_size));
   }
+  state.sampled_label_bytes_[stack_trace.label].Add(
+      SampledLabelBytes(stack_trace));
 
   state.allocation_samples.ReportMalloc(stack_trace);
 
+  state.allocation_rate_tracker().RecordAllocation(stack_trace);
+
   state.deallocation_samples.ReportMalloc(stack_trace);
 
   // The SampledAllocation object is visible to readers after this. Readers only
   // care about its various metadata (e.g. stack trace, weight) to generate the
   // heap profile, and won't need any information from Span::Sample() next.
+  const StoredStack* stored_stack = state.stack_trace_store().Intern(
+      absl::MakeConstSpan(stack_trace.stack, stack_trace.depth));
   SampledAllocation* sampled_allocation =
-      state.sampled_allocation_recorder().Register(std::move(stack_trace));
+      state.sampled_allocation_recorder().Register(stack_trace, stored_stack);
   // No pageheap_lock required. The span is freshly allocated and no one else
   // can access it. It is visible after we return from this allocation path.
   span->Sample(sampled_allocation);
 
   state.peak_heap_tracker().MaybeSaveSample();
+  state.peak_heap_windows().MaybeSaveSample();
 
   if (obj != nullptr) {
     // We are not maintaining precise statistics on malloc hit/miss rates at our
@@ -270,7 +403,7 @@ static void ReportMismatchedDelete(const SampledAllocation& alloc, size_t size,
                                    std::optional<size_t> allocated_size) {
   TC_LOG("*** GWP-ASan (https://google.github.io/tcmalloc/gwp-asan.html) has detected a memory error ***");
   TC_LOG("Error originates from memory allocated at:");
-  PrintStackTrace(alloc.sampled_stack.stack, alloc.sampled_stack.depth);
+  PrintStackTrace(alloc.stack->stack, alloc.stack->depth);
 
   if (allocated_size.value_or(requested_size) != requested_size) {
     TC_LOG("Mismatched-size-delete of %v bytes (expected %v - %v bytes) at:",
@@ -295,14 +428,13 @@ void MaybeUnsampleAllocation(Static& state, void* ptr,
   if (SampledAllocation* sampled_allocation = span->Unsample()) {
     TC_ASSERT_EQ(state.pagemap().sizeclass(PageIdContainingTagged(ptr)), 0);
 
-    void* const proxy = sampled_allocation->sampled_stack.proxy;
-    const size_t weight = sampled_allocation->sampled_stack.weight;
-    const size_t requested_size =
-        sampled_allocation->sampled_stack.requested_size;
-    const size_t allocated_size =
-        sampled_allocation->sampled_stack.allocated_size;
+    const SampleDetails& details = sampled_allocation->details;
+    void* const proxy = details.proxy;
+    const size_t weight = details.weight;
+    const size_t requested_size = details.requested_size;
+    const size_t allocated_size = details.allocated_size;
     if (size.has_value()) {
-      if (sampled_allocation->sampled_stack.requested_size_returning) {
+      if (details.requested_size_returning) {
         if (ABSL_PREDICT_FALSE(
                 !(requested_size <= *size && *size <= allocated_size))) {
           ReportMismatchedDelete(*sampled_allocation, *size, requested_size,
@@ -316,16 +448,29 @@ void MaybeUnsampleAllocation(Static& state, void* ptr,
     // SampleifyAllocation turns alignment 1 into 0, turn it back for
     // SizeMap::SizeClass.
     const size_t alignment =
-        sampled_allocation->sampled_stack.requested_alignment != 0
-            ? sampled_allocation->sampled_stack.requested_alignment
-            : 1;
+        details.requested_alignment != 0 ? details.requested_alignment : 1;
     // How many allocations does this sample represent, given the sampling
     // frequency (weight) and its size.
     const double allocation_estimate =
         static_cast<double>(weight) / (requested_size + 1);
-    AllocHandle sampled_alloc_handle =
-        sampled_allocation->sampled_stack.sampled_alloc_handle;
+    const int label = details.label;
+    const int64_t label_bytes = SampledLabelBytes(details);
+    AllocHandle sampled_alloc_handle = details.sampled_alloc_handle;
+    const absl::Time allocation_time = details.allocation_time;
+    const StoredStack* const stack = sampled_allocation->stack;
+    // Only page-level allocations are placed by their callsite's lifetime.
+    if ((Parameters::cold_callsite_classification() ||
+         Parameters::lifetime_aware_filler_placement()) &&
+        allocated_size > kMaxSize) {
+      state.callsite_lifetimes().RecordFree(
+          absl::MakeConstSpan(stack->stack, stack->depth),
+          absl::Now() - allocation_time);
+    }
+    state.freed_samples.RecordFree(sampled_allocation->stack_trace());
     state.sampled_allocation_recorder().Unregister(sampled_allocation);
+    // The sample may be reused as soon as it is unregistered, so its stack is
+    // released through the pointer read before.
+    state.stack_trace_store().Release(stack);
 
     // Adjust our estimate of internal fragmentation.
     TC_ASSERT_LE(requested_size, allocated_size);
@@ -338,6 +483,7 @@ void MaybeUnsampleAllocation(Static& state, void* ptr,
                    sampled_fragmentation);
       state.sampled_internal_fragmentation_.Add(-sampled_fragmentation);
     }
+    state.sampled_label_bytes_[label].Add(-label_bytes);
 
     state.deallocation_samples.ReportFree(sampled_alloc_handle);
 
@@ -353,7 +499,14 @@ void MaybeUnsampleAllocation(Static& state, void* ptr,
       }
       TC_ASSERT_EQ(size_class,
                    state.pagemap().sizeclass(PageIdContainingTagged(proxy)));
+      if (Parameters::lifetime_aware_span_placement()) {
+        state.size_class_lifetimes().RecordFree(
+            size_class, absl::Now() - allocation_time);
+      }
       FreeProxyObject(state, proxy, size_class);
+    } else if (Parameters::lifetime_aware_region_placement()) {
+      state.large_allocation_lifetimes().RecordFree(
+          BytesToLengthCeil(allocated_size), absl::Now() - allocation_time);
     }
   }
 }
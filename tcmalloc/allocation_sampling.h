@@ -16,11 +16,14 @@
 #define TCMALLOC_ALLOCATION_SAMPLING_H_
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
 
 #include "absl/base/attributes.h"
+#include "absl/types/span.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/sampler.h"
@@ -42,8 +45,25 @@ class Static;
 // thus prevents the central free list to return the span to the page heap.
 std::unique_ptr<const ProfileBase> DumpFragmentationProfile(Static& state);
 
+// Like DumpFragmentationProfile, but also charges each sampled object, large
+// ones included, with its share of the free but backed pages on the hugepage
+// its span lives on.
+std::unique_ptr<const ProfileBase> DumpPreciseFragmentationProfile(
+    Static& state);
+
 std::unique_ptr<const ProfileBase> DumpHeapProfile(Static& state);
 
+// Returns the heap samples allocated since `allocated`, the handle of the last
+// sample a previous delta covered, and those freed since `freed`, the number of
+// frees recorded when it was taken, with negative counts.  Both are advanced
+// past this delta.  If `allocated` is zero, or if the frees since `freed` were
+// not all kept, returns the whole live heap instead and sets `is_delta` to
+// false.
+std::unique_ptr<const ProfileBase> DumpHeapProfileDelta(Static& state,
+                                                        AllocHandle& allocated,
+                                                        uint64_t& freed,
+                                                        bool& is_delta);
+
 extern "C" ABSL_CONST_INIT thread_local Sampler tcmalloc_sampler
     ABSL_ATTRIBUTE_INITIAL_EXEC;
 
@@ -67,6 +87,26 @@ inline Sampler* GetThreadSampler() {
   return &tcmalloc_sampler;
 }
 
+// The calling thread's allocation label, as set by
+// MallocExtension::ScopedAllocationLabel.  Only sampled allocations read it.
+class ThreadAllocationLabel {
+ public:
+  static int Get() { return label_; }
+
+  // Sets the label, which must be in [0, kNumAllocationLabels), and returns
+  // the previous one.
+  static int Swap(int label) {
+    TC_ASSERT_GE(label, 0);
+    TC_ASSERT_LT(label, MallocExtension::kNumAllocationLabels);
+    const int previous = label_;
+    label_ = label;
+    return previous;
+  }
+
+ private:
+  ABSL_CONST_INIT static thread_local int label_ ABSL_ATTRIBUTE_INITIAL_EXEC;
+};
+
 // Performs sampling for already occurred allocation of object.
 //
 // For very small object sizes, object is used as 'proxy' and full
@@ -90,10 +130,14 @@ inline Sampler* GetThreadSampler() {
 // In case of out-of-memory condition when allocating span or
 // stacktrace struct, this function simply cheats and returns original
 // object. As if no sampling was requested.
+//
+// If stack is not empty, it is recorded as the allocation's stack instead of
+// the current one.
 sized_ptr_t SampleifyAllocation(Static& state, size_t requested_size,
                                 size_t align, size_t weight, size_t size_class,
                                 hot_cold_t access_hint, bool size_returning,
-                                void* obj, Span* span);
+                                void* obj, Span* span,
+                                absl::Span<void* const> stack = {});
 
 void MaybeUnsampleAllocation(Static& state, void* ptr,
                              std::optional<size_t> size, Span* span);
@@ -101,9 +145,11 @@ void MaybeUnsampleAllocation(Static& state, void* ptr,
 template <typename Policy>
 static sized_ptr_t SampleLargeAllocation(Static& state, Policy policy,
                                          size_t requested_size, size_t weight,
-                                         Span* span, hot_cold_t hint) {
+                                         Span* span, hot_cold_t hint,
+                                         absl::Span<void* const> stack) {
   return SampleifyAllocation(state, requested_size, policy.align(), weight, 0,
-                             hint, policy.size_returning(), nullptr, span);
+                             hint, policy.size_returning(), nullptr, span,
+                             stack);
 }
 
 template <typename Policy>
@@ -14,14 +14,19 @@
 
 #include "tcmalloc/arena.h"
 
+#include <sys/mman.h>
+
 #include <cstddef>
 #include <cstdint>
 #include <new>
 
 #include "absl/base/optimization.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/optimization.h"
+#include "tcmalloc/parameters.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/system-alloc.h"
 
@@ -29,20 +34,52 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
-void* Arena::Alloc(size_t bytes, std::align_val_t alignment) {
+absl::string_view ArenaUseToLabel(ArenaUse use) {
+  switch (use) {
+    case ArenaUse::kSpan:
+      return "SPAN";
+    case ArenaUse::kPageTracker:
+      return "PAGE_TRACKER";
+    case ArenaUse::kPagemap:
+      return "PAGEMAP";
+    case ArenaUse::kSampled:
+      return "SAMPLED";
+    case ArenaUse::kCpuCache:
+      return "CPU_CACHE";
+    case ArenaUse::kTransferCache:
+      return "TRANSFER_CACHE";
+    case ArenaUse::kOther:
+      return "OTHER";
+  }
+
+  ASSUME(false);
+}
+
+void* Arena::Alloc(size_t bytes, std::align_val_t alignment, ArenaUse use) {
   size_t align = static_cast<size_t>(alignment);
   TC_ASSERT_GT(align, 0);
+  size_t& by_use = bytes_by_use_[static_cast<size_t>(use)];
   {  // First we need to move up to the correct alignment.
     const int misalignment = reinterpret_cast<uintptr_t>(free_area_) % align;
     const int alignment_bytes = misalignment != 0 ? align - misalignment : 0;
     free_area_ += alignment_bytes;
     free_avail_ -= alignment_bytes;
     bytes_allocated_ += alignment_bytes;
+    by_use += alignment_bytes;
   }
   char* result;
   if (free_avail_ < bytes) {
-    size_t ask = bytes > kAllocIncrement ? bytes : kAllocIncrement;
-    auto [ptr, actual_size] = SystemAlloc(ask, kPageSize, MemoryTag::kMetadata);
+    const bool hugepages = Parameters::metadata_arena_hugepages();
+    size_t ask, ask_alignment;
+    if (hugepages) {
+      ask = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+      ask_alignment = kHugePageSize;
+    } else {
+      ask = bytes > kAllocIncrement ? bytes : kAllocIncrement;
+      ask_alignment = kPageSize;
+    }
+    auto [ptr, actual_size] =
+        SystemAlloc(ask, ask_alignment, MemoryTag::kMetadata);
     free_area_ = reinterpret_cast<char*>(ptr);
     if (ABSL_PREDICT_FALSE(free_area_ == nullptr)) {
       TC_BUG(
@@ -51,6 +88,13 @@ void* Arena::Alloc(size_t bytes, std::align_val_t alignment) {
           "succeeding (sandbox, VSS limitations)?",
           kAllocIncrement, bytes);
     }
+    if (hugepages) {
+      // The metadata region asks for small pages, which suits the rest of the
+      // arena; override that for this block.  This is only advisory.
+      ErrnoRestorer errno_restorer;
+      (void)madvise(free_area_, actual_size, MADV_HUGEPAGE);
+      hugepage_blocks_++;
+    }
     SystemBack(free_area_, actual_size);
 
     // We've discarded the previous free_area_, so any bytes that were
@@ -66,6 +110,7 @@ void* Arena::Alloc(size_t bytes, std::align_val_t alignment) {
   free_area_ += bytes;
   free_avail_ -= bytes;
   bytes_allocated_ += bytes;
+  by_use += bytes;
   return reinterpret_cast<void*>(result);
 }
 
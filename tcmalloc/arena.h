@@ -18,10 +18,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <iterator>
 #include <new>
 
 #include "absl/base/attributes.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -30,6 +33,25 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+// What Arena memory is used for, for accounting.
+enum class ArenaUse : uint8_t {
+  kSpan,
+  // HugePageFiller trackers, HugeRegions and the bookkeeping of the hugepage
+  // allocators.
+  kPageTracker,
+  kPagemap,
+  // Stack traces and records of sampled allocations.
+  kSampled,
+  kCpuCache,
+  // Transfer caches and central freelists.
+  kTransferCache,
+  kOther,
+};
+inline constexpr size_t kNumArenaUses =
+    static_cast<size_t>(ArenaUse::kOther) + 1;
+
+absl::string_view ArenaUseToLabel(ArenaUse use);
+
 struct ArenaStats {
   // The number of bytes allocated and in-use by calls to Alloc().
   size_t bytes_allocated;
@@ -43,8 +65,13 @@ struct ArenaStats {
   // the ones counted in `bytes_allocated`.
   size_t bytes_nonresident;
 
-  // The number of blocks allocated by the Arena.
+  // The number of blocks allocated by the Arena, and of those, the ones backed
+  // by hugepages.
   size_t blocks;
+  size_t hugepage_blocks;
+
+  // Of bytes_allocated, those for each ArenaUse.
+  size_t bytes_by_use[kNumArenaUses];
 };
 
 // Arena allocation; designed for use by tcmalloc internal data structures like
@@ -53,17 +80,26 @@ class Arena {
  public:
   constexpr Arena() {}
 
-  // Returns a properly aligned byte array of length "bytes".  Crashes if
-  // allocation fails.  Requires pageheap_lock is held.
+  // Returns a properly aligned byte array of length "bytes", accounted to
+  // "use".  Crashes if allocation fails.  Requires pageheap_lock is held.
+  //
+  // With metadata_arena_hugepages, blocks obtained from the system from then
+  // on are whole, aligned hugepages advised to be backed as such, so that
+  // metadata takes few TLB entries.
   ABSL_ATTRIBUTE_RETURNS_NONNULL void* Alloc(
-      size_t bytes, std::align_val_t alignment = kAlignment)
+      size_t bytes, std::align_val_t alignment = kAlignment,
+      ArenaUse use = ArenaUse::kOther)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   // Updates the stats for allocated and non-resident bytes.
-  void UpdateAllocatedAndNonresident(int64_t allocated, int64_t nonresident)
+  void UpdateAllocatedAndNonresident(int64_t allocated, int64_t nonresident,
+                                     ArenaUse use = ArenaUse::kOther)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
     TC_ASSERT_GE(static_cast<int64_t>(bytes_allocated_) + allocated, 0);
     bytes_allocated_ += allocated;
+    size_t& by_use = bytes_by_use_[static_cast<size_t>(use)];
+    TC_ASSERT_GE(static_cast<int64_t>(by_use) + allocated, 0);
+    by_use += allocated;
     TC_ASSERT_GE(static_cast<int64_t>(bytes_nonresident_) + nonresident, 0);
     bytes_nonresident_ += nonresident;
   }
@@ -76,12 +112,19 @@ class Arena {
     s.bytes_unavailable = bytes_unavailable_;
     s.bytes_nonresident = bytes_nonresident_;
     s.blocks = blocks_;
+    s.hugepage_blocks = hugepage_blocks_;
+    std::copy(std::begin(bytes_by_use_), std::end(bytes_by_use_),
+              s.bytes_by_use);
     return s;
   }
 
  private:
   // How much to allocate from system at a time
+#if defined(TCMALLOC_INTERNAL_SMALL_FOOTPRINT)
+  static constexpr int kAllocIncrement = 32 << 10;
+#else
   static constexpr int kAllocIncrement = 128 << 10;
+#endif
 
   // Free area from which to carve new objects
   char* free_area_ ABSL_GUARDED_BY(pageheap_lock) = nullptr;
@@ -97,6 +140,8 @@ class Arena {
   size_t bytes_nonresident_ ABSL_GUARDED_BY(pageheap_lock) = 0;
   // Total number of blocks/free areas managed by this Arena.
   size_t blocks_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  size_t hugepage_blocks_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  size_t bytes_by_use_[kNumArenaUses] ABSL_GUARDED_BY(pageheap_lock) = {};
 
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
@@ -21,6 +21,7 @@
 #include "gtest/gtest.h"
 #include "absl/base/internal/spinlock.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/parameters.h"
 
 namespace tcmalloc {
 namespace tcmalloc_internal {
@@ -155,6 +156,59 @@ TEST(Arena, BytesImpending) {
   EXPECT_EQ(stats.bytes_allocated, 100);
 }
 
+TEST(Arena, BytesByUse) {
+  Arena arena;
+  ArenaStats stats;
+  {
+    PageHeapSpinLockHolder l;
+    arena.Alloc(64, Align(8), ArenaUse::kSpan);
+    arena.Alloc(24, Align(8), ArenaUse::kPagemap);
+    arena.Alloc(40, Align(8));
+    arena.UpdateAllocatedAndNonresident(100, 0, ArenaUse::kCpuCache);
+    stats = arena.stats();
+  }
+
+  EXPECT_EQ(stats.bytes_by_use[static_cast<size_t>(ArenaUse::kSpan)], 64);
+  EXPECT_EQ(stats.bytes_by_use[static_cast<size_t>(ArenaUse::kPagemap)], 24);
+  EXPECT_EQ(stats.bytes_by_use[static_cast<size_t>(ArenaUse::kOther)], 40);
+  EXPECT_EQ(stats.bytes_by_use[static_cast<size_t>(ArenaUse::kCpuCache)], 100);
+  size_t total = 0;
+  for (size_t bytes : stats.bytes_by_use) {
+    total += bytes;
+  }
+  EXPECT_EQ(total, stats.bytes_allocated);
+}
+
+TEST(Arena, HugepageBlocks) {
+  const bool hugepages = Parameters::metadata_arena_hugepages();
+  Parameters::set_metadata_arena_hugepages(true);
+
+  Arena arena;
+  void* ptr;
+  ArenaStats stats;
+  {
+    PageHeapSpinLockHolder l;
+    ptr = arena.Alloc(1, Align(1));
+    stats = arena.stats();
+  }
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % kHugePageSize, 0);
+  EXPECT_EQ(stats.blocks, 1);
+  EXPECT_EQ(stats.hugepage_blocks, 1);
+  EXPECT_EQ(stats.bytes_unallocated, kHugePageSize - 1);
+
+  // Blocks obtained once it is turned off are small again.
+  Parameters::set_metadata_arena_hugepages(false);
+  {
+    PageHeapSpinLockHolder l;
+    arena.Alloc(stats.bytes_unallocated + 1, Align(1));
+    stats = arena.stats();
+  }
+  EXPECT_EQ(stats.blocks, 2);
+  EXPECT_EQ(stats.hugepage_blocks, 1);
+
+  Parameters::set_metadata_arena_hugepages(hugepages);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -13,33 +13,203 @@
 // limitations under the License.
 
 
+#include <sched.h>
+
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
 
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "tcmalloc/background_scheduler.h"
+#include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/global_stats.h"
+#include "tcmalloc/huge_page_filler.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/cgroup.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_pressure.h"
+#include "tcmalloc/internal/pageflags.h"
 #include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/release_rate_controller.h"
+#include "tcmalloc/internal/residency.h"
 #include "tcmalloc/internal_malloc_extension.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/page_allocator.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/sampler.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
+#include "tcmalloc/system-alloc.h"
+#include "tcmalloc/thread_cache.h"
+
+namespace {
+
+// Sets the memory limits from the cgroup's, except for any limit that someone
+// else changed since we last set it: limits set by the application take
+// precedence.  *soft and *hard hold the limits we last set.
+void FollowCgroupLimits(const tcmalloc::tcmalloc_internal::CgroupMemoryLimits&
+                            limits,
+                        size_t* soft, size_t* hard) {
+  using tcmalloc::MallocExtension;
+  using tcmalloc::tcmalloc_internal::CgroupHardLimit;
+  using tcmalloc::tcmalloc_internal::CgroupSoftLimit;
+  using LimitKind = tcmalloc::MallocExtension::LimitKind;
+
+  const bool own_soft =
+      MallocExtension::GetMemoryLimit(LimitKind::kSoft) == *soft;
+  const bool own_hard =
+      MallocExtension::GetMemoryLimit(LimitKind::kHard) == *hard;
+  // Lowering the hard limit also clamps the soft limit, so it goes first.
+  if (own_hard && CgroupHardLimit(limits) != *hard) {
+    MallocExtension::SetMemoryLimit(CgroupHardLimit(limits), LimitKind::kHard);
+  }
+  if (own_soft && CgroupSoftLimit(limits) !=
+                      MallocExtension::GetMemoryLimit(LimitKind::kSoft)) {
+    MallocExtension::SetMemoryLimit(CgroupSoftLimit(limits), LimitKind::kSoft);
+  }
+  if (own_hard) {
+    *hard = MallocExtension::GetMemoryLimit(LimitKind::kHard);
+  }
+  if (own_soft) {
+    *soft = MallocExtension::GetMemoryLimit(LimitKind::kSoft);
+  }
+}
+
+// Returns whether the mapped heap is within 10% of the soft or hard memory
+// limit, so that the background thread keeps releasing at full speed.
+bool NearMemoryLimit() {
+  using tcmalloc::MallocExtension;
+  using LimitKind = tcmalloc::MallocExtension::LimitKind;
+
+  const size_t limit =
+      std::min(MallocExtension::GetMemoryLimit(LimitKind::kSoft),
+               MallocExtension::GetMemoryLimit(LimitKind::kHard));
+  if (limit == std::numeric_limits<size_t>::max()) {
+    return false;
+  }
+  tcmalloc::tcmalloc_internal::BackingStats stats;
+  {
+    tcmalloc::tcmalloc_internal::PageHeapSpinLockHolder l;
+    stats = tcmalloc::tcmalloc_internal::tc_globals.page_allocator().stats();
+  }
+  return stats.system_bytes - stats.unmapped_bytes >= limit / 10 * 9;
+}
+
+// Returns the bytes of the objects held in the per-cpu and transfer caches.
+size_t CachedBytes() {
+  using tcmalloc::tcmalloc_internal::kNumClasses;
+  using tcmalloc::tcmalloc_internal::tc_globals;
+
+  size_t bytes = 0;
+  for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+    bytes += tc_globals.sizemap().class_to_size(size_class) *
+             tc_globals.transfer_cache().tc_length(size_class);
+  }
+  if (tcmalloc::MallocExtension::PerCpuCachesActive()) {
+    bytes += tc_globals.cpu_cache().TotalUsedBytes() +
+             tc_globals.sharded_transfer_cache().TotalBytes();
+  }
+  return bytes;
+}
+
+}  // namespace
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Finds how the kernel backs a hugepage from /proc/self/pageflags, which needs
+// kernel support, and /proc/self/pagemap.  Both stay open while this exists.
+class SystemHugePageBacking final : public HugePageBackingFunction {
+ public:
+  HugePageBacking operator()(HugePage p) override {
+    const std::optional<bool> huge =
+        pageflags_.IsHugepageBacked(p.start_addr());
+    if (!huge.has_value()) {
+      return HugePageBacking::kUnknown;
+    }
+    if (*huge) {
+      return HugePageBacking::kHugePage;
+    }
+    // Free pages that were never touched aren't backed by anything yet.
+    const std::optional<Residency::Info> residency =
+        residency_.Get(p.start_addr(), kHugePageSize);
+    if (!residency.has_value() || residency->bytes_resident == 0) {
+      return HugePageBacking::kUnknown;
+    }
+    return HugePageBacking::kNativePages;
+  }
+
+ private:
+  PageFlags pageflags_;
+  Residency residency_;
+};
+
+// Finds whether a hugepage has gone idle from the kernel's stale page
+// tracking (kstaled) in /proc/self/pageflags, and moves it between NUMA nodes
+// with mbind.  Without kstaled, no page is ever stale, so nothing is demoted.
+class SystemHugePageTiering final : public HugePageTieringFunction {
+ public:
+  std::optional<bool> IsIdle(HugePage p) override {
+    const std::optional<PageFlags::PageStats> flags =
+        pageflags_.Get(p.start_addr(), kHugePageSize);
+    const std::optional<Residency::Info> residency =
+        residency_.Get(p.start_addr(), kHugePageSize);
+    if (!flags.has_value() || !residency.has_value() ||
+        residency->bytes_resident == 0) {
+      return std::nullopt;
+    }
+    return flags->bytes_stale >= residency->bytes_resident;
+  }
+
+  bool Demote(HugePage p) override {
+    return SystemDemote(p.start_addr(), kHugePageSize,
+                        GetMemoryTag(p.start_addr()));
+  }
+
+  bool Promote(HugePage p) override {
+    return SystemPromote(p.start_addr(), kHugePageSize,
+                         GetMemoryTag(p.start_addr()));
+  }
+
+ private:
+  PageFlags pageflags_;
+  Residency residency_;
+};
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
 
 // Release memory to the system at a constant rate.
 void MallocExtension_Internal_ProcessBackgroundActions() {
+  using ::tcmalloc::tcmalloc_internal::BackgroundScheduler;
+  using ::tcmalloc::tcmalloc_internal::HugePageFiller;
+  using ::tcmalloc::tcmalloc_internal::PageHeapSpinLockHolder;
+  using ::tcmalloc::tcmalloc_internal::PageTracker;
   using ::tcmalloc::tcmalloc_internal::Parameters;
   using ::tcmalloc::tcmalloc_internal::tc_globals;
+  using ::tcmalloc::tcmalloc_internal::ThreadCache;
 
   tcmalloc::MallocExtension::MarkThreadIdle();
 
   absl::Time prev_time = absl::Now();
   absl::Time last_reclaim = prev_time;
-  absl::Time last_shuffle = prev_time;
-  absl::Time last_size_class_resize = prev_time;
+  tcmalloc::tcmalloc_internal::BackgroundAction shuffle(prev_time);
+  tcmalloc::tcmalloc_internal::BackgroundAction size_class_resize(prev_time);
   absl::Time last_size_class_max_capacity_resize = prev_time;
   absl::Time last_slab_resize_check = prev_time;
+  absl::Time last_sampling_rate_update = prev_time;
+  absl::Time last_thread_cache_resize = prev_time;
+  // The number of samples taken when the sampling rate was last updated.
+  int64_t last_sampled_count = tc_globals.total_sampled_count_.value();
+  // The number of times a memory limit was hit, as of the last iteration.
+  int64_t last_limit_hits = tc_globals.page_allocator().total_limit_hits();
 
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
   absl::Time last_transfer_cache_plunder_check = prev_time;
@@ -52,6 +222,26 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
   // want to separately account for pages released by ProcessBackgroundActions.
   tcmalloc::tcmalloc_internal::ConstantRatePageAllocatorReleaser releaser;
 
+  // Releases queued by ReleaseMemoryToSystem, when it runs asynchronously.
+  tcmalloc::tcmalloc_internal::ConstantRatePageAllocatorReleaser
+      queued_releaser;
+  tcmalloc::tcmalloc_internal::MemoryPressureMonitor pressure_monitor;
+  // Scales the release rate to keep refaults within the budget.
+  tcmalloc::tcmalloc_internal::ReleaseRateController refault_controller;
+  tcmalloc::tcmalloc_internal::CgroupMemoryLimitMonitor cgroup_monitor;
+  // The limits we last took from the cgroup.  No limit is the default.
+  size_t cgroup_soft_limit = std::numeric_limits<size_t>::max();
+  size_t cgroup_hard_limit = std::numeric_limits<size_t>::max();
+  // Opened once hugepage auditing is first enabled.
+  std::optional<tcmalloc::tcmalloc_internal::SystemHugePageBacking>
+      hugepage_backing;
+  // Opened once demotion of idle hugepages is first enabled.
+  std::optional<tcmalloc::tcmalloc_internal::SystemHugePageTiering>
+      hugepage_tiering;
+
+  tc_globals.page_allocator().tracer().InitFromEnvironment();
+  tc_globals.release_queue().SetDraining(true);
+
   while (tcmalloc::MallocExtension::GetBackgroundProcessActionsEnabled()) {
     const absl::Duration sleep_time =
         tcmalloc::MallocExtension::GetBackgroundProcessSleepInterval();
@@ -77,6 +267,14 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
     // cpu_cache_shuffle_period.
     const absl::Duration cpu_cache_slab_resize_period = 29 * sleep_time;
 
+    // Measure the sample rate over a few cycles, so that bursts of sampled
+    // allocations do not make the sampling rate swing.
+    const absl::Duration sampling_rate_update_period = 10 * sleep_time;
+
+    // Without per-cpu caches, rebalance the per-thread caches as often as
+    // per-cpu caches are shuffled.
+    const absl::Duration thread_cache_resize_period = 5 * sleep_time;
+
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
     // We reclaim unused objects from the transfer caches once per
     // transfer_cache_plunder_period.
@@ -87,10 +285,33 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
 
     absl::Time now = absl::Now();
 
+    // When event driven, actions that respond to per-cpu cache misses run as
+    // soon as the misses spike, but no more than once per iteration.
+    const bool event_driven = Parameters::background_event_driven();
+    BackgroundScheduler& scheduler = tc_globals.background_scheduler();
+    const bool miss_spike = event_driven && scheduler.miss_spike();
+    const absl::Duration min_action_period =
+        event_driven ? sleep_time : absl::InfiniteDuration();
+
+    // If a memory limit was hit since the last iteration, drain the idle
+    // caches now rather than when they are due, so that the memory they hold
+    // can be released before the page heap has to break up hugepages.
+    const int64_t limit_hits = tc_globals.page_allocator().total_limit_hits();
+    const bool limit_hit = limit_hits != last_limit_hits;
+    const size_t cached_before_limit_drain = limit_hit ? CachedBytes() : 0;
+
     // We follow the cache hierarchy in TCMalloc from outermost (per-CPU) to
     // innermost (the page heap).  Freeing up objects at one layer can help aid
     // memory coalescing for inner caches.
 
+    // Per-cpu caches enabled after startup, with set_per_cpu_caches, are
+    // activated here.  Each thread then moves from its thread cache to the
+    // per-cpu caches on its own next call into TCMalloc.
+    if (Parameters::per_cpu_caches() &&
+        !tcmalloc::MallocExtension::PerCpuCachesActive()) {
+      TCMalloc_Internal_ForceCpuCacheActivation();
+    }
+
     if (tcmalloc::MallocExtension::PerCpuCachesActive()) {
       // Accelerate fences as part of this operation by registering this thread
       // with rseq.  While this is not strictly required to succeed, we do not
@@ -100,19 +321,33 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
 
       // Try to reclaim per-cpu caches once every cpu_cache_reclaim_period
       // when enabled.
-      if (now - last_reclaim >= cpu_cache_reclaim_period) {
-        tc_globals.cpu_cache().TryReclaimingCaches();
+      if (limit_hit || now - last_reclaim >= cpu_cache_reclaim_period) {
+        // Caches of cpus we can no longer run on would otherwise only be
+        // reclaimed once they look idle, and keep their capacity forever.
+        tc_globals.cpu_cache().ReclaimDisallowedCpuCaches();
+        // Partitions with a worker of their own reclaim their caches.
+        tc_globals.cpu_cache().TryReclaimingCaches([](int cpu) {
+          return !tc_globals.page_allocator().HasPartitionWorker(
+              tc_globals.numa_topology().GetCpuPartition(cpu));
+        });
         last_reclaim = now;
       }
 
-      if (now - last_shuffle >= cpu_cache_shuffle_period) {
+      if (shuffle.Due(now,
+                      std::min(min_action_period, cpu_cache_shuffle_period),
+                      cpu_cache_shuffle_period, miss_spike)) {
         tc_globals.cpu_cache().ShuffleCpuCaches();
-        last_shuffle = now;
       }
 
-      if (now - last_size_class_resize >= size_class_resize_period) {
+      tc_globals.cpu_cache().UpdateMissTimeSeries();
+
+      if (size_class_resize.Due(
+              now, std::min(min_action_period, size_class_resize_period),
+              size_class_resize_period, miss_spike)) {
         tc_globals.cpu_cache().ResizeSizeClasses();
-        last_size_class_resize = now;
+        if (Parameters::per_cpu_caches_batch_size_autotune()) {
+          tc_globals.cpu_cache().TuneBatchLengths();
+        }
       }
 
       if (Parameters::resize_size_class_max_capacity() &&
@@ -123,20 +358,35 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
       }
 
       // See if we need to grow the slab once every kCpuCacheSlabResizePeriod
-      // when enabled.
-      if (Parameters::per_cpu_caches_dynamic_slab_enabled() &&
-          now - last_slab_resize_check >= cpu_cache_slab_resize_period) {
+      // when enabled. An incremental resize underway carries on every
+      // iteration until it is done.
+      if (tc_globals.cpu_cache().SlabResizeInProgress() ||
+          (Parameters::per_cpu_caches_dynamic_slab_enabled() &&
+           now - last_slab_resize_check >= cpu_cache_slab_resize_period)) {
         tc_globals.cpu_cache().ResizeSlabIfNeeded();
         last_slab_resize_check = now;
       }
+    } else if (Parameters::thread_cache_dynamic_resize() &&
+               now - last_thread_cache_resize >= thread_cache_resize_period) {
+      ThreadCache::ResizeCaches();
+      last_thread_cache_resize = now;
     }
 
+    // Flush the caches of threads that stopped allocating, such as threads
+    // parked in a pool, without waiting for them to call MarkThreadIdle().
+    if (const int64_t intervals =
+            Parameters::thread_cache_idle_flush_intervals();
+        intervals > 0) {
+      ThreadCache::FlushIdleCaches(intervals);
+    }
+
+    tc_globals.sharded_transfer_cache().Rebalance();
     tc_globals.sharded_transfer_cache().Plunder();
 
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
     // Try to plunder and reclaim unused objects from transfer caches.
-    if (now - last_transfer_cache_plunder_check >=
-        transfer_cache_plunder_period) {
+    if (limit_hit || now - last_transfer_cache_plunder_check >=
+                         transfer_cache_plunder_period) {
       tc_globals.transfer_cache().TryPlunder();
       last_transfer_cache_plunder_check = now;
     }
@@ -144,16 +394,132 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
     if (now - last_transfer_cache_resize_check >=
         transfer_cache_resize_period) {
       tc_globals.transfer_cache().TryResizingCaches();
+      tc_globals.sharded_transfer_cache().TryResizingCaches();
+      tc_globals.transfer_cache().TryRefill();
       last_transfer_cache_resize_check = now;
     }
 #endif
 
+    if (limit_hit) {
+      const size_t cached = CachedBytes();
+      tc_globals.page_allocator().RecordShrinkDrained(
+          cached_before_limit_drain > cached
+              ? cached_before_limit_drain - cached
+              : 0);
+      // Release what draining freed, if that is enough to get back under the
+      // limit.
+      PageHeapSpinLockHolder l;
+      tc_globals.page_allocator().ShrinkToUsageLimit(
+          tcmalloc::tcmalloc_internal::Length(0));
+    }
+    // Hits by the shrink above don't count, so that the caches are only
+    // drained again once allocations hit a limit.
+    last_limit_hits = tc_globals.page_allocator().total_limit_hits();
+
+    // Steer the sampling rate toward the target number of samples per second.
+    if (const int64_t target = Parameters::profile_samples_per_second_target();
+        target > 0 &&
+        now - last_sampling_rate_update >= sampling_rate_update_period) {
+      const int64_t sampled_count = tc_globals.total_sampled_count_.value();
+      // Tests may reset the count.
+      const int64_t samples = sampled_count >= last_sampled_count
+                                  ? sampled_count - last_sampled_count
+                                  : sampled_count;
+      const double samples_per_second =
+          samples / absl::ToDoubleSeconds(now - last_sampling_rate_update);
+      const int64_t rate = Parameters::profile_sampling_rate();
+      const int64_t adapted = tcmalloc::tcmalloc_internal::AdaptSamplingRate(
+          rate, samples_per_second, target);
+      if (adapted != rate) {
+        Parameters::set_profile_sampling_rate(adapted);
+      }
+      last_sampled_count = sampled_count;
+      last_sampling_rate_update = now;
+    }
+
+    // Release preferentially from the NUMA partition that is short on memory.
+    tc_globals.page_allocator().UpdateNumaMemoryPressure();
+
+    // Do not let frees deferred by the central freelists linger.
+    tc_globals.transfer_cache().ReturnDeferredSpans();
+
+    // Nor large spans that have not been reused since the last iteration.
+    tcmalloc::tcmalloc_internal::LargeSpanCache::ReleaseIdle();
+
+    // Grow the spans of size classes that fill them quickly, and shrink them
+    // back when they no longer do.
+    tc_globals.transfer_cache().UpdateSpanSizes();
+
+    // Check that the hugepages we assume are intact still are, a few at a
+    // time, so that hugepages the kernel split can be collapsed again.
+    if (Parameters::audit_hugepage_backing()) {
+      if (!hugepage_backing.has_value()) {
+        hugepage_backing.emplace();
+      }
+      PageHeapSpinLockHolder l;
+      tc_globals.page_allocator().AuditHugePages(
+          HugePageFiller<PageTracker>::kMaxHugePagesToAudit, *hugepage_backing);
+    }
+
+    // Restore hugepage backing for hugepages that subrelease or the kernel
+    // broke up but that are fully used again.
+    if (Parameters::collapse_subreleased_hugepages()) {
+      PageHeapSpinLockHolder l;
+      tc_globals.page_allocator().CollapseHugePages(
+          HugePageFiller<PageTracker>::kMaxHugePagesToCollapse);
+    }
+
+    // Move the filler's hugepages that have gone idle to the warm tier's
+    // slower node, and back once they are used again.
+    if (Parameters::demote_idle_hugepages() &&
+        tcmalloc::tcmalloc_internal::WarmTierNumaNode() >= 0) {
+      if (!hugepage_tiering.has_value()) {
+        hugepage_tiering.emplace();
+      }
+      PageHeapSpinLockHolder l;
+      tc_globals.page_allocator().TierHugePages(
+          HugePageFiller<PageTracker>::kMaxHugePagesToTier, *hugepage_tiering);
+    }
+
+    // Track the cgroup's limits, so that ShrinkToUsageLimit releases memory
+    // before the kernel throttles or OOM-kills us.
+    if (Parameters::follow_cgroup_memory_limits()) {
+      tcmalloc::tcmalloc_internal::CgroupMemoryLimits limits;
+      if (cgroup_monitor.Read(&limits)) {
+        FollowCgroupLimits(limits, &cgroup_soft_limit, &cgroup_hard_limit);
+      }
+    }
+
     // If time goes backwards, we would like to cap the release rate at 0.
     ssize_t bytes_to_release =
         static_cast<size_t>(Parameters::background_release_rate()) *
         absl::ToDoubleSeconds(now - prev_time);
     bytes_to_release = std::max<ssize_t>(bytes_to_release, 0);
 
+    // Release faster the more the system stalls on memory, and not at all
+    // while memory is plentiful.  If the kernel doesn't report pressure stall
+    // information, keep the constant rate.
+    if (Parameters::memory_pressure_aware_release()) {
+      tcmalloc::tcmalloc_internal::MemoryPressure pressure;
+      if (pressure_monitor.Read(&pressure)) {
+        bytes_to_release *=
+            tcmalloc::tcmalloc_internal::MemoryPressureReleaseScale(pressure);
+      }
+    }
+
+    // Release slower while released pages are faulted back in faster than
+    // the budget allows, and faster while they are not.
+    if (const size_t budget = Parameters::release_refault_budget();
+        budget > 0) {
+      tcmalloc::tcmalloc_internal::Length refaulted;
+      {
+        PageHeapSpinLockHolder l;
+        refaulted = tc_globals.page_allocator().GetRefaultedPages();
+      }
+      bytes_to_release *= refault_controller.Update(
+          refaulted.in_bytes(), now - prev_time, budget);
+    }
+
     // If release rate is set to 0, do not release memory to system. However, if
     // we want to release free and backed hugepages from HugeRegion,
     // ReleaseMemoryToSystem should be able to release those pages to the
@@ -164,7 +530,117 @@ void MallocExtension_Internal_ProcessBackgroundActions() {
                            PageReleaseReason::kProcessBackgroundActions);
     }
 
+    if (const size_t queued = tc_globals.release_queue().TakePending();
+        queued > 0) {
+      tcmalloc::tcmalloc_internal::LargeSpanCache::Drain();
+      queued_releaser.Release(queued,
+                              /*reason=*/tcmalloc::tcmalloc_internal::
+                                  PageReleaseReason::kReleaseMemoryToSystem);
+    }
+
+    // Write out the page heap operations traced since the last iteration.
+    tc_globals.page_allocator().tracer().Flush();
+
+    // Keep the stats GetStatsSnapshot reads without the page heap lock fresh.
+    tcmalloc::tcmalloc_internal::MirrorLockedStats();
+
+    // Releases above scale with the time since the last iteration, so they
+    // keep their rate however long the thread sleeps.
+    BackgroundScheduler::Events events;
+    if (tcmalloc::MallocExtension::PerCpuCachesActive()) {
+      const auto misses = tc_globals.cpu_cache().GetTotalCacheMissStats();
+      events.cache_misses = misses.underflows + misses.overflows;
+      events.work_in_progress = tc_globals.cpu_cache().SlabResizeInProgress();
+    }
+    events.queued_release = tc_globals.release_queue().pending();
+    events.near_limit = NearMemoryLimit();
+
+    prev_time = now;
+    absl::SleepFor(scheduler.Iterate(now, events, sleep_time, event_driven));
+  }
+
+  // Stop accepting asynchronous releases and carry out any still queued.
+  tc_globals.release_queue().SetDraining(false);
+  if (const size_t queued = tc_globals.release_queue().TakePending();
+      queued > 0) {
+    queued_releaser.Release(queued,
+                            /*reason=*/tcmalloc::tcmalloc_internal::
+                                PageReleaseReason::kReleaseMemoryToSystem);
+  }
+}
+
+size_t MallocExtension_Internal_GetNumBackgroundNumaPartitions() {
+  using ::tcmalloc::tcmalloc_internal::tc_globals;
+
+  const auto& topology = tc_globals.numa_topology();
+  return topology.numa_aware() ? topology.active_partitions() : 0;
+}
+
+void MallocExtension_Internal_ProcessNumaPartitionBackgroundActions(
+    size_t partition) {
+  using ::tcmalloc::tcmalloc_internal::NumCPUs;
+  using ::tcmalloc::tcmalloc_internal::Parameters;
+  using ::tcmalloc::tcmalloc_internal::tc_globals;
+
+  const size_t partitions =
+      MallocExtension_Internal_GetNumBackgroundNumaPartitions();
+  if (partition >= partitions) {
+    return;
+  }
+
+  tcmalloc::MallocExtension::MarkThreadIdle();
+
+  // Run next to the caches and pages of the partition.  If our cpuset doesn't
+  // allow it, we still do the partition's work, only from further away.
+  const auto& topology = tc_globals.numa_topology();
+  const int num_cpus = NumCPUs();
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int cpu = 0; cpu < num_cpus && cpu < CPU_SETSIZE; ++cpu) {
+    if (topology.GetCpuPartition(cpu) == partition) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  if (CPU_COUNT(&cpus) > 0) {
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+  }
+
+  tcmalloc::tcmalloc_internal::ConstantRatePageAllocatorReleaser releaser(
+      partition);
+  tc_globals.page_allocator().SetPartitionWorker(partition, true);
+
+  absl::Time prev_time = absl::Now();
+  absl::Time last_reclaim = prev_time;
+  while (tcmalloc::MallocExtension::GetBackgroundProcessActionsEnabled()) {
+    const absl::Duration sleep_time =
+        tcmalloc::MallocExtension::GetBackgroundProcessSleepInterval();
+    // As in ProcessBackgroundActions.
+    const absl::Duration cpu_cache_reclaim_period = 30 * sleep_time;
+    const absl::Time now = absl::Now();
+
+    if (tcmalloc::MallocExtension::PerCpuCachesActive() &&
+        now - last_reclaim >= cpu_cache_reclaim_period) {
+      TC_CHECK(tcmalloc::tcmalloc_internal::subtle::percpu::IsFast());
+      tc_globals.cpu_cache().TryReclaimingCaches([&](int cpu) {
+        return topology.GetCpuPartition(cpu) == partition;
+      });
+      last_reclaim = now;
+    }
+
+    // Each partition releases its share of the background release rate.
+    ssize_t bytes_to_release =
+        static_cast<size_t>(Parameters::background_release_rate()) *
+        absl::ToDoubleSeconds(now - prev_time) / partitions;
+    bytes_to_release = std::max<ssize_t>(bytes_to_release, 0);
+    if (bytes_to_release > 0) {
+      releaser.Release(bytes_to_release,
+                       /*reason=*/tcmalloc::tcmalloc_internal::
+                           PageReleaseReason::kProcessBackgroundActions);
+    }
+
     prev_time = now;
     absl::SleepFor(sleep_time);
   }
+
+  tc_globals.page_allocator().SetPartitionWorker(partition, false);
 }
@@ -0,0 +1,149 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_BACKGROUND_SCHEDULER_H_
+#define TCMALLOC_BACKGROUND_SCHEDULER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Runs a periodic action of the background thread once it is triggered, but
+// no more often than once per minimum period and at least once per maximum
+// period.  With equal periods, the action runs at a fixed period.
+class BackgroundAction {
+ public:
+  explicit BackgroundAction(absl::Time now) : last_run_(now) {}
+
+  // Returns whether the action should run at `now`, and if so, records that
+  // it did.
+  bool Due(absl::Time now, absl::Duration min_period,
+           absl::Duration max_period, bool triggered) {
+    const absl::Duration since = now - last_run_;
+    if (since < min_period || (since < max_period && !triggered)) {
+      return false;
+    }
+    last_run_ = now;
+    return true;
+  }
+
+ private:
+  absl::Time last_run_;
+};
+
+// Decides how long the background thread sleeps between iterations.
+//
+// Each iteration reports the events it has seen.  An iteration is idle if none
+// of them asks for work: no per-cpu cache missed, no release is queued, memory
+// usage is not close to a limit, and no action is underway.  When event
+// driven, the sleep doubles after each idle iteration, up to kMaxSleepMultiple
+// sleep intervals, and goes back to one sleep interval after any other one.
+// This keeps idle processes from being woken up for nothing, while the
+// actions of a busy process run as often as ever.
+class BackgroundScheduler {
+ public:
+  static constexpr int kMaxSleepMultiple = 16;
+
+  // The events seen by an iteration of the background thread.
+  struct Events {
+    // Per-cpu cache underflows and overflows so far.
+    uint64_t cache_misses = 0;
+    // Bytes queued for release by ReleaseMemoryToSystem.
+    size_t queued_release = 0;
+    // Whether memory usage is close to the soft or hard memory limit.
+    bool near_limit = false;
+    // Whether an action is underway that carries on in the next iteration.
+    bool work_in_progress = false;
+  };
+
+  constexpr BackgroundScheduler() = default;
+
+  // Records an iteration at `now` with the events it has seen, and returns
+  // how long to sleep before the next one.
+  absl::Duration Iterate(absl::Time now, const Events& events,
+                         absl::Duration interval, bool event_driven) {
+    const uint64_t misses = events.cache_misses >= last_cache_misses_
+                                ? events.cache_misses - last_cache_misses_
+                                : events.cache_misses;
+    const double seconds = absl::ToDoubleSeconds(now - last_iteration_);
+    const double miss_rate = seconds > 0 ? misses / seconds : 0;
+    miss_spike_ = misses >= kMinSpikeMisses && miss_rate >= 2 * miss_rate_;
+    miss_rate_ = miss_rate;
+    last_cache_misses_ = events.cache_misses;
+    last_iteration_ = now;
+
+    const bool idle = misses == 0 && events.queued_release == 0 &&
+                      !events.near_limit && !events.work_in_progress;
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+    if (idle) {
+      idle_wakeups_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    sleep_multiple_ = event_driven && idle
+                          ? std::min(2 * sleep_multiple_, kMaxSleepMultiple)
+                          : 1;
+    const absl::Duration sleep = sleep_multiple_ * interval;
+    sleep_ms_.store(absl::ToInt64Milliseconds(sleep),
+                    std::memory_order_relaxed);
+    return sleep;
+  }
+
+  // Whether the miss rate of the per-cpu caches at least doubled in the last
+  // iteration.  Actions that respond to misses run early on a spike.
+  bool miss_spike() const { return miss_spike_; }
+
+  struct Stats {
+    uint64_t wakeups;
+    uint64_t idle_wakeups;
+    // The sleep after the last iteration.
+    int64_t sleep_ms;
+  };
+
+  // May be called from any thread.
+  Stats GetStats() const {
+    return {.wakeups = wakeups_.load(std::memory_order_relaxed),
+            .idle_wakeups = idle_wakeups_.load(std::memory_order_relaxed),
+            .sleep_ms = sleep_ms_.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  // Fewer misses than this are noise, not a spike.
+  static constexpr uint64_t kMinSpikeMisses = 1000;
+
+  // Only accessed by the background thread.
+  absl::Time last_iteration_ = absl::InfinitePast();
+  uint64_t last_cache_misses_ = 0;
+  double miss_rate_ = 0;
+  bool miss_spike_ = false;
+  int sleep_multiple_ = 1;
+
+  std::atomic<uint64_t> wakeups_{0};
+  std::atomic<uint64_t> idle_wakeups_{0};
+  std::atomic<int64_t> sleep_ms_{0};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_BACKGROUND_SCHEDULER_H_
@@ -0,0 +1,133 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/background_scheduler.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr absl::Duration kInterval = absl::Seconds(1);
+
+TEST(BackgroundSchedulerTest, BacksOffWhileIdle) {
+  BackgroundScheduler scheduler;
+  absl::Time now = absl::UnixEpoch();
+  const BackgroundScheduler::Events idle;
+
+  absl::Duration expected = kInterval;
+  for (int i = 0; i < 10; ++i) {
+    expected = std::min(2 * expected,
+                        BackgroundScheduler::kMaxSleepMultiple * kInterval);
+    EXPECT_EQ(scheduler.Iterate(now, idle, kInterval, true), expected);
+    now += expected;
+  }
+
+  BackgroundScheduler::Events busy;
+  busy.queued_release = 1;
+  EXPECT_EQ(scheduler.Iterate(now, busy, kInterval, true), kInterval);
+
+  const BackgroundScheduler::Stats stats = scheduler.GetStats();
+  EXPECT_EQ(stats.wakeups, 11);
+  EXPECT_EQ(stats.idle_wakeups, 10);
+  EXPECT_EQ(stats.sleep_ms, absl::ToInt64Milliseconds(kInterval));
+}
+
+TEST(BackgroundSchedulerTest, FixedIntervalUnlessEventDriven) {
+  BackgroundScheduler scheduler;
+  absl::Time now = absl::UnixEpoch();
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(scheduler.Iterate(now, {}, kInterval, false), kInterval);
+    now += kInterval;
+  }
+  EXPECT_EQ(scheduler.GetStats().idle_wakeups, 5);
+}
+
+TEST(BackgroundSchedulerTest, AnyEventEndsBackoff) {
+  BackgroundScheduler::Events events[4];
+  events[0].cache_misses = 1;
+  events[1].queued_release = 1;
+  events[2].near_limit = true;
+  events[3].work_in_progress = true;
+
+  for (const BackgroundScheduler::Events& event : events) {
+    BackgroundScheduler scheduler;
+    absl::Time now = absl::UnixEpoch();
+    EXPECT_EQ(scheduler.Iterate(now, {}, kInterval, true), 2 * kInterval);
+    now += 2 * kInterval;
+    EXPECT_EQ(scheduler.Iterate(now, event, kInterval, true), kInterval);
+  }
+}
+
+TEST(BackgroundSchedulerTest, DetectsMissSpikes) {
+  BackgroundScheduler scheduler;
+  absl::Time now = absl::UnixEpoch();
+  BackgroundScheduler::Events events;
+  scheduler.Iterate(now, events, kInterval, true);
+
+  // A steady miss rate is not a spike.
+  for (int i = 0; i < 3; ++i) {
+    now += kInterval;
+    events.cache_misses += 10000;
+    scheduler.Iterate(now, events, kInterval, true);
+  }
+  EXPECT_FALSE(scheduler.miss_spike());
+
+  now += kInterval;
+  events.cache_misses += 20000;
+  scheduler.Iterate(now, events, kInterval, true);
+  EXPECT_TRUE(scheduler.miss_spike());
+
+  now += kInterval;
+  events.cache_misses += 20000;
+  scheduler.Iterate(now, events, kInterval, true);
+  EXPECT_FALSE(scheduler.miss_spike());
+
+  // Too few misses are noise, however fast they grow.
+  BackgroundScheduler quiet;
+  BackgroundScheduler::Events few;
+  quiet.Iterate(now, few, kInterval, true);
+  few.cache_misses = 100;
+  quiet.Iterate(now + kInterval, few, kInterval, true);
+  EXPECT_FALSE(quiet.miss_spike());
+}
+
+TEST(BackgroundActionTest, RunsBetweenMinAndMaxPeriods) {
+  const absl::Time start = absl::UnixEpoch();
+  BackgroundAction action(start);
+  const absl::Duration min_period = absl::Seconds(1);
+  const absl::Duration max_period = absl::Seconds(5);
+
+  // Not before the minimum period, even when triggered.
+  EXPECT_FALSE(action.Due(start + absl::Milliseconds(500), min_period,
+                          max_period, true));
+  // Early once triggered.
+  EXPECT_FALSE(
+      action.Due(start + absl::Seconds(2), min_period, max_period, false));
+  EXPECT_TRUE(
+      action.Due(start + absl::Seconds(2), min_period, max_period, true));
+  // At the maximum period regardless.
+  EXPECT_FALSE(
+      action.Due(start + absl::Seconds(6), min_period, max_period, false));
+  EXPECT_TRUE(
+      action.Due(start + absl::Seconds(7), min_period, max_period, false));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
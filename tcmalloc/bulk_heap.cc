@@ -0,0 +1,149 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/bulk_heap.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <new>
+
+#include "absl/base/attributes.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/numeric/bits.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/page_heap_allocator.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+ABSL_CONST_INIT PageHeapAllocator<BulkHeap> heap_allocator
+    ABSL_GUARDED_BY(pageheap_lock);
+ABSL_CONST_INIT bool heap_allocator_inited ABSL_GUARDED_BY(pageheap_lock) =
+    false;
+
+// Returns a block of whole hugepages holding at least `bytes`.  Exact
+// multiples of a hugepage come straight from the HugeCache, rather than from
+// the filler or a region.
+Span* NewBlock(size_t bytes) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+  const Length pages = HLFromPages(BytesToLengthCeil(bytes)).in_pages();
+  MemoryTag tag = MemoryTag::kNormal;
+  if (tc_globals.numa_topology().numa_aware()) {
+    tag = NumaNormalTag(tc_globals.numa_topology().GetCurrentPartition());
+  }
+  return tc_globals.page_allocator().New(
+      pages, {1, AccessDensityPrediction::kDense}, tag);
+}
+
+}  // namespace
+
+BulkHeap* BulkHeap::Create() {
+  tc_globals.InitIfNecessary();
+
+  PageHeapSpinLockHolder l;
+  if (!heap_allocator_inited) {
+    heap_allocator.Init(&tc_globals.arena());
+    heap_allocator_inited = true;
+  }
+  return new (heap_allocator.New()) BulkHeap();
+}
+
+void BulkHeap::Destroy(BulkHeap* heap) {
+  AllocationGuardSpinLockHolder h(&heap->lock_);
+  PageHeapSpinLockHolder l;
+  while (!heap->blocks_.empty()) {
+    Span* block = heap->blocks_.first();
+    heap->blocks_.remove(block);
+    tc_globals.page_allocator().Delete(block, /*objects_per_span=*/1,
+                                       GetMemoryTag(block->start_address()));
+  }
+  heap->~BulkHeap();
+  heap_allocator.Delete(heap);
+}
+
+void* BulkHeap::TryAllocateLocked(size_t size, size_t alignment) {
+  if (cursor_ == 0) return nullptr;
+  const uintptr_t start = (cursor_ + alignment - 1) & ~(alignment - 1);
+  if (start > limit_ || limit_ - start < size) return nullptr;
+  cursor_ = start + size;
+  allocated_bytes_ += size;
+  return reinterpret_cast<void*>(start);
+}
+
+void* BulkHeap::Allocate(size_t size, size_t alignment) {
+  TC_ASSERT(absl::has_single_bit(alignment));
+  TC_ASSERT_LE(alignment, kBlockSize);
+  size = std::max<size_t>(size, 1);
+  {
+    AllocationGuardSpinLockHolder h(&lock_);
+    if (void* ptr = TryAllocateLocked(size, alignment)) {
+      return ptr;
+    }
+  }
+
+  // Sharing a block with an allocation of more than half of it would waste
+  // much of the block, so such allocations get a block of their own.  Blocks
+  // are hugepage aligned, which satisfies any alignment we accept.
+  const bool dedicated = size > kBlockSize / 2;
+  Span* block = NewBlock(dedicated ? size : kBlockSize);
+  if (block == nullptr) {
+    return nullptr;
+  }
+
+  AllocationGuardSpinLockHolder h(&lock_);
+  blocks_.prepend(block);
+  backing_bytes_ += block->bytes_in_span();
+  const uintptr_t start = reinterpret_cast<uintptr_t>(block->start_address());
+  const uintptr_t end = start + block->bytes_in_span();
+  if (!dedicated) {
+    // Another thread may have started a block of its own meanwhile, in which
+    // case the rest of that block goes unused.
+    cursor_ = start;
+    limit_ = end;
+    void* ptr = TryAllocateLocked(size, alignment);
+    TC_ASSERT_NE(ptr, nullptr);
+    return ptr;
+  }
+
+  allocated_bytes_ += size;
+  // Allocate from the rest of the block's last hugepage, if that leaves more
+  // room than the current block.
+  if (end - (start + size) > limit_ - cursor_) {
+    cursor_ = start + size;
+    limit_ = end;
+  }
+  return block->start_address();
+}
+
+size_t BulkHeap::allocated_bytes() const {
+  AllocationGuardSpinLockHolder h(&lock_);
+  return allocated_bytes_;
+}
+
+size_t BulkHeap::backing_bytes() const {
+  AllocationGuardSpinLockHolder h(&lock_);
+  return backing_bytes_;
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
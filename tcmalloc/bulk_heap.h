@@ -0,0 +1,86 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_BULK_HEAP_H_
+#define TCMALLOC_BULK_HEAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/span.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// BulkHeap carves allocations out of whole hugepages of its own, which go back
+// to the page heap together when the heap is destroyed, rather than object by
+// object.  The hugepages are page-level allocations of normal memory, taken
+// directly from the HugePageAwareAllocator's HugeCache, so that a destroyed
+// heap leaves no partially used hugepage behind.
+//
+// Allocations are bump allocated, and are neither sampled nor individually
+// freed.
+class BulkHeap {
+ public:
+  // The size of the blocks of hugepages allocations are carved from.  Larger
+  // allocations get blocks of their own.
+  static constexpr size_t kBlockSize = kHugePageSize;
+
+  // Returns a new, empty heap, or nullptr if we are out of memory.
+  static BulkHeap* Create() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns the hugepages of `heap` to the page heap and destroys it.
+  static void Destroy(BulkHeap* heap) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns `size` bytes aligned to `alignment`, a power of two no larger than
+  // kBlockSize, or nullptr if we are out of memory.  Safe to call from several
+  // threads at once.
+  void* Allocate(size_t size, size_t alignment)
+      ABSL_LOCKS_EXCLUDED(lock_, pageheap_lock);
+
+  // Returns the number of bytes handed out by Allocate().
+  size_t allocated_bytes() const ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the number of bytes of hugepages backing the heap.
+  size_t backing_bytes() const ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  BulkHeap() = default;
+  ~BulkHeap() = default;
+
+  // Bump allocates from the current block, returning nullptr if it does not
+  // have room.
+  void* TryAllocateLocked(size_t size, size_t alignment)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable absl::base_internal::SpinLock lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  // The blocks of the heap.
+  SpanList blocks_ ABSL_GUARDED_BY(lock_);
+  // The unused part of the current block.
+  uintptr_t cursor_ ABSL_GUARDED_BY(lock_) = 0;
+  uintptr_t limit_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t allocated_bytes_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t backing_bytes_ ABSL_GUARDED_BY(lock_) = 0;
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_BULK_HEAP_H_
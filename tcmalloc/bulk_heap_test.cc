@@ -0,0 +1,124 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/bulk_heap.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/common.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+TEST(BulkHeapTest, SmallAllocations) {
+  BulkHeap* heap = BulkHeap::Create();
+  ASSERT_NE(heap, nullptr);
+  EXPECT_EQ(heap->allocated_bytes(), 0);
+  EXPECT_EQ(heap->backing_bytes(), 0);
+
+  constexpr int kAllocations = 10000;
+  size_t total = 0;
+  std::vector<char*> ptrs;
+  for (int i = 0; i < kAllocations; ++i) {
+    const size_t size = 1 + i % 500;
+    const size_t alignment = size_t{1} << (i % 7);
+    char* ptr = static_cast<char*>(heap->Allocate(size, alignment));
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+    memset(ptr, i & 0xff, size);
+    ptrs.push_back(ptr);
+    total += size;
+  }
+  // Allocations do not overlap.
+  for (int i = 0; i < kAllocations; ++i) {
+    EXPECT_EQ(static_cast<unsigned char>(*ptrs[i]), i & 0xff);
+  }
+
+  EXPECT_EQ(heap->allocated_bytes(), total);
+  EXPECT_GE(heap->backing_bytes(), total);
+  EXPECT_EQ(heap->backing_bytes() % kHugePageSize, 0);
+  BulkHeap::Destroy(heap);
+}
+
+TEST(BulkHeapTest, LargeAllocations) {
+  BulkHeap* heap = BulkHeap::Create();
+  ASSERT_NE(heap, nullptr);
+
+  // Larger than half a block, so the allocation gets a block of its own.
+  const size_t size = 3 * kHugePageSize + 123;
+  char* large = static_cast<char*>(heap->Allocate(size, kHugePageSize));
+  ASSERT_NE(large, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(large) % kHugePageSize, 0);
+  memset(large, 1, size);
+  EXPECT_EQ(heap->backing_bytes(), 4 * kHugePageSize);
+
+  // The rest of the large allocation's last hugepage is used for smaller ones.
+  char* small = static_cast<char*>(heap->Allocate(64, 64));
+  ASSERT_NE(small, nullptr);
+  EXPECT_GE(small, large + size);
+  EXPECT_LT(small, large + 4 * kHugePageSize);
+  EXPECT_EQ(heap->backing_bytes(), 4 * kHugePageSize);
+  EXPECT_EQ(heap->allocated_bytes(), size + 64);
+  BulkHeap::Destroy(heap);
+}
+
+TEST(BulkHeapTest, Threads) {
+  BulkHeap* heap = BulkHeap::Create();
+  ASSERT_NE(heap, nullptr);
+
+  constexpr int kThreads = 4;
+  constexpr int kAllocations = 10000;
+  constexpr size_t kSize = 1024;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([heap] {
+      for (int j = 0; j < kAllocations; ++j) {
+        void* ptr = heap->Allocate(kSize, 16);
+        ASSERT_NE(ptr, nullptr);
+        memset(ptr, j & 0xff, kSize);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(heap->allocated_bytes(), kThreads * kAllocations * kSize);
+  BulkHeap::Destroy(heap);
+}
+
+TEST(BulkHeapTest, Independent) {
+  BulkHeap* a = BulkHeap::Create();
+  BulkHeap* b = BulkHeap::Create();
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  ASSERT_NE(a->Allocate(100, 8), nullptr);
+  ASSERT_NE(b->Allocate(100, 8), nullptr);
+
+  // Destroying one heap leaves the other usable.
+  BulkHeap::Destroy(a);
+  void* ptr = b->Allocate(100, 8);
+  ASSERT_NE(ptr, nullptr);
+  memset(ptr, 0, 100);
+  EXPECT_EQ(b->allocated_bytes(), 200);
+  BulkHeap::Destroy(b);
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
@@ -16,17 +16,21 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <new>
 
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/experiment.h"
+#include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/prefetch.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/parameters.h"
 #include "tcmalloc/selsan/selsan.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/static_vars.h"
@@ -58,12 +62,18 @@ Length StaticForwarder::class_to_pages(int size_class) {
 }
 
 void StaticForwarder::MapObjectsToSpans(absl::Span<void*> batch, Span** spans) {
-  // Prefetch Span objects to reduce cache misses.
+  // Prefetch Span objects to reduce cache misses. Consecutive objects on the
+  // same page share a pagemap lookup.
+  PageId prev_page;
+  Span* span = nullptr;
   for (int i = 0; i < batch.size(); ++i) {
     const PageId p = PageIdContaining(batch[i]);
-    Span* span = tc_globals.pagemap().GetExistingDescriptor(p);
-    TC_ASSERT_NE(span, nullptr);
-    span->Prefetch();
+    if (span == nullptr || p != prev_page) {
+      span = tc_globals.pagemap().GetExistingDescriptor(p);
+      TC_ASSERT_NE(span, nullptr);
+      span->Prefetch();
+      prev_page = p;
+    }
     spans[i] = span;
   }
 }
@@ -75,7 +85,14 @@ Span* StaticForwarder::AllocateSpan(int size_class,
   Span* span =
       tc_globals.page_allocator().New(pages_per_span, span_alloc_info, tag);
   if (ABSL_PREDICT_FALSE(span == nullptr)) {
-    return nullptr;
+    // Free spans held back by the central freelists may be all that stands
+    // between us and the limit.
+    tc_globals.transfer_cache().ReturnDeferredSpans();
+    span =
+        tc_globals.page_allocator().New(pages_per_span, span_alloc_info, tag);
+    if (span == nullptr) {
+      return nullptr;
+    }
   }
   TC_ASSERT_EQ(tag, GetMemoryTag(span->start_address()));
   TC_ASSERT_EQ(span->num_pages(), pages_per_span);
@@ -119,6 +136,51 @@ void StaticForwarder::DeallocateSpans(int size_class, size_t objects_per_span,
   ReturnSpansToPageHeap(tag, free_spans, objects_per_span);
 }
 
+size_t StaticForwarder::num_sub_lists(int size_class) {
+  // Lacking a profile at startup, we take the smallest size classes as the
+  // hot ones. Splitting costs each of them up to kMaxSubLists partially used
+  // spans.
+  static constexpr size_t kMaxSplitObjectSize = 64;
+  if (!IsExperimentActive(
+          Experiment::TEST_ONLY_TCMALLOC_SPLIT_CENTRAL_FREELIST) ||
+      IsExpandedSizeClass(size_class)) {
+    return 0;
+  }
+  const size_t size = class_to_size(size_class);
+  if (size == 0 || size > kMaxSplitObjectSize) {
+    return 0;
+  }
+  return kMaxSubLists;
+}
+
+size_t StaticForwarder::max_deferred_spans(int size_class) {
+  // Bound the memory held back per size class, so that classes with large
+  // spans do not pin much of the heap.
+  static constexpr size_t kMaxDeferredBytes = 64 << 10;
+  if (!IsExperimentActive(
+          Experiment::TEST_ONLY_TCMALLOC_DEFERRED_SPAN_RETURNS)) {
+    return 0;
+  }
+  return kMaxDeferredBytes / class_to_pages(size_class).in_bytes();
+}
+
+bool StaticForwarder::adaptive_span_sizes(int size_class) {
+  return IsExperimentActive(
+             Experiment::TEST_ONLY_TCMALLOC_ADAPTIVE_SPAN_SIZES) &&
+         !IsExpandedSizeClass(size_class);
+}
+
+LifetimePrediction StaticForwarder::PredictLifetime(int size_class) {
+  if (!Parameters::lifetime_aware_span_placement()) {
+    return LifetimePrediction::kUnknown;
+  }
+  return tc_globals.size_class_lifetimes().Predict(size_class);
+}
+
+void* StaticForwarder::AllocSubLists(size_t size, std::align_val_t alignment) {
+  return tc_globals.arena().Alloc(size, alignment, ArenaUse::kTransferCache);
+}
+
 }  // namespace central_freelist_internal
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
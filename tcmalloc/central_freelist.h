@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <new>
 
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
@@ -30,13 +31,18 @@
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/hinted_tracker_lists.h"
+#include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/atomic_stats_counter.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/linked_list.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/prefetch.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/selsan/selsan.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/span.h"
 #include "tcmalloc/span_stats.h"
 
@@ -65,15 +71,53 @@ class StaticForwarder {
   static void DeallocateSpans(int size_class, size_t objects_per_span,
                               absl::Span<Span*> free_spans)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns the number of independently locked sub-lists the freelist for
+  // size_class is split into, or 0 if it is not split.
+  static size_t num_sub_lists(int size_class);
+  static void* AllocSubLists(size_t size, std::align_val_t alignment)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Returns the lifetime sampled objects of size_class are predicted to have,
+  // or kUnknown if lifetime-aware span placement is disabled.
+  static LifetimePrediction PredictLifetime(int size_class);
+
+  // Returns how many free spans of size_class may be held back and returned
+  // to the page heap together, or 0 if they are returned immediately.
+  static size_t max_deferred_spans(int size_class);
+
+  // Returns true if the spans of size_class may grow bigger than
+  // class_to_pages while they run full, see UpdateSpanSize.
+  static bool adaptive_span_sizes(int size_class);
 };
 
+// Sub-lists of a split CentralFreeList never talk to the page heap themselves;
+// their parent allocates and returns spans on their behalf.
+struct SubListForwarder {};
+
 // Specifies number of nonempty_ lists that keep track of non-empty spans.
 static constexpr size_t kNumLists = 8;
 
+// Specifies the maximum number of sub-lists a CentralFreeList is split into.
+static constexpr size_t kMaxSubLists = 4;
+
+// Specifies the maximum number of free spans a CentralFreeList holds back
+// before returning them to the page heap.
+static constexpr size_t kMaxDeferredSpans = 8;
+
 // Specifies the threshold for number of objects per span. The threshold is
 // used to consider a span sparsely- vs. densely-accessed.
 static constexpr size_t kFewObjectsAllocMaxLimit = 16;
 
+// With adaptive span sizes, a size class switches to bigger spans once it
+// allocates at least kMinNewSpansForBigSpans spans between two calls to
+// UpdateSpanSize while its live spans are at least kBigSpanMinOccupancy
+// percent full, and back to its base span size once they fall below
+// kBaseSpanMaxOccupancy percent.
+static constexpr size_t kMinNewSpansForBigSpans = 8;
+static constexpr size_t kBigSpanMinOccupancy = 90;
+static constexpr size_t kBaseSpanMaxOccupancy = 75;
+
 // Data kept per size-class in central cache.
 template <typename ForwarderT>
 class CentralFreeList {
@@ -107,8 +151,30 @@ class CentralFreeList {
   ABSL_MUST_USE_RESULT int RemoveRange(void** batch, int N)
       ABSL_LOCKS_EXCLUDED(lock_);
 
+  // Unless the freelist has free objects to hand out, allocates a span and
+  // pushes all of its objects onto objects, for a per-cpu cache to own. The
+  // span is recorded as fully allocated, so objects freed from it come back
+  // to it here like any others. Returns the number of objects pushed.
+  ABSL_MUST_USE_RESULT int RemoveSpan(LinkedList& objects)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the spans held back by InsertRange to the page heap.
+  void ReturnDeferredSpans() ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Picks the size of the spans allocated from now on, based on how full the
+  // live spans are and how many were allocated since the last call. Called
+  // periodically. Does nothing unless the forwarder enabled adaptive span
+  // sizes for this size class and it can use bigger spans.
+  void UpdateSpanSize() ABSL_LOCKS_EXCLUDED(lock_);
+
   // Returns the number of free objects in cache.
-  size_t length() const { return static_cast<size_t>(counter_.value()); }
+  size_t length() const {
+    size_t length = static_cast<size_t>(counter_.value());
+    for (size_t i = 0; i < num_sub_lists_; ++i) {
+      length += sub_lists_[i].length();
+    }
+    return length;
+  }
 
   // Returns the memory overhead (internal fragmentation) attributable
   // to the freelist.  This is memory lost when the size of elements
@@ -135,10 +201,69 @@ class CentralFreeList {
   Forwarder& forwarder() { return forwarder_; }
 
  private:
-  // Release an object to spans.
-  // Returns object's span if it become completely free.
-  Span* ReleaseToSpans(void* object, Span* span, size_t object_size,
-                       uint32_t size_reciprocal, uint32_t max_span_cache_size)
+  template <typename>
+  friend class CentralFreeList;
+
+  using SubList = CentralFreeList<SubListForwarder>;
+
+  // Copies the immutable parameters of parent into this sub-list.
+  template <typename ParentForwarder>
+  void InitSubList(const CentralFreeList<ParentForwarder>& parent)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the sub-list owning span. Ownership is derived from the span's
+  // address, so that objects freed from any CPU find their way back.
+  // REQUIRES: num_sub_lists_ > 0.
+  size_t SubListFor(const Span* span) const {
+    const uint64_t hash =
+        span->first_page().index() * uint64_t{0x9E3779B97F4A7C15};
+    return (hash >> 32) % num_sub_lists_;
+  }
+
+  // Split variants of InsertRange and RemoveRange. Objects are released to
+  // the sub-list owning their span, and allocated starting from the sub-list
+  // of the current CPU.
+  void InsertRangeIntoSubLists(absl::Span<void*> batch, Span** spans);
+  int RemoveRangeFromSubLists(void** batch, int N);
+
+  // Release the objects in batch, which belong to spans, under lock_. Spans
+  // that become completely free are stored in free_spans, which may alias
+  // spans, and their number is returned.
+  int ReleaseBatch(absl::Span<void*> batch, Span** spans,
+                   uint32_t max_span_cache_size, Span** free_spans)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns free_spans, which InsertRange just emptied, to the page heap.
+  // While fewer than max_deferred_spans_ are pending, the spans are held back
+  // instead, so that a burst of frees takes pageheap_lock once rather than
+  // once per InsertRange.
+  void DeallocateSpans(absl::Span<Span*> free_spans) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Fill a prefix of batch[0..N-1] with up to N elements from the spans
+  // already in nonempty_, without fetching new spans. RemoveFromSpans also
+  // updates the object count. Both return the number of elements removed.
+  int PopFromSpans(void** batch, int N) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  int RemoveFromSpans(void** batch, int N) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Fill a prefix of batch[0..N-1] with up to N elements from span, which was
+  // just allocated from the page heap, and add the rest of it to nonempty_.
+  // Returns the number of elements removed.
+  int AdoptSpan(Span* span, void** batch, int N, uint32_t max_span_cache_size)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Records span, all of whose objects RemoveSpan just handed out.
+  void AdoptExhaustedSpan(Span* span) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Records a span from which allocated objects were just built, adding it
+  // to nonempty_ unless it is already exhausted.
+  void AddPopulatedSpan(Span* span, uint16_t allocated)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Release objects, which all belong to span, to it.
+  // Returns span if it become completely free.
+  Span* ReleaseToSpans(absl::Span<void* const> objects, Span* span,
+                       size_t object_size, uint32_t size_reciprocal,
+                       uint32_t max_span_cache_size)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
   // Populate cache by fetching from the page heap.
@@ -147,8 +272,42 @@ class CentralFreeList {
   // freelist. Returns the number of elements removed.
   int Populate(void** batch, int N) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
-  // Allocate a span from the forwarder.
-  Span* AllocateSpan();
+  // Allocate a span of pages_per_span pages, holding objects_per_span
+  // objects, from the forwarder.
+  Span* AllocateSpan(Length pages_per_span, size_t objects_per_span);
+
+  // Predicts whether a new span of pages_per_span pages, holding
+  // objects_per_span objects, will be densely accessed.
+  AccessDensityPrediction PredictDensity(Length pages_per_span,
+                                         size_t objects_per_span) const;
+
+  // Returns the number of objects span holds. Spans are either
+  // pages_per_span_ or big_pages_per_span_ long.
+  size_t ObjectsPerSpan(const Span* span) const {
+    if (ABSL_PREDICT_TRUE(big_objects_per_span_ == 0) ||
+        span->num_pages() != big_pages_per_span_) {
+      return objects_per_span_;
+    }
+    return big_objects_per_span_;
+  }
+
+  // Returns the number of objects spans hold.
+  size_t ObjectsInSpans(absl::Span<Span* const> spans) const {
+    return spans.size() * objects_per_span_ +
+           NumBigSpans(spans) * (big_objects_per_span_ - objects_per_span_);
+  }
+
+  // Returns the number of spans that are big_pages_per_span_ long.
+  size_t NumBigSpans(absl::Span<Span* const> spans) const {
+    if (ABSL_PREDICT_TRUE(big_objects_per_span_ == 0)) {
+      return 0;
+    }
+    size_t num_big_spans = 0;
+    for (const Span* span : spans) {
+      num_big_spans += span->num_pages() == big_pages_per_span_;
+    }
+    return num_big_spans;
+  }
 
   // Parses nonempty_ lists and returns span from the list with the lowest
   // possible index.
@@ -189,12 +348,25 @@ class CentralFreeList {
   // Size reciprocal is used to replace division with multiplication when
   // computing object indices in the Span bitmap.
   uint32_t size_reciprocal_ = 0;
+  // Span freelist operations for object_size_, specialized for the hottest
+  // sizes.
+  Span::FreelistOps freelist_ops_ = {};
   // Hint used for parsing through the nonempty_ lists. This prevents us from
   // parsing the lists with an index starting zero, if the lowest possible index
   // is higher than that.
   size_t first_nonempty_index_;
   Length pages_per_span_;
 
+  // Spans of size classes that adapt their span size are either
+  // pages_per_span_ or big_pages_per_span_ long. big_objects_per_span_ is 0
+  // for other size classes. Both are immutable after Init().
+  Length big_pages_per_span_;
+  size_t big_objects_per_span_ = 0;
+  // Whether Populate allocates big spans.
+  bool use_big_spans_ ABSL_GUARDED_BY(lock_) = false;
+  // num_spans_requested_ as of the last UpdateSpanSize.
+  size_t last_spans_requested_ ABSL_GUARDED_BY(lock_) = 0;
+
   size_t num_spans() const {
     size_t requested = num_spans_requested_.value();
     size_t returned = num_spans_returned_.value();
@@ -202,15 +374,22 @@ class CentralFreeList {
     return (requested - returned);
   }
 
-  void RecordSpanAllocated() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
-    counter_.LossyAdd(objects_per_span_);
+  void RecordSpanAllocated(Span* span) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    const size_t objects_per_span = ObjectsPerSpan(span);
+    counter_.LossyAdd(objects_per_span);
     num_spans_requested_.LossyAdd(1);
+    if (ABSL_PREDICT_FALSE(objects_per_span != objects_per_span_)) {
+      num_big_spans_.LossyAdd(1);
+    }
   }
 
-  void RecordMultiSpansDeallocated(size_t num_spans_returned)
+  void RecordMultiSpansDeallocated(absl::Span<Span* const> spans)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
-    counter_.LossyAdd(-num_spans_returned * objects_per_span_);
-    num_spans_returned_.LossyAdd(num_spans_returned);
+    counter_.LossyAdd(-ObjectsInSpans(spans));
+    num_spans_returned_.LossyAdd(spans.size());
+    if (ABSL_PREDICT_FALSE(big_objects_per_span_ != 0)) {
+      num_big_spans_.LossyAdd(-NumBigSpans(spans));
+    }
   }
 
   void UpdateObjectCounts(int num) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
@@ -227,6 +406,8 @@ class CentralFreeList {
 
   StatsCounter num_spans_requested_;
   StatsCounter num_spans_returned_;
+  // Live spans that are big_pages_per_span_ long.
+  StatsCounter num_big_spans_;
 
   // Records histogram of span utilization.
   //
@@ -268,6 +449,19 @@ class CentralFreeList {
 #endif
   bool use_all_buckets_for_few_object_spans_;
 
+  // Hot size classes may be split into num_sub_lists_ sub-lists, each with
+  // its own spans and lock, so that concurrent bulk frees do not serialize on
+  // lock_. When split, all spans live in the sub-lists and this list's own
+  // nonempty_ and counters stay empty. Immutable after Init().
+  SubList* sub_lists_ = nullptr;
+  size_t num_sub_lists_ = 0;
+
+  // Free spans not yet returned to the page heap. Their objects are still
+  // counted in counter_. max_deferred_spans_ is immutable after Init().
+  Span* deferred_spans_[kMaxDeferredSpans] ABSL_GUARDED_BY(lock_) = {};
+  size_t num_deferred_spans_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t max_deferred_spans_ = 0;
+
   ABSL_ATTRIBUTE_NO_UNIQUE_ADDRESS Forwarder forwarder_;
 };
 
@@ -288,6 +482,7 @@ inline void CentralFreeList<Forwarder>::Init(
   objects_per_span_ =
       pages_per_span_.in_bytes() / (object_size_ ? object_size_ : 1);
   size_reciprocal_ = Span::CalcReciprocal(object_size_);
+  freelist_ops_ = Span::FreelistOpsFor(object_size_);
   use_all_buckets_for_few_object_spans_ =
       use_all_buckets_for_few_object_spans &&
       objects_per_span_ <= 2 * kNumLists;
@@ -304,12 +499,81 @@ inline void CentralFreeList<Forwarder>::Init(
                 std::min<size_t>(absl::bit_width(objects_per_span_), kNumLists);
 
   TC_ASSERT(absl::bit_width(objects_per_span_) <= kSpanUtilBucketCapacity);
+
+  // Spans holding a single object bypass the lists entirely, so there is
+  // nothing to defer or split for them.
+  max_deferred_spans_ =
+      objects_per_span_ == 1
+          ? 0
+          : std::min(forwarder_.max_deferred_spans(size_class),
+                     kMaxDeferredSpans);
+  const size_t num_sub_lists =
+      std::min(forwarder_.num_sub_lists(size_class), kMaxSubLists);
+
+  // Bigger spans are limited to size classes that neither embed their
+  // freelist in the objects, which needs single-page spans, nor are split.
+  // Spans of their base size have enough objects for both sizes to index
+  // nonempty_ by bitwidth, and to count as dense.
+  big_pages_per_span_ = Length(0);
+  big_objects_per_span_ = 0;
+  if (forwarder_.adaptive_span_sizes(size_class) && num_sub_lists < 2 &&
+      Span::IsNonIntrusive(object_size_) &&
+      objects_per_span_ > std::max(2 * kNumLists, kFewObjectsAllocMaxLimit)) {
+    // Use the largest multiple of the base size that the bitmap can track.
+    for (Length pages = pages_per_span_ + pages_per_span_;
+         Span::IsValidSizeClass(object_size_, pages.raw_num());
+         pages += pages_per_span_) {
+      big_pages_per_span_ = pages;
+    }
+    if (big_pages_per_span_ != Length(0)) {
+      big_objects_per_span_ = big_pages_per_span_.in_bytes() / object_size_;
+      // Fuller spans of the big size are indexed below the fullest ones of
+      // the base size.
+      first_nonempty_index_ =
+          kNumLists - std::min<size_t>(absl::bit_width(big_objects_per_span_),
+                                       kNumLists);
+      TC_ASSERT(absl::bit_width(big_objects_per_span_) <=
+                kSpanUtilBucketCapacity);
+    }
+  }
+
+  if (num_sub_lists < 2 || objects_per_span_ == 1) {
+    return;
+  }
+  // Init may be called more than once for the same list.
+  if (sub_lists_ == nullptr) {
+    sub_lists_ = reinterpret_cast<SubList*>(forwarder_.AllocSubLists(
+        sizeof(SubList) * kMaxSubLists, std::align_val_t{alignof(SubList)}));
+    for (size_t i = 0; i < kMaxSubLists; ++i) {
+      new (&sub_lists_[i]) SubList();
+    }
+  }
+  for (size_t i = 0; i < num_sub_lists; ++i) {
+    sub_lists_[i].InitSubList(*this);
+  }
+  num_sub_lists_ = num_sub_lists;
+}
+
+template <class Forwarder>
+template <typename ParentForwarder>
+inline void CentralFreeList<Forwarder>::InitSubList(
+    const CentralFreeList<ParentForwarder>& parent)
+    ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  size_class_ = parent.size_class_;
+  object_size_ = parent.object_size_;
+  objects_per_span_ = parent.objects_per_span_;
+  size_reciprocal_ = parent.size_reciprocal_;
+  freelist_ops_ = parent.freelist_ops_;
+  first_nonempty_index_ = parent.first_nonempty_index_;
+  pages_per_span_ = parent.pages_per_span_;
+  use_all_buckets_for_few_object_spans_ =
+      parent.use_all_buckets_for_few_object_spans_;
 }
 
 template <class Forwarder>
 inline Span* CentralFreeList<Forwarder>::ReleaseToSpans(
-    void* object, Span* span, size_t object_size, uint32_t size_reciprocal,
-    uint32_t max_span_cache_size) {
+    absl::Span<void* const> objects, Span* span, size_t object_size,
+    uint32_t size_reciprocal, uint32_t max_span_cache_size) {
   if (ABSL_PREDICT_FALSE(span->FreelistEmpty(object_size))) {
 #ifdef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
     nonempty_.prepend(span);
@@ -323,8 +587,10 @@ inline Span* CentralFreeList<Forwarder>::ReleaseToSpans(
 #ifdef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
   // We maintain a single nonempty list for small-but-slow. Also, we do not
   // collect histogram stats due to performance issues.
-  if (ABSL_PREDICT_TRUE(span->FreelistPush(object, object_size, size_reciprocal,
-                                           max_span_cache_size))) {
+  if (ABSL_PREDICT_TRUE(freelist_ops_.push_batch(span, objects, object_size,
+                                                 size_reciprocal,
+                                                 max_span_cache_size) ==
+                        objects.size())) {
     return nullptr;
   }
   nonempty_.remove(span);
@@ -333,8 +599,10 @@ inline Span* CentralFreeList<Forwarder>::ReleaseToSpans(
   const uint8_t prev_index = span->nonempty_index();
   const uint16_t prev_allocated = span->Allocated();
   const uint8_t prev_bitwidth = absl::bit_width(prev_allocated);
-  if (ABSL_PREDICT_FALSE(!span->FreelistPush(
-          object, object_size, size_reciprocal, max_span_cache_size))) {
+  if (ABSL_PREDICT_FALSE(freelist_ops_.push_batch(span, objects, object_size,
+                                                  size_reciprocal,
+                                                  max_span_cache_size) !=
+                         objects.size())) {
     // Update the histogram as the span is full and will be removed from the
     // nonempty_ list.
     RecordSpanUtil(prev_bitwidth, /*increase=*/false);
@@ -344,7 +612,7 @@ inline Span* CentralFreeList<Forwarder>::ReleaseToSpans(
   // As the objects are being added to the span, its utilization might change.
   // We remove the stale utilization from the histogram and add the new
   // utilization to the histogram after we release objects to the span.
-  uint16_t cur_allocated = prev_allocated - 1;
+  uint16_t cur_allocated = prev_allocated - objects.size();
   TC_ASSERT_EQ(cur_allocated, span->Allocated());
   const uint8_t cur_bitwidth = absl::bit_width(cur_allocated);
   if (cur_bitwidth != prev_bitwidth) {
@@ -426,11 +694,15 @@ template <class Forwarder>
 inline size_t CentralFreeList<Forwarder>::NumSpansInList(int n) {
   ASSUME(n >= 0);
   ASSUME(n < kNumLists);
+  size_t spans = 0;
+  for (size_t i = 0; i < num_sub_lists_; ++i) {
+    spans += sub_lists_[i].NumSpansInList(n);
+  }
   absl::base_internal::SpinLockHolder h(&lock_);
 #ifdef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
-  return nonempty_.length();
+  return spans + nonempty_.length();
 #else
-  return nonempty_.SizeOfList(n);
+  return spans + nonempty_.SizeOfList(n);
 #endif
 }
 
@@ -445,6 +717,11 @@ inline void CentralFreeList<Forwarder>::InsertRange(absl::Span<void*> batch) {
     }
   }
 
+  // Order the batch by address, so that objects from the same span are
+  // adjacent: they then share a pagemap lookup and are released to their span
+  // together.
+  std::sort(batch.begin(), batch.end());
+
   Span* spans[kMaxObjectsToMove];
   // First, map objects to spans and prefetch spans outside of our mutex
   // (to reduce critical section size and cache misses).
@@ -457,45 +734,189 @@ inline void CentralFreeList<Forwarder>::InsertRange(absl::Span<void*> batch) {
     return;
   }
 
+  if (num_sub_lists_ > 0) {
+    InsertRangeIntoSubLists(batch, spans);
+    return;
+  }
+
   // Safe to store free spans into freed up space in span array.
-  const uint32_t max_span_cache_size = forwarder_.max_span_cache_size();
   Span** free_spans = spans;
-  int free_count = 0;
+  const int free_count = ReleaseBatch(
+      batch, spans, forwarder_.max_span_cache_size(), free_spans);
+
+  // Then, release all free spans into page heap under its mutex.
+  if (ABSL_PREDICT_FALSE(free_count)) {
+    DeallocateSpans(absl::MakeSpan(free_spans, free_count));
+  }
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::DeallocateSpans(
+    absl::Span<Span*> free_spans) {
+  if (max_deferred_spans_ == 0) {
+    forwarder_.DeallocateSpans(size_class_, objects_per_span_, free_spans);
+    return;
+  }
 
-  // Then, release all individual objects into spans under our mutex
-  // and collect spans that become completely free.
+  Span* to_return[kMaxDeferredSpans + kMaxObjectsToMove];
+  size_t num_to_return;
   {
-    // Use local copy of variables to ensure that they are not reloaded.
-    size_t object_size = object_size_;
-    uint32_t size_reciprocal = size_reciprocal_;
     absl::base_internal::SpinLockHolder h(&lock_);
-    for (int i = 0; i < batch.size(); ++i) {
-      Span* span = ReleaseToSpans(batch[i], spans[i], object_size,
-                                  size_reciprocal, max_span_cache_size);
-      if (ABSL_PREDICT_FALSE(span)) {
-        free_spans[free_count] = span;
-        free_count++;
-      }
+    if (num_deferred_spans_ + free_spans.size() <= max_deferred_spans_) {
+      std::copy(free_spans.begin(), free_spans.end(),
+                deferred_spans_ + num_deferred_spans_);
+      num_deferred_spans_ += free_spans.size();
+      UpdateObjectCounts(ObjectsInSpans(free_spans));
+      return;
     }
+    // Full: return everything pending along with free_spans.
+    num_to_return = num_deferred_spans_;
+    std::copy(deferred_spans_, deferred_spans_ + num_to_return, to_return);
+    UpdateObjectCounts(-static_cast<int>(
+        ObjectsInSpans(absl::MakeSpan(to_return, num_to_return))));
+    num_deferred_spans_ = 0;
+  }
+  std::copy(free_spans.begin(), free_spans.end(), to_return + num_to_return);
+  num_to_return += free_spans.size();
+  forwarder_.DeallocateSpans(size_class_, objects_per_span_,
+                             absl::MakeSpan(to_return, num_to_return));
+}
 
-    RecordMultiSpansDeallocated(free_count);
-    UpdateObjectCounts(batch.size());
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::ReturnDeferredSpans() {
+  if (max_deferred_spans_ == 0) {
+    return;
+  }
+  Span* to_return[kMaxDeferredSpans];
+  size_t num_to_return;
+  {
+    absl::base_internal::SpinLockHolder h(&lock_);
+    num_to_return = num_deferred_spans_;
+    std::copy(deferred_spans_, deferred_spans_ + num_to_return, to_return);
+    UpdateObjectCounts(-static_cast<int>(
+        ObjectsInSpans(absl::MakeSpan(to_return, num_to_return))));
+    num_deferred_spans_ = 0;
+  }
+  if (num_to_return > 0) {
+    forwarder_.DeallocateSpans(size_class_, objects_per_span_,
+                               absl::MakeSpan(to_return, num_to_return));
+  }
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::UpdateSpanSize() {
+  if (ABSL_PREDICT_TRUE(big_objects_per_span_ == 0)) {
+    return;
+  }
+  absl::base_internal::SpinLockHolder h(&lock_);
+  const SpanStats stats = GetSpanStats();
+  const size_t new_spans = stats.num_spans_requested - last_spans_requested_;
+  last_spans_requested_ = stats.num_spans_requested;
+  if (stats.obj_capacity == 0) {
+    use_big_spans_ = false;
+    return;
+  }
+  // Objects of deferred spans are counted as free, but their spans are no
+  // longer live.
+  const int64_t free_objects =
+      counter_.value() - static_cast<int64_t>(ObjectsInSpans(
+                             absl::MakeSpan(deferred_spans_,
+                                            num_deferred_spans_)));
+  const size_t allocated =
+      stats.obj_capacity -
+      std::clamp<int64_t>(free_objects, 0, stats.obj_capacity);
+  // Classes whose spans rarely fill up pay for bigger ones in fragmentation,
+  // so only those that keep filling and asking for spans get them.
+  if (use_big_spans_) {
+    use_big_spans_ =
+        allocated * 100 >= stats.obj_capacity * kBaseSpanMaxOccupancy;
+  } else {
+    use_big_spans_ =
+        new_spans >= kMinNewSpansForBigSpans &&
+        allocated * 100 >= stats.obj_capacity * kBigSpanMinOccupancy;
+  }
+}
+
+template <class Forwarder>
+inline int CentralFreeList<Forwarder>::ReleaseBatch(
+    absl::Span<void*> batch, Span** spans, uint32_t max_span_cache_size,
+    Span** free_spans) {
+  int free_count = 0;
+
+  // Release all objects into spans under our mutex, one run of objects from
+  // the same span at a time, and collect spans that become completely free.
+  // Use local copy of variables to ensure that they are not reloaded.
+  size_t object_size = object_size_;
+  uint32_t size_reciprocal = size_reciprocal_;
+  absl::base_internal::SpinLockHolder h(&lock_);
+  for (size_t i = 0; i < batch.size();) {
+    size_t end = i + 1;
+    while (end < batch.size() && spans[end] == spans[i]) {
+      ++end;
+    }
+    Span* span =
+        ReleaseToSpans(batch.subspan(i, end - i), spans[i], object_size,
+                       size_reciprocal, max_span_cache_size);
+    if (ABSL_PREDICT_FALSE(span)) {
+      free_spans[free_count] = span;
+      free_count++;
+    }
+    i = end;
+  }
+
+  RecordMultiSpansDeallocated(absl::MakeSpan(free_spans, free_count));
+  UpdateObjectCounts(batch.size());
+  return free_count;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::InsertRangeIntoSubLists(
+    absl::Span<void*> batch, Span** spans) {
+  // Group the objects by the sub-list owning their span, so that each
+  // sub-list's lock is taken at most once.
+  uint8_t owners[kMaxObjectsToMove];
+  size_t begin[kMaxSubLists + 1] = {};
+  for (size_t i = 0; i < batch.size(); ++i) {
+    owners[i] = SubListFor(spans[i]);
+    ++begin[owners[i] + 1];
+  }
+  for (size_t i = 1; i <= num_sub_lists_; ++i) {
+    begin[i] += begin[i - 1];
+  }
+  void* objects[kMaxObjectsToMove];
+  Span* object_spans[kMaxObjectsToMove];
+  size_t end[kMaxSubLists];
+  std::copy(begin, begin + num_sub_lists_, end);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    const size_t pos = end[owners[i]]++;
+    objects[pos] = batch[i];
+    object_spans[pos] = spans[i];
+  }
+
+  // spans is no longer needed, so collect the free spans in it.
+  const uint32_t max_span_cache_size = forwarder_.max_span_cache_size();
+  int free_count = 0;
+  for (size_t i = 0; i < num_sub_lists_; ++i) {
+    const size_t n = begin[i + 1] - begin[i];
+    if (n == 0) continue;
+    free_count += sub_lists_[i].ReleaseBatch(
+        absl::MakeSpan(objects + begin[i], n), object_spans + begin[i],
+        max_span_cache_size, spans + free_count);
   }
 
-  // Then, release all free spans into page heap under its mutex.
   if (ABSL_PREDICT_FALSE(free_count)) {
-    forwarder_.DeallocateSpans(size_class_, objects_per_span_,
-                               absl::MakeSpan(free_spans, free_count));
+    DeallocateSpans(absl::MakeSpan(spans, free_count));
   }
 }
 
 template <class Forwarder>
 inline int CentralFreeList<Forwarder>::RemoveRange(void** batch, int N) {
   ASSUME(N > 0);
+  SlowPathTimer timer(SlowPathLayer::kCentralFreeList, size_class_);
 
   if (objects_per_span_ == 1) {
     // If there is only 1 object per span, skip CentralFreeList entirely.
-    Span* span = AllocateSpan();
+    Span* span = AllocateSpan(pages_per_span_, objects_per_span_);
     if (ABSL_PREDICT_FALSE(span == nullptr)) {
       return 0;
     }
@@ -503,21 +924,35 @@ inline int CentralFreeList<Forwarder>::RemoveRange(void** batch, int N) {
     return 1;
   }
 
+  if (num_sub_lists_ > 0) {
+    return RemoveRangeFromSubLists(batch, N);
+  }
+
+  absl::base_internal::SpinLockHolder h(&lock_);
+  int result = PopFromSpans(batch, N);
+  if (result < N) {
+    result += Populate(batch + result, N - result);
+  }
+  UpdateObjectCounts(-result);
+  return result;
+}
+
+template <class Forwarder>
+inline int CentralFreeList<Forwarder>::PopFromSpans(void** batch, int N) {
   // Use local copy of variable to ensure that it is not reloaded.
   size_t object_size = object_size_;
   int result = 0;
-  absl::base_internal::SpinLockHolder h(&lock_);
 
   do {
     Span* span = FirstNonEmptySpan();
     if (ABSL_PREDICT_FALSE(!span)) {
-      result += Populate(batch + result, N - result);
       break;
     }
 
 #ifdef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
     // We do not collect histogram stats for small-but-slow.
-    int here = span->FreelistPopBatch(batch + result, N - result, object_size);
+    int here = freelist_ops_.pop_batch(span, batch + result, N - result,
+                                       object_size);
     TC_ASSERT_GT(here, 0);
     if (span->FreelistEmpty(object_size)) {
       nonempty_.remove(span);
@@ -526,8 +961,24 @@ inline int CentralFreeList<Forwarder>::RemoveRange(void** batch, int N) {
     const uint16_t prev_allocated = span->Allocated();
     const uint8_t prev_bitwidth = absl::bit_width(prev_allocated);
     const uint8_t prev_index = span->nonempty_index();
-    int here = span->FreelistPopBatch(batch + result, N - result, object_size);
+    // If this span cannot satisfy the rest of the request, it is drained and
+    // we move on to the next span while still holding the lock. Start fetching
+    // that span now so that its cache miss overlaps with draining this one.
+    if (static_cast<int>(ObjectsPerSpan(span) - prev_allocated) <
+        N - result) {
+      if (Span* next = nonempty_.PeekSecondLeast(GetFirstNonEmptyIndex())) {
+        next->Prefetch();
+      }
+    }
+    int here = freelist_ops_.pop_batch(span, batch + result, N - result,
+                                       object_size);
     TC_ASSERT_GT(here, 0);
+    // The caller links the objects into its own lists or hands them out, so
+    // it writes to their first cache line before long.  Start fetching them
+    // while we update the span's accounting.
+    for (int i = result; i < result + here; ++i) {
+      PrefetchW(batch[i]);
+    }
     // As the objects are being popped from the span, its utilization might
     // change. So, we remove the stale utilization from the histogram here and
     // add it again once we pop the objects.
@@ -554,10 +1005,102 @@ inline int CentralFreeList<Forwarder>::RemoveRange(void** batch, int N) {
 #endif
     result += here;
   } while (result < N);
+  return result;
+}
+
+template <class Forwarder>
+inline int CentralFreeList<Forwarder>::RemoveFromSpans(void** batch, int N) {
+  absl::base_internal::SpinLockHolder h(&lock_);
+  const int result = PopFromSpans(batch, N);
+  UpdateObjectCounts(-result);
+  return result;
+}
+
+template <class Forwarder>
+inline int CentralFreeList<Forwarder>::RemoveRangeFromSubLists(void** batch,
+                                                               int N) {
+  // Start with the sub-list of the current CPU. Others are only locked when
+  // they look like they have objects to spare.
+  const int cpu = subtle::percpu::GetRealCpuUnsafe();
+  const size_t home = cpu < 0 ? 0 : cpu % num_sub_lists_;
+  int result = 0;
+  for (size_t i = 0; i < num_sub_lists_ && result < N; ++i) {
+    SubList& sub_list = sub_lists_[(home + i) % num_sub_lists_];
+    if (i > 0 && sub_list.length() == 0) continue;
+    result += sub_list.RemoveFromSpans(batch + result, N - result);
+  }
+  if (result == N) {
+    return result;
+  }
+
+  // Fetch memory from the system. The span is owned by the sub-list its
+  // address maps to, which frees will find again.
+  Span* span = AllocateSpan(pages_per_span_, objects_per_span_);
+  if (ABSL_PREDICT_FALSE(span == nullptr)) {
+    return result;
+  }
+  result += sub_lists_[SubListFor(span)].AdoptSpan(
+      span, batch + result, N - result, forwarder_.max_span_cache_size());
+  return result;
+}
+
+template <class Forwarder>
+inline int CentralFreeList<Forwarder>::AdoptSpan(
+    Span* span, void** batch, int N, uint32_t max_span_cache_size) {
+  const int result = span->BuildFreelist(object_size_, objects_per_span_,
+                                         batch, N, max_span_cache_size);
+  TC_ASSERT_GT(result, 0);
+
+  absl::base_internal::SpinLockHolder h(&lock_);
+  AddPopulatedSpan(span, result);
   UpdateObjectCounts(-result);
   return result;
 }
 
+template <class Forwarder>
+inline int CentralFreeList<Forwarder>::RemoveSpan(LinkedList& objects) {
+  if (objects_per_span_ <= 1 || length() > 0) {
+    return 0;
+  }
+  SlowPathTimer timer(SlowPathLayer::kCentralFreeList, size_class_);
+
+  Span* span = AllocateSpan(pages_per_span_, objects_per_span_);
+  if (ABSL_PREDICT_FALSE(span == nullptr)) {
+    return 0;
+  }
+  // Nothing else knows of span until it is recorded, so its freelist can be
+  // emptied without holding lock_.
+  const size_t object_size = object_size_;
+  const int total = objects_per_span_;
+  void* batch[kMaxObjectsToMove];
+  int got = span->BuildFreelist(object_size, total, batch,
+                                std::min<int>(total, kMaxObjectsToMove),
+                                forwarder_.max_span_cache_size());
+  TC_ASSERT_GT(got, 0);
+  objects.PushBatch(got, batch);
+  for (int removed = got; removed < total; removed += got) {
+    got = freelist_ops_.pop_batch(
+        span, batch, std::min<int>(total - removed, kMaxObjectsToMove),
+        object_size);
+    TC_ASSERT_GT(got, 0);
+    objects.PushBatch(got, batch);
+  }
+
+  if (num_sub_lists_ > 0) {
+    sub_lists_[SubListFor(span)].AdoptExhaustedSpan(span);
+  } else {
+    AdoptExhaustedSpan(span);
+  }
+  return total;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::AdoptExhaustedSpan(Span* span) {
+  absl::base_internal::SpinLockHolder h(&lock_);
+  AddPopulatedSpan(span, objects_per_span_);
+  UpdateObjectCounts(-static_cast<int>(objects_per_span_));
+}
+
 // Fetch memory from the system and add to the central cache freelist.
 template <class Forwarder>
 inline int CentralFreeList<Forwarder>::Populate(void** batch, int N)
@@ -565,20 +1108,30 @@ inline int CentralFreeList<Forwarder>::Populate(void** batch, int N)
   // Release central list lock while operating on pageheap
   // Note, this could result in multiple calls to populate each allocating
   // a new span and the pushing those partially full spans onto nonempty.
+  const bool use_big_spans = use_big_spans_;
   lock_.Unlock();
 
-  Span* span = AllocateSpan();
+  Span* span = ABSL_PREDICT_FALSE(use_big_spans)
+                   ? AllocateSpan(big_pages_per_span_, big_objects_per_span_)
+                   : AllocateSpan(pages_per_span_, objects_per_span_);
   if (ABSL_PREDICT_FALSE(span == nullptr)) {
     return 0;
   }
 
-  int result = span->BuildFreelist(object_size_, objects_per_span_, batch, N,
-                                   forwarder_.max_span_cache_size());
+  int result = span->BuildFreelist(object_size_, ObjectsPerSpan(span), batch,
+                                   N, forwarder_.max_span_cache_size());
   TC_ASSERT_GT(result, 0);
-  // This is a cheaper check than using FreelistEmpty().
-  bool span_empty = result == objects_per_span_;
 
   lock_.Lock();
+  AddPopulatedSpan(span, result);
+  return result;
+}
+
+template <class Forwarder>
+inline void CentralFreeList<Forwarder>::AddPopulatedSpan(Span* span,
+                                                         uint16_t allocated) {
+  // This is a cheaper check than using FreelistEmpty().
+  bool span_empty = allocated == ObjectsPerSpan(span);
 
 #ifdef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
   // We do not collect histogram stats for small-but-slow. Moreover, we maintain
@@ -588,7 +1141,6 @@ inline int CentralFreeList<Forwarder>::Populate(void** batch, int N)
   }
 #else
   // Update the histogram once we populate the span.
-  const uint16_t allocated = result;
   TC_ASSERT_EQ(allocated, span->Allocated());
   const uint8_t bitwidth = absl::bit_width(allocated);
   RecordSpanUtil(bitwidth, /*increase=*/true);
@@ -598,26 +1150,57 @@ inline int CentralFreeList<Forwarder>::Populate(void** batch, int N)
     span->set_nonempty_index(index);
   }
 #endif
-  RecordSpanAllocated();
-  return result;
+  RecordSpanAllocated(span);
 }
 
 template <class Forwarder>
-Span* CentralFreeList<Forwarder>::AllocateSpan() {
+inline AccessDensityPrediction CentralFreeList<Forwarder>::PredictDensity(
+    Length pages_per_span, size_t objects_per_span) const {
   // Use number of objects per span as a proxy for estimating access density of
   // the span. If number of objects per span is higher than
   // kFewObjectsAllocMaxLimit threshold, we assume that the span would be
-  // long-lived.
-  const AccessDensityPrediction density =
-      objects_per_span_ > kFewObjectsAllocMaxLimit
-          ? AccessDensityPrediction::kDense
-          : AccessDensityPrediction::kSparse;
-
-  SpanAllocInfo info = {.objects_per_span = objects_per_span_,
-                        .density = density};
-  Span* span = forwarder_.AllocateSpan(size_class_, info, pages_per_span_);
+  // long-lived, unless sampled lifetimes say otherwise.
+  switch (forwarder_.PredictLifetime(size_class_)) {
+    case LifetimePrediction::kShortLived:
+      // Keeping the spans of short-lived size classes with the sparse ones
+      // lets their hugepages empty out together instead of being pinned by
+      // long-lived neighbours.
+      return AccessDensityPrediction::kSparse;
+    case LifetimePrediction::kLongLived: {
+      // A size class with few objects per span still behaves like a dense
+      // one when its objects live long and it allocates spans fast enough for
+      // its live spans to fill whole hugepages.
+      size_t spans = num_spans();
+      for (size_t i = 0; i < num_sub_lists_; ++i) {
+        spans += sub_lists_[i].num_spans();
+      }
+      if (pages_per_span * spans >= kPagesPerHugePage) {
+        return AccessDensityPrediction::kDense;
+      }
+      break;
+    }
+    case LifetimePrediction::kUnknown:
+      break;
+  }
+  return objects_per_span > kFewObjectsAllocMaxLimit
+             ? AccessDensityPrediction::kDense
+             : AccessDensityPrediction::kSparse;
+}
+
+template <class Forwarder>
+Span* CentralFreeList<Forwarder>::AllocateSpan(Length pages_per_span,
+                                               size_t objects_per_span) {
+  SpanAllocInfo info = {
+      .objects_per_span = objects_per_span,
+      .density = PredictDensity(pages_per_span, objects_per_span),
+      .lifetime = forwarder_.PredictLifetime(size_class_)};
+  Span* span;
+  {
+    SlowPathTimer timer(SlowPathLayer::kPageHeap, size_class_);
+    span = forwarder_.AllocateSpan(size_class_, info, pages_per_span);
+  }
   if (ABSL_PREDICT_FALSE(span == nullptr)) {
-    TC_LOG("tcmalloc: allocation failed %v", pages_per_span_);
+    TC_LOG("tcmalloc: allocation failed %v", pages_per_span);
   }
   return span;
 }
@@ -628,7 +1211,17 @@ inline size_t CentralFreeList<Forwarder>::OverheadBytes() const {
     return 0;
   }
   const size_t overhead_per_span = pages_per_span_.in_bytes() % object_size_;
-  return num_spans() * overhead_per_span;
+  size_t spans = num_spans();
+  for (size_t i = 0; i < num_sub_lists_; ++i) {
+    spans += sub_lists_[i].num_spans();
+  }
+  if (ABSL_PREDICT_FALSE(big_objects_per_span_ != 0)) {
+    const size_t big_spans =
+        std::min<size_t>(std::max<int64_t>(num_big_spans_.value(), 0), spans);
+    return (spans - big_spans) * overhead_per_span +
+           big_spans * (big_pages_per_span_.in_bytes() % object_size_);
+  }
+  return spans * overhead_per_span;
 }
 
 template <class Forwarder>
@@ -639,7 +1232,18 @@ inline SpanStats CentralFreeList<Forwarder>::GetSpanStats() const {
   }
   stats.num_spans_requested = static_cast<size_t>(num_spans_requested_.value());
   stats.num_spans_returned = static_cast<size_t>(num_spans_returned_.value());
+  for (size_t i = 0; i < num_sub_lists_; ++i) {
+    const SpanStats sub_list_stats = sub_lists_[i].GetSpanStats();
+    stats.num_spans_requested += sub_list_stats.num_spans_requested;
+    stats.num_spans_returned += sub_list_stats.num_spans_returned;
+  }
   stats.obj_capacity = stats.num_live_spans() * objects_per_span_;
+  if (ABSL_PREDICT_FALSE(big_objects_per_span_ != 0)) {
+    const size_t big_spans = std::min<size_t>(
+        std::max<int64_t>(num_big_spans_.value(), 0), stats.num_live_spans());
+    stats.obj_capacity +=
+        big_spans * (big_objects_per_span_ - objects_per_span_);
+  }
   return stats;
 }
 
@@ -648,7 +1252,11 @@ inline size_t CentralFreeList<Forwarder>::NumSpansWith(
     uint16_t bitwidth) const {
   TC_ASSERT_GT(bitwidth, 0);
   const int bucket = bitwidth - 1;
-  return objects_to_spans_[bucket].value();
+  size_t spans = objects_to_spans_[bucket].value();
+  for (size_t i = 0; i < num_sub_lists_; ++i) {
+    spans += sub_lists_[i].NumSpansWith(bitwidth);
+  }
+  return spans;
 }
 
 template <class Forwarder>
@@ -334,6 +334,8 @@ INSTANTIATE_TEST_SUITE_P(
 
 namespace {
 
+using central_freelist_internal::kFewObjectsAllocMaxLimit;
+using central_freelist_internal::kMinNewSpansForBigSpans;
 using central_freelist_internal::kNumLists;
 using TypeParam = FakeCentralFreeListEnvironment<
     central_freelist_internal::CentralFreeList<MockStaticForwarder>>;
@@ -795,6 +797,195 @@ TEST_P(CentralFreeListTest, MultipleSpans) {
   EXPECT_EQ(stats.obj_capacity, 0);
 }
 
+TEST_P(CentralFreeListTest, SubLists) {
+  TypeParam e(std::get<0>(GetParam()).size, std::get<0>(GetParam()).pages,
+              std::get<0>(GetParam()).num_to_move, std::get<1>(GetParam()),
+              std::get<2>(GetParam()));
+  if (e.objects_per_span() == 1) {
+    GTEST_SKIP() << "Skipping test as single object spans are not split.";
+  }
+  e.forwarder().set_num_sub_lists(central_freelist_internal::kMaxSubLists);
+  e.central_freelist().Init(TypeParam::kSizeClass,
+                            e.use_all_buckets_for_few_object_spans());
+
+  // Fetch enough objects for spans to land in several sub-lists.
+  constexpr size_t kNumSpans = 16;
+  std::vector<void*> all_objects;
+  void* batch[kMaxObjectsToMove];
+  const size_t num_objects_to_fetch = kNumSpans * e.objects_per_span();
+  while (all_objects.size() < num_objects_to_fetch) {
+    const size_t n = std::min(num_objects_to_fetch - all_objects.size(),
+                              e.batch_size());
+    const int got = e.central_freelist().RemoveRange(batch, n);
+    ASSERT_GT(got, 0);
+    all_objects.insert(all_objects.end(), batch, batch + got);
+  }
+
+  SpanStats stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_spans_requested, kNumSpans);
+  EXPECT_EQ(stats.num_spans_returned, 0);
+  EXPECT_EQ(e.central_freelist().length(), 0);
+  EXPECT_EQ(
+      e.central_freelist().NumSpansWith(absl::bit_width(e.objects_per_span())),
+      kNumSpans);
+
+  // Return the objects in a different order than they were handed out, so
+  // that batches mix objects of spans owned by different sub-lists.
+  absl::BitGen rng;
+  std::shuffle(all_objects.begin(), all_objects.end(), rng);
+  size_t total_returned = 0;
+  while (total_returned < all_objects.size()) {
+    const size_t n =
+        std::min(all_objects.size() - total_returned, e.batch_size());
+    e.central_freelist().InsertRange({&all_objects[total_returned], n});
+    total_returned += n;
+    if (total_returned < all_objects.size()) {
+      stats = e.central_freelist().GetSpanStats();
+      EXPECT_EQ(e.central_freelist().length() + all_objects.size() -
+                    total_returned,
+                stats.obj_capacity);
+      size_t spans_in_lists = 0;
+      for (int i = 0; i < kNumLists; ++i) {
+        spans_in_lists += e.central_freelist().NumSpansInList(i);
+      }
+      EXPECT_LE(spans_in_lists, stats.num_live_spans());
+    }
+  }
+
+  stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_spans_requested, stats.num_spans_returned);
+  EXPECT_EQ(stats.obj_capacity, 0);
+  EXPECT_EQ(e.central_freelist().length(), 0);
+  EXPECT_EQ(e.central_freelist().OverheadBytes(), 0);
+}
+
+TEST_P(CentralFreeListTest, DeferredSpans) {
+  TypeParam e(std::get<0>(GetParam()).size, std::get<0>(GetParam()).pages,
+              std::get<0>(GetParam()).num_to_move, std::get<1>(GetParam()),
+              std::get<2>(GetParam()));
+  if (e.objects_per_span() == 1) {
+    GTEST_SKIP() << "Skipping test as single object spans are not deferred.";
+  }
+  e.forwarder().set_max_deferred_spans(2);
+  e.central_freelist().Init(TypeParam::kSizeClass,
+                            e.use_all_buckets_for_few_object_spans());
+
+  // Allocates a whole span and frees it again.
+  auto cycle_span = [&]() {
+    std::vector<void*> objects;
+    void* batch[kMaxObjectsToMove];
+    while (objects.size() < e.objects_per_span()) {
+      const size_t n =
+          std::min(e.objects_per_span() - objects.size(), e.batch_size());
+      const int got = e.central_freelist().RemoveRange(batch, n);
+      ASSERT_GT(got, 0);
+      objects.insert(objects.end(), batch, batch + got);
+    }
+    for (size_t i = 0; i < objects.size(); i += e.batch_size()) {
+      const size_t n = std::min(objects.size() - i, e.batch_size());
+      e.central_freelist().InsertRange({&objects[i], n});
+    }
+  };
+
+  // The first two free spans are held back, the third flushes all of them.
+  EXPECT_CALL(e.forwarder(),
+              DeallocateSpans(testing::_, testing::_, testing::SizeIs(3)))
+      .Times(1);
+  cycle_span();
+  cycle_span();
+  EXPECT_EQ(e.central_freelist().length(), 2 * e.objects_per_span());
+  cycle_span();
+  EXPECT_EQ(e.central_freelist().length(), 0);
+  testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+
+  EXPECT_CALL(e.forwarder(),
+              DeallocateSpans(testing::_, testing::_, testing::SizeIs(1)))
+      .Times(1);
+  cycle_span();
+  EXPECT_EQ(e.central_freelist().length(), e.objects_per_span());
+  e.central_freelist().ReturnDeferredSpans();
+  EXPECT_EQ(e.central_freelist().length(), 0);
+
+  SpanStats stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_spans_requested, stats.num_spans_returned);
+}
+
+TEST_P(CentralFreeListTest, AdaptiveSpanSizes) {
+  TypeParam e(std::get<0>(GetParam()).size, std::get<0>(GetParam()).pages,
+              std::get<0>(GetParam()).num_to_move, std::get<1>(GetParam()),
+              std::get<2>(GetParam()));
+  const size_t size = std::get<0>(GetParam()).size;
+  const Length pages = Length(std::get<0>(GetParam()).pages);
+  if (!Span::IsNonIntrusive(size) || e.objects_per_span() <= 2 * kNumLists ||
+      !Span::IsValidSizeClass(size, 2 * pages.raw_num())) {
+    GTEST_SKIP() << "Skipping test as spans of this size class cannot grow.";
+  }
+  e.forwarder().set_adaptive_span_sizes(true);
+  e.central_freelist().Init(TypeParam::kSizeClass,
+                            e.use_all_buckets_for_few_object_spans());
+
+  std::vector<void*> objects;
+  auto fetch = [&](size_t num_objects) {
+    void* batch[kMaxObjectsToMove];
+    for (size_t fetched = 0; fetched < num_objects;) {
+      const int got = e.central_freelist().RemoveRange(
+          batch, std::min(num_objects - fetched, e.batch_size()));
+      ASSERT_GT(got, 0);
+      objects.insert(objects.end(), batch, batch + got);
+      fetched += got;
+    }
+  };
+  auto release = [&](absl::Span<void*> to_release) {
+    for (size_t i = 0; i < to_release.size(); i += e.batch_size()) {
+      const size_t n = std::min(to_release.size() - i, e.batch_size());
+      e.central_freelist().InsertRange(to_release.subspan(i, n));
+    }
+  };
+
+  // Spans that fill up as soon as they are allocated make the freelist switch
+  // to bigger ones.
+  EXPECT_CALL(e.forwarder(), AllocateSpan(testing::_, testing::_, pages))
+      .Times(kMinNewSpansForBigSpans);
+  fetch(kMinNewSpansForBigSpans * e.objects_per_span());
+  testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+  e.central_freelist().UpdateSpanSize();
+
+  EXPECT_CALL(e.forwarder(),
+              AllocateSpan(testing::_, testing::_, testing::Gt(pages)))
+      .Times(1);
+  fetch(1);
+  testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+
+  SpanStats stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_live_spans(), kMinNewSpansForBigSpans + 1);
+  EXPECT_GT(stats.obj_capacity,
+            (kMinNewSpansForBigSpans + 1) * e.objects_per_span());
+  EXPECT_EQ(e.central_freelist().length(),
+            stats.obj_capacity - objects.size());
+
+  // Once spans run half empty, new ones are back to the base size.
+  std::vector<void*> kept;
+  std::vector<void*> released;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    (i % 2 == 0 ? kept : released).push_back(objects[i]);
+  }
+  release(absl::MakeSpan(released));
+  objects = std::move(kept);
+  e.central_freelist().UpdateSpanSize();
+
+  EXPECT_CALL(e.forwarder(), AllocateSpan(testing::_, testing::_, pages))
+      .Times(1);
+  fetch(e.central_freelist().length() + 1);
+  testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+
+  release(absl::MakeSpan(objects));
+  stats = e.central_freelist().GetSpanStats();
+  EXPECT_EQ(stats.num_spans_requested, stats.num_spans_returned);
+  EXPECT_EQ(stats.obj_capacity, 0);
+  EXPECT_EQ(e.central_freelist().length(), 0);
+  EXPECT_EQ(e.central_freelist().OverheadBytes(), 0);
+}
+
 TEST_P(CentralFreeListTest, PassSpanDensityToPageheap) {
   TypeParam e(std::get<0>(GetParam()).size, std::get<0>(GetParam()).pages,
               std::get<0>(GetParam()).num_to_move, std::get<1>(GetParam()),
@@ -822,6 +1013,64 @@ TEST_P(CentralFreeListTest, PassSpanDensityToPageheap) {
   test_function(e.objects_per_span(), AccessDensityPrediction::kDense);
 }
 
+TEST_P(CentralFreeListTest, ShortLivedSpansAreSparse) {
+  TypeParam e(std::get<0>(GetParam()).size, std::get<0>(GetParam()).pages,
+              std::get<0>(GetParam()).num_to_move, std::get<1>(GetParam()),
+              std::get<2>(GetParam()));
+  e.forwarder().set_lifetime(LifetimePrediction::kShortLived);
+
+  // Whatever the objects per span, spans of a short-lived size class are kept
+  // with the sparsely-accessed ones.
+  EXPECT_CALL(e.forwarder(),
+              AllocateSpan(testing::_,
+                           testing::Field(&SpanAllocInfo::density,
+                                          AccessDensityPrediction::kSparse),
+                           testing::_))
+      .Times(1);
+  void* object;
+  ASSERT_EQ(e.central_freelist().RemoveRange(&object, 1), 1);
+  e.central_freelist().InsertRange({&object, 1});
+}
+
+TEST_P(CentralFreeListTest, LongLivedSpansFillingHugepagesAreDense) {
+  TypeParam e(std::get<0>(GetParam()).size, std::get<0>(GetParam()).pages,
+              std::get<0>(GetParam()).num_to_move, std::get<1>(GetParam()),
+              std::get<2>(GetParam()));
+  e.forwarder().set_lifetime(LifetimePrediction::kLongLived);
+  const size_t pages =
+      e.forwarder().class_to_pages(TypeParam::kSizeClass).raw_num();
+  const size_t spans_per_hugepage =
+      (kPagesPerHugePage.raw_num() + pages - 1) / pages;
+  // Size classes with many objects per span are dense from the start.
+  const bool dense_by_objects = e.objects_per_span() > kFewObjectsAllocMaxLimit;
+  const size_t spans = dense_by_objects ? 1 : spans_per_hugepage + 1;
+
+  // Until its live spans fill a hugepage, a long-lived size class keeps its
+  // static prediction.  From then on, its spans are dense.
+  std::vector<void*> objects;
+  for (size_t i = 0; i < spans; ++i) {
+    const AccessDensityPrediction expected =
+        dense_by_objects || i >= spans_per_hugepage
+            ? AccessDensityPrediction::kDense
+            : AccessDensityPrediction::kSparse;
+    EXPECT_CALL(e.forwarder(),
+                AllocateSpan(testing::_,
+                             testing::Field(&SpanAllocInfo::density, expected),
+                             testing::_))
+        .Times(1);
+    for (size_t j = 0; j < e.objects_per_span(); ++j) {
+      void* object;
+      ASSERT_EQ(e.central_freelist().RemoveRange(&object, 1), 1);
+      objects.push_back(object);
+    }
+    testing::Mock::VerifyAndClearExpectations(&e.forwarder());
+  }
+
+  for (void* object : objects) {
+    e.central_freelist().InsertRange({&object, 1});
+  }
+}
+
 TEST_P(CentralFreeListTest, SpanFragmentation) {
   // This test is primarily exercising Span itself to model how tcmalloc.cc uses
   // it, but this gives us a self-contained (and sanitizable) implementation of
@@ -28,12 +28,18 @@ absl::string_view MemoryTagToLabel(MemoryTag tag) {
       return "NORMAL";
     case MemoryTag::kNormalP1:
       return "NORMAL_P1";
+    case MemoryTag::kNormalP2:
+      return "NORMAL_P2";
+    case MemoryTag::kNormalP3:
+      return "NORMAL_P3";
     case MemoryTag::kSampled:
       return "SAMPLED";
     case MemoryTag::kSelSan:
       return "SELSAN";
     case MemoryTag::kCold:
       return "COLD";
+    case MemoryTag::kWarm:
+      return "WARM";
     case MemoryTag::kMetadata:
       return "METADATA";
   }
@@ -34,6 +34,7 @@
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/pageheap_lock_profiler.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -76,6 +77,11 @@ static_assert(sizeof(void*) == 8);
 //   Used for situations where minimizing the memory footprint is the most
 //   desirable attribute, even at the cost of performance.
 //
+// TCMALLOC_INTERNAL_SMALL_FOOTPRINT:
+//   A middle ground for hosts running many small processes.  It uses 8KiB
+//   pages and keeps the per-CPU and transfer caches, but caps their sizes, and
+//   uses a three-level PageMap, whose leaves are smaller.
+//
 // The constants that vary between models are:
 //
 //   kPageShift - Shift amount used to compute the page size.
@@ -100,6 +106,9 @@ static_assert(sizeof(void*) == 8);
 #define TCMALLOC_PAGE_SHIFT 18
 #elif defined(TCMALLOC_INTERNAL_32K_PAGES)
 #define TCMALLOC_PAGE_SHIFT 15
+#elif defined(TCMALLOC_INTERNAL_SMALL_FOOTPRINT)
+#define TCMALLOC_PAGE_SHIFT 13
+#define TCMALLOC_USE_PAGEMAP3
 #else
 #define TCMALLOC_PAGE_SHIFT 13
 #endif
@@ -107,10 +116,11 @@ static_assert(sizeof(void*) == 8);
 #error "TCMALLOC_PAGE_SHIFT is an internal macro!"
 #endif
 
-#if defined(TCMALLOC_INTERNAL_SMALL_BUT_SLOW) + \
-        defined(TCMALLOC_INTERNAL_8K_PAGES) +   \
-        defined(TCMALLOC_INTERNAL_256K_PAGES) + \
-        defined(TCMALLOC_INTERNAL_32K_PAGES) >  \
+#if defined(TCMALLOC_INTERNAL_SMALL_BUT_SLOW) +   \
+        defined(TCMALLOC_INTERNAL_SMALL_FOOTPRINT) + \
+        defined(TCMALLOC_INTERNAL_8K_PAGES) +        \
+        defined(TCMALLOC_INTERNAL_256K_PAGES) +      \
+        defined(TCMALLOC_INTERNAL_32K_PAGES) >       \
     1
 #error "At most 1 variant configuration must be used."
 #endif
@@ -157,7 +167,11 @@ inline constexpr bool kHasExpandedClasses = true;
 inline constexpr size_t kMaxSize = 256 * 1024;
 inline constexpr size_t kMinThreadCacheSize = kMaxSize * 2;
 inline constexpr size_t kMaxThreadCacheSize = 4 << 20;
+#if defined(TCMALLOC_INTERNAL_SMALL_FOOTPRINT)
+inline constexpr size_t kMaxCpuCacheSize = 256 * 1024;
+#else
 inline constexpr size_t kMaxCpuCacheSize = 1.5 * 1024 * 1024;
+#endif
 inline constexpr size_t kDefaultOverallThreadCacheSize =
     8u * kMaxThreadCacheSize;
 inline constexpr size_t kStealAmount = 1 << 16;
@@ -181,12 +195,35 @@ inline constexpr bool kSanitizerAddressSpace = true;
 inline constexpr bool kSanitizerAddressSpace = false;
 #endif
 
+// TCMALLOC_INTERNAL_POW2_SIZE_CLASSES builds use only power-of-two size
+// classes (kExperimentalPow2SizeClasses), with any page size.  Sizes are then
+// mapped to classes by arithmetic rather than through SizeMap's class array,
+// and objects no larger than a page are aligned to their size.
+#if defined(TCMALLOC_INTERNAL_POW2_SIZE_CLASSES)
+inline constexpr bool kPow2SizeClasses = true;
+#else
+inline constexpr bool kPow2SizeClasses = false;
+#endif
+
+// Each NUMA partition has a MemoryTag of its own; there are tags for up to
+// this many.
+inline constexpr size_t kMaxNumaPartitions = 4;
+
 // Disable NUMA awareness under Sanitizers to avoid failing to mmap memory.
+// NUMA-aware builds support two partitions, or as many as
+// TCMALLOC_INTERNAL_NUMA_PARTITIONS asks for.  Systems with more nodes than
+// partitions fold nodes together (see NumaTopology).
 #if defined(TCMALLOC_INTERNAL_NUMA_AWARE)
-inline constexpr size_t kNumaPartitions = kSanitizerAddressSpace ? 1 : 2;
+#ifndef TCMALLOC_INTERNAL_NUMA_PARTITIONS
+#define TCMALLOC_INTERNAL_NUMA_PARTITIONS 2
+#endif
+inline constexpr size_t kNumaPartitions =
+    kSanitizerAddressSpace ? 1 : TCMALLOC_INTERNAL_NUMA_PARTITIONS;
 #else
 inline constexpr size_t kNumaPartitions = 1;
 #endif
+static_assert(kNumaPartitions >= 1 && kNumaPartitions <= kMaxNumaPartitions,
+              "Unsupported number of NUMA partitions");
 
 // We have copies of kNumBaseClasses size classes for each NUMA node, followed
 // by any expanded classes.
@@ -232,6 +269,12 @@ inline constexpr int kMaxOverages = 3;
 // scavenging code will shrink it down when its contents are not in use.
 inline constexpr size_t kMaxDynamicFreeListLength = 8192;
 
+// The warm tier, a middle tier between normal and cold memory for tiered
+// memory hosts, takes the tag that SelSan would otherwise use.  A 2-bit tag
+// has no room for it.
+inline constexpr bool kWarmTierPresent =
+    !kSelSanPresent && !kSanitizerAddressSpace;
+
 enum class MemoryTag : uint8_t {
   // Sampled, infrequently allocated
   kSampled = 0x0,
@@ -239,10 +282,18 @@ enum class MemoryTag : uint8_t {
   kNormalP0 = kSanitizerAddressSpace ? 0x1 : 0x4,
   // Normal memory, NUMA partition 1
   kNormalP1 = kSanitizerAddressSpace ? 0xff : 0x6,
+  // Normal memory, NUMA partitions 2 and 3.  These take the remaining tags
+  // with the kNormal bit set; sanitizer builds, which are never NUMA aware,
+  // give them arbitrary values that shouldn't be used.
+  kNormalP2 = kSanitizerAddressSpace ? 0xfd : 0x5,
+  kNormalP3 = kSanitizerAddressSpace ? 0xfc : 0x7,
   // Normal memory
   kNormal = kNormalP0,
   // Cold
   kCold = 0x2,
+  // Warm, see kWarmTierPresent.  0xfb is an arbitrary value that shouldn't be
+  // used.
+  kWarm = kWarmTierPresent ? 0x1 : 0xfb,
   // Metadata
   kMetadata = 0x3,
   // SelSan sampled spans, kept separately because we need to quickly
@@ -260,15 +311,43 @@ inline MemoryTag GetMemoryTag(const void* ptr) {
                                 kTagShift);
 }
 
+// Returns the NUMA partition of normal memory with the given tag, or
+// kNumaPartitions for any other tag.
+inline size_t NumaPartitionFromTag(MemoryTag tag) {
+  size_t partition;
+  switch (tag) {
+    case MemoryTag::kNormalP0:
+      partition = 0;
+      break;
+    case MemoryTag::kNormalP1:
+      partition = 1;
+      break;
+    case MemoryTag::kNormalP2:
+      partition = 2;
+      break;
+    case MemoryTag::kNormalP3:
+      partition = 3;
+      break;
+    default:
+      return kNumaPartitions;
+  }
+  return partition < kNumaPartitions ? partition : kNumaPartitions;
+}
+
 inline bool IsNormalMemory(const void* ptr) {
-  // This is slightly faster than checking kNormalP0/P1 separetly.
+  // This is slightly faster than checking each kNormalP* separately.
   static_assert((static_cast<uint8_t>(MemoryTag::kNormalP0) &
                  (static_cast<uint8_t>(MemoryTag::kSampled) |
                   static_cast<uint8_t>(MemoryTag::kCold))) == 0);
+  static_assert(!kWarmTierPresent ||
+                (static_cast<uint8_t>(MemoryTag::kWarm) &
+                 static_cast<uint8_t>(MemoryTag::kNormal)) == 0);
+  static_assert(kSanitizerAddressSpace ||
+                (static_cast<uint8_t>(MemoryTag::kNormalP3) &
+                 static_cast<uint8_t>(MemoryTag::kNormal)) != 0);
   bool res = (static_cast<uintptr_t>(GetMemoryTag(ptr)) &
               static_cast<uintptr_t>(MemoryTag::kNormal)) != 0;
-  TC_ASSERT(res == (GetMemoryTag(ptr) == MemoryTag::kNormalP0 ||
-                    GetMemoryTag(ptr) == MemoryTag::kNormalP1),
+  TC_ASSERT(res == (NumaPartitionFromTag(GetMemoryTag(ptr)) < kNumaPartitions),
             "ptr=%p res=%d tag=%d", ptr, res,
             static_cast<int>(GetMemoryTag(ptr)));
   return res;
@@ -339,6 +418,10 @@ inline MemoryTag NumaNormalTag(size_t numa_partition) {
       return MemoryTag::kNormalP0;
     case 1:
       return MemoryTag::kNormalP1;
+    case 2:
+      return MemoryTag::kNormalP2;
+    case 3:
+      return MemoryTag::kNormalP3;
     default:
       ASSUME(false);
       __builtin_unreachable();
@@ -350,26 +433,48 @@ inline size_t NumaPartitionFromPointer(void* ptr) {
     return 0;
   }
 
-  switch (GetMemoryTag(ptr)) {
-    case MemoryTag::kNormalP1:
-      return 1;
-    default:
-      return 0;
-  }
+  const size_t partition = NumaPartitionFromTag(GetMemoryTag(ptr));
+  return partition < kNumaPartitions ? partition : 0;
 }
 
 // Linker initialized, so this lock can be accessed at any time.
 // Note: `CpuCache::ResizeInfo::lock` must be taken before the `pageheap_lock`
 // if both are going to be held simultaneously.
+//
+// One lock guards the page allocators of every MemoryTag.  Besides them, it
+// guards state that all tags share: pagemap writes, the span and metadata
+// allocators, the memory limits, and the page heap tracer.  Allocating with
+// one tag may also release memory from the others, through
+// ShrinkToUsageLimit.  Splitting the lock per tag would require those to get
+// locks of their own first.
 extern absl::base_internal::SpinLock pageheap_lock;
 
+// Acquisitions of pageheap_lock through PageHeapSpinLockHolder, and how many
+// of them found it held, for comparing experiments.  Only updated with the
+// lock held, so that counting adds no contention.
+struct PageHeapLockCounts {
+  uint64_t acquisitions = 0;
+  uint64_t contended = 0;
+};
+extern PageHeapLockCounts pageheap_lock_counts;
+
 class ABSL_SCOPED_LOCKABLE PageHeapSpinLockHolder {
  public:
-  PageHeapSpinLockHolder()
-      ABSL_EXCLUSIVE_LOCK_FUNCTION(pageheap_lock) = default;
-  ~PageHeapSpinLockHolder() ABSL_UNLOCK_FUNCTION() = default;
+  PageHeapSpinLockHolder() ABSL_EXCLUSIVE_LOCK_FUNCTION(pageheap_lock) {
+    sample_.Acquired();
+    ++pageheap_lock_counts.acquisitions;
+    pageheap_lock_counts.contended += contended_;
+  }
+  ~PageHeapSpinLockHolder() ABSL_UNLOCK_FUNCTION() { sample_.Releasing(); }
 
  private:
+  // Constructed before lock_ and destroyed after it, so that a sampled
+  // acquisition is timed from before the wait and recorded once the lock is
+  // released.
+  PageHeapLockSample sample_;
+  // Whether another thread held the lock as we went to take it.  Reading the
+  // lock word is cheaper than timing the wait.
+  bool contended_ = pageheap_lock.IsHeld();
   AllocationGuardSpinLockHolder lock_{&pageheap_lock};
 };
 
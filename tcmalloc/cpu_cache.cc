@@ -16,8 +16,17 @@
 
 #include <stdlib.h>
 
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <new>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
 
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -30,12 +39,24 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+// Serializes activation, which the background thread may attempt while the
+// process is running in per-thread mode.
+ABSL_CONST_INIT static absl::base_internal::SpinLock activation_lock(
+    absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
+
+// Threads running in per-thread mode keep their caches until their next call
+// into TCMalloc after this, where UsePerCpuCache() drains them.  Nothing waits
+// for the other threads.
 static void ActivatePerCpuCaches() {
   if (tcmalloc::tcmalloc_internal::tc_globals.CpuCacheActive()) {
     // Already active.
     return;
   }
 
+  absl::base_internal::SpinLockHolder l(&activation_lock);
+  if (tc_globals.CpuCacheActive()) {
+    return;
+  }
   if (Parameters::per_cpu_caches() && subtle::percpu::IsFast()) {
     tc_globals.InitIfNecessary();
     tc_globals.cpu_cache().Activate();
@@ -74,3 +95,27 @@ extern "C" int32_t MallocExtension_Internal_GetMaxPerCpuCacheSize() {
 extern "C" void MallocExtension_Internal_SetMaxPerCpuCacheSize(int32_t value) {
   tcmalloc::tcmalloc_internal::Parameters::set_max_per_cpu_cache_size(value);
 }
+
+extern "C" void MallocExtension_Internal_GetPerCpuCacheCapacityProfile(
+    std::vector<size_t>* ret) {
+  using tcmalloc::tcmalloc_internal::kNumClasses;
+  using tcmalloc::tcmalloc_internal::tc_globals;
+  ret->clear();
+  if (!tc_globals.CpuCacheActive()) return;
+  ret->resize(kNumClasses, 0);
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    (*ret)[size_class] = std::lround(tc_globals.cpu_cache()
+                                         .GetSizeClassCapacityStats(size_class)
+                                         .avg_capacity);
+  }
+}
+
+extern "C" void MallocExtension_Internal_SetPerCpuCacheCapacityProfile(
+    const size_t* capacities, size_t n) {
+  using tcmalloc::tcmalloc_internal::tc_globals;
+  tc_globals.cpu_cache().SetCapacityProfile(
+      absl::Span<const size_t>(capacities, n));
+  if (tc_globals.CpuCacheActive()) {
+    tc_globals.cpu_cache().WarmUpPopulatedCaches();
+  }
+}
@@ -18,9 +18,11 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <atomic>
+#include <limits>
 #include <new>
 #include <tuple>
 #include <type_traits>
@@ -42,16 +44,21 @@
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/cache_topology.h"
+#include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
+#include "tcmalloc/internal/linked_list.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/numa.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/percpu_tcmalloc.h"
 #include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/internal/timeseries_tracker.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/thread_cache.h"
 #include "tcmalloc/transfer_cache.h"
@@ -70,12 +77,21 @@ struct DrainHandler;
 // When dynamic slab size is enabled, we start with kInitialPerCpuShift and
 // grow as needed up to kMaxPerCpuShift. When dynamic slab size is disabled,
 // we always use kMaxPerCpuShift.
+//
+// kMaxCapacityShift shrinks the per-size-class capacities, which are sized for
+// a 256KiB slab, for a smaller largest slab.
 #if defined(TCMALLOC_INTERNAL_SMALL_BUT_SLOW)
 constexpr inline uint8_t kInitialBasePerCpuShift = 12;
 constexpr inline uint8_t kMaxBasePerCpuShift = 12;
+constexpr inline uint8_t kMaxCapacityShift = 0;
+#elif defined(TCMALLOC_INTERNAL_SMALL_FOOTPRINT)
+constexpr inline uint8_t kInitialBasePerCpuShift = 12;
+constexpr inline uint8_t kMaxBasePerCpuShift = 15;
+constexpr inline uint8_t kMaxCapacityShift = 18 - kMaxBasePerCpuShift;
 #else
 constexpr inline uint8_t kInitialBasePerCpuShift = 14;
 constexpr inline uint8_t kMaxBasePerCpuShift = 18;
+constexpr inline uint8_t kMaxCapacityShift = 0;
 #endif
 constexpr inline uint8_t kNumPossiblePerCpuShifts =
     kMaxBasePerCpuShift - kInitialBasePerCpuShift + 1;
@@ -83,6 +99,9 @@ constexpr inline uint8_t kNumPossiblePerCpuShifts =
 constexpr inline uint8_t kResizeSlabCopies = 2;
 constexpr inline uint8_t kTotalPossibleSlabs =
     kNumPossiblePerCpuShifts * kResizeSlabCopies;
+// With incremental slab resizing, the number of CPUs set up in the new slabs
+// per call to ResizeSlabIfNeeded().
+constexpr inline int kSlabResizeCpusPerStep = 8;
 // StaticForwarder provides access to the SizeMap and transfer caches.
 //
 // This is a class, rather than namespaced globals, so that it can be mocked for
@@ -93,7 +112,7 @@ class StaticForwarder {
       ABSL_LOCKS_EXCLUDED(pageheap_lock) {
     TC_ASSERT(tc_globals.IsInited());
     PageHeapSpinLockHolder l;
-    return tc_globals.arena().Alloc(size, alignment);
+    return tc_globals.arena().Alloc(size, alignment, ArenaUse::kCpuCache);
   }
   static void* AllocReportedImpending(size_t size, std::align_val_t alignment)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) {
@@ -101,8 +120,8 @@ class StaticForwarder {
     PageHeapSpinLockHolder l;
     // Negate previous update to allocated that accounted for this allocation.
     tc_globals.arena().UpdateAllocatedAndNonresident(
-        -static_cast<int64_t>(size), 0);
-    return tc_globals.arena().Alloc(size, alignment);
+        -static_cast<int64_t>(size), 0, ArenaUse::kCpuCache);
+    return tc_globals.arena().Alloc(size, alignment, ArenaUse::kCpuCache);
   }
 
   static void Dealloc(void* ptr, size_t size, std::align_val_t alignment) {
@@ -114,7 +133,8 @@ class StaticForwarder {
       ABSL_LOCKS_EXCLUDED(pageheap_lock) {
     TC_ASSERT(tc_globals.IsInited());
     PageHeapSpinLockHolder l;
-    tc_globals.arena().UpdateAllocatedAndNonresident(allocated, nonresident);
+    tc_globals.arena().UpdateAllocatedAndNonresident(allocated, nonresident,
+                                                     ArenaUse::kCpuCache);
   }
 
   static void ShrinkToUsageLimit() ABSL_LOCKS_EXCLUDED(pageheap_lock) {
@@ -135,6 +155,58 @@ class StaticForwarder {
     return Parameters::per_cpu_caches_dynamic_slab_shrink_threshold();
   }
 
+  static bool per_cpu_caches_remote_steal() {
+    return Parameters::per_cpu_caches_remote_steal();
+  }
+
+  static bool per_cpu_caches_batch_remote_frees() {
+    return Parameters::per_cpu_caches_batch_remote_frees();
+  }
+
+  static unsigned GetL3FromCpuId(int cpu) {
+    return CacheTopology::Instance().GetL3FromCpuId(cpu);
+  }
+
+  static bool per_cpu_caches_partitioned_slab_resize() {
+    return Parameters::per_cpu_caches_partitioned_slab_resize();
+  }
+
+  static bool per_cpu_caches_incremental_slab_resize() {
+    return Parameters::per_cpu_caches_incremental_slab_resize();
+  }
+
+  static bool per_cpu_caches_l3_capacity_pools() {
+    return Parameters::per_cpu_caches_l3_capacity_pools();
+  }
+
+  static bool per_cpu_caches_partial_reclaim() {
+    return Parameters::per_cpu_caches_partial_reclaim();
+  }
+
+  static size_t GetNumaPartitionFromCpuId(int cpu) {
+    return tc_globals.numa_topology().GetCpuPartition(cpu);
+  }
+
+  static bool per_cpu_caches_allocation_rate_resize() {
+    return Parameters::per_cpu_caches_allocation_rate_resize();
+  }
+
+  static double per_cpu_caches_target_hit_rate() {
+    return Parameters::per_cpu_caches_target_hit_rate();
+  }
+
+  static bool per_cpu_caches_prefetch_cold_classes() {
+    return Parameters::per_cpu_caches_prefetch_cold_classes();
+  }
+
+  static bool per_cpu_caches_batch_size_autotune() {
+    return Parameters::per_cpu_caches_batch_size_autotune();
+  }
+
+  static bool per_cpu_caches_summary_stats() {
+    return Parameters::per_cpu_caches_summary_stats();
+  }
+
   static size_t class_to_size(int size_class) {
     return tc_globals.sizemap().class_to_size(size_class);
   }
@@ -171,15 +243,40 @@ class StaticForwarder {
   //
   // TODO(b/311398687): re-enable this experiment.
   static bool ConfigureSizeClassMaxCapacity() { return false; }
+
+  static bool per_cpu_caches_local_spans() {
+    return IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_CPU_LOCAL_SPANS);
+  }
+
+  // Pushes all objects of a fresh span of <size_class> onto <objects>, for a
+  // CPU to own, unless the transfer cache or central freelist have objects of
+  // it to hand out. Returns the number of objects pushed.
+  static int RemoveLocalSpan(int size_class, LinkedList& objects) {
+    if (tc_globals.transfer_cache().tc_length(size_class) > 0) return 0;
+    return tc_globals.central_freelist(size_class).RemoveSpan(objects);
+  }
 };
 
+// The slabs hold the size classes of every active NUMA partition, so they
+// grow by this shift to keep each partition's capacity.
 template <typename NumaTopology>
-uint8_t NumaShift(const NumaTopology& topology) {
+uint8_t NumaPartitionsShift(const NumaTopology& topology) {
   return topology.numa_aware()
-             ? absl::bit_ceil(topology.active_partitions() - 1)
+             ? absl::bit_width(topology.active_partitions() - 1)
              : 0;
 }
 
+// Slab offsets are 16 bits wide, in units of pointers, which limits slabs
+// to 512KiB: twice the largest base slab.
+constexpr inline uint8_t kMaxNumaShift = 1;
+
+// Returns how much NUMA partitions widen the slabs.  With more than two
+// partitions, capacities shrink instead to fit into kMaxNumaShift.
+template <typename NumaTopology>
+uint8_t NumaShift(const NumaTopology& topology) {
+  return std::min(NumaPartitionsShift(topology), kMaxNumaShift);
+}
+
 // Translates from a shift value to the offset of that shift in arrays of
 // possible shift values.
 inline uint8_t ShiftOffset(uint8_t shift, uint8_t initial_shift) {
@@ -187,6 +284,13 @@ inline uint8_t ShiftOffset(uint8_t shift, uint8_t initial_shift) {
   return shift - initial_shift;
 }
 
+// Converts a CycleClock duration, such as the time a slab was stopped, to
+// nanoseconds for reporting.
+inline int64_t CyclesToNanoseconds(int64_t cycles) {
+  return static_cast<int64_t>(
+      cycles * 1e9 / absl::base_internal::CycleClock::Frequency());
+}
+
 // Tracks the range of allowed slab shifts.
 struct SlabShiftBounds {
   uint8_t initial_shift;
@@ -248,6 +352,16 @@ class CpuCache {
     // Tracks number of misses recorded as of the end of the last per-class
     // max capacity resize interval.
     kMaxCapacityResize,
+    // Tracks total number of underflows.
+    kUnderflowTotal,
+    // Tracks number of underflows recorded as of the last miss time series
+    // update.
+    kUnderflowTimeSeries,
+    // Tracks total number of overflows.
+    kOverflowTotal,
+    // Tracks number of overflows recorded as of the last miss time series
+    // update.
+    kOverflowTimeSeries,
     kNumTypes,
   };
 
@@ -264,9 +378,34 @@ class CpuCache {
     // Tracks number of misses recorded as of the end of the last slab resize
     // interval.
     kSlabResize,
+    // Tracks number of misses recorded as of the last miss time series
+    // update.
+    kTimeSeries,
     kNumCounts,
   };
 
+  // Underflows and overflows recorded during one epoch of the miss time
+  // series.
+  struct MissTimeSeriesEntry {
+    size_t underflows = 0;
+    size_t overflows = 0;
+
+    static MissTimeSeriesEntry Nil() { return MissTimeSeriesEntry(); }
+
+    void Report(const CpuCacheMissStats& misses) {
+      underflows += misses.underflows;
+      overflows += misses.overflows;
+    }
+
+    bool empty() const { return underflows == 0 && overflows == 0; }
+  };
+
+  // The miss time series keeps one minute epochs over a window of this
+  // length.
+  static constexpr size_t kMissTimeSeriesEpochs = 16;
+  static constexpr absl::Duration kMissTimeSeriesWindow =
+      absl::Minutes(kMissTimeSeriesEpochs);
+
   struct SizeClassCapacityStats {
     size_t min_capacity = 0;
     double avg_capacity = 0;
@@ -318,6 +457,18 @@ class CpuCache {
   // when it's known that no hooks are installed.
   void DeallocateSlowNoHooks(void* ptr, size_t size_class);
 
+  // Allocate up to <len> objects of the given size class into <batch>.
+  // Objects are taken from the current cpu's slab with a single PopBatch and
+  // the remainder is fetched directly from the backing cache. Returns the
+  // number of objects allocated, which is less than <len> only on allocation
+  // failure. May only be called when it's known that no hooks are installed.
+  size_t AllocateBatch(size_t size_class, void** batch, size_t len);
+  // Free <len> objects of the given size class from <batch>. Objects are
+  // pushed to the current cpu's slab with a single PushBatch and whatever
+  // does not fit is released directly to the backing cache. May only be called
+  // when it's known that no hooks are installed.
+  void DeallocateBatch(size_t size_class, void** batch, size_t len);
+
   // Force all Allocate/DeallocateFast to fail in the current thread
   // if malloc hooks are installed.
   void MaybeForceSlowPath();
@@ -339,6 +490,11 @@ class CpuCache {
   // Give the number of objects of a given class in all cpu caches.
   uint64_t TotalObjectsOfClass(size_t size_class) const;
 
+  // Sets objects[size_class] to the number of objects of each class in all cpu
+  // caches and returns the number of bytes used in all cpu caches.  Visits
+  // each cpu once, where TotalObjectsOfClass must visit every cpu per class.
+  uint64_t TotalObjectsByClass(absl::Span<uint64_t> objects) const;
+
   // Give the number of bytes unallocated to any sizeclass in <cpu>'s cache.
   uint64_t Unallocated(int cpu) const;
 
@@ -366,7 +522,38 @@ class CpuCache {
   // populated cpu caches and reclaims the caches that:
   // (1) had same number of used bytes since the last interval,
   // (2) had no change in the number of misses since the last interval.
-  void TryReclaimingCaches();
+  // With L3 capacity pools enabled, the capacity of the reclaimed caches goes
+  // to the pool of their L3 cache. With partial reclaim enabled, the caches
+  // are reclaimed by PartialReclaim() instead of drained.
+  void TryReclaimingCaches() {
+    TryReclaimingCaches([](int) { return true; });
+  }
+
+  // Like TryReclaimingCaches(), but only looks at the caches of the cpus for
+  // which <owns_cpu> returns true.  Calls for disjoint sets of cpus may run
+  // concurrently.
+  void TryReclaimingCaches(absl::FunctionRef<bool(int cpu)> owns_cpu);
+
+  struct L3CapacityPoolStats {
+    // Capacity in the pool, in bytes.
+    size_t available;
+    // Bytes of capacity put into and taken out of the pool so far.
+    uint64_t donated;
+    uint64_t taken;
+  };
+
+  // Reports the capacity pool shared by the cpus of L3 cache <l3>.
+  L3CapacityPoolStats GetL3CapacityPoolStats(unsigned l3) const;
+
+  // Reclaims the caches of populated cpus that this thread is no longer
+  // allowed to run on, e.g. after the cpuset of the container shrank, and
+  // hands their capacity to the cpus that remain allowed. Returns the number
+  // of bytes reclaimed.
+  uint64_t ReclaimDisallowedCpuCaches();
+
+  // Reports the number of times a cache was reclaimed by
+  // ReclaimDisallowedCpuCaches().
+  uint64_t GetNumDisallowedCpuReclaims() const;
 
   // Resize size classes for up to kNumCpuCachesToResize cpu caches per
   // interval.
@@ -384,6 +571,17 @@ class CpuCache {
   // Gets the current capacity for the <size_class> in a <cpu> cache.
   size_t GetCapacityOfSizeClass(int cpu, int size_class) const;
 
+  // Sets the capacities, indexed by size class, that per-cpu caches are
+  // warmed up to when they are first populated. This lets caches start at
+  // capacities learned by a previous run instead of growing them from zero
+  // one cache miss at a time. Warm-up is bounded by the per-cpu cache limit
+  // and capacities keep adapting as usual afterwards.
+  void SetCapacityProfile(absl::Span<const size_t> capacities);
+
+  // Warms up capacities of the already populated per-cpu caches to the
+  // profile set by SetCapacityProfile.
+  void WarmUpPopulatedCaches();
+
   // Computes maximum capacities that we want to update the size classes to. It
   // fetches number of capacity misses obvserved for the size classes, and
   // computes increases to the maximum capacities for the size classes with the
@@ -406,6 +604,17 @@ class CpuCache {
   // stopping all per-cpu caches, this mechanism should be used sparingly.
   void ResizeSizeClassMaxCapacities();
 
+  // Adjusts the number of objects moved between per-cpu caches and the backing
+  // cache of each size class, within [num_objects_to_move / 2,
+  // 2 * num_objects_to_move], based on the backing transfer cache hits and
+  // misses since the previous call. Busy classes that rarely miss move larger
+  // batches, and classes that mostly miss move smaller ones to avoid hoarding.
+  void TuneBatchLengths();
+
+  // Returns the number of objects moved between per-cpu caches and the backing
+  // cache per batch for the size class.
+  size_t GetBatchLength(size_t size_class) const;
+
   // Empty out the cache on <cpu>; move all objects to the central
   // cache.  (If other threads run concurrently on that cpu, we can't
   // guarantee it will be fully empty on return, but if the cpu is
@@ -413,6 +622,19 @@ class CpuCache {
   // of bytes we sent back.  This function is thread safe.
   uint64_t Reclaim(int cpu);
 
+  // Like Reclaim(), but keeps a warm core of objects of each size class. Its
+  // size is taken from the low-water mark of the size class's length over the
+  // last reclaim interval, L: we would not have missed even if the cache had
+  // held L fewer objects. Of those L objects, we keep half, up to a batch, and
+  // release the rest along with all of the unused capacity. Returns the
+  // number of bytes we sent back.
+  uint64_t PartialReclaim(int cpu);
+
+  // Reclaim() for every populated cpu in <cpus>, which must be in increasing
+  // order. The caches are drained together, behind a single fence when there
+  // are more than a few. Returns the number of bytes we sent back.
+  uint64_t ReclaimCpus(absl::Span<const int> cpus);
+
   // Reports number of times the size classes were resized for <cpu>.
   uint64_t GetNumResizes(int cpu) const;
 
@@ -425,10 +647,55 @@ class CpuCache {
   // Reports total number of times any CPU has been reclaimed.
   uint64_t GetNumReclaims() const;
 
+  // Reports number of objects <cpu> has stolen from sibling caches on refill.
+  uint64_t GetNumRemoteSteals(int cpu) const;
+
+  // Reports total number of objects stolen from sibling caches on refill.
+  uint64_t GetNumRemoteSteals() const;
+
+  // Reports number of objects owned by other NUMA partitions that <cpu> has
+  // freed and returned to their partition's transfer cache.
+  uint64_t GetNumRemoteFrees(int cpu) const;
+
+  // Reports total number of objects freed on a CPU of another NUMA partition
+  // and returned to their own partition's transfer cache.
+  uint64_t GetNumRemoteFrees() const;
+
+  // Reports number of spans <cpu> has taken ownership of for its smallest
+  // size classes.
+  uint64_t GetNumLocalSpans(int cpu) const;
+
+  // Reports total number of spans owned by a CPU when they were allocated.
+  uint64_t GetNumLocalSpans() const;
+
   // When dynamic slab size is enabled, checks if there is a need to resize
   // the slab based on miss-counts and resizes if so.
+  //
+  // With incremental slab resizing, the new slabs are set up for a few CPUs
+  // per call, and the CPUs only switch to them once every populated CPU has
+  // been; until then, calls carry on with the resize underway rather than
+  // checking for a new one.
   void ResizeSlabIfNeeded();
 
+  // Returns whether an incremental slab resize is underway, so that
+  // ResizeSlabIfNeeded() should be called again without waiting for the next
+  // resize period.
+  bool SlabResizeInProgress() const { return pending_slab_resize_.active; }
+
+  // Adds the misses recorded since the last call to the per-cpu and
+  // per-size-class miss time series. Called periodically by the background
+  // thread.
+  void UpdateMissTimeSeries();
+
+  // Reports the misses on <cpu> during the epoch <offset> epochs ago, where
+  // offset 0 is the current, incomplete epoch. Does not take pageheap_lock.
+  MissTimeSeriesEntry GetCpuMissTimeSeries(int cpu, size_t offset);
+
+  // Reports the misses of <size_class> summed over all cpus during the epoch
+  // <offset> epochs ago. Does not take pageheap_lock.
+  MissTimeSeriesEntry GetSizeClassMissTimeSeries(size_t size_class,
+                                                 size_t offset);
+
   // Reports total cache underflows and overflows for <cpu>.
   CpuCacheMissStats GetTotalCacheMissStats(int cpu) const;
 
@@ -461,6 +728,16 @@ class CpuCache {
                                     PerClassMissType total_type,
                                     PerClassMissType interval_type);
 
+  // Attributes <bytes> of allocation volume of <size_class> to <cpu>. This is
+  // fed from sampled allocations, with <bytes> being the sample weight, so it
+  // is an unbiased estimate of the bytes allocated without touching the fast
+  // path. Ignores invalid <cpu> ids.
+  void RecordAllocatedBytes(int cpu, size_t size_class, size_t bytes);
+
+  // Reports the estimated number of bytes of <size_class> allocated on <cpu>
+  // during the current size class resize interval.
+  size_t GetIntervalSizeClassAllocatedBytes(int cpu, size_t size_class);
+
   // Reports if we should use a wider 512KiB slab.
   bool UseWiderSlabs() const;
 
@@ -528,6 +805,16 @@ class CpuCache {
     void UpdateIntervalMisses(PerClassMissType total_type,
                               PerClassMissType interval_type);
 
+    // Records <bytes> of allocation volume for this size class.
+    void RecordAllocatedBytes(size_t bytes);
+
+    // Reports the allocation volume recorded since the last call to
+    // UpdateIntervalAllocatedBytes().
+    size_t GetIntervalAllocatedBytes();
+
+    // Takes a snapshot of the allocation volume at the end of an interval.
+    void UpdateIntervalAllocatedBytes();
+
    private:
     std::atomic<int32_t> state_;
     // state_ layout:
@@ -540,6 +827,8 @@ class CpuCache {
       uint32_t successive : 16;
     };
     PerClassMissCounts misses_;
+    std::atomic<size_t> allocated_bytes_;
+    std::atomic<size_t> interval_allocated_bytes_;
     static_assert(sizeof(State) == sizeof(std::atomic<int32_t>),
                   "size mismatch");
   };
@@ -553,6 +842,10 @@ class CpuCache {
     }
   };
 
+  // With cpu-local spans, size classes [1, kNumLocalSpanClasses) of a CPU are
+  // refilled from whole spans it owns.
+  static constexpr size_t kNumLocalSpanClasses = 8;
+
   struct ABSL_CACHELINE_ALIGNED ResizeInfo {
     // cache space on this CPU we're not using.  Modify atomically;
     // we don't want to lose space.
@@ -561,6 +854,8 @@ class CpuCache {
     size_t next_steal = 1;
     // Track whether we have ever populated this CPU.
     std::atomic<bool> populated;
+    // Whether InitResizeInfo() has run.  Until then, every field is zero.
+    std::atomic<bool> initialized;
     // For cross-cpu operations. We can't allocate while holding one of these so
     // please use AllocationGuardSpinLockHolder to hold it.
     absl::base_internal::SpinLock lock ABSL_ACQUIRED_BEFORE(pageheap_lock){
@@ -577,22 +872,60 @@ class CpuCache {
     std::atomic<size_t> capacity;
     // Used bytes in the cache as of the end of the last resize interval.
     std::atomic<uint64_t> reclaim_used_bytes;
+    // Length of each size class as of the end of the last reclaim interval,
+    // if partial reclaim is enabled. Only accessed by the reclaim thread.
+    uint16_t reclaim_lengths[kNumClasses];
     // Tracks number of times this CPU has been reclaimed.
     std::atomic<size_t> num_reclaims;
     // Tracks last time this CPU was reclaimed.  If last underflow/overflow data
     // appears before this point in time, we ignore the CPU.
     std::atomic<int64_t> last_reclaim;
+    // Tracks number of objects this CPU has stolen from sibling caches.
+    std::atomic<size_t> num_remote_steals;
+    // Tracks number of objects of other NUMA partitions' size classes that
+    // this CPU has released to the backing cache on overflow.
+    std::atomic<size_t> num_remote_frees;
+    // Objects left of the spans this CPU owns, by size class, guarded by
+    // lock. Their total size is kept apart so that it can be read without it.
+    LinkedList local_span_objects[kNumLocalSpanClasses];
+    std::atomic<size_t> local_span_bytes;
+    // Tracks number of spans this CPU has taken ownership of.
+    std::atomic<size_t> num_local_spans;
+    // Set by ShouldResizeSlab() for CPUs that saw no misses while their NUMA
+    // partition did not ask for wider slabs. Such CPUs are not re-populated in
+    // the new slab when it grows. Only accessed by the slab resizing thread.
+    bool idle_for_slab_grow;
+    // Whether this CPU has been set up in the new slabs of the incremental
+    // resize underway. Only accessed by the slab resizing thread.
+    bool initialized_for_slab_resize;
+  };
+
+  // A slab resize that sets up the new slabs a few CPUs at a time.
+  struct PendingSlabResize {
+    bool active = false;
+    uint8_t new_shift = 0;
+    // Whether idle CPUs are left unpopulated in the new slabs.
+    bool drop_idle = false;
+    void* new_slabs = nullptr;
+    size_t reused_bytes = 0;
+    // The next CPU to set up in new_slabs.
+    int next_cpu = 0;
   };
 
   struct DynamicSlabInfo {
     std::atomic<size_t> grow_count[kNumPossiblePerCpuShifts];
     std::atomic<size_t> shrink_count[kNumPossiblePerCpuShifts];
     std::atomic<size_t> madvise_failed_bytes;
+    // Number of times a populated CPU was left unpopulated when growing the
+    // slab because its NUMA partition was idle.
+    std::atomic<size_t> idle_cpus_depopulated;
   };
 
   // Determines how we distribute memory in the per-cpu cache to the various
   // class sizes.
   size_t MaxCapacity(size_t size_class) const;
+  // As MaxCapacity(), for a largest slab of 256KiB.
+  size_t MaxCapacityForDefaultSlab(size_t size_class) const;
 
   // Updates maximum capacity for the <size_class> to <cap>.
   void UpdateMaxCapacity(int size_class, uint16_t cap);
@@ -606,8 +939,38 @@ class CpuCache {
   void ReleaseToBackingCache(size_t size_class, absl::Span<void*> batch);
 
   void* Refill(int cpu, size_t size_class);
+
+  // Handles an overflow on <cpu> of <size_class> owned by another NUMA
+  // partition when per_cpu_caches_batch_remote_frees is enabled.
+  void FlushRemoteFrees(int cpu, void* ptr, size_t size_class);
+
+  // Maximum number of sibling caches RefillFromSiblingCache looks at before
+  // giving up and falling back to the transfer cache.
+  static constexpr int kMaxRemoteStealCandidates = 4;
+
+  // Tries to refill <cpu>'s <size_class> from a cache on another cpu sharing
+  // <cpu>'s L3. Returns one of the stolen objects, pushing the rest into
+  // <cpu>'s slab, or nullptr if no sibling had a batch of idle objects.
+  void* RefillFromSiblingCache(int cpu, size_t size_class, size_t target);
+
+  // Tries to refill <cpu>'s <size_class> from the objects left of the spans
+  // <cpu> owns, taking ownership of a new span when there are none and the
+  // backing caches have no objects to hand out either. Returns one of the
+  // objects, pushing the rest into <cpu>'s slab, or nullptr on failure.
+  void* RefillFromLocalSpans(int cpu, size_t size_class, size_t target);
+
+  // Returns the objects left of the spans <cpu> owns to the backing caches.
+  // Returns the number of bytes released.
+  // REQUIRES: resize_[cpu].lock is held.
+  uint64_t ReleaseLocalSpans(int cpu);
   std::pair<int, bool> CacheCpuSlab();
   void Populate(int cpu);
+  // Sets up resize_[cpu] from its zero-filled state, bar its lock.
+  void InitResizeInfo(int cpu);
+
+  // Grows capacities of <cpu>'s size classes towards the warm-up profile.
+  // REQUIRES: resize_[cpu].lock is held.
+  void WarmUpCapacities(int cpu);
 
   // Returns true if we bypass cpu cache for a <size_class>. We may bypass
   // per-cpu cache when we enable certain configurations of sharded transfer
@@ -631,6 +994,26 @@ class CpuCache {
   // previous resize interval, returns if slabs should be grown, shrunk or
   // remain the same.
   DynamicSlabResize ShouldResizeSlab();
+  // Sets up the next kSlabResizeCpusPerStep CPUs in the new slabs of the
+  // incremental resize underway, and switches every CPU to them once all are
+  // set up.
+  void ContinueSlabResize();
+  // Moves every CPU to <new_slabs> of <new_shift>. CPUs for which
+  // <initialized> is true are already set up in them.
+  void CommitSlabResize(uint8_t new_shift, void* new_slabs, size_t reused_bytes,
+                        bool drop_idle,
+                        absl::FunctionRef<bool(size_t)> initialized);
+  // Returns the NUMA partition <cpu> belongs to.
+  size_t PartitionOf(int cpu) const;
+  // Returns whether a NUMA partition with <misses> during the last interval
+  // asks for wider slabs. Partitions without misses never do.
+  static bool PartitionWantsGrow(const CpuCacheMissStats& misses,
+                                 double grow_threshold);
+  // Clears the idle_for_slab_grow mark of CPUs in partitions that ask for
+  // wider slabs.
+  void MarkIdleForSlabGrow(
+      const CpuCacheMissStats (&partition_misses)[kNumaPartitions],
+      double grow_threshold);
 
   // Determine if the <size_class> is a good candidate to be shrunk. We use
   // clock-like algorithm to prioritize size classes for shrinking.
@@ -638,6 +1021,8 @@ class CpuCache {
 
   struct SizeClassMissStat {
     size_t size_class;
+    // When budgeting by allocation rate, this holds the interval allocation
+    // volume in bytes of size classes below the target hit rate instead.
     size_t misses;
   };
   struct CpuMissStat {
@@ -674,6 +1059,13 @@ class CpuCache {
   // Try to steal one object from cpu/size_class. Return bytes stolen.
   size_t ShrinkOtherCache(int cpu, size_t size_class);
 
+  // Moves the unused capacity of <cpu> to the pool of its L3 cache.
+  void DonateToL3Pool(int cpu);
+
+  // Takes up to <bytes> of capacity for <cpu> from the pool of its L3 cache.
+  // The caller adds them to the capacity of <cpu>. Returns bytes taken.
+  size_t TakeFromL3Pool(int cpu, size_t bytes);
+
   // Resizes capacities of up to kMaxSizeClassesToResize size classes for a
   // single <cpu>.
   void ResizeCpuSizeClasses(int cpu);
@@ -686,21 +1078,78 @@ class CpuCache {
       subtle::percpu::Shift shift, int num_cpus, uint8_t shift_offset,
       uint8_t resize_offset);
 
+  // Per-cpu statistics summed across cpus, for reports that leave out the
+  // per-cpu breakdown.
+  struct CpuTotals {
+    uint64_t used = 0;
+    uint64_t unallocated = 0;
+    int active = 0;
+    int populated = 0;
+    typename Freelist::CpuStats slab;
+  };
+  CpuTotals GetCpuTotals(const cpu_set_t& allowed_cpus) const;
+
   Freelist freelist_;
 
   // Tracking data for each CPU's cache resizing efforts.
   ResizeInfo* resize_ = nullptr;
 
+  // Capacity shared by the cpus of an L3 cache, indexed by L3 cache. L3
+  // caches are numbered densely, so there are never more than NumCPUs().
+  struct ABSL_CACHELINE_ALIGNED L3CapacityPool {
+    std::atomic<size_t> available;
+    std::atomic<uint64_t> donated;
+    std::atomic<uint64_t> taken;
+  };
+  L3CapacityPool* l3_pools_ = nullptr;
+
   // Tracks initial and maximum slab shift bounds.
   SlabShiftBounds shift_bounds_{};
 
+  using MissTimeSeries = TimeSeriesTracker<MissTimeSeriesEntry,
+                                           CpuCacheMissStats,
+                                           kMissTimeSeriesEpochs>;
+  // Protects miss_timeseries_. Readers copy entries out, so that we never
+  // allocate while holding it.
+  absl::base_internal::SpinLock miss_timeseries_lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  // Miss time series for each cpu, followed by the ones for each size class.
+  MissTimeSeries* miss_timeseries_ ABSL_GUARDED_BY(miss_timeseries_lock_) =
+      nullptr;
+
   // The maximum capacity of each size class within the slab.
   std::atomic<uint16_t> max_capacity_[kNumClasses] = {0};
 
+  // Batch lengths chosen by TuneBatchLengths(), or 0 for num_objects_to_move.
+  static_assert(kMaxObjectsToMove <= std::numeric_limits<uint8_t>::max());
+  std::atomic<uint8_t> batch_length_[kNumClasses] = {};
+  // Backing transfer cache transfers and misses of each size class as of the
+  // previous TuneBatchLengths(). Only accessed by the background thread.
+  struct BatchLengthTuneState {
+    size_t transfers;
+    size_t misses;
+  };
+  BatchLengthTuneState batch_length_tune_[kNumClasses] = {};
+
+  // Capacities that newly populated caches are warmed up to. Only consulted if
+  // has_capacity_profile_ is set.
+  std::atomic<uint16_t> warmup_capacity_[kNumClasses] = {0};
+  std::atomic<bool> has_capacity_profile_ = false;
+
   // Provides a hint to StealFromOtherCache() so that we can steal from the
   // caches in a round-robin fashion.
   int next_cpu_cache_steal_ = 0;
 
+  // Provides a hint to RefillFromSiblingCache() on where to start looking for
+  // sibling caches with idle objects.
+  std::atomic<int> next_remote_steal_cpu_ = 0;
+
+  // Whether the smallest size classes are refilled from cpu-local spans.
+  bool local_spans_ = false;
+
+  // Number of caches reclaimed because their cpu was no longer allowed.
+  std::atomic<uint64_t> num_disallowed_cpu_reclaims_ = 0;
+
   // Provides a hint to ResizeSizeClasses() that records the last CPU for which
   // we resized size classes. We use this to resize size classes for CPUs in a
   // round-robin fashion.
@@ -712,6 +1161,10 @@ class CpuCache {
   // is an index into the copy currently in use.
   std::atomic<int> resize_slab_offset_ = 0;
 
+  // The incremental slab resize underway, if any. Only accessed by the slab
+  // resizing thread.
+  PendingSlabResize pending_slab_resize_;
+
   // Per-core cache limit in bytes.
   std::atomic<uint64_t> max_per_cpu_cache_size_{kMaxCpuCacheSize};
 
@@ -738,6 +1191,14 @@ template <class Forwarder>
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* CpuCache<Forwarder>::AllocateFast(
     size_t size_class) {
   TC_ASSERT_GT(size_class, 0);
+  // Objects of cold size classes are rarely touched soon after allocation, so
+  // prefetching the next one mostly wastes cache capacity and bandwidth.
+  // IsExpandedSizeClass is a constant comparison, so hot size classes do not
+  // pay for the parameter check.
+  if (IsExpandedSizeClass(size_class) &&
+      ABSL_PREDICT_FALSE(!forwarder_.per_cpu_caches_prefetch_cold_classes())) {
+    return freelist_.Pop</*PrefetchNext=*/false>(size_class);
+  }
   return freelist_.Pop(size_class);
 }
 
@@ -762,13 +1223,15 @@ void CpuCache<Forwarder>::MaybeForceSlowPath() {
   }
 }
 
-static cpu_set_t FillActiveCpuMask() {
+// Returns the cpus that thread <tid> may run on, or those of the calling
+// thread if <tid> is 0.
+static cpu_set_t FillActiveCpuMask(pid_t tid = 0) {
   cpu_set_t allowed_cpus;
-  if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) != 0) {
+  if (sched_getaffinity(tid, sizeof(allowed_cpus), &allowed_cpus) != 0) {
     CPU_ZERO(&allowed_cpus);
   }
 
-#ifdef PERCPU_USE_RSEQ
+#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
   const bool real_cpus = !subtle::percpu::UsingVirtualCpus();
 #else
   const bool real_cpus = true;
@@ -788,6 +1251,17 @@ static cpu_set_t FillActiveCpuMask() {
 
 template <class Forwarder>
 inline size_t CpuCache<Forwarder>::MaxCapacity(size_t size_class) const {
+  const size_t capacity = MaxCapacityForDefaultSlab(size_class);
+  if (kMaxCapacityShift == 0 || capacity == 0) {
+    return capacity;
+  }
+  // Shrink the capacity as GetShiftMaxCapacity does for a narrower slab.
+  return std::max<int>((capacity >> kMaxCapacityShift) - 3, 0);
+}
+
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::MaxCapacityForDefaultSlab(
+    size_t size_class) const {
   // The number of size classes that are commonly used and thus should be
   // allocated more slots in the per-cpu cache.
   static constexpr size_t kNumSmall = 10;
@@ -795,6 +1269,11 @@ inline size_t CpuCache<Forwarder>::MaxCapacity(size_t size_class) const {
   // When we use wider slabs, we also want to double the maximum capacities for
   // size classes to use that slab.
   const size_t kWiderSlabMultiplier = UseWiderSlabs() ? 2 : 1;
+  // If the slabs can't widen enough for all NUMA partitions, they share it.
+  const auto& topology = forwarder_.numa_topology();
+  const size_t kNumaDivisor = size_t{1}
+                              << (NumaPartitionsShift(topology) -
+                                  NumaShift(topology));
 
   // The memory used for each per-CPU slab is the sum of:
   //   sizeof(std::atomic<int64_t>) * kNumClasses
@@ -811,8 +1290,8 @@ inline size_t CpuCache<Forwarder>::MaxCapacity(size_t size_class) const {
   // With SMALL_BUT_SLOW we have 4KiB of per-cpu slab and 46 class sizes we
   // allocate:
   //   == 8 * 46 + 8 * ((16 + 1) * 10 + (6 + 1) * 35) = 4038 bytes of 4096
-  static const uint16_t kSmallObjectDepth = 16;
-  static const uint16_t kLargeObjectDepth = 6;
+  const uint16_t kSmallObjectDepth = 16 / kNumaDivisor;
+  const uint16_t kLargeObjectDepth = 6 / kNumaDivisor;
 #else
   // We allocate 256KiB per-cpu for pointers to cached per-cpu memory.
   // Max(kNumClasses) is 89, so the maximum footprint per CPU for a 256KiB
@@ -824,12 +1303,12 @@ inline size_t CpuCache<Forwarder>::MaxCapacity(size_t size_class) const {
       (ConfigureSizeClassMaxCapacity()
            ? tc_globals.sizemap().max_capacity(size_class)
            : 2048) *
-      kWiderSlabMultiplier;
+      kWiderSlabMultiplier / kNumaDivisor;
   const uint16_t kLargeObjectDepth =
       (ConfigureSizeClassMaxCapacity()
            ? tc_globals.sizemap().max_capacity(size_class)
            : 152) *
-      kWiderSlabMultiplier;
+      kWiderSlabMultiplier / kNumaDivisor;
 #endif
   if (size_class == 0 || size_class >= kNumClasses) {
     return 0;
@@ -858,8 +1337,9 @@ inline size_t CpuCache<Forwarder>::MaxCapacity(size_t size_class) const {
         (ConfigureSizeClassMaxCapacity()
              ? tc_globals.sizemap().max_capacity(size_class)
              : 133) *
-        kWiderSlabMultiplier;
-    const uint16_t kLargeInterestingObjectDepth = 53 * kWiderSlabMultiplier;
+        kWiderSlabMultiplier / kNumaDivisor;
+    const uint16_t kLargeInterestingObjectDepth =
+        53 * kWiderSlabMultiplier / kNumaDivisor;
 
     absl::Span<const size_t> cold = forwarder_.cold_size_classes();
     if (absl::c_binary_search(cold, size_class)) {
@@ -940,6 +1420,7 @@ inline SlabShiftBounds CpuCache<Forwarder>::GetPerCpuSlabShiftBounds() const {
 template <class Forwarder>
 inline void CpuCache<Forwarder>::Activate() {
   int num_cpus = NumCPUs();
+  local_spans_ = forwarder_.per_cpu_caches_local_spans();
 
   shift_bounds_.initial_shift = kInitialBasePerCpuShift;
   shift_bounds_.max_shift = kMaxBasePerCpuShift;
@@ -991,19 +1472,42 @@ inline void CpuCache<Forwarder>::Activate() {
     }
   }
 
+  // Like the slabs, resize_ is mmap'd and not resident.  Only the CPUs we may
+  // run on now are set up here.  Any others are set up by Populate(), if we
+  // ever run there, so that a process confined to a few CPUs of a large
+  // machine does not fault in metadata for all of them.
   resize_ = reinterpret_cast<ResizeInfo*>(forwarder_.Alloc(
       sizeof(ResizeInfo) * num_cpus, std::align_val_t{alignof(ResizeInfo)}));
 
-  auto max_cache_size = CacheLimit();
-
+  const cpu_set_t allowed_cpus = FillActiveCpuMask(getpid());
+  // If we could not determine the mask, set up every CPU.
+  const bool all_cpus = CPU_COUNT(&allowed_cpus) == 0;
   for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    if (!all_cpus && !CPU_ISSET(cpu, &allowed_cpus)) continue;
     new (&resize_[cpu]) ResizeInfo();
+    InitResizeInfo(cpu);
+  }
 
-    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
-      resize_[cpu].per_class[size_class].Init();
+  l3_pools_ = reinterpret_cast<L3CapacityPool*>(
+      forwarder_.Alloc(sizeof(L3CapacityPool) * num_cpus,
+                       std::align_val_t{alignof(L3CapacityPool)}));
+  for (int l3 = 0; l3 < num_cpus; ++l3) {
+    new (&l3_pools_[l3]) L3CapacityPool();
+  }
+
+  {
+    const size_t num_timeseries = num_cpus + kNumClasses;
+    auto* timeseries = reinterpret_cast<MissTimeSeries*>(
+        forwarder_.Alloc(sizeof(MissTimeSeries) * num_timeseries,
+                         std::align_val_t{alignof(MissTimeSeries)}));
+    for (size_t i = 0; i < num_timeseries; ++i) {
+      new (&timeseries[i]) MissTimeSeries(
+          Clock{.now = absl::base_internal::CycleClock::Now,
+                .freq = absl::base_internal::CycleClock::Frequency},
+          kMissTimeSeriesWindow);
     }
-    resize_[cpu].available.store(max_cache_size, std::memory_order_relaxed);
-    resize_[cpu].capacity.store(max_cache_size, std::memory_order_relaxed);
+    AllocationGuardSpinLockHolder h(&miss_timeseries_lock_);
+    miss_timeseries_ = timeseries;
   }
 
   void* slabs =
@@ -1026,10 +1530,30 @@ inline void CpuCache<Forwarder>::Deactivate() {
   }
 
   freelist_.Destroy(&forwarder_.Dealloc);
+  // The new slabs of an unfinished incremental resize stay in
+  // slabs_by_shift_, like every other slab we have switched away from.
+  pending_slab_resize_ = {};
   static_assert(std::is_trivially_destructible<decltype(*resize_)>::value,
                 "ResizeInfo is expected to be trivially destructible");
   forwarder_.Dealloc(resize_, sizeof(*resize_) * num_cpus,
                      std::align_val_t{alignof(decltype(*resize_))});
+  static_assert(std::is_trivially_destructible<L3CapacityPool>::value,
+                "L3CapacityPool is expected to be trivially destructible");
+  forwarder_.Dealloc(l3_pools_, sizeof(L3CapacityPool) * num_cpus,
+                     std::align_val_t{alignof(L3CapacityPool)});
+  l3_pools_ = nullptr;
+
+  MissTimeSeries* timeseries;
+  {
+    AllocationGuardSpinLockHolder h(&miss_timeseries_lock_);
+    timeseries = miss_timeseries_;
+    miss_timeseries_ = nullptr;
+  }
+  static_assert(std::is_trivially_destructible<MissTimeSeries>::value,
+                "MissTimeSeries is expected to be trivially destructible");
+  forwarder_.Dealloc(timeseries,
+                     sizeof(MissTimeSeries) * (num_cpus + kNumClasses),
+                     std::align_val_t{alignof(MissTimeSeries)});
 }
 
 template <class Forwarder>
@@ -1056,6 +1580,7 @@ inline void CpuCache<Forwarder>::ReleaseToBackingCache(
 
 template <class Forwarder>
 void* CpuCache<Forwarder>::AllocateSlow(size_t size_class) {
+  SlowPathTimer timer(SlowPathLayer::kCpuCache, size_class);
   void* ret = AllocateSlowNoHooks(size_class);
   MaybeForceSlowPath();
   return ret;
@@ -1096,6 +1621,19 @@ template <class Forwarder>
 inline void* CpuCache<Forwarder>::Refill(int cpu, size_t size_class) {
   const size_t target = UpdateCapacity(cpu, size_class, false);
 
+  if (ABSL_PREDICT_FALSE(forwarder_.per_cpu_caches_remote_steal())) {
+    if (void* result = RefillFromSiblingCache(cpu, size_class, target)) {
+      return result;
+    }
+  }
+
+  if (ABSL_PREDICT_FALSE(local_spans_) && size_class < kNumLocalSpanClasses &&
+      !UseBackingShardedTransferCache(size_class)) {
+    if (void* result = RefillFromLocalSpans(cpu, size_class, target)) {
+      return result;
+    }
+  }
+
   // Refill target objects in batch_length batches.
   size_t total = 0;
   size_t got;
@@ -1125,13 +1663,139 @@ inline void* CpuCache<Forwarder>::Refill(int cpu, size_t size_class) {
   return result;
 }
 
+template <class Forwarder>
+void* CpuCache<Forwarder>::RefillFromSiblingCache(int cpu, size_t size_class,
+                                                  size_t target) {
+  const size_t want = std::min(kMaxObjectsToMove, std::max<size_t>(target, 1));
+  const int num_cpus = NumCPUs();
+  const unsigned l3 = forwarder_.GetL3FromCpuId(cpu);
+  const int start = next_remote_steal_cpu_.load(std::memory_order_relaxed);
+  void* batch[kMaxObjectsToMove];
+  size_t got = 0;
+  int candidates = 0;
+  for (int i = 0; i < num_cpus && candidates < kMaxRemoteStealCandidates;
+       ++i) {
+    const int other = (start + i) % num_cpus;
+    if (other == cpu || !HasPopulated(other) ||
+        forwarder_.GetL3FromCpuId(other) != l3) {
+      continue;
+    }
+    ++candidates;
+    // Stopping a cpu requires a fence, so only do it for a sibling that holds
+    // at least a full batch of idle objects. Smaller amounts are better served
+    // by the transfer cache.
+    if (freelist_.Length(other, size_class) < want) continue;
+    {
+      AllocationGuardSpinLockHolder h(&resize_[other].lock);
+      subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_,
+                                                               other);
+      got = freelist_.PopBatchOtherCache(other, size_class, batch, want);
+    }
+    if (got != 0) {
+      // Come back to the same sibling next time; it is likely the cpu our
+      // objects are being freed on.
+      next_remote_steal_cpu_.store(other, std::memory_order_relaxed);
+      break;
+    }
+  }
+  if (got == 0) {
+    next_remote_steal_cpu_.store((start + 1) % num_cpus,
+                                 std::memory_order_relaxed);
+    return nullptr;
+  }
+  resize_[cpu].num_remote_steals.fetch_add(got, std::memory_order_relaxed);
+
+  void* result = batch[--got];
+  if (got != 0) {
+    got -= freelist_.PushBatch(size_class, batch, got);
+    if (got != 0) {
+      ReleaseToBackingCache(size_class, {batch, got});
+    }
+  }
+  return result;
+}
+
+template <class Forwarder>
+void* CpuCache<Forwarder>::RefillFromLocalSpans(int cpu, size_t size_class,
+                                                size_t target) {
+  const size_t want = std::min(kMaxObjectsToMove, std::max<size_t>(target, 1));
+  const size_t size = forwarder_.class_to_size(size_class);
+  ResizeInfo& resize = resize_[cpu];
+  void* batch[kMaxObjectsToMove];
+  size_t got;
+  {
+    AllocationGuardSpinLockHolder h(&resize.lock);
+    LinkedList& objects = resize.local_span_objects[size_class];
+    got = std::min(want, objects.length());
+    if (got > 0) {
+      objects.PopBatch(got, batch);
+      resize.local_span_bytes.fetch_sub(got * size, std::memory_order_relaxed);
+    }
+  }
+
+  if (got == 0) {
+    // Take a span of our own; it is only handed out once the backing caches
+    // run dry, so that objects freed to them are reused first.
+    LinkedList span_objects;
+    const size_t total = forwarder_.RemoveLocalSpan(size_class, span_objects);
+    if (total == 0) {
+      return nullptr;
+    }
+    resize.num_local_spans.fetch_add(1, std::memory_order_relaxed);
+    got = std::min(want, total);
+    span_objects.PopBatch(got, batch);
+
+    AllocationGuardSpinLockHolder h(&resize.lock);
+    LinkedList& objects = resize.local_span_objects[size_class];
+    void* chunk[kMaxObjectsToMove];
+    while (!span_objects.empty()) {
+      const size_t n = std::min(kMaxObjectsToMove, span_objects.length());
+      span_objects.PopBatch(n, chunk);
+      objects.PushBatch(n, chunk);
+    }
+    resize.local_span_bytes.fetch_add((total - got) * size,
+                                      std::memory_order_relaxed);
+  }
+
+  void* result = batch[--got];
+  if (got != 0) {
+    got -= freelist_.PushBatch(size_class, batch, got);
+    if (got != 0) {
+      ReleaseToBackingCache(size_class, {batch, got});
+    }
+  }
+  return result;
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::ReleaseLocalSpans(int cpu) {
+  ResizeInfo& resize = resize_[cpu];
+  uint64_t bytes = 0;
+  void* batch[kMaxObjectsToMove];
+  for (size_t size_class = 1; size_class < kNumLocalSpanClasses;
+       ++size_class) {
+    LinkedList& objects = resize.local_span_objects[size_class];
+    const size_t batch_length = forwarder_.num_objects_to_move(size_class);
+    while (!objects.empty()) {
+      const size_t n = std::min(batch_length, objects.length());
+      objects.PopBatch(n, batch);
+      ReleaseToBackingCache(size_class, {batch, n});
+      bytes += n * forwarder_.class_to_size(size_class);
+    }
+  }
+  resize.local_span_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  return bytes;
+}
+
 template <class Forwarder>
 inline bool CpuCache<Forwarder>::BypassCpuCache(size_t size_class) const {
   // We bypass per-cpu cache when sharded transfer cache is enabled for large
   // size classes (i.e. when we use the traditional configuration of the sharded
-  // transfer cache).
+  // transfer cache), except for cold size classes in the cold tier, which keep
+  // their per-cpu caches.
   return forwarder_.sharded_transfer_cache().should_use(size_class) &&
-         forwarder_.UseShardedCacheForLargeClassesOnly();
+         forwarder_.UseShardedCacheForLargeClassesOnly() &&
+         !forwarder_.sharded_transfer_cache().is_cold_tier(size_class);
 }
 
 template <class Forwarder>
@@ -1140,9 +1804,11 @@ inline bool CpuCache<Forwarder>::UseBackingShardedTransferCache(
   // Make sure that the thread is registered with rseq.
   TC_ASSERT(subtle::percpu::IsFastNoInit());
   // We enable sharded cache as a backing cache for all size classes when
-  // generic configuration is enabled.
+  // generic configuration is enabled, and for cold size classes in the cold
+  // tier.
   return forwarder_.sharded_transfer_cache().should_use(size_class) &&
-         forwarder_.UseGenericShardedCache();
+         (forwarder_.UseGenericShardedCache() ||
+          forwarder_.sharded_transfer_cache().is_cold_tier(size_class));
 }
 
 // Calculate number of objects to return/request from transfer cache.
@@ -1205,7 +1871,7 @@ inline size_t CpuCache<Forwarder>::UpdateCapacity(int cpu, size_t size_class,
   // We assert that the return value, target, is non-zero, so starting from an
   // initial capacity of zero means we may be populating this core for the
   // first time.
-  size_t batch_length = forwarder_.num_objects_to_move(size_class);
+  size_t batch_length = GetBatchLength(size_class);
   const size_t max_capacity = GetMaxCapacity(size_class, freelist_.GetShift());
   size_t capacity = freelist_.Capacity(cpu, size_class);
   const bool grow_by_one = capacity < 2 * batch_length;
@@ -1215,6 +1881,9 @@ inline size_t CpuCache<Forwarder>::UpdateCapacity(int cpu, size_t size_class,
   // TODO(ckennelly): Use a strongly typed enum.
   resize.last_miss_cycles[overflow][size_class].store(
       now, std::memory_order_relaxed);
+  resize.per_class[size_class].RecordMiss(
+      overflow ? PerClassMissType::kOverflowTotal
+               : PerClassMissType::kUnderflowTotal);
   bool grow_by_batch =
       resize.per_class[size_class].Update(overflow, grow_by_one, &successive);
   if ((grow_by_one || grow_by_batch) && capacity != max_capacity) {
@@ -1256,10 +1925,28 @@ ABSL_ATTRIBUTE_NOINLINE void CpuCache<Forwarder>::Populate(int cpu) {
   if (resize_[cpu].populated.load(std::memory_order_relaxed)) {
     return;
   }
+  if (!resize_[cpu].initialized.load(std::memory_order_relaxed)) {
+    InitResizeInfo(cpu);
+  }
   freelist_.InitCpu(cpu, GetMaxCapacityFunctor(freelist_.GetShift()));
+  WarmUpCapacities(cpu);
   resize_[cpu].populated.store(true, std::memory_order_release);
 }
 
+template <class Forwarder>
+inline void CpuCache<Forwarder>::InitResizeInfo(int cpu) {
+  ResizeInfo& resize = resize_[cpu];
+  resize.next_steal = 1;
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    resize.per_class[size_class].Init();
+  }
+  // Capacity may have been handed to this CPU already, so add to it.
+  const size_t max_cache_size = CacheLimit();
+  resize.available.fetch_add(max_cache_size, std::memory_order_relaxed);
+  resize.capacity.fetch_add(max_cache_size, std::memory_order_relaxed);
+  resize.initialized.store(true, std::memory_order_relaxed);
+}
+
 inline size_t subtract_at_least(std::atomic<size_t>* a, size_t min,
                                 size_t max) {
   size_t cmp = a->load(std::memory_order_relaxed);
@@ -1281,6 +1968,13 @@ inline void CpuCache<Forwarder>::Grow(int cpu, size_t size_class,
   const size_t desired_bytes = desired_increase * size;
   size_t acquired_bytes =
       subtract_at_least(&resize_[cpu].available, size, desired_bytes);
+  if (acquired_bytes < desired_bytes) {
+    // Top up from the capacity pool of our L3 cache, if there is any.
+    if (size_t taken = TakeFromL3Pool(cpu, desired_bytes - acquired_bytes)) {
+      resize_[cpu].capacity.fetch_add(taken, std::memory_order_relaxed);
+      acquired_bytes += taken;
+    }
+  }
   if (acquired_bytes < desired_bytes) {
     resize_[cpu].per_class[size_class].RecordMiss(
         PerClassMissType::kCapacityTotal);
@@ -1302,12 +1996,68 @@ inline void CpuCache<Forwarder>::Grow(int cpu, size_t size_class,
 }
 
 template <class Forwarder>
-inline void CpuCache<Forwarder>::TryReclaimingCaches() {
+inline void CpuCache<Forwarder>::SetCapacityProfile(
+    absl::Span<const size_t> capacities) {
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t cap =
+        size_class < capacities.size() ? capacities[size_class] : 0;
+    warmup_capacity_[size_class].store(
+        std::min<size_t>(cap, std::numeric_limits<uint16_t>::max()),
+        std::memory_order_relaxed);
+  }
+  has_capacity_profile_.store(true, std::memory_order_release);
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::WarmUpPopulatedCaches() {
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    if (!HasPopulated(cpu)) continue;
+    AllocationGuardSpinLockHolder h(&resize_[cpu].lock);
+    WarmUpCapacities(cpu);
+  }
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::WarmUpCapacities(int cpu) {
+  if (!has_capacity_profile_.load(std::memory_order_acquire)) return;
+
+  subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_, cpu);
+  const auto max_capacity = GetMaxCapacityFunctor(freelist_.GetShift());
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t target =
+        std::min<size_t>(warmup_capacity_[size_class].load(
+                             std::memory_order_relaxed),
+                         max_capacity(size_class));
+    const size_t capacity = freelist_.Capacity(cpu, size_class);
+    if (target <= capacity) continue;
+
+    // Warm-up draws from the same budget as Grow, so it cannot take the cache
+    // over its limit.
+    const size_t size = forwarder_.class_to_size(size_class);
+    const size_t acquired_bytes = subtract_at_least(
+        &resize_[cpu].available, size, (target - capacity) * size);
+    if (acquired_bytes == 0) continue;
+    const size_t got = freelist_.GrowOtherCache(
+        cpu, size_class, acquired_bytes / size,
+        [&](uint8_t shift) { return GetMaxCapacity(size_class, shift); });
+    if (size_t unused = acquired_bytes - got * size) {
+      resize_[cpu].available.fetch_add(unused, std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::TryReclaimingCaches(
+    absl::FunctionRef<bool(int cpu)> owns_cpu) {
   const int num_cpus = NumCPUs();
+  absl::FixedArray<int> to_reclaim(num_cpus);
+  int num_to_reclaim = 0;
+  const bool partial = forwarder_.per_cpu_caches_partial_reclaim();
+  const bool l3_pools = forwarder_.per_cpu_caches_l3_capacity_pools();
 
   for (int cpu = 0; cpu < num_cpus; ++cpu) {
     // Nothing to reclaim if the cpu is not populated.
-    if (!HasPopulated(cpu)) {
+    if (!HasPopulated(cpu) || !owns_cpu(cpu)) {
       continue;
     }
 
@@ -1325,17 +2075,131 @@ inline void CpuCache<Forwarder>::TryReclaimingCaches() {
     // Reclaim the cache if the number of used bytes and total number of misses
     // stayed constant since the last interval.
     if (used_bytes != 0 && used_bytes == prev_used_bytes && misses == 0) {
-      Reclaim(cpu);
+      if (partial) {
+        PartialReclaim(cpu);
+        if (l3_pools) DonateToL3Pool(cpu);
+        // The objects that we kept stay idle; look at the cache again in the
+        // next interval.
+        used_bytes = UsedBytes(cpu);
+      } else {
+        to_reclaim[num_to_reclaim++] = cpu;
+      }
+    }
+    if (partial) {
+      for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+        resize_[cpu].reclaim_lengths[size_class] =
+            freelist_.Length(cpu, size_class);
+      }
     }
 
     // Takes a snapshot of used bytes in the cache at the end of this interval
     // so that we can calculate if cache usage changed in the next interval.
     //
-    // Reclaim occurs on a single thread. So, the relaxed store to used_bytes
-    // is safe.
+    // Each cpu is reclaimed by a single thread. So, the relaxed store to
+    // used_bytes is safe.
     resize_[cpu].reclaim_used_bytes.store(used_bytes,
                                           std::memory_order_relaxed);
   }
+
+  // Idle caches tend to go idle together, e.g. when load drops, so drain them
+  // in one go to share the fences between them.
+  ReclaimCpus(absl::MakeConstSpan(to_reclaim.data(), num_to_reclaim));
+
+  if (l3_pools) {
+    for (int i = 0; i < num_to_reclaim; ++i) {
+      DonateToL3Pool(to_reclaim[i]);
+    }
+  }
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::DonateToL3Pool(int cpu) {
+  // Reclaim has returned all of the slab capacity to the cpu's available
+  // bytes. Should a thread grow a freelist of the cpu concurrently, it keeps
+  // the capacity it took.
+  const size_t freed =
+      resize_[cpu].available.exchange(0, std::memory_order_relaxed);
+  if (freed == 0) return;
+  resize_[cpu].capacity.fetch_sub(freed, std::memory_order_relaxed);
+
+  L3CapacityPool& pool = l3_pools_[forwarder_.GetL3FromCpuId(cpu)];
+  pool.available.fetch_add(freed, std::memory_order_relaxed);
+  pool.donated.fetch_add(freed, std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::TakeFromL3Pool(int cpu, size_t bytes) {
+  // Pools are only filled while they are enabled, but are drawn from even
+  // after that, so that no capacity is stranded in them.
+  L3CapacityPool& pool = l3_pools_[forwarder_.GetL3FromCpuId(cpu)];
+  const size_t taken = subtract_at_least(&pool.available, 0, bytes);
+  if (taken != 0) {
+    pool.taken.fetch_add(taken, std::memory_order_relaxed);
+  }
+  return taken;
+}
+
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::L3CapacityPoolStats
+CpuCache<Forwarder>::GetL3CapacityPoolStats(unsigned l3) const {
+  TC_ASSERT_LT(l3, NumCPUs());
+  const L3CapacityPool& pool = l3_pools_[l3];
+  return {.available = pool.available.load(std::memory_order_relaxed),
+          .donated = pool.donated.load(std::memory_order_relaxed),
+          .taken = pool.taken.load(std::memory_order_relaxed)};
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::ReclaimDisallowedCpuCaches() {
+  const int num_cpus = NumCPUs();
+  // Use the mask of the main thread rather than our own: the calling
+  // background thread may have been pinned by the application, while cpuset
+  // changes apply to all threads.
+  const cpu_set_t allowed_cpus = FillActiveCpuMask(getpid());
+  const int num_allowed = CPU_COUNT(&allowed_cpus);
+  // If we could not determine the mask, there is nothing to hand capacity to.
+  if (num_allowed == 0) return 0;
+
+  uint64_t reclaimed = 0;
+  int next_dest = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed_cpus) || !HasPopulated(cpu)) continue;
+    // Skip caches whose capacity we already handed out.
+    if (resize_[cpu].capacity.load(std::memory_order_relaxed) == 0) continue;
+
+    reclaimed += Reclaim(cpu);
+    num_disallowed_cpu_reclaims_.fetch_add(1, std::memory_order_relaxed);
+
+    // Reclaim has returned all of the slab capacity to the cpu's available
+    // bytes, so we can hand over all of it. Another thread that still runs on
+    // this cpu may grow a freelist concurrently, in which case we leave its
+    // capacity where it is.
+    const size_t freed =
+        resize_[cpu].available.exchange(0, std::memory_order_relaxed);
+    resize_[cpu].capacity.fetch_sub(freed, std::memory_order_relaxed);
+
+    // Spread the freed capacity over the allowed cpus.
+    const size_t share = freed / num_allowed;
+    size_t remainder = freed - share * num_allowed;
+    for (int i = 0; i < num_cpus && (share != 0 || remainder != 0); ++i) {
+      const int dest = (next_dest + i) % num_cpus;
+      if (!CPU_ISSET(dest, &allowed_cpus)) continue;
+      size_t bytes = share;
+      if (remainder != 0) {
+        bytes += remainder;
+        remainder = 0;
+      }
+      resize_[dest].capacity.fetch_add(bytes, std::memory_order_relaxed);
+      resize_[dest].available.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    next_dest = (next_dest + 1) % num_cpus;
+  }
+  return reclaimed;
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumDisallowedCpuReclaims() const {
+  return num_disallowed_cpu_reclaims_.load(std::memory_order_relaxed);
 }
 
 template <class Forwarder>
@@ -1471,6 +2335,11 @@ int CpuCache<Forwarder>::GetUpdatedMaxCapacities(
 template <class Forwarder>
 void CpuCache<Forwarder>::ResizeSizeClassMaxCapacities()
     ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  // The CPUs already set up in the new slabs of an incremental slab resize
+  // are laid out for the current maximum capacities; leave them be until the
+  // resize is done.
+  if (pending_slab_resize_.active) return;
+
   const int num_cpus = NumCPUs();
   const auto& topology = forwarder_.numa_topology();
 
@@ -1557,6 +2426,53 @@ void CpuCache<Forwarder>::ResizeSizeClassMaxCapacities()
                                                 old_slabs_size - reused_bytes);
 }
 
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::GetBatchLength(size_t size_class) const {
+  const size_t default_length = forwarder_.num_objects_to_move(size_class);
+  if (!forwarder_.per_cpu_caches_batch_size_autotune()) return default_length;
+  const size_t tuned =
+      batch_length_[size_class].load(std::memory_order_relaxed);
+  return tuned != 0 ? tuned : default_length;
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::TuneBatchLengths() {
+  // Classes with fewer backing cache transfers than this in an interval keep
+  // their batch length; there is too little to learn from.
+  constexpr size_t kMinTransfers = 64;
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    const size_t default_length = forwarder_.num_objects_to_move(size_class);
+    if (default_length == 0) continue;
+
+    const TransferCacheStats stats =
+        UseBackingShardedTransferCache(size_class)
+            ? forwarder_.sharded_transfer_cache().GetStats(size_class)
+            : forwarder_.transfer_cache().GetStats(size_class);
+    const size_t misses = stats.insert_misses + stats.remove_misses;
+    const size_t transfers = stats.insert_hits + stats.remove_hits + misses;
+    BatchLengthTuneState& state = batch_length_tune_[size_class];
+    const size_t interval_transfers = transfers - state.transfers;
+    const size_t interval_misses = misses - state.misses;
+    state = {transfers, misses};
+    if (interval_transfers < kMinTransfers) continue;
+
+    const size_t min_length = std::max<size_t>(default_length / 2, 1);
+    const size_t max_length = std::min(2 * default_length, kMaxObjectsToMove);
+    const size_t length = GetBatchLength(size_class);
+    const size_t step = std::max<size_t>(default_length / 4, 1);
+    size_t new_length = length;
+    if (2 * interval_misses > interval_transfers) {
+      // Most batches go to the central freelist anyway. Smaller batches drag
+      // fewer objects out of it into the per-cpu caches.
+      new_length = std::max(length > step ? length - step : 0, min_length);
+    } else if (8 * interval_misses < interval_transfers) {
+      // The backing cache absorbs the batches, so make fewer, larger ones.
+      new_length = std::min(length + step, max_length);
+    }
+    batch_length_[size_class].store(new_length, std::memory_order_relaxed);
+  }
+}
+
 template <class Forwarder>
 inline void CpuCache<Forwarder>::ResizeSizeClasses() {
   const int num_cpus = NumCPUs();
@@ -1586,6 +2502,7 @@ inline void CpuCache<Forwarder>::ResizeSizeClasses() {
     for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
       resize_[cpu].per_class[size_class].UpdateIntervalMisses(
           PerClassMissType::kCapacityTotal, PerClassMissType::kCapacityResize);
+      resize_[cpu].per_class[size_class].UpdateIntervalAllocatedBytes();
     }
 
     if (++num_cpus_resized >= kNumCpuCachesToResize) break;
@@ -1605,12 +2522,28 @@ void CpuCache<Forwarder>::ResizeCpuSizeClasses(int cpu) {
   }
 
   absl::FixedArray<SizeClassMissStat> miss_stats(kNumClasses - 1);
+  const bool by_allocation_rate =
+      forwarder_.per_cpu_caches_allocation_rate_resize();
+  const double target_hit_rate = forwarder_.per_cpu_caches_target_hit_rate();
   for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
-    miss_stats[size_class - 1] = SizeClassMissStat{
-        .size_class = size_class,
-        .misses = resize_[cpu].per_class[size_class].GetIntervalMisses(
-            PerClassMissType::kCapacityTotal,
-            PerClassMissType::kCapacityResize)};
+    size_t misses = resize_[cpu].per_class[size_class].GetIntervalMisses(
+        PerClassMissType::kCapacityTotal, PerClassMissType::kCapacityResize);
+    if (by_allocation_rate && misses != 0) {
+      // Rank the classes that miss the target hit rate by the bytes they
+      // allocated during this interval, so that capacity does not go to
+      // classes that miss often but allocate few bytes. As intervals are the
+      // same for all size classes of a cpu, this orders them by allocation
+      // rate.
+      const size_t allocated_bytes =
+          resize_[cpu].per_class[size_class].GetIntervalAllocatedBytes();
+      const double allocations = static_cast<double>(allocated_bytes) /
+                                 forwarder_.class_to_size(size_class);
+      const double hit_rate =
+          allocations > misses ? 1.0 - misses / allocations : 0.0;
+      misses = hit_rate < target_hit_rate ? allocated_bytes : 0;
+    }
+    miss_stats[size_class - 1] =
+        SizeClassMissStat{.size_class = size_class, .misses = misses};
   }
 
   // Sort the collected stats to record size classes with largest number of
@@ -1767,7 +2700,13 @@ inline void CpuCache<Forwarder>::StealFromOtherCache(
     return;
   }
 
-  size_t acquired = 0;
+  // Capacity in the pool of our L3 cache is the cheapest to get, as it is not
+  // held by any cache.
+  size_t acquired = TakeFromL3Pool(cpu, bytes);
+  // With L3 capacity pools, capacity stays within the L3 cache that it was
+  // pooled in.
+  const bool same_l3_only = forwarder_.per_cpu_caches_l3_capacity_pools();
+  const unsigned l3 = forwarder_.GetL3FromCpuId(cpu);
 
   // We use next_cpu_cache_steal_ as a hint to start our search for cpu ids to
   // steal from so that we can iterate through the cpus in a nice round-robin
@@ -1805,6 +2744,8 @@ inline void CpuCache<Forwarder>::StealFromOtherCache(
     // We do not steal from the cache that hasn't been populated yet.
     if (!HasPopulated(src_cpu)) continue;
 
+    if (same_l3_only && forwarder_.GetL3FromCpuId(src_cpu) != l3) continue;
+
     // We do not steal from cache that has capacity less than our lower
     // capacity threshold.
     if (Capacity(src_cpu) < kCacheCapacityThreshold * CacheLimit()) continue;
@@ -1976,6 +2917,12 @@ void CpuCache<Forwarder>::DeallocateSlowNoHooks(void* ptr, size_t size_class) {
       return;
     }
   }
+  const bool remote =
+      !forwarder_.numa_topology().IsLocalToCpuPartition(size_class, cpu);
+  if (ABSL_PREDICT_FALSE(remote) &&
+      forwarder_.per_cpu_caches_batch_remote_frees()) {
+    return FlushRemoteFrees(cpu, ptr, size_class);
+  }
   RecordCacheMissStat(cpu, false);
   const size_t target = UpdateCapacity(cpu, size_class, true);
   size_t total = 0;
@@ -1994,6 +2941,90 @@ void CpuCache<Forwarder>::DeallocateSlowNoHooks(void* ptr, size_t size_class) {
     if (count != kMaxObjectsToMove) break;
     count = 0;
   } while (total < target);
+  if (ABSL_PREDICT_FALSE(remote)) {
+    resize_[cpu].num_remote_frees.fetch_add(total, std::memory_order_relaxed);
+  }
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::FlushRemoteFrees(int cpu, void* ptr,
+                                           size_t size_class) {
+  // Nothing on this CPU allocates from a size class of another partition, so
+  // its slab slots only ever collect remote frees. Rather than growing them
+  // like a missing local class, which also counts as an overflow for cache
+  // shuffling and resizing, keep at most one batch buffered and hand it back
+  // to the owning partition's transfer cache in one go once it fills up.
+  // That moves the objects' cache lines across the interconnect once per
+  // batch rather than trickling them back.
+  const size_t batch_length = GetBatchLength(size_class);
+  const size_t capacity = freelist_.Capacity(cpu, size_class);
+  if (capacity + 1 < batch_length) {
+    Grow(cpu, size_class, batch_length - 1 - capacity);
+    if (DeallocateFast(ptr, size_class)) {
+      return;
+    }
+  }
+
+  void* batch[kMaxObjectsToMove];
+  batch[0] = ptr;
+  const size_t count =
+      1 + freelist_.PopBatch(size_class, batch + 1, batch_length - 1);
+  ReleaseToBackingCache(size_class, absl::Span<void*>(batch, count));
+  resize_[cpu].num_remote_frees.fetch_add(count, std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+size_t CpuCache<Forwarder>::AllocateBatch(size_t size_class, void** batch,
+                                          size_t len) {
+  TC_ASSERT_GT(size_class, 0);
+  if (ABSL_PREDICT_FALSE(len == 0)) return 0;
+  const bool bypass = BypassCpuCache(size_class);
+  size_t total = 0;
+  if (!bypass) {
+    auto [cpu, cached] = CacheCpuSlab();
+    if (ABSL_PREDICT_TRUE(cpu >= 0)) {
+      total = freelist_.PopBatch(size_class, batch, len);
+      if (total != len) {
+        RecordCacheMissStat(cpu, true);
+      }
+    }
+  }
+  while (total < len) {
+    const size_t want = std::min(kMaxObjectsToMove, len - total);
+    const int got =
+        bypass ? forwarder_.sharded_transfer_cache().RemoveRange(
+                     size_class, batch + total, want)
+               : FetchFromBackingCache(size_class, batch + total, want);
+    if (got <= 0) break;
+    total += got;
+  }
+  return total;
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::DeallocateBatch(size_t size_class, void** batch,
+                                          size_t len) {
+  TC_ASSERT_GT(size_class, 0);
+  if (ABSL_PREDICT_FALSE(len == 0)) return;
+  const bool bypass = BypassCpuCache(size_class);
+  if (!bypass) {
+    auto [cpu, cached] = CacheCpuSlab();
+    if (ABSL_PREDICT_TRUE(cpu >= 0)) {
+      // Objects that did not fit are left at the start of <batch>.
+      len -= freelist_.PushBatch(size_class, batch, len);
+      if (len != 0) {
+        RecordCacheMissStat(cpu, false);
+      }
+    }
+  }
+  for (size_t i = 0; i < len; i += kMaxObjectsToMove) {
+    absl::Span<void*> chunk(batch + i, std::min(kMaxObjectsToMove, len - i));
+    if (bypass) {
+      forwarder_.sharded_transfer_cache().InsertRange(size_class, chunk);
+    } else {
+      ReleaseToBackingCache(size_class, chunk);
+    }
+  }
 }
 
 template <class Forwarder>
@@ -2018,7 +3049,8 @@ inline uint64_t CpuCache<Forwarder>::UsedBytes(int target_cpu) const {
     return 0;
   }
 
-  uint64_t total = 0;
+  uint64_t total =
+      resize_[target_cpu].local_span_bytes.load(std::memory_order_relaxed);
   for (int size_class = 1; size_class < kNumClasses; size_class++) {
     int size = forwarder_.class_to_size(size_class);
     total += size * freelist_.Length(target_cpu, size_class);
@@ -2062,14 +3094,45 @@ inline uint64_t CpuCache<Forwarder>::TotalObjectsOfClass(
   return total_objects;
 }
 
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::TotalObjectsByClass(
+    absl::Span<uint64_t> objects) const {
+  TC_ASSERT_EQ(objects.size(), kNumClasses);
+  std::fill(objects.begin(), objects.end(), 0);
+  uint64_t total = 0;
+  for (int cpu = 0, n = NumCPUs(); cpu < n; cpu++) {
+    if (!HasPopulated(cpu)) {
+      continue;
+    }
+    total += resize_[cpu].local_span_bytes.load(std::memory_order_relaxed);
+    for (int size_class = 1; size_class < kNumClasses; size_class++) {
+      const size_t length = freelist_.Length(cpu, size_class);
+      objects[size_class] += length;
+      total += forwarder_.class_to_size(size_class) * length;
+    }
+  }
+  return total;
+}
+
 template <class Forwarder>
 inline uint64_t CpuCache<Forwarder>::Unallocated(int cpu) const {
-  return resize_[cpu].available.load(std::memory_order_relaxed);
+  const uint64_t available =
+      resize_[cpu].available.load(std::memory_order_relaxed);
+  // A CPU not yet set up is owed its limit by InitResizeInfo().
+  if (!resize_[cpu].initialized.load(std::memory_order_relaxed)) {
+    return available + CacheLimit();
+  }
+  return available;
 }
 
 template <class Forwarder>
 inline uint64_t CpuCache<Forwarder>::Capacity(int cpu) const {
-  return resize_[cpu].capacity.load(std::memory_order_relaxed);
+  const uint64_t capacity =
+      resize_[cpu].capacity.load(std::memory_order_relaxed);
+  if (!resize_[cpu].initialized.load(std::memory_order_relaxed)) {
+    return capacity + CacheLimit();
+  }
+  return capacity;
 }
 
 template <class Forwarder>
@@ -2118,6 +3181,7 @@ inline uint64_t CpuCache<Forwarder>::Reclaim(int cpu) {
 
   uint64_t bytes = 0;
   freelist_.Drain(cpu, DrainHandler<CpuCache>{*this, &bytes});
+  bytes += ReleaseLocalSpans(cpu);
 
   // Record that the reclaim occurred for this CPU.
   resize_[cpu].num_reclaims.store(
@@ -2128,6 +3192,95 @@ inline uint64_t CpuCache<Forwarder>::Reclaim(int cpu) {
 
   return bytes;
 }
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::PartialReclaim(int cpu) {
+  AllocationGuardSpinLockHolder h(&resize_[cpu].lock);
+  // As in Reclaim(), avoid faulting in the slabs of unpopulated cpus.
+  if (!HasPopulated(cpu)) {
+    return 0;
+  }
+
+  uint64_t bytes = 0;
+  size_t freed_capacity = 0;
+  {
+    subtle::percpu::ScopedSlabCpuStop<kNumClasses> cpu_stop(freelist_, cpu);
+    for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+      const size_t capacity = freelist_.Capacity(cpu, size_class);
+      if (capacity == 0) continue;
+      const size_t length = freelist_.Length(cpu, size_class);
+      const size_t low_water = std::min<size_t>(
+          length, resize_[cpu].reclaim_lengths[size_class]);
+      const size_t batch_length = forwarder_.num_objects_to_move(size_class);
+      // Objects above the low-water mark were freed during the interval, so
+      // we keep them too.
+      const size_t keep =
+          length - low_water + std::min(low_water / 2, batch_length);
+      if (keep == capacity) continue;
+
+      const size_t size = forwarder_.class_to_size(size_class);
+      const size_t shrunk = freelist_.ShrinkOtherCache(
+          cpu, size_class, capacity - keep,
+          [&](size_t size_class, void** batch, size_t count) {
+            bytes += count * size;
+            for (size_t i = 0; i < count; i += batch_length) {
+              size_t n = std::min(batch_length, count - i);
+              ReleaseToBackingCache(size_class, {batch + i, n});
+            }
+          });
+      freed_capacity += shrunk * size;
+    }
+  }
+  resize_[cpu].available.fetch_add(freed_capacity, std::memory_order_relaxed);
+
+  // Record that the reclaim occurred for this CPU.
+  resize_[cpu].num_reclaims.store(
+      resize_[cpu].num_reclaims.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  resize_[cpu].last_reclaim.store(absl::base_internal::CycleClock::Now(),
+                                  std::memory_order_relaxed);
+  return bytes;
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::ReclaimCpus(absl::Span<const int> cpus)
+    ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  if (cpus.empty()) return 0;
+  if (cpus.size() == 1) return Reclaim(cpus[0]);
+
+  absl::FixedArray<int> populated(cpus.size());
+  int num_populated = 0;
+  uint64_t bytes = 0;
+  // We lock the cpus in increasing order, as the slab resizing does.
+  for (int cpu : cpus) resize_[cpu].lock.Lock();
+  {
+    // We can't allocate while holding the per-cpu spinlocks.
+    AllocationGuard enforce_no_alloc;
+    // As in Reclaim(), avoid faulting in the slabs of unpopulated cpus.
+    for (int cpu : cpus) {
+      if (HasPopulated(cpu)) populated[num_populated++] = cpu;
+    }
+    freelist_.DrainCpus(
+        absl::MakeConstSpan(populated.data(), num_populated),
+        DrainHandler<CpuCache>{*this, &bytes});
+    for (int i = 0; i < num_populated; ++i) {
+      bytes += ReleaseLocalSpans(populated[i]);
+    }
+
+    const int64_t now = absl::base_internal::CycleClock::Now();
+    for (int i = 0; i < num_populated; ++i) {
+      const int cpu = populated[i];
+      resize_[cpu].num_reclaims.store(
+          resize_[cpu].num_reclaims.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+      resize_[cpu].last_reclaim.store(now, std::memory_order_relaxed);
+    }
+  }
+  for (int cpu : cpus) resize_[cpu].lock.Unlock();
+
+  return bytes;
+}
+
 template <class Forwarder>
 inline uint64_t CpuCache<Forwarder>::GetNumResizes(int cpu) const {
   return resize_[cpu].num_size_class_resizes.load(std::memory_order_relaxed);
@@ -2157,6 +3310,45 @@ inline uint64_t CpuCache<Forwarder>::GetNumReclaims() const {
   return reclaims;
 }
 
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumRemoteSteals(int cpu) const {
+  return resize_[cpu].num_remote_steals.load(std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumRemoteSteals() const {
+  uint64_t steals = 0;
+  const int num_cpus = NumCPUs();
+  for (int cpu = 0; cpu < num_cpus; ++cpu) steals += GetNumRemoteSteals(cpu);
+  return steals;
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumLocalSpans(int cpu) const {
+  return resize_[cpu].num_local_spans.load(std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumLocalSpans() const {
+  uint64_t spans = 0;
+  const int num_cpus = NumCPUs();
+  for (int cpu = 0; cpu < num_cpus; ++cpu) spans += GetNumLocalSpans(cpu);
+  return spans;
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumRemoteFrees(int cpu) const {
+  return resize_[cpu].num_remote_frees.load(std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline uint64_t CpuCache<Forwarder>::GetNumRemoteFrees() const {
+  uint64_t frees = 0;
+  const int num_cpus = NumCPUs();
+  for (int cpu = 0; cpu < num_cpus; ++cpu) frees += GetNumRemoteFrees(cpu);
+  return frees;
+}
+
 template <class Forwarder>
 inline std::pair<void*, size_t> CpuCache<Forwarder>::AllocOrReuseSlabs(
     absl::FunctionRef<void*(size_t, std::align_val_t)> alloc,
@@ -2190,17 +3382,33 @@ CpuCache<Forwarder>::ShouldResizeSlab() {
   CpuCacheMissStats total_misses{};
   DynamicSlabResize resize = DynamicSlabResize::kNoop;
   const bool wider_slabs_enabled = UseWiderSlabs();
+  const double grow_threshold =
+      forwarder_.per_cpu_caches_dynamic_slab_grow_threshold();
+  const double shrink_threshold =
+      forwarder_.per_cpu_caches_dynamic_slab_shrink_threshold();
+  const bool partitioned = forwarder_.per_cpu_caches_partitioned_slab_resize();
+  CpuCacheMissStats partition_misses[kNumaPartitions] = {};
   for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    // CPUs never populated have no misses, and are left untouched: they have
+    // nothing to drain when the slab grows.
+    const bool populated = HasPopulated(cpu);
     CpuCacheMissStats misses =
-        GetAndUpdateIntervalCacheMissStats(cpu, MissCount::kSlabResize);
+        populated
+            ? GetAndUpdateIntervalCacheMissStats(cpu, MissCount::kSlabResize)
+            : CpuCacheMissStats{};
     total_misses += misses;
+    if (populated) {
+      resize_[cpu].idle_for_slab_grow =
+          misses.underflows == 0 && misses.overflows == 0;
+    }
+    if (partitioned) {
+      partition_misses[PartitionOf(cpu)] += misses;
+    }
 
     // If overflows to underflows ratio exceeds the threshold, grow the slab.
     // Increase counts by 1 during comparison so that we can still compare the
     // ratio to the threshold when underflows is zero.
-    if (misses.overflows + 1 >
-        (misses.underflows + 1) *
-            forwarder_.per_cpu_caches_dynamic_slab_grow_threshold()) {
+    if (misses.overflows + 1 > (misses.underflows + 1) * grow_threshold) {
       resize = DynamicSlabResize::kGrow;
     }
   }
@@ -2209,29 +3417,82 @@ CpuCache<Forwarder>::ShouldResizeSlab() {
   // condition for at least one cpu cache is met. Else, we use total misses to
   // figure out whether to grow the slab, shrink it, or do nothing.
   if (wider_slabs_enabled && resize == DynamicSlabResize::kGrow) {
+    if (partitioned) MarkIdleForSlabGrow(partition_misses, grow_threshold);
     return resize;
   }
 
+  // With partitioned resizing, misses are judged per NUMA partition so that a
+  // busy partition is not masked by an idle one: any partition may ask for
+  // growth, while shrinking requires agreement from every partition.
+  if (partitioned) {
+    bool grow = false;
+    bool shrink = total_misses.underflows > 0;
+    for (const CpuCacheMissStats& misses : partition_misses) {
+      // Partitions without any misses have no opinion either way.
+      if (misses.underflows == 0 && misses.overflows == 0) continue;
+      if (PartitionWantsGrow(misses, grow_threshold)) grow = true;
+      if (misses.overflows >= misses.underflows * shrink_threshold) {
+        shrink = false;
+      }
+    }
+    if (grow) {
+      MarkIdleForSlabGrow(partition_misses, grow_threshold);
+      return DynamicSlabResize::kGrow;
+    }
+    return shrink ? DynamicSlabResize::kShrink : DynamicSlabResize::kNoop;
+  }
+
   // As a simple heuristic, we decide to grow if the total number of overflows
   // is large compared to total number of underflows during the growth period.
   // If the slab size was infinite, we would expect 0 overflows. If the slab
   // size was 0, we would expect approximately equal numbers of underflows and
   // overflows.
   if (total_misses.overflows + 1 >
-      (total_misses.underflows + 1) *
-          forwarder_.per_cpu_caches_dynamic_slab_grow_threshold()) {
+      (total_misses.underflows + 1) * grow_threshold) {
     return DynamicSlabResize::kGrow;
   } else if (total_misses.overflows <
-             total_misses.underflows *
-                 forwarder_.per_cpu_caches_dynamic_slab_shrink_threshold()) {
+             total_misses.underflows * shrink_threshold) {
     return DynamicSlabResize::kShrink;
   }
 
   return DynamicSlabResize::kNoop;
 }
 
+template <class Forwarder>
+inline size_t CpuCache<Forwarder>::PartitionOf(int cpu) const {
+  const size_t partition = forwarder_.GetNumaPartitionFromCpuId(cpu);
+  TC_ASSERT_LT(partition, kNumaPartitions);
+  return partition;
+}
+
+template <class Forwarder>
+inline bool CpuCache<Forwarder>::PartitionWantsGrow(
+    const CpuCacheMissStats& misses, double grow_threshold) {
+  if (misses.underflows == 0 && misses.overflows == 0) return false;
+  return misses.overflows + 1 > (misses.underflows + 1) * grow_threshold;
+}
+
+template <class Forwarder>
+inline void CpuCache<Forwarder>::MarkIdleForSlabGrow(
+    const CpuCacheMissStats (&partition_misses)[kNumaPartitions],
+    double grow_threshold) {
+  // A CPU stays marked idle only if it had no misses itself and its partition
+  // as a whole did not ask for wider slabs.
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    if (!resize_[cpu].idle_for_slab_grow) continue;
+    if (PartitionWantsGrow(partition_misses[PartitionOf(cpu)],
+                           grow_threshold)) {
+      resize_[cpu].idle_for_slab_grow = false;
+    }
+  }
+}
+
 template <class Forwarder>
 void CpuCache<Forwarder>::ResizeSlabIfNeeded() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  if (pending_slab_resize_.active) {
+    ContinueSlabResize();
+    return;
+  }
   uint8_t per_cpu_shift = freelist_.GetShift();
 
   const int num_cpus = NumCPUs();
@@ -2261,27 +3522,104 @@ void CpuCache<Forwarder>::ResizeSlabIfNeeded() ABSL_NO_THREAD_SAFETY_ANALYSIS {
   forwarder_.ArenaUpdateAllocatedAndNonresident(new_slabs_size, 0);
   forwarder_.ShrinkToUsageLimit();
 
+  // With partitioned resizing, idle CPUs of partitions that did not ask for
+  // growth are drained from the old slab but not initialized in the new one,
+  // so the wider slab does not fault in metadata for them. They are populated
+  // again lazily on their next use.
+  const bool drop_idle = resize == DynamicSlabResize::kGrow &&
+                         forwarder_.per_cpu_caches_partitioned_slab_resize();
+  auto [new_slabs, reused_bytes] = AllocOrReuseSlabs(
+      [&](size_t size, std::align_val_t align) {
+        return forwarder_.AllocReportedImpending(size, align);
+      },
+      new_shift, num_cpus,
+      ShiftOffset(per_cpu_shift, shift_bounds_.initial_shift),
+      resize_slab_offset_.load(std::memory_order_relaxed));
+
+  if (!forwarder_.per_cpu_caches_incremental_slab_resize()) {
+    CommitSlabResize(per_cpu_shift, new_slabs, reused_bytes, drop_idle,
+                     [](size_t) { return false; });
+    return;
+  }
+
+  // Setting up the new slabs faults them in, which is most of the cost of a
+  // resize. Do it ahead of the switch, a few CPUs per call, so that every
+  // CPU is only stopped for the switch itself. Both slabs stay allocated in
+  // the meantime.
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    resize_[cpu].initialized_for_slab_resize = false;
+  }
+  PendingSlabResize& pending = pending_slab_resize_;
+  pending.active = true;
+  pending.new_shift = per_cpu_shift;
+  pending.drop_idle = drop_idle;
+  pending.new_slabs = new_slabs;
+  pending.reused_bytes = reused_bytes;
+  pending.next_cpu = 0;
+  ContinueSlabResize();
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::ContinueSlabResize() {
+  PendingSlabResize& pending = pending_slab_resize_;
+  TC_ASSERT(pending.active);
+  const int num_cpus = NumCPUs();
+  const GetShiftMaxCapacity capacity{max_capacity_, pending.new_shift,
+                                     shift_bounds_};
+  const int end = std::min(pending.next_cpu + kSlabResizeCpusPerStep, num_cpus);
+  for (int cpu = pending.next_cpu; cpu < end; ++cpu) {
+    // CPUs populated after their turn are set up when the slabs are switched.
+    if (!HasPopulated(cpu) ||
+        (pending.drop_idle && resize_[cpu].idle_for_slab_grow)) {
+      continue;
+    }
+    freelist_.InitCpuForResize(pending.new_slabs,
+                               subtle::percpu::ToShiftType(pending.new_shift),
+                               cpu, capacity);
+    resize_[cpu].initialized_for_slab_resize = true;
+  }
+  pending.next_cpu = end;
+  if (end < num_cpus) return;
+
+  CommitSlabResize(pending.new_shift, pending.new_slabs, pending.reused_bytes,
+                   pending.drop_idle, [this](int cpu) {
+                     return resize_[cpu].initialized_for_slab_resize;
+                   });
+  pending = {};
+}
+
+template <class Forwarder>
+void CpuCache<Forwarder>::CommitSlabResize(
+    uint8_t new_shift, void* new_slabs, size_t reused_bytes, bool drop_idle,
+    absl::FunctionRef<bool(size_t)> initialized)
+    ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  const int num_cpus = NumCPUs();
   for (int cpu = 0; cpu < num_cpus; ++cpu) resize_[cpu].lock.Lock();
+  // The populated bit of dropped idle CPUs must be cleared before the CPUs are
+  // restarted by ResizeSlabs; the resize locks held here keep Populate() from
+  // racing with us.
+  for (int cpu = 0; drop_idle && cpu < num_cpus; ++cpu) {
+    if (resize_[cpu].idle_for_slab_grow && HasPopulated(cpu)) {
+      resize_[cpu].populated.store(false, std::memory_order_relaxed);
+      dynamic_slab_info_.idle_cpus_depopulated.fetch_add(
+          1, std::memory_order_relaxed);
+    } else {
+      resize_[cpu].idle_for_slab_grow = false;
+    }
+  }
   ResizeSlabsInfo info;
-  const uint8_t resize_offset =
-      resize_slab_offset_.load(std::memory_order_relaxed);
-  int64_t reused_bytes;
   {
     // We can't allocate while holding the per-cpu spinlocks.
     AllocationGuard enforce_no_alloc;
-
-    void* new_slabs;
-    std::tie(new_slabs, reused_bytes) = AllocOrReuseSlabs(
-        [&](size_t size, std::align_val_t align) {
-          return forwarder_.AllocReportedImpending(size, align);
-        },
-        new_shift, num_cpus,
-        ShiftOffset(per_cpu_shift, shift_bounds_.initial_shift), resize_offset);
     info = freelist_.ResizeSlabs(
-        new_shift, new_slabs,
-        GetShiftMaxCapacity{max_capacity_, per_cpu_shift, shift_bounds_},
+        subtle::percpu::ToShiftType(new_shift), new_slabs,
+        GetShiftMaxCapacity{max_capacity_, new_shift, shift_bounds_},
         [this](int cpu) { return HasPopulated(cpu); },
-        DrainHandler<CpuCache>{*this, nullptr});
+        [this, drop_idle](int cpu) {
+          return HasPopulated(cpu) ||
+                 (drop_idle && resize_[cpu].idle_for_slab_grow);
+        },
+        initialized, DrainHandler<CpuCache>{*this, nullptr});
   }
   for (int cpu = 0; cpu < num_cpus; ++cpu) resize_[cpu].lock.Unlock();
 
@@ -2301,8 +3639,9 @@ void CpuCache<Forwarder>::ResizeSlabIfNeeded() ABSL_NO_THREAD_SAFETY_ANALYSIS {
         info.old_slabs_size, std::memory_order_relaxed);
   }
   const int64_t old_slabs_size = info.old_slabs_size;
+  const int64_t reused = reused_bytes;
   forwarder_.ArenaUpdateAllocatedAndNonresident(-old_slabs_size,
-                                                old_slabs_size - reused_bytes);
+                                                old_slabs_size - reused);
 }
 
 template <class Forwarder>
@@ -2378,6 +3717,59 @@ CpuCache<Forwarder>::GetAndUpdateIntervalCacheMissStats(int cpu,
   return interval_stats;
 }
 
+template <class Forwarder>
+void CpuCache<Forwarder>::UpdateMissTimeSeries() {
+  const int num_cpus = NumCPUs();
+  AllocationGuardSpinLockHolder h(&miss_timeseries_lock_);
+  if (miss_timeseries_ == nullptr) return;
+
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    // Unpopulated CPUs have no misses to report.
+    if (!HasPopulated(cpu)) continue;
+    miss_timeseries_[cpu].Report(
+        GetAndUpdateIntervalCacheMissStats(cpu, MissCount::kTimeSeries));
+  }
+
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    CpuCacheMissStats misses;
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      if (!HasPopulated(cpu)) continue;
+      PerClassResizeInfo& info = resize_[cpu].per_class[size_class];
+      misses.underflows += info.GetAndUpdateIntervalMisses(
+          PerClassMissType::kUnderflowTotal,
+          PerClassMissType::kUnderflowTimeSeries);
+      misses.overflows += info.GetAndUpdateIntervalMisses(
+          PerClassMissType::kOverflowTotal,
+          PerClassMissType::kOverflowTimeSeries);
+    }
+    miss_timeseries_[num_cpus + size_class].Report(misses);
+  }
+}
+
+template <class Forwarder>
+typename CpuCache<Forwarder>::MissTimeSeriesEntry
+CpuCache<Forwarder>::GetCpuMissTimeSeries(int cpu, size_t offset) {
+  TC_ASSERT_GE(cpu, 0);
+  TC_ASSERT_LT(cpu, NumCPUs());
+  AllocationGuardSpinLockHolder h(&miss_timeseries_lock_);
+  if (miss_timeseries_ == nullptr) return MissTimeSeriesEntry::Nil();
+  miss_timeseries_[cpu].UpdateTimeBase();
+  return miss_timeseries_[cpu].GetEpochAtOffset(offset);
+}
+
+template <class Forwarder>
+typename CpuCache<Forwarder>::MissTimeSeriesEntry
+CpuCache<Forwarder>::GetSizeClassMissTimeSeries(size_t size_class,
+                                                size_t offset) {
+  TC_ASSERT_LT(size_class, kNumClasses);
+  const int num_cpus = NumCPUs();
+  AllocationGuardSpinLockHolder h(&miss_timeseries_lock_);
+  if (miss_timeseries_ == nullptr) return MissTimeSeriesEntry::Nil();
+  MissTimeSeries& timeseries = miss_timeseries_[num_cpus + size_class];
+  timeseries.UpdateTimeBase();
+  return timeseries.GetEpochAtOffset(offset);
+}
+
 template <class Forwarder>
 size_t CpuCache<Forwarder>::GetIntervalSizeClassMisses(
     int cpu, size_t size_class, PerClassMissType total_type,
@@ -2386,6 +3778,21 @@ size_t CpuCache<Forwarder>::GetIntervalSizeClassMisses(
                                                               interval_type);
 }
 
+template <class Forwarder>
+inline void CpuCache<Forwarder>::RecordAllocatedBytes(int cpu,
+                                                      size_t size_class,
+                                                      size_t bytes) {
+  if (ABSL_PREDICT_FALSE(cpu < 0 || cpu >= NumCPUs())) return;
+  TC_ASSERT_LT(size_class, kNumClasses);
+  resize_[cpu].per_class[size_class].RecordAllocatedBytes(bytes);
+}
+
+template <class Forwarder>
+size_t CpuCache<Forwarder>::GetIntervalSizeClassAllocatedBytes(
+    int cpu, size_t size_class) {
+  return resize_[cpu].per_class[size_class].GetIntervalAllocatedBytes();
+}
+
 template <class Forwarder>
 inline typename CpuCache<Forwarder>::SizeClassCapacityStats
 CpuCache<Forwarder>::GetSizeClassCapacityStats(size_t size_class) const {
@@ -2469,6 +3876,23 @@ CpuCache<Forwarder>::GetSizeClassCapacityStats(size_t size_class) const {
   return stats;
 }
 
+template <class Forwarder>
+inline typename CpuCache<Forwarder>::CpuTotals
+CpuCache<Forwarder>::GetCpuTotals(const cpu_set_t& allowed_cpus) const {
+  CpuTotals totals;
+  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+    totals.used += UsedBytes(cpu);
+    totals.unallocated += Unallocated(cpu);
+    totals.active += CPU_ISSET(cpu, &allowed_cpus) ? 1 : 0;
+    totals.populated += HasPopulated(cpu) ? 1 : 0;
+    const auto slab_stats = freelist_.GetCpuStats(cpu);
+    totals.slab.rseq_aborts += slab_stats.rseq_aborts;
+    totals.slab.fences += slab_stats.fences;
+    totals.slab.stopped_cycles += slab_stats.stopped_cycles;
+  }
+  return totals;
+}
+
 template <class Forwarder>
 inline void CpuCache<Forwarder>::Print(Printer* out) const {
   out->printf("------------------------------------------------\n");
@@ -2478,10 +3902,18 @@ inline void CpuCache<Forwarder>::Print(Printer* out) const {
 
   const cpu_set_t allowed_cpus = FillActiveCpuMask();
   const int num_cpus = NumCPUs();
+  const bool summary = forwarder_.per_cpu_caches_summary_stats();
+  static constexpr double MiB = 1048576.0;
 
-  for (int cpu = 0; cpu < num_cpus; ++cpu) {
-    static constexpr double MiB = 1048576.0;
-
+  if (summary) {
+    const CpuTotals totals = GetCpuTotals(allowed_cpus);
+    out->printf(
+        "Total  : %12u bytes (%7.1f MiB) with%12u bytes unallocated, "
+        "%d active, %d populated cpus\n",
+        totals.used, totals.used / MiB, totals.unallocated, totals.active,
+        totals.populated);
+  }
+  for (int cpu = 0; !summary && cpu < num_cpus; ++cpu) {
     uint64_t rbytes = UsedBytes(cpu);
     bool populated = HasPopulated(cpu);
     uint64_t unallocated = Unallocated(cpu);
@@ -2537,11 +3969,67 @@ inline void CpuCache<Forwarder>::Print(Printer* out) const {
   };
   out->printf("Total  :");
   print_miss_stats(GetTotalCacheMissStats(), GetNumReclaims(), GetNumResizes());
-  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+  for (int cpu = 0; !summary && cpu < num_cpus; ++cpu) {
     out->printf("cpu %3d:", cpu);
     print_miss_stats(GetTotalCacheMissStats(cpu), GetNumReclaims(cpu),
                      GetNumResizes(cpu));
   }
+  out->printf("Objects stolen from sibling caches on refill: %12u\n",
+              GetNumRemoteSteals());
+  out->printf("Caches reclaimed from disallowed cpus: %12u\n",
+              GetNumDisallowedCpuReclaims());
+  out->printf("Objects freed on a remote NUMA partition: %12u\n",
+              GetNumRemoteFrees());
+  out->printf("Spans owned by a cpu when allocated: %12u\n",
+              GetNumLocalSpans());
+  for (int l3 = 0; l3 < num_cpus; ++l3) {
+    const L3CapacityPoolStats pool = GetL3CapacityPoolStats(l3);
+    if (pool.donated == 0) continue;
+    out->printf(
+        "L3 %3d capacity pool: %12u bytes available, %12u donated, "
+        "%12u taken\n",
+        l3, pool.available, pool.donated, pool.taken);
+  }
+
+  out->printf("------------------------------------------------\n");
+  out->printf("Per-CPU slab rseq aborts, fences, and time stopped\n");
+  out->printf("------------------------------------------------\n");
+  if (summary) {
+    const auto slab_stats = GetCpuTotals(allowed_cpus).slab;
+    out->printf("Total  : %12u rseq aborts, %12u fences, %12d ns stopped\n",
+                slab_stats.rseq_aborts, slab_stats.fences,
+                CyclesToNanoseconds(slab_stats.stopped_cycles));
+  }
+  for (int cpu = 0; !summary && cpu < num_cpus; ++cpu) {
+    const auto slab_stats = freelist_.GetCpuStats(cpu);
+    out->printf("cpu %3d: %12u rseq aborts, %12u fences, %12d ns stopped\n",
+                cpu, slab_stats.rseq_aborts, slab_stats.fences,
+                CyclesToNanoseconds(slab_stats.stopped_cycles));
+  }
+  out->printf("Fences across all cpus: %12u\n",
+              subtle::percpu::NumFenceAllCpus());
+  const subtle::percpu::FenceStats fence_stats =
+      subtle::percpu::GetFenceStats();
+  out->printf(
+      "Fence latency: %12u single-cpu fences, %12d ns; "
+      "%12u all-cpu fences, %12d ns\n",
+      fence_stats.cpu_fences, CyclesToNanoseconds(fence_stats.cpu_fence_cycles),
+      fence_stats.all_cpu_fences,
+      CyclesToNanoseconds(fence_stats.all_cpu_fence_cycles));
+
+  if (forwarder_.per_cpu_caches_batch_size_autotune()) {
+    out->printf("------------------------------------------------\n");
+    out->printf("Per-CPU cache batch lengths tuned away from the default:\n");
+    out->printf("------------------------------------------------\n");
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      const size_t length = GetBatchLength(size_class);
+      const size_t default_length = forwarder_.num_objects_to_move(size_class);
+      if (length == default_length) continue;
+      out->printf("class %3d [ %8zu bytes ] : %3zu objects (default %3zu)\n",
+                  size_class, forwarder_.class_to_size(size_class), length,
+                  default_length);
+    }
+  }
 
   out->printf("------------------------------------------------\n");
   out->printf("Per-CPU cache slab resizing info:\n");
@@ -2559,13 +4047,37 @@ inline void CpuCache<Forwarder>::Print(Printer* out) const {
   out->printf(
       "%12u bytes for which MADVISE_DONTNEED failed\n",
       dynamic_slab_info_.madvise_failed_bytes.load(std::memory_order_relaxed));
+  out->printf("%12u idle CPUs left unpopulated on slab growth\n",
+              dynamic_slab_info_.idle_cpus_depopulated.load(
+                  std::memory_order_relaxed));
 }
 
 template <class Forwarder>
 inline void CpuCache<Forwarder>::PrintInPbtxt(PbtxtRegion* region) const {
   const cpu_set_t allowed_cpus = FillActiveCpuMask();
-
-  for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+  const bool summary = forwarder_.per_cpu_caches_summary_stats();
+
+  if (summary) {
+    const CpuTotals totals = GetCpuTotals(allowed_cpus);
+    const CpuCacheMissStats miss_stats = GetTotalCacheMissStats();
+    PbtxtRegion entry = region->CreateSubRegion("cpu_cache_total");
+    entry.PrintI64("used", totals.used);
+    entry.PrintI64("unused", totals.unallocated);
+    entry.PrintI64("active_cpus", totals.active);
+    entry.PrintI64("populated_cpus", totals.populated);
+    entry.PrintI64("underflows", miss_stats.underflows);
+    entry.PrintI64("overflows", miss_stats.overflows);
+    entry.PrintI64("reclaims", GetNumReclaims());
+    entry.PrintI64("size_class_resizes", GetNumResizes());
+    entry.PrintI64("remote_steals", GetNumRemoteSteals());
+    entry.PrintI64("remote_frees", GetNumRemoteFrees());
+    entry.PrintI64("local_spans", GetNumLocalSpans());
+    entry.PrintI64("rseq_aborts", totals.slab.rseq_aborts);
+    entry.PrintI64("fences", totals.slab.fences);
+    entry.PrintI64("stopped_ns",
+                   CyclesToNanoseconds(totals.slab.stopped_cycles));
+  }
+  for (int cpu = 0, num_cpus = NumCPUs(); !summary && cpu < num_cpus; ++cpu) {
     PbtxtRegion entry = region->CreateSubRegion("cpu_cache");
     uint64_t rbytes = UsedBytes(cpu);
     bool populated = HasPopulated(cpu);
@@ -2582,7 +4094,33 @@ inline void CpuCache<Forwarder>::PrintInPbtxt(PbtxtRegion* region) const {
     entry.PrintI64("overflows", miss_stats.overflows);
     entry.PrintI64("reclaims", reclaims);
     entry.PrintI64("size_class_resizes", resizes);
+    entry.PrintI64("remote_steals", GetNumRemoteSteals(cpu));
+    entry.PrintI64("remote_frees", GetNumRemoteFrees(cpu));
+    entry.PrintI64("local_spans", GetNumLocalSpans(cpu));
+    const auto slab_stats = freelist_.GetCpuStats(cpu);
+    entry.PrintI64("rseq_aborts", slab_stats.rseq_aborts);
+    entry.PrintI64("fences", slab_stats.fences);
+    entry.PrintI64("stopped_ns",
+                   CyclesToNanoseconds(slab_stats.stopped_cycles));
+  }
+  region->PrintI64("disallowed_cpu_reclaims", GetNumDisallowedCpuReclaims());
+  for (int l3 = 0, num_l3s = NumCPUs(); l3 < num_l3s; ++l3) {
+    const L3CapacityPoolStats pool = GetL3CapacityPoolStats(l3);
+    if (pool.donated == 0) continue;
+    PbtxtRegion entry = region->CreateSubRegion("l3_capacity_pool");
+    entry.PrintI64("l3", l3);
+    entry.PrintI64("available", pool.available);
+    entry.PrintI64("donated", pool.donated);
+    entry.PrintI64("taken", pool.taken);
   }
+  region->PrintI64("fence_all_cpus", subtle::percpu::NumFenceAllCpus());
+  const subtle::percpu::FenceStats fence_stats =
+      subtle::percpu::GetFenceStats();
+  region->PrintI64("single_cpu_fences", fence_stats.cpu_fences);
+  region->PrintI64("single_cpu_fence_ns",
+                   CyclesToNanoseconds(fence_stats.cpu_fence_cycles));
+  region->PrintI64("all_cpu_fence_ns",
+                   CyclesToNanoseconds(fence_stats.all_cpu_fence_cycles));
 
   // Record size class capacity statistics.
   for (int size_class = 1; size_class < kNumClasses; ++size_class) {
@@ -2619,6 +4157,9 @@ inline void CpuCache<Forwarder>::PrintInPbtxt(PbtxtRegion* region) const {
   region->PrintI64(
       "dynamic_slab_madvise_failed_bytes",
       dynamic_slab_info_.madvise_failed_bytes.load(std::memory_order_relaxed));
+  region->PrintI64("dynamic_slab_idle_cpus_depopulated",
+                   dynamic_slab_info_.idle_cpus_depopulated.load(
+                       std::memory_order_relaxed));
 }
 
 template <class Forwarder>
@@ -2711,6 +4252,34 @@ void CpuCache<Forwarder>::PerClassResizeInfo::UpdateIntervalMisses(
   misses_[interval_type].store(total_misses, std::memory_order_relaxed);
 }
 
+template <class Forwarder>
+inline void CpuCache<Forwarder>::PerClassResizeInfo::RecordAllocatedBytes(
+    size_t bytes) {
+  // Sampled allocations on the same cpu may race; losing an occasional sample
+  // is fine for a rate estimate.
+  allocated_bytes_.store(
+      allocated_bytes_.load(std::memory_order_relaxed) + bytes,
+      std::memory_order_relaxed);
+}
+
+template <class Forwarder>
+inline size_t
+CpuCache<Forwarder>::PerClassResizeInfo::GetIntervalAllocatedBytes() {
+  const size_t total = allocated_bytes_.load(std::memory_order_relaxed);
+  const size_t interval =
+      interval_allocated_bytes_.load(std::memory_order_relaxed);
+  // In case of a size_t overflow, we wrap around to 0.
+  return total > interval ? total - interval : 0;
+}
+
+template <class Forwarder>
+inline void
+CpuCache<Forwarder>::PerClassResizeInfo::UpdateIntervalAllocatedBytes() {
+  interval_allocated_bytes_.store(
+      allocated_bytes_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+}
+
 }  // namespace cpu_cache_internal
 
 // Static forward declares CpuCache to avoid a cycle in headers.  Make
@@ -0,0 +1,81 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <new>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/testing/testutil.h"
+#include "tcmalloc/thread_cache.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Like cpu_cache_activate_test, this starts in per-thread mode and must run in
+// a process of its own.
+TEST(CpuCacheLateActivationTest, BackgroundThreadActivates) {
+  if (!subtle::percpu::IsFast()) {
+    GTEST_SKIP() << "rseq is unavailable";
+  }
+  ASSERT_FALSE(tc_globals.CpuCacheActive());
+
+  // A thread that fills its thread cache in per-thread mode, then allocates
+  // once more after the per-cpu caches are activated.
+  absl::Notification cached, activated;
+  bool had_cache = false;
+  bool kept_cache = true;
+  std::thread worker([&]() {
+    for (int i = 0; i < 100; ++i) {
+      ::operator delete(::operator new(64));
+    }
+    had_cache = ThreadCache::GetCacheIfPresent() != nullptr;
+    cached.Notify();
+
+    activated.WaitForNotification();
+    ::operator delete(::operator new(64));
+    kept_cache = ThreadCache::GetCacheIfPresent() != nullptr;
+  });
+  cached.WaitForNotification();
+
+  ScopedBackgroundProcessSleepInterval interval(absl::Milliseconds(1));
+  MallocExtension::SetBackgroundProcessActionsEnabled(true);
+  std::thread background([] { MallocExtension::ProcessBackgroundActions(); });
+
+  Parameters::set_per_cpu_caches(true);
+  const absl::Time deadline = absl::Now() + absl::Seconds(30);
+  while (!tc_globals.CpuCacheActive() && absl::Now() < deadline) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  EXPECT_TRUE(tc_globals.CpuCacheActive());
+
+  activated.Notify();
+  worker.join();
+  EXPECT_TRUE(had_cache);
+  EXPECT_FALSE(kept_cache);
+
+  MallocExtension::SetBackgroundProcessActionsEnabled(false);
+  background.join();
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
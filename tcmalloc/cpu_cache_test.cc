@@ -148,6 +148,63 @@ class TestStaticForwarder {
 
   bool per_cpu_caches_dynamic_slab_enabled() { return dynamic_slab_enabled_; }
 
+  bool per_cpu_caches_remote_steal() const { return remote_steal_; }
+
+  bool per_cpu_caches_local_spans() const { return local_spans_; }
+
+  // Stands in for a fresh span with a few batches from the transfer cache.
+  int RemoveLocalSpan(int size_class, LinkedList& objects) {
+    if (transfer_cache_.tc_length(size_class) > 0) return 0;
+    ++remove_local_span_calls_;
+    void* batch[kMaxObjectsToMove];
+    int total = 0;
+    for (int i = 0; i < kLocalSpanBatches; ++i) {
+      const int n =
+          transfer_cache_.RemoveRange(size_class, batch, kMaxObjectsToMove);
+      objects.PushBatch(n, batch);
+      total += n;
+    }
+    return total;
+  }
+
+  bool per_cpu_caches_batch_remote_frees() const {
+    return batch_remote_frees_;
+  }
+
+  unsigned GetL3FromCpuId(int cpu) const { return cpu / cpus_per_l3_; }
+
+  bool per_cpu_caches_partitioned_slab_resize() const {
+    return partitioned_slab_resize_;
+  }
+
+  bool per_cpu_caches_incremental_slab_resize() const {
+    return incremental_slab_resize_;
+  }
+
+  bool per_cpu_caches_l3_capacity_pools() const { return l3_capacity_pools_; }
+
+  bool per_cpu_caches_partial_reclaim() const { return partial_reclaim_; }
+
+  size_t GetNumaPartitionFromCpuId(int cpu) const {
+    return std::min<size_t>(cpu / cpus_per_partition_, kNumaPartitions - 1);
+  }
+
+  bool per_cpu_caches_allocation_rate_resize() const {
+    return allocation_rate_resize_;
+  }
+
+  double per_cpu_caches_target_hit_rate() const { return target_hit_rate_; }
+
+  bool per_cpu_caches_prefetch_cold_classes() const {
+    return prefetch_cold_classes_;
+  }
+
+  bool per_cpu_caches_batch_size_autotune() const {
+    return batch_size_autotune_;
+  }
+
+  bool per_cpu_caches_summary_stats() const { return summary_stats_; }
+
   double per_cpu_caches_dynamic_slab_grow_threshold() {
     if (dynamic_slab_grow_threshold_ >= 0) return dynamic_slab_grow_threshold_;
     return dynamic_slab_ == DynamicSlab::kGrow
@@ -233,6 +290,22 @@ class TestStaticForwarder {
   int64_t arena_reported_impending_bytes_ = 0;
   size_t shrink_to_usage_limit_calls_ = 0;
   bool dynamic_slab_enabled_ = false;
+  bool remote_steal_ = false;
+  bool local_spans_ = false;
+  static constexpr int kLocalSpanBatches = 2;
+  int remove_local_span_calls_ = 0;
+  bool batch_remote_frees_ = false;
+  int cpus_per_l3_ = std::numeric_limits<int>::max();
+  bool partitioned_slab_resize_ = false;
+  bool incremental_slab_resize_ = false;
+  bool l3_capacity_pools_ = false;
+  bool partial_reclaim_ = false;
+  int cpus_per_partition_ = std::numeric_limits<int>::max();
+  bool allocation_rate_resize_ = false;
+  double target_hit_rate_ = 0.99;
+  bool prefetch_cold_classes_ = true;
+  bool batch_size_autotune_ = false;
+  bool summary_stats_ = false;
   double dynamic_slab_grow_threshold_ = -1;
   double dynamic_slab_shrink_threshold_ = -1;
   bool configure_size_class_max_capacity_ = false;
@@ -384,7 +457,8 @@ TEST(CpuCacheTest, Metadata) {
   PerCPUMetadataState r = cache.MetadataMemoryUsage();
   size_t slabs_size = subtle::percpu::GetSlabsAllocSize(
       subtle::percpu::ToShiftType(shift_bounds.max_shift), num_cpus);
-  size_t resize_size = num_cpus * sizeof(bool);
+  size_t resize_size =
+      num_cpus * (sizeof(bool) + sizeof(subtle::percpu::AtomicSlabCpuStats));
   size_t begins_size = kNumClasses * sizeof(std::atomic<uint16_t>);
   EXPECT_EQ(r.virtual_size, slabs_size + resize_size + begins_size);
   EXPECT_EQ(r.resident_size, 0);
@@ -494,6 +568,14 @@ TEST(CpuCacheTest, Metadata) {
   }
   EXPECT_EQ(cache.TotalUsedBytes(), total_used_bytes);
 
+  std::vector<uint64_t> objects(kNumClasses, 1);
+  EXPECT_EQ(cache.TotalObjectsByClass(absl::MakeSpan(objects)),
+            total_used_bytes);
+  for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+    EXPECT_EQ(objects[size_class], cache.TotalObjectsOfClass(size_class))
+        << size_class;
+  }
+
   PerCPUMetadataState post_stats = cache.MetadataMemoryUsage();
   // Confirm stats are within expected bounds.
   EXPECT_GT(post_stats.resident_size, 0);
@@ -506,6 +588,98 @@ TEST(CpuCacheTest, Metadata) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, ColdClassesWithoutPrefetch) {
+  if (!subtle::percpu::IsFast() || !kHasExpandedClasses) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.forwarder().prefetch_cold_classes_ = false;
+  cache.Activate();
+
+  const size_t kSizeClass = kExpandedClassesStart + 1;
+  const size_t kHotSizeClass = 1;
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(
+        tcmalloc_internal::AllowedCpus()[0]);
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 8; ++i) {
+      ptrs.push_back(cache.Allocate(kSizeClass));
+      ptrs.push_back(cache.Allocate(kHotSizeClass));
+    }
+    for (size_t i = 0; i < ptrs.size(); i += 2) {
+      ASSERT_NE(ptrs[i], nullptr);
+      ASSERT_NE(ptrs[i + 1], nullptr);
+      cache.Deallocate(ptrs[i], kSizeClass);
+      cache.Deallocate(ptrs[i + 1], kHotSizeClass);
+    }
+
+    // Freed objects are handed back in LIFO order regardless of whether the
+    // fast path prefetched them.
+    void* cold = cache.Allocate(kSizeClass);
+    void* hot = cache.Allocate(kHotSizeClass);
+    if (!mask.Tampered()) {
+      EXPECT_EQ(cold, ptrs[ptrs.size() - 2]);
+      EXPECT_EQ(hot, ptrs[ptrs.size() - 1]);
+    }
+    cache.Deallocate(cold, kSizeClass);
+    cache.Deallocate(hot, kHotSizeClass);
+  }
+
+  // Tear down.
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, SummaryStats) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+  void* ptr = cache.Allocate(1);
+
+  auto print = [&](bool pbtxt) {
+    std::string out;
+    out.resize(128 << 10);
+    Printer p(out.data(), out.size());
+    if (pbtxt) {
+      PbtxtRegion r(&p, kTop);
+      cache.PrintInPbtxt(&r);
+    } else {
+      cache.Print(&p);
+    }
+    out.resize(p.SpaceRequired());
+    return out;
+  };
+
+  EXPECT_THAT(print(false), testing::HasSubstr("cpu   0:"));
+  EXPECT_THAT(print(true), testing::HasSubstr(" cpu_cache "));
+
+  cache.forwarder().summary_stats_ = true;
+  const std::string text = print(false);
+  EXPECT_THAT(text, testing::Not(testing::HasSubstr("cpu   0:")));
+  EXPECT_THAT(text, testing::HasSubstr("populated cpus"));
+  const std::string pbtxt = print(true);
+  EXPECT_THAT(pbtxt, testing::Not(testing::HasSubstr(" cpu_cache ")));
+  EXPECT_THAT(pbtxt, testing::HasSubstr(" cpu_cache_total "));
+
+  // Tear down.
+  cache.Deallocate(ptr, 1);
+  cache.Deactivate();
+}
+
+// Runs a single allocate and deallocate operation to warm up the cache. Once a
+// few objects are allocated in the cold cache, we can shuffle cpu caches to
+// steal that capacity from the cold cache to the hot cache.
+static void ColdCacheOperations(CpuCache& cache, int cpu_id,
+                                size_t size_class) {
+  // Temporarily fake being on the given CPU.
+  ScopedFakeCpuId fake_cpu_id(cpu_id);
+  void* ptr = cache.Allocate(size_class);
+  cache.Deallocate(ptr, size_class);
+}
+
 TEST(CpuCacheTest, CacheMissStats) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -572,6 +746,359 @@ TEST(CpuCacheTest, CacheMissStats) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, MissTimeSeries) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  constexpr int kCpuId = 0;
+  constexpr size_t kSizeClass = 1;
+  // Sums up the last two epochs, in case we crossed an epoch boundary.
+  auto cpu_misses = [&](int cpu) {
+    CpuCache::MissTimeSeriesEntry total;
+    for (size_t offset = 0; offset < 2; ++offset) {
+      const CpuCache::MissTimeSeriesEntry e =
+          cache.GetCpuMissTimeSeries(cpu, offset);
+      total.underflows += e.underflows;
+      total.overflows += e.overflows;
+    }
+    return total;
+  };
+  auto size_class_misses = [&](size_t size_class) {
+    CpuCache::MissTimeSeriesEntry total;
+    for (size_t offset = 0; offset < 2; ++offset) {
+      const CpuCache::MissTimeSeriesEntry e =
+          cache.GetSizeClassMissTimeSeries(size_class, offset);
+      total.underflows += e.underflows;
+      total.overflows += e.overflows;
+    }
+    return total;
+  };
+
+  cache.UpdateMissTimeSeries();
+  EXPECT_TRUE(cpu_misses(kCpuId).empty());
+  EXPECT_TRUE(size_class_misses(kSizeClass).empty());
+
+  for (int i = 0; i < 10; ++i) {
+    ColdCacheOperations(cache, kCpuId, kSizeClass);
+    cache.Reclaim(kCpuId);
+  }
+  const CpuCache::CpuCacheMissStats interval_misses =
+      cache.GetIntervalCacheMissStats(kCpuId, MissCount::kTimeSeries);
+  ASSERT_GT(interval_misses.underflows, 0);
+
+  // Nothing is visible before the time series is updated.
+  EXPECT_TRUE(cpu_misses(kCpuId).empty());
+  cache.UpdateMissTimeSeries();
+
+  CpuCache::MissTimeSeriesEntry misses = cpu_misses(kCpuId);
+  EXPECT_EQ(misses.underflows, interval_misses.underflows);
+  EXPECT_EQ(misses.overflows, interval_misses.overflows);
+  EXPECT_GT(size_class_misses(kSizeClass).underflows, 0);
+  EXPECT_TRUE(size_class_misses(kSizeClass + 1).empty());
+
+  // Updating again without new misses does not double count.
+  cache.UpdateMissTimeSeries();
+  misses = cpu_misses(kCpuId);
+  EXPECT_EQ(misses.underflows, interval_misses.underflows);
+  EXPECT_EQ(misses.overflows, interval_misses.overflows);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, ReclaimDisallowedCpuCaches) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+  const std::vector<int> allowed_cpus = tcmalloc_internal::AllowedCpus();
+  if (allowed_cpus.size() < 2) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+  const int num_cpus = NumCPUs();
+  const int kept_cpu = allowed_cpus[0];
+  const int dropped_cpu = allowed_cpus[1];
+
+  uint64_t total_capacity = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    total_capacity += cache.Capacity(cpu);
+  }
+
+  // Leave an object in the cache of the cpu that we will drop.
+  ColdCacheOperations(cache, dropped_cpu, /*size_class=*/1);
+  ASSERT_GT(cache.UsedBytes(dropped_cpu), 0);
+
+  uint64_t reclaimed;
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(kept_cpu);
+    reclaimed = cache.ReclaimDisallowedCpuCaches();
+    if (mask.Tampered()) {
+      return;
+    }
+  }
+
+  EXPECT_GT(reclaimed, 0);
+  EXPECT_EQ(cache.GetNumDisallowedCpuReclaims(), 1);
+  EXPECT_EQ(cache.UsedBytes(dropped_cpu), 0);
+  EXPECT_EQ(cache.Capacity(dropped_cpu), 0);
+  EXPECT_GT(cache.Capacity(kept_cpu), cache.CacheLimit());
+
+  // No capacity is lost.
+  uint64_t new_total_capacity = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    new_total_capacity += cache.Capacity(cpu);
+  }
+  EXPECT_EQ(new_total_capacity, total_capacity);
+
+  // Once all cpus are allowed again, nothing is reclaimed.
+  EXPECT_EQ(cache.ReclaimDisallowedCpuCaches(), 0);
+  EXPECT_EQ(cache.GetNumDisallowedCpuReclaims(), 1);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, ActivateOutsideAffinityMask) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+  const std::vector<int> allowed_cpus = tcmalloc_internal::AllowedCpus();
+  if (allowed_cpus.size() < 2) {
+    return;
+  }
+  const int outside_cpu = allowed_cpus[1];
+
+  CpuCache cache;
+  {
+    tcmalloc_internal::ScopedAffinityMask mask(allowed_cpus[0]);
+    cache.Activate();
+    if (mask.Tampered()) {
+      cache.Deactivate();
+      return;
+    }
+  }
+
+  // A CPU outside the mask is not set up, but is still owed its capacity.
+  EXPECT_FALSE(cache.HasPopulated(outside_cpu));
+  EXPECT_EQ(cache.Capacity(outside_cpu), cache.CacheLimit());
+  EXPECT_EQ(cache.Unallocated(outside_cpu), cache.CacheLimit());
+
+  // Using it sets it up, without changing its capacity.
+  ColdCacheOperations(cache, outside_cpu, /*size_class=*/1);
+  EXPECT_TRUE(cache.HasPopulated(outside_cpu));
+  EXPECT_EQ(cache.Capacity(outside_cpu), cache.CacheLimit());
+  EXPECT_EQ(cache.Allocated(outside_cpu) + cache.Unallocated(outside_cpu),
+            cache.Capacity(outside_cpu));
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, AllocateDeallocateBatch) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  constexpr int kCpu = 0;
+  constexpr size_t kSizeClass = 1;
+  constexpr size_t kBatch = 3 * kMaxObjectsToMove + 5;
+  const size_t object_size = cache.forwarder().class_to_size(kSizeClass);
+  ScopedFakeCpuId fake_cpu_id(kCpu);
+
+  for (int round = 0; round < 3; ++round) {
+    void* batch[kBatch];
+    ASSERT_EQ(cache.AllocateBatch(kSizeClass, batch, kBatch), kBatch);
+    std::sort(batch, batch + kBatch);
+    EXPECT_EQ(std::adjacent_find(batch, batch + kBatch), batch + kBatch);
+    EXPECT_EQ(std::count(batch, batch + kBatch, nullptr), 0);
+
+    cache.DeallocateBatch(kSizeClass, batch, kBatch);
+    // Whatever did not fit into the slab was returned to the backing cache,
+    // but the slab itself should now hold some of the freed objects.
+    EXPECT_GE(cache.UsedBytes(kCpu), object_size);
+  }
+
+  // Tear down.
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, CapacityProfileWarmUp) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  constexpr size_t kSizeClass = 1;
+  constexpr size_t kCapacity = 37;
+  std::vector<size_t> profile(kNumClasses, 0);
+  profile[kSizeClass] = kCapacity;
+  cache.SetCapacityProfile(profile);
+  cache.Activate();
+
+  // Populating cpu 0 warms up the cache to the profile.
+  {
+    ScopedFakeCpuId fake_cpu_id(0);
+    cache.Deallocate(cache.Allocate(kSizeClass), kSizeClass);
+  }
+  EXPECT_GE(cache.GetCapacityOfSizeClass(0, kSizeClass), kCapacity);
+  EXPECT_EQ(cache.GetCapacityOfSizeClass(0, kSizeClass + 1), 0);
+
+  // Raising the profile grows already populated caches.
+  profile[kSizeClass + 1] = kCapacity;
+  cache.SetCapacityProfile(profile);
+  cache.WarmUpPopulatedCaches();
+  EXPECT_GE(cache.GetCapacityOfSizeClass(0, kSizeClass + 1), kCapacity);
+
+  // Tear down.
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, RemoteStealOnRefill) {
+  if (!subtle::percpu::IsFast() || NumCPUs() < 3) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.remote_steal_ = true;
+  // cpus 0 and 1 share an L3, cpu 2 does not.
+  forwarder.cpus_per_l3_ = 2;
+  cache.Activate();
+
+  constexpr size_t kSizeClass = 1;
+  constexpr int kObjects = 4 * kMaxObjectsToMove;
+  const size_t object_size = forwarder.class_to_size(kSizeClass);
+  const auto fill_cache = [&](int cpu) {
+    ScopedFakeCpuId fake_cpu_id(cpu);
+    std::vector<void*> objects;
+    for (int i = 0; i < kObjects; ++i) {
+      objects.push_back(cache.Allocate(kSizeClass));
+    }
+    for (void* ptr : objects) {
+      cache.Deallocate(ptr, kSizeClass);
+    }
+  };
+  fill_cache(1);
+  fill_cache(2);
+  const uint64_t sibling_used = cache.UsedBytes(1);
+  const uint64_t remote_used = cache.UsedBytes(2);
+  ASSERT_GE(sibling_used, kMaxObjectsToMove * object_size);
+
+  {
+    ScopedFakeCpuId fake_cpu_id(0);
+    void* ptr = cache.Allocate(kSizeClass);
+    ASSERT_NE(ptr, nullptr);
+    cache.Deallocate(ptr, kSizeClass);
+  }
+  EXPECT_GT(cache.GetNumRemoteSteals(0), 0);
+  EXPECT_EQ(cache.GetNumRemoteSteals(), cache.GetNumRemoteSteals(0));
+  EXPECT_LT(cache.UsedBytes(1), sibling_used);
+  // Caches on a different L3 are left alone.
+  EXPECT_EQ(cache.UsedBytes(2), remote_used);
+
+  // Tear down.
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, LocalSpans) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.local_spans_ = true;
+  cache.Activate();
+
+  constexpr size_t kSizeClass = 1;
+  const size_t object_size = forwarder.class_to_size(kSizeClass);
+  ScopedFakeCpuId fake_cpu_id(0);
+
+  // The first miss finds nothing in the transfer cache, so takes a span and
+  // keeps what it doesn't hand out.
+  void* ptr = cache.Allocate(kSizeClass);
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_EQ(forwarder.remove_local_span_calls_, 1);
+  EXPECT_EQ(cache.GetNumLocalSpans(0), 1);
+  EXPECT_EQ(cache.GetNumLocalSpans(), 1);
+  const uint64_t used = cache.UsedBytes(0);
+  EXPECT_GE(used, (TestStaticForwarder::kLocalSpanBatches - 1) *
+                      kMaxObjectsToMove * object_size);
+
+  // Reclaiming hands back the slab and whatever is left of the span.
+  cache.Deallocate(ptr, kSizeClass);
+  EXPECT_GE(cache.Reclaim(0), used);
+  EXPECT_EQ(cache.UsedBytes(0), 0);
+
+  // Those objects are now in the transfer cache, and are reused before
+  // another span is taken.
+  ptr = cache.Allocate(kSizeClass);
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_EQ(forwarder.remove_local_span_calls_, 1);
+  cache.Deallocate(ptr, kSizeClass);
+
+  // Tear down.
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, BatchRemoteFrees) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  const auto& topology = forwarder.numa_topology();
+  if (!topology.numa_aware()) {
+    return;
+  }
+  forwarder.batch_remote_frees_ = true;
+  cache.Activate();
+
+  constexpr int kCpuId = 0;
+  const size_t remote_partition =
+      (topology.GetCpuPartition(kCpuId) + 1) % topology.active_partitions();
+  const size_t size_class = remote_partition * kNumBaseClasses + 1;
+  ASSERT_FALSE(topology.IsLocalToCpuPartition(size_class, kCpuId));
+  const size_t object_size = forwarder.class_to_size(size_class);
+  const size_t batch_length = cache.GetBatchLength(size_class);
+
+  constexpr int kObjects = 4 * kMaxObjectsToMove;
+  std::vector<void*> objects;
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpuId);
+    for (int i = 0; i < kObjects; ++i) {
+      objects.push_back(cache.Allocate(size_class));
+    }
+  }
+  // Drop whatever the refills left behind, so that only frees are counted.
+  cache.Reclaim(kCpuId);
+  const CpuCache::CpuCacheMissStats before =
+      cache.GetTotalCacheMissStats(kCpuId);
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpuId);
+    for (void* ptr : objects) {
+      cache.Deallocate(ptr, size_class);
+    }
+  }
+
+  // At most one batch stays buffered, the rest went back to the remote
+  // partition without counting as overflows.
+  const uint64_t buffered = cache.UsedBytes(kCpuId) / object_size;
+  EXPECT_LT(buffered, batch_length);
+  EXPECT_EQ(cache.GetNumRemoteFrees(kCpuId) + buffered, kObjects);
+  EXPECT_EQ(cache.GetNumRemoteFrees(), cache.GetNumRemoteFrees(kCpuId));
+  EXPECT_EQ(cache.GetTotalCacheMissStats(kCpuId).overflows, before.overflows);
+
+  cache.Deactivate();
+}
+
 static void ResizeSizeClasses(CpuCache& cache, const std::atomic<bool>& stop) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -971,6 +1498,58 @@ TEST(CpuCacheTest, DynamicSlab) {
   cache.Deactivate();
 }
 
+// Test that with incremental slab resizing, the new slabs are set up a few
+// CPUs per call, and only taken into use once all CPUs are, while the caches
+// stay in use.
+TEST(CpuCacheTest, IncrementalSlabResize) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.dynamic_slab_enabled_ = true;
+  forwarder.incremental_slab_resize_ = true;
+  forwarder.dynamic_slab_ = DynamicSlab::kGrow;
+
+  cache.Activate();
+  const cpu_cache_internal::SlabShiftBounds shift_bounds =
+      cache.GetPerCpuSlabShiftBounds();
+  if (shift_bounds.max_shift == shift_bounds.initial_shift) {
+    cache.Deactivate();
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<bool> stop(false);
+  for (size_t t = 0; t < NumCPUs(); ++t) {
+    threads.push_back(
+        std::thread(StressThread, std::ref(cache), t, std::ref(stop)));
+  }
+
+  const int steps =
+      (NumCPUs() + cpu_cache_internal::kSlabResizeCpusPerStep - 1) /
+      cpu_cache_internal::kSlabResizeCpusPerStep;
+  const int shift = shift_bounds.initial_shift;
+  CpuCachePeer::IncrementCacheMisses(cache);
+  for (int i = 1; i < steps; ++i) {
+    cache.ResizeSlabIfNeeded();
+    EXPECT_TRUE(cache.SlabResizeInProgress());
+    EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift);
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  cache.ResizeSlabIfNeeded();
+  EXPECT_FALSE(cache.SlabResizeInProgress());
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift + 1);
+  EXPECT_EQ(forwarder.arena_reported_impending_bytes_, 0);
+
+  stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  cache.Deactivate();
+}
+
 // In this test, we check if we can resize size classes based on the number of
 // misses they encounter. First, we exhaust cache capacity by filling up
 // larger size class as much as possible. Then, we try to allocate objects for
@@ -1074,15 +1653,146 @@ TEST(CpuCacheTest, ResizeSizeClassesTest) {
   cache.Deactivate();
 }
 
-// Runs a single allocate and deallocate operation to warm up the cache. Once a
-// few objects are allocated in the cold cache, we can shuffle cpu caches to
-// steal that capacity from the cold cache to the hot cache.
-static void ColdCacheOperations(CpuCache& cache, int cpu_id,
-                                size_t size_class) {
-  // Temporarily fake being on the given CPU.
-  ScopedFakeCpuId fake_cpu_id(cpu_id);
-  void* ptr = cache.Allocate(size_class);
-  cache.Deallocate(ptr, size_class);
+// Similar to ResizeSizeClassesTest, but budgets capacity by allocation rate.
+// A size class that misses but has no recorded allocation volume should not
+// get capacity, while one that allocates enough bytes should.
+TEST(CpuCacheTest, ResizeSizeClassesByAllocationRate) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.forwarder().allocation_rate_resize_ = true;
+  const size_t max_cpu_cache_size = 128 << 10;
+  cache.SetCacheLimit(max_cpu_cache_size);
+  cache.Activate();
+
+  constexpr int kCpuId = 0;
+  constexpr int kCpuId1 = 1;
+
+  constexpr int kSmallClass = 1;
+  constexpr int kLargeClass = 2;
+  const int kMaxCapacity = cache.forwarder().max_capacity(kLargeClass);
+  const size_t small_class_size = cache.forwarder().class_to_size(kSmallClass);
+  const size_t batch_size_small =
+      cache.forwarder().num_objects_to_move(kSmallClass);
+  const size_t batch_size_large =
+      cache.forwarder().num_objects_to_move(kLargeClass);
+
+  // Use up all of the cpu's capacity for the large size class.
+  size_t ops = 0;
+  while (true) {
+    ops += batch_size_large;
+    if (ops > kMaxCapacity || cache.Allocated(kCpuId) == max_cpu_cache_size)
+      break;
+
+    AllocateThenDeallocate(cache, kCpuId, kLargeClass, ops);
+  }
+  ASSERT_EQ(cache.Allocated(kCpuId), max_cpu_cache_size);
+
+  const int num_resizes = NumCPUs() / CpuCache::kNumCpuCachesToResize + 1;
+  auto resize = [&]() {
+    ScopedFakeCpuId fake_cpu_id_1(kCpuId1);
+    for (int i = 0; i < num_resizes; ++i) {
+      cache.ResizeSizeClasses();
+    }
+  };
+  // Start a fresh interval.
+  resize();
+
+  // The small class misses, but nothing accounts for its allocation volume.
+  AllocateThenDeallocate(cache, kCpuId, kSmallClass, batch_size_small);
+  EXPECT_GT(cache.GetIntervalSizeClassMisses(kCpuId, kSmallClass,
+                                             PerClassMissType::kCapacityTotal,
+                                             PerClassMissType::kCapacityResize),
+            0);
+  EXPECT_EQ(cache.GetIntervalSizeClassAllocatedBytes(kCpuId, kSmallClass), 0);
+  resize();
+  AllocateThenDeallocate(cache, kCpuId, kSmallClass, batch_size_small);
+  EXPECT_EQ(cache.TotalObjectsOfClass(kSmallClass), 0);
+
+  // Now pretend that we sampled plenty of small class allocations, so that its
+  // hit rate falls short of the target.
+  const size_t allocated_bytes = 1000 * batch_size_small * small_class_size;
+  cache.RecordAllocatedBytes(kCpuId, kSmallClass, allocated_bytes);
+  // Out of range cpus are ignored.
+  cache.RecordAllocatedBytes(-1, kSmallClass, allocated_bytes);
+  EXPECT_EQ(cache.GetIntervalSizeClassAllocatedBytes(kCpuId, kSmallClass),
+            allocated_bytes);
+  cache.forwarder().target_hit_rate_ = 1.0;
+  resize();
+  EXPECT_EQ(cache.GetIntervalSizeClassAllocatedBytes(kCpuId, kSmallClass), 0);
+
+  AllocateThenDeallocate(cache, kCpuId, kSmallClass, batch_size_small);
+  EXPECT_EQ(cache.TotalObjectsOfClass(kSmallClass), batch_size_small);
+  EXPECT_EQ(cache.Allocated(kCpuId), max_cpu_cache_size);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, TuneBatchLengths) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+  TestStaticForwarder& forwarder = cache.forwarder();
+  constexpr int kSizeClass = 1;
+  const size_t num_to_move = forwarder.num_objects_to_move(kSizeClass);
+  const size_t step = std::max<size_t>(num_to_move / 4, 1);
+  auto& transfer_cache = forwarder.transfer_cache();
+
+  // Tuning has no effect unless enabled.
+  EXPECT_EQ(cache.GetBatchLength(kSizeClass), num_to_move);
+  forwarder.batch_size_autotune_ = true;
+  cache.TuneBatchLengths();
+  EXPECT_EQ(cache.GetBatchLength(kSizeClass), num_to_move);
+
+  // Busy transfers that the transfer cache absorbs grow the batch length, up
+  // to twice the default.
+  std::vector<void*> batch(num_to_move);
+  for (int round = 0; round < 8; ++round) {
+    for (int i = 0; i < 64; ++i) {
+      const int got =
+          transfer_cache.RemoveRange(kSizeClass, batch.data(), num_to_move);
+      ASSERT_GT(got, 0);
+      transfer_cache.InsertRange(kSizeClass, {batch.data(),
+                                              static_cast<size_t>(got)});
+    }
+    cache.TuneBatchLengths();
+    EXPECT_EQ(cache.GetBatchLength(kSizeClass),
+              std::min({num_to_move + (round + 1) * step, 2 * num_to_move,
+                        kMaxObjectsToMove}));
+  }
+  const size_t grown = cache.GetBatchLength(kSizeClass);
+  EXPECT_GT(grown, num_to_move);
+
+  // Without enough transfers in an interval, the batch length is kept.
+  cache.TuneBatchLengths();
+  EXPECT_EQ(cache.GetBatchLength(kSizeClass), grown);
+
+  // Mostly missing shrinks it again.
+  std::vector<void*> objects;
+  for (int i = 0; i < 64; ++i) {
+    const int got =
+        transfer_cache.RemoveRange(kSizeClass, batch.data(), num_to_move);
+    ASSERT_GT(got, 0);
+    objects.insert(objects.end(), batch.begin(), batch.begin() + got);
+  }
+  cache.TuneBatchLengths();
+  EXPECT_EQ(cache.GetBatchLength(kSizeClass), grown - step);
+
+  for (size_t i = 0; i < objects.size(); i += num_to_move) {
+    transfer_cache.InsertRange(
+        kSizeClass,
+        {&objects[i], std::min(num_to_move, objects.size() - i)});
+  }
+
+  // Disabling tuning restores the default.
+  forwarder.batch_size_autotune_ = false;
+  EXPECT_EQ(cache.GetBatchLength(kSizeClass), num_to_move);
+  cache.Deactivate();
 }
 
 // Runs multiple allocate and deallocate operation on the cpu cache to collect
@@ -1179,6 +1889,51 @@ TEST_P(DynamicWideSlabTest, DynamicSlabThreshold) {
   EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift + 1);
 }
 
+// Test that with partitioned slab resizing, a busy NUMA partition grows the
+// slab while populated but idle CPUs of the other partition are left
+// unpopulated, and get populated again on their next use.
+TEST_P(DynamicWideSlabTest, PartitionedSlabGrow) {
+  if (!subtle::percpu::IsFast() || kNumaPartitions < 2 || NumCPUs() < 3) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.dynamic_slab_enabled_ = true;
+  forwarder.dynamic_slab_grow_threshold_ = 0.9;
+  forwarder.partitioned_slab_resize_ = true;
+  forwarder.cpus_per_partition_ = 2;
+  SizeMap size_map;
+  size_map.Init(kSizeClasses.classes);
+  forwarder.size_map_ = size_map;
+
+  cache.Activate();
+
+  constexpr int kBusyCpu = 0;
+  constexpr int kIdleCpu = 2;
+
+  // Populate the idle CPU, then forget about the misses this caused.
+  ColdCacheOperations(cache, kIdleCpu, /*size_class=*/1);
+  ASSERT_TRUE(cache.HasPopulated(kIdleCpu));
+  (void)cache.GetAndUpdateIntervalCacheMissStats(kIdleCpu,
+                                                 MissCount::kSlabResize);
+
+  HotCacheOperations(cache, kBusyCpu);
+
+  const int shift = cache.GetPerCpuSlabShiftBounds().initial_shift;
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift);
+  cache.ResizeSlabIfNeeded();
+  EXPECT_EQ(CpuCachePeer::GetSlabShift(cache), shift + 1);
+
+  EXPECT_TRUE(cache.HasPopulated(kBusyCpu));
+  EXPECT_FALSE(cache.HasPopulated(kIdleCpu));
+
+  ColdCacheOperations(cache, kIdleCpu, /*size_class=*/1);
+  EXPECT_TRUE(cache.HasPopulated(kIdleCpu));
+
+  cache.Deactivate();
+}
+
 // Test that when dynamic slab parameters change, things still work.
 TEST_P(DynamicWideSlabTest, DynamicSlabParamsChange) {
   if (!subtle::percpu::IsFast()) {
@@ -1437,6 +2192,152 @@ TEST(CpuCacheTest, ReclaimCpuCache) {
   cache.Deactivate();
 }
 
+TEST(CpuCacheTest, ReclaimOwnedCpuCaches) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  cache.Activate();
+
+  const int num_cpus = NumCPUs();
+  const size_t kSizeClass = 2;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    ColdCacheOperations(cache, cpu, kSizeClass);
+  }
+  // Take the first snapshot of the caches.
+  cache.TryReclaimingCaches();
+
+  // As a NUMA partition's background worker does, only look at even cpus.
+  auto even = [](int cpu) { return cpu % 2 == 0; };
+  cache.TryReclaimingCaches(even);
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    SCOPED_TRACE(absl::StrFormat("Failed CPU: %d", cpu));
+    if (even(cpu)) {
+      EXPECT_EQ(cache.UsedBytes(cpu), 0);
+      EXPECT_EQ(cache.GetNumReclaims(cpu), 1);
+    } else {
+      EXPECT_GT(cache.UsedBytes(cpu), 0);
+      EXPECT_EQ(cache.GetNumReclaims(cpu), 0);
+    }
+  }
+
+  // The cpus left out are still idle, so they are reclaimed by the next pass
+  // that looks at them.
+  cache.TryReclaimingCaches([&](int cpu) { return !even(cpu); });
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    SCOPED_TRACE(absl::StrFormat("Failed CPU: %d", cpu));
+    EXPECT_EQ(cache.UsedBytes(cpu), 0);
+    EXPECT_EQ(cache.GetNumReclaims(cpu), 1);
+  }
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, PartialReclaim) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.partial_reclaim_ = true;
+  cache.Activate();
+
+  constexpr int kCpu = 0;
+  constexpr size_t kSizeClass = 1;
+  const size_t batch_length = forwarder.num_objects_to_move(kSizeClass);
+  {
+    ScopedFakeCpuId fake_cpu_id(kCpu);
+    std::vector<void*> objects;
+    for (int i = 0; i < 4 * batch_length; ++i) {
+      objects.push_back(cache.Allocate(kSizeClass));
+    }
+    for (void* ptr : objects) {
+      cache.Deallocate(ptr, kSizeClass);
+    }
+  }
+  const size_t size = forwarder.class_to_size(kSizeClass);
+  const size_t length = cache.UsedBytes(kCpu) / size;
+  ASSERT_GT(length, 2 * batch_length);
+
+  // The first pass records the low-water mark, the second one reclaims the
+  // cache down to a warm core of at most a batch.
+  cache.TryReclaimingCaches();
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 0);
+  cache.TryReclaimingCaches();
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 1);
+  size_t kept = std::min(length / 2, batch_length);
+  EXPECT_EQ(cache.UsedBytes(kCpu), kept * size);
+  EXPECT_EQ(cache.GetCapacityOfSizeClass(kCpu, kSizeClass), kept);
+
+  // While the cache stays idle, each reclaim halves its warm core.
+  cache.TryReclaimingCaches();
+  EXPECT_EQ(cache.GetNumReclaims(kCpu), 2);
+  kept /= 2;
+  EXPECT_EQ(cache.UsedBytes(kCpu), kept * size);
+
+  cache.Deactivate();
+}
+
+TEST(CpuCacheTest, L3CapacityPools) {
+  if (!subtle::percpu::IsFast() || NumCPUs() < 3) {
+    return;
+  }
+
+  CpuCache cache;
+  TestStaticForwarder& forwarder = cache.forwarder();
+  forwarder.l3_capacity_pools_ = true;
+  // cpus 0 and 1 share an L3, cpu 2 does not.
+  forwarder.cpus_per_l3_ = 2;
+  cache.Activate();
+
+  constexpr size_t kSizeClass = 1;
+  const int num_cpus = NumCPUs();
+  for (int cpu = 0; cpu < 3; ++cpu) {
+    ColdCacheOperations(cache, cpu, kSizeClass);
+  }
+  uint64_t total_capacity = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    total_capacity += cache.Capacity(cpu);
+  }
+
+  // The first pass records used bytes, the second reclaims the idle caches.
+  cache.TryReclaimingCaches();
+  cache.TryReclaimingCaches();
+  for (int cpu = 0; cpu < 3; ++cpu) {
+    SCOPED_TRACE(absl::StrFormat("cpu %d", cpu));
+    ASSERT_EQ(cache.GetNumReclaims(cpu), 1);
+    EXPECT_EQ(cache.Capacity(cpu), 0);
+  }
+  const CpuCache::L3CapacityPoolStats pool = cache.GetL3CapacityPoolStats(0);
+  EXPECT_EQ(pool.available, 2 * cache.CacheLimit());
+  EXPECT_EQ(pool.donated, pool.available);
+  EXPECT_EQ(pool.taken, 0);
+  EXPECT_EQ(cache.GetL3CapacityPoolStats(1).available, cache.CacheLimit());
+
+  // No capacity is lost.
+  uint64_t new_total_capacity = 0;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    new_total_capacity += cache.Capacity(cpu);
+  }
+  for (int l3 = 0; l3 < num_cpus; ++l3) {
+    new_total_capacity += cache.GetL3CapacityPoolStats(l3).available;
+  }
+  EXPECT_EQ(new_total_capacity, total_capacity);
+
+  // A cache growing again takes capacity from the pool of its L3 cache only.
+  ColdCacheOperations(cache, /*cpu_id=*/1, kSizeClass);
+  EXPECT_GT(cache.Capacity(1), 0);
+  EXPECT_GT(cache.GetL3CapacityPoolStats(0).taken, 0);
+  EXPECT_EQ(cache.GetL3CapacityPoolStats(0).available +
+                cache.GetL3CapacityPoolStats(0).taken,
+            pool.donated);
+  EXPECT_EQ(cache.GetL3CapacityPoolStats(1).taken, 0);
+
+  cache.Deactivate();
+}
+
 TEST(CpuCacheTest, SizeClassCapacityTest) {
   if (!subtle::percpu::IsFast()) {
     return;
@@ -0,0 +1,49 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+
+#include "gtest/gtest.h"
+#include "absl/base/macros.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/sizemap.h"
+#include "tcmalloc/static_vars.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// The BUILD rule sets TCMALLOC_SIZE_CLASSES to these classes.
+TEST(CustomSizeClassesTest, Loaded) {
+  Static::InitIfNecessary();
+
+  ASSERT_EQ(Static::size_class_configuration(),
+            SizeClassConfiguration::kCustom);
+  const size_t kExpectedClasses[] = {0, 8, 64, 1024, 8192, kMaxSize};
+  for (int c = 0; c < ABSL_ARRAYSIZE(kExpectedClasses); ++c) {
+    EXPECT_EQ(Static::sizemap().class_to_size(c), kExpectedClasses[c]) << c;
+  }
+  EXPECT_EQ(Static::sizemap().class_to_size(ABSL_ARRAYSIZE(kExpectedClasses)),
+            0);
+
+  EXPECT_EQ(MallocExtension::GetEstimatedAllocatedSize(9), 64);
+  EXPECT_EQ(MallocExtension::GetEstimatedAllocatedSize(2000), 8192);
+  EXPECT_EQ(SizeMap::CurrentClasses().assumptions.span_size,
+            kSizeClasses.assumptions.span_size);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -22,6 +22,7 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <new>
 #include <type_traits>
 #include <utility>
 
@@ -43,6 +44,7 @@
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal_malloc_extension.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/static_vars.h"
@@ -423,6 +425,12 @@ class DeallocationProfiler {
       double variance_life_times_ns[kNumCases] = {0.0};
       double min_life_times_ns[kNumCases] = {0.0};
       double max_life_times_ns[kNumCases] = {0.0};
+      // Pair-wide lifetime histogram and number of frees made on another NUMA
+      // node or L3 cache, counted like `counts`.
+      double lifetime_histogram[Profile::Sample::kLifetimeHistogramBuckets] = {
+          0.0};
+      double cross_numa_frees = 0.0;
+      double cross_l3_frees = 0.0;
 
       Value() {
         std::fill_n(min_life_times_ns, kNumCases,
@@ -493,7 +501,10 @@ class DeallocationProfiler {
                         (stack_trace.requested_size + 1);
   }
 
-  void ReportFree(tcmalloc_internal::AllocHandle handle) {
+  // `deallocation` holds where and when the free was made; the sizes are
+  // taken from the allocation.
+  void ReportFree(tcmalloc_internal::AllocHandle handle,
+                  const DeallocationSampleRecord& deallocation) {
     auto it = allocs_.find(handle);
 
     // Handle the case that we observed the deallocation but not the allocation
@@ -504,39 +515,63 @@ class DeallocationProfiler {
     DeallocationSampleRecord sample = it->second;
     allocs_.erase(it);
 
-    DeallocationSampleRecord deallocation;
-    deallocation.allocated_size = sample.allocated_size;
-    deallocation.requested_alignment = sample.requested_alignment;
-    deallocation.requested_size = sample.requested_size;
-    deallocation.creation_time = absl::Now();
-    deallocation.cpu_id = tcmalloc_internal::subtle::percpu::GetRealCpu();
-    deallocation.vcpu_id = tcmalloc_internal::subtle::percpu::VirtualCpu::get();
-    deallocation.l3_id = GetL3Id(deallocation.cpu_id);
-    deallocation.numa_id = GetNumaId(deallocation.cpu_id);
-    deallocation.thread_id = absl::base_internal::GetTID();
-    deallocation.depth =
-        absl::GetStackTrace(deallocation.stack, kMaxStackDepth, 1);
-
-    reports_->AddTrace(sample, deallocation);
+    DeallocationSampleRecord dealloc = deallocation;
+    dealloc.allocated_size = sample.allocated_size;
+    dealloc.requested_alignment = sample.requested_alignment;
+    dealloc.requested_size = sample.requested_size;
+
+    reports_->AddTrace(sample, dealloc);
   }
 };
 
+struct ABSL_CACHELINE_ALIGNED DeallocationProfilerList::Shard {
+  // Sampled frees are rare, so a few make for long gaps between flushes.
+  static constexpr int kFrees = 8;
+
+  struct Free {
+    tcmalloc_internal::AllocHandle handle;
+    DeallocationSampleRecord deallocation;
+  };
+
+  SpinLock lock{absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  int size ABSL_GUARDED_BY(lock) = 0;
+  Free frees[kFrees] ABSL_GUARDED_BY(lock);
+};
+
 void DeallocationProfilerList::Add(DeallocationProfiler* profiler) {
   AllocationGuardSpinLockHolder h(&profilers_lock_);
+  if (shards_ == nullptr) {
+    const int num_shards = tcmalloc_internal::NumCPUs();
+    tcmalloc_internal::PageHeapSpinLockHolder l;
+    Shard* shards =
+        static_cast<Shard*>(tcmalloc_internal::tc_globals.arena().Alloc(
+            num_shards * sizeof(Shard), std::align_val_t(alignof(Shard))));
+    for (int i = 0; i < num_shards; ++i) {
+      new (&shards[i]) Shard();
+    }
+    num_shards_ = num_shards;
+    shards_ = shards;
+  }
   profiler->next_ = first_;
   first_ = profiler;
+  active_.store(true, std::memory_order_release);
 
   // Whenever a new profiler is created, we seed it with live allocations.
   tcmalloc_internal::tc_globals.sampled_allocation_recorder().Iterate(
       [profiler](
           const tcmalloc_internal::SampledAllocation& sampled_allocation) {
-        profiler->ReportMalloc(sampled_allocation.sampled_stack);
+        profiler->ReportMalloc(sampled_allocation.stack_trace());
       });
 }
 
 // This list is very short and we're nowhere near a hot path, just walk
 void DeallocationProfilerList::Remove(DeallocationProfiler* profiler) {
   AllocationGuardSpinLockHolder h(&profilers_lock_);
+  // Hand over the frees made up to now, before the profiler records the
+  // allocations it is left with as censored.
+  for (int i = 0; i < num_shards_; ++i) {
+    FlushLocked(shards_[i]);
+  }
   DeallocationProfiler** link = &first_;
   DeallocationProfiler* cur = first_;
   while (cur != profiler) {
@@ -545,6 +580,20 @@ void DeallocationProfilerList::Remove(DeallocationProfiler* profiler) {
     cur = cur->next_;
   }
   *link = profiler->next_;
+  if (first_ == nullptr) {
+    active_.store(false, std::memory_order_relaxed);
+  }
+}
+
+void DeallocationProfilerList::FlushLocked(Shard& shard) {
+  AllocationGuardSpinLockHolder h(&shard.lock);
+  for (int i = 0; i < shard.size; ++i) {
+    const Shard::Free& free = shard.frees[i];
+    for (DeallocationProfiler* cur = first_; cur != nullptr; cur = cur->next_) {
+      cur->ReportFree(free.handle, free.deallocation);
+    }
+  }
+  shard.size = 0;
 }
 
 void DeallocationProfilerList::ReportMalloc(
@@ -559,11 +608,40 @@ void DeallocationProfilerList::ReportMalloc(
 
 void DeallocationProfilerList::ReportFree(
     tcmalloc_internal::AllocHandle handle) {
+  // Pairs with the release in Add, so that shards_ is set.  A free racing
+  // with the first profiler's start may be missed, as may its allocation.
+  if (!active_.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  // Capture the free while holding no lock.
+  DeallocationSampleRecord deallocation;
+  deallocation.creation_time = absl::Now();
+  deallocation.cpu_id = tcmalloc_internal::subtle::percpu::GetRealCpu();
+  deallocation.vcpu_id = tcmalloc_internal::subtle::percpu::VirtualCpu::get();
+  deallocation.l3_id = GetL3Id(deallocation.cpu_id);
+  deallocation.numa_id = GetNumaId(deallocation.cpu_id);
+  deallocation.thread_id = absl::base_internal::GetTID();
+  deallocation.depth =
+      absl::GetStackTrace(deallocation.stack, kMaxStackDepth, 1);
+
+  // The thread may have moved since; the free is then buffered on the CPU it
+  // came from, which only matters for contention.
+  Shard& shard =
+      shards_[static_cast<unsigned>(deallocation.cpu_id) % num_shards_];
+  {
+    AllocationGuardSpinLockHolder h(&shard.lock);
+    if (shard.size < Shard::kFrees) {
+      shard.frees[shard.size++] = {handle, deallocation};
+      return;
+    }
+  }
+
+  // The buffer is full: empty it, and report this free directly.
   AllocationGuardSpinLockHolder h(&profilers_lock_);
-  DeallocationProfiler* cur = first_;
-  while (cur != nullptr) {
-    cur->ReportFree(handle);
-    cur = cur->next_;
+  FlushLocked(shard);
+  for (DeallocationProfiler* cur = first_; cur != nullptr; cur = cur->next_) {
+    cur->ReportFree(handle, deallocation);
   }
 }
 
@@ -627,6 +705,10 @@ void DeallocationProfiler::DeallocationStackTraceTable::AddTrace(
   v.max_life_times_ns[index] =
       std::max(v.max_life_times_ns[index], life_time_ns);
   v.counts[index]++;
+
+  v.lifetime_histogram[internal::LifetimeNsToHistogramBucket(life_time_ns)]++;
+  v.cross_numa_frees += !status.numa_matched;
+  v.cross_l3_frees += !status.l3_matched;
 }
 
 void DeallocationProfiler::DeallocationStackTraceTable::Iterate(
@@ -640,6 +722,11 @@ void DeallocationProfiler::DeallocationStackTraceTable::Iterate(
     // Report total bytes that are a multiple of the object size.
     size_t allocated_size = k.alloc.allocated_size;
 
+    double frees = 0;
+    for (double count : v.counts) {
+      frees += count;
+    }
+
     for (const auto& matching_case : kAllCases) {
       const int index = ComputeIndex(matching_case.first, matching_case.second);
       if (v.counts[index] == 0) {
@@ -672,6 +759,10 @@ void DeallocationProfiler::DeallocationStackTraceTable::Iterate(
           .stddev_lifetime = bucketize(stddev_life_time_ns),
           .min_lifetime = bucketize(v.min_life_times_ns[index]),
           .max_lifetime = bucketize(v.max_life_times_ns[index])};
+      for (int i = 0; i < Profile::Sample::kLifetimeHistogramBuckets; ++i) {
+        sample.lifetime_histogram[i] =
+            std::lround(v.lifetime_histogram[i] * k.alloc.weight);
+      }
       // Only set the cpu and thread matched flags if the sample is not
       // censored.
       if (!sample.is_censored) {
@@ -685,6 +776,8 @@ void DeallocationProfiler::DeallocationStackTraceTable::Iterate(
             matching_case.first.numa_matched;
         sample.allocator_deallocator_thread_matched =
             matching_case.first.thread_matched;
+        sample.cross_numa_free_ratio = v.cross_numa_frees / frees;
+        sample.cross_l3_free_ratio = v.cross_l3_frees / frees;
       }
 
       // first for allocation
@@ -753,6 +846,18 @@ absl::Duration LifetimeNsToBucketedDuration(double lifetime_ns) {
                            1000000L);
 }
 
+// Lifetimes below 10ns fall in bucket 0 and each further power of 10 in the
+// next bucket, up to the last one, which holds all longer lifetimes.
+int LifetimeNsToHistogramBucket(double lifetime_ns) {
+  constexpr int kLastBucket = Profile::Sample::kLifetimeHistogramBuckets - 1;
+  int bucket = 0;
+  for (double cutoff_ns = 10; bucket < kLastBucket && lifetime_ns >= cutoff_ns;
+       cutoff_ns *= 10) {
+    ++bucket;
+  }
+  return bucket;
+}
+
 }  // namespace internal
 }  // namespace deallocationz
 }  // namespace tcmalloc
@@ -15,10 +15,12 @@
 #ifndef TCMALLOC_DEALLOCATION_PROFILER_H_
 #define TCMALLOC_DEALLOCATION_PROFILER_H_
 
+#include <atomic>
 #include <memory>
 
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
 #include "absl/time/time.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -30,6 +32,10 @@ namespace deallocationz {
 
 class DeallocationProfiler;
 
+// Frees are captured without profilers_lock_ and buffered per CPU, to be
+// handed to the profilers a buffer at a time, when it fills or a profiler
+// stops.  Mallocs are reported to the profilers at once, so a buffered free
+// always finds the allocation it ends.
 class DeallocationProfilerList {
  public:
   constexpr DeallocationProfilerList() = default;
@@ -40,9 +46,20 @@ class DeallocationProfilerList {
   void Remove(DeallocationProfiler* profiler);
 
  private:
+  struct Shard;
+
+  // Hands the frees buffered in shard to every profiler.
+  void FlushLocked(Shard& shard) ABSL_EXCLUSIVE_LOCKS_REQUIRED(profilers_lock_);
+
   DeallocationProfiler* first_ = nullptr;
   absl::base_internal::SpinLock profilers_lock_{
       absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+
+  // Whether any profiler is running.  Set after shards_ is.
+  std::atomic<bool> active_{false};
+  // Allocated by the first Add, and never freed.
+  Shard* shards_ = nullptr;
+  int num_shards_ = 0;
 };
 
 class DeallocationSample final
@@ -60,6 +77,8 @@ class DeallocationSample final
 
 namespace internal {
 absl::Duration LifetimeNsToBucketedDuration(double lifetime_ns);
+// Returns the Profile::Sample::lifetime_histogram bucket of `lifetime_ns`.
+int LifetimeNsToHistogramBucket(double lifetime_ns);
 }  // namespace internal
 }  // namespace deallocationz
 }  // namespace tcmalloc
@@ -0,0 +1,120 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/emergency_reserve.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/system-alloc.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+// Serializes Set and Release.  It is taken before pageheap_lock, never while
+// holding it.
+ABSL_CONST_INIT absl::base_internal::SpinLock reserve_lock(
+    absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
+ABSL_CONST_INIT SpanList reserved ABSL_GUARDED_BY(reserve_lock);
+ABSL_CONST_INIT std::atomic<size_t> reserved_bytes(0);
+ABSL_CONST_INIT StatsCounter release_count;
+
+// Returns a hugepage for the reserve, faulted in, or nullptr if the page heap
+// is out of memory.
+Span* NewReservedHugepage() ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+  MemoryTag tag = MemoryTag::kNormal;
+  if (tc_globals.numa_topology().numa_aware()) {
+    tag = NumaNormalTag(tc_globals.numa_topology().GetCurrentPartition());
+  }
+  Span* span = tc_globals.page_allocator().New(
+      kPagesPerHugePage, {1, AccessDensityPrediction::kDense}, tag);
+  if (span == nullptr) {
+    return nullptr;
+  }
+  if (!SystemPopulate(span->start_address(), kHugePageSize)) {
+    memset(span->start_address(), 0, kHugePageSize);
+  }
+  span->set_zeroed(false);
+  return span;
+}
+
+void DeleteReservedHugepage(Span* span) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+  PageHeapSpinLockHolder l;
+  tc_globals.page_allocator().Delete(span, /*objects_per_span=*/1,
+                                     GetMemoryTag(span->start_address()));
+}
+
+}  // namespace
+
+size_t EmergencyReserve::Set(size_t bytes) {
+  tc_globals.InitIfNecessary();
+
+  const size_t target = (bytes + kHugePageSize - 1) / kHugePageSize;
+  AllocationGuardSpinLockHolder h(&reserve_lock);
+  size_t held = reserved_bytes.load(std::memory_order_relaxed) / kHugePageSize;
+  for (; held < target; ++held) {
+    Span* span = NewReservedHugepage();
+    if (span == nullptr) {
+      break;
+    }
+    reserved.prepend(span);
+    reserved_bytes.fetch_add(kHugePageSize, std::memory_order_relaxed);
+  }
+  for (; held > target; --held) {
+    Span* span = reserved.first();
+    reserved.remove(span);
+    reserved_bytes.fetch_sub(kHugePageSize, std::memory_order_relaxed);
+    DeleteReservedHugepage(span);
+  }
+  return held * kHugePageSize;
+}
+
+size_t EmergencyReserve::Release() {
+  AllocationGuardSpinLockHolder h(&reserve_lock);
+  const size_t released = reserved_bytes.load(std::memory_order_relaxed);
+  if (released == 0) {
+    return 0;
+  }
+  while (!reserved.empty()) {
+    Span* span = reserved.first();
+    reserved.remove(span);
+    DeleteReservedHugepage(span);
+  }
+  reserved_bytes.store(0, std::memory_order_relaxed);
+  release_count.Add(1);
+  return released;
+}
+
+size_t EmergencyReserve::bytes() {
+  return reserved_bytes.load(std::memory_order_relaxed);
+}
+
+size_t EmergencyReserve::releases() { return release_count.value(); }
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
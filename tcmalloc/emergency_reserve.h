@@ -0,0 +1,54 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_EMERGENCY_RESERVE_H_
+#define TCMALLOC_EMERGENCY_RESERVE_H_
+
+#include <stddef.h>
+
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// EmergencyReserve holds whole hugepages, allocated from the page heap and
+// faulted in ahead of time, for a program to give back when it runs short of
+// memory.  Released, they are free and backed in the page heap, so that
+// allocations can use them without growing the heap past a hard limit or
+// faulting in memory the system may not have.
+//
+// The page heap counts the reserve as in use; stats report it apart from the
+// bytes in use by the application.
+class EmergencyReserve {
+ public:
+  // Grows or shrinks the reserve to `bytes`, rounded up to whole hugepages.
+  // Returns the bytes now held, which fall short of `bytes` if the page heap
+  // runs out of memory while the reserve grows.
+  static size_t Set(size_t bytes) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns the whole reserve to the page heap, and the bytes it held.
+  static size_t Release() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // The bytes held in the reserve.
+  static size_t bytes();
+  // The number of times Release gave back a non-empty reserve.
+  static size_t releases();
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_EMERGENCY_RESERVE_H_
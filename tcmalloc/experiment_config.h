@@ -29,7 +29,20 @@ enum class Experiment : int {
   TEST_ONLY_TCMALLOC_LOWFRAG_SIZECLASSES,  // TODO(b/224799825): Complete experiment.
   TEST_ONLY_TCMALLOC_FEWER_SIZE_CLASSES,  // TODO(b/294132292): Complete experiment.
   TEST_ONLY_TCMALLOC_BIG_SPAN,  // TODO(b/304135905): Complete experiment.
-  TEST_ONLY_L3_AWARE,  // TODO(b/239977380): Complete experiment.
+  TEST_ONLY_L3_AWARE,
+  TEST_ONLY_TCMALLOC_LOCK_FREE_TRANSFER_CACHE,
+  TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE_AFFINITY,
+  TEST_ONLY_TCMALLOC_SPLIT_CENTRAL_FREELIST,
+  TEST_ONLY_TCMALLOC_SPAN_BITMAP_LIFO,
+  TEST_ONLY_TCMALLOC_DEFERRED_SPAN_RETURNS,
+  TEST_ONLY_TCMALLOC_HUGE_CACHE_DEMAND_FORECAST,
+  TEST_ONLY_TCMALLOC_FLAT_SIZECLASS_MAP,
+  TEST_ONLY_TCMALLOC_ADAPTIVE_SPAN_SIZES,
+  TEST_ONLY_TCMALLOC_HUGE_ALLOCATOR_BEST_FIT,
+  TEST_ONLY_TCMALLOC_LARGE_SPAN_CACHE,
+  TEST_ONLY_TCMALLOC_SHARDED_COLD_CLASSES,
+  TEST_ONLY_TCMALLOC_CPU_LOCAL_SPANS,
+  TEST_ONLY_TCMALLOC_HUGE_REGION_SUBRELEASE,
   kMaxExperimentID,
   // clang-format on
 };
@@ -49,6 +62,19 @@ inline constexpr ExperimentConfig experiments[] = {
     {Experiment::TEST_ONLY_TCMALLOC_FEWER_SIZE_CLASSES, "TEST_ONLY_TCMALLOC_FEWER_SIZE_CLASSES"},
     {Experiment::TEST_ONLY_TCMALLOC_BIG_SPAN, "TEST_ONLY_TCMALLOC_BIG_SPAN"},
     {Experiment::TEST_ONLY_L3_AWARE, "TEST_ONLY_L3_AWARE"},
+    {Experiment::TEST_ONLY_TCMALLOC_LOCK_FREE_TRANSFER_CACHE, "TEST_ONLY_TCMALLOC_LOCK_FREE_TRANSFER_CACHE"},
+    {Experiment::TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE_AFFINITY, "TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE_AFFINITY"},
+    {Experiment::TEST_ONLY_TCMALLOC_SPLIT_CENTRAL_FREELIST, "TEST_ONLY_TCMALLOC_SPLIT_CENTRAL_FREELIST"},
+    {Experiment::TEST_ONLY_TCMALLOC_SPAN_BITMAP_LIFO, "TEST_ONLY_TCMALLOC_SPAN_BITMAP_LIFO"},
+    {Experiment::TEST_ONLY_TCMALLOC_DEFERRED_SPAN_RETURNS, "TEST_ONLY_TCMALLOC_DEFERRED_SPAN_RETURNS"},
+    {Experiment::TEST_ONLY_TCMALLOC_HUGE_CACHE_DEMAND_FORECAST, "TEST_ONLY_TCMALLOC_HUGE_CACHE_DEMAND_FORECAST"},
+    {Experiment::TEST_ONLY_TCMALLOC_FLAT_SIZECLASS_MAP, "TEST_ONLY_TCMALLOC_FLAT_SIZECLASS_MAP"},
+    {Experiment::TEST_ONLY_TCMALLOC_ADAPTIVE_SPAN_SIZES, "TEST_ONLY_TCMALLOC_ADAPTIVE_SPAN_SIZES"},
+    {Experiment::TEST_ONLY_TCMALLOC_HUGE_ALLOCATOR_BEST_FIT, "TEST_ONLY_TCMALLOC_HUGE_ALLOCATOR_BEST_FIT"},
+    {Experiment::TEST_ONLY_TCMALLOC_LARGE_SPAN_CACHE, "TEST_ONLY_TCMALLOC_LARGE_SPAN_CACHE"},
+    {Experiment::TEST_ONLY_TCMALLOC_SHARDED_COLD_CLASSES, "TEST_ONLY_TCMALLOC_SHARDED_COLD_CLASSES"},
+    {Experiment::TEST_ONLY_TCMALLOC_CPU_LOCAL_SPANS, "TEST_ONLY_TCMALLOC_CPU_LOCAL_SPANS"},
+    {Experiment::TEST_ONLY_TCMALLOC_HUGE_REGION_SUBRELEASE, "TEST_ONLY_TCMALLOC_HUGE_REGION_SUBRELEASE"},
 };
 // clang-format on
 
@@ -0,0 +1,96 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/experiment_counters.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_stats.h"
+#include "tcmalloc/page_allocator.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/stats.h"
+#include "tcmalloc/transfer_cache.h"
+#include "tcmalloc/transfer_cache_stats.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+ABSL_CONST_INIT PageHeapLockCounts pageheap_lock_counts;
+
+void WalkExperimentCounters(
+    absl::FunctionRef<void(absl::string_view name, uint64_t value)> f) {
+  uint64_t underflows = 0;
+  uint64_t overflows = 0;
+  if (tc_globals.CpuCacheActive()) {
+    const auto misses = tc_globals.cpu_cache().GetTotalCacheMissStats();
+    underflows = misses.underflows;
+    overflows = misses.overflows;
+  }
+
+  uint64_t transfer_cache_misses = 0;
+  for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+    const TransferCacheStats stats =
+        tc_globals.transfer_cache().GetStats(size_class);
+    transfer_cache_misses += stats.insert_misses + stats.remove_misses;
+  }
+
+  PageHeapLockCounts lock_counts;
+  uint64_t filler_used_bytes;
+  uint64_t covered_bytes;
+  {
+    PageHeapSpinLockHolder l;
+    lock_counts = pageheap_lock_counts;
+    const BackingStats filler = tc_globals.page_allocator().FillerStats();
+    filler_used_bytes =
+        filler.system_bytes - filler.free_bytes - filler.unmapped_bytes;
+    covered_bytes = tc_globals.page_allocator().FillerIntactHugepageBytes();
+  }
+
+  MemoryStats memstats;
+  const uint64_t rss = GetMemoryStats(&memstats) ? memstats.rss : 0;
+
+  f("cpu_cache_underflows", underflows);
+  f("cpu_cache_overflows", overflows);
+  f("transfer_cache_misses", transfer_cache_misses);
+  f("pageheap_lock_acquisitions", lock_counts.acquisitions);
+  f("pageheap_lock_contended", lock_counts.contended);
+  f("hugepage_covered_bytes", covered_bytes);
+  f("hugepage_uncovered_bytes", filler_used_bytes - covered_bytes);
+  f("rss_bytes", rss);
+}
+
+void PrintExperimentCounters(Printer* out) {
+  out->printf("MALLOC EXPERIMENT COUNTERS:");
+  WalkExperimentCounters([&](absl::string_view name, uint64_t value) {
+    out->printf(" %s=%u", name, value);
+  });
+  out->printf("\n");
+}
+
+void PrintExperimentCountersInPbtxt(PbtxtRegion* region) {
+  PbtxtRegion counters = region->CreateSubRegion("experiment_counters");
+  WalkExperimentCounters([&](absl::string_view name, uint64_t value) {
+    counters.PrintI64(name, value);
+  });
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,58 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_EXPERIMENT_COUNTERS_H_
+#define TCMALLOC_EXPERIMENT_COUNTERS_H_
+
+#include <stdint.h>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// A standard set of counters for comparing runs under different experiments,
+// each cheap enough to keep always:
+//
+// - cpu_cache_underflows, cpu_cache_overflows and transfer_cache_misses count
+//   the slow paths taken past the per-CPU and transfer caches.
+// - pageheap_lock_acquisitions and pageheap_lock_contended count acquisitions
+//   of pageheap_lock, and those that found it held.
+// - hugepage_covered_bytes and hugepage_uncovered_bytes split the bytes in use
+//   in the HugePageFillers by whether their hugepage is intact.
+// - rss_bytes is the resident size of the process.
+//
+// They are printed with the active experiments in the stats, and are the
+// "tcmalloc.experiment_counters.<name>" properties.
+inline constexpr absl::string_view kExperimentCounterPrefix =
+    "tcmalloc.experiment_counters.";
+
+// Calls f(name, value) for each counter.
+void WalkExperimentCounters(
+    absl::FunctionRef<void(absl::string_view name, uint64_t value)> f)
+    ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+void PrintExperimentCounters(Printer* out) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+void PrintExperimentCountersInPbtxt(PbtxtRegion* region)
+    ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_EXPERIMENT_COUNTERS_H_
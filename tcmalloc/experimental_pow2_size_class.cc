@@ -12,10 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stddef.h>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/size_class_info.h"
+#include "tcmalloc/sizemap.h"
+#include "tcmalloc/static_vars.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -289,6 +295,21 @@ static constexpr SizeClassInfo List[] = {
 static_assert(sizeof(List) / sizeof(List[0]) <= kNumBaseClasses);
 extern constexpr SizeClasses kExperimentalPow2SizeClasses{List, Assumptions};
 
+// Every power of two from 8 bytes to kMaxSize, as kPow2SizeClasses builds
+// require.
+constexpr bool IsPow2Table(absl::Span<const SizeClassInfo> classes) {
+  for (size_t c = 1; c < classes.size(); ++c) {
+    if (classes[c].size != size_t{4} << c) return false;
+  }
+  return classes[classes.size() - 1].size == kMaxSize;
+}
+static_assert(IsPow2Table(List));
+
+#ifdef TCMALLOC_INTERNAL_POW2_SIZE_CLASSES
+// As in size_classes.cc, the SizeMap is built from List at compile time.
+ABSL_CONST_INIT SizeMap ABSL_CACHELINE_ALIGNED Static::sizemap_(List);
+#endif
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,119 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_FREED_SAMPLE_LOG_H_
+#define TCMALLOC_FREED_SAMPLE_LOG_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// FreedSampleLog keeps the most recently freed heap samples that have already
+// been reported in a heap profile delta, so that the next delta can report
+// them as freed.  Frees are numbered from 1 in the order they are recorded;
+// only the last capacity of them are kept.
+class FreedSampleLog {
+ public:
+  // The number of freed samples kept once the log is enabled.
+  static constexpr size_t kCapacity = 1024;
+
+  constexpr FreedSampleLog() = default;
+
+  bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  // Starts recording frees into `entries`, which must outlive the log.
+  void Enable(absl::Span<StackTrace> entries) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    TC_CHECK(!entries.empty());
+    if (enabled()) {
+      return;
+    }
+    entries_ = entries;
+    enabled_.store(true, std::memory_order_release);
+  }
+
+  // Records frees of samples with handles up to `handle` from now on.  Later
+  // samples have not been reported yet, so there is nothing to undo for them.
+  void Cover(AllocHandle handle) {
+    AllocHandle covered = covered_.load(std::memory_order_relaxed);
+    while (covered < handle &&
+           !covered_.compare_exchange_weak(covered, handle,
+                                           std::memory_order_relaxed)) {
+    }
+  }
+
+  void RecordFree(const StackTrace& t) {
+    if (t.sampled_alloc_handle > covered_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    AllocationGuardSpinLockHolder h(&lock_);
+    if (entries_.empty()) {
+      return;
+    }
+    entries_[recorded_ % entries_.size()] = t;
+    ++recorded_;
+  }
+
+  // Returns the number of frees recorded so far.
+  uint64_t recorded() {
+    AllocationGuardSpinLockHolder h(&lock_);
+    return recorded_;
+  }
+
+  // Calls `f` on frees `from` + 1 through `to`, or returns false without
+  // calling it if some of them are no longer kept.  `f` runs under the log's
+  // lock and must not allocate.
+  bool Read(uint64_t from, uint64_t to,
+            absl::FunctionRef<void(const StackTrace&)> f) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    TC_ASSERT_LE(from, to);
+    TC_ASSERT_LE(to, recorded_);
+    if (from == to) {
+      return true;
+    }
+    if (recorded_ - from > entries_.size()) {
+      return false;
+    }
+    for (uint64_t i = from; i < to; ++i) {
+      f(entries_[i % entries_.size()]);
+    }
+    return true;
+  }
+
+ private:
+  absl::base_internal::SpinLock lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  std::atomic<bool> enabled_{false};
+  std::atomic<AllocHandle> covered_{0};
+  absl::Span<StackTrace> entries_ ABSL_GUARDED_BY(lock_);
+  uint64_t recorded_ ABSL_GUARDED_BY(lock_) = 0;
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_FREED_SAMPLE_LOG_H_
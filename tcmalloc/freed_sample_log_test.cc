@@ -0,0 +1,95 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/freed_sample_log.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/logging.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+StackTrace Sample(AllocHandle handle) {
+  StackTrace t = {};
+  t.sampled_alloc_handle = handle;
+  return t;
+}
+
+std::vector<AllocHandle> Read(FreedSampleLog& log, uint64_t from, uint64_t to,
+                              bool* ok) {
+  std::vector<AllocHandle> handles;
+  *ok = log.Read(from, to, [&](const StackTrace& t) {
+    handles.push_back(t.sampled_alloc_handle);
+  });
+  return handles;
+}
+
+TEST(FreedSampleLogTest, RecordsCoveredFrees) {
+  std::vector<StackTrace> entries(4);
+  FreedSampleLog log;
+  EXPECT_FALSE(log.enabled());
+  log.Enable(absl::MakeSpan(entries));
+  EXPECT_TRUE(log.enabled());
+
+  // Nothing has been reported yet, so there is nothing to record.
+  log.RecordFree(Sample(1));
+  EXPECT_EQ(log.recorded(), 0);
+
+  log.Cover(2);
+  log.RecordFree(Sample(1));
+  log.RecordFree(Sample(3));
+  log.RecordFree(Sample(2));
+  EXPECT_EQ(log.recorded(), 2);
+
+  // Covering less than before does not stop recording.
+  log.Cover(1);
+  log.RecordFree(Sample(2));
+  EXPECT_EQ(log.recorded(), 3);
+
+  bool ok;
+  EXPECT_THAT(Read(log, 0, 3, &ok), testing::ElementsAre(1, 2, 2));
+  EXPECT_TRUE(ok);
+  EXPECT_THAT(Read(log, 1, 2, &ok), testing::ElementsAre(2));
+  EXPECT_TRUE(ok);
+  EXPECT_THAT(Read(log, 3, 3, &ok), testing::IsEmpty());
+  EXPECT_TRUE(ok);
+}
+
+TEST(FreedSampleLogTest, Overflow) {
+  std::vector<StackTrace> entries(4);
+  FreedSampleLog log;
+  log.Enable(absl::MakeSpan(entries));
+  log.Cover(10);
+  for (AllocHandle h = 1; h <= 6; ++h) {
+    log.RecordFree(Sample(h));
+  }
+  ASSERT_EQ(log.recorded(), 6);
+
+  bool ok;
+  EXPECT_THAT(Read(log, 2, 6, &ok), testing::ElementsAre(3, 4, 5, 6));
+  EXPECT_TRUE(ok);
+  // The first two frees have been overwritten.
+  EXPECT_THAT(Read(log, 1, 6, &ok), testing::IsEmpty());
+  EXPECT_FALSE(ok);
+  EXPECT_THAT(Read(log, 0, 2, &ok), testing::IsEmpty());
+  EXPECT_FALSE(ok);
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
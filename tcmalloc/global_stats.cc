@@ -14,41 +14,59 @@
 
 #include "tcmalloc/global_stats.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <initializer_list>
+#include <limits>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "tcmalloc/central_freelist.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/emergency_reserve.h"
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
+#include "tcmalloc/experiment_counters.h"
 #include "tcmalloc/guarded_page_allocator.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_stats.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/io_buffer_pool.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/page_heap_allocator.h"
+#include "tcmalloc/pageheap_lock_profiler.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/selsan/selsan.h"
+#include "tcmalloc/slow_path_latency.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/span_recycler.h"
 #include "tcmalloc/span_stats.h"
+#include "tcmalloc/stack_trace_store.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
 #include "tcmalloc/system-alloc.h"
 #include "tcmalloc/thread_cache.h"
+#include "tcmalloc/thread_magazine.h"
 #include "tcmalloc/transfer_cache.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -57,6 +75,16 @@ namespace tcmalloc_internal {
 
 using subtle::percpu::RseqVcpuMode;
 
+// The names of the stages of getting back under a memory limit.
+static constexpr absl::string_view
+    kShrinkStageNames[PageAllocator::kNumShrinkStages] = {
+        "caches", "cold", "hugecache", "filler", "breaking_hugepages"};
+
+// The names of the kinds of page heaps that can be limited on their own.
+static constexpr absl::string_view
+    kHeapKindNames[PageAllocator::kNumHeapKinds] = {"normal", "cold",
+                                                    "sampled"};
+
 static absl::string_view MadviseString() {
   MadvisePreference pref = Parameters::madvise();
 
@@ -86,6 +114,17 @@ void ExtractStats(TCMallocStats* r, uint64_t* class_count,
                   LargeSpanStats* large_spans, bool report_residence) {
   r->central_bytes = 0;
   r->transfer_bytes = 0;
+  // The per-CPU caches are counted in a single pass over the cpus, rather
+  // than one per size class.
+  uint64_t per_cpu_bytes = 0;
+  if (class_count) {
+    if (UsePerCpuCache(tc_globals)) {
+      per_cpu_bytes = tc_globals.cpu_cache().TotalObjectsByClass(
+          absl::MakeSpan(class_count, kNumClasses));
+    } else {
+      std::fill(class_count, class_count + kNumClasses, 0);
+    }
+  }
   for (int size_class = 0; size_class < kNumClasses; ++size_class) {
     const size_t length = tc_globals.central_freelist(size_class).length();
     const size_t tc_length = tc_globals.transfer_cache().tc_length(size_class);
@@ -99,11 +138,7 @@ void ExtractStats(TCMallocStats* r, uint64_t* class_count,
     if (class_count) {
       // Sum the lengths of all per-class freelists, except the per-thread
       // freelists, which get counted when we call GetThreadStats(), below.
-      class_count[size_class] = length + tc_length + sharded_tc_length;
-      if (UsePerCpuCache(tc_globals)) {
-        class_count[size_class] +=
-            tc_globals.cpu_cache().TotalObjectsOfClass(size_class);
-      }
+      class_count[size_class] += length + tc_length + sharded_tc_length;
     }
     if (span_stats) {
       span_stats[size_class] =
@@ -116,8 +151,14 @@ void ExtractStats(TCMallocStats* r, uint64_t* class_count,
   {  // scope
     PageHeapSpinLockHolder l;
     r->tc_stats = ThreadCache::GetStats(&r->thread_bytes, class_count);
+    r->tc_idle_reclaims = ThreadCache::idle_reclaims();
+    r->tc_idle_flushes = ThreadCache::idle_flushes();
     r->span_stats = tc_globals.span_allocator().stats();
+    // Spans held by the recycler are free, though not to span_allocator.
+    r->span_stats.in_use -=
+        std::min<size_t>(SpanRecycler::size(), r->span_stats.in_use);
     r->stack_stats = tc_globals.sampledallocation_allocator().stats();
+    r->stored_stack_stats = tc_globals.stack_trace_store().stats();
     r->linked_sample_stats = tc_globals.linked_sample_allocator().stats();
     r->metadata_bytes = tc_globals.metadata_bytes();
     r->pagemap_bytes = tc_globals.pagemap().bytes();
@@ -158,12 +199,16 @@ void ExtractStats(TCMallocStats* r, uint64_t* class_count,
     r->pagemap_root_bytes_res = 0;
   }
 
+  r->large_span_cache_bytes = LargeSpanCache::bytes();
+  r->emergency_reserve_bytes = EmergencyReserve::bytes();
   r->per_cpu_bytes = 0;
   r->sharded_transfer_bytes = 0;
   r->percpu_metadata_bytes_res = 0;
   r->percpu_metadata_bytes = 0;
   if (UsePerCpuCache(tc_globals)) {
-    r->per_cpu_bytes = tc_globals.cpu_cache().TotalUsedBytes();
+    r->per_cpu_bytes = class_count
+                           ? per_cpu_bytes
+                           : tc_globals.cpu_cache().TotalUsedBytes();
     r->sharded_transfer_bytes =
         tc_globals.sharded_transfer_cache().TotalBytes();
 
@@ -195,7 +240,9 @@ uint64_t InUseByApp(const TCMallocStats& stats) {
   return StatSub(stats.pageheap.system_bytes,
                  stats.thread_bytes + stats.central_bytes +
                      stats.transfer_bytes + stats.per_cpu_bytes +
-                     stats.sharded_transfer_bytes + stats.pageheap.free_bytes +
+                     stats.sharded_transfer_bytes +
+                     stats.large_span_cache_bytes +
+                     stats.emergency_reserve_bytes + stats.pageheap.free_bytes +
                      stats.pageheap.unmapped_bytes);
 }
 
@@ -209,6 +256,24 @@ uint64_t UnmappedBytes(const TCMallocStats& stats) {
   return stats.pageheap.unmapped_bytes + stats.arena.bytes_nonresident;
 }
 
+// Estimates how many of the page heap's unmapped bytes were released lazily
+// with MADV_FREE, and so may still be resident.  SystemRelease doesn't know
+// which of the pages it released have been reused since, so we split the
+// unmapped bytes in the ratio they were released in.  This is exact unless the
+// madvise preference has changed at runtime.
+static uint64_t LazilyReleasedBytes(uint64_t pageheap_unmapped_bytes) {
+  const SystemReleaseBytes released = GetSystemReleaseBytes();
+  if (released.lazy == 0) {
+    return 0;
+  }
+  if (released.eager == 0) {
+    return pageheap_unmapped_bytes;
+  }
+  return pageheap_unmapped_bytes *
+         (static_cast<double>(released.lazy) /
+          (released.lazy + released.eager));
+}
+
 uint64_t PhysicalMemoryUsed(const TCMallocStats& stats) {
   return StatSub(VirtualMemoryUsed(stats), UnmappedBytes(stats));
 }
@@ -222,7 +287,9 @@ uint64_t RequiredBytes(const TCMallocStats& stats) {
 size_t ExternalBytes(const TCMallocStats& stats) {
   return stats.pageheap.free_bytes + stats.central_bytes + stats.per_cpu_bytes +
          stats.sharded_transfer_bytes + stats.transfer_bytes +
-         stats.thread_bytes + stats.metadata_bytes +
+         stats.large_span_cache_bytes + stats.emergency_reserve_bytes +
+         stats.thread_bytes +
+         stats.metadata_bytes +
          stats.arena.bytes_unavailable + stats.arena.bytes_unallocated;
 }
 
@@ -232,7 +299,7 @@ size_t HeapSizeBytes(const BackingStats& stats) {
 
 size_t LocalBytes(const TCMallocStats& stats) {
   return stats.thread_bytes + stats.per_cpu_bytes +
-         stats.sharded_transfer_bytes;
+         stats.sharded_transfer_bytes + stats.large_span_cache_bytes;
 }
 
 size_t SlackBytes(const BackingStats& stats) {
@@ -262,6 +329,8 @@ static absl::string_view SizeClassConfigurationString(
       return "SIZE_CLASS_LEGACY";
     case SizeClassConfiguration::kFewer:
       return "SIZE_CLASS_FEWER";
+    case SizeClassConfiguration::kCustom:
+      return "SIZE_CLASS_CUSTOM";
   }
 
   ASSUME(false);
@@ -272,6 +341,8 @@ static absl::string_view PerCpuTypeString(RseqVcpuMode mode) {
   switch (mode) {
     case RseqVcpuMode::kNone:
       return "NONE";
+    case RseqVcpuMode::kMmCid:
+      return "MM_CID";
   }
 
   ASSUME(false);
@@ -312,6 +383,8 @@ void DumpStats(Printer* out, int level) {
       "MALLOC: + %12u (%7.1f MiB) Bytes in per-CPU cache freelist\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in Sharded cache freelist\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in transfer cache freelist\n"
+      "MALLOC: + %12u (%7.1f MiB) Bytes in large span cache freelist\n"
+      "MALLOC: + %12u (%7.1f MiB) Bytes in emergency reserve\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in thread cache freelists\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in malloc metadata\n"
       "MALLOC: + %12u (%7.1f MiB) Bytes in malloc metadata Arena unallocated\n"
@@ -329,6 +402,8 @@ void DumpStats(Printer* out, int level) {
       "MALLOC:   %12u (%7.1f MiB) Thread heaps created\n"
       "MALLOC:   %12u               Stack traces in use\n"
       "MALLOC:   %12u (%7.1f MiB) Stack traces created\n"
+      "MALLOC:   %12u               Sampled stacks in use\n"
+      "MALLOC:   %12u (%7.1f MiB) Sampled stacks created\n"
       "MALLOC:   %12u               Table buckets in use\n"
       "MALLOC:   %12u (%7.1f MiB) Table buckets created\n"
       "MALLOC:   %12u (%7.1f MiB) Pagemap bytes used\n"
@@ -349,6 +424,8 @@ void DumpStats(Printer* out, int level) {
       stats.per_cpu_bytes, stats.per_cpu_bytes / MiB,
       stats.sharded_transfer_bytes, stats.sharded_transfer_bytes / MiB,
       stats.transfer_bytes, stats.transfer_bytes / MiB,
+      stats.large_span_cache_bytes, stats.large_span_cache_bytes / MiB,
+      stats.emergency_reserve_bytes, stats.emergency_reserve_bytes / MiB,
       stats.thread_bytes, stats.thread_bytes / MiB,
       stats.metadata_bytes, stats.metadata_bytes / MiB,
       stats.arena.bytes_unallocated, stats.arena.bytes_unallocated / MiB,
@@ -364,7 +441,10 @@ void DumpStats(Printer* out, int level) {
       (stats.tc_stats.total * sizeof(ThreadCache)) / MiB,
       uint64_t(stats.stack_stats.in_use),
       uint64_t(stats.stack_stats.total),
-      (stats.stack_stats.total * sizeof(StackTrace)) / MiB,
+      (stats.stack_stats.total * sizeof(SampledAllocation)) / MiB,
+      uint64_t(stats.stored_stack_stats.stacks),
+      uint64_t(stats.stored_stack_stats.created),
+      (stats.stored_stack_stats.created * sizeof(StoredStack)) / MiB,
       uint64_t(stats.linked_sample_stats.in_use),
       uint64_t(stats.linked_sample_stats.total),
       (stats.linked_sample_stats.total * sizeof(StackTraceTable::LinkedSample)) / MiB,
@@ -387,12 +467,20 @@ void DumpStats(Printer* out, int level) {
   );
   // clang-format on
 
+  const uint64_t lazily_released_bytes =
+      LazilyReleasedBytes(stats.pageheap.unmapped_bytes);
+  out->printf(
+      "MALLOC:   %12u (%7.1f MiB) Bytes released to OS lazily (MADV_FREE, "
+      "possibly resident)\n",
+      lazily_released_bytes, lazily_released_bytes / MiB);
+
   out->printf("MALLOC EXPERIMENTS:");
   WalkExperiments([&](absl::string_view name, bool active) {
     const char* value = active ? "1" : "0";
     out->printf(" %s=%s", name, value);
   });
   out->printf("\n");
+  PrintExperimentCounters(out);
 
   out->printf(
       "MALLOC SAMPLED PROFILES: %zu bytes (current), %zu bytes (internal "
@@ -402,6 +490,23 @@ void DumpStats(Printer* out, int level) {
       tc_globals.peak_heap_tracker().CurrentPeakSize(),
       tc_globals.total_sampled_count_.value());
 
+  out->printf(
+      "MALLOC THREAD MAGAZINES: %zu hits, %zu refills, %zu flushes\n",
+      ThreadMagazine::hits(), ThreadMagazine::refills(),
+      ThreadMagazine::flushes());
+
+  out->printf("MALLOC LARGE SPAN CACHE: %zu hits, %zu misses\n",
+              LargeSpanCache::hits(), LargeSpanCache::misses());
+  IoBufferPool::Print(out);
+
+  out->printf("MALLOC METADATA ARENA: %zu hugepage blocks, bytes by use:",
+              stats.arena.hugepage_blocks);
+  for (size_t i = 0; i < kNumArenaUses; ++i) {
+    out->printf(" %s=%zu", ArenaUseToLabel(static_cast<ArenaUse>(i)),
+                stats.arena.bytes_by_use[i]);
+  }
+  out->printf("\n");
+
   MemoryStats memstats;
   if (GetMemoryStats(&memstats)) {
     uint64_t rss = memstats.rss;
@@ -466,12 +571,14 @@ void DumpStats(Printer* out, int level) {
       tc_globals.cpu_cache().Print(out);
     }
 
-    tc_globals.page_allocator().Print(out, MemoryTag::kNormal);
-    if (tc_globals.numa_topology().active_partitions() > 1) {
-      tc_globals.page_allocator().Print(out, MemoryTag::kNormalP1);
+    for (size_t partition = 0;
+         partition < tc_globals.numa_topology().active_partitions();
+         ++partition) {
+      tc_globals.page_allocator().Print(out, NumaNormalTag(partition));
     }
     tc_globals.page_allocator().Print(out, MemoryTag::kSampled);
     tc_globals.page_allocator().Print(out, MemoryTag::kCold);
+    tc_globals.page_allocator().Print(out, MemoryTag::kWarm);
     tc_globals.guardedpage_allocator().Print(out);
     selsan::PrintTextStats(out);
 
@@ -495,6 +602,14 @@ void DumpStats(Printer* out, int level) {
     out->printf("Number of times memory shrank below hard limit: %lld\n",
                 tc_globals.page_allocator().successful_shrinks_after_limit_hit(
                     PageAllocator::kHard));
+    for (int i = 0; i < PageAllocator::kNumHeapKinds; ++i) {
+      const auto kind = static_cast<PageAllocator::HeapKind>(i);
+      out->printf("PARAMETER %s_memory_limit_bytes %u\n", kHeapKindNames[i],
+                  tc_globals.page_allocator().heap_limit(kind));
+      out->printf("Number of times %s memory limit was hit: %lld\n",
+                  kHeapKindNames[i],
+                  tc_globals.page_allocator().heap_limit_hits(kind));
+    }
 
     out->printf("Total number of pages released: %llu (%7.1f MiB)\n",
                 stats.num_released_total.in_pages().raw_num(),
@@ -519,6 +634,18 @@ void DumpStats(Printer* out, int level) {
         "MiB)\n",
         stats.num_released_hard_limit_exceeded.in_pages().raw_num(),
         stats.num_released_hard_limit_exceeded.in_mib());
+    for (int i = 0; i < PageAllocator::kNumShrinkStages; ++i) {
+      const size_t bytes = tc_globals.page_allocator().shrink_released_bytes(
+          static_cast<PageAllocator::ShrinkStage>(i));
+      out->printf("Bytes recovered under limits by %s: %zu (%7.1f MiB)\n",
+                  kShrinkStageNames[i], bytes, bytes / MiB);
+    }
+
+    const BackgroundScheduler::Stats background =
+        tc_globals.background_scheduler().GetStats();
+    out->printf(
+        "Background thread wakeups: %llu (%llu idle), last sleep: %lld ms\n",
+        background.wakeups, background.idle_wakeups, background.sleep_ms);
 
     out->printf("------------------------------------------------\n");
     out->printf("Parameters\n");
@@ -570,10 +697,95 @@ void DumpStats(Printer* out, int level) {
     out->printf("PARAMETER madvise %s\n", MadviseString());
     out->printf("PARAMETER tcmalloc_resize_size_class_max_capacity %d\n",
                 Parameters::resize_size_class_max_capacity() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_remote_steal %d\n",
+                Parameters::per_cpu_caches_remote_steal() ? 1 : 0);
+    out->printf(
+        "PARAMETER tcmalloc_per_cpu_caches_partitioned_slab_resize %d\n",
+        Parameters::per_cpu_caches_partitioned_slab_resize() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_allocation_rate_resize %d\n",
+                Parameters::per_cpu_caches_allocation_rate_resize() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_target_hit_rate %f\n",
+                Parameters::per_cpu_caches_target_hit_rate());
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_prefetch_cold_classes %d\n",
+                Parameters::per_cpu_caches_prefetch_cold_classes() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_thread_magazine %d\n",
+                Parameters::per_cpu_caches_thread_magazine() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_transfer_cache_plunder_intervals %d\n",
+                Parameters::transfer_cache_plunder_intervals());
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_batch_size_autotune %d\n",
+                Parameters::per_cpu_caches_batch_size_autotune() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_summary_stats %d\n",
+                Parameters::per_cpu_caches_summary_stats() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_lifetime_aware_span_placement %d\n",
+                Parameters::lifetime_aware_span_placement() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_collapse_subreleased_hugepages %d\n",
+                Parameters::collapse_subreleased_hugepages() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_lifetime_aware_region_placement %d\n",
+                Parameters::lifetime_aware_region_placement() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_lifetime_aware_filler_placement %d\n",
+                Parameters::lifetime_aware_filler_placement() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_async_release_memory_to_system %d\n",
+                Parameters::async_release_memory_to_system() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_memory_pressure_aware_release %d\n",
+                Parameters::memory_pressure_aware_release() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_follow_cgroup_memory_limits %d\n",
+                Parameters::follow_cgroup_memory_limits() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_large_allocation_prefault_threshold %d\n",
+                Parameters::large_allocation_prefault_threshold());
+    out->printf("PARAMETER tcmalloc_gigantic_page_threshold %d\n",
+                Parameters::gigantic_page_threshold());
+    out->printf("PARAMETER tcmalloc_audit_hugepage_backing %d\n",
+                Parameters::audit_hugepage_backing() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_batch_remote_frees %d\n",
+                Parameters::per_cpu_caches_batch_remote_frees() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_demote_idle_hugepages %d\n",
+                Parameters::demote_idle_hugepages() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_cold_callsite_classification %d\n",
+                Parameters::cold_callsite_classification() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_profile_samples_per_second_target %d\n",
+                Parameters::profile_samples_per_second_target());
+    out->printf("PARAMETER tcmalloc_slow_path_latency_sampling_interval %d\n",
+                Parameters::slow_path_latency_sampling_interval());
+    out->printf(
+        "PARAMETER tcmalloc_pageheap_lock_contention_sampling_interval %d\n",
+        Parameters::pageheap_lock_contention_sampling_interval());
+    out->printf("PARAMETER tcmalloc_metadata_arena_hugepages %d\n",
+                Parameters::metadata_arena_hugepages() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_thread_cache_dynamic_resize %d\n",
+                Parameters::thread_cache_dynamic_resize() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_release_caches_at_fork %d\n",
+                Parameters::release_caches_at_fork() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_adaptive_guarded_sampling %d\n",
+                Parameters::adaptive_guarded_sampling() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_selsan_sampling_interval %d\n",
+                Parameters::selsan_sampling_interval());
+    out->printf("PARAMETER tcmalloc_release_refault_budget %d\n",
+                Parameters::release_refault_budget());
+    out->printf("PARAMETER tcmalloc_large_span_cache_bytes %d\n",
+                Parameters::large_span_cache_bytes());
+    out->printf(
+        "PARAMETER tcmalloc_per_cpu_caches_incremental_slab_resize %d\n",
+        Parameters::per_cpu_caches_incremental_slab_resize() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_l3_capacity_pools %d\n",
+                Parameters::per_cpu_caches_l3_capacity_pools() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_cpu_caches_partial_reclaim %d\n",
+                Parameters::per_cpu_caches_partial_reclaim() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_background_event_driven %d\n",
+                Parameters::background_event_driven() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_transfer_cache_background_refill %d\n",
+                Parameters::transfer_cache_background_refill() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_thread_cache_idle_flush_intervals %d\n",
+                Parameters::thread_cache_idle_flush_intervals());
+    out->printf("PARAMETER tcmalloc_frame_pointer_unwinding %d\n",
+                Parameters::frame_pointer_unwinding() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_per_thread_allocation_accounting %d\n",
+                Parameters::per_thread_allocation_accounting() ? 1 : 0);
+    out->printf("PARAMETER tcmalloc_cached_stats_max_age_ms %d\n",
+                Parameters::cached_stats_max_age_ms());
   }
 }
 
-void DumpStatsInPbtxt(Printer* out, int level) {
+void DumpStatsInPbtxt(Printer* out, int level, PbtxtEncoding encoding) {
   TCMallocStats stats;
   uint64_t class_count[kNumClasses];
   SpanStats span_stats[kNumClasses];
@@ -588,7 +800,7 @@ void DumpStatsInPbtxt(Printer* out, int level) {
   const uint64_t physical_memory_used = PhysicalMemoryUsed(stats);
   const uint64_t unmapped_bytes = UnmappedBytes(stats);
 
-  PbtxtRegion region(out, kTop);
+  PbtxtRegion region(out, kTop, encoding);
   region.PrintI64("in_use_by_app", bytes_in_use_by_app);
   region.PrintI64("page_heap_freelist", stats.pageheap.free_bytes);
   region.PrintI64("central_cache_freelist", stats.central_bytes);
@@ -596,6 +808,9 @@ void DumpStatsInPbtxt(Printer* out, int level) {
   region.PrintI64("sharded_transfer_cache_freelist",
                   stats.sharded_transfer_bytes);
   region.PrintI64("transfer_cache_freelist", stats.transfer_bytes);
+  region.PrintI64("large_span_cache_freelist", stats.large_span_cache_bytes);
+  region.PrintI64("emergency_reserve", stats.emergency_reserve_bytes);
+  region.PrintI64("emergency_reserve_releases", EmergencyReserve::releases());
   region.PrintI64("thread_cache_freelists", stats.thread_bytes);
   region.PrintI64("malloc_metadata", stats.metadata_bytes);
   region.PrintI64("malloc_metadata_arena_unavailable",
@@ -604,14 +819,24 @@ void DumpStatsInPbtxt(Printer* out, int level) {
                   stats.arena.bytes_unallocated);
   region.PrintI64("actual_mem_used", physical_memory_used);
   region.PrintI64("unmapped", unmapped_bytes);
+  region.PrintI64("unmapped_lazily_released",
+                  LazilyReleasedBytes(stats.pageheap.unmapped_bytes));
   region.PrintI64("virtual_address_space_used", virtual_memory_used);
   region.PrintI64("num_spans", uint64_t(stats.span_stats.in_use));
   region.PrintI64("num_spans_created", uint64_t(stats.span_stats.total));
   region.PrintI64("num_thread_heaps", uint64_t(stats.tc_stats.in_use));
   region.PrintI64("num_thread_heaps_created", uint64_t(stats.tc_stats.total));
+  region.PrintI64("thread_cache_idle_reclaims", stats.tc_idle_reclaims);
+  region.PrintI64("thread_cache_idle_flushes", stats.tc_idle_flushes);
   region.PrintI64("num_stack_traces", uint64_t(stats.stack_stats.in_use));
   region.PrintI64("num_stack_traces_created",
                   uint64_t(stats.stack_stats.total));
+  region.PrintI64("num_sampled_stacks",
+                  uint64_t(stats.stored_stack_stats.stacks));
+  region.PrintI64("num_sampled_stack_refs",
+                  uint64_t(stats.stored_stack_stats.refs));
+  region.PrintI64("num_sampled_stacks_created",
+                  uint64_t(stats.stored_stack_stats.created));
   region.PrintI64("num_table_buckets",
                   uint64_t(stats.linked_sample_stats.in_use));
   region.PrintI64("num_table_buckets_created",
@@ -627,6 +852,15 @@ void DumpStatsInPbtxt(Printer* out, int level) {
   region.PrintI64("tcmalloc_huge_page_size", uint64_t(kHugePageSize));
   region.PrintI64("cpus_allowed", CountAllowedCpus());
   region.PrintI64("arena_blocks", stats.arena.blocks);
+  {
+    auto arena = region.CreateSubRegion("metadata_arena");
+    arena.PrintI64("hugepage_blocks", stats.arena.hugepage_blocks);
+    for (size_t i = 0; i < kNumArenaUses; ++i) {
+      auto use = arena.CreateSubRegion("bytes_by_use");
+      use.PrintRaw("use", ArenaUseToLabel(static_cast<ArenaUse>(i)));
+      use.PrintI64("bytes", stats.arena.bytes_by_use[i]);
+    }
+  }
 
   {
     auto sampled_profiles = region.CreateSubRegion("sampled_profiles");
@@ -639,6 +873,20 @@ void DumpStatsInPbtxt(Printer* out, int level) {
                               tc_globals.peak_heap_tracker().CurrentPeakSize());
   }
 
+  {
+    auto thread_magazines = region.CreateSubRegion("thread_magazines");
+    thread_magazines.PrintI64("hits", ThreadMagazine::hits());
+    thread_magazines.PrintI64("refills", ThreadMagazine::refills());
+    thread_magazines.PrintI64("flushes", ThreadMagazine::flushes());
+  }
+
+  {
+    auto large_span_cache = region.CreateSubRegion("large_span_cache");
+    large_span_cache.PrintI64("hits", LargeSpanCache::hits());
+    large_span_cache.PrintI64("misses", LargeSpanCache::misses());
+  }
+  IoBufferPool::PrintInPbtxt(&region);
+
   // Print total process stats (inclusive of non-malloc sources).
   MemoryStats memstats;
   if (GetMemoryStats(&memstats)) {
@@ -648,6 +896,9 @@ void DumpStatsInPbtxt(Printer* out, int level) {
 
   region.PrintI64("total_sampled_count",
                   tc_globals.total_sampled_count_.value());
+  region.PrintI64("pageheap_lock_contention_samples_dropped",
+                  PageHeapLockProfiler::dropped());
+  PrintExperimentCountersInPbtxt(&region);
 
   if (level >= 2) {
     {
@@ -677,12 +928,15 @@ void DumpStatsInPbtxt(Printer* out, int level) {
       tc_globals.cpu_cache().PrintInPbtxt(&region);
     }
   }
-  tc_globals.page_allocator().PrintInPbtxt(&region, MemoryTag::kNormal);
-  if (tc_globals.numa_topology().active_partitions() > 1) {
-    tc_globals.page_allocator().PrintInPbtxt(&region, MemoryTag::kNormalP1);
+  SlowPathLatency::PrintInPbtxt(region);
+  for (size_t partition = 0;
+       partition < tc_globals.numa_topology().active_partitions();
+       ++partition) {
+    tc_globals.page_allocator().PrintInPbtxt(&region, NumaNormalTag(partition));
   }
   tc_globals.page_allocator().PrintInPbtxt(&region, MemoryTag::kSampled);
   tc_globals.page_allocator().PrintInPbtxt(&region, MemoryTag::kCold);
+  tc_globals.page_allocator().PrintInPbtxt(&region, MemoryTag::kWarm);
   // We do not collect tracking information in pbtxt.
 
   size_t soft_limit_bytes =
@@ -704,6 +958,14 @@ void DumpStatsInPbtxt(Printer* out, int level) {
       "successful_shrinks_after_hard_limit_hit",
       tc_globals.page_allocator().successful_shrinks_after_limit_hit(
           PageAllocator::kHard));
+  for (int i = 0; i < PageAllocator::kNumHeapKinds; ++i) {
+    const auto kind = static_cast<PageAllocator::HeapKind>(i);
+    PbtxtRegion limit = region.CreateSubRegion("memory_kind_limit");
+    limit.PrintRaw("kind", kHeapKindNames[i]);
+    limit.PrintI64("limit_bytes", tc_globals.page_allocator().heap_limit(kind));
+    limit.PrintI64("limit_hits",
+                   tc_globals.page_allocator().heap_limit_hits(kind));
+  }
 
   region.PrintI64("num_released_total_pages",
                   stats.num_released_total.in_pages().raw_num());
@@ -717,6 +979,19 @@ void DumpStatsInPbtxt(Printer* out, int level) {
                   stats.num_released_soft_limit_exceeded.in_pages().raw_num());
   region.PrintI64("num_released_hard_limit_exceeded_pages",
                   stats.num_released_hard_limit_exceeded.in_pages().raw_num());
+  for (int i = 0; i < PageAllocator::kNumShrinkStages; ++i) {
+    PbtxtRegion stage = region.CreateSubRegion("limit_shrink_stage");
+    stage.PrintRaw("stage", kShrinkStageNames[i]);
+    stage.PrintI64("recovered_bytes",
+                   tc_globals.page_allocator().shrink_released_bytes(
+                       static_cast<PageAllocator::ShrinkStage>(i)));
+  }
+
+  const BackgroundScheduler::Stats background =
+      tc_globals.background_scheduler().GetStats();
+  region.PrintI64("background_wakeups", background.wakeups);
+  region.PrintI64("background_idle_wakeups", background.idle_wakeups);
+  region.PrintI64("background_sleep_ms", background.sleep_ms);
 
   {
     auto gwp_asan = region.CreateSubRegion("gwp_asan");
@@ -725,6 +1000,13 @@ void DumpStatsInPbtxt(Printer* out, int level) {
   selsan::PrintPbtxtStats(&region);
 
   region.PrintI64("memory_release_failures", SystemReleaseErrors());
+  region.PrintI64("address_space_region_size", SystemAllocRegionSize());
+  region.PrintRaw("thp_mode", ThpModeToLabel(GetThpMode()));
+  {
+    const SystemReleaseBytes released = GetSystemReleaseBytes();
+    region.PrintI64("memory_released_lazily_total", released.lazy);
+    region.PrintI64("memory_released_eagerly_total", released.eager);
+  }
 
   region.PrintBool("tcmalloc_per_cpu_caches", Parameters::per_cpu_caches());
   region.PrintI64("tcmalloc_max_per_cpu_cache_size",
@@ -769,10 +1051,339 @@ void DumpStatsInPbtxt(Printer* out, int level) {
   region.PrintRaw("madvise", MadviseString());
   region.PrintBool("tcmalloc_resize_size_class_max_capacity",
                    Parameters::resize_size_class_max_capacity());
+  region.PrintBool("tcmalloc_per_cpu_caches_remote_steal",
+                   Parameters::per_cpu_caches_remote_steal());
+  region.PrintBool("tcmalloc_per_cpu_caches_partitioned_slab_resize",
+                   Parameters::per_cpu_caches_partitioned_slab_resize());
+  region.PrintBool("tcmalloc_per_cpu_caches_allocation_rate_resize",
+                   Parameters::per_cpu_caches_allocation_rate_resize());
+  region.PrintDouble("tcmalloc_per_cpu_caches_target_hit_rate",
+                     Parameters::per_cpu_caches_target_hit_rate());
+  region.PrintBool("tcmalloc_per_cpu_caches_prefetch_cold_classes",
+                   Parameters::per_cpu_caches_prefetch_cold_classes());
+  region.PrintBool("tcmalloc_per_cpu_caches_thread_magazine",
+                   Parameters::per_cpu_caches_thread_magazine());
+  region.PrintI64("tcmalloc_transfer_cache_plunder_intervals",
+                  Parameters::transfer_cache_plunder_intervals());
+  region.PrintBool("tcmalloc_per_cpu_caches_batch_size_autotune",
+                   Parameters::per_cpu_caches_batch_size_autotune());
+  region.PrintBool("tcmalloc_per_cpu_caches_summary_stats",
+                   Parameters::per_cpu_caches_summary_stats());
+  region.PrintBool("tcmalloc_lifetime_aware_span_placement",
+                   Parameters::lifetime_aware_span_placement());
+  region.PrintBool("tcmalloc_collapse_subreleased_hugepages",
+                   Parameters::collapse_subreleased_hugepages());
+  region.PrintBool("tcmalloc_lifetime_aware_region_placement",
+                   Parameters::lifetime_aware_region_placement());
+  region.PrintBool("tcmalloc_lifetime_aware_filler_placement",
+                   Parameters::lifetime_aware_filler_placement());
+  region.PrintBool("tcmalloc_async_release_memory_to_system",
+                   Parameters::async_release_memory_to_system());
+  region.PrintBool("tcmalloc_memory_pressure_aware_release",
+                   Parameters::memory_pressure_aware_release());
+  region.PrintBool("tcmalloc_follow_cgroup_memory_limits",
+                   Parameters::follow_cgroup_memory_limits());
+  region.PrintI64("tcmalloc_large_allocation_prefault_threshold",
+                  Parameters::large_allocation_prefault_threshold());
+  region.PrintI64("tcmalloc_gigantic_page_threshold",
+                  Parameters::gigantic_page_threshold());
+  region.PrintBool("tcmalloc_audit_hugepage_backing",
+                   Parameters::audit_hugepage_backing());
+  region.PrintBool("tcmalloc_per_cpu_caches_batch_remote_frees",
+                   Parameters::per_cpu_caches_batch_remote_frees());
+  region.PrintBool("tcmalloc_demote_idle_hugepages",
+                   Parameters::demote_idle_hugepages());
+  region.PrintBool("tcmalloc_cold_callsite_classification",
+                   Parameters::cold_callsite_classification());
+  region.PrintI64("tcmalloc_profile_samples_per_second_target",
+                  Parameters::profile_samples_per_second_target());
+  region.PrintI64("tcmalloc_slow_path_latency_sampling_interval",
+                  Parameters::slow_path_latency_sampling_interval());
+  region.PrintI64("tcmalloc_pageheap_lock_contention_sampling_interval",
+                  Parameters::pageheap_lock_contention_sampling_interval());
+  region.PrintBool("tcmalloc_metadata_arena_hugepages",
+                   Parameters::metadata_arena_hugepages());
+  region.PrintBool("tcmalloc_thread_cache_dynamic_resize",
+                   Parameters::thread_cache_dynamic_resize());
+  region.PrintBool("tcmalloc_release_caches_at_fork",
+                   Parameters::release_caches_at_fork());
+  region.PrintBool("tcmalloc_adaptive_guarded_sampling",
+                   Parameters::adaptive_guarded_sampling());
+  region.PrintI64("tcmalloc_selsan_sampling_interval",
+                  Parameters::selsan_sampling_interval());
+  region.PrintI64("tcmalloc_release_refault_budget",
+                  Parameters::release_refault_budget());
+  region.PrintI64("tcmalloc_large_span_cache_bytes",
+                  Parameters::large_span_cache_bytes());
+  region.PrintBool("tcmalloc_per_cpu_caches_incremental_slab_resize",
+                   Parameters::per_cpu_caches_incremental_slab_resize());
+  region.PrintBool("tcmalloc_per_cpu_caches_l3_capacity_pools",
+                   Parameters::per_cpu_caches_l3_capacity_pools());
+  region.PrintBool("tcmalloc_per_cpu_caches_partial_reclaim",
+                   Parameters::per_cpu_caches_partial_reclaim());
+  region.PrintBool("tcmalloc_background_event_driven",
+                   Parameters::background_event_driven());
+  region.PrintBool("tcmalloc_transfer_cache_background_refill",
+                   Parameters::transfer_cache_background_refill());
+  region.PrintI64("tcmalloc_thread_cache_idle_flush_intervals",
+                  Parameters::thread_cache_idle_flush_intervals());
+  region.PrintBool("tcmalloc_frame_pointer_unwinding",
+                   Parameters::frame_pointer_unwinding());
+  region.PrintBool("tcmalloc_per_thread_allocation_accounting",
+                   Parameters::per_thread_allocation_accounting());
+  region.PrintI64("tcmalloc_cached_stats_max_age_ms",
+                  Parameters::cached_stats_max_age_ms());
+}
+
+namespace {
+
+// The stats kept under pageheap_lock, as of the last MirrorLockedStats.  The
+// fields are mirrored one by one, so a reader may see some of them before an
+// update and others after it.
+struct LockedStatsMirror {
+  static constexpr int64_t kNever = std::numeric_limits<int64_t>::min();
+
+  std::atomic<int64_t> as_of_unix_nanos{kNever};
+  std::atomic<uint64_t> system_bytes{0};
+  std::atomic<uint64_t> free_bytes{0};
+  std::atomic<uint64_t> unmapped_bytes{0};
+  std::atomic<uint64_t> thread_bytes{0};
+  std::atomic<uint64_t> metadata_bytes{0};
+  std::atomic<uint64_t> filler_system_bytes{0};
+  std::atomic<uint64_t> filler_free_bytes{0};
+  std::atomic<uint64_t> filler_unmapped_bytes{0};
+};
+
+ABSL_CONST_INIT LockedStatsMirror locked_stats_mirror;
+
+}  // namespace
+
+void MirrorLockedStats() {
+  uint64_t thread_bytes = 0;
+  BackingStats pageheap;
+  BackingStats filler;
+  size_t metadata_bytes;
+  {
+    PageHeapSpinLockHolder l;
+    ThreadCache::GetStats(&thread_bytes, nullptr);
+    pageheap = tc_globals.page_allocator().stats();
+    filler = tc_globals.page_allocator().FillerStats();
+    // As ExtractStats does when not reporting residence.
+    metadata_bytes = tc_globals.metadata_bytes() +
+                     tc_globals.arena().stats().bytes_nonresident;
+  }
+
+  LockedStatsMirror& m = locked_stats_mirror;
+  m.system_bytes.store(pageheap.system_bytes, std::memory_order_relaxed);
+  m.free_bytes.store(pageheap.free_bytes, std::memory_order_relaxed);
+  m.unmapped_bytes.store(pageheap.unmapped_bytes, std::memory_order_relaxed);
+  m.thread_bytes.store(thread_bytes, std::memory_order_relaxed);
+  m.metadata_bytes.store(metadata_bytes, std::memory_order_relaxed);
+  m.filler_system_bytes.store(filler.system_bytes, std::memory_order_relaxed);
+  m.filler_free_bytes.store(filler.free_bytes, std::memory_order_relaxed);
+  m.filler_unmapped_bytes.store(filler.unmapped_bytes,
+                                std::memory_order_relaxed);
+  m.as_of_unix_nanos.store(absl::ToUnixNanos(absl::Now()),
+                           std::memory_order_relaxed);
+}
+
+void ExtractStatsSnapshot(MallocExtension::StatsSnapshot* snapshot,
+                          bool exact) {
+  if (exact) {
+    MirrorLockedStats();
+  }
+
+  const LockedStatsMirror& m = locked_stats_mirror;
+  const int64_t as_of = m.as_of_unix_nanos.load(std::memory_order_relaxed);
+  if (as_of != LockedStatsMirror::kNever) {
+    snapshot->page_heap_as_of = absl::FromUnixNanos(as_of);
+  }
+  snapshot->heap_size = m.system_bytes.load(std::memory_order_relaxed);
+  snapshot->page_heap_free = m.free_bytes.load(std::memory_order_relaxed);
+  snapshot->page_heap_unmapped =
+      m.unmapped_bytes.load(std::memory_order_relaxed);
+  snapshot->thread_cache_free = m.thread_bytes.load(std::memory_order_relaxed);
+  snapshot->metadata = m.metadata_bytes.load(std::memory_order_relaxed);
+  snapshot->filler_size =
+      m.filler_system_bytes.load(std::memory_order_relaxed);
+  snapshot->filler_free = m.filler_free_bytes.load(std::memory_order_relaxed);
+  snapshot->filler_unmapped =
+      m.filler_unmapped_bytes.load(std::memory_order_relaxed);
+
+  // The caches keep their lengths in atomics, so these are read as they are.
+  for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+    const CentralFreeList& freelist = tc_globals.central_freelist(size_class);
+    const size_t size = tc_globals.sizemap().class_to_size(size_class);
+    snapshot->central_cache_free +=
+        size * freelist.length() + freelist.OverheadBytes();
+    snapshot->transfer_cache_free +=
+        size * tc_globals.transfer_cache().tc_length(size_class);
+  }
+  if (UsePerCpuCache(tc_globals)) {
+    snapshot->cpu_cache_free = tc_globals.cpu_cache().TotalUsedBytes();
+    snapshot->sharded_transfer_cache_free =
+        tc_globals.sharded_transfer_cache().TotalBytes();
+  }
+  snapshot->large_span_cache_free = LargeSpanCache::bytes();
+  snapshot->emergency_reserve = EmergencyReserve::bytes();
+  if (UsePerCpuCache(tc_globals)) {
+    const auto misses = tc_globals.cpu_cache().GetTotalCacheMissStats();
+    snapshot->cpu_cache_underflows = misses.underflows;
+    snapshot->cpu_cache_overflows = misses.overflows;
+  }
+
+  snapshot->bytes_in_use_by_app = StatSub(
+      snapshot->heap_size,
+      snapshot->thread_cache_free + snapshot->central_cache_free +
+          snapshot->transfer_cache_free + snapshot->cpu_cache_free +
+          snapshot->sharded_transfer_cache_free +
+          snapshot->large_span_cache_free + snapshot->emergency_reserve +
+          snapshot->page_heap_free +
+          snapshot->page_heap_unmapped);
+}
+
+const TCMallocStats& SharedTCMallocStats::Get(bool report_residence) {
+  if (!extracted_ || (report_residence && !report_residence_)) {
+    ExtractTCMallocStats(&stats_, report_residence);
+    extracted_ = true;
+    report_residence_ = report_residence;
+  }
+  return stats_;
+}
+
+void GetMemoryUsageByTag(std::vector<MallocExtension::MemoryTagUsage>* ret) {
+  struct TagStats {
+    MemoryTag tag;
+    BackingStats stats;
+  };
+  // One page heap per NUMA partition, plus sampled, selsan, cold and warm.
+  constexpr size_t kMaxHeaps = kNumaPartitions + 4;
+  TagStats heaps[kMaxHeaps];
+  size_t num_heaps = 0;
+  BackingStats metadata;
+  {
+    // Nothing is allocated under the lock; the result is built after.
+    PageHeapSpinLockHolder l;
+    tc_globals.page_allocator().ForEachTagStats(
+        [&](MemoryTag tag, BackingStats stats) {
+          TC_CHECK_LT(num_heaps, kMaxHeaps);
+          heaps[num_heaps++] = {tag, stats};
+        });
+    const ArenaStats arena = tc_globals.arena().stats();
+    metadata.system_bytes =
+        tc_globals.metadata_bytes() + arena.bytes_nonresident;
+    metadata.free_bytes = arena.bytes_unallocated;
+    metadata.unmapped_bytes = arena.bytes_nonresident;
+  }
+
+  auto add = [&](MemoryTag tag, const BackingStats& stats) {
+    MallocExtension::MemoryTagUsage& usage = ret->emplace_back();
+    usage.tag = std::string(MemoryTagToLabel(tag));
+    const size_t partition = NumaPartitionFromTag(tag);
+    if (partition < kNumaPartitions) {
+      usage.numa_partition = partition;
+      usage.numa_nodes =
+          tc_globals.numa_topology().GetPartitionNodes(partition);
+    }
+    usage.mapped_bytes = stats.system_bytes;
+    usage.committed_bytes = StatSub(stats.system_bytes, stats.unmapped_bytes);
+    usage.free_bytes = stats.free_bytes;
+    usage.released_bytes = stats.unmapped_bytes;
+  };
+  ret->clear();
+  ret->reserve(num_heaps + 1);
+  for (size_t i = 0; i < num_heaps; ++i) {
+    add(heaps[i].tag, heaps[i].stats);
+  }
+  add(MemoryTag::kMetadata, metadata);
+}
+
+namespace {
+
+// The totals GetStatsTotals last extracted, with cached_stats_max_age_ms set.
+// As with LockedStatsMirror, a reader may see some fields before an update and
+// others after it.
+struct CachedStatsTotals {
+  static constexpr int64_t kNever = std::numeric_limits<int64_t>::min();
+
+  std::atomic<int64_t> as_of_nanos{kNever};
+  std::atomic<uint64_t> system_bytes{0};
+  std::atomic<uint64_t> free_bytes{0};
+  std::atomic<uint64_t> unmapped_bytes{0};
+  std::atomic<uint64_t> cache_bytes{0};
+  std::atomic<uint64_t> bytes_in_use_by_app{0};
+  std::atomic<uint64_t> physical_memory_used{0};
+  std::atomic<uint64_t> virtual_memory_used{0};
+};
+
+ABSL_CONST_INIT CachedStatsTotals cached_stats_totals;
+
+}  // namespace
+
+StatsTotals GetStatsTotals() {
+  CachedStatsTotals& c = cached_stats_totals;
+  const int64_t max_age_ms = Parameters::cached_stats_max_age_ms();
+  if (max_age_ms > 0) {
+    const int64_t now = absl::GetCurrentTimeNanos();
+    int64_t as_of = c.as_of_nanos.load(std::memory_order_relaxed);
+    // Only one caller refreshes stale totals, claiming them by moving their
+    // time forward.  The others answer from them in the meantime.
+    if (as_of != CachedStatsTotals::kNever &&
+        (absl::Nanoseconds(now - as_of) <= absl::Milliseconds(max_age_ms) ||
+         !c.as_of_nanos.compare_exchange_strong(as_of, now,
+                                                std::memory_order_relaxed))) {
+      return {
+          .system_bytes = c.system_bytes.load(std::memory_order_relaxed),
+          .free_bytes = c.free_bytes.load(std::memory_order_relaxed),
+          .unmapped_bytes = c.unmapped_bytes.load(std::memory_order_relaxed),
+          .cache_bytes = c.cache_bytes.load(std::memory_order_relaxed),
+          .bytes_in_use_by_app =
+              c.bytes_in_use_by_app.load(std::memory_order_relaxed),
+          .physical_memory_used =
+              c.physical_memory_used.load(std::memory_order_relaxed),
+          .virtual_memory_used =
+              c.virtual_memory_used.load(std::memory_order_relaxed),
+      };
+    }
+  }
+
+  TCMallocStats stats;
+  ExtractTCMallocStats(&stats, false);
+  const StatsTotals totals = {
+      .system_bytes = stats.pageheap.system_bytes,
+      .free_bytes = stats.pageheap.free_bytes,
+      .unmapped_bytes = stats.pageheap.unmapped_bytes,
+      .cache_bytes =
+          stats.thread_bytes + stats.central_bytes + stats.transfer_bytes,
+      .bytes_in_use_by_app = InUseByApp(stats),
+      .physical_memory_used = PhysicalMemoryUsed(stats),
+      .virtual_memory_used = VirtualMemoryUsed(stats),
+  };
+  if (max_age_ms > 0) {
+    c.system_bytes.store(totals.system_bytes, std::memory_order_relaxed);
+    c.free_bytes.store(totals.free_bytes, std::memory_order_relaxed);
+    c.unmapped_bytes.store(totals.unmapped_bytes, std::memory_order_relaxed);
+    c.cache_bytes.store(totals.cache_bytes, std::memory_order_relaxed);
+    c.bytes_in_use_by_app.store(totals.bytes_in_use_by_app,
+                                std::memory_order_relaxed);
+    c.physical_memory_used.store(totals.physical_memory_used,
+                                 std::memory_order_relaxed);
+    c.virtual_memory_used.store(totals.virtual_memory_used,
+                                std::memory_order_relaxed);
+    c.as_of_nanos.store(absl::GetCurrentTimeNanos(),
+                        std::memory_order_relaxed);
+  }
+  return totals;
 }
 
 bool GetNumericProperty(const char* name_data, size_t name_size,
                         size_t* value) {
+  SharedTCMallocStats shared;
+  return GetNumericProperty(name_data, name_size, value, shared);
+}
+
+bool GetNumericProperty(const char* name_data, size_t name_size, size_t* value,
+                        SharedTCMallocStats& shared) {
   // LINT.IfChange
   TC_ASSERT_NE(name_data, nullptr);
   TC_ASSERT_NE(value, nullptr);
@@ -784,38 +1395,55 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
     return true;
   }
 
+  // With cached stats, these are answered in O(1) from recent totals.
+  if (Parameters::cached_stats_max_age_ms() > 0) {
+    if (name == "generic.current_allocated_bytes" ||
+        name == "generic.bytes_in_use_by_app") {
+      *value = GetStatsTotals().bytes_in_use_by_app;
+      return true;
+    }
+    if (name == "generic.heap_size") {
+      const StatsTotals totals = GetStatsTotals();
+      *value = StatSub(totals.system_bytes, totals.unmapped_bytes);
+      return true;
+    }
+    if (name == "generic.physical_memory_used") {
+      *value = GetStatsTotals().physical_memory_used;
+      return true;
+    }
+    if (name == "generic.virtual_memory_used") {
+      *value = GetStatsTotals().virtual_memory_used;
+      return true;
+    }
+  }
+
   if (name == "generic.virtual_memory_used") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = VirtualMemoryUsed(stats);
     return true;
   }
 
   if (name == "generic.physical_memory_used") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = PhysicalMemoryUsed(stats);
     return true;
   }
 
   if (name == "generic.current_allocated_bytes" ||
       name == "generic.bytes_in_use_by_app") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = InUseByApp(stats);
     return true;
   }
 
   if (name == "generic.peak_memory_usage") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = static_cast<uint64_t>(stats.peak_stats.sampled_application_bytes);
     return true;
   }
 
   if (name == "generic.realized_fragmentation") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = static_cast<uint64_t>(
         100. * safe_div(stats.peak_stats.backed_bytes -
                             stats.peak_stats.sampled_application_bytes,
@@ -832,22 +1460,30 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
   }
 
   if (name == "tcmalloc.central_cache_free") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = stats.central_bytes;
     return true;
   }
 
   if (name == "tcmalloc.cpu_free") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = stats.per_cpu_bytes;
     return true;
   }
 
+  if (name == "tcmalloc.large_span_cache_free") {
+    const TCMallocStats& stats = shared.Get(false);
+    *value = stats.large_span_cache_bytes;
+    return true;
+  }
+
+  if (name == "tcmalloc.emergency_reserve_bytes") {
+    *value = EmergencyReserve::bytes();
+    return true;
+  }
+
   if (name == "tcmalloc.sharded_transfer_cache_free") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = stats.sharded_transfer_bytes;
     return true;
   }
@@ -877,6 +1513,28 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
     return true;
   }
 
+  if (name == "tcmalloc.pageheap_lazily_released_bytes") {
+    PageHeapSpinLockHolder l;
+    *value = LazilyReleasedBytes(
+        tc_globals.page_allocator().stats().unmapped_bytes);
+    return true;
+  }
+
+  if (name == "tcmalloc.thread_magazine_hits") {
+    *value = ThreadMagazine::hits();
+    return true;
+  }
+
+  if (name == "tcmalloc.thread_magazine_refills") {
+    *value = ThreadMagazine::refills();
+    return true;
+  }
+
+  if (name == "tcmalloc.thread_magazine_flushes") {
+    *value = ThreadMagazine::flushes();
+    return true;
+  }
+
   if (name == "tcmalloc.sampled_internal_fragmentation") {
     *value = tc_globals.sampled_internal_fragmentation_.value();
     return true;
@@ -896,43 +1554,37 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
 
   if (name == "tcmalloc.current_total_thread_cache_bytes" ||
       name == "tcmalloc.thread_cache_free") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = stats.thread_bytes;
     return true;
   }
 
   if (name == "tcmalloc.thread_cache_count") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = stats.tc_stats.in_use;
     return true;
   }
 
   if (name == "tcmalloc.local_bytes") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = LocalBytes(stats);
     return true;
   }
 
   if (name == "tcmalloc.external_fragmentation_bytes") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = ExternalBytes(stats);
     return true;
   }
 
   if (name == "tcmalloc.metadata_bytes") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, true);
+    const TCMallocStats& stats = shared.Get(true);
     *value = stats.metadata_bytes;
     return true;
   }
 
   if (name == "tcmalloc.transfer_cache_free") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = stats.transfer_bytes;
     return true;
   }
@@ -985,12 +1637,37 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
   }
 
   if (name == "tcmalloc.required_bytes") {
-    TCMallocStats stats;
-    ExtractTCMallocStats(&stats, false);
+    const TCMallocStats& stats = shared.Get(false);
     *value = RequiredBytes(stats);
     return true;
   }
 
+  const absl::string_view kLabelBytesPrefix = "tcmalloc.sampled_label_bytes.";
+  if (absl::StartsWith(name, kLabelBytesPrefix)) {
+    int label;
+    if (absl::SimpleAtoi(absl::StripPrefix(name, kLabelBytesPrefix), &label) &&
+        label >= 0 && label < MallocExtension::kNumAllocationLabels) {
+      // Samples are added and removed concurrently, so a label can briefly
+      // read negative.
+      *value = std::max<int64_t>(
+          tc_globals.sampled_label_bytes_[label].value(), 0);
+      return true;
+    }
+  }
+
+  if (absl::StartsWith(name, kExperimentCounterPrefix)) {
+    const absl::string_view counter =
+        absl::StripPrefix(name, kExperimentCounterPrefix);
+    bool found = false;
+    WalkExperimentCounters([&](absl::string_view name, uint64_t counter_value) {
+      if (name == counter) {
+        *value = counter_value;
+        found = true;
+      }
+    });
+    return found;
+  }
+
   const absl::string_view kExperimentPrefix = "tcmalloc.experiment.";
   if (absl::StartsWith(name, kExperimentPrefix)) {
     std::optional<Experiment> exp =
@@ -1005,6 +1682,27 @@ bool GetNumericProperty(const char* name_data, size_t name_size,
   return false;
 }
 
+void GetNumericProperties(const absl::string_view* names, size_t count,
+                          std::optional<size_t>* values) {
+  SharedTCMallocStats shared;
+  // Extracting the stats with residence also serves the properties that do
+  // not need it, so do so up front if any does.
+  for (size_t i = 0; i < count; ++i) {
+    if (names[i] == "tcmalloc.metadata_bytes") {
+      shared.Get(true);
+      break;
+    }
+  }
+  for (size_t i = 0; i < count; ++i) {
+    size_t value;
+    if (GetNumericProperty(names[i].data(), names[i].size(), &value, shared)) {
+      values[i] = value;
+    } else {
+      values[i] = std::nullopt;
+    }
+  }
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -17,13 +17,20 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <optional>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/arena.h"
+#include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/page_heap_allocator.h"
 #include "tcmalloc/pages.h"
+#include "tcmalloc/stack_trace_store.h"
 #include "tcmalloc/stats.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -38,11 +45,16 @@ struct TCMallocStats {
   uint64_t metadata_bytes;             // Bytes alloced for metadata
   uint64_t sharded_transfer_bytes;     // Bytes in per-CCX cache
   uint64_t per_cpu_bytes;              // Bytes in per-CPU cache
+  uint64_t large_span_cache_bytes;     // Bytes in LargeSpanCache
+  uint64_t emergency_reserve_bytes;    // Bytes in EmergencyReserve
   uint64_t pagemap_root_bytes_res;     // Resident bytes of pagemap root node
   uint64_t percpu_metadata_bytes_res;  // Resident bytes of the per-CPU metadata
   AllocatorStats tc_stats;             // ThreadCache objects
+  uint64_t tc_idle_reclaims;           // Idle ThreadCaches reclaimed
+  uint64_t tc_idle_flushes;            // Idle ThreadCaches flushed
   AllocatorStats span_stats;           // Span objects
-  AllocatorStats stack_stats;          // StackTrace objects
+  AllocatorStats stack_stats;          // SampledAllocation objects
+  StackTraceStore::Stats stored_stack_stats;  // StoredStack objects
   AllocatorStats linked_sample_stats;  // StackTraceTable::LinkedSample objects
   size_t pagemap_bytes;                // included in metadata bytes
   size_t percpu_metadata_bytes;        // included in metadata bytes
@@ -75,10 +87,63 @@ size_t SlackBytes(const BackingStats& stats);
 
 // WRITE stats to "out"
 void DumpStats(Printer* out, int level);
-void DumpStatsInPbtxt(Printer* out, int level);
+void DumpStatsInPbtxt(Printer* out, int level,
+                      PbtxtEncoding encoding = PbtxtEncoding::kText);
 
 bool GetNumericProperty(const char* name_data, size_t name_size, size_t* value);
 
+// Extracts TCMallocStats when first needed, for the properties of one batch to
+// share.
+class SharedTCMallocStats {
+ public:
+  const TCMallocStats& Get(bool report_residence);
+
+ private:
+  TCMallocStats stats_;
+  bool extracted_ = false;
+  bool report_residence_ = false;
+};
+
+// Looks up the property like the above, taking the TCMallocStats it is
+// computed from, if any, from `shared`.
+bool GetNumericProperty(const char* name_data, size_t name_size, size_t* value,
+                        SharedTCMallocStats& shared);
+
+// Sets values[i] to the value of property names[i], or nullopt if it is not
+// valid, extracting the stats they share once.
+void GetNumericProperties(const absl::string_view* names, size_t count,
+                          std::optional<size_t>* values);
+
+// Copies the stats kept under pageheap_lock into atomics, for
+// ExtractStatsSnapshot to read without it.
+void MirrorLockedStats() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+// Fills `snapshot`, from the mirrored stats for those kept under
+// pageheap_lock.  With `exact`, mirrors them first.
+void ExtractStatsSnapshot(MallocExtension::StatsSnapshot* snapshot,
+                          bool exact);
+
+// The totals behind mallinfo and the main generic.* properties.
+struct StatsTotals {
+  uint64_t system_bytes;         // Bytes of the page heap
+  uint64_t free_bytes;           // Of those, free
+  uint64_t unmapped_bytes;       // Of those, released to the OS
+  uint64_t cache_bytes;          // Bytes in thread, central, transfer caches
+  uint64_t bytes_in_use_by_app;  // InUseByApp
+  uint64_t physical_memory_used;
+  uint64_t virtual_memory_used;
+};
+
+// Returns the totals of freshly extracted stats.  With
+// Parameters::cached_stats_max_age_ms() set, returns those of an earlier call
+// instead while they are no older than that, without taking pageheap_lock or
+// walking the caches.
+StatsTotals GetStatsTotals();
+
+// Replaces *ret with the memory of each MemoryTag in use.
+void GetMemoryUsageByTag(std::vector<MallocExtension::MemoryTagUsage>* ret)
+    ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -35,6 +35,7 @@
 #include "tcmalloc/internal/exponential_biased.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
@@ -54,6 +55,13 @@ void GuardedPageAllocator::Init(size_t max_alloced_pages, size_t total_pages) {
   TC_CHECK_LE(total_pages, kGpaMaxPages);
   max_alloced_pages_ = max_alloced_pages;
   total_pages_ = total_pages;
+  shard_pages_ = (total_pages + kShards - 1) / kShards;
+  for (size_t i = 0; i < kShards; ++i) {
+    const size_t begin = std::min(i * shard_pages_, total_pages);
+    const size_t end = std::min(begin + shard_pages_, total_pages);
+    AllocationGuardSpinLockHolder h(&shards_[i].lock);
+    shards_[i].num_free_pages = end - begin;
+  }
 
   // If the system page size is larger than kPageSize, we need to use the
   // system page size for this allocator since mprotect operates on full pages
@@ -67,12 +75,12 @@ void GuardedPageAllocator::Init(size_t max_alloced_pages, size_t total_pages) {
 
 void GuardedPageAllocator::Destroy() {
   AllocationGuardSpinLockHolder h(&guarded_page_lock_);
-  if (initialized_) {
+  if (initialized_.load(std::memory_order_relaxed)) {
     size_t len = pages_end_addr_ - pages_base_addr_;
     int err = munmap(reinterpret_cast<void*>(pages_base_addr_), len);
     TC_ASSERT_NE(err, -1);
     (void)err;
-    initialized_ = false;
+    initialized_.store(false, std::memory_order_relaxed);
   }
 }
 
@@ -102,6 +110,8 @@ GuardedAllocWithStatus GuardedPageAllocator::TrySample(
   const int64_t profile_sampling_rate =
       tcmalloc::tcmalloc_internal::Parameters::profile_sampling_rate();
   // If guarded_sampling_rate == 0, then attempt to guard, as usual.
+  bool new_stack = false;
+  bool boosted = false;
   if (guarded_sampling_rate > 0) {
     const double target_ratio =
         profile_sampling_rate > 0
@@ -109,11 +119,20 @@ GuardedAllocWithStatus GuardedPageAllocator::TrySample(
             : 1.0;
     const double current_ratio = 1.0 * tc_globals.total_sampled_count_.value() /
                                  (std::max(SuccessfulAllocations(), 1UL));
+    const size_t count = stacktrace_filter_.Count(stack_trace);
+    new_stack = count == 0;
     if (current_ratio <= target_ratio) {
-      return {nullptr, Profile::Sample::GuardedStatus::RateLimited};
+      // With adaptive sampling, stacks that were never guarded may be guarded
+      // up to kNewStackBoost times as often as the rate allows, which still
+      // bounds the number of guarded allocations.
+      if (!new_stack || !Parameters::adaptive_guarded_sampling() ||
+          current_ratio * kNewStackBoost <= target_ratio) {
+        return {nullptr, Profile::Sample::GuardedStatus::RateLimited};
+      }
+      boosted = true;
     }
 
-    switch (stacktrace_filter_.Count(stack_trace)) {
+    switch (count) {
       case 0:
         // Fall through to allocation below.
         break;
@@ -149,6 +168,8 @@ GuardedAllocWithStatus GuardedPageAllocator::TrySample(
   auto alloc_with_status = Allocate(size, alignment);
   if (alloc_with_status.status == Profile::Sample::GuardedStatus::Guarded) {
     stacktrace_filter_.Add(stack_trace);
+    if (new_stack) num_new_stack_allocations_.LossyAdd(1);
+    if (boosted) num_boosted_allocations_.LossyAdd(1);
   }
   return alloc_with_status;
 }
@@ -170,10 +191,11 @@ GuardedAllocWithStatus GuardedPageAllocator::Allocate(size_t size,
   void* result = reinterpret_cast<void*>(SlotToAddr(free_slot));
   if (mprotect(result, page_size_, PROT_READ | PROT_WRITE) == -1) {
     TC_ASSERT(false && "mprotect failed");
-    AllocationGuardSpinLockHolder h(&guarded_page_lock_);
+    Shard& shard = ShardOf(free_slot);
+    AllocationGuardSpinLockHolder h(&shard.lock);
     num_failed_allocations_.LossyAdd(1);
     num_successful_allocations_.LossyAdd(-1);
-    FreeSlot(free_slot);
+    FreeSlot(shard, free_slot);
     return {nullptr, Profile::Sample::GuardedStatus::MProtectFailed};
   }
 
@@ -183,13 +205,11 @@ GuardedAllocWithStatus GuardedPageAllocator::Allocate(size_t size,
   // Record stack trace.
   SlotMetadata& d = data_[free_slot];
   // Count the number of pages that have been used at least once.
-  if (d.allocation_start == 0) {
-    AllocationGuardSpinLockHolder h(&guarded_page_lock_);
-    ++total_pages_used_;
-    if (total_pages_used_ == total_pages_) {
-      alloced_page_count_when_all_used_once_ =
-          num_successful_allocations_.value();
-    }
+  if (d.allocation_start == 0 &&
+      total_pages_used_.fetch_add(1, std::memory_order_relaxed) + 1 ==
+          total_pages_) {
+    alloced_page_count_when_all_used_once_.store(
+        num_successful_allocations_.value(), std::memory_order_relaxed);
   }
   d.dealloc_trace.depth = 0;
   d.alloc_trace.depth = absl::GetStackTrace(d.alloc_trace.stack, kMaxStackDepth,
@@ -206,10 +226,11 @@ void GuardedPageAllocator::Deallocate(void* ptr) {
   TC_ASSERT(PointerIsMine(ptr));
   const uintptr_t page_addr = GetPageAddr(reinterpret_cast<uintptr_t>(ptr));
   size_t slot = AddrToSlot(page_addr);
+  Shard& shard = ShardOf(slot);
 
   {
-    AllocationGuardSpinLockHolder h(&guarded_page_lock_);
-    if (IsFreed(slot)) {
+    AllocationGuardSpinLockHolder h(&shard.lock);
+    if (IsFreed(shard, slot)) {
       double_free_detected_ = true;
     } else if (WriteOverflowOccurred(slot)) {
       write_overflow_detected_ = true;
@@ -225,13 +246,13 @@ void GuardedPageAllocator::Deallocate(void* ptr) {
   }
 
   // Record stack trace.
-  AllocationGuardSpinLockHolder h(&guarded_page_lock_);
+  AllocationGuardSpinLockHolder h(&shard.lock);
   GuardedAllocationsStackTrace& trace = data_[slot].dealloc_trace;
   trace.depth = absl::GetStackTrace(trace.stack, kMaxStackDepth,
                                     /*skip_count=*/2);
   trace.thread_id = absl::base_internal::GetTID();
 
-  FreeSlot(slot);
+  FreeSlot(shard, slot);
 }
 
 size_t GuardedPageAllocator::GetRequestedSize(const void* ptr) const {
@@ -273,7 +294,8 @@ static int GetChainedRate() {
 }
 
 void GuardedPageAllocator::Print(Printer* out) {
-  AllocationGuardSpinLockHolder h(&guarded_page_lock_);
+  const size_t num_alloced_pages =
+      num_alloced_pages_.load(std::memory_order_relaxed);
   out->printf(
       "\n"
       "------------------------------------------------\n"
@@ -288,33 +310,45 @@ void GuardedPageAllocator::Print(Printer* out) {
       "StackTraceFilter Replacement Inserts: %zu\n"
       "Total Slots Used Once: %zu / %zu\n"
       "Allocation Count When All Slots Used Once: %zu\n"
+      "Allocations Of Never Guarded Stacks: %zu\n"
+      "Allocations Above Guarded Rate: %zu\n"
       "PARAMETER tcmalloc_guarded_sample_parameter %d\n",
       num_successful_allocations_.value(), num_failed_allocations_.value(),
-      num_alloced_pages_, total_pages_ - num_alloced_pages_,
-      num_alloced_pages_max_, max_alloced_pages_,
-      stacktrace_filter_.max_slots_used(),
-      stacktrace_filter_.replacement_inserts(), total_pages_used_, total_pages_,
-      alloced_page_count_when_all_used_once_, GetChainedRate());
+      num_alloced_pages, total_pages_ - num_alloced_pages,
+      num_alloced_pages_max_.load(std::memory_order_relaxed),
+      max_alloced_pages_, stacktrace_filter_.max_slots_used(),
+      stacktrace_filter_.replacement_inserts(),
+      total_pages_used_.load(std::memory_order_relaxed), total_pages_,
+      alloced_page_count_when_all_used_once_.load(std::memory_order_relaxed),
+      num_new_stack_allocations_.value(), num_boosted_allocations_.value(),
+      GetChainedRate());
 }
 
 void GuardedPageAllocator::PrintInPbtxt(PbtxtRegion* gwp_asan) {
-  AllocationGuardSpinLockHolder h(&guarded_page_lock_);
+  const size_t num_alloced_pages =
+      num_alloced_pages_.load(std::memory_order_relaxed);
   gwp_asan->PrintI64("successful_allocations",
                      num_successful_allocations_.value());
   gwp_asan->PrintI64("failed_allocations", num_failed_allocations_.value());
-  gwp_asan->PrintI64("current_slots_allocated", num_alloced_pages_);
+  gwp_asan->PrintI64("current_slots_allocated", num_alloced_pages);
   gwp_asan->PrintI64("current_slots_quarantined",
-                     total_pages_ - num_alloced_pages_);
-  gwp_asan->PrintI64("max_slots_allocated", num_alloced_pages_max_);
+                     total_pages_ - num_alloced_pages);
+  gwp_asan->PrintI64("max_slots_allocated",
+                     num_alloced_pages_max_.load(std::memory_order_relaxed));
   gwp_asan->PrintI64("allocated_slot_limit", max_alloced_pages_);
   gwp_asan->PrintI64("stack_trace_filter_max_slots_used",
                      stacktrace_filter_.max_slots_used());
   gwp_asan->PrintI64("stack_trace_filter_replacement_inserts",
                      stacktrace_filter_.replacement_inserts());
-  gwp_asan->PrintI64("total_pages_used", total_pages_used_);
+  gwp_asan->PrintI64("total_pages_used",
+                     total_pages_used_.load(std::memory_order_relaxed));
   gwp_asan->PrintI64("total_pages", total_pages_);
-  gwp_asan->PrintI64("alloced_page_count_when_all_used_once",
-                     alloced_page_count_when_all_used_once_);
+  gwp_asan->PrintI64(
+      "alloced_page_count_when_all_used_once",
+      alloced_page_count_when_all_used_once_.load(std::memory_order_relaxed));
+  gwp_asan->PrintI64("new_stack_allocations",
+                     num_new_stack_allocations_.value());
+  gwp_asan->PrintI64("boosted_allocations", num_boosted_allocations_.value());
   gwp_asan->PrintI64("tcmalloc_guarded_sample_parameter", GetChainedRate());
 }
 
@@ -351,26 +385,51 @@ void GuardedPageAllocator::MapPages() {
   // Align first page to page_size_.
   first_page_addr_ = GetPageAddr(pages_base_addr_ + page_size_);
 
-  initialized_ = true;
+  initialized_.store(true, std::memory_order_release);
 }
 
-// Selects a random slot in O(total_pages_) time.
+// Selects a random free slot of a shard, scanning its bitmap a word at a time.
 ssize_t GuardedPageAllocator::ReserveFreeSlot() {
-  AllocationGuardSpinLockHolder h(&guarded_page_lock_);
-  if (!initialized_ || !allow_allocations_) return -1;
-  if (num_alloced_pages_ == max_alloced_pages_) {
-    num_failed_allocations_.LossyAdd(1);
+  if (!initialized_.load(std::memory_order_acquire) ||
+      !allow_allocations_.load(std::memory_order_acquire)) {
     return -1;
   }
+  size_t alloced = num_alloced_pages_.load(std::memory_order_relaxed);
+  do {
+    if (alloced >= max_alloced_pages_) {
+      num_failed_allocations_.LossyAdd(1);
+      return -1;
+    }
+  } while (!num_alloced_pages_.compare_exchange_weak(
+      alloced, alloced + 1, std::memory_order_relaxed));
   num_successful_allocations_.LossyAdd(1);
+  size_t max = num_alloced_pages_max_.load(std::memory_order_relaxed);
+  while (alloced + 1 > max &&
+         !num_alloced_pages_max_.compare_exchange_weak(
+             max, alloced + 1, std::memory_order_relaxed)) {
+  }
 
-  size_t num_free_pages = total_pages_ - num_alloced_pages_;
-  size_t slot = GetIthFreeSlot(Rand(num_free_pages));
-  TC_ASSERT(!used_pages_.GetBit(slot));
-  used_pages_.SetBit(slot);
-  num_alloced_pages_++;
-  num_alloced_pages_max_ = std::max(num_alloced_pages_, num_alloced_pages_max_);
-  return slot;
+  // Having reserved against max_alloced_pages_ <= total_pages_, some shard has
+  // a free slot, though frees may move it while we look.
+  const int cpu = subtle::percpu::GetRealCpuUnsafe();
+  const size_t first = cpu >= 0 ? cpu : Rand(kShards);
+  for (size_t i = 0;; ++i) {
+    const size_t index = (first + i) % kShards;
+    Shard& shard = shards_[index];
+    AllocationGuardSpinLockHolder h(&shard.lock);
+    if (shard.num_free_pages == 0) continue;
+
+    const size_t begin = index * shard_pages_;
+    const size_t pages = std::min(shard_pages_, total_pages_ - begin);
+    size_t offset = shard.used_pages.FindClear(Rand(pages));
+    if (offset >= pages) {
+      offset = shard.used_pages.FindClear(0);
+    }
+    TC_ASSERT_LT(offset, pages);
+    shard.used_pages.SetBit(offset);
+    --shard.num_free_pages;
+    return begin + offset;
+  }
 }
 
 size_t GuardedPageAllocator::Rand(size_t max) {
@@ -379,21 +438,12 @@ size_t GuardedPageAllocator::Rand(size_t max) {
   return ExponentialBiased::GetRandom(x) % max;
 }
 
-size_t GuardedPageAllocator::GetIthFreeSlot(size_t ith_free_slot) {
-  TC_ASSERT_LT(ith_free_slot, total_pages_ - num_alloced_pages_);
-  for (size_t free_slot_count = 0, j = 0;; j++) {
-    if (!used_pages_.GetBit(j)) {
-      if (free_slot_count == ith_free_slot) return j;
-      free_slot_count++;
-    }
-  }
-}
-
-void GuardedPageAllocator::FreeSlot(size_t slot) {
+void GuardedPageAllocator::FreeSlot(Shard& shard, size_t slot) {
   TC_ASSERT_LT(slot, total_pages_);
-  TC_ASSERT(used_pages_.GetBit(slot));
-  used_pages_.ClearBit(slot);
-  num_alloced_pages_--;
+  TC_ASSERT(shard.used_pages.GetBit(slot % shard_pages_));
+  shard.used_pages.ClearBit(slot % shard_pages_);
+  ++shard.num_free_pages;
+  num_alloced_pages_.fetch_sub(1, std::memory_order_relaxed);
 }
 
 uintptr_t GuardedPageAllocator::GetPageAddr(uintptr_t addr) const {
@@ -423,8 +473,8 @@ size_t GuardedPageAllocator::GetNearestSlot(uintptr_t addr) const {
   return AddrToSlot(GetPageAddr(GetNearestValidPage(addr)));
 }
 
-bool GuardedPageAllocator::IsFreed(size_t slot) const {
-  return !used_pages_.GetBit(slot);
+bool GuardedPageAllocator::IsFreed(const Shard& shard, size_t slot) const {
+  return !shard.used_pages.GetBit(slot % shard_pages_);
 }
 
 bool GuardedPageAllocator::WriteOverflowOccurred(size_t slot) const {
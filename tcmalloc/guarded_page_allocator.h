@@ -15,6 +15,7 @@
 #ifndef TCMALLOC_GUARDED_PAGE_ALLOCATOR_H_
 #define TCMALLOC_GUARDED_PAGE_ALLOCATOR_H_
 
+#include <array>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
@@ -23,6 +24,7 @@
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/guarded_allocations.h"
@@ -46,7 +48,9 @@ namespace tcmalloc_internal {
 //
 // Is safe to use with static storage duration and is thread safe with the
 // exception of calls to Init() and Destroy() (see corresponding function
-// comments).
+// comments).  The slots are split into shards, each with a lock and free slot
+// bitmap of its own, which threads start from according to their CPU, so that
+// concurrent guarded allocations rarely contend.
 //
 // Example:
 //   ABSL_CONST_INIT GuardedPageAllocator gpa;
@@ -72,6 +76,9 @@ class GuardedPageAllocator {
  public:
   // Maximum number of pages this class can allocate.
   static constexpr size_t kGpaMaxPages = 512;
+  // Number of shards the slots are split into.
+  static constexpr size_t kShards = 8;
+  static_assert(kGpaMaxPages % kShards == 0);
 
   constexpr GuardedPageAllocator()
       : guarded_page_lock_(absl::kConstInit,
@@ -84,6 +91,7 @@ class GuardedPageAllocator {
         first_page_addr_(0),
         max_alloced_pages_(0),
         total_pages_(0),
+        shard_pages_(0),
         total_pages_used_(0),
         alloced_page_count_when_all_used_once_(0),
         page_size_(0),
@@ -137,12 +145,11 @@ class GuardedPageAllocator {
   //
   // Precondition:  size and alignment <= page_size_
   // Precondition:  alignment is 0 or a power of 2
-  GuardedAllocWithStatus Allocate(size_t size, size_t alignment)
-      ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+  GuardedAllocWithStatus Allocate(size_t size, size_t alignment);
 
   // Deallocates memory pointed to by ptr.  ptr must have been previously
   // returned by a call to Allocate.
-  void Deallocate(void* ptr) ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+  void Deallocate(void* ptr);
 
   // Returns the size requested when ptr was allocated.  ptr must have been
   // previously returned by a call to Allocate.
@@ -167,9 +174,8 @@ class GuardedPageAllocator {
 
   // Writes a human-readable summary of GuardedPageAllocator's internal state to
   // *out.
-  void Print(Printer* out) ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
-  void PrintInPbtxt(PbtxtRegion* gwp_asan)
-      ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+  void Print(Printer* out);
+  void PrintInPbtxt(PbtxtRegion* gwp_asan);
 
   // Returns true if ptr points to memory managed by this class.
   inline bool ABSL_ATTRIBUTE_ALWAYS_INLINE
@@ -179,20 +185,23 @@ class GuardedPageAllocator {
   }
 
   // Allows Allocate() to start returning allocations.
-  void AllowAllocations() ABSL_LOCKS_EXCLUDED(guarded_page_lock_) {
-    AllocationGuardSpinLockHolder h(&guarded_page_lock_);
-    allow_allocations_ = true;
+  void AllowAllocations() {
+    allow_allocations_.store(true, std::memory_order_release);
   }
 
   // Returns the number of pages available for allocation, based on how many are
   // currently in use.  (Should only be used in testing.)
-  size_t GetNumAvailablePages() ABSL_LOCKS_EXCLUDED(guarded_page_lock_) {
-    AllocationGuardSpinLockHolder h(&guarded_page_lock_);
-    return max_alloced_pages_ - num_alloced_pages_;
+  size_t GetNumAvailablePages() const {
+    return max_alloced_pages_ -
+           num_alloced_pages_.load(std::memory_order_relaxed);
   }
 
   size_t SuccessfulAllocations() { return num_successful_allocations_.value(); }
 
+  // Returns the number of allocations guarded beyond the guarded sampling rate
+  // by adaptive_guarded_sampling.
+  size_t BoostedAllocations() { return num_boosted_allocations_.value(); }
+
   // Resets sampling state.
   void Reset();
 
@@ -207,6 +216,22 @@ class GuardedPageAllocator {
     uintptr_t allocation_start = 0;
   };
 
+  // A shard of contiguous slots, with the lock that protects them.
+  struct ABSL_CACHELINE_ALIGNED Shard {
+    absl::base_internal::SpinLock lock{
+        absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+    // Maps each bool to one slot of the shard.
+    // true: reserved. false: freed.
+    Bitmap<kGpaMaxPages / kShards> used_pages ABSL_GUARDED_BY(lock);
+    // Number of free slots in the shard.
+    size_t num_free_pages ABSL_GUARDED_BY(lock) = 0;
+  };
+
+  // With adaptive_guarded_sampling, allocations from stacks that were never
+  // guarded may be guarded up to this many times as often as the guarded
+  // sampling rate allows.
+  static constexpr double kNewStackBoost = 4;
+
   // Max number of magic bytes we use to detect write-overflows at deallocation.
   static constexpr size_t kMagicSize = 32;
 
@@ -214,18 +239,17 @@ class GuardedPageAllocator {
   void MapPages() ABSL_LOCKS_EXCLUDED(guarded_page_lock_)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
-  // Reserves and returns a slot randomly selected from the free slots in
-  // used_pages_.  Returns -1 if no slots available, or if AllowAllocations()
-  // hasn't been called yet.
-  ssize_t ReserveFreeSlot() ABSL_LOCKS_EXCLUDED(guarded_page_lock_);
+  // Reserves and returns a slot randomly selected from the free slots of the
+  // first shard with any, starting from the calling CPU's.  Returns -1 if no
+  // slots available, or if AllowAllocations() hasn't been called yet.
+  ssize_t ReserveFreeSlot();
 
-  // Returns the i-th free slot of used_pages_.  i must be in the range [0,
-  // total_pages_ - num_alloced_pages_).
-  size_t GetIthFreeSlot(size_t i)
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(guarded_page_lock_);
+  // Returns the shard that slot belongs to.
+  Shard& ShardOf(size_t slot) { return shards_[slot / shard_pages_]; }
 
   // Marks the specified slot as unreserved.
-  void FreeSlot(size_t slot) ABSL_EXCLUSIVE_LOCKS_REQUIRED(guarded_page_lock_);
+  void FreeSlot(Shard& shard, size_t slot)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.lock);
 
   // Returns the address of the page that addr resides on.
   uintptr_t GetPageAddr(uintptr_t addr) const;
@@ -237,8 +261,8 @@ class GuardedPageAllocator {
   size_t GetNearestSlot(uintptr_t addr) const;
 
   // Returns true if the specified slot has already been freed.
-  bool IsFreed(size_t slot) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(guarded_page_lock_);
+  bool IsFreed(const Shard& shard, size_t slot) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.lock);
 
   // Returns true if magic bytes for slot were overwritten.
   bool WriteOverflowOccurred(size_t slot) const;
@@ -270,17 +294,17 @@ class GuardedPageAllocator {
 
   StackTraceFilter stacktrace_filter_;
 
+  // Serializes mapping and unmapping the pages.
   absl::base_internal::SpinLock guarded_page_lock_;
 
-  // Maps each bool to one page.
-  // true: reserved. false: freed.
-  Bitmap<kGpaMaxPages> used_pages_ ABSL_GUARDED_BY(guarded_page_lock_);
+  std::array<Shard, kShards> shards_;
 
-  // Number of currently-allocated pages.
-  size_t num_alloced_pages_ ABSL_GUARDED_BY(guarded_page_lock_);
+  // Number of currently-allocated pages.  Slots are reserved against
+  // max_alloced_pages_ here before a shard is picked.
+  std::atomic<size_t> num_alloced_pages_;
 
   // The high-water mark for num_alloced_pages_.
-  size_t num_alloced_pages_max_ ABSL_GUARDED_BY(guarded_page_lock_);
+  std::atomic<size_t> num_alloced_pages_max_;
 
   // Number of successful allocations (calls to Allocate - failed).
   tcmalloc_internal::StatsCounter num_successful_allocations_;
@@ -288,6 +312,12 @@ class GuardedPageAllocator {
   // Number of times Allocate has failed.
   tcmalloc_internal::StatsCounter num_failed_allocations_;
 
+  // Number of successful allocations from stacks the StackTraceFilter had not
+  // seen guarded, and of those guarded beyond the guarded sampling rate, as
+  // adaptive_guarded_sampling allows.
+  tcmalloc_internal::StatsCounter num_new_stack_allocations_;
+  tcmalloc_internal::StatsCounter num_boosted_allocations_;
+
   // A dynamically-allocated array of stack trace data captured when each page
   // is allocated/deallocated.  Printed by the SEGV handler when a memory error
   // is detected.
@@ -298,20 +328,20 @@ class GuardedPageAllocator {
   uintptr_t first_page_addr_;  // Points to first page returnable by Allocate.
   size_t max_alloced_pages_;   // Max number of pages to allocate at once.
   size_t total_pages_;         // Size of the page pool to allocate from.
+  size_t shard_pages_;         // Number of slots in each shard.
   // Number of pages allocated at least once from page pool.
-  size_t total_pages_used_ ABSL_GUARDED_BY(guarded_page_lock_);
+  std::atomic<size_t> total_pages_used_;
   // The count of allocs when all the pages had been used at least once (i.e.
   // when total_pages_used_ == total_pages_).
-  size_t alloced_page_count_when_all_used_once_
-      ABSL_GUARDED_BY(guarded_page_lock_);
+  std::atomic<size_t> alloced_page_count_when_all_used_once_;
   size_t page_size_;           // Size of pages we allocate.
   std::atomic<uint64_t> rand_;  // RNG seed.
 
   // True if this object has been fully initialized.
-  bool initialized_ ABSL_GUARDED_BY(guarded_page_lock_);
+  std::atomic<bool> initialized_;
 
   // Flag to control whether we can return allocations or not.
-  bool allow_allocations_ ABSL_GUARDED_BY(guarded_page_lock_);
+  std::atomic<bool> allow_allocations_;
 
   // Set to true if a double free has occurred.
   bool double_free_detected_;
@@ -328,6 +328,31 @@ TEST_F(GuardedPageAllocatorProfileTest, FilteredWithRateLimiting) {
   ExamineSamples(profile, Profile::Sample::GuardedStatus::Filtered);
 }
 
+TEST_F(GuardedPageAllocatorProfileTest, AdaptiveSamplingBoostsNewStacks) {
+  ScopedGuardedSamplingRate scoped_guarded_sampling_rate(
+      2 * tcmalloc::tcmalloc_internal::Parameters::profile_sampling_rate());
+  const bool adaptive = Parameters::adaptive_guarded_sampling();
+  Parameters::set_adaptive_guarded_sampling(true);
+  AllocateUntilGuarded();
+
+  // Forgetting each guarded stack keeps the allocation's stack new, so it may
+  // be guarded beyond the rate.
+  const size_t boosted = Static::guardedpage_allocator().BoostedAllocations();
+  int sampled_count = 0;
+  AllocateGuardableUntil(1064, [&](void* alloc) -> NextSteps {
+    if (!IsNormalMemory(alloc)) {
+      if (Static::guardedpage_allocator().PointerIsMine(alloc)) {
+        ResetStackTraceFilter();
+      }
+      ++sampled_count;
+    }
+    return {sampled_count > 1000, true};
+  });
+  EXPECT_GT(Static::guardedpage_allocator().BoostedAllocations(), boosted);
+
+  Parameters::set_adaptive_guarded_sampling(adaptive);
+}
+
 TEST_F(GuardedPageAllocatorProfileTest, DynamicParamChange) {
   ScopedGuardedSamplingRate scoped_guarded_sampling_rate(
       2 * tcmalloc::tcmalloc_internal::Parameters::profile_sampling_rate());
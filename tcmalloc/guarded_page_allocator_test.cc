@@ -168,6 +168,34 @@ TEST_P(GuardedPageAllocatorParamTest, AllocDeallocAllPages) {
 INSTANTIATE_TEST_SUITE_P(VaryNumPages, GuardedPageAllocatorParamTest,
                          testing::Values(1, kMaxGpaPages / 2, kMaxGpaPages));
 
+// Test that every page of a pool smaller than the number of shards, some of
+// which are then left empty, can be allocated.
+TEST(GuardedPageAllocatorSmallPoolTest, AllocAllPages) {
+  constexpr size_t kPages = GuardedPageAllocator::kShards - 3;
+  GuardedPageAllocator gpa;
+  {
+    PageHeapSpinLockHolder l;
+    gpa.Init(kPages, kPages);
+  }
+  gpa.AllowAllocations();
+
+  absl::flat_hash_set<void*> allocations;
+  for (size_t i = 0; i < kPages; i++) {
+    auto alloc_with_status = gpa.Allocate(1, 0);
+    ASSERT_EQ(alloc_with_status.status,
+              Profile::Sample::GuardedStatus::Guarded);
+    EXPECT_TRUE(allocations.insert(alloc_with_status.alloc).second);
+  }
+  EXPECT_EQ(gpa.GetNumAvailablePages(), 0);
+  EXPECT_EQ(gpa.Allocate(1, 0).status,
+            Profile::Sample::GuardedStatus::NoAvailableSlots);
+  for (void* ptr : allocations) {
+    gpa.Deallocate(ptr);
+  }
+  EXPECT_EQ(gpa.GetNumAvailablePages(), kPages);
+  gpa.Destroy();
+}
+
 TEST_F(GuardedPageAllocatorTest, PointerIsMine) {
   auto alloc_with_status = gpa_.Allocate(1, 0);
   EXPECT_EQ(alloc_with_status.status, Profile::Sample::GuardedStatus::Guarded);
@@ -28,6 +28,11 @@ namespace tcmalloc_internal {
 
 // This class wraps an array of N TrackerLists and a Bitmap storing which
 // elements are non-empty.
+//
+// Searches only read the size and the bitmap, which are kept together ahead
+// of the (much larger) array of list heads, so that a search of empty lists,
+// as HugePageFiller::TryGet does when falling back to less preferred lists,
+// touches a single cache line.
 template <class TrackerType, size_t N>
 class HintedTrackerLists {
  public:
@@ -39,6 +44,9 @@ class HintedTrackerLists {
   // least n and returns it. Returns nullptr if there is none.
   TrackerType* GetLeast(const size_t n) {
     TC_ASSERT_LT(n, N);
+    if (size_ == 0) {
+      return nullptr;
+    }
     size_t i = nonempty_.FindSet(n);
     if (i == N) {
       return nullptr;
@@ -59,6 +67,9 @@ class HintedTrackerLists {
   // found.
   TrackerType* PeekLeast(const size_t n) {
     TC_ASSERT_LT(n, N);
+    if (size_ == 0) {
+      return nullptr;
+    }
     size_t i = nonempty_.FindSet(n);
     if (i == N) {
       return nullptr;
@@ -67,6 +78,29 @@ class HintedTrackerLists {
     return lists_[i].first();
   }
 
+  // Returns the TrackerType that PeekLeast(n) would return once the one it
+  // returns now is removed, or nullptr if there is none.
+  TrackerType* PeekSecondLeast(const size_t n) const {
+    TC_ASSERT_LT(n, N);
+    if (size_ == 0) {
+      return nullptr;
+    }
+    size_t i = nonempty_.FindSet(n);
+    if (i == N) {
+      return nullptr;
+    }
+    auto it = lists_[i].begin();
+    ++it;
+    if (it != lists_[i].end()) {
+      return *it;
+    }
+    if (++i == N) {
+      return nullptr;
+    }
+    i = nonempty_.FindSet(i);
+    return i == N ? nullptr : lists_[i].first();
+  }
+
   // Adds pointer <pt> to the nonempty_[i] list.
   // REQUIRES: i < N && pt != nullptr.
   void Add(TrackerType* pt, const size_t i) {
@@ -105,6 +139,9 @@ class HintedTrackerLists {
   // This quirk is inherited from TrackerList.
   template <typename Functor>
   void Iter(const Functor& func, size_t start) const {
+    if (size_ == 0) {
+      return;
+    }
     size_t i = nonempty_.FindSet(start);
     while (i < N) {
       auto& list = lists_[i];
@@ -118,9 +155,9 @@ class HintedTrackerLists {
   }
 
  private:
-  TrackerList lists_[N];
   size_t size_;
   Bitmap<N> nonempty_;
+  TrackerList lists_[N];
 };
 
 }  // namespace tcmalloc_internal
@@ -50,6 +50,7 @@ class HugeAddressMap {
     // Tree structure
     Node* left();
     Node* right();
+    Node* parent();
     // Iterate to the next node in address order
     const Node* next() const;
     Node* next();
@@ -134,6 +135,9 @@ inline constexpr HugeAddressMap::HugeAddressMap(MetadataAllocator& meta)
 inline HugeRange HugeAddressMap::Node::range() const { return range_; }
 inline HugeAddressMap::Node* HugeAddressMap::Node::left() { return left_; }
 inline HugeAddressMap::Node* HugeAddressMap::Node::right() { return right_; }
+inline HugeAddressMap::Node* HugeAddressMap::Node::parent() {
+  return parent_;
+}
 
 inline int64_t HugeAddressMap::Node::when() const { return when_; }
 inline HugeLength HugeAddressMap::Node::longest() const { return longest_; }
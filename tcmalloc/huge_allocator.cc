@@ -14,8 +14,11 @@
 
 #include "tcmalloc/huge_allocator.h"
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "absl/numeric/bits.h"
 #include "tcmalloc/huge_address_map.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
@@ -33,15 +36,107 @@ void HugeAllocator::Print(Printer* out) {
       "HugeAllocator: %zu requested - %zu in use = %zu hugepages free\n",
       from_system_.raw_num(), in_use_.raw_num(),
       (from_system_ - in_use_).raw_num());
+  out->printf("HugeAllocator: %zu hugepages handed out untouched\n",
+              zeroed_.raw_num());
+  out->printf(
+      "HugeAllocator: %zu free ranges, largest %zu hugepages; "
+      "%.1f%% fragmented over %zu system allocations (%s fit)\n",
+      free_ranges(), largest_free_range().raw_num(), 100 * fragmentation(),
+      system_allocations_,
+      fit_ == HugeAllocatorFit::kBestFit ? "best" : "approximate");
 }
 
 void HugeAllocator::PrintInPbtxt(PbtxtRegion* hpaa) const {
   free_.PrintInPbtxt(hpaa);
   hpaa->PrintI64("num_total_requested_huge_pages", from_system_.raw_num());
   hpaa->PrintI64("num_in_use_huge_pages", in_use_.raw_num());
+  hpaa->PrintI64("num_zeroed_huge_pages", zeroed_.raw_num());
+  hpaa->PrintI64("num_free_ranges", free_ranges());
+  hpaa->PrintI64("num_system_allocations", system_allocations_);
+  hpaa->PrintDouble("free_address_space_fragmentation", fragmentation());
+  hpaa->PrintBool("best_fit", fit_ == HugeAllocatorFit::kBestFit);
+}
+
+HugeLength HugeAllocator::largest_free_range() const {
+  const HugeAddressMap::Node* root = free_.root();
+  return root != nullptr ? root->longest() : NHugePages(0);
+}
+
+double HugeAllocator::fragmentation() const {
+  const HugeLength free = free_.total_mapped();
+  if (free == NHugePages(0)) {
+    return 0;
+  }
+  return 1 - static_cast<double>(largest_free_range().raw_num()) /
+                 free.raw_num();
 }
 
 HugeAddressMap::Node* HugeAllocator::Find(HugeLength n) {
+  return fit_ == HugeAllocatorFit::kBestFit ? FindBestFit(n)
+                                            : FindApproximate(n);
+}
+
+HugeAddressMap::Node* HugeAllocator::FindBestFit(HugeLength n) {
+  // Walk the subtrees that hold a range of at least n in address order, so
+  // that the first of several equally good ranges is the lowest addressed.
+  // The walk ends at the first exact fit, which can't be bettered.
+  HugeAddressMap::Node* best = nullptr;
+  HugeAddressMap::Node* curr = free_.root();
+  if (curr == nullptr || curr->longest() < n) {
+    return nullptr;
+  }
+  // Descend to the lowest addressed range that's large enough...
+  auto descend = [n](HugeAddressMap::Node* node) {
+    while (true) {
+      HugeAddressMap::Node* left = node->left();
+      if (left != nullptr && left->longest() >= n) {
+        node = left;
+      } else if (node->range().len() >= n) {
+        return node;
+      } else {
+        // longest() >= n, so the right subtree must hold the range.
+        node = node->right();
+      }
+    }
+  };
+  // ...and then step to the next one, skipping subtrees too small to matter.
+  auto successor = [&descend, n](HugeAddressMap::Node* node)
+      -> HugeAddressMap::Node* {
+    HugeAddressMap::Node* right = node->right();
+    if (right != nullptr && right->longest() >= n) {
+      return descend(right);
+    }
+    // Climb until we arrive from a left child; that ancestor and its right
+    // subtree come next in address order.
+    while (true) {
+      HugeAddressMap::Node* parent = node->parent();
+      if (parent == nullptr) {
+        return nullptr;
+      }
+      if (parent->left() == node) {
+        if (parent->range().len() >= n) {
+          return parent;
+        }
+        HugeAddressMap::Node* next = parent->right();
+        if (next != nullptr && next->longest() >= n) {
+          return descend(next);
+        }
+      }
+      node = parent;
+    }
+  };
+  for (curr = descend(curr); curr != nullptr; curr = successor(curr)) {
+    if (best == nullptr || curr->range().len() < best->range().len()) {
+      best = curr;
+      if (best->range().len() == n) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+HugeAddressMap::Node* HugeAllocator::FindApproximate(HugeLength n) {
   HugeAddressMap::Node* curr = free_.root();
   // invariant: curr != nullptr && curr->longest >= n
   // we favor smaller gaps and lower nodes and lower addresses, in that
@@ -114,18 +209,21 @@ HugeRange HugeAllocator::AllocateRange(HugeLength n) {
   TC_CHECK_EQ(actual % kHugePageSize, 0);
   n = HLFromBytes(actual);
   from_system_ += n;
+  ++system_allocations_;
   return HugeRange::Make(HugePageContaining(ptr), n);
 }
 
-HugeRange HugeAllocator::Get(HugeLength n) {
+HugeRange HugeAllocator::Get(HugeLength n, bool* zeroed) {
   TC_CHECK_GT(n, NHugePages(0));
+  *zeroed = false;
+  HugeRange fresh = HugeRange::Nil();
   auto* node = Find(n);
   if (!node) {
     // Get more memory, then "delete" it
-    HugeRange r = AllocateRange(n);
-    if (!r.valid()) return r;
-    in_use_ += r.len();
-    Release(r);
+    fresh = AllocateRange(n);
+    if (!fresh.valid()) return fresh;
+    in_use_ += fresh.len();
+    Release(fresh);
     node = Find(n);
     TC_CHECK_NE(node, nullptr);
   }
@@ -146,9 +244,43 @@ HugeRange HugeAllocator::Get(HugeLength n) {
     DebugCheckFreelist();
   }
 
+  // The fresh range may have coalesced with free neighbors; only the part
+  // that came straight from the system is known to be zero.
+  if (fresh.valid() && fresh.contains(r)) {
+    *zeroed = true;
+    zeroed_ += n;
+  }
   return r;
 }
 
+HugeRange HugeAllocator::GetAligned(HugeLength n, HugeLength align,
+                                    bool* zeroed) {
+  TC_ASSERT(absl::has_single_bit(align.raw_num()));
+  if (align <= NHugePages(1)) {
+    return Get(n, zeroed);
+  }
+  // Any range of n + align - 1 hugepages holds an aligned one of n.
+  const HugeLength padded = n + align - NHugePages(1);
+  if (padded.overflows()) return HugeRange::Nil();
+  const HugeRange r = Get(padded, zeroed);
+  if (!r.valid()) return r;
+
+  const size_t mask = align.raw_num() - 1;
+  const HugePage start = {(r.start().index() + mask) & ~mask};
+  const HugeLength before = start - r.start();
+  const HugeLength after = padded - n - before;
+  if (*zeroed) {
+    zeroed_ -= padded - n;
+  }
+  if (before > NHugePages(0)) {
+    Release(HugeRange::Make(r.start(), before));
+  }
+  if (after > NHugePages(0)) {
+    Release(HugeRange::Make(start + n, after));
+  }
+  return HugeRange::Make(start, n);
+}
+
 void HugeAllocator::Release(HugeRange r) {
   in_use_ -= r.len();
 
@@ -168,6 +300,87 @@ void HugeAllocator::AddSpanStats(SmallSpanStats* small,
   }
 }
 
+HugeRange GiganticPageAllocator::Get(HugeLength n) {
+  HugeRange r = free_.Get(n);
+  if (!r.valid()) {
+    ++failures_;
+  }
+  return r;
+}
+
+void GiganticPageAllocator::Release(HugeRange r) {
+  TC_ASSERT(Contains(r.start()));
+  free_.Release(r);
+}
+
+bool GiganticPageAllocator::Contains(HugePage p) const {
+  for (size_t i = 0; i < num_ranges_; ++i) {
+    if (ranges_[i].contains(p)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+AddressRange GiganticPageAllocator::AllocateRange(size_t bytes) {
+  if (failed_ || num_ranges_ == kMaxRanges) {
+    return {nullptr, 0};
+  }
+  const size_t rounded =
+      (bytes + kGiganticPageSize - 1) & ~(kGiganticPageSize - 1);
+  if (rounded < bytes) {
+    return {nullptr, 0};
+  }
+  auto [ptr, actual] = allocate_(rounded, kGiganticPageSize);
+  if (ptr == nullptr) {
+    // The pool is exhausted or absent.  It is provisioned ahead of time, so
+    // there is no point in asking again.
+    failed_ = true;
+    return {nullptr, 0};
+  }
+  TC_CHECK_EQ(reinterpret_cast<uintptr_t>(ptr) % kGiganticPageSize, 0);
+  TC_CHECK_GE(actual, rounded);
+  actual = rounded;
+  ranges_[num_ranges_++] =
+      HugeRange::Make(HugePageContaining(ptr), HLFromBytes(actual));
+  return {ptr, actual};
+}
+
+void GiganticPageAllocator::AddSpanStats(SmallSpanStats* small,
+                                         LargeSpanStats* large) const {
+  if (large == nullptr) {
+    return;
+  }
+  // free_ reports its ranges as returned, but ours are backed.
+  LargeSpanStats free;
+  free_.AddSpanStats(nullptr, &free);
+  large->spans += free.spans;
+  large->normal_pages += free.returned_pages;
+}
+
+void GiganticPageAllocator::Print(Printer* out) const {
+  if (system() == NHugePages(0) && failures_ == 0) {
+    return;
+  }
+  out->printf(
+      "GiganticPageAllocator: %zu ranges, %zu hugepages backed by 1GiB pages "
+      "- %zu in use = %zu free\n",
+      num_ranges_, system().raw_num(), (system() - size()).raw_num(),
+      size().raw_num());
+  out->printf(
+      "GiganticPageAllocator: %zu allocations fell back to 2MiB pages%s\n",
+      failures_, failed_ ? " (no more 1GiB pages available)" : "");
+}
+
+void GiganticPageAllocator::PrintInPbtxt(PbtxtRegion* hpaa) const {
+  auto gigantic = hpaa->CreateSubRegion("gigantic_page_allocator");
+  gigantic.PrintI64("num_ranges", num_ranges_);
+  gigantic.PrintI64("num_total_huge_pages", system().raw_num());
+  gigantic.PrintI64("num_free_huge_pages", size().raw_num());
+  gigantic.PrintI64("num_fallbacks", failures_);
+  gigantic.PrintBool("exhausted", failed_);
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
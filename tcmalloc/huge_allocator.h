@@ -48,6 +48,18 @@ class VirtualAllocator {
                                                        size_t align) = 0;
 };
 
+// How HugeAllocator picks the free range a request is carved from.
+enum class HugeAllocatorFit {
+  // Descends the tree along one path, preferring smaller ranges: cheap, but
+  // neither a best-fit nor a lowest-address allocator.
+  kApproximate,
+  // Searches every range that fits for the smallest one, taking the lowest
+  // addressed among equals.  Large ranges stay whole, and allocations pack
+  // towards low addresses, so that the free ranges left between them are
+  // more likely to be adjacent and coalesce when released.
+  kBestFit,
+};
+
 // This tracks available ranges of hugepages and fulfills requests for
 // usable memory, allocating more from the system as needed.  All
 // hugepages are treated as (and assumed to be) unbacked.
@@ -55,12 +67,26 @@ class HugeAllocator {
  public:
   constexpr HugeAllocator(
       VirtualAllocator& allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
-      MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND)
-      : free_(meta_allocate), allocate_(allocate) {}
+      MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
+      HugeAllocatorFit fit = HugeAllocatorFit::kApproximate)
+      : free_(meta_allocate), allocate_(allocate), fit_(fit) {}
 
   // Obtain a range of n unbacked hugepages, distinct from all other
   // calls to Get (other than those that have been Released.)
-  HugeRange Get(HugeLength n);
+  HugeRange Get(HugeLength n) {
+    bool zeroed;
+    return Get(n, &zeroed);
+  }
+  // As above, but sets *zeroed to true if the range has never been handed
+  // out before, so that it still holds the zeroes the system gave us.
+  // Released ranges may have been only lazily freed and are never reported
+  // as zeroed.
+  HugeRange Get(HugeLength n, bool* zeroed);
+
+  // As above, but the range starts at a multiple of <align> hugepages, a
+  // power of two.  The hugepages before and after it in the range it is
+  // carved from stay free, so alignment only costs address space.
+  HugeRange GetAligned(HugeLength n, HugeLength align, bool* zeroed);
 
   // Returns a range of hugepages for reuse by subsequent Gets().
   // REQUIRES: <r> is the return value (or a subrange thereof) of a previous
@@ -72,6 +98,17 @@ class HugeAllocator {
   HugeLength system() const { return from_system_; }
   // Unused memory in the allocator.
   HugeLength size() const { return from_system_ - in_use_; }
+  // Memory handed out while still known to be zero.
+  HugeLength zeroed() const { return zeroed_; }
+  // The number of times we requested more address space from the system.
+  size_t system_allocations() const { return system_allocations_; }
+
+  // How fragmented the free address space is: the fraction of free memory
+  // outside the largest free range, from 0 when it is all one range (or
+  // there is none) towards 1 when it is scattered over many small ranges.
+  double fragmentation() const;
+  HugeLength largest_free_range() const;
+  size_t free_ranges() const { return free_.nranges(); }
 
   void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
 
@@ -101,6 +138,8 @@ class HugeAllocator {
   // requirements.
   HugeAddressMap free_;
   HugeAddressMap::Node* Find(HugeLength n);
+  HugeAddressMap::Node* FindApproximate(HugeLength n);
+  HugeAddressMap::Node* FindBestFit(HugeLength n);
 
   void CheckFreelist();
   void DebugCheckFreelist() {
@@ -111,11 +150,96 @@ class HugeAllocator {
 
   HugeLength from_system_{NHugePages(0)};
   HugeLength in_use_{NHugePages(0)};
+  HugeLength zeroed_{NHugePages(0)};
+  size_t system_allocations_{0};
 
   VirtualAllocator& allocate_;
+  HugeAllocatorFit fit_;
   HugeRange AllocateRange(HugeLength n);
 };
 
+// Serves very large, long-lived allocations from memory backed by 1GiB
+// (gigantic) hugetlb pages, each of which covers as much memory with one TLB
+// entry as 512 2MiB hugepages.
+//
+// hugetlb memory can't be subreleased and the kernel's pool of gigantic pages
+// is provisioned ahead of time, so none of this memory is ever returned to
+// the OS: freed ranges stay backed and are reused by later calls to Get.
+class GiganticPageAllocator {
+ public:
+  // Size and alignment of the ranges obtained from the system.
+  static constexpr size_t kGiganticPageSize = size_t{1} << 30;
+  // Upper bound on how many ranges we obtain, so that Contains stays cheap.
+  static constexpr size_t kMaxRanges = 256;
+
+  // allocate returns ranges backed by gigantic pages, or nothing if the
+  // system can't provide them.
+  GiganticPageAllocator(
+      VirtualAllocator& allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
+      MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND)
+      : source_(*this), free_(source_, meta_allocate), allocate_(allocate) {}
+
+  // Obtains a range of n backed hugepages, or an invalid range if we have too
+  // little free and can't get more, in which case the caller should fall back
+  // to ordinary hugepages.  Once the system fails to provide gigantic pages,
+  // we stop asking.
+  HugeRange Get(HugeLength n);
+
+  // Returns a range previously obtained from Get for reuse.
+  void Release(HugeRange r);
+
+  // Whether p was obtained from this allocator.
+  bool Contains(HugePage p) const;
+
+  HugeLength system() const { return free_.system(); }
+  HugeLength size() const { return free_.size(); }
+  // The number of Gets that returned an invalid range.
+  size_t failures() const { return failures_; }
+
+  // Free memory here is backed, unlike HugeAllocator's.
+  BackingStats stats() const {
+    BackingStats s;
+    s.system_bytes = system().in_bytes();
+    s.free_bytes = size().in_bytes();
+    s.unmapped_bytes = 0;
+    return s;
+  }
+
+  void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
+
+  void Print(Printer* out) const;
+  void PrintInPbtxt(PbtxtRegion* hpaa) const;
+
+ private:
+  // Rounds requests from free_ to whole gigantic pages and records the ranges
+  // obtained.
+  class Source final : public VirtualAllocator {
+   public:
+    explicit Source(
+        GiganticPageAllocator& gigantic ABSL_ATTRIBUTE_LIFETIME_BOUND)
+        : gigantic_(gigantic) {}
+
+    ABSL_MUST_USE_RESULT AddressRange operator()(size_t bytes,
+                                                 size_t align) override {
+      return gigantic_.AllocateRange(bytes);
+    }
+
+   private:
+    GiganticPageAllocator& gigantic_;
+  };
+
+  AddressRange AllocateRange(size_t bytes);
+
+  Source source_;
+  HugeAllocator free_;
+  VirtualAllocator& allocate_;
+
+  bool failed_ = false;
+  size_t failures_ = 0;
+  size_t num_ranges_ = 0;
+  HugeRange ranges_[kMaxRanges];
+};
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
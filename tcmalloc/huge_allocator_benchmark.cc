@@ -0,0 +1,91 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Churns a live set of large allocations through HugeAllocator under each
+// fit policy, timing Get and Release, and reports how much address space the
+// churn leaves reserved and how fragmented its free part is.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/huge_allocator.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/mock_metadata_allocator.h"
+#include "tcmalloc/mock_virtual_allocator.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Keeps range(1) allocations of between 1 and range(2) hugepages live,
+// replacing a random one each iteration, with the fit policy of range(0).
+void BM_churn(benchmark::State& state) {
+  const HugeAllocatorFit fit = state.range(0) ? HugeAllocatorFit::kBestFit
+                                              : HugeAllocatorFit::kApproximate;
+  const size_t live_allocs = state.range(1);
+  const int32_t max_len = state.range(2);
+
+  FakeVirtualAllocator vm_allocator;
+  // As in huge_allocator_test, keep clear of the zero page.
+  vm_allocator.backing_.resize(1024);
+  FakeMetadataAllocator metadata_allocator;
+  HugeAllocator allocator(vm_allocator, metadata_allocator, fit);
+
+  absl::BitGen rng(std::seed_seq{0});
+  auto random_len = [&]() {
+    return NHugePages(absl::LogUniform<int32_t>(rng, 1, max_len));
+  };
+  std::vector<HugeRange> live;
+  HugeLength live_len = NHugePages(0);
+  for (size_t i = 0; i < live_allocs; ++i) {
+    live.push_back(allocator.Get(random_len()));
+    live_len += live.back().len();
+  }
+
+  for (auto s : state) {
+    const size_t index = absl::Uniform<size_t>(rng, 0, live.size());
+    live_len -= live[index].len();
+    allocator.Release(live[index]);
+    live[index] = allocator.Get(random_len());
+    if (!live[index].valid()) {
+      state.SkipWithError("out of fake address space");
+      break;
+    }
+    live_len += live[index].len();
+  }
+
+  state.counters["reserved_per_live"] =
+      static_cast<double>(allocator.system().raw_num()) / live_len.raw_num();
+  state.counters["fragmentation"] = allocator.fragmentation();
+  state.counters["free_ranges"] = allocator.free_ranges();
+  state.counters["system_allocations"] = allocator.system_allocations();
+
+  for (HugeRange r : live) {
+    if (r.valid()) {
+      allocator.Release(r);
+    }
+  }
+}
+BENCHMARK(BM_churn)
+    ->ArgNames({"best_fit", "live", "max_len"})
+    ->ArgsProduct({{0, 1}, {64, 1024}, {16, 1024}});
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -134,6 +134,30 @@ TEST_P(HugeAllocatorTest, Basic) {
   }
 }
 
+TEST_P(HugeAllocatorTest, Zeroed) {
+  bool zeroed;
+  const HugeRange r1 = allocator_.Get(NHugePages(4), &zeroed);
+  ASSERT_TRUE(r1.valid());
+  EXPECT_TRUE(zeroed);
+  EXPECT_EQ(allocator_.zeroed(), NHugePages(4));
+
+  // Released memory might not have been cleared by the system.
+  allocator_.Release(r1);
+  const HugeRange r2 = allocator_.Get(NHugePages(4), &zeroed);
+  ASSERT_TRUE(r2.valid());
+  EXPECT_FALSE(zeroed);
+
+  // Nor is memory that straddles released and fresh ranges.
+  allocator_.Release(r2);
+  const HugeRange r3 =
+      allocator_.Get(allocator_.size() + NHugePages(1), &zeroed);
+  ASSERT_TRUE(r3.valid());
+  EXPECT_EQ(zeroed, !r3.intersects(r1));
+  EXPECT_EQ(allocator_.zeroed(), NHugePages(4) + (zeroed ? r3.len()
+                                                         : NHugePages(0)));
+  allocator_.Release(r3);
+}
+
 // Check that releasing small chunks of allocations works OK.
 TEST_P(HugeAllocatorTest, Subrelease) {
   size_t label = 1;
@@ -343,6 +367,75 @@ TEST_P(HugeAllocatorTest, Stats) {
   EXPECT_EQ(NHugePages(8).in_pages(), pages);
 }
 
+TEST_P(HugeAllocatorTest, BestFit) {
+  HugeAllocator allocator(vm_allocator_, metadata_allocator_,
+                          HugeAllocatorFit::kBestFit);
+  const HugeRange r = allocator.Get(NHugePages(16));
+  ASSERT_TRUE(r.valid());
+  const HugePage p = r.start();
+  // Free ranges of 4, 2, 3 and 2 hugepages, separated by ones in use.
+  const HugeRange a = {p, NHugePages(4)};
+  const HugeRange b = {p + NHugePages(5), NHugePages(2)};
+  const HugeRange c = {p + NHugePages(8), NHugePages(3)};
+  const HugeRange d = {p + NHugePages(12), NHugePages(2)};
+  for (HugeRange f : {d, c, b, a}) {
+    allocator.Release(f);
+  }
+  // An overallocating system leaves one more range, of a single hugepage.
+  const HugeLength extra = allocator.size() - NHugePages(11);
+  EXPECT_EQ(allocator.free_ranges(), extra > NHugePages(0) ? 5 : 4);
+  EXPECT_EQ(allocator.largest_free_range(), NHugePages(4));
+  EXPECT_DOUBLE_EQ(allocator.fragmentation(),
+                   1 - 4.0 / allocator.size().raw_num());
+
+  // The smallest range that fits is used, the lowest addressed of equals.
+  EXPECT_EQ(allocator.Get(NHugePages(2)), b);
+  EXPECT_EQ(allocator.Get(NHugePages(2)), d);
+  EXPECT_EQ(allocator.Get(NHugePages(3)), c);
+  EXPECT_EQ(allocator.Get(NHugePages(4)), a);
+  EXPECT_EQ(allocator.size(), extra);
+  EXPECT_EQ(allocator.fragmentation(), 0);
+  EXPECT_EQ(allocator.system_allocations(), 1);
+}
+
+TEST_P(HugeAllocatorTest, Aligned) {
+  // Knock the free space off any alignment first.
+  const HugeRange odd = allocator_.Get(NHugePages(1));
+  ASSERT_TRUE(odd.valid());
+  MarkPages(odd, 1);
+  HugeLength total = odd.len();
+
+  std::vector<std::pair<HugeRange, size_t>> allocs;
+  size_t label = 2;
+  for (size_t align : {1, 2, 8, 64}) {
+    for (size_t len : {1, 3, 64}) {
+      bool zeroed;
+      const HugeRange r =
+          allocator_.GetAligned(NHugePages(len), NHugePages(align), &zeroed);
+      ASSERT_TRUE(r.valid());
+      EXPECT_EQ(r.len(), NHugePages(len));
+      EXPECT_EQ(r.start().index() % align, 0) << align;
+      total += r.len();
+      // The padding around the range stays free.
+      CheckStats(total);
+      EXPECT_LE(allocator_.zeroed(), total);
+      MarkPages(r, label);
+      allocs.push_back({r, label});
+      label++;
+    }
+  }
+
+  CheckPages(odd, 1);
+  for (const auto& [r, c] : allocs) {
+    CheckPages(r, c);
+    allocator_.Release(r);
+    total -= r.len();
+    CheckStats(total);
+  }
+  allocator_.Release(odd);
+  CheckStats(NHugePages(0));
+}
+
 // Make sure we're well-behaved in the presence of OOM (and that we do
 // OOM at some point...)
 TEST_P(HugeAllocatorTest, OOM) {
@@ -358,6 +451,91 @@ INSTANTIATE_TEST_SUITE_P(
       return info.param ? "overallocates" : "normal";
     });
 
+// Hands out 1GiB-aligned address space without backing it.
+class FakeGiganticMemoryAllocator final : public VirtualAllocator {
+ public:
+  ABSL_MUST_USE_RESULT AddressRange operator()(size_t bytes,
+                                               size_t align) override {
+    TC_CHECK_EQ(align, GiganticPageAllocator::kGiganticPageSize);
+    TC_CHECK_EQ(bytes % align, 0);
+    ++calls;
+    if (!available) {
+      return {nullptr, 0};
+    }
+    void* ptr = reinterpret_cast<void*>(next);
+    next += bytes;
+    return {ptr, bytes};
+  }
+
+  bool available = true;
+  int calls = 0;
+  uintptr_t next = GiganticPageAllocator::kGiganticPageSize;
+};
+
+TEST(GiganticPageAllocatorTest, GetAndReuse) {
+  FakeGiganticMemoryAllocator vm_allocator;
+  FakeMetadataAllocator metadata_allocator;
+  GiganticPageAllocator allocator(vm_allocator, metadata_allocator);
+  const HugeLength kOneGiB =
+      HLFromBytes(GiganticPageAllocator::kGiganticPageSize);
+
+  // Requests are rounded up to whole gigantic pages.
+  HugeRange r1 = allocator.Get(kOneGiB + NHugePages(1));
+  ASSERT_TRUE(r1.valid());
+  EXPECT_EQ(r1.len(), kOneGiB + NHugePages(1));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(r1.start_addr()) %
+                GiganticPageAllocator::kGiganticPageSize,
+            0);
+  EXPECT_EQ(allocator.system(), 2 * kOneGiB);
+  EXPECT_EQ(allocator.size(), kOneGiB - NHugePages(1));
+  EXPECT_TRUE(allocator.Contains(r1.start()));
+  EXPECT_TRUE(allocator.Contains(r1.start() + 2 * kOneGiB - NHugePages(1)));
+  EXPECT_FALSE(allocator.Contains(r1.start() + 2 * kOneGiB));
+
+  // Free memory is backed.
+  BackingStats stats = allocator.stats();
+  EXPECT_EQ(stats.system_bytes, 2 * GiganticPageAllocator::kGiganticPageSize);
+  EXPECT_EQ(stats.free_bytes, allocator.size().in_bytes());
+  EXPECT_EQ(stats.unmapped_bytes, 0);
+  LargeSpanStats large;
+  allocator.AddSpanStats(nullptr, &large);
+  EXPECT_EQ(large.spans, 1);
+  EXPECT_EQ(large.normal_pages, allocator.size().in_pages());
+  EXPECT_EQ(large.returned_pages, Length(0));
+
+  // Freed memory is reused rather than obtained again.
+  allocator.Release(r1);
+  EXPECT_EQ(allocator.size(), 2 * kOneGiB);
+  HugeRange r2 = allocator.Get(2 * kOneGiB);
+  ASSERT_TRUE(r2.valid());
+  EXPECT_EQ(vm_allocator.calls, 1);
+  allocator.Release(r2);
+}
+
+TEST(GiganticPageAllocatorTest, Unavailable) {
+  FakeGiganticMemoryAllocator vm_allocator;
+  FakeMetadataAllocator metadata_allocator;
+  GiganticPageAllocator allocator(vm_allocator, metadata_allocator);
+  const HugeLength kOneGiB =
+      HLFromBytes(GiganticPageAllocator::kGiganticPageSize);
+
+  HugeRange r = allocator.Get(kOneGiB);
+  ASSERT_TRUE(r.valid());
+
+  // Once the system fails us, we stop asking, but still serve what we have.
+  vm_allocator.available = false;
+  EXPECT_FALSE(allocator.Get(kOneGiB).valid());
+  vm_allocator.available = true;
+  EXPECT_FALSE(allocator.Get(kOneGiB).valid());
+  EXPECT_EQ(vm_allocator.calls, 2);
+  EXPECT_EQ(allocator.failures(), 2);
+
+  allocator.Release(r);
+  r = allocator.Get(kOneGiB);
+  EXPECT_TRUE(r.valid());
+  allocator.Release(r);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -104,12 +104,13 @@ template class MinMaxTracker<600>;
 
 // The logic for actually allocating from the cache or backing, and keeping
 // the hit rates specified.
-HugeRange HugeCache::DoGet(HugeLength n, bool* from_released) {
+HugeRange HugeCache::DoGet(HugeLength n, bool* from_released,
+                           bool* zeroed) {
   auto* node = Find(n);
   if (!node) {
     misses_++;
     weighted_misses_ += n.raw_num();
-    HugeRange res = allocator_->Get(n);
+    HugeRange res = allocator_->Get(n, zeroed);
     if (res.valid()) {
       *from_released = true;
     }
@@ -119,6 +120,7 @@ HugeRange HugeCache::DoGet(HugeLength n, bool* from_released) {
   hits_++;
   weighted_hits_ += n.raw_num();
   *from_released = false;
+  *zeroed = false;
   size_ -= n;
   UpdateSize(size());
   HugeRange result, leftover;
@@ -128,9 +130,26 @@ HugeRange HugeCache::DoGet(HugeLength n, bool* from_released) {
   if (leftover.valid()) {
     cache_.Insert(leftover);
   }
+  IncludeInCoreDump(result);
   return result;
 }
 
+void HugeCache::ExcludeFromCoreDump(HugeRange r) {
+  if (core_dump_.exclude == nullptr) return;
+  if (ABSL_PREDICT_FALSE(
+          !(*core_dump_.exclude)(r.start().first_page(), r.len().in_pages()))) {
+    ++core_dump_failures_;
+  }
+}
+
+void HugeCache::IncludeInCoreDump(HugeRange r) {
+  if (core_dump_.include == nullptr) return;
+  if (ABSL_PREDICT_FALSE(
+          !(*core_dump_.include)(r.start().first_page(), r.len().in_pages()))) {
+    ++core_dump_failures_;
+  }
+}
+
 void HugeCache::MaybeGrowCacheLimit(HugeLength missed) {
   // Our goal is to make the cache size = the largest "brief dip."
   //
@@ -181,6 +200,9 @@ void HugeCache::IncUsage(HugeLength n) {
   usage_ += n;
   usage_tracker_.Report(usage_);
   detailed_tracker_.Report(usage_);
+  if (demand_intervals_.enabled()) {
+    long_term_tracker_.Report(usage_);
+  }
   off_peak_tracker_.Report(NHugePages(0));
 }
 
@@ -188,6 +210,9 @@ void HugeCache::DecUsage(HugeLength n) {
   usage_ -= n;
   usage_tracker_.Report(usage_);
   detailed_tracker_.Report(usage_);
+  if (demand_intervals_.enabled()) {
+    long_term_tracker_.Report(usage_);
+  }
   const HugeLength max = usage_tracker_.MaxOverTime(cache_time_);
   TC_ASSERT_GE(max, usage_);
   const HugeLength off_peak = max - usage_;
@@ -196,10 +221,18 @@ void HugeCache::DecUsage(HugeLength n) {
 
 void HugeCache::UpdateSize(HugeLength size) {
   size_tracker_.Report(size);
+  if (budget_ != nullptr) {
+    if (size > published_) {
+      budget_->Add(size - published_);
+    } else {
+      budget_->Remove(published_ - size);
+    }
+    published_ = size;
+  }
 }
 
-HugeRange HugeCache::Get(HugeLength n, bool* from_released) {
-  HugeRange r = DoGet(n, from_released);
+HugeRange HugeCache::Get(HugeLength n, bool* from_released, bool* zeroed) {
+  HugeRange r = DoGet(n, from_released, zeroed);
   // failure to get a range should "never" "never" happen (VSS limits
   // or wildly incorrect allocation sizes only...) Don't deal with
   // this case for cache size accounting.
@@ -210,9 +243,24 @@ HugeRange HugeCache::Get(HugeLength n, bool* from_released) {
   return r;
 }
 
+HugeRange HugeCache::GetAligned(HugeLength n, HugeLength align,
+                                bool* from_released, bool* zeroed) {
+  misses_++;
+  weighted_misses_ += n.raw_num();
+  HugeRange r = allocator_->GetAligned(n, align, zeroed);
+  IncUsage(r.len());
+  if (r.valid()) {
+    *from_released = true;
+    MaybeGrowCacheLimit(n);
+  }
+  return r;
+}
+
 void HugeCache::Release(HugeRange r) {
   DecUsage(r.len());
 
+  // The whole range is advised at once, before it can be split up again.
+  ExcludeFromCoreDump(r);
   cache_.Insert(r);
   size_ += r.len();
   if (size_ <= limit()) {
@@ -227,9 +275,13 @@ void HugeCache::Release(HugeRange r) {
   if ((clock_.now() - last_limit_change_) > (cache_time_ticks_ * 2)) {
     total_fast_unbacked_ += MaybeShrinkCacheLimit();
   }
-  total_fast_unbacked_ += ShrinkCache(limit());
+  // Past the limit, only unback what the demand forecast says is surplus.
+  if (size_ > limit()) {
+    total_fast_unbacked_ += ShrinkCache(std::max(limit(), DemandForecast()));
+  }
 
   UpdateSize(size());
+  EnforceBudget();
 }
 
 void HugeCache::ReleaseUnbacked(HugeRange r) {
@@ -251,7 +303,33 @@ HugeLength HugeCache::MaybeShrinkCacheLimit() {
   HugeLength drop = std::max(min / 2, NHugePages(1));
   limit_ = std::max(limit() <= drop ? NHugePages(0) : limit() - drop,
                     MinCacheLimit());
-  return ShrinkCache(limit());
+  return ShrinkCache(std::max(limit(), DemandForecast()));
+}
+
+HugeLength HugeCache::DemandForecast() {
+  if (!demand_intervals_.enabled()) {
+    return NHugePages(0);
+  }
+
+  // Bring the trackers up to date, so that peaks age out even if usage hasn't
+  // changed lately.
+  detailed_tracker_.Report(usage_);
+  long_term_tracker_.Report(usage_);
+  HugeLength peak = usage_;
+  for (absl::Duration interval :
+       {demand_intervals_.short_interval, demand_intervals_.medium_interval,
+        demand_intervals_.long_interval}) {
+    if (interval <= absl::ZeroDuration()) {
+      continue;
+    }
+    peak = std::max(
+        peak, interval <= kDetailedHistory
+                  ? detailed_tracker_.MaxOverTime(interval)
+                  : long_term_tracker_.MaxOverTime(
+                        std::min(interval, long_term_history_)));
+  }
+  TC_ASSERT_GE(peak, usage_);
+  return peak - usage_;
 }
 
 HugeLength HugeCache::ShrinkCache(HugeLength target) {
@@ -287,6 +365,8 @@ HugeLength HugeCache::ShrinkCache(HugeLength target) {
       cache_.Insert(r);
       break;
     }
+    // The HugeAllocator hands r out again without passing through DoGet.
+    IncludeInCoreDump(r);
     allocator_->Release(r);
     removed += r.len();
   }
@@ -294,19 +374,40 @@ HugeLength HugeCache::ShrinkCache(HugeLength target) {
   return removed;
 }
 
-HugeLength HugeCache::ReleaseCachedPages(HugeLength n) {
+HugeLength HugeCache::ReleaseCachedPages(HugeLength n, bool hit_limit) {
   // This is a good time to check: is our cache going persistently unused?
   HugeLength released = MaybeShrinkCacheLimit();
 
   if (released < n) {
     n -= released;
-    const HugeLength target = n > size() ? NHugePages(0) : size() - n;
+    HugeLength target = n > size() ? NHugePages(0) : size() - n;
+    if (!hit_limit) {
+      target = std::max(target, DemandForecast());
+    }
     released += ShrinkCache(target);
   }
 
   UpdateSize(size());
   total_periodic_unbacked_ += released;
-  return released;
+  // Other processes may have grown their caches since, without this one
+  // releasing any.
+  return released + EnforceBudget();
+}
+
+HugeLength HugeCache::EnforceBudget() {
+  if (budget_ == nullptr) {
+    return NHugePages(0);
+  }
+  // The group's budget overrides both the limit and the demand forecast, as
+  // a memory limit does.
+  const HugeLength excess = budget_->Excess(size());
+  if (excess == NHugePages(0)) {
+    return excess;
+  }
+  const HugeLength removed = ShrinkCache(size() - excess);
+  UpdateSize(size());
+  total_budget_unbacked_ += removed;
+  return removed;
 }
 
 void HugeCache::AddSpanStats(SmallSpanStats* small,
@@ -392,7 +493,29 @@ void HugeCache::Print(Printer* out) {
   out->printf("HugeCache: %zu MiB fast unbacked, %zu MiB periodic\n",
               total_fast_unbacked_.in_bytes() / 1024 / 1024,
               total_periodic_unbacked_.in_bytes() / 1024 / 1024);
+  if (core_dump_.exclude != nullptr) {
+    out->printf(
+        "HugeCache: cached hugepages excluded from core dumps "
+        "(%zu failed madvise calls)\n",
+        core_dump_failures_);
+  }
+  if (demand_intervals_.enabled()) {
+    out->printf(
+        "HugeCache: demand forecast over %llds / %llds / %llds wants %zu "
+        "hugepages cached\n",
+        absl::ToInt64Seconds(demand_intervals_.short_interval),
+        absl::ToInt64Seconds(demand_intervals_.medium_interval),
+        absl::ToInt64Seconds(demand_intervals_.long_interval),
+        DemandForecast().raw_num());
+  }
   UpdateSize(size());
+  if (budget_ != nullptr) {
+    out->printf(
+        "HugeCache: %zu MiB cached by this process, %zu MiB by its group, of "
+        "a %zu MiB budget (%zu MiB unbacked for it)\n",
+        budget_->held().in_mib(), budget_->total().in_mib(),
+        budget_->budget().in_mib(), total_budget_unbacked_.in_mib());
+  }
 
   usage_tracker_.Report(usage_);
   const HugeLength usage_min = usage_tracker_.MinOverTime(cache_time_);
@@ -445,7 +568,27 @@ void HugeCache::PrintInPbtxt(PbtxtRegion* hpaa) {
   // bytes unbacked by periodic releaser thread
   hpaa->PrintI64("periodic_unbacked_bytes",
                  total_periodic_unbacked_.in_bytes());
+  if (core_dump_.exclude != nullptr) {
+    // failed attempts to exclude cached hugepages from core dumps or to
+    // include them again
+    hpaa->PrintI64("core_dump_advice_failures", core_dump_failures_);
+  }
+  if (demand_intervals_.enabled()) {
+    // bytes the demand forecast wants to keep cached
+    hpaa->PrintI64("demand_forecast_cached_bytes",
+                   DemandForecast().in_bytes());
+  }
   UpdateSize(size());
+  if (budget_ != nullptr) {
+    auto budget = hpaa->CreateSubRegion("huge_cache_budget");
+    // bytes cached by this process's caches, and by all processes sharing
+    // the budget
+    budget.PrintI64("process_cached_bytes", budget_->held().in_bytes());
+    budget.PrintI64("group_cached_bytes", budget_->total().in_bytes());
+    budget.PrintI64("budget_bytes", budget_->budget().in_bytes());
+    // bytes this cache unbacked to keep the group within the budget
+    budget.PrintI64("unbacked_bytes", total_budget_unbacked_.in_bytes());
+  }
 
   usage_tracker_.Report(usage_);
   const HugeLength usage_min = usage_tracker_.MinOverTime(cache_time_);
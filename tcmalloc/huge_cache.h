@@ -27,6 +27,7 @@
 #include "absl/time/time.h"
 #include "tcmalloc/huge_address_map.h"
 #include "tcmalloc/huge_allocator.h"
+#include "tcmalloc/huge_cache_budget.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
@@ -46,6 +47,21 @@ class MemoryModifyFunction {
   ABSL_MUST_USE_RESULT virtual bool operator()(PageId start, Length len) = 0;
 };
 
+// Whether hugepages held in the cache, which are backed but hold no live data,
+// are written to core dumps.
+enum class HugeCacheCoreDumpOption {
+  kDumpCached,
+  kExcludeCached,
+};
+
+// The functions HugeCache marks cached ranges with, one leaving them out of
+// core dumps and one putting them back before the range is handed out or
+// returned to the HugeAllocator.  Unset, ranges are left as they are.
+struct HugeCacheCoreDumpFunctions {
+  MemoryModifyFunction* exclude = nullptr;
+  MemoryModifyFunction* include = nullptr;
+};
+
 // Track the extreme values of a HugeLength value over the past
 // kWindow (time ranges approximate.)
 template <size_t kEpochs = 16>
@@ -98,16 +114,49 @@ extern template class MinMaxTracker<600>;
 template <size_t kEpochs>
 constexpr HugeLength MinMaxTracker<kEpochs>::kMaxVal;
 
+// Horizons over which HugeCache forecasts demand for backed hugepages, as
+// SkipSubreleaseIntervals does for the filler.  With any horizon set, the cache
+// keeps enough hugepages to cover the highest usage peak seen within each
+// horizon, so that it only unbacks hugepages that every horizon agrees are
+// surplus.  Horizons are ignored while we are over a memory limit.
+struct HugeCacheDemandIntervals {
+  absl::Duration short_interval;
+  absl::Duration medium_interval;
+  absl::Duration long_interval;
+
+  bool enabled() const {
+    return short_interval > absl::ZeroDuration() ||
+           medium_interval > absl::ZeroDuration() ||
+           long_interval > absl::ZeroDuration();
+  }
+
+  absl::Duration longest() const {
+    return std::max({short_interval, medium_interval, long_interval});
+  }
+};
+
+// The horizons used when the demand forecast is turned on: a short one that
+// rides out bursts, and longer ones that keep the cache through lulls in
+// periodic load.
+inline constexpr HugeCacheDemandIntervals kDefaultHugeCacheDemandIntervals = {
+    .short_interval = absl::Seconds(10),
+    .medium_interval = absl::Minutes(5),
+    .long_interval = absl::Hours(1)};
+
 class HugeCache {
  public:
   // For use in production
   HugeCache(HugeAllocator* allocator,
             MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
             MemoryModifyFunction& unback ABSL_ATTRIBUTE_LIFETIME_BOUND,
-            absl::Duration cache_time)
+            absl::Duration cache_time,
+            HugeCacheDemandIntervals demand_intervals = {},
+            HugeCacheCoreDumpFunctions core_dump = {},
+            HugeCacheBudget* budget = nullptr)
       : HugeCache(allocator, meta_allocate, unback, cache_time,
                   Clock{.now = absl::base_internal::CycleClock::Now,
-                        .freq = absl::base_internal::CycleClock::Frequency}) {}
+                        .freq = absl::base_internal::CycleClock::Frequency},
+                  demand_intervals, core_dump, budget) {}
 
   // For testing with mock clock.
   //
@@ -139,7 +188,10 @@ class HugeCache {
   HugeCache(HugeAllocator* allocator,
             MetadataAllocator& meta_allocate ABSL_ATTRIBUTE_LIFETIME_BOUND,
             MemoryModifyFunction& unback ABSL_ATTRIBUTE_LIFETIME_BOUND,
-            absl::Duration cache_time, Clock clock)
+            absl::Duration cache_time, Clock clock,
+            HugeCacheDemandIntervals demand_intervals = {},
+            HugeCacheCoreDumpFunctions core_dump = {},
+            HugeCacheBudget* budget = nullptr)
       : allocator_(allocator),
         cache_(meta_allocate),
         clock_(clock),
@@ -147,17 +199,35 @@ class HugeCache {
         nanoseconds_per_tick_(absl::ToInt64Nanoseconds(absl::Seconds(1)) /
                               clock_.freq()),
         last_limit_change_(clock.now()),
-        detailed_tracker_(clock, absl::Minutes(10)),
+        detailed_tracker_(clock, kDetailedHistory),
         usage_tracker_(clock, cache_time * 2),
         off_peak_tracker_(clock, cache_time * 2),
         size_tracker_(clock, cache_time * 2),
+        long_term_history_(
+            std::max(demand_intervals.longest(), kDetailedHistory)),
+        long_term_tracker_(clock, long_term_history_),
+        demand_intervals_(demand_intervals),
         unback_(unback),
+        core_dump_(core_dump),
+        budget_(budget != nullptr && budget->active() ? budget : nullptr),
         cache_time_(cache_time) {}
   // Allocate a usable set of <n> contiguous hugepages.  Try to give out
   // memory that's currently backed from the kernel if we have it available.
   // *from_released is set to false if the return range is already backed;
   // otherwise, it is set to true (and the caller should back it.)
-  HugeRange Get(HugeLength n, bool* from_released);
+  HugeRange Get(HugeLength n, bool* from_released) {
+    bool zeroed;
+    return Get(n, from_released, &zeroed);
+  }
+  // As above, but also sets *zeroed to true if the range has never been used
+  // and so still holds the zeroes the system gave us.
+  HugeRange Get(HugeLength n, bool* from_released, bool* zeroed);
+
+  // As above, but the range starts at a multiple of <align> hugepages.  The
+  // cache holds no such ranges, so this always goes to the allocator and
+  // *from_released is set to true on success.
+  HugeRange GetAligned(HugeLength n, HugeLength align, bool* from_released,
+                       bool* zeroed);
 
   // Deallocate <r> (assumed to be backed by the kernel.)
   void Release(HugeRange r);
@@ -165,8 +235,9 @@ class HugeCache {
   void ReleaseUnbacked(HugeRange r);
 
   // Release to the system up to <n> hugepages of cache contents; returns
-  // the number of hugepages released.
-  HugeLength ReleaseCachedPages(HugeLength n);
+  // the number of hugepages released.  Unless hit_limit is set, hugepages the
+  // demand forecast wants to keep are not released.
+  HugeLength ReleaseCachedPages(HugeLength n, bool hit_limit = false);
 
   // Backed memory available.
   HugeLength size() const { return size_; }
@@ -202,7 +273,21 @@ class HugeCache {
   // returning the number removed.
   HugeLength ShrinkCache(HugeLength target);
 
-  HugeRange DoGet(HugeLength n, bool* from_released);
+  // Unbacks this cache's share of what its group caches over budget_, once
+  // size_ has been published to it by UpdateSize, and returns the number of
+  // hugepages unbacked.
+  HugeLength EnforceBudget();
+
+  // Returns how many hugepages the demand forecast wants cached: the highest
+  // usage peak within any of demand_intervals_, less current usage.
+  HugeLength DemandForecast();
+
+  HugeRange DoGet(HugeLength n, bool* from_released, bool* zeroed);
+
+  // Apply core_dump_, if set, to r.  The advice is only a hint, so failures
+  // are counted rather than acted on.
+  void ExcludeFromCoreDump(HugeRange r);
+  void IncludeInCoreDump(HugeRange r);
 
   HugeAddressMap::Node* Find(HugeLength n);
 
@@ -238,16 +323,31 @@ class HugeCache {
 
   void UpdateSize(HugeLength size);
 
+  // Usage history kept at fine granularity.
+  static constexpr absl::Duration kDetailedHistory = absl::Minutes(10);
   MinMaxTracker<600> detailed_tracker_;
 
   MinMaxTracker<> usage_tracker_;
   MinMaxTracker<> off_peak_tracker_;
   MinMaxTracker<> size_tracker_;
 
+  // Coarse usage history for demand horizons beyond kDetailedHistory, only
+  // maintained if the demand forecast is enabled.
+  const absl::Duration long_term_history_;
+  MinMaxTracker<> long_term_tracker_;
+  const HugeCacheDemandIntervals demand_intervals_;
+
   HugeLength total_fast_unbacked_{NHugePages(0)};
   HugeLength total_periodic_unbacked_{NHugePages(0)};
+  HugeLength total_budget_unbacked_{NHugePages(0)};
 
   MemoryModifyFunction& unback_;
+  const HugeCacheCoreDumpFunctions core_dump_;
+  size_t core_dump_failures_{0};
+  // Shared with other processes, if set: size_ is published to it, and the
+  // cache unbacks its share of whatever the group holds over budget.
+  HugeCacheBudget* const budget_;
+  HugeLength published_{NHugePages(0)};
   absl::Duration cache_time_;
 };
 
@@ -0,0 +1,198 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/huge_cache_budget.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/call_once.h"
+#include "absl/strings/numbers.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/util.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+bool HugeCacheBudget::Init(int fd, HugeLength budget) {
+  TC_ASSERT(!active());
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  // Processes racing to size a new file size it alike, so neither loses what
+  // the other has written.
+  if (st.st_size < static_cast<off_t>(sizeof(Table)) &&
+      ftruncate(fd, sizeof(Table)) != 0) {
+    return false;
+  }
+  void* p = mmap(nullptr, sizeof(Table), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  Table* table = static_cast<Table*>(p);
+  uint64_t magic = 0;
+  if (!table->magic.compare_exchange_strong(magic, kMagic,
+                                            std::memory_order_relaxed) &&
+      magic != kMagic) {
+    munmap(p, sizeof(Table));
+    return false;
+  }
+
+  // Prefer a free slot, then one left by a process which has died.
+  const pid_t pid = getpid();
+  Slot* slot = nullptr;
+  for (Slot& s : table->slots) {
+    pid_t expected = 0;
+    if (s.pid.compare_exchange_strong(expected, pid,
+                                      std::memory_order_relaxed)) {
+      slot = &s;
+      break;
+    }
+  }
+  for (int i = 0; slot == nullptr && i < kMaxProcesses; ++i) {
+    Slot& s = table->slots[i];
+    pid_t expected = s.pid.load(std::memory_order_relaxed);
+    if (!Live(s) && s.pid.compare_exchange_strong(expected, pid,
+                                                  std::memory_order_relaxed)) {
+      slot = &s;
+    }
+  }
+  if (slot == nullptr) {
+    munmap(p, sizeof(Table));
+    return false;
+  }
+
+  slot->hugepages.store(0, std::memory_order_relaxed);
+  table->budget.store(budget.raw_num(), std::memory_order_relaxed);
+  table_ = table;
+  slot_ = slot;
+  return true;
+}
+
+bool HugeCacheBudget::Live(const Slot& slot) {
+  const pid_t pid = slot.pid.load(std::memory_order_relaxed);
+  if (pid == 0) {
+    return false;
+  }
+  // EPERM means the process exists, but is not ours to signal.
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+HugeLength HugeCacheBudget::budget() const {
+  TC_ASSERT(active());
+  return NHugePages(table_->budget.load(std::memory_order_relaxed));
+}
+
+void HugeCacheBudget::Add(HugeLength n) {
+  TC_ASSERT(active());
+  slot_->hugepages.fetch_add(n.raw_num(), std::memory_order_relaxed);
+}
+
+void HugeCacheBudget::Remove(HugeLength n) {
+  TC_ASSERT(active());
+  slot_->hugepages.fetch_sub(n.raw_num(), std::memory_order_relaxed);
+}
+
+HugeLength HugeCacheBudget::held() const {
+  TC_ASSERT(active());
+  return NHugePages(slot_->hugepages.load(std::memory_order_relaxed));
+}
+
+HugeLength HugeCacheBudget::total() const {
+  TC_ASSERT(active());
+  uint64_t total = 0;
+  for (const Slot& s : table_->slots) {
+    if (&s == slot_ || Live(s)) {
+      total += s.hugepages.load(std::memory_order_relaxed);
+    }
+  }
+  return NHugePages(total);
+}
+
+HugeLength HugeCacheBudget::Excess(HugeLength cached) const {
+  TC_ASSERT(active());
+  const uint64_t budget = table_->budget.load(std::memory_order_relaxed);
+  // Only look for dead processes, which takes a syscall each, if the group
+  // seems to be over budget.
+  uint64_t claimed = 0;
+  for (const Slot& s : table_->slots) {
+    if (s.pid.load(std::memory_order_relaxed) != 0) {
+      claimed += s.hugepages.load(std::memory_order_relaxed);
+    }
+  }
+  if (claimed <= budget) {
+    return NHugePages(0);
+  }
+  const uint64_t live = total().raw_num();
+  if (live <= budget) {
+    return NHugePages(0);
+  }
+  // Round up, so that any cache holding hugepages gives back at least one.
+  const uint64_t excess = live - budget;
+  const uint64_t share = (excess * cached.raw_num() + live - 1) / live;
+  return std::min(NHugePages(share), cached);
+}
+
+HugeCacheBudget* SharedHugeCacheBudget() {
+  ABSL_CONST_INIT static HugeCacheBudget budget;
+  ABSL_CONST_INIT static HugeCacheBudget* result = nullptr;
+  ABSL_CONST_INIT static absl::once_flag flag;
+
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* path = thread_safe_getenv("TCMALLOC_HUGE_CACHE_BUDGET_FILE");
+    if (path == nullptr || *path == '\0') {
+      return;
+    }
+    const char* e = thread_safe_getenv("TCMALLOC_HUGE_CACHE_BUDGET");
+    uint64_t bytes;
+    if (e == nullptr || !absl::SimpleAtoi(e, &bytes)) {
+      TC_BUG("bad env var TCMALLOC_HUGE_CACHE_BUDGET='%s'",
+             e != nullptr ? e : "");
+    }
+    const int fd = signal_safe_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      TC_LOG("Couldn't open huge cache budget file %s", path);
+      return;
+    }
+    if (budget.Init(fd, HLFromBytes(bytes))) {
+      result = &budget;
+    } else {
+      TC_LOG("Couldn't share huge cache budget file %s", path);
+    }
+    signal_safe_close(fd);
+  });
+
+  return result;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
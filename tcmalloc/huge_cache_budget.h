@@ -0,0 +1,110 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_HUGE_CACHE_BUDGET_H_
+#define TCMALLOC_HUGE_CACHE_BUDGET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// A budget for the backed, free hugepages that the HugeCaches of a group of
+// co-located processes hold, such as those of a cgroup.  Each HugeCache sizes
+// itself for its own process, so idle memory is otherwise cached once per
+// process rather than once per group.
+//
+// The processes share a small table in a file they all map, where each
+// publishes how many hugepages its caches hold.  While the group's total is
+// over the budget, each cache unbacks its share of the excess, in proportion
+// to what it holds.  No memory moves between the processes: a hugepage is
+// always cached at its address in the process that freed it.
+//
+// The table is advisory.  A process which dies keeps its slot until another
+// claims it, but is left out of the total from then on; processes sharing a
+// table must share a PID namespace for that to work.  A forked child keeps
+// adding to its parent's slot, so one which keeps allocating must exec first.
+class HugeCacheBudget {
+ public:
+  // Processes, beyond which Init fails.
+  static constexpr int kMaxProcesses = 64;
+
+  constexpr HugeCacheBudget() = default;
+
+  // Maps the table in `fd`, sizing the file if it is new, claims a slot for
+  // this process and sets the group's budget to `budget`.  Returns false if
+  // the file is not such a table, or every slot is held by a live process.
+  // The file descriptor may be closed afterwards.
+  bool Init(int fd, HugeLength budget);
+
+  bool active() const { return slot_ != nullptr; }
+
+  HugeLength budget() const;
+
+  // Adds `n` hugepages to, or takes them from, what this process holds.
+  void Add(HugeLength n);
+  void Remove(HugeLength n);
+
+  // The hugepages this process holds, and the group's live processes hold.
+  HugeLength held() const;
+  HugeLength total() const;
+
+  // Returns how many of the `cached` hugepages held by one of this process's
+  // caches it should unback to bring the group within its budget.
+  HugeLength Excess(HugeLength cached) const;
+
+ private:
+  struct Slot {
+    std::atomic<pid_t> pid;
+    std::atomic<uint64_t> hugepages;
+  };
+
+  struct Table {
+    std::atomic<uint64_t> magic;
+    std::atomic<uint64_t> budget;
+    Slot slots[kMaxProcesses];
+  };
+
+  static constexpr uint64_t kMagic = 0x74636d6268636231;  // "tcmbhcb1"
+
+  // The atomics are shared between processes, so must not be implemented
+  // with a lock.
+  static_assert(std::atomic<pid_t>::is_always_lock_free);
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+  // Returns whether the process holding `slot` is alive.
+  static bool Live(const Slot& slot);
+
+  Table* table_ = nullptr;
+  Slot* slot_ = nullptr;
+};
+
+// The budget shared with other processes, as configured by the
+// TCMALLOC_HUGE_CACHE_BUDGET_FILE and TCMALLOC_HUGE_CACHE_BUDGET environment
+// variables, or nullptr if there is none.
+HugeCacheBudget* SharedHugeCacheBudget();
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_HUGE_CACHE_BUDGET_H_
@@ -0,0 +1,128 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/huge_cache_budget.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/huge_pages.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Each HugeCacheBudget claims a slot of its own, so several in one process
+// stand in for several processes.
+class HugeCacheBudgetTest : public testing::Test {
+ protected:
+  HugeCacheBudgetTest()
+      : fd_(memfd_create("huge_cache_budget", MFD_CLOEXEC)) {}
+  ~HugeCacheBudgetTest() override { close(fd_); }
+
+  const int fd_;
+};
+
+TEST_F(HugeCacheBudgetTest, Shared) {
+  ASSERT_GE(fd_, 0);
+  HugeCacheBudget a, b;
+  EXPECT_FALSE(a.active());
+  ASSERT_TRUE(a.Init(fd_, NHugePages(10)));
+  ASSERT_TRUE(b.Init(fd_, NHugePages(20)));
+  EXPECT_TRUE(a.active());
+
+  // The last process to join sets the budget.
+  EXPECT_EQ(a.budget(), NHugePages(20));
+
+  a.Add(NHugePages(5));
+  b.Add(NHugePages(7));
+  b.Remove(NHugePages(2));
+  EXPECT_EQ(a.held(), NHugePages(5));
+  EXPECT_EQ(b.held(), NHugePages(5));
+  EXPECT_EQ(a.total(), NHugePages(10));
+  EXPECT_EQ(b.total(), NHugePages(10));
+}
+
+TEST_F(HugeCacheBudgetTest, Excess) {
+  ASSERT_GE(fd_, 0);
+  HugeCacheBudget a, b;
+  ASSERT_TRUE(a.Init(fd_, NHugePages(20)));
+  ASSERT_TRUE(b.Init(fd_, NHugePages(20)));
+
+  a.Add(NHugePages(15));
+  b.Add(NHugePages(5));
+  EXPECT_EQ(a.Excess(NHugePages(15)), NHugePages(0));
+
+  // The excess is shared in proportion to what each holds.
+  a.Add(NHugePages(15));
+  b.Add(NHugePages(5));
+  EXPECT_EQ(a.Excess(NHugePages(30)), NHugePages(15));
+  EXPECT_EQ(b.Excess(NHugePages(10)), NHugePages(5));
+  // A cache holding little still gives back a hugepage.
+  EXPECT_EQ(b.Excess(NHugePages(1)), NHugePages(1));
+  EXPECT_EQ(b.Excess(NHugePages(0)), NHugePages(0));
+}
+
+TEST_F(HugeCacheBudgetTest, Full) {
+  ASSERT_GE(fd_, 0);
+  HugeCacheBudget budgets[HugeCacheBudget::kMaxProcesses];
+  for (HugeCacheBudget& budget : budgets) {
+    ASSERT_TRUE(budget.Init(fd_, NHugePages(1)));
+  }
+  HugeCacheBudget extra;
+  EXPECT_FALSE(extra.Init(fd_, NHugePages(1)));
+  EXPECT_FALSE(extra.active());
+}
+
+TEST_F(HugeCacheBudgetTest, RejectsOtherFiles) {
+  ASSERT_GE(fd_, 0);
+  const uint64_t garbage = 1;
+  ASSERT_EQ(write(fd_, &garbage, sizeof(garbage)), sizeof(garbage));
+  HugeCacheBudget budget;
+  EXPECT_FALSE(budget.Init(fd_, NHugePages(1)));
+}
+
+TEST_F(HugeCacheBudgetTest, DeadProcesses) {
+  ASSERT_GE(fd_, 0);
+  HugeCacheBudget budget;
+  ASSERT_TRUE(budget.Init(fd_, NHugePages(10)));
+  budget.Add(NHugePages(5));
+
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    HugeCacheBudget child;
+    if (!child.Init(fd_, NHugePages(10))) {
+      _exit(1);
+    }
+    child.Add(NHugePages(50));
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  // What the child held went with it.
+  EXPECT_EQ(budget.total(), NHugePages(5));
+  EXPECT_EQ(budget.Excess(NHugePages(5)), NHugePages(0));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -17,6 +17,8 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <memory>
@@ -34,6 +36,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "tcmalloc/huge_cache_budget.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
@@ -86,6 +89,10 @@ class HugeCacheTest : public testing::TestWithParam<absl::Duration> {
     clock_offset_ += absl::ToInt64Nanoseconds(d);
   }
 
+  static Clock FakeClock() {
+    return Clock{.now = GetClock, .freq = GetClockFrequency};
+  }
+
   FakeVirtualAllocator vm_allocator_;
   FakeMetadataAllocator metadata_allocator_;
   HugeAllocator alloc_{vm_allocator_, metadata_allocator_};
@@ -463,6 +470,115 @@ TEST_P(HugeCacheTest, Shrink) {
   ASSERT_GE(NHugePages(25), cache_.limit());
 }
 
+TEST_P(HugeCacheTest, DemandForecast) {
+  ON_CALL(mock_unback_, Unback).WillByDefault(Return(true));
+  HugeCache cache{&alloc_, metadata_allocator_, mock_unback_,
+                  /*cache_time=*/GetParam(), FakeClock(),
+                  kDefaultHugeCacheDemandIntervals};
+
+  bool from_released;
+  cache.Release(cache.Get(NHugePages(100), &from_released));
+  // Every horizon has seen the peak, so the cache keeps it past its limit.
+  EXPECT_EQ(cache.size(), NHugePages(100));
+  EXPECT_LT(cache.limit(), cache.size());
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(100)), NHugePages(0));
+
+  // The peak has aged out of the short horizon, but not the longer ones.
+  Advance(absl::Minutes(1));
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(100)), NHugePages(0));
+
+  // Memory limits override the forecast.
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(10), /*hit_limit=*/true),
+            NHugePages(10));
+
+  // Once no horizon remembers the peak, the cache is surplus.
+  Advance(2 * kDefaultHugeCacheDemandIntervals.long_interval);
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(90)), NHugePages(90));
+  EXPECT_EQ(cache.size(), NHugePages(0));
+}
+
+TEST_P(HugeCacheTest, CoreDump) {
+  class CountingAdvice final : public MemoryModifyFunction {
+   public:
+    bool operator()(PageId p, Length len) override {
+      pages += len;
+      return true;
+    }
+
+    Length pages;
+  };
+  CountingAdvice exclude, include;
+  ON_CALL(mock_unback_, Unback).WillByDefault(Return(true));
+  HugeCache cache{&alloc_,
+                  metadata_allocator_,
+                  mock_unback_,
+                  /*cache_time=*/GetParam(),
+                  FakeClock(),
+                  /*demand_intervals=*/{},
+                  {.exclude = &exclude, .include = &include}};
+
+  // Memory from the allocator is only advised once it is cached.
+  bool from_released;
+  HugeRange r = cache.Get(NHugePages(4), &from_released);
+  EXPECT_TRUE(from_released);
+  EXPECT_EQ(exclude.pages, Length(0));
+  cache.Release(r);
+  EXPECT_EQ(exclude.pages, NHugePages(4).in_pages());
+
+  // Only what is handed out goes back into core dumps.
+  HugeRange r1 = cache.Get(NHugePages(1), &from_released);
+  EXPECT_FALSE(from_released);
+  EXPECT_EQ(include.pages, NHugePages(1).in_pages());
+  cache.Release(r1);
+  EXPECT_EQ(exclude.pages, NHugePages(5).in_pages());
+
+  // Unbacked hugepages are back in dumps before the allocator reuses them.
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(4)), NHugePages(4));
+  EXPECT_EQ(cache.size(), NHugePages(0));
+  EXPECT_EQ(include.pages, exclude.pages);
+}
+
+TEST_P(HugeCacheTest, Budget) {
+  ON_CALL(mock_unback_, Unback).WillByDefault(Return(true));
+  const int fd = memfd_create("huge_cache_budget", MFD_CLOEXEC);
+  ASSERT_GE(fd, 0);
+  HugeCacheBudget budget, other;
+  ASSERT_TRUE(budget.Init(fd, NHugePages(40)));
+  ASSERT_TRUE(other.Init(fd, NHugePages(40)));
+  close(fd);
+  // Another process's caches hold 35 hugepages.
+  other.Add(NHugePages(35));
+  HugeCache cache{&alloc_,
+                  metadata_allocator_,
+                  mock_unback_,
+                  /*cache_time=*/GetParam(),
+                  FakeClock(),
+                  /*demand_intervals=*/{},
+                  /*core_dump=*/{},
+                  &budget};
+
+  // The cache keeps its limit of 10, less its share of the group's 5 hugepage
+  // excess.
+  bool from_released;
+  cache.Release(cache.Get(NHugePages(20), &from_released));
+  EXPECT_EQ(cache.size(), NHugePages(8));
+  EXPECT_EQ(budget.held(), NHugePages(8));
+
+  // The periodic release catches up with the other process growing.
+  other.Add(NHugePages(5));
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(0)), NHugePages(2));
+  EXPECT_EQ(cache.size(), NHugePages(6));
+  EXPECT_EQ(budget.held(), NHugePages(6));
+
+  other.Remove(NHugePages(40));
+  EXPECT_EQ(cache.ReleaseCachedPages(NHugePages(0)), NHugePages(0));
+  HugeRange r = cache.Get(NHugePages(6), &from_released);
+  EXPECT_FALSE(from_released);
+  EXPECT_EQ(budget.held(), NHugePages(0));
+  cache.Release(r);
+  EXPECT_EQ(budget.held(), NHugePages(6));
+}
+
 TEST_P(HugeCacheTest, Usage) {
   bool released;
 
@@ -27,10 +27,12 @@
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_allocator.h"
 #include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_cache_budget.h"
 #include "tcmalloc/huge_page_filler.h"
 #include "tcmalloc/huge_pages.h"
 #include "tcmalloc/huge_region.h"
 #include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/clock.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/prefetch.h"
@@ -84,6 +86,14 @@ class StaticForwarder {
     return Parameters::hpaa_cold_subrelease();
   }
 
+  static uint64_t gigantic_page_threshold() {
+    return Parameters::gigantic_page_threshold();
+  }
+
+  static bool lifetime_aware_filler_placement() {
+    return Parameters::lifetime_aware_filler_placement();
+  }
+
   // Arena state.
   static Arena& arena();
 
@@ -116,6 +126,21 @@ class StaticForwarder {
   static bool ReleasePages(PageId start, Length size) {
     return SystemRelease(start.start_addr(), size.in_bytes());
   }
+  static bool CollapsePages(PageId start, Length size) {
+    return SystemCollapse(start.start_addr(), size.in_bytes());
+  }
+  static bool ExcludeFromCoreDump(PageId start, Length size) {
+    return SystemExcludeFromCoreDump(start.start_addr(), size.in_bytes());
+  }
+  static bool IncludeInCoreDump(PageId start, Length size) {
+    return SystemIncludeInCoreDump(start.start_addr(), size.in_bytes());
+  }
+  static bool RemapPages(PageId from, PageId to, Length size) {
+    return SystemRemap(from.start_addr(), to.start_addr(), size.in_bytes());
+  }
+  static bool BackWithGiganticPages(PageId start, Length size) {
+    return SystemBackWithGiganticPages(start.start_addr(), size.in_bytes());
+  }
 };
 
 struct HugePageAwareAllocatorOptions {
@@ -127,6 +152,27 @@ struct HugePageAwareAllocatorOptions {
           : HugePageFillerAllocsOption::kUnifiedAllocs;
   size_t chunks_per_alloc = Parameters::chunks_per_alloc();
   absl::Duration huge_cache_time = Parameters::huge_cache_release_time();
+  HugeCacheDemandIntervals huge_cache_demand_intervals =
+      Parameters::huge_cache_demand_forecast()
+          ? kDefaultHugeCacheDemandIntervals
+          : HugeCacheDemandIntervals{};
+  HugeAllocatorFit huge_allocator_fit = Parameters::huge_allocator_best_fit()
+                                            ? HugeAllocatorFit::kBestFit
+                                            : HugeAllocatorFit::kApproximate;
+  HugeRegionReleaseOption huge_region_release =
+      Parameters::huge_region_subrelease()
+          ? HugeRegionReleaseOption::kSubreleasePartialHugepages
+          : HugeRegionReleaseOption::kFreeHugepagesOnly;
+  HugeCacheCoreDumpOption huge_cache_core_dump =
+      Parameters::exclude_free_memory_from_core_dumps()
+          ? HugeCacheCoreDumpOption::kExcludeCached
+          : HugeCacheCoreDumpOption::kDumpCached;
+  // Shared by the caches of every allocator in the process.
+  HugeCacheBudget* huge_cache_budget = SharedHugeCacheBudget();
+  // The clock read by time-based policies: the HugeCache's release delay and
+  // demand forecast, and the filler's and regions' demand history.
+  Clock clock = {.now = absl::base_internal::CycleClock::Now,
+                 .freq = absl::base_internal::CycleClock::Frequency};
 };
 
 // An implementation of the PageAllocator interface that is hugepage-efficient.
@@ -164,6 +210,17 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   void Delete(Span* span, size_t objects_per_span)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  // Spans from the filler are resized within their hugepage, and those from
+  // regions within their region.  Spans made of whole hugepages are not
+  // resized.
+  bool ResizeInPlace(Span* span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
+  // Only spans of whole hugepages from the HugeCache are moved, into new
+  // ones from the HugeCache.  The pages they leave behind are unbacked.
+  Span* Remap(Span* span, Length n, SpanAllocInfo span_alloc_info)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
+
   BackingStats stats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
@@ -186,9 +243,30 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
                                                PageReleaseReason reason)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Like ReleaseAtLeastNPages, but only releases whole free hugepages, from
+  // the HugeCache and HugeRegions, and never subreleases the filler's.
+  Length ReleaseFreeHugepages(Length num_pages, PageReleaseReason reason)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  HugeLength CollapseHugePages(HugeLength max)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
+
+  HugeLength AuditHugePages(HugeLength max, HugePageBackingFunction& backing)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
+
+  HugeLength TierHugePages(HugeLength max, HugePageTieringFunction& tiering)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
+
   PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  // Only counts the filler's pages: the cache and regions hand out whole
+  // released hugepages, which are not told apart from fresh memory.
+  Length GetRefaultedPages() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    return filler_.rebacked_pages() + short_lived_filler_.rebacked_pages();
+  }
+
   // Prints stats about the page heap to *out.
   void Print(Printer* out) ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
 
@@ -199,14 +277,47 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   void PrintInPbtxt(PbtxtRegion* region)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
 
+  // Covers both fillers, that for short-lived allocations included.
   BackingStats FillerStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
-    return filler_.stats();
+    BackingStats stats = filler_.stats();
+    stats += short_lived_filler_.stats();
+    return stats;
+  }
+
+  BackingStats ShortLivedFillerStats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return short_lived_filler_.stats();
+  }
+
+  // Fraction of the fillers' used pages that are on intact hugepages.
+  double FillerHugepageFrac() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    const double used = UsedBytes(filler_.stats());
+    const double short_lived_used = UsedBytes(short_lived_filler_.stats());
+    if (short_lived_used == 0) {
+      return filler_.hugepage_frac();
+    }
+    return (used * filler_.hugepage_frac() +
+            short_lived_used * short_lived_filler_.hugepage_frac()) /
+           (used + short_lived_used);
   }
 
   BackingStats RegionsStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
-    return regions_.stats();
+    BackingStats stats = regions_.stats();
+    stats += long_lived_regions_.stats();
+    return stats;
+  }
+
+  BackingStats LongLivedRegionsStats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return long_lived_regions_.stats();
+  }
+
+  BackingStats GiganticStats() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return gigantic_.stats();
   }
 
   HugeLength DonatedHugePages() const
@@ -216,7 +327,7 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
 
   HugeLength RegionsFreeBacked() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
-    return regions_.free_backed();
+    return regions_.free_backed() + long_lived_regions_.free_backed();
   }
 
   // Number of pages that have been retained on huge pages by donations that did
@@ -278,11 +389,79 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
     HugePageAwareAllocator& hpaa_;
   };
 
+  // Collapsing is synchronous and expensive, but like subrelease through
+  // unback_, it is done under pageheap_lock so that the hugepage cannot be
+  // released or reused concurrently.
+  class Collapse final : public MemoryModifyFunction {
+   public:
+    explicit Collapse(
+        HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND)
+        : hpaa_(hpaa) {}
+
+    ABSL_MUST_USE_RESULT bool operator()(PageId start, Length length) override
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+#ifndef NDEBUG
+      pageheap_lock.AssertHeld();
+#endif  // NDEBUG
+      return hpaa_.forwarder_.CollapsePages(start, length);
+    }
+
+   public:
+    HugePageAwareAllocator& hpaa_;
+  };
+
+  // Marks hugepages entering and leaving cache_ when
+  // HugeCacheCoreDumpOption::kExcludeCached is set.  This is a madvise under
+  // pageheap_lock for each range moved, the price of keeping cores small.
+  class CoreDumpAdvice final : public MemoryModifyFunction {
+   public:
+    CoreDumpAdvice(HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND,
+                   bool exclude)
+        : hpaa_(hpaa), exclude_(exclude) {}
+
+    ABSL_MUST_USE_RESULT bool operator()(PageId start, Length length) override
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+      return exclude_ ? hpaa_.forwarder_.ExcludeFromCoreDump(start, length)
+                      : hpaa_.forwarder_.IncludeInCoreDump(start, length);
+    }
+
+   private:
+    HugePageAwareAllocator& hpaa_;
+    const bool exclude_;
+  };
+
   Unback unback_ ABSL_GUARDED_BY(pageheap_lock);
   UnbackWithoutLock unback_without_lock_ ABSL_GUARDED_BY(pageheap_lock);
+  Collapse collapse_ ABSL_GUARDED_BY(pageheap_lock);
+  CoreDumpAdvice exclude_from_core_dump_ ABSL_GUARDED_BY(pageheap_lock);
+  CoreDumpAdvice include_in_core_dump_ ABSL_GUARDED_BY(pageheap_lock);
 
   typedef HugePageFiller<PageTracker> FillerType;
   FillerType filler_ ABSL_GUARDED_BY(pageheap_lock);
+  // Hugepages for allocations predicted to be short-lived, when forwarder_
+  // asks for lifetime-aware placement.  Their pages come and go together, so
+  // their hugepages empty out whole instead of pinning those of filler_.
+  FillerType short_lived_filler_ ABSL_GUARDED_BY(pageheap_lock);
+
+  // The filler that new allocations with this prediction are packed into.
+  FillerType& FillerFor(SpanAllocInfo span_alloc_info)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    if (span_alloc_info.lifetime == LifetimePrediction::kShortLived &&
+        forwarder_.lifetime_aware_filler_placement()) {
+      return short_lived_filler_;
+    }
+    return filler_;
+  }
+
+  // The filler that pt, and the allocations on it, belong to.
+  FillerType& FillerOf(const PageTracker* pt)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return pt->short_lived() ? short_lived_filler_ : filler_;
+  }
+
+  static uint64_t UsedBytes(const BackingStats& s) {
+    return s.system_bytes - s.free_bytes - s.unmapped_bytes;
+  }
 
   class VirtualMemoryAllocator final : public VirtualAllocator {
    public:
@@ -300,6 +479,29 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
     HugePageAwareAllocator& hpaa_;
   };
 
+  // Allocates address space and backs it with gigantic pages.
+  class GiganticMemoryAllocator final : public VirtualAllocator {
+   public:
+    explicit GiganticMemoryAllocator(
+        HugePageAwareAllocator& hpaa ABSL_ATTRIBUTE_LIFETIME_BOUND)
+        : hpaa_(hpaa) {}
+
+    ABSL_MUST_USE_RESULT AddressRange operator()(size_t bytes,
+                                                 size_t align) override
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+      AddressRange range = hpaa_.AllocAndReport(bytes, align);
+      if (range.ptr == nullptr ||
+          !hpaa_.forwarder_.BackWithGiganticPages(
+              PageIdContaining(range.ptr), BytesToLengthFloor(range.bytes))) {
+        return {nullptr, 0};
+      }
+      return range;
+    }
+
+   private:
+    HugePageAwareAllocator& hpaa_;
+  };
+
   class ArenaMetadataAllocator final : public MetadataAllocator {
    public:
     explicit ArenaMetadataAllocator(
@@ -308,7 +510,8 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
 
     ABSL_MUST_USE_RESULT void* operator()(size_t bytes) override
         ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
-      return hpaa_.forwarder_.arena().Alloc(bytes);
+      return hpaa_.forwarder_.arena().Alloc(bytes, kAlignment,
+                                            ArenaUse::kPageTracker);
     }
 
    public:
@@ -316,6 +519,10 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   };
 
   HugeRegionSet<HugeRegion> regions_ ABSL_GUARDED_BY(pageheap_lock);
+  // Regions dedicated to multi-hugepage allocations predicted to be
+  // long-lived, so that they do not pin regions shared with shorter-lived
+  // allocations.
+  HugeRegionSet<HugeRegion> long_lived_regions_ ABSL_GUARDED_BY(pageheap_lock);
 
   PageHeapAllocator<FillerType::Tracker> tracker_allocator_
       ABSL_GUARDED_BY(pageheap_lock);
@@ -334,6 +541,12 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
   HugeAllocator alloc_ ABSL_GUARDED_BY(pageheap_lock);
   HugeCache cache_ ABSL_GUARDED_BY(pageheap_lock);
 
+  // Backs enormous allocations with 1GiB pages, if enabled.  Its memory is
+  // never released, so it is kept apart from alloc_ and cache_.
+  GiganticMemoryAllocator gigantic_vm_allocator_
+      ABSL_GUARDED_BY(pageheap_lock);
+  GiganticPageAllocator gigantic_ ABSL_GUARDED_BY(pageheap_lock);
+
   // donated_huge_pages_ measures the number of huge pages contributed to the
   // filler from left overs of large huge page allocations.  When the large
   // allocation is deallocated, we decrement this count *if* we were able to
@@ -371,11 +584,27 @@ class HugePageAwareAllocator final : public PageAllocatorInterface {
                       bool* from_released)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Allocates whole hugepages for n pages, donating any slack in the last one
+  // to the filler.  The first hugepage is a multiple of <align> hugepages.
   Span* AllocRawHugepages(Length n, SpanAllocInfo span_alloc_info,
-                          bool* from_released)
+                          bool* from_released,
+                          HugeLength align = NHugePages(1))
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  bool AddRegion(HugeRegionSet<HugeRegion>& regions)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Releases free hugepages from both sets of regions: at least n pages by
+  // peak demand if forwarder_ asks for demand-based release, or else
+  // release_fraction of their free pages.
+  Length ReleaseRegions(Length n, double release_fraction,
+                        SkipSubreleaseIntervals intervals, bool hit_limit)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
-  bool AddRegion() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+  // Releases free hugepages from the HugeCache and, if they are used more
+  // often, the regions, without recording the release.
+  Length ReleaseCachedHugepages(Length num_pages, PageReleaseReason reason)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   void ReleaseHugepage(FillerType::Tracker* pt)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
@@ -400,16 +629,36 @@ inline HugePageAwareAllocator<Forwarder>::HugePageAwareAllocator(
     : PageAllocatorInterface("HugePageAware", options.tag),
       unback_(*this),
       unback_without_lock_(*this),
-      filler_(options.allocs_for_sparse_and_dense_spans,
+      collapse_(*this),
+      exclude_from_core_dump_(*this, /*exclude=*/true),
+      include_in_core_dump_(*this, /*exclude=*/false),
+      filler_(options.clock, options.allocs_for_sparse_and_dense_spans,
               options.chunks_per_alloc, unback_, unback_without_lock_),
-      regions_(options.use_huge_region_more_often),
+      short_lived_filler_(options.clock,
+                          options.allocs_for_sparse_and_dense_spans,
+                          options.chunks_per_alloc, unback_,
+                          unback_without_lock_),
+      regions_(options.use_huge_region_more_often, options.clock,
+               options.huge_region_release),
+      long_lived_regions_(options.use_huge_region_more_often, options.clock,
+                          options.huge_region_release),
       vm_allocator_(*this),
       metadata_allocator_(*this),
-      alloc_(vm_allocator_, metadata_allocator_),
-      cache_(HugeCache{&alloc_, metadata_allocator_, unback_without_lock_,
-                       options.huge_cache_time}) {
-  tracker_allocator_.Init(&forwarder_.arena());
-  region_allocator_.Init(&forwarder_.arena());
+      alloc_(vm_allocator_, metadata_allocator_, options.huge_allocator_fit),
+      cache_(HugeCache{
+          &alloc_, metadata_allocator_, unback_without_lock_,
+          options.huge_cache_time, options.clock,
+          options.huge_cache_demand_intervals,
+          options.huge_cache_core_dump ==
+                  HugeCacheCoreDumpOption::kExcludeCached
+              ? HugeCacheCoreDumpFunctions{&exclude_from_core_dump_,
+                                           &include_in_core_dump_}
+              : HugeCacheCoreDumpFunctions{},
+          options.huge_cache_budget}),
+      gigantic_vm_allocator_(*this),
+      gigantic_(gigantic_vm_allocator_, metadata_allocator_) {
+  tracker_allocator_.Init(&forwarder_.arena(), ArenaUse::kPageTracker);
+  region_allocator_.Init(&forwarder_.arena(), ArenaUse::kPageTracker);
 }
 
 template <class Forwarder>
@@ -443,7 +692,10 @@ inline PageId HugePageAwareAllocator<Forwarder>::AllocAndContribute(
   PageId page = pt->Get(n).page;
   TC_ASSERT_EQ(page, p.first_page());
   SetTracker(p, pt);
-  filler_.Contribute(pt, donated, span_alloc_info);
+  // Donated slack stays with filler_, which accounts for its abandonment.
+  FillerType& filler = donated ? filler_ : FillerFor(span_alloc_info);
+  pt->set_short_lived(&filler == &short_lived_filler_);
+  filler.Contribute(pt, donated, span_alloc_info);
   TC_ASSERT_EQ(pt->was_donated(), donated);
   return page;
 }
@@ -482,7 +734,8 @@ inline Span* HugePageAwareAllocator<Forwarder>::Finalize(Length n, PageId page)
 template <class Forwarder>
 inline Span* HugePageAwareAllocator<Forwarder>::AllocSmall(
     Length n, SpanAllocInfo span_alloc_info, bool* from_released) {
-  auto [pt, page, released] = filler_.TryGet(n, span_alloc_info);
+  auto [pt, page, released] =
+      FillerFor(span_alloc_info).TryGet(n, span_alloc_info);
   *from_released = released;
   if (ABSL_PREDICT_TRUE(pt != nullptr)) {
     return Finalize(n, page);
@@ -505,13 +758,39 @@ inline Span* HugePageAwareAllocator<Forwarder>::AllocLarge(
   }
 
   PageId page;
+  // Sampled lifetimes of allocations of this size tell multi-hugepage
+  // allocations apart: long-lived ones share dedicated regions, where their
+  // slack is not donated to the filler, and short-lived ones come straight
+  // from the HugeCache, so they do not fragment regions.
+  if (n > kPagesPerHugePage) {
+    if (span_alloc_info.lifetime == LifetimePrediction::kLongLived) {
+      if (long_lived_regions_.MaybeGet(n, &page, from_released) ||
+          (AddRegion(long_lived_regions_) &&
+           long_lived_regions_.MaybeGet(n, &page, from_released))) {
+        return Finalize(n, page);
+      }
+    } else if (span_alloc_info.lifetime == LifetimePrediction::kShortLived) {
+      return AllocRawHugepages(n, span_alloc_info, from_released);
+    }
+  }
+
   // If we fit in a single hugepage, try the Filler first.
   if (n < kPagesPerHugePage) {
-    auto [pt, page, released] = filler_.TryGet(n, span_alloc_info);
+    FillerType& filler = FillerFor(span_alloc_info);
+    auto [pt, page, released] = filler.TryGet(n, span_alloc_info);
     *from_released = released;
     if (ABSL_PREDICT_TRUE(pt != nullptr)) {
       return Finalize(n, page);
     }
+    // Short-lived allocations neither donate slack to filler_ nor share
+    // regions, but start a hugepage of their own.
+    if (&filler == &short_lived_filler_) {
+      page = RefillFiller(n, span_alloc_info, from_released);
+      if (ABSL_PREDICT_FALSE(page == PageId{0})) {
+        return nullptr;
+      }
+      return Finalize(n, page);
+    }
   }
 
   // If we're using regions in this binary (see below comment), is
@@ -551,7 +830,7 @@ inline Span* HugePageAwareAllocator<Forwarder>::AllocLarge(
 
   // We couldn't allocate a new region. They're oversized, so maybe we'd get
   // lucky with a smaller request?
-  if (!AddRegion()) {
+  if (!AddRegion(regions_)) {
     return AllocRawHugepages(n, span_alloc_info, from_released);
   }
 
@@ -562,15 +841,34 @@ inline Span* HugePageAwareAllocator<Forwarder>::AllocLarge(
 template <class Forwarder>
 inline Span* HugePageAwareAllocator<Forwarder>::AllocEnormous(
     Length n, SpanAllocInfo span_alloc_info, bool* from_released) {
+  // Allocations this large are worth backing with 1GiB pages, which are never
+  // released, unless they are predicted to be short-lived.  Cold memory is
+  // rarely accessed, so TLB misses on it don't matter.
+  if (const uint64_t threshold = forwarder_.gigantic_page_threshold();
+      ABSL_PREDICT_FALSE(threshold != 0) && n.in_bytes() >= threshold &&
+      tag_ != MemoryTag::kCold &&
+      span_alloc_info.lifetime != LifetimePrediction::kShortLived) {
+    // There is no slack to donate to the filler: it would subrelease it,
+    // which hugetlb memory doesn't support.
+    HugeRange r = gigantic_.Get(HLFromPages(n));
+    if (r.valid()) {
+      *from_released = false;
+      return Finalize(n, r.start().first_page());
+    }
+  }
   return AllocRawHugepages(n, span_alloc_info, from_released);
 }
 
 template <class Forwarder>
 inline Span* HugePageAwareAllocator<Forwarder>::AllocRawHugepages(
-    Length n, SpanAllocInfo span_alloc_info, bool* from_released) {
+    Length n, SpanAllocInfo span_alloc_info, bool* from_released,
+    HugeLength align) {
   HugeLength hl = HLFromPages(n);
 
-  HugeRange r = cache_.Get(hl, from_released);
+  bool zeroed;
+  HugeRange r = align > NHugePages(1)
+                    ? cache_.GetAligned(hl, align, from_released, &zeroed)
+                    : cache_.Get(hl, from_released, &zeroed);
   if (!r.valid()) return nullptr;
 
   // We now have a huge page range that covers our request.  There
@@ -584,7 +882,9 @@ inline Span* HugePageAwareAllocator<Forwarder>::AllocRawHugepages(
   HugePage last = first + r.len() - NHugePages(1);
   if (slack == Length(0)) {
     SetTracker(last, nullptr);
-    return Finalize(total, r.start().first_page());
+    Span* span = Finalize(total, r.start().first_page());
+    span->set_zeroed(zeroed);
+    return span;
   }
 
   ++donated_huge_pages_;
@@ -594,6 +894,7 @@ inline Span* HugePageAwareAllocator<Forwarder>::AllocRawHugepages(
   AllocAndContribute(last, here, span_alloc_info, /*donated=*/true);
   Span* span = Finalize(n, r.start().first_page());
   span->set_donated(/*value=*/true);
+  span->set_zeroed(zeroed);
   return span;
 }
 
@@ -646,14 +947,16 @@ inline Span* HugePageAwareAllocator<Forwarder>::NewAligned(
     return New(n, span_alloc_info);
   }
 
-  // we can do better than this, but...
-  // TODO(b/134690769): support higher align.
-  TC_CHECK_LE(align, kPagesPerHugePage);
+  // Alignments up to a hugepage are met by any hugepage range.  Larger ones
+  // are carved straight out of the HugeAllocator at the exact alignment, so
+  // they cost address space but no memory beyond n rounded up to hugepages.
   bool from_released;
   Span* s;
   {
     PageHeapSpinLockHolder l;
-    s = AllocRawHugepages(n, span_alloc_info, &from_released);
+    s = AllocRawHugepages(n, span_alloc_info, &from_released,
+                          align > kPagesPerHugePage ? HLFromPages(align)
+                                                    : NHugePages(1));
   }
   if (s && from_released) BackSpan(s);
   TC_ASSERT(!s || GetMemoryTag(s->start_address()) == tag_);
@@ -663,7 +966,7 @@ inline Span* HugePageAwareAllocator<Forwarder>::NewAligned(
 template <class Forwarder>
 inline void HugePageAwareAllocator<Forwarder>::DeleteFromHugepage(
     FillerType::Tracker* pt, PageId p, Length n, bool might_abandon) {
-  if (ABSL_PREDICT_TRUE(filler_.Put(pt, p, n) == nullptr)) {
+  if (ABSL_PREDICT_TRUE(FillerOf(pt).Put(pt, p, n) == nullptr)) {
     // If this allocation had resulted in a donation to the filler, we record
     // these pages as abandoned.
     if (ABSL_PREDICT_FALSE(might_abandon)) {
@@ -686,15 +989,125 @@ inline void HugePageAwareAllocator<Forwarder>::DeleteFromHugepage(
 }
 
 template <class Forwarder>
-inline bool HugePageAwareAllocator<Forwarder>::AddRegion() {
+inline bool HugePageAwareAllocator<Forwarder>::AddRegion(
+    HugeRegionSet<HugeRegion>& regions) {
   HugeRange r = alloc_.Get(HugeRegion::size());
   if (!r.valid()) return false;
   HugeRegion* region = region_allocator_.New();
   new (region) HugeRegion(r, unback_);
-  regions_.Contribute(region);
+  regions.Contribute(region);
+  return true;
+}
+
+template <class Forwarder>
+inline Length HugePageAwareAllocator<Forwarder>::ReleaseRegions(
+    Length n, double release_fraction, SkipSubreleaseIntervals intervals,
+    bool hit_limit) {
+  Length released;
+  if (forwarder_.huge_region_demand_based_release()) {
+    for (HugeRegionSet<HugeRegion>* regions :
+         {&regions_, &long_lived_regions_}) {
+      if (released < n) {
+        released += regions->ReleasePagesByPeakDemand(n - released, intervals,
+                                                      hit_limit);
+      }
+    }
+  } else {
+    released += regions_.ReleasePages(release_fraction);
+    released += long_lived_regions_.ReleasePages(release_fraction);
+  }
+  return released;
+}
+
+template <class Forwarder>
+inline bool HugePageAwareAllocator<Forwarder>::ResizeInPlace(Span* span,
+                                                             Length n) {
+  TC_ASSERT_GT(n, Length(0));
+  TC_ASSERT_EQ(GetMemoryTag(span->start_address()), tag_);
+  const PageId p = span->first_page();
+  const Length old_n = span->num_pages();
+  if (n == old_n) {
+    return true;
+  }
+  // The slack of donated spans is accounted for as a separate allocation in
+  // the filler.
+  if (span->donated()) {
+    return false;
+  }
+
+  bool from_released = false;
+  {
+    PageHeapSpinLockHolder l;
+    bool resized;
+    if (FillerType::Tracker* pt = GetTracker(HugePageContaining(p))) {
+      resized = FillerOf(pt).TryResize(pt, p, old_n, n, &from_released);
+    } else {
+      resized = regions_.MaybeResize(p, old_n, n, &from_released) ||
+                long_lived_regions_.MaybeResize(p, old_n, n, &from_released);
+    }
+    if (!resized) {
+      return false;
+    }
+    info_.RecordFree(p, old_n);
+    info_.RecordAlloc(p, n);
+    span->set_num_pages(n);
+    if (n > old_n) {
+      forwarder_.ShrinkToUsageLimit(n - old_n);
+    }
+  }
+  if (from_released) {
+    SystemBack((p + old_n).start_addr(), (n - old_n).in_bytes());
+  }
   return true;
 }
 
+template <class Forwarder>
+inline Span* HugePageAwareAllocator<Forwarder>::Remap(
+    Span* span, Length n, SpanAllocInfo span_alloc_info) {
+  TC_ASSERT_EQ(GetMemoryTag(span->start_address()), tag_);
+  const PageId p = span->first_page();
+  const HugePage hp = HugePageContaining(p);
+  const Length old_n = span->num_pages();
+  const HugeLength old_hl = HLFromPages(old_n);
+  TC_ASSERT_GE(n, old_n);
+  if (hp.first_page() != p || old_hl.in_pages() != old_n) {
+    return nullptr;
+  }
+
+  bool from_released;
+  Span* moved;
+  {
+    PageHeapSpinLockHolder l;
+    // Spans of whole hugepages may also come from a region, from gigantic
+    // pages, which can't be remapped, or, once resized in place, from the
+    // filler.
+    if (GetTracker(hp) != nullptr || regions_.contains(p) ||
+        long_lived_regions_.contains(p) ||
+        (gigantic_.system() > NHugePages(0) && gigantic_.Contains(hp))) {
+      return nullptr;
+    }
+    moved = AllocRawHugepages(n, span_alloc_info, &from_released);
+  }
+  if (moved == nullptr) {
+    return nullptr;
+  }
+  if (from_released) BackSpan(moved);
+
+  if (!forwarder_.RemapPages(p, moved->first_page(), old_n)) {
+    PageHeapSpinLockHolder l;
+    Delete(moved, /*objects_per_span=*/1);
+    return nullptr;
+  }
+
+  PageHeapSpinLockHolder l;
+  info_.RecordFree(p, old_n);
+  forwarder_.DeleteSpan(span);
+  forwarder_.Set(p, nullptr);
+  // There is nothing left to cache.
+  cache_.ReleaseUnbacked({hp, old_hl});
+  return moved;
+}
+
 template <class Forwarder>
 inline void HugePageAwareAllocator<Forwarder>::Delete(Span* span,
                                                       size_t objects_per_span) {
@@ -723,9 +1136,16 @@ inline void HugePageAwareAllocator<Forwarder>::Delete(Span* span,
 
   // b) We got put into a region, possibly crossing hugepages -
   //    return our allocation to the region.
-  if (regions_.MaybePut(p, n)) return;
+  if (regions_.MaybePut(p, n) || long_lived_regions_.MaybePut(p, n)) return;
+
+  // c) We were backed by gigantic pages - keep them for reuse.
+  if (ABSL_PREDICT_FALSE(gigantic_.system() > NHugePages(0)) &&
+      gigantic_.Contains(hp)) {
+    gigantic_.Release({hp, HLFromPages(n)});
+    return;
+  }
 
-  // c) we came straight from the HugeCache - return straight there.  (We
+  // d) we came straight from the HugeCache - return straight there.  (We
   //    might have had slack put into the filler - if so, return that virtual
   //    allocation to the filler too!)
   TC_ASSERT_GE(n, kPagesPerHugePage);
@@ -745,7 +1165,7 @@ inline void HugePageAwareAllocator<Forwarder>::Delete(Span* span,
     Length virt_len = kPagesPerHugePage - slack;
     // We may have used the slack, which would prevent us from returning
     // the entire range now.  If filler returned a Tracker, we are fully empty.
-    if (filler_.Put(pt, virt, virt_len) == nullptr) {
+    if (FillerOf(pt).Put(pt, virt, virt_len) == nullptr) {
       // Last page isn't empty -- pretend the range was shorter.
       --hl;
 
@@ -785,6 +1205,11 @@ inline void HugePageAwareAllocator<Forwarder>::ReleaseHugepage(
 
   if (pt->released()) {
     cache_.ReleaseUnbacked(r);
+  } else if (pt->demoted() &&
+             unback_(r.start().first_page(), r.len().in_pages())) {
+    // A demoted hugepage is backed by far memory.  Rather than let the cache
+    // hand it out again, we return it so that its next use is backed nearby.
+    cache_.ReleaseUnbacked(r);
   } else {
     cache_.Release(r);
   }
@@ -798,12 +1223,15 @@ inline BackingStats HugePageAwareAllocator<Forwarder>::stats() const {
   BackingStats stats = alloc_.stats();
   const auto actual_system = stats.system_bytes;
   stats += cache_.stats();
-  stats += filler_.stats();
+  stats += FillerStats();
   stats += regions_.stats();
+  stats += long_lived_regions_.stats();
   // the "system" (total managed) byte count is wildly double counted,
   // since it all comes from HugeAllocator but is then managed by
   // cache/regions/filler. Adjust for that.
   stats.system_bytes = actual_system;
+  // Gigantic pages don't come from HugeAllocator.
+  stats += gigantic_.stats();
   return stats;
 }
 
@@ -833,47 +1261,70 @@ inline void HugePageAwareAllocator<Forwarder>::GetSpanStats(
 
   alloc_.AddSpanStats(small, large);
   filler_.AddSpanStats(small, large);
+  short_lived_filler_.AddSpanStats(small, large);
   regions_.AddSpanStats(small, large);
+  long_lived_regions_.AddSpanStats(small, large);
   cache_.AddSpanStats(small, large);
+  gigantic_.AddSpanStats(small, large);
 }
 
-// public
 template <class Forwarder>
-inline Length HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPages(
+inline Length HugePageAwareAllocator<Forwarder>::ReleaseCachedHugepages(
     Length num_pages, PageReleaseReason reason) {
   Length released;
-  released += cache_.ReleaseCachedPages(HLFromPages(num_pages)).in_pages();
+  released += cache_
+                  .ReleaseCachedPages(
+                      HLFromPages(num_pages),
+                      /*hit_limit=*/reason ==
+                              PageReleaseReason::kSoftLimitExceeded ||
+                          reason == PageReleaseReason::kHardLimitExceeded)
+                  .in_pages();
 
   // Release all backed-but-free hugepages from HugeRegion.
   // TODO(b/199203282): We release all the free hugepages from HugeRegions when
   // the experiment is enabled. We can also explore releasing only a desired
   // number of pages.
   if (regions_.UseHugeRegionMoreOften()) {
-    if (forwarder_.huge_region_demand_based_release()) {
-      if (released < num_pages) {
-        released += regions_.ReleasePagesByPeakDemand(
-            num_pages - released,
-            SkipSubreleaseIntervals{
-                .peak_interval = forwarder_.filler_skip_subrelease_interval(),
-                .short_interval =
-                    forwarder_.filler_skip_subrelease_short_interval(),
-                .long_interval =
-                    forwarder_.filler_skip_subrelease_long_interval()},
-            /*hit_limit*/ false);
-      }
-    } else {
-      constexpr double kFractionPagesToRelease = 0.1;
-      released += regions_.ReleasePages(kFractionPagesToRelease);
-    }
+    constexpr double kFractionPagesToRelease = 0.1;
+    released += ReleaseRegions(
+        num_pages > released ? num_pages - released : Length(0),
+        kFractionPagesToRelease,
+        SkipSubreleaseIntervals{
+            .peak_interval = forwarder_.filler_skip_subrelease_interval(),
+            .short_interval =
+                forwarder_.filler_skip_subrelease_short_interval(),
+            .long_interval =
+                forwarder_.filler_skip_subrelease_long_interval()},
+        /*hit_limit=*/false);
   }
+  return released;
+}
+
+// public
+template <class Forwarder>
+inline Length HugePageAwareAllocator<Forwarder>::ReleaseFreeHugepages(
+    Length num_pages, PageReleaseReason reason) {
+  const Length released = ReleaseCachedHugepages(num_pages, reason);
+  info_.RecordRelease(num_pages, released, reason);
+  return released;
+}
+
+// public
+template <class Forwarder>
+inline Length HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPages(
+    Length num_pages, PageReleaseReason reason) {
+  Length released = ReleaseCachedHugepages(num_pages, reason);
 
   // This is our long term plan but in current state will lead to insufficient
   // THP coverage. It is however very useful to have the ability to turn this on
   // for testing.
   // TODO(b/134690769): make this work, remove the flag guard.
   if (hpaa_subrelease()) {
-    if (released < num_pages) {
-      released += filler_.ReleasePages(
+    for (FillerType* filler : {&filler_, &short_lived_filler_}) {
+      if (released >= num_pages) {
+        break;
+      }
+      released += filler->ReleasePages(
           num_pages - released,
           SkipSubreleaseIntervals{
               .peak_interval = forwarder_.filler_skip_subrelease_interval(),
@@ -932,10 +1383,15 @@ inline void HugePageAwareAllocator<Forwarder>::Print(Printer* out,
       "------------------------------------------------\n");
   out->printf("HugePageAware: breakdown of used / free / unmapped space:\n");
 
-  auto fstats = filler_.stats();
-  BreakdownStats(out, fstats, "HugePageAware: filler  ");
+  auto fstats = FillerStats();
+  const BackingStats short_lived_fstats = short_lived_filler_.stats();
+  BreakdownStats(out, filler_.stats(), "HugePageAware: filler  ");
+  if (short_lived_fstats.system_bytes > 0) {
+    BreakdownStats(out, short_lived_fstats,
+                   "HugePageAware: short-lived filler");
+  }
 
-  auto rstats = regions_.stats();
+  auto rstats = RegionsStats();
   BreakdownStats(out, rstats, "HugePageAware: region  ");
 
   auto cstats = cache_.stats();
@@ -949,6 +1405,7 @@ inline void HugePageAwareAllocator<Forwarder>::Print(Printer* out,
   // so again adjust the totals.
   astats.system_bytes -= (fstats + rstats + cstats).system_bytes;
   BreakdownStats(out, astats, "HugePageAware: alloc   ");
+  BreakdownStats(out, gigantic_.stats(), "HugePageAware: gigantic");
   out->printf("\n");
 
   out->printf(
@@ -961,11 +1418,22 @@ inline void HugePageAwareAllocator<Forwarder>::Print(Printer* out,
   // unconditionally.
   filler_.Print(out, everything);
   out->printf("\n");
+  if (short_lived_fstats.system_bytes > 0) {
+    out->printf("HugePageAware: filler for short-lived allocations\n");
+    short_lived_filler_.Print(out, everything);
+    out->printf("\n");
+  }
   if (everything) {
     regions_.Print(out);
     out->printf("\n");
+    if (long_lived_regions_.stats().system_bytes > 0) {
+      out->printf("HugePageAware: regions for long-lived allocations\n");
+      long_lived_regions_.Print(out);
+      out->printf("\n");
+    }
     cache_.Print(out);
     alloc_.Print(out);
+    gigantic_.Print(out);
     out->printf("\n");
 
     // Use statistics
@@ -993,11 +1461,15 @@ inline void HugePageAwareAllocator<Forwarder>::PrintInPbtxt(
                    regions_.UseHugeRegionMoreOften());
 
     // Fill HPAA Usage
-    auto fstats = filler_.stats();
-    BreakdownStatsInPbtxt(&hpaa, fstats, "filler_usage");
+    auto fstats = FillerStats();
+    BreakdownStatsInPbtxt(&hpaa, filler_.stats(), "filler_usage");
+    BreakdownStatsInPbtxt(&hpaa, short_lived_filler_.stats(),
+                          "short_lived_filler_usage");
 
-    auto rstats = regions_.stats();
+    auto rstats = RegionsStats();
     BreakdownStatsInPbtxt(&hpaa, rstats, "region_usage");
+    BreakdownStatsInPbtxt(&hpaa, long_lived_regions_.stats(),
+                          "long_lived_region_usage");
 
     auto cstats = cache_.stats();
     // Everything in the filler came from the cache -
@@ -1011,11 +1483,13 @@ inline void HugePageAwareAllocator<Forwarder>::PrintInPbtxt(
     astats.system_bytes -= (fstats + rstats + cstats).system_bytes;
 
     BreakdownStatsInPbtxt(&hpaa, astats, "alloc_usage");
+    BreakdownStatsInPbtxt(&hpaa, gigantic_.stats(), "gigantic_usage");
 
     filler_.PrintInPbtxt(&hpaa);
     regions_.PrintInPbtxt(&hpaa);
     cache_.PrintInPbtxt(&hpaa);
     alloc_.PrintInPbtxt(&hpaa);
+    gigantic_.PrintInPbtxt(&hpaa);
 
     // Use statistics
     info_.PrintInPbtxt(&hpaa, "hpaa_stat");
@@ -1046,25 +1520,57 @@ HugePageAwareAllocator<Forwarder>::ReleaseAtLeastNPagesBreakingHugepages(
 
   Length released;
   // We try to release as many free hugepages from HugeRegion as possible.
-  if (forwarder_.huge_region_demand_based_release()) {
-    released += regions_.ReleasePagesByPeakDemand(
-        n - released, SkipSubreleaseIntervals{}, /*hit_limit=*/true);
-  } else {
-    released += regions_.ReleasePages(/*release_fraction=*/1.0);
-  }
+  released += ReleaseRegions(n, /*release_fraction=*/1.0,
+                             SkipSubreleaseIntervals{}, /*hit_limit=*/true);
 
   if (released >= n) {
     return released;
   }
 
-  released += filler_.ReleasePages(n - released, SkipSubreleaseIntervals{},
-                                   /*release_partial_alloc_pages=*/false,
-                                   /*hit_limit=*/true);
+  for (FillerType* filler : {&filler_, &short_lived_filler_}) {
+    if (released >= n) {
+      break;
+    }
+    released += filler->ReleasePages(n - released, SkipSubreleaseIntervals{},
+                                     /*release_partial_alloc_pages=*/false,
+                                     /*hit_limit=*/true);
+  }
 
   info_.RecordRelease(n, released, reason);
   return released;
 }
 
+template <class Forwarder>
+inline HugeLength HugePageAwareAllocator<Forwarder>::CollapseHugePages(
+    HugeLength max) {
+  const HugeLength collapsed = filler_.CollapseHugePages(max, collapse_);
+  return collapsed +
+         short_lived_filler_.CollapseHugePages(max - collapsed, collapse_);
+}
+
+template <class Forwarder>
+inline HugeLength HugePageAwareAllocator<Forwarder>::AuditHugePages(
+    HugeLength max, HugePageBackingFunction& backing) {
+  // Only the filler's hugepages are worth auditing: it alone breaks hugepages
+  // up and collapses them again.
+  const HugeLength audited = filler_.AuditHugePages(max, backing);
+  return audited +
+         short_lived_filler_.AuditHugePages(max - audited, backing);
+}
+
+template <class Forwarder>
+inline HugeLength HugePageAwareAllocator<Forwarder>::TierHugePages(
+    HugeLength max, HugePageTieringFunction& tiering) {
+  // The warm tier's memory already lives on the far node.  Elsewhere, only
+  // the filler's hugepages go idle piecemeal; the cache and regions hand out
+  // large allocations whose lifetimes we leave to release.
+  if (tag_ == MemoryTag::kWarm) {
+    return NHugePages(0);
+  }
+  const HugeLength tiered = filler_.TierHugePages(max, tiering);
+  return tiered + short_lived_filler_.TierHugePages(max - tiered, tiering);
+}
+
 template <class Forwarder>
 inline PageReleaseStats HugePageAwareAllocator<Forwarder>::GetReleaseStats()
     const {
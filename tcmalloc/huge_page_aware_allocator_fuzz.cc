@@ -99,15 +99,18 @@ void FuzzHPAA(const std::string& s) {
   //                  deallocate.
 
   constexpr MemoryTag kTagOptions[] = {
-      MemoryTag::kSampled, MemoryTag::kNormalP0, MemoryTag::kNormalP1,
-      MemoryTag::kNormal, MemoryTag::kCold};
+      MemoryTag::kSampled,  MemoryTag::kNormalP0, MemoryTag::kNormalP1,
+      MemoryTag::kNormalP2, MemoryTag::kNormalP3, MemoryTag::kNormal,
+      MemoryTag::kCold,     MemoryTag::kWarm};
   constexpr int kTagSize = sizeof(kTagOptions) / sizeof(MemoryTag);
   static_assert(kTagSize > 0);
   MemoryTag tag = kTagOptions[static_cast<uint8_t>(data[0]) % kTagSize];
-  // Use kNormalP1 memory tag only if we have more than one NUMA partitions.
-  tag = (kNumaPartitions == 1 && tag == MemoryTag::kNormalP1)
-            ? MemoryTag::kNormalP0
-            : tag;
+  // Use the tags of NUMA partitions that we have only.
+  if (NumaPartitionFromTag(tag) == kNumaPartitions &&
+      tag != MemoryTag::kSampled && tag != MemoryTag::kCold &&
+      (tag != MemoryTag::kWarm || !kWarmTierPresent)) {
+    tag = MemoryTag::kNormalP0;
+  }
 
   const HugeRegionUsageOption huge_region_option =
       static_cast<uint8_t>(data[1]) >= 128
@@ -305,6 +305,162 @@ TEST_P(HugePageAwareAllocatorTest, JustUnderMultipleOfHugepages) {
   }
 }
 
+TEST_P(HugePageAwareAllocatorTest, LifetimePredictions) {
+  const Length n = 2 * kPagesPerHugePage + Length(1);
+  auto used_bytes = [](const BackingStats& s) {
+    return s.system_bytes - s.free_bytes - s.unmapped_bytes;
+  };
+
+  // Long-lived multi-hugepage allocations go to the dedicated regions, and do
+  // not donate their slack to the filler.
+  Span* long_lived = New(n, {.objects_per_span = 1,
+                             .density = AccessDensityPrediction::kSparse,
+                             .lifetime = LifetimePrediction::kLongLived});
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(used_bytes(allocator_->LongLivedRegionsStats()), n.in_bytes());
+    EXPECT_EQ(allocator_->DonatedHugePages(), NHugePages(0));
+  }
+
+  // Short-lived ones come straight from the HugeCache.
+  Span* short_lived = New(n, {.objects_per_span = 1,
+                              .density = AccessDensityPrediction::kSparse,
+                              .lifetime = LifetimePrediction::kShortLived});
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(used_bytes(allocator_->RegionsStats()), n.in_bytes());
+    EXPECT_EQ(allocator_->DonatedHugePages(), NHugePages(1));
+  }
+
+  Delete(short_lived, 1);
+  Delete(long_lived, 1);
+  PageHeapSpinLockHolder l;
+  EXPECT_EQ(used_bytes(allocator_->LongLivedRegionsStats()), 0);
+}
+
+TEST_P(HugePageAwareAllocatorTest, ShortLivedFiller) {
+  const bool previous = Parameters::lifetime_aware_filler_placement();
+  Parameters::set_lifetime_aware_filler_placement(true);
+  auto used_bytes = [](const BackingStats& s) {
+    return s.system_bytes - s.free_bytes - s.unmapped_bytes;
+  };
+  const SpanAllocInfo kLongLived = {
+      .objects_per_span = 1,
+      .density = AccessDensityPrediction::kSparse,
+      .lifetime = LifetimePrediction::kLongLived};
+  const SpanAllocInfo kShortLived = {
+      .objects_per_span = 1,
+      .density = AccessDensityPrediction::kSparse,
+      .lifetime = LifetimePrediction::kShortLived};
+
+  // Short-lived allocations get hugepages of their own, small ones and those
+  // too large to share a hugepage alike, and donate no slack.
+  Span* long_lived = New(Length(1), kLongLived);
+  Span* small = New(Length(1), kShortLived);
+  const Length large_n = kPagesPerHugePage / 2 + Length(1);
+  Span* large = New(large_n, kShortLived);
+  EXPECT_NE(HugePageContaining(long_lived->first_page()),
+            HugePageContaining(small->first_page()));
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(used_bytes(allocator_->ShortLivedFillerStats()),
+              (Length(1) + large_n).in_bytes());
+    EXPECT_EQ(used_bytes(allocator_->FillerStats()),
+              (Length(2) + large_n).in_bytes());
+    EXPECT_EQ(allocator_->DonatedHugePages(), NHugePages(0));
+  }
+  EXPECT_THAT(Print(), HasSubstr("HugePageAware: short-lived filler"));
+
+  // Frees find their way back however the parameter is set by then.
+  Parameters::set_lifetime_aware_filler_placement(false);
+  Delete(large, 1);
+  Delete(small, 1);
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(used_bytes(allocator_->ShortLivedFillerStats()), 0);
+  }
+  Delete(long_lived, 1);
+  Parameters::set_lifetime_aware_filler_placement(previous);
+}
+
+TEST_P(HugePageAwareAllocatorTest, GiganticPages) {
+  constexpr size_t kGiB = size_t{1} << 30;
+  const uint64_t previous = Parameters::gigantic_page_threshold();
+  Parameters::set_gigantic_page_threshold(kGiB);
+
+  const Length n = BytesToLengthCeil(kGiB) + Length(1);
+  Span* span = New(n, {.objects_per_span = 1,
+                       .density = AccessDensityPrediction::kSparse});
+  {
+    PageHeapSpinLockHolder l;
+    const BackingStats gigantic = allocator_->GiganticStats();
+    // Most machines have no pool of 1GiB pages, and fall back to 2MiB ones.
+    if (gigantic.system_bytes > 0) {
+      EXPECT_EQ(gigantic.system_bytes, 2 * kGiB);
+      EXPECT_EQ(gigantic.free_bytes, 2 * kGiB - HLFromPages(n).in_bytes());
+      // Hugetlb memory can't be subreleased, so no slack is donated.
+      EXPECT_EQ(allocator_->DonatedHugePages(), NHugePages(0));
+    } else {
+      EXPECT_EQ(allocator_->DonatedHugePages(), NHugePages(1));
+    }
+  }
+  Delete(span, 1);
+  {
+    // Gigantic pages are kept backed for reuse.
+    PageHeapSpinLockHolder l;
+    const BackingStats gigantic = allocator_->GiganticStats();
+    EXPECT_EQ(gigantic.free_bytes, gigantic.system_bytes);
+    EXPECT_EQ(gigantic.unmapped_bytes, 0);
+  }
+
+  Parameters::set_gigantic_page_threshold(previous);
+}
+
+TEST_P(HugePageAwareAllocatorTest, Remap) {
+  // Pages from custom region factories are never moved.
+  MallocExtension::SetRegionFactory(before_);
+  const SpanAllocInfo kSpanInfo = {1, AccessDensityPrediction::kSparse};
+  const Length n = 4 * kPagesPerHugePage;
+  Span* small = New(kPagesPerHugePage / 2, kSpanInfo);
+  Span* large = New(n, kSpanInfo);
+  auto fill = [](Span* span, Length len) {
+    for (Length i; i < len; ++i) {
+      *static_cast<size_t*>((span->first_page() + i).start_addr()) =
+          i.raw_num();
+    }
+  };
+  auto check = [](Span* span, Length len) {
+    for (Length i; i < len; ++i) {
+      ASSERT_EQ(*static_cast<size_t*>((span->first_page() + i).start_addr()),
+                i.raw_num());
+    }
+  };
+  fill(large, n);
+
+  // Spans from the filler stay put.
+  EXPECT_EQ(allocator_->Remap(small, n, kSpanInfo), nullptr);
+
+  Span* moved = allocator_->Remap(large, 2 * n + Length(1), kSpanInfo);
+  if (moved == nullptr) {
+    // The kernel may not move them, as before Linux 5.7.
+    check(large, n);
+  } else {
+    absl::base_internal::SpinLockHolder h(&lock_);
+    EXPECT_NE(moved, large);
+    EXPECT_EQ(moved->num_pages(), 2 * n + Length(1));
+    check(moved, n);
+    const size_t id = ids_[large];
+    ids_.erase(large);
+    ids_[moved] = id;
+    total_ += n + Length(1);
+    CheckStats();
+    large = moved;
+  }
+  Delete(large, 1);
+  Delete(small, 1);
+  MallocExtension::SetRegionFactory(extra_);
+}
+
 TEST_P(HugePageAwareAllocatorTest, Multithreaded) {
   static const size_t kThreads = 16;
   std::vector<std::thread> threads;
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <array>
 #include <limits>
+#include <optional>
 
 #include "absl/algorithm/container.h"
 #include "absl/base/attributes.h"
@@ -71,6 +72,8 @@ class PageTracker : public TList<PageTracker>::Elem {
         was_released_(false),
         abandoned_(false),
         unbroken_(true),
+        demoted_(false),
+        short_lived_(false),
         free_{} {
 #ifndef __ppc64__
 #if defined(__GNUC__)
@@ -116,6 +119,14 @@ class PageTracker : public TList<PageTracker>::Elem {
   // REQUIRES: p was the result of a previous call to Get(n)
   void Put(PageId p, Length n) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // REQUIRES: [p, p + n) is an allocation from Get, possibly resized since.
+  //
+  // Resizes it to new_n pages without moving it, if the pages it grows into
+  // are free, and returns true.  The count of previously unbacked pages among
+  // those is stored in *previously_unbacked.
+  bool TryResize(PageId p, Length n, Length new_n, Length* previously_unbacked)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Returns true if any unused pages have been returned-to-system.
   bool released() const { return released_count_ > 0; }
 
@@ -161,6 +172,18 @@ class PageTracker : public TList<PageTracker>::Elem {
   bool empty() const;
 
   bool unbroken() const { return unbroken_; }
+  // Records whether the system backs the hugepage with a single hugepage, as
+  // found by auditing it.
+  void set_unbroken(bool status) { unbroken_ = status; }
+
+  bool demoted() const { return demoted_; }
+  // Records whether the hugepage's memory was moved to the far tier.
+  void set_demoted(bool status) { demoted_ = status; }
+
+  bool short_lived() const { return short_lived_; }
+  // Records whether the hugepage is kept for allocations predicted to be
+  // short-lived, in a filler of their own.
+  void set_short_lived(bool status) { short_lived_ = status; }
 
   // Returns the hugepage whose availability is being tracked.
   HugePage location() const { return location_; }
@@ -170,6 +193,12 @@ class PageTracker : public TList<PageTracker>::Elem {
   Length ReleaseFree(MemoryModifyFunction& unback)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Asks the system to back the hugepage with a single hugepage again after it
+  // was broken up by subrelease.  Returns true on success.
+  // REQUIRES: !released()
+  bool Collapse(MemoryModifyFunction& collapse)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
   bool HasDenseSpans() const { return has_dense_spans_; }
   void SetHasDenseSpans() { has_dense_spans_ = true; }
@@ -192,6 +221,8 @@ class PageTracker : public TList<PageTracker>::Elem {
   // reset it once we measure those pages in abandoned_count_.
   bool abandoned_;
   bool unbroken_;
+  bool demoted_;
+  bool short_lived_;
 
   RangeTracker<kPagesPerHugePage.raw_num()> free_;
   // Bitmap of pages based on them being released to the OS.
@@ -240,6 +271,29 @@ struct HugePageFillerStats {
   HugeLength n_full[AccessDensityPrediction::kPredictionCounts + 1];
   // Number of hugepages in partially allocated (but not released) allocs.
   HugeLength n_partial[AccessDensityPrediction::kPredictionCounts + 1];
+  // Hugepages that were collapsed back into hugepages after subrelease, and
+  // the time spent collapsing them, since startup.
+  HugeLength n_collapsed;
+  absl::Duration collapse_time;
+  // Hugepages audited since startup.  Of those, how many we assumed were
+  // backed by a hugepage, how many actually were, and how many the kernel had
+  // split or collapsed without our knowing.
+  HugeLength n_audited;
+  HugeLength n_audited_assumed_huge;
+  HugeLength n_audited_huge;
+  HugeLength n_audit_split;
+  HugeLength n_audit_collapsed;
+  absl::Duration audit_time;
+  // Hugepages moved to the far tier after going idle, and back after being
+  // used again, since startup.
+  HugeLength n_demoted;
+  HugeLength n_promoted;
+  absl::Duration tier_time;
+  // Freshly donated hugepages taken for small spans since startup, and how
+  // many of those spans were predicted short-lived.  Small spans on a donated
+  // hugepage keep it from returning whole when its large allocation is freed.
+  HugeLength n_donated_used;
+  HugeLength n_donated_used_short_lived;
 };
 
 enum class HugePageFillerAllocsOption : bool {
@@ -249,10 +303,54 @@ enum class HugePageFillerAllocsOption : bool {
   kSeparateAllocs,
 };
 
+// Placement policies decide which of the hugepages with equally long free
+// ranges HugePageFiller prefers to allocate from.  The filler keeps hugepages
+// in lists ordered by longest free range first, then by the chunk the policy
+// assigns to them, and allocates from the first list that fits a request.  A
+// policy provides:
+//
+//   template <class TrackerType>
+//   static size_t ChunkFor(const TrackerType& pt, size_t chunks_per_alloc);
+//
+// which returns a chunk in [0, chunks_per_alloc), lower chunks being
+// preferred.  The chunk may only depend on the state of pt, which does not
+// change while pt is on a list.
+
+// Prefers hugepages with many allocations already present, spaced
+// logarithmically.  To first order allocations of any size are about as
+// likely to be freed, so a hugepage with few allocations is the most likely
+// to empty out.
+struct NallocsPlacementPolicy {
+  template <class TrackerType>
+  static size_t ChunkFor(const TrackerType& pt, size_t chunks_per_alloc) {
+    const size_t na = pt.nallocs();
+    // This equals 63 - ceil(log2(na))
+    // (or 31 if size_t is 4 bytes, etc.)
+    const size_t neg_ceil_log = __builtin_clzl(2 * na - 1);
+
+    // We want the same spread as neg_ceil_log, but spread over [0,
+    // chunks_per_alloc) (clamped at the left edge) instead of [0, 64). So
+    // subtract off the difference (computed by forcing na=1 to
+    // chunks_per_alloc - 1.)
+    const size_t kOffset = __builtin_clzl(1) - (chunks_per_alloc - 1);
+    return std::max(neg_ceil_log, kOffset) - kOffset;
+  }
+};
+
+// Prefers the hugepages with the most used pages, spaced linearly: a best fit
+// by occupancy rather than by allocation count.
+struct UsedPagesPlacementPolicy {
+  template <class TrackerType>
+  static size_t ChunkFor(const TrackerType& pt, size_t chunks_per_alloc) {
+    const Length free = kPagesPerHugePage - pt.used_pages();
+    return free.raw_num() * chunks_per_alloc / kPagesPerHugePage.raw_num();
+  }
+};
+
 // This tracks a set of unfilled hugepages, and fulfills allocations
 // with a goal of filling some hugepages as tightly as possible and emptying
 // out the remainder.
-template <class TrackerType>
+template <class TrackerType, class PlacementPolicy = NallocsPlacementPolicy>
 class HugePageFiller {
  public:
   explicit HugePageFiller(
@@ -292,6 +390,15 @@ class HugePageFiller {
   TrackerType* Put(TrackerType* pt, PageId p, Length n)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Resizes [p, p + n) to new_n pages without moving it and returns true if
+  // the pages it grows into are free, setting *from_released iff any of them
+  // are currently unbacked.  Otherwise, returns false.
+  // REQUIRES: {pt, p, n} was the result of a previous TryGet, possibly resized
+  // since, and new_n > 0.
+  bool TryResize(TrackerType* pt, PageId p, Length n, Length new_n,
+                 bool* from_released)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Contributes a tracker to the filler. If "donated," then the tracker is
   // marked as having come from the tail of a multi-hugepage allocation, which
   // causes it to be treated slightly differently.
@@ -310,6 +417,9 @@ class HugePageFiller {
   }
   Length used_pages() const { return pages_allocated(); }
   Length unmapped_pages() const { return unmapped_; }
+  // Returns the number of subreleased pages that were allocated again, and so
+  // faulted back in, since startup.
+  Length rebacked_pages() const { return rebacked_pages_; }
   Length free_pages() const;
   Length used_pages_in_released() const {
     TC_ASSERT_LE(n_used_released_[AccessDensityPrediction::kSparse],
@@ -378,6 +488,33 @@ class HugePageFiller {
   static constexpr size_t kCandidatesForReleasingMemory =
       kPagesPerHugePage.raw_num();
 
+  // Subrelease leaves a hugepage broken into small pages even once all of its
+  // pages are backed again.  Asks the system, through collapse, to restore
+  // hugepage backing for up to max such hugepages.  Returns the number of
+  // hugepages collapsed.
+  static constexpr HugeLength kMaxHugePagesToCollapse = NHugePages(4);
+  HugeLength CollapseHugePages(HugeLength max, MemoryModifyFunction& collapse)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // The kernel may split a hugepage behind our back, for instance under
+  // memory pressure, or khugepaged may collapse one that subrelease broke up.
+  // Checks, through backing, how the system backs up to max hugepages that
+  // have no released pages, continuing in address order from where the
+  // previous audit stopped, and updates their trackers to match.  Returns the
+  // number of hugepages whose backing could be determined.
+  static constexpr HugeLength kMaxHugePagesToAudit = NHugePages(16);
+  HugeLength AuditHugePages(HugeLength max, HugePageBackingFunction& backing)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Checks, through tiering, whether up to max hugepages with no released
+  // pages have gone idle, continuing in address order from where the previous
+  // call stopped.  Idle hugepages are demoted to the far tier, and demoted
+  // hugepages that are in use again are promoted back.  Returns the number of
+  // hugepages moved.
+  static constexpr HugeLength kMaxHugePagesToTier = NHugePages(16);
+  HugeLength TierHugePages(HugeLength max, HugePageTieringFunction& tiering)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
 
   BackingStats stats() const;
@@ -404,9 +541,7 @@ class HugePageFiller {
   // then into chunks_per_alloc_ chunks inside there by desirability of
   // allocation.
   static constexpr size_t kChunks = 16;
-  // Which chunk should this hugepage be in?
-  // This returns the largest possible value chunks_per_alloc_ - 1 iff
-  // pt has a single allocation.
+  // Which chunk should this hugepage be in?  This is up to PlacementPolicy.
   size_t IndexFor(TrackerType* pt) const;
   // Returns index for regular_alloc_.
   size_t ListFor(Length longest, size_t chunk) const;
@@ -493,11 +628,46 @@ class HugePageFiller {
 
   Length pages_allocated_[AccessDensityPrediction::kPredictionCounts];
   Length unmapped_;
+  Length rebacked_pages_;
 
   // How much have we eagerly unmapped (in already released hugepages), but
   // not reported to ReleasePages calls?
   Length unmapping_unaccounted_;
 
+  // Hugepages collapsed by CollapseHugePages, and the clock ticks it spent
+  // doing so.
+  const Clock clock_;
+  HugeLength n_collapsed_;
+  int64_t collapse_ticks_ = 0;
+
+  // Where the next AuditHugePages continues from, what it has found since
+  // startup, and the clock ticks it spent.
+  HugePage audit_next_ = {0};
+  HugeLength n_audited_;
+  HugeLength n_audited_assumed_huge_;
+  HugeLength n_audited_huge_;
+  HugeLength n_audit_split_;
+  HugeLength n_audit_collapsed_;
+  int64_t audit_ticks_ = 0;
+
+  // Where the next TierHugePages continues from, the hugepages it has moved
+  // since startup, and the clock ticks it spent.
+  HugePage tier_next_ = {0};
+  HugeLength n_demoted_;
+  HugeLength n_promoted_;
+  int64_t tier_ticks_ = 0;
+
+  // Donated hugepages taken for small spans since startup.
+  HugeLength n_donated_used_;
+  HugeLength n_donated_used_short_lived_;
+
+  // Gathers, sorted by address, up to max hugepages with no released pages
+  // at or after *next into candidates, and advances *next past them.  Returns
+  // the number of candidates.
+  size_t GatherUnreleasedHugePages(TrackerType** candidates, size_t max,
+                                   HugePage* next)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Functionality related to time series tracking.
   void UpdateFillerStatsTracker();
   using StatsTrackerType = SubreleaseStatsTracker<600>;
@@ -537,6 +707,30 @@ inline void PageTracker::Put(PageId p, Length n) {
   free_.Unmark(index.raw_num(), n.raw_num());
 }
 
+inline bool PageTracker::TryResize(PageId p, Length n, Length new_n,
+                                   Length* previously_unbacked) {
+  const size_t index = (p - location_.first_page()).raw_num();
+  *previously_unbacked = Length(0);
+  if (new_n < n) {
+    free_.Shrink(index, n.raw_num(), new_n.raw_num());
+    return true;
+  }
+  if (!free_.TryGrow(index, n.raw_num(), new_n.raw_num())) {
+    return false;
+  }
+  // As in Get, pages we grow into may have been released.
+  if (ABSL_PREDICT_FALSE(released_count_ > 0)) {
+    const size_t start = index + n.raw_num();
+    const size_t len = (new_n - n).raw_num();
+    const size_t unbacked = released_by_page_.CountBits(start, len);
+    released_by_page_.ClearRange(start, len);
+    TC_ASSERT_GE(released_count_, unbacked);
+    released_count_ -= unbacked;
+    *previously_unbacked = Length(unbacked);
+  }
+  return true;
+}
+
 inline Length PageTracker::ReleaseFree(MemoryModifyFunction& unback) {
   size_t count = 0;
   size_t index = 0;
@@ -627,14 +821,23 @@ inline void PageTracker::AddSpanStats(SmallSpanStats* small,
   }
 }
 
+inline bool PageTracker::Collapse(MemoryModifyFunction& collapse) {
+  TC_ASSERT(!released());
+  if (!collapse(location_.first_page(), kPagesPerHugePage)) {
+    return false;
+  }
+  unbroken_ = true;
+  return true;
+}
+
 inline bool PageTracker::empty() const { return free_.used() == 0; }
 
 inline Length PageTracker::free_pages() const {
   return kPagesPerHugePage - used_pages();
 }
 
-template <class TrackerType>
-inline HugePageFiller<TrackerType>::HugePageFiller(
+template <class TrackerType, class PlacementPolicy>
+inline HugePageFiller<TrackerType, PlacementPolicy>::HugePageFiller(
     HugePageFillerAllocsOption allocs_option, size_t chunks_per_alloc,
     MemoryModifyFunction& unback, MemoryModifyFunction& unback_without_lock)
     : HugePageFiller(Clock{.now = absl::base_internal::CycleClock::Now,
@@ -643,23 +846,25 @@ inline HugePageFiller<TrackerType>::HugePageFiller(
                      unback_without_lock) {}
 
 // For testing with mock clock
-template <class TrackerType>
-inline HugePageFiller<TrackerType>::HugePageFiller(
+template <class TrackerType, class PlacementPolicy>
+inline HugePageFiller<TrackerType, PlacementPolicy>::HugePageFiller(
     Clock clock, HugePageFillerAllocsOption allocs_option,
     size_t chunks_per_alloc, MemoryModifyFunction& unback,
     MemoryModifyFunction& unback_without_lock)
     : chunks_per_alloc_(chunks_per_alloc),
       allocs_for_sparse_and_dense_spans_(allocs_option),
       size_(NHugePages(0)),
+      clock_(clock),
       fillerstats_tracker_(clock, absl::Minutes(10), absl::Minutes(5)),
       unback_(unback),
       unback_without_lock_(unback_without_lock) {
   TC_ASSERT(chunks_per_alloc_ > 0 && chunks_per_alloc_ <= kChunks);
 }
 
-template <class TrackerType>
-inline typename HugePageFiller<TrackerType>::TryGetResult
-HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
+template <class TrackerType, class PlacementPolicy>
+inline typename HugePageFiller<TrackerType, PlacementPolicy>::TryGetResult
+HugePageFiller<TrackerType, PlacementPolicy>::TryGet(
+    Length n, SpanAllocInfo span_alloc_info) {
   TC_ASSERT_GT(n, Length(0));
 
   // How do we choose which hugepage to allocate from (among those with
@@ -726,6 +931,11 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
   // So all we have to do is find the first nonempty freelist in the regular
   // PageTrackerList that *could* support our allocation, and it will be our
   // best choice. If there is none we repeat with the donated PageTrackerList.
+  //
+  // Spans predicted short-lived are the likeliest to pin a donated hugepage
+  // past its large allocation's lifetime, for want of a few pages freed soon
+  // after, so they take a donated hugepage only when all else fails, even a
+  // released one.
   ASSUME(n < kPagesPerHugePage);
   TrackerType* pt;
 
@@ -736,15 +946,19 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
               IsDenseSpan(span_alloc_info.density)
           ? AccessDensityPrediction::kDense
           : AccessDensityPrediction::kSparse;
+  const bool short_lived =
+      span_alloc_info.lifetime == LifetimePrediction::kShortLived;
   do {
     pt = regular_alloc_[type].GetLeast(ListFor(n, 0));
     if (pt) {
       TC_ASSERT(!pt->donated());
       break;
     }
-    if (ABSL_PREDICT_TRUE(type == AccessDensityPrediction::kSparse)) {
+    if (ABSL_PREDICT_TRUE(type == AccessDensityPrediction::kSparse) &&
+        !short_lived) {
       pt = donated_alloc_.GetLeast(n.raw_num());
       if (pt) {
+        ++n_donated_used_;
         break;
       }
     }
@@ -764,6 +978,14 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
       n_used_released_[type] -= pt->used_pages();
       break;
     }
+    if (type == AccessDensityPrediction::kSparse && short_lived) {
+      pt = donated_alloc_.GetLeast(n.raw_num());
+      if (pt) {
+        ++n_donated_used_;
+        ++n_donated_used_short_lived_;
+        break;
+      }
+    }
 
     return {nullptr, PageId{0}};
   } while (false);
@@ -785,6 +1007,7 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
   TC_ASSERT(was_released || page_allocation.previously_unbacked == Length(0));
   TC_ASSERT_GE(unmapped_, page_allocation.previously_unbacked);
   unmapped_ -= page_allocation.previously_unbacked;
+  rebacked_pages_ += page_allocation.previously_unbacked;
   // We're being used for an allocation, so we are no longer considered
   // donated by this point.
   TC_ASSERT(!pt->donated());
@@ -792,13 +1015,56 @@ HugePageFiller<TrackerType>::TryGet(Length n, SpanAllocInfo span_alloc_info) {
   return {pt, page_allocation.page, was_released};
 }
 
+template <class TrackerType, class PlacementPolicy>
+inline bool HugePageFiller<TrackerType, PlacementPolicy>::TryResize(
+    TrackerType* pt, PageId p, Length n, Length new_n, bool* from_released) {
+  TC_ASSERT_GT(new_n, Length(0));
+  *from_released = false;
+  if (new_n == n) {
+    return true;
+  }
+  // The only allocation on a donated hugepage is the tail of a larger one,
+  // which is accounted for as such.
+  if (pt->donated()) {
+    return false;
+  }
+  // pt moves lists as its longest free range changes.
+  const bool was_released = pt->released();
+  RemoveFromFillerList(pt);
+  Length previously_unbacked;
+  const bool resized = pt->TryResize(p, n, new_n, &previously_unbacked);
+  if (resized) {
+    const AccessDensityPrediction type = pt->HasDenseSpans()
+                                             ? AccessDensityPrediction::kDense
+                                             : AccessDensityPrediction::kSparse;
+    if (new_n > n) {
+      pages_allocated_[type] += new_n - n;
+    } else {
+      TC_ASSERT_GE(pages_allocated_[type], n - new_n);
+      pages_allocated_[type] -= n - new_n;
+    }
+    TC_ASSERT_GE(unmapped_, previously_unbacked);
+    unmapped_ -= previously_unbacked;
+    rebacked_pages_ += previously_unbacked;
+    *from_released = previously_unbacked > Length(0);
+    // As in TryGet, record that a released hugepage is fully backed again.
+    if (was_released && !pt->released() && !pt->was_released()) {
+      pt->set_was_released(/*status=*/true);
+      ++n_was_released_[type];
+    }
+  }
+  AddToFillerList(pt);
+  UpdateFillerStatsTracker();
+  return resized;
+}
+
 // Marks [p, p + n) as usable by new allocations into *pt; returns pt
 // if that hugepage is now empty (nullptr otherwise.)
 // REQUIRES: pt is owned by this object (has been Contribute()), and
 // {pt, p, n} was the result of a previous TryGet.
-template <class TrackerType>
-inline TrackerType* HugePageFiller<TrackerType>::Put(TrackerType* pt, PageId p,
-                                                     Length n) {
+template <class TrackerType, class PlacementPolicy>
+inline TrackerType* HugePageFiller<TrackerType, PlacementPolicy>::Put(
+    TrackerType* pt, PageId p, Length n) {
   RemoveFromFillerList(pt);
   pt->Put(p, n);
   if (pt->HasDenseSpans()) {
@@ -851,8 +1117,8 @@ inline TrackerType* HugePageFiller<TrackerType>::Put(TrackerType* pt, PageId p,
   return nullptr;
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::Contribute(
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::Contribute(
     TrackerType* pt, bool donated, SpanAllocInfo span_alloc_info) {
   // A contributed huge page should not yet be subreleased.
   TC_ASSERT_EQ(pt->released_pages(), Length(0));
@@ -880,9 +1146,9 @@ inline void HugePageFiller<TrackerType>::Contribute(
   UpdateFillerStatsTracker();
 }
 
-template <class TrackerType>
+template <class TrackerType, class PlacementPolicy>
 template <size_t N>
-inline int HugePageFiller<TrackerType>::SelectCandidates(
+inline int HugePageFiller<TrackerType, PlacementPolicy>::SelectCandidates(
     absl::Span<TrackerType*> candidates, int current_candidates,
     const PageTrackerLists<N>& tracker_list, size_t tracker_start) {
   auto PushCandidate = [&](TrackerType* pt) {
@@ -923,8 +1189,8 @@ inline int HugePageFiller<TrackerType>::SelectCandidates(
   return current_candidates;
 }
 
-template <class TrackerType>
-inline Length HugePageFiller<TrackerType>::ReleaseCandidates(
+template <class TrackerType, class PlacementPolicy>
+inline Length HugePageFiller<TrackerType, PlacementPolicy>::ReleaseCandidates(
     absl::Span<TrackerType*> candidates, Length target) {
   absl::c_sort(candidates, CompareForSubrelease);
 
@@ -973,8 +1239,162 @@ inline Length HugePageFiller<TrackerType>::ReleaseCandidates(
   return total_released;
 }
 
-template <class TrackerType>
-inline Length HugePageFiller<TrackerType>::FreePagesInPartialAllocs() const {
+template <class TrackerType, class PlacementPolicy>
+inline HugeLength
+HugePageFiller<TrackerType, PlacementPolicy>::CollapseHugePages(
+    HugeLength max, MemoryModifyFunction& collapse) {
+  // Only hugepages that were broken up, by subrelease or by the kernel, and
+  // have no released pages are candidates; collapsing a hugepage with
+  // unbacked pages would back them.
+  if ((previously_released_huge_pages() == NHugePages(0) &&
+       n_audit_split_ == NHugePages(0)) ||
+      max == NHugePages(0)) {
+    return NHugePages(0);
+  }
+  TrackerType* candidates[kMaxHugePagesToCollapse.raw_num()];
+  const size_t max_candidates =
+      std::min(max, kMaxHugePagesToCollapse).raw_num();
+  size_t num_candidates = 0;
+  auto add_candidate = [&](TrackerType* pt) {
+    if (num_candidates < max_candidates && !pt->released() &&
+        !pt->unbroken()) {
+      candidates[num_candidates++] = pt;
+    }
+  };
+  for (const AccessDensityPrediction type :
+       {AccessDensityPrediction::kSparse, AccessDensityPrediction::kDense}) {
+    regular_alloc_[type].Iter(add_candidate, 0);
+  }
+
+  HugeLength collapsed;
+  const int64_t start = clock_.now();
+  for (size_t i = 0; i < num_candidates; ++i) {
+    if (candidates[i]->Collapse(collapse)) {
+      ++collapsed;
+    }
+  }
+  collapse_ticks_ += clock_.now() - start;
+  n_collapsed_ += collapsed;
+  return collapsed;
+}
+
+template <class TrackerType, class PlacementPolicy>
+inline size_t
+HugePageFiller<TrackerType, PlacementPolicy>::GatherUnreleasedHugePages(
+    TrackerType** candidates, size_t max, HugePage* next) {
+  size_t num_candidates = 0;
+  bool more = false;
+  auto add_candidate = [&](TrackerType* pt) {
+    const HugePage p = pt->location();
+    if (pt->released() || p < *next) {
+      return;
+    }
+    if (num_candidates == max) {
+      more = true;
+      if (candidates[num_candidates - 1]->location() < p) {
+        return;
+      }
+      --num_candidates;
+    }
+    size_t i = num_candidates++;
+    for (; i > 0 && p < candidates[i - 1]->location(); --i) {
+      candidates[i] = candidates[i - 1];
+    }
+    candidates[i] = pt;
+  };
+  for (const AccessDensityPrediction type :
+       {AccessDensityPrediction::kSparse, AccessDensityPrediction::kDense}) {
+    regular_alloc_[type].Iter(add_candidate, 0);
+  }
+  donated_alloc_.Iter(add_candidate, 0);
+  if (more) {
+    *next = candidates[num_candidates - 1]->location() + NHugePages(1);
+  } else {
+    // We reached the end of the filler; the next call starts over.
+    *next = HugePage{0};
+  }
+  return num_candidates;
+}
+
+template <class TrackerType, class PlacementPolicy>
+inline HugeLength HugePageFiller<TrackerType, PlacementPolicy>::AuditHugePages(
+    HugeLength max, HugePageBackingFunction& backing) {
+  if (max == NHugePages(0)) {
+    return NHugePages(0);
+  }
+  // Released hugepages are broken up by design, so we skip them.
+  TrackerType* candidates[kMaxHugePagesToAudit.raw_num()];
+  const size_t num_candidates = GatherUnreleasedHugePages(
+      candidates, std::min(max, kMaxHugePagesToAudit).raw_num(), &audit_next_);
+
+  HugeLength audited;
+  const int64_t start = clock_.now();
+  for (size_t i = 0; i < num_candidates; ++i) {
+    TrackerType* pt = candidates[i];
+    const HugePageBacking actual = backing(pt->location());
+    if (actual == HugePageBacking::kUnknown) {
+      continue;
+    }
+    const bool assumed_huge = pt->unbroken();
+    const bool huge = actual == HugePageBacking::kHugePage;
+    ++audited;
+    if (assumed_huge) {
+      ++n_audited_assumed_huge_;
+    }
+    if (huge) {
+      ++n_audited_huge_;
+    }
+    if (assumed_huge && !huge) {
+      ++n_audit_split_;
+    } else if (!assumed_huge && huge) {
+      ++n_audit_collapsed_;
+    }
+    pt->set_unbroken(huge);
+  }
+  audit_ticks_ += clock_.now() - start;
+  n_audited_ += audited;
+  return audited;
+}
+
+template <class TrackerType, class PlacementPolicy>
+inline HugeLength HugePageFiller<TrackerType, PlacementPolicy>::TierHugePages(
+    HugeLength max, HugePageTieringFunction& tiering) {
+  if (max == NHugePages(0)) {
+    return NHugePages(0);
+  }
+  // Released hugepages are only partially backed; subrelease already returns
+  // their idle memory, so we leave them alone.
+  TrackerType* candidates[kMaxHugePagesToTier.raw_num()];
+  const size_t num_candidates = GatherUnreleasedHugePages(
+      candidates, std::min(max, kMaxHugePagesToTier).raw_num(), &tier_next_);
+
+  HugeLength moved;
+  const int64_t start = clock_.now();
+  for (size_t i = 0; i < num_candidates; ++i) {
+    TrackerType* pt = candidates[i];
+    const std::optional<bool> idle = tiering.IsIdle(pt->location());
+    if (!idle.has_value() || *idle == pt->demoted()) {
+      continue;
+    }
+    if (*idle) {
+      if (tiering.Demote(pt->location())) {
+        pt->set_demoted(true);
+        ++n_demoted_;
+        ++moved;
+      }
+    } else if (tiering.Promote(pt->location())) {
+      pt->set_demoted(false);
+      ++n_promoted_;
+      ++moved;
+    }
+  }
+  tier_ticks_ += clock_.now() - start;
+  return moved;
+}
+
+template <class TrackerType, class PlacementPolicy>
+inline Length
+HugePageFiller<TrackerType, PlacementPolicy>::FreePagesInPartialAllocs() const {
   return regular_alloc_partial_released_[AccessDensityPrediction::kSparse]
              .size()
              .in_pages() +
@@ -990,8 +1410,9 @@ inline Length HugePageFiller<TrackerType>::FreePagesInPartialAllocs() const {
          used_pages_in_any_subreleased() - unmapped_pages();
 }
 
-template <class TrackerType>
-inline Length HugePageFiller<TrackerType>::GetDesiredSubreleasePages(
+template <class TrackerType, class PlacementPolicy>
+inline Length
+HugePageFiller<TrackerType, PlacementPolicy>::GetDesiredSubreleasePages(
     Length desired, Length total_released, SkipSubreleaseIntervals intervals) {
   // Don't subrelease pages if it would push you under either the latest peak or
   // the sum of short-term demand fluctuation peak and long-term demand trend.
@@ -1054,8 +1475,8 @@ inline Length HugePageFiller<TrackerType>::GetDesiredSubreleasePages(
 // Tries to release desired pages by iteratively releasing from the emptiest
 // possible hugepage and releasing its free memory to the system. Return the
 // number of pages actually released.
-template <class TrackerType>
-inline Length HugePageFiller<TrackerType>::ReleasePages(
+template <class TrackerType, class PlacementPolicy>
+inline Length HugePageFiller<TrackerType, PlacementPolicy>::ReleasePages(
     Length desired, SkipSubreleaseIntervals intervals,
     bool release_partial_alloc_pages, bool hit_limit) {
   Length total_released;
@@ -1170,8 +1591,8 @@ inline Length HugePageFiller<TrackerType>::ReleasePages(
   return total_released;
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::AddSpanStats(
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::AddSpanStats(
     SmallSpanStats* small, LargeSpanStats* large) const {
   auto loop = [&](const TrackerType* pt) { pt->AddSpanStats(small, large); };
   // We can skip the first chunks_per_tracker_list lists as they are known to be
@@ -1185,8 +1606,9 @@ inline void HugePageFiller<TrackerType>::AddSpanStats(
   }
 }
 
-template <class TrackerType>
-inline BackingStats HugePageFiller<TrackerType>::stats() const {
+template <class TrackerType, class PlacementPolicy>
+inline BackingStats HugePageFiller<TrackerType, PlacementPolicy>::stats()
+    const {
   BackingStats s;
   s.system_bytes = size_.in_bytes();
   s.free_bytes = free_pages().in_bytes();
@@ -1445,8 +1867,9 @@ class UsageInfo {
 };
 }  // namespace huge_page_filler_internal
 
-template <class TrackerType>
-inline HugePageFillerStats HugePageFiller<TrackerType>::GetStats() const {
+template <class TrackerType, class PlacementPolicy>
+inline HugePageFillerStats
+HugePageFiller<TrackerType, PlacementPolicy>::GetStats() const {
   HugePageFillerStats stats;
 
   // note chunks_per_alloc_, not kNumLists here--we're iterating *full*
@@ -1495,12 +1918,29 @@ inline HugePageFillerStats HugePageFiller<TrackerType>::GetStats() const {
   stats.n_partial[AccessDensityPrediction::kPredictionCounts] =
       size() - stats.n_released[AccessDensityPrediction::kPredictionCounts] -
       stats.n_full[AccessDensityPrediction::kPredictionCounts];
+
+  stats.n_collapsed = n_collapsed_;
+  stats.collapse_time = absl::Seconds(collapse_ticks_ / clock_.freq());
+
+  stats.n_audited = n_audited_;
+  stats.n_audited_assumed_huge = n_audited_assumed_huge_;
+  stats.n_audited_huge = n_audited_huge_;
+  stats.n_audit_split = n_audit_split_;
+  stats.n_audit_collapsed = n_audit_collapsed_;
+  stats.audit_time = absl::Seconds(audit_ticks_ / clock_.freq());
+
+  stats.n_demoted = n_demoted_;
+  stats.n_promoted = n_promoted_;
+  stats.tier_time = absl::Seconds(tier_ticks_ / clock_.freq());
+
+  stats.n_donated_used = n_donated_used_;
+  stats.n_donated_used_short_lived = n_donated_used_short_lived_;
   return stats;
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::Print(Printer* out,
-                                               bool everything) const {
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::Print(
+    Printer* out, bool everything) const {
   out->printf("HugePageFiller: densely pack small requests into hugepages\n");
   const HugePageFillerStats stats = GetStats();
 
@@ -1579,6 +2019,29 @@ inline void HugePageFiller<TrackerType>::Print(Printer* out,
       subrelease_stats_.total_hugepages_broken.raw_num(),
       subrelease_stats_.total_pages_subreleased_due_to_limit.raw_num(),
       subrelease_stats_.total_hugepages_broken_due_to_limit.raw_num());
+  out->printf(
+      "HugePageFiller: Since startup, %zu hugepages collapsed after "
+      "subrelease, %.3f ms spent collapsing\n",
+      stats.n_collapsed.raw_num(),
+      absl::ToDoubleMilliseconds(stats.collapse_time));
+  out->printf(
+      "HugePageFiller: Since startup, %zu hugepages audited, %zu assumed and "
+      "%zu found backed by hugepages (%zu split and %zu collapsed by the "
+      "kernel), %.3f ms spent auditing\n",
+      stats.n_audited.raw_num(), stats.n_audited_assumed_huge.raw_num(),
+      stats.n_audited_huge.raw_num(), stats.n_audit_split.raw_num(),
+      stats.n_audit_collapsed.raw_num(),
+      absl::ToDoubleMilliseconds(stats.audit_time));
+  out->printf(
+      "HugePageFiller: Since startup, %zu idle hugepages demoted to the far "
+      "tier and %zu promoted back, %.3f ms spent tiering\n",
+      stats.n_demoted.raw_num(), stats.n_promoted.raw_num(),
+      absl::ToDoubleMilliseconds(stats.tier_time));
+  out->printf(
+      "HugePageFiller: Since startup, %zu donated hugepages taken for small "
+      "spans, %zu of them for spans predicted short-lived\n",
+      stats.n_donated_used.raw_num(),
+      stats.n_donated_used_short_lived.raw_num());
 
   if (!everything) return;
 
@@ -1626,8 +2089,9 @@ inline void HugePageFiller<TrackerType>::Print(Printer* out,
   fillerstats_tracker_.Print(out, "HugePageFiller");
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::PrintAllocStatsInPbtxt(
+template <class TrackerType, class PlacementPolicy>
+inline void
+HugePageFiller<TrackerType, PlacementPolicy>::PrintAllocStatsInPbtxt(
     absl::string_view field, PbtxtRegion* hpaa,
     const HugePageFillerStats& stats, AccessDensityPrediction count) const {
   TC_ASSERT_LT(count, AccessDensityPrediction::kPredictionCounts);
@@ -1640,8 +2104,9 @@ inline void HugePageFiller<TrackerType>::PrintAllocStatsInPbtxt(
                         stats.n_partial_released[count].raw_num());
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::PrintInPbtxt(PbtxtRegion* hpaa) const {
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::PrintInPbtxt(
+    PbtxtRegion* hpaa) const {
   const HugePageFillerStats stats = GetStats();
 
   // A donated alloc full list is impossible because it would have never been
@@ -1705,6 +2170,29 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(PbtxtRegion* hpaa) const {
   hpaa->PrintI64(
       "filler_num_hugepages_broken_due_to_limit",
       subrelease_stats_.total_hugepages_broken_due_to_limit.raw_num());
+  hpaa->PrintI64("filler_num_hugepages_collapsed",
+                 stats.n_collapsed.raw_num());
+  hpaa->PrintI64("filler_collapse_time_ns",
+                 absl::ToInt64Nanoseconds(stats.collapse_time));
+  hpaa->PrintI64("filler_num_hugepages_audited", stats.n_audited.raw_num());
+  hpaa->PrintI64("filler_num_audited_assumed_hugepage_backed",
+                 stats.n_audited_assumed_huge.raw_num());
+  hpaa->PrintI64("filler_num_audited_hugepage_backed",
+                 stats.n_audited_huge.raw_num());
+  hpaa->PrintI64("filler_num_hugepages_split_by_kernel",
+                 stats.n_audit_split.raw_num());
+  hpaa->PrintI64("filler_num_hugepages_collapsed_by_kernel",
+                 stats.n_audit_collapsed.raw_num());
+  hpaa->PrintI64("filler_audit_time_ns",
+                 absl::ToInt64Nanoseconds(stats.audit_time));
+  hpaa->PrintI64("filler_num_hugepages_demoted", stats.n_demoted.raw_num());
+  hpaa->PrintI64("filler_num_hugepages_promoted", stats.n_promoted.raw_num());
+  hpaa->PrintI64("filler_tier_time_ns",
+                 absl::ToInt64Nanoseconds(stats.tier_time));
+  hpaa->PrintI64("filler_num_donated_hugepages_used",
+                 stats.n_donated_used.raw_num());
+  hpaa->PrintI64("filler_num_donated_hugepages_used_short_lived",
+                 stats.n_donated_used_short_lived.raw_num());
   // Compute some histograms of fullness.
   using huge_page_filler_internal::UsageInfo;
   UsageInfo usage;
@@ -1749,8 +2237,9 @@ inline void HugePageFiller<TrackerType>::PrintInPbtxt(PbtxtRegion* hpaa) const {
                                                    "filler_stats_timeseries");
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::UpdateFillerStatsTracker() {
+template <class TrackerType, class PlacementPolicy>
+inline void
+HugePageFiller<TrackerType, PlacementPolicy>::UpdateFillerStatsTracker() {
   StatsTrackerType::SubreleaseStats stats;
   stats.num_pages = pages_allocated();
   stats.free_pages = free_pages();
@@ -1777,38 +2266,28 @@ inline void HugePageFiller<TrackerType>::UpdateFillerStatsTracker() {
   subrelease_stats_.reset();
 }
 
-template <class TrackerType>
-inline size_t HugePageFiller<TrackerType>::IndexFor(TrackerType* pt) const {
+template <class TrackerType, class PlacementPolicy>
+inline size_t HugePageFiller<TrackerType, PlacementPolicy>::IndexFor(
+    TrackerType* pt) const {
   TC_ASSERT(!pt->empty());
-  // Prefer to allocate from hugepages with many allocations already present;
-  // spaced logarithmically.
-  const size_t na = pt->nallocs();
-  // This equals 63 - ceil(log2(na))
-  // (or 31 if size_t is 4 bytes, etc.)
-  const size_t neg_ceil_log = __builtin_clzl(2 * na - 1);
-
-  // We want the same spread as neg_ceil_log, but spread over [0,
-  // chunks_per_alloc_) (clamped at the left edge) instead of [0, 64). So
-  // subtract off the difference (computed by forcing na=1 to
-  // chunks_per_alloc_ - 1.)
-  const size_t kOffset = __builtin_clzl(1) - (chunks_per_alloc_ - 1);
-  const size_t i = std::max(neg_ceil_log, kOffset) - kOffset;
+  const size_t i = PlacementPolicy::ChunkFor(*pt, chunks_per_alloc_);
   TC_ASSERT_LT(i, chunks_per_alloc_);
   TC_ASSERT_LT(i, kChunks);
   return i;
 }
 
-template <class TrackerType>
-inline size_t HugePageFiller<TrackerType>::ListFor(const Length longest,
-                                                   const size_t chunk) const {
+template <class TrackerType, class PlacementPolicy>
+inline size_t HugePageFiller<TrackerType, PlacementPolicy>::ListFor(
+    const Length longest, const size_t chunk) const {
   TC_ASSERT_LT(chunk, kChunks);
   TC_ASSERT_LT(chunk, chunks_per_alloc_);
   TC_ASSERT_LT(longest, kPagesPerHugePage);
   return longest.raw_num() * chunks_per_alloc_ + chunk;
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::RemoveFromFillerList(TrackerType* pt) {
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::RemoveFromFillerList(
+    TrackerType* pt) {
   Length longest = pt->longest_free_range();
   TC_ASSERT_LT(longest, kPagesPerHugePage);
 
@@ -1839,8 +2318,9 @@ inline void HugePageFiller<TrackerType>::RemoveFromFillerList(TrackerType* pt) {
   }
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::AddToFillerList(TrackerType* pt) {
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::AddToFillerList(
+    TrackerType* pt) {
   size_t chunk = IndexFor(pt);
   Length longest = pt->longest_free_range();
   TC_ASSERT_LT(longest, kPagesPerHugePage);
@@ -1870,8 +2350,9 @@ inline void HugePageFiller<TrackerType>::AddToFillerList(TrackerType* pt) {
   }
 }
 
-template <class TrackerType>
-inline void HugePageFiller<TrackerType>::DonateToFillerList(TrackerType* pt) {
+template <class TrackerType, class PlacementPolicy>
+inline void HugePageFiller<TrackerType, PlacementPolicy>::DonateToFillerList(
+    TrackerType* pt) {
   Length longest = pt->longest_free_range();
   TC_ASSERT_LT(longest, kPagesPerHugePage);
 
@@ -1882,8 +2363,9 @@ inline void HugePageFiller<TrackerType>::DonateToFillerList(TrackerType* pt) {
   donated_alloc_.Add(pt, longest.raw_num());
 }
 
-template <class TrackerType>
-inline double HugePageFiller<TrackerType>::hugepage_frac() const {
+template <class TrackerType, class PlacementPolicy>
+inline double HugePageFiller<TrackerType, PlacementPolicy>::hugepage_frac()
+    const {
   // How many of our used pages are on non-huge pages? Since
   // everything on a released hugepage is either used or released,
   // just the difference:
@@ -1901,8 +2383,8 @@ inline double HugePageFiller<TrackerType>::hugepage_frac() const {
 }
 
 // Helper for stat functions.
-template <class TrackerType>
-inline Length HugePageFiller<TrackerType>::free_pages() const {
+template <class TrackerType, class PlacementPolicy>
+inline Length HugePageFiller<TrackerType, PlacementPolicy>::free_pages() const {
   return size().in_pages() - used_pages() - unmapped_pages();
 }
 
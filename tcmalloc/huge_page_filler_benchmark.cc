@@ -0,0 +1,296 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays traces of HugePageFiller Get/Put operations through different
+// placement policies and reports how well each keeps memory on intact
+// hugepages, and times TryGet against fillers holding many hugepages.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/random/random.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_page_filler.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/stats.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// One operation of a trace: allocates n pages as allocation id, frees
+// allocation id, or releases some of the filler's free pages.
+struct TraceOp {
+  enum Kind { kGet, kPut, kRelease };
+  Kind kind;
+  size_t id;
+  Length n;
+  SpanAllocInfo span_alloc_info;
+};
+
+class NoopUnback final : public MemoryModifyFunction {
+ public:
+  ABSL_MUST_USE_RESULT bool operator()(PageId p, Length len) override {
+    return true;
+  }
+};
+
+// Generates a trace that grows to about kPeakHugePages worth of small
+// allocations with random lifetimes, then shrinks to half of that.  Frees pick
+// a random live allocation, and a release of a tenth of the free pages is
+// interleaved every kReleaseInterval operations, modelling background
+// subrelease.
+std::vector<TraceOp> GenerateTrace() {
+  constexpr size_t kPeakHugePages = 256;
+  constexpr size_t kOps = 200000;
+  constexpr size_t kReleaseInterval = 1000;
+  const Length kPeak = kPagesPerHugePage * kPeakHugePages;
+
+  absl::BitGen rng(std::seed_seq{0});
+  std::vector<TraceOp> trace;
+  std::vector<std::pair<size_t, Length>> live;
+  Length live_pages;
+  size_t next_id = 0;
+  for (size_t i = 0; i < kOps; ++i) {
+    if (i % kReleaseInterval == kReleaseInterval - 1) {
+      trace.push_back({TraceOp::kRelease, 0, Length(0), {}});
+      continue;
+    }
+    // Grow during the first half of the trace, then shrink.
+    const Length target = i < kOps / 2 ? kPeak : kPeak / 2;
+    const bool get =
+        live.empty() ||
+        absl::Bernoulli(rng, live_pages < target ? 0.6 : 0.4);
+    if (get) {
+      // Mostly small spans, with a tail of larger ones.
+      const Length n =
+          absl::Bernoulli(rng, 0.9)
+              ? Length(absl::LogUniform<size_t>(rng, 1, 8))
+              : Length(absl::LogUniform<size_t>(
+                    rng, 1, kPagesPerHugePage.raw_num() / 2));
+      const size_t objects = absl::LogUniform<size_t>(rng, 1, 256);
+      const AccessDensityPrediction density =
+          objects > 16 ? AccessDensityPrediction::kDense
+                       : AccessDensityPrediction::kSparse;
+      trace.push_back({TraceOp::kGet, next_id, n, {objects, density}});
+      live.push_back({next_id, n});
+      live_pages += n;
+      ++next_id;
+    } else {
+      const size_t victim = absl::Uniform<size_t>(rng, 0, live.size());
+      std::swap(live[victim], live.back());
+      trace.push_back({TraceOp::kPut, live.back().first, live.back().second,
+                       {}});
+      live_pages -= live.back().second;
+      live.pop_back();
+    }
+  }
+  return trace;
+}
+
+const std::vector<TraceOp>& Trace() {
+  static const auto* trace = new std::vector<TraceOp>(GenerateTrace());
+  return *trace;
+}
+
+struct ReplayResult {
+  HugeLength hugepages;
+  double free_frac;
+  double hugepage_frac;
+};
+
+template <class PlacementPolicy>
+ReplayResult Replay(absl::Span<const TraceOp> trace, size_t chunks_per_alloc) {
+  struct Alloc {
+    PageTracker* pt = nullptr;
+    PageId p;
+    Length n;
+  };
+
+  NoopUnback unback;
+  HugePageFiller<PageTracker, PlacementPolicy> filler(
+      HugePageFillerAllocsOption::kSeparateAllocs, chunks_per_alloc, unback,
+      unback);
+  std::vector<Alloc> allocs;
+  size_t next_hugepage = 1;
+  for (const TraceOp& op : trace) {
+    switch (op.kind) {
+      case TraceOp::kGet: {
+        typename HugePageFiller<PageTracker, PlacementPolicy>::TryGetResult
+            result;
+        {
+          PageHeapSpinLockHolder l;
+          result = filler.TryGet(op.n, op.span_alloc_info);
+        }
+        if (result.pt == nullptr) {
+          result.pt = new PageTracker(HugePage{.pn = next_hugepage++},
+                                      /*was_donated=*/false);
+          PageHeapSpinLockHolder l;
+          result.page = result.pt->Get(op.n).page;
+          filler.Contribute(result.pt, /*donated=*/false, op.span_alloc_info);
+        }
+        if (allocs.size() <= op.id) {
+          allocs.resize(op.id + 1);
+        }
+        allocs[op.id] = {result.pt, result.page, op.n};
+        break;
+      }
+      case TraceOp::kPut: {
+        Alloc& alloc = allocs[op.id];
+        PageTracker* empty;
+        {
+          PageHeapSpinLockHolder l;
+          empty = filler.Put(alloc.pt, alloc.p, alloc.n);
+        }
+        delete empty;
+        alloc.pt = nullptr;
+        break;
+      }
+      case TraceOp::kRelease: {
+        PageHeapSpinLockHolder l;
+        filler.ReleasePages(filler.free_pages() / 10,
+                            SkipSubreleaseIntervals{},
+                            /*release_partial_alloc_pages=*/false,
+                            /*hit_limit=*/false);
+        break;
+      }
+    }
+  }
+
+  ReplayResult result;
+  {
+    PageHeapSpinLockHolder l;
+    result.hugepages = filler.size();
+    result.free_frac =
+        static_cast<double>(filler.free_pages().raw_num()) /
+        std::max<size_t>(filler.size().in_pages().raw_num(), 1);
+    result.hugepage_frac = filler.hugepage_frac();
+  }
+
+  // Drain the filler so that its trackers can be freed.
+  for (const Alloc& alloc : allocs) {
+    if (alloc.pt == nullptr) {
+      continue;
+    }
+    PageTracker* empty;
+    {
+      PageHeapSpinLockHolder l;
+      empty = filler.Put(alloc.pt, alloc.p, alloc.n);
+    }
+    delete empty;
+  }
+  return result;
+}
+
+// Reports, after replaying the trace, the hugepages held by the filler, the
+// fraction of their pages that are free but backed (fragmentation), and the
+// fraction of used pages on intact hugepages (hugepage coverage).
+template <class PlacementPolicy>
+void BM_ReplayTrace(benchmark::State& state) {
+  const size_t chunks_per_alloc = state.range(0);
+  const std::vector<TraceOp>& trace = Trace();
+  ReplayResult result;
+  for (auto s : state) {
+    result = Replay<PlacementPolicy>(trace, chunks_per_alloc);
+  }
+  state.counters["hugepages"] = result.hugepages.raw_num();
+  state.counters["free_frac"] = result.free_frac;
+  state.counters["hugepage_frac"] = result.hugepage_frac;
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+
+BENCHMARK_TEMPLATE(BM_ReplayTrace, NallocsPlacementPolicy)
+    ->Arg(8)
+    ->Arg(16);
+BENCHMARK_TEMPLATE(BM_ReplayTrace, UsedPagesPlacementPolicy)
+    ->Arg(8)
+    ->Arg(16);
+
+// Times a TryGet, and the Put undoing it, against a filler of range(0)
+// hugepages that are each partly used by small allocations, as the filler's
+// search through its lists is done with pageheap_lock held.
+void BM_TryGet(benchmark::State& state) {
+  struct Alloc {
+    PageTracker* pt;
+    PageId p;
+    Length n;
+  };
+
+  const size_t hugepages = state.range(0);
+  NoopUnback unback;
+  HugePageFiller<PageTracker> filler(
+      HugePageFillerAllocsOption::kSeparateAllocs, /*chunks_per_alloc=*/16,
+      unback, unback);
+  absl::BitGen rng(std::seed_seq{0});
+  std::vector<Alloc> allocs;
+  for (size_t i = 0; i < hugepages; ++i) {
+    auto* pt = new PageTracker(HugePage{.pn = i + 1}, /*was_donated=*/false);
+    const SpanAllocInfo info = {1, absl::Bernoulli(rng, 0.5)
+                                       ? AccessDensityPrediction::kSparse
+                                       : AccessDensityPrediction::kDense};
+    const Length used =
+        Length(absl::Uniform<size_t>(rng, 1, kPagesPerHugePage.raw_num()));
+    PageHeapSpinLockHolder l;
+    for (Length n; n < used;) {
+      const Length len = std::min(
+          Length(absl::LogUniform<size_t>(rng, 1, 8)), used - n);
+      allocs.push_back({pt, pt->Get(len).page, len});
+      n += len;
+    }
+    filler.Contribute(pt, /*donated=*/false, info);
+  }
+
+  std::vector<std::pair<Length, SpanAllocInfo>> requests(1024);
+  for (auto& [n, info] : requests) {
+    n = Length(absl::LogUniform<size_t>(rng, 1, 8));
+    info = {1, absl::Bernoulli(rng, 0.5) ? AccessDensityPrediction::kSparse
+                                         : AccessDensityPrediction::kDense};
+  }
+
+  size_t i = 0;
+  for (auto s : state) {
+    const auto& [n, info] = requests[i++ % requests.size()];
+    PageHeapSpinLockHolder l;
+    auto result = filler.TryGet(n, info);
+    if (result.pt != nullptr) {
+      benchmark::DoNotOptimize(filler.Put(result.pt, result.page, n));
+    }
+  }
+
+  for (const Alloc& alloc : allocs) {
+    PageTracker* empty;
+    {
+      PageHeapSpinLockHolder l;
+      empty = filler.Put(alloc.pt, alloc.p, alloc.n);
+    }
+    delete empty;
+  }
+}
+
+BENCHMARK(BM_TryGet)->Range(16, 64 << 10);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
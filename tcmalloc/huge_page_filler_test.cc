@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <random>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
@@ -640,6 +641,55 @@ class BlockingUnback final : public MemoryModifyFunction {
 
 thread_local absl::Mutex* BlockingUnback::mu_ = nullptr;
 
+// Builds two hugepages with equally long free ranges: "many" holds several
+// allocations but fewer pages than "one", which holds a single allocation.
+// Returns true if a filler using PlacementPolicy allocates from "many".
+template <class PlacementPolicy>
+bool PrefersManyAllocations() {
+  const Length N = kPagesPerHugePage;
+  const SpanAllocInfo info = {1, AccessDensityPrediction::kSparse};
+  BlockingUnback unback;
+  HugePageFiller<PageTracker, PlacementPolicy> filler(
+      HugePageFillerAllocsOption::kUnifiedAllocs, /*chunks_per_alloc=*/8,
+      unback, unback);
+  PageTracker many(HugePage{.pn = 1}, /*was_donated=*/false);
+  PageTracker one(HugePage{.pn = 2}, /*was_donated=*/false);
+
+  PageHeapSpinLockHolder l;
+  // many: [N/16 free][N/16 free][N/16][N/16][N/4][N/2 free]
+  PageId first = many.Get(N / 16).page;
+  filler.Contribute(&many, /*donated=*/false, info);
+  PageId second = filler.TryGet(N / 16, info).page;
+  PageId third = filler.TryGet(N / 16, info).page;
+  PageId fourth = filler.TryGet(N / 16, info).page;
+  PageId fifth = filler.TryGet(N / 4, info).page;
+  // one: [N/2][N/2 free]
+  PageId only = one.Get(N / 2).page;
+  filler.Contribute(&one, /*donated=*/false, info);
+  TC_CHECK_EQ(filler.Put(&many, first, N / 16), nullptr);
+  TC_CHECK_EQ(filler.Put(&many, second, N / 16), nullptr);
+  TC_CHECK_EQ(many.longest_free_range(), one.longest_free_range());
+  TC_CHECK_LT(many.used_pages(), one.used_pages());
+
+  const auto result = filler.TryGet(N / 4, info);
+  const bool chose_many = result.pt == &many;
+
+  TC_CHECK_EQ(filler.Put(result.pt, result.page, N / 4), nullptr);
+  TC_CHECK_EQ(filler.Put(&many, third, N / 16), nullptr);
+  TC_CHECK_EQ(filler.Put(&many, fourth, N / 16), nullptr);
+  TC_CHECK_EQ(filler.Put(&many, fifth, N / 4), &many);
+  TC_CHECK_EQ(filler.Put(&one, only, N / 2), &one);
+  return chose_many;
+}
+
+TEST(PlacementPolicyTest, Nallocs) {
+  EXPECT_TRUE(PrefersManyAllocations<NallocsPlacementPolicy>());
+}
+
+TEST(PlacementPolicyTest, UsedPages) {
+  EXPECT_FALSE(PrefersManyAllocations<UsedPagesPlacementPolicy>());
+}
+
 class FillerTest : public testing::TestWithParam<
                        std::tuple<HugePageFillerAllocsOption, size_t>> {
  protected:
@@ -930,10 +980,12 @@ TEST_P(FillerTest, ReleaseFromFullAllocs) {
   EXPECT_EQ(subrelease.num_pages_subreleased, kAlloc - Length(1));
   EXPECT_EQ(subrelease.num_partial_alloc_pages_subreleased, Length(0));
 
-  // We expect to reuse p1.pt.
+  // We expect to reuse p1.pt, faulting its released pages back in.
+  EXPECT_EQ(filler_.rebacked_pages(), Length(0));
   PAlloc p5 = AllocateWithSpanAllocInfo(kAlloc - Length(1), p1.span_alloc_info);
   ASSERT_TRUE(p1.pt == p5.pt);
   ASSERT_TRUE(p5.from_released);
+  EXPECT_EQ(filler_.rebacked_pages(), kAlloc - Length(1));
 
   Delete(p2);
   Delete(p4);
@@ -1514,6 +1566,233 @@ TEST_P(FillerTest, CheckPreviouslyReleasedStats) {
   }
 }
 
+TEST_P(FillerTest, CollapsePreviouslyReleased) {
+  const Length N = kPagesPerHugePage;
+  auto half = Allocate(N / 2);
+  auto tiny1 = AllocateWithSpanAllocInfo(N / 4, half.span_alloc_info);
+  auto tiny2 = AllocateWithSpanAllocInfo(N / 4, half.span_alloc_info);
+
+  // Nothing has been released, so there is nothing to collapse.
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.CollapseHugePages(NHugePages(4), blocking_unback_),
+              NHugePages(0));
+  }
+
+  Delete(half);
+  EXPECT_EQ(ReleasePages(kMaxValidPages), N / 2);
+
+  // The hugepage still has released pages, so it must not be collapsed.
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.CollapseHugePages(NHugePages(4), blocking_unback_),
+              NHugePages(0));
+  }
+
+  // Repopulate, making the hugepage full again.
+  half = AllocateWithSpanAllocInfo(N / 2, half.span_alloc_info);
+  EXPECT_EQ(filler_.previously_released_huge_pages(), NHugePages(1));
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.CollapseHugePages(NHugePages(0), blocking_unback_),
+              NHugePages(0));
+    EXPECT_EQ(filler_.CollapseHugePages(NHugePages(4), blocking_unback_),
+              NHugePages(1));
+    // Once collapsed, the hugepage is not collapsed again.
+    EXPECT_EQ(filler_.CollapseHugePages(NHugePages(4), blocking_unback_),
+              NHugePages(0));
+  }
+  EXPECT_EQ(filler_.GetStats().n_collapsed, NHugePages(1));
+  {
+    std::string buffer(1024 * 1024, '\0');
+    Printer printer(&*buffer.begin(), buffer.size());
+    filler_.Print(&printer, true);
+    buffer.resize(strlen(buffer.c_str()));
+    EXPECT_THAT(buffer,
+                testing::HasSubstr("HugePageFiller: Since startup, 1 "
+                                   "hugepages collapsed after subrelease"));
+  }
+
+  Delete(half);
+  Delete(tiny1);
+  Delete(tiny2);
+}
+
+// Reports every hugepage as backed by a hugepage, except native_ if set.
+class FakeHugePageBacking final : public HugePageBackingFunction {
+ public:
+  HugePageBacking operator()(HugePage p) override {
+    last_ = p;
+    if (!known_) {
+      return HugePageBacking::kUnknown;
+    }
+    if (has_native_ && p == native_) {
+      return HugePageBacking::kNativePages;
+    }
+    return HugePageBacking::kHugePage;
+  }
+
+  void SetNative(HugePage p) {
+    has_native_ = true;
+    native_ = p;
+  }
+
+  bool known_ = true;
+  bool has_native_ = false;
+  HugePage native_;
+  HugePage last_;
+};
+
+TEST_P(FillerTest, AuditHugePages) {
+  const Length N = kPagesPerHugePage;
+  auto a = Allocate(N);
+  auto b = Allocate(N);
+  ASSERT_LT(a.pt->location(), b.pt->location());
+  FakeHugePageBacking backing;
+  backing.SetNative(a.pt->location());
+
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(0), backing), NHugePages(0));
+    // Audits proceed in address order, a few hugepages at a time.
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(1), backing), NHugePages(1));
+    EXPECT_EQ(backing.last_, a.pt->location());
+    EXPECT_FALSE(a.pt->unbroken());
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(1), backing), NHugePages(1));
+    EXPECT_EQ(backing.last_, b.pt->location());
+    EXPECT_TRUE(b.pt->unbroken());
+    // Then start over.
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(4), backing), NHugePages(2));
+  }
+  HugePageFillerStats stats = filler_.GetStats();
+  EXPECT_EQ(stats.n_audited, NHugePages(4));
+  EXPECT_EQ(stats.n_audited_assumed_huge, NHugePages(3));
+  EXPECT_EQ(stats.n_audited_huge, NHugePages(2));
+  EXPECT_EQ(stats.n_audit_split, NHugePages(1));
+  EXPECT_EQ(stats.n_audit_collapsed, NHugePages(0));
+
+  // A hugepage the kernel split is collapsed like one that subrelease broke
+  // up, even though none of it was ever released.
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.CollapseHugePages(NHugePages(4), blocking_unback_),
+              NHugePages(1));
+  }
+  EXPECT_TRUE(a.pt->unbroken());
+
+  // Hugepages that khugepaged collapses are noticed as well.
+  backing.SetNative(b.pt->location());
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(4), backing), NHugePages(2));
+    EXPECT_FALSE(b.pt->unbroken());
+    backing.has_native_ = false;
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(4), backing), NHugePages(2));
+    EXPECT_TRUE(b.pt->unbroken());
+
+    // Hugepages whose backing can't be determined are left alone.
+    backing.known_ = false;
+    EXPECT_EQ(filler_.AuditHugePages(NHugePages(4), backing), NHugePages(0));
+  }
+  stats = filler_.GetStats();
+  EXPECT_EQ(stats.n_audited, NHugePages(8));
+  EXPECT_EQ(stats.n_audit_split, NHugePages(2));
+  EXPECT_EQ(stats.n_audit_collapsed, NHugePages(1));
+  {
+    std::string buffer(1024 * 1024, '\0');
+    Printer printer(&*buffer.begin(), buffer.size());
+    filler_.Print(&printer, true);
+    buffer.resize(strlen(buffer.c_str()));
+    EXPECT_THAT(buffer, testing::HasSubstr(
+                            "HugePageFiller: Since startup, 8 hugepages "
+                            "audited, 6 assumed and 5 found backed by "
+                            "hugepages (2 split and 1 collapsed by the "
+                            "kernel)"));
+  }
+
+  Delete(a);
+  Delete(b);
+}
+
+// Reports the hugepages in idle_ as idle, and records the moves asked of it.
+class FakeHugePageTiering final : public HugePageTieringFunction {
+ public:
+  std::optional<bool> IsIdle(HugePage p) override {
+    if (!known_) {
+      return std::nullopt;
+    }
+    return absl::c_linear_search(idle_, p);
+  }
+
+  bool Demote(HugePage p) override {
+    demoted_.push_back(p);
+    return succeed_;
+  }
+
+  bool Promote(HugePage p) override {
+    promoted_.push_back(p);
+    return succeed_;
+  }
+
+  bool known_ = true;
+  bool succeed_ = true;
+  std::vector<HugePage> idle_;
+  std::vector<HugePage> demoted_;
+  std::vector<HugePage> promoted_;
+};
+
+TEST_P(FillerTest, TierHugePages) {
+  const Length N = kPagesPerHugePage;
+  auto a = Allocate(N);
+  auto b = Allocate(N);
+  ASSERT_LT(a.pt->location(), b.pt->location());
+  FakeHugePageTiering tiering;
+  tiering.idle_.push_back(a.pt->location());
+
+  {
+    PageHeapSpinLockHolder l;
+    EXPECT_EQ(filler_.TierHugePages(NHugePages(0), tiering), NHugePages(0));
+    // Only the idle hugepage is demoted, and only once.
+    EXPECT_EQ(filler_.TierHugePages(NHugePages(4), tiering), NHugePages(1));
+    EXPECT_THAT(tiering.demoted_, testing::ElementsAre(a.pt->location()));
+    EXPECT_TRUE(a.pt->demoted());
+    EXPECT_FALSE(b.pt->demoted());
+    EXPECT_EQ(filler_.TierHugePages(NHugePages(4), tiering), NHugePages(0));
+
+    // Once used again, it is promoted back.
+    tiering.idle_.clear();
+    EXPECT_EQ(filler_.TierHugePages(NHugePages(4), tiering), NHugePages(1));
+    EXPECT_THAT(tiering.promoted_, testing::ElementsAre(a.pt->location()));
+    EXPECT_FALSE(a.pt->demoted());
+
+    // Hugepages that fail to move, or whose idleness can't be determined,
+    // keep their state.
+    tiering.idle_.push_back(b.pt->location());
+    tiering.succeed_ = false;
+    EXPECT_EQ(filler_.TierHugePages(NHugePages(4), tiering), NHugePages(0));
+    EXPECT_FALSE(b.pt->demoted());
+    tiering.succeed_ = true;
+    tiering.known_ = false;
+    EXPECT_EQ(filler_.TierHugePages(NHugePages(4), tiering), NHugePages(0));
+    EXPECT_FALSE(b.pt->demoted());
+  }
+  const HugePageFillerStats stats = filler_.GetStats();
+  EXPECT_EQ(stats.n_demoted, NHugePages(1));
+  EXPECT_EQ(stats.n_promoted, NHugePages(1));
+  {
+    std::string buffer(1024 * 1024, '\0');
+    Printer printer(&*buffer.begin(), buffer.size());
+    filler_.Print(&printer, true);
+    buffer.resize(strlen(buffer.c_str()));
+    EXPECT_THAT(buffer, testing::HasSubstr(
+                            "HugePageFiller: Since startup, 1 idle hugepages "
+                            "demoted to the far tier and 1 promoted back"));
+  }
+
+  Delete(a);
+  Delete(b);
+}
+
 TEST_P(FillerTest, AvoidArbitraryQuarantineVMGrowth) {
   const Length N = kPagesPerHugePage;
   // Guarantee we have a ton of released pages go empty.
@@ -1564,6 +1843,39 @@ TEST_P(FillerTest, StronglyPreferNonDonated) {
   }
 }
 
+// Short-lived spans go to a released hugepage rather than a donated one, which
+// other spans still take first.
+TEST_P(FillerTest, ShortLivedAvoidDonated) {
+  const SpanAllocInfo info = {1, AccessDensityPrediction::kSparse};
+  SpanAllocInfo short_lived = info;
+  short_lived.lifetime = LifetimePrediction::kShortLived;
+
+  // A hugepage with half of it released.
+  PAlloc kept = AllocateWithSpanAllocInfo(kPagesPerHugePage / 2, info);
+  PAlloc freed = AllocateWithSpanAllocInfo(kPagesPerHugePage / 2 - Length(1),
+                                           info);
+  ASSERT_EQ(kept.pt, freed.pt);
+  Delete(freed);
+  ASSERT_EQ(ReleasePages(kMaxValidPages), kPagesPerHugePage / 2);
+
+  PAlloc donated = AllocateWithSpanAllocInfo(kPagesPerHugePage / 2, info,
+                                             /*donated=*/true);
+  PAlloc a = AllocateWithSpanAllocInfo(Length(1), short_lived);
+  EXPECT_EQ(a.pt, kept.pt);
+  EXPECT_TRUE(a.from_released);
+  PAlloc b = AllocateWithSpanAllocInfo(Length(1), info);
+  EXPECT_EQ(b.pt, donated.pt);
+
+  const HugePageFillerStats stats = filler_.GetStats();
+  EXPECT_EQ(stats.n_donated_used, NHugePages(1));
+  EXPECT_EQ(stats.n_donated_used_short_lived, NHugePages(0));
+
+  Delete(b);
+  Delete(a);
+  Delete(donated);
+  Delete(kept);
+}
+
 TEST_P(FillerTest, SkipPartialAllocSubrelease) {
   // This test is sensitive to the number of pages per hugepage, as we are
   // printing raw stats.
@@ -2559,6 +2871,10 @@ HugePageFiller: 4 hugepages partially released, 0.0254 released
 HugePageFiller: 0.7186 of used pages hugepageable
 HugePageFiller: 0 hugepages were previously released, but later became full.
 HugePageFiller: Since startup, 282 pages subreleased, 5 hugepages broken, (0 pages, 0 hugepages due to reaching tcmalloc limit)
+HugePageFiller: Since startup, 0 hugepages collapsed after subrelease, 0.000 ms spent collapsing
+HugePageFiller: Since startup, 0 hugepages audited, 0 assumed and 0 found backed by hugepages (0 split and 0 collapsed by the kernel), 0.000 ms spent auditing
+HugePageFiller: Since startup, 0 idle hugepages demoted to the far tier and 0 promoted back, 0.000 ms spent tiering
+HugePageFiller: Since startup, 0 donated hugepages taken for small spans, 0 of them for spans predicted short-lived
 
 HugePageFiller: fullness histograms
 
@@ -2820,6 +3136,58 @@ TEST_P(FillerTest, GetsAndPuts) {
   ASSERT_EQ(filler_.pages_allocated(), Length(0));
 }
 
+TEST_P(FillerTest, Resize) {
+  randomize_density_ = false;
+  const Length N = kPagesPerHugePage;
+  PAlloc a = Allocate(N / 4);
+  PAlloc b = AllocateWithSpanAllocInfo(N / 4, a.span_alloc_info);
+  ASSERT_EQ(a.pt, b.pt);
+  ASSERT_EQ(a.p + a.n, b.p);
+  EXPECT_EQ(ReleasePartialPages(kMaxValidPages), N / 2);
+  EXPECT_EQ(filler_.unmapped_pages(), N / 2);
+
+  auto resize = [&](PAlloc& alloc, Length new_n, bool* from_released) {
+    bool resized;
+    {
+      PageHeapSpinLockHolder l;
+      resized =
+          filler_.TryResize(alloc.pt, alloc.p, alloc.n, new_n, from_released);
+    }
+    if (resized) {
+      total_allocated_ -= alloc.n;
+      total_allocated_ += new_n;
+      alloc.n = new_n;
+      Mark(alloc);
+    }
+    CheckStats();
+    return resized;
+  };
+
+  // a is followed by b, and b by the end of the hugepage.
+  bool from_released;
+  EXPECT_FALSE(resize(a, a.n + Length(1), &from_released));
+  EXPECT_FALSE(resize(b, N, &from_released));
+  EXPECT_EQ(filler_.pages_allocated(), N / 2);
+
+  // Growing b into released pages backs them again.
+  EXPECT_TRUE(resize(b, N / 2, &from_released));
+  EXPECT_TRUE(from_released);
+  EXPECT_EQ(filler_.pages_allocated(), N - N / 4);
+  EXPECT_EQ(filler_.unmapped_pages(), N / 4);
+
+  // Shrinking a frees its tail for others.
+  EXPECT_TRUE(resize(a, Length(1), &from_released));
+  EXPECT_FALSE(from_released);
+  EXPECT_EQ(filler_.pages_allocated(), N / 2 + Length(1));
+  PAlloc c = AllocateWithSpanAllocInfo(N / 4 - Length(1), a.span_alloc_info);
+  EXPECT_EQ(c.p, a.p + a.n);
+
+  Delete(c);
+  Delete(a);
+  Delete(b);
+  EXPECT_EQ(filler_.size(), NHugePages(0));
+}
+
 // Test that filler tries to release pages from the sparsely-accessed allocs
 // before attempting to release pages from the densely-accessed allocs.
 TEST_P(FillerTest, ReleasePrioritySparseAndDenseAllocs) {
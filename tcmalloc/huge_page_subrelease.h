@@ -292,6 +292,17 @@ class SubreleaseStatsTracker {
     Length free_backed;
   };
 
+  // The footprint and refaults a skip-subrelease setting is estimated to have
+  // had over the tracked window.
+  struct SkipSubreleaseCounterfactual {
+    // Average over the epochs of the pages kept backed at their minimum
+    // demand: the demand itself plus the free pages subrelease skipped.
+    Length avg_backed_pages;
+    // Pages that were subreleased at an epoch's minimum demand and faulted
+    // back in at the next epoch's maximum.
+    Length refaulted_pages;
+  };
+
   explicit constexpr SubreleaseStatsTracker(Clock clock, absl::Duration w,
                                             absl::Duration summary_interval)
       : summary_interval_(summary_interval),
@@ -464,6 +475,12 @@ class SubreleaseStatsTracker {
     return skipped_subrelease_correctness_.pending_skipped();
   }
 
+  // Replays the recorded demand as if each epoch had subreleased down to the
+  // pages GetRecentPeak or GetRecentDemand would have kept with <intervals>,
+  // to estimate how other settings would have traded footprint for refaults.
+  SkipSubreleaseCounterfactual EstimateSkipSubrelease(
+      SkipSubreleaseIntervals intervals) const;
+
   // Returns the minimum number of free pages throughout the tracker period.
   // The first value of the pair is the number of all free pages, the second
   // value contains only the backed ones.
@@ -578,6 +595,76 @@ inline double safe_div(Length a, Length b) {
   return safe_div(a.raw_num(), b.raw_num());
 }
 
+template <size_t kEpochs>
+typename SubreleaseStatsTracker<kEpochs>::SkipSubreleaseCounterfactual
+SubreleaseStatsTracker<kEpochs>::EstimateSkipSubrelease(
+    SkipSubreleaseIntervals intervals) const {
+  // Demand at each epoch, oldest first.
+  bool present[kEpochs] = {};
+  Length min_demand[kEpochs];
+  Length max_demand[kEpochs];
+  tracker_.Iter(
+      [&](size_t offset, int64_t ts, const SubreleaseStatsEntry& e) {
+        present[offset] = true;
+        min_demand[offset] = e.stats[kStatsAtMinDemand].num_pages;
+        max_demand[offset] = e.stats[kStatsAtMaxDemand].num_pages;
+      },
+      tracker_.kSkipEmptyEntries);
+
+  auto epochs = [&](absl::Duration d) {
+    return std::clamp<int64_t>(d / epoch_length_, 0, kEpochs);
+  };
+  const int64_t peak_epochs = epochs(intervals.peak_interval);
+  int64_t short_epochs = epochs(intervals.short_interval);
+  const int64_t long_epochs = epochs(intervals.long_interval);
+  if (short_epochs > 0 && long_epochs > 0) {
+    short_epochs = std::min(short_epochs, long_epochs);
+  }
+  const int64_t lookback =
+      std::max({peak_epochs, short_epochs, long_epochs, int64_t{1}});
+
+  SkipSubreleaseCounterfactual result;
+  Length total_backed, largest_demand, previous_backed;
+  size_t measured = 0;
+  for (int64_t t = 0; t < kEpochs; ++t) {
+    if (!present[t]) {
+      continue;
+    }
+    largest_demand = std::max(largest_demand, max_demand[t]);
+
+    // The pages GetRecentPeak or GetRecentDemand would keep at epoch t.
+    Length peak, fluctuation, trend;
+    for (int64_t i = std::max<int64_t>(0, t - lookback + 1); i <= t; ++i) {
+      if (!present[i]) {
+        continue;
+      }
+      if (t - i < peak_epochs) {
+        peak = std::max(peak, max_demand[i]);
+      }
+      if (t - i < short_epochs) {
+        fluctuation = std::max(fluctuation, max_demand[i] - min_demand[i]);
+      }
+      if (t - i < long_epochs) {
+        trend = std::max(trend, min_demand[i]);
+      }
+    }
+    const Length kept = intervals.IsPeakIntervalSet()
+                            ? peak
+                            : std::min(largest_demand, fluctuation + trend);
+
+    if (measured > 0 && max_demand[t] > previous_backed) {
+      result.refaulted_pages += max_demand[t] - previous_backed;
+    }
+    previous_backed = std::max(min_demand[t], kept);
+    total_backed += previous_backed;
+    ++measured;
+  }
+  if (measured > 0) {
+    result.avg_backed_pages = total_backed / measured;
+  }
+  return result;
+}
+
 template <size_t kEpochs>
 void SubreleaseStatsTracker<kEpochs>::Print(Printer* out,
                                             absl::string_view field) const {
@@ -713,6 +800,35 @@ void SubreleaseStatsTracker<kEpochs>::PrintSubreleaseStatsInPbtxt(
   region.PrintI64("pending_skipped_subrelease_count", pending_skipped().count);
   region.PrintI64("next_peak_interval_ms",
                   absl::ToInt64Milliseconds(last_next_peak_interval_));
+
+  // Estimates for the current setting, for no skipping, and for a few common
+  // short and long intervals, so that intervals can be tuned from the stats
+  // of a running process.
+  const SkipSubreleaseIntervals candidates[] = {
+      last_skip_subrelease_intervals_,
+      {},
+      {.short_interval = absl::Seconds(30), .long_interval = absl::Minutes(2)},
+      {.short_interval = absl::Seconds(30), .long_interval = absl::Minutes(5)},
+      {.short_interval = absl::Minutes(1), .long_interval = absl::Minutes(2)},
+      {.short_interval = absl::Minutes(1), .long_interval = absl::Minutes(5)},
+  };
+  for (const SkipSubreleaseIntervals& intervals : candidates) {
+    const SkipSubreleaseCounterfactual estimate =
+        EstimateSkipSubrelease(intervals);
+    PbtxtRegion counterfactual =
+        region.CreateSubRegion("skip_subrelease_counterfactual");
+    counterfactual.PrintI64("peak_interval_ms",
+                            absl::ToInt64Milliseconds(intervals.peak_interval));
+    counterfactual.PrintI64(
+        "short_interval_ms",
+        absl::ToInt64Milliseconds(intervals.short_interval));
+    counterfactual.PrintI64("long_interval_ms",
+                            absl::ToInt64Milliseconds(intervals.long_interval));
+    counterfactual.PrintI64("avg_backed_pages",
+                            estimate.avg_backed_pages.raw_num());
+    counterfactual.PrintI64("refaulted_pages",
+                            estimate.refaulted_pages.raw_num());
+  }
 }
 
 template <size_t kEpochs>
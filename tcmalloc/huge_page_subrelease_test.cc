@@ -185,6 +185,34 @@ TEST_F(StatsTrackerTest, InvalidDurations) {
   tracker_.min_free_pages(-absl::InfiniteDuration());
 }
 
+TEST_F(StatsTrackerTest, EstimateSkipSubrelease) {
+  // Demand alternates between 1000 and 100 pages, one epoch each.
+  for (int i = 0; i < 4; ++i) {
+    GenerateDemandPoint(Length(i % 2 == 0 ? 1000 : 100), Length(0));
+    Advance(absl::Seconds(40));
+  }
+
+  // Without skipping, each drop in demand is subreleased and faulted back in
+  // at the next rise.
+  auto estimate = tracker_.EstimateSkipSubrelease({});
+  EXPECT_EQ(estimate.avg_backed_pages, Length(550));
+  EXPECT_EQ(estimate.refaulted_pages, Length(900));
+
+  // Keeping the peak of the last two epochs avoids the refault, at the cost
+  // of keeping the peak backed throughout.
+  estimate = tracker_.EstimateSkipSubrelease(
+      {.peak_interval = absl::Seconds(75)});
+  EXPECT_EQ(estimate.avg_backed_pages, Length(1000));
+  EXPECT_EQ(estimate.refaulted_pages, Length(0));
+
+  // So does keeping the long-term trend, the largest minimum demand, of the
+  // last two epochs.
+  estimate = tracker_.EstimateSkipSubrelease(
+      {.short_interval = absl::Seconds(75),
+       .long_interval = absl::Seconds(75)});
+  EXPECT_EQ(estimate.refaulted_pages, Length(0));
+}
+
 TEST_F(StatsTrackerTest, ComputeRecentPeaks) {
   GenerateDemandPoint(Length(3000), Length(1000));
   Advance(absl::Minutes(1.25));
@@ -23,6 +23,7 @@
 
 #include <cmath>
 #include <limits>
+#include <optional>
 #include <ostream>
 #include <utility>
 
@@ -379,6 +380,43 @@ inline std::pair<HugeRange, HugeRange> Split(HugeRange r, HugeLength n) {
   }
 }
 
+// How the system actually backs a hugepage of our address space.
+enum class HugePageBacking {
+  // The backing couldn't be determined, for instance because none of the
+  // hugepage is resident.
+  kUnknown,
+  // Backed by a single hugepage.
+  kHugePage,
+  // Backed by native pages, because the kernel split the hugepage or never
+  // backed it with one.
+  kNativePages,
+};
+
+// Looks up how the system backs a hugepage, so that our assumptions about
+// hugepage coverage can be checked.
+class HugePageBackingFunction {
+ public:
+  virtual ~HugePageBackingFunction() = default;
+
+  virtual HugePageBacking operator()(HugePage p) = 0;
+};
+
+// Finds whether hugepages have gone unaccessed, and moves their memory
+// between the local memory tier and a slower, far one.
+class HugePageTieringFunction {
+ public:
+  virtual ~HugePageTieringFunction() = default;
+
+  // Returns whether none of the memory backing p has been accessed for a
+  // while, or std::nullopt if that can't be determined.
+  virtual std::optional<bool> IsIdle(HugePage p) = 0;
+
+  // Moves the memory backing p to the far tier, or back from it.  Returns
+  // true on success.
+  virtual bool Demote(HugePage p) = 0;
+  virtual bool Promote(HugePage p) = 0;
+};
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
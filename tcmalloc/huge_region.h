@@ -51,6 +51,15 @@ enum class HugeRegionUsageOption : bool {
   kUseForAllLargeAllocs
 };
 
+enum class HugeRegionReleaseOption : bool {
+  // Only hugepages with no allocated pages on them are released.
+  kFreeHugepagesOnly,
+  // When we hit the memory limit and releasing free hugepages isn't enough,
+  // free pages of partly used hugepages are released too.  Allocations then
+  // prefer to refill those broken hugepages.
+  kSubreleasePartialHugepages
+};
+
 // Track allocations from a fixed-size multiple huge page region.
 // Similar to PageTracker but a few important differences:
 // - crosses multiple hugepages
@@ -68,6 +77,7 @@ class HugeRegion : public TList<HugeRegion>::Elem {
   // We could template this if there was any need.
   static constexpr HugeLength kRegionSize = HLFromBytes(1024 * 1024 * 1024);
   static constexpr size_t kNumHugePages = kRegionSize.raw_num();
+  static constexpr size_t kNumPages = kRegionSize.in_pages().raw_num();
   static constexpr HugeLength size() { return kRegionSize; }
 
   // REQUIRES: r.len() == size(); r unbacked.
@@ -76,7 +86,8 @@ class HugeRegion : public TList<HugeRegion>::Elem {
   HugeRegion() = delete;
 
   // If available, return a range of n free pages, setting *from_released =
-  // true iff the returned range is currently unbacked.
+  // true iff the returned range is currently unbacked.  Ranges starting on
+  // hugepages broken by SubRelease are preferred.
   // Returns false if no range available.
   bool MaybeGet(Length n, PageId* p, bool* from_released);
 
@@ -85,10 +96,23 @@ class HugeRegion : public TList<HugeRegion>::Elem {
   // REQUIRES: [p, p + n) was the result of a previous MaybeGet.
   void Put(PageId p, Length n, bool release);
 
+  // Resize [p, p + n) to new_n pages without moving it, if the pages it grows
+  // into are free, setting *from_released = true iff some of them are
+  // currently unbacked.  If release=true, release any hugepages made empty by
+  // shrinking.  Returns false if the pages are not free.
+  // REQUIRES: [p, p + n) was the result of a previous MaybeGet, possibly
+  // resized since, and new_n > 0.
+  bool TryResize(PageId p, Length n, Length new_n, bool release,
+                 bool* from_released);
+
   // Release <desired> numbae of pages from free-and-backed hugepages from
   // region.
   HugeLength Release(Length desired);
 
+  // Releases up to about <desired> free pages of hugepages that are partly
+  // used, breaking them up.  Returns the number of pages released.
+  Length SubRelease(Length desired);
+
   // Is p located in this region?
   bool contains(PageId p) { return location_.contains(p); }
 
@@ -97,7 +121,11 @@ class HugeRegion : public TList<HugeRegion>::Elem {
   Length free_pages() const {
     return size().in_pages() - unmapped_pages() - used_pages();
   }
-  Length unmapped_pages() const { return (size() - nbacked_).in_pages(); }
+  Length unmapped_pages() const {
+    return (size() - nbacked_).in_pages() + nsubreleased_;
+  }
+  // Free pages of backed hugepages that SubRelease has released.
+  Length subreleased_pages() const { return nsubreleased_; }
 
   void AddSpanStats(SmallSpanStats* small, LargeSpanStats* large) const;
 
@@ -145,12 +173,31 @@ class HugeRegion : public TList<HugeRegion>::Elem {
 
   HugeLength UnbackHugepages(bool should_unback[kNumHugePages]);
 
+  // Is the page at <index> unbacked, as part of an unbacked hugepage or by
+  // SubRelease?
+  bool PageUnbacked(size_t index) const {
+    const size_t i = index / kPagesPerHugePage.raw_num();
+    return !backed_[i] || (pages_subreleased_[i] > Length(0) &&
+                           subreleased_.GetBit(index));
+  }
+  // Returns how many of the <n> pages from <index> on are backed or unbacked
+  // as the page at <index> is, stopping at the end of its hugepage.
+  size_t SameBackingPages(size_t index, size_t n) const;
+  // Finds the best fitting free range of n pages that starts on a hugepage
+  // broken by SubRelease.  Returns kNumPages if there is none.
+  size_t FindInBrokenHugepages(Length n) const;
+
   // How many pages are used in each hugepage?
   Length pages_used_[kNumHugePages];
   // Is this hugepage backed?
   bool backed_[kNumHugePages];
   HugeLength nbacked_;
   HugeLength total_unbacked_{NHugePages(0)};
+  // Free pages of backed hugepages that SubRelease has released, and how many
+  // of them each hugepage has.
+  Bitmap<kNumPages> subreleased_;
+  Length pages_subreleased_[kNumHugePages];
+  Length nsubreleased_;
 
   MemoryModifyFunction& unback_;
 };
@@ -161,16 +208,22 @@ template <typename Region>
 class HugeRegionSet {
  public:
   // For testing with mock clock.
-  HugeRegionSet(HugeRegionUsageOption use_huge_region_more_often, Clock clock)
+  HugeRegionSet(HugeRegionUsageOption use_huge_region_more_often, Clock clock,
+                HugeRegionReleaseOption release_option =
+                    HugeRegionReleaseOption::kFreeHugepagesOnly)
       : n_(0),
         use_huge_region_more_often_(use_huge_region_more_often),
+        release_option_(release_option),
         regionstats_tracker_(clock, absl::Minutes(10), absl::Minutes(5)) {}
 
-  explicit HugeRegionSet(HugeRegionUsageOption use_huge_region_more_often)
+  explicit HugeRegionSet(HugeRegionUsageOption use_huge_region_more_often,
+                         HugeRegionReleaseOption release_option =
+                             HugeRegionReleaseOption::kFreeHugepagesOnly)
       : HugeRegionSet(
             use_huge_region_more_often,
             Clock{.now = absl::base_internal::CycleClock::Now,
-                  .freq = absl::base_internal::CycleClock::Frequency}) {}
+                  .freq = absl::base_internal::CycleClock::Frequency},
+            release_option) {}
 
   // If available, return a range of n free pages, setting *from_released =
   // true iff the returned range is currently unbacked.
@@ -180,6 +233,13 @@ class HugeRegionSet {
   // Return an allocation to a region (if one matches!)
   bool MaybePut(PageId p, Length n);
 
+  // Resize an allocation from a region (if one matches!) without moving it,
+  // as HugeRegion::TryResize.
+  bool MaybeResize(PageId p, Length n, Length new_n, bool* from_released);
+
+  // Is p located in one of the regions?
+  bool contains(PageId p);
+
   // Add region to the set.
   void Contribute(Region* region);
 
@@ -188,9 +248,11 @@ class HugeRegionSet {
   // intervals, but unlike HugePageFiller skip-subrelease, it only releases free
   // hugepages.
   // Releases all free and backed hugepages to system when <hit_limit> is set to
-  // true. Else, it uses intervals to determine recent demand as seen by
-  // HugeRegions to compute realized fragmentation. It may only release as much
-  // memory in free pages as determined by the realized fragmentation.
+  // true, and then, with kSubreleasePartialHugepages, free pages of partly
+  // used hugepages for the rest of <desired>. Else, it uses intervals to
+  // determine recent demand as seen by HugeRegions to compute realized
+  // fragmentation. It may only release as much memory in free pages as
+  // determined by the realized fragmentation.
   // Returns the number of pages actually released.
   Length ReleasePagesByPeakDemand(Length desired,
                                   SkipSubreleaseIntervals intervals,
@@ -305,6 +367,7 @@ class HugeRegionSet {
 
   size_t n_;
   HugeRegionUsageOption use_huge_region_more_often_;
+  HugeRegionReleaseOption release_option_;
   // Sorted by longest_free increasing.
   TList<Region> list_;
 
@@ -328,6 +391,7 @@ inline HugeRegion::HugeRegion(HugeRange r, MemoryModifyFunction& unback)
       pages_used_{},
       backed_{},
       nbacked_(NHugePages(0)),
+      pages_subreleased_{},
       unback_(unback) {
   for (int i = 0; i < kNumHugePages; ++i) {
     // These are already 0 but for clarity...
@@ -339,7 +403,15 @@ inline HugeRegion::HugeRegion(HugeRange r, MemoryModifyFunction& unback)
 inline bool HugeRegion::MaybeGet(Length n, PageId* p, bool* from_released) {
   if (n > longest_free()) return false;
   TC_ASSERT_GT(n, Length(0));
-  auto index = Length(tracker_.FindAndMark(n.raw_num()));
+  // Refilling a broken hugepage brings it back to being fully backed, rather
+  // than leaving it broken while we back a new one.
+  Length index;
+  if (const size_t broken = FindInBrokenHugepages(n); broken < kNumPages) {
+    tracker_.Mark(broken, n.raw_num());
+    index = Length(broken);
+  } else {
+    index = Length(tracker_.FindAndMark(n.raw_num()));
+  }
 
   PageId page = location_.start().first_page() + index;
   *p = page;
@@ -381,6 +453,69 @@ inline HugeLength HugeRegion::Release(Length desired) {
   return UnbackHugepages(should_unback);
 }
 
+inline Length HugeRegion::SubRelease(Length desired) {
+  Length released;
+  const size_t pages_per_hugepage = kPagesPerHugePage.raw_num();
+  for (size_t i = 0; i < kNumHugePages && released < desired; ++i) {
+    if (!backed_[i] || pages_used_[i] == Length(0) ||
+        pages_used_[i] + pages_subreleased_[i] == kPagesPerHugePage) {
+      continue;
+    }
+    const size_t end = (i + 1) * pages_per_hugepage;
+    size_t index = i * pages_per_hugepage, n;
+    while (index < end && tracker_.NextFreeRange(index, &index, &n) &&
+           index < end) {
+      const size_t lim = std::min(index + n, end);
+      while (index < lim) {
+        if (subreleased_.GetBit(index)) {
+          index = std::min(subreleased_.FindClear(index), lim);
+          continue;
+        }
+        const size_t run = std::min(subreleased_.FindSet(index), lim) - index;
+        if (ABSL_PREDICT_TRUE(unback_(
+                location_.start().first_page() + Length(index), Length(run)))) {
+          subreleased_.SetRange(index, run);
+          pages_subreleased_[i] += Length(run);
+          nsubreleased_ += Length(run);
+          released += Length(run);
+        }
+        index += run;
+      }
+    }
+  }
+  return released;
+}
+
+inline size_t HugeRegion::FindInBrokenHugepages(Length n) const {
+  if (nsubreleased_ == Length(0)) return kNumPages;
+  const size_t pages_per_hugepage = kPagesPerHugePage.raw_num();
+  size_t best_index = kNumPages;
+  size_t best_len = 2 * kNumPages;
+  for (size_t i = 0; i < kNumHugePages; ++i) {
+    if (pages_subreleased_[i] == Length(0)) continue;
+    const size_t end = (i + 1) * pages_per_hugepage;
+    size_t index = i * pages_per_hugepage, len;
+    while (tracker_.NextFreeRange(index, &index, &len) && index < end) {
+      if (len >= n.raw_num() && len < best_len) {
+        best_index = index;
+        best_len = len;
+      }
+      index += len;
+    }
+  }
+  return best_index;
+}
+
+inline size_t HugeRegion::SameBackingPages(size_t index, size_t n) const {
+  const size_t i = index / kPagesPerHugePage.raw_num();
+  const size_t lim =
+      std::min(index + n, (i + 1) * kPagesPerHugePage.raw_num());
+  if (!backed_[i] || pages_subreleased_[i] == Length(0)) return lim - index;
+  const size_t end = subreleased_.GetBit(index) ? subreleased_.FindClear(index)
+                                                : subreleased_.FindSet(index);
+  return std::min(end, lim) - index;
+}
+
 inline void HugeRegion::AddSpanStats(SmallSpanStats* small,
                                      LargeSpanStats* large) const {
   size_t index = 0, n;
@@ -388,25 +523,14 @@ inline void HugeRegion::AddSpanStats(SmallSpanStats* small,
   // This is complicated a bit by the backed/unbacked status of pages.
   while (tracker_.NextFreeRange(index, &index, &n)) {
     // [index, index + n) is an *unused* range.  As it may cross
-    // hugepages, we may need to truncate it so it is either a
-    // *free* or a *released* range, and compute a reasonable value
-    // for its "when".
-    PageId p = location_.start().first_page() + Length(index);
-    const HugePage hp = HugePageContaining(p);
-    size_t i = (hp - location_.start()) / NHugePages(1);
-    const bool backed = backed_[i];
-    Length truncated;
-    while (n > 0 && backed_[i] == backed) {
-      const PageId lim = (location_.start() + NHugePages(i + 1)).first_page();
-      Length here = std::min(Length(n), lim - p);
-      truncated += here;
-      n -= here.raw_num();
-      p += here;
-      i++;
-      TC_ASSERT(i < kNumHugePages || n == 0);
+    // hugepages, or pages SubRelease released, we may need to truncate it so
+    // it is either a *free* or a *released* range.
+    const bool released = PageUnbacked(index);
+    size_t truncated = 0;
+    while (truncated < n && PageUnbacked(index + truncated) == released) {
+      truncated += SameBackingPages(index + truncated, n - truncated);
     }
-    n = truncated.raw_num();
-    const bool released = !backed;
+    n = truncated;
     if (released) {
       u += Length(n);
     } else {
@@ -490,6 +614,25 @@ inline BackingStats HugeRegion::stats() const {
   return s;
 }
 
+inline bool HugeRegion::TryResize(PageId p, Length n, Length new_n,
+                                  bool release, bool* from_released) {
+  TC_ASSERT_GT(new_n, Length(0));
+  *from_released = false;
+  const size_t index = (p - location_.start().first_page()).raw_num();
+  if (new_n < n) {
+    tracker_.Shrink(index, n.raw_num(), new_n.raw_num());
+    Dec(p + new_n, n - new_n, release);
+    return true;
+  }
+  if (new_n > n) {
+    if (!tracker_.TryGrow(index, n.raw_num(), new_n.raw_num())) {
+      return false;
+    }
+    Inc(p + n, new_n - n, from_released);
+  }
+  return true;
+}
+
 inline void HugeRegion::Inc(PageId p, Length n, bool* from_released) {
   bool should_back = false;
   while (n > Length(0)) {
@@ -502,6 +645,16 @@ inline void HugeRegion::Inc(PageId p, Length n, bool* from_released) {
       should_back = true;
       ++nbacked_;
     }
+    if (pages_subreleased_[i] > Length(0)) {
+      const size_t index = (p - location_.start().first_page()).raw_num();
+      const Length refilled(subreleased_.CountBits(index, here.raw_num()));
+      if (refilled > Length(0)) {
+        subreleased_.ClearRange(index, here.raw_num());
+        pages_subreleased_[i] -= refilled;
+        nsubreleased_ -= refilled;
+        should_back = true;
+      }
+    }
     pages_used_[i] += here;
     TC_ASSERT_LE(pages_used_[i], kPagesPerHugePage);
     p += here;
@@ -555,6 +708,12 @@ inline HugeLength HugeRegion::UnbackHugepages(
       for (size_t k = i; k < j; k++) {
         TC_ASSERT(should_unback[k]);
         backed_[k] = false;
+        if (pages_subreleased_[k] > Length(0)) {
+          subreleased_.ClearRange(k * kPagesPerHugePage.raw_num(),
+                                  kPagesPerHugePage.raw_num());
+          nsubreleased_ -= pages_subreleased_[k];
+          pages_subreleased_[k] = Length(0);
+        }
       }
 
       released += hl;
@@ -672,6 +831,34 @@ inline bool HugeRegionSet<Region>::MaybePut(PageId p, Length n) {
   return false;
 }
 
+template <typename Region>
+inline bool HugeRegionSet<Region>::MaybeResize(PageId p, Length n, Length new_n,
+                                               bool* from_released) {
+  const bool release = !UseHugeRegionMoreOften();
+  for (Region* region : list_) {
+    if (region->contains(p)) {
+      if (!region->TryResize(p, n, new_n, release, from_released)) {
+        return false;
+      }
+      Fix(region);
+      UpdateStatsTracker();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+template <typename Region>
+inline bool HugeRegionSet<Region>::contains(PageId p) {
+  for (Region* region : list_) {
+    if (region->contains(p)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Add region to the set.
 template <typename Region>
 inline void HugeRegionSet<Region>::Contribute(Region* region) {
@@ -701,6 +888,14 @@ inline Length HugeRegionSet<Region>::ReleasePagesByPeakDemand(
     }
   }
 
+  if (hit_limit && released < desired &&
+      release_option_ == HugeRegionReleaseOption::kSubreleasePartialHugepages) {
+    for (Region* region : list_) {
+      released += region->SubRelease(desired - released);
+      if (released >= desired) break;
+    }
+  }
+
   subrelease_stats_.num_pages_subreleased += released;
 
   // Keep separate stats if the on going release is triggered by reaching
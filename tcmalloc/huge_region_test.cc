@@ -193,6 +193,45 @@ TEST_F(HugeRegionTest, ReqsBacking) {
   }
 }
 
+TEST_F(HugeRegionTest, Resize) {
+  const Length n = kPagesPerHugePage;
+  bool from_released;
+  Alloc a = Allocate(n / 2, &from_released);
+  EXPECT_TRUE(from_released);
+  Alloc b = Allocate(n / 2, &from_released);
+  EXPECT_FALSE(from_released);
+
+  // a can't grow into b.
+  EXPECT_FALSE(region_.TryResize(a.p, a.n, n, false, &from_released));
+  EXPECT_EQ(n, region_.used_pages());
+
+  // Shrinking a leaves its hugepage backed, while growing b onto the next
+  // ones backs them.
+  EXPECT_TRUE(region_.TryResize(a.p, a.n, a.n / 2, false, &from_released));
+  EXPECT_FALSE(from_released);
+  a.n /= 2;
+  EXPECT_EQ(n - n / 4, region_.used_pages());
+  EXPECT_TRUE(region_.TryResize(b.p, b.n, 3 * n, false, &from_released));
+  EXPECT_TRUE(from_released);
+  b.n = 3 * n;
+  Mark(b);
+  EXPECT_EQ(a.n + b.n, region_.used_pages());
+  EXPECT_EQ((region_.size() - NHugePages(4)).in_pages(),
+            region_.unmapped_pages());
+
+  // Shrinking b back releases the hugepages it emptied.
+  ExpectUnback({p_ + NHugePages(1), NHugePages(3)});
+  EXPECT_TRUE(region_.TryResize(b.p, b.n, n / 4, true, &from_released));
+  CheckMock();
+  b.n = n / 4;
+  EXPECT_EQ(a.n + b.n, region_.used_pages());
+  EXPECT_EQ(region_.size().in_pages() - n, region_.unmapped_pages());
+
+  Delete(a);
+  Delete(b);
+  EXPECT_EQ(Length(0), region_.used_pages());
+}
+
 TEST_F(HugeRegionTest, ReleaseFrac) {
   const Length n = kPagesPerHugePage;
   bool from_released;
@@ -488,6 +527,54 @@ TEST_F(HugeRegionTest, StatBreakdownReleaseFailure) {
   Delete(d);
 }
 
+TEST_F(HugeRegionTest, SubRelease) {
+  const Length n = kPagesPerHugePage;
+  Alloc a = Allocate(n / 4);
+  Alloc b = Allocate(n / 2);
+  Alloc c = Allocate(n / 4);
+  Alloc d = Allocate(n / 4);
+  Alloc e = Allocate(n / 4);
+  Alloc f = Allocate(n / 2);
+  Delete(b);
+  Delete(e);
+  // No hugepage is entirely free.
+  EXPECT_EQ(NHugePages(0), region_.Release(n));
+  const Length unmapped = region_.unmapped_pages();
+
+  // The first partly used hugepage covers what we asked for.
+  EXPECT_CALL(*mock_, Unback(b.p, b.n)).WillOnce(Return(true));
+  EXPECT_EQ(b.n, region_.SubRelease(n / 2));
+  CheckMock();
+  EXPECT_EQ(b.n, region_.subreleased_pages());
+  EXPECT_EQ(unmapped + b.n, region_.unmapped_pages());
+  EXPECT_EQ(NHugePages(2), region_.backed());
+  // This checks its breakdown of free and released pages against the above.
+  region_.AddSpanStats(nullptr, nullptr);
+
+  // e's pages fit better, but refilling the broken hugepage is preferred, and
+  // needs backing.
+  bool from_released;
+  Alloc g = Allocate(n / 4, &from_released);
+  EXPECT_EQ(b.p, g.p);
+  EXPECT_TRUE(from_released);
+  EXPECT_EQ(n / 4, region_.subreleased_pages());
+  EXPECT_EQ(unmapped + n / 4, region_.unmapped_pages());
+  region_.AddSpanStats(nullptr, nullptr);
+
+  // Unbacking the whole hugepage forgets its released pages.
+  Delete(a);
+  Delete(c);
+  ExpectUnback({p_, NHugePages(1)});
+  DeleteUnback(g);
+  CheckMock();
+  EXPECT_EQ(Length(0), region_.subreleased_pages());
+  EXPECT_EQ(unmapped + n, region_.unmapped_pages());
+  region_.AddSpanStats(nullptr, nullptr);
+
+  Delete(d);
+  Delete(f);
+}
+
 class NilUnback final : public MemoryModifyFunction {
  public:
   bool operator()(PageId p, Length bytes) override { return true; }
@@ -899,6 +986,34 @@ TEST_P(HugeRegionSetTest, HardRelease) {
   EXPECT_EQ(stats.unmapped_bytes, stats.system_bytes);
 }
 
+// Tests that partly used hugepages are only subreleased when we hit the limit
+// and asked to.
+TEST_P(HugeRegionSetTest, SubreleaseOnLimit) {
+  HugeRegionSet<Region> set(
+      GetParam(), Clock{.now = FakeClock, .freq = GetFakeClockFrequency},
+      HugeRegionReleaseOption::kSubreleasePartialHugepages);
+  auto r1 = GetRegion();
+  set.Contribute(r1.get());
+
+  const Length n = kPagesPerHugePage;
+  PageId a, b, c;
+  bool from_released;
+  ASSERT_TRUE(set.MaybeGet(n / 2, &a, &from_released));
+  ASSERT_TRUE(set.MaybeGet(n / 2, &b, &from_released));
+  ASSERT_TRUE(set.MaybeGet(n / 2, &c, &from_released));
+  ASSERT_TRUE(set.MaybePut(b, n / 2));
+  const size_t unmapped = set.stats().unmapped_bytes;
+
+  EXPECT_EQ(Length(0), set.ReleasePagesByPeakDemand(n / 2, {},
+                                                    /*hit_limit=*/false));
+  EXPECT_EQ(n / 2, set.ReleasePagesByPeakDemand(n / 2, {},
+                                                /*hit_limit=*/true));
+  EXPECT_EQ(unmapped + (n / 2).in_bytes(), set.stats().unmapped_bytes);
+
+  ASSERT_TRUE(set.MaybePut(a, n / 2));
+  ASSERT_TRUE(set.MaybePut(c, n / 2));
+}
+
 TEST_P(HugeRegionSetTest, Set) {
   absl::BitGen rng;
   PageId p;
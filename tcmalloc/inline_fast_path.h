@@ -0,0 +1,114 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The allocation and sized deallocation fast paths of operator new and
+// operator delete, for callers to inline into hot loops, so that a per-CPU
+// cache hit costs no call.  Everything else -- a miss, a sample, hooks, a
+// ScopedAllocationPolicy, large objects -- calls out of line into the same
+// code operator new and operator delete use, so memory from either side may
+// be freed on the other.
+//
+// The fast paths are the plain ones: they leave objects to the out-of-line
+// paths while thread magazines, per-thread allocation accounting or an
+// allocation event trace are on.
+//
+// This header reaches into TCMalloc's internals, so it must be built with the
+// same configuration (page size, NUMA awareness, ...) as the TCMalloc that is
+// linked in.
+
+#ifndef TCMALLOC_INLINE_FAST_PATH_H_
+#define TCMALLOC_INLINE_FAST_PATH_H_
+
+#include <stddef.h>
+
+#include <new>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/allocation_sampling.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/size_class_tags.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/tcmalloc_policy.h"
+
+// The slow path of operator new for an object of size_class, once the sampler
+// has counted it.  Defined in tcmalloc.cc.
+extern "C" void* TCMallocInternalNewSmallMiss(size_t size, size_t size_class);
+
+namespace tcmalloc {
+
+// As ::operator new(size).
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* InlineNew(size_t size) {
+  using tcmalloc_internal::CppPolicy;
+  using tcmalloc_internal::Parameters;
+  using tcmalloc_internal::tc_globals;
+
+  size_t size_class;
+  if (ABSL_PREDICT_FALSE(
+          tcmalloc_internal::ThreadAllocationPolicy::Get().active()) ||
+      ABSL_PREDICT_FALSE(Parameters::per_cpu_caches_thread_magazine()) ||
+      ABSL_PREDICT_FALSE(Parameters::per_thread_allocation_accounting()) ||
+      ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active()) ||
+      ABSL_PREDICT_FALSE(
+          !tc_globals.sizemap().GetSizeClass(CppPolicy(), size, &size_class))) {
+    return ::operator new(size);
+  }
+  // The sampler has counted the allocation once this succeeds, so the misses
+  // below go to the part of the slow path that follows the counting.
+  if (ABSL_PREDICT_FALSE(
+          !tcmalloc_internal::GetThreadSampler()->TryRecordAllocationFast(
+              size))) {
+    return TCMallocInternalNewSmallMiss(size, size_class);
+  }
+  void* ret = tc_globals.cpu_cache().AllocateFast(size_class);
+  if (ABSL_PREDICT_FALSE(ret == nullptr)) {
+    return TCMallocInternalNewSmallMiss(size, size_class);
+  }
+  return tcmalloc_internal::size_class_tags::AddTag(ret, size_class);
+}
+
+// As ::operator delete(ptr, size).
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void InlineDeleteSized(void* ptr,
+                                                           size_t size) {
+  using tcmalloc_internal::CppPolicy;
+  using tcmalloc_internal::Parameters;
+  using tcmalloc_internal::tc_globals;
+
+  size_t size_class = tcmalloc_internal::size_class_tags::GetTag(ptr);
+  void* untagged = tcmalloc_internal::size_class_tags::RemoveTag(ptr);
+  if (ABSL_PREDICT_FALSE(Parameters::per_cpu_caches_thread_magazine()) ||
+      ABSL_PREDICT_FALSE(Parameters::per_thread_allocation_accounting()) ||
+      ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active())) {
+    return ::operator delete(ptr, size);
+  }
+  // Sampled, cold and SelSan objects aren't normal memory, and need their
+  // metadata looked at.
+  if (size_class == 0 &&
+      (ABSL_PREDICT_FALSE(!tcmalloc_internal::IsNormalMemory(ptr)) ||
+       ABSL_PREDICT_FALSE(!tc_globals.sizemap().GetSizeClass(
+           CppPolicy().InSameNumaPartitionAs(ptr), size, &size_class)))) {
+    return ::operator delete(ptr, size);
+  }
+  if (ABSL_PREDICT_FALSE(
+          !tc_globals.cpu_cache().DeallocateFast(untagged, size_class))) {
+    return ::operator delete(ptr, size);
+  }
+}
+
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_INLINE_FAST_PATH_H_
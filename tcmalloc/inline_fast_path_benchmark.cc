@@ -0,0 +1,64 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares sized new and delete through the out-of-line entry points with the
+// inline fast paths of inline_fast_path.h, for a hot loop that allocates a
+// handful of objects and frees them again.
+
+#include <stddef.h>
+
+#include <new>
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/inline_fast_path.h"
+
+namespace tcmalloc {
+namespace {
+
+constexpr int kBatch = 8;
+
+void BM_new_delete(benchmark::State& state) {
+  const size_t size = state.range(0);
+  void* ptrs[kBatch];
+  for (auto s : state) {
+    for (void*& p : ptrs) {
+      p = ::operator new(size);
+    }
+    benchmark::DoNotOptimize(ptrs);
+    for (void* p : ptrs) {
+      ::operator delete(p, size);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_new_delete)->Range(8, 4096);
+
+void BM_inline_new_delete(benchmark::State& state) {
+  const size_t size = state.range(0);
+  void* ptrs[kBatch];
+  for (auto s : state) {
+    for (void*& p : ptrs) {
+      p = InlineNew(size);
+    }
+    benchmark::DoNotOptimize(ptrs);
+    for (void* p : ptrs) {
+      InlineDeleteSized(p, size);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_inline_new_delete)->Range(8, 4096);
+
+}  // namespace
+}  // namespace tcmalloc
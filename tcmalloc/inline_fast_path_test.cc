@@ -0,0 +1,71 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/inline_fast_path.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/testing/testutil.h"
+
+namespace tcmalloc {
+namespace {
+
+constexpr size_t kSizes[] = {1, 8, 17, 64, 100, 1000, 4096, 100000, 1 << 20};
+
+// Memory from the inline paths and from operator new/delete mixes freely.
+void CheckMixed() {
+  for (size_t size : kSizes) {
+    std::vector<void*> inline_ptrs, ptrs;
+    for (int i = 0; i < 100; ++i) {
+      void* p = InlineNew(size);
+      ASSERT_NE(p, nullptr);
+      EXPECT_GE(*MallocExtension::GetAllocatedSize(p), size);
+      memset(p, 0xa5, size);
+      inline_ptrs.push_back(p);
+      ptrs.push_back(::operator new(size));
+    }
+    for (int i = 0; i < 100; ++i) {
+      // Free each one the other way.
+      InlineDeleteSized(ptrs[i], size);
+      ::operator delete(inline_ptrs[i], size);
+    }
+    InlineDeleteSized(InlineNew(size), size);
+  }
+}
+
+TEST(InlineFastPathTest, Mixed) {
+  ScopedNeverSample never_sample;
+  CheckMixed();
+}
+
+TEST(InlineFastPathTest, Sampled) {
+  ScopedAlwaysSample always_sample;
+  CheckMixed();
+}
+
+TEST(InlineFastPathTest, ThreadPolicy) {
+  MallocExtension::ScopedAllocationPolicy cold({.access = hot_cold_t{0}});
+  CheckMixed();
+}
+
+TEST(InlineFastPathTest, Null) { InlineDeleteSized(nullptr, 8); }
+
+}  // namespace
+}  // namespace tcmalloc
@@ -15,11 +15,14 @@
 #include "tcmalloc/internal/cache_topology.h"
 
 #include <fcntl.h>
+#include <sched.h>
 #include <string.h>
 
 #include <cerrno>
 #include <cstdio>
+#include <optional>
 
+#include "absl/functional/function_ref.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/string_view.h"
 #include "tcmalloc/internal/config.h"
@@ -53,10 +56,21 @@ int BuildCpuToL3CacheMap_FindFirstNumberInBuf(absl::string_view current) {
   return first_cpu;
 }
 
-void CacheTopology::Init() {
+void CacheTopology::Init() { InitForTest(OpenSysfsCacheList); }
+
+void CacheTopology::InitForTest(
+    absl::FunctionRef<int(size_t)> open_cache_list) {
   cpu_count_ = NumCPUs();
+  l3_count_ = 0;
+  // Each list names all of the CPUs sharing an L3 cache, so only the first
+  // CPU of each cache needs its list read.  Opening one file per CPU was a
+  // measurable part of startup on large machines.
+  cpu_set_t assigned;
+  CPU_ZERO(&assigned);
   for (int cpu = 0; cpu < cpu_count_; ++cpu) {
-    const int fd = OpenSysfsCacheList(cpu);
+    if (CPU_ISSET(cpu, &assigned)) continue;
+
+    const int fd = open_cache_list(cpu);
     if (fd == -1) {
       // At some point we reach the number of CPU on the system, and
       // we should exit. We verify that there was no other problem.
@@ -75,21 +89,20 @@ void CacheTopology::Init() {
     }
     // The file contains something like:
     //   0-11,22-33
-    // we are looking for the first number in that file.
-    char buf[10];
-    const size_t bytes_read =
-        signal_safe_read(fd, buf, 10, /*bytes_read=*/nullptr);
+    const std::optional<cpu_set_t> shared =
+        ParseCpulist([&](char* const buf, const size_t count) {
+          return signal_safe_read(fd, buf, count, /*bytes_read=*/nullptr);
+        });
     signal_safe_close(fd);
-    TC_CHECK_GE(bytes_read, 0);
+    TC_CHECK(shared.has_value());
 
-    const int first_cpu =
-        BuildCpuToL3CacheMap_FindFirstNumberInBuf({buf, bytes_read});
-    TC_CHECK_LT(first_cpu, CPU_SETSIZE);
-    TC_CHECK_LE(first_cpu, cpu);
-    if (cpu == first_cpu) {
-      l3_cache_index_[cpu] = l3_count_++;
-    } else {
-      l3_cache_index_[cpu] = l3_cache_index_[first_cpu];
+    const unsigned l3 = l3_count_++;
+    l3_cache_index_[cpu] = l3;
+    for (int other = cpu + 1; other < cpu_count_; ++other) {
+      if (CPU_ISSET(other, &*shared)) {
+        l3_cache_index_[other] = l3;
+        CPU_SET(other, &assigned);
+      }
     }
   }
 }
@@ -15,9 +15,12 @@
 #ifndef TCMALLOC_INTERNAL_CACHE_TOPOLOGY_H_
 #define TCMALLOC_INTERNAL_CACHE_TOPOLOGY_H_
 
+#include <stddef.h>
+
 #include <cstdint>
 
 #include "absl/base/attributes.h"
+#include "absl/functional/function_ref.h"
 #include "absl/strings/string_view.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -37,6 +40,11 @@ class CacheTopology {
 
   void Init();
 
+  // Like Init(), but allows a test to supply the shared_cpu_list of each CPU's
+  // L3 cache through `open_cache_list`, which returns a file descriptor to
+  // read it from, or -1 with errno set.
+  void InitForTest(absl::FunctionRef<int(size_t)> open_cache_list);
+
   unsigned l3_count() const { return l3_count_; }
 
   unsigned GetL3FromCpuId(int cpu) const {
@@ -14,7 +14,17 @@
 
 #include "tcmalloc/internal/cache_topology.h"
 
+#include <errno.h>
+#include <linux/memfd.h>
+#include <stddef.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include <string>
+
 #include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/sysinfo.h"
 
 namespace tcmalloc::tcmalloc_internal {
@@ -38,6 +48,55 @@ TEST(CacheTopology, ComputesSomethingReasonable) {
   }
 }
 
+// Returns a file descriptor from which `content` can be read, or -1 if memfd
+// is not supported.
+int SyntheticCacheList(const std::string& content) {
+#ifdef __NR_memfd_create
+  const int fd = syscall(__NR_memfd_create, "shared_cpu_list", MFD_CLOEXEC);
+#else
+  const int fd = -1;
+  errno = ENOSYS;
+#endif
+  if (fd == -1) return -1;
+  TC_CHECK_EQ(write(fd, content.data(), content.size()), content.size());
+  TC_CHECK_EQ(lseek(fd, 0, SEEK_SET), 0);
+  return fd;
+}
+
+TEST(CacheTopology, ReadsOneListPerCache) {
+  const int num_cpus = NumCPUs();
+  if (num_cpus < 2) {
+    GTEST_SKIP() << "Test requires at least 2 CPUs";
+  }
+  const int half = num_cpus / 2;
+  const std::string lists[] = {
+      absl::StrCat("0-", half - 1, "\n"),
+      absl::StrCat(half, "-", num_cpus - 1, "\n"),
+  };
+
+  int opened = 0;
+  bool memfd_failed = false;
+  CacheTopology topology;
+  topology.InitForTest([&](size_t cpu) {
+    ++opened;
+    const int fd = SyntheticCacheList(lists[cpu < half ? 0 : 1]);
+    if (fd == -1) {
+      memfd_failed = true;
+      errno = ENOENT;
+    }
+    return fd;
+  });
+  if (memfd_failed) {
+    GTEST_SKIP() << "Test requires memfd support";
+  }
+
+  EXPECT_EQ(opened, 2);
+  EXPECT_EQ(topology.l3_count(), 2);
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    EXPECT_EQ(topology.GetL3FromCpuId(cpu), cpu < half ? 0 : 1) << cpu;
+  }
+}
+
 TEST(CacheTopology, FindFirstNumberInBuf) {
   using tcmalloc::tcmalloc_internal::BuildCpuToL3CacheMap_FindFirstNumberInBuf;
   EXPECT_EQ(7, BuildCpuToL3CacheMap_FindFirstNumberInBuf("7,-787"));
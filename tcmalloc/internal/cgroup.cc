@@ -0,0 +1,150 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/cgroup.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/util.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+namespace {
+
+constexpr absl::string_view kCgroupRoot = "/sys/fs/cgroup";
+
+}  // namespace
+
+absl::string_view ReadSmallFile(const char* path, char* buf, size_t size) {
+  const int fd = signal_safe_open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return {};
+  }
+  size_t bytes_read = 0;
+  const ssize_t rc = signal_safe_read(fd, buf, size, &bytes_read);
+  signal_safe_close(fd);
+  if (rc < 0) {
+    return {};
+  }
+  return absl::string_view(buf, bytes_read);
+}
+
+bool CgroupFilePath(absl::string_view proc_self_cgroup, absl::string_view file,
+                    char* path, size_t size) {
+  // The cgroup v2 hierarchy is the "0::<path>" line.
+  size_t start;
+  if (proc_self_cgroup.substr(0, 3) == "0::") {
+    start = 3;
+  } else if (start = proc_self_cgroup.find("\n0::");
+             start != absl::string_view::npos) {
+    start += 4;
+  } else {
+    return false;
+  }
+  absl::string_view cgroup = proc_self_cgroup.substr(start);
+  cgroup = cgroup.substr(0, cgroup.find('\n'));
+  if (cgroup.empty()) {
+    return false;
+  }
+  // The root cgroup is "/".
+  if (cgroup.back() == '/') {
+    cgroup.remove_suffix(1);
+  }
+  if (kCgroupRoot.size() + cgroup.size() + 1 + file.size() >= size) {
+    return false;
+  }
+
+  char* p = path;
+  for (absl::string_view part : {kCgroupRoot, cgroup, absl::string_view("/"),
+                                 file}) {
+    memcpy(p, part.data(), part.size());
+    p += part.size();
+  }
+  *p = '\0';
+  return true;
+}
+
+bool OwnCgroupFilePath(absl::string_view file, char* path, size_t size) {
+  char buf[512];
+  return CgroupFilePath(ReadSmallFile("/proc/self/cgroup", buf, sizeof(buf)),
+                        file, path, size);
+}
+
+bool ParseCgroupMemoryLimit(absl::string_view contents, size_t* limit) {
+  contents = absl::StripTrailingAsciiWhitespace(contents);
+  if (contents == "max") {
+    *limit = std::numeric_limits<size_t>::max();
+    return true;
+  }
+  uint64_t value;
+  if (!absl::SimpleAtoi(contents, &value)) {
+    return false;
+  }
+  *limit = std::min<uint64_t>(value, std::numeric_limits<size_t>::max());
+  return true;
+}
+
+size_t CgroupSoftLimit(const CgroupMemoryLimits& limits) {
+  const size_t limit = std::min(limits.high, limits.max);
+  if (limit == std::numeric_limits<size_t>::max()) {
+    return limit;
+  }
+  return limit - static_cast<size_t>(limit * kCgroupSoftLimitHeadroom);
+}
+
+size_t CgroupHardLimit(const CgroupMemoryLimits& limits) { return limits.max; }
+
+void CgroupMemoryLimitMonitor::ResolvePaths() {
+  resolved_ = true;
+  // The root cgroup has no memory.high or memory.max; Read checks that the
+  // files exist.
+  found_ =
+      OwnCgroupFilePath("memory.high", high_path_, sizeof(high_path_)) &&
+      OwnCgroupFilePath("memory.max", max_path_, sizeof(max_path_));
+}
+
+bool CgroupMemoryLimitMonitor::Read(CgroupMemoryLimits* limits) {
+#if !defined(__linux__)
+  return false;
+#endif
+
+  if (!resolved_) {
+    ResolvePaths();
+  }
+  if (!found_) {
+    return false;
+  }
+  char buf[32];
+  return ParseCgroupMemoryLimit(ReadSmallFile(high_path_, buf, sizeof(buf)),
+                                &limits->high) &&
+         ParseCgroupMemoryLimit(ReadSmallFile(max_path_, buf, sizeof(buf)),
+                                &limits->max);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
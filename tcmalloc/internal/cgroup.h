@@ -0,0 +1,87 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_CGROUP_H_
+#define TCMALLOC_INTERNAL_CGROUP_H_
+
+#include <stddef.h>
+
+#include "absl/strings/string_view.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Reads up to size bytes of path into buf.  Returns the contents, or an empty
+// view if the file can't be read.
+absl::string_view ReadSmallFile(const char* path, char* buf, size_t size);
+
+// Writes the path of file in the cgroup v2 hierarchy named by proc_self_cgroup,
+// the contents of /proc/self/cgroup, to path.  Returns false if the process
+// isn't in a cgroup v2 hierarchy or the path doesn't fit in size bytes.
+bool CgroupFilePath(absl::string_view proc_self_cgroup, absl::string_view file,
+                    char* path, size_t size);
+
+// As above, for this process's cgroup.
+bool OwnCgroupFilePath(absl::string_view file, char* path, size_t size);
+
+// Parses the contents of a cgroup v2 memory.high or memory.max file.  "max"
+// means no limit and is returned as SIZE_MAX.
+bool ParseCgroupMemoryLimit(absl::string_view contents, size_t* limit);
+
+struct CgroupMemoryLimits {
+  // Usage above which the kernel throttles the cgroup and reclaims from it.
+  size_t high;
+  // Usage above which the kernel OOM-kills the cgroup.
+  size_t max;
+};
+
+// The fraction of the cgroup's limit kept clear of TCMalloc's soft limit, so
+// that we release memory before the kernel starts throttling us.  It also
+// leaves room for memory in the cgroup that TCMalloc doesn't manage.
+inline constexpr double kCgroupSoftLimitHeadroom = 0.1;
+
+// Returns the soft and hard limits to follow the cgroup's limits with.  The
+// soft limit leaves kCgroupSoftLimitHeadroom below memory.high, or below
+// memory.max if that is lower.  The hard limit is memory.max itself: TCMalloc
+// only reaches it once the kernel would OOM-kill us anyway, and crashing
+// instead reports what the memory was used for.  SIZE_MAX means no limit.
+size_t CgroupSoftLimit(const CgroupMemoryLimits& limits);
+size_t CgroupHardLimit(const CgroupMemoryLimits& limits);
+
+// Reads this process's cgroup v2 memory limits.
+class CgroupMemoryLimitMonitor {
+ public:
+  constexpr CgroupMemoryLimitMonitor() = default;
+
+  // Returns false if the process isn't in a cgroup v2 hierarchy with the
+  // memory controller enabled.
+  bool Read(CgroupMemoryLimits* limits);
+
+ private:
+  // Finds the files to read on first use.
+  void ResolvePaths();
+
+  bool resolved_ = false;
+  bool found_ = false;
+  char high_path_[256] = {};
+  char max_path_[256] = {};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_CGROUP_H_
@@ -0,0 +1,93 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/cgroup.h"
+
+#include <stddef.h>
+
+#include <limits>
+
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr size_t kNoLimit = std::numeric_limits<size_t>::max();
+
+TEST(CgroupTest, FilePath) {
+  char path[64];
+  ASSERT_TRUE(CgroupFilePath("0::/system.slice/job.service\n", "memory.max",
+                             path, sizeof(path)));
+  EXPECT_STREQ(path, "/sys/fs/cgroup/system.slice/job.service/memory.max");
+
+  // Hybrid hierarchies list the v1 controllers first.
+  ASSERT_TRUE(CgroupFilePath("12:memory:/job\n1:name=systemd:/job\n0::/job\n",
+                             "memory.high", path, sizeof(path)));
+  EXPECT_STREQ(path, "/sys/fs/cgroup/job/memory.high");
+
+  ASSERT_TRUE(CgroupFilePath("0::/\n", "memory.pressure", path, sizeof(path)));
+  EXPECT_STREQ(path, "/sys/fs/cgroup/memory.pressure");
+}
+
+TEST(CgroupTest, FilePathRejects) {
+  char path[64];
+  // cgroup v1 only.
+  EXPECT_FALSE(
+      CgroupFilePath("4:memory:/job\n10::/job\n", "memory.max", path, 64));
+  EXPECT_FALSE(CgroupFilePath("", "memory.max", path, sizeof(path)));
+  EXPECT_FALSE(CgroupFilePath("0::\n", "memory.max", path, sizeof(path)));
+  // Too long.
+  EXPECT_FALSE(CgroupFilePath("0::/job\n", "memory.max", path, 20));
+}
+
+TEST(CgroupTest, ParseMemoryLimit) {
+  size_t limit = 0;
+  ASSERT_TRUE(ParseCgroupMemoryLimit("max\n", &limit));
+  EXPECT_EQ(limit, kNoLimit);
+  ASSERT_TRUE(ParseCgroupMemoryLimit("1073741824\n", &limit));
+  EXPECT_EQ(limit, 1073741824);
+  ASSERT_TRUE(ParseCgroupMemoryLimit("0", &limit));
+  EXPECT_EQ(limit, 0);
+
+  EXPECT_FALSE(ParseCgroupMemoryLimit("", &limit));
+  EXPECT_FALSE(ParseCgroupMemoryLimit("-1\n", &limit));
+  EXPECT_FALSE(ParseCgroupMemoryLimit("lots\n", &limit));
+}
+
+TEST(CgroupTest, Limits) {
+  EXPECT_EQ(CgroupSoftLimit({.high = kNoLimit, .max = kNoLimit}), kNoLimit);
+  EXPECT_EQ(CgroupHardLimit({.high = kNoLimit, .max = kNoLimit}), kNoLimit);
+
+  // The soft limit stays clear of whichever cgroup limit is lower.
+  EXPECT_EQ(CgroupSoftLimit({.high = 1000, .max = kNoLimit}), 900);
+  EXPECT_EQ(CgroupSoftLimit({.high = kNoLimit, .max = 2000}), 1800);
+  EXPECT_EQ(CgroupSoftLimit({.high = 1000, .max = 2000}), 900);
+  EXPECT_EQ(CgroupHardLimit({.high = 1000, .max = 2000}), 2000);
+}
+
+TEST(CgroupTest, Read) {
+  CgroupMemoryLimitMonitor monitor;
+  CgroupMemoryLimits limits;
+  if (!monitor.Read(&limits)) {
+    GTEST_SKIP() << "Not in a cgroup v2 hierarchy with memory limits";
+  }
+  EXPECT_GT(limits.high, 0);
+  EXPECT_GT(limits.max, 0);
+  EXPECT_TRUE(monitor.Read(&limits));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
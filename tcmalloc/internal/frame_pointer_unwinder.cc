@@ -0,0 +1,82 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/frame_pointer_unwinder.h"
+
+#include <stdint.h>
+
+#include "absl/base/optimization.h"
+#include "absl/debugging/stacktrace.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// On both x86-64 and AArch64, a frame pointer points at the caller's saved
+// frame pointer, followed by the return address into the caller.
+struct Frame {
+  const Frame* next;
+  void* return_address;
+};
+
+// Returns the frame after `frame`, or nullptr if the chain looks broken.
+inline const Frame* NextFrame(const Frame* frame) {
+  const Frame* next = frame->next;
+  const uintptr_t from = reinterpret_cast<uintptr_t>(frame);
+  const uintptr_t to = reinterpret_cast<uintptr_t>(next);
+  // The stack grows down, so callers' frames are at higher addresses.
+  if (to <= from || to - from > kMaxFrameSize) {
+    return nullptr;
+  }
+  if (to % alignof(Frame) != 0) {
+    return nullptr;
+  }
+  return next;
+}
+
+}  // namespace
+
+int GetStackTraceFromFramePointers(void** result, int max_depth,
+                                   int skip_count) {
+  if constexpr (!kHaveFramePointerUnwinder) {
+    // Skip this frame, as we would have.
+    return absl::GetStackTrace(result, max_depth, skip_count + 1);
+  }
+
+  const Frame* frame =
+      reinterpret_cast<const Frame*>(__builtin_frame_address(0));
+  // Like absl::GetStackTrace, start with the return address into our caller's
+  // caller.
+  ++skip_count;
+  int depth = 0;
+  while (frame != nullptr && depth < max_depth) {
+    void* return_address = frame->return_address;
+    if (ABSL_PREDICT_FALSE(return_address == nullptr)) {
+      break;
+    }
+    if (skip_count > 0) {
+      --skip_count;
+    } else {
+      result[depth++] = return_address;
+    }
+    frame = NextFrame(frame);
+  }
+  return depth;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
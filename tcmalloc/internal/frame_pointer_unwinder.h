@@ -0,0 +1,56 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDER_H_
+#define TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDER_H_
+
+#include <stdint.h>
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Whether GetStackTraceFromFramePointers walks frame pointers on this target.
+// Elsewhere it falls back to absl::GetStackTrace.
+#if defined(__x86_64__) || defined(__aarch64__)
+inline constexpr bool kHaveFramePointerUnwinder = true;
+#else
+inline constexpr bool kHaveFramePointerUnwinder = false;
+#endif
+
+// The largest distance between two consecutive frames that the walk follows.
+inline constexpr uintptr_t kMaxFrameSize = 1 << 20;
+
+// Fills result with the return addresses of up to max_depth frames of the
+// calling thread, skipping the skip_count innermost ones, as
+// absl::GetStackTrace does, and returns the number of frames.
+//
+// Rather than looking up unwind tables, this follows the chain of saved frame
+// pointers, which is much cheaper but needs the binary to be built with
+// -fno-omit-frame-pointer.  The walk stops at the first frame pointer that
+// does not point further up the stack, by at most kMaxFrameSize bytes, to a
+// suitably aligned frame, so a frame without a frame pointer truncates the
+// trace rather than sending the walk off the stack.
+ABSL_ATTRIBUTE_NOINLINE int GetStackTraceFromFramePointers(void** result,
+                                                           int max_depth,
+                                                           int skip_count);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDER_H_
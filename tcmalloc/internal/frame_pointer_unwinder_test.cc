@@ -0,0 +1,94 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/frame_pointer_unwinder.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "absl/debugging/stacktrace.h"
+#include "benchmark/benchmark.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr int kMaxDepth = 64;
+
+struct Traces {
+  void* fp[kMaxDepth];
+  int fp_depth;
+  void* absl[kMaxDepth];
+  int absl_depth;
+};
+
+// Takes both traces from the same frame, at the bottom of `levels` recursive
+// calls.
+ABSL_ATTRIBUTE_NOINLINE void Recurse(int levels, int max_depth, int skip_count,
+                                     Traces& traces) {
+  if (levels > 0) {
+    Recurse(levels - 1, max_depth, skip_count, traces);
+  } else {
+    traces.fp_depth =
+        GetStackTraceFromFramePointers(traces.fp, max_depth, skip_count);
+    traces.absl_depth =
+        absl::GetStackTrace(traces.absl, max_depth, skip_count);
+  }
+  // Keep the recursive call from becoming a tail call.
+  benchmark::DoNotOptimize(levels);
+  ABSL_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+TEST(FramePointerUnwinderTest, MatchesAbslStackTrace) {
+  constexpr int kLevels = 10;
+  Traces traces;
+  Recurse(kLevels, kMaxDepth, 0, traces);
+
+  // Frames beyond main may lack frame pointers, for instance in libc, so only
+  // the frames of this test are sure to match.
+  ASSERT_GT(traces.fp_depth, kLevels);
+  ASSERT_GT(traces.absl_depth, kLevels);
+  for (int i = 0; i < kLevels; ++i) {
+    EXPECT_EQ(traces.fp[i], traces.absl[i]) << i;
+  }
+}
+
+TEST(FramePointerUnwinderTest, SkipsFrames) {
+  constexpr int kLevels = 10;
+  constexpr int kSkip = 3;
+  Traces all, skipped;
+  Recurse(kLevels, kMaxDepth, 0, all);
+  Recurse(kLevels, kMaxDepth, kSkip, skipped);
+
+  ASSERT_GT(skipped.fp_depth, kLevels - kSkip);
+  for (int i = 0; i < kLevels - kSkip; ++i) {
+    EXPECT_EQ(skipped.fp[i], all.fp[i + kSkip]) << i;
+  }
+}
+
+TEST(FramePointerUnwinderTest, StopsAtMaxDepth) {
+  constexpr int kLevels = 20;
+  constexpr int kDepth = 5;
+  Traces traces;
+  std::fill(traces.fp, traces.fp + kMaxDepth, nullptr);
+  Recurse(kLevels, kDepth, 0, traces);
+  EXPECT_EQ(traces.fp_depth, kDepth);
+  EXPECT_EQ(traces.fp[kDepth], nullptr);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
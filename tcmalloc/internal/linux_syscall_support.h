@@ -26,7 +26,12 @@ struct kernel_rseq {
   unsigned cpu_id;
   unsigned long long rseq_cs;
   unsigned flags;
-  unsigned padding[2];
+  // Upstream extensions since Linux 6.3, present if getauxval reports an
+  // AT_RSEQ_FEATURE_SIZE that covers them: the NUMA node of cpu_id, and a
+  // concurrency id that is unique among the running threads of the process
+  // and dense in [0, min(threads, allowed cpus)).
+  unsigned node_id;
+  unsigned mm_cid;
   // This is a prototype extension to the rseq() syscall.  Since a process may
   // run on only a few cores at a time, we can use a dense set of "v(irtual)
   // cpus."  This can reduce cache requirements, as we only need N caches for
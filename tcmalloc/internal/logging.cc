@@ -27,6 +27,7 @@
 #include <cstdint>
 
 #include "absl/base/attributes.h"
+#include "absl/base/casts.h"
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/macros.h"
@@ -197,8 +198,57 @@ void PrintStackTraceFromSignalHandler(void* context) {
   PrintStackTrace(stack_frames, depth);
 }
 
-PbtxtRegion::PbtxtRegion(Printer* out, PbtxtRegionType type)
-    : out_(out), type_(type) {
+namespace {
+
+// Field tags of the Entry message described at PbtxtEncoding::kWireFormat.
+constexpr char kKeyTag = (1 << 3) | 2;
+constexpr char kIntValueTag = (2 << 3) | 0;
+constexpr char kDoubleValueTag = (3 << 3) | 1;
+constexpr char kBoolValueTag = (4 << 3) | 0;
+constexpr char kRawValueTag = (5 << 3) | 2;
+constexpr char kEntriesTag = (6 << 3) | 2;
+
+constexpr size_t kMaxVarintSize = 10;
+// The length of a subregion is not known until it is closed, so it is written
+// in a fixed number of bytes, padded with continuation bits.
+constexpr size_t kPaddedLengthSize = 5;
+
+size_t VarintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+char* EncodeVarint(uint64_t value, char* out) {
+  while (value >= 0x80) {
+    *out++ = static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<char>(value);
+  return out;
+}
+
+void EncodePaddedLength(uint64_t value, char* out) {
+  TC_CHECK_LT(value, uint64_t{1} << (7 * kPaddedLengthSize));
+  for (size_t i = 0; i + 1 < kPaddedLengthSize; ++i) {
+    out[i] = static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out[kPaddedLengthSize - 1] = static_cast<char>(value);
+}
+
+}  // namespace
+
+PbtxtRegion::PbtxtRegion(Printer* out, PbtxtRegionType type,
+                         PbtxtEncoding encoding)
+    : out_(out), type_(type), encoding_(encoding) {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    // Nested regions in wire format are only opened by CreateSubRegion.
+    return;
+  }
   switch (type_) {
     case kTop:
       break;
@@ -209,6 +259,12 @@ PbtxtRegion::PbtxtRegion(Printer* out, PbtxtRegionType type)
 }
 
 PbtxtRegion::~PbtxtRegion() {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    if (length_ != nullptr) {
+      EncodePaddedLength(out_->SpaceRequired() - start_, length_);
+    }
+    return;
+  }
   switch (type_) {
     case kTop:
       break;
@@ -218,23 +274,76 @@ PbtxtRegion::~PbtxtRegion() {
   }
 }
 
+void PbtxtRegion::AppendWireEntry(absl::string_view key,
+                                  absl::string_view value,
+                                  absl::string_view payload) {
+  char header[1 + kMaxVarintSize + 1 + kMaxVarintSize];
+  const size_t key_size = 1 + VarintSize(key.size()) + key.size();
+  char* p = header;
+  *p++ = kEntriesTag;
+  p = EncodeVarint(key_size + value.size() + payload.size(), p);
+  *p++ = kKeyTag;
+  p = EncodeVarint(key.size(), p);
+  out_->Append(absl::string_view(header, p - header), key, value, payload);
+}
+
 void PbtxtRegion::PrintI64(absl::string_view key, int64_t value) {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    char field[1 + kMaxVarintSize];
+    field[0] = kIntValueTag;
+    char* end = EncodeVarint(static_cast<uint64_t>(value), field + 1);
+    AppendWireEntry(key, absl::string_view(field, end - field));
+    return;
+  }
   out_->Append(" ", key, ": ", value);
 }
 
 void PbtxtRegion::PrintDouble(absl::string_view key, double value) {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    char field[1 + sizeof(value)];
+    field[0] = kDoubleValueTag;
+    uint64_t bits = absl::bit_cast<uint64_t>(value);
+    for (size_t i = 0; i < sizeof(bits); ++i) {
+      field[1 + i] = static_cast<char>(bits >> (8 * i));
+    }
+    AppendWireEntry(key, absl::string_view(field, sizeof(field)));
+    return;
+  }
   out_->Append(" ", key, ": ", value);
 }
 
 void PbtxtRegion::PrintBool(absl::string_view key, bool value) {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    const char field[2] = {kBoolValueTag, value ? '\1' : '\0'};
+    AppendWireEntry(key, absl::string_view(field, sizeof(field)));
+    return;
+  }
   out_->Append(" ", key, value ? ": true" : ": false");
 }
 
 void PbtxtRegion::PrintRaw(absl::string_view key, absl::string_view value) {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    char field[1 + kMaxVarintSize];
+    field[0] = kRawValueTag;
+    char* end = EncodeVarint(value.size(), field + 1);
+    AppendWireEntry(key, absl::string_view(field, end - field), value);
+    return;
+  }
   out_->Append(" ", key, ": ", value);
 }
 
 PbtxtRegion PbtxtRegion::CreateSubRegion(absl::string_view key) {
+  if (encoding_ == PbtxtEncoding::kWireFormat) {
+    PbtxtRegion sub(out_, kNested, encoding_);
+    out_->Append(absl::string_view(&kEntriesTag, 1));
+    sub.length_ = out_->Reserve(kPaddedLengthSize);
+    sub.start_ = out_->SpaceRequired();
+    char field[1 + kMaxVarintSize];
+    field[0] = kKeyTag;
+    char* end = EncodeVarint(key.size(), field + 1);
+    out_->Append(absl::string_view(field, end - field), key);
+    return sub;
+  }
   out_->Append(" ", key, " ");
   PbtxtRegion sub(out_, kNested);
   return sub;
@@ -27,6 +27,7 @@
 #include <optional>
 #include <string>
 #include <type_traits>
+#include <utility>
 
 #include "absl/base/attributes.h"
 #include "absl/base/internal/sysinfo.h"
@@ -55,9 +56,8 @@ static constexpr int kMaxStackDepth = 64;
 // An opaque handle type used to identify allocations.
 using AllocHandle = int64_t;
 
-// size/depth are made the same size as a pointer so that some generic
-// code below can conveniently cast them back and forth to void*.
-struct StackTrace {
+// The details of a sampled allocation other than its call stack.
+struct SampleDetails {
   // An opaque handle used by allocator to uniquely identify the sampled
   // memory block.
   AllocHandle sampled_alloc_handle;
@@ -79,9 +79,6 @@ struct StackTrace {
   uint8_t access_hint;
   bool cold_allocated;
 
-  uintptr_t depth;  // Number of PC values stored in array below
-  void* stack[kMaxStackDepth];
-
   // weight is the expected number of *bytes* that were requested
   // between the previous sample and this one
   size_t weight;
@@ -97,6 +94,16 @@ struct StackTrace {
   // An integer representing the guarded status of the allocation.
   // The values are from the enum GuardedStatus in ../malloc_extension.h.
   int guarded_status;
+
+  // The allocating thread's label, from MallocExtension::ScopedAllocationLabel.
+  int label = 0;
+};
+
+// size/depth are made the same size as a pointer so that some generic
+// code below can conveniently cast them back and forth to void*.
+struct StackTrace : SampleDetails {
+  uintptr_t depth;  // Number of PC values stored in array below
+  void* stack[kMaxStackDepth];
 };
 
 #define TC_LOG(msg, ...)                                                \
@@ -287,6 +294,22 @@ class Printer {
     AppendPieces({static_cast<const absl::AlphaNum&>(args).Piece()...});
   }
 
+  // Reserves `n` bytes, to be written later through the returned pointer.
+  // Returns nullptr if they do not fit, in which case the space is still
+  // counted as required.
+  char* Reserve(size_t n) {
+    TC_ASSERT_GE(left_, 0);
+    required_ += n;
+    if (left_ < n) {
+      left_ = 0;
+      return nullptr;
+    }
+    char* reserved = buf_;
+    buf_ += n;
+    left_ -= n;
+    return reserved;
+  }
+
   size_t SpaceRequired() const { return required_; }
 
  private:
@@ -321,16 +344,46 @@ class Printer {
 
 enum PbtxtRegionType { kTop, kNested };
 
+// How a PbtxtRegion encodes what is printed into it.
+enum class PbtxtEncoding {
+  // Text format.
+  kText,
+  // Protobuf wire format of the self-describing message
+  //
+  //   message Entry {
+  //     string key = 1;
+  //     oneof value {
+  //       int64 int_value = 2;
+  //       double double_value = 3;
+  //       bool bool_value = 4;
+  //       string raw_value = 5;
+  //     }
+  //     repeated Entry entries = 6;
+  //   }
+  //
+  // The top region is an Entry without a key, and every key printed into a
+  // region, including that of a subregion, is an element of its entries.
+  // Repeated keys stay repeated, in the order they were printed.
+  kWireFormat,
+};
+
 // A helper class that prints pbtxt via RAII. A pbtxt region can be either a
 // top region (with no brackets) or a nested region (enclosed by curly
 // brackets).
 class PbtxtRegion {
  public:
-  PbtxtRegion(Printer* out, PbtxtRegionType type);
+  PbtxtRegion(Printer* out, PbtxtRegionType type,
+              PbtxtEncoding encoding = PbtxtEncoding::kText);
   ~PbtxtRegion();
 
   PbtxtRegion(const PbtxtRegion&) = delete;
-  PbtxtRegion(PbtxtRegion&&) = default;
+  // The moved-from region no longer closes anything.
+  PbtxtRegion(PbtxtRegion&& other)
+      : out_(other.out_),
+        type_(std::exchange(other.type_, kTop)),
+        encoding_(other.encoding_),
+        length_(std::exchange(other.length_, nullptr)),
+        start_(other.start_) {}
 
   // Prints 'key: value'.
   void PrintI64(absl::string_view key, int64_t value);
@@ -343,8 +396,19 @@ class PbtxtRegion {
   PbtxtRegion CreateSubRegion(absl::string_view key);
 
  private:
+  // Appends an Entry of `key` and the encoded `value` field, whose payload
+  // continues with `payload`.
+  void AppendWireEntry(absl::string_view key, absl::string_view value,
+                       absl::string_view payload = {});
+
   Printer* out_;
   PbtxtRegionType type_;
+  PbtxtEncoding encoding_;
+  // For nested regions in wire format, where the length of the region's Entry
+  // is written once it is closed, or nullptr if it did not fit.
+  char* length_ = nullptr;
+  // The bytes required by `out_` when the region's Entry began.
+  size_t start_ = 0;
 };
 
 }  // namespace tcmalloc_internal
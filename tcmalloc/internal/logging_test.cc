@@ -87,6 +87,73 @@ TEST(Printer, RequiredSpace) {
   }
 }
 
+TEST(PbtxtRegion, Text) {
+  char buf[100];
+  Printer printer(buf, sizeof(buf));
+  {
+    PbtxtRegion region(&printer, kTop);
+    region.PrintI64("a", 1);
+    auto sub = region.CreateSubRegion("b");
+    sub.PrintBool("c", true);
+  }
+  EXPECT_EQ(absl::string_view(buf, printer.SpaceRequired()),
+            " a: 1 b { c: true}");
+}
+
+TEST(PbtxtRegion, WireFormat) {
+  char buf[100];
+  Printer printer(buf, sizeof(buf));
+  {
+    PbtxtRegion region(&printer, kTop, PbtxtEncoding::kWireFormat);
+    region.PrintI64("a", 1);
+    region.PrintBool("b", true);
+    region.PrintRaw("c", "xy");
+    region.PrintDouble("d", 1.0);
+    auto sub = region.CreateSubRegion("e");
+    sub.PrintI64("f", -1);
+  }
+
+  // Each Entry is tagged 0x32, followed by its length, then its key, tagged
+  // 0x0a, and its value.
+  constexpr char kExpected[] =
+      "\x32\x05\x0a\x01"
+      "a"
+      "\x10\x01"
+      "\x32\x05\x0a\x01"
+      "b"
+      "\x20\x01"
+      "\x32\x07\x0a\x01"
+      "c"
+      "\x2a\x02"
+      "xy"
+      "\x32\x0c\x0a\x01"
+      "d"
+      "\x19\x00\x00\x00\x00\x00\x00\xf0\x3f"
+      // The length of a subregion is padded to 5 bytes.
+      "\x32\x93\x80\x80\x80\x00\x0a\x01"
+      "e"
+      "\x32\x0e\x0a\x01"
+      "f"
+      "\x10\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01";
+  EXPECT_EQ(absl::string_view(buf, printer.SpaceRequired()),
+            absl::string_view(kExpected, sizeof(kExpected) - 1));
+}
+
+TEST(PbtxtRegion, WireFormatTruncated) {
+  for (size_t size = 1; size < 20; ++size) {
+    SCOPED_TRACE(size);
+    std::vector<char> buf(size);
+    Printer printer(buf.data(), buf.size());
+    {
+      PbtxtRegion region(&printer, kTop, PbtxtEncoding::kWireFormat);
+      region.PrintI64("a", 1);
+      auto sub = region.CreateSubRegion("b");
+      sub.PrintI64("c", 2);
+    }
+    EXPECT_GE(printer.SpaceRequired(), size);
+  }
+}
+
 TEST(Check, OK) {
   TC_CHECK(true);
   TC_CHECK_EQ(1, 1);
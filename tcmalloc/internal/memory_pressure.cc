@@ -0,0 +1,107 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/memory_pressure.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cstddef>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/internal/cgroup.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+namespace {
+
+constexpr char kSystemPressurePath[] = "/proc/pressure/memory";
+
+// Parses the value of key=value in a PSI line.
+bool ParseField(absl::string_view line, absl::string_view key, double* value) {
+  const size_t pos = line.find(key);
+  if (pos == absl::string_view::npos) {
+    return false;
+  }
+  line.remove_prefix(pos + key.size());
+  return absl::SimpleAtod(line.substr(0, line.find(' ')), value);
+}
+
+}  // namespace
+
+bool ParseMemoryPressure(absl::string_view contents, MemoryPressure* pressure) {
+  while (!contents.empty()) {
+    const size_t end = contents.find('\n');
+    const absl::string_view line = contents.substr(0, end);
+    if (line.substr(0, 5) == "some ") {
+      return ParseField(line, " avg10=", &pressure->some_avg10) &&
+             ParseField(line, " avg60=", &pressure->some_avg60);
+    }
+    if (end == absl::string_view::npos) {
+      break;
+    }
+    contents.remove_prefix(end + 1);
+  }
+  return false;
+}
+
+double MemoryPressureReleaseScale(const MemoryPressure& pressure) {
+  const double stalled = pressure.some_avg10;
+  if (!(stalled >= kIdleMemoryPressure)) {
+    return 0;
+  }
+  const double fraction =
+      std::min((stalled - kIdleMemoryPressure) /
+                   (kSaturatedMemoryPressure - kIdleMemoryPressure),
+               1.0);
+  return 1 + fraction * (kMaxReleaseRateScale - 1);
+}
+
+void MemoryPressureMonitor::ResolvePath() {
+  resolved_ = true;
+  memcpy(path_, kSystemPressurePath, sizeof(kSystemPressurePath));
+
+  char candidate[sizeof(path_)];
+  if (!OwnCgroupFilePath("memory.pressure", candidate, sizeof(candidate))) {
+    return;
+  }
+
+  // The root cgroup has no memory.pressure on older kernels.
+  char contents[256];
+  MemoryPressure unused;
+  if (ParseMemoryPressure(ReadSmallFile(candidate, contents, sizeof(contents)),
+                          &unused)) {
+    memcpy(path_, candidate, sizeof(candidate));
+  }
+}
+
+bool MemoryPressureMonitor::Read(MemoryPressure* pressure) {
+#if !defined(__linux__)
+  return false;
+#endif
+
+  if (!resolved_) {
+    ResolvePath();
+  }
+  char buf[256];
+  return ParseMemoryPressure(ReadSmallFile(path_, buf, sizeof(buf)), pressure);
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,70 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_MEMORY_PRESSURE_H_
+#define TCMALLOC_INTERNAL_MEMORY_PRESSURE_H_
+
+#include "absl/strings/string_view.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// The "some" line of a PSI (pressure stall information) memory file: the
+// percentage of time at least one task was stalled waiting for memory,
+// averaged over the last 10 and 60 seconds.
+struct MemoryPressure {
+  double some_avg10;
+  double some_avg60;
+};
+
+// Parses the contents of /proc/pressure/memory or a cgroup's
+// memory.pressure file.
+bool ParseMemoryPressure(absl::string_view contents, MemoryPressure* pressure);
+
+// Below this stall percentage memory is plentiful, and we don't release.
+inline constexpr double kIdleMemoryPressure = 0.1;
+// At or above this stall percentage we release as fast as we are willing to.
+inline constexpr double kSaturatedMemoryPressure = 50;
+inline constexpr double kMaxReleaseRateScale = 8;
+
+// Returns the factor by which to scale the background release rate under the
+// given pressure: zero while memory is plentiful, then rising linearly from 1
+// to kMaxReleaseRateScale between kIdleMemoryPressure and
+// kSaturatedMemoryPressure.
+double MemoryPressureReleaseScale(const MemoryPressure& pressure);
+
+// Reads memory pressure for this process, preferring its cgroup v2
+// memory.pressure file over the system-wide /proc/pressure/memory.
+class MemoryPressureMonitor {
+ public:
+  constexpr MemoryPressureMonitor() = default;
+
+  // Returns false if the kernel doesn't report pressure stall information.
+  bool Read(MemoryPressure* pressure);
+
+ private:
+  // Picks the file to read on first use.
+  void ResolvePath();
+
+  bool resolved_ = false;
+  char path_[256] = {};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_MEMORY_PRESSURE_H_
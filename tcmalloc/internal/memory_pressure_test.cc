@@ -0,0 +1,82 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/memory_pressure.h"
+
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(MemoryPressureTest, Parse) {
+  MemoryPressure pressure;
+  ASSERT_TRUE(ParseMemoryPressure(
+      "some avg10=1.25 avg60=0.50 avg300=0.10 total=123456\n"
+      "full avg10=0.75 avg60=0.25 avg300=0.05 total=65432\n",
+      &pressure));
+  EXPECT_DOUBLE_EQ(pressure.some_avg10, 1.25);
+  EXPECT_DOUBLE_EQ(pressure.some_avg60, 0.50);
+
+  // Only the "some" line matters, wherever it is.
+  ASSERT_TRUE(ParseMemoryPressure(
+      "full avg10=9.00 avg60=9.00 avg300=9.00 total=1\n"
+      "some avg10=2.00 avg60=3.00 avg300=4.00 total=5",
+      &pressure));
+  EXPECT_DOUBLE_EQ(pressure.some_avg10, 2.0);
+  EXPECT_DOUBLE_EQ(pressure.some_avg60, 3.0);
+}
+
+TEST(MemoryPressureTest, RejectsMalformed) {
+  MemoryPressure pressure;
+  EXPECT_FALSE(ParseMemoryPressure("", &pressure));
+  EXPECT_FALSE(ParseMemoryPressure(
+      "full avg10=0.75 avg60=0.25 avg300=0.05 total=65432\n", &pressure));
+  EXPECT_FALSE(ParseMemoryPressure("some avg10=x avg60=0.25", &pressure));
+  EXPECT_FALSE(ParseMemoryPressure("some avg60=0.25", &pressure));
+}
+
+TEST(MemoryPressureTest, ReleaseScale) {
+  EXPECT_EQ(MemoryPressureReleaseScale({.some_avg10 = 0}), 0);
+  EXPECT_EQ(MemoryPressureReleaseScale({.some_avg10 = kIdleMemoryPressure / 2}),
+            0);
+  EXPECT_DOUBLE_EQ(
+      MemoryPressureReleaseScale({.some_avg10 = kIdleMemoryPressure}), 1);
+
+  const double mid = (kIdleMemoryPressure + kSaturatedMemoryPressure) / 2;
+  EXPECT_DOUBLE_EQ(MemoryPressureReleaseScale({.some_avg10 = mid}),
+                   (1 + kMaxReleaseRateScale) / 2);
+
+  EXPECT_DOUBLE_EQ(
+      MemoryPressureReleaseScale({.some_avg10 = kSaturatedMemoryPressure}),
+      kMaxReleaseRateScale);
+  EXPECT_DOUBLE_EQ(MemoryPressureReleaseScale({.some_avg10 = 100}),
+                   kMaxReleaseRateScale);
+}
+
+TEST(MemoryPressureTest, Read) {
+  // Not every kernel reports pressure stall information.
+  MemoryPressureMonitor monitor;
+  MemoryPressure pressure;
+  if (!monitor.Read(&pressure)) {
+    GTEST_SKIP() << "PSI unavailable";
+  }
+  EXPECT_GE(pressure.some_avg10, 0);
+  EXPECT_LE(pressure.some_avg10, 100);
+  EXPECT_TRUE(monitor.Read(&pressure));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
 
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/page_size.h"
@@ -129,6 +130,59 @@ size_t MInCore::residence(void* addr, size_t size) {
   return residence_impl(addr, size, &mc);
 }
 
+MInCoreCache::MInCoreCache() : MInCoreCache(nullptr) {}
+
+MInCoreCache::MInCoreCache(MInCoreInterface* mincore)
+    : mincore_(mincore),
+      page_size_(GetPageSize()),
+      batch_pages_(std::min(kMaxBatchPages,
+                            std::max<size_t>(kHugePageSize / page_size_, 1))) {}
+
+bool MInCoreCache::Fill(uintptr_t start) {
+  valid_ = false;
+  unsigned char res[kMaxBatchPages];
+  void* const addr = reinterpret_cast<void*>(start);
+  const size_t length = batch_pages_ * page_size_;
+  const int ret = mincore_ != nullptr ? mincore_->mincore(addr, length, res)
+                                      : ::mincore(addr, length, res);
+  if (ret != 0) {
+    return false;
+  }
+  std::fill(std::begin(bits_), std::end(bits_), 0);
+  for (size_t i = 0; i < batch_pages_; ++i) {
+    // Residence info is returned in LSB, other bits are undefined.
+    bits_[i / kBitsPerWord] |= static_cast<uint64_t>(res[i] & 1)
+                               << (i % kBitsPerWord);
+  }
+  batch_start_ = start;
+  valid_ = true;
+  return true;
+}
+
+size_t MInCoreCache::residence(void* addr, size_t size) {
+  const uintptr_t batch_bytes = batch_pages_ * page_size_;
+  const uintptr_t uaddr = reinterpret_cast<uintptr_t>(addr);
+  const uintptr_t end = uaddr + size;
+  size_t total = 0;
+  for (uintptr_t page = uaddr & ~(page_size_ - 1); page < end;
+       page += page_size_) {
+    if (!valid_ || page < batch_start_ || page - batch_start_ >= batch_bytes) {
+      if (!Fill(page - page % batch_bytes)) {
+        // Part of the batch is unmapped.  Leave it to MInCore, which only
+        // asks about the pages of the query itself.
+        OsMInCore os;
+        return MInCore::residence_impl(addr, size,
+                                       mincore_ != nullptr ? mincore_ : &os);
+      }
+    }
+    const size_t index = (page - batch_start_) / page_size_;
+    if ((bits_[index / kBitsPerWord] >> (index % kBitsPerWord)) & 1) {
+      total += std::min(end, page + page_size_) - std::max(uaddr, page);
+    }
+  }
+  return total;
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
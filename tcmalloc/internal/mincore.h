@@ -16,6 +16,7 @@
 #define TCMALLOC_INTERNAL_MINCORE_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "tcmalloc/internal/config.h"
 
@@ -56,6 +57,46 @@ class MInCore {
   static constexpr int kArrayLength = 4096;
   // Friends required for testing
   friend class MInCoreTest;
+  friend class MInCoreCache;
+};
+
+// MInCoreCache answers the same queries as MInCore::residence, but calls
+// mincore() once for the whole hugepage a query falls in and keeps the result
+// as a bitmap of the hugepage's resident pages.  Queries made in address
+// order, as in a scan of the whole heap, then cost one syscall per hugepage
+// rather than one or more per query.  The answers are as of the first query
+// in each hugepage; call Invalidate() to forget them.
+//
+// This is NOT thread-safe.
+class MInCoreCache {
+ public:
+  MInCoreCache();
+
+  size_t residence(void* addr, size_t size);
+
+  void Invalidate() { valid_ = false; }
+
+ private:
+  // For testing.
+  friend class MInCoreTest;
+  explicit MInCoreCache(MInCoreInterface* mincore);
+
+  // Reads the residency of the pages of the hugepage starting at `start` into
+  // bits_.  Returns false if mincore() fails, as it does if any of them is
+  // unmapped.
+  bool Fill(uintptr_t start);
+
+  // Enough bits for a hugepage of 4KiB pages.  With larger pages, or a
+  // smaller bitmap than the hugepage needs, a batch is fewer pages.
+  static constexpr size_t kMaxBatchPages = 512;
+  static constexpr size_t kBitsPerWord = 64;
+
+  MInCoreInterface* const mincore_;
+  const size_t page_size_;
+  const size_t batch_pages_;
+  bool valid_ = false;
+  uintptr_t batch_start_ = 0;
+  uint64_t bits_[kMaxBatchPages / kBitsPerWord];
 };
 
 }  // namespace tcmalloc_internal
@@ -18,11 +18,13 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 
 #include "benchmark/benchmark.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/mincore.h"
 #include "tcmalloc/internal/page_size.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
@@ -56,6 +58,40 @@ void BM_mincore(benchmark::State& state) {
 }
 BENCHMARK(BM_mincore)->Range(1, 16 * 1024);
 
+// Benchmark a scan of a resident heap that asks for the residence of every
+// range(1)-byte object in turn, as profile annotation does, through MInCore
+// (range(0) == 0) or through an MInCoreCache (range(0) == 1).
+void BM_residence_scan(benchmark::State& state) {
+  const bool cached = state.range(0) != 0;
+  const size_t object_size = state.range(1);
+
+  const size_t kRegionSize = 64 << 20;
+  void* region = mmap(nullptr, kRegionSize, PROT_READ | PROT_WRITE,
+                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  TC_CHECK_NE(region, MAP_FAILED);
+  memset(region, 1, kRegionSize);
+  char* const base = static_cast<char*>(region);
+
+  for (auto s : state) {
+    tcmalloc_internal::MInCoreCache cache;
+    size_t resident = 0;
+    for (size_t offset = 0; offset + object_size <= kRegionSize;
+         offset += object_size) {
+      resident +=
+          cached ? cache.residence(base + offset, object_size)
+                 : tcmalloc_internal::MInCore::residence(base + offset,
+                                                         object_size);
+    }
+    benchmark::DoNotOptimize(resident);
+  }
+  state.SetItemsProcessed(state.iterations() * (kRegionSize / object_size));
+
+  munmap(region, kRegionSize);
+}
+BENCHMARK(BM_residence_scan)
+    ->ArgsProduct({{0, 1}, {64, 4096, 64 << 10}})
+    ->Unit(benchmark::kMillisecond);
+
 }  // namespace
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -19,12 +19,14 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <set>
 
 #include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/page_size.h"
 
 namespace tcmalloc {
@@ -41,6 +43,7 @@ class MInCoreMock : public MInCoreInterface {
 
   // Implementation of minCore that reports presence based on provided array.
   int mincore(void* addr, size_t length, unsigned char* result) override {
+    ++calls_;
     const size_t kPageSize = GetPageSize();
     uintptr_t uAddress = reinterpret_cast<uintptr_t>(addr);
     // Check that we only pass page aligned addresses into mincore().
@@ -59,8 +62,11 @@ class MInCoreMock : public MInCoreInterface {
 
   void addPage(uintptr_t uAddress) { mapped_.insert(uAddress); }
 
+  int calls() const { return calls_; }
+
  private:
   std::set<uintptr_t> mapped_;
+  int calls_ = 0;
 };
 
 // Friend class of MInCore which calls the mincore mock.
@@ -73,6 +79,14 @@ class MInCoreTest {
     return MInCore::residence_impl(reinterpret_cast<void*>(addr), size, &mcm_);
   }
 
+  MInCoreCache cache() { return MInCoreCache(&mcm_); }
+
+  size_t cached_residence(MInCoreCache& cache, uintptr_t addr, size_t size) {
+    return cache.residence(reinterpret_cast<void*>(addr), size);
+  }
+
+  int mincore_calls() const { return mcm_.calls(); }
+
   void addPage(uintptr_t page) { mcm_.addPage(page); }
 
   // Expose the internal size of array that we use to call mincore() so
@@ -164,6 +178,61 @@ TEST(MInCoreTest, TestLargeResidence) {
   }
 }
 
+// The cache gives the uncached answers, with one mincore() call per hugepage
+// for queries made in address order.
+TEST(MInCoreTest, CachedResidence) {
+  MInCoreTest mct;
+  const size_t kPageSize = GetPageSize();
+  const size_t kPagesPerBatch =
+      std::min<size_t>(512, std::max<size_t>(kHugePageSize / kPageSize, 1));
+  const int kBatches = 4;
+  for (uintptr_t page = 0; page < kBatches * kPagesPerBatch; page += 3) {
+    mct.addPage(page * kPageSize);
+  }
+
+  MInCoreCache cache = mct.cache();
+  const size_t kObject = kPageSize / 3 + 5;
+  const uintptr_t kEnd = kBatches * kPagesPerBatch * kPageSize;
+  int uncached_calls = 0;
+  for (uintptr_t addr = 0; addr + kObject <= kEnd; addr += kObject) {
+    const int before = mct.mincore_calls();
+    const size_t expected = mct.residence(addr, kObject);
+    uncached_calls += mct.mincore_calls() - before;
+    ASSERT_EQ(mct.cached_residence(cache, addr, kObject), expected) << addr;
+  }
+  EXPECT_EQ(mct.mincore_calls() - uncached_calls, kBatches);
+
+  // Going back to an earlier hugepage reads it again, as does forgetting the
+  // cached one.
+  EXPECT_EQ(mct.cached_residence(cache, 0, kPageSize), kPageSize);
+  EXPECT_EQ(mct.mincore_calls() - uncached_calls, kBatches + 1);
+  cache.Invalidate();
+  EXPECT_EQ(mct.cached_residence(cache, 3 * kPageSize + 1, kPageSize),
+            kPageSize - 1);
+  EXPECT_EQ(mct.mincore_calls() - uncached_calls, kBatches + 2);
+}
+
+TEST(MInCoreTest, CachedUnmappedMemory) {
+  const size_t kPageSize = GetPageSize();
+  const int kNumPages = 16;
+
+  // Whatever surrounds the mapping within its hugepage may be unmapped, so the
+  // cache falls back to querying just the range asked about.
+  void* p = mmap(nullptr, kNumPages * kPageSize, PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(p, MAP_FAILED) << errno;
+  memset(p, 0, kNumPages * kPageSize);
+  ::benchmark::DoNotOptimize(p);
+
+  MInCoreCache cache;
+  for (int i = 0; i <= kNumPages; i++) {
+    EXPECT_EQ(i * kPageSize, cache.residence(p, i * kPageSize));
+  }
+  EXPECT_EQ(0, cache.residence(nullptr, kPageSize));
+
+  ASSERT_EQ(munmap(p, kNumPages * kPageSize), 0);
+}
+
 TEST(MInCoreTest, UnmappedMemory) {
   const size_t kPageSize = GetPageSize();
   const int kNumPages = 16;
@@ -27,6 +27,8 @@
 
 #include "absl/base/attributes.h"
 #include "absl/functional/function_ref.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
@@ -50,6 +52,68 @@ int OpenSysfsCpulist(size_t node) {
   return signal_safe_open(path, O_RDONLY | O_CLOEXEC);
 }
 
+int OpenSysfsMeminfo(size_t node) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/meminfo",
+           node);
+  return signal_safe_open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// Parses the value, in kB, of `field` from lines of the form
+// "Node 0 MemFree:        123456 kB" and returns it in bytes.
+static bool ParseMeminfoField(absl::string_view contents,
+                              absl::string_view field, size_t* bytes) {
+  auto pos = contents.find(field);
+  if (pos == absl::string_view::npos) {
+    return false;
+  }
+  contents.remove_prefix(pos + field.size());
+  pos = contents.find_first_not_of(' ');
+  if (pos == absl::string_view::npos) {
+    return false;
+  }
+  contents.remove_prefix(pos);
+  const auto end = contents.find(' ');
+  if (end == absl::string_view::npos) {
+    return false;
+  }
+  uint64_t kib;
+  if (!absl::SimpleAtoi(contents.substr(0, end), &kib)) {
+    return false;
+  }
+  *bytes = kib << 10;
+  return true;
+}
+
+bool ReadNumaMemInfo(uint64_t nodes, NumaMemInfo* info,
+                     absl::FunctionRef<int(size_t)> open_node_meminfo) {
+  *info = NumaMemInfo();
+  for (size_t node = 0; node < 64; ++node) {
+    if ((nodes & (uint64_t{1} << node)) == 0) {
+      continue;
+    }
+    const int fd = open_node_meminfo(node);
+    if (fd == -1) {
+      return false;
+    }
+    char buf[4096];
+    const ssize_t rc = signal_safe_read(fd, buf, sizeof(buf), nullptr);
+    signal_safe_close(fd);
+    if (rc <= 0 || rc >= sizeof(buf)) {
+      return false;
+    }
+    const absl::string_view contents(buf, rc);
+    size_t free_bytes, total_bytes;
+    if (!ParseMeminfoField(contents, "MemFree:", &free_bytes) ||
+        !ParseMeminfoField(contents, "MemTotal:", &total_bytes)) {
+      return false;
+    }
+    info->free_bytes += free_bytes;
+    info->total_bytes += total_bytes;
+  }
+  return true;
+}
+
 bool InitNumaTopology(size_t cpu_to_scaled_partition[CPU_SETSIZE],
                       uint64_t* const partition_to_nodes,
                       NumaBindMode* const bind_mode,
@@ -65,6 +129,10 @@ bool InitNumaTopology(size_t cpu_to_scaled_partition[CPU_SETSIZE],
   // disable NUMA awareness.
   if (!subtle::percpu::IsFast()) return false;
 
+  // Per-CPU caches indexed by virtual CPU ids are shared by threads on any
+  // node, so they cannot be partitioned by node.
+  if (subtle::percpu::UsingVirtualCpus()) return false;
+
   // Honor default_want_numa_aware() to allow compile time configuration of
   // whether to enable NUMA awareness by default, and allow the user to
   // override that either way by setting TCMALLOC_NUMA_AWARE in the
@@ -179,6 +179,20 @@ class NumaTopology {
 // returns the file descriptor.
 int OpenSysfsCpulist(size_t node);
 
+// Free and total memory of a set of NUMA nodes, in bytes.
+struct NumaMemInfo {
+  size_t free_bytes = 0;
+  size_t total_bytes = 0;
+};
+
+int OpenSysfsMeminfo(size_t node);
+
+// Sums MemFree and MemTotal over the nodes set in the `nodes` bitmap, reading
+// each node's meminfo through `open_node_meminfo`.  Returns false, leaving
+// `info` unspecified, if any of them could not be read or parsed.
+bool ReadNumaMemInfo(uint64_t nodes, NumaMemInfo* info,
+                     absl::FunctionRef<int(size_t)> open_node_meminfo);
+
 // Initialize the data members of a NumaTopology<> instance.
 //
 // This function must only be called once per NumaTopology<> instance, and
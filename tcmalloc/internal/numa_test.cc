@@ -177,6 +177,32 @@ TEST_F(NumaTopologyTest, TwoNode) {
   }
 }
 
+// An 8 node system folds into 4 partitions, two nodes apiece.
+TEST_F(NumaTopologyTest, EightNodeFourPartitions) {
+  std::vector<SyntheticCpuList> nodes;
+  for (int node = 0; node < 8; node++) {
+    nodes.emplace_back(absl::StrCat(node * 4, "-", node * 4 + 3));
+  }
+
+  const auto nt = CreateNumaTopology<4, 2>(nodes);
+
+  EXPECT_EQ(nt.numa_aware(), true);
+  EXPECT_EQ(nt.active_partitions(), 4);
+
+  for (int cpu = 0; cpu < 32; cpu++) {
+    const size_t partition = (cpu / 4) % 4;
+    EXPECT_EQ(nt.GetCpuPartition(cpu), partition) << cpu;
+    EXPECT_EQ(nt.GetCpuScaledPartition(cpu), partition * 2) << cpu;
+    EXPECT_TRUE(nt.IsLocalToCpuPartition(partition * 2 + 1, cpu)) << cpu;
+    EXPECT_FALSE(nt.IsLocalToCpuPartition(((partition + 1) % 4) * 2, cpu))
+        << cpu;
+  }
+  for (int partition = 0; partition < 4; partition++) {
+    EXPECT_EQ(nt.GetPartitionNodes(partition),
+              (uint64_t{1} << partition) | (uint64_t{1} << (partition + 4)));
+  }
+}
+
 // Confirm that an empty node parses correctly (b/212827142).
 TEST_F(NumaTopologyTest, EmptyNode) {
   std::vector<SyntheticCpuList> nodes;
@@ -247,6 +273,44 @@ TEST_F(NumaTopologyTest, LongCpuLists) {
   }
 }
 
+// Ensure that per-node meminfo is parsed and summed over the requested nodes.
+TEST_F(NumaTopologyTest, MemInfo) {
+  std::vector<SyntheticCpuList> nodes;
+  nodes.emplace_back(
+      "Node 0 MemTotal:        1000 kB\n"
+      "Node 0 MemFree:          100 kB\n"
+      "Node 0 MemUsed:          900 kB");
+  nodes.emplace_back(
+      "Node 1 MemTotal:        2000 kB\n"
+      "Node 1 MemFree:         1500 kB\n"
+      "Node 1 MemUsed:          500 kB");
+  nodes.emplace_back("Node 2 MemTotal: garbage");
+
+  auto open_node_meminfo = [&](const size_t node) {
+    if (node >= nodes.size()) {
+      errno = ENOENT;
+      return -1;
+    }
+    // ReadNumaMemInfo closes the file, so hand out a duplicate.
+    const int fd = dup(nodes[node].fd());
+    TC_CHECK_NE(fd, -1);
+    TC_CHECK_EQ(lseek(fd, 0, SEEK_SET), 0);
+    return fd;
+  };
+
+  NumaMemInfo info;
+  ASSERT_TRUE(ReadNumaMemInfo(0b01, &info, open_node_meminfo));
+  EXPECT_EQ(info.free_bytes, 100 << 10);
+  EXPECT_EQ(info.total_bytes, 1000 << 10);
+
+  ASSERT_TRUE(ReadNumaMemInfo(0b11, &info, open_node_meminfo));
+  EXPECT_EQ(info.free_bytes, 1600 << 10);
+  EXPECT_EQ(info.total_bytes, 3000 << 10);
+
+  EXPECT_FALSE(ReadNumaMemInfo(0b100, &info, open_node_meminfo));
+  EXPECT_FALSE(ReadNumaMemInfo(0b1000, &info, open_node_meminfo));
+}
+
 // Ensure we can initialize using the host system's real NUMA topology
 // information.
 TEST_F(NumaTopologyTest, Host) {
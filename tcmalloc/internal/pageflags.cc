@@ -294,6 +294,21 @@ std::optional<PageFlags::PageStats> PageFlags::Get(const void* const addr,
   return ret;
 }
 
+std::optional<bool> PageFlags::IsHugepageBacked(const void* const addr) {
+  if (fd_ < 0) {
+    return std::nullopt;
+  }
+  uint64_t flags = 0;
+  bool is_huge = false;
+  // The head page's flags describe the entire hugepage.
+  if (auto res = MaybeReadOne(reinterpret_cast<uintptr_t>(addr) & kHugePageMask,
+                              flags, is_huge);
+      res != absl::StatusCode::kOk) {
+    return std::nullopt;
+  }
+  return is_huge && PageThp(flags);
+}
+
 uint64_t PageFlags::MaybeReadStaleScanSeconds(const char* filename) {
   if (cached_scan_seconds_ != 0) return cached_scan_seconds_;
 
@@ -85,6 +85,11 @@ class PageFlags {
   // use the function in places where memory allocation is prohibited.
   std::optional<PageStats> Get(const void* addr, size_t size);
 
+  // Returns whether the kernel backs the hugepage containing `addr` with a
+  // transparent hugepage, rather than with native pages or not at all.
+  // Returns std::nullopt if the flags can't be read.
+  std::optional<bool> IsHugepageBacked(const void* addr);
+
  private:
   // This helper seeks the internal file to the correct location for the given
   // virtual address.
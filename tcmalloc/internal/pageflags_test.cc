@@ -67,6 +67,10 @@ class PageFlagsFriend {
     return r_.Get(std::forward<Args>(args)...);
   }
 
+  decltype(auto) IsHugepageBacked(const void* addr) {
+    return r_.IsHugepageBacked(addr);
+  }
+
   decltype(auto) MaybeReadStaleScanSeconds(absl::string_view filename) {
     return r_.MaybeReadStaleScanSeconds(filename.data());
   }
@@ -442,9 +446,48 @@ TEST(PageFlagsTest, NotThp) {
   EXPECT_THAT(s.Get(nullptr, kHugePageSize), std::nullopt);
 }
 
+TEST(PageFlagsTest, HugepageBacked) {
+  const size_t kPageSize = getpagesize();
+  const size_t kPagesPerHugePage = kHugePageSize / kPageSize;
+  // A transparent hugepage, followed by a hugepage's worth of native pages
+  // and one of unbacked memory.
+  std::vector<uint64_t> data(3 * kPagesPerHugePage);
+  data[0] = kPageHead | kPageThp;
+  for (size_t i = 1; i < kPagesPerHugePage; ++i) {
+    data[i] = kPageTail | kPageThp;
+  }
+  for (size_t i = kPagesPerHugePage; i < 2 * kPagesPerHugePage; ++i) {
+    data[i] = kPageStale;
+  }
+
+  std::string file_path = absl::StrCat(testing::TempDir(), "/hugepage-backed");
+  int write_fd =
+      signal_safe_open(file_path.c_str(), O_CREAT | O_WRONLY, S_IRUSR);
+  ASSERT_NE(write_fd, -1) << errno;
+
+  size_t bytes_to_write = data.size() * sizeof(data[0]);
+  ASSERT_EQ(write(write_fd, data.data(), bytes_to_write), bytes_to_write)
+      << errno;
+  ASSERT_EQ(close(write_fd), 0) << errno;
+
+  PageFlagsFriend s(file_path);
+  EXPECT_THAT(s.IsHugepageBacked(nullptr), Optional(true));
+  // Any address in the hugepage refers to its head page.
+  EXPECT_THAT(s.IsHugepageBacked(reinterpret_cast<char*>(5 * kPageSize)),
+              Optional(true));
+  EXPECT_THAT(s.IsHugepageBacked(reinterpret_cast<char*>(kHugePageSize)),
+              Optional(false));
+  EXPECT_THAT(s.IsHugepageBacked(reinterpret_cast<char*>(2 * kHugePageSize)),
+              Optional(false));
+  // Past the end of the file.
+  EXPECT_THAT(s.IsHugepageBacked(reinterpret_cast<char*>(3 * kHugePageSize)),
+              std::nullopt);
+}
+
 TEST(PageFlagsTest, CannotOpen) {
   PageFlagsFriend s("/tmp/a667ba48-18ba-4523-a8a7-b49ece3a6c2b");
   EXPECT_FALSE(s.Get(nullptr, 1).has_value());
+  EXPECT_FALSE(s.IsHugepageBacked(nullptr).has_value());
 }
 
 TEST(PageFlagsTest, CannotRead) {
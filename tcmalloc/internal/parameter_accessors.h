@@ -85,6 +85,8 @@ ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMadviseColdRegionsNoHugepage(
     bool v);
 ABSL_ATTRIBUTE_WEAK uint8_t TCMalloc_Internal_GetMinHotAccessHint();
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMinHotAccessHint(uint8_t v);
+ABSL_ATTRIBUTE_WEAK uint8_t TCMalloc_Internal_GetMaxWarmAccessHint();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMaxWarmAccessHint(uint8_t v);
 [[maybe_unused]] ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_PossiblyCold(
     const void* ptr);
 ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesDynamicSlabEnabled();
@@ -104,6 +106,122 @@ ABSL_ATTRIBUTE_WEAK tcmalloc::tcmalloc_internal::MadvisePreference
 TCMalloc_Internal_GetMadvise();
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMadvise(
     tcmalloc::tcmalloc_internal::MadvisePreference v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesRemoteSteal();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesRemoteSteal(bool v);
+ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetPerCpuCachesPartitionedSlabResize();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesPartitionedSlabResize(bool v);
+ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetPerCpuCachesAllocationRateResize();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesAllocationRateResize(bool v);
+ABSL_ATTRIBUTE_WEAK double TCMalloc_Internal_GetPerCpuCachesTargetHitRate();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesTargetHitRate(double v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesPrefetchColdClasses();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesPrefetchColdClasses(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesThreadMagazine();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesThreadMagazine(bool v);
+ABSL_ATTRIBUTE_WEAK int64_t
+TCMalloc_Internal_GetTransferCachePlunderIntervals();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetTransferCachePlunderIntervals(int64_t v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesBatchSizeAutotune();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesBatchSizeAutotune(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesSummaryStats();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetPerCpuCachesSummaryStats(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetLifetimeAwareSpanPlacement();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetLifetimeAwareSpanPlacement(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetCollapseSubreleasedHugepages();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetCollapseSubreleasedHugepages(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetLifetimeAwareRegionPlacement();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetLifetimeAwareRegionPlacement(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetLifetimeAwareFillerPlacement();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetLifetimeAwareFillerPlacement(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetAsyncReleaseMemoryToSystem();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetAsyncReleaseMemoryToSystem(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetMemoryPressureAwareRelease();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetMemoryPressureAwareRelease(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetFollowCgroupMemoryLimits();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetFollowCgroupMemoryLimits(bool v);
+ABSL_ATTRIBUTE_WEAK uint64_t
+TCMalloc_Internal_GetLargeAllocationPrefaultThreshold();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetLargeAllocationPrefaultThreshold(uint64_t v);
+ABSL_ATTRIBUTE_WEAK uint64_t TCMalloc_Internal_GetGiganticPageThreshold();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetGiganticPageThreshold(uint64_t v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetAuditHugepageBacking();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetAuditHugepageBacking(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesBatchRemoteFrees();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesBatchRemoteFrees(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetDemoteIdleHugepages();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetDemoteIdleHugepages(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetColdCallsiteClassification();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetColdCallsiteClassification(bool v);
+ABSL_ATTRIBUTE_WEAK int64_t
+TCMalloc_Internal_GetProfileSamplesPerSecondTarget();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetProfileSamplesPerSecondTarget(int64_t v);
+ABSL_ATTRIBUTE_WEAK int64_t
+TCMalloc_Internal_GetSlowPathLatencySamplingInterval();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetSlowPathLatencySamplingInterval(int64_t v);
+ABSL_ATTRIBUTE_WEAK int64_t
+TCMalloc_Internal_GetPageHeapLockContentionSamplingInterval();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(int64_t v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetMetadataArenaHugepages();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetMetadataArenaHugepages(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetThreadCacheDynamicResize();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetThreadCacheDynamicResize(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetReleaseCachesAtFork();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetReleaseCachesAtFork(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetAdaptiveGuardedSampling();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetAdaptiveGuardedSampling(bool v);
+ABSL_ATTRIBUTE_WEAK int64_t TCMalloc_Internal_GetSelSanSamplingInterval();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetSelSanSamplingInterval(int64_t v);
+ABSL_ATTRIBUTE_WEAK uint64_t TCMalloc_Internal_GetReleaseRefaultBudget();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetReleaseRefaultBudget(uint64_t v);
+ABSL_ATTRIBUTE_WEAK uint64_t TCMalloc_Internal_GetLargeSpanCacheBytes();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetLargeSpanCacheBytes(uint64_t v);
+ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetPerCpuCachesIncrementalSlabResize();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesIncrementalSlabResize(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesL3CapacityPools();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesL3CapacityPools(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerCpuCachesPartialReclaim();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerCpuCachesPartialReclaim(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetBackgroundEventDriven();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetBackgroundEventDriven(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetTransferCacheBackgroundRefill();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetTransferCacheBackgroundRefill(bool v);
+ABSL_ATTRIBUTE_WEAK int64_t
+TCMalloc_Internal_GetThreadCacheIdleFlushIntervals();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetThreadCacheIdleFlushIntervals(int64_t v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetFramePointerUnwinding();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetFramePointerUnwinding(bool v);
+ABSL_ATTRIBUTE_WEAK bool TCMalloc_Internal_GetPerThreadAllocationAccounting();
+ABSL_ATTRIBUTE_WEAK void
+TCMalloc_Internal_SetPerThreadAllocationAccounting(bool v);
+ABSL_ATTRIBUTE_WEAK int64_t TCMalloc_Internal_GetCachedStatsMaxAgeMs();
+ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetCachedStatsMaxAgeMs(int64_t v);
 }
 
 #endif  // TCMALLOC_INTERNAL_PARAMETER_ACCESSORS_H_
@@ -17,6 +17,8 @@
 #include <sched.h>
 #include <stdint.h>
 #include <sys/mman.h>
+#include <string.h>
+#include <sys/auxv.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <syscall.h>
@@ -30,11 +32,13 @@
 
 #include "absl/base/attributes.h"
 #include "absl/base/call_once.h"  // IWYU pragma: keep
+#include "absl/base/internal/cycleclock.h"
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/linux_syscall_support.h"
 #include "tcmalloc/internal/logging.h"
-#include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal/util.h"
 
@@ -56,10 +60,15 @@ enum PerCpuInitStatus {
 };
 
 ABSL_CONST_INIT static PerCpuInitStatus init_status = kSlowMode;
+ABSL_CONST_INIT static RseqVcpuMode rseq_vcpu_mode = RseqVcpuMode::kNone;
 ABSL_CONST_INIT static absl::once_flag init_per_cpu_once;
 #if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
 ABSL_CONST_INIT static std::atomic<bool> using_upstream_fence{false};
 #endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+ABSL_CONST_INIT static std::atomic<uint64_t> num_fence_all_cpus{0};
+ABSL_CONST_INIT static std::atomic<int64_t> fence_all_cpus_cycles{0};
+ABSL_CONST_INIT static std::atomic<uint64_t> num_fence_cpu{0};
+ABSL_CONST_INIT static std::atomic<int64_t> fence_cpu_cycles{0};
 
 extern "C" thread_local char tcmalloc_sampler ABSL_ATTRIBUTE_INITIAL_EXEC;
 
@@ -85,10 +94,35 @@ static bool InitThreadPerCpu() {
   return false;
 }
 
+RseqVcpuMode GetRseqVcpuMode() { return rseq_vcpu_mode; }
+
 bool UsingRseqVirtualCpus() {
-  return false;
+  return rseq_vcpu_mode == RseqVcpuMode::kMmCid;
 }
 
+#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+static RseqVcpuMode ChooseRseqVcpuMode() {
+  const char* e = thread_safe_getenv("TCMALLOC_RSEQ_VCPU_MODE");
+  if (e == nullptr || !strcmp(e, "none")) {
+    return RseqVcpuMode::kNone;
+  }
+  if (strcmp(e, "mm_cid")) {
+    TC_BUG("bad TCMALLOC_RSEQ_VCPU_MODE env var '%s'", e);
+  }
+
+#ifndef AT_RSEQ_FEATURE_SIZE
+#define AT_RSEQ_FEATURE_SIZE 27
+#endif
+  // Kernels before 6.3 do not report the size, and leave mm_cid alone.
+  const size_t feature_size = getauxval(AT_RSEQ_FEATURE_SIZE);
+  if (feature_size < offsetof(kernel_rseq, mm_cid) + sizeof(unsigned)) {
+    TC_LOG("mm_cid is not supported by the kernel, using real CPU ids");
+    return RseqVcpuMode::kNone;
+  }
+  return RseqVcpuMode::kMmCid;
+}
+#endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+
 static int UserVirtualCpuId() {
   TC_BUG("initialized unsupported vCPU mode");
 }
@@ -99,7 +133,7 @@ int VirtualCpu::Synchronize() {
 
   if (UsingVirtualCpus()) {
     if (UsingRseqVirtualCpus())
-      vcpu = __rseq_abi.vcpu_id;
+      vcpu = __rseq_abi.mm_cid;
     else
       vcpu = UserVirtualCpuId();
   } else {
@@ -143,6 +177,10 @@ static void InitPerCpu() {
     // Ensure that tcmalloc_sampler is located before tcmalloc_slabs.
     TC_CHECK_LE(sampler_addr + TCMALLOC_SAMPLER_SIZE, slabs_addr);
 
+    // Concurrency ids are below the number of possible CPUs, so they index
+    // the same slabs that real CPU ids would.
+    rseq_vcpu_mode = ChooseRseqVcpuMode();
+
     constexpr int kMEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ = (1 << 8);
     // It is safe to make the syscall below multiple times.
     using_upstream_fence.store(
@@ -340,6 +378,17 @@ static void FenceInterruptCPU(int cpu) {
   SlowFence(cpu);
 }
 
+// Fences "cpu" (or every cpu, for -1) with the cheapest fence available.
+static void FenceRealCpu(int cpu) {
+#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+  if (using_upstream_fence.load(std::memory_order_relaxed)) {
+    UpstreamRseqFenceCpu(cpu);
+    return;
+  }
+#endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+  FenceInterruptCPU(cpu);
+}
+
 void FenceCpu(int vcpu) {
   // Prevent compiler re-ordering of code below. In particular, the call to
   // GetRealCpu must not appear in assembly program order until after any
@@ -353,8 +402,6 @@ void FenceCpu(int vcpu) {
   }
 
   if (UsingRseqVirtualCpus()) {
-    ASSUME(false);
-
     // With virtual CPUs, we cannot identify the true physical core we need to
     // interrupt.
     FenceAllCpus();
@@ -362,25 +409,47 @@ void FenceCpu(int vcpu) {
   }
 
   int real_cpu = vcpu;
+  const int64_t start = absl::base_internal::CycleClock::Now();
+  FenceRealCpu(real_cpu);
+  num_fence_cpu.fetch_add(1, std::memory_order_relaxed);
+  fence_cpu_cycles.fetch_add(absl::base_internal::CycleClock::Now() - start,
+                             std::memory_order_relaxed);
+}
 
-#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
-  if (using_upstream_fence.load(std::memory_order_relaxed)) {
-    UpstreamRseqFenceCpu(real_cpu);
+void FenceAllCpus() {
+  num_fence_all_cpus.fetch_add(1, std::memory_order_relaxed);
+  const int64_t start = absl::base_internal::CycleClock::Now();
+  FenceRealCpu(-1);
+  fence_all_cpus_cycles.fetch_add(
+      absl::base_internal::CycleClock::Now() - start,
+      std::memory_order_relaxed);
+}
+
+void FenceCpus(absl::Span<const int> vcpus) {
+  // Past this many cpus, the fence of every cpu is the cheaper one.
+  constexpr size_t kMaxSingleCpuFences = 2;
+
+  if (vcpus.size() > kMaxSingleCpuFences) {
+    FenceAllCpus();
     return;
   }
-#endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
+  for (int vcpu : vcpus) {
+    FenceCpu(vcpu);
+  }
+}
 
-  FenceInterruptCPU(real_cpu);
+uint64_t NumFenceAllCpus() {
+  return num_fence_all_cpus.load(std::memory_order_relaxed);
 }
 
-void FenceAllCpus() {
-#if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
-  if (using_upstream_fence.load(std::memory_order_relaxed)) {
-    UpstreamRseqFenceCpu(-1);
-    return;
-  }
-#endif  // TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
-  FenceInterruptCPU(-1);
+FenceStats GetFenceStats() {
+  FenceStats stats;
+  stats.cpu_fences = num_fence_cpu.load(std::memory_order_relaxed);
+  stats.cpu_fence_cycles = fence_cpu_cycles.load(std::memory_order_relaxed);
+  stats.all_cpu_fences = num_fence_all_cpus.load(std::memory_order_relaxed);
+  stats.all_cpu_fence_cycles =
+      fence_all_cpus_cycles.load(std::memory_order_relaxed);
+  return stats;
 }
 
 }  // namespace percpu
@@ -16,7 +16,7 @@
 #define TCMALLOC_INTERNAL_PERCPU_H_
 
 // sizeof(Sampler)
-#define TCMALLOC_SAMPLER_SIZE 32
+#define TCMALLOC_SAMPLER_SIZE 48
 // alignof(Sampler)
 #define TCMALLOC_SAMPLER_ALIGN 8
 // Sampler::HotDataOffset()
@@ -62,6 +62,7 @@
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/linux_syscall_support.h"
 #include "tcmalloc/internal/logging.h"
@@ -163,6 +164,12 @@ extern "C" ABSL_CONST_INIT thread_local volatile kernel_rseq __rseq_abi
     ABSL_ATTRIBUTE_INITIAL_EXEC;
 extern "C" ABSL_CONST_INIT thread_local volatile int tcmalloc_cached_vcpu
     ABSL_ATTRIBUTE_INITIAL_EXEC;
+// Number of rseq critical sections of the calling thread that were aborted
+// (and restarted) since the last TakeRseqAborts(). Incremented by the abort
+// trampolines of the inline critical sections in percpu_tcmalloc.h; only
+// maintained on x86-64, where the trampoline can address TLS directly.
+extern "C" ABSL_CONST_INIT thread_local volatile uint32_t tcmalloc_rseq_aborts
+    ABSL_ATTRIBUTE_INITIAL_EXEC;
 
 // Provide weak definitions here to enable more efficient codegen.
 // If compiler sees only extern declaration when generating accesses,
@@ -174,15 +181,28 @@ ABSL_CONST_INIT thread_local volatile uintptr_t tcmalloc_slabs
     ABSL_ATTRIBUTE_WEAK = {};
 ABSL_CONST_INIT thread_local volatile kernel_rseq __rseq_abi
     ABSL_ATTRIBUTE_WEAK = {
-        0,      static_cast<unsigned>(kCpuIdUninitialized),   0, 0,
-        {0, 0}, {{kCpuIdUninitialized, kCpuIdUninitialized}},
+        0, static_cast<unsigned>(kCpuIdUninitialized), 0, 0, 0, 0,
+        {{kCpuIdUninitialized, kCpuIdUninitialized}},
 };
 ABSL_CONST_INIT thread_local volatile int tcmalloc_cached_vcpu
     ABSL_ATTRIBUTE_WEAK = kCpuIdUninitialized;
+ABSL_CONST_INIT thread_local volatile uint32_t tcmalloc_rseq_aborts
+    ABSL_ATTRIBUTE_WEAK = 0;
 
 inline int GetRealCpuUnsafe() { return __rseq_abi.cpu_id; }
+
+// Returns and resets the calling thread's count of aborted rseq critical
+// sections.
+inline uint32_t TakeRseqAborts() {
+  const uint32_t aborts = tcmalloc_rseq_aborts;
+  if (aborts != 0) {
+    tcmalloc_rseq_aborts = 0;
+  }
+  return aborts;
+}
 #else  // !TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
 inline int GetRealCpuUnsafe() { return kCpuIdUnsupported; }
+inline uint32_t TakeRseqAborts() { return 0; }
 #endif
 
 // Functions below are implemented in the architecture-specific percpu_rseq_*.S
@@ -199,8 +219,17 @@ size_t TcmallocSlab_Internal_PopBatch(size_t size_class, void** batch,
 // increase the visibility of functions embedded into the root-namespace (by
 // virtue of C linkage) in the supported case.
 
-enum class RseqVcpuMode { kNone };
-inline RseqVcpuMode GetRseqVcpuMode() { return RseqVcpuMode::kNone; }
+// Where virtual CPU ids come from:
+//   kNone:  No virtual CPUs, slabs are indexed by real CPU id.
+//   kMmCid: The kernel's per-process concurrency id, __rseq_abi.mm_cid.
+//           These are dense, so a process allowed 4 of 256 CPUs touches the
+//           slabs of only 4.
+//
+// The mode is chosen once, when per-CPU mode is initialized, from the
+// TCMALLOC_RSEQ_VCPU_MODE environment variable ("none" or "mm_cid"); kMmCid
+// falls back to kNone on kernels that do not provide mm_cid.
+enum class RseqVcpuMode { kNone, kMmCid };
+RseqVcpuMode GetRseqVcpuMode();
 
 // Return whether we are using any kind of virtual CPUs.
 inline bool UsingVirtualCpus() {
@@ -349,6 +378,27 @@ inline void TSANReleaseBatch(void** batch, int n) {
 void FenceCpu(int vcpu);
 void FenceAllCpus();
 
+// Fences every cpu of <vcpus>, as FenceCpu() does for each of them.  A
+// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ) call targets either a
+// single cpu or all of them, and the fallback fence moves to each cpu in turn,
+// so fencing more than a couple of cpus one by one costs more than a single
+// fence of every cpu, which is what is done then.
+void FenceCpus(absl::Span<const int> vcpus);
+
+// Returns the number of fences that had to interrupt every cpu, either from
+// FenceAllCpus() or from FenceCpu() when the target cpu cannot be identified.
+uint64_t NumFenceAllCpus();
+
+// The fences that had to interrupt other cpus, and the CycleClock ticks they
+// took.  Fences of the calling thread's own cpu are free, and not counted.
+struct FenceStats {
+  uint64_t cpu_fences = 0;
+  int64_t cpu_fence_cycles = 0;
+  uint64_t all_cpu_fences = 0;
+  int64_t all_cpu_fence_cycles = 0;
+};
+FenceStats GetFenceStats();
+
 }  // namespace percpu
 }  // namespace subtle
 }  // namespace tcmalloc_internal
@@ -33,9 +33,11 @@
 #include "absl/base/attributes.h"
 #include "absl/base/casts.h"
 #include "absl/base/dynamic_annotations.h"
+#include "absl/base/internal/cycleclock.h"
 #include "absl/base/optimization.h"
 #include "absl/functional/function_ref.h"
 #include "absl/numeric/bits.h"
+#include "absl/types/span.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/mincore.h"
 #include "tcmalloc/internal/optimization.h"
@@ -94,6 +96,16 @@ inline size_t GetSlabsAllocSize(Shift shift, int num_cpus) {
 // existing Arena block.
 static constexpr std::align_val_t kPhysicalPageAlign{EXEC_PAGESIZE};
 
+// Per-cpu storage behind TcmallocSlab::GetCpuStats().
+struct AtomicSlabCpuStats {
+  std::atomic<uint64_t> rseq_aborts;
+  std::atomic<uint64_t> fences;
+  std::atomic<int64_t> stopped_cycles;
+  // Time the cpu was last stopped. Only accessed by the thread that stopped
+  // the cpu.
+  int64_t stop_start;
+};
+
 // Tcmalloc slab for per-cpu caching mode.
 // Conceptually it is equivalent to an array of NumClasses PerCpuSlab's,
 // and in fallback implementation it is implemented that way. But optimized
@@ -174,7 +186,45 @@ class TcmallocSlab {
   ABSL_MUST_USE_RESULT ResizeSlabsInfo ResizeSlabs(
       Shift new_shift, void* new_slabs,
       absl::FunctionRef<size_t(size_t)> capacity,
-      absl::FunctionRef<bool(size_t)> populated, DrainHandler drain_handler);
+      absl::FunctionRef<bool(size_t)> populated, DrainHandler drain_handler) {
+    return ResizeSlabs(new_shift, new_slabs, capacity, populated, populated,
+                       drain_handler);
+  }
+
+  // Like above, but only cpus for which <populated> is true are initialized in
+  // <new_slabs>, while all cpus for which <drain> is true are drained from the
+  // old slabs. <drain> must be true whenever <populated> is.
+  ABSL_MUST_USE_RESULT ResizeSlabsInfo ResizeSlabs(
+      Shift new_shift, void* new_slabs,
+      absl::FunctionRef<size_t(size_t)> capacity,
+      absl::FunctionRef<bool(size_t)> populated,
+      absl::FunctionRef<bool(size_t)> drain, DrainHandler drain_handler) {
+    return ResizeSlabs(
+        new_shift, new_slabs, capacity, populated, drain,
+        [](size_t) { return false; }, drain_handler);
+  }
+
+  // Like above, but cpus for which <initialized> is true have already been
+  // set up in <new_slabs> by InitCpuForResize(), so that only the populated
+  // cpus initialized since then are set up while every cpu is stopped.
+  ABSL_MUST_USE_RESULT ResizeSlabsInfo ResizeSlabs(
+      Shift new_shift, void* new_slabs,
+      absl::FunctionRef<size_t(size_t)> capacity,
+      absl::FunctionRef<bool(size_t)> populated,
+      absl::FunctionRef<bool(size_t)> drain,
+      absl::FunctionRef<bool(size_t)> initialized, DrainHandler drain_handler);
+
+  // Sets up <cpu> in <new_slabs>, laid out for <new_shift> and the maximum
+  // capacities returned by <capacity>, ahead of a ResizeSlabs() to them.  As
+  // <new_slabs> are not in use yet, <cpu> keeps running on the current slabs
+  // in the meantime, and need not be stopped.  This moves the page faults of
+  // the new slabs out of the window during which ResizeSlabs() stops every
+  // cpu.
+  //
+  // The caller must ensure that the maximum capacities do not change before
+  // the ResizeSlabs() call.
+  void InitCpuForResize(void* new_slabs, Shift new_shift, int cpu,
+                        absl::FunctionRef<size_t(size_t)> capacity);
 
   // For tests. Returns the freed slabs pointer.
   void* Destroy(absl::FunctionRef<void(void*, size_t, std::align_val_t)> free);
@@ -202,7 +252,9 @@ class TcmallocSlab {
   bool Push(size_t size_class, void* item);
 
   // Remove an item (LIFO) from the current CPU's slab. If the slab is empty,
-  // invokes <underflow_handler> and returns its result.
+  // invokes <underflow_handler> and returns its result. If <PrefetchNext> is
+  // true, the object that the following Pop will return is prefetched.
+  template <bool PrefetchNext = true>
   ABSL_MUST_USE_RESULT void* Pop(size_t class_size);
 
   // Add up to <len> items to the current cpu slab from the array located at
@@ -274,6 +326,14 @@ class TcmallocSlab {
   size_t ShrinkOtherCache(int cpu, size_t size_class, size_t len,
                           ShrinkHandler shrink_handler);
 
+  // Pops up to <len> items from the cpu/size_class slab into <batch> and
+  // returns the number of items removed. Capacity is left unchanged.
+  //
+  // May be called from another processor, not just the <cpu>.
+  // REQUIRES: len > 0.
+  size_t PopBatchOtherCache(int cpu, size_t size_class, void** batch,
+                            size_t len);
+
   // Remove all items (of all classes) from <cpu>'s slab; reset capacity for all
   // classes to zero.  Then, for each sizeclass, invoke
   // DrainHandler(size_class, <items from slab>, <previous slab capacity>);
@@ -282,8 +342,27 @@ class TcmallocSlab {
   // Push/Pop/Grow/Shrink concurrently (even on the same CPU) is safe.
   void Drain(int cpu, DrainHandler drain_handler);
 
+  // Drain() for every cpu in <cpus>. The cpus are stopped together, so that a
+  // single fence covers all of them when there are more than a few.
+  //
+  // It is invalid to concurrently execute Drain() for any of these CPUs.
+  void DrainCpus(absl::Span<const int> cpus, DrainHandler drain_handler);
+
   PerCPUMetadataState MetadataMemoryUsage() const;
 
+  // Counters of events that make local operations on a cpu slow or fail.
+  struct CpuStats {
+    // Number of rseq critical sections that were aborted and restarted. Aborts
+    // are counted per thread and attributed to the cpu the thread is running
+    // on when it next calls CacheCpuSlab(). Only maintained on x86-64.
+    uint64_t rseq_aborts = 0;
+    // Number of fences used to stop the cpu for remote operations.
+    uint64_t fences = 0;
+    // Total CycleClock ticks the cpu spent stopped by remote operations.
+    int64_t stopped_cycles = 0;
+  };
+  CpuStats GetCpuStats(int cpu) const;
+
   // Gets the current shift of the slabs. Intended for use by the thread that
   // calls ResizeSlabs().
   uint8_t GetShift() const {
@@ -373,6 +452,9 @@ class TcmallocSlab {
   // Implementation of InitCpu() allowing for reuse in ResizeSlabs().
   void InitCpuImpl(void* slabs, Shift shift, int cpu,
                    absl::FunctionRef<size_t(size_t)> capacity);
+  // Lays out the slab headers of <cpu> with zero capacity in <slabs>.
+  static void InitCpuSlabs(void* slabs, Shift shift, int cpu,
+                           absl::FunctionRef<size_t(size_t)> capacity);
 
   std::pair<int, bool> CacheCpuSlabSlow();
 
@@ -384,6 +466,14 @@ class TcmallocSlab {
   std::atomic<bool>* stopped_ = nullptr;
   // begins_[size_class] is offset of the size_class region in the slabs area.
   std::atomic<uint16_t>* begins_ = nullptr;
+  // cpu_stats_[cpu] backs GetCpuStats(cpu).
+  AtomicSlabCpuStats* cpu_stats_ = nullptr;
+
+  // Attributes the calling thread's rseq aborts to <cpu>.
+  void RecordRseqAborts(int cpu);
+  // Record that <cpu> has been stopped with a fence, and restarted.
+  void RecordCpuStopped(int cpu, int64_t now);
+  void RecordCpuStarted(int cpu, int64_t now);
 };
 
 // RAII for StopCpu/StartCpu.
@@ -428,6 +518,12 @@ inline size_t TcmallocSlab<NumClasses>::Capacity(int cpu,
 #if defined(__x86_64__)
 #define TCMALLOC_RSEQ_RELOC_TYPE "R_X86_64_NONE"
 #define TCMALLOC_RSEQ_JUMP "jmp"
+// The trampoline only runs on abort, so counting there costs nothing on the
+// fast path. tcmalloc_rseq_aborts is addressed %fs-relative, which needs no
+// register.
+#define TCMALLOC_RSEQ_COUNT_ABORT "addl $1, %[rseq_aborts_addr]\n"
+#define TCMALLOC_RSEQ_ABORTS_INPUT \
+  , [rseq_aborts_addr] "m"(tcmalloc_rseq_aborts)
 #if !defined(__PIC__) && !defined(__PIE__)
 #define TCMALLOC_RSEQ_SET_CS(name) \
   "movq $__rseq_cs_" #name "_%=, %[rseq_cs_addr]\n"
@@ -459,6 +555,10 @@ inline size_t TcmallocSlab<NumClasses>::Capacity(int cpu,
 #define TCMALLOC_RSEQ_CLOBBER "x16", "x17"
 #define TCMALLOC_RSEQ_RELOC_TYPE "R_AARCH64_NONE"
 #define TCMALLOC_RSEQ_JUMP "b"
+// Addressing TLS takes registers that the trampoline does not have, so aborts
+// are not counted.
+#define TCMALLOC_RSEQ_COUNT_ABORT
+#define TCMALLOC_RSEQ_ABORTS_INPUT
 #define TCMALLOC_RSEQ_SET_CS(name)                     \
   TCMALLOC_RSEQ_TRAMPLINE_SMASH                        \
   "adrp %[scratch], __rseq_cs_" #name                  \
@@ -519,7 +619,7 @@ inline size_t TcmallocSlab<NumClasses>::Capacity(int cpu,
   "_trampoline_%=,@function\n"                                                \
   "" #name                                                                    \
   "_trampoline_%=:\n"                                                         \
-  "2:\n" TCMALLOC_RSEQ_JUMP                                                   \
+  "2:\n" TCMALLOC_RSEQ_COUNT_ABORT TCMALLOC_RSEQ_JUMP                         \
   " 3f\n"                                                                     \
   ".size " #name "_trampoline_%=, . - " #name                                 \
   "_trampoline_%=\n"                                                          \
@@ -537,7 +637,8 @@ inline size_t TcmallocSlab<NumClasses>::Capacity(int cpu,
                                               is no cost to passing unused   \
                                               consts. */                     \
       [cached_slabs_bit] "n"(TCMALLOC_CACHED_SLABS_BIT),                     \
-      [cached_slabs_mask_neg] "n"(~TCMALLOC_CACHED_SLABS_MASK)
+      [cached_slabs_mask_neg] "n"(~TCMALLOC_CACHED_SLABS_MASK)               \
+          TCMALLOC_RSEQ_ABORTS_INPUT
 
 // Store v to p (*p = v) if the current thread wasn't rescheduled
 // (still has the slab pointer cached). Otherwise returns false.
@@ -774,6 +875,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void PrefetchNextObject(
 
 #if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__x86_64__)
 template <size_t NumClasses>
+template <bool PrefetchNext>
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
     size_t size_class) {
   TC_ASSERT_NE(size_class, 0);
@@ -845,7 +947,9 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
   // The next pop will be from current-1, but because we prefetch the previous
   // element we've already just read that, so prefetch current-2.
   PrefetchSlabMemory(scratch + (current - 2) * sizeof(void*));
-  PrefetchNextObject(next);
+  if constexpr (PrefetchNext) {
+    PrefetchNextObject(next);
+  }
   return AssumeNotNull(result);
 underflow_path:
   return nullptr;
@@ -854,6 +958,7 @@ underflow_path:
 
 #if TCMALLOC_INTERNAL_PERCPU_USE_RSEQ && defined(__aarch64__)
 template <size_t NumClasses>
+template <bool PrefetchNext>
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
     size_t size_class) {
   TC_ASSERT_NE(size_class, 0);
@@ -928,7 +1033,9 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
   }
 #endif
   TSANAcquire(result);
-  PrefetchNextObject(prefetch);
+  if constexpr (PrefetchNext) {
+    PrefetchNextObject(prefetch);
+  }
   return AssumeNotNull(result);
 underflow_path:
   return nullptr;
@@ -937,6 +1044,7 @@ underflow_path:
 
 #if !TCMALLOC_INTERNAL_PERCPU_USE_RSEQ
 template <size_t NumClasses>
+template <bool PrefetchNext>
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* TcmallocSlab<NumClasses>::Pop(
     size_t size_class) {
   return nullptr;
@@ -969,7 +1077,44 @@ inline std::pair<int, bool> TcmallocSlab<NumClasses>::CacheCpuSlab() {
   }
   // We already have slab offset cached, so the slab is indeed full/empty.
 #endif
-  return {VirtualCpu::GetAfterSynchronize(), false};
+  const int cpu = VirtualCpu::GetAfterSynchronize();
+  RecordRseqAborts(cpu);
+  return {cpu, false};
+}
+
+template <size_t NumClasses>
+inline void TcmallocSlab<NumClasses>::RecordRseqAborts(int cpu) {
+  const uint32_t aborts = TakeRseqAborts();
+  if (ABSL_PREDICT_FALSE(aborts != 0)) {
+    cpu_stats_[cpu].rseq_aborts.fetch_add(aborts, std::memory_order_relaxed);
+  }
+}
+
+template <size_t NumClasses>
+inline void TcmallocSlab<NumClasses>::RecordCpuStopped(int cpu, int64_t now) {
+  AtomicSlabCpuStats& stats = cpu_stats_[cpu];
+  stats.fences.store(stats.fences.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  stats.stop_start = now;
+}
+
+template <size_t NumClasses>
+inline void TcmallocSlab<NumClasses>::RecordCpuStarted(int cpu, int64_t now) {
+  AtomicSlabCpuStats& stats = cpu_stats_[cpu];
+  const int64_t stopped = now - stats.stop_start;
+  stats.stopped_cycles.store(
+      stats.stopped_cycles.load(std::memory_order_relaxed) + stopped,
+      std::memory_order_relaxed);
+}
+
+template <size_t NumClasses>
+auto TcmallocSlab<NumClasses>::GetCpuStats(int cpu) const -> CpuStats {
+  const AtomicSlabCpuStats& stats = cpu_stats_[cpu];
+  CpuStats result;
+  result.rseq_aborts = stats.rseq_aborts.load(std::memory_order_relaxed);
+  result.fences = stats.fences.load(std::memory_order_relaxed);
+  result.stopped_cycles = stats.stopped_cycles.load(std::memory_order_relaxed);
+  return result;
 }
 
 template <size_t NumClasses>
@@ -1045,6 +1190,12 @@ void TcmallocSlab<NumClasses>::Init(
   for (int cpu = NumCPUs() - 1; cpu >= 0; cpu--) {
     stopped_[cpu].store(false, std::memory_order_relaxed);
   }
+  cpu_stats_ = static_cast<AtomicSlabCpuStats*>(
+      alloc(sizeof(cpu_stats_[0]) * NumCPUs(),
+            std::align_val_t{ABSL_CACHELINE_SIZE}));
+  for (int cpu = NumCPUs() - 1; cpu >= 0; cpu--) {
+    new (&cpu_stats_[cpu]) AtomicSlabCpuStats{};
+  }
   begins_ = static_cast<std::atomic<uint16_t>*>(alloc(
       sizeof(begins_[0]) * NumClasses, std::align_val_t{ABSL_CACHELINE_SIZE}));
   InitSlabs(slabs, shift, capacity);
@@ -1094,6 +1245,21 @@ void TcmallocSlab<NumClasses>::InitCpuImpl(
     void* slabs, Shift shift, int cpu,
     absl::FunctionRef<size_t(size_t)> capacity) {
   TC_CHECK(stopped_[cpu].load(std::memory_order_relaxed));
+  InitCpuSlabs(slabs, shift, cpu, capacity);
+}
+
+template <size_t NumClasses>
+void TcmallocSlab<NumClasses>::InitCpuForResize(
+    void* new_slabs, Shift new_shift, int cpu,
+    absl::FunctionRef<size_t(size_t)> capacity) {
+  TC_ASSERT_NE(new_slabs, GetSlabsAndShift(std::memory_order_relaxed).first);
+  InitCpuSlabs(new_slabs, new_shift, cpu, capacity);
+}
+
+template <size_t NumClasses>
+void TcmallocSlab<NumClasses>::InitCpuSlabs(
+    void* slabs, Shift shift, int cpu,
+    absl::FunctionRef<size_t(size_t)> capacity) {
   TC_CHECK_LE((1 << ToUint8(shift)), (1 << 16) * sizeof(void*));
 
   // Initialize prefetch target and compute the offsets for the
@@ -1178,6 +1344,7 @@ std::pair<int, bool> TcmallocSlab<NumClasses>::CacheCpuSlabSlow() {
     if (slabs_and_shift != slabs_and_shift_.load(std::memory_order_relaxed)) {
       continue;
     }
+    RecordRseqAborts(vcpu);
     return {vcpu, true};
   }
 }
@@ -1248,9 +1415,11 @@ ResizeSlabsInfo TcmallocSlab<NumClasses>::UpdateMaxCapacities(
   }
 
   const int num_cpus = NumCPUs();
+  const int64_t stop_start = absl::base_internal::CycleClock::Now();
   for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
     TC_CHECK(!stopped_[cpu].load(std::memory_order_relaxed));
     stopped_[cpu].store(true, std::memory_order_relaxed);
+    RecordCpuStopped(cpu, stop_start);
   }
   FenceAllCpus();
 
@@ -1269,7 +1438,9 @@ ResizeSlabsInfo TcmallocSlab<NumClasses>::UpdateMaxCapacities(
   InitSlabs(new_slabs, shift, capacity);
 
   // Phase 4: Re-start all CPUs.
+  const int64_t stop_end = absl::base_internal::CycleClock::Now();
   for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
+    RecordCpuStarted(cpu, stop_end);
     stopped_[cpu].store(false, std::memory_order_release);
   }
 
@@ -1286,9 +1457,12 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
     Shift new_shift, void* new_slabs,
     absl::FunctionRef<size_t(size_t)> capacity,
     absl::FunctionRef<bool(size_t)> populated,
+    absl::FunctionRef<bool(size_t)> drain,
+    absl::FunctionRef<bool(size_t)> initialized,
     DrainHandler drain_handler) -> ResizeSlabsInfo {
   // Phase 1: Collect begins, stop all CPUs and initialize any CPUs in the new
-  // slab that have already been populated in the old slab.
+  // slab that have already been populated in the old slab, unless
+  // InitCpuForResize() has initialized them already.
   const auto [old_slabs, old_shift] =
       GetSlabsAndShift(std::memory_order_relaxed);
   std::array<uint16_t, NumClasses> old_begins;
@@ -1299,11 +1473,16 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
 
   TC_ASSERT_NE(new_shift, old_shift);
   const int num_cpus = NumCPUs();
+  const int64_t stop_start = absl::base_internal::CycleClock::Now();
   for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
     TC_CHECK(!stopped_[cpu].load(std::memory_order_relaxed));
     stopped_[cpu].store(true, std::memory_order_relaxed);
+    RecordCpuStopped(cpu, stop_start);
     if (populated(cpu)) {
-      InitCpuImpl(new_slabs, new_shift, cpu, capacity);
+      TC_ASSERT(drain(cpu));
+      if (!initialized(cpu)) {
+        InitCpuImpl(new_slabs, new_shift, cpu, capacity);
+      }
     }
   }
   FenceAllCpus();
@@ -1312,13 +1491,15 @@ auto TcmallocSlab<NumClasses>::ResizeSlabs(
   InitSlabs(new_slabs, new_shift, capacity);
 
   // Phase 3: Re-start all CPUs.
+  const int64_t stop_end = absl::base_internal::CycleClock::Now();
   for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
+    RecordCpuStarted(cpu, stop_end);
     stopped_[cpu].store(false, std::memory_order_release);
   }
 
   // Phase 4: Return pointers from the old slab to the TransferCache.
   for (size_t cpu = 0; cpu < num_cpus; ++cpu) {
-    if (!populated(cpu)) continue;
+    if (!drain(cpu)) continue;
     DrainOldSlabs(old_slabs, old_shift, cpu, old_begins, drain_handler);
   }
 
@@ -1331,6 +1512,9 @@ void* TcmallocSlab<NumClasses>::Destroy(
   free(stopped_, sizeof(stopped_[0]) * NumCPUs(),
        std::align_val_t{ABSL_CACHELINE_SIZE});
   stopped_ = nullptr;
+  free(cpu_stats_, sizeof(cpu_stats_[0]) * NumCPUs(),
+       std::align_val_t{ABSL_CACHELINE_SIZE});
+  cpu_stats_ = nullptr;
   free(begins_, sizeof(begins_[0]) * NumClasses,
        std::align_val_t{ABSL_CACHELINE_SIZE});
   begins_ = nullptr;
@@ -1386,6 +1570,30 @@ size_t TcmallocSlab<NumClasses>::ShrinkOtherCache(
   return to_shrink;
 }
 
+template <size_t NumClasses>
+size_t TcmallocSlab<NumClasses>::PopBatchOtherCache(int cpu, size_t size_class,
+                                                    void** batch, size_t len) {
+  TC_ASSERT(stopped_[cpu].load(std::memory_order_relaxed));
+  TC_ASSERT_NE(size_class, 0);
+  TC_ASSERT_NE(len, 0);
+  const auto [slabs, shift] = GetSlabsAndShift(std::memory_order_relaxed);
+
+  auto* hdrp = GetHeader(slabs, shift, cpu, size_class);
+  Header hdr = LoadHeader(hdrp);
+  const uint16_t begin = begins_[size_class].load(std::memory_order_relaxed);
+  const uint16_t pop = std::min<size_t>(len, hdr.current - begin);
+  if (pop == 0) {
+    return 0;
+  }
+  void** items = reinterpret_cast<void**>(CpuMemoryStart(slabs, shift, cpu)) +
+                 hdr.current - pop;
+  TSANAcquireBatch(items, pop);
+  memcpy(batch, items, pop * sizeof(void*));
+  hdr.current -= pop;
+  StoreHeader(hdrp, hdr);
+  return pop;
+}
+
 template <size_t NumClasses>
 void TcmallocSlab<NumClasses>::Drain(int cpu, DrainHandler drain_handler) {
   ScopedSlabCpuStop<NumClasses> cpu_stop(*this, cpu);
@@ -1393,11 +1601,36 @@ void TcmallocSlab<NumClasses>::Drain(int cpu, DrainHandler drain_handler) {
   DrainCpu(slabs, shift, cpu, drain_handler);
 }
 
+template <size_t NumClasses>
+void TcmallocSlab<NumClasses>::DrainCpus(absl::Span<const int> cpus,
+                                         DrainHandler drain_handler) {
+  const int64_t stop_start = absl::base_internal::CycleClock::Now();
+  for (int cpu : cpus) {
+    TC_ASSERT(cpu >= 0 && cpu < NumCPUs(), "cpu=%d", cpu);
+    TC_CHECK(!stopped_[cpu].load(std::memory_order_relaxed));
+    stopped_[cpu].store(true, std::memory_order_relaxed);
+    RecordCpuStopped(cpu, stop_start);
+  }
+  FenceCpus(cpus);
+
+  const auto [slabs, shift] = GetSlabsAndShift(std::memory_order_relaxed);
+  for (int cpu : cpus) {
+    DrainCpu(slabs, shift, cpu, drain_handler);
+  }
+
+  const int64_t stop_end = absl::base_internal::CycleClock::Now();
+  for (int cpu : cpus) {
+    RecordCpuStarted(cpu, stop_end);
+    stopped_[cpu].store(false, std::memory_order_release);
+  }
+}
+
 template <size_t NumClasses>
 void TcmallocSlab<NumClasses>::StopCpu(int cpu) {
   TC_ASSERT(cpu >= 0 && cpu < NumCPUs(), "cpu=%d", cpu);
   TC_CHECK(!stopped_[cpu].load(std::memory_order_relaxed));
   stopped_[cpu].store(true, std::memory_order_relaxed);
+  RecordCpuStopped(cpu, absl::base_internal::CycleClock::Now());
   FenceCpu(cpu);
 }
 
@@ -1405,6 +1638,7 @@ template <size_t NumClasses>
 void TcmallocSlab<NumClasses>::StartCpu(int cpu) {
   TC_ASSERT(cpu >= 0 && cpu < NumCPUs(), "cpu=%d", cpu);
   TC_ASSERT(stopped_[cpu].load(std::memory_order_relaxed));
+  RecordCpuStarted(cpu, absl::base_internal::CycleClock::Now());
   stopped_[cpu].store(false, std::memory_order_release);
 }
 
@@ -1414,8 +1648,10 @@ PerCPUMetadataState TcmallocSlab<NumClasses>::MetadataMemoryUsage() const {
   const auto [slabs, shift] = GetSlabsAndShift(std::memory_order_relaxed);
   size_t slabs_size = GetSlabsAllocSize(shift, NumCPUs());
   size_t stopped_size = NumCPUs() * sizeof(stopped_[0]);
+  size_t cpu_stats_size = NumCPUs() * sizeof(cpu_stats_[0]);
   size_t begins_size = NumClasses * sizeof(begins_[0]);
-  result.virtual_size = stopped_size + slabs_size + begins_size;
+  result.virtual_size =
+      stopped_size + cpu_stats_size + slabs_size + begins_size;
   result.resident_size = MInCore::residence(slabs, slabs_size);
   return result;
 }
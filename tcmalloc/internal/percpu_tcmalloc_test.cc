@@ -533,6 +533,74 @@ TEST_F(TcmallocSlabTest, ShrinkEmptyCache) {
   slab_.StartCpu(kCpu);
 }
 
+TEST_F(TcmallocSlabTest, CpuStats) {
+  if (MallocExtension::PerCpuCachesActive()) {
+    // This test unregisters rseq temporarily, as to decrease flakiness.
+    GTEST_SKIP() << "per-CPU TCMalloc is incompatible with unregistering rseq";
+  }
+
+  if (!IsFast()) {
+    GTEST_SKIP() << "Need fast percpu. Skipping.";
+    return;
+  }
+  constexpr int kCpu = 1;
+  slab_.InitCpu(kCpu, [](size_t size_class) { return kCapacity; });
+  const TcmallocSlab::CpuStats before = slab_.GetCpuStats(kCpu);
+  const uint64_t fence_all_cpus = NumFenceAllCpus();
+
+  slab_.StopCpu(kCpu);
+  absl::SleepFor(absl::Milliseconds(1));
+  slab_.StartCpu(kCpu);
+
+  const TcmallocSlab::CpuStats after = slab_.GetCpuStats(kCpu);
+  EXPECT_EQ(after.fences, before.fences + 1);
+  EXPECT_GT(after.stopped_cycles, before.stopped_cycles);
+  EXPECT_GE(after.rseq_aborts, before.rseq_aborts);
+  // FenceCpu() may fall back to fencing every cpu, but never fences less.
+  EXPECT_GE(NumFenceAllCpus(), fence_all_cpus);
+}
+
+TEST_F(TcmallocSlabTest, DrainCpus) {
+  if (MallocExtension::PerCpuCachesActive()) {
+    // This test unregisters rseq temporarily, as to decrease flakiness.
+    GTEST_SKIP() << "per-CPU TCMalloc is incompatible with unregistering rseq";
+  }
+
+  if (!IsFast()) {
+    GTEST_SKIP() << "Need fast percpu. Skipping.";
+    return;
+  }
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < std::min(NumCPUs(), 4); ++cpu) {
+    slab_.InitCpu(cpu, [](size_t size_class) { return kCapacity; });
+    cpus.push_back(cpu);
+  }
+  std::vector<TcmallocSlab::CpuStats> before;
+  for (int cpu : cpus) before.push_back(slab_.GetCpuStats(cpu));
+  const FenceStats fence_stats = GetFenceStats();
+
+  absl::flat_hash_set<int> drained;
+  slab_.DrainCpus(cpus, [&](int cpu, size_t size_class, void** batch,
+                            size_t size, size_t cap) {
+    drained.insert(cpu);
+    EXPECT_LT(size_class, kStressSlabs);
+    EXPECT_EQ(size, 0);
+    EXPECT_EQ(cap, 0);
+  });
+
+  EXPECT_THAT(drained, UnorderedElementsAreArray(cpus));
+  for (int i = 0; i < cpus.size(); ++i) {
+    EXPECT_EQ(slab_.GetCpuStats(cpus[i]).fences, before[i].fences + 1);
+  }
+  // All of the cpus are stopped behind one fence, unless there are so few that
+  // fencing them one by one is cheaper.
+  const FenceStats after = GetFenceStats();
+  EXPECT_LE(after.all_cpu_fences + after.cpu_fences,
+            fence_stats.all_cpu_fences + fence_stats.cpu_fences + cpus.size());
+  EXPECT_GT(after.all_cpu_fences + after.cpu_fences,
+            fence_stats.all_cpu_fences + fence_stats.cpu_fences);
+}
+
 TEST_F(TcmallocSlabTest, SimulatedMadviseFailure) {
   if (!IsFast()) {
     GTEST_SKIP() << "Need fast percpu. Skipping.";
@@ -1279,6 +1347,58 @@ void BM_PushPopBatch(benchmark::State& state) {
 }
 BENCHMARK(BM_PushPopBatch);
 
+// Pops objects scattered over a buffer larger than the L1/L2 caches and links
+// each one into a list, the way a linked-structure builder touches freshly
+// allocated memory. Comparing the two instantiations shows how many of those
+// first touches the next-object prefetch in Pop turns into cache hits.
+template <bool PrefetchNext>
+void BM_PopAndLink(benchmark::State& state) {
+  TC_CHECK(IsFast());
+  constexpr int kCpu = 0;
+  constexpr size_t kSizeClass = 1;
+  constexpr size_t kObjectSize = 256;
+  constexpr int kBatchSize = 4096;
+  ScopedFakeCpuId fake_cpu_id(kCpu);
+  TcmallocSlab slab;
+  const auto get_capacity = [](size_t size_class) -> size_t {
+    return kBatchSize;
+  };
+  InitSlab(slab, allocator, get_capacity, kShift);
+  for (int cpu = 0, n = NumCPUs(); cpu < n; ++cpu) {
+    slab.InitCpu(cpu, get_capacity);
+  }
+  auto [cpu, _] = slab.CacheCpuSlab();
+  TC_CHECK_EQ(cpu, kCpu);
+  TC_CHECK_EQ(slab.Grow(kCpu, kSizeClass, kBatchSize,
+                        [](uint8_t shift) { return kBatchSize; }),
+              kBatchSize);
+
+  std::vector<char> buffer(kBatchSize * kObjectSize);
+  std::vector<void*> objects(kBatchSize);
+  for (int i = 0; i < kBatchSize; i++) {
+    objects[i] = &buffer[i * kObjectSize];
+  }
+  absl::BitGen rng;
+  std::shuffle(objects.begin(), objects.end(), rng);
+
+  for (auto _ : state) {
+    for (void* object : objects) {
+      TC_CHECK(slab.Push(kSizeClass, object));
+    }
+    void* head = nullptr;
+    for (size_t x = 0; x < kBatchSize; x++) {
+      void* object = slab.Pop<PrefetchNext>(kSizeClass);
+      TC_CHECK_NE(object, nullptr);
+      *static_cast<void**>(object) = head;
+      head = object;
+    }
+    benchmark::DoNotOptimize(head);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK_TEMPLATE(BM_PopAndLink, true);
+BENCHMARK_TEMPLATE(BM_PopAndLink, false);
+
 }  // namespace
 }  // namespace percpu
 }  // namespace subtle
@@ -34,12 +34,14 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "tcmalloc/internal/profile.pb.h"
 #include "absl/base/attributes.h"
@@ -47,6 +49,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/residency.h"
 
@@ -97,6 +100,120 @@ static const char* GetSoName(const dl_phdr_info* const info) {
   TC_CHECK_LT(dt_soname->d_un.d_val, dt_strsz->d_un.d_val);
   return strtab + dt_soname->d_un.d_val;
 }
+
+// A loaded segment, as AddCurrentMappings adds it to a profile.
+struct CurrentMapping {
+  uintptr_t memory_start;
+  uintptr_t memory_limit;
+  uintptr_t file_offset;
+  std::string filename;
+  std::string build_id;
+};
+
+// Resolving the filename and build ID of each loaded object takes several
+// system calls, so the current mappings are read once and reused until the
+// dynamic linker reports that an object was loaded or unloaded.
+struct MappingCache {
+  absl::Mutex mu;
+  bool valid ABSL_GUARDED_BY(mu) = false;
+  unsigned long long adds ABSL_GUARDED_BY(mu) = 0;
+  unsigned long long subs ABSL_GUARDED_BY(mu) = 0;
+  std::vector<CurrentMapping> mappings ABSL_GUARDED_BY(mu);
+};
+
+// Reads the dynamic linker's counts of objects loaded and unloaded so far.
+// Returns false if it does not report them.
+bool GetLoadCounts(unsigned long long& adds, unsigned long long& subs) {
+  struct Counts {
+    unsigned long long adds = 0;
+    unsigned long long subs = 0;
+    bool valid = false;
+  } counts;
+  dl_iterate_phdr(
+      +[](dl_phdr_info* info, size_t size, void* data) {
+        Counts& counts = *static_cast<Counts*>(data);
+        if (size >=
+            offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+          counts.adds = info->dlpi_adds;
+          counts.subs = info->dlpi_subs;
+          counts.valid = true;
+        }
+        // Every object reports the same counts.
+        return 1;
+      },
+      &counts);
+  adds = counts.adds;
+  subs = counts.subs;
+  return counts.valid;
+}
+
+std::vector<CurrentMapping> ReadCurrentMappings() {
+  auto dl_iterate_callback = +[](dl_phdr_info* info, size_t size, void* data) {
+    // Skip dummy entry introduced since glibc 2.18.
+    if (info->dlpi_phdr == nullptr && info->dlpi_phnum == 0) {
+      return 0;
+    }
+
+    auto& mappings = *static_cast<std::vector<CurrentMapping>*>(data);
+    const bool is_main_executable = mappings.empty();
+
+    // Evaluate all the loadable segments.
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+      if (info->dlpi_phdr[i].p_type != PT_LOAD) {
+        continue;
+      }
+      const ElfW(Phdr)* pt_load = &info->dlpi_phdr[i];
+
+      TC_CHECK_NE(pt_load, nullptr);
+
+      // Extract data.
+      const size_t memory_start = info->dlpi_addr + pt_load->p_vaddr;
+      const size_t memory_limit = memory_start + pt_load->p_memsz;
+      const size_t file_offset = pt_load->p_offset;
+
+      // Storage for path to executable as dlpi_name isn't populated for the
+      // main executable.  +1 to allow for the null terminator that readlink
+      // does not add.
+      char self_filename[PATH_MAX + 1];
+      const char* filename = info->dlpi_name;
+      if (filename == nullptr || filename[0] == '\0') {
+        // This is either the main executable or the VDSO.  The main executable
+        // is always the first entry processed by callbacks.
+        if (is_main_executable) {
+          // This is the main executable.
+          ssize_t ret = readlink("/proc/self/exe", self_filename,
+                                 sizeof(self_filename) - 1);
+          if (ret >= 0 && ret < sizeof(self_filename)) {
+            self_filename[ret] = '\0';
+            filename = self_filename;
+          }
+        } else {
+          // This is the VDSO.
+          filename = GetSoName(info);
+        }
+      }
+
+      char resolved_path[PATH_MAX];
+      absl::string_view resolved_filename;
+      if (realpath(filename, resolved_path)) {
+        resolved_filename = resolved_path;
+      } else {
+        resolved_filename = filename;
+      }
+
+      const std::string build_id = GetBuildId(info);
+
+      mappings.push_back({memory_start, memory_limit, file_offset,
+                          std::string(resolved_filename), build_id});
+    }
+    // Keep going.
+    return 0;
+  };
+
+  std::vector<CurrentMapping> mappings;
+  dl_iterate_phdr(dl_iterate_callback, &mappings);
+  return mappings;
+}
 #endif  // defined(__linux__)
 
 struct SampleMergedData {
@@ -106,6 +223,7 @@ struct SampleMergedData {
   std::optional<size_t> swapped_size;
   std::optional<size_t> stale_size;
   std::optional<size_t> locked_size;
+  std::optional<size_t> hugepage_size;
 };
 
 // The equality and hash methods of Profile::Sample only use a subset of its
@@ -115,7 +233,8 @@ struct SampleEqWithSubFields {
     auto fields = [](const Profile::Sample& s) {
       return std::tie(s.depth, s.requested_size, s.requested_alignment,
                       s.requested_size_returning, s.allocated_size,
-                      s.access_hint, s.access_allocated, s.guarded_status);
+                      s.access_hint, s.access_allocated, s.guarded_status,
+                      s.label);
     };
     return fields(a) == fields(b) &&
            std::equal(a.stack, a.stack + a.depth, b.stack, b.stack + b.depth);
@@ -127,7 +246,8 @@ struct SampleHashWithSubFields {
     return absl::HashOf(absl::MakeConstSpan(s.stack, s.depth), s.depth,
                         s.requested_size, s.requested_alignment,
                         s.requested_size_returning, s.allocated_size,
-                        s.access_hint, s.access_allocated, s.guarded_status);
+                        s.access_hint, s.access_allocated, s.guarded_status,
+                        s.label);
   }
 };
 
@@ -135,6 +255,41 @@ using SampleMergedMap =
     absl::flat_hash_map<const tcmalloc::Profile::Sample, SampleMergedData,
                         SampleHashWithSubFields, SampleEqWithSubFields>;
 
+// Counts the bytes of [addr, addr + size) that lie on hugepages the kernel
+// backs with transparent hugepages.  Queries made in address order read the
+// flags of each hugepage once.
+class HugepageBacking {
+ public:
+  explicit HugepageBacking(PageFlags& pageflags) : pageflags_(pageflags) {}
+
+  // Returns nullopt if pageflags can't tell.
+  std::optional<size_t> Get(const void* addr, size_t size) {
+    const uintptr_t start = reinterpret_cast<uintptr_t>(addr);
+    const uintptr_t end = start + size;
+    size_t backed = 0;
+    for (uintptr_t hugepage = start & ~(kHugePageSize - 1); hugepage < end;
+         hugepage += kHugePageSize) {
+      if (hugepage != last_hugepage_) {
+        last_backed_ =
+            pageflags_.IsHugepageBacked(reinterpret_cast<void*>(hugepage));
+        last_hugepage_ = hugepage;
+      }
+      if (!last_backed_.has_value()) return std::nullopt;
+      if (*last_backed_) {
+        backed += std::min(end, hugepage + kHugePageSize) -
+                  std::max(start, hugepage);
+      }
+    }
+    return backed;
+  }
+
+ private:
+  PageFlags& pageflags_;
+  // An address no hugepage starts at.
+  uintptr_t last_hugepage_ = 1;
+  std::optional<bool> last_backed_;
+};
+
 SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
     const tcmalloc::Profile& profile, PageFlags* pageflags,
     Residency* residency) {
@@ -144,9 +299,32 @@ SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
     SampleMergedData& data = map[entry];
     data.count += entry.count;
     data.sum += entry.sum;
+  });
+  if (!residency && !pageflags) return map;
+
+  // Look at the samples' memory in address order, so that procfs is read a
+  // hugepage at a time however many samples share it.  The map is complete,
+  // so pointers into it stay valid.
+  struct Query {
+    const void* addr;
+    size_t size;
+    int64_t count;
+    SampleMergedData* data;
+  };
+  std::vector<Query> queries;
+  profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
+    queries.push_back({entry.span_start_address, entry.allocated_size,
+                       entry.count, &map.find(entry)->second});
+  });
+  std::sort(queries.begin(), queries.end(),
+            [](const Query& a, const Query& b) { return a.addr < b.addr; });
+
+  std::optional<HugepageBacking> hugepage_backing;
+  if (pageflags) hugepage_backing.emplace(*pageflags);
+  for (const Query& entry : queries) {
+    SampleMergedData& data = *entry.data;
     if (residency) {
-      auto residency_info =
-          residency->Get(entry.span_start_address, entry.allocated_size);
+      auto residency_info = residency->GetBatched(entry.addr, entry.size);
       // As long as `residency_info` provides data in some samples, the merged
       // data will have their sums.
       // NOTE: The data here is comparable to `tcmalloc::Profile::Sample::sum`,
@@ -171,8 +349,7 @@ SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
     // very careful while changing the below -- it needs to match entirely the
     // form above.
     if (pageflags) {
-      auto page_stats =
-          pageflags->Get(entry.span_start_address, entry.allocated_size);
+      auto page_stats = pageflags->Get(entry.addr, entry.size);
       if (page_stats.has_value()) {
         if (!data.stale_size.has_value()) {
           data.stale_size.emplace();
@@ -184,8 +361,16 @@ SampleMergedMap MergeProfileSamplesAndMaybeGetResidencyInfo(
         }
         data.locked_size.value() += entry.count * page_stats->bytes_locked;
       }
+
+      if (auto backed = hugepage_backing->Get(entry.addr, entry.size);
+          backed.has_value()) {
+        if (!data.hugepage_size.has_value()) {
+          data.hugepage_size.emplace();
+        }
+        data.hugepage_size.value() += entry.count * *backed;
+      }
     }
-  });
+  }
   return map;
 }
 
@@ -402,70 +587,22 @@ void ProfileBuilder::InternCallstack(absl::Span<const void* const> stack,
 
 void ProfileBuilder::AddCurrentMappings() {
 #if defined(__linux__)
-  auto dl_iterate_callback = +[](dl_phdr_info* info, size_t size, void* data) {
-    // Skip dummy entry introduced since glibc 2.18.
-    if (info->dlpi_phdr == nullptr && info->dlpi_phnum == 0) {
-      return 0;
-    }
-
-    ProfileBuilder& builder = *static_cast<ProfileBuilder*>(data);
-    const bool is_main_executable = builder.profile_->mapping_size() == 0;
-
-    // Evaluate all the loadable segments.
-    for (int i = 0; i < info->dlpi_phnum; ++i) {
-      if (info->dlpi_phdr[i].p_type != PT_LOAD) {
-        continue;
-      }
-      const ElfW(Phdr)* pt_load = &info->dlpi_phdr[i];
-
-      TC_CHECK_NE(pt_load, nullptr);
-
-      // Extract data.
-      const size_t memory_start = info->dlpi_addr + pt_load->p_vaddr;
-      const size_t memory_limit = memory_start + pt_load->p_memsz;
-      const size_t file_offset = pt_load->p_offset;
-
-      // Storage for path to executable as dlpi_name isn't populated for the
-      // main executable.  +1 to allow for the null terminator that readlink
-      // does not add.
-      char self_filename[PATH_MAX + 1];
-      const char* filename = info->dlpi_name;
-      if (filename == nullptr || filename[0] == '\0') {
-        // This is either the main executable or the VDSO.  The main executable
-        // is always the first entry processed by callbacks.
-        if (is_main_executable) {
-          // This is the main executable.
-          ssize_t ret = readlink("/proc/self/exe", self_filename,
-                                 sizeof(self_filename) - 1);
-          if (ret >= 0 && ret < sizeof(self_filename)) {
-            self_filename[ret] = '\0';
-            filename = self_filename;
-          }
-        } else {
-          // This is the VDSO.
-          filename = GetSoName(info);
-        }
-      }
-
-      char resolved_path[PATH_MAX];
-      absl::string_view resolved_filename;
-      if (realpath(filename, resolved_path)) {
-        resolved_filename = resolved_path;
-      } else {
-        resolved_filename = filename;
-      }
-
-      const std::string build_id = GetBuildId(info);
-
-      // Add to profile.
-      builder.AddMapping(memory_start, memory_limit, file_offset,
-                         resolved_filename, build_id);
-    }
-    // Keep going.
-    return 0;
-  };
-
-  dl_iterate_phdr(dl_iterate_callback, this);
+  static MappingCache* const cache = new MappingCache;
+
+  unsigned long long adds, subs;
+  const bool counted = GetLoadCounts(adds, subs);
+  absl::MutexLock l(&cache->mu);
+  if (!counted || !cache->valid || adds != cache->adds ||
+      subs != cache->subs) {
+    cache->mappings = ReadCurrentMappings();
+    cache->valid = counted;
+    cache->adds = adds;
+    cache->subs = subs;
+  }
+  for (const CurrentMapping& mapping : cache->mappings) {
+    AddMapping(mapping.memory_start, mapping.memory_limit, mapping.file_offset,
+               mapping.filename, mapping.build_id);
+  }
 #endif  // defined(__linux__)
 }
 
@@ -529,6 +666,24 @@ static void MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
   const int active_thread_id = builder->InternString("active thread");
   const int callstack_pair_id = builder->InternString("callstack-pair-id");
   const int none_id = builder->InternString("none");
+  const int ppm_id = builder->InternString("ppm");
+  const int cross_numa_free_ratio_id =
+      builder->InternString("cross_numa_free_ratio");
+  const int cross_l3_free_ratio_id =
+      builder->InternString("cross_l3_free_ratio");
+
+  // Each bucket is labeled with the shortest lifetime it holds.
+  constexpr const char* kLifetimeBucketNames[] = {
+      "lifetime_1ns",  "lifetime_10ns",  "lifetime_100ns", "lifetime_1us",
+      "lifetime_10us", "lifetime_100us", "lifetime_1ms",   "lifetime_10ms",
+      "lifetime_100ms", "lifetime_1s",   "lifetime_10s",   "lifetime_100s",
+  };
+  static_assert(ABSL_ARRAYSIZE(kLifetimeBucketNames) ==
+                tcmalloc::Profile::Sample::kLifetimeHistogramBuckets);
+  int lifetime_bucket_ids[ABSL_ARRAYSIZE(kLifetimeBucketNames)];
+  for (size_t i = 0; i < ABSL_ARRAYSIZE(kLifetimeBucketNames); ++i) {
+    lifetime_bucket_ids[i] = builder->InternString(kLifetimeBucketNames[i]);
+  }
 
   profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
     perftools::profiles::Sample& sample = *converted.add_sample();
@@ -578,6 +733,14 @@ static void MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
                        absl::ToInt64Nanoseconds(entry.min_lifetime));
     add_positive_label(max_lifetime_id, nanoseconds_id,
                        absl::ToInt64Nanoseconds(entry.max_lifetime));
+    for (size_t i = 0; i < ABSL_ARRAYSIZE(lifetime_bucket_ids); ++i) {
+      add_positive_label(lifetime_bucket_ids[i], count_id,
+                         entry.lifetime_histogram[i]);
+    }
+    add_positive_label(cross_numa_free_ratio_id, ppm_id,
+                       std::lround(entry.cross_numa_free_ratio * 1e6));
+    add_positive_label(cross_l3_free_ratio_id, ppm_id,
+                       std::lround(entry.cross_l3_free_ratio * 1e6));
 
     add_optional_string_label(active_cpu_id,
                               entry.allocator_deallocator_physical_cpu_matched,
@@ -625,6 +788,40 @@ static void MakeLifetimeProfileProto(const tcmalloc::Profile& profile,
   });
 }
 
+static void MakeLockContentionProfileProto(const tcmalloc::Profile& profile,
+                                           ProfileBuilder* builder) {
+  TC_CHECK_NE(builder, nullptr);
+  perftools::profiles::Profile& converted = builder->profile();
+  perftools::profiles::ValueType* period_type = converted.mutable_period_type();
+
+  period_type->set_type(builder->InternString("contentions"));
+  period_type->set_unit(builder->InternString("count"));
+
+  for (const auto& [type, unit] : {std::pair{"contentions", "count"},
+                                   {"delay", "nanoseconds"},
+                                   {"hold", "nanoseconds"}}) {
+    perftools::profiles::ValueType* sample_type = converted.add_sample_type();
+    sample_type->set_type(builder->InternString(type));
+    sample_type->set_unit(builder->InternString(unit));
+  }
+
+  converted.set_default_sample_type(builder->InternString("delay"));
+  converted.set_duration_nanos(absl::ToInt64Nanoseconds(profile.Duration()));
+  // The allocator's own frames are kept: they tell which of its paths took
+  // the lock.
+
+  profile.Iterate([&](const tcmalloc::Profile::Sample& entry) {
+    perftools::profiles::Sample& sample = *converted.add_sample();
+
+    TC_CHECK_LE(entry.depth, ABSL_ARRAYSIZE(entry.stack));
+    builder->InternCallstack(absl::MakeSpan(entry.stack, entry.depth), sample);
+
+    sample.add_value(entry.count);
+    sample.add_value(absl::ToInt64Nanoseconds(entry.lock_wait_time));
+    sample.add_value(absl::ToInt64Nanoseconds(entry.lock_hold_time));
+  });
+}
+
 std::unique_ptr<perftools::profiles::Profile> ProfileBuilder::Finalize() && {
   return std::move(profile_);
 }
@@ -640,7 +837,13 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     return std::move(builder).Finalize();
   }
 
+  if (profile.Type() == ProfileType::kLockContention) {
+    MakeLockContentionProfileProto(profile, &builder);
+    return std::move(builder).Finalize();
+  }
+
   const int alignment_id = builder.InternString("alignment");
+  const int allocation_label_id = builder.InternString("allocation_label");
   const int bytes_id = builder.InternString("bytes");
   const int count_id = builder.InternString("count");
   const int objects_id = builder.InternString("objects");
@@ -651,6 +854,7 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
   const int swapped_space_id = builder.InternString("swapped_space");
   const int stale_space_id = builder.InternString("stale_space");
   const int locked_space_id = builder.InternString("locked_space");
+  const int hugepage_space_id = builder.InternString("hugepage_space");
   const int access_hint_id = builder.InternString("access_hint");
   const int access_allocated_id = builder.InternString("access_allocated");
   const int cold_id = builder.InternString("cold");
@@ -696,13 +900,19 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     sample_type = converted.add_sample_type();
     sample_type->set_type(locked_space_id);
     sample_type->set_unit(bytes_id);
+
+    sample_type = converted.add_sample_type();
+    sample_type->set_type(hugepage_space_id);
+    sample_type->set_unit(bytes_id);
   }
 
   int default_sample_type_id;
   switch (profile.Type()) {
     case tcmalloc::ProfileType::kFragmentation:
+    case tcmalloc::ProfileType::kPreciseFragmentation:
     case tcmalloc::ProfileType::kHeap:
     case tcmalloc::ProfileType::kPeakHeap:
+    case tcmalloc::ProfileType::kAllocationRate:
       default_sample_type_id = space_id;
       break;
     case tcmalloc::ProfileType::kAllocations:
@@ -737,6 +947,7 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
       sample.add_value(data.swapped_size.value_or(0));
       sample.add_value(data.stale_size.value_or(0));
       sample.add_value(data.locked_size.value_or(0));
+      sample.add_value(data.hugepage_size.value_or(0));
     }
 
     // add fields that are common to all memory profiles
@@ -756,6 +967,7 @@ absl::StatusOr<std::unique_ptr<perftools::profiles::Profile>> MakeProfileProto(
     add_positive_label(request_id, bytes_id, entry.requested_size);
     add_positive_label(alignment_id, bytes_id, entry.requested_alignment);
     add_positive_label(size_returning_id, 0, entry.requested_size_returning);
+    add_positive_label(allocation_label_id, 0, entry.label);
 
     auto add_access_label = [&](int key,
                                 tcmalloc::Profile::Sample::Access access) {
@@ -97,6 +97,26 @@ TEST(ProfileBuilderTest, Mappings) {
   EXPECT_THAT(mapping_ids, Not(testing::Contains(0)));
 }
 
+// The second call reuses the mappings read by the first, which must match.
+TEST(ProfileBuilderTest, MappingsAreStable) {
+  auto Mappings = []() {
+    ProfileBuilder builder;
+    builder.AddCurrentMappings();
+    auto profile = std::move(builder).Finalize();
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t, std::string>> result;
+    for (const auto& mapping : profile->mapping()) {
+      result.emplace_back(mapping.memory_start(), mapping.memory_limit(),
+                          mapping.file_offset(),
+                          profile->string_table(mapping.filename()));
+    }
+    return result;
+  };
+
+  const auto first = Mappings();
+  EXPECT_THAT(first, Not(testing::IsEmpty()));
+  EXPECT_EQ(Mappings(), first);
+}
+
 TEST(ProfileBuilderTest, LocationTableNoMappings) {
   const uintptr_t kAddress = uintptr_t{0x150};
 
@@ -478,15 +498,13 @@ TEST(ProfileConverterTest, HeapProfile) {
   EXPECT_THAT(sample_types, testing::Contains(converted.default_sample_type()));
 
   constexpr int kNumSamples = 6;
-  // This is slightly redundant with the next line, but we need to loop over
-  // each of the samples later.
-  EXPECT_THAT(extracted_sample_type, SizeIs(kNumSamples));
   EXPECT_THAT(
       extracted_sample_type,
       UnorderedElementsAre(
           Pair("objects", "count"), Pair("space", "bytes"),
           Pair("resident_space", "bytes"), Pair("stale_space", "bytes"),
-          Pair("locked_space", "bytes"), Pair("swapped_space", "bytes")));
+          Pair("locked_space", "bytes"), Pair("swapped_space", "bytes"),
+          Pair("hugepage_space", "bytes")));
 
   SampleLabels extracted_labels;
   {
@@ -738,6 +756,10 @@ TEST(ProfileBuilderTest, LifetimeProfile) {
     alloc1.stack[3] = absl::bit_cast<void*>(uintptr_t{0x45123});
     alloc1.stack[4] = reinterpret_cast<void*>(&ProfileAccessor::MakeProfile);
     alloc1.stack[5] = reinterpret_cast<void*>(&RealPath);
+    // Both objects of the pair lived between 10ns and 100ns, and one in four of
+    // its frees happened on another NUMA node.
+    alloc1.lifetime_histogram[1] = 2;
+    alloc1.cross_numa_free_ratio = 0.25;
 
     samples.push_back(alloc1);
 
@@ -758,6 +780,7 @@ TEST(ProfileBuilderTest, LifetimeProfile) {
     censored_alloc1.allocator_deallocator_l3_matched = std::nullopt;
     censored_alloc1.allocator_deallocator_numa_matched = std::nullopt;
     censored_alloc1.allocator_deallocator_thread_matched = std::nullopt;
+    censored_alloc1.cross_numa_free_ratio = 0;
     censored_alloc1.profile_id++;
     samples.push_back(censored_alloc1);
   }
@@ -821,7 +844,8 @@ TEST(ProfileBuilderTest, LifetimeProfile) {
               Pair("bytes", 16), Pair("request", 2), Pair("alignment", 4),
               Pair("callstack-pair-id", 33), Pair("avg_lifetime", 77),
               Pair("stddev_lifetime", 22), Pair("min_lifetime", 55),
-              Pair("max_lifetime", 99),
+              Pair("max_lifetime", 99), Pair("lifetime_10ns", 2),
+              Pair("cross_numa_free_ratio", 250000),
               Pair("active CPU", "same"), Pair("active vCPU", "same"),
               Pair("active L3", "same"), Pair("active NUMA", "same"),
               Pair("active thread", "different")),
@@ -829,7 +853,8 @@ TEST(ProfileBuilderTest, LifetimeProfile) {
               Pair("bytes", 16), Pair("request", 2), Pair("alignment", 4),
               Pair("callstack-pair-id", 33), Pair("avg_lifetime", 77),
               Pair("stddev_lifetime", 22), Pair("min_lifetime", 55),
-              Pair("max_lifetime", 99),
+              Pair("max_lifetime", 99), Pair("lifetime_10ns", 2),
+              Pair("cross_numa_free_ratio", 250000),
               Pair("active CPU", "same"), Pair("active vCPU", "same"),
               Pair("active L3", "same"), Pair("active NUMA", "same"),
               Pair("active thread", "different")),
@@ -838,7 +863,7 @@ TEST(ProfileBuilderTest, LifetimeProfile) {
               Pair("bytes", 16), Pair("request", 2), Pair("alignment", 4),
               Pair("callstack-pair-id", 34), Pair("avg_lifetime", 77),
               Pair("stddev_lifetime", 22), Pair("min_lifetime", 55),
-              Pair("max_lifetime", 99),
+              Pair("max_lifetime", 99), Pair("lifetime_10ns", 2),
               Pair("active CPU", "none"), Pair("active vCPU", "none"),
               Pair("active L3", "none"), Pair("active NUMA", "none"),
               Pair("active thread", "none"))));
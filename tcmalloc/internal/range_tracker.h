@@ -32,11 +32,39 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+namespace range_tracker_internal {
+
+// Bitmaps of fewer words are cheap enough to scan word by word, and stay as
+// small as they can be.
+inline constexpr size_t kMinWordsToSummarize = 16;
+
+// Summarizes the words of a Bitmap: bit i of nonzero_ is set iff word i has any
+// bits set, and bit i of notfull_ iff word i has any of its bits clear.
+template <size_t kWords, bool kEnabled = (kWords >= kMinWordsToSummarize)>
+class BitmapSummary {
+ protected:
+  static constexpr size_t kWordSize = sizeof(size_t) * 8;
+  static constexpr size_t kSummaryWords = (kWords + kWordSize - 1) / kWordSize;
+
+  size_t nonzero_[kSummaryWords] = {};
+  size_t notfull_[kSummaryWords] = {};
+};
+
+template <size_t kWords>
+class BitmapSummary<kWords, false> {};
+
+}  // namespace range_tracker_internal
+
 // Keeps a bitmap of some fixed size (N bits).
+//
+// Large bitmaps also keep a summary bit per word, so that searches skip over
+// words that are entirely set or entirely clear a whole summary word (that is,
+// kWordSize words) at a time.
 template <size_t N>
-class Bitmap {
+class Bitmap : private range_tracker_internal::BitmapSummary<
+                   (N + sizeof(size_t) * 8 - 1) / (sizeof(size_t) * 8)> {
  public:
-  constexpr Bitmap() : bits_{} {}
+  constexpr Bitmap() : bits_{} { InitSummary(); }
 
   size_t size() const { return N; }
   bool GetBit(size_t i) const;
@@ -75,9 +103,25 @@ class Bitmap {
   static constexpr size_t kWordSize = sizeof(size_t) * 8;
   static constexpr size_t kWords = (N + kWordSize - 1) / kWordSize;
   static constexpr size_t kDeadBits = kWordSize * kWords - N;
+  static constexpr bool kSummarized =
+      kWords >= range_tracker_internal::kMinWordsToSummarize;
+  static constexpr size_t kSummaryWords = (kWords + kWordSize - 1) / kWordSize;
 
   size_t bits_[kWords];
 
+  // Marks every word as all clear.
+  constexpr void InitSummary();
+  // Refreshes the summary of the i-th word after it changed.
+  void UpdateSummary(size_t i);
+  // Returns the first word at or after i with a Goal bit, or kWords if none.
+  // REQUIRES: kSummarized
+  template <bool Goal>
+  size_t NextWordWith(size_t i) const;
+  // Returns the last word at or before i with a Goal bit, or -1 if none.
+  // REQUIRES: kSummarized
+  template <bool Goal>
+  ssize_t PrevWordWith(ssize_t i) const;
+
   size_t CountWordBits(size_t i, size_t from, size_t to) const;
 
   template <bool Value>
@@ -117,10 +161,26 @@ class RangeTracker {
   // best fit.
   size_t FindAndMark(size_t n);
 
+  // REQUIRES: the range [index, index + n) is entirely free, and n > 0.
+  //
+  // Marks it as a new allocation, for callers that pick the range themselves.
+  void Mark(size_t index, size_t n);
+
   // REQUIRES: the range [index, index + n) is fully marked, and
   // was the returned value from a call to FindAndMark.
   // Unmarks it.
   void Unmark(size_t index, size_t n);
+
+  // REQUIRES: [index, index + n) is an allocation returned by FindAndMark,
+  // possibly resized since, and n < new_n.
+  // If [index + n, index + new_n) is free, marks it as part of the same
+  // allocation and returns true.  Otherwise, returns false.
+  bool TryGrow(size_t index, size_t n, size_t new_n);
+  // REQUIRES: [index, index + n) is an allocation as for TryGrow, and
+  // 0 < new_n < n.
+  // Unmarks [index + new_n, index + n), keeping the allocation.
+  void Shrink(size_t index, size_t n, size_t new_n);
+
   // If there is at least one free range at or after <start>,
   // put it in *index, *length and return true; else return false.
   bool NextFreeRange(size_t start, size_t* index, size_t* length) const;
@@ -237,6 +297,29 @@ inline size_t RangeTracker<N>::FindAndMark(size_t n) {
   return best_index;
 }
 
+template <size_t N>
+inline void RangeTracker<N>::Mark(size_t index, size_t n) {
+  TC_ASSERT_GT(n, 0);
+  TC_ASSERT_LE(index + n, N);
+  const size_t lim = bits_.FindSet(index);
+  TC_ASSERT_GE(lim, index + n);
+  const size_t start = bits_.FindSetBackwards(index) + 1;
+  bits_.SetRange(index, n);
+  nused_ += n;
+  nallocs_++;
+
+  // Only taking from a longest free range can shorten the longest one.
+  if (lim - start == longest_free()) {
+    size_t longest = 0;
+    size_t i = 0, len;
+    while (bits_.NextFreeRange(i, &i, &len)) {
+      longest = std::max(longest, len);
+      i += len;
+    }
+    longest_free_ = longest;
+  }
+}
+
 // REQUIRES: the range [index, index + n) is fully marked.
 // Unmarks it.
 template <size_t N>
@@ -255,6 +338,51 @@ inline void RangeTracker<N>::Unmark(size_t index, size_t n) {
   }
 }
 
+template <size_t N>
+inline bool RangeTracker<N>::TryGrow(size_t index, size_t n, size_t new_n) {
+  TC_ASSERT_LT(n, new_n);
+  TC_ASSERT_LE(index + n, N);
+  if (new_n > N - index) {
+    return false;
+  }
+  const size_t start = index + n;
+  const size_t lim = bits_.FindSet(start);
+  if (lim < index + new_n) {
+    return false;
+  }
+  bits_.SetRange(start, new_n - n);
+  nused_ += new_n - n;
+
+  // Only taking from a longest free range can shorten the longest one.
+  if (lim - start == longest_free()) {
+    size_t longest = 0;
+    size_t i = 0, len;
+    while (bits_.NextFreeRange(i, &i, &len)) {
+      longest = std::max(longest, len);
+      i += len;
+    }
+    longest_free_ = longest;
+  }
+  return true;
+}
+
+template <size_t N>
+inline void RangeTracker<N>::Shrink(size_t index, size_t n, size_t new_n) {
+  TC_ASSERT_GT(new_n, 0);
+  TC_ASSERT_LT(new_n, n);
+  TC_ASSERT(bits_.FindClear(index) >= index + n);
+  const size_t start = index + new_n;
+  bits_.ClearRange(start, n - new_n);
+  nused_ -= n - new_n;
+
+  // The free range we just extended might now be the longest.
+  const size_t lim = bits_.FindSet(start);
+  const size_t len = lim - start;
+  if (len > longest_free()) {
+    longest_free_ = len;
+  }
+}
+
 // If there is at least one free range at or after <start>,
 // put it in *index, *length and return true; else return false.
 template <size_t N>
@@ -303,6 +431,75 @@ inline void Bitmap<N>::SetWordBits(size_t i, size_t from, size_t to) {
   } else {
     bits_[i] &= ~mask;
   }
+  UpdateSummary(i);
+}
+
+template <size_t N>
+constexpr void Bitmap<N>::InitSummary() {
+  if constexpr (kSummarized) {
+    for (size_t i = 0; i < kSummaryWords; ++i) {
+      this->nonzero_[i] = 0;
+      this->notfull_[i] = 0;
+    }
+    for (size_t i = 0; i < kWords; ++i) {
+      this->notfull_[i / kWordSize] |= size_t{1} << (i % kWordSize);
+    }
+  }
+}
+
+template <size_t N>
+inline void Bitmap<N>::UpdateSummary(size_t i) {
+  if constexpr (kSummarized) {
+    // The dead bits of the last word are always clear.
+    const size_t live = (i == kWords - 1 && kDeadBits > 0)
+                            ? ~static_cast<size_t>(0) >> kDeadBits
+                            : ~static_cast<size_t>(0);
+    const size_t bit = size_t{1} << (i % kWordSize);
+    size_t& nonzero = this->nonzero_[i / kWordSize];
+    size_t& notfull = this->notfull_[i / kWordSize];
+    nonzero = bits_[i] != 0 ? (nonzero | bit) : (nonzero & ~bit);
+    notfull = (bits_[i] & live) != live ? (notfull | bit) : (notfull & ~bit);
+  }
+}
+
+template <size_t N>
+template <bool Goal>
+inline size_t Bitmap<N>::NextWordWith(size_t i) const {
+  static_assert(kSummarized);
+  if (i >= kWords) {
+    return kWords;
+  }
+  const size_t* summary = Goal ? this->nonzero_ : this->notfull_;
+  size_t s = i / kWordSize;
+  size_t here = summary[s] & (~static_cast<size_t>(0) << (i % kWordSize));
+  while (here == 0) {
+    ++s;
+    if (s >= kSummaryWords) {
+      return kWords;
+    }
+    here = summary[s];
+  }
+  return s * kWordSize + absl::countr_zero(here);
+}
+
+template <size_t N>
+template <bool Goal>
+inline ssize_t Bitmap<N>::PrevWordWith(ssize_t i) const {
+  static_assert(kSummarized);
+  if (i < 0) {
+    return -1;
+  }
+  const size_t* summary = Goal ? this->nonzero_ : this->notfull_;
+  ssize_t s = i / kWordSize;
+  size_t here = summary[s] & ((static_cast<size_t>(2) << (i % kWordSize)) - 1);
+  while (here == 0) {
+    --s;
+    if (s < 0) {
+      return -1;
+    }
+    here = summary[s];
+  }
+  return s * kWordSize + absl::bit_width(here) - 1;
 }
 
 template <size_t N>
@@ -321,6 +518,7 @@ inline void Bitmap<N>::SetBit(size_t i) {
   size_t offset = i % kWordSize;
   ASSUME(word < kWords);
   bits_[word] |= (size_t{1} << offset);
+  UpdateSummary(word);
 }
 
 template <size_t N>
@@ -330,6 +528,7 @@ inline void Bitmap<N>::ClearBit(size_t i) {
   size_t offset = i % kWordSize;
   ASSUME(word < kWords);
   bits_[word] &= ~(size_t{1} << offset);
+  UpdateSummary(word);
 }
 
 template <size_t N>
@@ -357,6 +556,14 @@ inline size_t Bitmap<N>::CountBits(size_t index, size_t n) const {
 
 template <size_t N>
 inline bool Bitmap<N>::IsZero() const {
+  if constexpr (kSummarized) {
+    for (size_t i = 0; i < kSummaryWords; ++i) {
+      if (this->nonzero_[i] != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
   for (int i = 0; i < kWords; ++i) {
     if (bits_[i] != 0) {
       return false;
@@ -380,6 +587,7 @@ inline void Bitmap<N>::ClearLowestBit() {
   for (int i = 0; i < kWords; ++i) {
     if (bits_[i] != 0) {
       bits_[i] &= bits_[i] - 1;
+      UpdateSummary(i);
       break;
     }
   }
@@ -441,6 +649,7 @@ inline void Bitmap<N>::Clear() {
   for (int i = 0; i < kWords; ++i) {
     bits_[i] = 0;
   }
+  InitSummary();
 }
 
 template <size_t N>
@@ -454,13 +663,24 @@ inline size_t Bitmap<N>::FindValue(size_t index) const {
   if (!Goal) here = ~here;
   size_t mask = ~static_cast<size_t>(0) << offset;
   here &= mask;
-  while (here == 0) {
-    ++word;
-    if (word >= kWords) {
-      return N;
+  if constexpr (kSummarized) {
+    if (here == 0) {
+      word = NextWordWith<Goal>(word + 1);
+      if (word >= kWords) {
+        return N;
+      }
+      here = bits_[word];
+      if (!Goal) here = ~here;
+    }
+  } else {
+    while (here == 0) {
+      ++word;
+      if (word >= kWords) {
+        return N;
+      }
+      here = bits_[word];
+      if (!Goal) here = ~here;
     }
-    here = bits_[word];
-    if (!Goal) here = ~here;
   }
 
   word *= kWordSize;
@@ -483,13 +703,24 @@ inline ssize_t Bitmap<N>::FindValueBackwards(size_t index) const {
   if (!Goal) here = ~here;
   size_t mask = (static_cast<size_t>(2) << offset) - 1;
   here &= mask;
-  while (here == 0) {
-    --word;
-    if (word < 0) {
-      return -1;
+  if constexpr (kSummarized) {
+    if (here == 0) {
+      word = PrevWordWith<Goal>(word - 1);
+      if (word < 0) {
+        return -1;
+      }
+      here = bits_[word];
+      if (!Goal) here = ~here;
+    }
+  } else {
+    while (here == 0) {
+      --word;
+      if (word < 0) {
+        return -1;
+      }
+      here = bits_[word];
+      if (!Goal) here = ~here;
     }
-    here = bits_[word];
-    if (!Goal) here = ~here;
   }
 
   word *= kWordSize;
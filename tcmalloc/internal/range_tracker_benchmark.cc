@@ -61,6 +61,7 @@ static void BM_MarkUnmark(benchmark::State& state) {
 
 BENCHMARK_TEMPLATE(BM_MarkUnmark, 256);
 BENCHMARK_TEMPLATE(BM_MarkUnmark, 256 * 32);
+BENCHMARK_TEMPLATE(BM_MarkUnmark, 256 * 512);
 
 template <size_t N, size_t K>
 static void BM_MarkUnmarkEmpty(benchmark::State& state) {
@@ -110,6 +111,7 @@ static void BM_MarkUnmarkChunks(benchmark::State& state) {
 BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 64);
 BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 256);
 BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 256 * 32);
+BENCHMARK_TEMPLATE(BM_MarkUnmarkChunks, 256 * 512);
 
 template <size_t N>
 static void BM_FillOnes(benchmark::State& state) {
@@ -216,6 +218,10 @@ BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 32, false, Forward);
 BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 32, false, Backward);
 BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 32, true, Forward);
 BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 32, true, Backward);
+BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 512, false, Forward);
+BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 512, false, Backward);
+BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 512, true, Forward);
+BENCHMARK_TEMPLATE(BM_FindEmpty, 256 * 512, true, Backward);
 
 template <size_t N, bool Goal, SearchDirection Dir>
 static void BM_FindLast(benchmark::State& state) {
@@ -240,6 +246,10 @@ BENCHMARK_TEMPLATE(BM_FindLast, 256 * 32, false, Forward);
 BENCHMARK_TEMPLATE(BM_FindLast, 256 * 32, false, Backward);
 BENCHMARK_TEMPLATE(BM_FindLast, 256 * 32, true, Forward);
 BENCHMARK_TEMPLATE(BM_FindLast, 256 * 32, true, Backward);
+BENCHMARK_TEMPLATE(BM_FindLast, 256 * 512, false, Forward);
+BENCHMARK_TEMPLATE(BM_FindLast, 256 * 512, false, Backward);
+BENCHMARK_TEMPLATE(BM_FindLast, 256 * 512, true, Forward);
+BENCHMARK_TEMPLATE(BM_FindLast, 256 * 512, true, Backward);
 
 template <size_t N, bool Goal, SearchDirection Dir>
 static void BM_FindFull(benchmark::State& state) {
@@ -264,6 +274,10 @@ BENCHMARK_TEMPLATE(BM_FindFull, 256 * 32, false, Forward);
 BENCHMARK_TEMPLATE(BM_FindFull, 256 * 32, false, Backward);
 BENCHMARK_TEMPLATE(BM_FindFull, 256 * 32, true, Forward);
 BENCHMARK_TEMPLATE(BM_FindFull, 256 * 32, true, Backward);
+BENCHMARK_TEMPLATE(BM_FindFull, 256 * 512, false, Forward);
+BENCHMARK_TEMPLATE(BM_FindFull, 256 * 512, false, Backward);
+BENCHMARK_TEMPLATE(BM_FindFull, 256 * 512, true, Forward);
+BENCHMARK_TEMPLATE(BM_FindFull, 256 * 512, true, Backward);
 
 template <size_t N, bool Goal, SearchDirection Dir>
 static void BM_FindRandom(benchmark::State& state) {
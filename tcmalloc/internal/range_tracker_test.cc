@@ -17,6 +17,7 @@
 #include <stddef.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -250,6 +251,89 @@ TEST_F(BitmapTest, CountBitsFuzz) {
   }
 }
 
+// Large enough for its words to be summarized, with a partial summary word and
+// a partial last word.
+constexpr size_t kSummarizedBits = 64 * 64 * 2 + 37;
+
+TEST_F(BitmapTest, FindSummarized) {
+  Bitmap<kSummarizedBits> map;
+  EXPECT_TRUE(map.IsZero());
+  EXPECT_THAT(FindSetResults(map), ElementsAre(kSummarizedBits));
+  EXPECT_EQ(map.FindSetBackwards(kSummarizedBits - 1), -1);
+
+  map.SetBit(5);
+  map.SetBit(4100);
+  map.SetBit(kSummarizedBits - 1);
+  EXPECT_FALSE(map.IsZero());
+  EXPECT_THAT(FindSetResults(map), ElementsAre(5, 4100, kSummarizedBits - 1));
+  EXPECT_THAT(FindSetResultsBackwards(map),
+              ElementsAre(kSummarizedBits - 1, 4100, 5, -1));
+
+  map.ClearBit(5);
+  map.ClearLowestBit();
+  EXPECT_EQ(map.FindSet(0), kSummarizedBits - 1);
+  map.ClearBit(kSummarizedBits - 1);
+  EXPECT_TRUE(map.IsZero());
+  map.SetRange(64, kSummarizedBits - 64 - 1);
+  EXPECT_EQ(map.FindSet(0), 64);
+  EXPECT_EQ(map.FindClear(64), kSummarizedBits - 1);
+  EXPECT_EQ(map.FindClearBackwards(kSummarizedBits - 2), 63);
+  EXPECT_EQ(map.FindSetBackwards(63), -1);
+  map.SetBit(kSummarizedBits - 1);
+  EXPECT_EQ(map.FindClear(64), kSummarizedBits);
+
+  map.Clear();
+  EXPECT_TRUE(map.IsZero());
+  EXPECT_EQ(map.FindSet(0), kSummarizedBits);
+  EXPECT_EQ(map.FindClearBackwards(kSummarizedBits - 1), kSummarizedBits - 1);
+}
+
+TEST_F(BitmapTest, FindSummarizedFuzz) {
+  absl::FixedArray<bool> truth(kSummarizedBits, false);
+  Bitmap<kSummarizedBits> map;
+
+  absl::BitGen rng;
+  for (int i = 0; i < 1000; i++) {
+    SCOPED_TRACE(i);
+
+    // Set or clear long runs, so that whole words (and whole summary words)
+    // become uniform.
+    const size_t start = absl::Uniform(rng, 0u, kSummarizedBits);
+    const size_t length =
+        absl::Uniform(rng, 1u, std::min<size_t>(kSummarizedBits - start, 3000));
+    const bool v = absl::Bernoulli(rng, 0.5);
+    for (size_t j = start; j < start + length; j++) {
+      truth[j] = v;
+    }
+    if (v) {
+      map.SetRange(start, length);
+    } else {
+      map.ClearRange(start, length);
+    }
+
+    bool zero = true;
+    for (bool t : truth) {
+      zero = zero && !t;
+    }
+    EXPECT_EQ(zero, map.IsZero());
+
+    // Compare searches from a few random points with a naive loop over truth.
+    for (int k = 0; k < 10; k++) {
+      const size_t index = absl::Uniform(rng, 0u, kSummarizedBits);
+      for (bool goal : {true, false}) {
+        size_t next = index;
+        while (next < kSummarizedBits && truth[next] != goal) ++next;
+        ssize_t prev = index;
+        while (prev >= 0 && truth[prev] != goal) --prev;
+
+        EXPECT_EQ(next, goal ? map.FindSet(index) : map.FindClear(index));
+        EXPECT_EQ(prev, goal ? map.FindSetBackwards(index)
+                             : map.FindClearBackwards(index));
+      }
+    }
+  }
+}
+
 class RangeTrackerTest : public ::testing::Test {
  protected:
   std::vector<std::pair<size_t, size_t>> FreeRanges() {
@@ -289,6 +373,65 @@ TEST_F(RangeTrackerTest, Trivial) {
   EXPECT_THAT(FreeRanges(), ElementsAre(Pair(0, 300)));
 }
 
+TEST_F(RangeTrackerTest, Resize) {
+  ASSERT_EQ(0, range_.FindAndMark(100));
+  ASSERT_EQ(100, range_.FindAndMark(100));
+  range_.Unmark(0, 100);
+  EXPECT_EQ(kBits - 200, range_.longest_free());
+
+  // Grow into the longest free range.
+  EXPECT_TRUE(range_.TryGrow(100, 100, 150));
+  EXPECT_EQ(150, range_.used());
+  EXPECT_EQ(1, range_.allocs());
+  EXPECT_EQ(kBits - 250, range_.longest_free());
+  EXPECT_THAT(FreeRanges(), ElementsAre(Pair(0, 100), Pair(250, kBits - 250)));
+
+  // Not enough room, including past the end.
+  EXPECT_FALSE(range_.TryGrow(100, 150, kBits));
+  EXPECT_FALSE(range_.TryGrow(100, 150, kBits - 99));
+  EXPECT_EQ(150, range_.used());
+
+  // Growing to the end leaves the range before us as the longest.
+  EXPECT_TRUE(range_.TryGrow(100, 150, kBits - 100));
+  EXPECT_EQ(100, range_.longest_free());
+  EXPECT_THAT(FreeRanges(), ElementsAre(Pair(0, 100)));
+
+  range_.Shrink(100, kBits - 100, 10);
+  EXPECT_EQ(10, range_.used());
+  EXPECT_EQ(1, range_.allocs());
+  EXPECT_EQ(kBits - 110, range_.longest_free());
+  EXPECT_THAT(FreeRanges(), ElementsAre(Pair(0, 100), Pair(110, kBits - 110)));
+
+  range_.Unmark(100, 10);
+  EXPECT_EQ(0, range_.used());
+  EXPECT_EQ(0, range_.allocs());
+  EXPECT_EQ(kBits, range_.longest_free());
+}
+
+TEST_F(RangeTrackerTest, Mark) {
+  range_.Mark(100, 50);
+  EXPECT_EQ(50, range_.used());
+  EXPECT_EQ(1, range_.allocs());
+  EXPECT_EQ(kBits - 150, range_.longest_free());
+  EXPECT_THAT(FreeRanges(), ElementsAre(Pair(0, 100), Pair(150, kBits - 150)));
+
+  // Marking outside the longest range leaves it alone.
+  range_.Mark(10, 20);
+  EXPECT_EQ(2, range_.allocs());
+  EXPECT_EQ(kBits - 150, range_.longest_free());
+  EXPECT_THAT(FreeRanges(), ElementsAre(Pair(0, 10), Pair(30, 70),
+                                        Pair(150, kBits - 150)));
+
+  range_.Mark(150, kBits - 150);
+  EXPECT_EQ(70, range_.longest_free());
+
+  range_.Unmark(150, kBits - 150);
+  range_.Unmark(10, 20);
+  range_.Unmark(100, 50);
+  EXPECT_EQ(0, range_.used());
+  EXPECT_EQ(kBits, range_.longest_free());
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
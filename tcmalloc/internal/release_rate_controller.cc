@@ -0,0 +1,52 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/release_rate_controller.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+double ReleaseRateController::Update(uint64_t refaulted_bytes,
+                                     absl::Duration elapsed, size_t budget) {
+  const bool has_last = has_last_;
+  const uint64_t refaulted = refaulted_bytes - last_refaulted_bytes_;
+  has_last_ = true;
+  last_refaulted_bytes_ = refaulted_bytes;
+  // Without a previous count, or if time goes backwards, there is no rate to
+  // act on.
+  if (!has_last || elapsed <= absl::ZeroDuration()) {
+    return scale_;
+  }
+
+  const double rate = refaulted / absl::ToDoubleSeconds(elapsed);
+  if (rate > budget) {
+    scale_ = std::max(scale_ * kDecrease, kMinScale);
+  } else {
+    scale_ = std::min(scale_ * kIncrease, kMaxScale);
+  }
+  return scale_;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
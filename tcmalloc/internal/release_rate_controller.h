@@ -0,0 +1,63 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_INTERNAL_RELEASE_RATE_CONTROLLER_H_
+#define TCMALLOC_INTERNAL_RELEASE_RATE_CONTROLLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/time/time.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Closes the loop around background release: released pages that are
+// allocated again have to be faulted back in, which costs CPU, so the
+// controller scales the configured release rate down while the refault rate
+// exceeds a budget and back up while it is below, releasing as fast as the
+// budget allows.
+class ReleaseRateController {
+ public:
+  static constexpr double kMinScale = 1.0 / 64;
+  static constexpr double kMaxScale = 64;
+  // The scale shrinks by kDecrease per update over budget, and grows by
+  // kIncrease per update under it.  Backing off faster than speeding up keeps
+  // the refault rate from oscillating far above the budget.
+  static constexpr double kDecrease = 0.5;
+  static constexpr double kIncrease = 1.25;
+
+  constexpr ReleaseRateController() = default;
+
+  // Updates the scale from the bytes refaulted since startup, refaulted_bytes,
+  // `elapsed` after the previous update, against a budget of refaulted bytes
+  // per second, and returns it.  The first update only records the count.
+  double Update(uint64_t refaulted_bytes, absl::Duration elapsed,
+                size_t budget);
+
+  double scale() const { return scale_; }
+
+ private:
+  double scale_ = 1;
+  bool has_last_ = false;
+  uint64_t last_refaulted_bytes_ = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_INTERNAL_RELEASE_RATE_CONTROLLER_H_
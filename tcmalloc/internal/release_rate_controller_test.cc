@@ -0,0 +1,79 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/internal/release_rate_controller.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr size_t kBudget = 1 << 20;
+
+TEST(ReleaseRateControllerTest, FirstUpdateRecordsBaseline) {
+  ReleaseRateController controller;
+  // A large count from before the controller started is not a refault rate.
+  EXPECT_EQ(controller.Update(uint64_t{1} << 40, absl::Seconds(1), kBudget),
+            1);
+  EXPECT_EQ(controller.scale(), 1);
+}
+
+TEST(ReleaseRateControllerTest, AdjustsToBudget) {
+  ReleaseRateController controller;
+  uint64_t refaulted = 0;
+  controller.Update(refaulted, absl::Seconds(1), kBudget);
+
+  // Under budget, the release rate speeds up until it reaches kMaxScale.
+  refaulted += kBudget / 2;
+  EXPECT_DOUBLE_EQ(controller.Update(refaulted, absl::Seconds(1), kBudget),
+                   ReleaseRateController::kIncrease);
+  for (int i = 0; i < 100; ++i) {
+    controller.Update(refaulted, absl::Seconds(1), kBudget);
+  }
+  EXPECT_EQ(controller.scale(), ReleaseRateController::kMaxScale);
+
+  // Over budget, it slows down until it reaches kMinScale.  The rate is per
+  // second, so the same refaults over a longer interval are within budget.
+  refaulted += 2 * kBudget;
+  EXPECT_DOUBLE_EQ(controller.Update(refaulted, absl::Seconds(1), kBudget),
+                   ReleaseRateController::kMaxScale *
+                       ReleaseRateController::kDecrease);
+  refaulted += 2 * kBudget;
+  EXPECT_DOUBLE_EQ(controller.Update(refaulted, absl::Seconds(4), kBudget),
+                   ReleaseRateController::kMaxScale *
+                       ReleaseRateController::kDecrease *
+                       ReleaseRateController::kIncrease);
+  for (int i = 0; i < 100; ++i) {
+    refaulted += 2 * kBudget;
+    controller.Update(refaulted, absl::Seconds(1), kBudget);
+  }
+  EXPECT_EQ(controller.scale(), ReleaseRateController::kMinScale);
+}
+
+TEST(ReleaseRateControllerTest, IgnoresTimeGoingBackwards) {
+  ReleaseRateController controller;
+  controller.Update(0, absl::Seconds(1), kBudget);
+  EXPECT_EQ(controller.Update(kBudget * 10, -absl::Seconds(1), kBudget), 1);
+  EXPECT_EQ(controller.Update(kBudget * 10, absl::ZeroDuration(), kBudget),
+            1);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -159,6 +159,41 @@ std::optional<Residency::Info> Residency::Get(const void* const addr,
   return info;
 }
 
+std::optional<Residency::Info> Residency::GetBatched(const void* const addr,
+                                                     const size_t size) {
+  if (fd_ < 0) {
+    return std::nullopt;
+  }
+
+  // A hugepage's entries, unless pages are so large that they don't fit.
+  const size_t batch_pages =
+      std::min<size_t>(kEntriesInBuf, std::max(kHugePageSize / kPageSize, 1ul));
+  const uintptr_t batch_bytes = batch_pages * kPageSize;
+
+  Residency::Info info;
+  const uintptr_t uaddr = reinterpret_cast<uintptr_t>(addr);
+  const uintptr_t end = uaddr + size;
+  for (uintptr_t page = uaddr & ~(kPageSize - 1); page < end;
+       page += kPageSize) {
+    if (!batch_start_.has_value() || page < *batch_start_ ||
+        page - *batch_start_ >= batch_bytes) {
+      batch_start_.reset();
+      const uintptr_t start = page - page % batch_bytes;
+      if (Seek(start) != absl::StatusCode::kOk) return std::nullopt;
+      const size_t to_read = kPagemapEntrySize * batch_pages;
+      if (signal_safe_read(fd_, reinterpret_cast<char*>(batch_),
+                           to_read, nullptr) != to_read) {
+        return std::nullopt;
+      }
+      batch_start_ = start;
+    }
+    const uintptr_t overlap =
+        std::min(end, page + kPageSize) - std::max(uaddr, page);
+    Update(batch_[(page - *batch_start_) / kPageSize], overlap, info);
+  }
+  return info;
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -41,6 +41,11 @@ class ResidencySpouse {
     return r_.Get(std::forward<Args>(args)...);
   }
 
+  template <typename... Args>
+  decltype(auto) GetBatched(Args&&... args) {
+    return r_.GetBatched(std::forward<Args>(args)...);
+  }
+
  private:
   Residency r_;
 };
@@ -107,14 +112,48 @@ TEST(ResidenceTest, ThisProcess) {
   }
 }
 
+// GetBatched answers as Get does, for queries in any order, as long as
+// residency doesn't change between them.
+TEST(ResidenceTest, Batched) {
+  const size_t kPageSize = GetPageSize();
+  const int kNumPages = 64;
+
+  void* p = mmap(nullptr, kNumPages * kPageSize, PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(p, MAP_FAILED) << errno;
+  char* base = reinterpret_cast<char*>(p);
+  for (int i = 0; i < kNumPages; i += 3) {
+    memset(base + i * kPageSize, 1, kPageSize);
+  }
+  ::benchmark::DoNotOptimize(base);
+
+  Residency r;
+  for (size_t offset : {size_t{0}, size_t{7}, kPageSize, 5 * kPageSize + 1}) {
+    for (size_t size :
+         {size_t{1}, kPageSize, 3 * kPageSize - 2, 40 * kPageSize}) {
+      std::optional<Residency::Info> expected = r.Get(base + offset, size);
+      ASSERT_TRUE(expected.has_value());
+      EXPECT_THAT(r.GetBatched(base + offset, size),
+                  Optional(FieldsAre(expected->bytes_resident,
+                                     expected->bytes_swapped)))
+          << offset << " " << size;
+    }
+  }
+  EXPECT_THAT(r.GetBatched(base, 0), Optional(FieldsAre(0, 0)));
+
+  ASSERT_EQ(munmap(p, kNumPages * kPageSize), 0);
+}
+
 TEST(ResidenceTest, CannotOpen) {
   ResidencySpouse r("/tmp/a667ba48-18ba-4523-a8a7-b49ece3a6c2b");
   EXPECT_FALSE(r.Get(nullptr, 1).has_value());
+  EXPECT_FALSE(r.GetBatched(nullptr, 1).has_value());
 }
 
 TEST(ResidenceTest, CannotRead) {
   ResidencySpouse r("/dev/null");
   EXPECT_FALSE(r.Get(nullptr, 1).has_value());
+  EXPECT_FALSE(r.GetBatched(nullptr, 1).has_value());
 }
 
 TEST(ResidenceTest, CannotSeek) {
@@ -15,8 +15,11 @@
 #ifndef TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_H_
 #define TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_H_
 
-#include <utility>
+#include <stdint.h>
 
+#include <algorithm>
+
+#include "absl/base/thread_annotations.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/sampled_allocation_recorder.h"
 
@@ -24,9 +27,22 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+// A call stack of sampled allocations, stored once for all the live samples
+// that have it.  It is immutable while referenced.  See StackTraceStore.
+struct StoredStack {
+  // The next stack in the same bucket of the store.
+  StoredStack* next;
+  uint64_t hash;
+  // The number of samples referencing this stack.
+  int64_t refs;
+
+  uintptr_t depth;
+  void* stack[kMaxStackDepth];
+};
+
 // Stores information about the sampled allocation.
 struct SampledAllocation : public tcmalloc_internal::Sample<SampledAllocation> {
-  // We use this constructor to initialize `graveyard_`, which is used to
+  // We use this constructor to initialize `graveyards_`, which is used to
   // maintain the freelist of SampledAllocations. When we revive objects from
   // the freelist, we use `PrepareForSampling()` to update the state of the
   // object.
@@ -35,8 +51,8 @@ struct SampledAllocation : public tcmalloc_internal::Sample<SampledAllocation> {
   // When no object is available on the freelist, we allocate for a new
   // SampledAllocation object and invoke this constructor with
   // `PrepareForSampling()`.
-  explicit SampledAllocation(StackTrace&& stack_trace) {
-    PrepareForSampling(std::move(stack_trace));
+  SampledAllocation(const SampleDetails& details, const StoredStack* stack) {
+    PrepareForSampling(details, stack);
   }
 
   SampledAllocation(const SampledAllocation&) = delete;
@@ -47,13 +63,28 @@ struct SampledAllocation : public tcmalloc_internal::Sample<SampledAllocation> {
 
   // Prepares the state of the object. It is invoked when either a new sampled
   // allocation is constructed or when an object is revived from the freelist.
-  void PrepareForSampling(StackTrace&& stack_trace)
+  // The caller hands over its reference on `stack`.
+  void PrepareForSampling(const SampleDetails& details,
+                          const StoredStack* stack)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
-    sampled_stack = std::move(stack_trace);
+    this->details = details;
+    this->stack = stack;
+  }
+
+  // Returns the stack trace of the sampled allocation, frames included.
+  StackTrace stack_trace() const {
+    StackTrace t;
+    static_cast<SampleDetails&>(t) = details;
+    t.depth = stack->depth;
+    std::copy_n(stack->stack, stack->depth, t.stack);
+    return t;
   }
 
-  // The stack trace of the sampled allocation.
-  StackTrace sampled_stack = {};
+  // The details of the sampled allocation.
+  SampleDetails details = {};
+  // The call stack of the sampled allocation, shared with the other samples
+  // that have the same one.  nullptr only for the graveyards.
+  const StoredStack* stack = nullptr;
 };
 
 }  // namespace tcmalloc_internal
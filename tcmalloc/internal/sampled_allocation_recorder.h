@@ -22,6 +22,8 @@
 #ifndef TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_RECORDER_H_
 #define TCMALLOC_INTERNAL_SAMPLED_ALLOCATION_RECORDER_H_
 
+#include <stddef.h>
+
 #include <atomic>
 
 #include "absl/base/const_init.h"
@@ -30,6 +32,7 @@
 #include "absl/functional/function_ref.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/percpu.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -64,7 +67,8 @@ class SampleRecorder {
   SampleRecorder(SampleRecorder&&) = delete;
   SampleRecorder& operator=(SampleRecorder&&) = delete;
 
-  // Sets up the dead pointer of `graveyard_` to make it a circular linked list.
+  // Sets up the dead pointers of `graveyards_` to make them circular linked
+  // lists.
   void Init();
 
   // Registers for sampling.  Returns an opaque registration info.
@@ -90,10 +94,22 @@ class SampleRecorder {
   // passed to `Unregister()` which assumes the sample is live.
   void UnregisterAll();
 
-  // Iterates over all the registered samples.
+  // Iterates over all the registered samples.  Samples registered or
+  // unregistered concurrently may or may not be visited; the others are
+  // visited exactly once.  No lock shared with Register() or Unregister() is
+  // held between samples.
   void Iterate(const absl::FunctionRef<void(const T& sample)>& f);
 
  private:
+  // Dead samples are kept on several graveyards, picked by the current CPU, so
+  // that threads sampling on different CPUs rarely contend.
+  static constexpr size_t kNumGraveyards = 8;
+
+  T& graveyard() {
+    const int cpu = subtle::percpu::GetRealCpu();
+    return graveyards_[cpu < 0 ? 0 : cpu % kNumGraveyards];
+  }
+
   void PushNew(T* sample);
   void PushDead(T* sample);
   template <typename... Targs>
@@ -104,8 +120,8 @@ class SampleRecorder {
   // `all_` records all samples (they are never removed from this list) and is
   // terminated with a `nullptr`.
   //
-  // `graveyard_.dead` is a circular linked list.  When it is empty,
-  // `graveyard_.dead == &graveyard`.  The list is circular so that
+  // Each `graveyards_[i].dead` is a circular linked list.  When it is empty,
+  // `graveyards_[i].dead == &graveyards_[i]`.  The list is circular so that
   // every item on it (even the last) has a non-null dead pointer.  This allows
   // `Iterate` to determine if a given sample is live or dead using only
   // information on the sample itself.
@@ -125,7 +141,7 @@ class SampleRecorder {
   //     +--------------------------------------+
   //
   std::atomic<T*> all_;
-  T graveyard_;
+  T graveyards_[kNumGraveyards];
 
   std::atomic<DisposeCallback> dispose_;
   Allocator* const allocator_;
@@ -153,8 +169,10 @@ SampleRecorder<T, Allocator>::~SampleRecorder() {
 
 template <typename T, typename Allocator>
 void SampleRecorder<T, Allocator>::Init() {
-  AllocationGuardSpinLockHolder l(&graveyard_.lock);
-  graveyard_.dead = &graveyard_;
+  for (T& graveyard : graveyards_) {
+    AllocationGuardSpinLockHolder l(&graveyard.lock);
+    graveyard.dead = &graveyard;
+  }
 }
 
 template <typename T, typename Allocator>
@@ -172,28 +190,36 @@ void SampleRecorder<T, Allocator>::PushDead(T* sample) {
     dispose(*sample);
   }
 
-  AllocationGuardSpinLockHolder graveyard_lock(&graveyard_.lock);
+  T& graveyard = this->graveyard();
+  AllocationGuardSpinLockHolder graveyard_lock(&graveyard.lock);
   AllocationGuardSpinLockHolder sample_lock(&sample->lock);
-  sample->dead = graveyard_.dead;
-  graveyard_.dead = sample;
+  sample->dead = graveyard.dead;
+  graveyard.dead = sample;
 }
 
 template <typename T, typename Allocator>
 template <typename... Targs>
 T* SampleRecorder<T, Allocator>::PopDead(Targs&&... args) {
-  AllocationGuardSpinLockHolder graveyard_lock(&graveyard_.lock);
-
-  // The list is circular, so eventually it collapses down to
-  //   graveyard_.dead == &graveyard_
-  // when it is empty.
-  T* sample = graveyard_.dead;
-  if (sample == &graveyard_) return nullptr;
-
-  AllocationGuardSpinLockHolder sample_lock(&sample->lock);
-  graveyard_.dead = sample->dead;
-  sample->dead = nullptr;
-  sample->PrepareForSampling(std::forward<Targs>(args)...);
-  return sample;
+  // Start with this CPU's graveyard, which its frees fill, and fall back to the
+  // others before giving up on reusing a sample.
+  T* const start = &graveyard();
+  for (size_t i = 0; i < kNumGraveyards; ++i) {
+    T& graveyard = graveyards_[(start - graveyards_ + i) % kNumGraveyards];
+    AllocationGuardSpinLockHolder graveyard_lock(&graveyard.lock);
+
+    // The list is circular, so eventually it collapses down to
+    //   graveyard.dead == &graveyard
+    // when it is empty.
+    T* sample = graveyard.dead;
+    if (sample == &graveyard) continue;
+
+    AllocationGuardSpinLockHolder sample_lock(&sample->lock);
+    graveyard.dead = sample->dead;
+    sample->dead = nullptr;
+    sample->PrepareForSampling(std::forward<Targs>(args)...);
+    return sample;
+  }
+  return nullptr;
 }
 
 template <typename T, typename Allocator>
@@ -216,7 +242,8 @@ void SampleRecorder<T, Allocator>::Unregister(T* sample) {
 
 template <typename T, typename Allocator>
 void SampleRecorder<T, Allocator>::UnregisterAll() {
-  AllocationGuardSpinLockHolder graveyard_lock(&graveyard_.lock);
+  T& graveyard = this->graveyard();
+  AllocationGuardSpinLockHolder graveyard_lock(&graveyard.lock);
   T* sample = all_.load(std::memory_order_acquire);
   auto* dispose = dispose_.load(std::memory_order_relaxed);
   while (sample != nullptr) {
@@ -224,8 +251,8 @@ void SampleRecorder<T, Allocator>::UnregisterAll() {
       AllocationGuardSpinLockHolder sample_lock(&sample->lock);
       if (sample->dead == nullptr) {
         if (dispose) dispose(*sample);
-        sample->dead = graveyard_.dead;
-        graveyard_.dead = sample;
+        sample->dead = graveyard.dead;
+        graveyard.dead = sample;
       }
     }
     sample = sample->next;
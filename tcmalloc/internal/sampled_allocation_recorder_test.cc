@@ -233,6 +233,24 @@ TEST_F(SampleRecorderTest, MultiThreaded) {
   threads.Stop();
 }
 
+// Dead samples are kept per CPU, but a thread registering a sample reuses one
+// freed on any CPU before allocating a new one.
+TEST_F(SampleRecorderTest, ReusesSamplesAcrossThreads) {
+  const int kThreads = 10;
+  const uint64_t alloc_count1 = allocator_.alloc_count();
+  ThreadManager threads;
+  threads.Start(kThreads, [&](int) {
+    for (int i = 0; i < 100; ++i) {
+      sample_recorder_.Unregister(Register(i));
+    }
+  });
+  absl::SleepFor(absl::Milliseconds(100));
+  threads.Stop();
+  // At most one sample per thread is live at any time.  Allow as many again
+  // for samples freed onto a graveyard just after Register() checked it.
+  EXPECT_LE(allocator_.alloc_count() - alloc_count1, 2 * kThreads);
+}
+
 TEST_F(SampleRecorderTest, Callback) {
   auto* info1 = Register(1);
   auto* info2 = Register(2);
@@ -259,7 +277,7 @@ TEST_F(SampleRecorderTest, Callback) {
 // Similar to Sample<Info> above but requires parameter(s) at initialization.
 struct InfoWithParam : public Sample<InfoWithParam> {
  public:
-  // Default constructor to initialize |graveyard_|.
+  // Default constructor to initialize |graveyards_|.
   InfoWithParam() = default;
   explicit InfoWithParam(size_t size) { PrepareForSampling(size); }
   void PrepareForSampling(size_t size) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
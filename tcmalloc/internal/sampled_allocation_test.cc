@@ -14,6 +14,8 @@
 
 #include "tcmalloc/internal/sampled_allocation.h"
 
+#include <algorithm>
+
 #include "gtest/gtest.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/debugging/stacktrace.h"
@@ -34,35 +36,60 @@ StackTrace PrepareStackTrace() {
   return st;
 }
 
+StoredStack PrepareStoredStack(const StackTrace& st) {
+  StoredStack stored = {.next = nullptr, .hash = 0, .refs = 1};
+  stored.depth = st.depth;
+  std::copy_n(st.stack, st.depth, stored.stack);
+  return stored;
+}
+
 TEST(SampledAllocationTest, PrepareForSampling) {
+  const StackTrace st = PrepareStackTrace();
+  const StoredStack stored = PrepareStoredStack(st);
+
   // PrepareForSampling() invoked in the constructor.
-  SampledAllocation sampled_allocation(PrepareStackTrace());
+  SampledAllocation sampled_allocation(st, &stored);
   absl::base_internal::SpinLockHolder sample_lock(&sampled_allocation.lock);
 
   // Now verify some fields.
-  EXPECT_GT(sampled_allocation.sampled_stack.depth, 0);
-  EXPECT_EQ(sampled_allocation.sampled_stack.requested_size, 8);
-  EXPECT_EQ(sampled_allocation.sampled_stack.requested_alignment, 4);
-  EXPECT_EQ(sampled_allocation.sampled_stack.allocated_size, 8);
-  EXPECT_EQ(sampled_allocation.sampled_stack.access_hint, 1);
-  EXPECT_EQ(sampled_allocation.sampled_stack.weight, 4);
+  EXPECT_EQ(sampled_allocation.stack, &stored);
+  EXPECT_GT(sampled_allocation.stack->depth, 0);
+  EXPECT_EQ(sampled_allocation.details.requested_size, 8);
+  EXPECT_EQ(sampled_allocation.details.requested_alignment, 4);
+  EXPECT_EQ(sampled_allocation.details.allocated_size, 8);
+  EXPECT_EQ(sampled_allocation.details.access_hint, 1);
+  EXPECT_EQ(sampled_allocation.details.weight, 4);
 
   // Set them to different values.
-  sampled_allocation.sampled_stack.depth = 0;
-  sampled_allocation.sampled_stack.requested_size = 0;
-  sampled_allocation.sampled_stack.requested_alignment = 0;
-  sampled_allocation.sampled_stack.allocated_size = 0;
-  sampled_allocation.sampled_stack.access_hint = 0;
-  sampled_allocation.sampled_stack.weight = 0;
+  sampled_allocation.stack = nullptr;
+  sampled_allocation.details.requested_size = 0;
+  sampled_allocation.details.requested_alignment = 0;
+  sampled_allocation.details.allocated_size = 0;
+  sampled_allocation.details.access_hint = 0;
+  sampled_allocation.details.weight = 0;
 
   // Call PrepareForSampling() again and check the fields.
-  sampled_allocation.PrepareForSampling(PrepareStackTrace());
-  EXPECT_GT(sampled_allocation.sampled_stack.depth, 0);
-  EXPECT_EQ(sampled_allocation.sampled_stack.requested_size, 8);
-  EXPECT_EQ(sampled_allocation.sampled_stack.requested_alignment, 4);
-  EXPECT_EQ(sampled_allocation.sampled_stack.allocated_size, 8);
-  EXPECT_EQ(sampled_allocation.sampled_stack.access_hint, 1);
-  EXPECT_EQ(sampled_allocation.sampled_stack.weight, 4);
+  sampled_allocation.PrepareForSampling(st, &stored);
+  EXPECT_EQ(sampled_allocation.stack, &stored);
+  EXPECT_GT(sampled_allocation.stack->depth, 0);
+  EXPECT_EQ(sampled_allocation.details.requested_size, 8);
+  EXPECT_EQ(sampled_allocation.details.requested_alignment, 4);
+  EXPECT_EQ(sampled_allocation.details.allocated_size, 8);
+  EXPECT_EQ(sampled_allocation.details.access_hint, 1);
+  EXPECT_EQ(sampled_allocation.details.weight, 4);
+}
+
+TEST(SampledAllocationTest, StackTrace) {
+  const StackTrace st = PrepareStackTrace();
+  const StoredStack stored = PrepareStoredStack(st);
+  SampledAllocation sampled_allocation(st, &stored);
+
+  const StackTrace t = sampled_allocation.stack_trace();
+  ASSERT_GT(t.depth, 0);
+  EXPECT_EQ(t.depth, st.depth);
+  EXPECT_TRUE(std::equal(t.stack, t.stack + t.depth, st.stack));
+  EXPECT_EQ(t.requested_size, 8);
+  EXPECT_EQ(t.weight, 4);
 }
 
 }  // namespace
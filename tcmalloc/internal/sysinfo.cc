@@ -105,8 +105,52 @@ std::optional<cpu_set_t> ParseCpulist(
   return set;
 }
 
+ThpMode ParseThpMode(absl::FunctionRef<ssize_t(char* buf, size_t count)> read) {
+  // The file is a single short line.
+  std::array<char, 128> buf;
+  size_t len = 0;
+  while (len < buf.size()) {
+    const ssize_t n = read(buf.data() + len, buf.size() - len);
+    if (n < 0) {
+      return ThpMode::kUnknown;
+    }
+    if (n == 0) {
+      break;
+    }
+    len += n;
+  }
+  absl::string_view contents(buf.data(), len);
+  const size_t open = contents.find('[');
+  const size_t close = contents.find(']', open);
+  if (open == contents.npos || close == contents.npos) {
+    return ThpMode::kUnknown;
+  }
+  const absl::string_view mode = contents.substr(open + 1, close - open - 1);
+  if (mode == "always") {
+    return ThpMode::kAlways;
+  } else if (mode == "madvise") {
+    return ThpMode::kMadvise;
+  } else if (mode == "never") {
+    return ThpMode::kNever;
+  }
+  return ThpMode::kUnknown;
+}
+
 namespace sysinfo_internal {
 
+ThpMode GetThpModeNoCache() {
+  int fd = signal_safe_open("/sys/kernel/mm/transparent_hugepage/enabled",
+                            O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return ThpMode::kUnknown;
+  }
+  const ThpMode mode = ParseThpMode([&](char* const buf, const size_t count) {
+    return signal_safe_read(fd, buf, count, /*bytes_read=*/nullptr);
+  });
+  signal_safe_close(fd);
+  return mode;
+}
+
 int NumPossibleCPUsNoCache() {
   int fd = signal_safe_open("/sys/devices/system/cpu/possible",
                             O_RDONLY | O_CLOEXEC);
@@ -45,6 +45,17 @@ namespace tcmalloc_internal {
 std::optional<cpu_set_t> ParseCpulist(
     absl::FunctionRef<ssize_t(char* buf, size_t count)> read);
 
+// The system's transparent hugepage (THP) mode.  In kMadvise mode, only
+// memory advised with MADV_HUGEPAGE is backed by hugepages.
+enum class ThpMode { kUnknown, kAlways, kMadvise, kNever };
+
+// Parses /sys/kernel/mm/transparent_hugepage/enabled, which lists the modes
+// with the active one in brackets ("always [madvise] never").  `read` is as
+// for ParseCpulist.
+//
+// Returns ThpMode::kUnknown on error.
+ThpMode ParseThpMode(absl::FunctionRef<ssize_t(char* buf, size_t count)> read);
+
 namespace sysinfo_internal {
 
 // Returns the number of possible CPUs on the machine, including currently
@@ -53,6 +64,10 @@ namespace sysinfo_internal {
 // The result of this function is not cached internally.
 int NumPossibleCPUsNoCache();
 
+// Returns the system's THP mode.  The result of this function is not cached
+// internally.
+ThpMode GetThpModeNoCache();
+
 }  // namespace sysinfo_internal
 #endif  // __linux__
 
@@ -64,6 +79,33 @@ inline int NumCPUs() {
   return result;
 }
 
+// Returns the THP mode of the system, as read at first call.
+inline ThpMode GetThpMode() {
+#if __linux__
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static ThpMode result;
+  absl::base_internal::LowLevelCallOnce(
+      &flag, [&]() { result = sysinfo_internal::GetThpModeNoCache(); });
+  return result;
+#else
+  return ThpMode::kUnknown;
+#endif
+}
+
+inline const char* ThpModeToLabel(ThpMode mode) {
+  switch (mode) {
+    case ThpMode::kUnknown:
+      return "unknown";
+    case ThpMode::kAlways:
+      return "always";
+    case ThpMode::kMadvise:
+      return "madvise";
+    case ThpMode::kNever:
+      return "never";
+  }
+  return "unknown";
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -139,6 +139,30 @@ TEST(ParseCpulistTest, Random) {
   }
 }
 
+ThpMode ParseThpModeFrom(absl::string_view contents) {
+  return ParseThpMode([&](char* const buf, const size_t count) -> ssize_t {
+    const size_t to_copy = std::min(count, contents.size());
+    memcpy(buf, contents.data(), to_copy);
+    contents.remove_prefix(to_copy);
+    return to_copy;
+  });
+}
+
+TEST(ParseThpModeTest, Modes) {
+  EXPECT_EQ(ParseThpModeFrom("[always] madvise never\n"), ThpMode::kAlways);
+  EXPECT_EQ(ParseThpModeFrom("always [madvise] never\n"), ThpMode::kMadvise);
+  EXPECT_EQ(ParseThpModeFrom("always madvise [never]\n"), ThpMode::kNever);
+}
+
+TEST(ParseThpModeTest, Malformed) {
+  EXPECT_EQ(ParseThpModeFrom(""), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpModeFrom("always madvise never\n"), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpModeFrom("always [madvise never\n"), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpModeFrom("[sometimes] never\n"), ThpMode::kUnknown);
+  EXPECT_EQ(ParseThpMode([](char*, size_t) -> ssize_t { return -1; }),
+            ThpMode::kUnknown);
+}
+
 TEST(NumCPUs, NoCache) {
   const int result = []() {
     AllocationGuard guard;
@@ -24,10 +24,13 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "tcmalloc/malloc_extension.h"
 
@@ -61,6 +64,11 @@ extern "C" {
 
 ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_ForceCpuCacheActivation();
 
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_CreateHeap();
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_HeapAllocate(
+    void* heap, size_t size, size_t alignment);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_DestroyHeap(void* heap);
+
 ABSL_ATTRIBUTE_WEAK tcmalloc::AddressRegionFactory*
 MallocExtension_Internal_GetRegionFactory();
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetRegionFactory(
@@ -68,6 +76,18 @@ ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetRegionFactory(
 
 ABSL_ATTRIBUTE_WEAK const tcmalloc::tcmalloc_internal::ProfileBase*
 MallocExtension_Internal_SnapshotCurrent(tcmalloc::ProfileType type);
+ABSL_ATTRIBUTE_WEAK const tcmalloc::tcmalloc_internal::ProfileBase*
+MallocExtension_Internal_SnapshotHeapDelta(int64_t* allocated, uint64_t* freed,
+                                           bool* is_delta);
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_ResetPeakHeapWindow(
+    const char* name_data, size_t name_size);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_RemovePeakHeapWindow(
+    const char* name_data, size_t name_size);
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetPeakHeapWindowSize(
+    const char* name_data, size_t name_size, size_t* size);
+ABSL_ATTRIBUTE_WEAK const tcmalloc::tcmalloc_internal::ProfileBase*
+MallocExtension_Internal_SnapshotPeakHeapWindow(const char* name_data,
+                                                size_t name_size);
 
 ABSL_ATTRIBUTE_WEAK tcmalloc::tcmalloc_internal::AllocationProfilingTokenBase*
 MallocExtension_Internal_StartAllocationProfiling();
@@ -79,12 +99,25 @@ ABSL_ATTRIBUTE_WEAK tcmalloc::MallocExtension::Ownership
 MallocExtension_Internal_GetOwnership(const void* ptr);
 ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_GetMemoryLimit(
     tcmalloc::MallocExtension::LimitKind limit_kind);
+ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_GetMemoryKindLimit(
+    tcmalloc::MallocExtension::MemoryKind kind);
 ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetNumericProperty(
     const char* name_data, size_t name_size, size_t* value);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetNumericProperties(
+    const absl::string_view* names, size_t count,
+    std::optional<size_t>* values);
 ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetPerCpuCachesActive();
 ABSL_ATTRIBUTE_WEAK int32_t MallocExtension_Internal_GetMaxPerCpuCacheSize();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetPerCpuCacheCapacityProfile(
+    std::vector<size_t>* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetPerCpuCacheCapacityProfile(
+    const size_t* capacities, size_t n);
 ABSL_ATTRIBUTE_WEAK bool
 MallocExtension_Internal_GetBackgroundProcessActionsEnabled();
+ABSL_ATTRIBUTE_WEAK bool
+MallocExtension_Internal_GetPerThreadAllocationAccountingEnabled();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetThreadAllocationCounts(
+    tcmalloc::MallocExtension::ThreadAllocationCounts* counts);
 ABSL_ATTRIBUTE_WEAK void
 MallocExtension_Internal_GetBackgroundProcessSleepInterval(absl::Duration* ret);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetSkipSubreleaseInterval(
@@ -98,11 +131,19 @@ ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetProperties(
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetExperiments(
     std::map<std::string, tcmalloc::MallocExtension::Property>* ret);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetStats(std::string* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetStatsInWireFormat(
+    std::string* ret);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetStatsSnapshot(
+    tcmalloc::MallocExtension::StatsSnapshot* snapshot, bool exact);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetMemoryUsageByTag(
+    std::vector<tcmalloc::MallocExtension::MemoryTagUsage>* ret);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMaxPerCpuCacheSize(
     int32_t value);
 ABSL_ATTRIBUTE_WEAK void
 MallocExtension_Internal_SetBackgroundProcessActionsEnabled(bool value);
 ABSL_ATTRIBUTE_WEAK void
+MallocExtension_Internal_SetPerThreadAllocationAccountingEnabled(bool value);
+ABSL_ATTRIBUTE_WEAK void
 MallocExtension_Internal_SetBackgroundProcessSleepInterval(
     absl::Duration value);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetSkipSubreleaseInterval(
@@ -111,15 +152,35 @@ ABSL_ATTRIBUTE_WEAK void
 MallocExtension_Internal_SetSkipSubreleaseShortInterval(absl::Duration value);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetSkipSubreleaseLongInterval(
     absl::Duration value);
+ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_ReleaseAllCachedMemory();
 ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_ReleaseCpuMemory(int cpu);
+ABSL_ATTRIBUTE_WEAK size_t MallocExtension_Internal_ReleaseEmergencyReserve();
 ABSL_ATTRIBUTE_WEAK size_t
 MallocExtension_Internal_ReleaseMemoryToSystem(size_t bytes);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMemoryLimit(
     size_t limit, tcmalloc::MallocExtension::LimitKind limit_kind);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetMemoryKindLimit(
+    size_t limit, tcmalloc::MallocExtension::MemoryKind kind);
+ABSL_ATTRIBUTE_WEAK size_t
+MallocExtension_Internal_SetEmergencyReserve(size_t bytes);
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_CreateIoBufferPool(
+    size_t buffer_size, size_t num_buffers,
+    tcmalloc::MallocExtension::IoBufferPool* pool);
+ABSL_ATTRIBUTE_WEAK bool MallocExtension_Internal_GetIoBufferPool(
+    tcmalloc::MallocExtension::IoBufferPool* pool);
+ABSL_ATTRIBUTE_WEAK void* MallocExtension_Internal_AllocateIoBuffer();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_FreeIoBuffer(void* buffer);
 
 ABSL_ATTRIBUTE_WEAK size_t
 MallocExtension_Internal_GetAllocatedSize(const void* ptr);
+ABSL_ATTRIBUTE_WEAK size_t
+MallocExtension_Internal_GetAllocatedSizeWithHint(const void* ptr,
+                                                  size_t size);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_MarkThreadBusy();
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SwapAllocationPolicy(
+    tcmalloc::MallocExtension::AllocationPolicy* policy);
+ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SwapAllocationLabel(
+    int* label);
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_MarkThreadIdle();
 
 ABSL_ATTRIBUTE_WEAK int64_t MallocExtension_Internal_GetProfileSamplingRate();
@@ -127,6 +188,11 @@ ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_SetProfileSamplingRate(
     int64_t);
 
 ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_ProcessBackgroundActions();
+ABSL_ATTRIBUTE_WEAK void
+MallocExtension_Internal_ProcessNumaPartitionBackgroundActions(
+    size_t partition);
+ABSL_ATTRIBUTE_WEAK size_t
+MallocExtension_Internal_GetNumBackgroundNumaPartitions();
 
 ABSL_ATTRIBUTE_WEAK tcmalloc::MallocExtension::BytesPerSecond
 MallocExtension_Internal_GetBackgroundReleaseRate();
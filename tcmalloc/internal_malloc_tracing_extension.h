@@ -20,8 +20,14 @@
 #ifndef TCMALLOC_INTERNAL_MALLOC_TRACING_EXTENSION_H_
 #define TCMALLOC_INTERNAL_MALLOC_TRACING_EXTENSION_H_
 
+#include <cstddef>
+#include <cstdint>
+
 #include "absl/base/attributes.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "tcmalloc/malloc_tracing_extension.h"
 
 #if ABSL_HAVE_ATTRIBUTE_WEAK && !defined(__APPLE__) && !defined(__EMSCRIPTEN__)
@@ -30,6 +36,25 @@ ABSL_ATTRIBUTE_WEAK
 absl::StatusOr<tcmalloc::malloc_tracing_extension::AllocatedAddressRanges>
 MallocTracingExtension_Internal_GetAllocatedAddressRanges();
 
+ABSL_ATTRIBUTE_WEAK absl::StatusOr<uint64_t>
+MallocTracingExtension_Internal_ForEachAllocatedAddressRange(
+    const tcmalloc::malloc_tracing_extension::AddressRangeScanOptions& options,
+    absl::FunctionRef<void(
+        const tcmalloc::malloc_tracing_extension::AllocatedAddressRangeBatch&)>
+        callback);
+
+ABSL_ATTRIBUTE_WEAK absl::Status
+MallocTracingExtension_Internal_StartAllocationEventTrace();
+
+ABSL_ATTRIBUTE_WEAK absl::Status
+MallocTracingExtension_Internal_StopAllocationEventTrace();
+
+ABSL_ATTRIBUTE_WEAK absl::StatusOr<size_t>
+MallocTracingExtension_Internal_DrainAllocationEvents(
+    absl::FunctionRef<void(
+        absl::Span<const tcmalloc::malloc_tracing_extension::AllocationEvent>)>
+        callback);
+
 #endif
 
 #endif  // TCMALLOC_INTERNAL_MALLOC_TRACING_EXTENSION_H_
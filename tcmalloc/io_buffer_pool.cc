@@ -0,0 +1,178 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/io_buffer_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/system-alloc.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+// Free buffers are chained through their first words.
+struct FreeBuffer {
+  FreeBuffer* next;
+};
+
+ABSL_CONST_INIT absl::base_internal::SpinLock pool_lock(
+    absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
+// Set once, when the pool is created, and read without the lock after.
+ABSL_CONST_INIT std::atomic<uintptr_t> pool_start(0);
+ABSL_CONST_INIT size_t pool_buffer_size = 0;
+ABSL_CONST_INIT size_t pool_num_buffers = 0;
+ABSL_CONST_INIT bool pool_locked = false;
+
+ABSL_CONST_INIT FreeBuffer* free_buffers ABSL_GUARDED_BY(pool_lock) = nullptr;
+ABSL_CONST_INIT size_t num_free ABSL_GUARDED_BY(pool_lock) = 0;
+ABSL_CONST_INIT size_t num_exhausted ABSL_GUARDED_BY(pool_lock) = 0;
+
+void Describe(uintptr_t start, MallocExtension::IoBufferPool* pool) {
+  pool->start = reinterpret_cast<void*>(start);
+  pool->buffer_size = pool_buffer_size;
+  pool->num_buffers = pool_num_buffers;
+  pool->locked = pool_locked;
+}
+
+}  // namespace
+
+bool IoBufferPool::Create(size_t buffer_size, size_t num_buffers,
+                          MallocExtension::IoBufferPool* pool) {
+  const size_t page_size = GetPageSize();
+  if (buffer_size == 0 || num_buffers == 0 ||
+      buffer_size > kHugePageSize * 1024) {
+    return false;
+  }
+  buffer_size = (buffer_size + page_size - 1) & ~(page_size - 1);
+  if (num_buffers > (size_t{1} << 40) / buffer_size) {
+    return false;
+  }
+
+  AllocationGuardSpinLockHolder h(&pool_lock);
+  if (pool_start.load(std::memory_order_relaxed) != 0) {
+    return false;
+  }
+  auto [ptr, bytes] = SystemAllocIoBuffers(buffer_size * num_buffers);
+  if (ptr == nullptr) {
+    return false;
+  }
+  // Fault the whole region in now, rather than on first I/O, and pin it where
+  // RLIMIT_MEMLOCK allows.  Registering the buffers pins them anyway, so
+  // failing to lock is not fatal.
+  if (!SystemPopulate(ptr, bytes)) {
+    for (size_t offset = 0; offset < bytes; offset += page_size) {
+      static_cast<volatile char*>(ptr)[offset] = 0;
+    }
+  }
+  pool_locked = mlock(ptr, bytes) == 0;
+
+  pool_buffer_size = buffer_size;
+  pool_num_buffers = bytes / buffer_size;
+  const uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+  // Hand out buffers from the start of the region first.
+  for (size_t i = pool_num_buffers; i-- > 0;) {
+    FreeBuffer* buffer = reinterpret_cast<FreeBuffer*>(start + i * buffer_size);
+    buffer->next = free_buffers;
+    free_buffers = buffer;
+  }
+  num_free = pool_num_buffers;
+  pool_start.store(start, std::memory_order_release);
+
+  Describe(start, pool);
+  return true;
+}
+
+bool IoBufferPool::Get(MallocExtension::IoBufferPool* pool) {
+  const uintptr_t start = pool_start.load(std::memory_order_acquire);
+  if (start == 0) {
+    return false;
+  }
+  Describe(start, pool);
+  return true;
+}
+
+void* IoBufferPool::Allocate() {
+  if (pool_start.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+  AllocationGuardSpinLockHolder h(&pool_lock);
+  FreeBuffer* buffer = free_buffers;
+  if (buffer == nullptr) {
+    ++num_exhausted;
+    return nullptr;
+  }
+  free_buffers = buffer->next;
+  --num_free;
+  return buffer;
+}
+
+void IoBufferPool::Free(void* buffer) {
+  const uintptr_t start = pool_start.load(std::memory_order_acquire);
+  const uintptr_t p = reinterpret_cast<uintptr_t>(buffer);
+  TC_CHECK(start != 0 && p >= start &&
+               p < start + pool_num_buffers * pool_buffer_size &&
+               (p - start) % pool_buffer_size == 0,
+           "%p is not a buffer of the I/O buffer pool", buffer);
+
+  AllocationGuardSpinLockHolder h(&pool_lock);
+  FreeBuffer* free_buffer = static_cast<FreeBuffer*>(buffer);
+  free_buffer->next = free_buffers;
+  free_buffers = free_buffer;
+  ++num_free;
+}
+
+void IoBufferPool::Print(Printer* out) {
+  const uintptr_t start = pool_start.load(std::memory_order_acquire);
+  if (start == 0) {
+    return;
+  }
+  AllocationGuardSpinLockHolder h(&pool_lock);
+  out->printf(
+      "MALLOC I/O BUFFER POOL: %zu buffers of %zu bytes at %p, %zu in use, "
+      "%zu exhausted, %s\n",
+      pool_num_buffers, pool_buffer_size, reinterpret_cast<void*>(start),
+      pool_num_buffers - num_free, num_exhausted,
+      pool_locked ? "locked" : "not locked");
+}
+
+void IoBufferPool::PrintInPbtxt(PbtxtRegion* region) {
+  if (pool_start.load(std::memory_order_acquire) == 0) {
+    return;
+  }
+  AllocationGuardSpinLockHolder h(&pool_lock);
+  PbtxtRegion pool = region->CreateSubRegion("io_buffer_pool");
+  pool.PrintI64("buffer_size", pool_buffer_size);
+  pool.PrintI64("num_buffers", pool_num_buffers);
+  pool.PrintI64("in_use", pool_num_buffers - num_free);
+  pool.PrintI64("exhausted", num_exhausted);
+  pool.PrintBool("locked", pool_locked);
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,61 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_IO_BUFFER_POOL_H_
+#define TCMALLOC_IO_BUFFER_POOL_H_
+
+#include <stddef.h>
+
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// IoBufferPool serves fixed-size, page-aligned buffers for I/O, such as
+// io_uring registered buffers, from one contiguous region.  The region comes
+// from SystemAllocIoBuffers, is faulted in and, where RLIMIT_MEMLOCK allows,
+// locked into memory when the pool is created, and is never returned, so that
+// it can be registered with the kernel once.  Freed buffers go back to the
+// pool, never to the page heap.
+//
+// There is at most one pool per process.  Thread safe.
+class IoBufferPool {
+ public:
+  // Creates the pool, with at least `num_buffers` buffers of `buffer_size`
+  // bytes, each rounded up to a multiple of the system page size, filling out
+  // whole hugepages.  Returns false if there is already a pool, or if memory
+  // runs out.
+  static bool Create(size_t buffer_size, size_t num_buffers,
+                     MallocExtension::IoBufferPool* pool);
+
+  // Describes the pool, returning false if there is none.
+  static bool Get(MallocExtension::IoBufferPool* pool);
+
+  // Returns a free buffer, or nullptr if there is no pool or all of its
+  // buffers are in use.
+  static void* Allocate();
+
+  // Returns `buffer`, from Allocate, to the pool.
+  static void Free(void* buffer);
+
+  static void Print(Printer* out);
+  static void PrintInPbtxt(PbtxtRegion* region);
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_IO_BUFFER_POOL_H_
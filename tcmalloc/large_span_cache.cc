@@ -0,0 +1,189 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/large_span_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+struct Slot {
+  Span* span;
+  MemoryTag tag;
+  // The ReleaseIdle epoch the span was put in.
+  uint32_t epoch;
+};
+
+class Shard {
+ public:
+  constexpr Shard() = default;
+
+  Span* Get(Length n, MemoryTag tag) ABSL_LOCKS_EXCLUDED(lock_) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    // Search from the most recently put span, the likeliest to be hot in
+    // cache and TLB.
+    for (size_t i = count_; i-- > 0;) {
+      if (slots_[i].span->num_pages() == n && slots_[i].tag == tag) {
+        Span* span = slots_[i].span;
+        std::copy(slots_ + i + 1, slots_ + count_, slots_ + i);
+        --count_;
+        bytes_ -= n.in_bytes();
+        return span;
+      }
+    }
+    return nullptr;
+  }
+
+  bool Put(Span* span, MemoryTag tag, uint32_t epoch, size_t capacity)
+      ABSL_LOCKS_EXCLUDED(lock_) {
+    const size_t bytes = span->bytes_in_span();
+    AllocationGuardSpinLockHolder h(&lock_);
+    if (count_ == LargeSpanCache::kSlots || bytes_ + bytes > capacity) {
+      return false;
+    }
+    slots_[count_++] = {span, tag, epoch};
+    bytes_ += bytes;
+    return true;
+  }
+
+  // Moves into out the slots put in epochs other than epoch, or all of them
+  // if all is set, returning how many were moved.
+  size_t Take(Slot* out, uint32_t epoch, bool all) ABSL_LOCKS_EXCLUDED(lock_) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    size_t taken = 0, kept = 0;
+    for (size_t i = 0; i < count_; ++i) {
+      if (all || slots_[i].epoch != epoch) {
+        bytes_ -= slots_[i].span->bytes_in_span();
+        out[taken++] = slots_[i];
+      } else {
+        slots_[kept++] = slots_[i];
+      }
+    }
+    count_ = kept;
+    return taken;
+  }
+
+ private:
+  absl::base_internal::SpinLock lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  size_t count_ ABSL_GUARDED_BY(lock_) = 0;
+  size_t bytes_ ABSL_GUARDED_BY(lock_) = 0;
+  Slot slots_[LargeSpanCache::kSlots] ABSL_GUARDED_BY(lock_) = {};
+};
+
+ABSL_CONST_INIT Shard shards[LargeSpanCache::kShards];
+// Updated after each Get and Put, so it may be briefly off, even negative.
+ABSL_CONST_INIT std::atomic<int64_t> held_bytes(0);
+ABSL_CONST_INIT std::atomic<uint32_t> current_epoch(0);
+ABSL_CONST_INIT StatsCounter hit_count;
+ABSL_CONST_INIT StatsCounter miss_count;
+
+Shard& CurrentShard() {
+  const int cpu = subtle::percpu::GetRealCpuUnsafe();
+  return shards[cpu < 0 ? 0 : cpu % LargeSpanCache::kShards];
+}
+
+void ReleaseSlots(uint32_t epoch, bool all) {
+  for (Shard& shard : shards) {
+    Slot taken[LargeSpanCache::kSlots];
+    const size_t n = shard.Take(taken, epoch, all);
+    if (n == 0) {
+      continue;
+    }
+    int64_t bytes = 0;
+    PageHeapSpinLockHolder l;
+    for (size_t i = 0; i < n; ++i) {
+      bytes += taken[i].span->bytes_in_span();
+      tc_globals.page_allocator().Delete(taken[i].span,
+                                         /*objects_per_span=*/1, taken[i].tag);
+    }
+    held_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+Span* LargeSpanCache::Get(Length n, MemoryTag tag) {
+  if (ABSL_PREDICT_TRUE(Parameters::large_span_cache_bytes() == 0) ||
+      n > kMaxPages) {
+    return nullptr;
+  }
+  Span* span = CurrentShard().Get(n, tag);
+  if (span == nullptr) {
+    miss_count.Add(1);
+    return nullptr;
+  }
+  hit_count.Add(1);
+  held_bytes.fetch_sub(n.in_bytes(), std::memory_order_relaxed);
+  return span;
+}
+
+bool LargeSpanCache::Put(Span* span, MemoryTag tag) {
+  const size_t capacity = Parameters::large_span_cache_bytes();
+  if (ABSL_PREDICT_TRUE(capacity == 0) || span->num_pages() > kMaxPages) {
+    return false;
+  }
+  // The memory is no longer known to be zero, and must not be handed out as
+  // such.
+  span->set_zeroed(false);
+  if (!CurrentShard().Put(span, tag,
+                          current_epoch.load(std::memory_order_relaxed),
+                          capacity)) {
+    return false;
+  }
+  held_bytes.fetch_add(span->bytes_in_span(), std::memory_order_relaxed);
+  return true;
+}
+
+void LargeSpanCache::ReleaseIdle() {
+  // Spans put since the previous call carry its epoch and stay for one more
+  // round; Get and Put refresh the spans that are reused.
+  const uint32_t epoch =
+      current_epoch.fetch_add(1, std::memory_order_relaxed);
+  ReleaseSlots(epoch, /*all=*/Parameters::large_span_cache_bytes() == 0);
+}
+
+void LargeSpanCache::Drain() { ReleaseSlots(0, /*all=*/true); }
+
+size_t LargeSpanCache::bytes() {
+  return std::max<int64_t>(held_bytes.load(std::memory_order_relaxed), 0);
+}
+
+size_t LargeSpanCache::hits() { return hit_count.value(); }
+
+size_t LargeSpanCache::misses() { return miss_count.value(); }
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
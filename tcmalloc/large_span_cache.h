@@ -0,0 +1,80 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_LARGE_SPAN_CACHE_H_
+#define TCMALLOC_LARGE_SPAN_CACHE_H_
+
+#include <stddef.h>
+
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// LargeSpanCache keeps a few recently freed page-level allocations per CPU,
+// so that programs which free and allocate buffers of the same large size at
+// a high rate take neither pageheap_lock nor the page heap's search for a
+// free range.  Cached spans stay allocated from the page heap's view, with
+// their pagemap entries intact, and are handed out again whole, to requests
+// of exactly their length and memory tag.
+//
+// As with SpanRecycler, CPUs share a fixed number of shards, each guarded by
+// a lock of its own.  Each shard holds up to
+// Parameters::large_span_cache_bytes(); at zero, the default, nothing is
+// cached.  Spans that are not reused between two calls to ReleaseIdle, which
+// the background thread makes, go back to the page heap.
+class LargeSpanCache {
+ public:
+  static constexpr size_t kShards = 16;
+  static constexpr size_t kSlots = 8;
+  // Only allocations of up to a hugepage are cached: larger ones are rare
+  // enough that pageheap_lock is not their bottleneck.
+  static constexpr Length kMaxPages = kPagesPerHugePage;
+  // The capacity of each shard under TEST_ONLY_TCMALLOC_LARGE_SPAN_CACHE:
+  // enough for a few allocations just past kMaxSize, or a couple of MiB-sized
+  // ones, so that the cache stays a sparse tier above the size classes.
+  static constexpr size_t kExperimentCapacity = 2 << 20;
+
+  // Returns a cached span of n pages of memory tagged tag, no longer marked
+  // as holding zeroes, or nullptr if there is none.
+  static Span* Get(Length n, MemoryTag tag) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Caches span, a page-level allocation freed from memory tagged tag.
+  // Returns false, keeping nothing, if span is too large or the current
+  // shard is full, in which case the caller returns it to the page heap.
+  static bool Put(Span* span, MemoryTag tag)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns to the page heap the spans put before the previous call and not
+  // reused since, or all spans if the cache has been disabled.
+  static void ReleaseIdle() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns every cached span to the page heap.
+  static void Drain() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // The bytes of the cached spans, which the page heap counts as in use.
+  static size_t bytes();
+  static size_t hits();
+  static size_t misses();
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_LARGE_SPAN_CACHE_H_
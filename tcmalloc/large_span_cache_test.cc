@@ -0,0 +1,105 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/large_span_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+
+#include "gtest/gtest.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/testing/testutil.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+constexpr size_t kSize = 512 << 10;
+
+class LargeSpanCacheTest : public testing::Test {
+ protected:
+  LargeSpanCacheTest() : previous_(Parameters::large_span_cache_bytes()) {
+    LargeSpanCache::Drain();
+    Parameters::set_large_span_cache_bytes(4 * kSize);
+  }
+
+  ~LargeSpanCacheTest() override {
+    Parameters::set_large_span_cache_bytes(previous_);
+    LargeSpanCache::Drain();
+  }
+
+ private:
+  uint64_t previous_;
+  ScopedNeverSample never_sample_;
+};
+
+TEST_F(LargeSpanCacheTest, ReusesFreedSpans) {
+  // The thread may migrate to a CPU of another shard between the free and the
+  // allocation, so allow a few attempts.
+  bool reused = false;
+  for (int i = 0; i < 100 && !reused; ++i) {
+    const size_t hits = LargeSpanCache::hits();
+    void* p = ::operator new(kSize);
+    benchmark::DoNotOptimize(p);
+    ::operator delete(p, kSize);
+    EXPECT_GE(LargeSpanCache::bytes(), kSize);
+
+    void* q = ::operator new(kSize);
+    reused = p == q && LargeSpanCache::hits() > hits;
+    ::operator delete(q, kSize);
+  }
+  EXPECT_TRUE(reused);
+
+  // Cached spans still count as free memory, not memory in use.
+  EXPECT_EQ(MallocExtension::GetNumericProperty(
+                "tcmalloc.large_span_cache_free"),
+            LargeSpanCache::bytes());
+}
+
+TEST_F(LargeSpanCacheTest, ReleasesIdleSpans) {
+  void* p = ::operator new(kSize);
+  benchmark::DoNotOptimize(p);
+  ::operator delete(p, kSize);
+  ASSERT_GE(LargeSpanCache::bytes(), kSize);
+
+  // Spans survive the first pass after they were put, but not the second.
+  LargeSpanCache::ReleaseIdle();
+  EXPECT_GE(LargeSpanCache::bytes(), kSize);
+  LargeSpanCache::ReleaseIdle();
+  EXPECT_EQ(LargeSpanCache::bytes(), 0);
+}
+
+TEST_F(LargeSpanCacheTest, Disabled) {
+  Parameters::set_large_span_cache_bytes(0);
+  void* p = ::operator new(kSize);
+  benchmark::DoNotOptimize(p);
+  ::operator delete(p, kSize);
+  EXPECT_EQ(LargeSpanCache::bytes(), 0);
+}
+
+TEST_F(LargeSpanCacheTest, SkipsLargerAllocations) {
+  const size_t size = LargeSpanCache::kMaxPages.in_bytes() + kPageSize;
+  Parameters::set_large_span_cache_bytes(4 * size);
+  void* p = ::operator new(size);
+  benchmark::DoNotOptimize(p);
+  ::operator delete(p, size);
+  EXPECT_EQ(LargeSpanCache::bytes(), 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
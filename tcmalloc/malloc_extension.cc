@@ -27,6 +27,7 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/call_once.h"
@@ -224,6 +225,47 @@ std::string MallocExtension::GetStats() {
   return "";
 }
 
+std::string MallocExtension::GetStatsInWireFormat() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetStatsInWireFormat != nullptr) {
+    std::string ret;
+    MallocExtension_Internal_GetStatsInWireFormat(&ret);
+    return ret;
+  }
+#endif
+  return "";
+}
+
+MallocExtension::StatsSnapshot MallocExtension::GetStatsSnapshot(bool exact) {
+  StatsSnapshot snapshot;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetStatsSnapshot != nullptr) {
+    MallocExtension_Internal_GetStatsSnapshot(&snapshot, exact);
+  }
+#endif
+  return snapshot;
+}
+
+std::vector<MallocExtension::MemoryTagUsage>
+MallocExtension::GetMemoryUsageByTag() {
+  std::vector<MemoryTagUsage> ret;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetMemoryUsageByTag != nullptr) {
+    MallocExtension_Internal_GetMemoryUsageByTag(&ret);
+  }
+#endif
+  return ret;
+}
+
+size_t MallocExtension::ReleaseAllCachedMemory() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ReleaseAllCachedMemory != nullptr) {
+    return MallocExtension_Internal_ReleaseAllCachedMemory();
+  }
+#endif
+  return 0;
+}
+
 void MallocExtension::ReleaseMemoryToSystem(size_t num_bytes) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_ReleaseMemoryToSystem != nullptr) {
@@ -232,6 +274,36 @@ void MallocExtension::ReleaseMemoryToSystem(size_t num_bytes) {
 #endif
 }
 
+std::optional<MallocExtension::HeapHandle> MallocExtension::CreateHeap() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_CreateHeap != nullptr) {
+    if (void* heap = MallocExtension_Internal_CreateHeap()) {
+      return HeapHandle{reinterpret_cast<uintptr_t>(heap)};
+    }
+  }
+#endif
+  return std::nullopt;
+}
+
+void* MallocExtension::HeapAllocate(HeapHandle heap, size_t size,
+                                    std::align_val_t alignment) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_HeapAllocate != nullptr) {
+    return MallocExtension_Internal_HeapAllocate(
+        reinterpret_cast<void*>(heap), size, static_cast<size_t>(alignment));
+  }
+#endif
+  return nullptr;
+}
+
+void MallocExtension::DestroyHeap(HeapHandle heap) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_DestroyHeap != nullptr) {
+    MallocExtension_Internal_DestroyHeap(reinterpret_cast<void*>(heap));
+  }
+#endif
+}
+
 AddressRegionFactory* MallocExtension::GetRegionFactory() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_GetRegionFactory == nullptr) {
@@ -269,6 +341,68 @@ Profile MallocExtension::SnapshotCurrent(tcmalloc::ProfileType type) {
 #endif
 }
 
+Profile MallocExtension::SnapshotHeapDelta(HeapProfileCursor* cursor) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SnapshotHeapDelta == nullptr) {
+    return Profile();
+  }
+
+  return tcmalloc_internal::ProfileAccessor::MakeProfile(
+      std::unique_ptr<const tcmalloc_internal::ProfileBase>(
+          MallocExtension_Internal_SnapshotHeapDelta(
+              &cursor->allocated_, &cursor->freed_, &cursor->is_delta_)));
+#else
+  return Profile();
+#endif
+}
+
+bool MallocExtension::ResetPeakHeapWindow(absl::string_view name) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ResetPeakHeapWindow != nullptr) {
+    return MallocExtension_Internal_ResetPeakHeapWindow(name.data(),
+                                                        name.size());
+  }
+#endif
+  return false;
+}
+
+void MallocExtension::RemovePeakHeapWindow(absl::string_view name) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_RemovePeakHeapWindow != nullptr) {
+    MallocExtension_Internal_RemovePeakHeapWindow(name.data(), name.size());
+  }
+#endif
+}
+
+std::optional<size_t> MallocExtension::GetPeakHeapWindowSize(
+    absl::string_view name) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetPeakHeapWindowSize != nullptr) {
+    size_t size;
+    if (MallocExtension_Internal_GetPeakHeapWindowSize(name.data(),
+                                                       name.size(), &size)) {
+      return size;
+    }
+  }
+#endif
+  return std::nullopt;
+}
+
+Profile MallocExtension::SnapshotPeakHeapWindow(absl::string_view name) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SnapshotPeakHeapWindow == nullptr) {
+    return Profile();
+  }
+
+  return tcmalloc_internal::ProfileAccessor::MakeProfile(
+      std::unique_ptr<const tcmalloc_internal::ProfileBase>(
+          MallocExtension_Internal_SnapshotPeakHeapWindow(name.data(),
+                                                          name.size())));
+#else
+  return Profile();
+#endif
+}
+
 MallocExtension::AllocationProfilingToken
 MallocExtension::StartAllocationProfiling() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
@@ -322,6 +456,41 @@ void MallocExtension::MarkThreadBusy() {
 #endif
 }
 
+MallocExtension::ScopedAllocationPolicy::ScopedAllocationPolicy(
+    AllocationPolicy policy)
+    : previous_(policy) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SwapAllocationPolicy != nullptr) {
+    MallocExtension_Internal_SwapAllocationPolicy(&previous_);
+  }
+#endif
+}
+
+MallocExtension::ScopedAllocationPolicy::~ScopedAllocationPolicy() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SwapAllocationPolicy != nullptr) {
+    MallocExtension_Internal_SwapAllocationPolicy(&previous_);
+  }
+#endif
+}
+
+MallocExtension::ScopedAllocationLabel::ScopedAllocationLabel(int label)
+    : previous_(label) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SwapAllocationLabel != nullptr) {
+    MallocExtension_Internal_SwapAllocationLabel(&previous_);
+  }
+#endif
+}
+
+MallocExtension::ScopedAllocationLabel::~ScopedAllocationLabel() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SwapAllocationLabel != nullptr) {
+    MallocExtension_Internal_SwapAllocationLabel(&previous_);
+  }
+#endif
+}
+
 size_t MallocExtension::GetMemoryLimit(LimitKind limit_kind) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_GetMemoryLimit != nullptr) {
@@ -342,6 +511,88 @@ void MallocExtension::SetMemoryLimit(const size_t limit, LimitKind limit_kind) {
 #endif
 }
 
+size_t MallocExtension::GetMemoryKindLimit(MemoryKind kind) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetMemoryKindLimit != nullptr) {
+    return MallocExtension_Internal_GetMemoryKindLimit(kind);
+  }
+#endif
+  return 0;
+}
+
+void MallocExtension::SetMemoryKindLimit(const size_t limit, MemoryKind kind) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetMemoryKindLimit != nullptr) {
+    // limit == 0 implies no limit.
+    const size_t new_limit =
+        (limit > 0) ? limit : std::numeric_limits<size_t>::max();
+    MallocExtension_Internal_SetMemoryKindLimit(new_limit, kind);
+  }
+#endif
+}
+
+size_t MallocExtension::SetEmergencyReserve(size_t bytes) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_SetEmergencyReserve != nullptr) {
+    return MallocExtension_Internal_SetEmergencyReserve(bytes);
+  }
+#endif
+  return 0;
+}
+
+size_t MallocExtension::ReleaseEmergencyReserve() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ReleaseEmergencyReserve != nullptr) {
+    return MallocExtension_Internal_ReleaseEmergencyReserve();
+  }
+#endif
+  return 0;
+}
+
+std::optional<MallocExtension::IoBufferPool>
+MallocExtension::CreateIoBufferPool(size_t buffer_size, size_t num_buffers) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_CreateIoBufferPool != nullptr) {
+    IoBufferPool pool;
+    if (MallocExtension_Internal_CreateIoBufferPool(buffer_size, num_buffers,
+                                                    &pool)) {
+      return pool;
+    }
+  }
+#endif
+  return std::nullopt;
+}
+
+std::optional<MallocExtension::IoBufferPool>
+MallocExtension::GetIoBufferPool() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetIoBufferPool != nullptr) {
+    IoBufferPool pool;
+    if (MallocExtension_Internal_GetIoBufferPool(&pool)) {
+      return pool;
+    }
+  }
+#endif
+  return std::nullopt;
+}
+
+void* MallocExtension::AllocateIoBuffer() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_AllocateIoBuffer != nullptr) {
+    return MallocExtension_Internal_AllocateIoBuffer();
+  }
+#endif
+  return nullptr;
+}
+
+void MallocExtension::FreeIoBuffer(void* buffer) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_FreeIoBuffer != nullptr) {
+    MallocExtension_Internal_FreeIoBuffer(buffer);
+  }
+#endif
+}
+
 int64_t MallocExtension::GetProfileSamplingRate() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_GetProfileSamplingRate != nullptr) {
@@ -428,6 +679,30 @@ void MallocExtension::SetMaxPerCpuCacheSize(int32_t value) {
 #endif
 }
 
+std::vector<size_t> MallocExtension::GetPerCpuCacheCapacityProfile() {
+  std::vector<size_t> ret;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_GetPerCpuCacheCapacityProfile != nullptr) {
+    MallocExtension_Internal_GetPerCpuCacheCapacityProfile(&ret);
+  }
+#endif
+  return ret;
+}
+
+void MallocExtension::SetPerCpuCacheCapacityProfile(
+    absl::Span<const size_t> capacities) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_SetPerCpuCacheCapacityProfile == nullptr) {
+    return;
+  }
+
+  MallocExtension_Internal_SetPerCpuCacheCapacityProfile(capacities.data(),
+                                                        capacities.size());
+#else
+  (void)capacities;
+#endif
+}
+
 int64_t MallocExtension::GetMaxTotalThreadCacheBytes() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (MallocExtension_Internal_GetMaxTotalThreadCacheBytes == nullptr) {
@@ -502,6 +777,43 @@ void MallocExtension::SetBackgroundProcessActionsEnabled(bool value) {
 #endif
 }
 
+bool MallocExtension::GetPerThreadAllocationAccountingEnabled() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_GetPerThreadAllocationAccountingEnabled ==
+      nullptr) {
+    return false;
+  }
+
+  return MallocExtension_Internal_GetPerThreadAllocationAccountingEnabled();
+#else
+  return false;
+#endif
+}
+
+void MallocExtension::SetPerThreadAllocationAccountingEnabled(bool value) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_SetPerThreadAllocationAccountingEnabled ==
+      nullptr) {
+    return;
+  }
+
+  MallocExtension_Internal_SetPerThreadAllocationAccountingEnabled(value);
+#else
+  (void)value;
+#endif
+}
+
+MallocExtension::ThreadAllocationCounts
+MallocExtension::GetThreadAllocationCounts() {
+  ThreadAllocationCounts counts;
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetThreadAllocationCounts != nullptr) {
+    MallocExtension_Internal_GetThreadAllocationCounts(&counts);
+  }
+#endif
+  return counts;
+}
+
 absl::Duration MallocExtension::GetBackgroundProcessSleepInterval() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (MallocExtension_Internal_GetBackgroundProcessSleepInterval == nullptr) {
@@ -630,6 +942,22 @@ std::optional<size_t> MallocExtension::GetNumericProperty(
   return std::nullopt;
 }
 
+std::vector<std::optional<size_t>> MallocExtension::GetNumericProperties(
+    absl::Span<const absl::string_view> properties) {
+  std::vector<std::optional<size_t>> values(properties.size());
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetNumericProperties != nullptr) {
+    MallocExtension_Internal_GetNumericProperties(
+        properties.data(), properties.size(), values.data());
+    return values;
+  }
+#endif
+  for (size_t i = 0; i < properties.size(); ++i) {
+    values[i] = GetNumericProperty(properties[i]);
+  }
+  return values;
+}
+
 size_t MallocExtension::GetEstimatedAllocatedSize(size_t size) {
   return nallocx(size, 0);
 }
@@ -646,6 +974,16 @@ std::optional<size_t> MallocExtension::GetAllocatedSize(const void* p) {
   return std::nullopt;
 }
 
+std::optional<size_t> MallocExtension::GetAllocatedSize(const void* p,
+                                                        size_t size) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (MallocExtension_Internal_GetAllocatedSizeWithHint != nullptr) {
+    return MallocExtension_Internal_GetAllocatedSizeWithHint(p, size);
+  }
+#endif
+  return GetAllocatedSize(p);
+}
+
 MallocExtension::Ownership MallocExtension::GetOwnership(const void* p) {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (MallocExtension_Internal_GetOwnership != nullptr) {
@@ -721,6 +1059,24 @@ bool MallocExtension::NeedsProcessBackgroundActions() {
 #endif
 }
 
+void MallocExtension::ProcessNumaPartitionBackgroundActions(size_t partition) {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_ProcessNumaPartitionBackgroundActions !=
+      nullptr) {
+    MallocExtension_Internal_ProcessNumaPartitionBackgroundActions(partition);
+  }
+#endif
+}
+
+size_t MallocExtension::NumBackgroundNumaPartitions() {
+#if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
+  if (&MallocExtension_Internal_GetNumBackgroundNumaPartitions != nullptr) {
+    return MallocExtension_Internal_GetNumBackgroundNumaPartitions();
+  }
+#endif
+  return 0;
+}
+
 MallocExtension::BytesPerSecond MallocExtension::GetBackgroundReleaseRate() {
 #if ABSL_INTERNAL_HAVE_WEAK_MALLOCEXTENSION_STUBS
   if (&MallocExtension_Internal_GetBackgroundReleaseRate != nullptr) {
@@ -751,6 +1107,13 @@ ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE size_t nallocx(size_t size,
   return size;
 }
 
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void tcmalloc_nallocx_batch(
+    const size_t* sizes, size_t* rounded, size_t n) noexcept {
+  for (size_t i = 0; i < n; ++i) {
+    rounded[i] = nallocx(sizes[i], 0);
+  }
+}
+
 // Default implementation just frees memory.  The expectation is that the
 // linked-in malloc implementation may provide an override with an
 // implementation that uses this optimization.
@@ -759,6 +1122,38 @@ ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void sdallocx(void* ptr, size_t,
   free(ptr);
 }
 
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void* tcmalloc_realloc_sized(
+    void* ptr, size_t, size_t new_size) noexcept {
+  return realloc(ptr, new_size);
+}
+
+// Default implementations allocate and free objects one at a time.
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE size_t
+tcmalloc_alloc_batch(size_t size, void** batch, size_t n) noexcept {
+  for (size_t i = 0; i < n; ++i) {
+    void* p = malloc(size);
+    if (p == nullptr) {
+      return i;
+    }
+    batch[i] = p;
+  }
+  return n;
+}
+
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void tcmalloc_free_batch(
+    void** batch, size_t n, size_t) noexcept {
+  for (size_t i = 0; i < n; ++i) {
+    free(batch[i]);
+  }
+}
+
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void tcmalloc_free_unsized_batch(
+    void** batch, size_t n) noexcept {
+  for (size_t i = 0; i < n; ++i) {
+    free(batch[i]);
+  }
+}
+
 ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE tcmalloc::sized_ptr_t
 tcmalloc_size_returning_operator_new(size_t size) {
   return {::operator new(size), size};
@@ -783,6 +1178,32 @@ tcmalloc_size_returning_operator_new_hot_cold_nothrow(
   return {p, p ? size : 0};
 }
 
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void* tcmalloc_zeroed_operator_new(
+    size_t size) {
+  void* p = ::operator new(size);
+  memset(p, 0, size);
+  return p;
+}
+
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void*
+tcmalloc_zeroed_operator_new_nothrow(size_t size) noexcept {
+  void* p = ::operator new(size, std::nothrow);
+  if (p != nullptr) {
+    memset(p, 0, size);
+  }
+  return p;
+}
+
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void*
+tcmalloc_interleaved_operator_new(size_t size) {
+  return ::operator new(size);
+}
+
+ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE void*
+tcmalloc_interleaved_operator_new_nothrow(size_t size) noexcept {
+  return ::operator new(size, std::nothrow);
+}
+
 #if defined(_LIBCPP_VERSION) && defined(__cpp_aligned_new)
 
 ABSL_ATTRIBUTE_WEAK ABSL_ATTRIBUTE_NOINLINE tcmalloc::sized_ptr_t
@@ -32,6 +32,7 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/functional/function_ref.h"
@@ -59,6 +60,11 @@ using hot_cold_t = __hot_cold_t;
 constexpr hot_cold_t kDefaultMinHotAccessHint =
     static_cast<tcmalloc::hot_cold_t>(1);
 
+// No hint is warm by default: the range [kDefaultMinHotAccessHint,
+// kDefaultMaxWarmAccessHint] is empty.
+constexpr hot_cold_t kDefaultMaxWarmAccessHint =
+    static_cast<tcmalloc::hot_cold_t>(0);
+
 }  // namespace tcmalloc
 
 inline bool AbslParseFlag(absl::string_view text, tcmalloc::hot_cold_t* hotness,
@@ -106,6 +112,23 @@ enum class ProfileType {
   // Lifetimes of sampled objects that are live during the profiling session.
   kLifetimes,
 
+  // Recent allocation rate of each sampled allocation stack.  Sample sums are
+  // in bytes per second and counts in objects per second, each an
+  // exponentially decaying average over roughly the profile's duration.
+  kAllocationRate,
+
+  // Fragmentation report that also charges each sampled object with its share
+  // of the free but backed pages of the hugepage its span lives on.  It shows
+  // which callsites leave hugepages partially used, at the cost of taking the
+  // page heap lock once per sample.
+  kPreciseFragmentation,
+
+  // Contention on the page heap lock, aggregated by acquiring stack: how many
+  // acquisitions each stack made, how long they waited for the lock and how
+  // long they held it.  Only populated while
+  // pageheap_lock_contention_sampling_interval is positive.
+  kLockContention,
+
   // Only present to prevent switch statements without a default clause so that
   // we can extend this enumeration without breaking code.
   kDoNotUse,
@@ -170,6 +193,18 @@ class Profile final {
     absl::Duration min_lifetime;
     absl::Duration max_lifetime;
 
+    // Statistics of the allocation/deallocation callstack pair as a whole,
+    // across the CPU and thread matching cases it is split into, and thus the
+    // same for all of its samples.  lifetime_histogram[i] is the number of
+    // objects that lived between 10^i and 10^(i+1) ns, with longer lifetimes
+    // in the last bucket; for censored samples, these are the lifetimes so
+    // far.  The ratios are the fractions of frees made on a different NUMA
+    // node or L3 cache than the allocation.
+    static constexpr int kLifetimeHistogramBuckets = 12;
+    int64_t lifetime_histogram[kLifetimeHistogramBuckets] = {};
+    double cross_numa_free_ratio = 0;
+    double cross_l3_free_ratio = 0;
+
     // For the *_matched vars below we use true = "same", false = "different".
     // When the value is unavailable the profile contains "none". For
     // right-censored observations, CPU and thread matched values are "none".
@@ -179,6 +214,12 @@ class Profile final {
     std::optional<bool> allocator_deallocator_numa_matched;
     std::optional<bool> allocator_deallocator_thread_matched;
 
+    // The following vars are used by the lock contention profile, where count
+    // is the number of acquisitions from the stack.  They are the total time
+    // those acquisitions waited for the lock, and then held it.
+    absl::Duration lock_wait_time;
+    absl::Duration lock_hold_time;
+
     // Provide the status of GWP-ASAN guarding for a given sample.
     enum class GuardedStatus {
       // Conditions which represent why a sample was not guarded:
@@ -221,6 +262,10 @@ class Profile final {
     // The start address of the sampled allocation, used to calculate the
     // residency info for the objects represented by this sampled allocation.
     void* span_start_address;
+
+    // The MallocExtension::ScopedAllocationLabel in place on the allocating
+    // thread, or 0 if there was none.
+    int label = 0;
   };
 
   void Iterate(absl::FunctionRef<void(const Sample&)> f) const;
@@ -267,6 +312,11 @@ class AddressRegionFactory {
     // mbind is not sufficient (e.g. when dealing with pre-faulted memory).
     kNormalNumaAwareS0,  // Normal usage intended for NUMA S0 under numa_aware.
     kNormalNumaAwareS1,  // Normal usage intended for NUMA S1 under numa_aware.
+    kNormalNumaAwareS2,  // Normal usage intended for NUMA S2 under numa_aware.
+    kNormalNumaAwareS3,  // Normal usage intended for NUMA S3 under numa_aware.
+    kIoBuffers,  // The pool of MallocExtension::CreateIoBufferPool, which
+                 // TCMalloc faults in and locks into memory once, and never
+                 // returns.
   };
 
   AddressRegionFactory() {}
@@ -318,6 +368,25 @@ class MallocExtension final {
   // statistics.
   static std::string GetStats();
 
+  // Gets the same stats as the pbtxt form of GetStats, serialized in protobuf
+  // wire format, which is cheaper to produce and to parse.  Every key is an
+  // Entry of
+  //
+  //   message Entry {
+  //     string key = 1;
+  //     oneof value {
+  //       int64 int_value = 2;
+  //       double double_value = 3;
+  //       bool bool_value = 4;
+  //       string raw_value = 5;
+  //     }
+  //     repeated Entry entries = 6;
+  //   }
+  //
+  // and the result as a whole parses as an Entry without a key.  Returns an
+  // empty string if unsupported.
+  static std::string GetStatsInWireFormat();
+
   // -------------------------------------------------------------------
   // Control operations for getting malloc implementation specific parameters.
   // Some currently useful properties:
@@ -358,6 +427,12 @@ class MallocExtension final {
   //      virtual memory usage, and depending on the OS, typically
   //      do not count towards physical memory usage.
   //
+  // "tcmalloc.pageheap_lazily_released_bytes"
+  //      Estimated number of the unmapped bytes above that were released
+  //      with MADV_FREE alone (MadvisePreference::kFreeOnly).  These
+  //      may still count towards physical memory usage until the kernel
+  //      reclaims them under memory pressure.
+  //
   //  "tcmalloc.per_cpu_caches_active"
   //      Whether tcmalloc is using per-CPU caches (1 or 0 respectively).
   // -------------------------------------------------------------------
@@ -365,6 +440,12 @@ class MallocExtension final {
   // Gets the named property's value or a nullopt if the property is not valid.
   static std::optional<size_t> GetNumericProperty(absl::string_view property);
 
+  // Gets the values of the named properties, in order, as GetNumericProperty
+  // would.  The stats several properties are computed from are only gathered
+  // once, so this is cheaper than looking the properties up one at a time.
+  static std::vector<std::optional<size_t>> GetNumericProperties(
+      absl::Span<const absl::string_view> properties);
+
   // Marks the current thread as "idle".  This function may optionally be called
   // by threads as a hint to the malloc implementation that any thread-specific
   // resources should be released.  Note: this may be an expensive function, so
@@ -380,6 +461,67 @@ class MallocExtension final {
   // not called, performance may suffer.
   static void MarkThreadBusy();
 
+  // Describes where allocations are placed. See ScopedAllocationPolicy.
+  struct AllocationPolicy {
+    // Access hint, as for operator new(size_t, hot_cold_t).  Hints below
+    // the minimum hot access hint place allocations in cold memory.
+    hot_cold_t access = hot_cold_t{255};
+    // NUMA partition to allocate from, or -1 for the one local to the
+    // allocating CPU.  Ignored unless TCMalloc is NUMA aware.
+    int numa_partition = -1;
+  };
+
+  // Applies a policy to the allocations made by the calling thread while this
+  // object is alive.  This steers whole subsystems, such as a thread loading a
+  // cache, without touching every call site:
+  //
+  //   MallocExtension::ScopedAllocationPolicy cold({.access = hot_cold_t{0}});
+  //
+  // Allocations that ask for cold memory or a NUMA partition themselves are
+  // not affected.  Scopes nest: destroying one restores the policy in place
+  // when it was created, so they must be destroyed in reverse order, on the
+  // thread that created them.
+  class ScopedAllocationPolicy {
+   public:
+    explicit ScopedAllocationPolicy(AllocationPolicy policy);
+    ~ScopedAllocationPolicy();
+
+    ScopedAllocationPolicy(const ScopedAllocationPolicy&) = delete;
+    ScopedAllocationPolicy& operator=(const ScopedAllocationPolicy&) = delete;
+
+   private:
+    // The policy to restore on destruction.
+    AllocationPolicy previous_;
+  };
+
+  // The number of allocation labels.  Label 0 is the label of threads that
+  // have not set one.
+  static constexpr int kNumAllocationLabels = 64;
+
+  // Labels the allocations made by the calling thread while this object is
+  // alive, to attribute heap usage to subsystems without a full heap profile:
+  //
+  //   MallocExtension::ScopedAllocationLabel label(kRpcBufferLabel);
+  //
+  // Sampled allocations record the label in Profile::Sample::label, and the
+  // numeric property "tcmalloc.sampled_label_bytes.<label>" estimates the live
+  // bytes of each label.  The label is only read when an allocation is
+  // sampled, so labeling does not slow down other allocations.  Labels outside
+  // [0, kNumAllocationLabels) are treated as 0.  Scopes nest and must be
+  // destroyed as ScopedAllocationPolicy's are.
+  class ScopedAllocationLabel {
+   public:
+    explicit ScopedAllocationLabel(int label);
+    ~ScopedAllocationLabel();
+
+    ScopedAllocationLabel(const ScopedAllocationLabel&) = delete;
+    ScopedAllocationLabel& operator=(const ScopedAllocationLabel&) = delete;
+
+   private:
+    // The label to restore on destruction.
+    int previous_;
+  };
+
   // Attempts to free any resources associated with cpu <cpu> (in the sense of
   // only being usable from that CPU.)  Returns the number of bytes previously
   // assigned to "cpu" that were freed.  Safe to call from any processor, not
@@ -413,6 +555,10 @@ class MallocExtension final {
   // * There are not at least num_bytes of free memory cached, or free memory is
   //   fragmented in ways that keep it from being returned to the OS.
   //
+  // If TCMalloc's tcmalloc_async_release_memory_to_system parameter is set and
+  // ProcessBackgroundActions is running, the release is carried out by the
+  // background thread on its next iteration and this call returns immediately.
+  //
   // Returning memory to the OS can hurt performance in two ways:
   // * Parts of huge pages may be free and returning them to the OS requires
   //   breaking up the huge page they are located on.  This can slow accesses to
@@ -421,6 +567,41 @@ class MallocExtension final {
   //   back in.
   static void ReleaseMemoryToSystem(size_t num_bytes);
 
+  // Flushes the calling thread's cache and every per-CPU, sharded and
+  // transfer cache, and then releases all free memory to the OS, as
+  // malloc_trim() does.  Returns the number of bytes released.  Meant for the
+  // start of long idle phases, or before fork(): the caches have to be warmed
+  // up again afterwards, and every CPU's cache is visited, so it costs far more
+  // than ReleaseMemoryToSystem.  Memory cached by other threads' caches, in
+  // thread-cache mode, is not released.
+  static size_t ReleaseAllCachedMemory();
+
+  // A heap holds allocations that are all freed at once, by destroying the
+  // heap, such as those made while serving one request.  Allocations are
+  // carved out of whole hugepages the heap keeps to itself, and destroying it
+  // returns those hugepages to TCMalloc, without freeing each allocation.
+  //
+  // Memory from a heap must not be passed to free() or operator delete, and
+  // must not be used once the heap is destroyed.  Heap allocations are not
+  // sampled, so they do not show up in heap profiles.
+  enum class HeapHandle : uintptr_t {};
+
+  // Creates an empty heap.  Returns std::nullopt if heaps are not supported,
+  // or if we are out of memory.
+  static std::optional<HeapHandle> CreateHeap();
+
+  // Allocates `size` bytes from `heap`, aligned to `alignment`, which must be
+  // a power of two no larger than a hugepage (2 MiB on x86-64).  Safe to call
+  // from several threads at once.  Returns nullptr if we are out of memory, or
+  // if `alignment` is not supported.
+  static void* HeapAllocate(
+      HeapHandle heap, size_t size,
+      std::align_val_t alignment = std::align_val_t{alignof(std::max_align_t)});
+
+  // Frees everything allocated from `heap`, and the heap itself.  No other
+  // thread may be allocating from `heap` at the same time.
+  static void DestroyHeap(HeapHandle heap);
+
   enum class LimitKind { kSoft, kHard };
 
   // Make a best effort attempt to prevent more than limit bytes of memory
@@ -430,9 +611,70 @@ class MallocExtension final {
   //
   // If limit_kind == kHard, crash if returning memory is unable to get below
   // the limit.
+  //
+  // If TCMalloc's tcmalloc_follow_cgroup_memory_limits parameter is set,
+  // ProcessBackgroundActions keeps limits that haven't been set this way in
+  // line with the process's cgroup memory.high and memory.max.
   static size_t GetMemoryLimit(LimitKind limit_kind);
   static void SetMemoryLimit(size_t limit, LimitKind limit_kind);
 
+  // The kinds of memory that can be limited on their own: memory for ordinary
+  // allocations, for allocations hinted cold, and for sampled allocations.
+  enum class MemoryKind { kNormal, kCold, kSampled };
+
+  // Sets a soft limit, like SetMemoryLimit's kSoft limit, on the memory backing
+  // allocations of `kind` alone.  Exceeding it only releases memory of that
+  // kind, so that, for example, a cache that outgrows its cold memory does not
+  // make the serving heap give up memory it is using.  The process-wide limits
+  // still apply to all memory.  A limit of 0 removes the limit.
+  static size_t GetMemoryKindLimit(MemoryKind kind);
+  static void SetMemoryKindLimit(size_t limit, MemoryKind kind);
+
+  // Sets aside `bytes`, rounded up to whole hugepages, of memory faulted in
+  // ahead of time, which no allocation uses until ReleaseEmergencyReserve
+  // gives it back.  A program near a hard limit, or short of system memory,
+  // can then release the reserve, for example from an out-of-memory callback,
+  // so that the allocations it needs to finish or shed its work succeed
+  // without growing the heap.  Call again to refill the reserve.  Returns the
+  // bytes now reserved, which may fall short of `bytes` if memory runs out.
+  // The reserve counts towards memory limits, and is reported in the
+  // "tcmalloc.emergency_reserve_bytes" property.
+  static size_t SetEmergencyReserve(size_t bytes);
+
+  // Returns the emergency reserve to TCMalloc's free memory, and the bytes it
+  // held.
+  static size_t ReleaseEmergencyReserve();
+
+  // A pool of fixed-size buffers for I/O, such as io_uring registered buffers
+  // or DMA targets.  The buffers sit one after another from `start`, each
+  // page-aligned, in hugepage-backed memory that is faulted in when the pool
+  // is created and never returned to the OS, so that the whole region can be
+  // registered with the kernel once.
+  struct IoBufferPool {
+    void* start;
+    size_t buffer_size;
+    size_t num_buffers;
+    // Whether the region is locked into memory.  Locking is subject to
+    // RLIMIT_MEMLOCK, and registering the buffers pins them regardless.
+    bool locked;
+  };
+
+  // Creates the process's pool of I/O buffers, with at least `num_buffers`
+  // buffers of at least `buffer_size` bytes.  Buffer sizes are rounded up to
+  // whole pages, and the pool to whole hugepages.  Returns std::nullopt if a
+  // pool already exists, or if TCMalloc is not in use or out of memory.
+  static std::optional<IoBufferPool> CreateIoBufferPool(size_t buffer_size,
+                                                        size_t num_buffers);
+
+  // Returns the pool made by CreateIoBufferPool, if any.
+  static std::optional<IoBufferPool> GetIoBufferPool();
+
+  // Returns a free buffer from the pool, or nullptr if there is no pool or
+  // all of its buffers are in use.  Buffers must be returned with
+  // FreeIoBuffer, not free().
+  static void* AllocateIoBuffer();
+  static void FreeIoBuffer(void* buffer);
+
   // Gets the sampling rate.  Returns a value < 0 if unknown.
   static int64_t GetProfileSamplingRate();
   // Sets the sampling rate for heap profiles.  TCMalloc samples approximately
@@ -462,6 +704,21 @@ class MallocExtension final {
   // Sets the maximum cache size per CPU cache.  This is a per-core limit.
   static void SetMaxPerCpuCacheSize(int32_t value);
 
+  // Returns the per-CPU cache capacity profile: for each size class, the
+  // average capacity (in objects) of the populated per-CPU caches.  Index i
+  // holds the capacity of size class i.  Returns an empty vector if per-CPU
+  // caches are not active.
+  //
+  // The profile may be persisted and passed to SetPerCpuCacheCapacityProfile
+  // in a later run of the same binary, so that per-CPU caches start at their
+  // steady-state capacities instead of ramping up through cache misses.
+  static std::vector<size_t> GetPerCpuCacheCapacityProfile();
+  // Sets the capacities per-CPU caches are warmed up to when first populated,
+  // and warms up the caches that are already populated.  Capacities are
+  // bounded by the per-CPU cache size limit and continue to adapt as usual.
+  static void SetPerCpuCacheCapacityProfile(
+      absl::Span<const size_t> capacities);
+
   // Gets the current maximum thread cache.
   static int64_t GetMaxTotalThreadCacheBytes();
   // Sets the maximum thread cache size.  This is a whole-process limit.
@@ -487,6 +744,28 @@ class MallocExtension final {
   static absl::Duration GetSkipSubreleaseLongInterval();
   static void SetSkipSubreleaseLongInterval(absl::Duration value);
 
+  // Enables or disables the exact per-thread allocation counts returned by
+  // GetThreadAllocationCounts.  They are off by default.  While on, every
+  // allocation and free adds to a counter of the calling thread.
+  static bool GetPerThreadAllocationAccountingEnabled();
+  static void SetPerThreadAllocationAccountingEnabled(bool value);
+
+  // The bytes a thread allocated and freed while per-thread allocation
+  // accounting was enabled.  Both count the capacity of the allocations, as
+  // GetAllocatedSize returns it, so that freeing everything a thread
+  // allocated frees as many bytes.  A thread's frees include those of memory
+  // other threads allocated.
+  struct ThreadAllocationCounts {
+    size_t allocated_bytes = 0;
+    size_t freed_bytes = 0;
+  };
+
+  // Returns the counts of the calling thread, which only it updates, so this
+  // is about as cheap as reading a thread-local variable.  An RPC framework,
+  // for instance, can charge a request the difference of the counts taken
+  // before and after the thread served it.  Returns zeros if not supported.
+  static ThreadAllocationCounts GetThreadAllocationCounts();
+
   // Returns the estimated number of bytes that will be allocated for a request
   // of "size" bytes.  This is an estimate: an allocation of "size" bytes may
   // reserve more bytes, but will never reserve fewer.
@@ -510,6 +789,13 @@ class MallocExtension final {
   // null.
   static std::optional<size_t> GetAllocatedSize(const void* p);
 
+  // As above, for a p that malloc() or tcmalloc_realloc_sized() returned for
+  // a request of `size` bytes.  TCMalloc works out the size of most small
+  // objects from `size`, rather than looking p up, which saves a cache miss
+  // for containers that know the size they asked for.  Any size from the
+  // requested one up to GetAllocatedSize(p) will do.
+  static std::optional<size_t> GetAllocatedSize(const void* p, size_t size);
+
   // Returns
   // * kOwned if TCMalloc allocated the memory pointed to by p, or
   // * kNotOwned if allocated elsewhere or p is null.
@@ -547,8 +833,123 @@ class MallocExtension final {
   //  tcmalloc.experiment.NAME     -- Experiment NAME is running if 1
   static std::map<std::string, Property> GetProperties();
 
+  // Statistics returned by GetStatsSnapshot.  Sizes are in bytes.
+  struct StatsSnapshot {
+    // When the statistics kept under the page heap lock were last mirrored,
+    // or absl::InfinitePast() if they never were.
+    absl::Time page_heap_as_of = absl::InfinitePast();
+
+    // Kept under the page heap lock, and reported as last mirrored.
+    size_t heap_size = 0;
+    size_t page_heap_free = 0;
+    size_t page_heap_unmapped = 0;
+    size_t thread_cache_free = 0;
+    size_t metadata = 0;
+    // Of the page heap above, the part in HugePageFillers.  Zero when the page
+    // heap is not hugepage aware.
+    size_t filler_size = 0;
+    size_t filler_free = 0;
+    size_t filler_unmapped = 0;
+
+    // Read as they are, without locks.
+    size_t central_cache_free = 0;
+    size_t transfer_cache_free = 0;
+    size_t sharded_transfer_cache_free = 0;
+    size_t cpu_cache_free = 0;
+    size_t large_span_cache_free = 0;
+    // Set aside by SetEmergencyReserve, and not in use by the application.
+    size_t emergency_reserve = 0;
+    size_t cpu_cache_underflows = 0;
+    size_t cpu_cache_overflows = 0;
+
+    // generic.bytes_in_use_by_app, from the above.
+    size_t bytes_in_use_by_app = 0;
+  };
+
+  // Returns the main statistics of GetProperties without taking the page heap
+  // lock, so that they can be polled often without stalling allocations.  The
+  // statistics kept under that lock are those last mirrored, about once per
+  // background action interval if ProcessBackgroundActions runs.  With
+  // `exact`, they are mirrored first, taking the lock.
+  static StatsSnapshot GetStatsSnapshot(bool exact = false);
+
+  // Memory of one kind, returned by GetMemoryUsageByTag.  Sizes are in bytes.
+  struct MemoryTagUsage {
+    // The kind of memory, as labelled in GetStats: "NORMAL", "NORMAL_P1",
+    // etc. for each NUMA partition of normal memory, "SAMPLED", "COLD",
+    // "WARM", "SELSAN" and "METADATA".
+    std::string tag;
+    // For normal memory, its NUMA partition and the bitmap of the NUMA nodes
+    // that back it; -1 and 0 for the rest.
+    int numa_partition = -1;
+    uint64_t numa_nodes = 0;
+
+    // Address space obtained from the system.
+    size_t mapped_bytes = 0;
+    // Of the above, not released back to the system.
+    size_t committed_bytes = 0;
+    // Of the committed bytes, those free for reuse.
+    size_t free_bytes = 0;
+    // Of the mapped bytes, those released back to the system.
+    size_t released_bytes = 0;
+  };
+
+  // Returns the memory of each MemoryTag in use, taking the page heap lock
+  // once and without rendering the stats.
+  static std::vector<MemoryTagUsage> GetMemoryUsageByTag();
+
   static Profile SnapshotCurrent(tcmalloc::ProfileType type);
 
+  // HeapProfileCursor records how much of the heap SnapshotHeapDelta has
+  // reported.  A default-constructed cursor has reported nothing yet.
+  class HeapProfileCursor {
+   public:
+    // Returns whether the profile last returned by SnapshotHeapDelta for this
+    // cursor was a delta, rather than the whole live heap.
+    bool is_delta() const { return is_delta_; }
+
+   private:
+    int64_t allocated_ = 0;
+    uint64_t freed_ = 0;
+    bool is_delta_ = false;
+    friend class MallocExtension;
+  };
+
+  // Returns the heap samples allocated since the last call for `cursor`, and
+  // those it reported that were freed since, with negative counts and sums,
+  // then advances `cursor`.  Only what changed is copied, rather than the
+  // whole heap, so a continuous profiler can keep a heap profile current by
+  // adding each delta to it.  The first call for a cursor, and any call after
+  // more samples were freed than TCMalloc keeps, return the whole live heap
+  // instead, which replaces the profile; `cursor->is_delta()` tells which.
+  //
+  // Like SnapshotCurrent, this is best effort: a sample freed while the delta
+  // is taken may be reported freed without having been reported allocated.
+  static Profile SnapshotHeapDelta(HeapProfileCursor* cursor);
+
+  // Peak heap windows track the peak of the sampled heap since the application
+  // last reset them, such as over one request batch or one phase of a job,
+  // alongside the all-time peak of ProfileType::kPeakHeap.  A few windows can
+  // exist at once, each identified by a short name.  Like kPeakHeap, a window
+  // saves the heap only when it grows by a fraction (by default 10%) past the
+  // window's last peak, so a window costs nothing while the heap is below it.
+  //
+  // Starts window `name` over, creating it if needed.  Returns false if `name`
+  // is empty or too long, if too many windows exist, or if peak heap windows
+  // are not supported.
+  static bool ResetPeakHeapWindow(absl::string_view name);
+
+  // Stops tracking window `name`, freeing its slot.
+  static void RemovePeakHeapWindow(absl::string_view name);
+
+  // Returns the sampled heap size at the peak of window `name` since it was
+  // last reset, or std::nullopt if there is no such window.
+  static std::optional<size_t> GetPeakHeapWindowSize(absl::string_view name);
+
+  // Returns the sampled heap at the peak of window `name` since it was last
+  // reset, or an empty profile if there is no such window.
+  static Profile SnapshotPeakHeapWindow(absl::string_view name);
+
   // AllocationProfilingToken tracks an active profiling session started with
   // StartAllocationProfiling.  Profiling continues until Stop() is called.
   class AllocationProfilingToken {
@@ -599,6 +1000,23 @@ class MallocExtension final {
   // includes Apple and Emscripten.
   static bool NeedsProcessBackgroundActions();
 
+  // Runs the background actions of NUMA partition `partition` on the calling
+  // thread, which it binds to the partition's CPUs.  These are reclaiming the
+  // idle per-cpu caches of those CPUs and releasing memory from the
+  // partition's page heap at its share of GetBackgroundReleaseRate().  While
+  // it runs, ProcessBackgroundActions leaves this work to it, so that no
+  // thread touches the caches and pages of another node.  Run one thread per
+  // partition alongside the one running ProcessBackgroundActions.
+  //
+  // Returns right away if `partition` is not less than
+  // NumBackgroundNumaPartitions().  Otherwise, when linked against TCMalloc,
+  // this method does not return while background actions are enabled.
+  static void ProcessNumaPartitionBackgroundActions(size_t partition);
+
+  // Returns the number of NUMA partitions ProcessNumaPartitionBackgroundActions
+  // accepts, or 0 if TCMalloc is not NUMA aware.
+  static size_t NumBackgroundNumaPartitions();
+
   // Specifies a rate in bytes per second.
   //
   // The enum is used to provide strong-typing for the value.
@@ -625,6 +1043,17 @@ class MallocExtension final {
 // with better telemetry.
 extern "C" size_t nallocx(size_t size, int flags) noexcept;
 
+// Sets `rounded[i]` to nallocx(sizes[i], 0) for each i in [0, n).  `rounded`
+// may alias `sizes`.
+//
+// TCMalloc looks up the whole batch in one branch-free loop over its size
+// class tables, which is substantially cheaper than `n` calls to nallocx when
+// planning the layout of many buffers.
+//
+// The default weak implementation calls nallocx() `n` times.
+extern "C" void tcmalloc_nallocx_batch(const size_t* sizes, size_t* rounded,
+                                       size_t n) noexcept;
+
 // The sdallocx function deallocates memory allocated by malloc or memalign.  It
 // takes a size parameter to pass the original allocation size.
 //
@@ -632,6 +1061,59 @@ extern "C" size_t nallocx(size_t size, int flags) noexcept;
 // uses the size to improve deallocation performance.
 extern "C" void sdallocx(void* ptr, size_t size, int flags) noexcept;
 
+// Resizes `ptr`, which malloc() or tcmalloc_realloc_sized() returned for a
+// request of `old_size` bytes, to `new_size` bytes, as if by
+// realloc(ptr, new_size). As for sdallocx(), `old_size` may be anything from
+// the requested size up to the capacity of `ptr`.
+//
+// TCMalloc takes the size class of `ptr` from `old_size`, rather than looking
+// it up, and returns `ptr` at once when `new_size` falls in the same size
+// class. Resizing a small object to any other size class moves it, even where
+// realloc() would shrink it in place, so that `new_size` is always a valid
+// `old_size` for the next call.
+//
+// The default weak implementation calls realloc().
+extern "C" void* tcmalloc_realloc_sized(void* ptr, size_t old_size,
+                                        size_t new_size) noexcept;
+
+// Allocates up to `n` objects of `size` bytes each, as if by `n` calls to
+// malloc(size), storing the resulting pointers in `batch[0, n)`. Returns the
+// number of objects allocated; on allocation failure the return value may be
+// less than `n` and the remaining entries of `batch` are left untouched.
+//
+// TCMalloc resolves the size class and the current CPU once for the whole
+// batch and services it with a single per-CPU cache operation where possible,
+// which is substantially cheaper than `n` individual malloc calls for
+// node-based containers and object pools.
+//
+// The default weak implementation calls malloc() `n` times.
+extern "C" size_t tcmalloc_alloc_batch(size_t size, void** batch,
+                                       size_t n) noexcept;
+
+// Frees the `n` objects in `batch[0, n)`, as if by `n` calls to
+// sdallocx(batch[i], size, 0). Every object must have been allocated with the
+// same requested `size` by malloc() or tcmalloc_alloc_batch(). nullptr entries
+// are ignored.
+//
+// Like tcmalloc_alloc_batch(), the size class and hooks are looked up once for
+// the whole batch, and objects are returned to the per-CPU cache together,
+// which suits destroying containers of many equally sized objects.
+//
+// The default weak implementation calls free() `n` times.
+extern "C" void tcmalloc_free_batch(void** batch, size_t n,
+                                    size_t size) noexcept;
+
+// Frees the `n` objects in `batch[0, n)`, as if by `n` calls to
+// free(batch[i]). Unlike tcmalloc_free_batch(), the objects may be of any
+// sizes, such as the garbage found by a sweep. nullptr entries are ignored.
+//
+// TCMalloc looks up the size classes of several objects at once, so that
+// their lookups overlap, and returns the objects of each size class to the
+// per-CPU cache together.
+//
+// The default weak implementation calls free() `n` times.
+extern "C" void tcmalloc_free_unsized_batch(void** batch, size_t n) noexcept;
+
 namespace tcmalloc {
 
 // sized_ptr_t constains pointer / capacity information as returned
@@ -701,6 +1183,38 @@ tcmalloc_size_returning_operator_new_aligned_hot_cold_nothrow(
 
 }  // extern "C"
 
+// Allocates zero-initialized memory like `::operator new(size)` followed by
+// `memset(p, 0, size)`, but skips clearing memory that TCMalloc knows to be
+// fresh from the OS, and hence already zero.  This mostly benefits large
+// buffers, which are often backed by pages that were never touched.
+//
+// The nothrow variant returns nullptr on failure.  The returned pointer must
+// be freed calling the matching ::operator delete.
+//
+// The default weak implementation allocates the memory using ::operator
+// new(size_t, ...) and clears all of it.
+extern "C" {
+void* tcmalloc_zeroed_operator_new(size_t size);
+void* tcmalloc_zeroed_operator_new_nothrow(size_t size) noexcept;
+}  // extern "C"
+
+// Allocates memory like `::operator new(size)`, but asks for it to be
+// interleaved across all NUMA nodes rather than bound to the local one.  This
+// suits large tables that every socket reads about equally, which would
+// otherwise make the node holding them a hotspot.  Only allocations larger
+// than the largest size class are interleaved, as smaller objects share pages.
+// The hint is ignored on single-node systems.
+//
+// The nothrow variant returns nullptr on failure.  The returned pointer must
+// be freed calling the matching ::operator delete.
+//
+// The default weak implementation allocates the memory using ::operator
+// new(size_t, ...) and ignores the hint.
+extern "C" {
+void* tcmalloc_interleaved_operator_new(size_t size);
+void* tcmalloc_interleaved_operator_new_nothrow(size_t size) noexcept;
+}  // extern "C"
+
 #ifndef MALLOCX_LG_ALIGN
 #define MALLOCX_LG_ALIGN(la) (la)
 #endif
@@ -37,5 +37,50 @@ absl::StatusOr<AllocatedAddressRanges> GetAllocatedAddressRanges() {
       "malloc_tracing_extension routines not exported by the current malloc.");
 }
 
+absl::StatusOr<uint64_t> ForEachAllocatedAddressRange(
+    const AddressRangeScanOptions& options,
+    absl::FunctionRef<void(const AllocatedAddressRangeBatch&)> callback) {
+#if ABSL_HAVE_ATTRIBUTE_WEAK && !defined(__APPLE__) && !defined(__EMSCRIPTEN__)
+  if (&MallocTracingExtension_Internal_ForEachAllocatedAddressRange !=
+      nullptr) {
+    return MallocTracingExtension_Internal_ForEachAllocatedAddressRange(
+        options, callback);
+  }
+#endif
+  return absl::UnimplementedError(
+      "malloc_tracing_extension routines not exported by the current malloc.");
+}
+
+absl::Status StartAllocationEventTrace() {
+#if ABSL_HAVE_ATTRIBUTE_WEAK && !defined(__APPLE__) && !defined(__EMSCRIPTEN__)
+  if (&MallocTracingExtension_Internal_StartAllocationEventTrace != nullptr) {
+    return MallocTracingExtension_Internal_StartAllocationEventTrace();
+  }
+#endif
+  return absl::UnimplementedError(
+      "malloc_tracing_extension routines not exported by the current malloc.");
+}
+
+absl::Status StopAllocationEventTrace() {
+#if ABSL_HAVE_ATTRIBUTE_WEAK && !defined(__APPLE__) && !defined(__EMSCRIPTEN__)
+  if (&MallocTracingExtension_Internal_StopAllocationEventTrace != nullptr) {
+    return MallocTracingExtension_Internal_StopAllocationEventTrace();
+  }
+#endif
+  return absl::UnimplementedError(
+      "malloc_tracing_extension routines not exported by the current malloc.");
+}
+
+absl::StatusOr<size_t> DrainAllocationEvents(
+    absl::FunctionRef<void(absl::Span<const AllocationEvent>)> callback) {
+#if ABSL_HAVE_ATTRIBUTE_WEAK && !defined(__APPLE__) && !defined(__EMSCRIPTEN__)
+  if (&MallocTracingExtension_Internal_DrainAllocationEvents != nullptr) {
+    return MallocTracingExtension_Internal_DrainAllocationEvents(callback);
+  }
+#endif
+  return absl::UnimplementedError(
+      "malloc_tracing_extension routines not exported by the current malloc.");
+}
+
 }  // namespace malloc_tracing_extension
 }  // namespace tcmalloc
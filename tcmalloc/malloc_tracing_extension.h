@@ -24,7 +24,10 @@
 #include <cstdint>
 #include <vector>
 
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 
 namespace tcmalloc {
 namespace malloc_tracing_extension {
@@ -48,6 +51,93 @@ struct AllocatedAddressRanges {
 // Returns the address ranges currently allocated by TCMalloc.
 absl::StatusOr<AllocatedAddressRanges> GetAllocatedAddressRanges();
 
+// The kinds of memory TCMalloc keeps in separate parts of the address space.
+enum class AddressRangeKind {
+  kAll,
+  // Memory for most allocations, on any NUMA partition.
+  kNormal,
+  // Memory for sampled allocations.
+  kSampled,
+  // Memory for allocations hinted to be accessed rarely.
+  kCold,
+};
+
+struct AddressRangeScanOptions {
+  // Which kind of memory to report ranges of.
+  AddressRangeKind kind = AddressRangeKind::kAll;
+  // If nonzero, only report parts of the address space in which ranges may
+  // have been allocated or freed since the scan that returned this epoch.
+  uint64_t changed_since_epoch = 0;
+};
+
+// A batch of ranges reported by ForEachAllocatedAddressRange.
+struct AllocatedAddressRangeBatch {
+  // Every range allocated by TCMalloc that starts in [start_addr, end_addr)
+  // is in spans.  Ranges previously seen in [start_addr, end_addr) but missing
+  // from spans have been freed.
+  uintptr_t start_addr;
+  uintptr_t end_addr;
+  absl::Span<const AllocatedAddressRanges::SpanDetails> spans;
+};
+
+// Streams the address ranges currently allocated by TCMalloc to <callback>, a
+// batch at a time, without building the full set.  Parts of the address space
+// that aren't covered by any batch hold no ranges of options.kind or, for an
+// incremental scan, are unchanged.  Batches are not a consistent snapshot:
+// ranges may be allocated or freed while the scan runs.
+//
+// <callback> is not called with any TCMalloc lock held, so it may allocate.
+//
+// Returns an epoch to pass as changed_since_epoch to the next scan.
+absl::StatusOr<uint64_t> ForEachAllocatedAddressRange(
+    const AddressRangeScanOptions& options,
+    absl::FunctionRef<void(const AllocatedAddressRangeBatch&)> callback);
+
+enum class AllocationEventKind : uint8_t {
+  // An allocation returned address.
+  kNew,
+  // address was freed.
+  kDelete,
+  // size events were lost because the buffer of cpu was full or busy.
+  kDropped,
+};
+
+// A compact record of an allocation or free, as DrainAllocationEvents reports
+// it.
+struct AllocationEvent {
+  uintptr_t address;
+  // kNew: the bytes requested.  kDelete: the capacity of the object freed.
+  // kDropped: the number of events lost.  Saturates at UINT32_MAX.
+  uint32_t size;
+  // The CPU in whose buffer the event was recorded.
+  uint16_t cpu;
+  AllocationEventKind kind;
+};
+
+// Starts recording allocations and frees, which DrainAllocationEvents then
+// delivers.  This is the cheap alternative to allocation hooks for tracing
+// agents: events are appended to a buffer per CPU by the allocation fast
+// paths, which stay fast, and handed over in batches.  Resizes that realloc
+// does in place are not recorded, as with hooks.
+//
+// Returns FailedPreconditionError if a trace is already running.
+absl::Status StartAllocationEventTrace();
+
+// Stops recording.  Events recorded so far can still be drained.
+absl::Status StopAllocationEventTrace();
+
+// Passes the events recorded since the last call to <callback>, a batch per
+// CPU, each batch in the order its events were recorded.  Events of different
+// batches are not ordered.  Each CPU buffers a limited number of events, so a
+// consumer thread should drain them often, e.g. every few milliseconds; events
+// that find the buffer full are lost, and counted by a kDropped event.
+//
+// <callback> is not called with any TCMalloc lock held, so it may allocate,
+// but it must not call DrainAllocationEvents.  Only one thread drains at a
+// time.  Returns the number of events passed to <callback>.
+absl::StatusOr<size_t> DrainAllocationEvents(
+    absl::FunctionRef<void(absl::Span<const AllocationEvent>)> callback);
+
 }  // namespace malloc_tracing_extension
 }  // namespace tcmalloc
 
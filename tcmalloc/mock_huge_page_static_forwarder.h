@@ -57,6 +57,10 @@ class FakeStaticForwarder {
   bool release_partial_alloc_pages() { return release_partial_alloc_pages_; }
   bool hpaa_subrelease() const { return hpaa_subrelease_; }
   bool hpaa_cold_subrelease() const { return hpaa_cold_subrelease_; }
+  uint64_t gigantic_page_threshold() const { return gigantic_page_threshold_; }
+  bool lifetime_aware_filler_placement() const {
+    return lifetime_aware_filler_placement_;
+  }
 
   void set_filler_skip_subrelease_interval(absl::Duration v) {
     subrelease_interval_ = v;
@@ -72,6 +76,11 @@ class FakeStaticForwarder {
   }
   void set_hpaa_subrelease(bool v) { hpaa_subrelease_ = v; }
   void set_hpaa_cold_subrelease(bool v) { hpaa_cold_subrelease_ = v; }
+  void set_gigantic_page_threshold(uint64_t v) { gigantic_page_threshold_ = v; }
+  void set_lifetime_aware_filler_placement(bool v) {
+    lifetime_aware_filler_placement_ = v;
+  }
+  void set_gigantic_pages_available(bool v) { gigantic_pages_available_ = v; }
   bool release_succeeds() const { return release_succeeds_; }
   void set_release_succeeds(bool v) { release_succeeds_ = v; }
 
@@ -148,6 +157,48 @@ class FakeStaticForwarder {
 
     return release_succeeds_;
   }
+  bool CollapsePages(PageId begin, Length size) {
+    const uintptr_t start =
+        reinterpret_cast<uintptr_t>(begin.start_addr()) & ~kTagMask;
+    const uintptr_t end = start + size.in_bytes();
+    TC_CHECK_LE(end, fake_allocation_);
+
+    return true;
+  }
+  bool ExcludeFromCoreDump(PageId begin, Length size) {
+    const uintptr_t start =
+        reinterpret_cast<uintptr_t>(begin.start_addr()) & ~kTagMask;
+    const uintptr_t end = start + size.in_bytes();
+    TC_CHECK_LE(end, fake_allocation_);
+
+    excluded_from_core_dump_ += size;
+    return true;
+  }
+  bool IncludeInCoreDump(PageId begin, Length size) {
+    const uintptr_t start =
+        reinterpret_cast<uintptr_t>(begin.start_addr()) & ~kTagMask;
+    const uintptr_t end = start + size.in_bytes();
+    TC_CHECK_LE(end, fake_allocation_);
+
+    TC_CHECK_LE(size, excluded_from_core_dump_);
+    excluded_from_core_dump_ -= size;
+    return true;
+  }
+  // Pages ExcludeFromCoreDump has marked, less those IncludeInCoreDump has
+  // marked again.
+  Length excluded_from_core_dump() const { return excluded_from_core_dump_; }
+  bool RemapPages(PageId from, PageId to, Length size) {
+    // There are no pages behind fake allocations to move.
+    return false;
+  }
+  bool BackWithGiganticPages(PageId begin, Length size) {
+    const uintptr_t start =
+        reinterpret_cast<uintptr_t>(begin.start_addr()) & ~kTagMask;
+    const uintptr_t end = start + size.in_bytes();
+    TC_CHECK_LE(end, fake_allocation_);
+
+    return gigantic_pages_available_;
+  }
 
  private:
   static absl::base_internal::LowLevelAlloc::Arena* ll_arena() {
@@ -166,6 +217,10 @@ class FakeStaticForwarder {
   bool hpaa_cold_subrelease_ = true;
   bool release_succeeds_ = true;
   bool huge_region_demand_based_release_ = false;
+  uint64_t gigantic_page_threshold_ = 0;
+  bool lifetime_aware_filler_placement_ = false;
+  bool gigantic_pages_available_ = true;
+  Length excluded_from_core_dump_;
   Arena arena_;
 
   uintptr_t fake_allocation_ = 0x1000;
@@ -19,6 +19,8 @@
 #include <cstdint>
 #include <map>
 #include <new>
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "absl/synchronization/mutex.h"
@@ -32,6 +34,11 @@ namespace tcmalloc_internal {
 class FakeStaticForwarder {
  public:
   FakeStaticForwarder() : class_size_(0), pages_() {}
+  ~FakeStaticForwarder() {
+    for (auto [buffer, alignment] : sub_list_buffers_) {
+      ::operator delete(buffer, alignment);
+    }
+  }
   void Init(size_t class_size, size_t pages, size_t num_objects_to_move,
             bool use_large_spans) {
     class_size_ = class_size;
@@ -46,6 +53,35 @@ class FakeStaticForwarder {
     return use_large_spans_ ? Span::kLargeCacheSize : Span::kCacheSize;
   }
 
+  size_t num_sub_lists(int size_class) const { return num_sub_lists_; }
+  void set_num_sub_lists(size_t num_sub_lists) {
+    num_sub_lists_ = num_sub_lists;
+  }
+  size_t max_deferred_spans(int size_class) const {
+    return max_deferred_spans_;
+  }
+  void set_max_deferred_spans(size_t max_deferred_spans) {
+    max_deferred_spans_ = max_deferred_spans;
+  }
+
+  bool adaptive_span_sizes(int size_class) const {
+    return adaptive_span_sizes_;
+  }
+  void set_adaptive_span_sizes(bool adaptive_span_sizes) {
+    adaptive_span_sizes_ = adaptive_span_sizes;
+  }
+
+  LifetimePrediction PredictLifetime(int size_class) const {
+    return lifetime_;
+  }
+  void set_lifetime(LifetimePrediction lifetime) { lifetime_ = lifetime; }
+
+  void* AllocSubLists(size_t size, std::align_val_t alignment) {
+    void* buffer = ::operator new(size, alignment);
+    sub_list_buffers_.emplace_back(buffer, alignment);
+    return buffer;
+  }
+
   void MapObjectsToSpans(absl::Span<void*> batch, Span** spans) {
     for (size_t i = 0; i < batch.size(); ++i) {
       spans[i] = MapObjectToSpan(batch[i]);
@@ -121,6 +157,11 @@ class FakeStaticForwarder {
   Length pages_;
   size_t num_objects_to_move_;
   bool use_large_spans_;
+  size_t num_sub_lists_ = 0;
+  size_t max_deferred_spans_ = 0;
+  bool adaptive_span_sizes_ = false;
+  LifetimePrediction lifetime_ = LifetimePrediction::kUnknown;
+  std::vector<std::pair<void*, std::align_val_t>> sub_list_buffers_;
 };
 
 class RawMockStaticForwarder : public FakeStaticForwarder {
@@ -24,5 +24,8 @@ ABSL_CONST_INIT bool FakeShardedTransferCacheManager::enable_generic_cache_(
 ABSL_CONST_INIT bool
     FakeShardedTransferCacheManager::enable_cache_for_large_classes_only_(
         false);
+ABSL_CONST_INIT bool FakeShardedTransferCacheManager::use_origin_affinity_(
+    false);
+ABSL_CONST_INIT bool FakeShardedTransferCacheManager::use_cold_tier_(false);
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -38,6 +38,9 @@ namespace tcmalloc_internal {
 inline constexpr size_t kClassSize = 8;
 inline constexpr size_t kNumToMove = 32;
 inline constexpr int kSizeClass = 1;
+// An expanded size class, which FakeShardedTransferCacheManager sizes as a cold
+// one while its cold tier is on.
+inline constexpr int kColdSizeClass = kExpandedClassesStart + kSizeClass;
 
 // TransferCacheManager with basic stubs for everything.
 //
@@ -125,10 +128,27 @@ class FakeShardedTransferCacheManager
   static void SetCacheForLargeClassesOnly(bool value) {
     enable_cache_for_large_classes_only_ = value;
   }
+  static bool UseOriginAffinity() { return use_origin_affinity_; }
+  static void SetOriginAffinity(bool value) { use_origin_affinity_ = value; }
+  static bool UseColdTier() { return use_cold_tier_; }
+  static void SetColdTier(bool value) { use_cold_tier_ = value; }
+
+  constexpr static size_t class_to_size(int size_class) {
+    if (size_class == kColdSizeClass && use_cold_tier_) {
+      return SizeMap::kMinAllocSizeForCold;
+    }
+    return ArenaBasedFakeTransferCacheManager::class_to_size(size_class);
+  }
+  constexpr static size_t num_objects_to_move(int size_class) {
+    if (size_class == kColdSizeClass && use_cold_tier_) return kNumToMove;
+    return ArenaBasedFakeTransferCacheManager::num_objects_to_move(size_class);
+  }
 
  private:
   static bool enable_generic_cache_;
   static bool enable_cache_for_large_classes_only_;
+  static bool use_origin_affinity_;
+  static bool use_cold_tier_;
 };
 
 // Wires up a largely functional TransferCache + TransferCacheManager +
@@ -325,6 +345,15 @@ class FakeMultiClassTransferCacheManager : public TransferCacheManager {
   }
 };
 
+// Defines transfer cache manager for testing lock-free transfer cache.
+class FakeMultiClassLockFreeTransferCacheManager : public TransferCacheManager {
+ public:
+  void Init() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    implementation_ = TransferCacheImplementation::LockFreeRing;
+    InitCaches();
+  }
+};
+
 // Wires up a largely functional TransferCache + TransferCacheManager +
 // CentralFreeList.
 //
@@ -14,6 +14,8 @@
 
 #include "tcmalloc/page_allocator.h"
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <limits>
 
@@ -21,17 +23,22 @@
 #include "absl/base/call_once.h"
 #include "absl/base/macros.h"
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_aware_allocator.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/numa.h"
+#include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/page_heap.h"
+#include "tcmalloc/page_heap_trace.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/selsan/selsan.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
+#include "tcmalloc/system-alloc.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -98,13 +105,12 @@ bool want_hpaa() {
 PageAllocator::PageAllocator() {
   const bool kUseHPAA = want_hpaa();
   has_cold_impl_ = ColdFeatureActive();
+  has_warm_impl_ = WarmTierNumaNode() >= 0;
   size_t part = 0;
   if (kUseHPAA) {
-    normal_impl_[0] = new (&choices_[part++].hpaa) HugePageAwareAllocator(
-        HugePageAwareAllocatorOptions{MemoryTag::kNormal});
-    if (tc_globals.numa_topology().numa_aware()) {
-      normal_impl_[1] = new (&choices_[part++].hpaa) HugePageAwareAllocator(
-          HugePageAwareAllocatorOptions{MemoryTag::kNormalP1});
+    for (size_t p = 0; p < active_numa_partitions(); ++p) {
+      normal_impl_[p] = new (&choices_[part++].hpaa) HugePageAwareAllocator(
+          HugePageAwareAllocatorOptions{NumaNormalTag(p)});
     }
     sampled_impl_ = new (&choices_[part++].hpaa) HugePageAwareAllocator(
         HugePageAwareAllocatorOptions{MemoryTag::kSampled});
@@ -118,13 +124,15 @@ PageAllocator::PageAllocator() {
     } else {
       cold_impl_ = normal_impl_[0];
     }
+    if (has_warm_impl_) {
+      warm_impl_ = new (&choices_[part++].hpaa) HugePageAwareAllocator(
+          HugePageAwareAllocatorOptions{MemoryTag::kWarm});
+    }
     alg_ = HPAA;
   } else {
 #if defined(TCMALLOC_INTERNAL_SMALL_BUT_SLOW)
-    normal_impl_[0] = new (&choices_[part++].ph) PageHeap(MemoryTag::kNormal);
-    if (tc_globals.numa_topology().numa_aware()) {
-      normal_impl_[1] =
-          new (&choices_[part++].ph) PageHeap(MemoryTag::kNormalP1);
+    for (size_t p = 0; p < active_numa_partitions(); ++p) {
+      normal_impl_[p] = new (&choices_[part++].ph) PageHeap(NumaNormalTag(p));
     }
     sampled_impl_ = new (&choices_[part++].ph) PageHeap(MemoryTag::kSampled);
     if (selsan::IsEnabled()) {
@@ -135,6 +143,9 @@ PageAllocator::PageAllocator() {
     } else {
       cold_impl_ = normal_impl_[0];
     }
+    if (has_warm_impl_) {
+      warm_impl_ = new (&choices_[part++].ph) PageHeap(MemoryTag::kWarm);
+    }
     alg_ = PAGE_HEAP;
 #else
     static_assert(huge_page_allocator_internal::kUnconditionalHPAA);
@@ -166,6 +177,14 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
   // occur if we allocate space for many objects preemptively and only later
   // sample them (incrementing sampled_objects_size_).
 
+  if (ABSL_PREDICT_FALSE(has_heap_limits_)) {
+    for (int kind = 0; kind < kNumHeapKinds; ++kind) {
+      if (heap_limits_[kind] != std::numeric_limits<size_t>::max()) {
+        ShrinkHeapsToLimit(static_cast<HeapKind>(kind));
+      }
+    }
+  }
+
   if (limits_[kSoft] == std::numeric_limits<size_t>::max()) {
     // Limits are not set.
     return;
@@ -222,52 +241,171 @@ void PageAllocator::ShrinkToUsageLimit(Length n) {
          limits_[kSoft]);
 }
 
-bool PageAllocator::ShrinkHardBy(Length pages, LimitKind limit_kind) {
-  const PageReleaseReason release_reason =
-      limit_kind == kHard ? PageReleaseReason::kHardLimitExceeded
-                          : PageReleaseReason::kSoftLimitExceeded;
-  Length ret = ReleaseAtLeastNPages(pages, release_reason);
-  if (alg_ == HPAA) {
-    if (pages <= ret) {
-      // We released target amount.
-      return true;
+void PageAllocator::ShrinkHeapsToLimit(HeapKind kind) {
+  std::array<Interface*, kNumaPartitions> impls;
+  size_t num_impls = 0;
+  switch (kind) {
+    case kNormalHeaps: {
+      std::array<size_t, kNumaPartitions> order;
+      const size_t partitions = NumaReleaseOrder(order);
+      for (size_t i = 0; i < partitions; i++) {
+        impls[num_impls++] = normal_impl_[order[i]];
+      }
+      break;
     }
+    case kColdHeap:
+      if (has_cold_impl_) {
+        impls[num_impls++] = cold_impl_;
+      }
+      break;
+    case kSampledHeap:
+      impls[num_impls++] = sampled_impl_;
+      break;
+    default:
+      ASSUME(false);
+      __builtin_unreachable();
+  }
+
+  size_t backed = 0;
+  for (size_t i = 0; i < num_impls; i++) {
+    const BackingStats s = impls[i]->stats();
+    backed += s.system_bytes - s.unmapped_bytes;
+  }
+  if (backed <= heap_limits_[kind]) {
+    return;
+  }
+  ++heap_limit_hits_[kind];
 
-    // At this point, we have no choice but to break up hugepages.
-    // However, if the client has turned off subrelease, and is using hard
-    // limits, then respect desire to do no subrelease ever.
-    if (limit_kind == kHard && !Parameters::hpaa_subrelease()) return false;
-
-    static bool warned_hugepages = false;
-    if (!warned_hugepages) {
-      const size_t limit = limits_[limit_kind];
-      TC_LOG(
-          "Couldn't respect usage limit of %v without breaking hugepages - "
-          "performance will drop",
-          limit);
-      warned_hugepages = true;
+  // Only the heaps over their limit give up memory, so that a runaway kind of
+  // memory does not make the others release memory they are using.
+  const PageReleaseReason reason = PageReleaseReason::kSoftLimitExceeded;
+  const Length pages =
+      LengthFromBytes(backed - heap_limits_[kind] + kPageSize - 1);
+  if (alg_ != HPAA) {
+    Length released;
+    for (size_t i = 0; i < num_impls && released < pages; i++) {
+      released += impls[i]->ReleaseAtLeastNPages(pages - released, reason);
     }
-    if (has_cold_impl_) {
-      ret += static_cast<HugePageAwareAllocator*>(cold_impl_)
-                 ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
-                                                         release_reason);
-      if (ret >= pages) {
-        return true;
-      }
+    if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+      tracer_.RecordRelease(PageHeapTraceRecord::kRelease, pages, released,
+                            reason);
     }
-    for (int partition = 0; partition < active_numa_partitions(); partition++) {
-      ret += static_cast<HugePageAwareAllocator*>(normal_impl_[partition])
-                 ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
-                                                         release_reason);
-      if (ret >= pages) {
-        return true;
-      }
+    return;
+  }
+
+  const absl::Span<Interface* const> heaps(impls.data(), num_impls);
+  Length released;
+  if (kind == kColdHeap) {
+    released = ReleaseInStage(kShrinkCold, heaps, pages, reason);
+  } else {
+    released = ReleaseInStage(kShrinkHugeCache, heaps, pages, reason);
+    if (released < pages) {
+      released +=
+          ReleaseInStage(kShrinkFiller, heaps, pages - released, reason);
     }
+  }
+  if (released < pages) {
+    ReleaseInStage(kShrinkBreakingHugepages, heaps, pages - released, reason);
+  }
+}
 
-    ret += static_cast<HugePageAwareAllocator*>(sampled_impl_)
-               ->ReleaseAtLeastNPagesBreakingHugepages(pages - ret,
-                                                       release_reason);
+Length PageAllocator::ReleaseInStage(ShrinkStage stage,
+                                     absl::Span<Interface* const> impls,
+                                     Length pages, PageReleaseReason reason) {
+  Length released;
+  for (size_t i = 0; i < impls.size() && released < pages; i++) {
+    Interface* impl = impls[i];
+    const Length n = pages - released;
+    switch (stage) {
+      case kShrinkCold:
+      case kShrinkFiller:
+        released += impl->ReleaseAtLeastNPages(n, reason);
+        break;
+      case kShrinkHugeCache:
+        released += static_cast<HugePageAwareAllocator*>(impl)
+                        ->ReleaseFreeHugepages(n, reason);
+        break;
+      case kShrinkBreakingHugepages:
+        released += static_cast<HugePageAwareAllocator*>(impl)
+                        ->ReleaseAtLeastNPagesBreakingHugepages(n, reason);
+        break;
+      default:
+        ASSUME(false);
+        __builtin_unreachable();
+    }
   }
+  shrink_released_[stage] += released;
+  if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+    tracer_.RecordRelease(stage == kShrinkBreakingHugepages
+                              ? PageHeapTraceRecord::kReleaseBreakingHugepages
+                              : PageHeapTraceRecord::kRelease,
+                          pages, released, reason);
+  }
+  return released;
+}
+
+bool PageAllocator::ShrinkHardBy(Length pages, LimitKind limit_kind) {
+  const PageReleaseReason release_reason =
+      limit_kind == kHard ? PageReleaseReason::kHardLimitExceeded
+                          : PageReleaseReason::kSoftLimitExceeded;
+  if (alg_ != HPAA) {
+    // Return "true", if we got back under the limit.
+    return pages <= ReleaseAtLeastNPages(pages, release_reason);
+  }
+
+  // Release what costs the least first: cold and warm memory, where losing
+  // hugepages matters least, then whole free hugepages of the other heaps,
+  // then the free pages of their filler.  The background thread has already
+  // started draining idle caches when it saw the limit hit.
+  std::array<Interface*, kNumaPartitions + 3> impls;
+  size_t num_cold = 0;
+  if (has_cold_impl_) {
+    impls[num_cold++] = cold_impl_;
+  }
+  if (has_warm_impl_) {
+    impls[num_cold++] = warm_impl_;
+  }
+  size_t num_impls = num_cold;
+  std::array<size_t, kNumaPartitions> order;
+  const size_t partitions = NumaReleaseOrder(order);
+  for (size_t i = 0; i < partitions; i++) {
+    impls[num_impls++] = normal_impl_[order[i]];
+  }
+  impls[num_impls++] = sampled_impl_;
+  const absl::Span<Interface* const> all(impls.data(), num_impls);
+  const absl::Span<Interface* const> hot = all.subspan(num_cold);
+
+  Length ret =
+      ReleaseInStage(kShrinkCold, all.first(num_cold), pages, release_reason);
+  if (ret < pages) {
+    ret += ReleaseInStage(kShrinkHugeCache, hot, pages - ret, release_reason);
+  }
+  if (ret < pages) {
+    ret += ReleaseInStage(kShrinkFiller, hot, pages - ret, release_reason);
+  }
+  if (pages <= ret) {
+    // We released target amount.
+    return true;
+  }
+
+  // At this point, we have no choice but to break up hugepages.
+  // However, if the client has turned off subrelease, and is using hard
+  // limits, then respect desire to do no subrelease ever.
+  if (limit_kind == kHard && !Parameters::hpaa_subrelease()) return false;
+
+  static bool warned_hugepages = false;
+  if (!warned_hugepages) {
+    const size_t limit = limits_[limit_kind];
+    TC_LOG(
+        "Couldn't respect usage limit of %v without breaking hugepages - "
+        "performance will drop",
+        limit);
+    warned_hugepages = true;
+  }
+  // Break up hugepages in cold and warm memory first, then in the
+  // partitions whose nodes are shortest on memory.
+  ret += ReleaseInStage(kShrinkBreakingHugepages, all, pages - ret,
+                        release_reason);
   // Return "true", if we got back under the limit.
   return (pages <= ret);
 }
@@ -276,6 +414,48 @@ size_t PageAllocator::active_numa_partitions() const {
   return tc_globals.numa_topology().active_partitions();
 }
 
+size_t PageAllocator::NumaReleaseOrder(
+    std::array<size_t, kNumaPartitions>& order) const {
+  const size_t partitions = active_numa_partitions();
+  // Insertion sort: there are only a handful of partitions, and it keeps ties
+  // in index order.
+  for (size_t i = 0; i < partitions; i++) {
+    size_t j = i;
+    for (; j > 0 && partition_free_fraction_[order[j - 1]] >
+                        partition_free_fraction_[i];
+         j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+  return partitions;
+}
+
+void PageAllocator::UpdateNumaMemoryPressure() {
+  const size_t partitions = active_numa_partitions();
+  if (partitions < 2) {
+    return;
+  }
+
+  double free_fraction[kNumaPartitions] = {};
+  for (size_t partition = 0; partition < partitions; partition++) {
+    NumaMemInfo info;
+    if (!ReadNumaMemInfo(
+            tc_globals.numa_topology().GetPartitionNodes(partition), &info,
+            OpenSysfsMeminfo) ||
+        info.total_bytes == 0) {
+      // Keep the previous sample rather than comparing partial data.
+      return;
+    }
+    free_fraction[partition] =
+        static_cast<double>(info.free_bytes) / info.total_bytes;
+  }
+
+  PageHeapSpinLockHolder l;
+  std::copy(free_fraction, free_fraction + partitions,
+            partition_free_fraction_);
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -18,14 +18,17 @@
 #include <stddef.h>
 
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <utility>
 
 #include "absl/base/attributes.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_aware_allocator.h"
 #include "tcmalloc/internal/allocation_guard.h"
@@ -34,6 +37,7 @@
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/page_allocator_interface.h"
 #include "tcmalloc/page_heap.h"
+#include "tcmalloc/page_heap_trace.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/span.h"
@@ -67,8 +71,36 @@ class PageAllocator {
   void Delete(Span* span, size_t objects_per_span, MemoryTag tag)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Resizes span to n pages without moving it if possible.  Returns false if
+  // the allocation has to move instead.
+  // REQUIRES: span was returned by earlier call to New() or NewAligned() with
+  //           the same value of "tag" for a page-level allocation, and has not
+  //           yet been deleted.
+  bool ResizeInPlace(Span* span, Length n, MemoryTag tag)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Moves the pages of span, without copying them, to the start of a new
+  // span of n pages, and deletes span.  Returns the new span, or nullptr if
+  // the allocation has to be copied instead.
+  // REQUIRES: as for ResizeInPlace, and n >= span->num_pages().
+  Span* Remap(Span* span, Length n, SpanAllocInfo span_alloc_info,
+              MemoryTag tag) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   BackingStats stats() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Returns the stats of the HugePageFillers of all tags, or zeroes if the
+  // page heap is not hugepage aware.
+  BackingStats FillerStats() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Returns how many of the bytes in use in the HugePageFillers of all tags
+  // are on intact hugepages, or 0 if the page heap is not hugepage aware.
+  uint64_t FillerIntactHugepageBytes() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Calls f(tag, stats) with the stats of the page heap of each tag in use.
+  void ForEachTagStats(absl::FunctionRef<void(MemoryTag, BackingStats)> f) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   void GetSmallSpanStats(SmallSpanStats* result)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
@@ -84,11 +116,65 @@ class PageAllocator {
   Length ReleaseAtLeastNPages(Length num_pages, PageReleaseReason reason)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Like ReleaseAtLeastNPages, but only releases from the heap of NUMA
+  // `partition`.
+  Length ReleasePartitionAtLeastNPages(size_t partition, Length num_pages,
+                                       PageReleaseReason reason)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Records whether NUMA `partition` has a background worker of its own,
+  // which releases from the partition's heap.  Background releases by
+  // ReleaseAtLeastNPages skip the heaps of such partitions.
+  void SetPartitionWorker(size_t partition, bool running) {
+    TC_ASSERT_LT(partition, kNumaPartitions);
+    const uint64_t bit = uint64_t{1} << partition;
+    if (running) {
+      partition_workers_.fetch_or(bit, std::memory_order_relaxed);
+    } else {
+      partition_workers_.fetch_and(~bit, std::memory_order_relaxed);
+    }
+  }
+
+  bool HasPartitionWorker(size_t partition) const {
+    return partition < kNumaPartitions &&
+           ((partition_workers_.load(std::memory_order_relaxed) >> partition) &
+            1);
+  }
+
+  // Samples the free memory of the NUMA nodes backing each partition, so that
+  // releasing memory starts with the partition whose nodes are shortest on
+  // memory.  Reads sysfs, so it should only be called from the background
+  // thread.
+  void UpdateNumaMemoryPressure() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Asks the system to restore hugepage backing for up to max hugepages that
+  // were broken up by subrelease but are fully backed again, across all child
+  // PageAllocatorInterface implementations.  Returns the number of hugepages
+  // collapsed.
+  HugeLength CollapseHugePages(HugeLength max)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Checks, through backing, how the system backs up to max hugepages across
+  // all child PageAllocatorInterface implementations, updating their view of
+  // hugepage coverage to match.  Returns the number of hugepages audited.
+  HugeLength AuditHugePages(HugeLength max, HugePageBackingFunction& backing)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  // Moves, through tiering, up to max idle hugepages across the normal, cold
+  // and sampled PageAllocatorInterface implementations to the far tier, and
+  // back those that are used again.  Returns the number of hugepages moved.
+  HugeLength TierHugePages(HugeLength max, HugePageTieringFunction& tiering)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Returns the number of pages that have been released, combined across all
   // child PageAllocatorInterface implementations.
   PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Returns the number of released pages that were faulted back in, combined
+  // across all child PageAllocatorInterface implementations.
+  Length GetRefaultedPages() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   // Prints stats about the page heap to *out.
   void Print(Printer* out, MemoryTag tag) ABSL_LOCKS_EXCLUDED(pageheap_lock);
   void PrintInPbtxt(PbtxtRegion* region, MemoryTag tag)
@@ -109,11 +195,72 @@ class PageAllocator {
   int64_t successful_shrinks_after_limit_hit(LimitKind limit_kind) const
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
+  // Soft limits on the backed memory of the page heaps of one kind, as set by
+  // MallocExtension::SetMemoryKindLimit.  These are checked along with the
+  // process-wide limits, but only count, and only release, the memory of the
+  // heaps of their kind.
+  enum HeapKind { kNormalHeaps, kColdHeap, kSampledHeap, kNumHeapKinds };
+  void set_heap_limit(size_t limit, HeapKind kind)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+  size_t heap_limit(HeapKind kind) const ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    TC_ASSERT_LT(kind, kNumHeapKinds);
+    PageHeapSpinLockHolder l;
+    return heap_limits_[kind];
+  }
+
+  int64_t heap_limit_hits(HeapKind kind) const
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    TC_ASSERT_LT(kind, kNumHeapKinds);
+    PageHeapSpinLockHolder l;
+    return heap_limit_hits_[kind];
+  }
+
   // If we have a usage limit set, ensure we're not violating it from our latest
   // allocation.
   void ShrinkToUsageLimit(Length n)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // The stages of getting back under a memory limit, in the order they run.
+  // The background thread drains idle caches once it sees a limit hit; the
+  // others release from the page heaps, and only the last breaks up hugepages
+  // that still hold allocations.
+  enum ShrinkStage {
+    kShrinkCaches,
+    kShrinkCold,
+    kShrinkHugeCache,
+    kShrinkFiller,
+    kShrinkBreakingHugepages,
+    kNumShrinkStages,
+  };
+
+  // Returns the bytes recovered by `stage` so far.  For kShrinkCaches, these
+  // are the bytes of the objects drained from the caches, and for the others
+  // those of the pages released.
+  size_t shrink_released_bytes(ShrinkStage stage) const
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    TC_ASSERT_LT(stage, kNumShrinkStages);
+    PageHeapSpinLockHolder l;
+    return stage == kShrinkCaches ? shrink_drained_bytes_
+                                  : shrink_released_[stage].in_bytes();
+  }
+
+  // Records that the background thread drained `bytes` from the caches
+  // because a limit was hit.
+  void RecordShrinkDrained(size_t bytes) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    PageHeapSpinLockHolder l;
+    shrink_drained_bytes_ += bytes;
+  }
+
+  // Returns the number of times any limit, process-wide or per kind, was hit.
+  int64_t total_limit_hits() const ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    PageHeapSpinLockHolder l;
+    int64_t hits = limit_hits_[kSoft];
+    for (int64_t heap_hits : heap_limit_hits_) {
+      hits += heap_hits;
+    }
+    return hits;
+  }
+
   const PageAllocInfo& info(MemoryTag tag) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
@@ -124,6 +271,10 @@ class PageAllocator {
 
   Algorithm algorithm() const { return alg_; }
 
+  // Whether there is a warm tier to allocate MemoryTag::kWarm memory from.
+  // See WarmTierNumaNode.
+  bool has_warm_tier() const { return has_warm_impl_; }
+
   struct PeakStats {
     size_t backed_bytes;
     size_t sampled_application_bytes;
@@ -133,20 +284,40 @@ class PageAllocator {
     return PeakStats{peak_backed_bytes_, peak_sampled_application_bytes_};
   }
 
+  // Records the operations above for offline replay, when enabled.
+  PageHeapTracer& tracer() { return tracer_; }
+
  private:
   bool ShrinkHardBy(Length page, LimitKind limit_kind)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Releases memory from the page heaps of `kind` until their backed memory is
+  // within heap_limits_[kind], if it can.
+  void ShrinkHeapsToLimit(HeapKind kind)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   using Interface =
       std::conditional<huge_page_allocator_internal::kUnconditionalHPAA,
                        HugePageAwareAllocator, PageAllocatorInterface>::type;
 
   ABSL_ATTRIBUTE_RETURNS_NONNULL Interface* impl(MemoryTag tag) const;
 
+  // Releases up to `pages` from `impls`, in order, as `stage` does.  Returns
+  // the number of pages released.
+  Length ReleaseInStage(ShrinkStage stage, absl::Span<Interface* const> impls,
+                        Length pages, PageReleaseReason reason)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   size_t active_numa_partitions() const;
 
-  static constexpr size_t kNumHeaps =
-      kNumaPartitions + 2 + (kSelSanPresent ? 1 : 0);
+  // Fills order with the active NUMA partitions, those whose nodes have the
+  // least free memory first.  Returns the number of active partitions.
+  size_t NumaReleaseOrder(std::array<size_t, kNumaPartitions>& order) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
+  static constexpr size_t kNumHeaps = kNumaPartitions + 2 +
+                                      (kSelSanPresent ? 1 : 0) +
+                                      (kWarmTierPresent ? 1 : 0);
 
   union Choices {
     Choices() : dummy(0) {}
@@ -159,8 +330,20 @@ class PageAllocator {
   Interface* sampled_impl_;
   Interface* selsan_impl_ = nullptr;
   Interface* cold_impl_;
+  Interface* warm_impl_ = nullptr;
   Algorithm alg_;
   bool has_cold_impl_;
+  bool has_warm_impl_;
+
+  // Fraction of the memory of each partition's NUMA nodes that was free when
+  // last sampled by UpdateNumaMemoryPressure.  All zero until then, which
+  // releases from partitions in index order.
+  double partition_free_fraction_[kNumaPartitions] ABSL_GUARDED_BY(
+      pageheap_lock) = {};
+
+  // Bitmap of the NUMA partitions with a background worker of their own.
+  static_assert(kNumaPartitions <= 64);
+  std::atomic<uint64_t> partition_workers_{0};
 
   // Max size of backed spans we will attempt to maintain.
   // Crash if we can't maintain below limits_[kHard], which is guaranteed to be
@@ -174,6 +357,19 @@ class PageAllocator {
   // or at the limit.
   int64_t successful_shrinks_after_limit_hit_[kNumLimits]{0};
 
+  // Limits on the backed bytes of each kind of page heap, and the number of
+  // times each was exceeded.
+  size_t heap_limits_[kNumHeapKinds] = {std::numeric_limits<size_t>::max(),
+                                        std::numeric_limits<size_t>::max(),
+                                        std::numeric_limits<size_t>::max()};
+  int64_t heap_limit_hits_[kNumHeapKinds]{0};
+  // Whether any of heap_limits_ is set.
+  bool has_heap_limits_ = false;
+
+  // What each stage of getting back under a limit recovered.
+  Length shrink_released_[kNumShrinkStages];
+  size_t shrink_drained_bytes_ = 0;
+
   // peak_backed_bytes_ tracks the maximum number of pages backed (with physical
   // memory) in the page heap and metadata.
   //
@@ -184,6 +380,8 @@ class PageAllocator {
   // requires minimal work to compute.
   size_t peak_backed_bytes_{0};
   size_t peak_sampled_application_bytes_{0};
+
+  PageHeapTracer tracer_;
 };
 
 inline PageAllocator::Interface* PageAllocator::impl(MemoryTag tag) const {
@@ -193,15 +391,20 @@ inline PageAllocator::Interface* PageAllocator::impl(MemoryTag tag) const {
 
   switch (tag) {
     case MemoryTag::kNormalP0:
-      return normal_impl_[0];
     case MemoryTag::kNormalP1:
-      return normal_impl_[1];
+    case MemoryTag::kNormalP2:
+    case MemoryTag::kNormalP3:
+      TC_ASSERT_LT(NumaPartitionFromTag(tag), kNumaPartitions);
+      return normal_impl_[NumaPartitionFromTag(tag)];
     case MemoryTag::kSampled:
       return sampled_impl_;
     case MemoryTag::kSelSan:
       return selsan_impl_;
     case MemoryTag::kCold:
       return cold_impl_;
+    case MemoryTag::kWarm:
+      TC_ASSERT(has_warm_impl_);
+      return warm_impl_;
     default:
       ASSUME(false);
       __builtin_unreachable();
@@ -210,20 +413,51 @@ inline PageAllocator::Interface* PageAllocator::impl(MemoryTag tag) const {
 
 inline Span* PageAllocator::New(Length n, SpanAllocInfo span_alloc_info,
                                 MemoryTag tag) {
-  return impl(tag)->New(n, span_alloc_info);
+  Span* span = impl(tag)->New(n, span_alloc_info);
+  if (ABSL_PREDICT_FALSE(tracer_.enabled()) && span != nullptr) {
+    PageHeapSpinLockHolder l;
+    tracer_.RecordNew(span, Length(1), span_alloc_info, tag);
+  }
+  return span;
 }
 
 inline Span* PageAllocator::NewAligned(Length n, Length align,
                                        SpanAllocInfo span_alloc_info,
                                        MemoryTag tag) {
-  return impl(tag)->NewAligned(n, align, span_alloc_info);
+  Span* span = impl(tag)->NewAligned(n, align, span_alloc_info);
+  if (ABSL_PREDICT_FALSE(tracer_.enabled()) && span != nullptr) {
+    PageHeapSpinLockHolder l;
+    tracer_.RecordNew(span, align, span_alloc_info, tag);
+  }
+  return span;
 }
 
 inline void PageAllocator::Delete(Span* span, size_t objects_per_span,
                                   MemoryTag tag) {
+  if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+    tracer_.RecordDelete(span, objects_per_span, tag);
+  }
   impl(tag)->Delete(span, objects_per_span);
 }
 
+inline bool PageAllocator::ResizeInPlace(Span* span, Length n,
+                                         MemoryTag tag) {
+  // Traces have no notion of resizing, so keep replays faithful.
+  if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+    return false;
+  }
+  return impl(tag)->ResizeInPlace(span, n);
+}
+
+inline Span* PageAllocator::Remap(Span* span, Length n,
+                                  SpanAllocInfo span_alloc_info,
+                                  MemoryTag tag) {
+  if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+    return nullptr;
+  }
+  return impl(tag)->Remap(span, n, span_alloc_info);
+}
+
 inline BackingStats PageAllocator::stats() const {
   BackingStats ret = normal_impl_[0]->stats();
   for (int partition = 1; partition < active_numa_partitions(); partition++) {
@@ -236,9 +470,81 @@ inline BackingStats PageAllocator::stats() const {
   if (has_cold_impl_) {
     ret += cold_impl_->stats();
   }
+  if (has_warm_impl_) {
+    ret += warm_impl_->stats();
+  }
   return ret;
 }
 
+inline BackingStats PageAllocator::FillerStats() const {
+  BackingStats ret;
+  if (alg_ != HPAA) {
+    return ret;
+  }
+  auto add = [&](Interface* impl) {
+    ret += static_cast<HugePageAwareAllocator*>(impl)->FillerStats();
+  };
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    add(normal_impl_[partition]);
+  }
+  add(sampled_impl_);
+  if (selsan_impl_) {
+    add(selsan_impl_);
+  }
+  if (has_cold_impl_) {
+    add(cold_impl_);
+  }
+  if (has_warm_impl_) {
+    add(warm_impl_);
+  }
+  return ret;
+}
+
+inline uint64_t PageAllocator::FillerIntactHugepageBytes() const {
+  uint64_t ret = 0;
+  if (alg_ != HPAA) {
+    return ret;
+  }
+  auto add = [&](Interface* impl) {
+    const auto* hpaa = static_cast<HugePageAwareAllocator*>(impl);
+    const BackingStats stats = hpaa->FillerStats();
+    const uint64_t used =
+        stats.system_bytes - stats.free_bytes - stats.unmapped_bytes;
+    ret += static_cast<uint64_t>(used * hpaa->FillerHugepageFrac());
+  };
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    add(normal_impl_[partition]);
+  }
+  add(sampled_impl_);
+  if (selsan_impl_) {
+    add(selsan_impl_);
+  }
+  if (has_cold_impl_) {
+    add(cold_impl_);
+  }
+  if (has_warm_impl_) {
+    add(warm_impl_);
+  }
+  return ret;
+}
+
+inline void PageAllocator::ForEachTagStats(
+    absl::FunctionRef<void(MemoryTag, BackingStats)> f) const {
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    f(NumaNormalTag(partition), normal_impl_[partition]->stats());
+  }
+  f(MemoryTag::kSampled, sampled_impl_->stats());
+  if (selsan_impl_) {
+    f(MemoryTag::kSelSan, selsan_impl_->stats());
+  }
+  if (has_cold_impl_) {
+    f(MemoryTag::kCold, cold_impl_->stats());
+  }
+  if (has_warm_impl_) {
+    f(MemoryTag::kWarm, warm_impl_->stats());
+  }
+}
+
 inline void PageAllocator::GetSmallSpanStats(SmallSpanStats* result) {
   SmallSpanStats normal, sampled;
   for (int partition = 0; partition < active_numa_partitions(); partition++) {
@@ -253,6 +559,11 @@ inline void PageAllocator::GetSmallSpanStats(SmallSpanStats* result) {
     cold_impl_->GetSmallSpanStats(&cold);
     *result += cold;
   }
+  if (has_warm_impl_) {
+    SmallSpanStats warm;
+    warm_impl_->GetSmallSpanStats(&warm);
+    *result += warm;
+  }
 }
 
 inline void PageAllocator::GetLargeSpanStats(LargeSpanStats* result) {
@@ -269,6 +580,11 @@ inline void PageAllocator::GetLargeSpanStats(LargeSpanStats* result) {
     cold_impl_->GetLargeSpanStats(&cold);
     *result = *result + cold;
   }
+  if (has_warm_impl_) {
+    LargeSpanStats warm;
+    warm_impl_->GetLargeSpanStats(&warm);
+    *result = *result + warm;
+  }
 }
 
 inline Length PageAllocator::ReleaseAtLeastNPages(Length num_pages,
@@ -279,22 +595,103 @@ inline Length PageAllocator::ReleaseAtLeastNPages(Length num_pages,
   if (has_cold_impl_) {
     released = cold_impl_->ReleaseAtLeastNPages(num_pages, reason);
   }
-  for (int partition = 0; partition < active_numa_partitions(); partition++) {
-    released += normal_impl_[partition]->ReleaseAtLeastNPages(
+  if (has_warm_impl_) {
+    released += warm_impl_->ReleaseAtLeastNPages(
+        num_pages > released ? num_pages - released : Length(0), reason);
+  }
+  std::array<size_t, kNumaPartitions> order;
+  const size_t partitions = NumaReleaseOrder(order);
+  for (size_t i = 0; i < partitions; i++) {
+    if (reason == PageReleaseReason::kProcessBackgroundActions &&
+        HasPartitionWorker(order[i])) {
+      continue;
+    }
+    released += normal_impl_[order[i]]->ReleaseAtLeastNPages(
         num_pages > released ? num_pages - released : Length(0), reason);
   }
 
   released += sampled_impl_->ReleaseAtLeastNPages(
       num_pages > released ? num_pages - released : Length(0), reason);
+  if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+    tracer_.RecordRelease(PageHeapTraceRecord::kRelease, num_pages, released,
+                          reason);
+  }
+  return released;
+}
+
+inline Length PageAllocator::ReleasePartitionAtLeastNPages(
+    size_t partition, Length num_pages, PageReleaseReason reason) {
+  TC_ASSERT_LT(partition, active_numa_partitions());
+  const Length released =
+      normal_impl_[partition]->ReleaseAtLeastNPages(num_pages, reason);
+  if (ABSL_PREDICT_FALSE(tracer_.enabled())) {
+    tracer_.RecordRelease(PageHeapTraceRecord::kRelease, num_pages, released,
+                          reason);
+  }
   return released;
 }
 
+inline HugeLength PageAllocator::CollapseHugePages(HugeLength max) {
+  HugeLength collapsed;
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    collapsed += normal_impl_[partition]->CollapseHugePages(
+        max > collapsed ? max - collapsed : NHugePages(0));
+  }
+  if (has_cold_impl_) {
+    collapsed += cold_impl_->CollapseHugePages(
+        max > collapsed ? max - collapsed : NHugePages(0));
+  }
+  if (has_warm_impl_) {
+    collapsed += warm_impl_->CollapseHugePages(
+        max > collapsed ? max - collapsed : NHugePages(0));
+  }
+  return collapsed;
+}
+
+inline HugeLength PageAllocator::AuditHugePages(
+    HugeLength max, HugePageBackingFunction& backing) {
+  HugeLength audited;
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    audited += normal_impl_[partition]->AuditHugePages(
+        max > audited ? max - audited : NHugePages(0), backing);
+  }
+  if (has_cold_impl_) {
+    audited += cold_impl_->AuditHugePages(
+        max > audited ? max - audited : NHugePages(0), backing);
+  }
+  if (has_warm_impl_) {
+    audited += warm_impl_->AuditHugePages(
+        max > audited ? max - audited : NHugePages(0), backing);
+  }
+  return audited;
+}
+
+inline HugeLength PageAllocator::TierHugePages(
+    HugeLength max, HugePageTieringFunction& tiering) {
+  HugeLength moved;
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    moved += normal_impl_[partition]->TierHugePages(
+        max > moved ? max - moved : NHugePages(0), tiering);
+  }
+  if (has_cold_impl_) {
+    moved += cold_impl_->TierHugePages(
+        max > moved ? max - moved : NHugePages(0), tiering);
+  }
+  // The warm tier is already on the far node, so we skip it.
+  moved += sampled_impl_->TierHugePages(
+      max > moved ? max - moved : NHugePages(0), tiering);
+  return moved;
+}
+
 inline PageReleaseStats PageAllocator::GetReleaseStats() const {
   PageReleaseStats stats;
 
   if (has_cold_impl_) {
     stats += cold_impl_->GetReleaseStats();
   }
+  if (has_warm_impl_) {
+    stats += warm_impl_->GetReleaseStats();
+  }
   for (int partition = 0; partition < active_numa_partitions(); partition++) {
     stats += normal_impl_[partition]->GetReleaseStats();
   }
@@ -304,8 +701,23 @@ inline PageReleaseStats PageAllocator::GetReleaseStats() const {
   return stats;
 }
 
+inline Length PageAllocator::GetRefaultedPages() const {
+  Length refaulted = sampled_impl_->GetRefaultedPages();
+  if (has_cold_impl_) {
+    refaulted += cold_impl_->GetRefaultedPages();
+  }
+  if (has_warm_impl_) {
+    refaulted += warm_impl_->GetRefaultedPages();
+  }
+  for (int partition = 0; partition < active_numa_partitions(); partition++) {
+    refaulted += normal_impl_[partition]->GetRefaultedPages();
+  }
+  return refaulted;
+}
+
 inline void PageAllocator::Print(Printer* out, MemoryTag tag) {
-  if (tag == MemoryTag::kCold && !has_cold_impl_) {
+  if ((tag == MemoryTag::kCold && !has_cold_impl_) ||
+      (tag == MemoryTag::kWarm && !has_warm_impl_)) {
     return;
   }
 
@@ -320,7 +732,8 @@ inline void PageAllocator::Print(Printer* out, MemoryTag tag) {
 }
 
 inline void PageAllocator::PrintInPbtxt(PbtxtRegion* region, MemoryTag tag) {
-  if (tag == MemoryTag::kCold && !has_cold_impl_) {
+  if ((tag == MemoryTag::kCold && !has_cold_impl_) ||
+      (tag == MemoryTag::kWarm && !has_warm_impl_)) {
     return;
   }
 
@@ -340,6 +753,18 @@ inline void PageAllocator::set_limit(size_t limit, LimitKind limit_kind) {
   ShrinkToUsageLimit(Length(0));
 }
 
+inline void PageAllocator::set_heap_limit(size_t limit, HeapKind kind) {
+  TC_ASSERT_LT(kind, kNumHeapKinds);
+  PageHeapSpinLockHolder h;
+  heap_limits_[kind] = limit;
+  has_heap_limits_ = false;
+  for (size_t heap_limit : heap_limits_) {
+    has_heap_limits_ |= heap_limit != std::numeric_limits<size_t>::max();
+  }
+  // Attempt to shed memory to get below the new limit.
+  ShrinkToUsageLimit(Length(0));
+}
+
 inline int64_t PageAllocator::limit_hits(LimitKind limit_kind) const {
   TC_ASSERT_LT(limit_kind, kNumLimits);
   PageHeapSpinLockHolder l;
@@ -19,6 +19,7 @@
 
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/pages.h"
@@ -55,6 +56,23 @@ class PageAllocatorInterface {
   virtual void Delete(Span* span, size_t num_objects)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
+  // Resizes span to n pages without moving it, if the pages it would grow
+  // into are free, and returns true.  Otherwise, returns false and leaves
+  // span as it is.
+  // REQUIRES: span was returned by an earlier call to New() or NewAligned()
+  //           for a page-level allocation and has not yet been deleted.
+  virtual bool ResizeInPlace(Span* span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
+  // Allocates a span of n >= span->num_pages() pages and moves the pages of
+  // span to its start, without copying them, before deleting span.  Returns
+  // the new span, or nullptr, leaving span as it is, if its pages can't be
+  // moved.
+  // REQUIRES: span was returned by an earlier call to New() or NewAligned()
+  //           for a page-level allocation and has not yet been deleted.
+  virtual Span* Remap(Span* span, Length n, SpanAllocInfo span_alloc_info)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
+
   virtual BackingStats stats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
@@ -74,11 +92,36 @@ class PageAllocatorInterface {
                                       PageReleaseReason reason)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
+  // Asks the system to restore hugepage backing for up to max hugepages that
+  // were broken up by subrelease but are fully backed again.  Returns the
+  // number of hugepages collapsed.
+  virtual HugeLength CollapseHugePages(HugeLength max)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
+
+  // Checks, through backing, how the system backs up to max of the hugepages
+  // we assume are backed by hugepages, and updates our view of them to match.
+  // Returns the number of hugepages audited.
+  virtual HugeLength AuditHugePages(HugeLength max,
+                                    HugePageBackingFunction& backing)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
+
+  // Moves, through tiering, up to max hugepages that have gone idle to the far
+  // tier, and back those that are used again.  Returns the number of
+  // hugepages moved.
+  virtual HugeLength TierHugePages(HugeLength max,
+                                   HugePageTieringFunction& tiering)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
+
   // Returns the number of pages that have been released from this page
   // allocator.
   virtual PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
 
+  // Returns the number of released pages that were allocated again, and so
+  // faulted back in, since startup.
+  virtual Length GetRefaultedPages() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) = 0;
+
   // Prints stats about the page heap to *out.
   virtual void Print(Printer* out) ABSL_LOCKS_EXCLUDED(pageheap_lock) = 0;
 
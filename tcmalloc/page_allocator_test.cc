@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <limits>
 #include <new>
 #include <string>
 #include <vector>
@@ -220,6 +221,48 @@ TEST_F(PageAllocatorTest, b270916852) {
   Parameters::set_hpaa_subrelease(old_subrelease);
 }
 
+TEST_F(PageAllocatorTest, ShrinkReleasesFreeHugepagesFirst) {
+  if (allocator_->algorithm() != PageAllocator::HPAA) {
+    GTEST_SKIP() << "Only the hugepage-aware allocator has shrink stages";
+  }
+  // Turn off subrelease so that we take the ShrinkHardBy path.
+  const bool old_subrelease = Parameters::hpaa_subrelease();
+  Parameters::set_hpaa_subrelease(false);
+
+  constexpr SpanAllocInfo kSpanInfo = {/*objects_per_span=*/1,
+                                       AccessDensityPrediction::kSparse};
+  // A used hugepage in the filler, and a free one in the HugeCache.
+  Span* filler = New(kPagesPerHugePage / 2, kSpanInfo, MemoryTag::kNormal);
+  Delete(New(kPagesPerHugePage, kSpanInfo, MemoryTag::kNormal),
+         kSpanInfo.objects_per_span, MemoryTag::kNormal);
+
+  // Leave room for the filler's hugepage only.
+  const size_t metadata_bytes = []() {
+    PageHeapSpinLockHolder l;
+    return tc_globals.metadata_bytes();
+  }();
+  allocator_->set_limit(metadata_bytes + kHugePageSize + kPageSize,
+                        PageAllocator::kSoft);
+  {
+    PageHeapSpinLockHolder l;
+    allocator_->ShrinkToUsageLimit(Length(0));
+  }
+  EXPECT_LE(1, allocator_->limit_hits(PageAllocator::kSoft));
+  EXPECT_GE(allocator_->shrink_released_bytes(PageAllocator::kShrinkHugeCache),
+            kHugePageSize);
+  // The free hugepage was enough, so the filler's was left intact.
+  EXPECT_EQ(allocator_->shrink_released_bytes(PageAllocator::kShrinkFiller),
+            0);
+  EXPECT_EQ(allocator_->shrink_released_bytes(
+                PageAllocator::kShrinkBreakingHugepages),
+            0);
+
+  allocator_->set_limit(std::numeric_limits<size_t>::max(),
+                        PageAllocator::kSoft);
+  Delete(filler, kSpanInfo.objects_per_span, MemoryTag::kNormal);
+  Parameters::set_hpaa_subrelease(old_subrelease);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
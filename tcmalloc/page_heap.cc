@@ -16,6 +16,8 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+
 #include "absl/base/attributes.h"
 #include "absl/base/internal/cycleclock.h"
 #include "absl/base/internal/spinlock.h"
@@ -45,6 +47,12 @@ void PageHeap::RecordSpan(Span* span) {
   }
 }
 
+int PageHeap::FreeListIndex(Length n) {
+  if (n < kMaxPages) return n.raw_num();
+  const int bucket = absl::bit_width(n.raw_num() / kMaxPages.raw_num()) - 1;
+  return kMaxPages.raw_num() + std::min(bucket, kNumLargeBuckets - 1);
+}
+
 PageHeap::PageHeap(MemoryTag tag) : PageHeap(&tc_globals.pagemap(), tag) {}
 
 PageHeap::PageHeap(PageMap* map, MemoryTag tag)
@@ -57,24 +65,33 @@ Span* PageHeap::SearchFreeAndLargeLists(Length n, bool* from_returned) {
   TC_ASSERT_GT(n, Length(0));
 
   // Find first size >= n that has a non-empty list
-  for (Length s = n; s < kMaxPages; ++s) {
-    SpanList* ll = &free_[s.raw_num()].normal;
+  const int start = FreeListIndex(n);
+  int s = nonempty_.FindSet(start);
+  if (s < kMaxPages.raw_num()) {
+    SpanList* ll = &free_[s].normal;
     // If we're lucky, ll is non-empty, meaning it has a suitable span.
     if (!ll->empty()) {
       TC_ASSERT_EQ(ll->first()->location(), Span::ON_NORMAL_FREELIST);
       *from_returned = false;
       return Carve(ll->first(), n);
     }
-    // Alternatively, maybe there's a usable returned span.
-    ll = &free_[s.raw_num()].returned;
-    if (!ll->empty()) {
-      TC_ASSERT_EQ(ll->first()->location(), Span::ON_RETURNED_FREELIST);
-      *from_returned = true;
-      return Carve(ll->first(), n);
-    }
+    // Otherwise, there's a usable returned span.
+    ll = &free_[s].returned;
+    TC_ASSERT(!ll->empty());
+    TC_ASSERT_EQ(ll->first()->location(), Span::ON_RETURNED_FREELIST);
+    *from_returned = true;
+    return Carve(ll->first(), n);
   }
   // No luck in free lists, our last chance is in a larger class.
-  return AllocLarge(n, from_returned);  // May be NULL
+  while (s < kNumFreeLists) {
+    Span* span = AllocLarge(s, n, from_returned);
+    if (span != nullptr) return span;
+    // Only the bucket n falls in may hold spans shorter than n.
+    TC_ASSERT_EQ(s, start);
+    if (s + 1 == kNumFreeLists) break;
+    s = nonempty_.FindSet(s + 1);
+  }
+  return nullptr;
 }
 
 Span* PageHeap::AllocateSpan(Length n, bool* from_returned) {
@@ -193,13 +210,16 @@ Span* PageHeap::NewAligned(Length n, Length align,
   return span;
 }
 
-Span* PageHeap::AllocLarge(Length n, bool* from_returned) {
+Span* PageHeap::AllocLarge(int index, Length n, bool* from_returned) {
   // find the best span (closest to n in size).
-  // The following loops implements address-ordered best-fit.
+  // The following loops implements address-ordered best-fit.  Buckets hold
+  // disjoint, increasing ranges of lengths, so the best span in the first
+  // bucket holding any span long enough is the best of all.
   Span* best = nullptr;
+  SpanListPair& large = free_[index];
 
   // Search through normal list
-  for (Span* span : large_.normal) {
+  for (Span* span : large.normal) {
     TC_ASSERT_EQ(span->location(), Span::ON_NORMAL_FREELIST);
     if (IsSpanBetter(span, best, n)) {
       best = span;
@@ -208,7 +228,7 @@ Span* PageHeap::AllocLarge(Length n, bool* from_returned) {
   }
 
   // Search through released list in case it has a better fit
-  for (Span* span : large_.returned) {
+  for (Span* span : large.returned) {
     TC_ASSERT_EQ(span->location(), Span::ON_RETURNED_FREELIST);
     if (IsSpanBetter(span, best, n)) {
       best = span;
@@ -316,9 +336,8 @@ void PageHeap::MergeIntoFreeList(Span* span) {
 
 void PageHeap::PrependToFreeList(Span* span) {
   TC_ASSERT_NE(span->location(), Span::IN_USE);
-  SpanListPair* list = (span->num_pages() < kMaxPages)
-                           ? &free_[span->num_pages().raw_num()]
-                           : &large_;
+  const int index = FreeListIndex(span->num_pages());
+  SpanListPair* list = &free_[index];
   if (span->location() == Span::ON_NORMAL_FREELIST) {
     stats_.free_bytes += span->bytes_in_span();
     list->normal.prepend(span);
@@ -326,13 +345,13 @@ void PageHeap::PrependToFreeList(Span* span) {
     stats_.unmapped_bytes += span->bytes_in_span();
     list->returned.prepend(span);
   }
+  nonempty_.SetBit(index);
 }
 
 void PageHeap::RemoveFromFreeList(Span* span) {
   TC_ASSERT_NE(span->location(), Span::IN_USE);
-  SpanListPair* list = (span->num_pages() < kMaxPages)
-                           ? &free_[span->num_pages().raw_num()]
-                           : &large_;
+  const int index = FreeListIndex(span->num_pages());
+  SpanListPair* list = &free_[index];
   if (span->location() == Span::ON_NORMAL_FREELIST) {
     stats_.free_bytes -= span->bytes_in_span();
     list->normal.remove(span);
@@ -340,6 +359,9 @@ void PageHeap::RemoveFromFreeList(Span* span) {
     stats_.unmapped_bytes -= span->bytes_in_span();
     list->returned.remove(span);
   }
+  if (list->normal.empty() && list->returned.empty()) {
+    nonempty_.ClearBit(index);
+  }
 }
 
 Length PageHeap::ReleaseLastNormalSpan(SpanListPair* slist) {
@@ -396,12 +418,10 @@ Length PageHeap::ReleaseAtLeastNPages(Length num_pages,
     }
     prev_released_pages = released_pages;
 
-    for (int i = 0; i < kMaxPages.raw_num() + 1 && released_pages < num_pages;
+    for (int i = 0; i < kNumFreeLists && released_pages < num_pages;
          i++, release_index_++) {
-      if (release_index_ > kMaxPages.raw_num()) release_index_ = 0;
-      SpanListPair* slist = (release_index_ == kMaxPages.raw_num())
-                                ? &large_
-                                : &free_[release_index_];
+      if (release_index_ >= kNumFreeLists) release_index_ = 0;
+      SpanListPair* slist = &free_[release_index_];
       if (!slist->normal.empty()) {
         Length released_len = ReleaseLastNormalSpan(slist);
         released_pages += released_len;
@@ -427,13 +447,15 @@ void PageHeap::GetLargeSpanStats(LargeSpanStats* result) {
   result->spans = 0;
   result->normal_pages = Length(0);
   result->returned_pages = Length(0);
-  for (Span* s : large_.normal) {
-    result->normal_pages += s->num_pages();
-    result->spans++;
-  }
-  for (Span* s : large_.returned) {
-    result->returned_pages += s->num_pages();
-    result->spans++;
+  for (int i = kMaxPages.raw_num(); i < kNumFreeLists; ++i) {
+    for (Span* s : free_[i].normal) {
+      result->normal_pages += s->num_pages();
+      result->spans++;
+    }
+    for (Span* s : free_[i].returned) {
+      result->returned_pages += s->num_pages();
+      result->spans++;
+    }
   }
 }
 
@@ -477,6 +499,7 @@ bool PageHeap::GrowHeap(Length n) {
 bool PageHeap::Check() {
   TC_ASSERT(free_[0].normal.empty());
   TC_ASSERT(free_[0].returned.empty());
+  TC_ASSERT(!nonempty_.GetBit(0));
   return true;
 }
 
@@ -19,8 +19,10 @@
 
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/range_tracker.h"
 #include "tcmalloc/page_allocator_interface.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/span.h"
@@ -63,6 +65,18 @@ class PageHeap final : public PageAllocatorInterface {
   void Delete(Span* span, size_t objects_per_span)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  // Spans are not resized in place by the page heap.
+  bool ResizeInPlace(Span* span, Length n)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override {
+    return false;
+  }
+
+  // Nor are their pages moved.
+  Span* Remap(Span* span, Length n, SpanAllocInfo span_alloc_info)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) override {
+    return nullptr;
+  }
+
   inline BackingStats stats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
     return stats_;
@@ -83,9 +97,34 @@ class PageHeap final : public PageAllocatorInterface {
   Length ReleaseAtLeastNPages(Length num_pages, PageReleaseReason reason)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  // PageHeap does not track hugepages, so there is nothing to collapse.
+  HugeLength CollapseHugePages(HugeLength max)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    return NHugePages(0);
+  }
+
+  // Nor to audit.
+  HugeLength AuditHugePages(HugeLength max, HugePageBackingFunction& backing)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    return NHugePages(0);
+  }
+
+  // Nor to tier.
+  HugeLength TierHugePages(HugeLength max, HugePageTieringFunction& tiering)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    return NHugePages(0);
+  }
+
   PageReleaseStats GetReleaseStats() const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override;
 
+  // PageHeap releases whole free spans, which are not told apart from fresh
+  // memory when they are allocated again.
+  Length GetRefaultedPages() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) override {
+    return Length(0);
+  }
+
   // Prints stats about the page heap to *out.
   void Print(Printer* out) ABSL_LOCKS_EXCLUDED(pageheap_lock) override;
 
@@ -101,11 +140,22 @@ class PageHeap final : public PageAllocatorInterface {
     SpanList returned;
   };
 
-  // List of free spans of length >= kMaxPages
-  SpanListPair large_ ABSL_GUARDED_BY(pageheap_lock);
+  // Free spans of length >= kMaxPages are bucketed by powers of two: bucket
+  // b holds the lengths [kMaxPages << b, kMaxPages << (b + 1)), and the last
+  // bucket every length beyond.
+  static constexpr int kNumLargeBuckets = 32;
+  static constexpr int kNumFreeLists = kMaxPages.raw_num() + kNumLargeBuckets;
+
+  // Returns the index into free_ of the list for spans of length n.
+  static int FreeListIndex(Length n);
+
+  // Array mapping from span length to a doubly linked list of free spans, for
+  // lengths < kMaxPages, followed by the large buckets.
+  SpanListPair free_[kNumFreeLists] ABSL_GUARDED_BY(pageheap_lock);
 
-  // Array mapping from span length to a doubly linked list of free spans
-  SpanListPair free_[kMaxPages.raw_num()] ABSL_GUARDED_BY(pageheap_lock);
+  // Bit i is set when free_[i] holds a span, normal or returned, so that a
+  // search skips the empty lists.
+  Bitmap<kNumFreeLists> nonempty_ ABSL_GUARDED_BY(pageheap_lock);
 
   // Statistics on system, free, and unmapped bytes
   BackingStats stats_ ABSL_GUARDED_BY(pageheap_lock);
@@ -125,9 +175,10 @@ class PageHeap final : public PageAllocatorInterface {
   Span* Carve(Span* span, Length n)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
-  // Allocate a large span of length == n.  If successful, returns a
-  // span of exactly the specified length.  Else, returns NULL.
-  Span* AllocLarge(Length n, bool* from_returned)
+  // Allocate a span of length == n from the large bucket at index of free_,
+  // whose spans may all be shorter than n.  If successful, returns a span of
+  // exactly the specified length.  Else, returns NULL.
+  Span* AllocLarge(int index, Length n, bool* from_returned)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
   // Coalesce span with neighboring spans if possible, prepend to
@@ -53,8 +53,10 @@ class PageHeapAllocator {
   // We use an explicit Init function because these variables are statically
   // allocated and their constructors might not have run by the time some
   // other static variable tries to allocate memory.
-  void Init(Arena* arena) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+  void Init(Arena* arena, ArenaUse use = ArenaUse::kOther)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
     arena_ = arena;
+    use_ = use;
     // Reserve some space at the beginning to avoid fragmentation.
     Delete(New());
   }
@@ -73,7 +75,7 @@ class PageHeapAllocator {
     stats_.in_use++;
     if (ABSL_PREDICT_FALSE(result == nullptr)) {
       stats_.total++;
-      result = reinterpret_cast<T*>(arena_->Alloc(size, align));
+      result = reinterpret_cast<T*>(arena_->Alloc(size, align, use_));
       ABSL_ANNOTATE_MEMORY_IS_UNINITIALIZED(result, size);
       return result;
     } else {
@@ -106,6 +108,7 @@ class PageHeapAllocator {
  private:
   // Arena from which to allocate memory
   Arena* arena_;
+  ArenaUse use_ = ArenaUse::kOther;
 
   // Free list of already carved objects
   T* free_list_ ABSL_GUARDED_BY(pageheap_lock);
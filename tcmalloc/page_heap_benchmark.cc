@@ -0,0 +1,82 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Times large allocations from a PageHeap whose free memory is fragmented
+// into many large spans, as it is in long running no-HPAA binaries.
+
+#include <stdlib.h>
+
+#include <new>
+#include <random>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/page_heap.h"
+#include "tcmalloc/pagemap.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr SpanAllocInfo kSpanAllocInfo = {1, AccessDensityPrediction::kDense};
+
+// Leaves range(0) free spans of between kMaxPages and 2 * kMaxPages pages,
+// each followed by a page in use, then allocates and frees a span of a
+// random length in the same range each iteration.
+void BM_fragmented(benchmark::State& state) {
+  tc_globals.InitIfNecessary();
+  const int holes = state.range(0);
+
+  // As in page_heap_test, the heap and its memory are never torn down.
+  PageMap* pagemap = new PageMap;
+  void* memory = calloc(1, sizeof(PageHeap));
+  PageHeap* ph = new (memory) PageHeap(pagemap, MemoryTag::kNormal);
+
+  absl::BitGen rng(std::seed_seq{0});
+  auto random_len = [&]() {
+    return Length(absl::Uniform<size_t>(rng, kMaxPages.raw_num(),
+                                        2 * kMaxPages.raw_num()));
+  };
+  std::vector<Span*> free_spans;
+  for (int i = 0; i < holes; ++i) {
+    free_spans.push_back(ph->New(random_len(), kSpanAllocInfo));
+    ph->New(Length(1), kSpanAllocInfo);
+  }
+  for (Span* span : free_spans) {
+    PageHeapSpinLockHolder l;
+    ph->Delete(span, kSpanAllocInfo.objects_per_span);
+  }
+
+  for (auto s : state) {
+    Span* span = ph->New(random_len(), kSpanAllocInfo);
+    benchmark::DoNotOptimize(span);
+    PageHeapSpinLockHolder l;
+    ph->Delete(span, kSpanAllocInfo.objects_per_span);
+  }
+
+  PageHeapSpinLockHolder l;
+  LargeSpanStats large;
+  ph->GetLargeSpanStats(&large);
+  state.counters["large_free_spans"] = large.spans;
+}
+BENCHMARK(BM_fragmented)->Range(16, 1024);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
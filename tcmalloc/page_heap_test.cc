@@ -17,8 +17,11 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <memory>
 #include <new>
+#include <random>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/base/internal/spinlock.h"
@@ -111,6 +114,85 @@ TEST_F(PageHeapTest, Stats) {
   free(memory);
 }
 
+// Large free spans are found by best fit, however many there are and in
+// whichever order they were freed.
+TEST_F(PageHeapTest, LargeBestFit) {
+  auto pagemap = std::make_unique<PageMap>();
+  void* memory = calloc(1, sizeof(PageHeap));
+  PageHeap* ph = new (memory) PageHeap(pagemap.get(), MemoryTag::kNormal);
+  constexpr SpanAllocInfo kSpanAllocInfo = {1,
+                                            AccessDensityPrediction::kDense};
+
+  const auto large_spans = [&]() {
+    PageHeapSpinLockHolder l;
+    LargeSpanStats large;
+    ph->GetLargeSpanStats(&large);
+    return large.spans;
+  };
+  std::vector<Span*> in_use;
+  // Use up the large free spans left of the memory the heap grew by.
+  const auto drain = [&]() {
+    while (large_spans() > 0) {
+      in_use.push_back(ph->New(kMaxPages, kSpanAllocInfo));
+    }
+  };
+
+  // Holes of distinct lengths, spread over several power-of-two buckets,
+  // each followed by a span in use so that they don't coalesce.
+  constexpr int kHoles = 64;
+  const auto hole_length = [](int i) { return kMaxPages + Length(3 * i); };
+  Length total;
+  for (int i = 0; i < kHoles; ++i) total += hole_length(i) + kMaxPages;
+
+  // Grow the heap by one contiguous span, and carve the holes out of it once
+  // it is the only large free span.
+  Span* region = ph->New(total, kSpanAllocInfo);
+  ASSERT_NE(region, nullptr);
+  drain();
+  Delete(ph, region, kSpanAllocInfo.objects_per_span);
+  ASSERT_EQ(large_spans(), 1);
+
+  std::vector<int> order(kHoles);
+  for (int i = 0; i < kHoles; ++i) order[i] = i;
+  std::shuffle(order.begin(), order.end(), std::mt19937(0));
+  std::vector<Span*> holes(kHoles);
+  for (int i : order) {
+    holes[i] = ph->New(hole_length(i), kSpanAllocInfo);
+    ASSERT_NE(holes[i], nullptr);
+    in_use.push_back(ph->New(kMaxPages, kSpanAllocInfo));
+  }
+  ASSERT_EQ(large_spans(), 0);
+
+  std::shuffle(order.begin(), order.end(), std::mt19937(1));
+  std::vector<PageId> starts(kHoles);
+  for (int i : order) {
+    starts[i] = holes[i]->first_page();
+    Delete(ph, holes[i], kSpanAllocInfo.objects_per_span);
+  }
+  EXPECT_EQ(large_spans(), kHoles);
+
+  // Each request one page shorter than a hole is carved from that hole, and
+  // not from a longer one of the same bucket.
+  for (int i : order) {
+    if (i == 0) continue;
+    Span* s = ph->New(hole_length(i) - Length(1), kSpanAllocInfo);
+    ASSERT_NE(s, nullptr);
+    EXPECT_EQ(s->first_page(), starts[i]) << i;
+    in_use.push_back(s);
+  }
+  // The shortest hole is then the only large free span left.
+  EXPECT_EQ(large_spans(), 1);
+  Span* s = ph->New(hole_length(0), kSpanAllocInfo);
+  ASSERT_NE(s, nullptr);
+  EXPECT_EQ(s->first_page(), starts[0]);
+  in_use.push_back(s);
+
+  for (Span* span : in_use) {
+    Delete(ph, span, kSpanAllocInfo.objects_per_span);
+  }
+  free(memory);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -0,0 +1,132 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/page_heap_trace.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "absl/base/internal/cycleclock.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/util.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+void PageHeapTracer::InitFromEnvironment() {
+  if (initialized_) {
+    return;
+  }
+  initialized_ = true;
+
+  const char* path = thread_safe_getenv("TCMALLOC_PAGE_HEAP_TRACE_FILE");
+  if (path == nullptr || path[0] == '\0') {
+    return;
+  }
+  const int fd =
+      signal_safe_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    TC_LOG("Couldn't open page heap trace file %s", path);
+    return;
+  }
+  if (!Start(fd)) {
+    TC_LOG("Couldn't write page heap trace file %s", path);
+    signal_safe_close(fd);
+  }
+}
+
+bool PageHeapTracer::Start(int fd) {
+  TC_ASSERT(!enabled());
+  fd_ = fd;
+  const PageHeapTraceHeader header = {
+      .magic = PageHeapTraceHeader::kMagic,
+      .record_size = sizeof(PageHeapTraceRecord),
+      .page_shift = kPageShift,
+      .cycles_per_second = absl::base_internal::CycleClock::Frequency(),
+  };
+  if (!WriteOut(&header, sizeof(header))) {
+    fd_ = -1;
+    return false;
+  }
+
+  PageHeapSpinLockHolder l;
+  constexpr size_t kBufferBytes = kBufferRecords * sizeof(PageHeapTraceRecord);
+  active_ = static_cast<PageHeapTraceRecord*>(tc_globals.arena().Alloc(
+      kBufferBytes, std::align_val_t(alignof(PageHeapTraceRecord))));
+  flushing_ = static_cast<PageHeapTraceRecord*>(tc_globals.arena().Alloc(
+      kBufferBytes, std::align_val_t(alignof(PageHeapTraceRecord))));
+  active_size_ = 0;
+  dropped_ = 0;
+  enabled_.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void PageHeapTracer::Flush() {
+  if (!enabled()) {
+    return;
+  }
+
+  size_t size;
+  uint64_t dropped;
+  {
+    PageHeapSpinLockHolder l;
+    std::swap(active_, flushing_);
+    size = active_size_;
+    dropped = dropped_;
+    active_size_ = 0;
+    dropped_ = 0;
+  }
+
+  bool ok = WriteOut(flushing_, size * sizeof(PageHeapTraceRecord));
+  if (ok && dropped > 0) {
+    const PageHeapTraceRecord gap = {
+        .cycles = static_cast<uint64_t>(absl::base_internal::CycleClock::Now()),
+        .page = dropped,
+        .op = PageHeapTraceRecord::kDropped,
+    };
+    ok = WriteOut(&gap, sizeof(gap));
+  }
+  if (!ok) {
+    // Stop tracing rather than leave a trace with a silent gap.  The buffers
+    // stay allocated, since the arena cannot free them.
+    TC_LOG("Couldn't write page heap trace, stopping");
+    enabled_.store(false, std::memory_order_relaxed);
+    signal_safe_close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool PageHeapTracer::WriteOut(const void* data, size_t size) {
+  if (size == 0) {
+    return true;
+  }
+  size_t written = 0;
+  return signal_safe_write(fd_, static_cast<const char*>(data), size,
+                           &written) >= 0 &&
+         written == size;
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
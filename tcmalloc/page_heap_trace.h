@@ -0,0 +1,179 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_PAGE_HEAP_TRACE_H_
+#define TCMALLOC_PAGE_HEAP_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/stats.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// A page heap trace is a PageHeapTraceHeader followed by PageHeapTraceRecords,
+// all in host byte order.  See page_heap_trace_replay.h for replaying one.
+struct PageHeapTraceHeader {
+  static constexpr uint64_t kMagic = 0x3143525448504354;  // "TCPHTRC1"
+
+  uint64_t magic;
+  uint32_t record_size;
+  uint32_t page_shift;
+  double cycles_per_second;
+};
+
+struct PageHeapTraceRecord {
+  enum Op : uint8_t {
+    // A span was allocated by PageAllocator::New or NewAligned.
+    kNew,
+    // A span was returned by PageAllocator::Delete.
+    kDelete,
+    // PageAllocator::ReleaseAtLeastNPages was called.
+    kRelease,
+    // PageAllocator broke up hugepages to get back under a usage limit.
+    kReleaseBreakingHugepages,
+    // Records were lost because the tracer's buffer was full.
+    kDropped,
+    kNumOps,
+  };
+
+  // CycleClock::Now() when the operation completed.
+  uint64_t cycles;
+  // kNew, kDelete: first page of the span.  kRelease*: pages requested.
+  // kDropped: number of records lost.
+  uint64_t page;
+  // kNew, kDelete: pages in the span.  kRelease*: pages released.
+  uint32_t length;
+  // kNew: alignment in pages, 1 if unaligned.  kDelete: objects per span.
+  uint32_t align_or_objects;
+  // kNew: objects per span.
+  uint32_t objects_per_span;
+  uint8_t op;
+  // kNew, kDelete: MemoryTag.  kRelease*: PageReleaseReason.
+  uint8_t tag;
+  // kNew: AccessDensityPrediction.
+  uint8_t density;
+  uint8_t padding;
+};
+
+static_assert(sizeof(PageHeapTraceRecord) == 32,
+              "trace records should stay compact");
+
+// Records page heap operations at the PageAllocator boundary into a file, so
+// that HugePageAwareAllocator configurations can be evaluated offline against
+// real traffic.  Tracing is off unless TCMALLOC_PAGE_HEAP_TRACE_FILE names the
+// file to write.
+//
+// Records are appended to an in-memory buffer under pageheap_lock and written
+// out by Flush, which the background thread calls periodically.  If the buffer
+// fills up between flushes, further records are counted and dropped, and a
+// kDropped record marks the gap.
+class PageHeapTracer {
+ public:
+  // Records buffered between flushes.  Two buffers of this many records are
+  // allocated from the arena when tracing starts.
+  static constexpr size_t kBufferRecords = 1 << 15;
+
+  constexpr PageHeapTracer() = default;
+
+  // Starts tracing to the file named by TCMALLOC_PAGE_HEAP_TRACE_FILE, if set.
+  // Only the first call has an effect.
+  void InitFromEnvironment() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Writes the trace header to fd and starts tracing to it.  Returns false,
+  // leaving tracing off, if the header could not be written.
+  bool Start(int fd) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void RecordNew(const Span* span, Length align, SpanAllocInfo span_alloc_info,
+                 MemoryTag tag) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    Append({.cycles = static_cast<uint64_t>(
+                absl::base_internal::CycleClock::Now()),
+            .page = span->first_page().index(),
+            .length = static_cast<uint32_t>(span->num_pages().raw_num()),
+            .align_or_objects = static_cast<uint32_t>(align.raw_num()),
+            .objects_per_span =
+                static_cast<uint32_t>(span_alloc_info.objects_per_span),
+            .op = PageHeapTraceRecord::kNew,
+            .tag = static_cast<uint8_t>(tag),
+            .density = static_cast<uint8_t>(span_alloc_info.density)});
+  }
+
+  void RecordDelete(const Span* span, size_t objects_per_span, MemoryTag tag)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    Append({.cycles = static_cast<uint64_t>(
+                absl::base_internal::CycleClock::Now()),
+            .page = span->first_page().index(),
+            .length = static_cast<uint32_t>(span->num_pages().raw_num()),
+            .align_or_objects = static_cast<uint32_t>(objects_per_span),
+            .op = PageHeapTraceRecord::kDelete,
+            .tag = static_cast<uint8_t>(tag)});
+  }
+
+  void RecordRelease(PageHeapTraceRecord::Op op, Length requested,
+                     Length released, PageReleaseReason reason)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    Append({.cycles = static_cast<uint64_t>(
+                absl::base_internal::CycleClock::Now()),
+            .page = requested.raw_num(),
+            .length = static_cast<uint32_t>(released.raw_num()),
+            .op = op,
+            .tag = static_cast<uint8_t>(reason)});
+  }
+
+  // Writes out the records buffered so far.  Only one thread, the background
+  // thread in production, may flush.
+  void Flush() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+ private:
+  void Append(const PageHeapTraceRecord& record)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    if (ABSL_PREDICT_FALSE(active_size_ == kBufferRecords)) {
+      ++dropped_;
+      return;
+    }
+    active_[active_size_++] = record;
+  }
+
+  bool WriteOut(const void* data, size_t size);
+
+  std::atomic<bool> enabled_{false};
+  bool initialized_ = false;
+  int fd_ = -1;
+
+  PageHeapTraceRecord* active_ ABSL_GUARDED_BY(pageheap_lock) = nullptr;
+  size_t active_size_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  uint64_t dropped_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  // Owned by the flushing thread while its records are written out.
+  PageHeapTraceRecord* flushing_ = nullptr;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_PAGE_HEAP_TRACE_H_
@@ -0,0 +1,335 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/page_heap_trace_replay.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <new>
+#include <utility>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/mock_huge_page_static_forwarder.h"
+#include "tcmalloc/page_heap_trace.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/stats.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using huge_page_allocator_internal::FakeStaticForwarder;
+using huge_page_allocator_internal::HugePageAwareAllocator;
+using Allocator = HugePageAwareAllocator<FakeStaticForwarder>;
+
+// The order in which PageAllocator releases from its allocators.
+constexpr MemoryTag kReleaseOrder[] = {
+    MemoryTag::kCold,     MemoryTag::kWarm,     MemoryTag::kNormalP0,
+    MemoryTag::kNormalP1, MemoryTag::kNormalP2, MemoryTag::kNormalP3,
+    MemoryTag::kSampled};
+
+// The trace clock, for PageHeapTraceReplayOptions::trace_clock.  Clock takes
+// plain functions, so its state is global.
+int64_t trace_cycles = 0;
+double trace_cycles_per_second = 1;
+
+int64_t TraceNow() { return trace_cycles; }
+double TraceFrequency() { return trace_cycles_per_second; }
+
+class Replayer {
+ public:
+  Replayer(double cycles_per_second, const PageHeapTraceReplayOptions& options)
+      : ns_per_cycle_(1e9 / cycles_per_second), options_(options) {
+    if (options_.trace_clock) {
+      trace_cycles_per_second = cycles_per_second;
+    }
+  }
+
+  ~Replayer() {
+    PageHeapSpinLockHolder l;
+    for (auto& [page, live] : live_) {
+      live.allocator->Delete(live.span, live.objects_per_span);
+    }
+    for (Allocator* allocator : allocators_) {
+      if (allocator != nullptr) {
+        // HugePageAwareAllocator can't be destroyed cleanly.
+        free(allocator);
+      }
+    }
+  }
+
+  void Replay(const PageHeapTraceRecord& record) {
+    ++stats_.records;
+    if (options_.trace_clock) {
+      trace_cycles = record.cycles;
+    }
+    switch (record.op) {
+      case PageHeapTraceRecord::kNew:
+        New(record);
+        break;
+      case PageHeapTraceRecord::kDelete:
+        Delete(record);
+        break;
+      case PageHeapTraceRecord::kRelease:
+      case PageHeapTraceRecord::kReleaseBreakingHugepages:
+        Release(record);
+        break;
+      case PageHeapTraceRecord::kDropped:
+        stats_.dropped_records += record.page;
+        break;
+      default:
+        ++stats_.skipped_records;
+        break;
+    }
+  }
+
+  PageHeapTraceReplayStats Finish() {
+    PageHeapSpinLockHolder l;
+    stats_.final_backed_bytes = BackedBytes();
+    double off_hugepage_bytes = 0;
+    size_t used_bytes = 0;
+    for (Allocator* allocator : allocators_) {
+      if (allocator == nullptr) {
+        continue;
+      }
+      // Only the filler breaks up hugepages that still hold live spans.
+      const BackingStats filler = allocator->FillerStats();
+      off_hugepage_bytes +=
+          (1 - allocator->FillerHugepageFrac()) *
+          (filler.system_bytes - filler.free_bytes - filler.unmapped_bytes);
+      const BackingStats all = allocator->stats();
+      used_bytes += all.system_bytes - all.free_bytes - all.unmapped_bytes;
+    }
+    stats_.final_used_bytes = used_bytes;
+    if (used_bytes > 0) {
+      stats_.hugepage_coverage = 1 - off_hugepage_bytes / used_bytes;
+    }
+    return stats_;
+  }
+
+ private:
+  struct LiveSpan {
+    Allocator* allocator;
+    Span* span;
+    size_t objects_per_span;
+  };
+
+  Allocator* GetAllocator(MemoryTag tag) {
+    Allocator*& allocator = allocators_[static_cast<uint8_t>(tag)];
+    if (allocator == nullptr) {
+      huge_page_allocator_internal::HugePageAwareAllocatorOptions options =
+          options_.allocator;
+      options.tag = tag;
+      // Other processes would make the replay depend on what they cache.
+      options.huge_cache_budget = nullptr;
+      if (options_.trace_clock) {
+        options.clock = {.now = TraceNow, .freq = TraceFrequency};
+      }
+      allocator = new (malloc(sizeof(Allocator))) Allocator(options);
+      FakeStaticForwarder& forwarder = allocator->forwarder();
+      forwarder.set_filler_skip_subrelease_interval(
+          options_.filler_skip_subrelease_interval);
+      forwarder.set_filler_skip_subrelease_short_interval(
+          options_.filler_skip_subrelease_short_interval);
+      forwarder.set_filler_skip_subrelease_long_interval(
+          options_.filler_skip_subrelease_long_interval);
+      forwarder.set_release_partial_alloc_pages(
+          options_.release_partial_alloc_pages);
+    }
+    return allocator;
+  }
+
+  size_t BackedBytes() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    size_t backed = 0;
+    for (Allocator* allocator : allocators_) {
+      if (allocator != nullptr) {
+        const BackingStats s = allocator->stats();
+        backed += s.system_bytes - s.unmapped_bytes;
+      }
+    }
+    return backed;
+  }
+
+  void Account(uint8_t op, int64_t start) {
+    const double ns =
+        (absl::base_internal::CycleClock::Now() - start) * ns_per_cycle_;
+    PageHeapTraceReplayStats::OpStats& s = stats_.ops[op];
+    ++s.count;
+    s.total_ns += ns;
+    s.max_ns = std::max(s.max_ns, ns);
+  }
+
+  void New(const PageHeapTraceRecord& record) {
+    const Length n(record.length);
+    const Length align(std::max<uint32_t>(record.align_or_objects, 1));
+    if (n == Length(0) ||
+        record.density >= AccessDensityPrediction::kPredictionCounts) {
+      ++stats_.skipped_records;
+      return;
+    }
+    auto it = live_.find(record.page);
+    if (it != live_.end()) {
+      // The span's delete was dropped; retire it so that its pages can be
+      // reused.
+      ++stats_.skipped_records;
+      PageHeapSpinLockHolder l;
+      it->second.allocator->Delete(it->second.span,
+                                   it->second.objects_per_span);
+      live_.erase(it);
+    }
+
+    Allocator* allocator = GetAllocator(static_cast<MemoryTag>(record.tag));
+    const SpanAllocInfo span_alloc_info = {
+        .objects_per_span = std::max<uint32_t>(record.objects_per_span, 1),
+        .density = static_cast<AccessDensityPrediction>(record.density)};
+    const int64_t start = absl::base_internal::CycleClock::Now();
+    Span* span = align > Length(1)
+                     ? allocator->NewAligned(n, align, span_alloc_info)
+                     : allocator->New(n, span_alloc_info);
+    Account(record.op, start);
+    TC_CHECK_NE(span, nullptr);
+    live_[record.page] = {allocator, span, span_alloc_info.objects_per_span};
+
+    PageHeapSpinLockHolder l;
+    stats_.peak_backed_bytes =
+        std::max(stats_.peak_backed_bytes, BackedBytes());
+  }
+
+  void Delete(const PageHeapTraceRecord& record) {
+    auto it = live_.find(record.page);
+    if (it == live_.end()) {
+      // The span's allocation was dropped.
+      ++stats_.skipped_records;
+      return;
+    }
+    const LiveSpan live = it->second;
+    live_.erase(it);
+    const int64_t start = absl::base_internal::CycleClock::Now();
+    {
+      PageHeapSpinLockHolder l;
+      live.allocator->Delete(live.span, live.objects_per_span);
+    }
+    Account(record.op, start);
+  }
+
+  void Release(const PageHeapTraceRecord& record) {
+    const Length requested(record.page);
+    const PageReleaseReason reason =
+        static_cast<PageReleaseReason>(record.tag);
+    const int64_t start = absl::base_internal::CycleClock::Now();
+    {
+      PageHeapSpinLockHolder l;
+      Length released;
+      for (MemoryTag tag : kReleaseOrder) {
+        Allocator* allocator = allocators_[static_cast<uint8_t>(tag)];
+        if (allocator == nullptr || released >= requested) {
+          continue;
+        }
+        if (record.op == PageHeapTraceRecord::kRelease) {
+          released +=
+              allocator->ReleaseAtLeastNPages(requested - released, reason);
+        } else {
+          released += allocator->ReleaseAtLeastNPagesBreakingHugepages(
+              requested - released, reason);
+        }
+      }
+    }
+    Account(record.op, start);
+  }
+
+  const double ns_per_cycle_;
+  const PageHeapTraceReplayOptions& options_;
+  std::array<Allocator*, 256> allocators_ = {};
+  absl::flat_hash_map<uint64_t, LiveSpan> live_;
+  PageHeapTraceReplayStats stats_;
+};
+
+}  // namespace
+
+bool ParsePageHeapTrace(absl::string_view data, PageHeapTrace* trace) {
+  PageHeapTraceHeader header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != PageHeapTraceHeader::kMagic ||
+      header.record_size != sizeof(PageHeapTraceRecord) ||
+      header.page_shift != kPageShift || !(header.cycles_per_second > 0)) {
+    return false;
+  }
+  data.remove_prefix(sizeof(header));
+
+  // A trace cut short while being written may end in a partial record.
+  trace->cycles_per_second = header.cycles_per_second;
+  trace->records.resize(data.size() / sizeof(PageHeapTraceRecord));
+  memcpy(trace->records.data(), data.data(),
+         trace->records.size() * sizeof(PageHeapTraceRecord));
+  return true;
+}
+
+PageHeapTraceReplayStats ReplayPageHeapTrace(
+    const PageHeapTrace& trace, const PageHeapTraceReplayOptions& options) {
+  Replayer replayer(trace.cycles_per_second, options);
+  for (const PageHeapTraceRecord& record : trace.records) {
+    replayer.Replay(record);
+  }
+  PageHeapTraceReplayStats stats = replayer.Finish();
+  if (!trace.records.empty()) {
+    stats.trace_seconds =
+        (trace.records.back().cycles - trace.records.front().cycles) /
+        trace.cycles_per_second;
+  }
+  return stats;
+}
+
+void PrintPageHeapTraceReplayStats(Printer* out,
+                                   const PageHeapTraceReplayStats& stats) {
+  constexpr double MiB = 1048576.0;
+  out->printf(
+      "Replayed %zu records over %.3f s of trace (%zu dropped by the tracer, "
+      "%zu skipped)\n",
+      stats.records, stats.trace_seconds, stats.dropped_records,
+      stats.skipped_records);
+  out->printf("Footprint: %.1f MiB peak backed, %.1f MiB backed at end\n",
+              stats.peak_backed_bytes / MiB, stats.final_backed_bytes / MiB);
+  out->printf(
+      "Hugepage coverage: %.4f of %.1f MiB in use at end is on intact "
+      "hugepages\n",
+      stats.hugepage_coverage, stats.final_used_bytes / MiB);
+
+  constexpr absl::string_view kOpNames[] = {"New", "Delete", "Release",
+                                            "ReleaseBreakingHugepages"};
+  out->printf("Estimated pageheap_lock hold times:\n");
+  for (size_t op = 0; op < std::size(kOpNames); ++op) {
+    const PageHeapTraceReplayStats::OpStats& s = stats.ops[op];
+    out->printf("  %-24s %10zu ops, %12.3f ms total, %8.1f ns mean, "
+                "%10.1f ns max\n",
+                kOpNames[op], s.count, s.total_ns / 1e6,
+                s.count > 0 ? s.total_ns / s.count : 0.0, s.max_ns);
+  }
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
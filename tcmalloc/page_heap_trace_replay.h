@@ -0,0 +1,109 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_PAGE_HEAP_TRACE_REPLAY_H_
+#define TCMALLOC_PAGE_HEAP_TRACE_REPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/page_heap_trace.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// A page heap trace written by PageHeapTracer.
+struct PageHeapTrace {
+  double cycles_per_second = 0;
+  std::vector<PageHeapTraceRecord> records;
+};
+
+// Parses the contents of a trace file into *trace.  Returns false if data is
+// not a trace written with this build's record layout and page size.
+bool ParsePageHeapTrace(absl::string_view data, PageHeapTrace* trace);
+
+struct PageHeapTraceReplayOptions {
+  // Configuration of the replayed allocators.  The tag is taken from the
+  // trace.
+  huge_page_allocator_internal::HugePageAwareAllocatorOptions allocator;
+
+  absl::Duration filler_skip_subrelease_interval = absl::ZeroDuration();
+  absl::Duration filler_skip_subrelease_short_interval = absl::ZeroDuration();
+  absl::Duration filler_skip_subrelease_long_interval = absl::ZeroDuration();
+  bool release_partial_alloc_pages = false;
+
+  // Runs the allocators' time-based policies on the trace's own clock, which
+  // reads the cycle count of the record being replayed, rather than the real
+  // one.  A trace then replays the same way every time, with the footprint it
+  // had when it was captured, however fast the replay runs.  Only one replay
+  // may use the trace clock at a time.
+  bool trace_clock = false;
+};
+
+struct PageHeapTraceReplayStats {
+  struct OpStats {
+    size_t count = 0;
+    double total_ns = 0;
+    double max_ns = 0;
+  };
+
+  size_t records = 0;
+  // Records the tracer lost to a full buffer.
+  size_t dropped_records = 0;
+  // Records that could not be replayed, such as deletes of spans whose
+  // allocation was dropped.
+  size_t skipped_records = 0;
+  // Wall time covered by the trace.
+  double trace_seconds = 0;
+
+  // Bytes backed by the replayed allocators, at peak and at the end.
+  size_t peak_backed_bytes = 0;
+  size_t final_backed_bytes = 0;
+  // Bytes in live spans at the end.
+  size_t final_used_bytes = 0;
+  // Estimated fraction of the bytes in live spans at the end that are on
+  // intact hugepages.
+  double hugepage_coverage = 1;
+
+  // Time spent in the replayed allocators per operation.  Each operation runs
+  // under pageheap_lock, so this estimates how long it would hold the lock.
+  OpStats ops[PageHeapTraceRecord::kNumOps];
+};
+
+// Replays trace against HugePageAwareAllocators, one per memory tag in the
+// trace, backed by FakeStaticForwarder rather than real memory.  Releases are
+// spread across the allocators in PageAllocator's order, taking partitions in
+// index order.
+//
+// Unless options.trace_clock is set, the allocators run on the real clock, so
+// time-based policies (the HugeCache's release delay and the skip-subrelease
+// intervals) see the trace compressed into the time it takes to replay.  The
+// hold times in the stats are always measured on the real clock.  Replayed
+// allocators never share a HugeCacheBudget with other processes.
+PageHeapTraceReplayStats ReplayPageHeapTrace(
+    const PageHeapTrace& trace, const PageHeapTraceReplayOptions& options);
+
+void PrintPageHeapTraceReplayStats(Printer* out,
+                                   const PageHeapTraceReplayStats& stats);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_PAGE_HEAP_TRACE_REPLAY_H_
@@ -0,0 +1,155 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a page heap trace, recorded by running a binary with
+// TCMALLOC_PAGE_HEAP_TRACE_FILE set, against HugePageAwareAllocator with the
+// given tuning, and prints the resulting footprint, hugepage coverage and
+// estimated pageheap_lock hold times.  Options not given on the command line
+// keep TCMalloc's defaults.
+//
+// Usage: page_heap_trace_replay --chunks_per_alloc=8 <trace file>
+
+#include <stdio.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/reflection.h"
+#include "absl/time/time.h"
+#include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/huge_page_filler.h"
+#include "tcmalloc/huge_region.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/page_heap_trace_replay.h"
+
+ABSL_FLAG(int, chunks_per_alloc, 0, "HugePageFiller chunks per allocation");
+ABSL_FLAG(bool, use_huge_region_more_often, false,
+          "Use HugeRegion for all large allocations");
+ABSL_FLAG(bool, separate_allocs, true,
+          "Keep spans with few and many objects on separate hugepages");
+ABSL_FLAG(absl::Duration, huge_cache_time, absl::Seconds(1),
+          "How long HugeCache keeps free hugepages backed");
+ABSL_FLAG(bool, huge_cache_demand_forecast, false,
+          "Size HugeCache from demand peaks over several horizons");
+ABSL_FLAG(bool, huge_allocator_best_fit, false,
+          "Carve hugepage ranges from the best-fitting free range");
+ABSL_FLAG(bool, huge_region_subrelease, false,
+          "Release free pages of partly used hugepages in HugeRegions");
+ABSL_FLAG(absl::Duration, skip_subrelease_interval, absl::ZeroDuration(),
+          "Demand interval for skipping subrelease");
+ABSL_FLAG(absl::Duration, skip_subrelease_short_interval, absl::ZeroDuration(),
+          "Short-term demand interval for skipping subrelease");
+ABSL_FLAG(absl::Duration, skip_subrelease_long_interval, absl::ZeroDuration(),
+          "Long-term demand interval for skipping subrelease");
+ABSL_FLAG(bool, release_partial_alloc_pages, false,
+          "Release free pages of partially used hugepages");
+ABSL_FLAG(bool, trace_clock, true,
+          "Run time-based policies on the trace's timestamps, so that replays "
+          "are deterministic");
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+template <typename T>
+bool Specified(const absl::Flag<T>& flag) {
+  return absl::GetFlagReflectionHandle(flag).IsSpecifiedOnCommandLine();
+}
+
+PageHeapTraceReplayOptions OptionsFromFlags() {
+  PageHeapTraceReplayOptions options;
+  auto& allocator = options.allocator;
+  if (Specified(FLAGS_chunks_per_alloc)) {
+    allocator.chunks_per_alloc = absl::GetFlag(FLAGS_chunks_per_alloc);
+  }
+  if (Specified(FLAGS_use_huge_region_more_often)) {
+    allocator.use_huge_region_more_often =
+        absl::GetFlag(FLAGS_use_huge_region_more_often)
+            ? HugeRegionUsageOption::kUseForAllLargeAllocs
+            : HugeRegionUsageOption::kDefault;
+  }
+  if (Specified(FLAGS_separate_allocs)) {
+    allocator.allocs_for_sparse_and_dense_spans =
+        absl::GetFlag(FLAGS_separate_allocs)
+            ? HugePageFillerAllocsOption::kSeparateAllocs
+            : HugePageFillerAllocsOption::kUnifiedAllocs;
+  }
+  if (Specified(FLAGS_huge_cache_time)) {
+    allocator.huge_cache_time = absl::GetFlag(FLAGS_huge_cache_time);
+  }
+  if (Specified(FLAGS_huge_cache_demand_forecast)) {
+    allocator.huge_cache_demand_intervals =
+        absl::GetFlag(FLAGS_huge_cache_demand_forecast)
+            ? kDefaultHugeCacheDemandIntervals
+            : HugeCacheDemandIntervals{};
+  }
+  if (Specified(FLAGS_huge_allocator_best_fit)) {
+    allocator.huge_allocator_fit = absl::GetFlag(FLAGS_huge_allocator_best_fit)
+                                       ? HugeAllocatorFit::kBestFit
+                                       : HugeAllocatorFit::kApproximate;
+  }
+  if (Specified(FLAGS_huge_region_subrelease)) {
+    allocator.huge_region_release =
+        absl::GetFlag(FLAGS_huge_region_subrelease)
+            ? HugeRegionReleaseOption::kSubreleasePartialHugepages
+            : HugeRegionReleaseOption::kFreeHugepagesOnly;
+  }
+  options.filler_skip_subrelease_interval =
+      absl::GetFlag(FLAGS_skip_subrelease_interval);
+  options.filler_skip_subrelease_short_interval =
+      absl::GetFlag(FLAGS_skip_subrelease_short_interval);
+  options.filler_skip_subrelease_long_interval =
+      absl::GetFlag(FLAGS_skip_subrelease_long_interval);
+  options.release_partial_alloc_pages =
+      absl::GetFlag(FLAGS_release_partial_alloc_pages);
+  options.trace_clock = absl::GetFlag(FLAGS_trace_clock);
+  return options;
+}
+
+int Main(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  PageHeapTrace trace;
+  if (!file || !ParsePageHeapTrace(data, &trace)) {
+    fprintf(stderr, "%s is not a page heap trace\n", path);
+    return 1;
+  }
+
+  const PageHeapTraceReplayStats stats =
+      ReplayPageHeapTrace(trace, OptionsFromFlags());
+  std::string buffer(1 << 16, '\0');
+  Printer printer(buffer.data(), buffer.size());
+  PrintPageHeapTraceReplayStats(&printer, stats);
+  fputs(buffer.c_str(), stdout);
+  return 0;
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+int main(int argc, char** argv) {
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 2) {
+    fprintf(stderr, "usage: %s [flags] <trace file>\n", args[0]);
+    return 1;
+  }
+  return tcmalloc::tcmalloc_internal::Main(args[1]);
+}
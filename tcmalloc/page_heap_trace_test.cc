@@ -0,0 +1,269 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/page_heap_trace.h"
+
+#include <errno.h>
+#include <linux/memfd.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_cache.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/page_heap_trace_replay.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/stats.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+int memfd_create(const char* name, unsigned int flags) {
+#ifdef __NR_memfd_create
+  return syscall(__NR_memfd_create, name, flags);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Returns everything written to fd so far.
+std::string Contents(int fd) {
+  struct stat st;
+  TC_CHECK_EQ(fstat(fd, &st), 0);
+  std::string data(st.st_size, '\0');
+  TC_CHECK_EQ(pread(fd, data.data(), data.size(), 0), data.size());
+  return data;
+}
+
+TEST(PageHeapTracerTest, RoundTrip) {
+  const int fd = memfd_create("trace", MFD_CLOEXEC);
+  ASSERT_NE(fd, -1);
+  PageHeapTracer tracer;
+  ASSERT_TRUE(tracer.Start(dup(fd)));
+  EXPECT_TRUE(tracer.enabled());
+
+  Span span;
+  span.Init(PageId{1234}, Length(3));
+  {
+    PageHeapSpinLockHolder l;
+    tracer.RecordNew(&span, Length(2),
+                     {.objects_per_span = 7,
+                      .density = AccessDensityPrediction::kDense},
+                     MemoryTag::kCold);
+    tracer.RecordRelease(PageHeapTraceRecord::kRelease, Length(10), Length(4),
+                         PageReleaseReason::kReleaseMemoryToSystem);
+    tracer.RecordDelete(&span, 7, MemoryTag::kCold);
+  }
+  tracer.Flush();
+
+  PageHeapTrace trace;
+  ASSERT_TRUE(ParsePageHeapTrace(Contents(fd), &trace));
+  EXPECT_GT(trace.cycles_per_second, 0);
+  ASSERT_EQ(trace.records.size(), 3);
+
+  const PageHeapTraceRecord& alloc = trace.records[0];
+  EXPECT_EQ(alloc.op, PageHeapTraceRecord::kNew);
+  EXPECT_EQ(alloc.page, 1234);
+  EXPECT_EQ(alloc.length, 3);
+  EXPECT_EQ(alloc.align_or_objects, 2);
+  EXPECT_EQ(alloc.objects_per_span, 7);
+  EXPECT_EQ(alloc.tag, static_cast<uint8_t>(MemoryTag::kCold));
+  EXPECT_EQ(alloc.density, AccessDensityPrediction::kDense);
+
+  const PageHeapTraceRecord& release = trace.records[1];
+  EXPECT_EQ(release.op, PageHeapTraceRecord::kRelease);
+  EXPECT_EQ(release.page, 10);
+  EXPECT_EQ(release.length, 4);
+  EXPECT_EQ(release.tag,
+            static_cast<uint8_t>(PageReleaseReason::kReleaseMemoryToSystem));
+
+  const PageHeapTraceRecord& free = trace.records[2];
+  EXPECT_EQ(free.op, PageHeapTraceRecord::kDelete);
+  EXPECT_EQ(free.page, 1234);
+  EXPECT_EQ(free.length, 3);
+  EXPECT_EQ(free.align_or_objects, 7);
+  EXPECT_LE(alloc.cycles, release.cycles);
+  EXPECT_LE(release.cycles, free.cycles);
+
+  close(fd);
+}
+
+TEST(PageHeapTracerTest, Dropped) {
+  const int fd = memfd_create("trace", MFD_CLOEXEC);
+  ASSERT_NE(fd, -1);
+  PageHeapTracer tracer;
+  ASSERT_TRUE(tracer.Start(dup(fd)));
+
+  constexpr size_t kExtra = 5;
+  Span span;
+  span.Init(PageId{1}, Length(1));
+  for (int flush = 0; flush < 2; ++flush) {
+    {
+      PageHeapSpinLockHolder l;
+      for (size_t i = 0; i < PageHeapTracer::kBufferRecords + kExtra; ++i) {
+        tracer.RecordDelete(&span, 1, MemoryTag::kNormal);
+      }
+    }
+    tracer.Flush();
+  }
+
+  PageHeapTrace trace;
+  ASSERT_TRUE(ParsePageHeapTrace(Contents(fd), &trace));
+  ASSERT_EQ(trace.records.size(), 2 * (PageHeapTracer::kBufferRecords + 1));
+  for (size_t end : {PageHeapTracer::kBufferRecords,
+                     2 * PageHeapTracer::kBufferRecords + 1}) {
+    EXPECT_EQ(trace.records[end].op, PageHeapTraceRecord::kDropped);
+    EXPECT_EQ(trace.records[end].page, kExtra);
+  }
+
+  close(fd);
+}
+
+TEST(PageHeapTraceReplayTest, RejectsOtherFiles) {
+  PageHeapTrace trace;
+  EXPECT_FALSE(ParsePageHeapTrace("", &trace));
+  EXPECT_FALSE(ParsePageHeapTrace(std::string(64, 'x'), &trace));
+}
+
+TEST(PageHeapTraceReplayTest, Replay) {
+  PageHeapTrace trace;
+  trace.cycles_per_second = 1e9;
+  uint64_t now = 0;
+  auto add = [&](PageHeapTraceRecord record) {
+    record.cycles = now++;
+    trace.records.push_back(record);
+  };
+
+  // Fill most of a hugepage with small spans, free every other one and
+  // release what we can.
+  constexpr size_t kSpans = 64;
+  constexpr uint64_t kBase = 1 << 20;
+  for (size_t i = 0; i < kSpans; ++i) {
+    add({.page = kBase + 2 * i,
+         .length = 2,
+         .align_or_objects = 1,
+         .objects_per_span = 1,
+         .op = PageHeapTraceRecord::kNew,
+         .tag = static_cast<uint8_t>(MemoryTag::kNormal)});
+  }
+  for (size_t i = 0; i < kSpans; i += 2) {
+    add({.page = kBase + 2 * i,
+         .length = 2,
+         .align_or_objects = 1,
+         .op = PageHeapTraceRecord::kDelete,
+         .tag = static_cast<uint8_t>(MemoryTag::kNormal)});
+  }
+  add({.page = kPagesPerHugePage.raw_num(),
+       .op = PageHeapTraceRecord::kReleaseBreakingHugepages,
+       .tag = static_cast<uint8_t>(PageReleaseReason::kReleaseMemoryToSystem)});
+  // The allocation of this span was dropped by the tracer.
+  add({.page = 7, .op = PageHeapTraceRecord::kDropped});
+  add({.page = 1,
+       .length = 1,
+       .op = PageHeapTraceRecord::kDelete,
+       .tag = static_cast<uint8_t>(MemoryTag::kNormal)});
+
+  const PageHeapTraceReplayStats stats =
+      ReplayPageHeapTrace(trace, PageHeapTraceReplayOptions{});
+  EXPECT_EQ(stats.records, trace.records.size());
+  EXPECT_EQ(stats.dropped_records, 7);
+  EXPECT_EQ(stats.skipped_records, 1);
+  EXPECT_EQ(stats.ops[PageHeapTraceRecord::kNew].count, kSpans);
+  EXPECT_EQ(stats.ops[PageHeapTraceRecord::kDelete].count, kSpans / 2);
+  EXPECT_EQ(stats.ops[PageHeapTraceRecord::kReleaseBreakingHugepages].count,
+            1);
+  EXPECT_GE(stats.peak_backed_bytes, kHugePageSize);
+  EXPECT_EQ(stats.final_used_bytes, kSpans * Length(2).in_bytes() / 2);
+  // Releasing the freed spans broke up the hugepage they shared with the
+  // live ones.
+  EXPECT_LT(stats.final_backed_bytes, stats.peak_backed_bytes);
+  EXPECT_LT(stats.hugepage_coverage, 1);
+
+  std::string buffer(1 << 14, '\0');
+  Printer printer(buffer.data(), buffer.size());
+  PrintPageHeapTraceReplayStats(&printer, stats);
+  EXPECT_NE(buffer.find("Hugepage coverage"), std::string::npos);
+}
+
+// Frees hugepages, then asks for them back 1 s and 2 h later.  The demand
+// forecast keeps them cached for an hour of the clock it runs on.
+TEST(PageHeapTraceReplayTest, TraceClock) {
+  PageHeapTrace trace;
+  trace.cycles_per_second = 1e9;
+  constexpr uint64_t kSecond = 1000000000;
+  constexpr size_t kHugepages = 20;
+  constexpr uint64_t kBase = 1 << 20;
+  for (size_t i = 0; i < kHugepages; ++i) {
+    trace.records.push_back(
+        {.cycles = i,
+         .page = kBase + i * kPagesPerHugePage.raw_num(),
+         .length = static_cast<uint32_t>(kPagesPerHugePage.raw_num()),
+         .align_or_objects = 1,
+         .objects_per_span = 1,
+         .op = PageHeapTraceRecord::kNew,
+         .tag = static_cast<uint8_t>(MemoryTag::kNormal)});
+  }
+  for (size_t i = 0; i < kHugepages; ++i) {
+    trace.records.push_back(
+        {.cycles = kSecond + i,
+         .page = kBase + i * kPagesPerHugePage.raw_num(),
+         .length = static_cast<uint32_t>(kPagesPerHugePage.raw_num()),
+         .align_or_objects = 1,
+         .op = PageHeapTraceRecord::kDelete,
+         .tag = static_cast<uint8_t>(MemoryTag::kNormal)});
+  }
+  for (uint64_t cycles : {2 * kSecond, 7202 * kSecond}) {
+    trace.records.push_back(
+        {.cycles = cycles,
+         .page = NHugePages(kHugepages).in_pages().raw_num(),
+         .op = PageHeapTraceRecord::kRelease,
+         .tag = static_cast<uint8_t>(
+             PageReleaseReason::kReleaseMemoryToSystem)});
+  }
+
+  PageHeapTraceReplayOptions options;
+  options.allocator.huge_cache_demand_intervals =
+      kDefaultHugeCacheDemandIntervals;
+
+  // On the real clock, the replay takes far less than an hour.
+  const PageHeapTraceReplayStats real = ReplayPageHeapTrace(trace, options);
+  EXPECT_EQ(real.peak_backed_bytes, kHugepages * kHugePageSize);
+  EXPECT_EQ(real.final_backed_bytes, kHugepages * kHugePageSize);
+
+  options.trace_clock = true;
+  const PageHeapTraceReplayStats replayed =
+      ReplayPageHeapTrace(trace, options);
+  EXPECT_EQ(replayed.peak_backed_bytes, kHugepages * kHugePageSize);
+  EXPECT_EQ(replayed.final_backed_bytes, 0);
+
+  // As often as it is replayed.
+  const PageHeapTraceReplayStats again = ReplayPageHeapTrace(trace, options);
+  EXPECT_EQ(again.peak_backed_bytes, replayed.peak_backed_bytes);
+  EXPECT_EQ(again.final_backed_bytes, replayed.final_backed_bytes);
+  EXPECT_EQ(again.final_used_bytes, replayed.final_used_bytes);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,148 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/pageheap_lock_profiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "absl/base/const_init.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/debugging/stacktrace.h"
+#include "absl/functional/function_ref.h"
+#include "absl/hash/hash.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+struct Slot {
+  size_t hash = 0;
+  int depth = 0;
+  void* stack[kMaxStackDepth] = {};
+  int64_t acquisitions = 0;
+  int64_t wait_cycles = 0;
+  int64_t hold_cycles = 0;
+};
+
+ABSL_CONST_INIT absl::base_internal::SpinLock lock(
+    absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
+ABSL_CONST_INIT Slot slots[PageHeapLockProfiler::kSize] ABSL_GUARDED_BY(lock);
+// When the first acquisition was recorded.
+ABSL_CONST_INIT absl::Time first_recorded ABSL_GUARDED_BY(lock) =
+    absl::InfinitePast();
+ABSL_CONST_INIT std::atomic<uint64_t> dropped_count(0);
+
+class LockContentionProfile final : public ProfileBase {
+ public:
+  LockContentionProfile()
+      : slots_(std::make_unique<Slot[]>(PageHeapLockProfiler::kSize)) {}
+
+  // Copies the recorded acquisitions.  The copy is allocated beforehand, as
+  // allocating under the lock could record an acquisition, and deadlock.
+  void Snapshot() ABSL_LOCKS_EXCLUDED(lock) {
+    AllocationGuardSpinLockHolder h(&lock);
+    std::copy(std::begin(slots), std::end(slots), slots_.get());
+    if (first_recorded != absl::InfinitePast()) {
+      duration_ = absl::Now() - first_recorded;
+    }
+  }
+
+  void Iterate(
+      absl::FunctionRef<void(const Profile::Sample&)> f) const override {
+    const double ns_per_cycle =
+        1e9 / absl::base_internal::CycleClock::Frequency();
+    for (size_t i = 0; i < PageHeapLockProfiler::kSize; ++i) {
+      const Slot& slot = slots_[i];
+      if (slot.hash == 0) {
+        continue;
+      }
+
+      Profile::Sample sample = {};
+      sample.depth = slot.depth;
+      std::copy(slot.stack, slot.stack + slot.depth, sample.stack);
+      sample.count = slot.acquisitions;
+      sample.lock_wait_time =
+          absl::Nanoseconds(slot.wait_cycles * ns_per_cycle);
+      sample.lock_hold_time =
+          absl::Nanoseconds(slot.hold_cycles * ns_per_cycle);
+      sample.sum = absl::ToInt64Nanoseconds(sample.lock_wait_time);
+      f(sample);
+    }
+  }
+
+  ProfileType Type() const override { return ProfileType::kLockContention; }
+
+  absl::Duration Duration() const override { return duration_; }
+
+ private:
+  std::unique_ptr<Slot[]> slots_;
+  absl::Duration duration_;
+};
+
+}  // namespace
+
+void PageHeapLockProfiler::Record(int64_t weight, int64_t wait, int64_t hold) {
+  void* stack[kMaxStackDepth];
+  const int depth = absl::GetStackTrace(stack, kMaxStackDepth, 1);
+  const size_t hash =
+      std::max<size_t>(absl::HashOf(absl::MakeConstSpan(stack, depth)), 1);
+
+  AllocationGuardSpinLockHolder h(&lock);
+  for (size_t i = 0; i < kProbes; ++i) {
+    Slot& slot = slots[(hash + i) % kSize];
+    if (slot.hash != 0 && slot.hash != hash) {
+      continue;
+    }
+    if (slot.hash == 0) {
+      slot.hash = hash;
+      slot.depth = depth;
+      std::copy(stack, stack + depth, slot.stack);
+      if (first_recorded == absl::InfinitePast()) {
+        first_recorded = absl::Now();
+      }
+    }
+    slot.acquisitions += weight;
+    slot.wait_cycles += std::max<int64_t>(wait, 0) * weight;
+    slot.hold_cycles += std::max<int64_t>(hold, 0) * weight;
+    return;
+  }
+  dropped_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::unique_ptr<ProfileBase> PageHeapLockProfiler::DumpSample() {
+  auto profile = std::make_unique<LockContentionProfile>();
+  profile->Snapshot();
+  return profile;
+}
+
+uint64_t PageHeapLockProfiler::dropped() {
+  return dropped_count.load(std::memory_order_relaxed);
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
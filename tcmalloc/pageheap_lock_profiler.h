@@ -0,0 +1,123 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_PAGEHEAP_LOCK_PROFILER_H_
+#define TCMALLOC_PAGEHEAP_LOCK_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/parameters.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// PageHeapLockProfiler aggregates, per acquiring stack, how long sampled
+// acquisitions of pageheap_lock waited for the lock and then held it.
+//
+// Sampling is off unless pageheap_lock_contention_sampling_interval is
+// positive, in which case roughly one in that many acquisitions is timed and
+// stands for that many in the profile.  Samples are recorded after the lock
+// is released, under a lock of the profiler's own that is never held while
+// acquiring another, so recording never extends the time pageheap_lock is
+// held.
+class PageHeapLockProfiler {
+ public:
+  // The number of distinct stacks tracked.  Acquisitions from further stacks
+  // are dropped.
+  static constexpr size_t kSize = 128;
+  static constexpr size_t kProbes = 8;
+
+  // Accounts for a sampled acquisition from the caller's stack, standing for
+  // `weight` acquisitions, which waited `wait` and held `hold` cycles.
+  ABSL_ATTRIBUTE_NOINLINE static void Record(int64_t weight, int64_t wait,
+                                             int64_t hold);
+
+  // Returns the acquisitions recorded so far.
+  static std::unique_ptr<ProfileBase> DumpSample();
+
+  // Returns the number of sampled acquisitions that found no slot.
+  static uint64_t dropped();
+};
+
+// PageHeapLockSample times one acquisition of pageheap_lock, if it is
+// sampled: from its construction to Acquired() is the wait, from there to
+// Releasing() the hold.  Holders that drop the lock temporarily, such as to
+// back memory, count the time without it as held.
+class PageHeapLockSample {
+ public:
+  PageHeapLockSample() {
+    const int64_t interval =
+        Parameters::pageheap_lock_contention_sampling_interval();
+    if (ABSL_PREDICT_TRUE(interval <= 0)) {
+      return;
+    }
+    StartSlow(interval);
+  }
+
+  ~PageHeapLockSample() {
+    if (ABSL_PREDICT_FALSE(weight_ != 0)) {
+      PageHeapLockProfiler::Record(weight_, acquired_ - start_,
+                                   released_ - acquired_);
+    }
+  }
+
+  PageHeapLockSample(const PageHeapLockSample&) = delete;
+  PageHeapLockSample& operator=(const PageHeapLockSample&) = delete;
+
+  void Acquired() {
+    if (ABSL_PREDICT_FALSE(weight_ != 0)) {
+      acquired_ = absl::base_internal::CycleClock::Now();
+    }
+  }
+
+  void Releasing() {
+    if (ABSL_PREDICT_FALSE(weight_ != 0)) {
+      released_ = absl::base_internal::CycleClock::Now();
+    }
+  }
+
+ private:
+  void StartSlow(int64_t interval) {
+    const int64_t now = absl::base_internal::CycleClock::Now();
+    // The low bits of the cycle counter pick acquisitions about as well as a
+    // random number would, without a shared counter.  The lowest bits are
+    // dropped as some clocks do not tick them.
+    if (interval > 1 && (static_cast<uint64_t>(now) >> 4) % interval != 0) {
+      return;
+    }
+    weight_ = interval;
+    start_ = now;
+    acquired_ = now;
+    released_ = now;
+  }
+
+  // The number of acquisitions this one stands for, or 0 if it is not timed.
+  int64_t weight_ = 0;
+  int64_t start_ = 0;
+  int64_t acquired_ = 0;
+  int64_t released_ = 0;
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_PAGEHEAP_LOCK_PROFILER_H_
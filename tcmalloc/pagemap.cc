@@ -39,6 +39,12 @@ void PageMap::RegisterSizeClass(Span* span, size_t sc) {
   for (PageId p = first; p <= last; ++p) {
     map_.set_with_sizeclass(p.index(), span, sc);
   }
+  MarkChanged(first);
+  if (flat_.enabled()) {
+    for (PageId p = first; p <= last; ++p) {
+      flat_.set_sizeclass(p.index(), sc);
+    }
+  }
 }
 
 void PageMap::UnregisterSizeClass(Span* span) {
@@ -49,6 +55,12 @@ void PageMap::UnregisterSizeClass(Span* span) {
   for (PageId p = first; p <= last; ++p) {
     map_.clear_sizeclass(p.index());
   }
+  MarkChanged(first);
+  if (flat_.enabled()) {
+    for (PageId p = first; p <= last; ++p) {
+      flat_.set_sizeclass(p.index(), 0);
+    }
+  }
 }
 
 void PageMap::MapRootWithSmallPages() {
@@ -72,8 +84,21 @@ void PageMap::MapRootWithSmallPages() {
   }
 }
 
+void* ReserveFlatSizeClassMap(size_t bytes) {
+  ErrnoRestorer errno_restorer;
+  void* result = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (result == MAP_FAILED) {
+    return nullptr;
+  }
+  // The array is sparse: on hugepages, recording a single size class would
+  // back the 2MiB of the array around it.
+  madvise(result, bytes, MADV_NOHUGEPAGE);
+  return result;
+}
+
 void* MetaDataAlloc(size_t bytes) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
-  return tc_globals.arena().Alloc(bytes);
+  return tc_globals.arena().Alloc(bytes, kAlignment, ArenaUse::kPagemap);
 }
 
 }  // namespace tcmalloc_internal
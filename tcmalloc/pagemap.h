@@ -30,11 +30,13 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <atomic>
 #include <optional>
 #include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
@@ -52,6 +54,22 @@ namespace tcmalloc_internal {
 typedef void* (*PagemapAllocator)(size_t);
 void* MetaDataAlloc(size_t bytes);
 
+// Zeroes a newly allocated radix tree node.  Memory fresh from the system is
+// already zero, and reading it maps the kernel's shared zero page rather than
+// backing it, so we only write to nodes that need it.  Most of a leaf is never
+// written (large spans only set their first and last pages), and stays
+// unbacked.
+inline void ClearPageMapNode(void* node, size_t bytes) {
+  TC_ASSERT_EQ(bytes % sizeof(uintptr_t), 0);
+  const uintptr_t* words = reinterpret_cast<const uintptr_t*>(node);
+  for (size_t i = 0; i < bytes / sizeof(uintptr_t); ++i) {
+    if (words[i] != 0) {
+      memset(node, 0, bytes);
+      return;
+    }
+  }
+}
+
 template <int BITS, PagemapAllocator Allocator>
 class PageMap2 {
  private:
@@ -79,6 +97,8 @@ class PageMap2 {
     CompactSizeClass sizeclass[kLeafLength];
     Span* span[kLeafLength];
     void* hugepage[kLeafHugepages];
+    // The last epoch at which an entry of the leaf changed.  See PageMap.
+    uint64_t epoch;
   };
 
   Leaf* root_[kRootLength];  // Top-level node
@@ -87,6 +107,8 @@ class PageMap2 {
  public:
   typedef uintptr_t Number;
 
+  static constexpr Number kPagesPerLeaf = kLeafLength;
+
   constexpr PageMap2() : root_{}, bytes_used_(0) {}
 
   // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
@@ -113,6 +135,23 @@ class PageMap2 {
     return std::nullopt;
   }
 
+  // Returns the first page of the first leaf at or after the one covering k
+  // whose epoch is at least since, if that page is below limit.
+  std::optional<Number> get_next_changed_leaf(Number k, Number limit,
+                                              uint64_t since) const {
+    for (Number i1 = k >> kLeafBits; i1 < kRootLength; ++i1) {
+      if ((i1 << kLeafBits) >= limit) break;
+      const Leaf* leaf = root_[i1];
+      if (leaf != nullptr && leaf->epoch >= since) return i1 << kLeafBits;
+    }
+    return std::nullopt;
+  }
+
+  // REQUIRES: Ensure(k, 1) has succeeded.
+  void set_epoch(Number k, uint64_t epoch) {
+    root_[k >> kLeafBits]->epoch = epoch;
+  }
+
   // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
   // Requires that the span is known to already exist.
   Span* get_existing(Number k) const ABSL_NO_THREAD_SAFETY_ANALYSIS {
@@ -186,7 +225,7 @@ class PageMap2 {
         Leaf* leaf = reinterpret_cast<Leaf*>(Allocator(sizeof(Leaf)));
         if (leaf == nullptr) return false;
         bytes_used_ += sizeof(Leaf);
-        memset(leaf, 0, sizeof(*leaf));
+        ClearPageMapNode(leaf, sizeof(*leaf));
         root_[i1] = leaf;
       }
 
@@ -206,7 +245,8 @@ class PageMap2 {
 };
 
 // Three-level radix tree
-// Currently only used for TCMALLOC_INTERNAL_SMALL_BUT_SLOW
+// Currently only used for TCMALLOC_INTERNAL_SMALL_BUT_SLOW and
+// TCMALLOC_INTERNAL_SMALL_FOOTPRINT
 template <int BITS, PagemapAllocator Allocator>
 class PageMap3 {
  private:
@@ -240,6 +280,8 @@ class PageMap3 {
     CompactSizeClass sizeclass[kLeafLength];
     Span* span[kLeafLength];
     void* hugepage[kLeafHugepages];
+    // The last epoch at which an entry of the leaf changed.  See PageMap.
+    uint64_t epoch;
   };
 
   struct Node {
@@ -253,6 +295,8 @@ class PageMap3 {
  public:
   typedef uintptr_t Number;
 
+  static constexpr Number kPagesPerLeaf = kLeafLength;
+
   constexpr PageMap3() : root_{}, bytes_used_(0) {}
 
   // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
@@ -286,6 +330,33 @@ class PageMap3 {
     return std::nullopt;
   }
 
+  // Returns the first page of the first leaf at or after the one covering k
+  // whose epoch is at least since, if that page is below limit.
+  std::optional<Number> get_next_changed_leaf(Number k, Number limit,
+                                              uint64_t since) const {
+    Number i1 = k >> (kLeafBits + kMidBits);
+    Number i2 = (k >> kLeafBits) & (kMidLength - 1);
+    for (; i1 < kRootLength; ++i1, i2 = 0) {
+      if ((i1 << (kLeafBits + kMidBits)) >= limit) break;
+      const Node* node = root_[i1];
+      if (node == nullptr) continue;
+      for (; i2 < kMidLength; ++i2) {
+        const Number start = (i1 << (kLeafBits + kMidBits)) | (i2 << kLeafBits);
+        if (start >= limit) return std::nullopt;
+        const Leaf* leaf = node->leafs[i2];
+        if (leaf != nullptr && leaf->epoch >= since) return start;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // REQUIRES: Ensure(k, 1) has succeeded.
+  void set_epoch(Number k, uint64_t epoch) {
+    const Number i1 = k >> (kLeafBits + kMidBits);
+    const Number i2 = (k >> kLeafBits) & (kMidLength - 1);
+    root_[i1]->leafs[i2]->epoch = epoch;
+  }
+
   // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
   // Requires that the span is known to already exist.
   Span* get_existing(Number k) const ABSL_NO_THREAD_SAFETY_ANALYSIS {
@@ -370,7 +441,7 @@ class PageMap3 {
         Node* node = reinterpret_cast<Node*>(Allocator(sizeof(Node)));
         if (node == nullptr) return false;
         bytes_used_ += sizeof(Node);
-        memset(node, 0, sizeof(*node));
+        ClearPageMapNode(node, sizeof(*node));
         root_[i1] = node;
       }
 
@@ -379,7 +450,7 @@ class PageMap3 {
         Leaf* leaf = reinterpret_cast<Leaf*>(Allocator(sizeof(Leaf)));
         if (leaf == nullptr) return false;
         bytes_used_ += sizeof(Leaf);
-        memset(leaf, 0, sizeof(*leaf));
+        ClearPageMapNode(leaf, sizeof(*leaf));
         root_[i1]->leafs[i2] = leaf;
       }
 
@@ -395,7 +466,59 @@ class PageMap3 {
   const void* RootAddress() { return root_; }
 };
 
+// Reserves bytes of zero-filled, lazily backed memory for a
+// FlatSizeClassMap.  Returns nullptr on failure.
+void* ReserveFlatSizeClassMap(size_t bytes);
+
+// A direct-mapped array of the size class of every page in the address space.
+// Looking up a size class is a single load, rather than a walk of the radix
+// tree.  The array is reserved up front but only backed where it is written,
+// so it costs about as much memory as the size classes in the radix tree's
+// leaves: one byte per page in use.
+template <int BITS>
+class FlatSizeClassMap {
+ public:
+  typedef uintptr_t Number;
+
+  static constexpr size_t kBytes = size_t{1} << BITS;
+
+  constexpr FlatSizeClassMap() = default;
+
+  // Reserves the array.  Returns false, leaving the map disabled, if the
+  // reservation fails.
+  bool Init() {
+    TC_ASSERT(!enabled());
+    sizeclass_ =
+        reinterpret_cast<CompactSizeClass*>(ReserveFlatSizeClassMap(kBytes));
+    return enabled();
+  }
+
+  bool enabled() const { return sizeclass_ != nullptr; }
+
+  // No locks required.  See SYNCHRONIZATION explanation at top of tcmalloc.cc.
+  // REQUIRES: enabled()
+  CompactSizeClass ABSL_ATTRIBUTE_ALWAYS_INLINE sizeclass(Number k) const {
+    TC_ASSERT_EQ(k >> BITS, 0);
+    return sizeclass_[k];
+  }
+
+  // REQUIRES: enabled()
+  void set_sizeclass(Number k, CompactSizeClass sc) {
+    TC_ASSERT_EQ(k >> BITS, 0);
+    sizeclass_[k] = sc;
+  }
+
+ private:
+  CompactSizeClass* sizeclass_ = nullptr;
+};
+
 class PageMap {
+#ifdef TCMALLOC_USE_PAGEMAP3
+  using Map = PageMap3<kAddressBits - kPageShift, MetaDataAlloc>;
+#else
+  using Map = PageMap2<kAddressBits - kPageShift, MetaDataAlloc>;
+#endif
+
  public:
   constexpr PageMap() : map_{} {}
 
@@ -406,10 +529,21 @@ class PageMap {
   // TODO(b/193887621): Convert to atomics to permit the PageMap to run cleanly
   // under TSan.
   CompactSizeClass sizeclass(PageId p) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    if (flat_.enabled()) {
+      return flat_.sizeclass(p.index());
+    }
     return map_.sizeclass(p.index());
   }
 
-  void Set(PageId p, Span* span) { map_.set(p.index(), span); }
+  // Serves sizeclass() from a FlatSizeClassMap from now on, if one can be
+  // reserved; otherwise we keep using the radix tree.
+  // REQUIRES: no size class has been registered yet.
+  void InitFlatSizeClassMap() { flat_.Init(); }
+
+  void Set(PageId p, Span* span) {
+    map_.set(p.index(), span);
+    MarkChanged(p);
+  }
 
   bool Ensure(PageId p, Length n) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
     return map_.Ensure(p.index(), n.raw_num());
@@ -459,6 +593,59 @@ class PageMap {
   // small pages to minimise the amount of unused memory.
   void MapRootWithSmallPages();
 
+  // The pages covered by each leaf of the radix tree.  Scans of allocated spans
+  // skip whole leaves at a time.
+  static constexpr Length kPagesPerLeaf = Length(Map::kPagesPerLeaf);
+
+  // Starts a scan of the allocated spans.  Every span set or freed, or given a
+  // size class, under the pageheap_lock after this is called is in a leaf for
+  // which a later NextChangedLeaf(..., since_epoch = the returned value) stops.
+  uint64_t StartScan() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return epoch_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Returns the first page of the first leaf that starts in [p, limit), or
+  // covers p, in which some span has changed since since_epoch, as returned by
+  // StartScan.  Returns nullopt if there is none.  A since_epoch of zero
+  // matches every leaf.
+  std::optional<PageId> NextChangedLeaf(PageId p, PageId limit,
+                                        uint64_t since_epoch) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    std::optional<uintptr_t> i =
+        map_.get_next_changed_leaf(p.index(), limit.index(), since_epoch);
+    if (!i.has_value()) return std::nullopt;
+    return PageId{i.value()};
+  }
+
+  // Copies the details of the allocated spans that start in [*start, limit)
+  // to out, in address order, until out is full.  Sets *start to the page
+  // after the last span copied if out filled up; otherwise to limit.  Returns
+  // how many spans were copied.  Unlike the vector version below, the caller
+  // holds the pageheap_lock, so it can resume the scan after dropping it.
+  size_t GetAllocatedSpans(
+      PageId* start, PageId limit,
+      absl::Span<tcmalloc::malloc_tracing_extension::AllocatedAddressRanges::
+                     SpanDetails>
+          out) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    size_t n = 0;
+    for (uintptr_t i = start->index(); i < limit.index(); ++i) {
+      PageId page_id = PageId{i};
+      Span* s = GetDescriptor(page_id);
+      // Only spans starting here are reported: this skips the rest of a span
+      // that began before *start, as well as stale entries of freed spans.
+      if (s == nullptr || s->first_page() != page_id) continue;
+      if (n == out.size()) {
+        *start = page_id;
+        return n;
+      }
+      out[n++] = {s->first_page().start_uintptr(), s->bytes_in_span(),
+                  Static::sizemap().class_to_size(sizeclass(page_id))};
+      i = s->last_page().index();
+    }
+    *start = limit;
+    return n;
+  }
+
   // Returns the count of the currently allocated Spans and also adds details
   // of such Spans in the provided allocated_spans vector. This routine avoids
   // allocation events since we hold the pageheap_lock, so no more elements will
@@ -497,11 +684,18 @@ class PageMap {
   }
 
  private:
-#ifdef TCMALLOC_USE_PAGEMAP3
-  PageMap3<kAddressBits - kPageShift, MetaDataAlloc> map_;
-#else
-  PageMap2<kAddressBits - kPageShift, MetaDataAlloc> map_;
-#endif
+  // Stamps the leaf covering p with the current epoch.
+  void MarkChanged(PageId p) {
+    map_.set_epoch(p.index(), epoch_.load(std::memory_order_relaxed));
+  }
+
+  Map map_;
+  // Leaves are stamped with this when their spans change; StartScan advances
+  // it.  It starts above the zero a leaf is created with.
+  std::atomic<uint64_t> epoch_{1};
+  // When enabled, size classes are recorded here as well as in map_, and
+  // sizeclass() reads them from here.
+  FlatSizeClassMap<kAddressBits - kPageShift> flat_;
 };
 
 }  // namespace tcmalloc_internal
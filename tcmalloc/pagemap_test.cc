@@ -29,6 +29,8 @@
 #include "absl/random/random.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/memory_stats.h"
 
 // Note: we leak memory every time a map is constructed, so do not
 // create too many maps.
@@ -135,6 +137,77 @@ TEST_P(PageMapTest, RandomAccess) {
 
 INSTANTIATE_TEST_SUITE_P(Limits, PageMapTest, ::testing::Values(100, 1 << 20));
 
+TEST(ClearPageMapNodeTest, ClearsDirtyMemory) {
+  std::vector<uintptr_t> node(1024, 0);
+  node[1000] = 1;
+  node[1023] = 2;
+  ClearPageMapNode(node.data(), node.size() * sizeof(node[0]));
+  for (uintptr_t word : node) {
+    ASSERT_EQ(word, 0);
+  }
+}
+
+// Allocates nodes from fresh mappings, as the arena does.
+void* MmapAlloc(size_t n) {
+  void* ptr = mmap(nullptr, n, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TC_CHECK_NE(ptr, MAP_FAILED);
+  // Keep the nodes on small pages, so that we back only what we write.
+  madvise(ptr, n, MADV_NOHUGEPAGE);
+  return ptr;
+}
+
+TEST(PageMapFootprintTest, UnsetEntriesStayUnbacked) {
+  using Map = PageMap2<20, MmapAlloc>;
+  static Map* map = new Map();
+
+  MemoryStats before;
+  ASSERT_TRUE(GetMemoryStats(&before));
+  constexpr intptr_t kPages = 1 << 20;
+  ASSERT_TRUE(map->Ensure(0, kPages));
+  // Register some large spans, which only set their first and last pages.
+  constexpr intptr_t kSpanPages = 1 << 14;
+  for (intptr_t i = 0; i < kPages; i += kSpanPages) {
+    map->set(i, span(i));
+    map->set(i + kSpanPages - 1, span(i));
+  }
+  MemoryStats after;
+  ASSERT_TRUE(GetMemoryStats(&after));
+
+  EXPECT_EQ(map->get(0), span(0));
+  EXPECT_EQ(map->get(1), nullptr);
+  // Each span backs at most two pages of the leaves, far less than the size of
+  // the leaves themselves.
+  const size_t leaves = map->bytes_used() - sizeof(*map);
+  EXPECT_LT(after.rss - before.rss, static_cast<int64_t>(leaves / 4));
+}
+
+TEST(FlatSizeClassMapTest, SetAndGet) {
+  static constexpr int kBits = 20;
+  FlatSizeClassMap<kBits> map;
+  EXPECT_FALSE(map.enabled());
+  ASSERT_TRUE(map.Init());
+  EXPECT_TRUE(map.enabled());
+
+  // Spread the pages out, so that they land on different pages of the array.
+  std::vector<uintptr_t> pages;
+  for (uintptr_t p = 1; p < (1 << kBits); p += 1021) {
+    pages.push_back(p);
+  }
+  for (uintptr_t p : pages) {
+    EXPECT_EQ(map.sizeclass(p), 0);
+    map.set_sizeclass(p, sc(p));
+  }
+  for (uintptr_t p : pages) {
+    EXPECT_EQ(map.sizeclass(p), sc(p));
+  }
+  EXPECT_EQ(map.sizeclass(0), 0);
+  for (uintptr_t p : pages) {
+    map.set_sizeclass(p, 0);
+    EXPECT_EQ(map.sizeclass(p), 0);
+  }
+}
+
 // Surround pagemap with unused memory. This isolates it so that it does not
 // share pages with any other structures. This avoids the risk that adjacent
 // objects might cause it to be mapped in. The padding is of sufficient size
@@ -29,6 +29,7 @@
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/selsan/selsan.h"
+#include "tcmalloc/size_class_tags.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -238,12 +239,14 @@ inline constexpr Length operator-(PageId lhs, PageId rhs) {
 TCMALLOC_ATTRIBUTE_CONST
 inline PageId PageIdContaining(const void* p) {
   TC_ASSERT_EQ(selsan::RemoveTag(p), p);
+  TC_ASSERT_EQ(size_class_tags::RemoveTag(p), p);
   return PageId(reinterpret_cast<uintptr_t>(p) >> kPageShift);
 }
 
+// As above, for pointers that may carry a SelSan or size class tag.
 TCMALLOC_ATTRIBUTE_CONST
 inline PageId PageIdContainingTagged(const void* p) {
-  return PageIdContaining(selsan::RemoveTag(p));
+  return PageIdContaining(size_class_tags::RemoveTag(selsan::RemoveTag(p)));
 }
 
 TCMALLOC_ATTRIBUTE_CONST
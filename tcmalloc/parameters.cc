@@ -198,6 +198,61 @@ absl::Duration Parameters::huge_cache_release_time() {
   return absl::Seconds(v.load(std::memory_order_relaxed));
 }
 
+bool Parameters::huge_cache_demand_forecast() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    v.store(IsExperimentActive(
+                Experiment::TEST_ONLY_TCMALLOC_HUGE_CACHE_DEMAND_FORECAST),
+            std::memory_order_relaxed);
+  });
+  return v.load(std::memory_order_relaxed);
+}
+
+bool Parameters::huge_allocator_best_fit() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    v.store(IsExperimentActive(
+                Experiment::TEST_ONLY_TCMALLOC_HUGE_ALLOCATOR_BEST_FIT),
+            std::memory_order_relaxed);
+  });
+  return v.load(std::memory_order_relaxed);
+}
+
+bool Parameters::huge_region_subrelease() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    v.store(IsExperimentActive(
+                Experiment::TEST_ONLY_TCMALLOC_HUGE_REGION_SUBRELEASE),
+            std::memory_order_relaxed);
+  });
+  return v.load(std::memory_order_relaxed);
+}
+
+// Set TCMALLOC_EXCLUDE_FREE_MEMORY_FROM_CORE_DUMPS=1 to leave the hugepages the
+// page heap caches, backed but free, out of core dumps.
+bool Parameters::exclude_free_memory_from_core_dumps() {
+  ABSL_CONST_INIT static absl::once_flag flag;
+  ABSL_CONST_INIT static std::atomic<bool> v{false};
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e =
+        thread_safe_getenv("TCMALLOC_EXCLUDE_FREE_MEMORY_FROM_CORE_DUMPS");
+    if (e == nullptr) return;
+    switch (e[0]) {
+      case '0':
+        break;
+      case '1':
+        v.store(true, std::memory_order_relaxed);
+        break;
+      default:
+        TC_BUG("bad env var '%s'", e);
+    }
+  });
+  return v.load(std::memory_order_relaxed);
+}
+
 ABSL_CONST_INIT std::atomic<MallocExtension::BytesPerSecond>
     Parameters::background_release_rate_(MallocExtension::BytesPerSecond{
         0
@@ -235,11 +290,207 @@ ABSL_CONST_INIT std::atomic<MadvisePreference> Parameters::madvise_(
 ABSL_CONST_INIT std::atomic<bool> Parameters::hpaa_cold_subrelease_(false);
 ABSL_CONST_INIT std::atomic<tcmalloc::hot_cold_t>
     Parameters::min_hot_access_hint_(kDefaultMinHotAccessHint);
+ABSL_CONST_INIT std::atomic<tcmalloc::hot_cold_t>
+    Parameters::max_warm_access_hint_(kDefaultMaxWarmAccessHint);
 ABSL_CONST_INIT std::atomic<double>
     Parameters::per_cpu_caches_dynamic_slab_grow_threshold_(0.9);
 ABSL_CONST_INIT std::atomic<double>
     Parameters::per_cpu_caches_dynamic_slab_shrink_threshold_(0.4);
 
+// Opt-in: steal objects from sibling per-CPU caches on the same L3 before
+// refilling from the transfer cache.
+ABSL_CONST_INIT std::atomic<bool> Parameters::per_cpu_caches_remote_steal_(
+    false);
+
+// Whether dynamic slab resizing evaluates misses per NUMA partition and
+// leaves idle CPUs of non-growing partitions unpopulated after a grow.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::per_cpu_caches_partitioned_slab_resize_(false);
+
+// Whether per-cpu size class capacities are budgeted by sampled allocation
+// volume and a target hit rate instead of by miss counts alone.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::per_cpu_caches_allocation_rate_resize_(false);
+
+// Hit rate a size class must fall below to receive more capacity when
+// per_cpu_caches_allocation_rate_resize is enabled.
+ABSL_CONST_INIT std::atomic<double> Parameters::per_cpu_caches_target_hit_rate_(
+    0.99);
+
+// When false, popping an object of an expanded (cold) size class from the
+// per-cpu cache does not prefetch the next object in the freelist.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::per_cpu_caches_prefetch_cold_classes_(true);
+
+// When true, each thread keeps a few objects of the smallest size classes in
+// a ThreadMagazine in front of the per-cpu cache.
+ABSL_CONST_INIT std::atomic<bool> Parameters::per_cpu_caches_thread_magazine_(
+    false);
+
+// Number of plunder intervals objects must stay unused across before the
+// transfer caches return them to the central freelists.
+ABSL_CONST_INIT std::atomic<int64_t>
+    Parameters::transfer_cache_plunder_intervals_(1);
+
+// Whether the number of objects moved between per-cpu caches and the backing
+// caches is tuned per size class from transfer cache miss statistics.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::per_cpu_caches_batch_size_autotune_(false);
+
+// Whether the per-cpu cache reports in MallocExtension::GetStats sum their
+// statistics across cpus instead of listing them for every cpu.
+ABSL_CONST_INIT std::atomic<bool> Parameters::per_cpu_caches_summary_stats_(
+    false);
+
+// Whether CentralFreeList places the spans of size classes whose sampled
+// objects are mostly short-lived apart from long-lived ones.
+ABSL_CONST_INIT std::atomic<bool> Parameters::lifetime_aware_span_placement_(
+    false);
+
+// Whether the background thread asks the kernel to restore hugepage backing
+// for hugepages that were subreleased but are fully used again.
+ABSL_CONST_INIT std::atomic<bool> Parameters::collapse_subreleased_hugepages_(
+    false);
+
+// Whether HugePageAwareAllocator keeps multi-hugepage allocations predicted to
+// be long-lived in dedicated regions, and serves short-lived ones from the
+// HugeCache.
+ABSL_CONST_INIT std::atomic<bool> Parameters::lifetime_aware_region_placement_(
+    false);
+
+// Whether page-level allocations from callsites whose sampled allocations tend
+// to be short-lived are packed into hugepages of their own, apart from the
+// filler's other hugepages.
+ABSL_CONST_INIT std::atomic<bool> Parameters::lifetime_aware_filler_placement_(
+    false);
+
+// Whether MallocExtension::ReleaseMemoryToSystem queues its request for the
+// background thread instead of releasing memory on the calling thread.
+ABSL_CONST_INIT std::atomic<bool> Parameters::async_release_memory_to_system_(
+    false);
+
+// Whether the background thread scales its release rate by memory pressure,
+// as reported by PSI, instead of releasing at a constant rate.
+ABSL_CONST_INIT std::atomic<bool> Parameters::memory_pressure_aware_release_(
+    false);
+
+// Whether the background thread sets the memory limits from the cgroup's
+// memory.high and memory.max.
+ABSL_CONST_INIT std::atomic<bool> Parameters::follow_cgroup_memory_limits_(
+    false);
+
+// Page allocations of at least this many bytes are faulted in on allocation
+// rather than on first touch.  Zero disables prefaulting.
+ABSL_CONST_INIT std::atomic<uint64_t>
+    Parameters::large_allocation_prefault_threshold_(0);
+
+// Page allocations of at least this many bytes are backed by 1GiB hugetlb
+// pages when the system provides them.  Zero disables 1GiB pages.
+ABSL_CONST_INIT std::atomic<uint64_t> Parameters::gigantic_page_threshold_(
+    0);
+
+// Whether the background thread periodically checks how the kernel backs the
+// filler's hugepages.
+ABSL_CONST_INIT std::atomic<bool> Parameters::audit_hugepage_backing_(false);
+
+// Opt-in: buffer frees of objects owned by another NUMA partition in the
+// per-CPU cache and return them to their partition in whole batches.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::per_cpu_caches_batch_remote_frees_(false);
+
+// Whether the background thread moves the filler's hugepages that have gone
+// unaccessed to the warm tier's NUMA node, and back once they are used again.
+ABSL_CONST_INIT std::atomic<bool> Parameters::demote_idle_hugepages_(false);
+
+// Whether page-level allocations from callsites whose sampled allocations
+// tend to be long-lived are placed in cold memory.
+ABSL_CONST_INIT std::atomic<bool> Parameters::cold_callsite_classification_(
+    false);
+
+// The number of heap profile samples per second that the background thread
+// steers the sampling rate toward, or 0 to keep the rate as set.
+ABSL_CONST_INIT std::atomic<int64_t>
+    Parameters::profile_samples_per_second_target_(0);
+
+ABSL_CONST_INIT std::atomic<int64_t>
+    Parameters::slow_path_latency_sampling_interval_(0);
+
+ABSL_CONST_INIT std::atomic<int64_t>
+    Parameters::pageheap_lock_contention_sampling_interval_(0);
+
+ABSL_CONST_INIT std::atomic<bool> Parameters::metadata_arena_hugepages_(
+    false);
+
+ABSL_CONST_INIT std::atomic<bool> Parameters::thread_cache_dynamic_resize_(
+    false);
+
+ABSL_CONST_INIT std::atomic<bool> Parameters::release_caches_at_fork_(false);
+
+ABSL_CONST_INIT std::atomic<bool> Parameters::adaptive_guarded_sampling_(false);
+
+ABSL_CONST_INIT std::atomic<int64_t> Parameters::selsan_sampling_interval_(1);
+
+// Refaulted bytes per second that the background release rate is adjusted to
+// stay within, or 0 to release at the configured rate.
+ABSL_CONST_INIT std::atomic<uint64_t> Parameters::release_refault_budget_(0);
+
+// Off by default: cached spans are only returned to the page heap by the
+// background thread.
+ABSL_CONST_INIT std::atomic<uint64_t> Parameters::large_span_cache_bytes_(0);
+
+// When set, slab resizes initialize the new slabs a few CPUs per background
+// iteration, and only stop every CPU to switch to them.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::per_cpu_caches_incremental_slab_resize_(false);
+
+// When set, the capacity of idle per-CPU caches goes to a pool shared by the
+// CPUs of their L3 cache, which growing caches draw from first, and capacity
+// shuffling does not steal across L3 caches.
+ABSL_CONST_INIT std::atomic<bool> Parameters::per_cpu_caches_l3_capacity_pools_(
+    false);
+
+// When set, reclaiming an idle per-CPU cache keeps a warm core of each size
+// class, based on its low-water mark, instead of draining the cache.
+ABSL_CONST_INIT std::atomic<bool> Parameters::per_cpu_caches_partial_reclaim_(
+    false);
+
+// Whether the background thread backs off while idle and runs actions that
+// respond to per-cpu cache misses early on a spike of misses.
+ABSL_CONST_INIT std::atomic<bool> Parameters::background_event_driven_(
+    false);
+
+// Whether the background thread tops up transfer caches that keep missing from
+// their central freelists.
+ABSL_CONST_INIT std::atomic<bool>
+    Parameters::transfer_cache_background_refill_(false);
+
+// The number of background thread iterations without a trip to the transfer
+// cache after which a thread's cache is flushed.  Zero disables flushing.
+ABSL_CONST_INIT std::atomic<int64_t>
+    Parameters::thread_cache_idle_flush_intervals_(0);
+
+// Whether sampled allocations take their stack trace by walking frame pointers
+// rather than with absl::GetStackTrace.  On by default in builds that define
+// TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDING, which should also keep frame
+// pointers.
+ABSL_CONST_INIT std::atomic<bool> Parameters::frame_pointer_unwinding_(
+#if defined(TCMALLOC_INTERNAL_FRAME_POINTER_UNWINDING)
+    true
+#else
+    false
+#endif
+);
+
+// Whether each thread counts the bytes it allocates and frees exactly, for
+// MallocExtension::GetThreadAllocationCounts.
+ABSL_CONST_INIT std::atomic<bool> Parameters::per_thread_allocation_accounting_(
+    false);
+
+// How long, in milliseconds, mallinfo and the main generic.* properties may
+// answer from the totals of stats extracted before.  At 0, they always extract
+// the stats afresh.
+ABSL_CONST_INIT std::atomic<int64_t> Parameters::cached_stats_max_age_ms_(0);
+
 ABSL_CONST_INIT std::atomic<int64_t> Parameters::profile_sampling_rate_(
     kDefaultProfileSamplingRate);
 // TODO.  Start with 0 to make it clear if we have read this before it is
@@ -366,6 +617,15 @@ void MallocExtension_Internal_SetMaxTotalThreadCacheBytes(int64_t value) {
   Parameters::set_max_total_thread_cache_bytes(value);
 }
 
+bool MallocExtension_Internal_GetPerThreadAllocationAccountingEnabled() {
+  return Parameters::per_thread_allocation_accounting();
+}
+
+void MallocExtension_Internal_SetPerThreadAllocationAccountingEnabled(
+    bool value) {
+  Parameters::set_per_thread_allocation_accounting(value);
+}
+
 bool MallocExtension_Internal_GetBackgroundProcessActionsEnabled() {
   return Parameters::background_process_actions_enabled();
 }
@@ -642,4 +902,365 @@ void TCMalloc_Internal_SetMinHotAccessHint(uint8_t v) {
                                          std::memory_order_relaxed);
 }
 
+uint8_t TCMalloc_Internal_GetMaxWarmAccessHint() {
+  return static_cast<uint8_t>(Parameters::max_warm_access_hint());
+}
+
+void TCMalloc_Internal_SetMaxWarmAccessHint(uint8_t v) {
+  Parameters::max_warm_access_hint_.store(static_cast<tcmalloc::hot_cold_t>(v),
+                                          std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesRemoteSteal() {
+  return Parameters::per_cpu_caches_remote_steal();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesRemoteSteal(bool v) {
+  Parameters::per_cpu_caches_remote_steal_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesPartitionedSlabResize() {
+  return Parameters::per_cpu_caches_partitioned_slab_resize();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesPartitionedSlabResize(bool v) {
+  Parameters::per_cpu_caches_partitioned_slab_resize_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesAllocationRateResize() {
+  return Parameters::per_cpu_caches_allocation_rate_resize();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesAllocationRateResize(bool v) {
+  Parameters::per_cpu_caches_allocation_rate_resize_.store(
+      v, std::memory_order_relaxed);
+}
+
+double TCMalloc_Internal_GetPerCpuCachesTargetHitRate() {
+  return Parameters::per_cpu_caches_target_hit_rate();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesTargetHitRate(double v) {
+  Parameters::per_cpu_caches_target_hit_rate_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesPrefetchColdClasses() {
+  return Parameters::per_cpu_caches_prefetch_cold_classes();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesPrefetchColdClasses(bool v) {
+  Parameters::per_cpu_caches_prefetch_cold_classes_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesThreadMagazine() {
+  return Parameters::per_cpu_caches_thread_magazine();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesThreadMagazine(bool v) {
+  Parameters::per_cpu_caches_thread_magazine_.store(
+      v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetTransferCachePlunderIntervals() {
+  return Parameters::transfer_cache_plunder_intervals();
+}
+
+void TCMalloc_Internal_SetTransferCachePlunderIntervals(int64_t v) {
+  Parameters::transfer_cache_plunder_intervals_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesBatchSizeAutotune() {
+  return Parameters::per_cpu_caches_batch_size_autotune();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesBatchSizeAutotune(bool v) {
+  Parameters::per_cpu_caches_batch_size_autotune_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesSummaryStats() {
+  return Parameters::per_cpu_caches_summary_stats();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesSummaryStats(bool v) {
+  Parameters::per_cpu_caches_summary_stats_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetLifetimeAwareSpanPlacement() {
+  return Parameters::lifetime_aware_span_placement();
+}
+
+void TCMalloc_Internal_SetLifetimeAwareSpanPlacement(bool v) {
+  Parameters::lifetime_aware_span_placement_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetCollapseSubreleasedHugepages() {
+  return Parameters::collapse_subreleased_hugepages();
+}
+
+void TCMalloc_Internal_SetCollapseSubreleasedHugepages(bool v) {
+  Parameters::collapse_subreleased_hugepages_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetLifetimeAwareRegionPlacement() {
+  return Parameters::lifetime_aware_region_placement();
+}
+
+void TCMalloc_Internal_SetLifetimeAwareRegionPlacement(bool v) {
+  Parameters::lifetime_aware_region_placement_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetLifetimeAwareFillerPlacement() {
+  return Parameters::lifetime_aware_filler_placement();
+}
+
+void TCMalloc_Internal_SetLifetimeAwareFillerPlacement(bool v) {
+  Parameters::lifetime_aware_filler_placement_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetAsyncReleaseMemoryToSystem() {
+  return Parameters::async_release_memory_to_system();
+}
+
+void TCMalloc_Internal_SetAsyncReleaseMemoryToSystem(bool v) {
+  Parameters::async_release_memory_to_system_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetMemoryPressureAwareRelease() {
+  return Parameters::memory_pressure_aware_release();
+}
+
+void TCMalloc_Internal_SetMemoryPressureAwareRelease(bool v) {
+  Parameters::memory_pressure_aware_release_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetFollowCgroupMemoryLimits() {
+  return Parameters::follow_cgroup_memory_limits();
+}
+
+void TCMalloc_Internal_SetFollowCgroupMemoryLimits(bool v) {
+  Parameters::follow_cgroup_memory_limits_.store(v, std::memory_order_relaxed);
+}
+
+uint64_t TCMalloc_Internal_GetLargeAllocationPrefaultThreshold() {
+  return Parameters::large_allocation_prefault_threshold();
+}
+
+void TCMalloc_Internal_SetLargeAllocationPrefaultThreshold(uint64_t v) {
+  Parameters::large_allocation_prefault_threshold_.store(
+      v, std::memory_order_relaxed);
+}
+
+uint64_t TCMalloc_Internal_GetGiganticPageThreshold() {
+  return Parameters::gigantic_page_threshold();
+}
+
+void TCMalloc_Internal_SetGiganticPageThreshold(uint64_t v) {
+  Parameters::gigantic_page_threshold_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetAuditHugepageBacking() {
+  return Parameters::audit_hugepage_backing();
+}
+
+void TCMalloc_Internal_SetAuditHugepageBacking(bool v) {
+  Parameters::audit_hugepage_backing_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesBatchRemoteFrees() {
+  return Parameters::per_cpu_caches_batch_remote_frees();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesBatchRemoteFrees(bool v) {
+  Parameters::per_cpu_caches_batch_remote_frees_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetDemoteIdleHugepages() {
+  return Parameters::demote_idle_hugepages();
+}
+
+void TCMalloc_Internal_SetDemoteIdleHugepages(bool v) {
+  Parameters::demote_idle_hugepages_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetColdCallsiteClassification() {
+  return Parameters::cold_callsite_classification();
+}
+
+void TCMalloc_Internal_SetColdCallsiteClassification(bool v) {
+  Parameters::cold_callsite_classification_.store(v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetProfileSamplesPerSecondTarget() {
+  return Parameters::profile_samples_per_second_target();
+}
+
+void TCMalloc_Internal_SetProfileSamplesPerSecondTarget(int64_t v) {
+  Parameters::profile_samples_per_second_target_.store(
+      v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetSlowPathLatencySamplingInterval() {
+  return Parameters::slow_path_latency_sampling_interval();
+}
+
+void TCMalloc_Internal_SetSlowPathLatencySamplingInterval(int64_t v) {
+  Parameters::slow_path_latency_sampling_interval_.store(
+      v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetPageHeapLockContentionSamplingInterval() {
+  return Parameters::pageheap_lock_contention_sampling_interval();
+}
+
+void TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(int64_t v) {
+  Parameters::pageheap_lock_contention_sampling_interval_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetMetadataArenaHugepages() {
+  return Parameters::metadata_arena_hugepages();
+}
+
+void TCMalloc_Internal_SetMetadataArenaHugepages(bool v) {
+  Parameters::metadata_arena_hugepages_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetThreadCacheDynamicResize() {
+  return Parameters::thread_cache_dynamic_resize();
+}
+
+void TCMalloc_Internal_SetThreadCacheDynamicResize(bool v) {
+  Parameters::thread_cache_dynamic_resize_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetReleaseCachesAtFork() {
+  return Parameters::release_caches_at_fork();
+}
+
+void TCMalloc_Internal_SetReleaseCachesAtFork(bool v) {
+  Parameters::release_caches_at_fork_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetAdaptiveGuardedSampling() {
+  return Parameters::adaptive_guarded_sampling();
+}
+
+void TCMalloc_Internal_SetAdaptiveGuardedSampling(bool v) {
+  Parameters::adaptive_guarded_sampling_.store(v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetSelSanSamplingInterval() {
+  return Parameters::selsan_sampling_interval();
+}
+
+void TCMalloc_Internal_SetSelSanSamplingInterval(int64_t v) {
+  Parameters::selsan_sampling_interval_.store(v, std::memory_order_relaxed);
+}
+
+uint64_t TCMalloc_Internal_GetReleaseRefaultBudget() {
+  return Parameters::release_refault_budget();
+}
+
+void TCMalloc_Internal_SetReleaseRefaultBudget(uint64_t v) {
+  Parameters::release_refault_budget_.store(v, std::memory_order_relaxed);
+}
+
+uint64_t TCMalloc_Internal_GetLargeSpanCacheBytes() {
+  return Parameters::large_span_cache_bytes();
+}
+
+void TCMalloc_Internal_SetLargeSpanCacheBytes(uint64_t v) {
+  Parameters::large_span_cache_bytes_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesIncrementalSlabResize() {
+  return Parameters::per_cpu_caches_incremental_slab_resize();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesIncrementalSlabResize(bool v) {
+  Parameters::per_cpu_caches_incremental_slab_resize_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesL3CapacityPools() {
+  return Parameters::per_cpu_caches_l3_capacity_pools();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesL3CapacityPools(bool v) {
+  Parameters::per_cpu_caches_l3_capacity_pools_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerCpuCachesPartialReclaim() {
+  return Parameters::per_cpu_caches_partial_reclaim();
+}
+
+void TCMalloc_Internal_SetPerCpuCachesPartialReclaim(bool v) {
+  Parameters::per_cpu_caches_partial_reclaim_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetBackgroundEventDriven() {
+  return Parameters::background_event_driven();
+}
+
+void TCMalloc_Internal_SetBackgroundEventDriven(bool v) {
+  Parameters::background_event_driven_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetTransferCacheBackgroundRefill() {
+  return Parameters::transfer_cache_background_refill();
+}
+
+void TCMalloc_Internal_SetTransferCacheBackgroundRefill(bool v) {
+  Parameters::transfer_cache_background_refill_.store(
+      v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetThreadCacheIdleFlushIntervals() {
+  return Parameters::thread_cache_idle_flush_intervals();
+}
+
+void TCMalloc_Internal_SetThreadCacheIdleFlushIntervals(int64_t v) {
+  Parameters::thread_cache_idle_flush_intervals_.store(
+      v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetFramePointerUnwinding() {
+  return Parameters::frame_pointer_unwinding();
+}
+
+void TCMalloc_Internal_SetFramePointerUnwinding(bool v) {
+  Parameters::frame_pointer_unwinding_.store(v, std::memory_order_relaxed);
+}
+
+bool TCMalloc_Internal_GetPerThreadAllocationAccounting() {
+  return Parameters::per_thread_allocation_accounting();
+}
+
+void TCMalloc_Internal_SetPerThreadAllocationAccounting(bool v) {
+  Parameters::per_thread_allocation_accounting_.store(
+      v, std::memory_order_relaxed);
+}
+
+int64_t TCMalloc_Internal_GetCachedStatsMaxAgeMs() {
+  return Parameters::cached_stats_max_age_ms();
+}
+
+void TCMalloc_Internal_SetCachedStatsMaxAgeMs(int64_t v) {
+  Parameters::cached_stats_max_age_ms_.store(v, std::memory_order_relaxed);
+}
+
 }  // extern "C"
@@ -59,6 +59,10 @@ class Parameters {
   static bool use_all_buckets_for_few_object_spans_in_cfl();
 
   static absl::Duration huge_cache_release_time();
+  static bool huge_cache_demand_forecast();
+  static bool huge_allocator_best_fit();
+  static bool huge_region_subrelease();
+  static bool exclude_free_memory_from_core_dumps();
 
   static int64_t guarded_sampling_rate() {
     return guarded_sampling_rate_.load(std::memory_order_relaxed);
@@ -94,6 +98,16 @@ class Parameters {
     TCMalloc_Internal_SetMinHotAccessHint(static_cast<uint8_t>(value));
   }
 
+  // Page-level allocations with hints in [min_hot_access_hint,
+  // max_warm_access_hint] are placed in the warm tier, when there is one.
+  static tcmalloc::hot_cold_t max_warm_access_hint() {
+    return max_warm_access_hint_.load(std::memory_order_relaxed);
+  }
+
+  static void set_max_warm_access_hint(tcmalloc::hot_cold_t value) {
+    TCMalloc_Internal_SetMaxWarmAccessHint(static_cast<uint8_t>(value));
+  }
+
   static void set_max_total_thread_cache_bytes(int64_t value) {
     TCMalloc_Internal_SetMaxTotalThreadCacheBytes(value);
   }
@@ -199,6 +213,298 @@ class Parameters {
     TCMalloc_Internal_SetPerCpuCachesDynamicSlabShrinkThreshold(value);
   }
 
+  static bool per_cpu_caches_remote_steal() {
+    return per_cpu_caches_remote_steal_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_remote_steal(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesRemoteSteal(value);
+  }
+
+  static bool per_cpu_caches_partitioned_slab_resize() {
+    return per_cpu_caches_partitioned_slab_resize_.load(
+        std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_partitioned_slab_resize(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesPartitionedSlabResize(value);
+  }
+
+  static bool per_cpu_caches_allocation_rate_resize() {
+    return per_cpu_caches_allocation_rate_resize_.load(
+        std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_allocation_rate_resize(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesAllocationRateResize(value);
+  }
+
+  static double per_cpu_caches_target_hit_rate() {
+    return per_cpu_caches_target_hit_rate_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_target_hit_rate(double value) {
+    TCMalloc_Internal_SetPerCpuCachesTargetHitRate(value);
+  }
+
+  static bool per_cpu_caches_prefetch_cold_classes() {
+    return per_cpu_caches_prefetch_cold_classes_.load(
+        std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_prefetch_cold_classes(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesPrefetchColdClasses(value);
+  }
+
+  static bool per_cpu_caches_thread_magazine() {
+    return per_cpu_caches_thread_magazine_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_thread_magazine(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesThreadMagazine(value);
+  }
+
+  static int64_t transfer_cache_plunder_intervals() {
+    return transfer_cache_plunder_intervals_.load(std::memory_order_relaxed);
+  }
+  static void set_transfer_cache_plunder_intervals(int64_t value) {
+    TCMalloc_Internal_SetTransferCachePlunderIntervals(value);
+  }
+
+  static bool per_cpu_caches_batch_size_autotune() {
+    return per_cpu_caches_batch_size_autotune_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_batch_size_autotune(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesBatchSizeAutotune(value);
+  }
+
+  static bool per_cpu_caches_summary_stats() {
+    return per_cpu_caches_summary_stats_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_summary_stats(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesSummaryStats(value);
+  }
+
+  static bool lifetime_aware_span_placement() {
+    return lifetime_aware_span_placement_.load(std::memory_order_relaxed);
+  }
+  static void set_lifetime_aware_span_placement(bool value) {
+    TCMalloc_Internal_SetLifetimeAwareSpanPlacement(value);
+  }
+
+  static bool collapse_subreleased_hugepages() {
+    return collapse_subreleased_hugepages_.load(std::memory_order_relaxed);
+  }
+  static void set_collapse_subreleased_hugepages(bool value) {
+    TCMalloc_Internal_SetCollapseSubreleasedHugepages(value);
+  }
+
+  static bool lifetime_aware_region_placement() {
+    return lifetime_aware_region_placement_.load(std::memory_order_relaxed);
+  }
+  static void set_lifetime_aware_region_placement(bool value) {
+    TCMalloc_Internal_SetLifetimeAwareRegionPlacement(value);
+  }
+
+  static bool lifetime_aware_filler_placement() {
+    return lifetime_aware_filler_placement_.load(std::memory_order_relaxed);
+  }
+  static void set_lifetime_aware_filler_placement(bool value) {
+    TCMalloc_Internal_SetLifetimeAwareFillerPlacement(value);
+  }
+
+  static bool async_release_memory_to_system() {
+    return async_release_memory_to_system_.load(std::memory_order_relaxed);
+  }
+  static void set_async_release_memory_to_system(bool value) {
+    TCMalloc_Internal_SetAsyncReleaseMemoryToSystem(value);
+  }
+
+  static bool memory_pressure_aware_release() {
+    return memory_pressure_aware_release_.load(std::memory_order_relaxed);
+  }
+  static void set_memory_pressure_aware_release(bool value) {
+    TCMalloc_Internal_SetMemoryPressureAwareRelease(value);
+  }
+
+  static bool follow_cgroup_memory_limits() {
+    return follow_cgroup_memory_limits_.load(std::memory_order_relaxed);
+  }
+  static void set_follow_cgroup_memory_limits(bool value) {
+    TCMalloc_Internal_SetFollowCgroupMemoryLimits(value);
+  }
+
+  static uint64_t large_allocation_prefault_threshold() {
+    return large_allocation_prefault_threshold_.load(std::memory_order_relaxed);
+  }
+  static void set_large_allocation_prefault_threshold(uint64_t value) {
+    TCMalloc_Internal_SetLargeAllocationPrefaultThreshold(value);
+  }
+
+  static uint64_t gigantic_page_threshold() {
+    return gigantic_page_threshold_.load(std::memory_order_relaxed);
+  }
+  static void set_gigantic_page_threshold(uint64_t value) {
+    TCMalloc_Internal_SetGiganticPageThreshold(value);
+  }
+
+  static bool audit_hugepage_backing() {
+    return audit_hugepage_backing_.load(std::memory_order_relaxed);
+  }
+  static void set_audit_hugepage_backing(bool value) {
+    TCMalloc_Internal_SetAuditHugepageBacking(value);
+  }
+
+  static bool per_cpu_caches_batch_remote_frees() {
+    return per_cpu_caches_batch_remote_frees_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_batch_remote_frees(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesBatchRemoteFrees(value);
+  }
+
+  static bool demote_idle_hugepages() {
+    return demote_idle_hugepages_.load(std::memory_order_relaxed);
+  }
+  static void set_demote_idle_hugepages(bool value) {
+    TCMalloc_Internal_SetDemoteIdleHugepages(value);
+  }
+
+  static bool cold_callsite_classification() {
+    return cold_callsite_classification_.load(std::memory_order_relaxed);
+  }
+  static void set_cold_callsite_classification(bool value) {
+    TCMalloc_Internal_SetColdCallsiteClassification(value);
+  }
+
+  static int64_t profile_samples_per_second_target() {
+    return profile_samples_per_second_target_.load(std::memory_order_relaxed);
+  }
+  static void set_profile_samples_per_second_target(int64_t value) {
+    TCMalloc_Internal_SetProfileSamplesPerSecondTarget(value);
+  }
+
+  static int64_t slow_path_latency_sampling_interval() {
+    return slow_path_latency_sampling_interval_.load(std::memory_order_relaxed);
+  }
+  static void set_slow_path_latency_sampling_interval(int64_t value) {
+    TCMalloc_Internal_SetSlowPathLatencySamplingInterval(value);
+  }
+
+  static int64_t pageheap_lock_contention_sampling_interval() {
+    return pageheap_lock_contention_sampling_interval_.load(
+        std::memory_order_relaxed);
+  }
+  static void set_pageheap_lock_contention_sampling_interval(int64_t value) {
+    TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(value);
+  }
+
+  static bool metadata_arena_hugepages() {
+    return metadata_arena_hugepages_.load(std::memory_order_relaxed);
+  }
+  static void set_metadata_arena_hugepages(bool value) {
+    TCMalloc_Internal_SetMetadataArenaHugepages(value);
+  }
+
+  static bool thread_cache_dynamic_resize() {
+    return thread_cache_dynamic_resize_.load(std::memory_order_relaxed);
+  }
+  static void set_thread_cache_dynamic_resize(bool value) {
+    TCMalloc_Internal_SetThreadCacheDynamicResize(value);
+  }
+
+  static bool release_caches_at_fork() {
+    return release_caches_at_fork_.load(std::memory_order_relaxed);
+  }
+  static void set_release_caches_at_fork(bool value) {
+    TCMalloc_Internal_SetReleaseCachesAtFork(value);
+  }
+
+  static bool adaptive_guarded_sampling() {
+    return adaptive_guarded_sampling_.load(std::memory_order_relaxed);
+  }
+  static void set_adaptive_guarded_sampling(bool value) {
+    TCMalloc_Internal_SetAdaptiveGuardedSampling(value);
+  }
+
+  static int64_t selsan_sampling_interval() {
+    return selsan_sampling_interval_.load(std::memory_order_relaxed);
+  }
+  static void set_selsan_sampling_interval(int64_t value) {
+    TCMalloc_Internal_SetSelSanSamplingInterval(value);
+  }
+
+  static uint64_t release_refault_budget() {
+    return release_refault_budget_.load(std::memory_order_relaxed);
+  }
+  static void set_release_refault_budget(uint64_t value) {
+    TCMalloc_Internal_SetReleaseRefaultBudget(value);
+  }
+
+  static uint64_t large_span_cache_bytes() {
+    return large_span_cache_bytes_.load(std::memory_order_relaxed);
+  }
+  static void set_large_span_cache_bytes(uint64_t value) {
+    TCMalloc_Internal_SetLargeSpanCacheBytes(value);
+  }
+
+  static bool per_cpu_caches_incremental_slab_resize() {
+    return per_cpu_caches_incremental_slab_resize_.load(
+        std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_incremental_slab_resize(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesIncrementalSlabResize(value);
+  }
+
+  static bool per_cpu_caches_l3_capacity_pools() {
+    return per_cpu_caches_l3_capacity_pools_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_l3_capacity_pools(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesL3CapacityPools(value);
+  }
+
+  static bool per_cpu_caches_partial_reclaim() {
+    return per_cpu_caches_partial_reclaim_.load(std::memory_order_relaxed);
+  }
+  static void set_per_cpu_caches_partial_reclaim(bool value) {
+    TCMalloc_Internal_SetPerCpuCachesPartialReclaim(value);
+  }
+
+  static bool background_event_driven() {
+    return background_event_driven_.load(std::memory_order_relaxed);
+  }
+  static void set_background_event_driven(bool value) {
+    TCMalloc_Internal_SetBackgroundEventDriven(value);
+  }
+
+  static bool transfer_cache_background_refill() {
+    return transfer_cache_background_refill_.load(std::memory_order_relaxed);
+  }
+  static void set_transfer_cache_background_refill(bool value) {
+    TCMalloc_Internal_SetTransferCacheBackgroundRefill(value);
+  }
+
+  static int64_t thread_cache_idle_flush_intervals() {
+    return thread_cache_idle_flush_intervals_.load(std::memory_order_relaxed);
+  }
+  static void set_thread_cache_idle_flush_intervals(int64_t value) {
+    TCMalloc_Internal_SetThreadCacheIdleFlushIntervals(value);
+  }
+
+  static bool frame_pointer_unwinding() {
+    return frame_pointer_unwinding_.load(std::memory_order_relaxed);
+  }
+  static void set_frame_pointer_unwinding(bool value) {
+    TCMalloc_Internal_SetFramePointerUnwinding(value);
+  }
+
+  static bool per_thread_allocation_accounting() {
+    return per_thread_allocation_accounting_.load(std::memory_order_relaxed);
+  }
+  static void set_per_thread_allocation_accounting(bool value) {
+    TCMalloc_Internal_SetPerThreadAllocationAccounting(value);
+  }
+
+  static int64_t cached_stats_max_age_ms() {
+    return cached_stats_max_age_ms_.load(std::memory_order_relaxed);
+  }
+  static void set_cached_stats_max_age_ms(int64_t value) {
+    TCMalloc_Internal_SetCachedStatsMaxAgeMs(value);
+  }
+
   static bool separate_allocs_for_few_and_many_objects_spans();
   static size_t chunks_per_alloc();
 
@@ -229,11 +535,94 @@ class Parameters {
   friend void ::TCMalloc_Internal_SetPerCpuCachesDynamicSlabShrinkThreshold(
       double v);
 
+  friend void ::TCMalloc_Internal_SetPerCpuCachesRemoteSteal(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesPartitionedSlabResize(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesAllocationRateResize(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesTargetHitRate(double v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesPrefetchColdClasses(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesThreadMagazine(bool v);
+
+  friend void ::TCMalloc_Internal_SetTransferCachePlunderIntervals(int64_t v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesBatchSizeAutotune(bool v);
+  friend void ::TCMalloc_Internal_SetPerCpuCachesSummaryStats(bool v);
+
+  friend void ::TCMalloc_Internal_SetLifetimeAwareSpanPlacement(bool v);
+
+  friend void ::TCMalloc_Internal_SetCollapseSubreleasedHugepages(bool v);
+
+  friend void ::TCMalloc_Internal_SetLifetimeAwareRegionPlacement(bool v);
+  friend void ::TCMalloc_Internal_SetLifetimeAwareFillerPlacement(bool v);
+
+  friend void ::TCMalloc_Internal_SetAsyncReleaseMemoryToSystem(bool v);
+
+  friend void ::TCMalloc_Internal_SetMemoryPressureAwareRelease(bool v);
+
+  friend void ::TCMalloc_Internal_SetFollowCgroupMemoryLimits(bool v);
+
+  friend void ::TCMalloc_Internal_SetLargeAllocationPrefaultThreshold(
+      uint64_t v);
+
+  friend void ::TCMalloc_Internal_SetGiganticPageThreshold(uint64_t v);
+
+  friend void ::TCMalloc_Internal_SetAuditHugepageBacking(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesBatchRemoteFrees(bool v);
+
+  friend void ::TCMalloc_Internal_SetDemoteIdleHugepages(bool v);
+
+  friend void ::TCMalloc_Internal_SetColdCallsiteClassification(bool v);
+
+  friend void ::TCMalloc_Internal_SetProfileSamplesPerSecondTarget(int64_t v);
+
+  friend void ::TCMalloc_Internal_SetSlowPathLatencySamplingInterval(int64_t v);
+
+  friend void ::TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(
+      int64_t v);
+
+  friend void ::TCMalloc_Internal_SetMetadataArenaHugepages(bool v);
+
+  friend void ::TCMalloc_Internal_SetThreadCacheDynamicResize(bool v);
+
+  friend void ::TCMalloc_Internal_SetReleaseCachesAtFork(bool v);
+
+  friend void ::TCMalloc_Internal_SetAdaptiveGuardedSampling(bool v);
+
+  friend void ::TCMalloc_Internal_SetSelSanSamplingInterval(int64_t v);
+
+  friend void ::TCMalloc_Internal_SetReleaseRefaultBudget(uint64_t v);
+
+  friend void ::TCMalloc_Internal_SetLargeSpanCacheBytes(uint64_t v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesIncrementalSlabResize(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesL3CapacityPools(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerCpuCachesPartialReclaim(bool v);
+
+  friend void ::TCMalloc_Internal_SetBackgroundEventDriven(bool v);
+
+  friend void ::TCMalloc_Internal_SetTransferCacheBackgroundRefill(bool v);
+
+  friend void ::TCMalloc_Internal_SetThreadCacheIdleFlushIntervals(int64_t v);
+
+  friend void ::TCMalloc_Internal_SetFramePointerUnwinding(bool v);
+
+  friend void ::TCMalloc_Internal_SetPerThreadAllocationAccounting(bool v);
+
+  friend void ::TCMalloc_Internal_SetCachedStatsMaxAgeMs(int64_t v);
+
   friend void TCMalloc_Internal_SetLifetimeAllocatorOptions(
       absl::string_view s);
   friend void ::TCMalloc_Internal_SetMadvise(
       tcmalloc::tcmalloc_internal::MadvisePreference v);
   friend void ::TCMalloc_Internal_SetMinHotAccessHint(uint8_t v);
+  friend void ::TCMalloc_Internal_SetMaxWarmAccessHint(uint8_t v);
 
   static std::atomic<MallocExtension::BytesPerSecond> background_release_rate_;
   static std::atomic<int64_t> guarded_sampling_rate_;
@@ -250,9 +639,51 @@ class Parameters {
   static std::atomic<bool> per_cpu_caches_dynamic_slab_;
   static std::atomic<MadvisePreference> madvise_;
   static std::atomic<tcmalloc::hot_cold_t> min_hot_access_hint_;
+  static std::atomic<tcmalloc::hot_cold_t> max_warm_access_hint_;
   static std::atomic<double> per_cpu_caches_dynamic_slab_grow_threshold_;
   static std::atomic<double> per_cpu_caches_dynamic_slab_shrink_threshold_;
   static std::atomic<bool> hpaa_cold_subrelease_;
+  static std::atomic<int64_t> cached_stats_max_age_ms_;
+  static std::atomic<bool> per_thread_allocation_accounting_;
+  static std::atomic<bool> frame_pointer_unwinding_;
+  static std::atomic<int64_t> thread_cache_idle_flush_intervals_;
+  static std::atomic<bool> background_event_driven_;
+  static std::atomic<bool> transfer_cache_background_refill_;
+  static std::atomic<bool> per_cpu_caches_partial_reclaim_;
+  static std::atomic<bool> per_cpu_caches_l3_capacity_pools_;
+  static std::atomic<bool> per_cpu_caches_incremental_slab_resize_;
+  static std::atomic<uint64_t> large_span_cache_bytes_;
+  static std::atomic<uint64_t> release_refault_budget_;
+  static std::atomic<int64_t> selsan_sampling_interval_;
+  static std::atomic<bool> adaptive_guarded_sampling_;
+  static std::atomic<bool> release_caches_at_fork_;
+  static std::atomic<bool> thread_cache_dynamic_resize_;
+  static std::atomic<bool> metadata_arena_hugepages_;
+  static std::atomic<int64_t> pageheap_lock_contention_sampling_interval_;
+  static std::atomic<int64_t> slow_path_latency_sampling_interval_;
+  static std::atomic<int64_t> profile_samples_per_second_target_;
+  static std::atomic<bool> cold_callsite_classification_;
+  static std::atomic<bool> demote_idle_hugepages_;
+  static std::atomic<bool> per_cpu_caches_batch_remote_frees_;
+  static std::atomic<bool> audit_hugepage_backing_;
+  static std::atomic<uint64_t> gigantic_page_threshold_;
+  static std::atomic<uint64_t> large_allocation_prefault_threshold_;
+  static std::atomic<bool> follow_cgroup_memory_limits_;
+  static std::atomic<bool> memory_pressure_aware_release_;
+  static std::atomic<bool> async_release_memory_to_system_;
+  static std::atomic<bool> lifetime_aware_region_placement_;
+  static std::atomic<bool> lifetime_aware_filler_placement_;
+  static std::atomic<bool> collapse_subreleased_hugepages_;
+  static std::atomic<bool> lifetime_aware_span_placement_;
+  static std::atomic<bool> per_cpu_caches_batch_size_autotune_;
+  static std::atomic<bool> per_cpu_caches_summary_stats_;
+  static std::atomic<int64_t> transfer_cache_plunder_intervals_;
+  static std::atomic<bool> per_cpu_caches_thread_magazine_;
+  static std::atomic<bool> per_cpu_caches_prefetch_cold_classes_;
+  static std::atomic<double> per_cpu_caches_target_hit_rate_;
+  static std::atomic<bool> per_cpu_caches_allocation_rate_resize_;
+  static std::atomic<bool> per_cpu_caches_partitioned_slab_resize_;
+  static std::atomic<bool> per_cpu_caches_remote_steal_;
 };
 
 }  // namespace tcmalloc_internal
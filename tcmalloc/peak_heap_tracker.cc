@@ -15,12 +15,13 @@
 #include "tcmalloc/peak_heap_tracker.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include <memory>
-#include <utility>
 
 #include "absl/base/internal/spinlock.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -54,14 +55,14 @@ void PeakHeapTracker::MaybeSaveSample() {
   }
   SetCurrentPeakSize(tc_globals.sampled_objects_size_.value());
 
-  // Guaranteed to have no live sample after this call since we are doing this
-  // under `recorder_lock_`.
-  peak_heap_recorder_.get_mutable().UnregisterAll();
+  ClearSamples();
   tc_globals.sampled_allocation_recorder().Iterate(
       [this](const SampledAllocation& sampled_allocation) {
         recorder_lock_.AssertHeld();
-        StackTrace st = sampled_allocation.sampled_stack;
-        peak_heap_recorder_.get_mutable().Register(std::move(st));
+        // The live sample holds its stack until we return, so we can share it.
+        tc_globals.stack_trace_store().Ref(sampled_allocation.stack);
+        peak_heap_recorder_.get_mutable().Register(sampled_allocation.details,
+                                                   sampled_allocation.stack);
       });
 }
 
@@ -71,11 +72,95 @@ std::unique_ptr<ProfileBase> PeakHeapTracker::DumpSample() {
   AllocationGuardSpinLockHolder h(&recorder_lock_);
   peak_heap_recorder_.get_mutable().Iterate(
       [&profile](const SampledAllocation& peak_heap_record) {
-        profile->AddTrace(1.0, peak_heap_record.sampled_stack);
+        profile->AddTrace(1.0, peak_heap_record.stack_trace());
       });
   return profile;
 }
 
+void PeakHeapTracker::Reset() {
+  AllocationGuardSpinLockHolder h(&recorder_lock_);
+  SetCurrentPeakSize(0);
+  ClearSamples();
+}
+
+void PeakHeapTracker::ClearSamples() {
+  // Nothing else registers or iterates the saved samples without
+  // `recorder_lock_`, so there is no live sample after this, and none of the
+  // dead ones is reused before its stack is released.
+  peak_heap_recorder_.get_mutable().Iterate(
+      [](const SampledAllocation& peak_heap_record) {
+        tc_globals.stack_trace_store().Release(peak_heap_record.stack);
+      });
+  peak_heap_recorder_.get_mutable().UnregisterAll();
+}
+
+int PeakHeapWindows::Find(absl::string_view name) const {
+  for (int i = 0; i < kMaxWindows; ++i) {
+    if (name_lengths_[i] != 0 &&
+        absl::string_view(names_[i], name_lengths_[i]) == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool PeakHeapWindows::Reset(absl::string_view name) {
+  if (name.empty() || name.size() > kMaxNameLength) {
+    return false;
+  }
+
+  AllocationGuardSpinLockHolder h(&lock_);
+  int i = Find(name);
+  if (i < 0) {
+    for (i = 0; i < kMaxWindows && name_lengths_[i] != 0; ++i) {
+    }
+    if (i == kMaxWindows) {
+      return false;
+    }
+    memcpy(names_[i], name.data(), name.size());
+    name_lengths_[i] = name.size();
+  }
+  trackers_[i].Reset();
+  active_[i].store(true, std::memory_order_release);
+  return true;
+}
+
+void PeakHeapWindows::Remove(absl::string_view name) {
+  AllocationGuardSpinLockHolder h(&lock_);
+  const int i = Find(name);
+  if (i < 0) {
+    return;
+  }
+  active_[i].store(false, std::memory_order_release);
+  name_lengths_[i] = 0;
+  trackers_[i].Reset();
+}
+
+bool PeakHeapWindows::PeakSize(absl::string_view name, size_t* size) {
+  AllocationGuardSpinLockHolder h(&lock_);
+  const int i = Find(name);
+  if (i < 0) {
+    return false;
+  }
+  *size = trackers_[i].CurrentPeakSize();
+  return true;
+}
+
+std::unique_ptr<ProfileBase> PeakHeapWindows::DumpSample(
+    absl::string_view name) {
+  int i;
+  {
+    AllocationGuardSpinLockHolder h(&lock_);
+    i = Find(name);
+  }
+  if (i < 0) {
+    return nullptr;
+  }
+  // The window may be reset or removed meanwhile, which at worst returns a
+  // profile of where it was left.
+  return trackers_[i].DumpSample();
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -23,6 +23,7 @@
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
@@ -60,6 +61,10 @@ class PeakHeapTracker {
   // Return the saved high-water-mark heap profile, if any.
   std::unique_ptr<ProfileBase> DumpSample() ABSL_LOCKS_EXCLUDED(recorder_lock_);
 
+  // Forgets the saved high-water-mark, so that the next sampled allocation
+  // saves the heap as it is then.
+  void Reset() ABSL_LOCKS_EXCLUDED(recorder_lock_);
+
   size_t CurrentPeakSize() const {
     return do_not_access_directly_peak_sampled_heap_size_.load(
         std::memory_order_relaxed);
@@ -72,6 +77,9 @@ class PeakHeapTracker {
         value, std::memory_order_relaxed);
   }
 
+  // Unregisters the saved samples and releases their stacks.
+  void ClearSamples() ABSL_EXCLUSIVE_LOCKS_REQUIRED(recorder_lock_);
+
   using PeakHeapRecorder =
       SampleRecorder<SampledAllocation, SampledAllocationAllocator>;
 
@@ -97,6 +105,64 @@ class PeakHeapTracker {
   bool IsNewPeak();
 };
 
+// PeakHeapWindows tracks the peak sampled heap over a few named windows that
+// the application resets, such as one request batch or one phase of a job.
+// Each window is a PeakHeapTracker of its own, so it costs nothing until the
+// heap grows past the window's peak.
+class PeakHeapWindows {
+ public:
+  static constexpr int kMaxWindows = 4;
+  static constexpr size_t kMaxNameLength = 32;
+
+  constexpr PeakHeapWindows() = default;
+
+  void Init(Arena* arena) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    for (PeakHeapTracker& tracker : trackers_) {
+      tracker.Init(arena);
+    }
+  }
+
+  // Updates every active window.  Should be called immediately after sampling
+  // an allocation, like PeakHeapTracker::MaybeSaveSample().
+  void MaybeSaveSample() {
+    for (int i = 0; i < kMaxWindows; ++i) {
+      if (active_[i].load(std::memory_order_acquire)) {
+        trackers_[i].MaybeSaveSample();
+      }
+    }
+  }
+
+  // Starts window `name` over, creating it if needed.  Returns false if `name`
+  // is empty or longer than kMaxNameLength, or if all windows are in use.
+  bool Reset(absl::string_view name) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Stops tracking window `name` and drops its saved samples.
+  void Remove(absl::string_view name) ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the sampled heap size at the peak of window `name`, or false if
+  // there is no such window.
+  bool PeakSize(absl::string_view name, size_t* size)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+  // Returns the saved peak heap profile of window `name`, or nullptr if there
+  // is no such window.
+  std::unique_ptr<ProfileBase> DumpSample(absl::string_view name)
+      ABSL_LOCKS_EXCLUDED(lock_);
+
+ private:
+  // Returns the index of window `name`, or -1 if there is none.
+  int Find(absl::string_view name) const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  absl::base_internal::SpinLock lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  char names_[kMaxWindows][kMaxNameLength] ABSL_GUARDED_BY(lock_) = {};
+  // Zero for unused windows.
+  size_t name_lengths_[kMaxWindows] ABSL_GUARDED_BY(lock_) = {};
+  // Set while a window is in use.  Only written under `lock_`.
+  std::atomic<bool> active_[kMaxWindows] = {};
+  PeakHeapTracker trackers_[kMaxWindows];
+};
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
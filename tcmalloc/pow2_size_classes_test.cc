@@ -0,0 +1,100 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/sizemap.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/tcmalloc_policy.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+static_assert(kPow2SizeClasses);
+
+TEST(Pow2SizeClassesTest, Configuration) {
+  Static::InitIfNecessary();
+
+  EXPECT_EQ(Static::size_class_configuration(),
+            SizeClassConfiguration::kPow2Only);
+  EXPECT_EQ(&SizeMap::CurrentClasses(), &kExperimentalPow2SizeClasses);
+  EXPECT_EQ(MallocExtension::GetEstimatedAllocatedSize(9), 16);
+  EXPECT_EQ(MallocExtension::GetEstimatedAllocatedSize(3000), 4096);
+}
+
+// The computed classes are those that a search of the table finds.
+TEST(Pow2SizeClassesTest, MatchesTable) {
+  Static::InitIfNecessary();
+  const SizeMap& size_map = Static::sizemap();
+
+  for (size_t align = 1; align <= kPageSize; align <<= 1) {
+    for (size_t size = 0; size <= kMaxSize; ++size) {
+      size_t expected = 1;
+      while (size_map.class_to_size(expected) < size ||
+             size_map.class_to_size(expected) % align != 0) {
+        ++expected;
+      }
+      size_t size_class;
+      ASSERT_TRUE(size_map.GetSizeClass(CppPolicy().AlignAs(align), size,
+                                        &size_class))
+          << size << " " << align;
+      ASSERT_EQ(size_class, expected) << size << " " << align;
+    }
+  }
+  size_t size_class;
+  EXPECT_FALSE(size_map.GetSizeClass(CppPolicy(), kMaxSize + 1, &size_class));
+}
+
+TEST(Pow2SizeClassesTest, ColdClasses) {
+  if (!ColdFeatureActive()) {
+    GTEST_SKIP() << "cold size classes are not activated";
+  }
+  Static::InitIfNecessary();
+  const SizeMap& size_map = Static::sizemap();
+
+  for (size_t size = SizeMap::kMinAllocSizeForCold; size <= kMaxSize;
+       size *= 2) {
+    EXPECT_EQ(size_map.SizeClass(CppPolicy().AccessAsCold(), size),
+              size_map.SizeClass(CppPolicy().AccessAsHot(), size) +
+                  kExpandedClassesStart)
+        << size;
+  }
+}
+
+// Tables of other classes would be mapped wrongly, so aren't accepted.
+TEST(Pow2SizeClassesTest, RejectsOtherClasses) {
+  SizeMap size_map;
+  EXPECT_FALSE(size_map.Init(kSizeClasses.classes));
+  EXPECT_TRUE(size_map.Init(kExperimentalPow2SizeClasses.classes));
+}
+
+// Spans start on page boundaries, which are multiples of the smaller classes.
+TEST(Pow2SizeClassesTest, NaturalAlignment) {
+  for (size_t size = 8; size <= kPageSize; size *= 2) {
+    void* ptr = ::operator new(size);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % size, 0) << size;
+    ::operator delete(ptr, size);
+  }
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -16,11 +16,50 @@
 
 #include <string>
 
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "tcmalloc/internal/profile.pb.h"
 #include "tcmalloc/internal/profile_builder.h"
 
 namespace tcmalloc {
+namespace {
+
+// Serializes `profile` through a gzip stream into `output`.
+absl::Status SerializeGzipped(
+    const tcmalloc_internal::perftools::profiles::Profile& profile,
+    google::protobuf::io::ZeroCopyOutputStream* output) {
+  google::protobuf::io::GzipOutputStream gzip_stream(output);
+  if (!profile.SerializeToZeroCopyStream(&gzip_stream)) {
+    return absl::InternalError("Failed to serialize to gzip stream");
+  }
+  if (!gzip_stream.Close()) {
+    return absl::InternalError("Failed to serialize to gzip stream");
+  }
+  return absl::OkStatus();
+}
+
+// Passes everything written to it on to a caller-provided sink.
+class SinkOutputStream final
+    : public google::protobuf::io::CopyingOutputStream {
+ public:
+  explicit SinkOutputStream(absl::FunctionRef<bool(absl::string_view)> sink)
+      : sink_(sink) {}
+
+  bool Write(const void* buffer, int size) override {
+    return sink_(absl::string_view(static_cast<const char*>(buffer), size));
+  }
+
+ private:
+  absl::FunctionRef<bool(absl::string_view)> sink_;
+};
+
+}  // namespace
 
 // Marshal converts a Profile instance into a gzip-encoded, serialized
 // representation suitable for viewing with PProf
@@ -33,14 +72,47 @@ absl::StatusOr<std::string> Marshal(const tcmalloc::Profile& profile) {
 
   std::string output;
   google::protobuf::io::StringOutputStream stream(&output);
-  google::protobuf::io::GzipOutputStream gzip_stream(&stream);
-  if (!(*converted_or)->SerializeToZeroCopyStream(&gzip_stream)) {
-    return absl::InternalError("Failed to serialize to gzip stream");
-  }
-  if (!gzip_stream.Close()) {
-    return absl::InternalError("Failed to serialize to gzip stream");
+  absl::Status status = SerializeGzipped(**converted_or, &stream);
+  if (!status.ok()) {
+    return status;
   }
   return output;
 }
 
+absl::Status MarshalTo(const tcmalloc::Profile& profile,
+                       absl::FunctionRef<bool(absl::string_view)> sink) {
+  auto converted_or = tcmalloc_internal::MakeProfileProto(profile);
+  if (!converted_or.ok()) {
+    return converted_or.status();
+  }
+
+  SinkOutputStream sink_stream(sink);
+  google::protobuf::io::CopyingOutputStreamAdaptor stream(&sink_stream);
+  absl::Status status = SerializeGzipped(**converted_or, &stream);
+  if (!status.ok()) {
+    return status;
+  }
+  if (!stream.Flush()) {
+    return absl::DataLossError("Failed to write to sink");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MarshalToFileDescriptor(const tcmalloc::Profile& profile, int fd) {
+  auto converted_or = tcmalloc_internal::MakeProfileProto(profile);
+  if (!converted_or.ok()) {
+    return converted_or.status();
+  }
+
+  google::protobuf::io::FileOutputStream stream(fd);
+  absl::Status status = SerializeGzipped(**converted_or, &stream);
+  if (!status.ok()) {
+    return status;
+  }
+  if (!stream.Flush()) {
+    return absl::ErrnoToStatus(stream.GetErrno(), "Failed to write profile");
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace tcmalloc
@@ -17,7 +17,10 @@
 
 #include <string>
 
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "tcmalloc/malloc_extension.h"
 
 namespace tcmalloc {
@@ -27,6 +30,16 @@ namespace tcmalloc {
 // (https://github.com/google/pprof).
 absl::StatusOr<std::string> Marshal(const tcmalloc::Profile& profile);
 
+// MarshalTo produces the same encoding as Marshal, but passes it to `sink` a
+// chunk at a time as it is compressed, rather than building it up in memory.
+// `sink` returns false on a write error, which stops marshaling.
+absl::Status MarshalTo(const tcmalloc::Profile& profile,
+                       absl::FunctionRef<bool(absl::string_view)> sink);
+
+// MarshalToFileDescriptor produces the same encoding as Marshal, and writes it
+// to `fd` as it is compressed.
+absl::Status MarshalToFileDescriptor(const tcmalloc::Profile& profile, int fd);
+
 }  // namespace tcmalloc
 
 #endif  // TCMALLOC_PROFILE_MARSHALER_H_
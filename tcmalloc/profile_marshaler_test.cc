@@ -14,6 +14,8 @@
 
 #include "tcmalloc/profile_marshaler.h"
 
+#include <stdio.h>
+
 #include <memory>
 #include <string>
 #include <utility>
@@ -23,6 +25,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/memory/memory.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
@@ -81,6 +84,65 @@ TEST(ProfileMarshalTest, Smoke) {
   EXPECT_EQ(converted.string_table(converted.default_sample_type()), "objects");
 }
 
+Profile MakeFakeProfile() {
+  auto fake_profile = std::make_unique<FakeProfile>();
+  fake_profile->SetType(ProfileType::kAllocations);
+  fake_profile->SetDuration(absl::Seconds(1));
+
+  std::vector<Profile::Sample> samples;
+  for (int i = 0; i < 100; ++i) {
+    auto& sample = samples.emplace_back();
+    sample.sum = 1024 * (i + 1);
+    sample.count = i + 1;
+    sample.requested_size = 1024;
+    sample.allocated_size = 1024;
+    sample.depth = 1;
+    sample.stack[0] = reinterpret_cast<void*>(0x1000 + i);
+  }
+  fake_profile->SetSamples(std::move(samples));
+
+  return tcmalloc_internal::ProfileAccessor::MakeProfile(
+      std::move(fake_profile));
+}
+
+TEST(ProfileMarshalTest, MarshalTo) {
+  Profile profile = MakeFakeProfile();
+  absl::StatusOr<std::string> encoded_or = Marshal(profile);
+  ASSERT_TRUE(encoded_or.ok());
+
+  std::string streamed;
+  int chunks = 0;
+  absl::Status status = MarshalTo(profile, [&](absl::string_view chunk) {
+    streamed.append(chunk.data(), chunk.size());
+    ++chunks;
+    return true;
+  });
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_GT(chunks, 0);
+  EXPECT_EQ(streamed, *encoded_or);
+
+  // A failing sink stops marshaling.
+  status = MarshalTo(profile, [](absl::string_view) { return false; });
+  EXPECT_FALSE(status.ok());
+}
+
+TEST(ProfileMarshalTest, MarshalToFileDescriptor) {
+  Profile profile = MakeFakeProfile();
+  absl::StatusOr<std::string> encoded_or = Marshal(profile);
+  ASSERT_TRUE(encoded_or.ok());
+
+  FILE* file = tmpfile();
+  ASSERT_NE(file, nullptr);
+  absl::Status status = MarshalToFileDescriptor(profile, fileno(file));
+  ASSERT_TRUE(status.ok()) << status;
+
+  std::string written(encoded_or->size() + 1, '\0');
+  rewind(file);
+  written.resize(fread(written.data(), 1, written.size(), file));
+  fclose(file);
+  EXPECT_EQ(written, *encoded_or);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -353,5 +353,52 @@ TEST(FragmentationzTest, Accuracy) {
       << " requested = " << requested_size << " count = " << count;
 }
 
+TEST(FragmentationzTest, PreciseChargesHugePageWaste) {
+  // Sample every allocation so each of ours shows up.
+  ScopedProfileSamplingRate ps(1);
+  // Disable GWP-ASan, since it allocates different sizes than normal samples.
+  ScopedGuardedSamplingRate gs(-1);
+
+  // Large enough to get a span to itself, small enough for several to share a
+  // hugepage.  The odd size lets us find our records in the table.
+  static const size_t kItemSize = (300 << 10) + 1;
+  static const int kNumItems = 64;
+
+  // Free every other allocation, leaving holes on the hugepages the rest live
+  // on.
+  std::vector<void*> keep;
+  for (int i = 0; i < kNumItems; ++i) {
+    void* ptr = ::operator new(kItemSize);
+    if (i % 2 == 0) {
+      keep.push_back(ptr);
+    } else {
+      ::operator delete(ptr);
+    }
+  }
+
+  auto sum = [](ProfileType type) {
+    size_t sum = 0;
+    MallocExtension::SnapshotCurrent(type).Iterate(
+        [&](const Profile::Sample& e) {
+          if (e.requested_size == kItemSize) {
+            sum += e.sum;
+          }
+        });
+    return sum;
+  };
+
+  // Large objects pin no co-residents on their span, so the approximate
+  // profile charges them nothing.  The precise one charges them for the holes
+  // left on their hugepages.
+  EXPECT_EQ(sum(ProfileType::kFragmentation), 0);
+#if !defined(UNDEFINED_BEHAVIOR_SANITIZER)
+  EXPECT_GT(sum(ProfileType::kPreciseFragmentation), 0);
+#endif
+
+  for (void* ptr : keep) {
+    ::operator delete(ptr);
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc
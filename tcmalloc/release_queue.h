@@ -0,0 +1,84 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_RELEASE_QUEUE_H_
+#define TCMALLOC_RELEASE_QUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <limits>
+
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Hands MallocExtension::ReleaseMemoryToSystem requests off to the background
+// thread, so that the calling thread waits neither for pageheap_lock nor for
+// the madvise calls that follow.  Requests are coalesced into a byte count,
+// which the background thread releases on its next iteration.
+//
+// We queue bytes rather than page ranges: a range picked for release stays
+// free only while pageheap_lock is held, so it has to be madvised before the
+// lock is dropped for good.
+class ReleaseQueue {
+ public:
+  constexpr ReleaseQueue() = default;
+
+  // Queues num_bytes for release.  Returns false, queueing nothing, if no
+  // thread is draining the queue, in which case the caller should release
+  // the memory itself.
+  bool Enqueue(size_t num_bytes) {
+    if (!draining_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    // Callers commonly ask for SIZE_MAX bytes to release everything, so
+    // saturate rather than wrap.
+    size_t pending = pending_.load(std::memory_order_relaxed);
+    size_t updated;
+    do {
+      updated = pending > std::numeric_limits<size_t>::max() - num_bytes
+                    ? std::numeric_limits<size_t>::max()
+                    : pending + num_bytes;
+    } while (!pending_.compare_exchange_weak(pending, updated,
+                                             std::memory_order_relaxed));
+    return true;
+  }
+
+  // Starts or stops accepting requests.  Called by the draining thread.  A
+  // request racing with SetDraining(false) may be left queued until draining
+  // resumes.
+  void SetDraining(bool draining) {
+    draining_.store(draining, std::memory_order_release);
+  }
+
+  // Returns the bytes queued since the last call.
+  size_t TakePending() {
+    return pending_.exchange(0, std::memory_order_relaxed);
+  }
+
+  size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<bool> draining_{false};
+  std::atomic<size_t> pending_{0};
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_RELEASE_QUEUE_H_
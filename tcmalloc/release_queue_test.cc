@@ -0,0 +1,81 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/release_queue.h"
+
+#include <stddef.h>
+
+#include <limits>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+TEST(ReleaseQueueTest, RejectsWithoutDrainer) {
+  ReleaseQueue queue;
+  EXPECT_FALSE(queue.Enqueue(100));
+  EXPECT_EQ(queue.pending(), 0);
+
+  queue.SetDraining(true);
+  EXPECT_TRUE(queue.Enqueue(100));
+  EXPECT_TRUE(queue.Enqueue(50));
+  EXPECT_EQ(queue.TakePending(), 150);
+  EXPECT_EQ(queue.TakePending(), 0);
+
+  queue.SetDraining(false);
+  EXPECT_FALSE(queue.Enqueue(100));
+  EXPECT_EQ(queue.pending(), 0);
+}
+
+TEST(ReleaseQueueTest, Saturates) {
+  ReleaseQueue queue;
+  queue.SetDraining(true);
+  ASSERT_TRUE(queue.Enqueue(100));
+  ASSERT_TRUE(queue.Enqueue(std::numeric_limits<size_t>::max()));
+  ASSERT_TRUE(queue.Enqueue(100));
+  EXPECT_EQ(queue.TakePending(), std::numeric_limits<size_t>::max());
+}
+
+TEST(ReleaseQueueTest, ConcurrentEnqueue) {
+  constexpr int kThreads = 4;
+  constexpr int kRequests = 10000;
+  ReleaseQueue queue;
+  queue.SetDraining(true);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < kRequests; ++j) {
+        ASSERT_TRUE(queue.Enqueue(1));
+      }
+    });
+  }
+  size_t taken = 0;
+  for (int i = 0; i < 100; ++i) {
+    taken += queue.TakePending();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  taken += queue.TakePending();
+  EXPECT_EQ(taken, kThreads * kRequests);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
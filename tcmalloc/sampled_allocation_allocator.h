@@ -15,7 +15,7 @@
 #ifndef TCMALLOC_SAMPLED_ALLOCATION_ALLOCATOR_H_
 #define TCMALLOC_SAMPLED_ALLOCATION_ALLOCATOR_H_
 
-#include <utility>
+#include <new>
 
 #include "absl/base/thread_annotations.h"
 #include "tcmalloc/arena.h"
@@ -42,17 +42,18 @@ class SampledAllocationAllocator {
   constexpr SampledAllocationAllocator() = default;
 
   void Init(Arena* arena) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
-    allocator_.Init(arena);
+    allocator_.Init(arena, ArenaUse::kSampled);
   }
 
-  SampledAllocation* New(StackTrace stack_trace)
+  SampledAllocation* New(const SampleDetails& details,
+                         const StoredStack* stack)
       ABSL_LOCKS_EXCLUDED(pageheap_lock) {
     SampledAllocation* s;
     {
       PageHeapSpinLockHolder l;
       s = allocator_.New();
     }
-    return new (s) SampledAllocation(std::move(stack_trace));
+    return new (s) SampledAllocation(details, stack);
   }
 
   void Delete(SampledAllocation* s) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
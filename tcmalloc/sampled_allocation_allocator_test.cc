@@ -34,10 +34,13 @@ TEST(SampledAllocationAllocatorTest, AllocAndDealloc) {
   st.depth = absl::GetStackTrace(st.stack, kMaxStackDepth, /* skip_count= */ 0);
   st.requested_size = 8;
   st.allocated_size = 8;
-  SampledAllocation* sampled_allocation = allocator.New(st);
-  EXPECT_GT(sampled_allocation->sampled_stack.depth, 0);
-  EXPECT_EQ(sampled_allocation->sampled_stack.requested_size, 8);
-  EXPECT_EQ(sampled_allocation->sampled_stack.allocated_size, 8);
+  StoredStack stored = {.next = nullptr, .hash = 0, .refs = 1};
+  stored.depth = st.depth;
+  SampledAllocation* sampled_allocation = allocator.New(st, &stored);
+  EXPECT_EQ(sampled_allocation->stack, &stored);
+  EXPECT_GT(sampled_allocation->stack->depth, 0);
+  EXPECT_EQ(sampled_allocation->details.requested_size, 8);
+  EXPECT_EQ(sampled_allocation->details.allocated_size, 8);
   allocator.Delete(sampled_allocation);
 }
 
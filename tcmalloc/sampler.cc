@@ -22,8 +22,11 @@
 #include <limits>
 
 #include "absl/base/attributes.h"
+#include "absl/base/call_once.h"
 #include "absl/base/optimization.h"
+#include "absl/strings/numbers.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/exponential_biased.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/parameters.h"
@@ -41,6 +44,27 @@ namespace tcmalloc_internal {
 // counter value and then add it back when we calculate the sample weight.
 constexpr ssize_t kIntervalOffset = 1;
 
+// TCMALLOC_SAMPLER_SEED, if set, seeds each thread's sampler from it and the
+// order in which threads first allocate, rather than from the sampler's
+// address, so that a workload which starts its threads in the same order
+// samples the same allocations in every run.  Returns 0 if it is unset.
+static uint64_t FixedSamplerSeed() {
+  ABSL_CONST_INIT static uint64_t seed = 0;
+  ABSL_CONST_INIT static absl::once_flag flag;
+
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_SAMPLER_SEED");
+    if (e == nullptr || *e == '\0') {
+      return;
+    }
+    if (!absl::SimpleAtoi(e, &seed) || seed == 0) {
+      TC_BUG("bad env var TCMALLOC_SAMPLER_SEED='%s'", e);
+    }
+  });
+
+  return seed;
+}
+
 ssize_t Sampler::GetSamplePeriod() {
   return Parameters::profile_sampling_rate();
 }
@@ -126,7 +150,9 @@ size_t Sampler::RecordAllocationSlow(size_t k) {
     initialized_ = true;
     uint64_t global_seed =
         global_randomness.fetch_add(1, std::memory_order_relaxed);
-    Init(reinterpret_cast<uintptr_t>(this) ^ global_seed);
+    const uint64_t fixed_seed = FixedSamplerSeed();
+    Init(fixed_seed != 0 ? fixed_seed + global_seed
+                         : reinterpret_cast<uintptr_t>(this) ^ global_seed);
     // Avoid missampling 0.
     bytes_until_sample_ -= k + 1;
     if (ABSL_PREDICT_TRUE(bytes_until_sample_ >= 0)) {
@@ -147,12 +173,34 @@ size_t Sampler::RecordAllocationSlow(size_t k) {
   //
   size_t weight = sample_period_ - bytes_until_sample_ - kIntervalOffset;
   bytes_until_sample_ = PickNextSamplingPoint();
-  return GetSamplePeriod() <= 0 ? 0 : weight;
+  // PickNextSamplingPoint just read the current sampling period.
+  return sample_period_ <= 0 ? 0 : weight;
+}
+
+int64_t AdaptSamplingRate(int64_t rate, double samples_per_second,
+                          double target) {
+  TC_ASSERT_GT(target, 0);
+  if (rate <= 0) {
+    // Sampling is disabled; we leave it to whoever disabled it.
+    return rate;
+  }
+  if (std::abs(samples_per_second - target) <=
+      kSamplingRateTolerance * target) {
+    return rate;
+  }
+  const double factor = std::clamp(samples_per_second / target,
+                                   1 / kMaxSamplingRateStep,
+                                   kMaxSamplingRateStep);
+  const double adapted =
+      std::clamp(static_cast<double>(rate) * factor,
+                 static_cast<double>(kMinAdaptiveSamplingRate),
+                 static_cast<double>(kMaxAdaptiveSamplingRate));
+  return static_cast<int64_t>(adapted);
 }
 
-double AllocatedBytes(const StackTrace& stack) {
-  return static_cast<double>(stack.weight) * stack.allocated_size /
-         (stack.requested_size + 1);
+double AllocatedBytes(const SampleDetails& sample) {
+  return static_cast<double>(sample.weight) * sample.allocated_size /
+         (sample.requested_size + 1);
 }
 
 }  // namespace tcmalloc_internal
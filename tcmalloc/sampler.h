@@ -120,6 +120,16 @@ class Sampler {
   // Returns the current sample period
   static ssize_t GetSamplePeriod();
 
+  // Adds to the exact counts of the bytes this thread allocated and freed,
+  // which are kept while Parameters::per_thread_allocation_accounting() is
+  // set.  They share the cache line of bytes_until_sample_, which every
+  // allocation touches anyway.
+  void RecordAllocatedBytes(size_t bytes) { allocated_bytes_ += bytes; }
+  void RecordFreedBytes(size_t bytes) { freed_bytes_ += bytes; }
+
+  size_t allocated_bytes() const { return allocated_bytes_; }
+  size_t freed_bytes() const { return freed_bytes_; }
+
   // The following are public for the purposes of testing
 
   // Used to ensure that the hot fields are collocated in the same cache line
@@ -132,7 +142,9 @@ class Sampler {
       : sample_period_(0),
         rnd_(0),
         initialized_(false),
-        bytes_until_sample_(0) {}
+        bytes_until_sample_(0),
+        allocated_bytes_(0),
+        freed_bytes_(0) {}
 
  private:
   // Saved copy of the sampling period from when we actually set
@@ -153,6 +165,10 @@ class Sampler {
   // DecrementFast{,Finish}, so casting to size_t is ok.
   ssize_t bytes_until_sample_;
 
+  // Only written by the owning thread.
+  size_t allocated_bytes_;
+  size_t freed_bytes_;
+
  private:
   friend class SamplerTest;
   // Initialize this sampler.
@@ -195,7 +211,26 @@ inline bool Sampler::WillRecordAllocation(size_t k) {
 
 // Returns the approximate number of bytes that would have been allocated to
 // obtain this sample.
-double AllocatedBytes(const StackTrace& stack);
+double AllocatedBytes(const SampleDetails& sample);
+
+// Bounds and step of the adaptive sampling rate (see AdaptSamplingRate).
+inline constexpr int64_t kMinAdaptiveSamplingRate = int64_t{64} << 10;
+inline constexpr int64_t kMaxAdaptiveSamplingRate = int64_t{1} << 30;
+inline constexpr double kMaxSamplingRateStep = 2.0;
+inline constexpr double kSamplingRateTolerance = 0.1;
+
+// Returns the sampling rate that brings the <samples_per_second> observed at
+// <rate> to <target> samples per second.  Since samples are taken in
+// proportion to the bytes allocated, the rate scales with the observed
+// number of samples.  Rates change by at most kMaxSamplingRateStep per call
+// and stay within [kMinAdaptiveSamplingRate, kMaxAdaptiveSamplingRate];
+// observations within kSamplingRateTolerance of the target leave the rate as
+// it was.
+//
+// Changing the rate does not bias profiles: each sample is weighed by the
+// rate its sampling point was drawn with.
+int64_t AdaptSamplingRate(int64_t rate, double samples_per_second,
+                          double target);
 
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -0,0 +1,103 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+
+#include <cstdint>
+
+#include "absl/base/optimization.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/allocation_sampling.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/sampler.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// BM_TryRecordAllocationFast measures the countdown on the allocation fast
+// path alone.  Allocations are tiny next to the default sampling period, so
+// nearly every iteration stays on the fast path.
+void BM_TryRecordAllocationFast(benchmark::State& state) {
+  const size_t size = state.range(0);
+  Sampler sampler;
+  // Initialize the sampler through the slow path, as the first allocation of
+  // a thread does.
+  benchmark::DoNotOptimize(sampler.RecordAllocation(size));
+
+  int64_t slow = 0;
+  for (auto s : state) {
+    if (ABSL_PREDICT_FALSE(!sampler.TryRecordAllocationFast(size))) {
+      benchmark::DoNotOptimize(sampler.RecordedAllocationFast(size));
+      ++slow;
+    }
+  }
+  state.counters["slow_path_fraction"] = benchmark::Counter(
+      static_cast<double>(slow), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_TryRecordAllocationFast)->Arg(8)->Arg(64)->Arg(1024)->Arg(32768);
+
+// BM_ThreadSampler measures the same countdown on the thread's own sampler, as
+// malloc uses it, whose hot data shares a cache line with the per-CPU cache's
+// rseq state.
+void BM_ThreadSampler(benchmark::State& state) {
+  const size_t size = state.range(0);
+  Sampler* sampler = GetThreadSampler();
+  for (auto s : state) {
+    if (ABSL_PREDICT_FALSE(!sampler->TryRecordAllocationFast(size))) {
+      benchmark::DoNotOptimize(sampler->RecordedAllocationFast(size));
+    }
+  }
+}
+
+BENCHMARK(BM_ThreadSampler)->Arg(8)->Arg(64)->Arg(1024)->Arg(32768);
+
+// BM_PickNextSamplingPoint measures drawing the next sampling point, which
+// every sampled allocation pays for.
+void BM_PickNextSamplingPoint(benchmark::State& state) {
+  Sampler sampler;
+  benchmark::DoNotOptimize(sampler.RecordAllocation(0));
+  for (auto s : state) {
+    benchmark::DoNotOptimize(sampler.PickNextSamplingPoint());
+  }
+}
+
+BENCHMARK(BM_PickNextSamplingPoint);
+
+// BM_RecordAllocation mixes the fast and slow paths in the proportion the
+// allocation size and the sampling period give.
+void BM_RecordAllocation(benchmark::State& state) {
+  const size_t size = state.range(0);
+  Sampler sampler;
+  size_t weight = 0;
+  for (auto s : state) {
+    weight += sampler.RecordAllocation(size);
+  }
+  benchmark::DoNotOptimize(weight);
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_RecordAllocation)
+    ->Arg(8)
+    ->Arg(1024)
+    ->Arg(32768)
+    ->Arg(1 << 20)
+    ->Arg(16 << 20);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -27,6 +27,7 @@
 #include "absl/base/internal/sysinfo.h"
 #include "absl/debugging/stacktrace.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "tcmalloc/guarded_allocations.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -139,6 +140,62 @@ GuardedAllocationsErrorType RefineErrorTypeBasedOnContext(
   return RefineErrorTypeBasedOnWriteFlag(error, write_flag);
 }
 
+size_t FormatStackTrace(absl::Span<char> buf, absl::string_view label,
+                        void* const* stack, size_t depth) {
+  constexpr absl::string_view kPrefix = "GWP-ASan ";
+  // A space, "0x" and up to 16 digits.
+  constexpr size_t kMaxFrameSize = 3 + 2 * sizeof(uintptr_t);
+  if (buf.size() < kPrefix.size() + label.size() + 2) {
+    return 0;
+  }
+
+  char* p = buf.data();
+  // Leave room for the trailing newline.
+  char* const end = buf.data() + buf.size() - 1;
+  memcpy(p, kPrefix.data(), kPrefix.size());
+  p += kPrefix.size();
+  memcpy(p, label.data(), label.size());
+  p += label.size();
+  *p++ = ':';
+  for (size_t i = 0;
+       i < depth && static_cast<size_t>(end - p) >= kMaxFrameSize; ++i) {
+    static constexpr char kDigits[] = "0123456789abcdef";
+    char digits[2 * sizeof(uintptr_t)];
+    uintptr_t pc = reinterpret_cast<uintptr_t>(stack[i]);
+    int n = 0;
+    do {
+      digits[n++] = kDigits[pc & 0xf];
+      pc >>= 4;
+    } while (pc != 0);
+
+    *p++ = ' ';
+    *p++ = '0';
+    *p++ = 'x';
+    while (n > 0) {
+      *p++ = digits[--n];
+    }
+  }
+  *p++ = '\n';
+  return p - buf.data();
+}
+
+// Writes `stack` as a single line, rather than a line per frame.  Reports are
+// printed while crashing, which should not be slowed down by formatting or
+// symbolizing each frame.
+static void PrintCompactStackTrace(absl::string_view label, void* const* stack,
+                                   size_t depth) {
+  char buf[kMaxStackDepth * (3 + 2 * sizeof(uintptr_t)) + 64];
+  size_t n = FormatStackTrace(absl::MakeSpan(buf), label, stack, depth);
+  (*log_message_writer)(buf, n);
+}
+
+static void PrintCompactStackTraceFromSignalHandler(void* context) {
+  void* stack[kMaxStackDepth];
+  size_t depth = absl::GetStackTraceWithContext(stack, kMaxStackDepth, 1,
+                                                context, nullptr);
+  PrintCompactStackTrace("access", stack, depth);
+}
+
 // This is overridden by selsan, if it's linked in.
 ABSL_ATTRIBUTE_WEAK void SelsanTrapHandler(void* info, void* ctx) {}
 
@@ -169,14 +226,15 @@ void SegvHandler(int signo, siginfo_t* info, void* context) {
   TC_LOG(">>> Access at offset %v into buffer of length %v", offset, size);
   TC_LOG("Error originates from memory allocated in thread %v at:",
          alloc_trace->thread_id);
-  PrintStackTrace(alloc_trace->stack, alloc_trace->depth);
+  PrintCompactStackTrace("alloc", alloc_trace->stack, alloc_trace->depth);
 
   switch (error) {
     case GuardedAllocationsErrorType::kUseAfterFree:
     case GuardedAllocationsErrorType::kUseAfterFreeRead:
     case GuardedAllocationsErrorType::kUseAfterFreeWrite:
       TC_LOG("The memory was freed in thread %v at:", dealloc_trace->thread_id);
-      PrintStackTrace(dealloc_trace->stack, dealloc_trace->depth);
+      PrintCompactStackTrace("dealloc", dealloc_trace->stack,
+                             dealloc_trace->depth);
       TC_LOG("Use-after-free %s occurs in thread %v at:",
              WriteFlagToString(write_flag), current_thread);
       RecordCrash("GWP-ASan", "use-after-free");
@@ -197,7 +255,8 @@ void SegvHandler(int signo, siginfo_t* info, void* context) {
       break;
     case GuardedAllocationsErrorType::kDoubleFree:
       TC_LOG("The memory was freed in thread %v at:", dealloc_trace->thread_id);
-      PrintStackTrace(dealloc_trace->stack, dealloc_trace->depth);
+      PrintCompactStackTrace("dealloc", dealloc_trace->stack,
+                             dealloc_trace->depth);
       TC_LOG("Double free occurs in thread %v at:", current_thread);
       RecordCrash("GWP-ASan", "double-free");
       break;
@@ -209,7 +268,7 @@ void SegvHandler(int signo, siginfo_t* info, void* context) {
     case GuardedAllocationsErrorType::kUnknown:
       TC_BUG("Unexpected GuardedAllocationsErrorType::kUnknown");
   }
-  PrintStackTraceFromSignalHandler(context);
+  PrintCompactStackTraceFromSignalHandler(context);
   if (error == GuardedAllocationsErrorType::kBufferOverflowOnDealloc) {
     TC_LOG(
         "*** Try rerunning with --config=asan to get stack trace of overflow "
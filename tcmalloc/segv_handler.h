@@ -16,6 +16,10 @@
 #define TCMALLOC_SEGV_HANDLER_H_
 
 #include <signal.h>
+#include <stddef.h>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 #include "tcmalloc/guarded_allocations.h"
 #include "tcmalloc/internal/config.h"
@@ -27,6 +31,13 @@ namespace tcmalloc_internal {
 GuardedAllocationsErrorType RefineErrorTypeBasedOnContext(
     const void* context, GuardedAllocationsErrorType error);
 
+// Formats `stack` into `buf` as a single line, "GWP-ASan <label>:" followed by
+// the raw program counters in hexadecimal, and returns the length written.
+// The line is cheap to produce from a signal handler and is symbolized
+// offline.  Frames that do not fit are dropped.
+size_t FormatStackTrace(absl::Span<char> buf, absl::string_view label,
+                        void* const* stack, size_t depth);
+
 void SegvHandler(int signo, siginfo_t* info, void* context);
 
 }  // namespace tcmalloc_internal
@@ -14,10 +14,17 @@
 
 #include "tcmalloc/segv_handler.h"
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 
+#include <vector>
+
 #include "gtest/gtest.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/logging.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/static_vars.h"
 
@@ -94,6 +101,38 @@ TEST(SegvHandlerTest, SignalHandlerStackConsumption) {
   EXPECT_GT(usage, kExpectedUsage * (100 - kUsageSlack) / 100);
 }
 
+TEST(SegvHandlerTest, FormatStackTrace) {
+  void* stack[] = {reinterpret_cast<void*>(0x1234),
+                   reinterpret_cast<void*>(uintptr_t{0xdeadbeef0}),
+                   reinterpret_cast<void*>(0)};
+  char buf[128];
+  size_t n = FormatStackTrace(absl::MakeSpan(buf), "alloc", stack, 3);
+  EXPECT_EQ(absl::string_view(buf, n),
+            "GWP-ASan alloc: 0x1234 0xdeadbeef0 0x0\n");
+
+  n = FormatStackTrace(absl::MakeSpan(buf), "access", stack, 0);
+  EXPECT_EQ(absl::string_view(buf, n), "GWP-ASan access:\n");
+}
+
+TEST(SegvHandlerTest, FormatStackTraceTruncates) {
+  std::vector<void*> stack(kMaxStackDepth,
+                           reinterpret_cast<void*>(~uintptr_t{0}));
+  char buf[64];
+  size_t n = FormatStackTrace(absl::MakeSpan(buf), "alloc", stack.data(),
+                              stack.size());
+  ASSERT_GT(n, 0);
+  ASSERT_LE(n, sizeof(buf));
+  absl::string_view line(buf, n);
+  EXPECT_EQ(line.back(), '\n');
+  // Only whole frames are written.
+  EXPECT_EQ(line.find(' ', line.rfind("0x")), absl::string_view::npos);
+
+  // Too small for even the label.
+  EXPECT_EQ(FormatStackTrace(absl::MakeSpan(buf, 8), "alloc", stack.data(),
+                             stack.size()),
+            0);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
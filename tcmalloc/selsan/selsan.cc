@@ -28,6 +28,10 @@
 
 #include <utility>
 
+#ifdef __aarch64__
+#include <sys/auxv.h>
+#endif
+
 #ifdef __x86_64__
 #include <asm/prctl.h>
 #include <sys/syscall.h>
@@ -90,8 +94,27 @@ bool EnableTBI() {
 #ifndef PR_TAGGED_ADDR_ENABLE
 #define PR_TAGGED_ADDR_ENABLE (1UL << 0)
 #endif
-  TC_CHECK_EQ(0, prctl(PR_SET_TAGGED_ADDR_CTRL, PR_TAGGED_ADDR_ENABLE, 0, 0, 0),
-              "errno=%d", errno);
+  unsigned long ctrl = PR_TAGGED_ADDR_ENABLE;  // NOLINT(runtime/int)
+  if (kMte) {
+#ifndef HWCAP2_MTE
+#define HWCAP2_MTE (1 << 18)
+#endif
+#ifndef PR_MTE_TCF_SYNC
+#define PR_MTE_TCF_SYNC (1UL << 1)
+#endif
+#ifndef PR_MTE_TAG_SHIFT
+#define PR_MTE_TAG_SHIFT 3
+#endif
+    // Without MTE the STG instructions we tag memory with would fault.
+    if ((getauxval(AT_HWCAP2) & HWCAP2_MTE) == 0) {
+      return false;
+    }
+    // Report mismatches synchronously, at the faulting access.  The tag mask
+    // only matters for IRG, which we don't use, but excludes the untagged 0.
+    ctrl |= PR_MTE_TCF_SYNC | (0xfffeUL << PR_MTE_TAG_SHIFT);
+  }
+  TC_CHECK_EQ(0, prctl(PR_SET_TAGGED_ADDR_CTRL, ctrl, 0, 0, 0), "errno=%d",
+              errno);
   return true;
 #else
   return false;
@@ -99,7 +122,11 @@ bool EnableTBI() {
 }
 
 void Init() {
-  MapShadow();
+  // With MTE the tags live in the hardware, and the compiler doesn't emit the
+  // checks that read the shadow.
+  if (!kMte) {
+    MapShadow();
+  }
   if (HeapObjectInfo == nullptr) {
     return;  // don't have tcmalloc linked in
   }
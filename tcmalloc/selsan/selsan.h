@@ -16,6 +16,9 @@
 #define TCMALLOC_SELSAN_SELSAN_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/logging.h"
@@ -52,11 +55,30 @@ inline constexpr uintptr_t kTagUnsetMask = 1ul << 63;
 #elif defined(__aarch64__)
 inline constexpr uintptr_t kAddressSpaceBits = 48;
 inline constexpr uintptr_t kTagShift = 56;
+#ifdef TCMALLOC_INTERNAL_SELSAN_MTE
+// MTE only keeps bits 56-59 of the pointer as the tag, so the increment
+// must not carry into the rest of the top byte.
+inline constexpr uintptr_t kTagUnsetMask = 0xful << (kTagShift + 4);
+#else
 inline constexpr uintptr_t kTagUnsetMask = 0;
+#endif
 #else
 #error "Unsupported platform."
 #endif
 
+#if defined(TCMALLOC_INTERNAL_SELSAN_MTE) && !defined(__aarch64__)
+#error "TCMALLOC_INTERNAL_SELSAN_MTE requires aarch64."
+#endif
+
+#ifdef TCMALLOC_INTERNAL_SELSAN_MTE
+// Retagging steps through all 16 MTE tags.
+inline constexpr uintptr_t kTagIncrement = 1ul << kTagShift;
+inline constexpr bool kMte = true;
+#else
+inline constexpr uintptr_t kTagIncrement = 1ul << (kTagShift + 1);
+inline constexpr bool kMte = false;
+#endif
+
 inline constexpr uintptr_t kShadowShift = 4;
 inline constexpr uintptr_t kShadowScale = 1 << kShadowShift;
 
@@ -86,7 +108,61 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE size_t RoundUpObjectSize(size_t size) {
   return (size + kShadowScale - 1) & ~(kShadowScale - 1);
 }
 
-#if __has_builtin(__builtin_memset_inline)
+#ifndef PROT_MTE
+#define PROT_MTE 0x20
+#endif
+
+// Returns the protection bits, besides PROT_READ | PROT_WRITE, that heap memory
+// for SelSan objects must be mapped with.
+inline int ExtraProtection() { return kMte && IsEnabled() ? PROT_MTE : 0; }
+
+#ifdef __aarch64__
+// Sets the MTE tag of the granules of [ptr, ptr + size) to the tag in bits
+// 56-59 of ptr, with STG for an odd granule and ST2G for pairs of them.  The
+// memory must be mapped with PROT_MTE.  This stands in for the shadow in the
+// TCMALLOC_INTERNAL_SELSAN_MTE build, where the hardware checks the tags.
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void SetTagMte(uintptr_t ptr, size_t size) {
+  TC_ASSERT_NE(size, 0);
+  static_assert(kShadowScale == 16, "MTE granules are 16 bytes");
+  TC_ASSERT_EQ(ptr % kShadowScale, 0);
+  const size_t granules = (size + kShadowScale - 1) / kShadowScale;
+  if (granules % 2 != 0) {
+    asm volatile(".arch_extension memtag\n\tstg %0, [%0]"
+                 :
+                 : "r"(ptr)
+                 : "memory");
+    ptr += kShadowScale;
+  }
+  const uintptr_t end = ptr + (granules / 2) * 2 * kShadowScale;
+  for (; ptr != end; ptr += 2 * kShadowScale) {
+    asm volatile(".arch_extension memtag\n\tst2g %0, [%0]"
+                 :
+                 : "r"(ptr)
+                 : "memory");
+  }
+}
+#endif  // #ifdef __aarch64__
+
+// Objects of at least this size have their shadow set by memset.  For them the
+// call is amortized, and memset picks the fastest way to store that much for
+// the CPU (e.g. rep stosb or wider vectors), where our loop below is limited
+// to the vector width the binary is compiled for.
+inline constexpr size_t kMemsetMinSize = 2048 * kShadowScale;
+
+// Sets the shadow of [ptr, ptr + size) with memset.
+inline void SetTagMemset(uintptr_t ptr, size_t size, unsigned char tag) {
+  uintptr_t off = (ptr << (64 - kTagShift)) >> (64 - kTagShift + kShadowShift);
+  memset(reinterpret_cast<unsigned char*>(kShadowBase + off), tag,
+         (size + kShadowScale - 1) / kShadowScale);
+}
+
+#if defined(TCMALLOC_INTERNAL_SELSAN_MTE)
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void SetTag(uintptr_t ptr, size_t size,
+                                                unsigned char tag) {
+  SetTagMte((ptr & ((1ul << kTagShift) - 1)) | (uintptr_t{tag} << kTagShift),
+            size);
+}
+#elif __has_builtin(__builtin_memset_inline)
 template <size_t kBlockSize>
 ABSL_ATTRIBUTE_ALWAYS_INLINE void SetTagTail(unsigned char* p, size_t size,
                                              unsigned char tag) {
@@ -125,6 +201,8 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void SetTag(uintptr_t ptr, size_t size,
     // resorting to machine-specific intrinsics:
     // https://github.com/llvm/llvm-project/issues/69895
     SetTagPair<64>(p, size, tag);
+  } else if (size >= kMemsetMinSize) {
+    SetTagMemset(ptr, size, tag);
   } else {
     const size_t kUnroll = 4;
     const size_t kBlockSize = 32;
@@ -145,17 +223,21 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void SetTag(uintptr_t ptr, size_t size,
     SetTagTail<kBlockSize>(p, size, tag);
   }
 }
-#else   // #if __has_builtin(__builtin_memset_inline)
+#else   // #elif __has_builtin(__builtin_memset_inline)
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void SetTag(uintptr_t ptr, size_t size,
                                                 unsigned char tag) {
   TC_ASSERT_NE(size, 0);
+  if (size >= kMemsetMinSize) {
+    SetTagMemset(ptr, size, tag);
+    return;
+  }
   uintptr_t off = (ptr << (64 - kTagShift)) >> (64 - kTagShift + kShadowShift);
   auto* p = reinterpret_cast<unsigned char*>(kShadowBase + off);
   for (size_t i = 0; i < RoundUpObjectSize(size) / kShadowScale; i++) {
     p[i] = tag;
   }
 }
-#endif  // #if __has_builtin(__builtin_memset_inline)
+#endif  // #elif __has_builtin(__builtin_memset_inline)
 
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* RemoveTag(const void* ptr) {
   return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) &
@@ -172,7 +254,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* ResetTag(void* ptr, size_t size) {
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* UpdateTag(void* ptr, size_t size) {
   TC_ASSERT(IsEnabled());
   uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
-  p += 1ul << (kTagShift + 1);
+  p += kTagIncrement;
   p &= ~kTagUnsetMask;
   SetTag(reinterpret_cast<uintptr_t>(ptr), size, p >> 56);
   return reinterpret_cast<void*>(p);
@@ -188,6 +270,7 @@ inline void* ResetTag(void* ptr, size_t size) { return ptr; }
 inline void* UpdateTag(void* ptr, size_t size) { return ptr; }
 inline void* RemoveTag(const void* ptr) { return const_cast<void*>(ptr); }
 inline bool IsEnabled() { return false; }
+inline int ExtraProtection() { return 0; }
 inline void PrintTextStats(Printer* out) {}
 inline void PrintPbtxtStats(PbtxtRegion* out) {}
 
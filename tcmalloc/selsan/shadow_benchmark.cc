@@ -0,0 +1,106 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The benchmark won't work in the actual SelSan build b/c it uses fake shadow.
+// To compare the allocation throughput with SelSan on and off, run the
+// allocation benchmarks in a TCMALLOC_INTERNAL_SELSAN_FAKE_MODE build.
+// On aarch64, BM_SetTagMte times the tagging the TCMALLOC_INTERNAL_SELSAN_MTE
+// build does instead of BM_SetTag's shadow stores.
+#if !defined(TCMALLOC_INTERNAL_SELSAN) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+#define TCMALLOC_INTERNAL_SELSAN 1
+#define TCMALLOC_SELSAN_TEST_SHADOW_OVERRIDE 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#ifdef __aarch64__
+#include <sys/auxv.h>
+#endif
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/selsan/selsan.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal::selsan {
+
+bool enabled = true;
+unsigned char test_shadow[(256 << 10) / kShadowScale];
+uintptr_t kShadowBase = reinterpret_cast<uintptr_t>(test_shadow);
+
+namespace {
+
+// Tags objects of the given size, as allocating and freeing them does.
+void BM_SetTag(benchmark::State& state) {
+  const size_t size = state.range(0);
+  unsigned char tag = 0;
+  for (auto _ : state) {
+    SetTag(0x1800000000000000, size, tag++);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+// Tags objects of the given size with memset, whatever their size.
+void BM_SetTagMemset(benchmark::State& state) {
+  const size_t size = state.range(0);
+  unsigned char tag = 0;
+  for (auto _ : state) {
+    SetTagMemset(0x1800000000000000, size, tag++);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+#ifdef __aarch64__
+// Tags objects of the given size with STG/ST2G, in memory mapped with PROT_MTE.
+void BM_SetTagMte(benchmark::State& state) {
+#ifndef HWCAP2_MTE
+#define HWCAP2_MTE (1 << 18)
+#endif
+  if ((getauxval(AT_HWCAP2) & HWCAP2_MTE) == 0) {
+    state.SkipWithError("MTE is not supported");
+    return;
+  }
+  const size_t size = state.range(0);
+  constexpr size_t kMapSize = 256 << 10;
+  void* mem = mmap(nullptr, kMapSize, PROT_READ | PROT_WRITE | PROT_MTE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    state.SkipWithError("mmap(PROT_MTE) failed");
+    return;
+  }
+  const uintptr_t base = reinterpret_cast<uintptr_t>(mem);
+  uintptr_t tag = 0;
+  for (auto _ : state) {
+    SetTagMte(base | (tag++ % 16) << kTagShift, size);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  munmap(mem, kMapSize);
+}
+#endif  // #ifdef __aarch64__
+
+BENCHMARK(BM_SetTag)->RangeMultiplier(2)->Range(16, 256 << 10);
+BENCHMARK(BM_SetTagMemset)->RangeMultiplier(2)->Range(16, 256 << 10);
+#ifdef __aarch64__
+BENCHMARK(BM_SetTagMte)->RangeMultiplier(2)->Range(16, 256 << 10);
+#endif
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal::selsan
+GOOGLE_MALLOC_SECTION_END
+#endif
@@ -27,7 +27,7 @@
 namespace tcmalloc::tcmalloc_internal::selsan {
 
 bool enabled = true;
-unsigned char test_shadow[1024];
+unsigned char test_shadow[kMemsetMinSize / kShadowScale + 1024];
 uintptr_t kShadowBase = reinterpret_cast<uintptr_t>(test_shadow);
 
 namespace {
@@ -120,8 +120,23 @@ TEST(Unit, UpdateTag) {
 }
 
 TEST(Unit, SetTag) {
-  for (size_t size = 1; size < (sizeof(test_shadow) - 2) * kShadowScale;
-       size++) {
+  for (size_t size = 1; size < 1022 * kShadowScale; size++) {
+    SCOPED_TRACE(size);
+    memset(test_shadow, 0x55, sizeof(test_shadow));
+    SetTag(0x1800000000000000 + kShadowScale, size, 0x77);
+    size_t n = (size + kShadowScale - 1) / kShadowScale;
+    ASSERT_EQ(test_shadow[0], 0x55);
+    ASSERT_EQ(test_shadow[n + 1], 0x55);
+    for (size_t i = 0; i < n; i++) {
+      ASSERT_EQ(test_shadow[i + 1], 0x77);
+    }
+  }
+}
+
+TEST(Unit, SetTagLarge) {
+  // Sizes around kMemsetMinSize, where SetTag switches to memset.
+  for (size_t size = kMemsetMinSize - 4 * kShadowScale;
+       size < (sizeof(test_shadow) - 2) * kShadowScale; size += 7) {
     SCOPED_TRACE(size);
     memset(test_shadow, 0x55, sizeof(test_shadow));
     SetTag(0x1800000000000000 + kShadowScale, size, 0x77);
@@ -0,0 +1,179 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/shared_memory_region_factory.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <utility>
+
+#include "absl/types/span.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+// Hands out the memory of one shared region from its start, so that the file
+// is used in order.
+class SharedMemoryRegion final : public AddressRegion {
+ public:
+  SharedMemoryRegion(uintptr_t start, size_t size)
+      : end_(start + size), next_(start) {}
+
+  std::pair<void*, size_t> Alloc(size_t size, size_t alignment) override {
+    const size_t page_size = getpagesize();
+    alignment = std::max(alignment, page_size);
+    size = (size + page_size - 1) & ~(page_size - 1);
+    const uintptr_t result = (next_ + alignment - 1) & ~(alignment - 1);
+    if (size == 0 || result < next_ || result > end_ || end_ - result < size) {
+      return {nullptr, 0};
+    }
+    void* ptr = reinterpret_cast<void*>(result);
+    if (mprotect(ptr, size, PROT_READ | PROT_WRITE) != 0) {
+      return {nullptr, 0};
+    }
+    next_ = result + size;
+    return {ptr, size};
+  }
+
+ private:
+  const uintptr_t end_;
+  uintptr_t next_;
+};
+
+// Appends to `buffer` as snprintf does, advancing `*used` by the bytes
+// required even when they do not fit.  GetStats is called with pageheap_lock
+// held, so it must not allocate.
+template <typename... Args>
+void Append(absl::Span<char> buffer, size_t* used, const char* format,
+            Args... args) {
+  char* out = *used < buffer.size() ? buffer.data() + *used : nullptr;
+  const size_t left = out != nullptr ? buffer.size() - *used : 0;
+  const int n = snprintf(out, left, format, args...);
+  if (n > 0) {
+    *used += n;
+  }
+}
+
+}  // namespace
+
+SharedMemoryRegionFactory::SharedMemoryRegionFactory(
+    AddressRegionFactory* next, UsageHint shared_hint)
+    : next_(next), shared_hint_(shared_hint) {}
+
+AddressRegion* SharedMemoryRegionFactory::Create(void* start, size_t size,
+                                                 UsageHint hint) {
+  if (hint != shared_hint_) {
+    return next_->Create(start, size, hint);
+  }
+  const size_t n = num_mappings_.load(std::memory_order_relaxed);
+  if (n == kMaxMappings) {
+    return nullptr;
+  }
+
+  int fd = fd_.load(std::memory_order_relaxed);
+  if (fd < 0) {
+    fd = memfd_create("tcmalloc_shared", MFD_CLOEXEC);
+    if (fd < 0) {
+      return nullptr;
+    }
+    fd_.store(fd, std::memory_order_release);
+  }
+  // The file grows by whole regions, sparsely: pages are only allocated as
+  // they are touched.
+  if (ftruncate(fd, file_size_ + size) != 0) {
+    return nullptr;
+  }
+  // Replace the reservation, keeping it inaccessible until Alloc hands it
+  // out, as the default factory does.
+  if (mmap(start, size, PROT_NONE, MAP_SHARED | MAP_FIXED, fd, file_size_) ==
+      MAP_FAILED) {
+    return nullptr;
+  }
+  void* region_space = MallocInternal(sizeof(SharedMemoryRegion));
+  if (region_space == nullptr) {
+    return nullptr;
+  }
+
+  mappings_[n] = {.start = start, .size = size, .offset = file_size_};
+  file_size_ += size;
+  num_mappings_.store(n + 1, std::memory_order_release);
+  return new (region_space)
+      SharedMemoryRegion(reinterpret_cast<uintptr_t>(start), size);
+}
+
+size_t SharedMemoryRegionFactory::GetMappings(
+    absl::Span<Mapping> mappings) const {
+  const size_t n = num_mappings_.load(std::memory_order_acquire);
+  std::copy_n(mappings_, std::min(n, mappings.size()), mappings.begin());
+  return n;
+}
+
+const SharedMemoryRegionFactory::Mapping*
+SharedMemoryRegionFactory::FindMapping(const void* ptr) const {
+  const uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
+  const size_t n = num_mappings_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < n; ++i) {
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mappings_[i].start);
+    if (p >= start && p - start < mappings_[i].size) {
+      return &mappings_[i];
+    }
+  }
+  return nullptr;
+}
+
+size_t SharedMemoryRegionFactory::GetStats(absl::Span<char> buffer) {
+  size_t used = next_->GetStats(buffer);
+  const size_t n = num_mappings_.load(std::memory_order_acquire);
+  Append(buffer, &used,
+         "SharedMemoryRegionFactory: memfd %d, %zu regions, %llu bytes; "
+         "regions are never moved or unmapped, so objects keep their "
+         "addresses and file offsets until freed\n",
+         fd(), n, static_cast<unsigned long long>(file_size_));
+  for (size_t i = 0; i < n; ++i) {
+    Append(buffer, &used,
+           "SharedMemoryRegionFactory: [%p, %p) at file offset %llu\n",
+           mappings_[i].start,
+           static_cast<char*>(mappings_[i].start) + mappings_[i].size,
+           static_cast<unsigned long long>(mappings_[i].offset));
+  }
+  return used;
+}
+
+size_t SharedMemoryRegionFactory::GetStatsInPbtxt(absl::Span<char> buffer) {
+  size_t used = next_->GetStatsInPbtxt(buffer);
+  const size_t n = num_mappings_.load(std::memory_order_acquire);
+  Append(buffer, &used, " shared_memory_fd: %d\n", fd());
+  Append(buffer, &used, " shared_memory_bytes: %llu\n",
+         static_cast<unsigned long long>(file_size_));
+  Append(buffer, &used, " shared_memory_addresses_stable: true\n");
+  for (size_t i = 0; i < n; ++i) {
+    Append(buffer, &used,
+           " shared_memory_region { start: %llu size: %llu offset: %llu }\n",
+           static_cast<unsigned long long>(
+               reinterpret_cast<uintptr_t>(mappings_[i].start)),
+           static_cast<unsigned long long>(mappings_[i].size),
+           static_cast<unsigned long long>(mappings_[i].offset));
+  }
+  return used;
+}
+
+}  // namespace tcmalloc
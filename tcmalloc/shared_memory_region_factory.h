@@ -0,0 +1,109 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SHARED_MEMORY_REGION_FACTORY_H_
+#define TCMALLOC_SHARED_MEMORY_REGION_FACTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/types/span.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+
+// An AddressRegionFactory that backs the regions of one usage hint with a
+// memfd, mapped MAP_SHARED, so that other processes can map the same memory
+// and read the objects in it without copying them.  Regions of other hints
+// come from the factory it wraps.
+//
+// The default hint, kInfrequentAccess, is that of cold memory, so that
+// allocations are steered into shared memory with an existing policy:
+//
+//   static auto* factory = new tcmalloc::SharedMemoryRegionFactory(
+//       tcmalloc::MallocExtension::GetRegionFactory());
+//   tcmalloc::MallocExtension::SetRegionFactory(factory);
+//   ...
+//   {
+//     tcmalloc::MallocExtension::ScopedAllocationPolicy shared(
+//         {.access = tcmalloc::hot_cold_t{0}});
+//     // Allocations made here, and cold allocations anywhere, are shared.
+//   }
+//
+// Install the factory before the first allocation of the hint: regions
+// created earlier stay private.
+//
+// Address stability: TCMalloc never moves or unmaps a region, so a shared
+// object keeps its address, and its offset in the file, until it is freed.
+// The regions' pages are only given back by punching holes in the file, which
+// other mappings of it see as zeroed.  At `start`, a mapping holds the file's
+// bytes from `offset` on; another process may map them anywhere, so pointers
+// stored in shared objects must be translated, or be offsets.  The mappings
+// are listed by GetStats.
+//
+// Forked children share the regions with their parent, so a child which
+// keeps allocating from them must exec first.
+class SharedMemoryRegionFactory final : public AddressRegionFactory {
+ public:
+  // Regions created with `shared_hint` are shared; regions of other hints
+  // come from `next`, which must outlive this factory.
+  explicit SharedMemoryRegionFactory(
+      AddressRegionFactory* next,
+      UsageHint shared_hint = UsageHint::kInfrequentAccess);
+  ~SharedMemoryRegionFactory() override = default;
+
+  AddressRegion* Create(void* start, size_t size, UsageHint hint) override;
+
+  size_t GetStats(absl::Span<char> buffer) override;
+  size_t GetStatsInPbtxt(absl::Span<char> buffer) override;
+
+  // The memfd backing the shared regions, or -1 until the first of them.  The
+  // factory owns it; pass it to other processes with SCM_RIGHTS, or through
+  // /proc/<pid>/fd.
+  int fd() const { return fd_.load(std::memory_order_acquire); }
+
+  // A shared region, mapped at `start` from `offset` in the file.
+  struct Mapping {
+    void* start;
+    size_t size;
+    uint64_t offset;
+  };
+
+  // Copies up to mappings.size() of the shared regions, in order of
+  // creation, into `mappings`, and returns the number there are.
+  size_t GetMappings(absl::Span<Mapping> mappings) const;
+
+  // Returns the mapping holding `ptr`, or nullptr if it is not shared.
+  const Mapping* FindMapping(const void* ptr) const;
+
+ private:
+  // Enough for 256 GiB of shared memory in regions of kMinMmapAlloc on
+  // 64-bit builds.
+  static constexpr size_t kMaxMappings = 256;
+
+  AddressRegionFactory* const next_;
+  const UsageHint shared_hint_;
+  std::atomic<int> fd_{-1};
+  // The file's size; the next region is mapped from here.  Create() is
+  // serialized by TCMalloc, so only readers need the atomics.
+  uint64_t file_size_ = 0;
+  Mapping mappings_[kMaxMappings] = {};
+  std::atomic<size_t> num_mappings_{0};
+};
+
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_SHARED_MEMORY_REGION_FACTORY_H_
@@ -0,0 +1,139 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the cost of allocating a batch of objects of every size class with
+// the caches above a given layer of the allocator emptied first, so that the
+// batch is served by that layer.  Comparing the states of a size class shows
+// what each layer adds.
+
+#include <sched.h>
+#include <stddef.h>
+
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/central_freelist.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/transfer_cache.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Where the first allocation of the timed batch is served from.
+enum class CacheState {
+  // The per-CPU cache is empty, so it refills from the transfer cache.
+  kColdCpuCache,
+  // The transfer caches are empty too, so refills come from the central
+  // freelist.
+  kEmptyTransferCache,
+  // The central freelist has no free objects either, so it takes a new span
+  // from the page heap.
+  kEmptyCentralFreeList,
+  // The page heap has released its free memory as well, so the new span's
+  // memory has to be backed again.
+  kFreshPageHeap,
+};
+
+void ReleaseCurrentCpuCache() {
+  const int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    MallocExtension::ReleaseCpuMemory(cpu);
+  }
+}
+
+// Allocates, and keeps in `hoard`, every free object of the central freelist
+// of `size_class`.
+void EmptyCentralFreeList(int size_class, std::vector<void*>& hoard) {
+  CentralFreeList& freelist = tc_globals.central_freelist(size_class);
+  void* batch[kMaxObjectsToMove];
+  while (freelist.length() > 0) {
+    const int n = freelist.RemoveRange(batch, kMaxObjectsToMove);
+    if (n == 0) {
+      break;
+    }
+    hoard.insert(hoard.end(), batch, batch + n);
+  }
+}
+
+template <CacheState kState>
+void BM_size_class(benchmark::State& state) {
+  // Make sure the allocator is initialized before looking up sizes.
+  ::operator delete(::operator new(1));
+  const int size_class = state.range(0);
+  const size_t size = tc_globals.sizemap().class_to_size(size_class);
+  const int batch_size = tc_globals.sizemap().num_objects_to_move(size_class);
+  if (size == 0 || batch_size == 0) {
+    state.SkipWithError("unused size class");
+    return;
+  }
+  state.SetLabel(absl::StrCat(size, " bytes"));
+
+  std::vector<void*> batch(batch_size);
+  std::vector<void*> hoard;
+  for (auto s : state) {
+    state.PauseTiming();
+    ReleaseCurrentCpuCache();
+    if (kState != CacheState::kColdCpuCache) {
+      tc_globals.sharded_transfer_cache().Drain();
+      tc_globals.transfer_cache().Drain();
+    }
+    if (kState == CacheState::kEmptyCentralFreeList ||
+        kState == CacheState::kFreshPageHeap) {
+      EmptyCentralFreeList(size_class, hoard);
+    }
+    if (kState == CacheState::kFreshPageHeap) {
+      MallocExtension::ReleaseMemoryToSystem(
+          std::numeric_limits<size_t>::max());
+    }
+    state.ResumeTiming();
+
+    for (void*& p : batch) {
+      p = ::operator new(size);
+    }
+    benchmark::DoNotOptimize(batch.data());
+
+    state.PauseTiming();
+    for (void* p : batch) {
+      ::operator delete(p, size);
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+
+  for (void* p : hoard) {
+    ::operator delete(p, size);
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_size_class, CacheState::kColdCpuCache)
+    ->DenseRange(1, kNumBaseClasses - 1);
+BENCHMARK_TEMPLATE(BM_size_class, CacheState::kEmptyTransferCache)
+    ->DenseRange(1, kNumBaseClasses - 1);
+BENCHMARK_TEMPLATE(BM_size_class, CacheState::kEmptyCentralFreeList)
+    ->DenseRange(1, kNumBaseClasses - 1);
+BENCHMARK_TEMPLATE(BM_size_class, CacheState::kFreshPageHeap)
+    ->DenseRange(1, kNumBaseClasses - 1);
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,347 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_generator.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_page_aware_allocator.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/size_class_info.h"
+#include "tcmalloc/sizemap.h"
+#include "tcmalloc/span.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// The alignment that a class of size bytes must have.
+size_t ClassAlignment(size_t size) {
+  if (size > SizeMap::kLargeSize) {
+    return SizeMap::kLargeSizeAlignment;
+  }
+#if defined(__cpp_aligned_new) && __STDCPP_DEFAULT_NEW_ALIGNMENT__ > 8
+  if (size >= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    return __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+  }
+#endif
+  return static_cast<size_t>(kAlignment);
+}
+
+size_t RoundUpToClass(size_t size) {
+  size = std::max<size_t>(size, 1);
+  const size_t alignment = ClassAlignment(size);
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// Whether size and pages satisfy SizeMap::IsValidSizeClass, without its
+// logging.
+bool IsValidSpan(size_t size, size_t pages) {
+  if (pages == 0 || pages >= 255 || Length(pages).in_bytes() < size) {
+    return false;
+  }
+  return Span::IsValidSizeClass(size, pages) &&
+         HugePageAwareAllocator::IsValidSizeClass(size, pages);
+}
+
+// Bytes lost to the end of the span and to span metadata, as a fraction of
+// the bytes of objects in a full span.
+double SpanOverhead(size_t size, size_t pages) {
+  const size_t span_bytes = Length(pages).in_bytes();
+  const size_t objects = span_bytes / size;
+  const size_t tail = span_bytes - objects * size;
+  return static_cast<double>(tail + sizeof(Span)) / (objects * size);
+}
+
+// Returns the pages per span for size, or 0 if there are none.
+size_t ChoosePages(size_t size, const SizeClassGeneratorOptions& options) {
+  const size_t min_pages = BytesToLengthCeil(size).raw_num();
+  const size_t max_pages = std::max(min_pages, options.max_pages);
+  size_t best = 0;
+  double best_overhead = std::numeric_limits<double>::infinity();
+  for (size_t pages = min_pages; pages <= max_pages; ++pages) {
+    if (!IsValidSpan(size, pages)) {
+      continue;
+    }
+    const double overhead = SpanOverhead(size, pages);
+    if (overhead <= options.max_span_overhead) {
+      return pages;
+    }
+    if (overhead < best_overhead) {
+      best = pages;
+      best_overhead = overhead;
+    }
+  }
+  return best;
+}
+
+// The class of classes that size falls in, or nullptr if none does.
+const SizeClassInfo* FindClass(absl::Span<const SizeClassInfo> classes,
+                               size_t size) {
+  for (size_t c = 1; c < classes.size(); ++c) {
+    if (classes[c].size >= size) {
+      return &classes[c];
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+SizeHistogram SizeHistogramFromProfile(const Profile& profile) {
+  std::map<size_t, double> counts;
+  profile.Iterate([&](const Profile::Sample& sample) {
+    if (sample.requested_size <= kMaxSize) {
+      counts[sample.requested_size] += sample.count;
+    }
+  });
+
+  SizeHistogram histogram;
+  histogram.reserve(counts.size());
+  for (const auto& [size, count] : counts) {
+    histogram.push_back({size, count});
+  }
+  return histogram;
+}
+
+bool ParseSizeHistogram(absl::string_view data, SizeHistogram* histogram) {
+  std::map<size_t, double> counts;
+  for (absl::string_view line : absl::StrSplit(data, '\n')) {
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<absl::string_view> fields =
+        absl::StrSplit(line, ' ', absl::SkipEmpty());
+    size_t size;
+    double count;
+    if (fields.size() != 2 || !absl::SimpleAtoi(fields[0], &size) ||
+        !absl::SimpleAtod(fields[1], &count) || count < 0) {
+      return false;
+    }
+    counts[size] += count;
+  }
+
+  histogram->clear();
+  for (const auto& [size, count] : counts) {
+    histogram->push_back({size, count});
+  }
+  return true;
+}
+
+void PrintSizeHistogram(Printer* out, const SizeHistogram& histogram) {
+  out->printf("# requested size, live objects\n");
+  for (const SizeHistogramEntry& entry : histogram) {
+    out->printf("%zu %.17g\n", entry.size, entry.count);
+  }
+}
+
+SizeClassWaste EstimateSizeClassWaste(absl::Span<const SizeClassInfo> classes,
+                                      const SizeHistogram& histogram) {
+  SizeClassWaste waste;
+  for (const SizeHistogramEntry& entry : histogram) {
+    const SizeClassInfo* info = FindClass(classes, entry.size);
+    if (info == nullptr) {
+      continue;
+    }
+    waste.requested_bytes += entry.count * entry.size;
+    waste.internal_bytes += entry.count * (info->size - entry.size);
+    waste.span_bytes +=
+        entry.count * info->size * SpanOverhead(info->size, info->pages);
+  }
+  return waste;
+}
+
+std::vector<SizeClassInfo> GenerateSizeClasses(
+    const SizeHistogram& histogram, absl::Span<const SizeClassInfo> current,
+    const SizeClassGeneratorOptions& options) {
+  const size_t max_classes =
+      std::min(options.num_classes != 0 ? options.num_classes : current.size(),
+               kNumBaseClasses) -
+      1;
+
+  // An optimal table only has classes at the rounded up sizes that are
+  // requested, besides the ones it must have.
+  std::map<size_t, bool> required;
+  for (size_t size = static_cast<size_t>(kAlignment); size <= kMaxSize;
+       size *= 2) {
+    required[size] = true;
+  }
+  required[kMaxSize] = true;
+  std::map<size_t, bool> sizes = required;
+  for (const SizeHistogramEntry& entry : histogram) {
+    if (entry.size <= kMaxSize && entry.count > 0) {
+      sizes.emplace(RoundUpToClass(entry.size), false);
+    }
+  }
+
+  struct Candidate {
+    size_t size;
+    bool required;
+    size_t pages;
+    double overhead;
+    // Objects and requested bytes with sizes up to this one.
+    double cumulative_count;
+    double cumulative_bytes;
+  };
+  std::vector<Candidate> candidates;
+  auto it = histogram.begin();
+  double count = 0, bytes = 0;
+  for (const auto& [size, is_required] : sizes) {
+    const size_t pages = ChoosePages(size, options);
+    // Sizes suitable for cold classes must not use intrusive spans.
+    if (pages == 0 || (size >= SizeMap::kMinAllocSizeForCold &&
+                       !Span::IsNonIntrusive(size))) {
+      if (is_required) {
+        return {};
+      }
+      continue;
+    }
+    for (; it != histogram.end() && it->size <= size; ++it) {
+      count += it->count;
+      bytes += it->count * it->size;
+    }
+    candidates.push_back({size, is_required, pages, SpanOverhead(size, pages),
+                          count, bytes});
+  }
+
+  // The waste of a class at candidates[i] serving the sizes above
+  // candidates[j].
+  auto cost = [&](int j, int i) {
+    const Candidate& c = candidates[i];
+    double n = c.cumulative_count, requested = c.cumulative_bytes;
+    if (j >= 0) {
+      n -= candidates[j].cumulative_count;
+      requested -= candidates[j].cumulative_bytes;
+    }
+    return n * c.size - requested + n * c.size * c.overhead;
+  };
+
+  // best[k][i] is the least waste of k + 1 classes serving sizes up to
+  // candidates[i], with the last at candidates[i].
+  const int n = candidates.size();
+  const double kInfinity = std::numeric_limits<double>::infinity();
+  std::vector<std::vector<double>> best;
+  std::vector<std::vector<int>> previous;
+  for (size_t k = 0; k < max_classes; ++k) {
+    best.emplace_back(n, kInfinity);
+    previous.emplace_back(n, -1);
+    if (k == 0) {
+      // The first class serves all sizes below it, so can't be above a
+      // required size.
+      for (int i = 0; i < n; ++i) {
+        best[k][i] = cost(-1, i);
+        if (candidates[i].required) {
+          break;
+        }
+      }
+      continue;
+    }
+    for (int i = 0; i < n; ++i) {
+      for (int j = i - 1; j >= 0; --j) {
+        if (best[k - 1][j] < kInfinity) {
+          const double total = best[k - 1][j] + cost(j, i);
+          if (total < best[k][i]) {
+            best[k][i] = total;
+            previous[k][i] = j;
+          }
+        }
+        // No class may skip a required size.
+        if (candidates[j].required) {
+          break;
+        }
+      }
+    }
+  }
+
+  int chosen_k = -1;
+  for (size_t k = 0; k < max_classes; ++k) {
+    if (best[k][n - 1] < kInfinity &&
+        (chosen_k < 0 || best[k][n - 1] < best[chosen_k][n - 1])) {
+      chosen_k = k;
+    }
+  }
+  if (chosen_k < 0) {
+    return {};
+  }
+
+  std::vector<SizeClassInfo> classes(chosen_k + 2, SizeClassInfo{0, 0, 0, 0});
+  for (int k = chosen_k, i = n - 1; k >= 0; i = previous[k][i], --k) {
+    const Candidate& c = candidates[i];
+    const SizeClassInfo* like = FindClass(current, c.size);
+    const size_t num_to_move = like != nullptr ? like->num_to_move : 2;
+    classes[k + 1] = {
+        .size = static_cast<uint32_t>(c.size),
+        .pages = static_cast<uint8_t>(c.pages),
+        .num_to_move = static_cast<uint8_t>(num_to_move),
+        .max_capacity = like != nullptr ? like->max_capacity : 128,
+    };
+    TC_CHECK(SizeMap::IsValidSizeClass(c.size, c.pages, num_to_move));
+  }
+  return classes;
+}
+
+void PrintSizeClasses(Printer* out, absl::Span<const SizeClassInfo> classes) {
+  out->printf("//                                         |waste|\n");
+  out->printf("//  bytes pages batch   cap    class  objs |fixed|    inc\n");
+  for (size_t c = 0; c < classes.size(); ++c) {
+    const SizeClassInfo& info = classes[c];
+    size_t objects = 0;
+    double fixed = 0, inc = 0;
+    if (c > 0) {
+      objects = Length(info.pages).in_bytes() / info.size;
+      fixed = SpanOverhead(info.size, info.pages);
+    }
+    if (c > 1) {
+      inc = static_cast<double>(info.size - classes[c - 1].size) /
+            classes[c - 1].size;
+    }
+    out->printf("  {%6u, %4u, %4u, %4u},  // %2zu %5zu  %5.2f%% %6.2f%%\n",
+                info.size, info.pages, info.num_to_move, info.max_capacity,
+                c, objects, 100 * fixed, 100 * inc);
+  }
+}
+
+void PrintSizeClassComparison(Printer* out, const SizeHistogram& histogram,
+                              absl::Span<const SizeClassInfo> current,
+                              absl::Span<const SizeClassInfo> generated) {
+  const SizeClassWaste before = EstimateSizeClassWaste(current, histogram);
+  const SizeClassWaste after = EstimateSizeClassWaste(generated, histogram);
+  out->printf("Requested:           %16.0f bytes\n", before.requested_bytes);
+  out->printf("                     %16s %16s\n", "current", "generated");
+  out->printf("Classes:             %16zu %16zu\n", current.size(),
+              generated.size());
+  out->printf("Internal waste:      %16.0f %16.0f bytes\n",
+              before.internal_bytes, after.internal_bytes);
+  out->printf("Span waste:          %16.0f %16.0f bytes\n", before.span_bytes,
+              after.span_bytes);
+  out->printf("Overhead:            %15.2f%% %15.2f%%\n",
+              100 * before.overhead(), 100 * after.overhead());
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,112 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Generates size class tables tuned to the requested sizes seen in heap
+// profiles, as an alternative to hand-curating size_classes.cc and friends.
+
+#ifndef TCMALLOC_SIZE_CLASS_GENERATOR_H_
+#define TCMALLOC_SIZE_CLASS_GENERATOR_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/size_class_info.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Number of live objects of each requested size, sorted by size with each
+// size appearing once.  Counts need not be integers, so that profiles from
+// several binaries can be scaled and merged.
+struct SizeHistogramEntry {
+  size_t size;
+  double count;
+};
+using SizeHistogram = std::vector<SizeHistogramEntry>;
+
+// Returns the small objects live in profile, which would typically come from
+// MallocExtension::SnapshotCurrent(ProfileType::kHeap).  Large allocations
+// don't use size classes and are left out.
+SizeHistogram SizeHistogramFromProfile(const Profile& profile);
+
+// Parses a histogram written by PrintSizeHistogram: one "<size> <count>" pair
+// per line.  Blank lines and lines starting with '#' are ignored.  Returns
+// false if data is malformed.
+bool ParseSizeHistogram(absl::string_view data, SizeHistogram* histogram);
+
+void PrintSizeHistogram(Printer* out, const SizeHistogram& histogram);
+
+// Memory needed to hold the objects in a histogram with a given table, split
+// by where it goes.
+struct SizeClassWaste {
+  // Bytes requested by the application.
+  double requested_bytes = 0;
+  // Bytes by which objects are rounded up to their size class.
+  double internal_bytes = 0;
+  // Bytes lost to the end of spans and to span metadata, assuming full spans.
+  double span_bytes = 0;
+
+  double total_waste_bytes() const { return internal_bytes + span_bytes; }
+  // Waste as a fraction of requested bytes.
+  double overhead() const {
+    return requested_bytes > 0 ? total_waste_bytes() / requested_bytes : 0;
+  }
+};
+
+// Estimates the waste of serving histogram with classes, a table in the
+// format of size_classes.cc (starting with the all-zero class 0).
+SizeClassWaste EstimateSizeClassWaste(absl::Span<const SizeClassInfo> classes,
+                                      const SizeHistogram& histogram);
+
+struct SizeClassGeneratorOptions {
+  // Number of classes in the generated table, including class 0.  0 means as
+  // many as the table we start from.
+  size_t num_classes = 0;
+  // Pages per span are the fewest for which the end of span and metadata
+  // waste no more than this fraction of each span, or else the ones that
+  // waste least, with up to max_pages pages.
+  double max_span_overhead = 0.02;
+  size_t max_pages = 8;
+};
+
+// Returns a table with the classes that minimize the waste of serving
+// histogram, subject to the constraints SizeMap::ValidSizeClasses enforces.
+// Powers of two stay classes of their own so that aligned allocations don't
+// round up further, and the last class is kMaxSize.  The batch size and
+// capacity of each class are taken from the class of current serving the
+// same sizes.
+//
+// Returns an empty table if no valid table has that few classes.
+std::vector<SizeClassInfo> GenerateSizeClasses(
+    const SizeHistogram& histogram, absl::Span<const SizeClassInfo> current,
+    const SizeClassGeneratorOptions& options = {});
+
+// Prints classes formatted like the tables in size_classes.cc, with the fixed
+// per-span waste of each class and its increment over the previous one.
+void PrintSizeClasses(Printer* out, absl::Span<const SizeClassInfo> classes);
+
+// Prints the waste of serving histogram with current and with generated.
+void PrintSizeClassComparison(Printer* out, const SizeHistogram& histogram,
+                              absl::Span<const SizeClassInfo> current,
+                              absl::Span<const SizeClassInfo> generated);
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_SIZE_CLASS_GENERATOR_H_
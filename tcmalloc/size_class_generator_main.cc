@@ -0,0 +1,94 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generates a size class table for the live objects in a histogram of
+// requested sizes, and prints it along with its expected waste compared to
+// the table this build uses.  Histograms are written by PrintSizeHistogram,
+// for instance from SizeHistogramFromProfile on heap profiles, and may be
+// merged by concatenating them.  The current table follows the size class
+// experiments set in the environment.
+//
+// Usage: size_class_generator_main --num_classes=86 <histogram file>
+
+#include <stdio.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/types/span.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/size_class_generator.h"
+#include "tcmalloc/size_class_info.h"
+#include "tcmalloc/sizemap.h"
+
+ABSL_FLAG(size_t, num_classes, 0,
+          "Classes in the generated table, including class 0; 0 for as many "
+          "as the current table");
+ABSL_FLAG(double, max_span_overhead, 0.02,
+          "Span waste, as a fraction, below which to use the fewest pages");
+ABSL_FLAG(size_t, max_pages, 8,
+          "Most pages per span, unless one object needs more");
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+int Main(const char* path) {
+  std::ifstream file(path);
+  const std::string data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  SizeHistogram histogram;
+  if (!file || !ParseSizeHistogram(data, &histogram)) {
+    fprintf(stderr, "%s is not a size histogram\n", path);
+    return 1;
+  }
+
+  SizeClassGeneratorOptions options;
+  options.num_classes = absl::GetFlag(FLAGS_num_classes);
+  options.max_span_overhead = absl::GetFlag(FLAGS_max_span_overhead);
+  options.max_pages = absl::GetFlag(FLAGS_max_pages);
+  const absl::Span<const SizeClassInfo> current =
+      SizeMap::CurrentClasses().classes;
+  const std::vector<SizeClassInfo> generated =
+      GenerateSizeClasses(histogram, current, options);
+  if (generated.empty()) {
+    fprintf(stderr, "no valid table has %zu classes\n", options.num_classes);
+    return 1;
+  }
+
+  std::string buffer(1 << 16, '\0');
+  Printer printer(buffer.data(), buffer.size());
+  PrintSizeClasses(&printer, generated);
+  printer.printf("\n");
+  PrintSizeClassComparison(&printer, histogram, current, generated);
+  fputs(buffer.c_str(), stdout);
+  return 0;
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+
+int main(int argc, char** argv) {
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() != 2) {
+    fprintf(stderr, "usage: %s [flags] <histogram file>\n", args[0]);
+    return 1;
+  }
+  return tcmalloc::tcmalloc_internal::Main(args[1]);
+}
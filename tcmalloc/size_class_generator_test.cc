@@ -0,0 +1,159 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_generator.h"
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/size_class_info.h"
+#include "tcmalloc/sizemap.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+struct TestingSizeMap : SizeMap {
+  using SizeMap::ValidSizeClasses;
+};
+
+absl::Span<const SizeClassInfo> CurrentClasses() {
+  return SizeMap::CurrentClasses().classes;
+}
+
+bool HasClass(absl::Span<const SizeClassInfo> classes, size_t size) {
+  for (const SizeClassInfo& info : classes) {
+    if (info.size == size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TEST(SizeClassGeneratorTest, ParseAndPrint) {
+  SizeHistogram histogram;
+  ASSERT_TRUE(ParseSizeHistogram("# comment\n24 10\n\n8 2.5\n24 5\n",
+                                 &histogram));
+  ASSERT_EQ(histogram.size(), 2);
+  EXPECT_EQ(histogram[0].size, 8);
+  EXPECT_EQ(histogram[0].count, 2.5);
+  EXPECT_EQ(histogram[1].size, 24);
+  EXPECT_EQ(histogram[1].count, 15);
+
+  std::string buffer(1024, '\0');
+  Printer printer(buffer.data(), buffer.size());
+  PrintSizeHistogram(&printer, histogram);
+  SizeHistogram reparsed;
+  ASSERT_TRUE(ParseSizeHistogram(buffer.c_str(), &reparsed));
+  ASSERT_EQ(reparsed.size(), 2);
+  EXPECT_EQ(reparsed[1].size, 24);
+  EXPECT_EQ(reparsed[1].count, 15);
+
+  EXPECT_FALSE(ParseSizeHistogram("24\n", &histogram));
+  EXPECT_FALSE(ParseSizeHistogram("24 many\n", &histogram));
+  EXPECT_FALSE(ParseSizeHistogram("24 -1\n", &histogram));
+}
+
+TEST(SizeClassGeneratorTest, EstimateWaste) {
+  const SizeClassInfo classes[] = {{0, 0, 0, 0}, {kMaxSize, 32, 2, 128}};
+  const SizeClassWaste waste = EstimateSizeClassWaste(
+      classes, {{kMaxSize - 100, 2}, {kMaxSize + 1, 1000}});
+  // Large allocations don't count.
+  EXPECT_EQ(waste.requested_bytes, 2.0 * (kMaxSize - 100));
+  EXPECT_EQ(waste.internal_bytes, 200.0);
+  EXPECT_GT(waste.span_bytes, 0);
+  EXPECT_EQ(waste.total_waste_bytes(), waste.internal_bytes + waste.span_bytes);
+}
+
+TEST(SizeClassGeneratorTest, Valid) {
+  const SizeHistogram histograms[] = {
+      {},
+      {{1, 1}, {kMaxSize, 1}},
+      {{200, 1000000}, {1000, 500}, {3000, 20}, {100000, 3}},
+  };
+  for (const SizeHistogram& histogram : histograms) {
+    const std::vector<SizeClassInfo> classes =
+        GenerateSizeClasses(histogram, CurrentClasses());
+    ASSERT_FALSE(classes.empty());
+    EXPECT_LE(classes.size(), CurrentClasses().size());
+    EXPECT_TRUE(TestingSizeMap::ValidSizeClasses(classes));
+    for (size_t size = static_cast<size_t>(kAlignment); size <= kMaxSize;
+         size *= 2) {
+      EXPECT_TRUE(HasClass(classes, size)) << size;
+    }
+  }
+}
+
+TEST(SizeClassGeneratorTest, FitsRequestedSizes) {
+  // With enough classes to go around, every requested size gets its own.
+  const SizeHistogram histogram = {
+      {24, 1000}, {200, 300}, {1000, 20}, {3000, 10}};
+  const std::vector<SizeClassInfo> classes =
+      GenerateSizeClasses(histogram, CurrentClasses());
+  ASSERT_FALSE(classes.empty());
+  for (const SizeHistogramEntry& entry : histogram) {
+    EXPECT_TRUE(HasClass(classes, entry.size)) << entry.size;
+  }
+  const SizeClassWaste waste = EstimateSizeClassWaste(classes, histogram);
+  EXPECT_EQ(waste.internal_bytes, 0.0);
+  EXPECT_LE(waste.total_waste_bytes(),
+            EstimateSizeClassWaste(CurrentClasses(), histogram)
+                .total_waste_bytes());
+}
+
+TEST(SizeClassGeneratorTest, FewClasses) {
+  // Each power of two up to kMaxSize must be a class.
+  size_t powers = 0;
+  for (size_t size = static_cast<size_t>(kAlignment); size <= kMaxSize;
+       size *= 2) {
+    ++powers;
+  }
+  const SizeHistogram histogram = {{24, 1000}, {200, 300}};
+  EXPECT_THAT(
+      GenerateSizeClasses(histogram, CurrentClasses(), {.num_classes = powers}),
+      testing::IsEmpty());
+
+  // With one more class, it goes to the size that wastes most: 56 bytes for
+  // each object of 200 bytes, against 8 for those of 24.
+  const std::vector<SizeClassInfo> classes = GenerateSizeClasses(
+      histogram, CurrentClasses(), {.num_classes = powers + 2});
+  ASSERT_EQ(classes.size(), powers + 2);
+  EXPECT_TRUE(HasClass(classes, 200));
+  EXPECT_FALSE(HasClass(classes, 24));
+}
+
+TEST(SizeClassGeneratorTest, PrintSizeClasses) {
+  const std::vector<SizeClassInfo> classes =
+      GenerateSizeClasses({{24, 1000}}, CurrentClasses());
+  std::string buffer(1 << 16, '\0');
+  Printer printer(buffer.data(), buffer.size());
+  PrintSizeClasses(&printer, classes);
+  EXPECT_THAT(buffer, testing::HasSubstr("{    24,    1,"));
+
+  Printer comparison(buffer.data(), buffer.size());
+  PrintSizeClassComparison(&comparison, {{24, 1000}}, CurrentClasses(),
+                           classes);
+  EXPECT_THAT(buffer, testing::HasSubstr("Overhead:"));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,218 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SIZE_CLASS_LIFETIMES_H_
+#define TCMALLOC_SIZE_CLASS_LIFETIMES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/hash/hash.h"
+#include "absl/numeric/bits.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Decaying counts of sampled lifetimes, shared by SizeClassLifetimes and
+// LargeAllocationLifetimes.  Samples are recorded as sampled objects are freed,
+// which is rare enough that recording does not need to be exact: concurrent
+// updates may be lost.
+class LifetimeSamples {
+ public:
+  // Objects freed within kShortLifetime of their allocation count as
+  // short-lived.
+  static constexpr absl::Duration kShortLifetime = absl::Milliseconds(100);
+  // Nothing is predicted before kMinSamples recent samples.  Past that, more
+  // than kShortLivedRatio short-lived samples predict short lifetimes, and
+  // fewer than 1 - kShortLivedRatio predict long ones.
+  static constexpr uint32_t kMinSamples = 16;
+  static constexpr double kShortLivedRatio = 0.75;
+  // Counts are halved after this many samples, so that the prediction follows
+  // changes in the workload.
+  static constexpr uint32_t kMaxSamples = 256;
+
+  constexpr LifetimeSamples() = default;
+
+  void Record(absl::Duration lifetime) {
+    uint32_t short_lived = short_lived_.load(std::memory_order_relaxed);
+    uint32_t total = total_.load(std::memory_order_relaxed);
+    if (total >= kMaxSamples) {
+      short_lived /= 2;
+      total /= 2;
+    }
+    if (lifetime < kShortLifetime) {
+      ++short_lived;
+    }
+    ++total;
+    short_lived_.store(short_lived, std::memory_order_relaxed);
+    total_.store(total, std::memory_order_relaxed);
+  }
+
+  LifetimePrediction Predict() const {
+    const uint32_t total = total_.load(std::memory_order_relaxed);
+    const uint32_t short_lived = short_lived_.load(std::memory_order_relaxed);
+    if (total < kMinSamples) {
+      return LifetimePrediction::kUnknown;
+    }
+    if (short_lived > kShortLivedRatio * total) {
+      return LifetimePrediction::kShortLived;
+    }
+    if (short_lived < (1 - kShortLivedRatio) * total) {
+      return LifetimePrediction::kLongLived;
+    }
+    return LifetimePrediction::kUnknown;
+  }
+
+  void Reset() {
+    short_lived_.store(0, std::memory_order_relaxed);
+    total_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint32_t> short_lived_{0};
+  std::atomic<uint32_t> total_{0};
+};
+
+// Tracks, per size class, whether sampled objects tend to be freed shortly
+// after they were allocated. When lifetime-aware span placement is enabled,
+// CentralFreeList asks the page heap to keep the spans of short-lived size
+// classes apart from the others, so that their hugepages empty out together,
+// and places the spans of long-lived size classes with enough live spans to
+// fill hugepages with the dense ones, whatever their objects per span.
+class SizeClassLifetimes {
+ public:
+  static constexpr absl::Duration kShortLifetime =
+      LifetimeSamples::kShortLifetime;
+  static constexpr uint32_t kMinSamples = LifetimeSamples::kMinSamples;
+  static constexpr double kShortLivedRatio = LifetimeSamples::kShortLivedRatio;
+  static constexpr uint32_t kMaxSamples = LifetimeSamples::kMaxSamples;
+
+  constexpr SizeClassLifetimes() = default;
+
+  // Records that a sampled object of <size_class> was freed after <lifetime>.
+  void RecordFree(size_t size_class, absl::Duration lifetime) {
+    if (size_class == 0 || size_class >= kNumClasses) {
+      return;
+    }
+    samples_[size_class].Record(lifetime);
+  }
+
+  // Returns the lifetime predicted for objects of <size_class>.
+  LifetimePrediction Predict(size_t size_class) const {
+    if (size_class >= kNumClasses) {
+      return LifetimePrediction::kUnknown;
+    }
+    return samples_[size_class].Predict();
+  }
+
+  // Returns true if objects of <size_class> are predicted to be short-lived.
+  bool ShortLived(size_t size_class) const {
+    return Predict(size_class) == LifetimePrediction::kShortLived;
+  }
+
+ private:
+  LifetimeSamples samples_[kNumClasses];
+};
+
+// Tracks, per power-of-two number of hugepages, the lifetimes of sampled
+// allocations too large for a size class.  When lifetime-aware region
+// placement is enabled, HugePageAwareAllocator keeps multi-hugepage
+// allocations predicted to be long-lived in dedicated HugeRegions, and serves
+// short-lived ones straight from the HugeCache.
+//
+// Predictions are made per size rather than per callsite: by the time a large
+// allocation reaches the page heap, all that is known about it is its size.
+class LargeAllocationLifetimes {
+ public:
+  static constexpr size_t kNumBuckets = 16;
+
+  constexpr LargeAllocationLifetimes() = default;
+
+  // Records that a sampled allocation of <n> pages was freed after <lifetime>.
+  void RecordFree(Length n, absl::Duration lifetime) {
+    samples_[BucketFor(n)].Record(lifetime);
+  }
+
+  LifetimePrediction Predict(Length n) const {
+    return samples_[BucketFor(n)].Predict();
+  }
+
+ private:
+  static size_t BucketFor(Length n) {
+    return std::min<size_t>(absl::bit_width(HLFromPages(n).raw_num()),
+                            kNumBuckets - 1);
+  }
+
+  LifetimeSamples samples_[kNumBuckets];
+};
+
+// Tracks the lifetimes of sampled page-level allocations per callsite, that
+// is, per hash of the stack they were allocated from.  When cold callsite
+// classification is enabled, page-level allocations from callsites predicted
+// to be long-lived are placed in cold memory.
+//
+// Like StackTraceFilter, it is a small table indexed by the lower bits of the
+// hash, in which a callsite replaces whichever one it collides with.
+class CallsiteLifetimes {
+ public:
+  static constexpr size_t kSize = 256;
+
+  constexpr CallsiteLifetimes() = default;
+
+  // Records that a sampled allocation from <stack> was freed after
+  // <lifetime>.
+  void RecordFree(absl::Span<void* const> stack, absl::Duration lifetime) {
+    const size_t hash = absl::HashOf(stack);
+    Slot& slot = slots_[hash % kSize];
+    if (slot.hash.load(std::memory_order_relaxed) != hash) {
+      slot.samples.Reset();
+      slot.hash.store(hash, std::memory_order_relaxed);
+    }
+    slot.samples.Record(lifetime);
+  }
+
+  LifetimePrediction Predict(absl::Span<void* const> stack) const {
+    const size_t hash = absl::HashOf(stack);
+    const Slot& slot = slots_[hash % kSize];
+    if (slot.hash.load(std::memory_order_relaxed) != hash) {
+      return LifetimePrediction::kUnknown;
+    }
+    return slot.samples.Predict();
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> hash{0};
+    LifetimeSamples samples;
+  };
+
+  Slot slots_[kSize];
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SIZE_CLASS_LIFETIMES_H_
@@ -0,0 +1,114 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_lifetimes.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tcmalloc/huge_pages.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+constexpr absl::Duration kShort = absl::Microseconds(1);
+constexpr absl::Duration kLong = absl::Seconds(10);
+
+TEST(SizeClassLifetimesTest, NeedsSamples) {
+  SizeClassLifetimes lifetimes;
+  for (uint32_t i = 0; i + 1 < SizeClassLifetimes::kMinSamples; ++i) {
+    lifetimes.RecordFree(1, kShort);
+  }
+  EXPECT_FALSE(lifetimes.ShortLived(1));
+  lifetimes.RecordFree(1, kShort);
+  EXPECT_TRUE(lifetimes.ShortLived(1));
+  // Other size classes are unaffected.
+  EXPECT_FALSE(lifetimes.ShortLived(2));
+}
+
+TEST(SizeClassLifetimesTest, MixedLifetimes) {
+  SizeClassLifetimes lifetimes;
+  for (int i = 0; i < 100; ++i) {
+    lifetimes.RecordFree(1, kShort);
+    lifetimes.RecordFree(1, kLong);
+  }
+  EXPECT_FALSE(lifetimes.ShortLived(1));
+}
+
+TEST(SizeClassLifetimesTest, FollowsWorkload) {
+  SizeClassLifetimes lifetimes;
+  for (uint32_t i = 0; i < SizeClassLifetimes::kMaxSamples; ++i) {
+    lifetimes.RecordFree(1, kLong);
+  }
+  EXPECT_FALSE(lifetimes.ShortLived(1));
+  // Old samples decay, so a sustained shift to short lifetimes is picked up.
+  for (uint32_t i = 0; i < 4 * SizeClassLifetimes::kMaxSamples; ++i) {
+    lifetimes.RecordFree(1, kShort);
+  }
+  EXPECT_TRUE(lifetimes.ShortLived(1));
+}
+
+TEST(LargeAllocationLifetimesTest, PredictsPerSize) {
+  LargeAllocationLifetimes lifetimes;
+  const Length small = kPagesPerHugePage * 2;
+  const Length large = kPagesPerHugePage * 64;
+  EXPECT_EQ(lifetimes.Predict(small), LifetimePrediction::kUnknown);
+  for (uint32_t i = 0; i < LifetimeSamples::kMinSamples; ++i) {
+    lifetimes.RecordFree(small, kShort);
+    lifetimes.RecordFree(large, kLong);
+  }
+  EXPECT_EQ(lifetimes.Predict(small), LifetimePrediction::kShortLived);
+  EXPECT_EQ(lifetimes.Predict(large), LifetimePrediction::kLongLived);
+  // Sizes within the same power of two hugepages share a prediction.
+  EXPECT_EQ(lifetimes.Predict(large + kPagesPerHugePage),
+            LifetimePrediction::kLongLived);
+}
+
+TEST(LargeAllocationLifetimesTest, MixedLifetimes) {
+  LargeAllocationLifetimes lifetimes;
+  const Length n = kPagesPerHugePage * 4;
+  for (int i = 0; i < 100; ++i) {
+    lifetimes.RecordFree(n, kShort);
+    lifetimes.RecordFree(n, kLong);
+  }
+  EXPECT_EQ(lifetimes.Predict(n), LifetimePrediction::kUnknown);
+}
+
+TEST(CallsiteLifetimesTest, PredictsPerStack) {
+  CallsiteLifetimes lifetimes;
+  void* const long_lived[] = {reinterpret_cast<void*>(0x1000),
+                              reinterpret_cast<void*>(0x2000)};
+  void* const short_lived[] = {reinterpret_cast<void*>(0x1000),
+                               reinterpret_cast<void*>(0x3000)};
+  void* const unseen[] = {reinterpret_cast<void*>(0x4000)};
+  for (uint32_t i = 0; i < LifetimeSamples::kMinSamples; ++i) {
+    lifetimes.RecordFree(long_lived, kLong);
+    lifetimes.RecordFree(short_lived, kShort);
+  }
+  EXPECT_EQ(lifetimes.Predict(long_lived), LifetimePrediction::kLongLived);
+  EXPECT_EQ(lifetimes.Predict(short_lived), LifetimePrediction::kShortLived);
+  EXPECT_EQ(lifetimes.Predict(unseen), LifetimePrediction::kUnknown);
+  // Stacks that share a prefix are still told apart.
+  EXPECT_EQ(lifetimes.Predict(absl::MakeConstSpan(long_lived, 1)),
+            LifetimePrediction::kUnknown);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -0,0 +1,68 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/size_class_tags.h"  // IWYU pragma: keep
+
+#ifdef TCMALLOC_INTERNAL_SIZE_CLASS_TAGS
+
+#include <errno.h>  // IWYU pragma: keep
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#ifdef __x86_64__
+#include <asm/prctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal::size_class_tags {
+
+ABSL_CONST_INIT bool enabled = false;
+
+namespace {
+
+bool EnableTaggedAddresses() {
+#if defined(__x86_64__)
+#ifndef ARCH_ENABLE_TAGGED_ADDR
+#define ARCH_ENABLE_TAGGED_ADDR 0x4002
+#endif
+  // Fails if the CPU or kernel does not support Intel LAM, or if the process
+  // already has several threads.
+  return TEMP_FAILURE_RETRY(syscall(SYS_arch_prctl, ARCH_ENABLE_TAGGED_ADDR,
+                                    /*LAM_U57_BITS*/ kTagBits)) == 0;
+#elif defined(__aarch64__)
+#ifndef PR_SET_TAGGED_ADDR_CTRL
+#define PR_SET_TAGGED_ADDR_CTRL 55
+#endif
+#ifndef PR_TAGGED_ADDR_ENABLE
+#define PR_TAGGED_ADDR_ENABLE (1UL << 0)
+#endif
+  // Loads and stores always ignore the top byte; this makes system calls
+  // accept tagged pointers as well.
+  return prctl(PR_SET_TAGGED_ADDR_CTRL, PR_TAGGED_ADDR_ENABLE, 0, 0, 0) == 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace
+
+void Init() { enabled = EnableTaggedAddresses(); }
+
+}  // namespace tcmalloc::tcmalloc_internal::size_class_tags
+GOOGLE_MALLOC_SECTION_END
+#endif  // #ifdef TCMALLOC_INTERNAL_SIZE_CLASS_TAGS
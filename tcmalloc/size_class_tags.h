@@ -0,0 +1,109 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Size class tags keep the size class of small objects in the top bits of the
+// pointers we return, which the hardware ignores on access: aarch64 TBI, or
+// x86 LAM_U57.  An unsized free can then read the size class off the pointer,
+// rather than looking it up in the pagemap.
+//
+// Only built with TCMALLOC_INTERNAL_SIZE_CLASS_TAGS; otherwise, pointers are
+// never tagged and everything below compiles away.  Pointers are only tagged
+// once the kernel accepts tagged pointers in system calls, and only on the
+// allocation fast path: sampled (and so guarded) allocations, large
+// allocations and size classes that don't fit in the tag stay untagged, and
+// are freed through the pagemap as usual.
+
+#ifndef TCMALLOC_SIZE_CLASS_TAGS_H_
+#define TCMALLOC_SIZE_CLASS_TAGS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/base/attributes.h"
+#include "tcmalloc/internal/config.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal::size_class_tags {
+
+#ifdef TCMALLOC_INTERNAL_SIZE_CLASS_TAGS
+
+#ifdef TCMALLOC_INTERNAL_SELSAN
+#error "SelSan keeps its own tags in the top bits of pointers."
+#endif
+
+#if defined(__x86_64__)
+// LAM_U57 ignores bits 57-62; bit 63 must stay clear in user pointers.
+inline constexpr uintptr_t kTagShift = 57;
+inline constexpr uintptr_t kTagBits = 6;
+#elif defined(__aarch64__)
+// TBI ignores the top byte.
+inline constexpr uintptr_t kTagShift = 56;
+inline constexpr uintptr_t kTagBits = 8;
+#else
+#error "Unsupported platform."
+#endif
+
+inline constexpr bool kPresent = true;
+inline constexpr uintptr_t kTagMask = ((uintptr_t{1} << kTagBits) - 1)
+                                      << kTagShift;
+// Size classes above this are never tagged.
+inline constexpr size_t kMaxTaggedSizeClass = (size_t{1} << kTagBits) - 1;
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE bool IsEnabled() {
+  extern bool enabled;
+  return enabled;
+}
+
+// Tries to have the kernel accept tagged pointers, and enables tagging if it
+// does.
+void Init();
+
+// Returns ptr tagged with size_class, if tagging is enabled and size_class
+// fits in the tag; otherwise returns ptr unchanged.
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* AddTag(void* ptr,
+                                                 size_t size_class) {
+  if (!IsEnabled() || size_class > kMaxTaggedSizeClass) {
+    return ptr;
+  }
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) |
+                                 (uintptr_t{size_class} << kTagShift));
+}
+
+// Returns the size class ptr is tagged with, or 0 if it is untagged.  This
+// doesn't depend on IsEnabled, so pointers stay valid if tagging is disabled
+// later.
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE size_t GetTag(const void* ptr) {
+  return (reinterpret_cast<uintptr_t>(ptr) & kTagMask) >> kTagShift;
+}
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* RemoveTag(const void* ptr) {
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) &
+                                 ~kTagMask);
+}
+
+#else  // #ifdef TCMALLOC_INTERNAL_SIZE_CLASS_TAGS
+
+inline constexpr bool kPresent = false;
+inline constexpr bool IsEnabled() { return false; }
+inline void Init() {}
+inline void* AddTag(void* ptr, size_t size_class) { return ptr; }
+inline constexpr size_t GetTag(const void* ptr) { return 0; }
+inline void* RemoveTag(const void* ptr) { return const_cast<void*>(ptr); }
+
+#endif  // #ifdef TCMALLOC_INTERNAL_SIZE_CLASS_TAGS
+
+}  // namespace tcmalloc::tcmalloc_internal::size_class_tags
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SIZE_CLASS_TAGS_H_
@@ -12,10 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/size_class_info.h"
+#include "tcmalloc/sizemap.h"
+#include "tcmalloc/static_vars.h"
 
 GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
@@ -741,6 +745,17 @@ static constexpr SizeClassInfo List[] = {
 static_assert(sizeof(List) / sizeof(List[0]) <= kNumBaseClasses);
 extern constexpr SizeClasses kSizeClasses{List, Assumptions};
 
+// The SizeMap is defined here rather than with the other globals, in
+// static_vars.cc, so that it can be built from List at compile time.  Its
+// tables are then part of the binary's image, and a process using the default
+// size classes never writes them: their pages stay clean and shared, and
+// initialization skips building them.  Other configurations overwrite them in
+// Static::SlowInitIfNecessary.  Power-of-two builds define it with their own
+// table, in experimental_pow2_size_class.cc.
+#ifndef TCMALLOC_INTERNAL_POW2_SIZE_CLASSES
+ABSL_CONST_INIT SizeMap ABSL_CACHELINE_ALIGNED Static::sizemap_(List);
+#endif
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
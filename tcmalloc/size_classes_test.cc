@@ -393,6 +393,13 @@ TEST(SizeMapTest, GetSizeClassWithAlignment) {
       ASSERT_GE(mapped_size, size);
       // The size needs to be a multiple of alignment.
       ASSERT_EQ(mapped_size % alignment, 0);
+      // And it should be the smallest class that fits both.
+      for (size_t c = 1; c < kNumBaseClasses; ++c) {
+        const size_t class_size = m.class_to_size(c);
+        if (class_size >= size && class_size % alignment == 0) {
+          ASSERT_LE(mapped_size, class_size) << size << " " << alignment;
+        }
+      }
     } else if (alignment <= kPageSize) {
       // When alignment > kPageSize, we do not produce a size class.
       //
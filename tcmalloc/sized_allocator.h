@@ -0,0 +1,112 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SIZED_ALLOCATOR_H_
+#define TCMALLOC_SIZED_ALLOCATOR_H_
+
+#include <stddef.h>
+
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+
+// A standard allocator whose allocate_at_least() returns all of the capacity
+// TCMalloc hands out, through tcmalloc_size_returning_operator_new().  A
+// container that grows through allocate_at_least(), as libc++'s std::vector
+// and std::basic_string do in C++23, then uses the slack at the end of its
+// size class rather than reallocating into it:
+//
+//   std::vector<int, tcmalloc::SizedAllocator<int>> v;
+//
+// Under other standard libraries, allocate_at_least() is still there to be
+// called directly, and the allocator otherwise behaves as std::allocator.
+// Memory is released with sized delete, which is cheaper than unsized.
+//
+// Without TCMalloc linked in, the weak default of the size-returning new
+// reports exactly the requested size.
+template <typename T>
+class SizedAllocator {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  using propagate_on_container_move_assignment = std::true_type;
+  using is_always_equal = std::true_type;
+
+#if defined(__cpp_lib_allocate_at_least) && \
+    __cpp_lib_allocate_at_least >= 202302L
+  using allocation_result = std::allocation_result<T*, size_t>;
+#else
+  struct allocation_result {
+    T* ptr;
+    size_t count;
+  };
+#endif
+
+  constexpr SizedAllocator() noexcept = default;
+  template <typename U>
+  constexpr SizedAllocator(const SizedAllocator<U>&) noexcept {}  // NOLINT
+
+  T* allocate(size_t n) { return allocate_at_least(n).ptr; }
+
+  // Returns room for at least n objects, and how many objects fit in it.
+  allocation_result allocate_at_least(size_t n) {
+    // An impossible size makes the allocation fail as operator new would.
+    const size_t bytes = n > std::numeric_limits<size_t>::max() / sizeof(T)
+                             ? std::numeric_limits<size_t>::max()
+                             : n * sizeof(T);
+    sized_ptr_t res;
+#if defined(__cpp_aligned_new)
+    if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      res = tcmalloc_size_returning_operator_new_aligned(
+          bytes, static_cast<std::align_val_t>(alignof(T)));
+    } else
+#endif
+    {
+      res = tcmalloc_size_returning_operator_new(bytes);
+    }
+    return {static_cast<T*>(res.p), res.n / sizeof(T)};
+  }
+
+  // n is the count given to allocate(), or any count up to the one that
+  // allocate_at_least() returned.
+  void deallocate(T* p, size_t n) noexcept {
+#if defined(__cpp_aligned_new)
+    if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      ::operator delete(p, n * sizeof(T),
+                        static_cast<std::align_val_t>(alignof(T)));
+      return;
+    }
+#endif
+    ::operator delete(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  constexpr bool operator==(const SizedAllocator<U>&) const noexcept {
+    return true;
+  }
+  template <typename U>
+  constexpr bool operator!=(const SizedAllocator<U>&) const noexcept {
+    return false;
+  }
+};
+
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_SIZED_ALLOCATOR_H_
@@ -14,19 +14,28 @@
 
 #include "tcmalloc/sizemap.h"
 
-#include <algorithm>
+#include <fcntl.h>
+#include <sys/types.h>
+
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
-#include <cstring>
+#include <limits>
 #include <new>
 
+#include "absl/base/attributes.h"
 #include "absl/base/macros.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/huge_page_aware_allocator.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/internal/util.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/size_class_info.h"
 #include "tcmalloc/span.h"
@@ -36,8 +45,128 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+namespace {
+
+ABSL_CONST_INIT SizeClassInfo custom_size_classes[kNumBaseClasses];
+ABSL_CONST_INIT SizeClasses custom_classes{};
+ABSL_CONST_INIT bool have_custom_classes = false;
+
+}  // namespace
+
+size_t ParseSizeClasses(absl::string_view text,
+                        absl::Span<SizeClassInfo> classes) {
+  constexpr uint64_t kMaxValue = std::numeric_limits<uint32_t>::max();
+  uint64_t fields[4];
+  size_t num_fields = 0;
+  size_t num_classes = 0;
+  while (!text.empty()) {
+    const char c = text.front();
+    if (c == '#' || absl::StartsWith(text, "//")) {
+      const size_t eol = text.find('\n');
+      text.remove_prefix(eol == text.npos ? text.size() : eol);
+      continue;
+    }
+    if (!absl::ascii_isdigit(c)) {
+      if (!absl::ascii_isspace(c) && c != ',' && c != ';' && c != '{' &&
+          c != '}') {
+        return 0;
+      }
+      text.remove_prefix(1);
+      continue;
+    }
+
+    uint64_t value = 0;
+    while (!text.empty() && absl::ascii_isdigit(text.front())) {
+      value = value * 10 + (text.front() - '0');
+      if (value > kMaxValue) {
+        return 0;
+      }
+      text.remove_prefix(1);
+    }
+    fields[num_fields++] = value;
+    if (num_fields < 4) {
+      continue;
+    }
+    num_fields = 0;
+
+    const SizeClassInfo info = {
+        .size = static_cast<uint32_t>(fields[0]),
+        .pages = static_cast<uint8_t>(fields[1]),
+        .num_to_move = static_cast<uint8_t>(fields[2]),
+        .max_capacity = static_cast<uint32_t>(fields[3]),
+    };
+    if (info.pages != fields[1] || info.num_to_move != fields[2]) {
+      return 0;
+    }
+    const bool is_class_zero = info.size == 0 && info.pages == 0 &&
+                               info.num_to_move == 0 && info.max_capacity == 0;
+    if (num_classes == 0 && !is_class_zero) {
+      if (classes.empty()) {
+        return 0;
+      }
+      classes[num_classes++] = {0, 0, 0, 0};
+    }
+    if (num_classes == classes.size()) {
+      return 0;
+    }
+    classes[num_classes++] = info;
+  }
+  return num_fields == 0 ? num_classes : 0;
+}
+
+bool SizeMap::LoadCustomClasses() {
+  // Large enough for a full table with comments.
+  ABSL_CONST_INIT static char buffer[1 << 15];
+
+  const char* source = "TCMALLOC_SIZE_CLASSES";
+  const char* path = thread_safe_getenv("TCMALLOC_SIZE_CLASSES_FILE");
+  absl::string_view text;
+  if (const char* e = thread_safe_getenv(source);
+      e != nullptr && e[0] != '\0') {
+    text = e;
+  } else if (path != nullptr && path[0] != '\0') {
+    source = path;
+    const int fd = signal_safe_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      TC_LOG("Couldn't open size class file %s", path);
+      return false;
+    }
+    size_t bytes_read = 0;
+    const ssize_t rc =
+        signal_safe_read(fd, buffer, sizeof(buffer), &bytes_read);
+    signal_safe_close(fd);
+    if (rc < 0 || bytes_read == sizeof(buffer)) {
+      TC_LOG("Couldn't read size class file %s", path);
+      return false;
+    }
+    text = absl::string_view(buffer, bytes_read);
+  } else {
+    return false;
+  }
+
+  const size_t num_classes = ParseSizeClasses(text, custom_size_classes);
+  const absl::Span<const SizeClassInfo> classes =
+      absl::MakeConstSpan(custom_size_classes, num_classes);
+  if (num_classes == 0 || !ValidSizeClasses(classes)) {
+    TC_LOG("Ignoring invalid size classes from %s", source);
+    return false;
+  }
+  // The table is generated for this build, so shares the assumptions of the
+  // table it replaces.
+  custom_classes = {
+      .classes = classes,
+      .assumptions = CurrentClasses().assumptions,
+  };
+  have_custom_classes = true;
+  return true;
+}
+
+bool SizeMap::HaveCustomClasses() { return have_custom_classes; }
+
 const SizeClasses& SizeMap::CurrentClasses() {
   switch (Static::size_class_configuration()) {
+    case SizeClassConfiguration::kCustom:
+      return custom_classes;
     case SizeClassConfiguration::kPow2Below64:
       return kSizeClasses;
     case SizeClassConfiguration::kPow2Only:
@@ -154,41 +283,11 @@ bool SizeMap::IsValidSizeClass(size_t size, size_t pages,
 }
 
 bool SizeMap::SetSizeClasses(absl::Span<const SizeClassInfo> size_classes) {
-  const int num_classes = size_classes.size();
   if (!ValidSizeClasses(size_classes)) {
     return false;
   }
 
-  class_to_size_[0] = 0;
-  class_to_pages_[0] = 0;
-  num_objects_to_move_[0] = 0;
-
-  int curr = 1;
-  for (int c = 1; c < num_classes; c++) {
-    class_to_size_[curr] = size_classes[c].size;
-    class_to_pages_[curr] = size_classes[c].pages;
-    num_objects_to_move_[curr] = size_classes[c].num_to_move;
-    max_capacity_[curr] = size_classes[c].max_capacity;
-    ++curr;
-  }
-
-  // Fill any unspecified size classes with 0.
-  for (int x = curr; x < kNumBaseClasses; x++) {
-    class_to_size_[x] = 0;
-    class_to_pages_[x] = 0;
-    num_objects_to_move_[x] = 0;
-  }
-
-  // Copy selected size classes into the upper registers.
-  for (int i = 1; i < (kNumClasses / kNumBaseClasses); i++) {
-    std::copy(&class_to_size_[0], &class_to_size_[kNumBaseClasses],
-              &class_to_size_[kNumBaseClasses * i]);
-    std::copy(&class_to_pages_[0], &class_to_pages_[kNumBaseClasses],
-              &class_to_pages_[kNumBaseClasses * i]);
-    std::copy(&num_objects_to_move_[0], &num_objects_to_move_[kNumBaseClasses],
-              &num_objects_to_move_[kNumBaseClasses * i]);
-  }
-
+  SetClassTables(size_classes);
   return true;
 }
 
@@ -221,6 +320,12 @@ bool SizeMap::ValidSizeClasses(absl::Span<const SizeClassInfo> size_classes) {
     if (!IsValidSizeClass(class_size, pages, num_objects_to_move)) {
       return false;
     }
+    // GetSizeClass computes these classes rather than looking them up.
+    if (kPow2SizeClasses && class_size != size_t{4} << c) {
+      TC_LOG("size class %v is %v bytes, not %v, in a power-of-two build", c,
+             class_size, size_t{4} << c);
+      return false;
+    }
   }
   // Last size class must be kMaxSize.  This is not strictly
   // class_to_size_[kNumBaseClasses - 1] because several size class
@@ -245,55 +350,12 @@ bool SizeMap::Init(absl::Span<const SizeClassInfo> size_classes) {
     return false;
   }
 
-  int next_size = 0;
-  for (int c = 1; c < kNumClasses; c++) {
-    const int max_size_in_class = class_to_size_[c];
-
-    for (int s = next_size; s <= max_size_in_class;
-         s += static_cast<size_t>(kAlignment)) {
-      class_array_[ClassIndex(s)] = c;
-    }
-    next_size = max_size_in_class + static_cast<size_t>(kAlignment);
-    if (next_size > kMaxSize) {
-      break;
-    }
-  }
-
-  if (!ColdFeatureActive()) {
-    return true;
-  }
-
-  memset(cold_sizes_, 0, sizeof(cold_sizes_));
-  cold_sizes_count_ = 0;
-  // Point all lookups in the upper register of class_array_ (allocations
-  // seeking cold memory) to the lower size classes.  This gives us an easy
-  // fallback for sizes that are too small for moving to cold memory (due to
-  // intrusive span metadata).
-  std::copy(&class_array_[0], &class_array_[kClassArraySize],
-            &class_array_[kClassArraySize]);
-
-  for (int c = kExpandedClassesStart; c < kNumClasses; c++) {
-    size_t max_size_in_class = class_to_size_[c];
-    if (max_size_in_class == 0 || max_size_in_class < kMinAllocSizeForCold) {
-      // Resetting next_size to the last size class before
-      // kMinAllocSizeForCold + kAlignment.
-      next_size = max_size_in_class + static_cast<size_t>(kAlignment);
-      continue;
-    }
+  SetClassArray();
 
-    TC_CHECK(Span::IsNonIntrusive(max_size_in_class), "size=%v",
-             max_size_in_class);
-    cold_sizes_[cold_sizes_count_] = c;
-    ++cold_sizes_count_;
-
-    for (int s = next_size; s <= max_size_in_class;
-         s += static_cast<size_t>(kAlignment)) {
-      class_array_[ClassIndex(s) + kClassArraySize] = c;
-    }
-    next_size = max_size_in_class + static_cast<size_t>(kAlignment);
-    if (next_size > kMaxSize) {
-      break;
-    }
+  // Cold size classes rely on Span keeping its metadata out of the objects.
+  for (size_t c : ColdSizeClasses()) {
+    TC_CHECK(Span::IsNonIntrusive(class_to_size_[c]), "size=%v",
+             class_to_size_[c]);
   }
   return true;
 }
@@ -22,6 +22,7 @@
 #include "absl/base/dynamic_annotations.h"
 #include "absl/base/optimization.h"
 #include "absl/numeric/bits.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
@@ -42,6 +43,18 @@ extern const SizeClasses kExperimentalPow2SizeClasses;
 extern const SizeClasses kLegacySizeClasses;
 extern const SizeClasses kLowFragSizeClasses;
 
+// The size classes that Static::sizemap_ is built from at compile time.
+inline constexpr const SizeClasses& kDefaultSizeClasses =
+    kPow2SizeClasses ? kExperimentalPow2SizeClasses : kSizeClasses;
+
+// Parses a size class table written like those in size_classes.cc: four
+// numbers per class (size, pages, num_to_move and max_capacity), optionally
+// in braces, separated by commas, semicolons or whitespace, with "//" and "#"
+// starting comments.  Class 0 may be left out.  Returns the number of classes
+// stored in classes, or 0 if text is malformed or has too many classes.
+size_t ParseSizeClasses(absl::string_view text,
+                        absl::Span<SizeClassInfo> classes);
+
 // Size-class information + mapping
 class SizeMap {
  public:
@@ -157,6 +170,30 @@ class SizeMap {
     return ret;
   }
 
+  // As ClassIndex(), for use in constant expressions.  REQUIRES: s <= kMaxSize.
+  static constexpr size_t ConstantClassIndex(size_t s) {
+    return s <= kLargeSize ? (s + 7) >> 3 : (s + 127 + (120 << 7)) >> 7;
+  }
+
+  // Size class c of a kPow2SizeClasses build holds objects of 4 << c bytes
+  // (ValidSizeClasses checks this), so the class for an object is the bit
+  // width of its last byte's offset, less 2.  Rounding the offset up to one
+  // less than align also rounds the class up to an aligned one, as any power
+  // of two no smaller than align is a multiple of it.  Offsets below 7 map to
+  // the 8-byte class 1.
+  //
+  // This replaces the load from class_array_, which can miss in cache, with a
+  // dependent OR and LZCNT (or CLZ).
+  ABSL_ATTRIBUTE_ALWAYS_INLINE static inline bool Pow2SizeClassMaybe(
+      size_t s, size_t align, size_t& size_class) {
+    if (ABSL_PREDICT_FALSE(s > kMaxSize)) {
+      return false;
+    }
+    const size_t last = (s - (s != 0)) | (align - 1) | 7;
+    size_class = absl::bit_width(last) - 2;
+    return true;
+  }
+
   // Mapping from size class to number of pages to allocate at a time
   unsigned char class_to_pages_[kNumClasses] = {0};
 
@@ -167,6 +204,12 @@ class SizeMap {
   // Set the give size classes to be used by TCMalloc.
   bool SetSizeClasses(absl::Span<const SizeClassInfo> size_classes);
 
+  // Fill the per-class arrays from size_classes, without checking them.
+  constexpr void SetClassTables(absl::Span<const SizeClassInfo> size_classes);
+
+  // Fill class_array_, and the cold size classes, from class_to_size_.
+  constexpr void SetClassArray();
+
   // Check that the size classes meet all requirements.
   static bool ValidSizeClasses(absl::Span<const SizeClassInfo> size_classes);
 
@@ -177,6 +220,16 @@ class SizeMap {
   // Returns size classes to use in the current process.
   static const SizeClasses& CurrentClasses();
 
+  // Loads the size classes given by TCMALLOC_SIZE_CLASSES, or else by the
+  // file named by TCMALLOC_SIZE_CLASSES_FILE, for CurrentClasses to return
+  // instead of the built-in tables.  Tables that fail ValidSizeClasses are
+  // ignored.  Returns whether a table was loaded.
+  //
+  // REQUIRES: pageheap_lock is held.
+  static bool LoadCustomClasses();
+  // Whether LoadCustomClasses has loaded a table.
+  static bool HaveCustomClasses();
+
   // Checks assumptions used to generate the current size classes.
   // Prints any wrong assumptions to stderr.
   static void CheckAssumptions();
@@ -185,6 +238,14 @@ class SizeMap {
   // rely on Init() to populate things.
   constexpr SizeMap() = default;
 
+  // Builds the mapping for size_classes, as Init() does, at compile time when
+  // size_classes is a constant expression.  Unlike Init(), the table isn't
+  // checked, so it must be one that passes Init().
+  explicit constexpr SizeMap(absl::Span<const SizeClassInfo> size_classes) {
+    SetClassTables(size_classes);
+    SetClassArray();
+  }
+
   // Initialize the mapping arrays.  Returns true on success.
   bool Init(absl::Span<const SizeClassInfo> size_classes);
 
@@ -215,8 +276,28 @@ class SizeMap {
       return false;
     }
 
+    // Cold classes are found through class_array_ below.
+    if (kPow2SizeClasses &&
+        (!kHasExpandedClasses || !IsColdHint(policy.access()))) {
+      if (ABSL_PREDICT_FALSE(!Pow2SizeClassMaybe(size, align, *size_class))) {
+        ABSL_ANNOTATE_MEMORY_IS_UNINITIALIZED(size_class, sizeof(*size_class));
+        return false;
+      }
+      *size_class += policy.scaled_numa_partition();
+      return true;
+    }
+
+    // Every suitably aligned class also holds size rounded up to align, so
+    // look that up instead: it usually maps straight to an aligned class (for
+    // example, 64- and 4KiB-aligned buffers, which are common for SIMD and
+    // I/O), where size itself would have us step through all the classes in
+    // between below.  As kMaxSize is a multiple of kPageSize >= align, the
+    // rounding never takes a size past kMaxSize.  For the default alignment
+    // it's a no-op that optimizes away.
+    const size_t aligned_size =
+        size <= kMaxSize ? (size + align - 1) & ~(align - 1) : size;
     size_t idx;
-    if (ABSL_PREDICT_FALSE(!ClassIndexMaybe(size, idx))) {
+    if (ABSL_PREDICT_FALSE(!ClassIndexMaybe(aligned_size, idx))) {
       ABSL_ANNOTATE_MEMORY_IS_UNINITIALIZED(size_class, sizeof(*size_class));
       return false;
     }
@@ -237,9 +318,9 @@ class SizeMap {
       return true;
     }
 
-    // Predict that size aligned allocs most often directly map to a proper
-    // size class, i.e., multiples of 32, 64, etc, matching our class sizes.
-    // Since alignment is <= kPageSize, we must find a suitable class
+    // Having rounded up the size, aligned allocs most often directly map to a
+    // proper size class, i.e., multiples of 32, 64, etc, matching our class
+    // sizes.  Since alignment is <= kPageSize, we must find a suitable class
     // (at least kMaxSize is aligned on kPageSize).
     static_assert((kMaxSize % kPageSize) == 0, "the loop below won't work");
     // Profiles say we usually get the right class based on the size,
@@ -263,6 +344,26 @@ class SizeMap {
     return ret;
   }
 
+  // Sets rounded[i] to the bytes operator new would use for sizes[i]: the size
+  // of its class, or whole pages past kMaxSize, as nallocx(sizes[i], 0) does.
+  // The loop has no branches, so that the compiler can vectorize it, with
+  // gathers for the table lookups where available.  rounded may alias sizes.
+  ABSL_ATTRIBUTE_ALWAYS_INLINE inline void GetAllocatedSizes(
+      const size_t* sizes, size_t* rounded, size_t n) const {
+    for (size_t i = 0; i < n; ++i) {
+      const size_t s = sizes[i];
+      const bool fits = s <= kMaxSize;
+      size_t idx = s <= kLargeSize ? Shr<3>(s + 7)
+                                   : Shr<7>(s + 127 + (120 << 7));
+      idx = fits ? idx : 0;
+      // Sizes are the same in all NUMA partitions.
+      const size_t class_size = class_to_size_[class_array_[idx]];
+      const size_t page_size =
+          ((s >> kPageShift) + ((s & (kPageSize - 1)) != 0)) << kPageShift;
+      rounded[i] = fits ? class_size : page_size;
+    }
+  }
+
   // Get the byte-size for a specified class. REQUIRES: size_class <=
   // kNumClasses.
   ABSL_ATTRIBUTE_ALWAYS_INLINE inline size_t class_to_size(
@@ -306,6 +407,94 @@ class SizeMap {
                                size_t num_objects_to_move);
 };
 
+inline constexpr void SizeMap::SetClassTables(
+    absl::Span<const SizeClassInfo> size_classes) {
+  const int num_classes = size_classes.size();
+  class_to_size_[0] = 0;
+  class_to_pages_[0] = 0;
+  num_objects_to_move_[0] = 0;
+
+  int curr = 1;
+  for (int c = 1; c < num_classes; c++) {
+    class_to_size_[curr] = size_classes[c].size;
+    class_to_pages_[curr] = size_classes[c].pages;
+    num_objects_to_move_[curr] = size_classes[c].num_to_move;
+    max_capacity_[curr] = size_classes[c].max_capacity;
+    ++curr;
+  }
+
+  // Fill any unspecified size classes with 0.
+  for (int x = curr; x < kNumBaseClasses; x++) {
+    class_to_size_[x] = 0;
+    class_to_pages_[x] = 0;
+    num_objects_to_move_[x] = 0;
+  }
+
+  // Copy selected size classes into the upper registers.  (std::copy isn't
+  // constexpr until C++20.)
+  for (int i = 1; i < (kNumClasses / kNumBaseClasses); i++) {
+    for (int x = 0; x < kNumBaseClasses; x++) {
+      class_to_size_[kNumBaseClasses * i + x] = class_to_size_[x];
+      class_to_pages_[kNumBaseClasses * i + x] = class_to_pages_[x];
+      num_objects_to_move_[kNumBaseClasses * i + x] = num_objects_to_move_[x];
+    }
+  }
+}
+
+inline constexpr void SizeMap::SetClassArray() {
+  int next_size = 0;
+  for (int c = 1; c < kNumClasses; c++) {
+    const int max_size_in_class = class_to_size_[c];
+
+    for (int s = next_size; s <= max_size_in_class;
+         s += static_cast<size_t>(kAlignment)) {
+      class_array_[ConstantClassIndex(s)] = c;
+    }
+    next_size = max_size_in_class + static_cast<size_t>(kAlignment);
+    if (next_size > kMaxSize) {
+      break;
+    }
+  }
+
+  if (!ColdFeatureActive()) {
+    return;
+  }
+
+  for (size_t& c : cold_sizes_) {
+    c = 0;
+  }
+  cold_sizes_count_ = 0;
+  // Point all lookups in the upper register of class_array_ (allocations
+  // seeking cold memory) to the lower size classes.  This gives us an easy
+  // fallback for sizes that are too small for moving to cold memory (due to
+  // intrusive span metadata).
+  for (size_t i = 0; i < kClassArraySize; i++) {
+    class_array_[i + kClassArraySize] = class_array_[i];
+  }
+
+  for (int c = kExpandedClassesStart; c < kNumClasses; c++) {
+    size_t max_size_in_class = class_to_size_[c];
+    if (max_size_in_class == 0 || max_size_in_class < kMinAllocSizeForCold) {
+      // Resetting next_size to the last size class before
+      // kMinAllocSizeForCold + kAlignment.
+      next_size = max_size_in_class + static_cast<size_t>(kAlignment);
+      continue;
+    }
+
+    cold_sizes_[cold_sizes_count_] = c;
+    ++cold_sizes_count_;
+
+    for (int s = next_size; s <= max_size_in_class;
+         s += static_cast<size_t>(kAlignment)) {
+      class_array_[ConstantClassIndex(s) + kClassArraySize] = c;
+    }
+    next_size = max_size_in_class + static_cast<size_t>(kAlignment);
+    if (next_size > kMaxSize) {
+      break;
+    }
+  }
+}
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
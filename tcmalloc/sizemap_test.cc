@@ -110,4 +110,68 @@ TEST(ColdSizeClassTest, VerifyAllocationFullRange) {
   }
 }
 
+void ExpectSameMapping(const SizeMap& a, const SizeMap& b) {
+  for (size_t c = 0; c < kNumClasses; ++c) {
+    EXPECT_EQ(a.class_to_size(c), b.class_to_size(c)) << c;
+    EXPECT_EQ(a.class_to_pages(c), b.class_to_pages(c)) << c;
+    EXPECT_EQ(a.num_objects_to_move(c), b.num_objects_to_move(c)) << c;
+    EXPECT_EQ(a.max_capacity(c), b.max_capacity(c)) << c;
+  }
+  for (size_t size = 0; size <= kMaxSize; ++size) {
+    ASSERT_EQ(a.SizeClass(CppPolicy(), size), b.SizeClass(CppPolicy(), size))
+        << size;
+    ASSERT_EQ(a.SizeClass(CppPolicy().AccessAsCold(), size),
+              b.SizeClass(CppPolicy().AccessAsCold(), size))
+        << size;
+  }
+  EXPECT_THAT(a.ColdSizeClasses(), ElementsAreArray(b.ColdSizeClasses()));
+}
+
+TEST(SizeMapTest, PrebuiltMatchesInit) {
+  SizeMap size_map;
+  ASSERT_TRUE(size_map.Init(kDefaultSizeClasses.classes));
+
+  const SizeMap prebuilt(kDefaultSizeClasses.classes);
+  ExpectSameMapping(prebuilt, size_map);
+
+  // The global map starts out built at compile time, and is only rebuilt for
+  // other size classes.
+  if (&SizeMap::CurrentClasses() == &kDefaultSizeClasses) {
+    ExpectSameMapping(tc_globals.sizemap(), size_map);
+  }
+}
+
+TEST(ParseSizeClassesTest, Parse) {
+  SizeClassInfo classes[4];
+  ASSERT_EQ(ParseSizeClasses("8 1 32 2048\n"
+                             "{  16, 1, 32,  1024},  // 1  512\n"
+                             "# Comment\n"
+                             "32 1 32 512;",
+                             classes),
+            4);
+  EXPECT_EQ(classes[0].size, 0);
+  EXPECT_EQ(classes[0].pages, 0);
+  EXPECT_EQ(classes[1].size, 8);
+  EXPECT_EQ(classes[1].max_capacity, 2048);
+  EXPECT_EQ(classes[2].size, 16);
+  EXPECT_EQ(classes[2].max_capacity, 1024);
+  EXPECT_EQ(classes[3].size, 32);
+  EXPECT_EQ(classes[3].pages, 1);
+  EXPECT_EQ(classes[3].num_to_move, 32);
+
+  // Class 0 may be given.
+  EXPECT_EQ(ParseSizeClasses("0 0 0 0, 8 1 32 2048", classes), 2);
+}
+
+TEST(ParseSizeClassesTest, Malformed) {
+  SizeClassInfo classes[2];
+  EXPECT_EQ(ParseSizeClasses("", classes), 0);
+  EXPECT_EQ(ParseSizeClasses("8 1 32", classes), 0);
+  EXPECT_EQ(ParseSizeClasses("8 1 32 x", classes), 0);
+  EXPECT_EQ(ParseSizeClasses("8 256 32 2048", classes), 0);
+  EXPECT_EQ(ParseSizeClasses("8 1 32 99999999999", classes), 0);
+  // Too many classes.
+  EXPECT_EQ(ParseSizeClasses("8 1 32 2048 16 1 32 2048", classes), 0);
+}
+
 }  // namespace tcmalloc::tcmalloc_internal
@@ -0,0 +1,96 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/slow_path_latency.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/numeric/bits.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+ABSL_CONST_INIT std::atomic<uint32_t>
+    SlowPathLatency::counts_[kNumSlowPathLayers][kNumClasses][kBuckets];
+
+int SlowPathLatency::BucketFor(int64_t cycles) {
+  if (cycles <= 0) {
+    return 0;
+  }
+  const int log2 =
+      absl::bit_width(static_cast<uint64_t>(cycles)) - 1 - kMinBucketShift;
+  return std::clamp(log2, 0, kBuckets - 1);
+}
+
+int64_t SlowPathLatency::StartSlow(int64_t interval) {
+  const int64_t now = absl::base_internal::CycleClock::Now();
+  // Slow paths are irregular enough that the low bits of the cycle counter
+  // pick them about as well as a random number would, without a shared
+  // counter.  The lowest bits are dropped as some clocks do not tick them.
+  if (interval > 1 && (static_cast<uint64_t>(now) >> 4) % interval != 0) {
+    return 0;
+  }
+  return std::max<int64_t>(now, 1);
+}
+
+void SlowPathLatency::PrintInPbtxt(PbtxtRegion& region) {
+  constexpr const char* kLayerNames[kNumSlowPathLayers] = {
+      "cpu_cache", "central_freelist", "page_heap"};
+
+  PbtxtRegion latency = region.CreateSubRegion("slow_path_latency");
+  latency.PrintDouble("cycles_per_second",
+                      absl::base_internal::CycleClock::Frequency());
+  latency.PrintI64("min_bucket_cycles", int64_t{1} << kMinBucketShift);
+  for (int layer = 0; layer < kNumSlowPathLayers; ++layer) {
+    for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
+      bool empty = true;
+      for (int bucket = 0; bucket < kBuckets; ++bucket) {
+        if (counts_[layer][size_class][bucket].load(
+                std::memory_order_relaxed) != 0) {
+          empty = false;
+          break;
+        }
+      }
+      if (empty) {
+        continue;
+      }
+
+      PbtxtRegion histogram = latency.CreateSubRegion("histogram");
+      histogram.PrintRaw("layer", kLayerNames[layer]);
+      histogram.PrintI64("sizeclass", size_class);
+      for (int bucket = 0; bucket < kBuckets; ++bucket) {
+        const uint32_t count =
+            counts_[layer][size_class][bucket].load(std::memory_order_relaxed);
+        if (count == 0) {
+          continue;
+        }
+        PbtxtRegion entry = histogram.CreateSubRegion("buckets");
+        entry.PrintI64("lower_bound_cycles",
+                       int64_t{1} << (bucket + kMinBucketShift));
+        entry.PrintI64("count", count);
+      }
+    }
+  }
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,127 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SLOW_PATH_LATENCY_H_
+#define TCMALLOC_SLOW_PATH_LATENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/parameters.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// The layers of the allocator whose slow paths are timed.
+enum class SlowPathLayer : uint8_t {
+  // CpuCache::AllocateSlow, a miss in the per-CPU cache.
+  kCpuCache,
+  // CentralFreeList::RemoveRange, a miss in the transfer cache.
+  kCentralFreeList,
+  // CentralFreeList::AllocateSpan, fetching a new span from the page heap.
+  kPageHeap,
+};
+
+inline constexpr int kNumSlowPathLayers = 3;
+
+// SlowPathLatency keeps, per layer and per size class, a histogram of how
+// many cycles sampled slow path allocations take.  Buckets are powers of two
+// starting at 2^kMinBucketShift cycles; the first one also holds anything
+// shorter and the last one anything longer.
+//
+// Timing is off unless slow_path_latency_sampling_interval is positive, in
+// which case roughly one in that many slow path operations is timed.  The
+// fast paths are never timed.
+class SlowPathLatency {
+ public:
+  static constexpr int kBuckets = 20;
+  static constexpr int kMinBucketShift = 6;
+
+  // Returns the cycle count at which a timed operation starts, or 0 if the
+  // operation should not be timed.
+  static int64_t Start() {
+    const int64_t interval = Parameters::slow_path_latency_sampling_interval();
+    if (ABSL_PREDICT_TRUE(interval <= 0)) {
+      return 0;
+    }
+    return StartSlow(interval);
+  }
+
+  // Accounts for an operation on `size_class` in `layer` that started at
+  // `start`, as returned by Start().
+  static void Record(SlowPathLayer layer, size_t size_class, int64_t start) {
+    RecordCycles(layer, size_class, absl::base_internal::CycleClock::Now() -
+                                        start);
+  }
+
+  static void RecordCycles(SlowPathLayer layer, size_t size_class,
+                           int64_t cycles) {
+    TC_ASSERT_LT(size_class, kNumClasses);
+    counts_[static_cast<int>(layer)][size_class][BucketFor(cycles)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  // Returns the number of operations recorded in `bucket`.
+  static uint64_t Count(SlowPathLayer layer, size_t size_class, int bucket) {
+    return counts_[static_cast<int>(layer)][size_class][bucket].load(
+        std::memory_order_relaxed);
+  }
+
+  static int BucketFor(int64_t cycles);
+
+  // Prints the nonempty histograms.
+  static void PrintInPbtxt(PbtxtRegion& region);
+
+ private:
+  static int64_t StartSlow(int64_t interval);
+
+  static std::atomic<uint32_t> counts_[kNumSlowPathLayers][kNumClasses]
+                                      [kBuckets];
+};
+
+// Times its own lifetime as one operation on `size_class` in `layer`, if the
+// operation is sampled.
+class SlowPathTimer {
+ public:
+  SlowPathTimer(SlowPathLayer layer, size_t size_class)
+      : layer_(layer),
+        size_class_(size_class),
+        start_(SlowPathLatency::Start()) {}
+
+  ~SlowPathTimer() {
+    if (ABSL_PREDICT_FALSE(start_ != 0)) {
+      SlowPathLatency::Record(layer_, size_class_, start_);
+    }
+  }
+
+  SlowPathTimer(const SlowPathTimer&) = delete;
+  SlowPathTimer& operator=(const SlowPathTimer&) = delete;
+
+ private:
+  SlowPathLayer layer_;
+  size_t size_class_;
+  int64_t start_;
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SLOW_PATH_LATENCY_H_
@@ -0,0 +1,77 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/slow_path_latency.h"
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/parameters.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+using Latency = SlowPathLatency;
+
+TEST(SlowPathLatencyTest, Buckets) {
+  EXPECT_EQ(Latency::BucketFor(0), 0);
+  EXPECT_EQ(Latency::BucketFor(1), 0);
+  EXPECT_EQ(Latency::BucketFor((1 << Latency::kMinBucketShift) - 1), 0);
+  EXPECT_EQ(Latency::BucketFor(1 << Latency::kMinBucketShift), 0);
+  EXPECT_EQ(Latency::BucketFor(2 << Latency::kMinBucketShift), 1);
+  EXPECT_EQ(Latency::BucketFor((4 << Latency::kMinBucketShift) - 1), 1);
+  EXPECT_EQ(Latency::BucketFor(4 << Latency::kMinBucketShift), 2);
+  EXPECT_EQ(Latency::BucketFor(int64_t{1} << 62), Latency::kBuckets - 1);
+}
+
+TEST(SlowPathLatencyTest, Records) {
+  constexpr SlowPathLayer kLayer = SlowPathLayer::kCentralFreeList;
+  constexpr size_t kSizeClass = 1;
+  const uint64_t before = Latency::Count(kLayer, kSizeClass, 2);
+
+  Latency::RecordCycles(kLayer, kSizeClass, 5 << Latency::kMinBucketShift);
+  Latency::RecordCycles(kLayer, kSizeClass, 6 << Latency::kMinBucketShift);
+  EXPECT_EQ(Latency::Count(kLayer, kSizeClass, 2), before + 2);
+  // Other layers are counted separately.
+  EXPECT_EQ(Latency::Count(SlowPathLayer::kPageHeap, kSizeClass, 2), 0);
+}
+
+TEST(SlowPathLatencyTest, Sampling) {
+  const int64_t interval = Parameters::slow_path_latency_sampling_interval();
+
+  // Timing is off by default.
+  Parameters::set_slow_path_latency_sampling_interval(0);
+  EXPECT_EQ(Latency::Start(), 0);
+
+  // With an interval of 1, every operation is timed.
+  Parameters::set_slow_path_latency_sampling_interval(1);
+  constexpr SlowPathLayer kLayer = SlowPathLayer::kCpuCache;
+  constexpr size_t kSizeClass = 2;
+  uint64_t before = 0;
+  for (int bucket = 0; bucket < Latency::kBuckets; ++bucket) {
+    before += Latency::Count(kLayer, kSizeClass, bucket);
+  }
+  { SlowPathTimer timer(kLayer, kSizeClass); }
+  uint64_t after = 0;
+  for (int bucket = 0; bucket < Latency::kBuckets; ++bucket) {
+    after += Latency::Count(kLayer, kSizeClass, bucket);
+  }
+  EXPECT_EQ(after, before + 1);
+
+  Parameters::set_slow_path_latency_sampling_interval(interval);
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
@@ -20,6 +20,7 @@
 #include <cstddef>
 
 #include "absl/base/optimization.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/atomic_stats_counter.h"
 #include "tcmalloc/internal/config.h"
@@ -43,7 +44,7 @@ void Span::Sample(SampledAllocation* sampled_allocation) {
   // The cast to value matches Unsample.
   tcmalloc_internal::StatsCounter::Value allocated_bytes =
       static_cast<tcmalloc_internal::StatsCounter::Value>(
-          AllocatedBytes(sampled_allocation->sampled_stack));
+          AllocatedBytes(sampled_allocation->details));
   tc_globals.sampled_objects_size_.Add(allocated_bytes);
   tc_globals.total_sampled_count_.Add(1);
 }
@@ -61,7 +62,7 @@ SampledAllocation* Span::Unsample() {
   // sizeof(size_t) != sizeof(Value).
   tcmalloc_internal::StatsCounter::Value neg_allocated_bytes =
       -static_cast<tcmalloc_internal::StatsCounter::Value>(
-          AllocatedBytes(sampled_allocation->sampled_stack));
+          AllocatedBytes(sampled_allocation->details));
   tc_globals.sampled_objects_size_.Add(neg_allocated_bytes);
   return sampled_allocation;
 }
@@ -126,29 +127,7 @@ double Span::Fragmentation(size_t object_size) const {
 //              [---|idx|idx|idx|idx|idx|idx|idx]  16-byte object
 //
 
-void* Span::BitmapIdxToPtr(ObjIdx idx, size_t size) const {
-  uintptr_t off = first_page_.start_uintptr() + idx * size;
-  return reinterpret_cast<ObjIdx*>(off);
-}
-
-size_t Span::BitmapPopBatch(void** __restrict batch, size_t N, size_t size) {
-  size_t before = bitmap_.CountBits(0, bitmap_.size());
-  size_t count = 0;
-  // Want to fill the batch either with N objects, or the number of objects
-  // remaining in the span.
-  while (!bitmap_.IsZero() && count < N) {
-    size_t offset = bitmap_.FindSet(0);
-    TC_ASSERT_LT(offset, bitmap_.size());
-    batch[count] = BitmapIdxToPtr(offset, size);
-    bitmap_.ClearLowestBit();
-    count++;
-  }
-
-  TC_ASSERT_EQ(bitmap_.CountBits(0, bitmap_.size()) + count, before);
-  allocated_.store(allocated_.load(std::memory_order_relaxed) + count,
-                   std::memory_order_relaxed);
-  return count;
-}
+ABSL_CONST_INIT bool Span::bitmap_lifo_ = false;
 
 size_t Span::FreelistPopBatch(void** __restrict batch, size_t N, size_t size) {
   // Handle spans with bitmap_.size() or fewer objects using a bitmap. We expect
@@ -159,62 +138,53 @@ size_t Span::FreelistPopBatch(void** __restrict batch, size_t N, size_t size) {
   return ListPopBatch(batch, N, size);
 }
 
-size_t Span::ListPopBatch(void** __restrict batch, size_t N, size_t size) {
-  size_t result = 0;
-
-  // Pop from cache.
-  auto csize = cache_size_;
-  // TODO(b/304135905):  Complete experiment and update kCacheSize.
-  ASSUME(csize <= kLargeCacheSize);
-  auto cache_reads = csize < N ? csize : N;
-  const uintptr_t span_start = first_page_.start_uintptr();
-  for (; result < cache_reads; result++) {
-    batch[result] = IdxToPtr(cache_[csize - result - 1], size, span_start);
-  }
-
-  // Store this->cache_size_ one time.
-  cache_size_ = csize - result;
-
-  while (result < N) {
-    if (freelist_ == kListEnd) {
-      break;
-    }
-
-    ObjIdx* const host = IdxToPtr(freelist_, size, span_start);
-    uint16_t embed_count = embed_count_;
-    ObjIdx current = host[embed_count];
+namespace {
 
-    size_t iter = embed_count;
-    if (result + embed_count > N) {
-      iter = N - result;
-    }
-    for (size_t i = 0; i < iter; i++) {
-      // Pop from the first object on freelist.
-      batch[result + i] = IdxToPtr(host[embed_count - i], size, span_start);
-    }
-    embed_count -= iter;
-    result += iter;
-
-    // Update current for next cycle.
-    current = host[embed_count];
+size_t GenericPopBatch(Span* span, void** batch, size_t N, size_t size) {
+  return span->FreelistPopBatch(batch, N, size);
+}
 
-    if (result == N) {
-      embed_count_ = embed_count;
-      break;
-    }
+size_t GenericPushBatch(Span* span, absl::Span<void* const> batch,
+                        size_t size, uint32_t reciprocal,
+                        uint32_t max_cache_size) {
+  return span->FreelistPushBatch(batch, size, reciprocal, max_cache_size);
+}
 
-    // The first object on the freelist is empty, pop it.
-    TC_ASSERT_EQ(embed_count, 0);
+template <size_t kSize>
+size_t FixedSizePopBatch(Span* span, void** batch, size_t N, size_t size) {
+  TC_ASSERT_EQ(size, kSize);
+  return span->FixedSizePopBatch<kSize>(batch, N);
+}
 
-    batch[result] = host;
-    result++;
+template <size_t kSize>
+size_t FixedSizePushBatch(Span* span, absl::Span<void* const> batch,
+                          size_t size, uint32_t reciprocal,
+                          uint32_t max_cache_size) {
+  TC_ASSERT_EQ(size, kSize);
+  return span->FixedSizePushBatch<kSize>(batch, max_cache_size);
+}
 
-    freelist_ = current;
-    embed_count_ = size / sizeof(ObjIdx) - 1;
+template <size_t kSize>
+constexpr Span::FreelistOps kFixedSizeOps = {FixedSizePopBatch<kSize>,
+                                             FixedSizePushBatch<kSize>};
+
+}  // namespace
+
+Span::FreelistOps Span::FreelistOpsFor(size_t size) {
+  switch (size) {
+    case 8:
+      return kFixedSizeOps<8>;
+    case 16:
+      return kFixedSizeOps<16>;
+    case 32:
+      return kFixedSizeOps<32>;
+    case 64:
+      return kFixedSizeOps<64>;
+    case 128:
+      return kFixedSizeOps<128>;
+    default:
+      return {GenericPopBatch, GenericPushBatch};
   }
-  allocated_.store(allocated_.load(std::memory_order_relaxed) + result,
-                   std::memory_order_relaxed);
-  return result;
 }
 
 uint32_t Span::CalcReciprocal(size_t size) {
@@ -230,6 +200,7 @@ void Span::BuildBitmap(size_t size, size_t count) {
   // maximum capacity for the bitmap is bitmap_.size() objects.
   TC_ASSERT_LE(count, bitmap_.size());
   allocated_.store(0, std::memory_order_relaxed);
+  cache_size_ = 0;
   bitmap_.Clear();  // bitmap_ can be non-zero from a previous use.
   bitmap_.SetRange(0, count);
   TC_ASSERT_EQ(bitmap_.CountBits(0, bitmap_.size()), count);
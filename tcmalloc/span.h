@@ -24,10 +24,12 @@
 #include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <type_traits>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/internal/linked_list.h"
@@ -56,9 +58,18 @@ enum AccessDensityPrediction {
   kPredictionCounts
 };
 
+// Predicted lifetime of a large allocation, from the sampled lifetimes of
+// allocations of similar size.
+enum class LifetimePrediction : uint8_t {
+  kUnknown,
+  kShortLived,
+  kLongLived,
+};
+
 struct SpanAllocInfo {
   size_t objects_per_span;
   AccessDensityPrediction density;
+  LifetimePrediction lifetime = LifetimePrediction::kUnknown;
 };
 
 // Information kept for a span (a contiguous run of pages).
@@ -135,6 +146,17 @@ class Span final : public SpanList::Elem {
 
   bool donated() const { return is_donated_; }
   void set_donated(bool value) { is_donated_ = value; }
+
+  // Were this span's pages fresh from the system, and so known to be zero,
+  // when it was allocated?  Only meaningful until the memory is handed out.
+  // REQUIRES: this is not a SAMPLED span.
+  bool zeroed() const;
+  void set_zeroed(bool value);
+
+  // Has this page-level allocation been interleaved across NUMA nodes with
+  // SystemInterleave, so that it needs SystemUninterleave when freed?
+  bool interleaved() const { return interleaved_; }
+  void set_interleaved(bool value) { interleaved_ = value; }
   // ---------------------------------------------------------------------------
   // Span memory range.
   // ---------------------------------------------------------------------------
@@ -192,10 +214,39 @@ class Span final : public SpanList::Elem {
   bool FreelistPush(void* ptr, size_t size, uint32_t reciprocal,
                     uint32_t max_cache_size);
 
+  // Pushes the objects in batch, which all belong to this span, onto the
+  // freelist. Returns the number of objects pushed, which is less than
+  // batch.size() if the freelist becomes full, as for FreelistPush.
+  size_t FreelistPushBatch(absl::Span<void* const> batch, size_t size,
+                           uint32_t reciprocal, uint32_t max_cache_size);
+
   // Pops up to N objects from the freelist and returns them in the batch array.
   // Returns number of objects actually popped.
   size_t FreelistPopBatch(void** batch, size_t N, size_t size);
 
+  // As FreelistPopBatch and FreelistPushBatch, for objects of kSize bytes.
+  // With the size known at compile time, the choice between the bitmap and
+  // the list and the index arithmetic fold away.
+  template <size_t kSize>
+  size_t FixedSizePopBatch(void** batch, size_t N);
+  template <size_t kSize>
+  size_t FixedSizePushBatch(absl::Span<void* const> batch,
+                            uint32_t max_cache_size);
+
+  // Freelist operations for objects of one size, chosen once per size class
+  // by FreelistOpsFor.
+  struct FreelistOps {
+    size_t (*pop_batch)(Span* span, void** batch, size_t N, size_t size);
+    size_t (*push_batch)(Span* span, absl::Span<void* const> batch,
+                         size_t size, uint32_t reciprocal,
+                         uint32_t max_cache_size);
+  };
+
+  // Returns operations specialized for objects of <size> bytes, for the
+  // hottest sizes, and ones calling FreelistPopBatch and FreelistPushBatch
+  // for all others.
+  static FreelistOps FreelistOpsFor(size_t size);
+
   // Reset a Span object to track the range [p, p + n).
   void Init(PageId p, Length n);
 
@@ -222,6 +273,12 @@ class Span final : public SpanList::Elem {
   static constexpr size_t kCacheSize = 4;
   static constexpr size_t kLargeCacheSize = 12;
 
+  // When enabled, spans that use a bitmap hand out their most recently freed
+  // objects first, which are more likely to still be in cache, rather than
+  // the lowest free index.
+  static bool bitmap_lifo() { return bitmap_lifo_; }
+  static void set_bitmap_lifo(bool value) { bitmap_lifo_ = value; }
+
   static std::align_val_t CalcAlignOf(uint32_t max_cache_size);
   static size_t CalcSizeOf(uint32_t max_cache_size);
 
@@ -230,6 +287,12 @@ class Span final : public SpanList::Elem {
   typedef uint16_t ObjIdx;
   static constexpr ObjIdx kListEnd = -1;
 
+  // The fields below are ordered so that everything FreelistPopBatch and
+  // FreelistPush touch, from embed_count_ to the embedded cache_, is
+  // contiguous. The colder num_pages_ sits between them and the list links
+  // inherited from SpanList::Elem. See Prefetch().
+  Length num_pages_;  // Number of pages in span.
+
   // Use uint16_t or uint8_t for 16 bit and 8 bit fields instead of bitfields.
   // LLVM will generate widen load/store and bit masking operations to access
   // bitfields and this hurts performance. Although compiler flag
@@ -239,9 +302,19 @@ class Span final : public SpanList::Elem {
   // look at b/35680381 and cl/199502226.
   // For available objects stored as a compressed linked list, the index of
   // the first object in recorded in freelist_.
-  struct {
-    uint16_t embed_count_;
-    uint16_t freelist_;
+  //
+  // Spans using a bitmap have no use for the list, and instead keep the
+  // indices of their most recently freed objects in recent_, most recent last,
+  // and their number in cache_size_. See bitmap_lifo().
+  union {
+    struct {
+      uint16_t embed_count_;
+      uint16_t freelist_;
+    };
+    uint8_t recent_[2 * sizeof(uint16_t)];
+
+    // Used only for page-level allocations, sampled or not. See interleaved().
+    bool interleaved_;
   };
   std::atomic<uint16_t> allocated_;  // Number of non-free objects
   uint8_t cache_size_;
@@ -254,8 +327,12 @@ class Span final : public SpanList::Elem {
 
   static constexpr size_t kBitmapSize = 8 * sizeof(ObjIdx) * kCacheSize;
 
+  // Object sizes known at compile time.  The helpers below take the size as
+  // either this or a size_t.
+  template <size_t kSize>
+  using FixedSize = std::integral_constant<size_t, kSize>;
+
   PageId first_page_;  // Starting page number.
-  Length num_pages_;   // Number of pages in span.
 
   union {
     // Used only for spans in CentralFreeList (SMALL_OBJECT state).
@@ -269,6 +346,9 @@ class Span final : public SpanList::Elem {
 
     // Used only for sampled spans (SAMPLED state).
     SampledAllocation* sampled_allocation_;
+
+    // Used only for unsampled spans of page-level allocations. See zeroed().
+    bool zeroed_;
   };
 
   // Returns true if Span will use bitmap for objects of size <size>.
@@ -279,19 +359,37 @@ class Span final : public SpanList::Elem {
   ObjIdx* IdxToPtr(ObjIdx idx, size_t size, uintptr_t start) const;
 
   // Convert object pointer <-> freelist index for bitmap managed objects.
-  ObjIdx BitmapPtrToIdx(void* ptr, size_t size, uint32_t reciprocal) const;
-  void* BitmapIdxToPtr(ObjIdx idx, size_t size) const;
+  template <typename Size>
+  ObjIdx BitmapPtrToIdx(void* ptr, Size size, uint32_t reciprocal) const;
+  template <typename Size>
+  void* BitmapIdxToPtr(ObjIdx idx, Size size) const;
 
   // Helper function for converting a pointer to an index.
   static ObjIdx OffsetToIdx(uintptr_t offset, uint32_t reciprocal);
+  static ObjIdx OffsetToIdx(uintptr_t offset, size_t size,
+                            uint32_t reciprocal) {
+    return OffsetToIdx(offset, reciprocal);
+  }
+  template <size_t kSize>
+  static ObjIdx OffsetToIdx(uintptr_t offset, FixedSize<kSize> size,
+                            uint32_t reciprocal) {
+    return static_cast<ObjIdx>(offset / kSize);
+  }
 
-  size_t ListPopBatch(void** __restrict batch, size_t N, size_t size);
+  template <typename Size>
+  size_t ListPopBatch(void** __restrict batch, size_t N, Size size);
 
-  bool ListPush(void* ptr, size_t size, uint32_t max_cache_size);
+  template <typename Size>
+  bool ListPush(void* ptr, Size size, uint32_t max_cache_size);
+
+  template <typename Size>
+  size_t PushBatch(absl::Span<void* const> batch, Size size,
+                   uint32_t reciprocal, uint32_t max_cache_size);
 
   // For spans containing 64 or fewer objects, indicate that the object at the
   // index has been returned. Always returns true.
-  bool BitmapPush(void* ptr, size_t size, uint32_t reciprocal);
+  template <typename Size>
+  bool BitmapPush(void* ptr, Size size, uint32_t reciprocal);
 
   // A bitmap is used to indicate object availability for spans containing
   // 64 or fewer objects.
@@ -299,7 +397,14 @@ class Span final : public SpanList::Elem {
 
   // For spans with 64 or fewer objects populate batch with up to N objects.
   // Returns number of objects actually popped.
-  size_t BitmapPopBatch(void** batch, size_t N, size_t size);
+  template <typename Size>
+  size_t BitmapPopBatch(void** __restrict batch, size_t N, Size size);
+
+  // Records idx as the most recently freed object of a bitmap'd span, evicting
+  // the oldest entry of recent_ if needed.
+  void PushRecent(ObjIdx idx);
+
+  ABSL_CONST_INIT static bool bitmap_lifo_;
 
   // Friend class to enable more indepth testing of bitmap code.
   friend class SpanTestPeer;
@@ -348,7 +453,50 @@ inline bool Span::FreelistPush(void* ptr, size_t size, uint32_t reciprocal,
   return ListPush(ptr, size, max_cache_size);
 }
 
-inline bool Span::ListPush(void* ptr, size_t size, uint32_t max_cache_size) {
+inline size_t Span::FreelistPushBatch(absl::Span<void* const> batch,
+                                     size_t size, uint32_t reciprocal,
+                                     uint32_t max_cache_size) {
+  return PushBatch(batch, size, reciprocal, max_cache_size);
+}
+
+template <size_t kSize>
+inline size_t Span::FixedSizePushBatch(absl::Span<void* const> batch,
+                                       uint32_t max_cache_size) {
+  // Bitmap indices divide by the constant size, so need no reciprocal.
+  return PushBatch(batch, FixedSize<kSize>(), 0, max_cache_size);
+}
+
+template <size_t kSize>
+inline size_t Span::FixedSizePopBatch(void** batch, size_t N) {
+  if (UseBitmapForSize(kSize)) {
+    return BitmapPopBatch(batch, N, FixedSize<kSize>());
+  }
+  return ListPopBatch(batch, N, FixedSize<kSize>());
+}
+
+template <typename Size>
+inline size_t Span::PushBatch(absl::Span<void* const> batch, Size size,
+                              uint32_t reciprocal, uint32_t max_cache_size) {
+  const auto allocated = allocated_.load(std::memory_order_relaxed);
+  TC_ASSERT_GE(allocated, batch.size());
+  // If the batch holds every allocated object, the last one is not pushed and
+  // the span is handed back to the caller, as FreelistPush would do.
+  const size_t n = allocated == batch.size() ? batch.size() - 1 : batch.size();
+  allocated_.store(allocated - n, std::memory_order_relaxed);
+  if (ABSL_PREDICT_FALSE(UseBitmapForSize(size))) {
+    for (size_t i = 0; i < n; ++i) {
+      BitmapPush(batch[i], size, reciprocal);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      ListPush(batch[i], size, max_cache_size);
+    }
+  }
+  return n;
+}
+
+template <typename Size>
+inline bool Span::ListPush(void* ptr, Size size, uint32_t max_cache_size) {
   ObjIdx idx = PtrToIdx(ptr, size);
   if (cache_size_ < max_cache_size) {
     // Have empty space in the cache, push there.
@@ -379,16 +527,24 @@ inline Span::ObjIdx Span::OffsetToIdx(uintptr_t offset, uint32_t reciprocal) {
       kBitmapScalingDenominator);
 }
 
-inline Span::ObjIdx Span::BitmapPtrToIdx(void* ptr, size_t size,
+template <typename Size>
+inline Span::ObjIdx Span::BitmapPtrToIdx(void* ptr, Size size,
                                          uint32_t reciprocal) const {
   uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
   uintptr_t off = static_cast<uint32_t>(p - first_page_.start_uintptr());
-  ObjIdx idx = OffsetToIdx(off, reciprocal);
+  ObjIdx idx = OffsetToIdx(off, size, reciprocal);
   TC_ASSERT_EQ(BitmapIdxToPtr(idx, size), ptr);
   return idx;
 }
 
-inline bool Span::BitmapPush(void* ptr, size_t size, uint32_t reciprocal) {
+template <typename Size>
+inline void* Span::BitmapIdxToPtr(ObjIdx idx, Size size) const {
+  uintptr_t off = first_page_.start_uintptr() + idx * size;
+  return reinterpret_cast<ObjIdx*>(off);
+}
+
+template <typename Size>
+inline bool Span::BitmapPush(void* ptr, Size size, uint32_t reciprocal) {
   size_t before = bitmap_.CountBits(0, bitmap_.size());
   // TODO(djgove) Conversions to offsets can be computed outside of lock.
   ObjIdx idx = BitmapPtrToIdx(ptr, size, reciprocal);
@@ -397,9 +553,115 @@ inline bool Span::BitmapPush(void* ptr, size_t size, uint32_t reciprocal) {
   // Set the bit indicating where the object was returned.
   bitmap_.SetBit(idx);
   TC_ASSERT_EQ(before + 1, bitmap_.CountBits(0, bitmap_.size()));
+  if (ABSL_PREDICT_FALSE(bitmap_lifo_)) {
+    PushRecent(idx);
+  }
   return true;
 }
 
+inline void Span::PushRecent(ObjIdx idx) {
+  static_assert(kBitmapSize <= 256, "recent_ cannot hold bitmap indices");
+  if (cache_size_ == sizeof(recent_)) {
+    memmove(&recent_[0], &recent_[1], sizeof(recent_) - 1);
+    --cache_size_;
+  }
+  recent_[cache_size_] = idx;
+  ++cache_size_;
+}
+
+template <typename Size>
+inline size_t Span::BitmapPopBatch(void** __restrict batch, size_t N,
+                                  Size size) {
+  size_t before = bitmap_.CountBits(0, bitmap_.size());
+  size_t count = 0;
+  // Hand out recently freed objects first. The bitmap has the final say on
+  // whether an object is available.
+  while (cache_size_ > 0 && count < N) {
+    --cache_size_;
+    const ObjIdx idx = recent_[cache_size_];
+    if (!bitmap_.GetBit(idx)) {
+      continue;
+    }
+    batch[count] = BitmapIdxToPtr(idx, size);
+    bitmap_.ClearBit(idx);
+    count++;
+  }
+  // Want to fill the batch either with N objects, or the number of objects
+  // remaining in the span.
+  while (!bitmap_.IsZero() && count < N) {
+    size_t offset = bitmap_.FindSet(0);
+    TC_ASSERT_LT(offset, bitmap_.size());
+    batch[count] = BitmapIdxToPtr(offset, size);
+    bitmap_.ClearLowestBit();
+    count++;
+  }
+
+  TC_ASSERT_EQ(bitmap_.CountBits(0, bitmap_.size()) + count, before);
+  allocated_.store(allocated_.load(std::memory_order_relaxed) + count,
+                   std::memory_order_relaxed);
+  return count;
+}
+
+template <typename Size>
+inline size_t Span::ListPopBatch(void** __restrict batch, size_t N,
+                                Size size) {
+  size_t result = 0;
+
+  // Pop from cache.
+  auto csize = cache_size_;
+  // TODO(b/304135905):  Complete experiment and update kCacheSize.
+  ASSUME(csize <= kLargeCacheSize);
+  auto cache_reads = csize < N ? csize : N;
+  const uintptr_t span_start = first_page_.start_uintptr();
+  for (; result < cache_reads; result++) {
+    batch[result] = IdxToPtr(cache_[csize - result - 1], size, span_start);
+  }
+
+  // Store this->cache_size_ one time.
+  cache_size_ = csize - result;
+
+  while (result < N) {
+    if (freelist_ == kListEnd) {
+      break;
+    }
+
+    ObjIdx* const host = IdxToPtr(freelist_, size, span_start);
+    uint16_t embed_count = embed_count_;
+    ObjIdx current = host[embed_count];
+
+    size_t iter = embed_count;
+    if (result + embed_count > N) {
+      iter = N - result;
+    }
+    for (size_t i = 0; i < iter; i++) {
+      // Pop from the first object on freelist.
+      batch[result + i] = IdxToPtr(host[embed_count - i], size, span_start);
+    }
+    embed_count -= iter;
+    result += iter;
+
+    // Update current for next cycle.
+    current = host[embed_count];
+
+    if (result == N) {
+      embed_count_ = embed_count;
+      break;
+    }
+
+    // The first object on the freelist is empty, pop it.
+    TC_ASSERT_EQ(embed_count, 0);
+
+    batch[result] = host;
+    result++;
+
+    freelist_ = current;
+    embed_count_ = size / sizeof(ObjIdx) - 1;
+  }
+  allocated_.store(allocated_.load(std::memory_order_relaxed) + result,
+                   std::memory_order_relaxed);
+  return result;
+}
+
 inline Span::Location Span::location() const {
   return static_cast<Location>(location_);
 }
@@ -415,6 +677,16 @@ inline SampledAllocation* Span::sampled_allocation() const {
 
 inline bool Span::sampled() const { return sampled_; }
 
+inline bool Span::zeroed() const {
+  TC_ASSERT(!sampled_);
+  return zeroed_;
+}
+
+inline void Span::set_zeroed(bool value) {
+  TC_ASSERT(!sampled_);
+  zeroed_ = value;
+}
+
 inline PageId Span::first_page() const { return first_page_; }
 
 inline PageId Span::last_page() const {
@@ -447,14 +719,18 @@ inline bool Span::FreelistEmpty(size_t size) const {
 
 inline void Span::Prefetch() {
   // TODO(b/304135905): Will revisit this.
-  // The first 16 bytes of a Span are the next and previous pointers
-  // for when it is stored in a linked list. Since the sizeof(Span) is
-  // 48 bytes, spans fit into 2 cache lines 50% of the time, with either
-  // the first 16-bytes or the last 16-bytes in a different cache line.
-  // Prefetch the cacheline that contains the most frequestly accessed
-  // data by offseting into the middle of the Span.
+  // The freelist state spans the last 24 bytes of a Span, after the list links
+  // and num_pages_. Since the sizeof(Span) is 48 bytes and spans are only
+  // 8-byte aligned, that range falls into 2 cache lines for one in four
+  // spans, in which case we fetch both. Spans with a large cache are cache line
+  // aligned, so their freelist state always shares one line.
   static_assert(sizeof(Span) <= 64, "Update span prefetch offset");
-  PrefetchT0(&this->allocated_);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(&embed_count_);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(this + 1) - 1;
+  PrefetchT0(reinterpret_cast<void*>(begin));
+  if (ABSL_PREDICT_FALSE((begin ^ end) >= ABSL_CACHELINE_SIZE)) {
+    PrefetchT0(reinterpret_cast<void*>(end));
+  }
 }
 
 inline void Span::Init(PageId p, Length n) {
@@ -470,6 +746,8 @@ inline void Span::Init(PageId p, Length n) {
   sampled_ = 0;
   nonempty_index_ = 0;
   is_donated_ = 0;
+  zeroed_ = false;
+  interleaved_ = false;
 }
 
 inline bool Span::IsValidSizeClass(size_t size, size_t pages) {
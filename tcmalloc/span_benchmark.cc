@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
 #include "benchmark/benchmark.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/allocation_guard.h"
@@ -85,6 +86,33 @@ void BM_single_span(benchmark::State& state) {
   state.SetItemsProcessed(processed);
 }
 
+// BM_single_span_ops is BM_single_span through the operations CentralFreeList
+// uses, which are specialized for the hottest object sizes.
+void BM_single_span_ops(benchmark::State& state) {
+  const int size_class = state.range(0);
+
+  size_t size = tc_globals.sizemap().class_to_size(size_class);
+  uint32_t reciprocal = Span::CalcReciprocal(size);
+  size_t batch_size = tc_globals.sizemap().num_objects_to_move(size_class);
+  const Span::FreelistOps ops = Span::FreelistOpsFor(size);
+  RawSpan raw_span;
+  raw_span.Init(size_class);
+  Span& span = raw_span.span();
+
+  void* batch[kMaxObjectsToMove];
+
+  int64_t processed = 0;
+  while (state.KeepRunningBatch(batch_size)) {
+    size_t n = ops.pop_batch(&span, batch, batch_size, size);
+    processed += n;
+
+    ops.push_batch(&span, {batch, n}, size, reciprocal, kMaxCacheSize);
+  }
+
+  state.SetItemsProcessed(processed);
+  state.SetLabel(absl::StrCat(size, " bytes"));
+}
+
 // BM_single_span_fulldrain alternates between fully draining and filling the
 // span.
 void BM_single_span_fulldrain(benchmark::State& state) {
@@ -141,6 +169,8 @@ BENCHMARK(BM_single_span)
     ->Arg(40)
     ->Arg(80);
 
+BENCHMARK(BM_single_span_ops)->DenseRange(1, 8)->Arg(12)->Arg(16);
+
 BENCHMARK(BM_single_span_fulldrain)
     ->Arg(1)
     ->Arg(2)
@@ -222,6 +252,59 @@ BENCHMARK(BM_multiple_spans)
     ->Arg(40)
     ->Arg(80);
 
+// BM_bitmap_reuse models a program writing to an object, freeing it, and then
+// allocating and writing to another one from the same span, across enough
+// spans to exceed the cache. Half of each span's objects are free. Comparing
+// the two modes of Span::bitmap_lifo() (second argument) shows the cost of
+// handing out a cold object by index rather than the one just freed; run it
+// under perf stat to observe the cache misses directly.
+void BM_bitmap_reuse(benchmark::State& state) {
+  const int size_class = state.range(0);
+
+  size_t size = tc_globals.sizemap().class_to_size(size_class);
+  uint32_t reciprocal = Span::CalcReciprocal(size);
+  TC_CHECK_GT(size, 0);
+  size_t npages = tc_globals.sizemap().class_to_pages(size_class);
+  size_t objects_per_span = npages * kPageSize / size;
+  if (!Span::IsNonIntrusive(size) || objects_per_span < 4) {
+    state.SkipWithError("Size class does not use a bitmap'd span");
+    return;
+  }
+
+  const bool bitmap_lifo = Span::bitmap_lifo();
+  Span::set_bitmap_lifo(state.range(1));
+
+  const int num_spans = 16384;
+  std::vector<RawSpan> spans(num_spans);
+  std::vector<std::vector<void*>> allocated(num_spans);
+  for (int i = 0; i < num_spans; i++) {
+    spans[i].Init(size_class);
+    allocated[i].resize(objects_per_span / 2);
+    TC_CHECK_EQ(spans[i].span().FreelistPopBatch(allocated[i].data(),
+                                                 allocated[i].size(), size),
+                allocated[i].size());
+  }
+  absl::BitGen rng;
+
+  for (auto _ : state) {
+    const int current_span = absl::Uniform(rng, 0, num_spans);
+    Span& span = spans[current_span].span();
+    std::vector<void*>& objects = allocated[current_span];
+    void*& object = objects[absl::Uniform<size_t>(rng, 0, objects.size())];
+
+    *static_cast<volatile char*>(object) = 1;
+    TC_CHECK(span.FreelistPush(object, size, reciprocal, kMaxCacheSize));
+    TC_CHECK_EQ(span.FreelistPopBatch(&object, 1, size), 1);
+    *static_cast<volatile char*>(object) = 2;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  Span::set_bitmap_lifo(bitmap_lifo);
+}
+
+BENCHMARK(BM_bitmap_reuse)
+    ->ArgsProduct({{12, 16, 20, 30, 40, 80}, {false, true}});
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -0,0 +1,144 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/span_recycler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/internal/spinlock.h"
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/allocation_guard.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/span.h"
+#include "tcmalloc/static_vars.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+class Shard {
+ public:
+  constexpr Shard() = default;
+
+  // Moves up to n spans into batch, returning how many were moved.
+  size_t Pop(Span** batch, size_t n) ABSL_LOCKS_EXCLUDED(lock_) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    n = std::min(n, count_);
+    count_ -= n;
+    std::copy(spans_ + count_, spans_ + count_ + n, batch);
+    return n;
+  }
+
+  // Moves up to n spans from batch, returning how many were moved.
+  size_t Push(Span* const* batch, size_t n) ABSL_LOCKS_EXCLUDED(lock_) {
+    AllocationGuardSpinLockHolder h(&lock_);
+    n = std::min(n, SpanRecycler::kCapacity - count_);
+    std::copy(batch, batch + n, spans_ + count_);
+    count_ += n;
+    return n;
+  }
+
+ private:
+  absl::base_internal::SpinLock lock_{
+      absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY};
+  size_t count_ ABSL_GUARDED_BY(lock_) = 0;
+  Span* spans_[SpanRecycler::kCapacity] ABSL_GUARDED_BY(lock_) = {};
+};
+
+ABSL_CONST_INIT Shard shards[SpanRecycler::kShards];
+// Updated after each Push and Pop, so it may be briefly off, even negative.
+ABSL_CONST_INIT std::atomic<int64_t> held(0);
+
+Shard& CurrentShard() {
+  const int cpu = subtle::percpu::GetRealCpuUnsafe();
+  return shards[cpu < 0 ? 0 : cpu % SpanRecycler::kShards];
+}
+
+void Free(Span** batch, size_t n) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+  PageHeapSpinLockHolder l;
+  for (size_t i = 0; i < n; ++i) {
+    Static::span_allocator().Delete(batch[i]);
+  }
+}
+
+}  // namespace
+
+Span* SpanRecycler::New(PageId p, Length len) {
+  Shard& shard = CurrentShard();
+  Span* span;
+  if (ABSL_PREDICT_TRUE(shard.Pop(&span, 1) == 1)) {
+    held.fetch_sub(1, std::memory_order_relaxed);
+  } else {
+    // Allocate a batch at once, keeping the rest for later.
+    Span* batch[kBatch];
+    {
+      const uint32_t max_span_cache_size = Parameters::max_span_cache_size();
+      const size_t size = Span::CalcSizeOf(max_span_cache_size);
+      const std::align_val_t align = Span::CalcAlignOf(max_span_cache_size);
+      PageHeapSpinLockHolder l;
+      for (Span*& s : batch) {
+        s = Static::span_allocator().NewWithSize(size, align);
+      }
+    }
+    span = batch[0];
+    const size_t kept = shard.Push(batch + 1, kBatch - 1);
+    held.fetch_add(kept, std::memory_order_relaxed);
+    if (ABSL_PREDICT_FALSE(kept < kBatch - 1)) {
+      // Others filled the shard meanwhile.
+      Free(batch + 1 + kept, kBatch - 1 - kept);
+    }
+  }
+  span->Init(p, len);
+  return span;
+}
+
+void SpanRecycler::Delete(Span* span) {
+#ifndef NDEBUG
+  // In debug mode, trash the contents of deleted Spans, as Span::Delete does.
+  memset(static_cast<void*>(span), 0x3f,
+         Span::CalcSizeOf(Parameters::max_span_cache_size()));
+#endif
+  Shard& shard = CurrentShard();
+  if (ABSL_PREDICT_TRUE(shard.Push(&span, 1) == 1)) {
+    held.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // The shard is full: free a batch along with the span.
+  Span* batch[kBatch];
+  const size_t n = shard.Pop(batch, kBatch - 1);
+  held.fetch_sub(n, std::memory_order_relaxed);
+  batch[n] = span;
+  Free(batch, n + 1);
+}
+
+size_t SpanRecycler::size() {
+  return std::max<int64_t>(held.load(std::memory_order_relaxed), 0);
+}
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,55 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_SPAN_RECYCLER_H_
+#define TCMALLOC_SPAN_RECYCLER_H_
+
+#include <stddef.h>
+
+#include "absl/base/thread_annotations.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc::tcmalloc_internal {
+
+// SpanRecycler keeps a few free Spans per CPU, for paths that would otherwise
+// take pageheap_lock only to create or destroy a Span.  Each CPU's spans are
+// guarded by a lock of their own, so those paths contend only with others on
+// the same CPU.  Spans come from, and go back to, Static::span_allocator() in
+// batches, taking pageheap_lock once per batch.
+//
+// Paths that hold pageheap_lock anyway should keep using Span::New and
+// Span::Delete, which are cheaper under it.
+class SpanRecycler {
+ public:
+  static constexpr size_t kShards = 16;
+  static constexpr size_t kCapacity = 32;
+  static constexpr size_t kBatch = 8;
+
+  // Like Span::New and Span::Delete, without pageheap_lock.
+  static Span* New(PageId p, Length len) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+  static void Delete(Span* span) ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns the number of free Spans held, which Static::span_allocator()
+  // counts as in use.
+  static size_t size();
+};
+
+}  // namespace tcmalloc::tcmalloc_internal
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_SPAN_RECYCLER_H_
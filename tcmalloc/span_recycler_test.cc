@@ -0,0 +1,63 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/span_recycler.h"
+
+#include <stddef.h>
+
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/pages.h"
+#include "tcmalloc/span.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+TEST(SpanRecyclerTest, NewInitializes) {
+  Span* span = SpanRecycler::New(PageId{123}, Length(2));
+  ASSERT_NE(span, nullptr);
+  EXPECT_EQ(span->first_page(), PageId{123});
+  EXPECT_EQ(span->num_pages(), Length(2));
+  SpanRecycler::Delete(span);
+}
+
+TEST(SpanRecyclerTest, Bounded) {
+  constexpr int kThreads = 4;
+  constexpr int kSpans = 1000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([] {
+      std::vector<Span*> spans;
+      for (int j = 0; j < kSpans; ++j) {
+        spans.push_back(SpanRecycler::New(PageId{j + 1u}, Length(1)));
+      }
+      for (Span* span : spans) {
+        SpanRecycler::Delete(span);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // Freed spans are kept for reuse, up to the capacity of every shard.
+  EXPECT_GT(SpanRecycler::size(), 0);
+  EXPECT_LE(SpanRecycler::size(),
+            SpanRecycler::kShards * SpanRecycler::kCapacity);
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
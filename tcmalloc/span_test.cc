@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <new>
 #include <string>
 #include <tuple>
@@ -170,6 +171,133 @@ TEST_P(SpanTest, FreelistBasic) {
   }
 }
 
+TEST_P(SpanTest, FreelistPushBatch) {
+  Span& span_ = raw_span_.span();
+
+  // Pop every object, then push them back in batches.
+  std::vector<void*> objects(objects_per_span_);
+  size_t popped = 0;
+  while (popped < objects_per_span_) {
+    const size_t want = std::min(batch_size_, objects_per_span_ - popped);
+    const size_t n = span_.FreelistPopBatch(&objects[popped], want, size_);
+    ASSERT_GT(n, 0);
+    popped += n;
+  }
+  EXPECT_TRUE(span_.FreelistEmpty(size_));
+
+  size_t pushed = 0;
+  while (objects_per_span_ - pushed > batch_size_) {
+    EXPECT_EQ(span_.FreelistPushBatch({&objects[pushed], batch_size_}, size_,
+                                      reciprocal_, max_cache_size_),
+              batch_size_);
+    pushed += batch_size_;
+    EXPECT_FALSE(span_.FreelistEmpty(size_));
+    EXPECT_EQ(span_.Allocated(), objects_per_span_ - pushed);
+  }
+
+  // The batch holding the last allocated object leaves that object to the
+  // caller, which returns the span.
+  const size_t remaining = objects_per_span_ - pushed;
+  EXPECT_EQ(span_.FreelistPushBatch({&objects[pushed], remaining}, size_,
+                                    reciprocal_, max_cache_size_),
+            remaining - 1);
+  EXPECT_EQ(span_.Allocated(), 1);
+}
+
+// The operations CentralFreeList uses, specialized for some sizes, keep the
+// span's freelist as FreelistPopBatch and FreelistPushBatch do.
+TEST_P(SpanTest, FreelistOps) {
+  Span& span_ = raw_span_.span();
+  const Span::FreelistOps ops = Span::FreelistOpsFor(size_);
+  char* start = static_cast<char*>(span_.start_address());
+
+  // Pop every object, each exactly once.
+  std::vector<void*> objects(objects_per_span_);
+  std::vector<bool> seen(objects_per_span_);
+  size_t popped = 0;
+  while (popped < objects_per_span_) {
+    const size_t want = std::min(batch_size_, objects_per_span_ - popped);
+    const size_t n = ops.pop_batch(&span_, &objects[popped], want, size_);
+    ASSERT_GT(n, 0);
+    for (size_t i = popped; i < popped + n; ++i) {
+      const uintptr_t off = static_cast<char*>(objects[i]) - start;
+      ASSERT_LT(off, span_.bytes_in_span());
+      ASSERT_EQ(off % size_, 0);
+      EXPECT_FALSE(seen[off / size_]);
+      seen[off / size_] = true;
+    }
+    popped += n;
+  }
+  EXPECT_TRUE(span_.FreelistEmpty(size_));
+  EXPECT_EQ(ops.pop_batch(&span_, objects.data(), 1, size_), 0);
+
+  // Push back all but the last object, which would empty the span.
+  size_t pushed = 0;
+  while (pushed < objects_per_span_ - 1) {
+    const size_t n = std::min(batch_size_, objects_per_span_ - 1 - pushed);
+    EXPECT_EQ(ops.push_batch(&span_, {&objects[pushed], n}, size_,
+                             reciprocal_, max_cache_size_),
+              n);
+    pushed += n;
+  }
+  EXPECT_EQ(span_.Allocated(), 1);
+
+  // The generic pop finds exactly the objects pushed back.
+  std::fill(seen.begin(), seen.end(), false);
+  void* batch[kMaxObjectsToMove];
+  size_t n;
+  popped = 0;
+  while ((n = span_.FreelistPopBatch(batch, batch_size_, size_)) > 0) {
+    for (size_t i = 0; i < n; ++i) {
+      const uintptr_t off = static_cast<char*>(batch[i]) - start;
+      EXPECT_FALSE(seen[off / size_]);
+      seen[off / size_] = true;
+    }
+    popped += n;
+  }
+  EXPECT_EQ(popped, objects_per_span_ - 1);
+  EXPECT_FALSE(seen[(static_cast<char*>(objects.back()) - start) / size_]);
+}
+
+TEST_P(SpanTest, FreelistBitmapLifo) {
+  if (!Span::IsNonIntrusive(size_) || objects_per_span_ < 3) {
+    GTEST_SKIP() << "Skipping test as span does not use a bitmap.";
+  }
+  Span& span_ = raw_span_.span();
+  const bool bitmap_lifo = Span::bitmap_lifo();
+  Span::set_bitmap_lifo(true);
+
+  std::vector<void*> objects(objects_per_span_);
+  ASSERT_EQ(span_.FreelistPopBatch(&objects[0], objects_per_span_, size_),
+            objects_per_span_);
+
+  // Recently freed objects are handed out again first, most recent first,
+  // rather than in order of their index.
+  ASSERT_TRUE(span_.FreelistPush(objects[2], size_, reciprocal_,
+                                 max_cache_size_));
+  ASSERT_TRUE(span_.FreelistPush(objects[1], size_, reciprocal_,
+                                 max_cache_size_));
+  void* batch[2];
+  ASSERT_EQ(span_.FreelistPopBatch(batch, 1, size_), 1);
+  EXPECT_EQ(batch[0], objects[1]);
+
+  // Objects freed while the mode is off are only found by their index, once
+  // the recently freed objects run out.
+  ASSERT_TRUE(span_.FreelistPush(objects[0], size_, reciprocal_,
+                                 max_cache_size_));
+  Span::set_bitmap_lifo(false);
+  ASSERT_TRUE(span_.FreelistPush(objects[1], size_, reciprocal_,
+                                 max_cache_size_));
+  ASSERT_EQ(span_.FreelistPopBatch(batch, 2, size_), 2);
+  EXPECT_EQ(batch[0], objects[0]);
+  EXPECT_EQ(batch[1], objects[2]);
+  ASSERT_EQ(span_.FreelistPopBatch(batch, 1, size_), 1);
+  EXPECT_EQ(batch[0], objects[1]);
+  EXPECT_TRUE(span_.FreelistEmpty(size_));
+
+  Span::set_bitmap_lifo(bitmap_lifo);
+}
+
 TEST_P(SpanTest, FreelistRandomized) {
   Span& span_ = raw_span_.span();
 
@@ -0,0 +1,139 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_STACK_TRACE_STORE_H_
+#define TCMALLOC_STACK_TRACE_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/hash/hash.h"
+#include "absl/types/span.h"
+#include "tcmalloc/arena.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/page_heap_allocator.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// Stores the call stacks of sampled allocations, once per distinct stack.
+//
+// Most samples come from a few hot call sites, so sharing their stacks keeps
+// the frames, which are most of the size of a sample, out of every
+// SampledAllocation.  Stacks are reference counted and freed on their last
+// release.  The frames of a stack are read without the lock, which is fine
+// since they do not change while the reader holds a reference.
+//
+// Thread safe.
+class StackTraceStore {
+ public:
+  constexpr StackTraceStore() = default;
+
+  void Init(Arena* arena) ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    allocator_.Init(arena, ArenaUse::kSampled);
+  }
+
+  // Returns the stored copy of `stack`, with a reference for the caller.
+  const StoredStack* Intern(absl::Span<void* const> stack)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    TC_ASSERT_LE(stack.size(), kMaxStackDepth);
+    const uint64_t hash = absl::HashOf(stack);
+
+    PageHeapSpinLockHolder l;
+    StoredStack*& bucket = buckets_[hash % kNumBuckets];
+    for (StoredStack* s = bucket; s != nullptr; s = s->next) {
+      if (s->hash == hash && s->depth == stack.size() &&
+          std::equal(stack.begin(), stack.end(), s->stack)) {
+        ++s->refs;
+        ++refs_;
+        return s;
+      }
+    }
+
+    StoredStack* s = allocator_.New();
+    s->next = bucket;
+    s->hash = hash;
+    s->refs = 1;
+    s->depth = stack.size();
+    std::copy(stack.begin(), stack.end(), s->stack);
+    bucket = s;
+    ++stacks_;
+    ++refs_;
+    return s;
+  }
+
+  // Takes another reference on `stack`, which the caller holds one on.
+  void Ref(const StoredStack* stack) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    PageHeapSpinLockHolder l;
+    TC_ASSERT_GT(stack->refs, 0);
+    ++const_cast<StoredStack*>(stack)->refs;
+    ++refs_;
+  }
+
+  // Drops a reference on `stack`, freeing it with the last one.
+  void Release(const StoredStack* stack) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
+    PageHeapSpinLockHolder l;
+    StoredStack* s = const_cast<StoredStack*>(stack);
+    TC_ASSERT_GT(s->refs, 0);
+    --refs_;
+    if (--s->refs > 0) {
+      return;
+    }
+
+    StoredStack** link = &buckets_[s->hash % kNumBuckets];
+    while (*link != s) {
+      TC_ASSERT_NE(*link, nullptr);
+      link = &(*link)->next;
+    }
+    *link = s->next;
+    allocator_.Delete(s);
+    --stacks_;
+  }
+
+  struct Stats {
+    // Number of distinct stacks stored.
+    size_t stacks;
+    // Number of references on them, one per sample.
+    size_t refs;
+    // Number of StoredStack objects created, live or free.
+    size_t created;
+  };
+
+  Stats stats() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    return {.stacks = stacks_,
+            .refs = refs_,
+            .created = allocator_.stats().total};
+  }
+
+ private:
+  static constexpr size_t kNumBuckets = 1024;
+
+  PageHeapAllocator<StoredStack> allocator_ ABSL_GUARDED_BY(pageheap_lock);
+  StoredStack* buckets_[kNumBuckets] ABSL_GUARDED_BY(pageheap_lock) = {};
+  size_t stacks_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+  size_t refs_ ABSL_GUARDED_BY(pageheap_lock) = 0;
+};
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_STACK_TRACE_STORE_H_
@@ -0,0 +1,129 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/stack_trace_store.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/types/span.h"
+#include "tcmalloc/arena.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/internal/sampled_allocation.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+class StackTraceStoreTest : public testing::Test {
+ protected:
+  StackTraceStoreTest() {
+    PageHeapSpinLockHolder l;
+    store_.Init(&arena_);
+  }
+
+  StackTraceStore::Stats stats() {
+    PageHeapSpinLockHolder l;
+    return store_.stats();
+  }
+
+  static std::vector<void*> Stack(uintptr_t first, int depth) {
+    std::vector<void*> stack;
+    for (int i = 0; i < depth; ++i) {
+      stack.push_back(reinterpret_cast<void*>(first + i));
+    }
+    return stack;
+  }
+
+  Arena arena_;
+  StackTraceStore store_;
+};
+
+TEST_F(StackTraceStoreTest, SharesEqualStacks) {
+  const std::vector<void*> stack = Stack(0x1000, 5);
+  const StoredStack* a = store_.Intern(stack);
+  const StoredStack* b = store_.Intern(stack);
+  EXPECT_EQ(a, b);
+  ASSERT_EQ(a->depth, stack.size());
+  EXPECT_EQ(absl::MakeConstSpan(a->stack, a->depth),
+            absl::MakeConstSpan(stack));
+  EXPECT_EQ(stats().stacks, 1);
+  EXPECT_EQ(stats().refs, 2);
+
+  store_.Ref(a);
+  EXPECT_EQ(stats().refs, 3);
+  store_.Release(a);
+  store_.Release(a);
+  store_.Release(b);
+  EXPECT_EQ(stats().stacks, 0);
+  EXPECT_EQ(stats().refs, 0);
+}
+
+TEST_F(StackTraceStoreTest, SeparatesDifferentStacks) {
+  const std::vector<void*> stack = Stack(0x1000, 5);
+  const StoredStack* a = store_.Intern(stack);
+  // A prefix of a stack is a stack of its own.
+  const StoredStack* b =
+      store_.Intern(absl::MakeConstSpan(stack).subspan(0, 4));
+  const StoredStack* c = store_.Intern(Stack(0x2000, 5));
+  const StoredStack* d = store_.Intern({});
+  EXPECT_NE(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_NE(b, c);
+  EXPECT_EQ(d->depth, 0);
+  EXPECT_EQ(stats().stacks, 4);
+
+  // Releasing one leaves the others intact.
+  store_.Release(b);
+  EXPECT_EQ(store_.Intern(stack), a);
+  EXPECT_EQ(store_.Intern(Stack(0x2000, 5)), c);
+  EXPECT_EQ(stats().stacks, 3);
+  EXPECT_EQ(stats().refs, 5);
+  for (const StoredStack* s : {a, a, c, c, d}) {
+    store_.Release(s);
+  }
+  EXPECT_EQ(stats().stacks, 0);
+}
+
+TEST_F(StackTraceStoreTest, ManyStacks) {
+  // More stacks than buckets, so that buckets chain.
+  constexpr int kStacks = 5000;
+  std::vector<const StoredStack*> stored;
+  for (int i = 0; i < kStacks; ++i) {
+    stored.push_back(store_.Intern(Stack(0x1000 * (i + 1), 3)));
+  }
+  EXPECT_EQ(stats().stacks, kStacks);
+  for (int i = 0; i < kStacks; ++i) {
+    EXPECT_EQ(store_.Intern(Stack(0x1000 * (i + 1), 3)), stored[i]);
+  }
+
+  // Free them out of order, so that some are unlinked from inside their chain.
+  for (int i = 0; i < kStacks; i += 2) {
+    store_.Release(stored[i]);
+    store_.Release(stored[i]);
+  }
+  for (int i = 1; i < kStacks; i += 2) {
+    EXPECT_EQ(stored[i]->stack[0], reinterpret_cast<void*>(0x1000 * (i + 1)));
+    store_.Release(stored[i]);
+    store_.Release(stored[i]);
+  }
+  EXPECT_EQ(stats().stacks, 0);
+  EXPECT_EQ(stats().refs, 0);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
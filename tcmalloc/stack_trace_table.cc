@@ -39,15 +39,22 @@ StackTraceTable::StackTraceTable(ProfileType type)
 StackTraceTable::~StackTraceTable() {
   LinkedSample* cur = all_;
   while (cur != nullptr) {
-    LinkedSample* next = cur->next;
-    cur->~LinkedSample();
-    {
-      PageHeapSpinLockHolder l;
+    PageHeapSpinLockHolder l;
+    for (int i = 0; i < kBatch && cur != nullptr; ++i) {
+      LinkedSample* next = cur->next;
+      cur->~LinkedSample();
       tc_globals.linked_sample_allocator().Delete(cur);
+      cur = next;
     }
-    cur = next;
   }
   all_ = nullptr;
+
+  if (num_spare_ > 0) {
+    PageHeapSpinLockHolder l;
+    for (int i = 0; i < num_spare_; ++i) {
+      tc_globals.linked_sample_allocator().Delete(spare_[i]);
+    }
+  }
 }
 
 void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t) {
@@ -63,12 +70,14 @@ void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t) {
   // when iterating over `tc_globals.sampled_allocation_recorder()` and
   // allocating, see more details in "HeapProfilingTest.AllocateWhileIterating"
   // under google3/tcmalloc/heap_profiling_test.cc.
-  LinkedSample* s;
-  {
+  if (num_spare_ == 0) {
     PageHeapSpinLockHolder l;
-    s = tc_globals.linked_sample_allocator().New();
+    for (int i = 0; i < kBatch; ++i) {
+      spare_[i] = tc_globals.linked_sample_allocator().New();
+    }
+    num_spare_ = kBatch;
   }
-  s = new (s) LinkedSample;
+  LinkedSample* s = new (spare_[--num_spare_]) LinkedSample;
 
   // Report total bytes that are a multiple of the object size.
   size_t allocated_size = t.allocated_size;
@@ -97,6 +106,7 @@ void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t) {
   s->sample.span_start_address = t.span_start_address;
   s->sample.guarded_status =
       static_cast<Profile::Sample::GuardedStatus>(t.guarded_status);
+  s->sample.label = t.label;
 
   static_assert(kMaxStackDepth <= Profile::Sample::kMaxStackDepth,
                 "Profile stack size smaller than internal stack sizes");
@@ -107,6 +117,13 @@ void StackTraceTable::AddTrace(double sample_weight, const StackTrace& t) {
   all_ = s;
 }
 
+void StackTraceTable::SubtractTrace(double sample_weight,
+                                    const StackTrace& t) {
+  AddTrace(sample_weight, t);
+  all_->sample.count = -all_->sample.count;
+  all_->sample.sum = -all_->sample.sum;
+}
+
 void StackTraceTable::Iterate(
     absl::FunctionRef<void(const Profile::Sample&)> func) const {
   LinkedSample* cur = all_;
@@ -52,6 +52,11 @@ class StackTraceTable final : public ProfileBase {
   void AddTrace(double sample_weight, const StackTrace& t)
       ABSL_LOCKS_EXCLUDED(pageheap_lock);
 
+  // Adds stack trace "t" like AddTrace, but with a negative count and sum, to
+  // report that the sample is gone in a heap profile delta.
+  void SubtractTrace(double sample_weight, const StackTrace& t)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
   // Exposed for PageHeapAllocator
   struct LinkedSample {
     Profile::Sample sample;
@@ -62,10 +67,16 @@ class StackTraceTable final : public ProfileBase {
   int depth_total() const { return depth_total_; }
 
  private:
+  // LinkedSamples are allocated and freed in batches of this many, to take
+  // pageheap_lock once per batch rather than once per sample.
+  static constexpr int kBatch = 32;
+
   ProfileType type_;
   absl::Duration duration_ = absl::ZeroDuration();
   int depth_total_;
   LinkedSample* all_;
+  LinkedSample* spare_[kBatch];
+  int num_spare_ = 0;
 };
 
 }  // namespace tcmalloc_internal
@@ -272,6 +272,21 @@ TEST(StackTraceTableTest, StackTraceTable) {
     CheckTraces(table, {k1, k2});
   }
 
+  // Table w/ t1 added, t2 subtracted
+  {
+    SCOPED_TRACE("t1, -t2");
+
+    AllocationEntry k2_freed = k2;
+    k2_freed.sum = -k2.sum;
+    k2_freed.count = -k2.count;
+
+    StackTraceTable table(ProfileType::kHeap);
+    AddTrace(&table, 1.0, t1);
+    table.SubtractTrace(1.0, t2);
+    EXPECT_EQ(4, table.depth_total());
+    CheckTraces(table, {k1, k2_freed});
+  }
+
   // Table w/ 1.2 x t1, 1 x t2.
   // Note that t1's 1.2 count will be rounded to 1.0.
   {
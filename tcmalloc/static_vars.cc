@@ -23,6 +23,8 @@
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/optimization.h"
 #include "absl/types/span.h"
+#include "tcmalloc/allocation_event_tracer.h"
+#include "tcmalloc/allocation_rate_tracker.h"
 #include "tcmalloc/allocation_sample.h"
 #include "tcmalloc/arena.h"
 #include "tcmalloc/common.h"
@@ -30,6 +32,7 @@
 #include "tcmalloc/deallocation_profiler.h"
 #include "tcmalloc/experiment.h"
 #include "tcmalloc/experiment_config.h"
+#include "tcmalloc/freed_sample_log.h"
 #include "tcmalloc/guarded_page_allocator.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/atomic_stats_counter.h"
@@ -41,16 +44,21 @@
 #include "tcmalloc/internal/numa.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/sysinfo.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/page_heap_allocator.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/peak_heap_tracker.h"
+#include "tcmalloc/release_queue.h"
 #include "tcmalloc/sampled_allocation_allocator.h"
+#include "tcmalloc/size_class_lifetimes.h"
 #include "tcmalloc/size_class_info.h"
+#include "tcmalloc/size_class_tags.h"
 #include "tcmalloc/sizemap.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/stack_trace_store.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/thread_cache.h"
 #include "tcmalloc/transfer_cache.h"
@@ -68,13 +76,14 @@ namespace tcmalloc_internal {
 ABSL_CONST_INIT absl::base_internal::SpinLock pageheap_lock(
     absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
 ABSL_CONST_INIT Arena Static::arena_;
-ABSL_CONST_INIT SizeMap ABSL_CACHELINE_ALIGNED Static::sizemap_;
+// Static::sizemap_ is defined in size_classes.cc.
 TCMALLOC_ATTRIBUTE_NO_DESTROY ABSL_CONST_INIT TransferCacheManager
     Static::transfer_cache_;
 ABSL_CONST_INIT ShardedTransferCacheManager
     Static::sharded_transfer_cache_(nullptr, nullptr);
 ABSL_CONST_INIT CpuCache ABSL_CACHELINE_ALIGNED Static::cpu_cache_;
 ABSL_CONST_INIT SampledAllocationAllocator Static::sampledallocation_allocator_;
+ABSL_CONST_INIT StackTraceStore Static::stack_trace_store_;
 ABSL_CONST_INIT PageHeapAllocator<Span> Static::span_allocator_;
 ABSL_CONST_INIT PageHeapAllocator<ThreadCache> Static::threadcache_allocator_;
 ABSL_CONST_INIT ExplicitlyConstructed<SampledAllocationRecorder>
@@ -82,13 +91,24 @@ ABSL_CONST_INIT ExplicitlyConstructed<SampledAllocationRecorder>
 ABSL_CONST_INIT tcmalloc_internal::StatsCounter Static::sampled_objects_size_;
 ABSL_CONST_INIT tcmalloc_internal::StatsCounter
     Static::sampled_internal_fragmentation_;
+ABSL_CONST_INIT tcmalloc_internal::StatsCounter
+    Static::sampled_label_bytes_[MallocExtension::kNumAllocationLabels];
 ABSL_CONST_INIT tcmalloc_internal::StatsCounter Static::total_sampled_count_;
 ABSL_CONST_INIT AllocationSampleList Static::allocation_samples;
 ABSL_CONST_INIT deallocationz::DeallocationProfilerList
     Static::deallocation_samples;
+ABSL_CONST_INIT FreedSampleLog Static::freed_samples;
 ABSL_CONST_INIT std::atomic<AllocHandle> Static::sampled_alloc_handle_generator{
     0};
 ABSL_CONST_INIT PeakHeapTracker Static::peak_heap_tracker_;
+ABSL_CONST_INIT PeakHeapWindows Static::peak_heap_windows_;
+ABSL_CONST_INIT AllocationRateTracker Static::allocation_rate_tracker_;
+ABSL_CONST_INIT AllocationEventTracer Static::allocation_event_tracer_;
+ABSL_CONST_INIT SizeClassLifetimes Static::size_class_lifetimes_;
+ABSL_CONST_INIT LargeAllocationLifetimes Static::large_allocation_lifetimes_;
+ABSL_CONST_INIT CallsiteLifetimes Static::callsite_lifetimes_;
+ABSL_CONST_INIT ReleaseQueue Static::release_queue_;
+ABSL_CONST_INIT BackgroundScheduler Static::background_scheduler_;
 ABSL_CONST_INIT PageHeapAllocator<StackTraceTable::LinkedSample>
     Static::linked_sample_allocator_;
 ABSL_CONST_INIT std::atomic<bool> Static::inited_{false};
@@ -115,13 +135,20 @@ size_t Static::metadata_bytes() {
       sizeof(pageheap_lock) + sizeof(arena_) + sizeof(sizemap_) +
       sizeof(sharded_transfer_cache_) + sizeof(transfer_cache_) +
       sizeof(cpu_cache_) + sizeof(sampledallocation_allocator_) +
+      sizeof(stack_trace_store_) +
       sizeof(span_allocator_) + +sizeof(threadcache_allocator_) +
       sizeof(sampled_allocation_recorder_) + sizeof(linked_sample_allocator_) +
       sizeof(inited_) + sizeof(cpu_cache_active_) + sizeof(page_allocator_) +
       sizeof(pagemap_) + sizeof(sampled_objects_size_) +
-      sizeof(sampled_internal_fragmentation_) + sizeof(total_sampled_count_) +
+      sizeof(sampled_internal_fragmentation_) + sizeof(sampled_label_bytes_) +
+      sizeof(total_sampled_count_) +
       sizeof(allocation_samples) + sizeof(deallocation_samples) +
-      sizeof(sampled_alloc_handle_generator) + sizeof(peak_heap_tracker_) +
+      sizeof(freed_samples) + sizeof(sampled_alloc_handle_generator) +
+      sizeof(peak_heap_tracker_) + sizeof(peak_heap_windows_) +
+      sizeof(allocation_rate_tracker_) + sizeof(allocation_event_tracer_) +
+      sizeof(size_class_lifetimes_) +
+      sizeof(large_allocation_lifetimes_) + sizeof(callsite_lifetimes_) +
+      sizeof(release_queue_) + sizeof(background_scheduler_) +
       sizeof(guardedpage_allocator_) + sizeof(numa_topology_) +
       sizeof(CacheTopology::Instance());
   // LINT.ThenChange(:static_vars)
@@ -140,7 +167,11 @@ size_t Static::pagemap_residence() {
 int ABSL_ATTRIBUTE_WEAK default_want_legacy_size_classes();
 
 SizeClassConfiguration Static::size_class_configuration() {
-  if (IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_POW2_SIZECLASS)) {
+  if (SizeMap::HaveCustomClasses()) {
+    return SizeClassConfiguration::kCustom;
+  } else if (kPow2SizeClasses ||
+             IsExperimentActive(
+                 Experiment::TEST_ONLY_TCMALLOC_POW2_SIZECLASS)) {
     return SizeClassConfiguration::kPow2Only;
   } else if (default_want_legacy_size_classes != nullptr &&
              default_want_legacy_size_classes() > 0) {
@@ -162,7 +193,11 @@ ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE void Static::SlowInitIfNecessary() {
 
   // double-checked locking
   if (!inited_.load(std::memory_order_acquire)) {
-    TC_CHECK(sizemap_.Init(SizeMap::CurrentClasses().classes));
+    SizeMap::LoadCustomClasses();
+    // sizemap_ already holds the default size classes.
+    if (&SizeMap::CurrentClasses() != &kDefaultSizeClasses) {
+      TC_CHECK(sizemap_.Init(SizeMap::CurrentClasses().classes));
+    }
     // Verify we can determine the number of CPUs now, since we will need it
     // later for per-CPU caches and initializing the cache topology.
     (void)NumCPUs();
@@ -170,19 +205,31 @@ ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE void Static::SlowInitIfNecessary() {
     numa_topology_.Init();
     CacheTopology::Instance().Init();
     sampledallocation_allocator_.Init(&arena_);
+    stack_trace_store_.Init(&arena_);
     sampled_allocation_recorder_.Construct(&sampledallocation_allocator_);
     sampled_allocation_recorder().Init();
     peak_heap_tracker_.Init(&arena_);
+    peak_heap_windows_.Init(&arena_);
 
     const bool large_span_experiment =
         IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_BIG_SPAN);
     Parameters::set_max_span_cache_size(
         large_span_experiment ? Span::kLargeCacheSize : Span::kCacheSize);
-
-    span_allocator_.Init(&arena_);
+    Span::set_bitmap_lifo(
+        IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_SPAN_BITMAP_LIFO));
+    if (IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_LARGE_SPAN_CACHE) &&
+        Parameters::large_span_cache_bytes() == 0) {
+      Parameters::set_large_span_cache_bytes(
+          LargeSpanCache::kExperimentCapacity);
+    }
+    if (IsExperimentActive(Experiment::TEST_ONLY_L3_AWARE)) {
+      Parameters::set_per_cpu_caches_l3_capacity_pools(true);
+    }
+
+    span_allocator_.Init(&arena_, ArenaUse::kSpan);
     span_allocator_.New();  // Reduce cache conflicts
     span_allocator_.New();  // Reduce cache conflicts
-    linked_sample_allocator_.Init(&arena_);
+    linked_sample_allocator_.Init(&arena_, ArenaUse::kSampled);
     // Do a bit of sanitizing: make sure central_cache is aligned properly
     TC_CHECK_EQ((sizeof(transfer_cache_) % ABSL_CACHELINE_SIZE), 0);
     transfer_cache_.Init();
@@ -192,6 +239,10 @@ ABSL_ATTRIBUTE_COLD ABSL_ATTRIBUTE_NOINLINE void Static::SlowInitIfNecessary() {
     new (page_allocator_.memory) PageAllocator;
     threadcache_allocator_.Init(&arena_);
     pagemap_.MapRootWithSmallPages();
+    size_class_tags::Init();
+    if (IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_FLAT_SIZECLASS_MAP)) {
+      pagemap_.InitFlatSizeClassMap();
+    }
     guardedpage_allocator_.Init(/*max_alloced_pages=*/64, /*total_pages=*/128);
     inited_.store(true, std::memory_order_release);
   }
@@ -22,15 +22,20 @@
 #include <string.h>
 
 #include <atomic>
+#include <optional>
 
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "tcmalloc/allocation_event_tracer.h"
+#include "tcmalloc/allocation_rate_tracker.h"
 #include "tcmalloc/allocation_sample.h"
 #include "tcmalloc/arena.h"
+#include "tcmalloc/background_scheduler.h"
 #include "tcmalloc/central_freelist.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/deallocation_profiler.h"
+#include "tcmalloc/freed_sample_log.h"
 #include "tcmalloc/guarded_page_allocator.h"
 #include "tcmalloc/internal/atomic_stats_counter.h"
 #include "tcmalloc/internal/config.h"
@@ -39,14 +44,18 @@
 #include "tcmalloc/internal/numa.h"
 #include "tcmalloc/internal/sampled_allocation.h"
 #include "tcmalloc/internal/sampled_allocation_recorder.h"
+#include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/page_heap_allocator.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/peak_heap_tracker.h"
+#include "tcmalloc/release_queue.h"
 #include "tcmalloc/sampled_allocation_allocator.h"
+#include "tcmalloc/size_class_lifetimes.h"
 #include "tcmalloc/sizemap.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/stack_trace_store.h"
 #include "tcmalloc/stack_trace_table.h"
 #include "tcmalloc/stats.h"
 #include "tcmalloc/transfer_cache.h"
@@ -69,6 +78,8 @@ enum class SizeClassConfiguration {
   kLowFrag = 3,
   kLegacy = 4,
   kFewer = 5,
+  // Loaded at startup; see SizeMap::LoadCustomClasses.
+  kCustom = 6,
 };
 
 class Static final {
@@ -100,6 +111,32 @@ class Static final {
 
   static PeakHeapTracker& peak_heap_tracker() { return peak_heap_tracker_; }
 
+  static PeakHeapWindows& peak_heap_windows() { return peak_heap_windows_; }
+
+  static AllocationRateTracker& allocation_rate_tracker() {
+    return allocation_rate_tracker_;
+  }
+
+  static AllocationEventTracer& allocation_event_tracer() {
+    return allocation_event_tracer_;
+  }
+
+  static SizeClassLifetimes& size_class_lifetimes() {
+    return size_class_lifetimes_;
+  }
+
+  static LargeAllocationLifetimes& large_allocation_lifetimes() {
+    return large_allocation_lifetimes_;
+  }
+
+  static CallsiteLifetimes& callsite_lifetimes() { return callsite_lifetimes_; }
+
+  static ReleaseQueue& release_queue() { return release_queue_; }
+
+  static BackgroundScheduler& background_scheduler() {
+    return background_scheduler_;
+  }
+
   static NumaTopology<kNumaPartitions, kNumBaseClasses>& numa_topology() {
     return numa_topology_;
   }
@@ -125,6 +162,8 @@ class Static final {
     return sampledallocation_allocator_;
   }
 
+  static StackTraceStore& stack_trace_store() { return stack_trace_store_; }
+
   static PageHeapAllocator<Span>& span_allocator() { return span_allocator_; }
 
   static PageHeapAllocator<ThreadCache>& threadcache_allocator() {
@@ -142,6 +181,9 @@ class Static final {
   // allocation sizes being rounded up to size class/page boundaries.
   ABSL_CONST_INIT static tcmalloc_internal::StatsCounter
       sampled_internal_fragmentation_;
+  // sampled_label_bytes_ estimates the live bytes of each allocation label.
+  ABSL_CONST_INIT static tcmalloc_internal::StatsCounter
+      sampled_label_bytes_[MallocExtension::kNumAllocationLabels];
   // total_sampled_count_ tracks the total number of allocations that are
   // sampled.
   ABSL_CONST_INIT static tcmalloc_internal::StatsCounter total_sampled_count_;
@@ -151,6 +193,8 @@ class Static final {
   ABSL_CONST_INIT static deallocationz::DeallocationProfilerList
       deallocation_samples;
 
+  ABSL_CONST_INIT static FreedSampleLog freed_samples;
+
   // MallocHook::AllocHandle is a simple 64-bit int, and is not dependent on
   // other data.
   ABSL_CONST_INIT static std::atomic<AllocHandle>
@@ -200,6 +244,7 @@ class Static final {
   static CpuCache cpu_cache_;
   ABSL_CONST_INIT static GuardedPageAllocator guardedpage_allocator_;
   static SampledAllocationAllocator sampledallocation_allocator_;
+  static StackTraceStore stack_trace_store_;
   static PageHeapAllocator<Span> span_allocator_;
   static PageHeapAllocator<ThreadCache> threadcache_allocator_;
   static PageHeapAllocator<StackTraceTable::LinkedSample>
@@ -207,6 +252,14 @@ class Static final {
   ABSL_CONST_INIT static std::atomic<bool> inited_;
   ABSL_CONST_INIT static std::atomic<bool> cpu_cache_active_;
   ABSL_CONST_INIT static PeakHeapTracker peak_heap_tracker_;
+  ABSL_CONST_INIT static PeakHeapWindows peak_heap_windows_;
+  ABSL_CONST_INIT static AllocationRateTracker allocation_rate_tracker_;
+  ABSL_CONST_INIT static AllocationEventTracer allocation_event_tracer_;
+  ABSL_CONST_INIT static SizeClassLifetimes size_class_lifetimes_;
+  ABSL_CONST_INIT static LargeAllocationLifetimes large_allocation_lifetimes_;
+  ABSL_CONST_INIT static CallsiteLifetimes callsite_lifetimes_;
+  ABSL_CONST_INIT static ReleaseQueue release_queue_;
+  ABSL_CONST_INIT static BackgroundScheduler background_scheduler_;
   ABSL_CONST_INIT static NumaTopology<kNumaPartitions, kNumBaseClasses>
       numa_topology_;
 
@@ -274,6 +327,11 @@ inline void Span::Delete(Span* span) {
 // constant rate.
 class ConstantRatePageAllocatorReleaser {
  public:
+  ConstantRatePageAllocatorReleaser() = default;
+  // Only releases from the heap of NUMA `partition`.
+  explicit ConstantRatePageAllocatorReleaser(size_t partition)
+      : partition_(partition) {}
+
   size_t Release(size_t num_bytes, PageReleaseReason reason) {
     const PageHeapSpinLockHolder l;
 
@@ -299,9 +357,13 @@ class ConstantRatePageAllocatorReleaser {
       }
     }();
 
-    const size_t bytes_released = tc_globals.page_allocator()
-                                      .ReleaseAtLeastNPages(num_pages, reason)
-                                      .in_bytes();
+    PageAllocator& page_allocator = tc_globals.page_allocator();
+    const size_t bytes_released =
+        (partition_.has_value()
+             ? page_allocator.ReleasePartitionAtLeastNPages(*partition_,
+                                                            num_pages, reason)
+             : page_allocator.ReleaseAtLeastNPages(num_pages, reason))
+            .in_bytes();
     if (bytes_released > num_bytes) {
       extra_bytes_released_ = bytes_released - num_bytes;
 
@@ -316,6 +378,7 @@ class ConstantRatePageAllocatorReleaser {
   }
 
  private:
+  std::optional<size_t> partition_;
   size_t extra_bytes_released_ = 0;
 };
 
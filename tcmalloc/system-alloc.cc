@@ -39,19 +39,23 @@
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/numeric/bits.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_format.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/environment.h"
 #include "tcmalloc/internal/exponential_biased.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/numa.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/page_size.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/selsan/selsan.h"
 #include "tcmalloc/static_vars.h"
 
 // On systems (like freebsd) that don't define MAP_ANONYMOUS, use the old
@@ -64,10 +68,38 @@
 #define MADV_FREE 8
 #endif
 
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+#ifndef MADV_DONTDUMP
+#define MADV_DONTDUMP 16
+#endif
+
+#ifndef MADV_DODUMP
+#define MADV_DODUMP 17
+#endif
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << 26)
+#endif
+
 #ifndef MAP_FIXED_NOREPLACE
 #define MAP_FIXED_NOREPLACE 0x100000
 #endif
 
+#ifndef MREMAP_DONTUNMAP
+#define MREMAP_DONTUNMAP 4
+#endif
+
 // The <sys/prctl.h> on some systems may not define these macros yet even though
 // the kernel may have support for the new PR_SET_VMA syscall, so we explicitly
 // define them here.
@@ -178,6 +210,7 @@ class RegionManager {
     sampled_region_ = nullptr;
     selsan_region_ = nullptr;
     cold_region_ = nullptr;
+    warm_region_ = nullptr;
     metadata_region_ = nullptr;
   }
 
@@ -193,6 +226,7 @@ class RegionManager {
   AddressRegion* sampled_region_{nullptr};
   AddressRegion* selsan_region_{nullptr};
   AddressRegion* cold_region_{nullptr};
+  AddressRegion* warm_region_{nullptr};
   AddressRegion* metadata_region_{nullptr};
 };
 ABSL_CONST_INIT
@@ -220,7 +254,12 @@ std::pair<void*, size_t> MmapRegion::Alloc(size_t request_size,
 
   TC_ASSERT_EQ(result % GetPageSize(), 0);
   void* result_ptr = reinterpret_cast<void*>(result);
-  if (mprotect(result_ptr, actual_size, PROT_READ | PROT_WRITE) != 0) {
+  int prot = PROT_READ | PROT_WRITE;
+  // Under MTE, SelSan objects are tagged in the memory itself.
+  if (GetMemoryTag(result_ptr) == MemoryTag::kSelSan) {
+    prot |= selsan::ExtraProtection();
+  }
+  if (mprotect(result_ptr, actual_size, prot) != 0) {
     TC_LOG("mprotect(%p, %v) failed (%s)", result_ptr, actual_size,
            strerror(errno));
     return {nullptr, 0};
@@ -233,6 +272,16 @@ std::pair<void*, size_t> MmapRegion::Alloc(size_t request_size,
     // This is only advisory, so ignore the error.
     ErrnoRestorer errno_restorer;
     (void)madvise(result_ptr, actual_size, MADV_NOHUGEPAGE);
+  } else if (hint_ == AddressRegionFactory::UsageHint::kIoBuffers ||
+             GetThpMode() == ThpMode::kMadvise) {
+    // I/O buffers are pinned as they are, so back them with hugepages from the
+    // start.  On hosts where THP is only used for advised memory, the rest of
+    // the heap, which is laid out in hugepages, must be advised too.  Under
+    // "always", we leave the advice out, since with the common "madvise"
+    // defrag setting it makes faults stall on compaction.  This is only
+    // advisory, too.
+    ErrnoRestorer errno_restorer;
+    (void)madvise(result_ptr, actual_size, MADV_HUGEPAGE);
   }
   free_size_ -= actual_size;
   return {result_ptr, actual_size};
@@ -268,14 +317,15 @@ size_t MmapRegionFactory::GetStatsInPbtxt(absl::Span<char> buffer) {
 static AddressRegionFactory::UsageHint TagToHint(MemoryTag tag) {
   using UsageHint = AddressRegionFactory::UsageHint;
   switch (tag) {
-    case MemoryTag::kNormal:
-      if (tc_globals.numa_topology().numa_aware()) {
-        return UsageHint::kNormalNumaAwareS0;
-      }
-      return UsageHint::kNormal;
+    case MemoryTag::kNormalP0:
     case MemoryTag::kNormalP1:
+    case MemoryTag::kNormalP2:
+    case MemoryTag::kNormalP3:
       if (tc_globals.numa_topology().numa_aware()) {
-        return UsageHint::kNormalNumaAwareS1;
+        constexpr UsageHint kNumaHints[kMaxNumaPartitions] = {
+            UsageHint::kNormalNumaAwareS0, UsageHint::kNormalNumaAwareS1,
+            UsageHint::kNormalNumaAwareS2, UsageHint::kNormalNumaAwareS3};
+        return kNumaHints[NumaPartitionFromTag(tag)];
       }
       return UsageHint::kNormal;
     case MemoryTag::kSelSan:
@@ -284,6 +334,8 @@ static AddressRegionFactory::UsageHint TagToHint(MemoryTag tag) {
       return UsageHint::kInfrequentAllocation;
     case MemoryTag::kCold:
       return UsageHint::kInfrequentAccess;
+    case MemoryTag::kWarm:
+      return UsageHint::kNormal;
     case MemoryTag::kMetadata:
       return UsageHint::kInfrequentAllocation;
   }
@@ -304,7 +356,8 @@ std::pair<void*, size_t> RegionManager::Alloc(size_t request_size,
   // If we are dealing with large sizes, or large alignments we do not
   // want to throw away the existing reserved region, so instead we
   // return a new region specifically targeted for the request.
-  if (request_size > kMinMmapAlloc || alignment > kMinMmapAlloc) {
+  const size_t region_size = SystemAllocRegionSize();
+  if (request_size > region_size || alignment > region_size) {
     // Align on kMinSystemAlloc boundaries to reduce external fragmentation for
     // future allocations.
     size_t size = RoundUp(request_size, kMinSystemAlloc);
@@ -335,16 +388,20 @@ std::pair<void*, size_t> RegionManager::Allocate(size_t size, size_t alignment,
                                                  const MemoryTag tag) {
   AddressRegion*& region = *[&]() {
     switch (tag) {
-      case MemoryTag::kNormal:
-        return &normal_region_[0];
+      case MemoryTag::kNormalP0:
       case MemoryTag::kNormalP1:
-        return &normal_region_[1];
+      case MemoryTag::kNormalP2:
+      case MemoryTag::kNormalP3:
+        TC_ASSERT_LT(NumaPartitionFromTag(tag), kNumaPartitions);
+        return &normal_region_[NumaPartitionFromTag(tag)];
       case MemoryTag::kSampled:
         return &sampled_region_;
       case MemoryTag::kSelSan:
         return &selsan_region_;
       case MemoryTag::kCold:
         return &cold_region_;
+      case MemoryTag::kWarm:
+        return &warm_region_;
       case MemoryTag::kMetadata:
         return &metadata_region_;
     }
@@ -361,13 +418,19 @@ std::pair<void*, size_t> RegionManager::Allocate(size_t size, size_t alignment,
 
   // Allocation failed so we need to reserve more memory.
   // Reserve new region and try allocation again.
-  void* ptr = MmapAligned(kMinMmapAlloc, kMinMmapAlloc, tag);
+  size_t region_size = SystemAllocRegionSize();
+  void* ptr = MmapAligned(region_size, kMinMmapAlloc, tag);
+  if (!ptr && region_size > kMinMmapAlloc) {
+    // A large reservation may run into RLIMIT_AS; fall back to the default.
+    region_size = kMinMmapAlloc;
+    ptr = MmapAligned(region_size, kMinMmapAlloc, tag);
+  }
   if (!ptr) return {nullptr, 0};
 
   const auto region_type = TagToHint(tag);
-  region = region_factory->Create(ptr, kMinMmapAlloc, region_type);
+  region = region_factory->Create(ptr, region_size, region_type);
   if (!region) {
-    munmap(ptr, kMinMmapAlloc);
+    munmap(ptr, region_size);
     return {nullptr, 0};
   }
   return region->Alloc(size, alignment);
@@ -384,20 +447,10 @@ void InitSystemAllocatorIfNecessary() ABSL_EXCLUSIVE_LOCKS_REQUIRED(spinlock) {
   region_factory = new (&mmap_space) MmapRegionFactory();
 }
 
-// Bind the memory region spanning `size` bytes starting from `base` to NUMA
-// nodes assigned to `partition`. Returns zero upon success, or a standard
-// error code upon failure.
-void BindMemory(void* const base, const size_t size, const size_t partition) {
-  auto& topology = tc_globals.numa_topology();
-
-  // If NUMA awareness is unavailable or disabled, or the user requested that
-  // we don't bind memory then do nothing.
-  const NumaBindMode bind_mode = topology.bind_mode();
-  if (!topology.numa_aware() || bind_mode == NumaBindMode::kNone) {
-    return;
-  }
-
-  const uint64_t nodemask = topology.GetPartitionNodes(partition);
+// Bind the memory region spanning `size` bytes starting from `base` to the
+// NUMA nodes in `nodemask`, failing as `bind_mode` asks.
+void BindMemoryToNodes(void* const base, const size_t size,
+                       const uint64_t nodemask, const NumaBindMode bind_mode) {
   int err =
       syscall(__NR_mbind, base, size, MPOL_BIND | MPOL_F_STATIC_NODES,
               &nodemask, sizeof(nodemask) * 8, MPOL_MF_STRICT | MPOL_MF_MOVE);
@@ -416,7 +469,56 @@ void BindMemory(void* const base, const size_t size, const size_t partition) {
          nodemask);
 }
 
+// Bind the memory region spanning `size` bytes starting from `base` to NUMA
+// nodes assigned to `partition`.
+void BindMemory(void* const base, const size_t size, const size_t partition) {
+  auto& topology = tc_globals.numa_topology();
+
+  // If NUMA awareness is unavailable or disabled, or the user requested that
+  // we don't bind memory then do nothing.
+  const NumaBindMode bind_mode = topology.bind_mode();
+  if (!topology.numa_aware() || bind_mode == NumaBindMode::kNone) {
+    return;
+  }
+
+  BindMemoryToNodes(base, size, topology.GetPartitionNodes(partition),
+                    bind_mode);
+}
+
+// Bind the memory region spanning `size` bytes starting from `base` to the
+// warm tier's node.  The tier was asked for explicitly, so we warn rather
+// than fail if the node can't be bound to.
+void BindWarmMemory(void* const base, const size_t size) {
+  const int node = WarmTierNumaNode();
+  if (node < 0) {
+    return;
+  }
+  BindMemoryToNodes(base, size, uint64_t{1} << node, NumaBindMode::kAdvisory);
+}
+
+// Returns the nodes this process may allocate memory from, or 0 if they can't
+// be determined.
+uint64_t AllowedNodes() {
+  // Some node is always allowed, so 0 marks the mask as not yet queried.
+  ABSL_CONST_INIT static std::atomic<uint64_t> allowed_nodes{0};
+  uint64_t nodemask = allowed_nodes.load(std::memory_order_relaxed);
+  if (nodemask != 0) {
+    return nodemask;
+  }
+  ErrnoRestorer errno_restorer;
+  // Systems with more than 64 possible nodes reject the query with EINVAL;
+  // memory isn't interleaved there.
+  if (syscall(__NR_get_mempolicy, nullptr, &nodemask, sizeof(nodemask) * 8,
+              nullptr, MPOL_F_MEMS_ALLOWED) != 0) {
+    return 0;
+  }
+  allowed_nodes.store(nodemask, std::memory_order_relaxed);
+  return nodemask;
+}
+
 ABSL_CONST_INIT std::atomic<int> system_release_errors(0);
+ABSL_CONST_INIT std::atomic<uint64_t> system_release_lazy_bytes(0);
+ABSL_CONST_INIT std::atomic<uint64_t> system_release_eager_bytes(0);
 
 int MapFixedNoReplaceFlagAvailable() {
   ABSL_CONST_INIT static int noreplace_flag;
@@ -461,6 +563,53 @@ int MapFixedNoReplaceFlagAvailable() {
 
 }  // namespace
 
+int WarmTierNumaNode() {
+  ABSL_CONST_INIT static int node = -1;
+  ABSL_CONST_INIT static absl::once_flag flag;
+
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    if (!kWarmTierPresent) {
+      return;
+    }
+    const char* e = thread_safe_getenv("TCMALLOC_WARM_TIER_NUMA_NODE");
+    if (e == nullptr || *e == '\0') {
+      return;
+    }
+    int value;
+    // Nodemasks passed to mbind are 64 bits wide.
+    if (!absl::SimpleAtoi(e, &value) || value < 0 || value >= 64) {
+      TC_BUG("bad env var TCMALLOC_WARM_TIER_NUMA_NODE='%s'", e);
+    }
+    node = value;
+  });
+
+  return node;
+}
+
+size_t SystemAllocRegionSize() {
+  ABSL_CONST_INIT static size_t region_size = kMinMmapAlloc;
+  ABSL_CONST_INIT static absl::once_flag flag;
+
+  absl::base_internal::LowLevelCallOnce(&flag, [&]() {
+    const char* e = thread_safe_getenv("TCMALLOC_RESERVE_ADDRESS_SPACE");
+    if (e == nullptr || *e == '\0') {
+      return;
+    }
+    uint64_t value;
+    if (!absl::SimpleAtoi(e, &value)) {
+      TC_BUG("bad env var TCMALLOC_RESERVE_ADDRESS_SPACE='%s'", e);
+    }
+    // Leave room in the tag's address range to place the reservation at a
+    // random address, and for allocations too large for it.
+    constexpr uint64_t kMaxRegionSize = (uint64_t{kTagMask} + 1) / 4;
+    value = std::min(value, kMaxRegionSize);
+    region_size = std::max<size_t>(RoundUp(value, kMinMmapAlloc),
+                                  kMinMmapAlloc);
+  });
+
+  return region_size;
+}
+
 AddressRange SystemAlloc(size_t bytes, size_t alignment, const MemoryTag tag) {
   // If default alignment is set request the minimum alignment provided by
   // the system.
@@ -483,8 +632,48 @@ AddressRange SystemAlloc(size_t bytes, size_t alignment, const MemoryTag tag) {
   return {result, actual_bytes};
 }
 
-static bool ReleasePages(void* start, size_t length) {
+AddressRange SystemAllocIoBuffers(size_t bytes) {
+  const size_t size = RoundUp(bytes, kHugePageSize);
+  if (size < bytes || size + kHugePageSize < size) return {nullptr, 0};
+
+  // Reserve a hugepage more than needed, so that the region can be aligned,
+  // and let the kernel place it: it belongs to no MemoryTag.
+  void* reserved = mmap(nullptr, size + kHugePageSize, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED) return {nullptr, 0};
+  const uintptr_t reserved_start = reinterpret_cast<uintptr_t>(reserved);
+  const uintptr_t start = RoundUp(reserved_start, kHugePageSize);
+  if (start > reserved_start) {
+    munmap(reserved, start - reserved_start);
+  }
+  if (const size_t tail = reserved_start + kHugePageSize - start; tail > 0) {
+    munmap(reinterpret_cast<void*>(start + size), tail);
+  }
+  void* ptr = reinterpret_cast<void*>(start);
+  MappedAddressBounds::Add(ptr, size);
+
+  AddressRegion* region;
+  {
+    AllocationGuardSpinLockHolder lock_holder(&spinlock);
+    InitSystemAllocatorIfNecessary();
+    region = region_factory->Create(
+        ptr, size, AddressRegionFactory::UsageHint::kIoBuffers);
+  }
+  if (region == nullptr) {
+    munmap(ptr, size);
+    return {nullptr, 0};
+  }
+  auto [result, actual_bytes] = region->Alloc(size, kHugePageSize);
+  if (result == nullptr) return {nullptr, 0};
+  TC_ASSERT_EQ(result, ptr);
+  return {result, actual_bytes};
+}
+
+// Sets *lazy if the pages were only marked with MADV_FREE, and so may still be
+// resident.
+static bool ReleasePages(void* start, size_t length, bool* lazy) {
   ErrnoRestorer errno_restorer;
+  *lazy = false;
 
   int ret;
   // Note -- ignoring most return codes, because if this fails it
@@ -521,6 +710,7 @@ static bool ReleasePages(void* start, size_t length) {
     do {
       ret = madvise(start, length, MADV_FREE);
     } while (ret == -1 && errno == EAGAIN);
+    *lazy = ret == 0;
   }
 #endif
 #ifdef MADV_DONTNEED
@@ -542,6 +732,7 @@ static bool ReleasePages(void* start, size_t length) {
     do {
       ret = madvise(start, length, MADV_DONTNEED);
     } while (ret == -1 && errno == EAGAIN);
+    *lazy = false;
   }
 #endif
   if (ret == 0) {
@@ -555,6 +746,11 @@ int SystemReleaseErrors() {
   return system_release_errors.load(std::memory_order_relaxed);
 }
 
+SystemReleaseBytes GetSystemReleaseBytes() {
+  return {.lazy = system_release_lazy_bytes.load(std::memory_order_relaxed),
+          .eager = system_release_eager_bytes.load(std::memory_order_relaxed)};
+}
+
 bool SystemRelease(void* start, size_t length) {
   bool result = false;
 
@@ -580,14 +776,15 @@ bool SystemRelease(void* start, size_t length) {
     void* new_ptr = reinterpret_cast<void*>(new_start);
     size_t new_length = new_end - new_start;
 
-    if (!ReleasePages(new_ptr, new_length)) {
+    bool lazy;
+    if (!ReleasePages(new_ptr, new_length, &lazy)) {
       // Try unlocking.
       int ret;
       do {
         ret = munlock(reinterpret_cast<char*>(new_start), new_end - new_start);
       } while (ret == -1 && errno == EAGAIN);
 
-      if (ret != 0 || !ReleasePages(new_ptr, new_length)) {
+      if (ret != 0 || !ReleasePages(new_ptr, new_length, &lazy)) {
         // If we fail to munlock *or* fail our second attempt at madvise,
         // increment our failure count.
         system_release_errors.fetch_add(1, std::memory_order_relaxed);
@@ -597,12 +794,219 @@ bool SystemRelease(void* start, size_t length) {
     } else {
       result = true;
     }
+
+    if (result) {
+      (lazy ? system_release_lazy_bytes : system_release_eager_bytes)
+          .fetch_add(new_length, std::memory_order_relaxed);
+    }
   }
 #endif
 
   return result;
 }
 
+bool SystemCollapse(void* start, size_t length) {
+#ifdef __linux__
+  ErrnoRestorer errno_restorer;
+  // EAGAIN reports transient resource shortage; we leave retrying to the next
+  // background pass rather than spinning here.
+  return madvise(start, length, MADV_COLLAPSE) == 0;
+#else
+  return false;
+#endif
+}
+
+bool SystemExcludeFromCoreDump(void* start, size_t length) {
+#ifdef __linux__
+  ErrnoRestorer errno_restorer;
+  return madvise(start, length, MADV_DONTDUMP) == 0;
+#else
+  return false;
+#endif
+}
+
+bool SystemIncludeInCoreDump(void* start, size_t length) {
+#ifdef __linux__
+  ErrnoRestorer errno_restorer;
+  return madvise(start, length, MADV_DODUMP) == 0;
+#else
+  return false;
+#endif
+}
+
+bool SystemPopulate(void* start, size_t length) {
+#ifdef __linux__
+  // Kernels that don't know MADV_POPULATE_WRITE reject it with EINVAL; stop
+  // asking once they have.
+  ABSL_CONST_INIT static std::atomic<bool> unsupported{false};
+  if (unsupported.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  ErrnoRestorer errno_restorer;
+  int ret;
+  do {
+    ret = madvise(start, length, MADV_POPULATE_WRITE);
+  } while (ret == -1 && errno == EINTR);
+  if (ret == -1 && errno == EINVAL) {
+    unsupported.store(true, std::memory_order_relaxed);
+  }
+  return ret == 0;
+#else
+  return false;
+#endif
+}
+
+bool SystemInterleave(void* start, size_t length) {
+#ifdef __linux__
+  const uint64_t nodemask = AllowedNodes();
+  if (absl::popcount(nodemask) < 2) {
+    return false;
+  }
+  ErrnoRestorer errno_restorer;
+  return syscall(__NR_mbind, start, length, MPOL_INTERLEAVE, &nodemask,
+                 sizeof(nodemask) * 8, MPOL_MF_MOVE) == 0;
+#else
+  return false;
+#endif
+}
+
+#ifdef __linux__
+namespace {
+
+// Restores the policy that SystemAlloc gave [start, start + length): the NUMA
+// partition of <tag> if tcmalloc is NUMA aware, the warm tier's node for warm
+// memory, and the default policy otherwise.  Pages that are already backed
+// are moved only by the bindings.
+void RestoreMemoryPolicy(void* start, size_t length, MemoryTag tag) {
+  const size_t partition = NumaPartitionFromTag(tag);
+  if (tc_globals.numa_topology().numa_aware() && partition < kNumaPartitions) {
+    BindMemory(start, length, partition);
+    return;
+  }
+  if (tag == MemoryTag::kWarm) {
+    BindWarmMemory(start, length);
+    return;
+  }
+  // Pages that are already backed stay where they are, new ones are placed
+  // by the default, local policy again.
+  ErrnoRestorer errno_restorer;
+  syscall(__NR_mbind, start, length, MPOL_DEFAULT, nullptr, 0, 0);
+}
+
+// Moves the pages backing [start, start + length) to the nodes in nodemask,
+// then restores the range's policy for pages faulted in later.  Returns false
+// if the pages could not be moved.
+bool MovePagesToNodes(void* start, size_t length, uint64_t nodemask,
+                      MemoryTag tag) {
+  if (nodemask == 0) {
+    return false;
+  }
+  ErrnoRestorer errno_restorer;
+  const bool moved = syscall(__NR_mbind, start, length, MPOL_BIND, &nodemask,
+                             sizeof(nodemask) * 8, MPOL_MF_MOVE) == 0;
+  RestoreMemoryPolicy(start, length, tag);
+  return moved;
+}
+
+}  // namespace
+#endif
+
+void SystemUninterleave(void* start, size_t length, MemoryTag tag) {
+#ifdef __linux__
+  RestoreMemoryPolicy(start, length, tag);
+#endif
+}
+
+bool SystemDemote(void* start, size_t length, MemoryTag tag) {
+#ifdef __linux__
+  const int node = WarmTierNumaNode();
+  if (node < 0) {
+    return false;
+  }
+  return MovePagesToNodes(start, length, uint64_t{1} << node, tag);
+#else
+  return false;
+#endif
+}
+
+bool SystemPromote(void* start, size_t length, MemoryTag tag) {
+#ifdef __linux__
+  const int node = WarmTierNumaNode();
+  if (node < 0) {
+    return false;
+  }
+  const size_t partition = NumaPartitionFromTag(tag);
+  if (tc_globals.numa_topology().numa_aware() && partition < kNumaPartitions) {
+    return MovePagesToNodes(
+        start, length,
+        tc_globals.numa_topology().GetPartitionNodes(partition), tag);
+  }
+  const uint64_t near_nodes = AllowedNodes() & ~(uint64_t{1} << node);
+  return MovePagesToNodes(start, length, near_nodes, tag);
+#else
+  return false;
+#endif
+}
+
+bool SystemRemap(void* from, void* to, size_t length) {
+#ifdef __linux__
+  TC_ASSERT_EQ(GetMemoryTag(from), GetMemoryTag(to));
+  {
+    // Regions from other factories need not be private anonymous memory.
+    AllocationGuardSpinLockHolder lock_holder(&spinlock);
+    if (region_factory !=
+        reinterpret_cast<AddressRegionFactory*>(&mmap_space)) {
+      return false;
+    }
+  }
+  // Kernels that don't know MREMAP_DONTUNMAP reject it with EINVAL; stop
+  // asking once they have.
+  ABSL_CONST_INIT static std::atomic<bool> unsupported{false};
+  if (unsupported.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  ErrnoRestorer errno_restorer;
+  void* result = mremap(from, length, length,
+                        MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP, to);
+  if (result == MAP_FAILED && errno == EINVAL) {
+    unsupported.store(true, std::memory_order_relaxed);
+  }
+  TC_ASSERT(result == MAP_FAILED || result == to);
+  return result == to;
+#else
+  return false;
+#endif
+}
+
+bool SystemBackWithGiganticPages(void* start, size_t length) {
+#ifdef __linux__
+  constexpr size_t kGiganticPageSize = size_t{1} << 30;
+  TC_ASSERT_EQ(reinterpret_cast<uintptr_t>(start) % kGiganticPageSize, 0);
+  TC_ASSERT_EQ(length % kGiganticPageSize, 0);
+  ErrnoRestorer errno_restorer;
+  // Without MAP_NORESERVE, the kernel reserves the pages from the pool now,
+  // so that faulting them in can't fail later.
+  void* result = mmap(start, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB |
+                          MAP_HUGE_1GB,
+                      -1, 0);
+  if (result == start) {
+    char name[256];
+    absl::SNPrintF(name, sizeof(name), "tcmalloc_region_%s_1g",
+                   MemoryTagToLabel(GetMemoryTag(start)));
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, result, length, name);
+    return true;
+  }
+  // A failed MAP_FIXED mapping may have unmapped the range.  Keep its
+  // addresses reserved, so that nothing else is mapped at our tag.
+  (void)mmap(start, length, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+  return false;
+#else
+  return false;
+#endif
+}
+
 AddressRegionFactory* GetRegionFactory() {
   AllocationGuardSpinLockHolder lock_holder(&spinlock);
   InitSystemAllocatorIfNecessary();
@@ -661,6 +1065,28 @@ static uintptr_t RandomMmapHint(size_t size, size_t alignment,
   return addr;
 }
 
+ABSL_CONST_INIT MappedAddressBounds::Window MappedAddressBounds::windows_[];
+
+void MappedAddressBounds::Add(const void* start, size_t size) {
+  uintptr_t lo = reinterpret_cast<uintptr_t>(start);
+  const uintptr_t end = lo + size;
+  // Only SystemAllocIoBuffers' kernel-placed mappings may span windows.
+  while (lo < end) {
+    const uintptr_t window_end = (lo | ((uintptr_t{1} << kTagShift) - 1)) + 1;
+    const uintptr_t hi = std::min(end, window_end);
+    Window& w = windows_[(lo & kTagMask) >> kTagShift];
+    uintptr_t cur = w.lo.load(std::memory_order_relaxed);
+    while (lo < cur && !w.lo.compare_exchange_weak(cur, lo,
+                                                   std::memory_order_relaxed)) {
+    }
+    cur = w.hi.load(std::memory_order_relaxed);
+    while (hi > cur && !w.hi.compare_exchange_weak(cur, hi,
+                                                   std::memory_order_relaxed)) {
+    }
+    lo = hi;
+  }
+}
+
 void* MmapAligned(size_t size, size_t alignment, const MemoryTag tag) {
   TC_ASSERT_LE(size, kTagMask);
   TC_ASSERT_LE(alignment, kTagMask);
@@ -669,6 +1095,7 @@ void* MmapAligned(size_t size, size_t alignment, const MemoryTag tag) {
   static uintptr_t next_selsan_addr = 0;
   static std::array<uintptr_t, kNumaPartitions> next_normal_addr = {0};
   static uintptr_t next_cold_addr = 0;
+  static uintptr_t next_warm_addr = 0;
   static uintptr_t next_metadata_addr = 0;
 
   std::optional<int> numa_partition;
@@ -679,13 +1106,16 @@ void* MmapAligned(size_t size, size_t alignment, const MemoryTag tag) {
       case MemoryTag::kSelSan:
         return &next_selsan_addr;
       case MemoryTag::kNormalP0:
-        numa_partition = 0;
-        return &next_normal_addr[0];
       case MemoryTag::kNormalP1:
-        numa_partition = 1;
-        return &next_normal_addr[1];
+      case MemoryTag::kNormalP2:
+      case MemoryTag::kNormalP3:
+        numa_partition = NumaPartitionFromTag(tag);
+        TC_ASSERT_LT(*numa_partition, kNumaPartitions);
+        return &next_normal_addr[*numa_partition];
       case MemoryTag::kCold:
         return &next_cold_addr;
+      case MemoryTag::kWarm:
+        return &next_warm_addr;
       case MemoryTag::kMetadata:
         return &next_metadata_addr;
     }
@@ -712,6 +1142,8 @@ void* MmapAligned(size_t size, size_t alignment, const MemoryTag tag) {
     if (result == hint) {
       if (numa_partition.has_value()) {
         BindMemory(result, size, *numa_partition);
+      } else if (tag == MemoryTag::kWarm) {
+        BindWarmMemory(result, size);
       }
       // Attempt to keep the next mmap contiguous in the common case.
       next_addr += size;
@@ -732,6 +1164,7 @@ void* MmapAligned(size_t size, size_t alignment, const MemoryTag tag) {
                      MemoryTagToLabel(tag));
       prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, result, size, name);
 #endif  // __linux__
+      MappedAddressBounds::Add(result, size);
       return result;
     }
     if (map_fixed_noreplace_flag) {
@@ -19,6 +19,9 @@
 #define TCMALLOC_SYSTEM_ALLOC_H_
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
 
 #include "absl/base/attributes.h"
 #include "tcmalloc/common.h"
@@ -50,10 +53,41 @@ struct AddressRange {
 // Returns nullptr when out of memory.
 AddressRange SystemAlloc(size_t bytes, size_t alignment, MemoryTag tag);
 
+// Allocates `bytes`, rounded up to whole hugepages, for a pool of I/O buffers,
+// from a hugepage-aligned region of its own that the region factory creates
+// with UsageHint::kIoBuffers.  The memory lies outside of the address ranges
+// of every MemoryTag, is backed with hugepages where the kernel allows, and is
+// never returned.  Returns {nullptr, 0} when out of memory.
+AddressRange SystemAllocIoBuffers(size_t bytes);
+
+// Returns the NUMA node that SystemAlloc binds MemoryTag::kWarm memory to, or
+// -1 if there is no warm tier.  Setting TCMALLOC_WARM_TIER_NUMA_NODE to a node,
+// typically one of slower, CXL-attached memory, enables the tier.
+int WarmTierNumaNode();
+
+// Returns the size of the address ranges reserved, unbacked, for each
+// MemoryTag, which SystemAlloc then carves allocations from.  This is
+// kMinMmapAlloc unless TCMALLOC_RESERVE_ADDRESS_SPACE asks for more bytes, up
+// to a quarter of a tag's address range, so that a growing heap adds a new
+// mapping, and pagemap leaves far apart, less often.  If a reservation this
+// large fails, SystemAlloc falls back to kMinMmapAlloc.
+size_t SystemAllocRegionSize();
+
 // Returns the number of times we failed to give pages back to the OS after a
 // call to SystemRelease.
 int SystemReleaseErrors();
 
+// Bytes SystemRelease has given back to the OS since startup.  Lazily released
+// bytes were only marked with MADV_FREE: they stay resident, and count toward
+// RSS, until the kernel reclaims them under memory pressure.  If they are
+// reused first, they come back without a page fault.  Eagerly released bytes
+// were unbacked at once.
+struct SystemReleaseBytes {
+  uint64_t lazy;
+  uint64_t eager;
+};
+SystemReleaseBytes GetSystemReleaseBytes();
+
 // This call is a hint to the operating system that the pages
 // contained in the specified range of memory will not be used for a
 // while, and can be released for use by other processes or the OS.
@@ -67,6 +101,87 @@ int SystemReleaseErrors();
 // Returns true on success.
 ABSL_MUST_USE_RESULT bool SystemRelease(void* start, size_t length);
 
+// Asks the OS to back [start, start + length) with hugepages again, after
+// part of it was released with SystemRelease and then faulted back in.  This
+// is synchronous and may be expensive: the kernel copies the range into a
+// newly allocated hugepage.
+//
+// Returns true on success.
+ABSL_MUST_USE_RESULT bool SystemCollapse(void* start, size_t length);
+
+// Leaves [start, start + length) out of core dumps (MADV_DONTDUMP), or puts it
+// back in (MADV_DODUMP).  The kernel keeps this per mapping, so it splits the
+// mapping where the advice changes; advise whole runs at once where possible.
+//
+// Returns true on success.
+// REQUIRES: [start, start + length) is page-aligned.
+ABSL_MUST_USE_RESULT bool SystemExcludeFromCoreDump(void* start, size_t length);
+ABSL_MUST_USE_RESULT bool SystemIncludeInCoreDump(void* start, size_t length);
+
+// Faults in [start, start + length) ahead of first touch, using
+// MADV_POPULATE_WRITE.  The kernel allocates the pages, as hugepages where it
+// can, according to the range's memory policy, so NUMA bindings are honored.
+// Contents are unchanged.  Unlike touching the pages ourselves, this takes no
+// user-space fault per page.
+//
+// Returns false if the range could not be fully populated, including on
+// kernels without MADV_POPULATE_WRITE (before Linux 5.14).
+ABSL_MUST_USE_RESULT bool SystemPopulate(void* start, size_t length);
+
+// Interleaves the memory backing [start, start + length) across all NUMA nodes
+// this process may allocate from (MPOL_INTERLEAVE), moving pages that are
+// already backed.  This spreads the load of memory read evenly by every
+// socket, at the cost of remote accesses from each of them.  The policy stays
+// with the range until SystemUninterleave.
+//
+// Returns false, leaving the range as it was, on single-node systems or if the
+// kernel refuses the policy.
+// REQUIRES: [start, start + length) is page-aligned.
+ABSL_MUST_USE_RESULT bool SystemInterleave(void* start, size_t length);
+
+// Undoes SystemInterleave before [start, start + length) is reused: the range
+// is bound to the NUMA partition of <tag> again if tcmalloc is NUMA aware, or
+// to the warm tier's node for warm memory, and reverts to the default policy
+// otherwise.
+void SystemUninterleave(void* start, size_t length, MemoryTag tag);
+
+// Moves the pages backing [start, start + length) to the warm tier's NUMA node
+// (see WarmTierNumaNode), or back to the nodes <tag> memory is placed on.  The
+// range keeps the policy SystemAlloc gave it, so pages faulted in later are
+// placed as before.
+//
+// Returns false if there is no warm tier or the kernel could not move the
+// pages.
+// REQUIRES: [start, start + length) is page-aligned.
+ABSL_MUST_USE_RESULT bool SystemDemote(void* start, size_t length,
+                                       MemoryTag tag);
+ABSL_MUST_USE_RESULT bool SystemPromote(void* start, size_t length,
+                                        MemoryTag tag);
+
+// Moves the pages backing [from, from + length) to [to, to + length) with
+// mremap(MREMAP_DONTUNMAP), replacing whatever backed the latter.  The kernel
+// moves page table entries rather than copying, and hugepages stay intact if
+// both ranges are hugepage-aligned.  Afterwards, [from, from + length) is
+// still mapped but unbacked, as after SystemRelease.
+//
+// Returns false, leaving both ranges as they were, if the kernel does not
+// support this (before Linux 5.7), if either range is from a custom
+// AddressRegionFactory, or if a range spans several mappings.
+// REQUIRES: both ranges are from SystemAlloc with the same tag, page-aligned
+//           and disjoint.
+ABSL_MUST_USE_RESULT bool SystemRemap(void* from, void* to, size_t length);
+
+// Replaces the mapping of [start, start + length), which SystemAlloc returned
+// and nothing has touched yet, with one backed by 1GiB hugetlb pages from the
+// kernel's pool (see /sys/kernel/mm/hugepages/hugepages-1048576kB).  The pool
+// is shared across NUMA nodes; the range's NUMA binding is not kept.
+//
+// Returns false if the pool can't back the whole range, in which case the
+// range is left inaccessible.
+// REQUIRES: start and length are multiples of 1GiB.
+ABSL_MUST_USE_RESULT bool SystemBackWithGiganticPages(void* start,
+                                                      size_t length);
+
 // This call is the inverse of SystemRelease: the pages in this range
 // are in use and should be faulted in.  (In principle this is a
 // best-effort hint, but in practice we will unconditionally fault the
@@ -93,6 +208,39 @@ void SetRegionFactory(AddressRegionFactory* factory);
 // REQUIRES: size <= kTagMask
 void* MmapAligned(size_t size, size_t alignment, MemoryTag tag);
 
+// MappedAddressBounds keeps, for each value of the kTagMask bits, the lowest
+// and highest address TCMalloc has mapped with those bits.  Any pointer
+// outside of the bounds of its window cannot be ours, which MayContain
+// answers with two loads and two compares, ahead of a pagemap lookup that a
+// process with other allocators would otherwise pay for every foreign
+// pointer.
+//
+// The bounds only ever widen, as mappings are never handed back, so a stale
+// read is only ever too narrow for memory no span has been carved from yet.
+class MappedAddressBounds {
+ public:
+  // Records that [start, start + size) is mapped.
+  static void Add(const void* start, size_t size);
+
+  // Returns false if ptr, with any tags removed, cannot lie in memory that
+  // was passed to Add.
+  static bool MayContain(const void* ptr) {
+    const uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
+    const Window& w = windows_[(p & kTagMask) >> kTagShift];
+    return w.lo.load(std::memory_order_relaxed) <= p &&
+           p < w.hi.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Window {
+    // [lo, hi), which is empty until the first Add.
+    std::atomic<uintptr_t> lo{UINTPTR_MAX};
+    std::atomic<uintptr_t> hi{0};
+  };
+
+  ABSL_CONST_INIT static Window windows_[(kTagMask >> kTagShift) + 1];
+};
+
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
 GOOGLE_MALLOC_SECTION_END
@@ -49,6 +49,7 @@
 #include "tcmalloc/tcmalloc.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <sched.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -58,6 +59,7 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <limits>
 #include <map>
@@ -73,6 +75,7 @@
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/debugging/stacktrace.h"
 #include "absl/numeric/bits.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -82,39 +85,51 @@
 #include "absl/types/span.h"
 #include "tcmalloc/allocation_sample.h"
 #include "tcmalloc/allocation_sampling.h"
+#include "tcmalloc/bulk_heap.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/cpu_cache.h"
 #include "tcmalloc/deallocation_profiler.h"
+#include "tcmalloc/emergency_reserve.h"
 #include "tcmalloc/experiment.h"
+#include "tcmalloc/experiment_counters.h"
 #include "tcmalloc/global_stats.h"
 #include "tcmalloc/guarded_allocations.h"
 #include "tcmalloc/guarded_page_allocator.h"
+#include "tcmalloc/huge_pages.h"
 #include "tcmalloc/internal/allocation_guard.h"
 #include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/exponential_biased.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/optimization.h"
 #include "tcmalloc/internal/overflow.h"
 #include "tcmalloc/internal/page_size.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/internal/sampled_allocation.h"
+#include "tcmalloc/internal/sysinfo.h"
 #include "tcmalloc/internal_malloc_extension.h"
+#include "tcmalloc/io_buffer_pool.h"
+#include "tcmalloc/large_span_cache.h"
 #include "tcmalloc/malloc_extension.h"
 #include "tcmalloc/malloc_tracing_extension.h"
 #include "tcmalloc/new_extension.h"
 #include "tcmalloc/page_allocator.h"
 #include "tcmalloc/page_heap_allocator.h"
+#include "tcmalloc/pageheap_lock_profiler.h"
 #include "tcmalloc/pagemap.h"
 #include "tcmalloc/pages.h"
 #include "tcmalloc/parameters.h"
 #include "tcmalloc/sampler.h"
 #include "tcmalloc/segv_handler.h"
 #include "tcmalloc/selsan/selsan.h"
+#include "tcmalloc/size_class_tags.h"
 #include "tcmalloc/span.h"
+#include "tcmalloc/span_recycler.h"
 #include "tcmalloc/static_vars.h"
 #include "tcmalloc/stats.h"
 #include "tcmalloc/system-alloc.h"
 #include "tcmalloc/tcmalloc_policy.h"
 #include "tcmalloc/thread_cache.h"
+#include "tcmalloc/thread_magazine.h"
 #include "tcmalloc/transfer_cache.h"
 
 #if defined(TCMALLOC_HAVE_STRUCT_MALLINFO) || \
@@ -164,6 +179,9 @@ GOOGLE_MALLOC_SECTION_BEGIN
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+ABSL_CONST_INIT thread_local ThreadAllocationPolicy
+    ThreadAllocationPolicy::thread_local_data_ ABSL_ATTRIBUTE_INITIAL_EXEC;
+
 // Gets a human readable description of the current state of the malloc data
 // structures. Returns the actual written size.
 // [buffer, buffer+result] will contain NUL-terminated output string.
@@ -221,6 +239,41 @@ extern "C" void MallocExtension_Internal_GetStats(std::string* ret) {
   }
 }
 
+extern "C" void MallocExtension_Internal_GetStatsInWireFormat(
+    std::string* ret) {
+  size_t shift = std::max<size_t>(16, absl::bit_width(ret->capacity()) - 1);
+  for (; shift < 24; shift++) {
+    const size_t size = size_t{1} << shift;
+    ret->resize(size);
+    Printer printer(&*ret->begin(), size);
+    DumpStatsInPbtxt(&printer, 2, PbtxtEncoding::kWireFormat);
+    const size_t written_size = printer.SpaceRequired();
+    if (written_size < size) {
+      // We did not truncate.
+      ret->resize(written_size);
+      return;
+    }
+  }
+  ret->clear();
+}
+
+extern "C" void MallocExtension_Internal_GetMemoryUsageByTag(
+    std::vector<MallocExtension::MemoryTagUsage>* ret) {
+  GetMemoryUsageByTag(ret);
+}
+
+extern "C" void MallocExtension_Internal_GetStatsSnapshot(
+    MallocExtension::StatsSnapshot* snapshot, bool exact) {
+  ExtractStatsSnapshot(snapshot, exact);
+}
+
+extern "C" void MallocExtension_Internal_GetThreadAllocationCounts(
+    MallocExtension::ThreadAllocationCounts* counts) {
+  const Sampler* sampler = GetThreadSampler();
+  counts->allocated_bytes = sampler->allocated_bytes();
+  counts->freed_bytes = sampler->freed_bytes();
+}
+
 extern "C" size_t TCMalloc_Internal_GetStats(char* buffer,
                                              size_t buffer_length) {
   Printer printer(buffer, buffer_length);
@@ -232,6 +285,12 @@ extern "C" size_t TCMalloc_Internal_GetStats(char* buffer,
 
   printer.printf("\nLow-level allocator stats:\n");
   printer.printf("Memory Release Failures: %d\n", SystemReleaseErrors());
+  printer.printf("Address Space Reserved Per Tag In Ranges Of: %zu bytes\n",
+                 SystemAllocRegionSize());
+  printer.printf("Transparent Hugepages: %s%s\n", ThpModeToLabel(GetThpMode()),
+                 GetThpMode() == ThpMode::kMadvise
+                     ? " (hugepage regions advised with MADV_HUGEPAGE)"
+                     : "");
 
   size_t n = printer.SpaceRequired();
 
@@ -251,13 +310,52 @@ extern "C" const ProfileBase* MallocExtension_Internal_SnapshotCurrent(
       return DumpHeapProfile(tc_globals).release();
     case ProfileType::kFragmentation:
       return DumpFragmentationProfile(tc_globals).release();
+    case ProfileType::kPreciseFragmentation:
+      return DumpPreciseFragmentationProfile(tc_globals).release();
     case ProfileType::kPeakHeap:
       return tc_globals.peak_heap_tracker().DumpSample().release();
+    case ProfileType::kAllocationRate:
+      return tc_globals.allocation_rate_tracker()
+          .DumpSample(absl::Now())
+          .release();
+    case ProfileType::kLockContention:
+      return PageHeapLockProfiler::DumpSample().release();
     default:
       return nullptr;
   }
 }
 
+extern "C" const ProfileBase* MallocExtension_Internal_SnapshotHeapDelta(
+    int64_t* allocated, uint64_t* freed, bool* is_delta) {
+  return DumpHeapProfileDelta(tc_globals, *allocated, *freed, *is_delta)
+      .release();
+}
+
+extern "C" bool MallocExtension_Internal_ResetPeakHeapWindow(
+    const char* name_data, size_t name_size) {
+  return tc_globals.peak_heap_windows().Reset(
+      absl::string_view(name_data, name_size));
+}
+
+extern "C" void MallocExtension_Internal_RemovePeakHeapWindow(
+    const char* name_data, size_t name_size) {
+  tc_globals.peak_heap_windows().Remove(
+      absl::string_view(name_data, name_size));
+}
+
+extern "C" bool MallocExtension_Internal_GetPeakHeapWindowSize(
+    const char* name_data, size_t name_size, size_t* size) {
+  return tc_globals.peak_heap_windows().PeakSize(
+      absl::string_view(name_data, name_size), size);
+}
+
+extern "C" const ProfileBase* MallocExtension_Internal_SnapshotPeakHeapWindow(
+    const char* name_data, size_t name_size) {
+  return tc_globals.peak_heap_windows()
+      .DumpSample(absl::string_view(name_data, name_size))
+      .release();
+}
+
 extern "C" AllocationProfilingTokenBase*
 MallocExtension_Internal_StartAllocationProfiling() {
   return new AllocationSample(&tc_globals.allocation_samples, absl::Now());
@@ -270,7 +368,13 @@ MallocExtension_Internal_StartLifetimeProfiling() {
 }
 
 MallocExtension::Ownership GetOwnership(const void* ptr) {
-  const PageId p = PageIdContainingTagged(ptr);
+  const void* untagged = size_class_tags::RemoveTag(selsan::RemoveTag(ptr));
+  // Pointers from other allocators ordinarily fall outside of every mapping
+  // of ours, so answer for them without the pagemap's cache misses.
+  if (!MappedAddressBounds::MayContain(untagged)) {
+    return MallocExtension::Ownership::kNotOwned;
+  }
+  const PageId p = PageIdContaining(untagged);
   return tc_globals.pagemap().GetDescriptor(p)
              ? MallocExtension::Ownership::kOwned
              : MallocExtension::Ownership::kNotOwned;
@@ -281,6 +385,12 @@ extern "C" bool MallocExtension_Internal_GetNumericProperty(
   return GetNumericProperty(name_data, name_size, value);
 }
 
+extern "C" void MallocExtension_Internal_GetNumericProperties(
+    const absl::string_view* names, size_t count,
+    std::optional<size_t>* values) {
+  GetNumericProperties(names, count, values);
+}
+
 // Make sure the two definitions are in sync.
 static_assert(static_cast<int>(tcmalloc::MallocExtension::LimitKind::kSoft) ==
               PageAllocator::kSoft);
@@ -302,8 +412,73 @@ extern "C" void MallocExtension_Internal_SetMemoryLimit(
       limit, static_cast<PageAllocator::LimitKind>(limit_kind));
 }
 
+static_assert(
+    static_cast<int>(tcmalloc::MallocExtension::MemoryKind::kNormal) ==
+    PageAllocator::kNormalHeaps);
+static_assert(static_cast<int>(tcmalloc::MallocExtension::MemoryKind::kCold) ==
+              PageAllocator::kColdHeap);
+static_assert(
+    static_cast<int>(tcmalloc::MallocExtension::MemoryKind::kSampled) ==
+    PageAllocator::kSampledHeap);
+
+extern "C" size_t MallocExtension_Internal_GetMemoryKindLimit(
+    tcmalloc::MallocExtension::MemoryKind kind) {
+  return tc_globals.page_allocator().heap_limit(
+      static_cast<PageAllocator::HeapKind>(kind));
+}
+
+extern "C" void MallocExtension_Internal_SetMemoryKindLimit(
+    size_t limit, tcmalloc::MallocExtension::MemoryKind kind) {
+  tc_globals.page_allocator().set_heap_limit(
+      limit, static_cast<PageAllocator::HeapKind>(kind));
+}
+
+extern "C" size_t MallocExtension_Internal_SetEmergencyReserve(size_t bytes) {
+  return EmergencyReserve::Set(bytes);
+}
+
+extern "C" size_t MallocExtension_Internal_ReleaseEmergencyReserve() {
+  return EmergencyReserve::Release();
+}
+
+extern "C" bool MallocExtension_Internal_CreateIoBufferPool(
+    size_t buffer_size, size_t num_buffers,
+    tcmalloc::MallocExtension::IoBufferPool* pool) {
+  return IoBufferPool::Create(buffer_size, num_buffers, pool);
+}
+
+extern "C" bool MallocExtension_Internal_GetIoBufferPool(
+    tcmalloc::MallocExtension::IoBufferPool* pool) {
+  return IoBufferPool::Get(pool);
+}
+
+extern "C" void* MallocExtension_Internal_AllocateIoBuffer() {
+  return IoBufferPool::Allocate();
+}
+
+extern "C" void MallocExtension_Internal_FreeIoBuffer(void* buffer) {
+  IoBufferPool::Free(buffer);
+}
+
 extern "C" void MallocExtension_Internal_MarkThreadIdle() {
   ThreadCache::BecomeIdle();
+  ThreadMagazine::FlushCurrentThread();
+}
+
+extern "C" void* MallocExtension_Internal_CreateHeap() {
+  return BulkHeap::Create();
+}
+
+extern "C" void* MallocExtension_Internal_HeapAllocate(void* heap, size_t size,
+                                                       size_t alignment) {
+  if (!absl::has_single_bit(alignment) || alignment > BulkHeap::kBlockSize) {
+    return nullptr;
+  }
+  return static_cast<BulkHeap*>(heap)->Allocate(size, alignment);
+}
+
+extern "C" void MallocExtension_Internal_DestroyHeap(void* heap) {
+  BulkHeap::Destroy(static_cast<BulkHeap*>(heap));
 }
 
 extern "C" AddressRegionFactory* MallocExtension_Internal_GetRegionFactory() {
@@ -323,17 +498,72 @@ extern "C" void MallocExtension_Internal_SetRegionFactory(
 ABSL_CONST_INIT static absl::base_internal::SpinLock release_lock(
     absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
 
-extern "C" size_t MallocExtension_Internal_ReleaseMemoryToSystem(
-    size_t num_bytes) {
+static size_t ReleaseMemoryToSystemNow(size_t num_bytes) {
   ABSL_CONST_INIT static ConstantRatePageAllocatorReleaser releaser
       ABSL_GUARDED_BY(release_lock);
 
   const AllocationGuardSpinLockHolder rh(&release_lock);
 
+  if (tc_globals.IsInited()) {
+    tc_globals.transfer_cache().ReturnDeferredSpans();
+    LargeSpanCache::Drain();
+  }
   return releaser.Release(num_bytes,
                           /*reason=*/PageReleaseReason::kReleaseMemoryToSystem);
 }
 
+extern "C" size_t MallocExtension_Internal_ReleaseMemoryToSystem(
+    size_t num_bytes) {
+  // Leave the release to the background thread, if it is running.  Requests
+  // for 0 bytes still run inline, as malloc_trim relies on learning whether
+  // anything was released.
+  if (num_bytes > 0 && Parameters::async_release_memory_to_system() &&
+      tc_globals.release_queue().Enqueue(num_bytes)) {
+    return 0;
+  }
+  return ReleaseMemoryToSystemNow(num_bytes);
+}
+
+// Drains the caches above the page heap, and then returns every free page,
+// including the HugeCache's, to the OS.  Returns the bytes released.  Only the
+// calling thread's own thread cache can be flushed.
+static size_t ReleaseAllCachedMemoryNow() {
+  if (!tc_globals.IsInited()) {
+    return 0;
+  }
+
+  MallocExtension_Internal_MarkThreadIdle();
+  if (tc_globals.CpuCacheActive()) {
+    auto& cpu_cache = tc_globals.cpu_cache();
+    for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+      if (cpu_cache.HasPopulated(cpu)) {
+        cpu_cache.Reclaim(cpu);
+      }
+    }
+  }
+  tc_globals.sharded_transfer_cache().Drain();
+  tc_globals.transfer_cache().Drain();
+  return ReleaseMemoryToSystemNow(std::numeric_limits<size_t>::max());
+}
+
+extern "C" size_t MallocExtension_Internal_ReleaseAllCachedMemory() {
+  return ReleaseAllCachedMemoryNow();
+}
+
+// With release_caches_at_fork, drains the caches above the page heap and
+// returns the free memory to the OS before fork().  A child forked from a
+// warmed parent then faults in fresh pages as it allocates, rather than
+// copying on write the pages of objects the parent happened to cache.
+//
+// This runs in the parent, where every lock can still be taken: in the child,
+// a lock held by a thread that did not survive the fork is never released.
+static void ReleaseCachesBeforeFork() {
+  if (!Parameters::release_caches_at_fork()) {
+    return;
+  }
+  ReleaseAllCachedMemoryNow();
+}
+
 // nallocx slow path.
 // Moved to a separate function because size_class_with_alignment is not inlined
 // which would cause nallocx to become non-leaf function with stack frame and
@@ -372,6 +602,12 @@ extern "C" size_t nallocx(size_t size, int flags) noexcept {
   }
 }
 
+extern "C" void tcmalloc_nallocx_batch(const size_t* sizes, size_t* rounded,
+                                       size_t n) noexcept {
+  tc_globals.InitIfNecessary();
+  tc_globals.sizemap().GetAllocatedSizes(sizes, rounded, n);
+}
+
 extern "C" MallocExtension::Ownership MallocExtension_Internal_GetOwnership(
     const void* ptr) {
   return GetOwnership(ptr);
@@ -419,6 +655,10 @@ extern "C" void MallocExtension_Internal_GetProperties(
   (*result)["tcmalloc.cpu_free"].value = stats.per_cpu_bytes;
   (*result)["tcmalloc.sharded_transfer_cache_free"].value =
       stats.sharded_transfer_bytes;
+  (*result)["tcmalloc.large_span_cache_free"].value =
+      stats.large_span_cache_bytes;
+  (*result)["tcmalloc.emergency_reserve_bytes"].value =
+      stats.emergency_reserve_bytes;
   (*result)["tcmalloc.per_cpu_caches_active"].value =
       tc_globals.CpuCacheActive();
   // Thread Cache Free List
@@ -443,6 +683,11 @@ extern "C" void MallocExtension_Internal_GetProperties(
       stats.pageheap.unmapped_bytes + stats.arena.bytes_nonresident;
   (*result)["tcmalloc.sampled_internal_fragmentation"].value =
       tc_globals.sampled_internal_fragmentation_.value();
+  (*result)["tcmalloc.thread_magazine_hits"].value = ThreadMagazine::hits();
+  (*result)["tcmalloc.thread_magazine_refills"].value =
+      ThreadMagazine::refills();
+  (*result)["tcmalloc.thread_magazine_flushes"].value =
+      ThreadMagazine::flushes();
 
   (*result)["tcmalloc.page_algorithm"].value =
       tc_globals.page_allocator().algorithm();
@@ -480,6 +725,46 @@ extern "C" void MallocExtension_Internal_GetProperties(
       stats.num_released_soft_limit_exceeded.in_bytes();
   (*result)["tcmalloc.num_released_hard_limit_exceeded_bytes"].value =
       stats.num_released_hard_limit_exceeded.in_bytes();
+
+  WalkExperimentCounters([&](absl::string_view name, uint64_t value) {
+    (*result)[absl::StrCat(kExperimentCounterPrefix, name)].value = value;
+  });
+
+  if (tc_globals.CpuCacheActive()) {
+    // Report the misses of the last complete epoch of the per-cpu cache miss
+    // time series, so that monitoring polling once per epoch sees every epoch.
+    // Size classes are only reported if they missed at all.
+    auto& cpu_cache = tc_globals.cpu_cache();
+    CpuCache::MissTimeSeriesEntry total;
+    for (int cpu = 0, num_cpus = NumCPUs(); cpu < num_cpus; ++cpu) {
+      if (!cpu_cache.HasPopulated(cpu)) continue;
+      const CpuCache::MissTimeSeriesEntry misses =
+          cpu_cache.GetCpuMissTimeSeries(cpu, /*offset=*/1);
+      total.underflows += misses.underflows;
+      total.overflows += misses.overflows;
+      const std::string prefix = absl::StrCat("tcmalloc.cpu_cache.", cpu, ".");
+      (*result)[absl::StrCat(prefix, "underflows_last_minute")].value =
+          misses.underflows;
+      (*result)[absl::StrCat(prefix, "overflows_last_minute")].value =
+          misses.overflows;
+    }
+    (*result)["tcmalloc.cpu_cache.underflows_last_minute"].value =
+        total.underflows;
+    (*result)["tcmalloc.cpu_cache.overflows_last_minute"].value =
+        total.overflows;
+
+    for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+      const CpuCache::MissTimeSeriesEntry misses =
+          cpu_cache.GetSizeClassMissTimeSeries(size_class, /*offset=*/1);
+      if (misses.empty()) continue;
+      const std::string prefix =
+          absl::StrCat("tcmalloc.cpu_cache.size_class.", size_class, ".");
+      (*result)[absl::StrCat(prefix, "underflows_last_minute")].value =
+          misses.underflows;
+      (*result)[absl::StrCat(prefix, "overflows_last_minute")].value =
+          misses.overflows;
+    }
+  }
 }
 
 extern "C" size_t MallocExtension_Internal_ReleaseCpuMemory(int cpu) {
@@ -502,7 +787,7 @@ inline size_t GetLargeSize(const void* ptr, const PageId p) {
     if (tc_globals.guardedpage_allocator().PointerIsMine(ptr)) {
       return tc_globals.guardedpage_allocator().GetRequestedSize(ptr);
     }
-    return span->sampled_allocation()->sampled_stack.allocated_size;
+    return span->sampled_allocation()->details.allocated_size;
   } else {
     return span->bytes_in_span();
   }
@@ -519,6 +804,37 @@ inline size_t GetSize(const void* ptr) {
   }
 }
 
+// Returns the size class of ptr, which malloc() returned for a request of
+// `size` bytes, without reading the pagemap; or 0 if that takes the pagemap.
+// Sampled, cold and large objects fall in the latter case.  Any size from the
+// requested one up to the capacity of ptr will do, as for sdallocx().
+inline size_t SizeClassWithHint(const void* ptr, size_t size) {
+  if (const size_t size_class = size_class_tags::GetTag(ptr);
+      size_class != 0) {
+    return size_class;
+  }
+  size_t size_class;
+  if (ABSL_PREDICT_FALSE(ptr == nullptr || !IsNormalMemory(ptr)) ||
+      !tc_globals.sizemap().GetSizeClass(
+          CppPolicy()
+              .AlignAs(MallocAlignPolicy::align())
+              .InSameNumaPartitionAs(const_cast<void*>(ptr)),
+          size, &size_class)) {
+    return 0;
+  }
+  TC_ASSERT_EQ(tc_globals.sizemap().class_to_size(size_class), GetSize(ptr));
+  return size_class;
+}
+
+// As GetSize(), but taking the size class from `size` where it can.
+inline size_t GetSizeWithHint(const void* ptr, size_t size) {
+  if (const size_t size_class = SizeClassWithHint(ptr, size);
+      size_class != 0) {
+    return tc_globals.sizemap().class_to_size(size_class);
+  }
+  return GetSize(ptr);
+}
+
 // This slow path also handles delete hooks and non-per-cpu mode.
 ABSL_ATTRIBUTE_NOINLINE static void FreeWithHooksOrPerThread(
     void* ptr, size_t size_class) {
@@ -535,6 +851,84 @@ ABSL_ATTRIBUTE_NOINLINE static void FreeWithHooksOrPerThread(
   }
 }
 
+// Keeps <ptr> in the calling thread's magazine, registering the thread and
+// flushing half of the slot to the per-cpu cache as needed. Returns false if
+// the object has to be freed to the per-cpu cache directly.
+ABSL_ATTRIBUTE_NOINLINE static bool FreeToThreadMagazineSlow(
+    void* ptr, size_t size_class) {
+  if (ABSL_PREDICT_FALSE(Static::HaveHooks()) ||
+      ABSL_PREDICT_FALSE(!UsePerCpuCache(tc_globals))) {
+    return false;
+  }
+  ThreadMagazine& magazine = ThreadMagazine::Get();
+  ThreadMagazine::RegisterThread();
+  if (!magazine.registered()) return false;
+  if (!magazine.Push(size_class, ptr)) {
+    magazine.Flush(tc_globals.cpu_cache(), size_class);
+    TC_CHECK(magazine.Push(size_class, ptr));
+  }
+  return true;
+}
+
+// Count the bytes the calling thread allocates and frees, if
+// Parameters::per_thread_allocation_accounting() is set.  Both are counted in
+// the capacity of the allocations, which is all that frees know of.
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void AccountAllocation(
+    size_t bytes) {
+  if (ABSL_PREDICT_FALSE(Parameters::per_thread_allocation_accounting())) {
+    GetThreadSampler()->RecordAllocatedBytes(bytes);
+  }
+}
+
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void AccountSmallAllocations(
+    size_t size_class, size_t count) {
+  if (ABSL_PREDICT_FALSE(Parameters::per_thread_allocation_accounting())) {
+    GetThreadSampler()->RecordAllocatedBytes(
+        count * tc_globals.sizemap().class_to_size(size_class));
+  }
+}
+
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void AccountFree(size_t bytes) {
+  if (ABSL_PREDICT_FALSE(Parameters::per_thread_allocation_accounting())) {
+    GetThreadSampler()->RecordFreedBytes(bytes);
+  }
+}
+
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void AccountSmallFrees(
+    size_t size_class, size_t count) {
+  if (ABSL_PREDICT_FALSE(Parameters::per_thread_allocation_accounting())) {
+    GetThreadSampler()->RecordFreedBytes(
+        count * tc_globals.sizemap().class_to_size(size_class));
+  }
+}
+
+// Record allocations and frees in the allocation event trace, if one is
+// running.  Unlike hooks, an active trace doesn't send the fast paths to the
+// slow ones.
+template <typename Policy>
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void TraceNew(const void* ptr,
+                                                         size_t size) {
+  if (Policy::invoke_hooks() &&
+      ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active())) {
+    tc_globals.allocation_event_tracer().RecordNew(ptr, size);
+  }
+}
+
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void TraceDelete(const void* ptr,
+                                                            size_t capacity) {
+  if (ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active())) {
+    tc_globals.allocation_event_tracer().RecordDelete(ptr, capacity);
+  }
+}
+
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void TraceSmallDelete(
+    const void* ptr, size_t size_class) {
+  if (ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active())) {
+    tc_globals.allocation_event_tracer().RecordDelete(
+        ptr, tc_globals.sizemap().class_to_size(size_class));
+  }
+}
+
 // In free fast-path we handle a number of conditions (delete hooks,
 // full cpu cache, uncached per-cpu slab pointer, etc) by delegating work to
 // slower function that handles all of these cases. This is done so that free
@@ -559,6 +953,17 @@ static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void FreeSmall(void* ptr,
   } else {
     TC_ASSERT_EQ(GetMemoryTag(ptr), MemoryTag::kCold, "ptr=%p", ptr);
   }
+  AccountSmallFrees(size_class, 1);
+  TraceSmallDelete(ptr, size_class);
+
+  if (ABSL_PREDICT_FALSE(Parameters::per_cpu_caches_thread_magazine()) &&
+      size_class < ThreadMagazine::kNumClasses) {
+    ThreadMagazine& magazine = ThreadMagazine::Get();
+    if ((magazine.registered() && magazine.Push(size_class, ptr)) ||
+        FreeToThreadMagazineSlow(ptr, size_class)) {
+      return;
+    }
+  }
 
   // DeallocateFast may fail if:
   //  - the cpu cache is full
@@ -594,10 +999,69 @@ std::pair<void*, size_t> HeapObjectInfo(void* ptr) {
   }
   return {reinterpret_cast<void*>(obj_start), obj_size};
 }
+
+// RetagSampler picks which freed objects are retagged, so that later accesses
+// through dangling pointers to them trap.  With selsan_sampling_interval above
+// 1, about one in that many frees, at geometrically distributed intervals, is
+// picked.  The other frees leave the shadow alone, so they cost next to
+// nothing, and objects keep tag 0 unless they were picked before.
+class RetagSampler {
+ public:
+  static ABSL_ATTRIBUTE_ALWAYS_INLINE bool ShouldRetag() {
+    const int64_t interval = Parameters::selsan_sampling_interval();
+    if (ABSL_PREDICT_TRUE(interval <= 1)) {
+      return true;
+    }
+    if (ABSL_PREDICT_TRUE(--frees_until_retag_ > 0)) {
+      return false;
+    }
+    PickNextRetag(interval);
+    return true;
+  }
+
+ private:
+  ABSL_ATTRIBUTE_NOINLINE static void PickNextRetag(int64_t interval) {
+    if (rnd_ == 0) {
+      rnd_ = reinterpret_cast<uintptr_t>(&rnd_);
+    }
+    rnd_ = ExponentialBiased::NextRandom(rnd_);
+    // q is uniform in (0, 1], so -log(q) * interval is exponentially
+    // distributed with mean interval.
+    const double q = (ExponentialBiased::GetRandom(rnd_) + 1.0) / 0x1p32;
+    frees_until_retag_ =
+        std::max<int64_t>(1, std::llround(-std::log(q) * interval));
+  }
+
+  static thread_local int64_t frees_until_retag_ ABSL_ATTRIBUTE_INITIAL_EXEC;
+  static thread_local uint64_t rnd_ ABSL_ATTRIBUTE_INITIAL_EXEC;
+};
+
+ABSL_CONST_INIT thread_local int64_t RetagSampler::frees_until_retag_
+    ABSL_ATTRIBUTE_INITIAL_EXEC = 0;
+ABSL_CONST_INIT thread_local uint64_t RetagSampler::rnd_
+    ABSL_ATTRIBUTE_INITIAL_EXEC = 0;
+
+// Retags ptr, of the given size, if the sampler picks it.
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* MaybeUpdateTag(void* ptr,
+                                                         size_t size) {
+  if (!RetagSampler::ShouldRetag()) {
+    return ptr;
+  }
+  return UpdateTag(ptr, size);
+}
 }  // namespace selsan
 
 namespace {
 
+// Returns true if page-level allocations with this hint belong in the warm
+// tier.  Smaller ones stay in normal memory: the warm tier has no size classes
+// of its own.
+inline bool IsWarmHint(hot_cold_t hint) {
+  return kWarmTierPresent && tc_globals.page_allocator().has_warm_tier() &&
+         hint >= Parameters::min_hot_access_hint() &&
+         hint <= Parameters::max_warm_access_hint();
+}
+
 template <typename Policy>
 inline sized_ptr_t do_malloc_pages(size_t size, size_t weight, Policy policy,
                                    hot_cold_t hint) {
@@ -607,13 +1071,55 @@ inline sized_ptr_t do_malloc_pages(size_t size, size_t weight, Policy policy,
   MemoryTag tag = MemoryTag::kNormal;
   if (IsColdHint(policy.access())) {
     tag = MemoryTag::kCold;
+  } else if (ABSL_PREDICT_FALSE(IsWarmHint(hint))) {
+    tag = MemoryTag::kWarm;
   } else if (tc_globals.numa_topology().numa_aware()) {
     tag = NumaNormalTag(policy.numa_partition());
   }
-  Span* span = tc_globals.page_allocator().NewAligned(
-      num_pages, BytesToLengthCeil(policy.align()),
-      {1, AccessDensityPrediction::kSparse}, tag);
-  if (span == nullptr) return {nullptr, 0};
+
+  // Page-level allocations are rare and costly enough that we can afford to
+  // find their callsite, and place those without an explicit hint in cold
+  // memory if the callsite's sampled allocations tend to be long-lived.  The
+  // stack also serves as the sample's, so that the lifetimes recorded when
+  // samples are freed are keyed the same way.
+  void* stack[kMaxStackDepth];
+  size_t depth = 0;
+  LifetimePrediction callsite_lifetime = LifetimePrediction::kUnknown;
+  if (ABSL_PREDICT_FALSE(Parameters::cold_callsite_classification() ||
+                         Parameters::lifetime_aware_filler_placement())) {
+    depth = absl::GetStackTrace(stack, kMaxStackDepth, 0);
+    callsite_lifetime = tc_globals.callsite_lifetimes().Predict(
+        absl::MakeConstSpan(stack, depth));
+  }
+  if (Parameters::cold_callsite_classification() && ColdFeatureActive() &&
+      hint == AllocationAccessHotPolicy::access() &&
+      callsite_lifetime == LifetimePrediction::kLongLived) {
+    tag = MemoryTag::kCold;
+  }
+  SpanAllocInfo span_alloc_info = {1, AccessDensityPrediction::kSparse};
+  if (Parameters::lifetime_aware_region_placement()) {
+    span_alloc_info.lifetime =
+        tc_globals.large_allocation_lifetimes().Predict(num_pages);
+  }
+  // Allocations that fit in a hugepage are told apart by their callsite, for
+  // the page allocator to keep short-lived ones on hugepages of their own.
+  if (Parameters::lifetime_aware_filler_placement() &&
+      num_pages < kPagesPerHugePage) {
+    span_alloc_info.lifetime = callsite_lifetime;
+  }
+  // Take a recently freed span of the same size if there is one, skipping
+  // pageheap_lock.  Sampled allocations keep to the page heap, so that their
+  // spans are accounted as they always were.
+  Span* span = nullptr;
+  if (weight == 0 && policy.align() <= kPageSize) {
+    span = LargeSpanCache::Get(num_pages, tag);
+  }
+  const bool cached = span != nullptr;
+  if (!cached) {
+    span = tc_globals.page_allocator().NewAligned(
+        num_pages, BytesToLengthCeil(policy.align()), span_alloc_info, tag);
+    if (span == nullptr) return {nullptr, 0};
+  }
 
   // Set capacity to the exact size for a page allocation.  This needs to be
   // revisited if we introduce gwp-asan sampling / guarded allocations to
@@ -621,15 +1127,119 @@ inline sized_ptr_t do_malloc_pages(size_t size, size_t weight, Policy policy,
   sized_ptr_t res{span->start_address(), num_pages.in_bytes()};
   TC_ASSERT(!ColdFeatureActive() || tag == GetMemoryTag(span->start_address()));
 
+  // Fault large allocations in now, outside of pageheap_lock, rather than a
+  // page at a time on first touch.  Cold memory is expected to go mostly
+  // untouched, so we leave it be, and cached spans have been touched before.
+  if (const uint64_t threshold =
+          Parameters::large_allocation_prefault_threshold();
+      ABSL_PREDICT_FALSE(threshold != 0) && size >= threshold &&
+      tag != MemoryTag::kCold && !cached) {
+    // Failure only means the pages are faulted in on first touch.
+    (void)SystemPopulate(res.p, res.n);
+  }
+
   if (weight != 0) {
-    auto ptr =
-        SampleLargeAllocation(tc_globals, policy, size, weight, span, hint);
+    auto ptr = SampleLargeAllocation(tc_globals, policy, size, weight, span,
+                                     hint, absl::MakeConstSpan(stack, depth));
     TC_CHECK_EQ(res.p, ptr.p);
   }
 
   return res;
 }
 
+// Remapping pages costs a few system calls, TLB shootdowns and a split of the
+// mappings involved, so it only pays off over copying for large allocations.
+constexpr size_t kMinRemapBytes = 16 * kHugePageSize;
+
+// Reallocates the page-level allocation at ptr to new_size bytes without
+// copying it, preferring alloc_size bytes if the pages after it allow.  It is
+// resized in place where the pages it grows into are free, or else, if large
+// enough, its pages are moved to a new allocation.  Returns the allocation,
+// or nullptr if realloc has to allocate and copy instead: ptr is sampled, or
+// hooks have to see a new allocation, or else neither way works out.
+static void* ReallocPagesWithoutCopy(void* ptr, size_t old_size,
+                                     size_t new_size, size_t alloc_size) {
+  if (new_size <= kMaxSize || ABSL_PREDICT_FALSE(Static::HaveHooks()) ||
+      ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active())) {
+    return nullptr;
+  }
+  const PageId p = PageIdContainingTagged(ptr);
+  if (tc_globals.pagemap().sizeclass(p) != 0) {
+    return nullptr;
+  }
+  Span* span = tc_globals.pagemap().GetExistingDescriptor(p);
+  TC_ASSERT_NE(span, nullptr);
+  // Sampled allocations, including guarded ones, are reallocated so that the
+  // profile shows the new size.  So are those the new size would sample.
+  // Interleaved ones are copied too, so that their pages go through
+  // SystemUninterleave when they are freed.
+  Sampler* sampler = GetThreadSampler();
+  if (span->sampled() || span->interleaved() ||
+      sampler->WillRecordAllocation(new_size)) {
+    return nullptr;
+  }
+  const MemoryTag tag = GetMemoryTag(ptr);
+  PageAllocator& page_allocator = tc_globals.page_allocator();
+  void* result = nullptr;
+  if ((alloc_size != new_size &&
+       page_allocator.ResizeInPlace(span, BytesToLengthCeil(alloc_size),
+                                    tag)) ||
+      page_allocator.ResizeInPlace(span, BytesToLengthCeil(new_size), tag)) {
+    result = ptr;
+  } else if (new_size > old_size && old_size >= kMinRemapBytes) {
+    const SpanAllocInfo span_alloc_info = {1, AccessDensityPrediction::kSparse};
+    if (Span* moved = page_allocator.Remap(
+            span, BytesToLengthCeil(alloc_size), span_alloc_info, tag)) {
+      result = moved->start_address();
+    }
+  }
+  if (result == nullptr) {
+    return nullptr;
+  }
+  AccountFree(old_size);
+  AccountAllocation(
+      tc_globals.pagemap().GetExistingDescriptor(PageIdContaining(result))
+          ->bytes_in_span());
+  // Count the bytes towards the next sample as realloc would have.
+  const bool recorded = sampler->TryRecordAllocationFast(new_size);
+  TC_ASSERT(recorded);
+  (void)recorded;
+  return result;
+}
+
+// Returns true if the just-allocated ptr of the given size is backed by pages
+// fresh from the system, which the kernel has already zeroed for us.
+static bool IsKnownZero(void* ptr, size_t size) {
+  if (size <= kMaxSize) {
+    return false;
+  }
+  const PageId p = PageIdContainingTagged(ptr);
+  if (tc_globals.pagemap().sizeclass(p) != 0) {
+    return false;
+  }
+  const Span* span = tc_globals.pagemap().GetExistingDescriptor(p);
+  TC_ASSERT_NE(span, nullptr);
+  return !span->sampled() && span->zeroed();
+}
+
+// Interleaves the pages backing the just-allocated ptr of the given size across
+// NUMA nodes if it is a page-level allocation.  Smaller objects share their
+// pages with others and are left alone.
+static void MaybeInterleave(void* ptr, size_t size) {
+  if (ptr == nullptr || size <= kMaxSize) {
+    return;
+  }
+  const PageId p = PageIdContainingTagged(ptr);
+  if (tc_globals.pagemap().sizeclass(p) != 0) {
+    return;
+  }
+  Span* span = tc_globals.pagemap().GetExistingDescriptor(p);
+  TC_ASSERT_NE(span, nullptr);
+  if (SystemInterleave(span->start_address(), span->bytes_in_span())) {
+    span->set_interleaved(true);
+  }
+}
+
 // Handles freeing object that doesn't have size class, i.e. which
 // is either large or sampled. We explicitly prevent inlining it to
 // keep it out of fast-path. This helps avoid expensive
@@ -641,16 +1251,29 @@ static void InvokeHooksAndFreePages(void* ptr, std::optional<size_t> size) {
   Span* span = tc_globals.pagemap().GetExistingDescriptor(p);
   TC_CHECK_NE(span, nullptr, "Possible double free detected");
 
+  const bool sampled = span->sampled();
+  // Sampled small objects have a span of their own, so their capacity is
+  // that of their size class, as when they were allocated.
+  AccountFree(sampled ? span->sampled_allocation()->details.allocated_size
+                      : span->bytes_in_span());
+  TraceDelete(ptr, sampled ? span->sampled_allocation()->details.allocated_size
+                           : span->bytes_in_span());
   MaybeUnsampleAllocation(tc_globals, ptr, size, span);
 
   if (ABSL_PREDICT_FALSE(
           tc_globals.guardedpage_allocator().PointerIsMine(ptr))) {
     tc_globals.guardedpage_allocator().Deallocate(ptr);
-    PageHeapSpinLockHolder l;
-    Span::Delete(span);
+    SpanRecycler::Delete(span);
   } else {
     TC_ASSERT_EQ(span->first_page(), p);
     TC_ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % kPageSize, 0);
+    if (ABSL_PREDICT_FALSE(span->interleaved())) {
+      SystemUninterleave(span->start_address(), span->bytes_in_span(),
+                         GetMemoryTag(ptr));
+    } else if (!sampled && IsNormalMemory(ptr) &&
+               LargeSpanCache::Put(span, GetMemoryTag(ptr))) {
+      return;
+    }
     PageHeapSpinLockHolder l;
     tc_globals.page_allocator().Delete(span, /*objects_per_span=*/1,
                                        GetMemoryTag(ptr));
@@ -674,6 +1297,14 @@ static size_t GetSizeClass(void* ptr) {
 // "have_size_class-case" and others are "!have_size_class-case". But we
 // certainly don't have such compiler. See also do_free_with_size below.
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void do_free(void* ptr) {
+  // Pointers from the allocation fast path may carry their size class.
+  if (const size_t size_class = size_class_tags::GetTag(ptr);
+      size_class != 0) {
+    ptr = size_class_tags::RemoveTag(ptr);
+    TC_ASSERT_EQ(size_class, GetSizeClass(ptr));
+    FreeSmall(ptr, size_class);
+    return;
+  }
   if (!kSelSanPresent || ABSL_PREDICT_FALSE(!IsNormalMemory(ptr))) {
     if (ABSL_PREDICT_FALSE(ptr == nullptr)) {
       return;
@@ -682,7 +1313,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void do_free(void* ptr) {
       size_t size_class =
           tc_globals.pagemap().sizeclass(PageIdContainingTagged(ptr));
       size_t size = tc_globals.sizemap().class_to_size(size_class);
-      ptr = selsan::UpdateTag(ptr, size);
+      ptr = selsan::MaybeUpdateTag(ptr, size);
       FreeSmall(ptr, size_class);
       return;
     }
@@ -717,6 +1348,10 @@ ABSL_ATTRIBUTE_NOINLINE static void free_non_normal(void* ptr, size_t size,
     // we don't know true class size of the ptr
     return InvokeHooksAndFreePages(ptr, size);
   }
+  if (GetMemoryTag(ptr) == MemoryTag::kWarm) {
+    // The warm tier only has page-level allocations.
+    return InvokeHooksAndFreePages(ptr, size);
+  }
   TC_ASSERT_EQ(GetMemoryTag(ptr), MemoryTag::kCold);
   size_t size_class;
   if (ABSL_PREDICT_FALSE(!tc_globals.sizemap().GetSizeClass(
@@ -737,6 +1372,15 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void do_free_with_size(void* ptr,
   TC_ASSERT(
       CorrectAlignment(ptr, static_cast<std::align_val_t>(align.align())));
 
+  // A size class tag is cheaper still than the computation below.
+  if (const size_t size_class = size_class_tags::GetTag(ptr);
+      size_class != 0) {
+    ptr = size_class_tags::RemoveTag(ptr);
+    TC_ASSERT(CorrectSize(ptr, size, align));
+    FreeSmall(ptr, size_class);
+    return;
+  }
+
   // This is an optimized path that may be taken if the binary is compiled
   // with -fsized-delete. We attempt to discover the size class cheaply
   // without any cache misses by doing a plain computation that
@@ -753,7 +1397,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void do_free_with_size(void* ptr,
       size_t size_class = tc_globals.sizemap().SizeClass(
           CppPolicy().AlignAs(align.align()).InSameNumaPartitionAs(ptr), size);
       size = tc_globals.sizemap().class_to_size(size_class);
-      ptr = selsan::UpdateTag(ptr, size);
+      ptr = selsan::MaybeUpdateTag(ptr, size);
       FreeSmall(ptr, size_class);
       return;
     }
@@ -835,9 +1479,10 @@ bool CorrectAlignment(void* ptr, std::align_val_t alignment) {
 inline void do_malloc_stats() { PrintStats(1); }
 
 inline int do_malloc_trim(size_t pad) {
-  // We ignore pad for now and just do a best effort release of pages.
+  // We ignore pad for now, and release all the memory we can: as with glibc,
+  // the caches are trimmed too.
   static_cast<void>(pad);
-  return MallocExtension_Internal_ReleaseMemoryToSystem(0) != 0 ? 1 : 0;
+  return ReleaseAllCachedMemoryNow() != 0 ? 1 : 0;
 }
 
 inline int do_mallopt(int cmd, int value) {
@@ -846,8 +1491,7 @@ inline int do_mallopt(int cmd, int value) {
 
 #ifdef TCMALLOC_HAVE_STRUCT_MALLINFO
 inline struct mallinfo do_mallinfo() {
-  TCMallocStats stats;
-  ExtractTCMallocStats(&stats, false);
+  const StatsTotals totals = GetStatsTotals();
 
   // Just some of the fields are filled in.
   struct mallinfo info;
@@ -855,12 +1499,10 @@ inline struct mallinfo do_mallinfo() {
 
   // Unfortunately, the struct contains "int" field, so some of the
   // size values will be truncated.
-  info.arena = static_cast<int>(stats.pageheap.system_bytes);
-  info.fsmblks = static_cast<int>(stats.thread_bytes + stats.central_bytes +
-                                  stats.transfer_bytes);
-  info.fordblks = static_cast<int>(stats.pageheap.free_bytes +
-                                   stats.pageheap.unmapped_bytes);
-  info.uordblks = static_cast<int>(InUseByApp(stats));
+  info.arena = static_cast<int>(totals.system_bytes);
+  info.fsmblks = static_cast<int>(totals.cache_bytes);
+  info.fordblks = static_cast<int>(totals.free_bytes + totals.unmapped_bytes);
+  info.uordblks = static_cast<int>(totals.bytes_in_use_by_app);
 
   return info;
 }
@@ -868,19 +1510,17 @@ inline struct mallinfo do_mallinfo() {
 
 #ifdef TCMALLOC_HAVE_STRUCT_MALLINFO2
 inline struct mallinfo2 do_mallinfo2() {
-  TCMallocStats stats;
-  ExtractTCMallocStats(&stats, false);
+  const StatsTotals totals = GetStatsTotals();
 
   // Just some of the fields are filled in.
   struct mallinfo2 info;
   memset(&info, 0, sizeof(info));
 
-  info.arena = static_cast<size_t>(stats.pageheap.system_bytes);
-  info.fsmblks = static_cast<size_t>(stats.thread_bytes + stats.central_bytes +
-                                     stats.transfer_bytes);
-  info.fordblks = static_cast<size_t>(stats.pageheap.free_bytes +
-                                      stats.pageheap.unmapped_bytes);
-  info.uordblks = static_cast<size_t>(InUseByApp(stats));
+  info.arena = static_cast<size_t>(totals.system_bytes);
+  info.fsmblks = static_cast<size_t>(totals.cache_bytes);
+  info.fordblks =
+      static_cast<size_t>(totals.free_bytes + totals.unmapped_bytes);
+  info.uordblks = static_cast<size_t>(totals.bytes_in_use_by_app);
 
   return info;
 }
@@ -936,11 +1576,16 @@ alloc_small_sampled_hooks_or_perthread(size_t size, size_t size_class,
   tcmalloc::sized_ptr_t ptr = {res,
                                tc_globals.sizemap().class_to_size(size_class)};
   if (ABSL_PREDICT_FALSE(weight != 0)) {
+    if (UsePerCpuCache(tc_globals)) {
+      // The sample weight estimates the bytes allocated since the last sample,
+      // which per-cpu caches use to budget capacity by allocation rate.
+      tc_globals.cpu_cache().RecordAllocatedBytes(
+          subtle::percpu::VirtualCpu::get(), size_class, weight);
+    }
     ptr = SampleSmallAllocation(tc_globals, policy, size, weight, size_class,
                                 ptr, hint);
   }
-  if (Policy::invoke_hooks()) {
-  }
+  TraceNew<Policy>(ptr.p, size);
   return Policy::as_pointer(ptr.p, ptr.n);
 }
 
@@ -968,25 +1613,53 @@ slow_alloc_small(size_t size, uint32_t size_class, Policy policy,
 
   void* res = tc_globals.cpu_cache().AllocateSlowNoHooks(size_class);
   if (ABSL_PREDICT_FALSE(res == nullptr)) return policy.handle_oom(size);
+  TraceNew<Policy>(res, size);
   return Policy::to_pointer(res, size_class);
 }
 
+// Refills the calling thread's magazine for <size_class> with a single batch
+// from the per-cpu cache and returns one of the objects. Returns nullptr if the
+// allocation has to take the regular slow path.
+ABSL_ATTRIBUTE_NOINLINE static void* RefillThreadMagazine(size_t size_class) {
+  if (ABSL_PREDICT_FALSE(Static::HaveHooks()) ||
+      ABSL_PREDICT_FALSE(!UsePerCpuCache(tc_globals))) {
+    return nullptr;
+  }
+  ThreadMagazine::RegisterThread();
+  ThreadMagazine& magazine = ThreadMagazine::Get();
+  if (!magazine.registered()) {
+    return tc_globals.cpu_cache().AllocateFast(size_class);
+  }
+  return magazine.Refill(tc_globals.cpu_cache(), size_class);
+}
+
 template <typename Policy>
 ABSL_ATTRIBUTE_NOINLINE static typename Policy::pointer_type slow_alloc_large(
     size_t size, Policy policy, hot_cold_t hint) {
   size_t weight = GetThreadSampler()->RecordAllocation(size);
   tcmalloc::sized_ptr_t res = do_malloc_pages(size, weight, policy, hint);
   if (ABSL_PREDICT_FALSE(res.p == nullptr)) return policy.handle_oom(size);
-
-  if (Policy::invoke_hooks()) {
-  }
+  AccountAllocation(res.n);
+  TraceNew<Policy>(res.p, size);
   return Policy::as_pointer(res.p, res.n);
 }
 
+template <typename Policy>
+static typename Policy::pointer_type alloc_with_thread_policy(size_t size,
+                                                              Policy policy,
+                                                              hot_cold_t hint);
+
 template <typename Policy, typename Pointer = typename Policy::pointer_type>
 static inline Pointer ABSL_ATTRIBUTE_ALWAYS_INLINE
 fast_alloc(size_t size, Policy policy,
            hot_cold_t hint = AllocationAccessHotPolicy::access()) {
+  if constexpr (Policy::follows_thread_policy()) {
+    if (ABSL_PREDICT_FALSE(ThreadAllocationPolicy::Get().active())) {
+      SLOW_PATH_BARRIER();
+      TCMALLOC_MUSTTAIL return alloc_with_thread_policy(size, policy, hint);
+    }
+  }
+
   // If size is larger than kMaxSize, it's not fast-path anymore. In
   // such case, GetSizeClass will return false, and we'll delegate to the slow
   // path. If malloc is not yet initialized, we may end up with size_class == 0
@@ -998,6 +1671,7 @@ fast_alloc(size_t size, Policy policy,
     SLOW_PATH_BARRIER();
     TCMALLOC_MUSTTAIL return slow_alloc_large(size, policy, hint);
   }
+  AccountSmallAllocations(size_class, 1);
 
   // TryRecordAllocationFast() returns true if no extra logic is required, e.g.:
   // - this allocation does not need to be sampled
@@ -1015,14 +1689,202 @@ fast_alloc(size_t size, Policy policy,
   // - cpu / thread cache data has been initialized.
   // - the allocation is not subject to sampling / gwp-asan.
   // - no new/delete hook is installed and required to be called.
-  void* ret = tc_globals.cpu_cache().AllocateFast(size_class);
+  //
+  // Objects held by the thread's magazine, if any, are used first.
+  void* ret = ThreadMagazine::Get().Pop(size_class);
+  if (ABSL_PREDICT_TRUE(ret == nullptr)) {
+    if (ABSL_PREDICT_FALSE(Parameters::per_cpu_caches_thread_magazine()) &&
+        size_class < ThreadMagazine::kNumClasses) {
+      ret = RefillThreadMagazine(size_class);
+    } else {
+      ret = tc_globals.cpu_cache().AllocateFast(size_class);
+    }
+  }
   if (ABSL_PREDICT_FALSE(ret == nullptr)) {
     SLOW_PATH_BARRIER();
     return slow_alloc_small(size, size_class, policy, hint);
   }
 
   TC_ASSERT_NE(ret, nullptr);
-  return Policy::to_pointer(ret, size_class);
+  TraceNew<Policy>(ret, size);
+  return Policy::to_pointer(size_class_tags::AddTag(ret, size_class),
+                            size_class);
+}
+
+// Allocates like fast_alloc, but as the calling thread's
+// ScopedAllocationPolicy asks for.  The policies used don't follow the thread
+// policy, so we don't come back here.
+template <typename Policy>
+ABSL_ATTRIBUTE_NOINLINE static typename Policy::pointer_type
+alloc_with_thread_policy(size_t size, Policy policy, hot_cold_t hint) {
+  const ThreadAllocationPolicy& thread_policy = ThreadAllocationPolicy::Get();
+  hint = thread_policy.access();
+  // Cold memory is not NUMA partitioned, so the partition does not matter.
+  if (hint < Parameters::min_hot_access_hint()) {
+    return fast_alloc(size, policy.AccessAsCold(), hint);
+  }
+  const int partition = thread_policy.numa_partition();
+  return fast_alloc(
+      size,
+      policy.InNumaPartition(partition >= 0 ? partition
+                                            : policy.numa_partition()),
+      hint);
+}
+
+// Allocates up to <n> objects of <size> bytes into <batch>. The unsampled
+// prefix of the batch is served by a single per-cpu cache operation; the
+// allocation that trips the sampler, and everything after it, falls back to
+// fast_alloc, which handles sampling, hooks, per-thread mode and thread
+// allocation policies as usual.
+static size_t do_alloc_batch(size_t size, void** batch, size_t n) {
+  MallocPolicy policy;
+  size_t size_class;
+  size_t done = 0;
+  if (ABSL_PREDICT_TRUE(!ThreadAllocationPolicy::Get().active()) &&
+      ABSL_PREDICT_TRUE(
+          tc_globals.sizemap().GetSizeClass(policy, size, &size_class)) &&
+      ABSL_PREDICT_TRUE(size_class != 0) &&
+      ABSL_PREDICT_TRUE(!Static::HaveHooks()) &&
+      ABSL_PREDICT_TRUE(!tc_globals.allocation_event_tracer().active()) &&
+      ABSL_PREDICT_TRUE(UsePerCpuCache(tc_globals))) {
+    Sampler* sampler = GetThreadSampler();
+    size_t unsampled = 0;
+    bool sample = false;
+    while (unsampled < n) {
+      if (ABSL_PREDICT_FALSE(!sampler->TryRecordAllocationFast(size))) {
+        sample = true;
+        break;
+      }
+      ++unsampled;
+    }
+    AccountSmallAllocations(size_class, unsampled + sample);
+    done = tc_globals.cpu_cache().AllocateBatch(size_class, batch, unsampled);
+    if (ABSL_PREDICT_FALSE(done != unsampled)) {
+      // The allocations are already accounted for by the sampler.
+      for (; done < unsampled; ++done) {
+        void* res = tc_globals.cpu_cache().AllocateSlowNoHooks(size_class);
+        if (ABSL_PREDICT_FALSE(res == nullptr)) {
+          policy.handle_oom(size);
+          return done;
+        }
+        batch[done] = res;
+      }
+    }
+    if (sample) {
+      // TryRecordAllocationFast failed for this allocation, so complete it on
+      // the slow path, which consults RecordedAllocationFast.
+      void* res = slow_alloc_small(size, size_class, policy,
+                                   AllocationAccessHotPolicy::access());
+      if (ABSL_PREDICT_FALSE(res == nullptr)) return done;
+      batch[done++] = res;
+    }
+  }
+  for (; done < n; ++done) {
+    void* res = fast_alloc(size, policy);
+    if (ABSL_PREDICT_FALSE(res == nullptr)) break;
+    batch[done] = res;
+  }
+  return done;
+}
+
+// Frees <n> objects of <size> bytes from <batch>. Normal-memory objects from
+// the same NUMA partition as the first one are returned to the per-cpu cache
+// in chunks; everything else (nullptr, sampled, cold, selsan, other partition)
+// is freed individually.  The hook check and size class lookup are done once
+// for the whole batch.
+static void do_free_batch(void** batch, size_t n, size_t size) {
+  size_t size_class = 0;
+  MemoryTag tag = MemoryTag::kNormal;
+  void* chunk[kMaxObjectsToMove];
+  size_t count = 0;
+  bool batched =
+      ABSL_PREDICT_TRUE(!Static::HaveHooks()) &&
+      ABSL_PREDICT_TRUE(!tc_globals.allocation_event_tracer().active()) &&
+      ABSL_PREDICT_TRUE(UsePerCpuCache(tc_globals));
+  for (size_t i = 0; i < n; ++i) {
+    void* ptr = size_class_tags::RemoveTag(batch[i]);
+    if (!batched || !IsNormalMemory(ptr) ||
+        (size_class != 0 && GetMemoryTag(ptr) != tag)) {
+      do_free_with_size(ptr, size, MallocAlignPolicy());
+      continue;
+    }
+    if (size_class == 0) {
+      if (ABSL_PREDICT_FALSE(!tc_globals.sizemap().GetSizeClass(
+              CppPolicy().InSameNumaPartitionAs(ptr), size, &size_class))) {
+        // size > kMaxSize: the batch consists of page allocations, which gain
+        // nothing from batching, so we stop looking up the size class.
+        batched = false;
+        do_free_with_size(ptr, size, MallocAlignPolicy());
+        continue;
+      }
+      tag = GetMemoryTag(ptr);
+    }
+    TC_ASSERT(CorrectSize(ptr, size, MallocAlignPolicy()));
+    chunk[count++] = ptr;
+    if (count == kMaxObjectsToMove) {
+      AccountSmallFrees(size_class, count);
+      tc_globals.cpu_cache().DeallocateBatch(size_class, chunk, count);
+      count = 0;
+    }
+  }
+  if (count != 0) {
+    AccountSmallFrees(size_class, count);
+    tc_globals.cpu_cache().DeallocateBatch(size_class, chunk, count);
+  }
+}
+
+// Frees the <n> objects of any sizes in <batch>. Each window of the batch is
+// looked up in the pagemap first, with no dependency between lookups, so
+// their cache misses overlap, rather than being taken one free at a time.
+// The normal-memory objects are then sorted by size class and returned to the
+// per-cpu cache a run of one class at a time; everything else (nullptr,
+// sampled, page allocations, cold, selsan) is freed individually.
+static void do_free_unsized_batch(void** batch, size_t n) {
+  if (ABSL_PREDICT_FALSE(Static::HaveHooks()) ||
+      ABSL_PREDICT_FALSE(tc_globals.allocation_event_tracer().active()) ||
+      ABSL_PREDICT_FALSE(!UsePerCpuCache(tc_globals))) {
+    for (size_t i = 0; i < n; ++i) {
+      do_free(batch[i]);
+    }
+    return;
+  }
+
+  struct Entry {
+    size_t size_class;
+    void* ptr;
+  };
+  constexpr size_t kWindow = kMaxObjectsToMove;
+  Entry entries[kWindow];
+  void* chunk[kWindow];
+  for (size_t start = 0; start < n; start += kWindow) {
+    const size_t len = std::min(kWindow, n - start);
+    for (size_t i = 0; i < len; ++i) {
+      void* ptr = batch[start + i];
+      size_t size_class = size_class_tags::GetTag(ptr);
+      ptr = size_class_tags::RemoveTag(ptr);
+      if (size_class == 0 && ptr != nullptr && IsNormalMemory(ptr)) {
+        size_class = tc_globals.pagemap().sizeclass(PageIdContaining(ptr));
+      }
+      entries[i] = {size_class, ptr};
+    }
+    std::sort(entries, entries + len, [](const Entry& a, const Entry& b) {
+      return a.size_class < b.size_class;
+    });
+
+    size_t i = 0;
+    for (; i < len && entries[i].size_class == 0; ++i) {
+      do_free(entries[i].ptr);
+    }
+    while (i < len) {
+      const size_t size_class = entries[i].size_class;
+      size_t count = 0;
+      for (; i < len && entries[i].size_class == size_class; ++i) {
+        chunk[count++] = entries[i].ptr;
+      }
+      AccountSmallFrees(size_class, count);
+      tc_globals.cpu_cache().DeallocateBatch(size_class, chunk, count);
+    }
+  }
 }
 
 }  // namespace tcmalloc_internal
@@ -1031,6 +1893,11 @@ GOOGLE_MALLOC_SECTION_END
 
 using tcmalloc::tcmalloc_internal::GetOwnership;
 using tcmalloc::tcmalloc_internal::GetSize;
+using tcmalloc::tcmalloc_internal::GetSizeWithHint;
+using tcmalloc::tcmalloc_internal::IsNormalMemory;
+using tcmalloc::tcmalloc_internal::SizeClassWithHint;
+using tcmalloc::tcmalloc_internal::ThreadAllocationLabel;
+using tcmalloc::tcmalloc_internal::ThreadAllocationPolicy;
 
 extern "C" size_t MallocExtension_Internal_GetAllocatedSize(const void* ptr) {
   TC_ASSERT(!ptr || GetOwnership(ptr) !=
@@ -1038,6 +1905,39 @@ extern "C" size_t MallocExtension_Internal_GetAllocatedSize(const void* ptr) {
   return GetSize(ptr);
 }
 
+extern "C" size_t MallocExtension_Internal_GetAllocatedSizeWithHint(
+    const void* ptr, size_t size) {
+  TC_ASSERT(!ptr || GetOwnership(ptr) !=
+                        tcmalloc::MallocExtension::Ownership::kNotOwned);
+  return GetSizeWithHint(ptr, size);
+}
+
+extern "C" void MallocExtension_Internal_SwapAllocationPolicy(
+    tcmalloc::MallocExtension::AllocationPolicy* policy) {
+  tc_globals.InitIfNecessary();
+
+  ThreadAllocationPolicy& thread_policy = ThreadAllocationPolicy::Get();
+  const tcmalloc::MallocExtension::AllocationPolicy previous = {
+      .access = thread_policy.access(),
+      .numa_partition = thread_policy.numa_partition(),
+  };
+  int partition = policy->numa_partition;
+  if (partition < 0 || static_cast<size_t>(partition) >=
+                           tc_globals.numa_topology().active_partitions()) {
+    partition = -1;
+  }
+  thread_policy.Set(policy->access, partition);
+  *policy = previous;
+}
+
+extern "C" void MallocExtension_Internal_SwapAllocationLabel(int* label) {
+  int next = *label;
+  if (next < 0 || next >= tcmalloc::MallocExtension::kNumAllocationLabels) {
+    next = 0;
+  }
+  *label = ThreadAllocationLabel::Swap(next);
+}
+
 extern "C" void MallocExtension_Internal_MarkThreadBusy() {
   tc_globals.InitIfNecessary();
 
@@ -1079,6 +1979,110 @@ MallocTracingExtension_Internal_GetAllocatedAddressRanges() {
       "output vector.");
 }
 
+absl::StatusOr<uint64_t>
+MallocTracingExtension_Internal_ForEachAllocatedAddressRange(
+    const tcmalloc::malloc_tracing_extension::AddressRangeScanOptions& options,
+    absl::FunctionRef<void(
+        const tcmalloc::malloc_tracing_extension::AllocatedAddressRangeBatch&)>
+        callback) {
+  using tcmalloc::malloc_tracing_extension::AddressRangeKind;
+  using tcmalloc::malloc_tracing_extension::AllocatedAddressRanges;
+  using tcmalloc::tcmalloc_internal::kAddressBits;
+  using tcmalloc::tcmalloc_internal::kNumaPartitions;
+  using tcmalloc::tcmalloc_internal::kTagShift;
+  using tcmalloc::tcmalloc_internal::MemoryTag;
+  using tcmalloc::tcmalloc_internal::PageId;
+  using tcmalloc::tcmalloc_internal::PageIdContaining;
+  using tcmalloc::tcmalloc_internal::PageMap;
+
+  tc_globals.InitIfNecessary();
+
+  // The parts of the address space to look at.  Each tag has its own.
+  std::pair<PageId, PageId> windows[kNumaPartitions + 1];
+  size_t num_windows = 0;
+  auto add_tag = [&](MemoryTag tag) {
+    const uintptr_t start = static_cast<uintptr_t>(tag) << kTagShift;
+    windows[num_windows++] = {
+        PageIdContaining(reinterpret_cast<void*>(start)),
+        PageIdContaining(reinterpret_cast<void*>(start + (uintptr_t{1}
+                                                          << kTagShift)))};
+  };
+  switch (options.kind) {
+    case AddressRangeKind::kAll:
+      windows[num_windows++] = {
+          PageId{0}, PageIdContaining(reinterpret_cast<void*>(
+                         uintptr_t{1} << kAddressBits))};
+      break;
+    case AddressRangeKind::kNormal:
+      for (size_t partition = 0; partition < kNumaPartitions; ++partition) {
+        add_tag(tcmalloc::tcmalloc_internal::NumaNormalTag(partition));
+      }
+      break;
+    case AddressRangeKind::kSampled:
+      add_tag(MemoryTag::kSampled);
+      break;
+    case AddressRangeKind::kCold:
+      add_tag(MemoryTag::kCold);
+      break;
+  }
+
+  PageMap& pagemap = tc_globals.pagemap();
+  uint64_t epoch;
+  {
+    AllocationGuardSpinLockHolder l(
+        &tcmalloc::tcmalloc_internal::pageheap_lock);
+    epoch = pagemap.StartScan();
+  }
+
+  // Spans are copied here under the pageheap_lock, a leaf or a buffer at a
+  // time, and handed to the callback once it is dropped.
+  constexpr size_t kBatchSpans = 256;
+  AllocatedAddressRanges::SpanDetails batch[kBatchSpans];
+  for (size_t w = 0; w < num_windows; ++w) {
+    const auto [window_start, window_limit] = windows[w];
+    PageId p = window_start;
+    while (p < window_limit) {
+      PageId start, limit;
+      size_t n;
+      {
+        AllocationGuardSpinLockHolder l(
+            &tcmalloc::tcmalloc_internal::pageheap_lock);
+        std::optional<PageId> leaf = pagemap.NextChangedLeaf(
+            p, window_limit, options.changed_since_epoch);
+        if (!leaf.has_value()) break;
+        start = std::max(p, *leaf);
+        limit = std::min(window_limit, *leaf + PageMap::kPagesPerLeaf);
+        p = start;
+        n = pagemap.GetAllocatedSpans(&p, limit, absl::MakeSpan(batch));
+      }
+      callback({start.start_uintptr(), p.start_uintptr(),
+                absl::MakeConstSpan(batch, n)});
+    }
+  }
+  return epoch;
+}
+
+absl::Status MallocTracingExtension_Internal_StartAllocationEventTrace() {
+  tc_globals.InitIfNecessary();
+  if (!tc_globals.allocation_event_tracer().Start()) {
+    return absl::FailedPreconditionError(
+        "An allocation event trace is already running.");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MallocTracingExtension_Internal_StopAllocationEventTrace() {
+  tc_globals.allocation_event_tracer().Stop();
+  return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> MallocTracingExtension_Internal_DrainAllocationEvents(
+    absl::FunctionRef<void(
+        absl::Span<const tcmalloc::malloc_tracing_extension::AllocationEvent>)>
+        callback) {
+  return tc_globals.allocation_event_tracer().Drain(callback);
+}
+
 //-------------------------------------------------------------------
 // Exported routines
 //-------------------------------------------------------------------
@@ -1089,8 +2093,12 @@ using tcmalloc::tcmalloc_internal::DefaultAlignPolicy;
 using tcmalloc::tcmalloc_internal::do_free;
 using tcmalloc::tcmalloc_internal::do_free_with_size;
 using tcmalloc::tcmalloc_internal::GetPageSize;
+using tcmalloc::tcmalloc_internal::IsKnownZero;
 using tcmalloc::tcmalloc_internal::MallocAlignPolicy;
+using tcmalloc::tcmalloc_internal::MaybeInterleave;
 using tcmalloc::tcmalloc_internal::MultiplyOverflow;
+using tcmalloc::tcmalloc_internal::ReallocPagesWithoutCopy;
+using tcmalloc::tcmalloc_internal::TraceNew;
 
 // depends on TCMALLOC_HAVE_STRUCT_MALLINFO, so needs to come after that.
 #ifndef TCMALLOC_INTERNAL_METHODS_ONLY
@@ -1109,6 +2117,13 @@ extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalNew(size_t size) {
   return fast_alloc(size, CppPolicy());
 }
 
+extern "C" ABSL_ATTRIBUTE_SECTION(google_malloc) void*
+    TCMallocInternalNewSmallMiss(size_t size, size_t size_class) {
+  return slow_alloc_small(
+      size, size_class, CppPolicy(),
+      tcmalloc::tcmalloc_internal::AllocationAccessHotPolicy::access());
+}
+
 extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalNewNothrow(
     size_t size, const std::nothrow_t&) noexcept {
   return fast_alloc(size, CppPolicy().Nothrow());
@@ -1128,6 +2143,22 @@ extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(
   return fast_alloc(size, CppPolicy().AlignAs(alignment).SizeReturning());
 }
 
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void*
+tcmalloc_zeroed_operator_new(size_t size) {
+  void* result = fast_alloc(size, CppPolicy());
+  if (!IsKnownZero(result, size)) {
+    memset(result, 0, size);
+  }
+  return result;
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void*
+tcmalloc_interleaved_operator_new(size_t size) {
+  void* result = fast_alloc(size, CppPolicy());
+  MaybeInterleave(result, size);
+  return result;
+}
+
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
     tcmalloc::sized_ptr_t tcmalloc_size_returning_operator_new_hot_cold(
         size_t size, tcmalloc::hot_cold_t hot_cold) {
@@ -1182,7 +2213,7 @@ extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalCalloc(
     return MallocPolicy::handle_oom(std::numeric_limits<size_t>::max());
   }
   void* result = fast_alloc(size, MallocPolicy());
-  if (ABSL_PREDICT_TRUE(result != nullptr)) {
+  if (ABSL_PREDICT_TRUE(result != nullptr) && !IsKnownZero(result, size)) {
     memset(result, 0, size);
   }
   return result;
@@ -1225,6 +2256,13 @@ static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* do_realloc(void* old_ptr,
   if ((new_size > old_size) || (new_size < upper_bound_to_shrink) ||
       will_sample ||
       tc_globals.guardedpage_allocator().PointerIsMine(old_ptr)) {
+    // Large allocations can often grow into, or shrink from, the pages after
+    // them, or have their pages moved, without copying.
+    if (void* ptr =
+            ReallocPagesWithoutCopy(old_ptr, old_size, new_size, alloc_size)) {
+      return ptr;
+    }
+
     // Need to reallocate.
     void* new_ptr = nullptr;
 
@@ -1239,6 +2277,7 @@ static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* do_realloc(void* old_ptr,
           fast_alloc(lower_bound_to_grow,
                      MallocPolicy().Nothrow().WithoutHooks().SizeReturning());
       if (res.p != nullptr) {
+        TraceNew<MallocPolicy>(res.p, new_size);
       }
       new_ptr = res.p;
     }
@@ -1260,6 +2299,46 @@ static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* do_realloc(void* old_ptr,
   }
 }
 
+// As do_realloc(), for an old_ptr that malloc() or do_realloc_sized() returned
+// for a request of old_size bytes.  Resizing within the size class of old_ptr
+// returns at once, without reading the pagemap.
+//
+// Every other resize of a small object moves it, so that the new size is
+// always a valid hint for the object that is returned: do_realloc() keeps
+// objects that it shrinks by up to half, leaving them in a larger size class
+// than their new size maps to.
+static inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* do_realloc_sized(
+    void* old_ptr, size_t old_size, size_t new_size) {
+  size_t new_size_class;
+  const bool new_small = tc_globals.sizemap().GetSizeClass(
+      CppPolicy()
+          .AlignAs(MallocAlignPolicy::align())
+          .InSameNumaPartitionAs(old_ptr),
+      new_size, &new_size_class);
+  size_t old_capacity;
+  if (const size_t size_class = SizeClassWithHint(old_ptr, old_size);
+      size_class != 0) {
+    if (new_small && size_class == new_size_class) {
+      return old_ptr;
+    }
+    old_capacity = tc_globals.sizemap().class_to_size(size_class);
+  } else if (!new_small || !IsNormalMemory(old_ptr)) {
+    // Neither the old size nor the new one are used as hints for these.
+    return do_realloc(old_ptr, new_size);
+  } else {
+    // A large object becoming small must move to a size class.
+    old_capacity = GetSize(old_ptr);
+  }
+
+  void* new_ptr = fast_alloc(new_size, MallocPolicy());
+  if (new_ptr == nullptr) {
+    return nullptr;
+  }
+  memcpy(new_ptr, old_ptr, std::min(old_capacity, new_size));
+  do_free(old_ptr);
+  return new_ptr;
+}
+
 extern "C" ABSL_CACHELINE_ALIGNED void* TCMallocInternalRealloc(
     void* ptr, size_t size) noexcept {
   if (ptr == nullptr) {
@@ -1294,6 +2373,22 @@ extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(
   return fast_alloc(size, CppPolicy().Nothrow().SizeReturning());
 }
 
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void*
+tcmalloc_zeroed_operator_new_nothrow(size_t size) noexcept {
+  void* result = fast_alloc(size, CppPolicy().Nothrow());
+  if (ABSL_PREDICT_TRUE(result != nullptr) && !IsKnownZero(result, size)) {
+    memset(result, 0, size);
+  }
+  return result;
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void*
+tcmalloc_interleaved_operator_new_nothrow(size_t size) noexcept {
+  void* result = fast_alloc(size, CppPolicy().Nothrow());
+  MaybeInterleave(result, size);
+  return result;
+}
+
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
     tcmalloc::sized_ptr_t tcmalloc_size_returning_operator_new_aligned_nothrow(
         size_t size, std::align_val_t alignment) noexcept {
@@ -1307,9 +2402,11 @@ extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc)
         size_t size, tcmalloc::hot_cold_t hot_cold) noexcept {
   return hot_cold >= Parameters::min_hot_access_hint()
              ? fast_alloc(size,
-                          CppPolicy().AccessAsHot().Nothrow().SizeReturning())
+                          CppPolicy().AccessAsHot().Nothrow().SizeReturning(),
+                          hot_cold)
              : fast_alloc(size,
-                          CppPolicy().AccessAsCold().Nothrow().SizeReturning());
+                          CppPolicy().AccessAsCold().Nothrow().SizeReturning(),
+                          hot_cold);
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(
@@ -1319,16 +2416,20 @@ extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(
         tcmalloc::hot_cold_t hot_cold) noexcept {
   TC_ASSERT(absl::has_single_bit(static_cast<size_t>(alignment)));
   return hot_cold >= Parameters::min_hot_access_hint()
-             ? fast_alloc(size, CppPolicy()
-                                    .AlignAs(alignment)
-                                    .AccessAsHot()
-                                    .Nothrow()
-                                    .SizeReturning())
-             : fast_alloc(size, CppPolicy()
-                                    .AlignAs(alignment)
-                                    .AccessAsCold()
-                                    .Nothrow()
-                                    .SizeReturning());
+             ? fast_alloc(size,
+                          CppPolicy()
+                              .AlignAs(alignment)
+                              .AccessAsHot()
+                              .Nothrow()
+                              .SizeReturning(),
+                          hot_cold)
+             : fast_alloc(size,
+                          CppPolicy()
+                              .AlignAs(alignment)
+                              .AccessAsCold()
+                              .Nothrow()
+                              .SizeReturning(),
+                          hot_cold);
 }
 
 extern "C" ABSL_CACHELINE_ALIGNED void TCMallocInternalFree(
@@ -1362,6 +2463,35 @@ extern "C" ABSL_CACHELINE_ALIGNED void TCMallocInternalSdallocx(
   return do_free_with_size(ptr, size, AlignAsPolicy(alignment));
 }
 
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void*
+    tcmalloc_realloc_sized(void* ptr, size_t old_size,
+                           size_t new_size) noexcept {
+  if (ptr == nullptr) {
+    return fast_alloc(new_size, MallocPolicy());
+  }
+  if (new_size == 0) {
+    do_free_with_size(ptr, old_size, MallocAlignPolicy());
+    return nullptr;
+  }
+  tc_globals.InitIfNecessary();
+  return do_realloc_sized(ptr, old_size, new_size);
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) size_t
+    tcmalloc_alloc_batch(size_t size, void** batch, size_t n) noexcept {
+  return tcmalloc::tcmalloc_internal::do_alloc_batch(size, batch, n);
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void
+    tcmalloc_free_batch(void** batch, size_t n, size_t size) noexcept {
+  tcmalloc::tcmalloc_internal::do_free_batch(batch, n, size);
+}
+
+extern "C" ABSL_CACHELINE_ALIGNED ABSL_ATTRIBUTE_SECTION(google_malloc) void
+    tcmalloc_free_unsized_batch(void** batch, size_t n) noexcept {
+  tcmalloc::tcmalloc_internal::do_free_unsized_batch(batch, n);
+}
+
 extern "C" void TCMallocInternalDelete(void* p) noexcept
     TCMALLOC_ALIAS(TCMallocInternalFree);
 
@@ -1542,7 +2672,11 @@ class TCMallocGuard {
   TCMallocGuard() {
     TCMallocInternalFree(TCMallocInternalMalloc(1));
     ThreadCache::InitTSD();
+    ThreadMagazine::InitTSD();
     TCMallocInternalFree(TCMallocInternalMalloc(1));
+    // pthread_atfork() may allocate, so it is registered here rather than
+    // during initialization, which holds pageheap_lock.
+    pthread_atfork(ReleaseCachesBeforeFork, nullptr, nullptr);
   }
 };
 
@@ -85,6 +85,7 @@
 
 #include <cstddef>
 #include <new>
+#include <type_traits>
 
 #include "absl/base/attributes.h"
 #include "tcmalloc/common.h"
@@ -244,6 +245,37 @@ struct LocalNumaPartitionPolicy {
   }
 };
 
+// The calling thread's allocation policy, as set by
+// MallocExtension::ScopedAllocationPolicy.
+class ThreadAllocationPolicy {
+ public:
+  static ThreadAllocationPolicy& Get() { return thread_local_data_; }
+
+  // Whether the policy differs from the default.  This is all that the
+  // allocation fast path checks.
+  bool active() const { return active_; }
+
+  hot_cold_t access() const { return access_; }
+
+  // Returns the NUMA partition to allocate from, or -1 for the local one.
+  int numa_partition() const { return numa_partition_; }
+
+  void Set(hot_cold_t access, int numa_partition) {
+    access_ = access;
+    numa_partition_ = numa_partition;
+    active_ = access != AllocationAccessHotPolicy::access() ||
+              numa_partition >= 0;
+  }
+
+ private:
+  bool active_ = false;
+  hot_cold_t access_ = AllocationAccessHotPolicy::access();
+  int numa_partition_ = -1;
+
+  ABSL_CONST_INIT static thread_local ThreadAllocationPolicy thread_local_data_
+      ABSL_ATTRIBUTE_INITIAL_EXEC;
+};
+
 // TCMallocPolicy defines the compound policy object containing
 // the OOM, alignment and hooks policies.
 // Is trivially constructible, copyable and destructible.
@@ -286,6 +318,13 @@ class TCMallocPolicy {
   // Hooks policy
   static constexpr bool invoke_hooks() { return HooksPolicy::invoke_hooks(); }
 
+  // Whether allocations with this policy follow the ThreadAllocationPolicy.
+  // Those that ask for cold memory or a NUMA partition themselves don't.
+  static constexpr bool follows_thread_policy() {
+    return std::is_same_v<AccessPolicy, AllocationAccessHotPolicy> &&
+           std::is_same_v<NumaPolicy, LocalNumaPartitionPolicy>;
+  }
+
   // Size returning functions
   static constexpr bool size_returning() {
     return SizeReturningPolicy::size_returning();
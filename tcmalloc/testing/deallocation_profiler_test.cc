@@ -19,6 +19,7 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <new>
 #include <optional>
 #include <thread>  // NOLINT(build/c++11)
@@ -122,6 +123,28 @@ void testEntry(Params &p, const tcmalloc::Profile::Sample &e) {
     EXPECT_LE(e.min_lifetime, e.avg_lifetime);
     EXPECT_LE(e.avg_lifetime, e.max_lifetime);
 
+    // The histogram covers the whole callstack pair, so it holds at least the
+    // objects of this sample, all within the observed lifetimes.
+    using deallocationz::internal::LifetimeNsToHistogramBucket;
+    const int min_bucket = LifetimeNsToHistogramBucket(
+        absl::ToDoubleNanoseconds(p.sleep_time));
+    const int max_bucket =
+        LifetimeNsToHistogramBucket(absl::ToDoubleNanoseconds(p.duration));
+    int64_t histogram_objects = 0;
+    for (int i = 0; i < tcmalloc::Profile::Sample::kLifetimeHistogramBuckets;
+         ++i) {
+      if (i < min_bucket || i > max_bucket) {
+        EXPECT_EQ(e.lifetime_histogram[i], 0) << i;
+      }
+      histogram_objects += e.lifetime_histogram[i];
+    }
+    EXPECT_GE(histogram_objects, std::abs(e.count) / 2);
+
+    EXPECT_GE(e.cross_numa_free_ratio, 0);
+    EXPECT_LE(e.cross_numa_free_ratio, 1);
+    EXPECT_GE(e.cross_l3_free_ratio, 0);
+    EXPECT_LE(e.cross_l3_free_ratio, 1);
+
     auto log_optional_bool = [](std::optional<bool> item) {
       if (!item.has_value()) {
         return "none";
@@ -769,4 +792,18 @@ TEST(LifetimeProfiler, LifetimeBucketing) {
   EXPECT_EQ(absl::Nanoseconds(34000000), BucketizeDuration(34200040));
 }
 
+TEST(LifetimeProfiler, LifetimeHistogramBucketing) {
+  using deallocationz::internal::LifetimeNsToHistogramBucket;
+
+  EXPECT_EQ(LifetimeNsToHistogramBucket(-5), 0);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(0), 0);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(9), 0);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(10), 1);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(4245), 3);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(1e9), 9);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(1e11), 11);
+  EXPECT_EQ(LifetimeNsToHistogramBucket(1e15),
+            tcmalloc::Profile::Sample::kLifetimeHistogramBuckets - 1);
+}
+
 }  // namespace
@@ -0,0 +1,360 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/testing/empirical_driver.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/random/discrete_distribution.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+
+namespace tcmalloc {
+namespace {
+
+bool ParseSize(absl::string_view line, EmpiricalSize* size) {
+  std::vector<absl::string_view> fields =
+      absl::StrSplit(line, ' ', absl::SkipWhitespace());
+  return fields.size() == 3 && absl::SimpleAtoi(fields[0], &size->size) &&
+         absl::SimpleAtod(fields[1], &size->weight) &&
+         absl::SimpleAtod(fields[2], &size->lifetime) && size->size > 0 &&
+         size->weight >= 0 && size->lifetime >= 1;
+}
+
+struct Object {
+  // The operation of the allocating thread at which the object is freed.
+  int64_t death;
+  void* ptr;
+  // Whether another thread frees the object.
+  bool remote;
+
+  bool operator>(const Object& other) const { return death > other.death; }
+};
+
+// Objects handed from one thread to another to free.
+class Inbox {
+ public:
+  void Push(void* ptr) {
+    absl::MutexLock l(&mu_);
+    ptrs_.push_back(ptr);
+  }
+
+  std::vector<void*> Take() {
+    std::vector<void*> ptrs;
+    absl::MutexLock l(&mu_);
+    ptrs.swap(ptrs_);
+    return ptrs;
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<void*> ptrs_ ABSL_GUARDED_BY(mu_);
+};
+
+// Reads the resident and hugepage-backed anonymous memory of the process from
+// /proc/self/smaps_rollup, or returns zeros where it is not available.
+EmpiricalMemorySample ReadMemory() {
+  EmpiricalMemorySample sample = {};
+  int fd = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return sample;
+  }
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  close(fd);
+  if (n <= 0) {
+    return sample;
+  }
+
+  for (absl::string_view line :
+       absl::StrSplit(absl::string_view(buf, n), '\n')) {
+    int64_t* field;
+    if (absl::ConsumePrefix(&line, "Rss:")) {
+      field = &sample.rss_bytes;
+    } else if (absl::ConsumePrefix(&line, "AnonHugePages:")) {
+      field = &sample.huge_page_bytes;
+    } else {
+      continue;
+    }
+    int64_t kib;
+    if (absl::SimpleAtoi(absl::StripSuffix(absl::StripAsciiWhitespace(line),
+                                           " kB"),
+                         &kib)) {
+      *field = kib << 10;
+    }
+  }
+  return sample;
+}
+
+class Driver {
+ public:
+  Driver(absl::Span<const EmpiricalPhase> phases,
+         const EmpiricalOptions& options)
+      : phases_(phases),
+        options_(options),
+        inboxes_(std::max(options.threads, 1)) {}
+
+  EmpiricalStats Run() {
+    const int threads = inboxes_.size();
+    std::vector<std::vector<int64_t>> alloc_cycles(threads);
+    std::vector<std::vector<int64_t>> free_cycles(threads);
+
+    EmpiricalStats stats;
+    const absl::Time start = absl::Now();
+    absl::Notification done;
+    std::thread sampler([&] {
+      do {
+        EmpiricalMemorySample sample = ReadMemory();
+        sample.elapsed = absl::Now() - start;
+        stats.memory.push_back(sample);
+      } while (!done.WaitForNotificationWithTimeout(
+          options_.memory_sample_period));
+    });
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+      workers.emplace_back(
+          [&, i] { Work(i, &alloc_cycles[i], &free_cycles[i]); });
+    }
+    for (auto& t : workers) {
+      t.join();
+    }
+    // Workers may have handed objects to threads that had already finished.
+    for (Inbox& inbox : inboxes_) {
+      for (void* ptr : inbox.Take()) {
+        ::operator delete(ptr);
+      }
+    }
+    stats.elapsed = absl::Now() - start;
+    done.Notify();
+    sampler.join();
+
+    for (const EmpiricalPhase& phase : phases_) {
+      stats.ops += phase.ops * threads;
+    }
+    Percentiles(&alloc_cycles, &stats.p50_alloc_latency,
+                &stats.p99_alloc_latency);
+    Percentiles(&free_cycles, &stats.p50_free_latency,
+                &stats.p99_free_latency);
+    return stats;
+  }
+
+ private:
+  // Objects handed to another thread are drained this often.
+  static constexpr int64_t kDrainInterval = 64;
+
+  void Work(int id, std::vector<int64_t>* alloc_cycles,
+            std::vector<int64_t>* free_cycles) {
+    absl::BitGen rng;
+    std::priority_queue<Object, std::vector<Object>, std::greater<Object>>
+        live;
+    Inbox& inbox = inboxes_[id];
+    Inbox& peer = inboxes_[(id + 1) % inboxes_.size()];
+    const int64_t sample_interval =
+        std::max<int64_t>(options_.latency_sample_interval, 1);
+
+    auto free = [&](void* ptr, int64_t op) {
+      if (op % sample_interval != 0) {
+        ::operator delete(ptr);
+        return;
+      }
+      const int64_t before = absl::base_internal::CycleClock::Now();
+      ::operator delete(ptr);
+      free_cycles->push_back(absl::base_internal::CycleClock::Now() - before);
+    };
+
+    int64_t op = 0;
+    for (const EmpiricalPhase& phase : phases_) {
+      std::vector<double> weights;
+      for (const EmpiricalSize& size : phase.sizes) {
+        weights.push_back(size.weight);
+      }
+      absl::discrete_distribution<int> pick(weights.begin(), weights.end());
+
+      for (int64_t end = op + phase.ops; op < end; ++op) {
+        const EmpiricalSize& size = phase.sizes[pick(rng)];
+        void* ptr;
+        if (op % sample_interval != 0) {
+          ptr = ::operator new(size.size);
+        } else {
+          const int64_t before = absl::base_internal::CycleClock::Now();
+          ptr = ::operator new(size.size);
+          alloc_cycles->push_back(absl::base_internal::CycleClock::Now() -
+                                  before);
+        }
+        Touch(ptr, size.size);
+
+        const int64_t lifetime = std::max<int64_t>(
+            1, std::llround(absl::Exponential<double>(rng, 1 / size.lifetime)));
+        live.push({op + lifetime, ptr,
+                   absl::Bernoulli(rng, options_.cross_thread_fraction)});
+
+        while (!live.empty() && live.top().death <= op) {
+          if (live.top().remote) {
+            peer.Push(live.top().ptr);
+          } else {
+            free(live.top().ptr, op);
+          }
+          live.pop();
+        }
+        if (op % kDrainInterval == 0) {
+          for (void* remote : inbox.Take()) {
+            free(remote, op);
+          }
+        }
+      }
+    }
+
+    while (!live.empty()) {
+      ::operator delete(live.top().ptr);
+      live.pop();
+    }
+  }
+
+  // Writes to every page of the object, so that it is resident as it would be
+  // in a real workload.
+  static void Touch(void* ptr, size_t size) {
+    constexpr size_t kPageSize = 4096;
+    char* p = static_cast<char*>(ptr);
+    for (size_t i = 0; i < size; i += kPageSize) {
+      p[i] = 1;
+    }
+  }
+
+  static void Percentiles(std::vector<std::vector<int64_t>>* per_thread,
+                          absl::Duration* p50, absl::Duration* p99) {
+    std::vector<int64_t> cycles;
+    for (const auto& v : *per_thread) {
+      cycles.insert(cycles.end(), v.begin(), v.end());
+    }
+    if (cycles.empty()) {
+      return;
+    }
+    const double ns_per_cycle =
+        1e9 / absl::base_internal::CycleClock::Frequency();
+    auto percentile = [&](double p) {
+      auto it = cycles.begin() + static_cast<size_t>(p * (cycles.size() - 1));
+      std::nth_element(cycles.begin(), it, cycles.end());
+      return absl::Nanoseconds(*it * ns_per_cycle);
+    };
+    *p50 = percentile(0.5);
+    *p99 = percentile(0.99);
+  }
+
+  absl::Span<const EmpiricalPhase> phases_;
+  EmpiricalOptions options_;
+  std::vector<Inbox> inboxes_;
+};
+
+}  // namespace
+
+bool ParseEmpiricalProfile(absl::string_view text, int64_t default_ops,
+                           std::vector<EmpiricalPhase>* phases) {
+  phases->clear();
+  for (absl::string_view line : absl::StrSplit(text, '\n')) {
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    if (absl::ConsumePrefix(&line, "phase ")) {
+      EmpiricalPhase phase;
+      if (!absl::SimpleAtoi(line, &phase.ops) || phase.ops < 0) {
+        return false;
+      }
+      phases->push_back(std::move(phase));
+      continue;
+    }
+
+    EmpiricalSize size;
+    if (!ParseSize(line, &size)) {
+      return false;
+    }
+    if (phases->empty()) {
+      phases->push_back({default_ops, {}});
+    }
+    phases->back().sizes.push_back(size);
+  }
+
+  if (phases->empty()) {
+    return false;
+  }
+  for (const EmpiricalPhase& phase : *phases) {
+    double total = 0;
+    for (const EmpiricalSize& size : phase.sizes) {
+      total += size.weight;
+    }
+    if (!(total > 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+EmpiricalStats RunEmpiricalDriver(absl::Span<const EmpiricalPhase> phases,
+                                  const EmpiricalOptions& options) {
+  return Driver(phases, options).Run();
+}
+
+std::string FormatEmpiricalStats(const EmpiricalStats& stats) {
+  std::string out;
+  const double seconds = absl::ToDoubleSeconds(stats.elapsed);
+  absl::StrAppendFormat(&out, "ops: %d in %s (%.0f ops/s)\n", stats.ops,
+                        absl::FormatDuration(stats.elapsed),
+                        seconds > 0 ? stats.ops / seconds : 0);
+  absl::StrAppendFormat(&out, "alloc latency: p50 %s p99 %s\n",
+                        absl::FormatDuration(stats.p50_alloc_latency),
+                        absl::FormatDuration(stats.p99_alloc_latency));
+  absl::StrAppendFormat(&out, "free latency: p50 %s p99 %s\n",
+                        absl::FormatDuration(stats.p50_free_latency),
+                        absl::FormatDuration(stats.p99_free_latency));
+  out += "memory:\n";
+  for (const EmpiricalMemorySample& sample : stats.memory) {
+    const double coverage =
+        sample.rss_bytes > 0
+            ? 100.0 * sample.huge_page_bytes / sample.rss_bytes
+            : 0.0;
+    absl::StrAppendFormat(&out,
+                          "  %12s rss %8.1f MiB hugepage coverage %5.1f%%\n",
+                          absl::FormatDuration(sample.elapsed),
+                          sample.rss_bytes / 1048576.0, coverage);
+  }
+  return out;
+}
+
+}  // namespace tcmalloc
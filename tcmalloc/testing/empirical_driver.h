@@ -0,0 +1,119 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_TESTING_EMPIRICAL_DRIVER_H_
+#define TCMALLOC_TESTING_EMPIRICAL_DRIVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+
+namespace tcmalloc {
+
+// An empirical driver runs threads that allocate objects with sizes and
+// lifetimes drawn from a profile, rather than the fixed patterns of
+// microbenchmarks, so that allocator changes can be judged under load that
+// resembles a real workload.
+//
+// A profile is a sequence of phases, which each thread runs in order, so that
+// the workload can change its mix part way.  A phase lists the sizes it
+// allocates, each with a relative frequency and a mean lifetime counted in
+// operations of the allocating thread.
+
+struct EmpiricalSize {
+  size_t size;
+  double weight;
+  double lifetime;
+};
+
+struct EmpiricalPhase {
+  // The number of allocations each thread makes in this phase.
+  int64_t ops;
+  std::vector<EmpiricalSize> sizes;
+};
+
+// A small mix of short-lived small objects and long-lived larger buffers,
+// followed by a phase dominated by larger, longer-lived objects.
+inline constexpr absl::string_view kDefaultEmpiricalProfile = R"(
+phase 2000000
+16 30 20
+32 25 50
+64 15 200
+128 10 1000
+512 5 5000
+4096 2 20000
+65536 0.1 50000
+phase 1000000
+64 10 100
+1024 5 100000
+16384 2 200000
+262144 0.05 10000
+)";
+
+// Parses a profile of the form
+//
+//   # A comment.
+//   phase <ops>
+//   <size> <weight> <lifetime>
+//   ...
+//
+// Size lines before the first phase line form a phase of `default_ops`.
+// Returns false if the profile is malformed or empty.
+bool ParseEmpiricalProfile(absl::string_view text, int64_t default_ops,
+                           std::vector<EmpiricalPhase>* phases);
+
+struct EmpiricalOptions {
+  int threads = 4;
+  // The fraction of objects freed by a different thread than the one that
+  // allocated them, as producer/consumer pipelines do.
+  double cross_thread_fraction = 0.1;
+  // One in this many allocations and frees is timed.
+  int64_t latency_sample_interval = 64;
+  // How often RSS and hugepage backing are sampled.
+  absl::Duration memory_sample_period = absl::Milliseconds(100);
+};
+
+struct EmpiricalMemorySample {
+  absl::Duration elapsed;
+  int64_t rss_bytes;
+  int64_t huge_page_bytes;
+};
+
+struct EmpiricalStats {
+  int64_t ops = 0;
+  absl::Duration elapsed;
+  absl::Duration p50_alloc_latency;
+  absl::Duration p99_alloc_latency;
+  absl::Duration p50_free_latency;
+  absl::Duration p99_free_latency;
+  std::vector<EmpiricalMemorySample> memory;
+};
+
+// Runs `phases` on `options.threads` threads, and frees everything left live
+// before returning.
+EmpiricalStats RunEmpiricalDriver(absl::Span<const EmpiricalPhase> phases,
+                                  const EmpiricalOptions& options);
+
+// Formats `stats` for humans, one memory sample per line.
+std::string FormatEmpiricalStats(const EmpiricalStats& stats);
+
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_TESTING_EMPIRICAL_DRIVER_H_
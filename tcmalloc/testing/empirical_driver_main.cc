@@ -0,0 +1,85 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs threads allocating from the size and lifetime distributions of a
+// profile (see empirical_driver.h for its format), and prints throughput,
+// allocation and free latencies, and RSS and hugepage coverage over time.
+// Without a profile, kDefaultEmpiricalProfile is used.
+//
+// Usage: empirical_driver_main --threads=8 [<profile file>]
+
+#include <stdio.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/time.h"
+#include "tcmalloc/testing/empirical_driver.h"
+
+ABSL_FLAG(int, threads, 4, "Number of allocating threads");
+ABSL_FLAG(double, cross_thread_fraction, 0.1,
+          "Fraction of objects freed by a different thread");
+ABSL_FLAG(int64_t, ops, 1000000,
+          "Allocations per thread for sizes before the first phase line");
+ABSL_FLAG(int64_t, latency_sample_interval, 64,
+          "Time one in this many allocations and frees");
+ABSL_FLAG(absl::Duration, memory_sample_period, absl::Milliseconds(100),
+          "How often to sample RSS and hugepage coverage");
+
+namespace tcmalloc {
+namespace {
+
+int Main(const char* path) {
+  std::string profile(kDefaultEmpiricalProfile);
+  if (path != nullptr) {
+    std::ifstream file(path);
+    profile.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+    if (!file) {
+      fprintf(stderr, "cannot read %s\n", path);
+      return 1;
+    }
+  }
+  std::vector<EmpiricalPhase> phases;
+  if (!ParseEmpiricalProfile(profile, absl::GetFlag(FLAGS_ops), &phases)) {
+    fprintf(stderr, "malformed profile\n");
+    return 1;
+  }
+
+  EmpiricalOptions options;
+  options.threads = absl::GetFlag(FLAGS_threads);
+  options.cross_thread_fraction = absl::GetFlag(FLAGS_cross_thread_fraction);
+  options.latency_sample_interval =
+      absl::GetFlag(FLAGS_latency_sample_interval);
+  options.memory_sample_period = absl::GetFlag(FLAGS_memory_sample_period);
+  const EmpiricalStats stats = RunEmpiricalDriver(phases, options);
+  fputs(FormatEmpiricalStats(stats).c_str(), stdout);
+  return 0;
+}
+
+}  // namespace
+}  // namespace tcmalloc
+
+int main(int argc, char** argv) {
+  const std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  if (args.size() > 2) {
+    fprintf(stderr, "usage: %s [flags] [<profile file>]\n", args[0]);
+    return 1;
+  }
+  return tcmalloc::Main(args.size() == 2 ? args[1] : nullptr);
+}
@@ -0,0 +1,103 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/testing/empirical_driver.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace tcmalloc {
+namespace {
+
+using ::testing::HasSubstr;
+
+TEST(EmpiricalDriverTest, ParseProfile) {
+  std::vector<EmpiricalPhase> phases;
+  ASSERT_TRUE(ParseEmpiricalProfile(R"(
+# Sizes before a phase line get the default number of operations.
+16 3 10
+32 1 100.5
+
+phase 500
+4096 1 1000
+)",
+                                    100, &phases));
+  ASSERT_EQ(phases.size(), 2);
+  EXPECT_EQ(phases[0].ops, 100);
+  ASSERT_EQ(phases[0].sizes.size(), 2);
+  EXPECT_EQ(phases[0].sizes[1].size, 32);
+  EXPECT_EQ(phases[0].sizes[1].weight, 1);
+  EXPECT_EQ(phases[0].sizes[1].lifetime, 100.5);
+  EXPECT_EQ(phases[1].ops, 500);
+  ASSERT_EQ(phases[1].sizes.size(), 1);
+  EXPECT_EQ(phases[1].sizes[0].size, 4096);
+
+  EXPECT_TRUE(ParseEmpiricalProfile(kDefaultEmpiricalProfile, 1, &phases));
+}
+
+TEST(EmpiricalDriverTest, ParseInvalidProfile) {
+  std::vector<EmpiricalPhase> phases;
+  EXPECT_FALSE(ParseEmpiricalProfile("", 100, &phases));
+  EXPECT_FALSE(ParseEmpiricalProfile("# nothing\n", 100, &phases));
+  EXPECT_FALSE(ParseEmpiricalProfile("16 1\n", 100, &phases));
+  EXPECT_FALSE(ParseEmpiricalProfile("16 1 0\n", 100, &phases));
+  EXPECT_FALSE(ParseEmpiricalProfile("0 1 10\n", 100, &phases));
+  EXPECT_FALSE(ParseEmpiricalProfile("phase x\n16 1 10\n", 100, &phases));
+  // A phase needs something to allocate.
+  EXPECT_FALSE(ParseEmpiricalProfile("phase 10\n", 100, &phases));
+  EXPECT_FALSE(ParseEmpiricalProfile("phase 10\n16 0 10\n", 100, &phases));
+}
+
+TEST(EmpiricalDriverTest, Run) {
+  std::vector<EmpiricalPhase> phases;
+  ASSERT_TRUE(ParseEmpiricalProfile(R"(
+phase 20000
+16 10 10
+256 5 1000
+phase 10000
+8192 1 100
+)",
+                                    0, &phases));
+
+  EmpiricalOptions options;
+  options.threads = 3;
+  options.cross_thread_fraction = 0.5;
+  options.latency_sample_interval = 16;
+  options.memory_sample_period = absl::Milliseconds(1);
+  const EmpiricalStats stats = RunEmpiricalDriver(phases, options);
+
+  EXPECT_EQ(stats.ops, 3 * 30000);
+  EXPECT_GT(stats.elapsed, absl::ZeroDuration());
+  EXPECT_GT(stats.p99_alloc_latency, absl::ZeroDuration());
+  EXPECT_GE(stats.p99_alloc_latency, stats.p50_alloc_latency);
+  EXPECT_GE(stats.p99_free_latency, stats.p50_free_latency);
+  ASSERT_FALSE(stats.memory.empty());
+  for (const EmpiricalMemorySample& sample : stats.memory) {
+    EXPECT_GE(sample.rss_bytes, sample.huge_page_bytes);
+  }
+
+  const std::string report = FormatEmpiricalStats(stats);
+  EXPECT_THAT(report, HasSubstr("ops: 90000"));
+  EXPECT_THAT(report, HasSubstr("alloc latency: p50"));
+  EXPECT_THAT(report, HasSubstr("hugepage coverage"));
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,222 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the same multithreaded allocation workload under no experiment and
+// under each experiment TCMalloc knows of in turn, and prints a table of the
+// workload's wall time and of the tcmalloc.experiment_counters.* properties
+// each run ended with, next to the baseline's.
+//
+// Experiments are chosen at startup, so each run is a fresh process: this
+// binary again, with BORG_EXPERIMENTS naming the experiment and --child set.
+//
+// Usage: experiment_comparison_benchmark [--experiments=A,B] [--threads=N]
+//            [--iterations=N]
+
+#include <spawn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <map>
+#include <new>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/random/random.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcmalloc/experiment.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+extern char** environ;
+
+ABSL_FLAG(std::vector<std::string>, experiments, {},
+          "Experiments to compare with the baseline, or all of them");
+ABSL_FLAG(int, threads, 8, "Threads running the workload");
+ABSL_FLAG(int, iterations, 1 << 20, "Allocations made by each thread");
+ABSL_FLAG(bool, child, false,
+          "Run the workload once and print its metrics, for the parent");
+
+namespace tcmalloc {
+namespace {
+
+constexpr absl::string_view kCounterPrefix = "tcmalloc.experiment_counters.";
+constexpr absl::string_view kTimeMetric = "wall_time_ms";
+
+using Metrics = std::map<std::string, double>;
+
+// Each thread keeps a working set of mostly small objects, with the odd
+// large one, and replaces a random member of it on every iteration.
+void Workload(int iterations) {
+  constexpr size_t kWorkingSet = 4096;
+  absl::BitGen rng;
+  std::vector<std::pair<void*, size_t>> live(kWorkingSet, {nullptr, 0});
+  for (int i = 0; i < iterations; ++i) {
+    auto& [ptr, size] = live[absl::Uniform<size_t>(rng, 0, kWorkingSet)];
+    if (ptr != nullptr) ::operator delete(ptr, size);
+    size = absl::Bernoulli(rng, 1.0 / 256)
+               ? absl::Uniform<size_t>(rng, 64 << 10, 1 << 20)
+               : absl::LogUniform<size_t>(rng, 8, 4096);
+    ptr = ::operator new(size);
+  }
+  for (auto& [ptr, size] : live) {
+    if (ptr != nullptr) ::operator delete(ptr, size);
+  }
+}
+
+int RunChild() {
+  const int threads = absl::GetFlag(FLAGS_threads);
+  const int iterations = absl::GetFlag(FLAGS_iterations);
+
+  const absl::Time start = absl::Now();
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(Workload, iterations);
+  }
+  for (auto& t : workers) t.join();
+  const absl::Duration elapsed = absl::Now() - start;
+
+  absl::PrintF("%s %f\n", kTimeMetric, absl::ToDoubleMilliseconds(elapsed));
+  for (const auto& [name, property] : MallocExtension::GetProperties()) {
+    if (absl::StartsWith(name, kCounterPrefix)) {
+      absl::PrintF("%s %d\n", absl::StripPrefix(name, kCounterPrefix),
+                   property.value);
+    }
+  }
+  return 0;
+}
+
+// Runs this binary with BORG_EXPERIMENTS set to experiment, and returns the
+// metrics it printed.
+Metrics Spawn(absl::string_view experiment) {
+  std::vector<std::string> env;
+  for (char** e = environ; *e != nullptr; ++e) {
+    if (!absl::StartsWith(*e, "BORG_EXPERIMENTS=")) env.push_back(*e);
+  }
+  env.push_back(absl::StrCat("BORG_EXPERIMENTS=", experiment));
+  std::vector<char*> envp;
+  for (auto& e : env) envp.push_back(e.data());
+  envp.push_back(nullptr);
+
+  std::vector<std::string> args = {
+      "/proc/self/exe", "--child",
+      absl::StrCat("--threads=", absl::GetFlag(FLAGS_threads)),
+      absl::StrCat("--iterations=", absl::GetFlag(FLAGS_iterations))};
+  std::vector<char*> argv;
+  for (auto& a : args) argv.push_back(a.data());
+  argv.push_back(nullptr);
+
+  int fds[2];
+  TC_CHECK_EQ(pipe(fds), 0);
+  posix_spawn_file_actions_t actions;
+  TC_CHECK_EQ(posix_spawn_file_actions_init(&actions), 0);
+  TC_CHECK_EQ(posix_spawn_file_actions_adddup2(&actions, fds[1],
+                                               STDOUT_FILENO),
+              0);
+  TC_CHECK_EQ(posix_spawn_file_actions_addclose(&actions, fds[0]), 0);
+
+  pid_t pid;
+  TC_CHECK_EQ(posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(),
+                          envp.data()),
+              0);
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);
+
+  std::string output;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) output.append(buf, n);
+  close(fds[0]);
+  int status;
+  TC_CHECK_EQ(waitpid(pid, &status, 0), pid);
+  TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "experiment=%s",
+           std::string(experiment).c_str());
+
+  Metrics metrics;
+  for (absl::string_view line :
+       absl::StrSplit(output, '\n', absl::SkipEmpty())) {
+    std::pair<absl::string_view, absl::string_view> kv =
+        absl::StrSplit(line, ' ');
+    double value;
+    TC_CHECK(absl::SimpleAtod(kv.second, &value), "line=%s",
+             std::string(line).c_str());
+    metrics[std::string(kv.first)] = value;
+  }
+  return metrics;
+}
+
+int RunParent() {
+  std::vector<std::string> experiments = absl::GetFlag(FLAGS_experiments);
+  if (experiments.empty()) {
+    WalkExperiments([&](absl::string_view name, bool) {
+      experiments.emplace_back(name);
+    });
+  }
+
+  const Metrics baseline = Spawn("");
+  std::vector<std::pair<std::string, Metrics>> runs;
+  for (const auto& experiment : experiments) {
+    TC_CHECK(FindExperimentByName(experiment).has_value(), "experiment=%s",
+             experiment.c_str());
+    runs.emplace_back(experiment, Spawn(experiment));
+  }
+
+  // One row per metric, with the baseline's value and each experiment's
+  // change from it.
+  absl::PrintF("%-28s %16s", "metric", "baseline");
+  for (const auto& [experiment, metrics] : runs) {
+    absl::PrintF("  %s", experiment);
+  }
+  absl::PrintF("\n");
+  for (const auto& [metric, base] : baseline) {
+    absl::PrintF("%-28s %16.0f", metric, base);
+    for (const auto& [experiment, metrics] : runs) {
+      const auto it = metrics.find(metric);
+      std::string cell = "-";
+      if (it != metrics.end()) {
+        cell = base == 0 ? absl::StrFormat("%.0f", it->second)
+                         : absl::StrFormat("%+.1f%%",
+                                           100 * (it->second - base) / base);
+      }
+      absl::PrintF("  %*s", static_cast<int>(experiment.size()), cell);
+    }
+    absl::PrintF("\n");
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace tcmalloc
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  return absl::GetFlag(FLAGS_child) ? tcmalloc::RunChild()
+                                    : tcmalloc::RunParent();
+}
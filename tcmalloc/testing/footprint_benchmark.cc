@@ -0,0 +1,267 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs standard allocation mixes and writes, for each, the memory footprint
+// they leave behind with their live objects still allocated: RSS, the
+// HugePageFiller's hugepage coverage, released, metadata and free bytes, and
+// how much of the central freelist's span capacity is in use.  The output has
+// one "<mix>.<metric> <value>" line per metric, so that runs against
+// different TCMalloc versions can be diffed, as speed is with benchmarks.
+//
+// Mixes run one after another in the same process, with memory released to
+// the OS in between.
+//
+// Usage: footprint_benchmark [--mixes=small_churn,...] [--output=<file>]
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <limits>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/random/random.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "tcmalloc/internal/memory_stats.h"
+#include "tcmalloc/malloc_extension.h"
+
+extern "C" ABSL_ATTRIBUTE_WEAK int MallocExtension_Internal_GetStatsInPbtxt(
+    char* buffer, int buffer_length);
+
+ABSL_FLAG(std::vector<std::string>, mixes,
+          std::vector<std::string>({"small_churn", "large_small",
+                                    "size_shift"}),
+          "Allocation mixes to run");
+ABSL_FLAG(std::string, output, "", "File to write metrics to, or stdout");
+
+namespace tcmalloc {
+namespace {
+
+// The objects a mix leaves live while its footprint is measured.
+class LiveSet {
+ public:
+  LiveSet() = default;
+  LiveSet(const LiveSet&) = delete;
+  LiveSet& operator=(const LiveSet&) = delete;
+
+  ~LiveSet() {
+    for (auto [ptr, size] : objects_) {
+      ::operator delete(ptr, size);
+    }
+  }
+
+  void Add(size_t size) { objects_.push_back({::operator new(size), size}); }
+
+  // Frees about `fraction` of the objects, chosen at random.
+  void FreeRandom(absl::BitGen& rng, double fraction) {
+    size_t kept = 0;
+    for (auto object : objects_) {
+      if (absl::Bernoulli(rng, fraction)) {
+        ::operator delete(object.first, object.second);
+      } else {
+        objects_[kept++] = object;
+      }
+    }
+    objects_.resize(kept);
+  }
+
+  // Frees the objects of at least `min_size` bytes.
+  void FreeLarger(size_t min_size) {
+    size_t kept = 0;
+    for (auto object : objects_) {
+      if (object.second >= min_size) {
+        ::operator delete(object.first, object.second);
+      } else {
+        objects_[kept++] = object;
+      }
+    }
+    objects_.resize(kept);
+  }
+
+ private:
+  std::vector<std::pair<void*, size_t>> objects_;
+};
+
+// Many small objects, most of which are freed at random, leaving sparsely
+// used spans behind.
+void SmallChurn(LiveSet& live) {
+  absl::BitGen rng;
+  for (int i = 0; i < 1000000; ++i) {
+    live.Add(absl::Uniform<size_t>(rng, 8, 512));
+  }
+  live.FreeRandom(rng, 0.9);
+}
+
+// Small objects interleaved with large buffers, which are then freed, leaving
+// the small objects scattered over hugepages.
+void LargeSmall(LiveSet& live) {
+  absl::BitGen rng;
+  for (int i = 0; i < 20000; ++i) {
+    live.Add(absl::Uniform<size_t>(rng, 16 << 10, 512 << 10));
+    for (int j = 0; j < 16; ++j) {
+      live.Add(absl::Uniform<size_t>(rng, 8, 256));
+    }
+  }
+  live.FreeLarger(16 << 10);
+}
+
+// A working set of one size is mostly replaced by one of another size, as
+// when a program changes phase.
+void SizeShift(LiveSet& live) {
+  absl::BitGen rng;
+  for (int i = 0; i < 500000; ++i) {
+    live.Add(64);
+  }
+  live.FreeRandom(rng, 0.95);
+  for (int i = 0; i < 100000; ++i) {
+    live.Add(1024);
+  }
+}
+
+size_t NumericProperty(absl::string_view name) {
+  return MallocExtension::GetNumericProperty(name).value_or(0);
+}
+
+// Returns the HugePageFiller's fraction of used pages on intact hugepages,
+// for the first (normal) heap in the stats.
+std::optional<double> FillerHugepageCoverage() {
+  constexpr absl::string_view kPrefix = "HugePageFiller: ";
+  constexpr absl::string_view kSuffix = " of used pages hugepageable";
+  const std::string stats = MallocExtension::GetStats();
+  for (absl::string_view line : absl::StrSplit(stats, '\n')) {
+    double coverage;
+    if (absl::ConsumePrefix(&line, kPrefix) &&
+        absl::ConsumeSuffix(&line, kSuffix) &&
+        absl::SimpleAtod(line, &coverage)) {
+      return coverage;
+    }
+  }
+  return std::nullopt;
+}
+
+// Returns the fraction of the span capacity of the central freelists that
+// holds objects in use, rather than objects free in any of the caches.
+std::optional<double> SpanUtilization() {
+  if (&MallocExtension_Internal_GetStatsInPbtxt == nullptr) {
+    return std::nullopt;
+  }
+  std::string pbtxt(4 << 20, '\0');
+  pbtxt.resize(
+      MallocExtension_Internal_GetStatsInPbtxt(pbtxt.data(), pbtxt.size()));
+
+  // Each freelist entry prints its size class, the bytes of its objects that
+  // are free, and then its capacity in objects.
+  double size = 0, free_bytes = 0, total_free = 0, total_capacity = 0;
+  std::vector<absl::string_view> tokens =
+      absl::StrSplit(pbtxt, ' ', absl::SkipWhitespace());
+  for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+    double value;
+    if (!absl::SimpleAtod(tokens[i + 1], &value)) {
+      continue;
+    }
+    if (tokens[i] == "sizeclass:") {
+      size = value;
+    } else if (tokens[i] == "bytes:") {
+      free_bytes = value;
+    } else if (tokens[i] == "obj_capacity:") {
+      total_free += free_bytes;
+      total_capacity += value * size;
+    }
+  }
+  if (total_capacity == 0) {
+    return std::nullopt;
+  }
+  return 1 - total_free / total_capacity;
+}
+
+void WriteMetrics(FILE* out, absl::string_view mix) {
+  tcmalloc_internal::MemoryStats memory;
+  if (tcmalloc_internal::GetMemoryStats(&memory)) {
+    absl::FPrintF(out, "%s.rss_bytes %d\n", mix, memory.rss);
+  }
+  for (absl::string_view property : {
+           "generic.physical_memory_used",
+           "generic.current_allocated_bytes",
+           "tcmalloc.pageheap_free_bytes",
+           "tcmalloc.pageheap_unmapped_bytes",
+           "tcmalloc.metadata_bytes",
+           "tcmalloc.external_fragmentation_bytes",
+       }) {
+    absl::FPrintF(out, "%s.%s %d\n", mix, property, NumericProperty(property));
+  }
+  if (std::optional<double> coverage = FillerHugepageCoverage()) {
+    absl::FPrintF(out, "%s.filler_hugepage_coverage %.4f\n", mix, *coverage);
+  }
+  if (std::optional<double> utilization = SpanUtilization()) {
+    absl::FPrintF(out, "%s.span_utilization %.4f\n", mix, *utilization);
+  }
+}
+
+int Main() {
+  const std::vector<std::pair<absl::string_view, void (*)(LiveSet&)>> kMixes =
+      {
+          {"small_churn", SmallChurn},
+          {"large_small", LargeSmall},
+          {"size_shift", SizeShift},
+      };
+
+  FILE* out = stdout;
+  const std::string path = absl::GetFlag(FLAGS_output);
+  if (!path.empty() && (out = fopen(path.c_str(), "w")) == nullptr) {
+    absl::FPrintF(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+
+  for (const std::string& name : absl::GetFlag(FLAGS_mixes)) {
+    void (*mix)(LiveSet&) = nullptr;
+    for (const auto& [mix_name, f] : kMixes) {
+      if (mix_name == name) {
+        mix = f;
+      }
+    }
+    if (mix == nullptr) {
+      absl::FPrintF(stderr, "unknown mix %s\n", name);
+      return 1;
+    }
+
+    MallocExtension::ReleaseMemoryToSystem(std::numeric_limits<size_t>::max());
+    LiveSet live;
+    mix(live);
+    WriteMetrics(out, name);
+  }
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace tcmalloc
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  return tcmalloc::Main();
+}
@@ -0,0 +1,81 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <new>
+#include <optional>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "tcmalloc/internal/parameter_accessors.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+size_t CpuCacheFreeBytes() {
+  std::optional<size_t> bytes =
+      MallocExtension::GetNumericProperty("tcmalloc.cpu_free");
+  EXPECT_TRUE(bytes.has_value());
+  return bytes.value_or(0);
+}
+
+// Forks a child that exits immediately, and waits for it.
+void ForkAndWait() {
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST(ForkTest, ReleasesCachesBeforeFork) {
+  if (!MallocExtension::PerCpuCachesActive()) {
+    GTEST_SKIP() << "Skipping test without per-CPU caches";
+  }
+
+  const bool previous = TCMalloc_Internal_GetReleaseCachesAtFork();
+  TCMalloc_Internal_SetReleaseCachesAtFork(true);
+
+  // Fill the per-CPU cache with freed objects.
+  constexpr int kObjects = 1000;
+  std::vector<void*> ptrs;
+  ptrs.reserve(kObjects);
+  for (int i = 0; i < kObjects; ++i) {
+    ptrs.push_back(::operator new(64));
+    benchmark::DoNotOptimize(ptrs.back());
+  }
+  for (void* ptr : ptrs) {
+    ::operator delete(ptr);
+  }
+  const size_t before = CpuCacheFreeBytes();
+  ASSERT_GT(before, 0);
+
+  ForkAndWait();
+  EXPECT_LT(CpuCacheFreeBytes(), before);
+
+  TCMalloc_Internal_SetReleaseCachesAtFork(previous);
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -21,12 +21,14 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/base/config.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "tcmalloc/common.h"
@@ -77,6 +79,8 @@ TEST_F(GetStatsTest, Pbtxt) {
 
   EXPECT_THAT(buf, ContainsRegex(R"(mmap_sys_allocator: [0-9]*)"));
   EXPECT_THAT(buf, HasSubstr("memory_release_failures: 0"));
+  EXPECT_THAT(buf, ContainsRegex(R"(memory_released_lazily_total: [0-9]*)"));
+  EXPECT_THAT(buf, ContainsRegex(R"(unmapped_lazily_released: [0-9]*)"));
 
   if (MallocExtension::PerCpuCachesActive()) {
     EXPECT_THAT(buf, ContainsRegex(R"(per_cpu_cache_freelist: [1-9][0-9]*)"));
@@ -309,6 +313,105 @@ TEST_F(GetStatsTest, StackDepth) {
   ASSERT_EQ(pthread_attr_destroy(&thread_attributes), 0);
 }
 
+TEST_F(GetStatsTest, Snapshot) {
+  const absl::Time before = absl::Now();
+  const MallocExtension::StatsSnapshot exact =
+      MallocExtension::GetStatsSnapshot(/*exact=*/true);
+  EXPECT_GE(exact.page_heap_as_of, before);
+  EXPECT_GT(exact.heap_size, 0);
+  EXPECT_GT(exact.metadata, 0);
+  EXPECT_GT(exact.bytes_in_use_by_app, 0);
+  EXPECT_LE(exact.filler_size, exact.heap_size);
+  EXPECT_LE(exact.filler_free + exact.filler_unmapped, exact.filler_size);
+
+  // Without exact, the stats kept under the page heap lock are those mirrored
+  // last, which is no earlier than the exact snapshot above.
+  const MallocExtension::StatsSnapshot mirrored =
+      MallocExtension::GetStatsSnapshot();
+  EXPECT_GE(mirrored.page_heap_as_of, exact.page_heap_as_of);
+  EXPECT_GT(mirrored.heap_size, 0);
+
+  // The snapshot agrees with the properties computed under the lock, up to
+  // the allocations made between them.
+  const std::optional<size_t> in_use =
+      MallocExtension::GetNumericProperty("generic.bytes_in_use_by_app");
+  ASSERT_TRUE(in_use.has_value());
+  const size_t tolerance = 4 << 20;
+  EXPECT_LE(exact.bytes_in_use_by_app, *in_use + tolerance);
+  EXPECT_GE(exact.bytes_in_use_by_app + tolerance, *in_use);
+}
+
+TEST_F(GetStatsTest, MemoryUsageByTag) {
+  const std::vector<MallocExtension::MemoryTagUsage> usage =
+      MallocExtension::GetMemoryUsageByTag();
+  ASSERT_FALSE(usage.empty());
+
+  bool has_normal = false, has_metadata = false;
+  size_t committed = 0;
+  for (const auto& u : usage) {
+    SCOPED_TRACE(u.tag);
+    EXPECT_EQ(u.committed_bytes + u.released_bytes, u.mapped_bytes);
+    EXPECT_LE(u.free_bytes, u.committed_bytes);
+    if (u.tag == "NORMAL") {
+      has_normal = true;
+      EXPECT_EQ(u.numa_partition, 0);
+      EXPECT_GT(u.mapped_bytes, 0);
+    } else if (u.tag == "METADATA") {
+      has_metadata = true;
+      EXPECT_EQ(u.numa_partition, -1);
+      EXPECT_GT(u.mapped_bytes, 0);
+      continue;
+    }
+    committed += u.committed_bytes;
+  }
+  EXPECT_TRUE(has_normal);
+  EXPECT_TRUE(has_metadata);
+
+  // The page heaps together make up the heap, up to the allocations made
+  // between the calls.
+  const std::optional<size_t> heap_size =
+      MallocExtension::GetNumericProperty("generic.heap_size");
+  ASSERT_TRUE(heap_size.has_value());
+  const size_t tolerance = 4 << 20;
+  EXPECT_LE(committed, *heap_size + tolerance);
+  EXPECT_GE(committed + tolerance, *heap_size);
+}
+
+TEST_F(GetStatsTest, WireFormat) {
+  const std::string wire = MallocExtension::GetStatsInWireFormat();
+  ASSERT_FALSE(wire.empty());
+  // The first entry of the top level is tagged as field 6, length delimited.
+  EXPECT_EQ(wire[0], '\x32');
+  // Keys are written as is, as are raw values.
+  EXPECT_THAT(wire, HasSubstr("in_use_by_app"));
+  EXPECT_THAT(wire, HasSubstr("page_heap_freelist"));
+  EXPECT_THAT(wire, HasSubstr("sampled_profiles"));
+  // It is more compact than the text form of the same stats.
+  EXPECT_LT(wire.size(), GetStatsInPbTxt().size());
+}
+
+TEST_F(GetStatsTest, ExperimentCounters) {
+  // A large allocation goes to the page heap.
+  constexpr size_t kSize = 4 << 20;
+  void* alloc = ::operator new(kSize);
+
+  const std::string buf = MallocExtension::GetStats();
+  EXPECT_THAT(buf,
+              ContainsRegex("MALLOC EXPERIMENT COUNTERS:.* "
+                            "pageheap_lock_acquisitions=[1-9][0-9]*"));
+  EXPECT_THAT(GetStatsInPbTxt(), HasSubstr("experiment_counters {"));
+
+  std::optional<size_t> acquisitions = MallocExtension::GetNumericProperty(
+      "tcmalloc.experiment_counters.pageheap_lock_acquisitions");
+  ASSERT_THAT(acquisitions, testing::Ne(std::nullopt));
+  EXPECT_GT(*acquisitions, 0);
+  EXPECT_THAT(MallocExtension::GetNumericProperty(
+                  "tcmalloc.experiment_counters.not_a_counter"),
+              testing::Eq(std::nullopt));
+
+  ::operator delete(alloc, kSize);
+}
+
 TEST_F(GetStatsTest, SelSan) {
   std::string buf = MallocExtension::GetStats();
   std::string pbtxt = GetStatsInPbTxt();
@@ -69,6 +69,7 @@ TEST_P(HeapProfilingTest, GetHeapProfileWhileAllocAndDealloc) {
   for (auto t : {
            ProfileType::kHeap,
            ProfileType::kFragmentation,
+           ProfileType::kPreciseFragmentation,
            ProfileType::kPeakHeap,
        }) {
     manager.Start(2, [&, t](int) {
@@ -232,6 +233,99 @@ TEST(HeapProfilingTest, CheckResidency) {
 // it is iterating at, wants to get the per-sample lock and ends up with a
 // deadlock. At the current state, making copies over sampled allocations and
 // iterate over those copies would not deadlock and the test case below passes.
+TEST(HeapProfilingTest, SnapshotHeapDelta) {
+  ScopedProfileSamplingRate s(1);
+  const int num_allocations = 100;
+  const size_t requested_size1 = 12345;
+  const size_t requested_size2 = 23456;
+
+  auto Sum = [](MallocExtension::HeapProfileCursor& cursor, size_t size) {
+    int64_t sum = 0;
+    MallocExtension::SnapshotHeapDelta(&cursor).Iterate(
+        [&](const Profile::Sample& s) {
+          if (s.requested_size == size) sum += s.sum;
+        });
+    return sum;
+  };
+
+  void* allocations[num_allocations];
+  for (int i = 0; i < num_allocations; i++) {
+    allocations[i] = ::operator new(requested_size1);
+  }
+
+  // The first call for a cursor reports the whole live heap.
+  MallocExtension::HeapProfileCursor cursor;
+  const int64_t allocated = Sum(cursor, requested_size1);
+  EXPECT_FALSE(cursor.is_delta());
+  EXPECT_GT(allocated, 0);
+
+  // Samples allocated and freed between two deltas are not reported at all.
+  for (int i = 0; i < num_allocations; i++) {
+    ::operator delete(::operator new(requested_size2));
+  }
+  EXPECT_EQ(Sum(cursor, requested_size2), 0);
+  EXPECT_TRUE(cursor.is_delta());
+
+  // Frees of reported samples cancel them out.
+  for (int i = 0; i < num_allocations; i++) {
+    ::operator delete(allocations[i]);
+  }
+  EXPECT_EQ(Sum(cursor, requested_size1), -allocated);
+  EXPECT_TRUE(cursor.is_delta());
+  EXPECT_EQ(Sum(cursor, requested_size1), 0);
+}
+
+TEST(HeapProfilingTest, AllocationLabels) {
+  ScopedProfileSamplingRate s(1);
+  constexpr int kLabel = 17;
+  constexpr int kNumAllocations = 100;
+  constexpr size_t kLabeledSize = 12345;
+  constexpr size_t kUnlabeledSize = 23456;
+  const std::string property =
+      absl::StrFormat("tcmalloc.sampled_label_bytes.%d", kLabel);
+
+  EXPECT_EQ(MallocExtension::GetNumericProperty(property), 0);
+  EXPECT_EQ(MallocExtension::GetNumericProperty(absl::StrFormat(
+                "tcmalloc.sampled_label_bytes.%d",
+                MallocExtension::kNumAllocationLabels)),
+            std::nullopt);
+
+  void* labeled[kNumAllocations];
+  {
+    MallocExtension::ScopedAllocationLabel label(kLabel);
+    for (int i = 0; i < kNumAllocations; i++) {
+      labeled[i] = ::operator new(kLabeledSize);
+    }
+  }
+  void* unlabeled = ::operator new(kUnlabeledSize);
+
+  int labeled_samples = 0;
+  int unlabeled_samples = 0;
+  MallocExtension::SnapshotCurrent(ProfileType::kHeap)
+      .Iterate([&](const Profile::Sample& s) {
+        if (s.requested_size == kLabeledSize) {
+          EXPECT_EQ(s.label, kLabel);
+          labeled_samples++;
+        } else if (s.requested_size == kUnlabeledSize) {
+          EXPECT_EQ(s.label, 0);
+          unlabeled_samples++;
+        }
+      });
+  EXPECT_GT(labeled_samples, 0);
+  EXPECT_GT(unlabeled_samples, 0);
+
+  std::optional<size_t> bytes = MallocExtension::GetNumericProperty(property);
+  ASSERT_TRUE(bytes.has_value());
+  EXPECT_GE(*bytes, kNumAllocations * kLabeledSize / 2);
+
+  // Freeing the samples takes their bytes back off the label.
+  for (int i = 0; i < kNumAllocations; i++) {
+    ::operator delete(labeled[i]);
+  }
+  ::operator delete(unlabeled);
+  EXPECT_EQ(MallocExtension::GetNumericProperty(property), 0);
+}
+
 TEST(HeapProfilingTest, AllocateWhileIterating) {
   ScopedProfileSamplingRate s(1);
   absl::flat_hash_set<void*> set;
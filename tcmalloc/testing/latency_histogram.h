@@ -0,0 +1,104 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_TESTING_LATENCY_HISTOGRAM_H_
+#define TCMALLOC_TESTING_LATENCY_HISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "absl/numeric/bits.h"
+
+namespace tcmalloc {
+
+// LatencyHistogram counts latencies, such as cycle counts, in log-linear
+// buckets the way HDR histograms do: each power of two range is split into
+// kSubBuckets buckets, so any value is reported to within 1/kSubBuckets of
+// itself, however rare it is.  Recording is a handful of instructions, cheap
+// enough to time every operation of a benchmark.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  void Record(int64_t value) {
+    const uint64_t v = std::max<int64_t>(value, 0);
+    ++counts_[BucketFor(v)];
+    ++count_;
+    max_ = std::max(max_, v);
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kBuckets; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+
+  // Returns the smallest bucket bound which at least a fraction `p` of the
+  // recorded values are at or below, or 0 if nothing was recorded.
+  uint64_t Percentile(double p) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(count_))));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(UpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  static int BucketFor(uint64_t v) {
+    if (v < 2 * kSubBuckets) {
+      return v;
+    }
+    // The top kSubBucketBits + 1 bits of v pick the bucket.
+    const int shift = absl::bit_width(v) - 1 - kSubBucketBits;
+    const uint64_t top = v >> shift;
+    return (shift + 1) * kSubBuckets + (top - kSubBuckets);
+  }
+
+  // Returns the largest value counted in `bucket`.
+  static uint64_t UpperBound(int bucket) {
+    if (bucket < 2 * kSubBuckets) {
+      return bucket;
+    }
+    const int shift = bucket / kSubBuckets - 1;
+    const uint64_t top = kSubBuckets + bucket % kSubBuckets;
+    return ((top + 1) << shift) - 1;
+  }
+
+ private:
+  std::array<uint64_t, kBuckets> counts_ = {};
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
+
+}  // namespace tcmalloc
+
+#endif  // TCMALLOC_TESTING_LATENCY_HISTOGRAM_H_
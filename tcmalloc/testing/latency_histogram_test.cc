@@ -0,0 +1,90 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/testing/latency_histogram.h"
+
+#include <stdint.h>
+
+#include <limits>
+
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace {
+
+TEST(LatencyHistogramTest, Empty) {
+  LatencyHistogram h;
+  EXPECT_EQ(h.count(), 0);
+  EXPECT_EQ(h.max(), 0);
+  EXPECT_EQ(h.Percentile(0.5), 0);
+}
+
+TEST(LatencyHistogramTest, Buckets) {
+  // Small values have buckets of their own, and every value is within its
+  // bucket's bounds.
+  uint64_t previous = 0;
+  for (uint64_t v = 0; v < (uint64_t{1} << 20); ++v) {
+    const int bucket = LatencyHistogram::BucketFor(v);
+    ASSERT_GE(bucket, previous);
+    ASSERT_LE(bucket, previous + 1);
+    ASSERT_LE(v, LatencyHistogram::UpperBound(bucket));
+    if (v < 2 * LatencyHistogram::kSubBuckets) {
+      ASSERT_EQ(LatencyHistogram::UpperBound(bucket), v);
+    } else {
+      ASSERT_LE(LatencyHistogram::UpperBound(bucket) - v,
+                v / LatencyHistogram::kSubBuckets);
+    }
+    previous = bucket;
+  }
+
+  const uint64_t max = std::numeric_limits<uint64_t>::max();
+  EXPECT_EQ(LatencyHistogram::BucketFor(max), LatencyHistogram::kBuckets - 1);
+  EXPECT_EQ(LatencyHistogram::UpperBound(LatencyHistogram::kBuckets - 1), max);
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram h;
+  for (int i = 1; i <= 10000; ++i) {
+    h.Record(i);
+  }
+  // A single stall stands out in the maximum, but not the percentiles.
+  h.Record(1000000);
+
+  EXPECT_EQ(h.count(), 10001);
+  EXPECT_EQ(h.max(), 1000000);
+  EXPECT_NEAR(h.Percentile(0.5), 5000, 5000 / LatencyHistogram::kSubBuckets);
+  EXPECT_NEAR(h.Percentile(0.99), 9900, 9900 / LatencyHistogram::kSubBuckets);
+  EXPECT_GE(h.Percentile(0.99), 9900);
+  EXPECT_LE(h.Percentile(0.999), 10239);
+  EXPECT_EQ(h.Percentile(1), 1000000);
+}
+
+TEST(LatencyHistogramTest, Merge) {
+  LatencyHistogram a, b;
+  for (int i = 0; i < 100; ++i) {
+    a.Record(10);
+    b.Record(20);
+  }
+  b.Record(-5);
+
+  a.Merge(b);
+  EXPECT_EQ(a.count(), 201);
+  EXPECT_EQ(a.max(), 20);
+  EXPECT_EQ(a.Percentile(0), 0);
+  EXPECT_EQ(a.Percentile(0.25), 10);
+  EXPECT_EQ(a.Percentile(0.75), 20);
+}
+
+}  // namespace
+}  // namespace tcmalloc
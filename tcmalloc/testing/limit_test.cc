@@ -62,6 +62,7 @@ class LimitTest : public ::testing::Test {
   void LimitChangeTriggersReleaseSmallAllocs();
   void LimitRespected();
   void ExceedingSoftLimitDoesntCrashWithHardLimit();
+  void MemoryKindLimitTriggersRelease();
 
   void ReleaseMemory() {
     MallocExtension::SetMemoryLimit(0, MallocExtension::LimitKind::kSoft);
@@ -473,5 +474,59 @@ TEST_F(LimitTest, ExceedingSoftLimitDoesntCrashWithHardLimit) {
               testing::ExitedWithCode(0), "");
 }
 
+void LimitTest::MemoryKindLimitTriggersRelease() {
+  // Needed to see what expectation failed (if any).
+  testing::UnitTest::GetInstance()->listeners().SuppressEventForwarding(false);
+
+  EXPECT_EQ(
+      MallocExtension::GetMemoryKindLimit(MallocExtension::MemoryKind::kNormal),
+      std::numeric_limits<size_t>::max());
+
+  constexpr size_t kSize = 1 << 30;
+
+  const size_t heap_size =
+      *MallocExtension::GetNumericProperty("generic.heap_size");
+
+  // Trigger a large allocation that will rest in the page heap momentarily.
+  ::operator delete(::operator new(kSize));
+
+  // Limiting normal memory releases it without a process-wide limit.
+  const size_t limit = heap_size + kSize / 2;
+  MallocExtension::SetMemoryKindLimit(limit,
+                                      MallocExtension::MemoryKind::kNormal);
+  EXPECT_EQ(
+      MallocExtension::GetMemoryKindLimit(MallocExtension::MemoryKind::kNormal),
+      limit);
+  EXPECT_EQ(MallocExtension::GetMemoryKindLimit(
+                MallocExtension::MemoryKind::kSampled),
+            std::numeric_limits<size_t>::max());
+
+  EXPECT_LT(
+      *MallocExtension::GetNumericProperty("tcmalloc.pageheap_free_bytes"),
+      kSize / 2);
+  const absl::string_view stats = GetStats();
+  EXPECT_THAT(stats,
+              ContainsRegex("Number of times normal memory limit was hit: "
+                            "[1-9]"));
+  EXPECT_THAT(stats,
+              HasSubstr("Number of times sampled memory limit was hit: 0"));
+  EXPECT_THAT(stats, HasSubstr("Number of times soft limit was hit: 0"));
+
+  MallocExtension::SetMemoryKindLimit(0, MallocExtension::MemoryKind::kNormal);
+  EXPECT_EQ(
+      MallocExtension::GetMemoryKindLimit(MallocExtension::MemoryKind::kNormal),
+      std::numeric_limits<size_t>::max());
+
+  // Exit status indicates whether we've failed any of the expectations above.
+  exit(testing::Test::HasFailure());
+}
+
+TEST_F(LimitTest, MemoryKindLimitTriggersRelease) {
+  // Run the test in a separate subprocess, so it doesn't interfere with other
+  // tests.
+  EXPECT_EXIT(MemoryKindLimitTriggersRelease(), testing::ExitedWithCode(0),
+              "");
+}
+
 }  // namespace
 }  // namespace tcmalloc
@@ -0,0 +1,111 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <new>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "tcmalloc/internal/parameter_accessors.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+class ScopedSamplingInterval {
+ public:
+  explicit ScopedSamplingInterval(int64_t temporary_value)
+      : previous_(
+            TCMalloc_Internal_GetPageHeapLockContentionSamplingInterval()) {
+    TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(
+        temporary_value);
+  }
+
+  ~ScopedSamplingInterval() {
+    TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(previous_);
+  }
+
+ private:
+  int64_t previous_;
+};
+
+struct Totals {
+  int64_t acquisitions = 0;
+  absl::Duration wait;
+  absl::Duration hold;
+  int max_depth = 0;
+};
+
+Totals LockContention() {
+  Totals totals;
+  Profile profile =
+      MallocExtension::SnapshotCurrent(ProfileType::kLockContention);
+  EXPECT_EQ(profile.Type(), ProfileType::kLockContention);
+  profile.Iterate([&](const Profile::Sample& s) {
+    EXPECT_GT(s.count, 0);
+    EXPECT_GE(s.lock_wait_time, absl::ZeroDuration());
+    EXPECT_GE(s.lock_hold_time, absl::ZeroDuration());
+    totals.acquisitions += s.count;
+    totals.wait += s.lock_wait_time;
+    totals.hold += s.lock_hold_time;
+    totals.max_depth = std::max(totals.max_depth, s.depth);
+  });
+  return totals;
+}
+
+void AllocateLarge(int iterations) {
+  // Large allocations go to the page heap, and so take its lock, every time.
+  constexpr size_t kSize = 1 << 20;
+  for (int i = 0; i < iterations; ++i) {
+    void* ptr = ::operator new(kSize);
+    benchmark::DoNotOptimize(ptr);
+    ::operator delete(ptr);
+  }
+}
+
+TEST(LockContentionProfileTest, RecordsSampledAcquisitions) {
+  const Totals before = LockContention();
+  {
+    ScopedSamplingInterval interval(1);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+      threads.emplace_back([] { AllocateLarge(1000); });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  const Totals after = LockContention();
+  // Every allocation and free takes the lock at least once.
+  EXPECT_GE(after.acquisitions - before.acquisitions, 4 * 2 * 1000);
+  EXPECT_GT(after.hold, before.hold);
+  EXPECT_GT(after.max_depth, 0);
+
+  // With sampling off, nothing more is recorded.
+  {
+    ScopedSamplingInterval interval(0);
+    AllocateLarge(1000);
+  }
+  EXPECT_EQ(LockContention().acquisitions, after.acquisitions);
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -41,7 +41,8 @@ TEST(MallocExtension, SnapshotCurrentIsEmpty) {
   ProfileType types[] = {
       ProfileType::kHeap,
       ProfileType::kFragmentation, ProfileType::kPeakHeap,
-      ProfileType::kAllocations,
+      ProfileType::kAllocations, ProfileType::kAllocationRate,
+      ProfileType::kPreciseFragmentation, ProfileType::kLockContention,
   };
 
   for (auto t : types) {
@@ -17,10 +17,16 @@
 #include "tcmalloc/malloc_extension.h"
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <iterator>
 #include <map>
+#include <new>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -112,9 +118,11 @@ TEST(MallocExtension, Properties) {
       "tcmalloc.cpu_free",
       "tcmalloc.current_total_thread_cache_bytes",
       "tcmalloc.desired_usage_limit_bytes",
+      "tcmalloc.emergency_reserve_bytes",
       "tcmalloc.external_fragmentation_bytes",
       "tcmalloc.hard_limit_hits",
       "tcmalloc.hard_usage_limit_bytes",
+      "tcmalloc.large_span_cache_free",
       "tcmalloc.local_bytes",
       "tcmalloc.max_total_thread_cache_bytes",
       "tcmalloc.metadata_bytes",
@@ -151,6 +159,32 @@ TEST(MallocExtension, Properties) {
   }
 }
 
+TEST(MallocExtension, NumericPropertiesBatch) {
+  constexpr absl::string_view kProperties[] = {
+      "generic.heap_size",
+      "tcmalloc.metadata_bytes",
+      "not.a.property",
+      "tcmalloc.per_cpu_caches_active",
+      "generic.bytes_in_use_by_app",
+  };
+  const std::vector<std::optional<size_t>> values =
+      MallocExtension::GetNumericProperties(kProperties);
+  ASSERT_EQ(values.size(), std::size(kProperties));
+  for (size_t i = 0; i < values.size(); ++i) {
+    std::optional<size_t> single =
+        MallocExtension::GetNumericProperty(kProperties[i]);
+    // Values may change between lookups, so only their presence is compared.
+    EXPECT_EQ(values[i].has_value(), single.has_value()) << kProperties[i];
+  }
+  EXPECT_EQ(values[2], std::nullopt);
+  // Whether per-CPU caches are active does not change.
+  EXPECT_EQ(values[3], MallocExtension::GetNumericProperty(kProperties[3]));
+  EXPECT_GT(*values[1], 0);
+  EXPECT_LE(*values[4], *values[0]);
+
+  EXPECT_THAT(MallocExtension::GetNumericProperties({}), testing::IsEmpty());
+}
+
 // Test that when we resize the slab repeatedly, the metadata metric is
 // positive.
 TEST(MallocExtension, DynamicSlabMallocMetadata) {
@@ -171,6 +205,164 @@ TEST(MallocExtension, DynamicSlabMallocMetadata) {
       testing::Field(&MallocExtension::Property::value, testing::Gt(0)));
 }
 
+TEST(MallocExtension, Heaps) {
+  std::optional<MallocExtension::HeapHandle> heap =
+      MallocExtension::CreateHeap();
+  ASSERT_TRUE(heap.has_value());
+
+  std::vector<char*> ptrs;
+  for (int i = 0; i < 1000; ++i) {
+    char* ptr = static_cast<char*>(MallocExtension::HeapAllocate(*heap, 100));
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, i & 0xff, 100);
+    ptrs.push_back(ptr);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(static_cast<unsigned char>(ptrs[i][99]), i & 0xff);
+  }
+
+  void* aligned =
+      MallocExtension::HeapAllocate(*heap, 10, std::align_val_t{4096});
+  ASSERT_NE(aligned, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 4096, 0);
+  // Alignments must be powers of two.
+  EXPECT_EQ(MallocExtension::HeapAllocate(*heap, 10, std::align_val_t{24}),
+            nullptr);
+
+  MallocExtension::DestroyHeap(*heap);
+}
+
+TEST(MallocExtension, ThreadAllocationCounts) {
+  ScopedNeverSample never_sample;
+  const bool previous =
+      MallocExtension::GetPerThreadAllocationAccountingEnabled();
+  MallocExtension::SetPerThreadAllocationAccountingEnabled(true);
+  ASSERT_TRUE(MallocExtension::GetPerThreadAllocationAccountingEnabled());
+
+  for (size_t size : {size_t{100}, size_t{64} << 10, size_t{4} << 20}) {
+    SCOPED_TRACE(size);
+    const MallocExtension::ThreadAllocationCounts before =
+        MallocExtension::GetThreadAllocationCounts();
+    void* ptr = ::operator new(size);
+    const MallocExtension::ThreadAllocationCounts allocated =
+        MallocExtension::GetThreadAllocationCounts();
+    const std::optional<size_t> capacity =
+        MallocExtension::GetAllocatedSize(ptr);
+    ASSERT_TRUE(capacity.has_value());
+    EXPECT_EQ(allocated.allocated_bytes - before.allocated_bytes, *capacity);
+    EXPECT_EQ(allocated.freed_bytes, before.freed_bytes);
+
+    ::operator delete(ptr);
+    const MallocExtension::ThreadAllocationCounts freed =
+        MallocExtension::GetThreadAllocationCounts();
+    EXPECT_EQ(freed.allocated_bytes, allocated.allocated_bytes);
+    EXPECT_EQ(freed.freed_bytes - before.freed_bytes, *capacity);
+  }
+
+  // Nothing is counted while accounting is disabled.
+  MallocExtension::SetPerThreadAllocationAccountingEnabled(false);
+  const MallocExtension::ThreadAllocationCounts before =
+      MallocExtension::GetThreadAllocationCounts();
+  ::operator delete(::operator new(100));
+  const MallocExtension::ThreadAllocationCounts after =
+      MallocExtension::GetThreadAllocationCounts();
+  EXPECT_EQ(after.allocated_bytes, before.allocated_bytes);
+  EXPECT_EQ(after.freed_bytes, before.freed_bytes);
+
+  MallocExtension::SetPerThreadAllocationAccountingEnabled(previous);
+}
+
+TEST(MallocExtension, ReleaseAllCachedMemory) {
+  {
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 10000; ++i) {
+      ptrs.push_back(::operator new(64));
+    }
+    for (void* ptr : ptrs) {
+      ::operator delete(ptr);
+    }
+  }
+
+  MallocExtension::ReleaseAllCachedMemory();
+  // Nothing else runs in this test to refill the caches.
+  EXPECT_EQ(MallocExtension::GetNumericProperty("tcmalloc.cpu_free"), 0);
+  EXPECT_EQ(
+      MallocExtension::GetNumericProperty("tcmalloc.transfer_cache_free"), 0);
+  EXPECT_EQ(MallocExtension::GetNumericProperty(
+                "tcmalloc.sharded_transfer_cache_free"),
+            0);
+}
+
+TEST(MallocExtension, EmergencyReserve) {
+  auto reserve_bytes = []() {
+    return MallocExtension::GetNumericProperty(
+        "tcmalloc.emergency_reserve_bytes");
+  };
+
+  // The reserve holds whole hugepages, and can grow and shrink.
+  EXPECT_EQ(MallocExtension::SetEmergencyReserve(3 * kHugePageSize + 1),
+            4 * kHugePageSize);
+  EXPECT_EQ(reserve_bytes(), 4 * kHugePageSize);
+  EXPECT_EQ(MallocExtension::SetEmergencyReserve(kHugePageSize),
+            kHugePageSize);
+  EXPECT_EQ(reserve_bytes(), kHugePageSize);
+
+  // The reserve is not in use by the application.
+  const MallocExtension::StatsSnapshot reserved =
+      MallocExtension::GetStatsSnapshot(/*exact=*/true);
+  EXPECT_EQ(reserved.emergency_reserve, kHugePageSize);
+  EXPECT_THAT(MallocExtension::GetStats(),
+              testing::HasSubstr("Bytes in emergency reserve"));
+
+  EXPECT_EQ(MallocExtension::ReleaseEmergencyReserve(), kHugePageSize);
+  EXPECT_EQ(reserve_bytes(), 0);
+  EXPECT_EQ(MallocExtension::ReleaseEmergencyReserve(), 0);
+}
+
+TEST(MallocExtension, IoBufferPool) {
+  // Without a pool, there are no buffers.
+  ASSERT_FALSE(MallocExtension::GetIoBufferPool().has_value());
+  EXPECT_EQ(MallocExtension::AllocateIoBuffer(), nullptr);
+
+  std::optional<MallocExtension::IoBufferPool> pool =
+      MallocExtension::CreateIoBufferPool(/*buffer_size=*/5000,
+                                          /*num_buffers=*/10);
+  ASSERT_TRUE(pool.has_value());
+  const size_t page_size = getpagesize();
+  EXPECT_EQ(pool->buffer_size % page_size, 0);
+  EXPECT_GE(pool->buffer_size, 5000);
+  EXPECT_GE(pool->num_buffers, 10);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(pool->start) % kHugePageSize, 0);
+  EXPECT_EQ(pool->num_buffers * pool->buffer_size % kHugePageSize, 0);
+  // There is only one pool.
+  EXPECT_FALSE(MallocExtension::CreateIoBufferPool(4096, 1).has_value());
+  ASSERT_TRUE(MallocExtension::GetIoBufferPool().has_value());
+  EXPECT_EQ(MallocExtension::GetIoBufferPool()->start, pool->start);
+
+  // All of the buffers can be handed out, from the pool, until it runs dry.
+  std::vector<void*> buffers;
+  for (size_t i = 0; i < pool->num_buffers; ++i) {
+    void* buffer = MallocExtension::AllocateIoBuffer();
+    ASSERT_NE(buffer, nullptr);
+    const uintptr_t offset = reinterpret_cast<uintptr_t>(buffer) -
+                             reinterpret_cast<uintptr_t>(pool->start);
+    EXPECT_LT(offset, pool->num_buffers * pool->buffer_size);
+    EXPECT_EQ(offset % pool->buffer_size, 0);
+    memset(buffer, 0xab, pool->buffer_size);
+    buffers.push_back(buffer);
+  }
+  EXPECT_EQ(MallocExtension::AllocateIoBuffer(), nullptr);
+  EXPECT_THAT(MallocExtension::GetStats(),
+              testing::HasSubstr("MALLOC I/O BUFFER POOL"));
+
+  // Freed buffers are reused.
+  MallocExtension::FreeIoBuffer(buffers.back());
+  EXPECT_EQ(MallocExtension::AllocateIoBuffer(), buffers.back());
+  for (void* buffer : buffers) {
+    MallocExtension::FreeIoBuffer(buffer);
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
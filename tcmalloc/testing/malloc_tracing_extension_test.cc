@@ -20,7 +20,9 @@
 #include "tcmalloc/malloc_tracing_extension.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
@@ -29,6 +31,7 @@
 #ifndef MALLOC_TRACING_EXTENSION_NOT_SUPPORTED
 #include "gmock/gmock.h"
 #include "absl/cleanup/cleanup.h"
+#include "absl/types/span.h"
 #endif
 
 namespace {
@@ -44,6 +47,26 @@ TEST(MallocTracingExtension, GetAllocatedAddressRanges) {
   ASSERT_FALSE(allocated.ok());
   EXPECT_EQ(allocated.status().code(), absl::StatusCode::kUnimplemented);
 }
+
+TEST(MallocTracingExtension, ForEachAllocatedAddressRange) {
+  absl::StatusOr<uint64_t> epoch =
+      tcmalloc::malloc_tracing_extension::ForEachAllocatedAddressRange(
+          {}, [](const auto&) {});
+
+  ASSERT_FALSE(epoch.ok());
+  EXPECT_EQ(epoch.status().code(), absl::StatusCode::kUnimplemented);
+}
+
+TEST(MallocTracingExtension, AllocationEventTrace) {
+  EXPECT_EQ(tcmalloc::malloc_tracing_extension::StartAllocationEventTrace()
+                .code(),
+            absl::StatusCode::kUnimplemented);
+  absl::StatusOr<size_t> drained =
+      tcmalloc::malloc_tracing_extension::DrainAllocationEvents(
+          [](auto) {});
+  ASSERT_FALSE(drained.ok());
+  EXPECT_EQ(drained.status().code(), absl::StatusCode::kUnimplemented);
+}
 #else
 
 using ::tcmalloc::malloc_tracing_extension::AllocatedAddressRanges;
@@ -107,6 +130,125 @@ TEST(MallocTracingExtension, GetAllocatedAddressRanges) {
     }
   }
 }
+
+using ::tcmalloc::malloc_tracing_extension::AddressRangeScanOptions;
+using ::tcmalloc::malloc_tracing_extension::AllocatedAddressRangeBatch;
+using ::tcmalloc::malloc_tracing_extension::ForEachAllocatedAddressRange;
+
+// Streams a scan into ranges, checking the batches as they arrive.
+absl::StatusOr<uint64_t> Scan(const AddressRangeScanOptions& options,
+                              AllocatedAddressRanges& ranges) {
+  // Capacity is reserved up front, as the callback can't see the batches
+  // reallocating under it, but appending may allocate more spans.
+  ranges.spans.reserve(1 << 16);
+  uintptr_t last_end = 0;
+  return ForEachAllocatedAddressRange(
+      options, [&](const AllocatedAddressRangeBatch& batch) {
+        EXPECT_LE(last_end, batch.start_addr);
+        EXPECT_LE(batch.start_addr, batch.end_addr);
+        last_end = batch.end_addr;
+        for (const auto& span : batch.spans) {
+          EXPECT_LE(batch.start_addr, span.start_addr);
+          EXPECT_LT(span.start_addr, batch.end_addr);
+          EXPECT_GT(span.size, 0);
+          ranges.spans.push_back(span);
+        }
+      });
+}
+
+TEST(MallocTracingExtension, ForEachAllocatedAddressRange) {
+  const int kArrCount = 3;
+  size_t size[] = {2, 1000, 1000000};
+  void* arr[kArrCount];
+  for (int i = 0; i < kArrCount; i++) {
+    arr[i] = ::operator new(size[i]);
+  }
+  absl::Cleanup cleanup = [arr] {
+    for (int i = 0; i < kArrCount; i++) {
+      ::operator delete(arr[i]);
+    }
+  };
+
+  AllocatedAddressRanges all;
+  absl::StatusOr<uint64_t> epoch = Scan({}, all);
+  ASSERT_TRUE(epoch.ok());
+  for (int i = 0; i < kArrCount; i++) {
+    EXPECT_TRUE(GetSpanDetailsForObject(all, arr[i], size[i]).has_value())
+        << " for the " << size[i] << "-byte object at index " << i;
+  }
+
+  // An allocation after the scan is seen by an incremental scan since it.
+  void* later = ::operator new(size[2]);
+  AllocatedAddressRanges changed;
+  AddressRangeScanOptions options;
+  options.changed_since_epoch = *epoch;
+  absl::StatusOr<uint64_t> next = Scan(options, changed);
+  ::operator delete(later);
+  ASSERT_TRUE(next.ok());
+  EXPECT_GT(*next, *epoch);
+  EXPECT_TRUE(GetSpanDetailsForObject(changed, later, size[2]).has_value());
+}
+
+TEST(MallocTracingExtension, AllocationEventTrace) {
+  using tcmalloc::malloc_tracing_extension::AllocationEvent;
+  using tcmalloc::malloc_tracing_extension::AllocationEventKind;
+  using tcmalloc::malloc_tracing_extension::DrainAllocationEvents;
+
+  ASSERT_TRUE(
+      tcmalloc::malloc_tracing_extension::StartAllocationEventTrace().ok());
+  absl::Cleanup stop = [] {
+    (void)tcmalloc::malloc_tracing_extension::StopAllocationEventTrace();
+  };
+  EXPECT_EQ(tcmalloc::malloc_tracing_extension::StartAllocationEventTrace()
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+
+  // Small and page-level objects, freed with and without their size.
+  constexpr size_t kSizes[] = {8, 1000, 1000000};
+  std::vector<uintptr_t> allocated;
+  for (size_t size : kSizes) {
+    void* unsized = ::operator new(size);
+    void* sized = ::operator new(size);
+    allocated.push_back(reinterpret_cast<uintptr_t>(unsized));
+    allocated.push_back(reinterpret_cast<uintptr_t>(sized));
+    ::operator delete(unsized);
+    ::operator delete(sized, size);
+  }
+
+  // The callback allocates as it collects, which only adds events.
+  std::vector<AllocationEvent> events;
+  auto collect = [&](absl::Span<const AllocationEvent> batch) {
+    events.insert(events.end(), batch.begin(), batch.end());
+  };
+  ASSERT_TRUE(DrainAllocationEvents(collect).ok());
+  bool dropped = false;
+  for (const AllocationEvent& event : events) {
+    dropped |= event.kind == AllocationEventKind::kDropped;
+  }
+  // Some other thread of the test binary could have filled our buffer.
+  if (!dropped) {
+    for (uintptr_t address : allocated) {
+      bool seen_new = false, seen_delete = false;
+      for (const AllocationEvent& event : events) {
+        if (event.address != address) continue;
+        seen_new |= event.kind == AllocationEventKind::kNew;
+        seen_delete |= event.kind == AllocationEventKind::kDelete;
+      }
+      EXPECT_TRUE(seen_new) << address;
+      EXPECT_TRUE(seen_delete) << address;
+    }
+  }
+
+  // Nothing is recorded once the trace stops.
+  ASSERT_TRUE(
+      tcmalloc::malloc_tracing_extension::StopAllocationEventTrace().ok());
+  ASSERT_TRUE(DrainAllocationEvents([](auto) {}).ok());
+  void* untraced = ::operator new(64);
+  ::operator delete(untraced);
+  absl::StatusOr<size_t> drained = DrainAllocationEvents(collect);
+  ASSERT_TRUE(drained.ok());
+  EXPECT_EQ(*drained, 0);
+}
 #endif
 
 }  // namespace
@@ -26,11 +26,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
 #include "tcmalloc/internal/page_size.h"
 
 namespace tcmalloc {
@@ -224,6 +226,37 @@ TEST(MemalignTest, Memalign) {
   }
 }
 
+// Alignments past a hugepage are served from whole, exactly aligned hugepage
+// ranges.
+TEST(MemalignTest, HugeAlignment) {
+  for (size_t a : {size_t{4} << 20, size_t{64} << 20, size_t{1} << 30}) {
+    for (size_t s : {size_t{1}, size_t{4096}, size_t{3} << 20, a}) {
+      SCOPED_TRACE(absl::StrCat("align ", a, " size ", s));
+      std::vector<void*> ptrs;
+      ptrs.push_back(memalign(a, s));
+      ptrs.push_back(aligned_alloc(a, (s + a - 1) & ~(a - 1)));
+      void* p;
+      ASSERT_EQ(0, posix_memalign(&p, a, s));
+      ptrs.push_back(p);
+      for (void* ptr : ptrs) {
+        ASSERT_NE(ptr, nullptr);
+        CheckAlignment(ptr, a);
+        // Touch only the ends of the larger allocations.
+        const int n = std::min<size_t>(s, 4096);
+        Fill(ptr, n, 'h');
+        Fill(static_cast<char*>(ptr) + s - n, n, 't');
+        ASSERT_TRUE(Valid(static_cast<char*>(ptr) + s - n, n, 't'));
+        if (s >= 2 * n) {
+          ASSERT_TRUE(Valid(ptr, n, 'h'));
+        }
+      }
+      for (void* ptr : ptrs) {
+        free(ptr);
+      }
+    }
+  }
+}
+
 TEST(MemalignTest, PosixMemalign) {
   // Try allocating data with a bunch of alignments and sizes
   for (int a = sizeof(void*); a < 1048576; a *= 2) {
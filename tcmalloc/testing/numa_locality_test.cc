@@ -77,7 +77,8 @@ size_t BackingNode(void* const ptr) {
 
 class FakeNumaAwareRegionFactory final : public tcmalloc::AddressRegionFactory {
  public:
-  static constexpr size_t kAddrsAndHintsSize = 8;
+  // Every partition has its normal, sampled and cold regions.
+  static constexpr size_t kAddrsAndHintsSize = 4 * kNumaPartitions;
 
   explicit FakeNumaAwareRegionFactory(AddressRegionFactory* under)
       : under_(under) {}
@@ -129,12 +130,10 @@ class FakeNumaAwareRegionFactory final : public tcmalloc::AddressRegionFactory {
         ++found_;
         // Ignore "special" hints, e.x. kInfrequentAllocation and
         // kInfrequentAccess.
-        if (hint != UsageHint::kNormalNumaAwareS0 &&
-            hint != UsageHint::kNormalNumaAwareS1) {
+        const int hinted_partition = HintedPartition(hint);
+        if (hinted_partition < 0) {
           return;
         }
-        const int hinted_partition =
-            hint == UsageHint::kNormalNumaAwareS1 ? 1 : 0;
         EXPECT_EQ(expected_partition, hinted_partition);
         return;
       }
@@ -149,6 +148,23 @@ class FakeNumaAwareRegionFactory final : public tcmalloc::AddressRegionFactory {
   }
 
  private:
+  // Returns the NUMA partition a region was created for, or -1 if its hint
+  // isn't for any partition in particular.
+  static int HintedPartition(UsageHint hint) {
+    switch (hint) {
+      case UsageHint::kNormalNumaAwareS0:
+        return 0;
+      case UsageHint::kNormalNumaAwareS1:
+        return 1;
+      case UsageHint::kNormalNumaAwareS2:
+        return 2;
+      case UsageHint::kNormalNumaAwareS3:
+        return 3;
+      default:
+        return -1;
+    }
+  }
+
   std::array<std::tuple<void*, size_t, UsageHint>, kAddrsAndHintsSize>
       addrs_and_hints_ = {};
   AddressRegionFactory* under_ = nullptr;
@@ -215,6 +231,9 @@ TEST(NumaLocalityTest, AllocationsAreLocal) {
       // same NUMA partition as the local node.
       EXPECT_EQ(NodeToPartition(backing_node, kNumaPartitions),
                 NodeToPartition(local_node, kNumaPartitions));
+      // Its tag should name that partition too.
+      EXPECT_EQ(NumaPartitionFromPointer(ptr),
+                NodeToPartition(local_node, kNumaPartitions));
       if (logging_factory) {
         logging_factory->VerifyHint(
             ptr, NodeToPartition(backing_node, kNumaPartitions));
@@ -16,10 +16,12 @@
 #include <stdint.h>
 
 #include <optional>
+#include <string>
 
 #include "benchmark/benchmark.h"
 #include "gtest/gtest.h"
 #include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
 #include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/malloc_extension.h"
 
@@ -143,5 +145,69 @@ TEST(PeakHeapProfilingTest, PeakHeapTracking) {
   }
 }
 
+int64_t ProfileSize(const Profile& profile) {
+  int64_t total = 0;
+  profile.Iterate([&](const Profile::Sample& e) { total += e.sum; });
+  return total;
+}
+
+TEST(PeakHeapProfilingTest, Windows) {
+  ScopedPeakGrowthFraction s(1.25);
+
+  EXPECT_EQ(MallocExtension::GetPeakHeapWindowSize("batch"), std::nullopt);
+  EXPECT_FALSE(MallocExtension::ResetPeakHeapWindow(""));
+  ASSERT_TRUE(MallocExtension::ResetPeakHeapWindow("batch"));
+
+  // The first sampled allocation after a reset saves the heap as it is then.
+  void* first = ::operator new(64 << 20);
+  benchmark::DoNotOptimize(first);
+  const std::optional<size_t> first_peak =
+      MallocExtension::GetPeakHeapWindowSize("batch");
+  ASSERT_TRUE(first_peak.has_value());
+  EXPECT_GE(*first_peak, 54 << 20);
+  EXPECT_NEAR(ProfileSize(MallocExtension::SnapshotPeakHeapWindow("batch")),
+              *first_peak, 10 << 20);
+  ::operator delete(first);
+
+  // After another reset the window no longer remembers the earlier peak, but
+  // the all-time peak does.
+  ASSERT_TRUE(MallocExtension::ResetPeakHeapWindow("batch"));
+  void* second = ::operator new(16 << 20);
+  benchmark::DoNotOptimize(second);
+  const std::optional<size_t> second_peak =
+      MallocExtension::GetPeakHeapWindowSize("batch");
+  ASSERT_TRUE(second_peak.has_value());
+  EXPECT_GT(*second_peak, 0);
+  EXPECT_LT(*second_peak, *first_peak);
+  EXPECT_GE(ProfileSize(ProfileType::kPeakHeap), *first_peak);
+  ::operator delete(second);
+
+  MallocExtension::RemovePeakHeapWindow("batch");
+  EXPECT_EQ(MallocExtension::GetPeakHeapWindowSize("batch"), std::nullopt);
+  EXPECT_EQ(ProfileSize(MallocExtension::SnapshotPeakHeapWindow("batch")), 0);
+}
+
+TEST(PeakHeapProfilingTest, TooManyWindows) {
+  int created = 0;
+  for (; created < 1000; ++created) {
+    const std::string name = absl::StrCat("window", created);
+    if (!MallocExtension::ResetPeakHeapWindow(name)) {
+      break;
+    }
+  }
+  ASSERT_LT(created, 1000);
+  EXPECT_GT(created, 1);
+  EXPECT_FALSE(MallocExtension::ResetPeakHeapWindow("one too many"));
+
+  // Removing a window makes room for another.
+  MallocExtension::RemovePeakHeapWindow("window0");
+  EXPECT_TRUE(MallocExtension::ResetPeakHeapWindow("one too many"));
+
+  MallocExtension::RemovePeakHeapWindow("one too many");
+  for (int i = 1; i < created; ++i) {
+    MallocExtension::RemovePeakHeapWindow(absl::StrCat("window", i));
+  }
+}
+
 }  // namespace
 }  // namespace tcmalloc
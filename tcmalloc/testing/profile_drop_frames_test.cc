@@ -169,6 +169,26 @@ wrap_size_returning_operator_new_hot_cold_nothrow(size_t size) {
       .p;
 }
 
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* wrap_zeroed_operator_new(
+    size_t size) {
+  return tcmalloc_zeroed_operator_new(size);
+}
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* wrap_zeroed_operator_new_nothrow(
+    size_t size) {
+  return tcmalloc_zeroed_operator_new_nothrow(size);
+}
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* wrap_interleaved_operator_new(
+    size_t size) {
+  return tcmalloc_interleaved_operator_new(size);
+}
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void*
+wrap_interleaved_operator_new_nothrow(size_t size) {
+  return tcmalloc_interleaved_operator_new_nothrow(size);
+}
+
 inline ABSL_ATTRIBUTE_ALWAYS_INLINE void*
 wrap_size_returning_operator_new_aligned(size_t size) {
   return tcmalloc_size_returning_operator_new_aligned(size,
@@ -254,6 +274,10 @@ void profile_test_top_func() {
   test<wrap_size_returning_operator_new_nothrow, wrap_sized_delete>();
   test<wrap_size_returning_operator_new_hot_cold, wrap_sized_delete>();
   test<wrap_size_returning_operator_new_hot_cold_nothrow, wrap_sized_delete>();
+  test<wrap_zeroed_operator_new, wrap_sized_delete>();
+  test<wrap_zeroed_operator_new_nothrow, wrap_sized_delete>();
+  test<wrap_interleaved_operator_new, wrap_sized_delete>();
+  test<wrap_interleaved_operator_new_nothrow, wrap_sized_delete>();
   test<wrap_size_returning_operator_new_aligned, wrap_delete_aligned>();
   test<wrap_size_returning_operator_new_aligned_nothrow, wrap_delete_aligned>();
   test<wrap_size_returning_operator_new_aligned_hot_cold,
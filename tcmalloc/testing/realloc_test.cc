@@ -96,5 +96,49 @@ TEST(ReallocTest, AlignedAllocRealloc) {
   }
 }
 
+// Large allocations may be resized in place, growing into or shrinking from
+// the pages after them.  Contents must survive either way.
+TEST(ReallocTest, LargeResize) {
+  constexpr size_t kSizes[] = {300 << 10, 320 << 10, 1 << 20,  600 << 10,
+                               3 << 20,   200 << 10, 400 << 10};
+  size_t size = kSizes[0];
+  auto buffer = static_cast<unsigned char*>(malloc(size));
+  ASSERT_NE(buffer, nullptr);
+  Fill(buffer, size);
+  for (size_t new_size : kSizes) {
+    buffer = static_cast<unsigned char*>(realloc(buffer, new_size));
+    ASSERT_NE(buffer, nullptr);
+    ExpectValid(buffer, std::min(size, new_size));
+    Fill(buffer, new_size);
+    size = new_size;
+  }
+  free(buffer);
+}
+
+// Allocations of many hugepages may have their pages moved rather than
+// copied.
+TEST(ReallocTest, HugeGrowth) {
+  constexpr size_t kStride = 4096;
+  constexpr size_t kSizes[] = {48 << 20, 96 << 20, 100 << 20, 200 << 20};
+  size_t size = kSizes[0];
+  auto buffer = static_cast<size_t*>(malloc(size));
+  ASSERT_NE(buffer, nullptr);
+  for (size_t i = 0; i < size / sizeof(size_t); i += kStride) {
+    buffer[i] = i;
+  }
+  for (size_t new_size : kSizes) {
+    buffer = static_cast<size_t*>(realloc(buffer, new_size));
+    ASSERT_NE(buffer, nullptr);
+    for (size_t i = 0; i < size / sizeof(size_t); i += kStride) {
+      ASSERT_EQ(buffer[i], i);
+    }
+    for (size_t i = 0; i < new_size / sizeof(size_t); i += kStride) {
+      buffer[i] = i;
+    }
+    size = new_size;
+  }
+  free(buffer);
+}
+
 }  // namespace
 }  // namespace tcmalloc
@@ -0,0 +1,61 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <new>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/system-alloc.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// This test's environment reserves 64 GiB per tag at a time.
+constexpr size_t kReservation = size_t{64} << 30;
+
+TEST(ReserveAddressSpace, CarvesFromOneReservation) {
+  if (sizeof(void*) < 8 || kReservation > (kTagMask + 1) / 4) {
+    GTEST_SKIP() << "Address space too small";
+  }
+  EXPECT_EQ(SystemAllocRegionSize(), std::max(kReservation, kMinMmapAlloc));
+
+  // Allocations larger than kMinMmapAlloc come from the reservation too, so
+  // they are placed next to each other.
+  constexpr size_t kSize = 3 * (kMinMmapAlloc / 2);
+  void* a = ::operator new(kSize);
+  void* b = ::operator new(kSize);
+  const uintptr_t lo = std::min(reinterpret_cast<uintptr_t>(a),
+                                reinterpret_cast<uintptr_t>(b));
+  const uintptr_t hi = std::max(reinterpret_cast<uintptr_t>(a),
+                                reinterpret_cast<uintptr_t>(b));
+  EXPECT_LT(hi - lo, kReservation);
+  EXPECT_EQ(GetMemoryTag(a), GetMemoryTag(b));
+  ::operator delete(a, kSize);
+  ::operator delete(b, kSize);
+
+  EXPECT_THAT(MallocExtension::GetStats(),
+              testing::HasSubstr(
+                  "Address Space Reserved Per Tag In Ranges Of: 68719476736"));
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
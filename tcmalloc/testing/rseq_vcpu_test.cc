@@ -0,0 +1,68 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sched.h>
+
+#include <new>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/internal/numa.h"
+#include "tcmalloc/internal/percpu.h"
+#include "tcmalloc/static_vars.h"
+
+namespace tcmalloc::tcmalloc_internal {
+namespace {
+
+using subtle::percpu::VirtualCpu;
+
+// This test runs with TCMALLOC_RSEQ_VCPU_MODE=mm_cid.
+TEST(RseqVcpuTest, DenseIds) {
+  if (!subtle::percpu::IsFast()) {
+    GTEST_SKIP() << "per-CPU unavailable";
+  }
+  if (!subtle::percpu::UsingRseqVirtualCpus()) {
+    GTEST_SKIP() << "mm_cid unavailable";
+  }
+  EXPECT_EQ(subtle::percpu::GetRseqVcpuMode(),
+            subtle::percpu::RseqVcpuMode::kMmCid);
+  // Caches indexed by mm_cid are not partitioned by node.
+  EXPECT_FALSE(tc_globals.numa_topology().numa_aware());
+
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  const int num_allowed = CPU_COUNT(&allowed);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([num_allowed]() {
+      for (int j = 0; j < 1000; ++j) {
+        ::operator delete(::operator new(64));
+        const int vcpu = VirtualCpu::Synchronize();
+        // Ids are dense: below both the number of CPUs we may run on, and
+        // the number of threads that might be running.
+        EXPECT_GE(vcpu, 0);
+        EXPECT_LT(vcpu, num_allowed);
+        EXPECT_LT(vcpu, 5);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace
+}  // namespace tcmalloc::tcmalloc_internal
@@ -271,6 +271,27 @@ TEST(Sampler, weight_distribution) {
   }
 }
 
+TEST(Sampler, AdaptSamplingRate) {
+  constexpr int64_t kRate = int64_t{2} << 20;
+  constexpr double kTarget = 10;
+  // Close enough to the target.
+  EXPECT_EQ(AdaptSamplingRate(kRate, kTarget * 1.05, kTarget), kRate);
+  // Too many samples call for a longer interval between them, and too few for
+  // a shorter one.
+  EXPECT_EQ(AdaptSamplingRate(kRate, kTarget * 1.5, kTarget), kRate * 3 / 2);
+  EXPECT_EQ(AdaptSamplingRate(kRate, kTarget / 1.6, kTarget), kRate * 5 / 8);
+  // The rate moves only so far at a time.
+  EXPECT_EQ(AdaptSamplingRate(kRate, kTarget * 100, kTarget), 2 * kRate);
+  EXPECT_EQ(AdaptSamplingRate(kRate, 0, kTarget), kRate / 2);
+  // And stays within bounds.
+  EXPECT_EQ(AdaptSamplingRate(kMinAdaptiveSamplingRate, 0, kTarget),
+            kMinAdaptiveSamplingRate);
+  EXPECT_EQ(AdaptSamplingRate(kMaxAdaptiveSamplingRate, kTarget * 100, kTarget),
+            kMaxAdaptiveSamplingRate);
+  // Disabled sampling stays disabled.
+  EXPECT_EQ(AdaptSamplingRate(0, 0, kTarget), 0);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -0,0 +1,133 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/shared_memory_region_factory.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/types/span.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+using UsageHint = AddressRegionFactory::UsageHint;
+
+// Records the hints of the regions it is asked for, without backing them.
+class RecordingRegionFactory final : public AddressRegionFactory {
+ public:
+  AddressRegion* Create(void* start, size_t size, UsageHint hint) override {
+    hints.push_back(hint);
+    return nullptr;
+  }
+
+  size_t GetStats(absl::Span<char> buffer) override { return 0; }
+
+  std::vector<UsageHint> hints;
+};
+
+class SharedMemoryRegionFactoryTest : public testing::Test {
+ protected:
+  static constexpr size_t kRegionSize = 4 << 20;
+
+  ~SharedMemoryRegionFactoryTest() override {
+    for (void* reservation : reservations_) {
+      munmap(reservation, kRegionSize);
+    }
+  }
+
+  // Reserves address space, as TCMalloc does before it creates a region.
+  void* Reserve() {
+    void* p = mmap(nullptr, kRegionSize, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    EXPECT_NE(p, MAP_FAILED);
+    reservations_.push_back(p);
+    return p;
+  }
+
+  std::string Stats() {
+    std::string stats(4096, '\0');
+    stats.resize(factory_.GetStats(absl::MakeSpan(stats)));
+    return stats;
+  }
+
+  RecordingRegionFactory next_;
+  SharedMemoryRegionFactory factory_{&next_};
+  std::vector<void*> reservations_;
+};
+
+TEST_F(SharedMemoryRegionFactoryTest, OtherHintsAreNotShared) {
+  EXPECT_EQ(factory_.Create(Reserve(), kRegionSize, UsageHint::kNormal),
+            nullptr);
+  EXPECT_THAT(next_.hints, testing::ElementsAre(UsageHint::kNormal));
+  EXPECT_EQ(factory_.fd(), -1);
+  EXPECT_EQ(factory_.GetMappings({}), 0);
+}
+
+TEST_F(SharedMemoryRegionFactoryTest, SharesRegions) {
+  const size_t page_size = getpagesize();
+  void* first = Reserve();
+  AddressRegion* region =
+      factory_.Create(first, kRegionSize, UsageHint::kInfrequentAccess);
+  ASSERT_NE(region, nullptr);
+  EXPECT_TRUE(next_.hints.empty());
+  ASSERT_GE(factory_.fd(), 0);
+
+  // Memory is handed out from the start of the region, and so of the file.
+  auto [p, size] = region->Alloc(page_size, page_size);
+  ASSERT_EQ(p, first);
+  EXPECT_EQ(size, page_size);
+  auto [q, q_size] = region->Alloc(page_size, 2 * page_size);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(q) % (2 * page_size), 0);
+  EXPECT_EQ(region->Alloc(kRegionSize, page_size).first, nullptr);
+
+  void* second = Reserve();
+  ASSERT_NE(factory_.Create(second, kRegionSize, UsageHint::kInfrequentAccess),
+            nullptr);
+  SharedMemoryRegionFactory::Mapping mappings[2];
+  ASSERT_EQ(factory_.GetMappings(absl::MakeSpan(mappings)), 2);
+  EXPECT_EQ(mappings[0].start, first);
+  EXPECT_EQ(mappings[0].offset, 0);
+  EXPECT_EQ(mappings[1].start, second);
+  EXPECT_EQ(mappings[1].offset, kRegionSize);
+  const SharedMemoryRegionFactory::Mapping* found =
+      factory_.FindMapping(static_cast<char*>(second) + 5);
+  ASSERT_NE(found, nullptr);
+  EXPECT_EQ(found->start, second);
+  EXPECT_EQ(factory_.FindMapping(&page_size), nullptr);
+
+  // Another mapping of the file, as a sibling process would make, sees what
+  // is written to the region without a copy.
+  void* view = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, factory_.fd(),
+                    mappings[0].offset);
+  ASSERT_NE(view, MAP_FAILED);
+  strcpy(static_cast<char*>(p), "shared");
+  EXPECT_STREQ(static_cast<char*>(view), "shared");
+  munmap(view, page_size);
+
+  EXPECT_THAT(Stats(), testing::HasSubstr("never moved or unmapped"));
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,161 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the speed and internal fragmentation of a TCMalloc's size classes,
+// for comparing size_class_tradeoff_benchmark with
+// size_class_tradeoff_benchmark_pow2, which differ only in linking the default
+// TCMalloc or the power-of-two one.
+//
+// Each benchmark draws sizes up to range(0) bytes, uniformly or log-uniformly,
+// and reports as rounding_overhead the bytes their classes add to them, as a
+// fraction of the bytes requested.  The live_* counters are those of a heap of
+// 64MiB of such objects: the memory TCMalloc holds for it beyond the bytes
+// requested, as a fraction of them.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+enum class Distribution { kUniform, kLogUniform };
+
+std::vector<size_t> Sizes(Distribution distribution, size_t max_size,
+                          size_t n) {
+  absl::BitGen rng;
+  std::vector<size_t> sizes(n);
+  for (size_t& size : sizes) {
+    size = distribution == Distribution::kUniform
+               ? absl::Uniform<size_t>(absl::IntervalClosed, rng, 1, max_size)
+               : absl::LogUniform<size_t>(rng, 1, max_size);
+  }
+  return sizes;
+}
+
+double RoundingOverhead(const std::vector<size_t>& sizes) {
+  double requested = 0;
+  double allocated = 0;
+  for (size_t size : sizes) {
+    requested += size;
+    allocated += nallocx(size, 0);
+  }
+  return (allocated - requested) / requested;
+}
+
+// What a heap of objects of sizes costs beyond the bytes in them, as a fraction
+// of those bytes.
+void LiveOverhead(benchmark::State& state, const std::vector<size_t>& sizes) {
+  constexpr size_t kHeapBytes = 64 << 20;
+  MallocExtension::ReleaseMemoryToSystem(std::numeric_limits<size_t>::max());
+  const std::optional<size_t> before_physical =
+      MallocExtension::GetNumericProperty("generic.physical_memory_used");
+  const std::optional<size_t> before_allocated =
+      MallocExtension::GetNumericProperty("generic.current_allocated_bytes");
+  if (!before_physical.has_value() || !before_allocated.has_value()) return;
+
+  std::vector<std::pair<void*, size_t>> live;
+  size_t requested = 0;
+  for (size_t i = 0; requested < kHeapBytes; i = (i + 1) % sizes.size()) {
+    live.emplace_back(::operator new(sizes[i]), sizes[i]);
+    requested += sizes[i];
+  }
+  const size_t allocated =
+      *MallocExtension::GetNumericProperty("generic.current_allocated_bytes") -
+      *before_allocated;
+  const size_t physical =
+      *MallocExtension::GetNumericProperty("generic.physical_memory_used") -
+      *before_physical;
+  for (auto [ptr, size] : live) {
+    ::operator delete(ptr, size);
+  }
+
+  state.counters["live_allocated_overhead"] =
+      static_cast<double>(allocated) / requested - 1;
+  state.counters["live_physical_overhead"] =
+      static_cast<double>(physical) / requested - 1;
+}
+
+template <Distribution distribution>
+void BM_size_class_lookup(benchmark::State& state) {
+  const std::vector<size_t> sizes =
+      Sizes(distribution, state.range(0), 4096);
+
+  for (auto s : state) {
+    for (size_t size : sizes) {
+      benchmark::DoNotOptimize(nallocx(size, 0));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * sizes.size());
+  state.counters["rounding_overhead"] = RoundingOverhead(sizes);
+}
+BENCHMARK_TEMPLATE(BM_size_class_lookup, Distribution::kUniform)
+    ->Arg(1024)
+    ->Arg(256 << 10);
+BENCHMARK_TEMPLATE(BM_size_class_lookup, Distribution::kLogUniform)
+    ->Arg(1024)
+    ->Arg(256 << 10);
+
+template <Distribution distribution>
+void BM_new_sized_delete(benchmark::State& state) {
+  const std::vector<size_t> sizes =
+      Sizes(distribution, state.range(0), 4096);
+
+  for (auto s : state) {
+    for (size_t size : sizes) {
+      void* ptr = ::operator new(size);
+      benchmark::DoNotOptimize(ptr);
+      ::operator delete(ptr, size);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * sizes.size());
+  state.counters["rounding_overhead"] = RoundingOverhead(sizes);
+  LiveOverhead(state, sizes);
+}
+BENCHMARK_TEMPLATE(BM_new_sized_delete, Distribution::kUniform)
+    ->Arg(1024)
+    ->Arg(256 << 10);
+BENCHMARK_TEMPLATE(BM_new_sized_delete, Distribution::kLogUniform)
+    ->Arg(1024)
+    ->Arg(256 << 10);
+
+// 64-byte alignment, as for SIMD buffers, which every power-of-two class from
+// 64 bytes up has without a search for an aligned class.
+void BM_aligned_new_delete(benchmark::State& state) {
+  const std::vector<size_t> sizes =
+      Sizes(Distribution::kLogUniform, state.range(0), 4096);
+  constexpr std::align_val_t kAlign{64};
+
+  for (auto s : state) {
+    for (size_t size : sizes) {
+      void* ptr = ::operator new(size, kAlign);
+      benchmark::DoNotOptimize(ptr);
+      ::operator delete(ptr, size, kAlign);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * sizes.size());
+}
+BENCHMARK(BM_aligned_new_delete)->Arg(1024)->Arg(256 << 10);
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,105 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares growing containers with std::allocator and with SizedAllocator,
+// which lets them use the slack TCMalloc gives them.  The "reallocs" counter
+// is the number of times a container moved to a larger buffer.
+
+#include <stddef.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/sized_allocator.h"
+
+namespace tcmalloc {
+namespace {
+
+template <typename Container>
+void BM_Growth(benchmark::State& state) {
+  const size_t n = state.range(0);
+  size_t reallocs = 0;
+  for (auto s : state) {
+    Container c;
+    size_t capacity = c.capacity();
+    for (size_t i = 0; i < n; ++i) {
+      c.push_back(static_cast<typename Container::value_type>(i));
+      if (c.capacity() != capacity) {
+        capacity = c.capacity();
+        ++reallocs;
+      }
+    }
+    benchmark::DoNotOptimize(c.data());
+  }
+  state.counters["reallocs"] =
+      benchmark::Counter(reallocs, benchmark::Counter::kAvgIterations);
+}
+
+template <typename T>
+using SizedVector = std::vector<T, SizedAllocator<T>>;
+using SizedString =
+    std::basic_string<char, std::char_traits<char>, SizedAllocator<char>>;
+
+BENCHMARK(BM_Growth<std::vector<int>>)->Range(8, 1 << 16);
+BENCHMARK(BM_Growth<SizedVector<int>>)->Range(8, 1 << 16);
+BENCHMARK(BM_Growth<std::vector<char>>)->Range(8, 1 << 16);
+BENCHMARK(BM_Growth<SizedVector<char>>)->Range(8, 1 << 16);
+BENCHMARK(BM_Growth<std::string>)->Range(8, 1 << 16);
+BENCHMARK(BM_Growth<SizedString>)->Range(8, 1 << 16);
+
+// Grows a buffer by hand the way a container using allocate_at_least() does,
+// which shows the savings under standard libraries whose containers don't.
+template <typename Alloc>
+void BM_ManualGrowth(benchmark::State& state) {
+  const size_t n = state.range(0);
+  Alloc alloc;
+  size_t reallocs = 0;
+  for (auto s : state) {
+    size_t capacity = 1;
+    char* buf = alloc.allocate(capacity);
+    for (size_t size = 0; size < n; ++size) {
+      if (size == capacity) {
+        size_t new_capacity = 2 * capacity;
+        char* next;
+        if constexpr (std::is_same_v<Alloc, SizedAllocator<char>>) {
+          auto [p, count] = alloc.allocate_at_least(new_capacity);
+          next = p;
+          new_capacity = count;
+        } else {
+          next = alloc.allocate(new_capacity);
+        }
+        memcpy(next, buf, size);
+        alloc.deallocate(buf, capacity);
+        buf = next;
+        capacity = new_capacity;
+        ++reallocs;
+      }
+      buf[size] = static_cast<char>(size);
+    }
+    benchmark::DoNotOptimize(buf);
+    alloc.deallocate(buf, capacity);
+  }
+  state.counters["reallocs"] =
+      benchmark::Counter(reallocs, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_ManualGrowth<std::allocator<char>>)->Range(8, 1 << 16);
+BENCHMARK(BM_ManualGrowth<SizedAllocator<char>>)->Range(8, 1 << 16);
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,86 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/sized_allocator.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+TEST(SizedAllocatorTest, ReturnsCapacity) {
+  SizedAllocator<int32_t> alloc;
+  for (size_t n : {1, 3, 5, 100, 1000, 100000}) {
+    auto [p, count] = alloc.allocate_at_least(n);
+    ASSERT_NE(p, nullptr);
+    EXPECT_GE(count, n);
+    // The count is all the room there is.
+    EXPECT_EQ(count,
+              *MallocExtension::GetAllocatedSize(p) / sizeof(int32_t));
+    for (size_t i = 0; i < count; ++i) {
+      p[i] = i;
+    }
+    alloc.deallocate(p, count);
+  }
+}
+
+TEST(SizedAllocatorTest, Aligned) {
+  struct alignas(256) Aligned {
+    char c;
+  };
+  SizedAllocator<Aligned> alloc;
+  for (size_t n : {1, 3, 100}) {
+    auto [p, count] = alloc.allocate_at_least(n);
+    ASSERT_NE(p, nullptr);
+    EXPECT_GE(count, n);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(Aligned), 0);
+    alloc.deallocate(p, n);
+  }
+}
+
+TEST(SizedAllocatorTest, Containers) {
+  std::vector<int, SizedAllocator<int>> v;
+  for (int i = 0; i < 10000; ++i) {
+    v.push_back(i);
+  }
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_EQ(v[i], i);
+  }
+
+  std::basic_string<char, std::char_traits<char>, SizedAllocator<char>> s;
+  for (int i = 0; i < 10000; ++i) {
+    s.push_back('a' + i % 26);
+  }
+  EXPECT_EQ(s.size(), 10000);
+
+  // Node containers rebind the allocator.
+  std::map<int, int, std::less<int>, SizedAllocator<std::pair<const int, int>>>
+      m;
+  for (int i = 0; i < 100; ++i) {
+    m[i] = i;
+  }
+  EXPECT_EQ(m.size(), 100);
+  EXPECT_EQ(SizedAllocator<int>(), SizedAllocator<char>());
+}
+
+}  // namespace
+}  // namespace tcmalloc
@@ -0,0 +1,131 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how allocation throughput scales with the number of threads once
+// each thread's working set overflows its per-CPU cache, so that allocations
+// and frees go through the transfer cache, the central freelist and, for
+// large enough working sets, the page heap.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/parameter_accessors.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+struct LockContention {
+  int64_t acquisitions = 0;
+  absl::Duration wait;
+  absl::Duration hold;
+};
+
+LockContention PageHeapLockContention() {
+  LockContention totals;
+  MallocExtension::SnapshotCurrent(ProfileType::kLockContention)
+      .Iterate([&](const Profile::Sample& s) {
+        totals.acquisitions += s.count;
+        totals.wait += s.lock_wait_time;
+        totals.hold += s.lock_hold_time;
+      });
+  return totals;
+}
+
+// Samples pageheap_lock acquisitions for the lifetime of the object, when the
+// allocator supports it.
+class ScopedLockContentionSampling {
+ public:
+  ScopedLockContentionSampling() {
+    if (&TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval ==
+        nullptr) {
+      return;
+    }
+    previous_ = TCMalloc_Internal_GetPageHeapLockContentionSamplingInterval();
+    TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(kInterval);
+  }
+
+  ~ScopedLockContentionSampling() {
+    if (&TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval ==
+        nullptr) {
+      return;
+    }
+    TCMalloc_Internal_SetPageHeapLockContentionSamplingInterval(previous_);
+  }
+
+ private:
+  static constexpr int64_t kInterval = 16;
+
+  int64_t previous_ = 0;
+};
+
+// Each thread allocates a working set of range(1) bytes of objects of range(0)
+// bytes, and then frees it.  Working sets beyond the capacity of the per-CPU
+// caches make most operations take the slow paths.
+void BM_slow_path_scaling(benchmark::State& state) {
+  const size_t size = state.range(0);
+  std::vector<void*> allocs(state.range(1) / size);
+
+  ScopedLockContentionSampling sampling;
+  LockContention before;
+  if (state.thread_index() == 0) {
+    before = PageHeapLockContention();
+  }
+
+  for (auto s : state) {
+    for (void*& p : allocs) {
+      p = ::operator new(size);
+    }
+    for (void* p : allocs) {
+      ::operator delete(p, size);
+    }
+  }
+
+  const double ops = 2.0 * state.iterations() * allocs.size();
+  state.counters["ops_per_thread"] =
+      benchmark::Counter(ops, benchmark::Counter::kIsRate |
+                                  benchmark::Counter::kAvgThreads);
+  if (state.thread_index() == 0) {
+    // The contention profile is process-wide, so one thread reports it for
+    // all of them.
+    const LockContention after = PageHeapLockContention();
+    const double total_ops = ops * state.threads();
+    state.counters["pageheap_lock_acquisitions_per_op"] =
+        (after.acquisitions - before.acquisitions) / total_ops;
+    state.counters["pageheap_lock_wait_ns_per_op"] =
+        absl::ToDoubleNanoseconds(after.wait - before.wait) / total_ops;
+    state.counters["pageheap_lock_hold_ns_per_op"] =
+        absl::ToDoubleNanoseconds(after.hold - before.hold) / total_ops;
+  }
+}
+BENCHMARK(BM_slow_path_scaling)
+    ->ArgNames({"size", "working_set"})
+    // Fits in the per-CPU cache, as a baseline.
+    ->Args({64, 64 << 10})
+    // Overflows the per-CPU cache into the transfer cache and central
+    // freelist.
+    ->Args({64, 4 << 20})
+    ->Args({1024, 4 << 20})
+    // Few objects per span, so spans cycle through the page heap.
+    ->Args({32 << 10, 16 << 20})
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace tcmalloc
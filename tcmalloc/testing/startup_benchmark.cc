@@ -0,0 +1,70 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the startup latency and peak RSS of a process using TCMalloc, by
+// running this binary again with a filter matching no benchmarks.  Both
+// include the cost of loading the binary and the benchmark library, which
+// stays the same between TCMalloc changes.
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/logging.h"
+
+extern char** environ;
+
+namespace tcmalloc {
+namespace {
+
+static void BM_startup(benchmark::State& state) {
+  char exe[] = "/proc/self/exe";
+  char filter[] = "--benchmark_filter=^$";
+  char* const argv[] = {exe, filter, nullptr};
+
+  // Quiet the child's complaint that no benchmark matched.
+  posix_spawn_file_actions_t actions;
+  TC_CHECK_EQ(posix_spawn_file_actions_init(&actions), 0);
+  TC_CHECK_EQ(posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                               "/dev/null", O_WRONLY, 0),
+              0);
+  TC_CHECK_EQ(posix_spawn_file_actions_addopen(&actions, STDERR_FILENO,
+                                               "/dev/null", O_WRONLY, 0),
+              0);
+
+  int64_t max_rss_kib = 0;
+  for (auto s : state) {
+    pid_t pid;
+    TC_CHECK_EQ(posix_spawn(&pid, exe, &actions, nullptr, argv, environ), 0);
+    int status;
+    struct rusage usage;
+    TC_CHECK_EQ(wait4(pid, &status, 0, &usage), pid);
+    TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    max_rss_kib += usage.ru_maxrss;
+  }
+  posix_spawn_file_actions_destroy(&actions);
+
+  state.counters["max_rss_kib"] =
+      benchmark::Counter(max_rss_kib, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_startup)->UseRealTime();
+
+}  // namespace
+}  // namespace tcmalloc
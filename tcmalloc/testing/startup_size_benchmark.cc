@@ -0,0 +1,67 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Reports the memory TCMalloc uses at startup, as startup_size_test checks it,
+// for comparing configurations: startup_size_benchmark,
+// startup_size_benchmark_small_but_slow and
+// startup_size_benchmark_small_footprint differ only in the TCMalloc they link.
+// The time is that of allocating and freeing one object in each of a spread of
+// sizes, as a small process does early on.  The memory counters include the
+// benchmark library's allocations, which are the same in each configuration.
+
+#include <stddef.h>
+#include <sys/resource.h>
+
+#include <cstdint>
+#include <map>
+#include <new>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/malloc_extension.h"
+
+namespace tcmalloc {
+namespace {
+
+static void BM_startup_size(benchmark::State& state) {
+  for (auto s : state) {
+    for (size_t size = 8; size <= 64 << 10; size *= 2) {
+      void* ptr = ::operator new(size);
+      benchmark::DoNotOptimize(ptr);
+      ::operator delete(ptr, size);
+    }
+  }
+
+  const std::map<std::string, MallocExtension::Property> properties =
+      MallocExtension::GetProperties();
+  auto property = [&](const char* name) {
+    const auto it = properties.find(name);
+    TC_CHECK(it != properties.end(), "name=%s", name);
+    return static_cast<double>(it->second.value);
+  };
+  state.counters["metadata_bytes"] = property("tcmalloc.metadata_bytes");
+  state.counters["physical_bytes"] = property("generic.physical_memory_used");
+  state.counters["cpu_free_bytes"] = property("tcmalloc.cpu_free");
+  state.counters["transfer_cache_free_bytes"] =
+      property("tcmalloc.transfer_cache_free");
+
+  struct rusage usage;
+  TC_CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+  state.counters["max_rss_kib"] = static_cast<int64_t>(usage.ru_maxrss);
+}
+BENCHMARK(BM_startup_size);
+
+}  // namespace
+}  // namespace tcmalloc
@@ -14,15 +14,20 @@
 
 #include "tcmalloc/system-alloc.h"
 
+#include <linux/mempolicy.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include <limits>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
@@ -30,8 +35,10 @@
 #include "absl/strings/str_format.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/logging.h"
+#include "tcmalloc/internal/page_size.h"
 #include "tcmalloc/internal/proc_maps.h"
 #include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/parameters.h"
 
 #ifndef PR_SET_VMA
 #define PR_SET_VMA 0x53564d41
@@ -73,14 +80,24 @@ class MmapAlignedTest : public testing::TestWithParam<size_t> {
   void MmapAndCheck(size_t size, size_t alignment) {
     SCOPED_TRACE(absl::StrFormat("size = %u, alignment = %u", size, alignment));
 
-    for (MemoryTag tag :
-         {MemoryTag::kNormal, MemoryTag::kSampled, MemoryTag::kCold}) {
+    std::vector<MemoryTag> tags = {MemoryTag::kNormal, MemoryTag::kSampled,
+                                   MemoryTag::kCold};
+    for (size_t partition = 1; partition < kNumaPartitions; ++partition) {
+      tags.push_back(NumaNormalTag(partition));
+    }
+    if (kWarmTierPresent) {
+      tags.push_back(MemoryTag::kWarm);
+    }
+    for (MemoryTag tag : tags) {
       SCOPED_TRACE(static_cast<unsigned int>(tag));
 
       void* p = MmapAligned(size, alignment, tag);
       EXPECT_NE(p, nullptr);
       EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignment, 0);
-      EXPECT_EQ(IsNormalMemory(p), tag == MemoryTag::kNormal);
+      EXPECT_EQ(IsNormalMemory(p),
+                NumaPartitionFromTag(tag) < kNumaPartitions);
+      EXPECT_EQ(NumaPartitionFromPointer(p),
+                IsNormalMemory(p) ? NumaPartitionFromTag(tag) : 0);
       EXPECT_EQ(GetMemoryTag(p), tag);
       EXPECT_EQ(GetMemoryTag(static_cast<char*>(p) + size - 1), tag);
       if (PrSetVmaIsSupported()) {
@@ -123,6 +140,19 @@ TEST_F(MmapAlignedTest, LargeSizeSmallAlignment) {
   MmapAndCheck(uintptr_t{1} << kTagShift, kPageSize);
 }
 
+// Every byte of a mapping lies within the bounds, while they stay clear of
+// the low addresses no mapping of ours is placed at.
+TEST(MappedAddressBounds, CoversMappings) {
+  constexpr size_t kSize = kMinSystemAlloc;
+  void* p = MmapAligned(kSize, kPageSize, MemoryTag::kNormal);
+  ASSERT_NE(p, nullptr);
+  EXPECT_TRUE(MappedAddressBounds::MayContain(p));
+  EXPECT_TRUE(
+      MappedAddressBounds::MayContain(static_cast<char*>(p) + kSize - 1));
+  EXPECT_FALSE(MappedAddressBounds::MayContain(nullptr));
+  EXPECT_EQ(munmap(p, kSize), 0);
+}
+
 // Was SimpleRegion::Alloc invoked at least once?
 static bool simple_region_alloc_invoked = false;
 
@@ -198,6 +228,89 @@ TEST(Basic, RetryFailTest) {
   free(q);
 }
 
+TEST(Basic, CountsLazyReleases) {
+  const MadvisePreference previous = Parameters::madvise();
+  const size_t size = 4 * GetPageSize();
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(p, MAP_FAILED);
+
+  // Other threads may release memory concurrently, so we can only check that
+  // our release was counted.
+  memset(p, 1, size);
+  Parameters::set_madvise_free(MadvisePreference::kFreeOnly);
+  SystemReleaseBytes before = GetSystemReleaseBytes();
+  if (SystemRelease(p, size)) {
+    EXPECT_GE(GetSystemReleaseBytes().lazy, before.lazy + size);
+  }
+
+  memset(p, 1, size);
+  Parameters::set_madvise_free(MadvisePreference::kFreeAndDontNeed);
+  before = GetSystemReleaseBytes();
+  ASSERT_TRUE(SystemRelease(p, size));
+  EXPECT_GE(GetSystemReleaseBytes().eager, before.eager + size);
+
+  Parameters::set_madvise_free(previous);
+  munmap(p, size);
+}
+
+TEST(Basic, Populate) {
+  const size_t size = 16 * GetPageSize();
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(p, MAP_FAILED);
+
+  if (!SystemPopulate(p, size)) {
+    munmap(p, size);
+    GTEST_SKIP() << "MADV_POPULATE_WRITE unsupported";
+  }
+  std::vector<unsigned char> residency(16);
+  ASSERT_EQ(mincore(p, size, residency.data()), 0);
+  for (unsigned char resident : residency) {
+    EXPECT_TRUE(resident & 1);
+  }
+  // Populating leaves the (zero) contents alone.
+  for (size_t i = 0; i < size; i += GetPageSize()) {
+    EXPECT_EQ(static_cast<char*>(p)[i], 0);
+  }
+
+  munmap(p, size);
+}
+
+// Returns the NUMA memory policy of the range containing <addr>.
+int MemoryPolicy(void* addr) {
+  int mode = -1;
+  uint64_t nodemask = 0;
+  if (syscall(__NR_get_mempolicy, &mode, &nodemask, sizeof(nodemask) * 8,
+              addr, MPOL_F_ADDR) != 0) {
+    return -1;
+  }
+  return mode;
+}
+
+TEST(Basic, Interleave) {
+  const size_t size = 16 * GetPageSize();
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(p, MAP_FAILED);
+  memset(p, 1, size);
+
+  if (!SystemInterleave(p, size)) {
+    munmap(p, size);
+    GTEST_SKIP() << "NUMA interleaving unavailable";
+  }
+  EXPECT_EQ(MemoryPolicy(p), MPOL_INTERLEAVE);
+  // Moving the pages leaves their contents alone.
+  for (size_t i = 0; i < size; i += GetPageSize()) {
+    EXPECT_EQ(static_cast<char*>(p)[i], 1);
+  }
+
+  SystemUninterleave(p, size, MemoryTag::kCold);
+  EXPECT_EQ(MemoryPolicy(p), MPOL_DEFAULT);
+
+  munmap(p, size);
+}
+
 }  // namespace
 }  // namespace tcmalloc_internal
 }  // namespace tcmalloc
@@ -0,0 +1,135 @@
+// Copyright 2024 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Times every allocation and free, rather than reporting the mean, so that
+// the rare stalls behind pageheap_lock, cache resizing and releasing show up
+// in the p99.9 and maximum.  The allocator's background actions run, at a
+// shortened interval, alongside threads that churn through page heap
+// allocations.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/base/internal/cycleclock.h"
+#include "absl/random/random.h"
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/testing/latency_histogram.h"
+#include "tcmalloc/testing/testutil.h"
+
+namespace tcmalloc {
+namespace {
+
+// Runs ProcessBackgroundActions and `churn_threads` threads allocating and
+// freeing large objects for as long as it exists.
+class BackgroundActivity {
+ public:
+  explicit BackgroundActivity(int churn_threads)
+      : sleep_interval_(absl::Milliseconds(1)),
+        previous_enabled_(
+            MallocExtension::GetBackgroundProcessActionsEnabled()) {
+    if (MallocExtension::NeedsProcessBackgroundActions()) {
+      MallocExtension::SetBackgroundProcessActionsEnabled(true);
+      threads_.emplace_back(
+          [] { MallocExtension::ProcessBackgroundActions(); });
+    }
+    for (int i = 0; i < churn_threads; ++i) {
+      threads_.emplace_back([this] {
+        absl::BitGen rng;
+        while (!done_.load(std::memory_order_relaxed)) {
+          const size_t size = absl::Uniform<size_t>(rng, 256 << 10, 4 << 20);
+          void* ptr = ::operator new(size);
+          benchmark::DoNotOptimize(ptr);
+          ::operator delete(ptr, size);
+        }
+      });
+    }
+  }
+
+  ~BackgroundActivity() {
+    done_.store(true, std::memory_order_relaxed);
+    MallocExtension::SetBackgroundProcessActionsEnabled(false);
+    for (auto& t : threads_) {
+      t.join();
+    }
+    MallocExtension::SetBackgroundProcessActionsEnabled(previous_enabled_);
+  }
+
+ private:
+  ScopedBackgroundProcessSleepInterval sleep_interval_;
+  bool previous_enabled_;
+  std::atomic<bool> done_ = false;
+  std::vector<std::thread> threads_;
+};
+
+void ReportPercentiles(benchmark::State& state, const std::string& prefix,
+                       const LatencyHistogram& h) {
+  const double ns_per_cycle =
+      1e9 / absl::base_internal::CycleClock::Frequency();
+  state.counters[prefix + "_p50_ns"] = h.Percentile(0.5) * ns_per_cycle;
+  state.counters[prefix + "_p99_ns"] = h.Percentile(0.99) * ns_per_cycle;
+  state.counters[prefix + "_p999_ns"] = h.Percentile(0.999) * ns_per_cycle;
+  state.counters[prefix + "_max_ns"] = h.max() * ns_per_cycle;
+}
+
+// Replaces random objects of a live set of range(0) byte objects, timing each
+// free and allocation, while range(1) threads churn through the page heap.
+void BM_tail_latency(benchmark::State& state) {
+  const size_t size = state.range(0);
+  constexpr size_t kLive = 4096;
+  std::vector<void*> live(kLive);
+  for (void*& p : live) {
+    p = ::operator new(size);
+  }
+
+  LatencyHistogram alloc_latency, free_latency;
+  absl::BitGen rng;
+  {
+    BackgroundActivity background(state.range(1));
+    for (auto s : state) {
+      void*& p = live[absl::Uniform<size_t>(rng, 0, kLive)];
+
+      int64_t start = absl::base_internal::CycleClock::Now();
+      ::operator delete(p, size);
+      int64_t end = absl::base_internal::CycleClock::Now();
+      free_latency.Record(end - start);
+
+      start = end;
+      p = ::operator new(size);
+      end = absl::base_internal::CycleClock::Now();
+      alloc_latency.Record(end - start);
+      benchmark::DoNotOptimize(p);
+    }
+  }
+
+  for (void* p : live) {
+    ::operator delete(p, size);
+  }
+  ReportPercentiles(state, "alloc", alloc_latency);
+  ReportPercentiles(state, "free", free_latency);
+}
+BENCHMARK(BM_tail_latency)
+    ->ArgNames({"size", "churn_threads"})
+    ->ArgsProduct({{64, 4096, 64 << 10}, {0, 4}})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace tcmalloc
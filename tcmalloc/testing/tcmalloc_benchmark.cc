@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <malloc.h>
+#include <sys/mman.h>
 
 #include <atomic>
 #include <cstddef>
@@ -26,6 +27,7 @@
 #include <vector>
 
 #include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/random/random.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
@@ -39,6 +41,10 @@ extern "C" ABSL_ATTRIBUTE_WEAK void MallocExtension_Internal_GetStats(
     std::string* ret);
 extern "C" ABSL_ATTRIBUTE_WEAK int MallocExtension_Internal_GetStatsInPbtxt(
     char* buffer, int buffer_length);
+extern "C" ABSL_ATTRIBUTE_WEAK bool
+TCMalloc_Internal_GetFramePointerUnwinding();
+extern "C" ABSL_ATTRIBUTE_WEAK void TCMalloc_Internal_SetFramePointerUnwinding(
+    bool v);
 
 namespace tcmalloc {
 namespace {
@@ -53,6 +59,23 @@ static void BM_new_delete(benchmark::State& state) {
 }
 BENCHMARK(BM_new_delete)->Range(1, 1 << 20);
 
+static void BM_new_delete_batch(benchmark::State& state) {
+  // Unsized deletes look up each object's size class in the pagemap.  Freeing
+  // a batch of objects spread over many spans makes those lookups miss in
+  // cache, as they do for long-lived objects.
+  std::vector<void*> allocs(4 << 10);
+  const size_t size = state.range(0);
+  for (auto s : state) {
+    for (void*& p : allocs) {
+      p = ::operator new(size);
+    }
+    for (void* p : allocs) {
+      ::operator delete(p);
+    }
+  }
+}
+BENCHMARK(BM_new_delete_batch)->Arg(8)->Arg(256)->Arg(8192);
+
 template <int size>
 static void BM_new_delete_fixed(benchmark::State& state) {
   for (auto s : state) {
@@ -99,6 +122,39 @@ static void BM_nallocx_new_sized_delete(benchmark::State& state) {
 }
 BENCHMARK(BM_nallocx_new_sized_delete)->Range(1, 1 << 20);
 
+std::vector<size_t> RandomSizes(size_t n, size_t max_size) {
+  absl::BitGen rng;
+  std::vector<size_t> sizes(n);
+  for (size_t& size : sizes) {
+    size = absl::Uniform<size_t>(rng, 0, max_size);
+  }
+  return sizes;
+}
+
+static void BM_nallocx(benchmark::State& state) {
+  const std::vector<size_t> sizes = RandomSizes(state.range(0), 4096);
+  std::vector<size_t> rounded(sizes.size());
+
+  for (auto s : state) {
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      rounded[i] = nallocx(sizes[i], 0);
+    }
+    benchmark::DoNotOptimize(rounded.data());
+  }
+}
+BENCHMARK(BM_nallocx)->Range(16, 4096);
+
+static void BM_nallocx_batch(benchmark::State& state) {
+  const std::vector<size_t> sizes = RandomSizes(state.range(0), 4096);
+  std::vector<size_t> rounded(sizes.size());
+
+  for (auto s : state) {
+    tcmalloc_nallocx_batch(sizes.data(), rounded.data(), sizes.size());
+    benchmark::DoNotOptimize(rounded.data());
+  }
+}
+BENCHMARK(BM_nallocx_batch)->Range(16, 4096);
+
 static void BM_aligned_new(benchmark::State& state) {
   const int size = state.range(0);
   const int alignment = state.range(1);
@@ -108,7 +164,15 @@ static void BM_aligned_new(benchmark::State& state) {
     operator delete(ptr, size, static_cast<std::align_val_t>(alignment));
   }
 }
-BENCHMARK(BM_aligned_new)->RangePair(1, 1 << 20, 8, 64)->ArgPair(65, 64);
+BENCHMARK(BM_aligned_new)
+    ->RangePair(1, 1 << 20, 8, 64)
+    ->ArgPair(65, 64)
+    ->RangePair(1, 1 << 20, 4096, 4096)
+    ->ArgPair(4097, 4096)
+    // Alignments past a hugepage.
+    ->ArgPair(1 << 20, 4 << 20)
+    ->ArgPair(8 << 20, 64 << 20)
+    ->ArgPair(1 << 20, 1 << 30);
 
 static void BM_new_delete_slow_path(benchmark::State& state) {
   // The benchmark is intended to cover CpuCache overflow/underflow paths,
@@ -165,6 +229,9 @@ BENCHMARK(BM_malloc_pages)
     ->Arg(511)
     ->Arg(513)
     ->Arg(1023)
+    // Just past kMaxSize, and 1MiB, with 8KiB pages.
+    ->Arg(1 + 256 * 1024 / (8 * 1024))
+    ->Arg(1024 * 1024 / (8 * 1024))
     ->Arg(1 + 20 * 1024 * 1024 / (8 * 1024))
     ->Arg(256);
 
@@ -242,6 +309,43 @@ static void BM_random_new_delete(benchmark::State& state) {
 }
 BENCHMARK(BM_random_new_delete);
 
+// Asks for the ownership of pointers of ours, for range(0) == 0, or of a
+// mapping the kernel placed, as those of another allocator would be.
+static void BM_get_ownership(benchmark::State& state) {
+  constexpr size_t kPointers = 1024;
+  constexpr size_t kMapping = kPointers * 64;
+  const bool foreign = state.range(0) != 0;
+
+  void* mapping = nullptr;
+  std::vector<void*> ptrs(kPointers);
+  if (foreign) {
+    mapping = mmap(nullptr, kMapping, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      state.SkipWithError("mmap failed");
+      return;
+    }
+    for (size_t i = 0; i < kPointers; ++i) {
+      ptrs[i] = static_cast<char*>(mapping) + i * (kMapping / kPointers);
+    }
+  } else {
+    for (auto& ptr : ptrs) ptr = ::operator new(64);
+  }
+
+  size_t i = 0;
+  for (auto s : state) {
+    benchmark::DoNotOptimize(MallocExtension::GetOwnership(ptrs[i]));
+    i = (i + 1) % kPointers;
+  }
+
+  if (foreign) {
+    munmap(mapping, kMapping);
+  } else {
+    for (void* ptr : ptrs) ::operator delete(ptr);
+  }
+}
+BENCHMARK(BM_get_ownership)->ArgName("foreign")->Arg(0)->Arg(1);
+
 static void BM_get_stats(benchmark::State& state) {
   std::vector<std::unique_ptr<char[]>> allocations;
   const int num_allocations = state.range(0);
@@ -264,6 +368,28 @@ static void BM_get_stats(benchmark::State& state) {
 }
 BENCHMARK(BM_get_stats)->Range(1, 1 << 20);
 
+static void BM_release_all_cached_memory(benchmark::State& state) {
+  const int num_allocations = state.range(0);
+  std::vector<void*> allocations(num_allocations);
+  absl::BitGen rand;
+
+  for (auto s : state) {
+    // Fill the caches, from small objects to a few pages, to be drained.
+    state.PauseTiming();
+    for (void*& ptr : allocations) {
+      ptr = ::operator new(absl::Uniform<size_t>(rand, 1, 64 << 10));
+    }
+    for (void* ptr : allocations) {
+      ::operator delete(ptr);
+    }
+    state.ResumeTiming();
+
+    const size_t released = MallocExtension::ReleaseAllCachedMemory();
+    benchmark::DoNotOptimize(released);
+  }
+}
+BENCHMARK(BM_release_all_cached_memory)->Range(1, 1 << 16);
+
 static void BM_get_stats_internal(benchmark::State& state) {
   if (&MallocExtension_Internal_GetStats == nullptr) {
     // Sanitizer builds don't provide this function.
@@ -499,5 +625,47 @@ static void BM_get_heap_profile_while_allocating(benchmark::State& state) {
 }
 BENCHMARK(BM_get_heap_profile_while_allocating)->Range(1, 1 << 18);
 
+// Allocates and frees at the bottom of `depth` frames, so that taking the
+// stack trace of the allocation walks them.
+ABSL_ATTRIBUTE_NOINLINE void NewDeleteAtDepth(int depth) {
+  if (depth > 0) {
+    NewDeleteAtDepth(depth - 1);
+  } else {
+    void* ptr = ::operator new(64);
+    benchmark::DoNotOptimize(ptr);
+    ::operator delete(ptr, 64);
+  }
+  benchmark::DoNotOptimize(depth);
+  ABSL_BLOCK_TAIL_CALL_OPTIMIZATION();
+}
+
+// Measures the cost of sampled allocations, which is dominated by taking
+// their stack trace, with absl::GetStackTrace (state.range(0) == 0) or by
+// walking frame pointers, state.range(1) frames deep.
+static void BM_sampled_new_delete(benchmark::State& state) {
+  if (&TCMalloc_Internal_SetFramePointerUnwinding == nullptr) {
+    state.SkipWithError("Not linked against TCMalloc.");
+    return;
+  }
+  const bool previous_unwinding = TCMalloc_Internal_GetFramePointerUnwinding();
+  const int64_t previous_rate = MallocExtension::GetProfileSamplingRate();
+  const int64_t previous_guarded_rate =
+      MallocExtension::GetGuardedSamplingRate();
+  TCMalloc_Internal_SetFramePointerUnwinding(state.range(0) != 0);
+  // Sample every allocation, without guarding any of them.
+  MallocExtension::SetGuardedSamplingRate(-1);
+  MallocExtension::SetProfileSamplingRate(1);
+
+  const int depth = state.range(1);
+  for (auto s : state) {
+    NewDeleteAtDepth(depth);
+  }
+
+  MallocExtension::SetProfileSamplingRate(previous_rate);
+  MallocExtension::SetGuardedSamplingRate(previous_guarded_rate);
+  TCMalloc_Internal_SetFramePointerUnwinding(previous_unwinding);
+}
+BENCHMARK(BM_sampled_new_delete)->ArgsProduct({{0, 1}, {4, 32}});
+
 }  // namespace
 }  // namespace tcmalloc
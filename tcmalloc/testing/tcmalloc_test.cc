@@ -489,6 +489,32 @@ TEST(TCMallocTest, ReleaseMemoryToSystem) {
 
 TEST(TCMallocTest, MallocTrim) { malloc_trim(0); }
 
+TEST(TCMallocTest, CachedStatsTotals) {
+  const int64_t previous = TCMalloc_Internal_GetCachedStatsMaxAgeMs();
+  auto allocated = []() {
+    return *MallocExtension::GetNumericProperty(
+        "generic.current_allocated_bytes");
+  };
+
+  // Let any totals cached before go stale, so that they are refreshed.
+  TCMalloc_Internal_SetCachedStatsMaxAgeMs(1);
+  absl::SleepFor(absl::Milliseconds(10));
+  const size_t before = allocated();
+
+  // With a long maximum age, those totals are reused.
+  TCMalloc_Internal_SetCachedStatsMaxAgeMs(3600 * 1000);
+  constexpr size_t kSize = 64 << 20;
+  void* ptr = ::operator new(kSize);
+  EXPECT_EQ(allocated(), before);
+
+  // Without one, the stats are extracted afresh.
+  TCMalloc_Internal_SetCachedStatsMaxAgeMs(0);
+  EXPECT_GE(allocated(), before + kSize);
+
+  ::operator delete(ptr);
+  TCMalloc_Internal_SetCachedStatsMaxAgeMs(previous);
+}
+
 TEST(TCMallocTest, NothrowSizedDelete) {
   struct Foo {
     double a;
@@ -555,6 +581,58 @@ TEST(TCMallocTest, MallocAlignment) {
   }
 }
 
+// calloc and tcmalloc_zeroed_operator_new skip clearing memory fresh from the
+// OS.  Make sure reused memory is still cleared.
+TEST(TCMallocTest, ZeroedReuse) {
+  constexpr size_t kSizes[] = {1 << 10, 300 << 10, 2 << 20, 9 << 20, 64 << 20};
+  for (size_t size : kSizes) {
+    SCOPED_TRACE(size);
+    for (int i = 0; i < 3; ++i) {
+      void* calloced = calloc(size, 1);
+      ASSERT_NE(calloced, nullptr);
+      void* zeroed = tcmalloc_zeroed_operator_new(size);
+      void* zeroed_nothrow = tcmalloc_zeroed_operator_new_nothrow(size);
+      ASSERT_NE(zeroed_nothrow, nullptr);
+      for (void* p : {calloced, zeroed, zeroed_nothrow}) {
+        const char* c = static_cast<const char*>(p);
+        for (size_t j = 0; j < size; j += 4096) {
+          ASSERT_EQ(c[j], 0) << j;
+        }
+        ASSERT_EQ(c[size - 1], 0);
+        // Dirty the memory so that any reuse by the next iteration would be
+        // noticed.
+        memset(p, 0xaa, size);
+      }
+      free(calloced);
+      ::operator delete(zeroed, size);
+      ::operator delete(zeroed_nothrow, size);
+    }
+  }
+}
+
+// Memory from tcmalloc_interleaved_operator_new behaves like any other, also
+// once it is freed and reused.
+TEST(TCMallocTest, InterleavedNew) {
+  constexpr size_t kSizes[] = {1 << 10, 300 << 10, 2 << 20, 9 << 20};
+  for (size_t size : kSizes) {
+    SCOPED_TRACE(size);
+    for (int i = 0; i < 3; ++i) {
+      void* interleaved = tcmalloc_interleaved_operator_new(size);
+      void* interleaved_nothrow =
+          tcmalloc_interleaved_operator_new_nothrow(size);
+      ASSERT_NE(interleaved_nothrow, nullptr);
+      void* normal = ::operator new(size);
+      for (void* p : {interleaved, interleaved_nothrow, normal}) {
+        memset(p, 0xaa, size);
+        EXPECT_EQ(static_cast<unsigned char*>(p)[size - 1], 0xaa);
+      }
+      ::operator delete(interleaved, size);
+      ::operator delete(interleaved_nothrow, size);
+      ::operator delete(normal);
+    }
+  }
+}
+
 TEST(TCMallocTest, CallocAlignment) {
   static constexpr int kNum = 100;
 
@@ -820,6 +898,27 @@ TEST(TCMallocTest, nallocx_alignment) {
   }
 }
 
+TEST(TCMallocTest, NallocxBatch) {
+  std::vector<size_t> sizes;
+  for (size_t size = 0; size <= 300000; size += 13) {
+    sizes.push_back(size);
+  }
+  for (size_t size : {size_t{1} << 20, (size_t{1} << 20) + 1,
+                      std::numeric_limits<size_t>::max() / 2}) {
+    sizes.push_back(size);
+  }
+
+  std::vector<size_t> rounded(sizes.size());
+  tcmalloc_nallocx_batch(sizes.data(), rounded.data(), sizes.size());
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    EXPECT_EQ(rounded[i], nallocx(sizes[i], 0)) << sizes[i];
+  }
+
+  // In place.
+  tcmalloc_nallocx_batch(sizes.data(), sizes.data(), sizes.size());
+  EXPECT_EQ(sizes, rounded);
+}
+
 TEST(TCMallocTest, sdallocx) {
   for (size_t size = 0; size <= 4096; size += 7) {
     void* ptr = malloc(size);
@@ -829,6 +928,133 @@ TEST(TCMallocTest, sdallocx) {
   }
 }
 
+void CheckAllocBatch() {
+  constexpr size_t kBatch = 300;
+  std::vector<void*> batch(kBatch);
+  for (size_t size : {0, 1, 8, 17, 64, 1000, 4096, 100000, 1 << 20}) {
+    for (size_t n : {1, 2, 31, 32, 64, 100, 300}) {
+      ASSERT_EQ(tcmalloc_alloc_batch(size, batch.data(), n), n) << size;
+      absl::flat_hash_set<void*> seen;
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_NE(batch[i], nullptr);
+        EXPECT_TRUE(seen.insert(batch[i]).second) << batch[i];
+        EXPECT_GE(MallocExtension::GetAllocatedSize(batch[i]), size);
+        memset(batch[i], 0xa5, size);
+      }
+      tcmalloc_free_batch(batch.data(), n, size);
+    }
+  }
+}
+
+TEST(TCMallocTest, AllocBatch) { CheckAllocBatch(); }
+
+TEST(TCMallocTest, AllocBatchSampled) {
+  ScopedAlwaysSample always_sample;
+  CheckAllocBatch();
+}
+
+TEST(TCMallocTest, FreeBatchMixed) {
+  constexpr size_t kSize = 48;
+  std::vector<void*> batch;
+  for (int i = 0; i < 200; ++i) {
+    batch.push_back(i % 10 == 0 ? nullptr : malloc(kSize));
+  }
+  tcmalloc_free_batch(batch.data(), batch.size(), kSize);
+}
+
+TEST(TCMallocTest, FreeBatchPages) {
+  constexpr size_t kSize = 1 << 20;
+  std::vector<void*> batch;
+  for (int i = 0; i < 20; ++i) {
+    batch.push_back(i % 5 == 0 ? nullptr : malloc(kSize));
+  }
+  // Sizes above kMaxSize are page allocations, which are freed one by one.
+  tcmalloc_free_batch(batch.data(), batch.size(), kSize);
+}
+
+TEST(TCMallocTest, FreeUnsizedBatch) {
+  std::vector<void*> batch;
+  for (size_t size : {0, 1, 8, 17, 64, 1000, 4096, 100000, 1 << 20}) {
+    for (int i = 0; i < 50; ++i) {
+      void* ptr = malloc(size);
+      memset(ptr, 0xa5, size);
+      batch.push_back(ptr);
+    }
+    batch.push_back(nullptr);
+  }
+  // Interleave the sizes, so that batches of one size class are not already
+  // contiguous.
+  absl::BitGen rng;
+  std::shuffle(batch.begin(), batch.end(), rng);
+  tcmalloc_free_unsized_batch(batch.data(), batch.size());
+}
+
+TEST(TCMallocTest, FreeUnsizedBatchSampled) {
+  ScopedAlwaysSample always_sample;
+  std::vector<void*> batch;
+  for (int i = 0; i < 300; ++i) {
+    batch.push_back(malloc(16 + i % 7 * 100));
+  }
+  tcmalloc_free_unsized_batch(batch.data(), batch.size());
+}
+
+// Grows an object a byte at a time, then shrinks it back, checking that its
+// contents survive and that its size is always a valid hint.
+void CheckReallocSized(size_t max_size, bool sampled) {
+  size_t size = 1;
+  char* p = static_cast<char*>(malloc(size));
+  p[0] = 0;
+  while (size < max_size) {
+    const size_t new_size = std::min(max_size, size + 1 + size / 16);
+    ASSERT_EQ(MallocExtension::GetAllocatedSize(p, size),
+              MallocExtension::GetAllocatedSize(p));
+    const size_t capacity = *MallocExtension::GetAllocatedSize(p);
+    void* old = p;
+    benchmark::DoNotOptimize(old);
+    p = static_cast<char*>(tcmalloc_realloc_sized(p, size, new_size));
+    ASSERT_NE(p, nullptr);
+    if (!sampled && new_size <= tcmalloc_internal::kMaxSize &&
+        nallocx(new_size, 0) == capacity) {
+      // Within the size class, the object stays put.
+      EXPECT_EQ(p, old) << size << " -> " << new_size;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      ASSERT_EQ(p[i], static_cast<char>(i)) << i;
+    }
+    for (size_t i = size; i < new_size; ++i) {
+      p[i] = static_cast<char>(i);
+    }
+    size = new_size;
+  }
+  while (size > 1) {
+    const size_t new_size = size - 1 - size / 8;
+    p = static_cast<char*>(tcmalloc_realloc_sized(p, size, new_size));
+    ASSERT_NE(p, nullptr);
+    ASSERT_EQ(MallocExtension::GetAllocatedSize(p, new_size),
+              MallocExtension::GetAllocatedSize(p));
+    for (size_t i = 0; i < new_size; ++i) {
+      ASSERT_EQ(p[i], static_cast<char>(i)) << i;
+    }
+    size = new_size;
+  }
+  EXPECT_EQ(tcmalloc_realloc_sized(p, size, 0), nullptr);
+}
+
+TEST(TCMallocTest, ReallocSized) {
+  ScopedNeverSample never_sample;
+  CheckReallocSized(1 << 20, /*sampled=*/false);
+
+  void* p = tcmalloc_realloc_sized(nullptr, 0, 100);
+  ASSERT_NE(p, nullptr);
+  EXPECT_GE(MallocExtension::GetAllocatedSize(p, 100), 100);
+  sdallocx(p, 100, 0);
+}
+
+TEST(TCMallocTest, ReallocSizedSampled) {
+  ScopedAlwaysSample always_sample;
+  CheckReallocSized(100000, /*sampled=*/true);
+}
+
 TEST(TCMallocTest, free_sized) {
   for (size_t size = 0; size <= 4096; size += 7) {
     void* ptr = malloc(size);
@@ -1595,6 +1821,53 @@ TEST(HotColdTest, SampleHasRuntimeHint) {
                      }));
 }
 
+TEST(HotColdTest, ScopedAllocationPolicy) {
+  const bool expectColdTags = tcmalloc_internal::ColdFeatureActive();
+  if (!expectColdTags) {
+    GTEST_SKIP() << "Cold allocations not enabled";
+  }
+
+  constexpr size_t kSmall = 128 << 10;
+  constexpr size_t kLarge = 1 << 20;
+
+  absl::BitGen rng;
+  std::vector<void*> ptrs;
+  {
+    MallocExtension::ScopedAllocationPolicy cold({.access = hot_cold_t{0}});
+    for (int i = 0; i < 100; i++) {
+      const size_t size = absl::LogUniform<size_t>(rng, kSmall, kLarge);
+      void* ptr = ::operator new(size);
+      EXPECT_FALSE(IsNormalMemory(ptr)) << size;
+      ptrs.push_back(ptr);
+
+      void* m = malloc(size);
+      EXPECT_FALSE(IsNormalMemory(m)) << size;
+      ptrs.push_back(m);
+    }
+
+    {
+      // Nested scopes override, and then restore, the enclosing policy.
+      MallocExtension::ScopedAllocationPolicy hot(
+          {.access = hot_cold_t{255}});
+      void* ptr = ::operator new(kSmall);
+      EXPECT_NE(GetMemoryTag(ptr), MemoryTag::kCold);
+      ptrs.push_back(ptr);
+    }
+
+    void* ptr = ::operator new(kSmall);
+    EXPECT_FALSE(IsNormalMemory(ptr));
+    ptrs.push_back(ptr);
+  }
+
+  void* ptr = ::operator new(kSmall);
+  EXPECT_NE(GetMemoryTag(ptr), MemoryTag::kCold);
+  ptrs.push_back(ptr);
+
+  for (void* p : ptrs) {
+    free(p);
+  }
+}
+
 // Test that when we use size-returning new, we can pass any of the sizes
 // between the requested size and the allocated size to sized-delete.
 // We follow
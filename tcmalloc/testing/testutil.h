@@ -240,7 +240,7 @@ class ScopedFakeCpuId {
     tcmalloc_internal::subtle::percpu::__rseq_abi.cpu_id = cpu_id;
 
     if (tcmalloc_internal::subtle::percpu::UsingRseqVirtualCpus()) {
-      tcmalloc_internal::subtle::percpu::__rseq_abi.vcpu_id = cpu_id;
+      tcmalloc_internal::subtle::percpu::__rseq_abi.mm_cid = cpu_id;
     }
 #endif
   }
@@ -253,7 +253,7 @@ class ScopedFakeCpuId {
         tcmalloc_internal::subtle::percpu::kCpuIdUninitialized;
 
     if (tcmalloc_internal::subtle::percpu::UsingRseqVirtualCpus()) {
-      tcmalloc_internal::subtle::percpu::__rseq_abi.vcpu_id =
+      tcmalloc_internal::subtle::percpu::__rseq_abi.mm_cid =
           tcmalloc_internal::subtle::percpu::kCpuIdUninitialized;
     }
 #endif
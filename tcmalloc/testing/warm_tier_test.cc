@@ -0,0 +1,84 @@
+// Copyright 2025 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stddef.h>
+
+#include <new>
+
+#include "gtest/gtest.h"
+#include "tcmalloc/common.h"
+#include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/new_extension.h"
+#include "tcmalloc/parameters.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/system-alloc.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// The warm tier is enabled, and bound to node 0, by this test's environment.
+TEST(WarmTier, PageLevelAllocations) {
+  // Make sure TCMalloc is initialized.
+  ::operator delete(::operator new(1));
+  if (!tc_globals.page_allocator().has_warm_tier()) {
+    GTEST_SKIP() << "No warm tier";
+  }
+  EXPECT_EQ(WarmTierNumaNode(), 0);
+
+  constexpr size_t kSmall = 1024;
+  constexpr size_t kLarge = 1 << 20;
+  constexpr hot_cold_t kWarm{100};
+  constexpr hot_cold_t kHot{200};
+
+  // No hint is warm by default.
+  void* ptr = ::operator new(kLarge, kWarm);
+  EXPECT_TRUE(IsNormalMemory(ptr)) << ptr;
+  ::operator delete(ptr, kLarge);
+
+  Parameters::set_max_warm_access_hint(hot_cold_t{127});
+
+  ptr = ::operator new(kLarge, kWarm);
+  EXPECT_EQ(GetMemoryTag(ptr), MemoryTag::kWarm) << ptr;
+  ::operator delete(ptr, kLarge);
+
+  ptr = ::operator new(kLarge, std::nothrow, kWarm);
+  EXPECT_EQ(GetMemoryTag(ptr), MemoryTag::kWarm) << ptr;
+  ::operator delete(ptr);
+
+  sized_ptr_t res =
+      tcmalloc_size_returning_operator_new_hot_cold(kLarge, kWarm);
+  EXPECT_EQ(GetMemoryTag(res.p), MemoryTag::kWarm) << res.p;
+  EXPECT_GE(res.n, kLarge);
+  ::operator delete(res.p, res.n);
+
+  // Objects in size classes stay in normal memory.
+  ptr = ::operator new(kSmall, kWarm);
+  EXPECT_TRUE(IsNormalMemory(ptr)) << ptr;
+  ::operator delete(ptr, kSmall);
+
+  ptr = ::operator new(kLarge, kHot);
+  EXPECT_TRUE(IsNormalMemory(ptr)) << ptr;
+  ::operator delete(ptr, kLarge);
+
+  ptr = ::operator new(kLarge);
+  EXPECT_TRUE(IsNormalMemory(ptr)) << ptr;
+  ::operator delete(ptr);
+
+  Parameters::set_max_warm_access_hint(kDefaultMaxWarmAccessHint);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -39,6 +39,8 @@ int64_t ThreadCache::unclaimed_cache_space_ = kDefaultOverallThreadCacheSize;
 ThreadCache* ThreadCache::thread_heaps_ = nullptr;
 int ThreadCache::thread_heap_count_ = 0;
 ThreadCache* ThreadCache::next_memory_steal_ = nullptr;
+uint64_t ThreadCache::idle_reclaims_ = 0;
+uint64_t ThreadCache::idle_flushes_ = 0;
 ABSL_CONST_INIT thread_local ThreadCache* ThreadCache::thread_local_data_
     ABSL_ATTRIBUTE_INITIAL_EXEC = nullptr;
 ABSL_CONST_INIT bool ThreadCache::tsd_inited_ = false;
@@ -48,21 +50,17 @@ ThreadCache::ThreadCache(pthread_t tid) {
   size_ = 0;
 
   max_size_ = 0;
-  IncreaseCacheLimitLocked();
-  if (max_size_ == 0) {
-    // There isn't enough memory to go around.  Just give the minimum to
-    // this thread.
-    max_size_ = kMinThreadCacheSize;
-
-    // Take unclaimed_cache_space_ negative.
-    unclaimed_cache_space_ -= kMinThreadCacheSize;
-    TC_ASSERT_LT(unclaimed_cache_space_, 0);
-  }
+  ClaimCacheLimitLocked();
 
   next_ = nullptr;
   prev_ = nullptr;
   tid_ = tid;
   in_setspecific_ = false;
+  misses_.store(0, std::memory_order_relaxed);
+  resize_misses_ = 0;
+  idle_intervals_ = 0;
+  flush_misses_ = 0;
+  flush_idle_intervals_ = 0;
   for (size_t size_class = 0; size_class < kNumClasses; ++size_class) {
     list_[size_class].Init();
   }
@@ -86,6 +84,10 @@ void ThreadCache::Cleanup() {
 void* ThreadCache::FetchFromTransferCache(size_t size_class, size_t byte_size) {
   FreeList* list = &list_[size_class];
   TC_ASSERT(list->empty());
+  RecordMiss();
+  if (ABSL_PREDICT_FALSE(max_size_ == 0)) {
+    ReturnReclaimedObjects();
+  }
   const int batch_size = tc_globals.sizemap().num_objects_to_move(size_class);
 
   const int num_to_move = std::min<int>(list->max_length(), batch_size);
@@ -121,6 +123,7 @@ void* ThreadCache::FetchFromTransferCache(size_t size_class, size_t byte_size) {
 }
 
 void ThreadCache::ListTooLong(FreeList* list, size_t size_class) {
+  RecordMiss();
   const int batch_size = tc_globals.sizemap().num_objects_to_move(size_class);
   ReleaseToTransferCache(list, size_class, batch_size);
 
@@ -207,6 +210,10 @@ void ThreadCache::Scavenge() {
 }
 
 void ThreadCache::DeallocateSlow(void* ptr, FreeList* list, size_t size_class) {
+  if (ABSL_PREDICT_FALSE(max_size_ == 0)) {
+    ReturnReclaimedObjects();
+    return;
+  }
   if (ABSL_PREDICT_FALSE(list->length() > list->max_length())) {
     ListTooLong(list, size_class);
   }
@@ -215,6 +222,34 @@ void ThreadCache::DeallocateSlow(void* ptr, FreeList* list, size_t size_class) {
   }
 }
 
+void ThreadCache::ReturnReclaimedObjects() {
+  // ResizeCaches() or FlushIdleCaches() found this cache idle and took its
+  // limit.  Return everything, and start over as a new cache would.
+  Cleanup();
+  for (size_t cl = 0; cl < kNumClasses; ++cl) {
+    list_[cl].Init();
+  }
+  PageHeapSpinLockHolder l;
+  // ResizeCaches() may have handed us some limit again meanwhile.
+  if (max_size_ == 0) {
+    ClaimCacheLimitLocked();
+  }
+}
+
+void ThreadCache::ClaimCacheLimitLocked() {
+  TC_ASSERT_EQ(max_size_, 0);
+  IncreaseCacheLimitLocked();
+  if (max_size_ == 0) {
+    // There isn't enough memory to go around.  Just give the minimum to
+    // this thread.
+    max_size_ = kMinThreadCacheSize;
+
+    // Take unclaimed_cache_space_ negative.
+    unclaimed_cache_space_ -= kMinThreadCacheSize;
+    TC_ASSERT_LT(unclaimed_cache_space_, 0);
+  }
+}
+
 void ThreadCache::IncreaseCacheLimit() {
   PageHeapSpinLockHolder l;
   IncreaseCacheLimitLocked();
@@ -249,6 +284,74 @@ void ThreadCache::IncreaseCacheLimitLocked() {
   }
 }
 
+void ThreadCache::ResizeCaches() {
+  PageHeapSpinLockHolder l;
+  // The caches that missed the most since the last call, most first.
+  ThreadCache* busiest[kNumCachesToGrow] = {};
+  uint64_t busiest_misses[kNumCachesToGrow] = {};
+  for (ThreadCache* h = thread_heaps_; h != nullptr; h = h->next_) {
+    const uint64_t misses = h->misses_.load(std::memory_order_relaxed);
+    const uint64_t interval_misses = misses - h->resize_misses_;
+    h->resize_misses_ = misses;
+
+    if (interval_misses == 0) {
+      // Taking the whole limit makes the owner's next free take the slow
+      // path, where it returns its objects.
+      if (++h->idle_intervals_ >= kIdleResizeIntervals && h->max_size_ != 0) {
+        unclaimed_cache_space_ += h->max_size_;
+        h->max_size_ = 0;
+        ++idle_reclaims_;
+      }
+      continue;
+    }
+    h->idle_intervals_ = 0;
+
+    if (h->max_size_ + kStealAmount > kMaxThreadCacheSize) continue;
+    for (int i = 0; i < kNumCachesToGrow; ++i) {
+      if (busiest[i] == nullptr || interval_misses > busiest_misses[i]) {
+        std::copy_backward(busiest + i, busiest + kNumCachesToGrow - 1,
+                           busiest + kNumCachesToGrow);
+        std::copy_backward(busiest_misses + i,
+                           busiest_misses + kNumCachesToGrow - 1,
+                           busiest_misses + kNumCachesToGrow);
+        busiest[i] = h;
+        busiest_misses[i] = interval_misses;
+        break;
+      }
+    }
+  }
+
+  for (ThreadCache* h : busiest) {
+    if (h == nullptr ||
+        unclaimed_cache_space_ < static_cast<int64_t>(kStealAmount)) {
+      break;
+    }
+    unclaimed_cache_space_ -= kStealAmount;
+    h->max_size_ += kStealAmount;
+  }
+}
+
+void ThreadCache::FlushIdleCaches(int64_t idle_intervals) {
+  PageHeapSpinLockHolder l;
+  for (ThreadCache* h = thread_heaps_; h != nullptr; h = h->next_) {
+    const uint64_t misses = h->misses_.load(std::memory_order_relaxed);
+    if (misses != h->flush_misses_) {
+      h->flush_misses_ = misses;
+      h->flush_idle_intervals_ = 0;
+      continue;
+    }
+    if (++h->flush_idle_intervals_ < idle_intervals || h->max_size_ == 0) {
+      continue;
+    }
+    // Taking the whole limit makes the owner's next free or miss take the
+    // slow path, where it returns its objects.
+    unclaimed_cache_space_ += h->max_size_;
+    h->max_size_ = 0;
+    h->flush_idle_intervals_ = 0;
+    ++idle_flushes_;
+  }
+}
+
 void ThreadCache::InitTSD() {
   TC_ASSERT(!tsd_inited_);
   pthread_key_create(&heap_key_, DestroyThreadCache);
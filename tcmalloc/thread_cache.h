@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
+
 #include "absl/base/attributes.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
@@ -71,6 +73,44 @@ class ThreadCache {
     return overall_thread_cache_size_;
   }
 
+  // The number of consecutive ResizeCaches() calls without a miss after which
+  // a thread's cache counts as idle.
+  static constexpr int kIdleResizeIntervals = 6;
+  // The number of threads whose limit ResizeCaches() grows per call.
+  static constexpr int kNumCachesToGrow = 4;
+
+  // Moves cache capacity from idle threads to busy ones, as
+  // CpuCache::ResizeSizeClasses does between size classes.  Threads that have
+  // not missed in kIdleResizeIntervals calls give up their whole limit, and
+  // the threads that missed the most since the last call grow their limit by
+  // kStealAmount out of the unclaimed space.
+  //
+  // An idle thread returns its objects to the transfer cache the next time it
+  // frees, and starts over with a new cache's limit.  Until then they stay
+  // cached, as this never touches another thread's free lists.
+  static void ResizeCaches() ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns the number of times ResizeCaches() has reclaimed an idle cache.
+  static uint64_t idle_reclaims() ABSL_SHARED_LOCKS_REQUIRED(pageheap_lock) {
+    return idle_reclaims_;
+  }
+
+  // Flushes the caches of threads that have not gone to the transfer cache in
+  // idle_intervals calls, so that threads parked in a pool don't have to call
+  // MallocExtension::MarkThreadIdle().  Called by the background thread once
+  // per iteration.
+  //
+  // As with ResizeCaches(), only the owner touches its free lists: this takes
+  // the cache's limit, and the owner returns all of its objects the next time
+  // it frees or misses, before carrying on with a new cache's limit.
+  static void FlushIdleCaches(int64_t idle_intervals)
+      ABSL_LOCKS_EXCLUDED(pageheap_lock);
+
+  // Returns the number of idle caches FlushIdleCaches() has flushed.
+  static uint64_t idle_flushes() ABSL_SHARED_LOCKS_REQUIRED(pageheap_lock) {
+    return idle_flushes_;
+  }
+
  private:
   // We inherit rather than include the list as a data structure to reduce
   // compiler padding.  Without inheritance, the compiler pads the list
@@ -143,9 +183,23 @@ class ThreadCache {
   // Same as above but called with pageheap_lock held.
   void IncreaseCacheLimitLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
 
+  // Sets max_size_, which must be 0, to what a new cache starts with.
+  void ClaimCacheLimitLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
+
   void Scavenge();
   static ThreadCache* CreateCacheIfNecessary();
 
+  // Returns the objects of a cache whose limit was taken by ResizeCaches() or
+  // FlushIdleCaches(), and claims a new cache's limit.
+  void ReturnReclaimedObjects();
+
+  // Counts a trip to the transfer cache, for ResizeCaches() and
+  // FlushIdleCaches().
+  void RecordMiss() {
+    misses_.store(misses_.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
   // If TLS is available, we also store a copy of the per-thread object
   // in a __thread variable since __thread variables are faster to read
   // than pthread_getspecific().  We still need pthread_setspecific()
@@ -190,6 +244,11 @@ class ThreadCache {
   // across all ThreadCaches.
   static int64_t unclaimed_cache_space_ ABSL_GUARDED_BY(pageheap_lock);
 
+  // The number of idle caches ResizeCaches() has reclaimed.
+  static uint64_t idle_reclaims_ ABSL_GUARDED_BY(pageheap_lock);
+  // The number of idle caches FlushIdleCaches() has flushed.
+  static uint64_t idle_flushes_ ABSL_GUARDED_BY(pageheap_lock);
+
   // This class is laid out with the most frequently used fields
   // first so that hot elements are placed on the same cache line.
 
@@ -201,6 +260,16 @@ class ThreadCache {
   pthread_t tid_;
   bool in_setspecific_;
 
+  // Misses so far.  Only the owning thread writes it.
+  std::atomic<uint64_t> misses_;
+  // misses_ as of the last ResizeCaches(), and the number of calls since it
+  // last changed.
+  uint64_t resize_misses_ ABSL_GUARDED_BY(pageheap_lock);
+  int idle_intervals_ ABSL_GUARDED_BY(pageheap_lock);
+  // The same, as of the last FlushIdleCaches().
+  uint64_t flush_misses_ ABSL_GUARDED_BY(pageheap_lock);
+  int64_t flush_idle_intervals_ ABSL_GUARDED_BY(pageheap_lock);
+
   // Allocate a new heap.
   static ThreadCache* NewHeap(pthread_t tid)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock);
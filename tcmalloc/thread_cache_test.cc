@@ -22,15 +22,18 @@
 #include <limits>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "gtest/gtest.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/memory_stats.h"
 #include "tcmalloc/internal/parameter_accessors.h"
 #include "tcmalloc/malloc_extension.h"
+#include "tcmalloc/thread_cache.h"
 
 namespace tcmalloc {
 namespace {
@@ -132,5 +135,89 @@ TEST_F(ThreadCacheTest, NoLeakOnThreadDestruction) {
       << "Before: " << start_size << " After: " << end_size;
 }
 
+size_t ThreadCacheBytes() {
+  return *MallocExtension::GetNumericProperty(
+      "tcmalloc.current_total_thread_cache_bytes");
+}
+
+TEST_F(ThreadCacheTest, ResizeCachesReclaimsIdleThreads) {
+  ASSERT_FALSE(MallocExtension::PerCpuCachesActive());
+  using tcmalloc_internal::ThreadCache;
+
+  absl::Notification filled, wake, reclaimed;
+  std::thread idle([&]() {
+    // Grow the cache's free lists, so that it holds objects when done.
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 100; ++i) {
+      for (int j = 0; j < 64; ++j) {
+        ptrs.push_back(::operator new(1024));
+      }
+      for (void* ptr : ptrs) {
+        ::operator delete(ptr);
+      }
+      ptrs.clear();
+    }
+    void* last = ::operator new(1024);
+    filled.Notify();
+
+    wake.WaitForNotification();
+    // Its cache has lost its limit, so this returns everything cached.
+    ::operator delete(last);
+    reclaimed.Notify();
+  });
+
+  filled.WaitForNotification();
+  const size_t before = ThreadCacheBytes();
+  ASSERT_GT(before, 0);
+  // The first call only records the misses so far.
+  for (int i = 0; i <= ThreadCache::kIdleResizeIntervals; ++i) {
+    ThreadCache::ResizeCaches();
+  }
+  wake.Notify();
+  reclaimed.WaitForNotification();
+  EXPECT_LT(ThreadCacheBytes(), before);
+  idle.join();
+}
+
+TEST_F(ThreadCacheTest, FlushIdleCachesFlushesParkedThreads) {
+  ASSERT_FALSE(MallocExtension::PerCpuCachesActive());
+  using tcmalloc_internal::ThreadCache;
+  constexpr int64_t kIdleIntervals = 3;
+
+  absl::Notification filled, wake, flushed;
+  std::thread parked([&]() {
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 100; ++i) {
+      for (int j = 0; j < 64; ++j) {
+        ptrs.push_back(::operator new(1024));
+      }
+      for (void* ptr : ptrs) {
+        ::operator delete(ptr);
+      }
+      ptrs.clear();
+    }
+    void* last = ::operator new(1024);
+    filled.Notify();
+
+    // As a thread waiting for work in a pool, which never calls
+    // MarkThreadIdle().
+    wake.WaitForNotification();
+    ::operator delete(last);
+    flushed.Notify();
+  });
+
+  filled.WaitForNotification();
+  const size_t before = ThreadCacheBytes();
+  ASSERT_GT(before, 0);
+  // The first call only records the misses so far.
+  for (int i = 0; i <= kIdleIntervals; ++i) {
+    ThreadCache::FlushIdleCaches(kIdleIntervals);
+  }
+  wake.Notify();
+  flushed.WaitForNotification();
+  EXPECT_LT(ThreadCacheBytes(), before);
+  parked.join();
+}
+
 }  // namespace
 }  // namespace tcmalloc
@@ -0,0 +1,90 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/thread_magazine.h"
+
+#include <pthread.h>
+
+#include <cstddef>
+
+#include "absl/base/attributes.h"
+#include "absl/types/span.h"
+#include "tcmalloc/cpu_cache.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+#include "tcmalloc/static_vars.h"
+#include "tcmalloc/transfer_cache.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+// Releases flushed objects straight to the transfer cache, for threads that
+// can no longer use the per-cpu cache (e.g. rseq is already unregistered).
+struct TransferCacheSink {
+  void DeallocateBatch(size_t size_class, void** batch, size_t len) {
+    tc_globals.transfer_cache().InsertRange(size_class,
+                                            absl::Span<void*>(batch, len));
+  }
+};
+
+}  // namespace
+
+ABSL_CONST_INIT thread_local ThreadMagazine ThreadMagazine::thread_local_data_
+    ABSL_ATTRIBUTE_INITIAL_EXEC;
+ABSL_CONST_INIT bool ThreadMagazine::tsd_inited_ = false;
+pthread_key_t ThreadMagazine::magazine_key_;
+ABSL_CONST_INIT StatsCounter ThreadMagazine::hits_;
+ABSL_CONST_INIT StatsCounter ThreadMagazine::refills_;
+ABSL_CONST_INIT StatsCounter ThreadMagazine::flushes_;
+
+void ThreadMagazine::InitTSD() {
+  TC_ASSERT(!tsd_inited_);
+  pthread_key_create(&magazine_key_, DestroyThreadMagazine);
+  tsd_inited_ = true;
+}
+
+void ThreadMagazine::RegisterThread() {
+  ThreadMagazine& magazine = Get();
+  if (magazine.registered_ || !tsd_inited_) return;
+  // pthread_setspecific() may allocate. Mark the magazine registered first so
+  // that a recursive call does not try again.
+  magazine.registered_ = true;
+  pthread_setspecific(magazine_key_, &magazine);
+}
+
+void ThreadMagazine::FlushCurrentThread() {
+  ThreadMagazine& magazine = Get();
+  if (UsePerCpuCache(tc_globals)) {
+    magazine.FlushAll(tc_globals.cpu_cache());
+  } else {
+    TransferCacheSink sink;
+    magazine.FlushAll(sink);
+  }
+}
+
+void ThreadMagazine::DestroyThreadMagazine(void* ptr) {
+  if (ptr == nullptr) return;
+  TC_ASSERT_EQ(static_cast<ThreadMagazine*>(ptr), &Get());
+  // Destructors of other keys may still allocate and fill the magazine again,
+  // in which case the thread registers once more and pthread runs this again.
+  Get().registered_ = false;
+  FlushCurrentThread();
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
@@ -0,0 +1,212 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TCMALLOC_THREAD_MAGAZINE_H_
+#define TCMALLOC_THREAD_MAGAZINE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "tcmalloc/internal/atomic_stats_counter.h"
+#include "tcmalloc/internal/config.h"
+#include "tcmalloc/internal/logging.h"
+
+GOOGLE_MALLOC_SECTION_BEGIN
+namespace tcmalloc {
+namespace tcmalloc_internal {
+
+// A ThreadMagazine keeps a handful of objects of each of the smallest size
+// classes in front of the per-cpu cache. Allocations and deallocations that
+// hit the magazine do not enter an rseq critical section, so they cannot be
+// restarted by preemption; the magazine exchanges objects with the per-cpu
+// cache a batch at a time when it runs empty or full.
+//
+// The magazine is only filled while
+// Parameters::per_cpu_caches_thread_magazine() is set. When it is not set,
+// Pop() always misses and costs a thread-local load.
+class ThreadMagazine {
+ public:
+  // Size classes [1, kNumClasses) are served by the magazine.
+  static constexpr size_t kNumClasses = 8;
+  // Maximum number of objects held per size class.
+  static constexpr size_t kCapacity = 8;
+
+  constexpr ThreadMagazine() = default;
+
+  // Returns an object of <size_class> held by the magazine, or nullptr if
+  // there is none.
+  void* Pop(size_t size_class);
+
+  // Keeps <ptr> in the magazine. Returns false if <size_class> is not served
+  // by the magazine or its slot is full.
+  bool Push(size_t size_class, void* ptr);
+
+  // Fills the slot of <size_class> from <cache> with a single
+  // AllocateBatch and returns one of the objects, or nullptr if <cache> could
+  // not provide any.
+  template <typename Cache>
+  void* Refill(Cache& cache, size_t size_class);
+
+  // Returns half of the objects of <size_class> to <cache> with a single
+  // DeallocateBatch, making room for further Push()es.
+  template <typename Cache>
+  void Flush(Cache& cache, size_t size_class);
+
+  // Returns every object held by the magazine to <cache>.
+  template <typename Cache>
+  void FlushAll(Cache& cache);
+
+  // Returns the number of objects of <size_class> held by the magazine.
+  size_t Count(size_t size_class) const {
+    return size_class < kNumClasses ? slots_[size_class].count : 0;
+  }
+
+  // Returns the magazine of the calling thread.
+  static ThreadMagazine& Get() { return thread_local_data_; }
+
+  // Creates the key used to flush magazines at thread exit.
+  static void InitTSD();
+  // Arranges for the calling thread's magazine to be flushed when the thread
+  // exits. Called the first time the thread fills its magazine.
+  static void RegisterThread();
+  bool registered() const { return registered_; }
+
+  // Returns every object held by the calling thread's magazine to the
+  // per-cpu cache (or the transfer cache if it cannot be used).
+  static void FlushCurrentThread();
+
+  // Process-wide counts of allocations served by a magazine, of refills from
+  // and of flushes to the per-cpu cache. Hits are accumulated per thread and
+  // published on every refill and flush.
+  static size_t hits() { return hits_.value(); }
+  static size_t refills() { return refills_.value(); }
+  static size_t flushes() { return flushes_.value(); }
+
+ private:
+  struct Slot {
+    uint32_t count = 0;
+    void* objects[kCapacity] = {};
+  };
+
+  void PublishHits() {
+    if (pending_hits_ != 0) {
+      hits_.Add(pending_hits_);
+      pending_hits_ = 0;
+    }
+  }
+
+  static void DestroyThreadMagazine(void* ptr);
+
+  Slot slots_[kNumClasses] = {};
+  uint64_t pending_hits_ = 0;
+  bool registered_ = false;
+
+  ABSL_CONST_INIT static thread_local ThreadMagazine thread_local_data_
+      ABSL_ATTRIBUTE_INITIAL_EXEC;
+
+  static bool tsd_inited_;
+  static pthread_key_t magazine_key_;
+
+  ABSL_CONST_INIT static StatsCounter hits_;
+  ABSL_CONST_INIT static StatsCounter refills_;
+  ABSL_CONST_INIT static StatsCounter flushes_;
+};
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE void* ThreadMagazine::Pop(
+    size_t size_class) {
+  if (size_class >= kNumClasses) {
+    return nullptr;
+  }
+  Slot& slot = slots_[size_class];
+  if (ABSL_PREDICT_TRUE(slot.count == 0)) {
+    return nullptr;
+  }
+  ++pending_hits_;
+  return slot.objects[--slot.count];
+}
+
+inline ABSL_ATTRIBUTE_ALWAYS_INLINE bool ThreadMagazine::Push(
+    size_t size_class, void* ptr) {
+  if (size_class >= kNumClasses) {
+    return false;
+  }
+  Slot& slot = slots_[size_class];
+  if (ABSL_PREDICT_FALSE(slot.count == kCapacity)) {
+    return false;
+  }
+  slot.objects[slot.count++] = ptr;
+  return true;
+}
+
+template <typename Cache>
+void* ThreadMagazine::Refill(Cache& cache, size_t size_class) {
+  TC_ASSERT_GT(size_class, 0);
+  TC_ASSERT_LT(size_class, kNumClasses);
+  Slot& slot = slots_[size_class];
+  // Keep the objects that are already held; only top the slot up.
+  const size_t want = kCapacity - slot.count;
+  if (want == 0) {
+    return Pop(size_class);
+  }
+  const size_t got =
+      cache.AllocateBatch(size_class, slot.objects + slot.count, want);
+  refills_.Add(1);
+  PublishHits();
+  if (got == 0) {
+    return nullptr;
+  }
+  slot.count += got;
+  return slot.objects[--slot.count];
+}
+
+template <typename Cache>
+void ThreadMagazine::Flush(Cache& cache, size_t size_class) {
+  TC_ASSERT_GT(size_class, 0);
+  TC_ASSERT_LT(size_class, kNumClasses);
+  Slot& slot = slots_[size_class];
+  // Return the oldest objects and keep the most recently freed ones, which are
+  // the most likely to still be in cache when they are reallocated.
+  const size_t n = (slot.count + 1) / 2;
+  if (n == 0) {
+    return;
+  }
+  cache.DeallocateBatch(size_class, slot.objects, n);
+  for (size_t i = n; i < slot.count; ++i) {
+    slot.objects[i - n] = slot.objects[i];
+  }
+  slot.count -= n;
+  flushes_.Add(1);
+  PublishHits();
+}
+
+template <typename Cache>
+void ThreadMagazine::FlushAll(Cache& cache) {
+  for (size_t size_class = 1; size_class < kNumClasses; ++size_class) {
+    Slot& slot = slots_[size_class];
+    if (slot.count == 0) continue;
+    cache.DeallocateBatch(size_class, slot.objects, slot.count);
+    slot.count = 0;
+    flushes_.Add(1);
+  }
+  PublishHits();
+}
+
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
+GOOGLE_MALLOC_SECTION_END
+
+#endif  // TCMALLOC_THREAD_MAGAZINE_H_
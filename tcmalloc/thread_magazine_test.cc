@@ -0,0 +1,155 @@
+// Copyright 2019 The TCMalloc Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tcmalloc/thread_magazine.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace tcmalloc {
+namespace tcmalloc_internal {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+// Hands out fake object addresses and records what is returned to it.
+class FakeCache {
+ public:
+  size_t AllocateBatch(size_t size_class, void** batch, size_t len) {
+    ++allocate_batches_;
+    const size_t n = std::min(len, available_);
+    for (size_t i = 0; i < n; ++i) {
+      batch[i] = reinterpret_cast<void*>(++next_);
+    }
+    available_ -= n;
+    return n;
+  }
+
+  void DeallocateBatch(size_t size_class, void** batch, size_t len) {
+    ++deallocate_batches_;
+    freed_.insert(freed_.end(), batch, batch + len);
+  }
+
+  size_t available_ = 1000;
+  uintptr_t next_ = 0;
+  int allocate_batches_ = 0;
+  int deallocate_batches_ = 0;
+  std::vector<void*> freed_;
+};
+
+void* Object(uintptr_t i) { return reinterpret_cast<void*>(i); }
+
+TEST(ThreadMagazineTest, PushPop) {
+  ThreadMagazine magazine;
+  constexpr size_t kSizeClass = 1;
+  EXPECT_EQ(magazine.Pop(kSizeClass), nullptr);
+
+  for (size_t i = 1; i <= ThreadMagazine::kCapacity; ++i) {
+    EXPECT_TRUE(magazine.Push(kSizeClass, Object(i)));
+  }
+  EXPECT_FALSE(magazine.Push(kSizeClass, Object(100)));
+  EXPECT_EQ(magazine.Count(kSizeClass), ThreadMagazine::kCapacity);
+
+  // Other size classes have their own slots.
+  EXPECT_EQ(magazine.Pop(kSizeClass + 1), nullptr);
+
+  for (size_t i = ThreadMagazine::kCapacity; i >= 1; --i) {
+    EXPECT_EQ(magazine.Pop(kSizeClass), Object(i));
+  }
+  EXPECT_EQ(magazine.Pop(kSizeClass), nullptr);
+}
+
+TEST(ThreadMagazineTest, LargeSizeClassesBypass) {
+  ThreadMagazine magazine;
+  EXPECT_FALSE(magazine.Push(ThreadMagazine::kNumClasses, Object(1)));
+  EXPECT_EQ(magazine.Pop(ThreadMagazine::kNumClasses), nullptr);
+  EXPECT_EQ(magazine.Count(ThreadMagazine::kNumClasses), 0);
+}
+
+TEST(ThreadMagazineTest, Refill) {
+  ThreadMagazine magazine;
+  FakeCache cache;
+  constexpr size_t kSizeClass = 2;
+  const size_t refills = ThreadMagazine::refills();
+
+  void* ptr = magazine.Refill(cache, kSizeClass);
+  EXPECT_NE(ptr, nullptr);
+  EXPECT_EQ(cache.allocate_batches_, 1);
+  EXPECT_EQ(magazine.Count(kSizeClass), ThreadMagazine::kCapacity - 1);
+  EXPECT_EQ(ThreadMagazine::refills(), refills + 1);
+
+  // The remaining objects are served without touching the cache.
+  for (size_t i = 0; i < ThreadMagazine::kCapacity - 1; ++i) {
+    EXPECT_NE(magazine.Pop(kSizeClass), nullptr);
+  }
+  EXPECT_EQ(cache.allocate_batches_, 1);
+
+  cache.available_ = 0;
+  EXPECT_EQ(magazine.Refill(cache, kSizeClass), nullptr);
+  EXPECT_EQ(magazine.Count(kSizeClass), 0);
+}
+
+TEST(ThreadMagazineTest, FlushReturnsOldestHalf) {
+  ThreadMagazine magazine;
+  FakeCache cache;
+  constexpr size_t kSizeClass = 3;
+  const size_t flushes = ThreadMagazine::flushes();
+
+  std::vector<void*> oldest;
+  for (size_t i = 1; i <= ThreadMagazine::kCapacity; ++i) {
+    ASSERT_TRUE(magazine.Push(kSizeClass, Object(i)));
+    if (i <= ThreadMagazine::kCapacity / 2) {
+      oldest.push_back(Object(i));
+    }
+  }
+
+  magazine.Flush(cache, kSizeClass);
+  EXPECT_EQ(cache.deallocate_batches_, 1);
+  EXPECT_THAT(cache.freed_, ElementsAreArray(oldest));
+  EXPECT_EQ(magazine.Count(kSizeClass), ThreadMagazine::kCapacity / 2);
+  EXPECT_EQ(ThreadMagazine::flushes(), flushes + 1);
+
+  // The most recently pushed objects are kept, in order.
+  EXPECT_EQ(magazine.Pop(kSizeClass), Object(ThreadMagazine::kCapacity));
+}
+
+TEST(ThreadMagazineTest, FlushAll) {
+  ThreadMagazine magazine;
+  FakeCache cache;
+  const size_t hits = ThreadMagazine::hits();
+
+  ASSERT_TRUE(magazine.Push(1, Object(1)));
+  ASSERT_TRUE(magazine.Push(1, Object(2)));
+  ASSERT_TRUE(magazine.Push(2, Object(3)));
+  EXPECT_EQ(magazine.Pop(1), Object(2));
+
+  magazine.FlushAll(cache);
+  EXPECT_EQ(cache.deallocate_batches_, 2);
+  EXPECT_THAT(cache.freed_, ElementsAreArray({Object(1), Object(3)}));
+  for (size_t size_class = 1; size_class < ThreadMagazine::kNumClasses;
+       ++size_class) {
+    EXPECT_EQ(magazine.Count(size_class), 0);
+  }
+  // Hits are published when the magazine is flushed.
+  EXPECT_EQ(ThreadMagazine::hits(), hits + 1);
+}
+
+}  // namespace
+}  // namespace tcmalloc_internal
+}  // namespace tcmalloc
@@ -21,6 +21,8 @@
 
 #include "absl/base/attributes.h"
 #include "absl/types/span.h"
+#include "tcmalloc/experiment.h"
+#include "tcmalloc/experiment_config.h"
 #include "tcmalloc/internal/config.h"
 #include "tcmalloc/static_vars.h"
 
@@ -37,12 +39,22 @@ size_t StaticForwarder::num_objects_to_move(int size_class) {
   return tc_globals.sizemap().num_objects_to_move(size_class);
 }
 void *StaticForwarder::Alloc(size_t size, std::align_val_t alignment) {
-  return tc_globals.arena().Alloc(size, alignment);
+  return tc_globals.arena().Alloc(size, alignment, ArenaUse::kTransferCache);
+}
+
+TransferCacheImplementation TransferCacheManager::ChooseImplementation() {
+  if (IsExperimentActive(
+          Experiment::TEST_ONLY_TCMALLOC_LOCK_FREE_TRANSFER_CACHE)) {
+    return TransferCacheImplementation::LockFreeRing;
+  }
+  return TransferCacheImplementation::Legacy;
 }
 
 ABSL_CONST_INIT bool ShardedStaticForwarder::use_generic_cache_(false);
 ABSL_CONST_INIT bool
     ShardedStaticForwarder::enable_cache_for_large_classes_only_(false);
+ABSL_CONST_INIT bool ShardedStaticForwarder::use_origin_affinity_(false);
+ABSL_CONST_INIT bool ShardedStaticForwarder::use_cold_tier_(false);
 
 void BackingTransferCache::InsertRange(absl::Span<void *> batch) const {
   tc_globals.transfer_cache().InsertRange(size_class_, batch);
@@ -39,6 +39,7 @@
 #include "tcmalloc/internal/logging.h"
 #include "tcmalloc/internal/percpu.h"
 #include "tcmalloc/parameters.h"
+#include "tcmalloc/sizemap.h"
 #include "tcmalloc/transfer_cache_stats.h"
 
 #ifndef TCMALLOC_INTERNAL_SMALL_BUT_SLOW
@@ -85,6 +86,10 @@ class ShardedStaticForwarder : public StaticForwarder {
     // classes alone.
     enable_cache_for_large_classes_only_ = IsExperimentActive(
         Experiment::TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE);
+    use_origin_affinity_ = IsExperimentActive(
+        Experiment::TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE_AFFINITY);
+    use_cold_tier_ =
+        IsExperimentActive(Experiment::TEST_ONLY_TCMALLOC_SHARDED_COLD_CLASSES);
   }
 
   static bool UseGenericCache() { return use_generic_cache_; }
@@ -93,9 +98,15 @@ class ShardedStaticForwarder : public StaticForwarder {
     return enable_cache_for_large_classes_only_;
   }
 
+  static bool UseOriginAffinity() { return use_origin_affinity_; }
+
+  static bool UseColdTier() { return use_cold_tier_; }
+
  private:
   static bool use_generic_cache_;
   static bool enable_cache_for_large_classes_only_;
+  static bool use_origin_affinity_;
+  static bool use_cold_tier_;
 };
 
 class ProdCpuLayout {
@@ -148,6 +159,16 @@ class ShardedTransferCacheManagerBase {
     for (int shard = 0; shard < num_shards_; ++shard) {
       new (&shards_[shard]) Shard;
     }
+    if (Manager::UseOriginAffinity() && num_shards_ > 1) {
+      // Shards are recorded as shard + 1 in a byte.
+      TC_ASSERT_LT(num_shards_, 256);
+      origins_ = reinterpret_cast<std::atomic<uint8_t> *>(
+          owner_->Alloc(sizeof(std::atomic<uint8_t>) * kOriginTableSize));
+      TC_ASSERT_NE(origins_, nullptr);
+      for (int i = 0; i < kOriginTableSize; ++i) {
+        new (&origins_[i]) std::atomic<uint8_t>(0);
+      }
+    }
     for (int size_class = 0; size_class < kNumClasses; ++size_class) {
       const int size_per_object = Manager::class_to_size(size_class);
       // We enable sharded transfer cache for all the size classes when a
@@ -162,8 +183,17 @@ class ShardedTransferCacheManagerBase {
       bool use_sharded_cache =
           UseCacheForLargeClassesOnly() ||
           (UseGenericCache() && (num_shards_ >= kMinShardsAllowed));
+      // With the cold tier, cold size classes get small caches of their own
+      // wherever there is more than one cache domain.  They still go through
+      // the per-CPU caches first, rather than bypassing them as large classes
+      // do in the traditional configuration.
+      cold_tier_for_class_[size_class] =
+          Manager::UseColdTier() && num_shards_ > 1 &&
+          IsExpandedSizeClass(size_class) &&
+          size_per_object >= SizeMap::kMinAllocSizeForCold;
       active_for_class_[size_class] =
-          use_sharded_cache && size_per_object >= min_size;
+          cold_tier_for_class_[size_class] ||
+          (use_sharded_cache && size_per_object >= min_size);
     }
   }
 
@@ -171,6 +201,11 @@ class ShardedTransferCacheManagerBase {
     return active_for_class_[size_class];
   }
 
+  // Whether size_class is a cold size class served by the cold tier.
+  bool is_cold_tier(int size_class) const {
+    return cold_tier_for_class_[size_class];
+  }
+
   size_t TotalBytes() const {
     if (shards_ == nullptr) return 0;
     size_t out = 0;
@@ -199,13 +234,13 @@ class ShardedTransferCacheManagerBase {
   void *Pop(int size_class) {
     TC_ASSERT(subtle::percpu::IsFastNoInit());
     void *batch[1];
-    const int got = get_cache(size_class).RemoveRange(size_class, batch, 1);
+    const int got = RemoveRange(size_class, batch, 1);
     return got == 1 ? batch[0] : nullptr;
   }
 
   void Push(int size_class, void *ptr) {
     TC_ASSERT(subtle::percpu::IsFastNoInit());
-    get_cache(size_class).InsertRange(size_class, {&ptr, 1});
+    InsertRange(size_class, {&ptr, 1});
   }
 
   void Print(Printer *out) const {
@@ -219,8 +254,14 @@ class ShardedTransferCacheManagerBase {
                 UseCacheForLargeClassesOnly() || UseGenericCache()
                     ? "ACTIVE"
                     : "INACTIVE");
+    out->printf("Cold size classes in the cold tier: %3d\n",
+                NumColdTierClasses());
     out->printf("Number of active sharded transfer caches: %3d\n",
                 NumActiveShards());
+    out->printf("Objects rebalanced between shards: %12u\n",
+                rebalanced_objects());
+    out->printf("Batches returned to their origin shard: %12u\n",
+                origin_handoffs());
     out->printf("------------------------------------------------\n");
     uint64_t sharded_cumulative_bytes = 0;
     static constexpr double MiB = 1048576.0;
@@ -256,6 +297,12 @@ class ShardedTransferCacheManagerBase {
       entry.PrintI64("max_capacity", stats.max_capacity);
     }
     region->PrintI64("active_sharded_transfer_caches", NumActiveShards());
+    region->PrintI64("sharded_transfer_cache_cold_tier_classes",
+                     NumColdTierClasses());
+    region->PrintI64("sharded_transfer_cache_rebalanced_objects",
+                     rebalanced_objects());
+    region->PrintI64("sharded_transfer_cache_origin_handoffs",
+                     origin_handoffs());
   }
 
   // Returns cumulative stats over all the shards of the sharded transfer cache.
@@ -273,16 +320,89 @@ class ShardedTransferCacheManagerBase {
       stats.used += shard_stats.used;
       stats.capacity += shard_stats.capacity;
       stats.max_capacity += shard_stats.max_capacity;
+      stats.insert_partial_batches += shard_stats.insert_partial_batches;
+      stats.remove_partial_batches += shard_stats.remove_partial_batches;
+      for (size_t i = 0; i < kBatchSizeBuckets; ++i) {
+        stats.insert_batch_sizes[i] += shard_stats.insert_batch_sizes[i];
+        stats.remove_batch_sizes[i] += shard_stats.remove_batch_sizes[i];
+      }
     }
     return stats;
   }
 
   int RemoveRange(int size_class, void **batch, size_t count) {
-    return get_cache(size_class).RemoveRange(size_class, batch, count);
+    const int shard = current_shard();
+    const int got = get_cache(shard, size_class).RemoveRange(size_class, batch,
+                                                             count);
+    if (origins_ != nullptr && got > 0) {
+      origins_[OriginIndex(batch[0])].store(shard + 1,
+                                            std::memory_order_relaxed);
+    }
+    return got;
   }
 
+  // When origin affinity is enabled, batches are returned to the shard that
+  // handed out their first object, so that objects freed in a consumer L3
+  // domain go straight back to the producer domain while still cache-warm.
   void InsertRange(int size_class, absl::Span<void *> batch) {
-    get_cache(size_class).InsertRange(size_class, batch);
+    int shard = current_shard();
+    if (origins_ != nullptr && !batch.empty()) {
+      const int origin =
+          origins_[OriginIndex(batch[0])].load(std::memory_order_relaxed) - 1;
+      if (origin >= 0 && origin != shard && shard_initialized(origin)) {
+        shard = origin;
+        origin_handoffs_.store(
+            origin_handoffs_.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+      }
+    }
+    get_cache(shard, size_class).InsertRange(size_class, batch);
+  }
+
+  // Returns the number of batches that InsertRange() returned to the shard
+  // they were allocated from rather than to the current one. The count is
+  // lossy.
+  uint64_t origin_handoffs() const {
+    return origin_handoffs_.load(std::memory_order_relaxed);
+  }
+
+  // Moves objects from shards that have a surplus of a size class to shards
+  // that missed on it since the previous call, so that objects freed in a
+  // consumer L3 domain serve producer domains instead of being plundered back
+  // to the non-sharded TransferCache.  This should run before Plunder().
+  void Rebalance() {
+    if (shards_ == nullptr || num_shards_ < 2) return;
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      if (!should_use(size_class)) continue;
+
+      for (int shard = 0; shard < num_shards_; ++shard) {
+        if (!shard_initialized(shard)) continue;
+        RebalanceState &state = shards_[shard].rebalance[size_class];
+        const size_t misses = shards_[shard]
+                                  .transfer_caches[size_class]
+                                  .GetStats()
+                                  .remove_object_misses;
+        state.demand = misses - state.last_remove_object_misses;
+        state.last_remove_object_misses = misses;
+      }
+
+      for (int to = 0; to < num_shards_; ++to) {
+        if (!shard_initialized(to)) continue;
+        if (shards_[to].rebalance[size_class].demand == 0) continue;
+        for (int from = 0; from < num_shards_; ++from) {
+          if (from == to || !shard_initialized(from)) continue;
+          // A shard that misses itself has no surplus to give away.
+          if (shards_[from].rebalance[size_class].demand > 0) continue;
+          MoveSurplus(size_class, shards_[from], shards_[to]);
+          if (shards_[to].rebalance[size_class].demand == 0) break;
+        }
+      }
+    }
+  }
+
+  // Returns the number of objects moved between shards by Rebalance().
+  uint64_t rebalanced_objects() const {
+    return rebalanced_objects_.load(std::memory_order_relaxed);
   }
 
   // All caches not touched since last attempt will return all objects
@@ -298,6 +418,27 @@ class ShardedTransferCacheManagerBase {
     }
   }
 
+  // Returns all objects in the shards to the non-sharded TransferCache, as
+  // TransferCacheManager::Drain() does.
+  void Drain() {
+    Plunder();
+    Plunder();
+  }
+
+  // Moves capacity between the size classes of each initialized shard based
+  // on the misses they incurred since the previous call, the way
+  // TransferCacheManager::TryResizingCaches() does for the non-sharded cache.
+  // Each shard adapts on its own, so a shard whose L3 domain is idle does not
+  // take capacity from classes that miss elsewhere.
+  void TryResizingCaches() {
+    if (shards_ == nullptr || num_shards_ == 0) return;
+    for (int shard = 0; shard < num_shards_; ++shard) {
+      if (!shard_initialized(shard)) continue;
+      ShardResizer resizer(shards_[shard]);
+      internal_transfer_cache::TryResizingCaches(resizer);
+    }
+  }
+
   int tc_length(int cpu, int size_class) const {
     if (shards_ == nullptr) return 0;
     const uint8_t shard = cpu_layout_->CpuShard(cpu);
@@ -320,10 +461,26 @@ class ShardedTransferCacheManagerBase {
     return active_shards_.load(std::memory_order_relaxed);
   }
 
+  int NumColdTierClasses() const {
+    int n = 0;
+    for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+      n += is_cold_tier(size_class);
+    }
+    return n;
+  }
+
  private:
   using TransferCache =
       internal_transfer_cache::TransferCache<FreeList, Manager>;
 
+  struct RebalanceState {
+    // Remove object misses of the size class as of the previous Rebalance().
+    size_t last_remove_object_misses;
+    // Objects the shard still failed to find since the previous Rebalance(),
+    // less those moved to it so far in the current one.
+    size_t demand;
+  };
+
   // Store the transfer cache pointers and information about whether they are
   // initialized next to each other.
   struct Shard {
@@ -333,12 +490,53 @@ class ShardedTransferCacheManagerBase {
       initialized.store(false, std::memory_order_release);
     }
     TransferCache *transfer_caches = nullptr;
+    // Per size class state of Rebalance(). Only the background thread
+    // accesses it once the shard is initialized.
+    RebalanceState *rebalance = nullptr;
     absl::once_flag once_flag;
     // We need to be able to tell whether a given shard is initialized, which
     // the `once_flag` API doesn't offer.
     std::atomic<bool> initialized;
   };
 
+  // Presents the caches of a single shard with the interface
+  // internal_transfer_cache::TryResizingCaches() expects of a manager.
+  class ShardResizer {
+   public:
+    static constexpr size_t kNumBaseClasses =
+        tcmalloc::tcmalloc_internal::kNumBaseClasses;
+    static constexpr size_t kNumClasses =
+        tcmalloc::tcmalloc_internal::kNumClasses;
+    static constexpr size_t kNumaPartitions =
+        tcmalloc::tcmalloc_internal::kNumaPartitions;
+    static constexpr size_t kHasExpandedClasses =
+        tcmalloc::tcmalloc_internal::kHasExpandedClasses;
+    static constexpr size_t kExpandedClassesStart =
+        tcmalloc::tcmalloc_internal::kExpandedClassesStart;
+    // As for the non-sharded cache, grow up to 10% of the size classes of a
+    // shard during one resize interval.
+    static constexpr int kMaxSizeClassesToResize =
+        std::max<int>(static_cast<int>(kNumClasses * 0.1), 1);
+
+    explicit ShardResizer(Shard &shard) : caches_(shard.transfer_caches) {}
+
+    size_t FetchCommitIntervalMisses(int size_class) {
+      return caches_[size_class].FetchCommitIntervalMisses();
+    }
+    bool CanIncreaseCapacity(int size_class) const {
+      return caches_[size_class].CanIncreaseCapacity(size_class);
+    }
+    bool IncreaseCacheCapacity(int size_class) {
+      return caches_[size_class].IncreaseCacheCapacity(size_class);
+    }
+    bool ShrinkCache(int size_class) {
+      return caches_[size_class].ShrinkCache(size_class);
+    }
+
+   private:
+    TransferCache *const caches_;
+  };
+
   struct Capacity {
     int capacity;
     int max_capacity;
@@ -357,6 +555,18 @@ class ShardedTransferCacheManagerBase {
     return {capacity, max_capacity};
   }
 
+  // Cold objects are allocated rarely, and their memory is meant to stay out of
+  // the way, so each shard holds two batches of them, and at most 1MiB unless a
+  // batch is larger.  The capacity is fixed, so that resizing never grows it.
+  Capacity ColdTierCapacity(size_t size_class) const {
+    static constexpr int k1MB = 1 << 20;
+    const int batch = Manager::num_objects_to_move(size_class);
+    const int size_per_object = Manager::class_to_size(size_class);
+    const int capacity =
+        std::max(batch, std::min(2 * batch, k1MB / size_per_object));
+    return {capacity, capacity};
+  }
+
   // Initializes all transfer caches in the given shard.
   void InitShard(Shard &shard) ABSL_LOCKS_EXCLUDED(pageheap_lock) {
     PageHeapSpinLockHolder l;
@@ -365,8 +575,14 @@ class ShardedTransferCacheManagerBase {
                       std::align_val_t{ABSL_CACHELINE_SIZE}));
     TC_ASSERT_NE(new_caches, nullptr);
     for (int size_class = 0; size_class < kNumClasses; ++size_class) {
-      Capacity capacity = UseGenericCache() ? ScaledCacheCapacity(size_class)
-                                            : LargeCacheCapacity(size_class);
+      Capacity capacity;
+      if (is_cold_tier(size_class)) {
+        capacity = ColdTierCapacity(size_class);
+      } else if (UseGenericCache()) {
+        capacity = ScaledCacheCapacity(size_class);
+      } else {
+        capacity = LargeCacheCapacity(size_class);
+      }
       new (&new_caches[size_class]) TransferCache(
           owner_, capacity.capacity > 0 ? size_class : 0,
           {capacity.capacity, capacity.max_capacity},
@@ -376,26 +592,75 @@ class ShardedTransferCacheManagerBase {
           Parameters::use_all_buckets_for_few_object_spans_in_cfl());
     }
     shard.transfer_caches = new_caches;
+    shard.rebalance = reinterpret_cast<RebalanceState *>(
+        owner_->Alloc(sizeof(RebalanceState) * kNumClasses));
+    TC_ASSERT_NE(shard.rebalance, nullptr);
+    for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+      shard.rebalance[size_class] = {0, 0};
+    }
     active_shards_.fetch_add(1, std::memory_order_relaxed);
     shard.initialized.store(true, std::memory_order_release);
   }
 
-  // Returns the cache shard corresponding to the given size class and the
-  // current cpu's L3 node. The cache will be initialized if required.
-  TransferCache &get_cache(int size_class) {
+  // Moves objects of size_class from one shard to another, up to the demand of
+  // the receiving shard and as long as it has room for them.
+  void MoveSurplus(int size_class, Shard &from, Shard &to) {
+    TransferCache &source = from.transfer_caches[size_class];
+    TransferCache &sink = to.transfer_caches[size_class];
+    size_t &demand = to.rebalance[size_class].demand;
+    const size_t batch_size = Manager::num_objects_to_move(size_class);
+    void *batch[kMaxObjectsToMove];
+    while (demand > 0 && sink.HasSpareCapacity(size_class)) {
+      const size_t n = std::min({demand, batch_size, source.tc_length()});
+      if (n == 0) return;
+      const int got = source.RemoveRange(size_class, batch, n);
+      if (got == 0) return;
+      sink.InsertRange(size_class, {batch, static_cast<size_t>(got)});
+      demand -= std::min<size_t>(demand, got);
+      rebalanced_objects_.store(
+          rebalanced_objects_.load(std::memory_order_relaxed) + got,
+          std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the shard of the current cpu's L3 node.
+  int current_shard() const {
     const uint8_t shard_index =
         cpu_layout_->CpuShard(cpu_layout_->CurrentCpu());
     TC_ASSERT_LT(shard_index, num_shards_);
+    return shard_index;
+  }
+
+  // Returns the slot of the origin table that records which shard last handed
+  // out objects from the page of ptr.
+  static size_t OriginIndex(const void *ptr) {
+    const uintptr_t page = reinterpret_cast<uintptr_t>(ptr) >> kPageShift;
+    return (page * 0x9E3779B97F4A7C15ull) >> (64 - kOriginTableBits);
+  }
+
+  // Returns the cache shard corresponding to the given size class and shard.
+  // The cache will be initialized if required.
+  TransferCache &get_cache(int shard_index, int size_class) {
     Shard &shard = shards_[shard_index];
     absl::base_internal::LowLevelCallOnce(
         &shard.once_flag, [this, &shard]() { InitShard(shard); });
     return shard.transfer_caches[size_class];
   }
 
+  static constexpr int kOriginTableBits = 12;
+  static constexpr int kOriginTableSize = 1 << kOriginTableBits;
+
   Shard *shards_ = nullptr;
   int num_shards_ = 0;
   std::atomic<int> active_shards_ = 0;
+  // Only updated by Rebalance(), which runs on the background thread.
+  std::atomic<uint64_t> rebalanced_objects_ = 0;
+  // Origin shard + 1 of the objects last handed out from a page, hashed by
+  // page, or 0 if unknown. Only allocated when origin affinity is enabled.
+  std::atomic<uint8_t> *origins_ = nullptr;
+  std::atomic<uint64_t> origin_handoffs_ = 0;
   bool active_for_class_[kNumClasses] = {false};
+  bool cold_tier_for_class_[kNumClasses] = {false};
   Manager *const owner_;
   CpuLayout *const cpu_layout_;
 };
@@ -404,6 +669,11 @@ using ShardedTransferCacheManager =
     ShardedTransferCacheManagerBase<ShardedStaticForwarder, ProdCpuLayout,
                                     BackingTransferCache>;
 
+enum class TransferCacheImplementation {
+  Legacy,
+  LockFreeRing,
+};
+
 class TransferCacheManager : public StaticForwarder {
   template <typename CentralFreeList, typename Manager>
   friend class internal_transfer_cache::TransferCache;
@@ -411,7 +681,13 @@ class TransferCacheManager : public StaticForwarder {
       internal_transfer_cache::TransferCache<tcmalloc_internal::CentralFreeList,
                                              TransferCacheManager>;
 
+  template <typename CentralFreeList, typename Manager>
+  friend class internal_transfer_cache::LockFreeTransferCache;
+  using LockFreeTransferCache = internal_transfer_cache::LockFreeTransferCache<
+      tcmalloc_internal::CentralFreeList, TransferCacheManager>;
+
   friend class FakeMultiClassTransferCacheManager;
+  friend class FakeMultiClassLockFreeTransferCacheManager;
 
  public:
   constexpr TransferCacheManager() = default;
@@ -420,33 +696,76 @@ class TransferCacheManager : public StaticForwarder {
   TransferCacheManager &operator=(const TransferCacheManager &) = delete;
 
   void Init() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
+    implementation_ = ChooseImplementation();
     InitCaches();
   }
 
   void InsertRange(int size_class, absl::Span<void *> batch) {
-    cache_[size_class].tc.InsertRange(size_class, batch);
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      cache_[size_class].lock_free.InsertRange(size_class, batch);
+    } else {
+      cache_[size_class].tc.InsertRange(size_class, batch);
+    }
   }
 
   ABSL_MUST_USE_RESULT int RemoveRange(int size_class, void **batch, int n) {
-    return cache_[size_class].tc.RemoveRange(size_class, batch, n);
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.RemoveRange(size_class, batch, n);
+    } else {
+      return cache_[size_class].tc.RemoveRange(size_class, batch, n);
+    }
   }
 
   // This is not const because the underlying ring-buffer transfer cache
   // function requires acquiring a lock.
   size_t tc_length(int size_class) const {
-    return cache_[size_class].tc.tc_length();
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.tc_length();
+    } else {
+      return cache_[size_class].tc.tc_length();
+    }
   }
 
   TransferCacheStats GetStats(int size_class) const {
-    return cache_[size_class].tc.GetStats();
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.GetStats();
+    } else {
+      return cache_[size_class].tc.GetStats();
+    }
+  }
+
+  // Returns the free spans the central freelists hold back to the page heap.
+  void ReturnDeferredSpans() {
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      central_freelist(size_class).ReturnDeferredSpans();
+    }
+  }
+
+  // Lets the central freelists pick the size of their next spans.
+  void UpdateSpanSizes() {
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      central_freelist(size_class).UpdateSpanSize();
+    }
   }
 
   CentralFreeList &central_freelist(int size_class) {
-    return cache_[size_class].tc.freelist();
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.freelist();
+    } else {
+      return cache_[size_class].tc.freelist();
+    }
+  }
+
+  TransferCacheImplementation implementation() const {
+    return implementation_;
   }
 
   bool CanIncreaseCapacity(int size_class) const {
-    return cache_[size_class].tc.CanIncreaseCapacity(size_class);
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.CanIncreaseCapacity(size_class);
+    } else {
+      return cache_[size_class].tc.CanIncreaseCapacity(size_class);
+    }
   }
 
   // We try to grow up to 10% of the total number of size classes during one
@@ -463,30 +782,82 @@ class TransferCacheManager : public StaticForwarder {
 
   // Plunders unused objects from the transfer caches. The transfer caches track
   // unused objects in low_water_mark_ that measures objects untouched since
-  // the previous plunder.
+  // the previous plunder, and only plunder objects that stayed untouched for
+  // the last transfer_cache_plunder_intervals plunders.
   void TryPlunder() {
+    const int intervals = Parameters::transfer_cache_plunder_intervals();
+    for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+      if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+        cache_[size_class].lock_free.TryPlunder(size_class, intervals);
+      } else {
+        cache_[size_class].tc.TryPlunder(size_class, intervals);
+      }
+    }
+  }
+
+  // Tops up the transfer caches that keep missing from their central
+  // freelists, when transfer_cache_background_refill is set.
+  void TryRefill() {
+    if (!Parameters::transfer_cache_background_refill()) return;
     for (int size_class = 0; size_class < kNumClasses; ++size_class) {
-      cache_[size_class].tc.TryPlunder(size_class);
+      if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+        cache_[size_class].lock_free.TryRefill(size_class);
+      } else {
+        cache_[size_class].tc.TryRefill(size_class);
+      }
+    }
+  }
+
+  // Returns the objects in the transfer caches to the central freelists.  The
+  // first plunder of each cache marks everything it holds as unused, so that
+  // the second returns all of it that was not used in between.  Caches whose
+  // lock is contended are skipped.
+  void Drain() {
+    for (int size_class = 0; size_class < kNumClasses; ++size_class) {
+      for (int i = 0; i < 2; ++i) {
+        if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+          cache_[size_class].lock_free.TryPlunder(size_class);
+        } else {
+          cache_[size_class].tc.TryPlunder(size_class);
+        }
+      }
     }
   }
 
   void InitCaches() ABSL_EXCLUSIVE_LOCKS_REQUIRED(pageheap_lock) {
     for (int i = 0; i < kNumClasses; ++i) {
-      new (&cache_[i].tc) TransferCache(
-          this, i, Parameters::use_all_buckets_for_few_object_spans_in_cfl());
+      if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+        new (&cache_[i].lock_free) LockFreeTransferCache(
+            this, i, Parameters::use_all_buckets_for_few_object_spans_in_cfl());
+      } else {
+        new (&cache_[i].tc) TransferCache(
+            this, i, Parameters::use_all_buckets_for_few_object_spans_in_cfl());
+      }
     }
   }
 
   bool ShrinkCache(int size_class) {
-    return cache_[size_class].tc.ShrinkCache(size_class);
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.ShrinkCache(size_class);
+    } else {
+      return cache_[size_class].tc.ShrinkCache(size_class);
+    }
   }
 
   bool IncreaseCacheCapacity(int size_class) {
-    return cache_[size_class].tc.IncreaseCacheCapacity(size_class);
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.IncreaseCacheCapacity(size_class);
+    } else {
+      return cache_[size_class].tc.IncreaseCacheCapacity(size_class);
+    }
   }
 
   size_t FetchCommitIntervalMisses(int size_class) {
-    return cache_[size_class].tc.FetchCommitIntervalMisses();
+    if (implementation_ == TransferCacheImplementation::LockFreeRing) {
+      return cache_[size_class].lock_free.FetchCommitIntervalMisses();
+    } else {
+      return cache_[size_class].tc.FetchCommitIntervalMisses();
+    }
   }
 
   void Print(Printer *out) const {
@@ -495,6 +866,14 @@ class TransferCacheManager : public StaticForwarder {
     out->printf("of the transfer cache freelists.\n");
     out->printf("It also reports insert/remove hits/misses by size class.\n");
     out->printf("------------------------------------------------\n");
+    out->printf("Transfer cache implementation: %s\n",
+                implementation_ == TransferCacheImplementation::LockFreeRing
+                    ? "lock-free ring"
+                    : "legacy");
+    out->printf("Transfer cache implementation: %s\n",
+                implementation_ == TransferCacheImplementation::LockFreeRing
+                    ? "lock-free ring"
+                    : "legacy");
     uint64_t cumulative_bytes = 0;
     static constexpr double MiB = 1048576.0;
     for (int size_class = 1; size_class < kNumClasses; ++size_class) {
@@ -516,6 +895,9 @@ class TransferCacheManager : public StaticForwarder {
   }
 
   void PrintInPbtxt(PbtxtRegion *region) const {
+    region->PrintBool(
+        "lock_free_transfer_cache",
+        implementation_ == TransferCacheImplementation::LockFreeRing);
     for (int size_class = 1; size_class < kNumClasses; ++size_class) {
       PbtxtRegion entry = region->CreateSubRegion("transfer_cache");
       const TransferCacheStats tc_stats = GetStats(size_class);
@@ -529,17 +911,39 @@ class TransferCacheManager : public StaticForwarder {
       entry.PrintI64("used", tc_stats.used);
       entry.PrintI64("capacity", tc_stats.capacity);
       entry.PrintI64("max_capacity", tc_stats.max_capacity);
+      entry.PrintI64("insert_partial_batches", tc_stats.insert_partial_batches);
+      entry.PrintI64("remove_partial_batches", tc_stats.remove_partial_batches);
+      PrintBatchSizesInPbtxt(entry, "insert_batch_size_histogram",
+                             tc_stats.insert_batch_sizes);
+      PrintBatchSizesInPbtxt(entry, "remove_batch_size_histogram",
+                             tc_stats.remove_batch_sizes);
     }
   }
 
  private:
+  static TransferCacheImplementation ChooseImplementation();
+
+  static void PrintBatchSizesInPbtxt(
+      PbtxtRegion &region, absl::string_view key,
+      const size_t (&batch_sizes)[kBatchSizeBuckets]) {
+    for (size_t i = 0; i < kBatchSizeBuckets; ++i) {
+      PbtxtRegion histogram = region.CreateSubRegion(key);
+      histogram.PrintI64("lower_bound", 1 << i);
+      histogram.PrintI64("upper_bound", 1 << (i + 1));
+      histogram.PrintI64("value", batch_sizes[i]);
+    }
+  }
+
   union Cache {
     constexpr Cache() : dummy(false) {}
     ~Cache() {}
 
     TransferCache tc;
+    LockFreeTransferCache lock_free;
     bool dummy;
   };
+  TransferCacheImplementation implementation_ =
+      TransferCacheImplementation::Legacy;
   Cache cache_[kNumClasses];
 } ABSL_CACHELINE_ALIGNED;
 
@@ -578,6 +982,22 @@ class TransferCacheManager {
     return freelist_[size_class];
   }
 
+  static constexpr void Drain() {}
+
+  // Returns the free spans the central freelists hold back to the page heap.
+  void ReturnDeferredSpans() {
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      freelist_[size_class].ReturnDeferredSpans();
+    }
+  }
+
+  // Lets the central freelists pick the size of their next spans.
+  void UpdateSpanSizes() {
+    for (int size_class = 1; size_class < kNumClasses; ++size_class) {
+      freelist_[size_class].UpdateSpanSize();
+    }
+  }
+
   void Print(Printer* out) const {}
   void PrintInPbtxt(PbtxtRegion* region) const {}
 
@@ -590,6 +1010,7 @@ struct ShardedTransferCacheManager {
   constexpr ShardedTransferCacheManager(std::nullptr_t, std::nullptr_t) {}
   static constexpr void Init() {}
   static constexpr bool should_use(int size_class) { return false; }
+  static constexpr bool is_cold_tier(int size_class) { return false; }
   static constexpr void* Pop(int size_class) { return nullptr; }
   static constexpr void Push(int size_class, void* ptr) {}
   static constexpr int RemoveRange(int size_class, void** batch, int n) {
@@ -597,7 +1018,12 @@ struct ShardedTransferCacheManager {
   }
   static constexpr void InsertRange(int size_class, absl::Span<void*> batch) {}
   static constexpr size_t TotalBytes() { return 0; }
+  static constexpr void Rebalance() {}
+  static constexpr uint64_t rebalanced_objects() { return 0; }
+  static constexpr uint64_t origin_handoffs() { return 0; }
   static constexpr void Plunder() {}
+  static constexpr void Drain() {}
+  static constexpr void TryResizingCaches() {}
   static int tc_length(int cpu, int size_class) { return 0; }
   static int TotalObjectsOfClass(int size_class) { return 0; }
   static constexpr TransferCacheStats GetStats(int size_class) { return {}; }
@@ -36,6 +36,12 @@ using TransferCacheWithRealCFLEnv =
 using TransferCacheEnv =
     FakeTransferCacheEnvironment<internal_transfer_cache::TransferCache<
         MinimalFakeCentralFreeList, FakeTransferCacheManager>>;
+using LockFreeTransferCacheWithRealCFLEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::LockFreeTransferCache<
+        RealCentralFreeListForTesting, FakeTransferCacheManager>>;
+using LockFreeTransferCacheEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::LockFreeTransferCache<
+        MinimalFakeCentralFreeList, FakeTransferCacheManager>>;
 static constexpr int kSizeClass = 0;
 
 template <typename Env>
@@ -233,6 +239,14 @@ BENCHMARK_TEMPLATE(BM_RemoveRange, TransferCacheEnv);
 BENCHMARK_TEMPLATE(BM_RealisticBatchNonBatchMutations, TransferCacheEnv);
 BENCHMARK_TEMPLATE(BM_RealisticHitRate, TransferCacheEnv);
 BENCHMARK_TEMPLATE(BM_RealisticHitRate, TransferCacheWithRealCFLEnv);
+BENCHMARK_TEMPLATE(BM_CrossThread, LockFreeTransferCacheEnv)
+    ->ThreadRange(2, 64);
+BENCHMARK_TEMPLATE(BM_InsertRange, LockFreeTransferCacheEnv);
+BENCHMARK_TEMPLATE(BM_RemoveRange, LockFreeTransferCacheEnv);
+BENCHMARK_TEMPLATE(BM_RealisticBatchNonBatchMutations,
+                   LockFreeTransferCacheEnv);
+BENCHMARK_TEMPLATE(BM_RealisticHitRate, LockFreeTransferCacheEnv);
+BENCHMARK_TEMPLATE(BM_RealisticHitRate, LockFreeTransferCacheWithRealCFLEnv);
 
 }  // namespace
 }  // namespace tcmalloc_internal
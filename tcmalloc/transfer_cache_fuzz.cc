@@ -31,15 +31,21 @@ using TransferCache =
     internal_transfer_cache::TransferCache<MockCentralFreeList,
                                            FakeTransferCacheManager>;
 using TransferCacheEnv = FakeTransferCacheEnvironment<TransferCache>;
+using LockFreeTransferCache =
+    internal_transfer_cache::LockFreeTransferCache<MockCentralFreeList,
+                                                   FakeTransferCacheManager>;
+using LockFreeTransferCacheEnv =
+    FakeTransferCacheEnvironment<LockFreeTransferCache>;
 
-void FuzzTransferCache(const std::string& s) {
+template <typename Env>
+void FuzzEnv(const std::string& s) {
   const char* data = s.data();
   size_t size = s.size();
 
-  TransferCacheEnv env;
+  Env env;
   // TODO(b/271282540): We should also add a capability to fuzz-test multiple
   // size classes.
-  constexpr int kBatchSize = TransferCache::Manager::num_objects_to_move(1);
+  constexpr int kBatchSize = Env::Manager::num_objects_to_move(1);
   for (int i = 0; i < size; ++i) {
     switch (data[i] % 10) {
       case 0: {
@@ -80,8 +86,16 @@ void FuzzTransferCache(const std::string& s) {
   }
 }
 
+void FuzzTransferCache(const std::string& s) { FuzzEnv<TransferCacheEnv>(s); }
+
+void FuzzLockFreeTransferCache(const std::string& s) {
+  FuzzEnv<LockFreeTransferCacheEnv>(s);
+}
+
 FUZZ_TEST(TransferCacheTest, FuzzTransferCache)
     ;
+FUZZ_TEST(TransferCacheTest, FuzzLockFreeTransferCache)
+    ;
 
 }  // namespace
 }  // namespace tcmalloc::tcmalloc_internal
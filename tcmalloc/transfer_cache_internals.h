@@ -24,12 +24,14 @@
 #include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <new>
 
 #include "absl/base/attributes.h"
 #include "absl/base/const_init.h"
 #include "absl/base/internal/spinlock.h"
 #include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/numeric/bits.h"
 #include "absl/types/span.h"
 #include "tcmalloc/common.h"
 #include "tcmalloc/internal/allocation_guard.h"
@@ -45,8 +47,18 @@ struct alignas(8) SizeInfo {
   int32_t used;
   int32_t capacity;
 };
+#if defined(TCMALLOC_INTERNAL_SMALL_FOOTPRINT)
+static constexpr int kMaxCapacityInBatches = 16;
+static constexpr int kInitialCapacityInBatches = 4;
+// The most bytes of objects a size class's cache may hold.
+static constexpr size_t kMaxBytesPerSizeClass = 256 * 1024;
+#else
 static constexpr int kMaxCapacityInBatches = 64;
 static constexpr int kInitialCapacityInBatches = 16;
+static constexpr size_t kMaxBytesPerSizeClass = 1024 * 1024;
+#endif
+// Remove misses between two calls to TryRefill that make it refill a cache.
+static constexpr size_t kRefillMinMisses = 4;
 
 // Records counters for different types of misses.
 class MissCounts {
@@ -74,6 +86,68 @@ class MissCounts {
   std::atomic<size_t> total_committed_ = {0};
 };
 
+// Records the sizes of the batches passed to InsertRange or RemoveRange.
+class BatchSizeCounts {
+ public:
+  static_assert(kMaxObjectsToMove < (size_t{1} << kBatchSizeBuckets));
+
+  // Records a batch of n objects, for a size class that moves batch_size
+  // objects at a time.
+  void Record(size_t n, size_t batch_size) {
+    TC_ASSERT_GT(n, 0);
+    sizes_[absl::bit_width(n) - 1].LossyAdd(1);
+    if (n != batch_size) {
+      partial_.LossyAdd(1);
+    }
+  }
+
+  void Get(size_t (&sizes)[kBatchSizeBuckets], size_t &partial) const {
+    for (size_t i = 0; i < kBatchSizeBuckets; ++i) {
+      sizes[i] = sizes_[i].value();
+    }
+    partial = partial_.value();
+  }
+
+ private:
+  StatsCounter sizes_[kBatchSizeBuckets];
+  StatsCounter partial_;
+};
+
+// Remembers the low water marks of the last few plunder intervals, so that
+// only objects that stayed unused across all of them are plundered.  With a
+// single interval, everything not touched since the previous plunder goes.
+class PlunderHistory {
+ public:
+  static constexpr int kMaxIntervals = 8;
+
+  // Records the low water mark of the interval that just ended and returns
+  // the number of objects that stayed unused over the last `intervals`
+  // intervals, including this one.  Intervals recorded before the cache was
+  // first plundered count as fully used.
+  int Advance(int low_water_mark, int intervals) {
+    intervals = std::clamp(intervals, 1, kMaxIntervals);
+    marks_[next_] = low_water_mark;
+    int unused = low_water_mark;
+    for (int i = 1; i < intervals; ++i) {
+      unused = std::min(unused, marks_[(next_ + kMaxIntervals - i) %
+                                       kMaxIntervals]);
+    }
+    next_ = (next_ + 1) % kMaxIntervals;
+    return unused;
+  }
+
+  // Accounts for n unused objects having been plundered from the cache.
+  void Plundered(int n) {
+    for (int &mark : marks_) {
+      mark = std::max(mark - n, 0);
+    }
+  }
+
+ private:
+  int marks_[kMaxIntervals] = {};
+  int next_ = 0;
+};
+
 // TransferCache is used to cache transfers of
 // sizemap.num_objects_to_move(size_class) back and forth between
 // thread caches and the central cache for a given size class.
@@ -101,7 +175,10 @@ class TransferCache {
         slots_(nullptr),
         freelist_do_not_access_directly_(),
         owner_(owner),
-        max_capacity_(capacity.max_capacity) {
+        max_capacity_(capacity.max_capacity),
+        batch_size_(max_capacity_ != 0
+                        ? Manager::num_objects_to_move(size_class)
+                        : 0) {
     freelist().Init(size_class, use_all_buckets_for_few_object_spans);
     slots_ = max_capacity_ != 0 ? reinterpret_cast<void **>(owner_->Alloc(
                                       max_capacity_ * sizeof(void *)))
@@ -133,14 +210,15 @@ class TransferCache {
     // max_capacity_ slots to put link list chains into.
     int capacity = kInitialCapacityInBatches * objs_to_move;
 
-    // Limit each size class cache to at most 1MB of objects or one entry,
-    // whichever is greater. Total transfer cache memory used across all
-    // size classes then can't be greater than approximately
-    // 1MB * kMaxNumTransferEntries.
+    // Limit each size class cache to at most kMaxBytesPerSizeClass of objects
+    // or one entry, whichever is greater. Total transfer cache memory used
+    // across all size classes then can't be greater than approximately
+    // kMaxBytesPerSizeClass * kMaxNumTransferEntries.
     max_capacity = std::min<int>(
         max_capacity,
-        std::max<int>(objs_to_move,
-                      (1024 * 1024) / (bytes * objs_to_move) * objs_to_move));
+        std::max<int>(objs_to_move, kMaxBytesPerSizeClass /
+                                        (bytes * objs_to_move) *
+                                        objs_to_move));
     capacity = std::min(capacity, max_capacity);
 
     return {capacity, max_capacity};
@@ -154,6 +232,7 @@ class TransferCache {
       ABSL_LOCKS_EXCLUDED(lock_) {
     const int N = batch.size();
     TC_ASSERT(0 < N && N <= kMaxObjectsToMove);
+    insert_batch_sizes_.Record(N, batch_size_);
     auto info = slot_info_.load(std::memory_order_relaxed);
     if (info.capacity > info.used) {
       AllocationGuardSpinLockHolder h(&lock_);
@@ -185,6 +264,7 @@ class TransferCache {
   ABSL_MUST_USE_RESULT int RemoveRange(int size_class, void **batch, int N)
       ABSL_LOCKS_EXCLUDED(lock_) {
     TC_ASSERT(0 < N && N <= kMaxObjectsToMove);
+    remove_batch_sizes_.Record(N, batch_size_);
     auto info = slot_info_.load(std::memory_order_relaxed);
     if (info.used) {
       AllocationGuardSpinLockHolder h(&lock_);
@@ -208,15 +288,19 @@ class TransferCache {
   }
 
   // We record the lowest value of info.used in a low water mark since the last
-  // call to TryPlunder. We plunder all those objects to the freelist, as the
-  // objects not used within a full cycle are unlikely to be used again.
-  void TryPlunder(int size_class) ABSL_LOCKS_EXCLUDED(lock_) {
+  // call to TryPlunder. We plunder the objects that stayed below the low water
+  // mark for the last plunder_intervals calls to the freelist, as the objects
+  // not used within that many cycles are unlikely to be used again.
+  void TryPlunder(int size_class, int plunder_intervals = 1)
+      ABSL_LOCKS_EXCLUDED(lock_) {
     if (max_capacity_ == 0) return;
     if (!lock_.TryLock()) return;
 
-    int to_return = low_water_mark_;
     SizeInfo info = GetSlotInfo();
-    TC_ASSERT_LE(to_return, info.used);
+    TC_ASSERT_LE(low_water_mark_, info.used);
+    int to_return =
+        plunder_history_.Advance(low_water_mark_, plunder_intervals);
+    plunder_history_.Plundered(to_return);
     // Make sure to record number of used objects in the cache in the low water
     // mark at the start of each plunder. If we plunder objects below, we record
     // the new value of info.used in the low water mark as we progress.
@@ -241,6 +325,47 @@ class TransferCache {
     }
     lock_.Unlock();
   }
+
+  // Tops the cache up from the freelist while RemoveRange keeps missing, so
+  // that the span carving behind a refill runs on the background thread
+  // rather than on an allocating one.  Runs when at least kRefillMinMisses
+  // removes missed since the previous call and the cache holds less than a
+  // quarter of its capacity, and fills it to half of its capacity at most,
+  // leaving room for inserts.  Objects left unused are plundered as usual.
+  // Only the background thread calls this.
+  void TryRefill(int size_class) ABSL_LOCKS_EXCLUDED(lock_) {
+    if (max_capacity_ == 0) return;
+    const size_t misses = remove_misses_.value();
+    const size_t interval_misses = misses - refill_misses_;
+    refill_misses_ = misses;
+    if (interval_misses < kRefillMinMisses) return;
+
+    SizeInfo info = GetSlotInfo();
+    if (info.used >= info.capacity / 4) return;
+    const int B = Manager::num_objects_to_move(size_class);
+    int to_fill = std::min<size_t>(info.capacity / 2 - info.used,
+                                   interval_misses * B);
+    void *buf[kMaxObjectsToMove];
+    while (to_fill > 0) {
+      const int n = freelist().RemoveRange(buf, std::min(B, to_fill));
+      if (n == 0) break;
+      to_fill -= n;
+      int stored;
+      {
+        AllocationGuardSpinLockHolder h(&lock_);
+        info = GetSlotInfo();
+        stored = std::min(n, info.capacity - info.used);
+        memcpy(GetSlot(info.used), buf, sizeof(void *) * stored);
+        info.used += stored;
+        SetSlotInfo(info);
+      }
+      if (stored < n) {
+        // Inserts filled the cache meanwhile.
+        freelist().InsertRange({buf + stored, static_cast<size_t>(n - stored)});
+        break;
+      }
+    }
+  }
   // Returns the number of free objects in the transfer cache.
   size_t tc_length() const {
     return static_cast<size_t>(slot_info_.load(std::memory_order_relaxed).used);
@@ -267,6 +392,11 @@ class TransferCache {
     stats.capacity = info.capacity;
     stats.max_capacity = max_capacity_;
 
+    insert_batch_sizes_.Get(stats.insert_batch_sizes,
+                            stats.insert_partial_batches);
+    remove_batch_sizes_.Get(stats.remove_batch_sizes,
+                            stats.remove_partial_batches);
+
     return stats;
   }
 
@@ -377,6 +507,7 @@ class TransferCache {
   // elements not used for a full cycle (2 seconds) are unlikely to get used
   // again.
   int low_water_mark_ ABSL_GUARDED_BY(lock_);
+  PlunderHistory plunder_history_ ABSL_GUARDED_BY(lock_);
 
   // insert_hits_ and remove_hits_ are logically guarded by lock_ for mutations
   // and use LossyAdd, but the thread annotations cannot indicate that we do not
@@ -400,6 +531,10 @@ class TransferCache {
   // Maximum size of the cache.
   const int32_t max_capacity_;
 
+  // Number of objects the size class moves at a time, or 0 if the cache has
+  // no capacity.
+  const int32_t batch_size_;
+
   // The following 4 *_misses_ counters
   // are frequently updated, so they should reside in a separate cacheline from
   // lock_.
@@ -410,6 +545,450 @@ class TransferCache {
 
   MissCounts insert_object_misses_;
   MissCounts remove_object_misses_;
+  // remove_misses_ as of the previous TryRefill.  Only the background thread
+  // touches it.
+  size_t refill_misses_ = 0;
+
+  BatchSizeCounts insert_batch_sizes_;
+  BatchSizeCounts remove_batch_sizes_;
+} ABSL_CACHELINE_ALIGNED;
+
+// LockFreeTransferCache is an alternative to TransferCache that does not
+// serialize InsertRange() and RemoveRange() on a lock.  Batches are kept in a
+// bounded multi-producer multi-consumer ring of cells, each holding up to
+// num_objects_to_move objects, after Vyukov's bounded queue.  It shares the
+// SizeInfo capacity model with TransferCache, so resizing and plundering work
+// unchanged: an insert first reserves room in slot_info_ and then claims a
+// cell, and a remove releases the room of the cells it takes.
+//
+// Unlike TransferCache, batches are handed out oldest first, and hit counts
+// may lose concurrent increments.
+template <typename CentralFreeList, typename TransferCacheManager>
+class LockFreeTransferCache {
+ public:
+  using Manager = TransferCacheManager;
+  using FreeList = CentralFreeList;
+  using Capacity =
+      typename TransferCache<CentralFreeList, TransferCacheManager>::Capacity;
+
+  LockFreeTransferCache(Manager *owner, int size_class,
+                        bool use_all_buckets_for_few_object_spans)
+      : LockFreeTransferCache(owner, size_class, CapacityNeeded(size_class),
+                              use_all_buckets_for_few_object_spans) {}
+
+  LockFreeTransferCache(Manager *owner, int size_class, Capacity capacity,
+                        bool use_all_buckets_for_few_object_spans)
+      : owner_(owner),
+        max_capacity_(capacity.max_capacity),
+        batch_size_(max_capacity_ != 0
+                        ? Manager::num_objects_to_move(size_class)
+                        : 0),
+        slot_info_(SizeInfo({0, capacity.capacity})),
+        low_water_mark_(0),
+        freelist_do_not_access_directly_() {
+    freelist().Init(size_class, use_all_buckets_for_few_object_spans);
+    if (max_capacity_ == 0) return;
+
+    // Partial batches take a whole cell.  Provision twice as many cells as
+    // there are full batches in max_capacity_, so that the ring rarely runs
+    // out of cells before the capacity runs out.
+    const uint32_t batches = (max_capacity_ + batch_size_ - 1) / batch_size_;
+    const uint32_t num_cells = absl::bit_ceil(2 * batches);
+    mask_ = num_cells - 1;
+    cells_ = reinterpret_cast<Cell *>(owner_->Alloc(num_cells * sizeof(Cell)));
+    slots_ = reinterpret_cast<void **>(
+        owner_->Alloc(num_cells * batch_size_ * sizeof(void *)));
+    for (uint32_t i = 0; i < num_cells; ++i) {
+      new (&cells_[i]) Cell;
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  LockFreeTransferCache(const LockFreeTransferCache &) = delete;
+  LockFreeTransferCache &operator=(const LockFreeTransferCache &) = delete;
+
+  static Capacity CapacityNeeded(size_t size_class) {
+    return TransferCache<CentralFreeList,
+                         TransferCacheManager>::CapacityNeeded(size_class);
+  }
+
+  // Insert the specified batch into the transfer cache.  N is the number of
+  // elements in the range.  RemoveRange() is the opposite operation.
+  void InsertRange(int size_class, absl::Span<void *> batch) {
+    const int N = batch.size();
+    TC_ASSERT(0 < N && N <= kMaxObjectsToMove);
+    insert_batch_sizes_.Record(N, batch_size_);
+    const int reserved = Reserve(N);
+    int got = 0;
+    while (got < reserved) {
+      const int n = std::min(reserved - got, batch_size_);
+      if (!PushCell({batch.data() + got, static_cast<size_t>(n)})) break;
+      got += n;
+    }
+    if (got < reserved) {
+      // The ring ran out of cells before the capacity ran out.
+      Release(reserved - got);
+    }
+    if (got > 0) {
+      insert_hits_.LossyAdd(1);
+      if (got == N) {
+        return;
+      }
+      batch = {batch.data() + got, batch.size() - got};
+    }
+
+    insert_misses_.LossyAdd(1);
+    insert_object_misses_.Inc(batch.size());
+
+    freelist().InsertRange(batch);
+  }
+
+  // Returns the actual number of fetched elements and stores elements in the
+  // batch.
+  ABSL_MUST_USE_RESULT int RemoveRange(int size_class, void **batch, int N) {
+    TC_ASSERT(0 < N && N <= kMaxObjectsToMove);
+    remove_batch_sizes_.Record(N, batch_size_);
+    if (slot_info_.load(std::memory_order_relaxed).used > 0) {
+      const int got = PopRange(batch, N);
+      if (got > 0) {
+        remove_hits_.LossyAdd(1);
+        return got;
+      }
+    }
+
+    remove_misses_.LossyAdd(1);
+    remove_object_misses_.Inc(N);
+    return freelist().RemoveRange(batch, N);
+  }
+
+  // Returns the objects not used over the last plunder_intervals calls to the
+  // freelist, as TransferCache::TryPlunder() does.
+  void TryPlunder(int size_class, int plunder_intervals = 1) {
+    if (max_capacity_ == 0) return;
+    // The plunder history is only touched by one plunder at a time.
+    if (plundering_.exchange(true, std::memory_order_acquire)) return;
+
+    int to_return = plunder_history_.Advance(
+        low_water_mark_.load(std::memory_order_relaxed), plunder_intervals);
+    plunder_history_.Plundered(to_return);
+    low_water_mark_.store(slot_info_.load(std::memory_order_relaxed).used,
+                          std::memory_order_relaxed);
+    void *buf[kMaxObjectsToMove];
+    while (to_return > 0) {
+      const int n = PopRange(buf, std::min(to_return, batch_size_));
+      if (n == 0) break;
+      to_return -= n;
+      freelist().InsertRange({buf, static_cast<size_t>(n)});
+    }
+    plundering_.store(false, std::memory_order_release);
+  }
+
+  // Tops the cache up from the freelist while RemoveRange keeps missing, as
+  // TransferCache::TryRefill() does.  Only the background thread calls this.
+  void TryRefill(int size_class) {
+    if (max_capacity_ == 0) return;
+    const size_t misses = remove_misses_.value();
+    const size_t interval_misses = misses - refill_misses_;
+    refill_misses_ = misses;
+    if (interval_misses < kRefillMinMisses) return;
+
+    const SizeInfo info = GetSlotInfo();
+    if (info.used >= info.capacity / 4) return;
+    int to_fill = std::min<size_t>(info.capacity / 2 - info.used,
+                                   interval_misses * batch_size_);
+    void *buf[kMaxObjectsToMove];
+    while (to_fill > 0) {
+      const int n = freelist().RemoveRange(buf, std::min(batch_size_, to_fill));
+      if (n == 0) break;
+      to_fill -= n;
+      const int reserved = Reserve(n);
+      const int stored =
+          reserved > 0 && PushCell({buf, static_cast<size_t>(reserved)})
+              ? reserved
+              : 0;
+      if (stored < reserved) Release(reserved - stored);
+      if (stored < n) {
+        freelist().InsertRange({buf + stored, static_cast<size_t>(n - stored)});
+        break;
+      }
+    }
+  }
+
+  // Returns the number of free objects in the transfer cache.
+  size_t tc_length() const {
+    return static_cast<size_t>(slot_info_.load(std::memory_order_relaxed).used);
+  }
+
+  // Fetches the misses for the latest interval and commits them to the total.
+  size_t FetchCommitIntervalMisses() {
+    return insert_object_misses_.Commit() + remove_object_misses_.Commit();
+  }
+
+  // Returns the number of transfer cache insert/remove hits/misses.
+  TransferCacheStats GetStats() const {
+    TransferCacheStats stats;
+
+    stats.insert_hits = insert_hits_.value();
+    stats.remove_hits = remove_hits_.value();
+    stats.insert_misses = insert_misses_.value();
+    stats.insert_object_misses = insert_object_misses_.Total();
+    stats.remove_misses = remove_misses_.value();
+    stats.remove_object_misses = remove_object_misses_.Total();
+
+    auto info = slot_info_.load(std::memory_order_relaxed);
+    stats.used = info.used;
+    stats.capacity = info.capacity;
+    stats.max_capacity = max_capacity_;
+
+    insert_batch_sizes_.Get(stats.insert_batch_sizes,
+                            stats.insert_partial_batches);
+    remove_batch_sizes_.Get(stats.remove_batch_sizes,
+                            stats.remove_partial_batches);
+
+    return stats;
+  }
+
+  SizeInfo GetSlotInfo() const {
+    return slot_info_.load(std::memory_order_relaxed);
+  }
+
+  // Increases capacity of the cache by a batch size. Returns true if it
+  // succeeded at growing the cache by a batch size. Else, returns false.
+  bool IncreaseCacheCapacity(int size_class) {
+    const int n = Manager::num_objects_to_move(size_class);
+    SizeInfo info = slot_info_.load(std::memory_order_relaxed);
+    do {
+      if (info.capacity + n > max_capacity_) return false;
+    } while (!slot_info_.compare_exchange_weak(
+        info, SizeInfo({info.used, info.capacity + n}),
+        std::memory_order_relaxed));
+    return true;
+  }
+
+  // Checks if the cache capacity may be increased by a batch size.
+  bool CanIncreaseCapacity(int size_class) const {
+    int n = Manager::num_objects_to_move(size_class);
+    auto info = GetSlotInfo();
+    return max_capacity_ - info.capacity >= n;
+  }
+
+  // Checks if the cache has at least batch size number of free slots. Returns
+  // false if (capacity - used) slots is less than the batch size.
+  bool HasSpareCapacity(int size_class) const {
+    int n = Manager::num_objects_to_move(size_class);
+    auto info = GetSlotInfo();
+    return info.capacity - info.used >= n;
+  }
+
+  // Tries to shrink the Cache by a batch size, returning the oldest objects to
+  // the freelist if there is not enough unused room.  Returns false if it
+  // failed to shrink the cache.
+  bool ShrinkCache(int size_class) {
+    const int N = Manager::num_objects_to_move(size_class);
+    bool evicted = false;
+    SizeInfo info = slot_info_.load(std::memory_order_relaxed);
+    while (true) {
+      if (info.capacity <= N) return false;
+      if (info.capacity - info.used >= N) {
+        if (slot_info_.compare_exchange_weak(
+                info, SizeInfo({info.used, info.capacity - N}),
+                std::memory_order_relaxed)) {
+          return true;
+        }
+        continue;
+      }
+      // Concurrent inserts may take the room we just made.  Give up rather
+      // than competing with them.
+      if (evicted) return false;
+      evicted = true;
+
+      void *to_free[kMaxObjectsToMove];
+      const int n = PopRange(to_free, N - (info.capacity - info.used));
+      if (n == 0) return false;
+      freelist().InsertRange({to_free, static_cast<size_t>(n)});
+      info = slot_info_.load(std::memory_order_relaxed);
+    }
+  }
+
+  ABSL_ATTRIBUTE_ALWAYS_INLINE FreeList &freelist() {
+    return freelist_do_not_access_directly_;
+  }
+
+  int32_t max_capacity() const { return max_capacity_; }
+
+ private:
+  // A cell holds one batch.  A cell at ring position pos is free to be
+  // written when sequence == pos, and holds a batch ready to be read when
+  // sequence == pos + 1.
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    int32_t length;
+  };
+
+  // Returns first object of the batch in the cell at ring position pos.
+  void **GetSlot(uint32_t pos) const {
+    return slots_ + static_cast<size_t>(pos & mask_) * batch_size_;
+  }
+
+  // Reserves room for up to n objects in slot_info_.  Returns the number of
+  // objects reserved.
+  int Reserve(int n) {
+    SizeInfo info = slot_info_.load(std::memory_order_relaxed);
+    while (true) {
+      const int got = std::min(n, info.capacity - info.used);
+      if (got <= 0) return 0;
+      if (slot_info_.compare_exchange_weak(
+              info, SizeInfo({info.used + got, info.capacity}),
+              std::memory_order_relaxed)) {
+        return got;
+      }
+    }
+  }
+
+  // Releases the room of n objects in slot_info_.  Returns the resulting
+  // number of used slots.
+  int Release(int n) {
+    SizeInfo info = slot_info_.load(std::memory_order_relaxed);
+    SizeInfo new_info;
+    do {
+      TC_ASSERT_LE(n, info.used);
+      new_info = {info.used - n, info.capacity};
+    } while (!slot_info_.compare_exchange_weak(info, new_info,
+                                               std::memory_order_relaxed));
+    return new_info.used;
+  }
+
+  // Stores batch in the next free cell.  Returns false if no cell is free.
+  bool PushCell(absl::Span<void *> batch) {
+    TC_ASSERT_GT(batch.size(), 0);
+    TC_ASSERT_LE(batch.size(), static_cast<size_t>(batch_size_));
+    uint32_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      const int32_t diff = static_cast<int32_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->length = batch.size();
+    memcpy(GetSlot(pos), batch.data(), sizeof(void *) * batch.size());
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves the oldest batch into batch, which must have room for batch_size_
+  // objects.  Returns the number of objects moved, or 0 if no batch is ready.
+  int PopCell(void **batch) {
+    uint32_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      const int32_t diff = static_cast<int32_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return 0;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    const int length = cell->length;
+    memcpy(batch, GetSlot(pos), sizeof(void *) * length);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return length;
+  }
+
+  // Moves up to n of the oldest objects into batch.  If the last batch taken
+  // holds more objects than needed, the excess goes back into the ring.
+  int PopRange(void **batch, int n) {
+    void *buf[kMaxObjectsToMove];
+    int got = 0;
+    int spilled = 0;
+    while (got < n) {
+      if (n - got >= batch_size_) {
+        const int popped = PopCell(batch + got);
+        if (popped == 0) break;
+        got += popped;
+        continue;
+      }
+      const int popped = PopCell(buf);
+      if (popped == 0) break;
+      const int take = std::min(popped, n - got);
+      memcpy(batch + got, buf, sizeof(void *) * take);
+      got += take;
+      if (take < popped) {
+        memmove(buf, buf + take, sizeof(void *) * (popped - take));
+        if (!PushCell({buf, static_cast<size_t>(popped - take)})) {
+          spilled = popped - take;
+        }
+      }
+    }
+    if (got + spilled == 0) return 0;
+
+    const int used = Release(got + spilled);
+    if (used < low_water_mark_.load(std::memory_order_relaxed)) {
+      low_water_mark_.store(used, std::memory_order_relaxed);
+    }
+    if (spilled > 0) {
+      freelist().InsertRange({buf, static_cast<size_t>(spilled)});
+    }
+    return got;
+  }
+
+  // The following fields are only written on construction.
+  Manager *const owner_;
+  const int32_t max_capacity_;
+  const int batch_size_;
+  uint32_t mask_ = 0;
+  Cell *cells_ = nullptr;
+  // Pointer to array of num_cells * batch_size_ free objects.  Use GetSlot()
+  // to get pointers to entries.
+  void **slots_ = nullptr;
+
+  // Producers and consumers advance their own position, so keep each on its
+  // own cacheline.
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<uint32_t> enqueue_pos_{0};
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<uint32_t> dequeue_pos_{0};
+
+  // Number of currently used and available cached entries.  used includes
+  // room reserved by inserts that have not yet claimed their cells.
+  // INVARIANT: [0 <= slot_info_.used <= slot_info.capacity <= max_capacity_]
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<SizeInfo> slot_info_;
+
+  // Lowest value of "slot_info_.used" since last call to TryPlunder.
+  std::atomic<int> low_water_mark_;
+  std::atomic<bool> plundering_{false};
+  PlunderHistory plunder_history_;
+
+  // For these we are deliberately fast-and-loose. Some increments may be lost.
+  StatsCounter insert_hits_;
+  StatsCounter remove_hits_;
+  StatsCounter insert_misses_;
+  StatsCounter remove_misses_;
+
+  MissCounts insert_object_misses_;
+  MissCounts remove_object_misses_;
+  // remove_misses_ as of the previous TryRefill.  Only the background thread
+  // touches it.
+  size_t refill_misses_ = 0;
+
+  BatchSizeCounts insert_batch_sizes_;
+  BatchSizeCounts remove_batch_sizes_;
+
+  FreeList freelist_do_not_access_directly_;
 } ABSL_CACHELINE_ALIGNED;
 
 template <typename Manager>
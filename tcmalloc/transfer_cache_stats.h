@@ -20,6 +20,11 @@
 namespace tcmalloc {
 namespace tcmalloc_internal {
 
+// Batch sizes are recorded in power-of-two buckets, indexed by
+// absl::bit_width(batch size) - 1: bucket N counts batches of [2^N, 2^(N+1))
+// objects.  The last bucket holds batches of kMaxObjectsToMove objects.
+inline constexpr size_t kBatchSizeBuckets = 8;
+
 struct TransferCacheStats {
   size_t insert_hits;
   size_t insert_misses;
@@ -30,6 +35,13 @@ struct TransferCacheStats {
   size_t used;
   size_t capacity;
   size_t max_capacity;
+  // Number of InsertRange/RemoveRange calls whose batch size differs from
+  // num_objects_to_move for the size class.
+  size_t insert_partial_batches;
+  size_t remove_partial_batches;
+  // Histograms of InsertRange/RemoveRange batch sizes.
+  size_t insert_batch_sizes[kBatchSizeBuckets];
+  size_t remove_batch_sizes[kBatchSizeBuckets];
 };
 
 }  // namespace tcmalloc_internal
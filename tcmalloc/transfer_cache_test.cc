@@ -24,6 +24,7 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/numeric/bits.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
@@ -173,6 +174,30 @@ TYPED_TEST_P(TransferCacheTest, ReadStats) {
   t2.join();
 }
 
+TYPED_TEST_P(TransferCacheTest, BatchSizeStats) {
+  const int batch_size = TypeParam::kBatchSize;
+  if (batch_size == 1) {
+    GTEST_SKIP() << "skipping trivial batch size";
+  }
+  TypeParam e;
+  const size_t full_bucket = absl::bit_width<unsigned>(batch_size) - 1;
+
+  e.Insert(batch_size);
+  e.Insert(1);
+  e.Insert(1);
+  e.Remove(batch_size);
+  e.Remove(1);
+
+  TransferCacheStats stats = e.transfer_cache().GetStats();
+  EXPECT_EQ(stats.insert_partial_batches, 2);
+  EXPECT_EQ(stats.remove_partial_batches, 1);
+  for (size_t i = 0; i < kBatchSizeBuckets; ++i) {
+    const size_t full = i == full_bucket ? 1 : 0;
+    EXPECT_EQ(stats.insert_batch_sizes[i], full + (i == 0 ? 2 : 0)) << i;
+    EXPECT_EQ(stats.remove_batch_sizes[i], full + (i == 0 ? 1 : 0)) << i;
+  }
+}
+
 TYPED_TEST_P(TransferCacheTest, SingleItemSmoke) {
   const int batch_size = TypeParam::kBatchSize;
   if (batch_size == 1) {
@@ -317,6 +342,61 @@ TYPED_TEST_P(TransferCacheTest, Plunder) {
   EXPECT_EQ(env.transfer_cache().tc_length(), 0);
 }
 
+TYPED_TEST_P(TransferCacheTest, PlunderAfterIntervals) {
+  TypeParam env;
+  constexpr int kIntervals = 3;
+
+  env.Insert(TypeParam::kBatchSize);
+  env.Insert(TypeParam::kBatchSize);
+  // The history starts out empty, so nothing is plundered for the first
+  // kIntervals plunders.
+  for (int i = 0; i < kIntervals; ++i) {
+    env.transfer_cache().TryPlunder(kSizeClass, kIntervals);
+    EXPECT_EQ(env.transfer_cache().tc_length(), 2 * TypeParam::kBatchSize);
+  }
+  // Dipping to one batch plunders the batch that stayed unused. The batch that
+  // was touched stays until it has been idle for kIntervals plunders.
+  void* buf[TypeParam::kBatchSize];
+  (void)env.transfer_cache().RemoveRange(kSizeClass, buf,
+                                         TypeParam::kBatchSize);
+  env.transfer_cache().InsertRange(kSizeClass, {buf, TypeParam::kBatchSize});
+  for (int i = 0; i < kIntervals; ++i) {
+    env.transfer_cache().TryPlunder(kSizeClass, kIntervals);
+    EXPECT_EQ(env.transfer_cache().tc_length(), TypeParam::kBatchSize);
+  }
+  // Once the dip has aged out, the remaining batch is plundered too.
+  env.transfer_cache().TryPlunder(kSizeClass, kIntervals);
+  EXPECT_EQ(env.transfer_cache().tc_length(), 0);
+}
+
+TYPED_TEST_P(TransferCacheTest, Refill) {
+  const int batch_size = TypeParam::kBatchSize;
+  TypeParam env;
+
+  // Without misses there is nothing to refill.
+  env.transfer_cache().TryRefill(kSizeClass);
+  EXPECT_EQ(env.transfer_cache().tc_length(), 0);
+
+  for (int i = 0; i < internal_transfer_cache::kRefillMinMisses; ++i) {
+    env.Remove(batch_size);
+  }
+  env.transfer_cache().TryRefill(kSizeClass);
+  const size_t refilled = env.transfer_cache().tc_length();
+  EXPECT_GT(refilled, 0);
+  EXPECT_LE(refilled, internal_transfer_cache::kRefillMinMisses * batch_size);
+  EXPECT_LE(refilled, env.transfer_cache().GetStats().capacity / 2);
+  // Refills are not inserts.
+  EXPECT_EQ(env.transfer_cache().GetStats().insert_hits, 0);
+
+  // The misses were counted once, so the next call leaves the cache alone.
+  env.transfer_cache().TryRefill(kSizeClass);
+  EXPECT_EQ(env.transfer_cache().tc_length(), refilled);
+
+  // The refilled objects serve the next removes.
+  env.Remove(batch_size);
+  EXPECT_EQ(env.transfer_cache().GetStats().remove_hits, 1);
+}
+
 // PickCoprimeBatchSize picks a batch size in [2, max_batch_size) that is
 // coprime with 2^32.  We choose the largest possible batch size within that
 // constraint to minimize the number of iterations of insert/remove required.
@@ -411,7 +491,8 @@ TYPED_TEST_P(TransferCacheTest, b172283201) {
 REGISTER_TYPED_TEST_SUITE_P(TransferCacheTest, IsolatedSmoke, ReadStats,
                             FetchesFromFreelist, PartialFetchFromFreelist,
                             PushesToFreelist, WrappingWorks, SingleItemSmoke,
-                            Plunder, b172283201);
+                            BatchSizeStats, Plunder,
+                            PlunderAfterIntervals, Refill, b172283201);
 
 template <typename Env>
 using FuzzTest = ::testing::Test;
@@ -662,12 +743,178 @@ TEST(ShardedTransferCacheManagerTest, ShardsOnDemand) {
   }
 }
 
+TEST(ShardedTransferCacheManagerTest, ResizeKeepsShardCapacity) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  using ShardedManager = FakeShardedTransferCacheEnvironment::ShardedManager;
+  constexpr int kNumShards = ShardedManager::kMinShardsAllowed;
+  FakeShardedTransferCacheEnvironment env(kNumShards,
+                                          /*use_generic_cache=*/true);
+  ShardedManager& manager = env.sharded_manager();
+
+  // Resizing before any shard is initialized is a no-op.
+  manager.TryResizingCaches();
+  EXPECT_FALSE(manager.shard_initialized(0));
+
+  void* ptr;
+  env.central_freelist().AllocateBatch(&ptr, 1);
+  env.SetCurrentCpu(0);
+  manager.Push(kSizeClass, ptr);
+  ASSERT_TRUE(manager.shard_initialized(0));
+  const TransferCacheStats before = manager.GetStats(kSizeClass);
+  EXPECT_GT(before.capacity, 0);
+
+  // Miss in the only size class with capacity.  Without another class of the
+  // shard to take capacity from, resizing must not change it, and must not
+  // initialize other shards.
+  for (int i = 0; i < 4; ++i) {
+    void* p = manager.Pop(kSizeClass);
+    ASSERT_NE(p, nullptr);
+    env.central_freelist().FreeBatch({&p, 1});
+  }
+  manager.TryResizingCaches();
+  EXPECT_EQ(manager.GetStats(kSizeClass).capacity, before.capacity);
+  EXPECT_EQ(manager.GetStats(kSizeClass).max_capacity, before.max_capacity);
+  EXPECT_FALSE(manager.shard_initialized(1));
+  EXPECT_FALSE(manager.shard_initialized(2));
+}
+
+TEST(ShardedTransferCacheManagerTest, OriginAffinity) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  using ShardedManager = FakeShardedTransferCacheEnvironment::ShardedManager;
+  constexpr int kNumShards = ShardedManager::kMinShardsAllowed;
+  for (bool affinity : {false, true}) {
+    FakeShardedTransferCacheManager::SetOriginAffinity(affinity);
+    FakeShardedTransferCacheEnvironment env(kNumShards,
+                                            /*use_generic_cache=*/true);
+    ShardedManager& manager = env.sharded_manager();
+
+    // Allocate on cpu 0/shard 0 and free on cpu 2/shard 1, as a producer and
+    // a consumer passing messages would.
+    env.SetCurrentCpu(0);
+    void* ptr = manager.Pop(kSizeClass);
+    ASSERT_NE(ptr, nullptr);
+    env.SetCurrentCpu(2);
+    manager.Push(kSizeClass, ptr);
+    if (affinity) {
+      EXPECT_EQ(manager.tc_length(0, kSizeClass), 1);
+      EXPECT_EQ(manager.tc_length(2, kSizeClass), 0);
+      EXPECT_EQ(manager.origin_handoffs(), 1);
+    } else {
+      EXPECT_EQ(manager.tc_length(0, kSizeClass), 0);
+      EXPECT_EQ(manager.tc_length(2, kSizeClass), 1);
+      EXPECT_EQ(manager.origin_handoffs(), 0);
+    }
+  }
+  FakeShardedTransferCacheManager::SetOriginAffinity(false);
+}
+
+TEST(ShardedTransferCacheManagerTest, ColdTier) {
+  if (!subtle::percpu::IsFast() || !kHasExpandedClasses) {
+    return;
+  }
+
+  // Two shards are too few for the generic cache, but not for the cold tier.
+  using ShardedManager = FakeShardedTransferCacheEnvironment::ShardedManager;
+  constexpr int kNumShards = ShardedManager::kMinShardsAllowed - 1;
+  TC_ASSERT_GT(kNumShards, 1);
+  FakeShardedTransferCacheManager::SetColdTier(true);
+  {
+    FakeShardedTransferCacheEnvironment env(kNumShards,
+                                            /*use_generic_cache=*/true);
+    ShardedManager& manager = env.sharded_manager();
+    EXPECT_FALSE(manager.should_use(kSizeClass));
+    EXPECT_FALSE(manager.is_cold_tier(kSizeClass));
+    EXPECT_TRUE(manager.should_use(kColdSizeClass));
+    EXPECT_TRUE(manager.is_cold_tier(kColdSizeClass));
+    EXPECT_EQ(manager.NumColdTierClasses(), 1);
+
+    void* ptr;
+    env.central_freelist().AllocateBatch(&ptr, 1);
+    env.SetCurrentCpu(0);
+    manager.Push(kColdSizeClass, ptr);
+    EXPECT_EQ(manager.tc_length(0, kColdSizeClass), 1);
+    EXPECT_EQ(manager.tc_length(2, kColdSizeClass), 0);
+
+    // Two batches fit, and resizing leaves the capacity where it is.
+    const TransferCacheStats stats = manager.GetStats(kColdSizeClass);
+    EXPECT_EQ(stats.capacity, 2 * kNumToMove);
+    EXPECT_EQ(stats.max_capacity, 2 * kNumToMove);
+    manager.TryResizingCaches();
+    EXPECT_EQ(manager.GetStats(kColdSizeClass).capacity, stats.capacity);
+
+    EXPECT_EQ(manager.Pop(kColdSizeClass), ptr);
+    env.central_freelist().FreeBatch({&ptr, 1});
+  }
+  FakeShardedTransferCacheManager::SetColdTier(false);
+
+  FakeShardedTransferCacheEnvironment env(kNumShards,
+                                          /*use_generic_cache=*/true);
+  EXPECT_FALSE(env.sharded_manager().should_use(kColdSizeClass));
+  EXPECT_EQ(env.sharded_manager().NumColdTierClasses(), 0);
+}
+
+TEST(ShardedTransferCacheManagerTest, RebalanceMovesSurplus) {
+  if (!subtle::percpu::IsFast()) {
+    return;
+  }
+
+  using ShardedManager = FakeShardedTransferCacheEnvironment::ShardedManager;
+  constexpr int kNumShards = ShardedManager::kMinShardsAllowed;
+  FakeShardedTransferCacheEnvironment env(kNumShards,
+                                          /*use_generic_cache=*/true);
+  ShardedManager& manager = env.sharded_manager();
+
+  // Shard 1 (cpu 2) misses, which pulls objects from the central freelist.
+  constexpr int kMisses = 5;
+  env.SetCurrentCpu(2);
+  for (int i = 0; i < kMisses; ++i) {
+    void* ptr = manager.Pop(kSizeClass);
+    ASSERT_NE(ptr, nullptr);
+    env.central_freelist().FreeBatch({&ptr, 1});
+  }
+  EXPECT_EQ(manager.tc_length(2, kSizeClass), 0);
+
+  // Shard 0 (cpu 0) only frees.
+  constexpr int kFrees = 2 * kMisses;
+  env.SetCurrentCpu(0);
+  for (int i = 0; i < kFrees; ++i) {
+    void* ptr;
+    env.central_freelist().AllocateBatch(&ptr, 1);
+    manager.Push(kSizeClass, ptr);
+  }
+  ASSERT_EQ(manager.tc_length(0, kSizeClass), kFrees);
+
+  // The surplus of shard 0 covers the misses of shard 1.
+  manager.Rebalance();
+  EXPECT_EQ(manager.tc_length(0, kSizeClass), kFrees - kMisses);
+  EXPECT_EQ(manager.tc_length(2, kSizeClass), kMisses);
+  EXPECT_EQ(manager.rebalanced_objects(), kMisses);
+  EXPECT_EQ(manager.TotalObjectsOfClass(kSizeClass), kFrees);
+
+  // Without new misses, there is nothing more to move.
+  manager.Rebalance();
+  EXPECT_EQ(manager.tc_length(2, kSizeClass), kMisses);
+  EXPECT_EQ(manager.rebalanced_objects(), kMisses);
+}
+
 namespace unit_tests {
 using Env = FakeTransferCacheEnvironment<internal_transfer_cache::TransferCache<
     MockCentralFreeList, FakeTransferCacheManager>>;
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferCache, TransferCacheTest,
                                ::testing::Types<Env>);
 
+using LockFreeEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::LockFreeTransferCache<
+        MockCentralFreeList, FakeTransferCacheManager>>;
+INSTANTIATE_TYPED_TEST_SUITE_P(LockFreeTransferCache, TransferCacheTest,
+                               ::testing::Types<LockFreeEnv>);
+
 }  // namespace unit_tests
 
 namespace fuzz_tests {
@@ -678,6 +925,12 @@ using Env = FakeTransferCacheEnvironment<internal_transfer_cache::TransferCache<
     MockCentralFreeList, FakeTransferCacheManager>>;
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferCache, FuzzTest, ::testing::Types<Env>);
 
+using LockFreeEnv =
+    FakeTransferCacheEnvironment<internal_transfer_cache::LockFreeTransferCache<
+        MockCentralFreeList, FakeTransferCacheManager>>;
+INSTANTIATE_TYPED_TEST_SUITE_P(LockFreeTransferCache, FuzzTest,
+                               ::testing::Types<LockFreeEnv>);
+
 }  // namespace fuzz_tests
 
 namespace resize_tests {
@@ -808,6 +1061,12 @@ using TransferCacheRealEnv = MultiSizeClassTransferCacheEnvironment<
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferCache, RealTransferCacheTest,
                                ::testing::Types<TransferCacheRealEnv>);
 
+using LockFreeTransferCacheRealEnv = MultiSizeClassTransferCacheEnvironment<
+    internal_transfer_cache::LockFreeTransferCache<
+        CentralFreeList, FakeMultiClassLockFreeTransferCacheManager>>;
+INSTANTIATE_TYPED_TEST_SUITE_P(LockFreeTransferCache, RealTransferCacheTest,
+                               ::testing::Types<LockFreeTransferCacheRealEnv>);
+
 }  // namespace resize_tests
 
 }  // namespace
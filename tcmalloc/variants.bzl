@@ -36,6 +36,10 @@ build_variants = [
         "name": "small_but_slow",
         "copts": ["-DTCMALLOC_INTERNAL_SMALL_BUT_SLOW"],
     },
+    {
+        "name": "small_footprint",
+        "copts": ["-DTCMALLOC_INTERNAL_SMALL_FOOTPRINT"],
+    },
     {
         "name": "numa_aware",
         "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_NUMA_AWARE"],
@@ -44,6 +48,22 @@ build_variants = [
         "name": "256k_pages_numa_aware",
         "copts": ["-DTCMALLOC_INTERNAL_256K_PAGES", "-DTCMALLOC_INTERNAL_NUMA_AWARE"],
     },
+    {
+        "name": "numa_aware_4_partitions",
+        "copts": [
+            "-DTCMALLOC_INTERNAL_8K_PAGES",
+            "-DTCMALLOC_INTERNAL_NUMA_AWARE",
+            "-DTCMALLOC_INTERNAL_NUMA_PARTITIONS=4",
+        ],
+    },
+    {
+        "name": "size_class_tags",
+        "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_SIZE_CLASS_TAGS"],
+    },
+    {
+        "name": "pow2_size_classes",
+        "copts": ["-DTCMALLOC_INTERNAL_8K_PAGES", "-DTCMALLOC_INTERNAL_POW2_SIZE_CLASSES"],
+    },
 ]
 
 test_variants = [
@@ -73,6 +93,12 @@ test_variants = [
         "deps": ["//tcmalloc:common_small_but_slow"],
         "copts": ["-DTCMALLOC_INTERNAL_SMALL_BUT_SLOW"],
     },
+    {
+        "name": "small_footprint",
+        "malloc": "//tcmalloc:tcmalloc_small_footprint",
+        "deps": ["//tcmalloc:common_small_footprint"],
+        "copts": ["-DTCMALLOC_INTERNAL_SMALL_FOOTPRINT"],
+    },
     {
         "name": "256k_pages_pow2",
         "malloc": "//tcmalloc:tcmalloc_256k_pages",
@@ -128,6 +154,26 @@ test_variants = [
         ],
         "copts": ["-DTCMALLOC_INTERNAL_256K_PAGES", "-DTCMALLOC_INTERNAL_NUMA_AWARE"],
     },
+    {
+        "name": "numa_aware_4_partitions",
+        "malloc": "//tcmalloc:tcmalloc_numa_aware_4_partitions",
+        "deps": [
+            "//tcmalloc:common_numa_aware_4_partitions",
+            "//tcmalloc:want_numa_aware",
+        ],
+        "copts": [
+            "-DTCMALLOC_INTERNAL_NUMA_AWARE",
+            "-DTCMALLOC_INTERNAL_NUMA_PARTITIONS=4",
+        ],
+    },
+    {
+        "name": "size_class_tags",
+        "malloc": "//tcmalloc:tcmalloc_size_class_tags",
+        "deps": [
+            "//tcmalloc:common_size_class_tags",
+        ],
+        "copts": ["-DTCMALLOC_INTERNAL_SIZE_CLASS_TAGS"],
+    },
     {
         "name": "256k_pages_pow2_sharded_transfer_cache",
         "malloc": "//tcmalloc:tcmalloc_256k_pages",
@@ -158,6 +204,90 @@ test_variants = [
         "deps": ["//tcmalloc:common_8k_pages"],
         "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_HUGE_CACHE_RELEASE_30S"},
     },
+    {
+        "name": "lock_free_transfer_cache",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_LOCK_FREE_TRANSFER_CACHE"},
+    },
+    {
+        "name": "sharded_transfer_cache_affinity",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_SHARDED_TRANSFER_CACHE_AFFINITY"},
+    },
+    {
+        "name": "cpu_local_spans",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_CPU_LOCAL_SPANS"},
+    },
+    {
+        "name": "sharded_cold_classes",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_SHARDED_COLD_CLASSES"},
+    },
+    {
+        "name": "split_central_freelist",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_SPLIT_CENTRAL_FREELIST"},
+    },
+    {
+        "name": "span_bitmap_lifo",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_SPAN_BITMAP_LIFO"},
+    },
+    {
+        "name": "deferred_span_returns",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_DEFERRED_SPAN_RETURNS"},
+    },
+    {
+        "name": "huge_cache_demand_forecast",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_HUGE_CACHE_DEMAND_FORECAST"},
+    },
+    {
+        "name": "flat_sizeclass_map",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_FLAT_SIZECLASS_MAP"},
+    },
+    {
+        "name": "adaptive_span_sizes",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_ADAPTIVE_SPAN_SIZES"},
+    },
+    {
+        "name": "huge_allocator_best_fit",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_HUGE_ALLOCATOR_BEST_FIT"},
+    },
+    {
+        "name": "huge_region_subrelease",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_HUGE_REGION_SUBRELEASE"},
+    },
+    {
+        "name": "large_span_cache",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_TCMALLOC_LARGE_SPAN_CACHE"},
+    },
+    {
+        "name": "l3_capacity_pools",
+        "malloc": "//tcmalloc",
+        "deps": ["//tcmalloc:common_8k_pages"],
+        "env": {"BORG_EXPERIMENTS": "TEST_ONLY_L3_AWARE"},
+    },
     {
         "name": "small_but_slow_no_hpaa",
         "malloc": "//tcmalloc:tcmalloc_small_but_slow",
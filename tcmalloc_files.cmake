@@ -1,4 +1,8 @@
 set(TCMALLOC_FILES
+    ./tcmalloc/allocation_event_tracer.cc
+    ./tcmalloc/allocation_event_tracer.h
+    ./tcmalloc/allocation_rate_tracker.cc
+    ./tcmalloc/allocation_rate_tracker.h
     ./tcmalloc/allocation_sample.cc
     ./tcmalloc/allocation_sample.h
     ./tcmalloc/allocation_sampling.cc
@@ -6,6 +10,9 @@ set(TCMALLOC_FILES
     ./tcmalloc/arena.cc
     ./tcmalloc/arena.h
     ./tcmalloc/background.cc
+    ./tcmalloc/background_scheduler.h
+    ./tcmalloc/bulk_heap.cc
+    ./tcmalloc/bulk_heap.h
     ./tcmalloc/central_freelist.cc
     ./tcmalloc/central_freelist.h
     ./tcmalloc/common.cc
@@ -14,11 +21,16 @@ set(TCMALLOC_FILES
     ./tcmalloc/cpu_cache.h
     ./tcmalloc/deallocation_profiler.cc
     ./tcmalloc/deallocation_profiler.h
+    ./tcmalloc/emergency_reserve.cc
+    ./tcmalloc/emergency_reserve.h
     ./tcmalloc/experimental_pow2_size_class.cc
     ./tcmalloc/experiment.cc
     ./tcmalloc/experiment_config.h
     ./tcmalloc/experiment.h
+    ./tcmalloc/experiment_counters.cc
+    ./tcmalloc/experiment_counters.h
     ./tcmalloc/fewer_size_classes.cc
+    ./tcmalloc/freed_sample_log.h
     ./tcmalloc/global_stats.cc
     ./tcmalloc/global_stats.h
     ./tcmalloc/guarded_allocations.h
@@ -31,14 +43,21 @@ set(TCMALLOC_FILES
     ./tcmalloc/huge_allocator.h
     ./tcmalloc/huge_cache.cc
     ./tcmalloc/huge_cache.h
+    ./tcmalloc/huge_cache_budget.cc
+    ./tcmalloc/huge_cache_budget.h
     ./tcmalloc/huge_page_aware_allocator.cc
     ./tcmalloc/huge_page_aware_allocator.h
     ./tcmalloc/huge_page_filler.h
     ./tcmalloc/huge_pages.h
     ./tcmalloc/huge_page_subrelease.h
     ./tcmalloc/huge_region.h
+    ./tcmalloc/inline_fast_path.h
     ./tcmalloc/internal_malloc_extension.h
     ./tcmalloc/internal_malloc_tracing_extension.h
+    ./tcmalloc/io_buffer_pool.cc
+    ./tcmalloc/io_buffer_pool.h
+    ./tcmalloc/large_span_cache.cc
+    ./tcmalloc/large_span_cache.h
     ./tcmalloc/legacy_size_classes.cc
     ./tcmalloc/libc_override.h
     ./tcmalloc/lowfrag_size_classes.cc
@@ -56,6 +75,10 @@ set(TCMALLOC_FILES
     ./tcmalloc/page_heap_allocator.h
     ./tcmalloc/page_heap.cc
     ./tcmalloc/page_heap.h
+    ./tcmalloc/page_heap_trace.cc
+    ./tcmalloc/page_heap_trace.h
+    ./tcmalloc/pageheap_lock_profiler.cc
+    ./tcmalloc/pageheap_lock_profiler.h
     ./tcmalloc/pagemap.cc
     ./tcmalloc/pagemap.h
     ./tcmalloc/pages.h
@@ -64,18 +87,30 @@ set(TCMALLOC_FILES
     ./tcmalloc/peak_heap_tracker.cc
     ./tcmalloc/peak_heap_tracker.h
     ./tcmalloc/profile_marshaler.h
+    ./tcmalloc/release_queue.h
     ./tcmalloc/sampled_allocation_allocator.h
     ./tcmalloc/sampler.cc
     ./tcmalloc/sampler.h
     ./tcmalloc/segv_handler.cc
     ./tcmalloc/segv_handler.h
+    ./tcmalloc/shared_memory_region_factory.cc
+    ./tcmalloc/shared_memory_region_factory.h
+    ./tcmalloc/sized_allocator.h
     ./tcmalloc/size_classes.cc
     ./tcmalloc/size_class_info.h
+    ./tcmalloc/size_class_lifetimes.h
+    ./tcmalloc/size_class_tags.cc
+    ./tcmalloc/size_class_tags.h
     ./tcmalloc/sizemap.cc
     ./tcmalloc/sizemap.h
+    ./tcmalloc/slow_path_latency.cc
+    ./tcmalloc/slow_path_latency.h
     ./tcmalloc/span.cc
     ./tcmalloc/span.h
+    ./tcmalloc/span_recycler.cc
+    ./tcmalloc/span_recycler.h
     ./tcmalloc/span_stats.h
+    ./tcmalloc/stack_trace_store.h
     ./tcmalloc/stack_trace_table.cc
     ./tcmalloc/stack_trace_table.h
     ./tcmalloc/static_vars.cc
@@ -89,6 +124,8 @@ set(TCMALLOC_FILES
     ./tcmalloc/tcmalloc_policy.h
     ./tcmalloc/thread_cache.cc
     ./tcmalloc/thread_cache.h
+    ./tcmalloc/thread_magazine.cc
+    ./tcmalloc/thread_magazine.h
     ./tcmalloc/transfer_cache.cc
     ./tcmalloc/transfer_cache.h
     ./tcmalloc/transfer_cache_internals.h
@@ -105,28 +142,40 @@ set(TCMALLOC_FILES
 
 
 set(TCMALLOC_TEST_FILES
+    ./tcmalloc/allocation_rate_tracker_test.cc
     ./tcmalloc/allocation_sample_test.cc
     ./tcmalloc/arena_test.cc
+    ./tcmalloc/background_scheduler_test.cc
+    ./tcmalloc/bulk_heap_test.cc
     ./tcmalloc/central_freelist_benchmark.cc
     ./tcmalloc/central_freelist_fuzz.cc
     ./tcmalloc/central_freelist_test.cc
     ./tcmalloc/cpu_cache_activate_test.cc
+    ./tcmalloc/cpu_cache_late_activation_test.cc
     ./tcmalloc/cpu_cache_test.cc
+    ./tcmalloc/custom_size_classes_test.cc
     ./tcmalloc/experiment_config_test.cc
     ./tcmalloc/experiment_fuzz.cc
+    ./tcmalloc/freed_sample_log_test.cc
     ./tcmalloc/guarded_page_allocator_benchmark.cc
     ./tcmalloc/guarded_page_allocator_profile_test.cc
     ./tcmalloc/guarded_page_allocator_test.cc
     ./tcmalloc/huge_address_map_test.cc
+    ./tcmalloc/huge_allocator_benchmark.cc
     ./tcmalloc/huge_allocator_test.cc
+    ./tcmalloc/huge_cache_budget_test.cc
     ./tcmalloc/huge_cache_test.cc
     ./tcmalloc/huge_page_aware_allocator_fuzz.cc
     ./tcmalloc/huge_page_aware_allocator_test.cc
+    ./tcmalloc/huge_page_filler_benchmark.cc
     ./tcmalloc/huge_page_filler_fuzz.cc
     ./tcmalloc/huge_page_filler_test.cc
     ./tcmalloc/huge_page_subrelease_test.cc
     ./tcmalloc/huge_region_fuzz.cc
     ./tcmalloc/huge_region_test.cc
+    ./tcmalloc/inline_fast_path_benchmark.cc
+    ./tcmalloc/inline_fast_path_test.cc
+    ./tcmalloc/large_span_cache_test.cc
     ./tcmalloc/malloc_extension_fuzz.cc
     ./tcmalloc/mock_central_freelist.cc
     ./tcmalloc/mock_central_freelist.h
@@ -140,23 +189,41 @@ set(TCMALLOC_TEST_FILES
     ./tcmalloc/new_extension_test.cc
     ./tcmalloc/page_allocator_test.cc
     ./tcmalloc/page_allocator_test_util.h
+    ./tcmalloc/page_heap_benchmark.cc
     ./tcmalloc/page_heap_test.cc
+    ./tcmalloc/page_heap_trace_replay.cc
+    ./tcmalloc/page_heap_trace_replay.h
+    ./tcmalloc/page_heap_trace_replay_main.cc
+    ./tcmalloc/page_heap_trace_test.cc
     ./tcmalloc/pagemap_test.cc
     ./tcmalloc/pages_test.cc
+    ./tcmalloc/pow2_size_classes_test.cc
     ./tcmalloc/profile_marshaler.cc
     ./tcmalloc/profile_marshaler_test.cc
     ./tcmalloc/profile_test.cc
+    ./tcmalloc/release_queue_test.cc
     ./tcmalloc/sampled_allocation_allocator_test.cc
+    ./tcmalloc/sampler_benchmark.cc
     ./tcmalloc/segv_handler_test.cc
+    ./tcmalloc/size_class_benchmark.cc
+    ./tcmalloc/size_class_generator.cc
+    ./tcmalloc/size_class_generator.h
+    ./tcmalloc/size_class_generator_main.cc
+    ./tcmalloc/size_class_generator_test.cc
+    ./tcmalloc/size_class_lifetimes_test.cc
     ./tcmalloc/size_classes_test.cc
     ./tcmalloc/sizemap_fuzz.cc
     ./tcmalloc/sizemap_test.cc
     ./tcmalloc/span_benchmark.cc
     ./tcmalloc/span_fuzz.cc
+    ./tcmalloc/slow_path_latency_test.cc
+    ./tcmalloc/span_recycler_test.cc
     ./tcmalloc/span_test.cc
+    ./tcmalloc/stack_trace_store_test.cc
     ./tcmalloc/stack_trace_table_test.cc
     ./tcmalloc/stats_test.cc
     ./tcmalloc/thread_cache_test.cc
+    ./tcmalloc/thread_magazine_test.cc
     ./tcmalloc/transfer_cache_benchmark.cc
     ./tcmalloc/transfer_cache_fuzz.cc
     ./tcmalloc/transfer_cache_test.cc
@@ -173,6 +240,8 @@ set(TCMALLOC_INTERNAL_FILES
     ./tcmalloc/internal/atomic_stats_counter.h
     ./tcmalloc/internal/cache_topology.cc
     ./tcmalloc/internal/cache_topology.h
+    ./tcmalloc/internal/cgroup.cc
+    ./tcmalloc/internal/cgroup.h
     ./tcmalloc/internal/clock.h
     ./tcmalloc/internal/config.h
     ./tcmalloc/internal/declarations.h
@@ -181,10 +250,14 @@ set(TCMALLOC_INTERNAL_FILES
     ./tcmalloc/internal/explicitly_constructed.h
     ./tcmalloc/internal/exponential_biased.h
     ./tcmalloc/internal/fake_profile.h
+    ./tcmalloc/internal/frame_pointer_unwinder.cc
+    ./tcmalloc/internal/frame_pointer_unwinder.h
     ./tcmalloc/internal/linked_list.h
     ./tcmalloc/internal/linux_syscall_support.h
     ./tcmalloc/internal/logging.cc
     ./tcmalloc/internal/logging.h
+    ./tcmalloc/internal/memory_pressure.cc
+    ./tcmalloc/internal/memory_pressure.h
     ./tcmalloc/internal/memory_stats.cc
     ./tcmalloc/internal/memory_stats.h
     ./tcmalloc/internal/mincore.cc
@@ -208,6 +281,8 @@ set(TCMALLOC_INTERNAL_FILES
     ./tcmalloc/internal/proc_maps.h
     ./tcmalloc/internal/profile_builder.h
     ./tcmalloc/internal/range_tracker.h
+    ./tcmalloc/internal/release_rate_controller.cc
+    ./tcmalloc/internal/release_rate_controller.h
     ./tcmalloc/internal/residency.cc
     ./tcmalloc/internal/residency.h
     ./tcmalloc/internal/sampled_allocation.h
@@ -225,13 +300,16 @@ set(TCMALLOC_INTERNAL_TEST_FILES
     ./tcmalloc/internal/affinity_test.cc
     ./tcmalloc/internal/allocation_guard_test.cc
     ./tcmalloc/internal/cache_topology_test.cc
+    ./tcmalloc/internal/cgroup_test.cc
     ./tcmalloc/internal/config_test.cc
     ./tcmalloc/internal/environment_test.cc
     ./tcmalloc/internal/exponential_biased_test.cc
+    ./tcmalloc/internal/frame_pointer_unwinder_test.cc
     ./tcmalloc/internal/linked_list_benchmark.cc
     ./tcmalloc/internal/linked_list_test.cc
     ./tcmalloc/internal/logging_test.cc
     ./tcmalloc/internal/logging_test_helper.cc
+    ./tcmalloc/internal/memory_pressure_test.cc
     ./tcmalloc/internal/memory_stats_test.cc
     ./tcmalloc/internal/mincore_benchmark.cc
     ./tcmalloc/internal/mincore_test.cc
@@ -246,6 +324,7 @@ set(TCMALLOC_INTERNAL_TEST_FILES
     ./tcmalloc/internal/profile_builder_test.cc
     ./tcmalloc/internal/range_tracker_benchmark.cc
     ./tcmalloc/internal/range_tracker_test.cc
+    ./tcmalloc/internal/release_rate_controller_test.cc
     ./tcmalloc/internal/residency_test.cc
     ./tcmalloc/internal/sampled_allocation_recorder_test.cc
     ./tcmalloc/internal/sampled_allocation_test.cc
@@ -264,13 +343,23 @@ set(TCMALLOC_TESTING_FILES
     ./tcmalloc/testing/deallocation_profiler_test.cc
     ./tcmalloc/testing/default_parameters_test.cc
     ./tcmalloc/testing/disable_numa_test.cc
+    ./tcmalloc/testing/empirical_driver.cc
+    ./tcmalloc/testing/empirical_driver.h
+    ./tcmalloc/testing/empirical_driver_main.cc
+    ./tcmalloc/testing/empirical_driver_test.cc
+    ./tcmalloc/testing/experiment_comparison_benchmark.cc
+    ./tcmalloc/testing/footprint_benchmark.cc
+    ./tcmalloc/testing/fork_test.cc
     ./tcmalloc/testing/frag_test.cc
     ./tcmalloc/testing/get_stats_test.cc
     ./tcmalloc/testing/heap_profiling_test.cc
     ./tcmalloc/testing/hello_main.cc
     ./tcmalloc/testing/large_alloc_size_test.cc
     ./tcmalloc/testing/largesmall_frag_test.cc
+    ./tcmalloc/testing/latency_histogram.h
+    ./tcmalloc/testing/latency_histogram_test.cc
     ./tcmalloc/testing/limit_test.cc
+    ./tcmalloc/testing/lock_contention_profile_test.cc
     ./tcmalloc/testing/malloc_extension_system_malloc_test.cc
     ./tcmalloc/testing/malloc_extension_test.cc
     ./tcmalloc/testing/malloc_tracing_extension_test.cc
@@ -288,12 +377,22 @@ set(TCMALLOC_TESTING_FILES
     ./tcmalloc/testing/realloc_test.cc
     ./tcmalloc/testing/reclaim_test.cc
     ./tcmalloc/testing/releasing_test.cc
+    ./tcmalloc/testing/reserve_address_space_test.cc
+    ./tcmalloc/testing/rseq_vcpu_test.cc
     ./tcmalloc/testing/sampler_test.cc
     ./tcmalloc/testing/sample_size_class_test.cc
     ./tcmalloc/testing/sampling_memusage_test.cc
     ./tcmalloc/testing/sampling_test.cc
+    ./tcmalloc/testing/shared_memory_region_factory_test.cc
+    ./tcmalloc/testing/size_class_tradeoff_benchmark.cc
+    ./tcmalloc/testing/sized_allocator_benchmark.cc
+    ./tcmalloc/testing/sized_allocator_test.cc
+    ./tcmalloc/testing/slow_path_scaling_benchmark.cc
+    ./tcmalloc/testing/startup_benchmark.cc
+    ./tcmalloc/testing/startup_size_benchmark.cc
     ./tcmalloc/testing/startup_size_test.cc
     ./tcmalloc/testing/system-alloc_test.cc
+    ./tcmalloc/testing/tail_latency_benchmark.cc
     ./tcmalloc/testing/tcmalloc_benchmark.cc
     ./tcmalloc/testing/tcmalloc_large_test.cc
     ./tcmalloc/testing/tcmalloc_test.cc
@@ -309,4 +408,5 @@ set(TCMALLOC_TESTING_FILES
     ./tcmalloc/testing/want_disable_huge_region_more_often_test_helper.cc
     ./tcmalloc/testing/want_disable_separate_allocs_for_few_and_many_objects_spans_test_helper.cc
     ./tcmalloc/testing/want_hpaa_test_helper.cc
+    ./tcmalloc/testing/warm_tier_test.cc
 )